@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+use criterion::{criterion_group, criterion_main, Criterion, Throughput};
+use pushpin::connmgr::counter::{Counter, ShardedCounter};
+use std::thread;
+
+const OPS_PER_THREAD: usize = 100_000;
+
+// each thread repeatedly takes and returns an amount, like connections
+// acquiring and releasing buffer blocks
+fn contend<D, I>(threads: usize, dec: D, inc: I)
+where
+    D: Fn(usize) -> bool + Sync,
+    I: Fn(usize) + Sync,
+{
+    thread::scope(|s| {
+        for _ in 0..threads {
+            s.spawn(|| {
+                for _ in 0..OPS_PER_THREAD {
+                    if dec(2) {
+                        inc(2);
+                    }
+                }
+            });
+        }
+    });
+}
+
+fn criterion_benchmark(c: &mut Criterion) {
+    let mut group = c.benchmark_group("counter");
+
+    for threads in [1, 4, 8, 16] {
+        group.throughput(Throughput::Elements((threads * OPS_PER_THREAD) as u64));
+
+        group.bench_function(format!("single threads={}", threads), |b| {
+            let counter = Counter::new(threads * 1000);
+
+            b.iter(|| {
+                contend(
+                    threads,
+                    |amount| counter.dec(amount).is_ok(),
+                    |amount| counter.inc(amount).unwrap(),
+                )
+            })
+        });
+
+        group.bench_function(format!("sharded threads={}", threads), |b| {
+            let counter = ShardedCounter::new(threads * 1000, threads);
+
+            b.iter(|| {
+                contend(
+                    threads,
+                    |amount| counter.dec(amount).is_ok(),
+                    |amount| counter.inc(amount).unwrap(),
+                )
+            })
+        });
+    }
+
+    group.finish();
+}
+
+criterion_group!(benches, criterion_benchmark);
+criterion_main!(benches);
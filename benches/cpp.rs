@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// runs the C++ benchmark scenarios. pass a substring to only run matching
+// scenarios, e.g. `cargo bench --bench cpp -- fanout/`
+
+use std::env;
+use std::ffi::CString;
+
+// the C++ code the scenarios depend on is linked through the pushpin crate
+#[link(name = "pushpin-cppbench")]
+#[cfg_attr(target_os = "macos", link(name = "c++"))]
+#[cfg_attr(not(target_os = "macos"), link(name = "stdc++"))]
+extern "C" {
+    fn tnetstring_bench(filter: *const libc::c_char);
+    fn ringqueue_bench(filter: *const libc::c_char);
+    fn bufferlist_bench(filter: *const libc::c_char);
+    fn httpheaders_bench(filter: *const libc::c_char);
+    fn defercall_bench(filter: *const libc::c_char);
+    fn fastsignal_bench(filter: *const libc::c_char);
+    fn eventloop_bench(filter: *const libc::c_char);
+    fn uuidutil_bench(filter: *const libc::c_char);
+    fn statsmanager_bench(filter: *const libc::c_char);
+    fn domainmap_bench(filter: *const libc::c_char);
+    fn proxyengine_bench(filter: *const libc::c_char);
+    fn handler_bench(filter: *const libc::c_char);
+}
+
+fn main() {
+    // ensure the pushpin crate is linked
+    let _ = pushpin::core::version();
+
+    // cargo passes flags such as --bench, so skip those
+    let filter = env::args()
+        .skip(1)
+        .find(|a| !a.starts_with('-'))
+        .unwrap_or_default();
+    let filter = CString::new(filter).unwrap();
+
+    // SAFETY: the functions only read the filter string, which outlives the
+    // calls
+    unsafe {
+        tnetstring_bench(filter.as_ptr());
+        ringqueue_bench(filter.as_ptr());
+        bufferlist_bench(filter.as_ptr());
+        httpheaders_bench(filter.as_ptr());
+        defercall_bench(filter.as_ptr());
+        fastsignal_bench(filter.as_ptr());
+        eventloop_bench(filter.as_ptr());
+        uuidutil_bench(filter.as_ptr());
+        statsmanager_bench(filter.as_ptr());
+        domainmap_bench(filter.as_ptr());
+        proxyengine_bench(filter.as_ptr());
+        handler_bench(filter.as_ptr());
+    }
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+use criterion::{criterion_group, criterion_main, Criterion, Throughput};
+use pushpin::connmgr::connection::testutil::BenchServerWsBroadcast;
+use pushpin::connmgr::server::BenchKeepAliveBatch;
+use std::alloc::{GlobalAlloc, Layout, System};
+use std::sync::atomic::{AtomicUsize, Ordering};
+
+// tracks heap usage, so that memory can be reported along with time. this
+// lives in its own bench so the other benches don't pay for the counting
+struct CountingAlloc;
+
+static ALLOCATED: AtomicUsize = AtomicUsize::new(0);
+
+unsafe impl GlobalAlloc for CountingAlloc {
+    unsafe fn alloc(&self, layout: Layout) -> *mut u8 {
+        let p = System.alloc(layout);
+
+        if !p.is_null() {
+            ALLOCATED.fetch_add(layout.size(), Ordering::Relaxed);
+        }
+
+        p
+    }
+
+    unsafe fn dealloc(&self, p: *mut u8, layout: Layout) {
+        System.dealloc(p, layout);
+
+        ALLOCATED.fetch_sub(layout.size(), Ordering::Relaxed);
+    }
+
+    unsafe fn realloc(&self, p: *mut u8, layout: Layout, new_size: usize) -> *mut u8 {
+        let new_p = System.realloc(p, layout, new_size);
+
+        if !new_p.is_null() {
+            ALLOCATED.fetch_sub(layout.size(), Ordering::Relaxed);
+            ALLOCATED.fetch_add(new_size, Ordering::Relaxed);
+        }
+
+        new_p
+    }
+}
+
+#[global_allocator]
+static GLOBAL: CountingAlloc = CountingAlloc;
+
+const WS_CONNS: usize = 1000;
+const KEEP_ALIVE_CONNS: usize = 1_000_000;
+
+fn criterion_benchmark(c: &mut Criterion) {
+    {
+        let t = BenchServerWsBroadcast::new(WS_CONNS);
+
+        let before = ALLOCATED.load(Ordering::Relaxed);
+        let mut args = t.init();
+        let after = ALLOCATED.load(Ordering::Relaxed);
+
+        println!(
+            "idle ws connections: {} bytes of heap each ({} connections)",
+            after.saturating_sub(before) / args.len(),
+            args.len()
+        );
+
+        let mut group = c.benchmark_group("ws_broadcast");
+        group.throughput(Throughput::Elements(args.len() as u64));
+
+        group.bench_function(format!("conns={}", args.len()), |b| {
+            b.iter(|| t.run(&mut args))
+        });
+
+        group.finish();
+    }
+
+    {
+        let t = BenchKeepAliveBatch::new(KEEP_ALIVE_CONNS);
+
+        let mut group = c.benchmark_group("keep_alive_batch");
+        group.throughput(Throughput::Elements(t.batch_size() as u64));
+
+        group.bench_function(format!("conns={}", KEEP_ALIVE_CONNS), |b| {
+            b.iter(|| t.run())
+        });
+
+        group.finish();
+    }
+}
+
+criterion_group!(benches, criterion_benchmark);
+criterion_main!(benches);
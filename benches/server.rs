@@ -20,13 +20,16 @@ use pushpin::connmgr::connection::testutil::{
     BenchServerStreamHandler,
 };
 use pushpin::connmgr::server::TestServer;
+use pushpin::connmgr::websocket::apply_mask;
 use pushpin::connmgr::websocket::testutil::{BenchRecvMessage, BenchSendMessage};
+use pushpin::core::buffer::{Buffer, BufferPool, TmpBuffer, VecRingBuffer};
 use pushpin::core::executor::Executor;
 use pushpin::core::io::{AsyncReadExt, AsyncWriteExt};
 use pushpin::core::net::AsyncTcpStream;
 use pushpin::core::reactor::Reactor;
 use std::io::{self, Write};
 use std::net::SocketAddr;
+use std::rc::Rc;
 use std::str;
 
 const REQS_PER_ITER: usize = 10;
@@ -95,6 +98,39 @@ fn criterion_benchmark(c: &mut Criterion) {
         });
     }
 
+    {
+        // a request with as many headers as a typical browser sends
+        let t = BenchServerReqConnection::with_request(
+            concat!(
+                "GET /api/v1/items?page=2&sort=name HTTP/1.1\r\n",
+                "Host: example.com\r\n",
+                "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:120.0) Gecko/20100101 Firefox/120.0\r\n",
+                "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n",
+                "Accept-Language: en-US,en;q=0.5\r\n",
+                "Accept-Encoding: gzip, deflate, br\r\n",
+                "Referer: https://example.com/api/v1/items?page=1&sort=name\r\n",
+                "Cookie: session=0123456789abcdef0123456789abcdef; theme=dark; lang=en\r\n",
+                "Cache-Control: no-cache\r\n",
+                "Pragma: no-cache\r\n",
+                "DNT: 1\r\n",
+                "Sec-Fetch-Dest: document\r\n",
+                "Sec-Fetch-Mode: navigate\r\n",
+                "Sec-Fetch-Site: same-origin\r\n",
+                "Sec-Fetch-User: ?1\r\n",
+                "Upgrade-Insecure-Requests: 1\r\n",
+                "X-Forwarded-For: 192.0.2.1, 198.51.100.2\r\n",
+                "X-Request-Id: 5f2b6c1e-8d3a-4f6b-9c2e-1a7d0e4b3c9f\r\n",
+                "Connection: keep-alive, close\r\n",
+                "\r\n"
+            )
+            .as_bytes(),
+        );
+
+        c.bench_function("req_connection_headers", |b| {
+            b.iter_batched_ref(|| t.init(), |i| t.run(i), criterion::BatchSize::SmallInput)
+        });
+    }
+
     {
         let t = BenchServerStreamConnection::new();
 
@@ -135,6 +171,31 @@ fn criterion_benchmark(c: &mut Criterion) {
         });
     }
 
+    {
+        let mut buf = vec![0; 16_384];
+
+        c.bench_function("ws_apply_mask", |b| {
+            b.iter(|| apply_mask(&mut buf, [0x01, 0x02, 0x03, 0x04], 1))
+        });
+    }
+
+    {
+        let tmp = Rc::new(TmpBuffer::new(16_384));
+        let pool = BufferPool::new(16_384, 1);
+        let mut rb = VecRingBuffer::new(16_384, &tmp);
+
+        // an idle connection giving up its buffer and taking it back when
+        // data arrives
+        c.bench_function("ring_release_acquire", |b| {
+            b.iter(|| {
+                assert!(rb.release(&pool));
+                rb.acquire(&pool);
+                rb.write_all(b"hello").unwrap();
+                rb.read_commit(5);
+            })
+        });
+    }
+
     {
         let server = TestServer::new(1);
         let req_addr = server.req_addr();
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+use criterion::{criterion_group, criterion_main, Criterion, Throughput};
+use pushpin::core::zmq::{compress_frame, decompress_frame};
+
+fn tnet_str(out: &mut Vec<u8>, s: &[u8]) {
+    out.extend_from_slice(format!("{}:", s.len()).as_bytes());
+    out.extend_from_slice(s);
+    out.push(b',');
+}
+
+fn tnet_container(out: &mut Vec<u8>, content: &[u8], end: u8) {
+    out.extend_from_slice(format!("{}:", content.len()).as_bytes());
+    out.extend_from_slice(content);
+    out.push(end);
+}
+
+// a zhttp request packet with typical browser headers and the given body
+fn request_packet(body: &[u8]) -> Vec<u8> {
+    let headers: &[(&[u8], &[u8])] = &[
+        (b"Host", b"api.example.com"),
+        (
+            b"User-Agent",
+            b"Mozilla/5.0 (X11; Linux x86_64; rv:128.0) Gecko/20100101 Firefox/128.0",
+        ),
+        (b"Accept", b"application/json, text/plain, */*"),
+        (b"Accept-Language", b"en-US,en;q=0.5"),
+        (b"Accept-Encoding", b"gzip, deflate, br"),
+        (b"Content-Type", b"application/json"),
+        (b"Origin", b"https://www.example.com"),
+        (b"Referer", b"https://www.example.com/app/dashboard"),
+        (
+            b"Cookie",
+            b"session=8f3a2c1d9e7b4a6f; theme=dark; locale=en-US",
+        ),
+        (b"X-Forwarded-For", b"203.0.113.45"),
+        (b"X-Forwarded-Proto", b"https"),
+    ];
+
+    let mut hlist = Vec::new();
+    for (name, value) in headers {
+        let mut pair = Vec::new();
+        tnet_str(&mut pair, name);
+        tnet_str(&mut pair, value);
+        tnet_container(&mut hlist, &pair, b']');
+    }
+
+    let mut map = Vec::new();
+    tnet_str(&mut map, b"from");
+    tnet_str(&mut map, b"pushpin-connmgr-8f3a2c1d");
+    tnet_str(&mut map, b"id");
+    tnet_str(&mut map, b"3b8e1f2a-9c4d-4e7b-a1f0-6d2c8e9b7a15");
+    tnet_str(&mut map, b"seq");
+    map.extend_from_slice(b"1:0#");
+    tnet_str(&mut map, b"method");
+    tnet_str(&mut map, b"POST");
+    tnet_str(&mut map, b"uri");
+    tnet_str(&mut map, b"https://api.example.com/v1/events/subscribe");
+    tnet_str(&mut map, b"headers");
+    tnet_container(&mut map, &hlist, b']');
+    tnet_str(&mut map, b"body");
+    tnet_str(&mut map, body);
+
+    let mut out = vec![b'T'];
+    tnet_container(&mut out, &map, b'}');
+
+    out
+}
+
+fn criterion_benchmark(c: &mut Criterion) {
+    let json = br#"{"channel":"updates","items":[{"id":1,"type":"status","value":"online"},{"id":2,"type":"status","value":"away"},{"id":3,"type":"status","value":"online"}]}"#;
+
+    let cases = [
+        ("headers", request_packet(b"")),
+        ("headers+json", request_packet(json)),
+        ("headers+json*8", request_packet(&json.repeat(8))),
+    ];
+
+    let mut group = c.benchmark_group("zmqcompress");
+
+    for (name, packet) in cases.iter() {
+        let compressed = compress_frame(packet).unwrap();
+
+        // the bandwidth side of the trade-off
+        println!(
+            "{}: {} bytes -> {} bytes ({:.0}%)",
+            name,
+            packet.len(),
+            compressed.len(),
+            compressed.len() as f64 * 100.0 / packet.len() as f64
+        );
+
+        group.throughput(Throughput::Bytes(packet.len() as u64));
+
+        group.bench_function(format!("compress {}", name), |b| {
+            b.iter(|| compress_frame(packet).unwrap())
+        });
+
+        group.bench_function(format!("decompress {}", name), |b| {
+            b.iter(|| decompress_frame(&compressed).unwrap())
+        });
+    }
+
+    group.finish();
+}
+
+criterion_group!(benches, criterion_benchmark);
+criterion_main!(benches);
@@ -474,8 +474,17 @@ fn main() -> Result<(), Box<dyn Error>> {
 
     let cpp_pro = root_dir.join("src/cpp.pro");
     let cpp_tests_pro = root_dir.join("src/cpptests.pro");
-
-    for dir in ["moc", "obj", "test-moc", "test-obj", "test-work"] {
+    let cpp_bench_pro = root_dir.join("src/cppbench.pro");
+
+    for dir in [
+        "moc",
+        "obj",
+        "test-moc",
+        "test-obj",
+        "test-work",
+        "bench-moc",
+        "bench-obj",
+    ] {
         fs::create_dir_all(out_dir.join(dir))?;
     }
 
@@ -527,6 +536,12 @@ fn main() -> Result<(), Box<dyn Error>> {
         cpp_tests_pro.as_os_str(),
     ]))?;
 
+    check_command(Command::new(&qmake_path).args([
+        OsStr::new("-o"),
+        out_dir.join("Makefile.bench").as_os_str(),
+        cpp_bench_pro.as_os_str(),
+    ]))?;
+
     check_command(
         Command::new(&qmake_path)
             .args(["-o", "Makefile", "postbuild.pro"])
@@ -547,6 +562,13 @@ fn main() -> Result<(), Box<dyn Error>> {
             .current_dir(&out_dir),
     )?;
 
+    check_command(
+        Command::new("make")
+            .env("MAKEFLAGS", env::var("CARGO_MAKEFLAGS")?)
+            .args(["-f", "Makefile.bench"])
+            .current_dir(&out_dir),
+    )?;
+
     println!("cargo:rustc-env=APP_VERSION={}", get_version());
     println!("cargo:rustc-env=CONFIG_DIR={}/pushpin", config_dir);
     println!("cargo:rustc-env=LIB_DIR={}/pushpin", lib_dir);
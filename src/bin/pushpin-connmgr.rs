@@ -17,9 +17,10 @@
 
 use clap::{Arg, ArgAction, Command};
 use log::{error, LevelFilter};
-use pushpin::connmgr::{run, App, Config, ListenConfig, ListenSpec};
+use pushpin::connmgr::{run, App, Config, ListenConfig, ListenSpec, PoolConfig, PoolLimits};
 use pushpin::core::log::{get_simple_logger, local_offset_check};
 use pushpin::core::version;
+use pushpin::core::zmq;
 use std::error::Error;
 use std::path::PathBuf;
 use std::process;
@@ -53,16 +54,24 @@ struct Args {
     req_timeout: usize,
     stream_timeout: usize,
     listen: Vec<String>,
+    listen_reuseport: bool,
+    listen_steer_cpu: bool,
     zclient_req_specs: Vec<String>,
     zclient_stream_specs: Vec<String>,
     zclient_connect: bool,
     zserver_req_specs: Vec<String>,
     zserver_stream_specs: Vec<String>,
     zserver_connect: bool,
+    zserver_batch: bool,
+    zmq_compression: bool,
     ipc_file_mode: u32,
     tls_identities_dir: String,
     allow_compression: bool,
     deny_out_internal: bool,
+    pool_limits: PoolLimits,
+    pool_origins: Vec<String>,
+    pool_warm_timeout: usize,
+    handoff_socket: Option<String>,
 }
 
 fn process_args_and_run(args: Args) -> Result<(), Box<dyn Error>> {
@@ -99,16 +108,25 @@ fn process_args_and_run(args: Args) -> Result<(), Box<dyn Error>> {
         req_timeout: Duration::from_secs(args.req_timeout as u64),
         stream_timeout: Duration::from_secs(args.stream_timeout as u64),
         listen: Vec::new(),
+        listen_reuseport: args.listen_reuseport,
+        listen_steer_cpu: args.listen_steer_cpu,
         zclient_req: args.zclient_req_specs,
         zclient_stream: args.zclient_stream_specs,
         zclient_connect: args.zclient_connect,
         zserver_req: args.zserver_req_specs,
         zserver_stream: args.zserver_stream_specs,
         zserver_connect: args.zserver_connect,
+        zserver_batch: args.zserver_batch,
         ipc_file_mode: args.ipc_file_mode,
         certs_dir: PathBuf::from(args.tls_identities_dir),
         allow_compression: args.allow_compression,
         deny: Vec::new(),
+        pool: PoolConfig {
+            default: args.pool_limits,
+            origins: Vec::new(),
+            warm_timeout: Duration::from_secs(args.pool_warm_timeout as u64),
+        },
+        handoff_socket: args.handoff_socket.map(PathBuf::from),
     };
 
     for v in args.listen.iter() {
@@ -120,6 +138,7 @@ fn process_args_and_run(args: Args) -> Result<(), Box<dyn Error>> {
         let mut stream = true;
         let mut tls = false;
         let mut default_cert = None;
+        let mut ktls = false;
         let mut local = false;
         let mut mode = None;
         let mut user = None;
@@ -136,6 +155,9 @@ fn process_args_and_run(args: Args) -> Result<(), Box<dyn Error>> {
                 "stream" => stream = true,
                 "tls" => tls = true,
                 "default-cert" => default_cert = Some(String::from(v)),
+                // offload transmit encryption to the kernel. such
+                // listeners don't issue TLS 1.3 session tickets
+                "ktls" => ktls = true,
                 "local" => local = true,
                 "mode" => match u32::from_str_radix(v, 8) {
                     Ok(x) => mode = Some(x),
@@ -178,22 +200,68 @@ fn process_args_and_run(args: Args) -> Result<(), Box<dyn Error>> {
                 }
             };
 
+            if ktls && !tls {
+                return Err("failed to parse listen: ktls requires tls".into());
+            }
+
             ListenSpec::Tcp {
                 addr,
                 tls,
                 default_cert,
+                ktls,
             }
         };
 
         config.listen.push(ListenConfig { spec, stream });
     }
 
+    for v in args.pool_origins.iter() {
+        let mut parts = v.split(',');
+
+        // there's always a first part
+        let origin = parts.next().unwrap().to_lowercase();
+
+        if origin.is_empty() {
+            return Err("failed to parse pool-origin: origin cannot be empty".into());
+        }
+
+        let mut limits = args.pool_limits;
+
+        for part in parts {
+            let (k, v) = match part.find('=') {
+                Some(pos) => (&part[..pos], &part[(pos + 1)..]),
+                None => (part, ""),
+            };
+
+            let v: usize = match v.parse() {
+                Ok(x) => x,
+                Err(e) => return Err(format!("failed to parse pool-origin {}: {}", k, e).into()),
+            };
+
+            match k {
+                "max-idle" => limits.max_idle = v,
+                "min-warm" => limits.min_warm = v,
+                "max-total" => limits.max_total = v,
+                _ => {
+                    return Err(
+                        format!("failed to parse pool-origin: invalid param: {}", part).into(),
+                    )
+                }
+            }
+        }
+
+        config.pool.origins.push((origin, limits));
+    }
+
     if args.deny_out_internal {
         for s in PRIVATE_SUBNETS.iter() {
             config.deny.push(s.parse().unwrap());
         }
     }
 
+    // must be set before any sockets are set up
+    zmq::set_tcp_compression_enabled(args.zmq_compression);
+
     run(&config)
 }
 
@@ -304,6 +372,26 @@ fn main() {
                 .action(ArgAction::Append)
                 .help("Port to listen on"),
         )
+        .arg(
+            Arg::new("listen-reuseport")
+                .long("listen-reuseport")
+                .action(ArgAction::SetTrue)
+                .help("Give each worker its own listening sockets using SO_REUSEPORT"),
+        )
+        .arg(
+            Arg::new("listen-steer-cpu")
+                .long("listen-steer-cpu")
+                .action(ArgAction::SetTrue)
+                .requires("listen-reuseport")
+                .help("Accept connections on the worker matching the CPU that received them"),
+        )
+        .arg(
+            Arg::new("handoff-socket")
+                .long("handoff-socket")
+                .num_args(1)
+                .value_name("path")
+                .help("Unix socket for passing listening sockets to a restarted instance"),
+        )
         .arg(
             Arg::new("zclient-req")
                 .long("zclient-req")
@@ -350,6 +438,18 @@ fn main() {
                 .action(ArgAction::SetTrue)
                 .help("ZeroMQ server sockets should connect instead of bind"),
         )
+        .arg(
+            Arg::new("zserver-batch")
+                .long("zserver-batch")
+                .action(ArgAction::SetTrue)
+                .help("Combine ZeroMQ server stream packets for the same peer when possible"),
+        )
+        .arg(
+            Arg::new("zmq-compression")
+                .long("zmq-compression")
+                .action(ArgAction::SetTrue)
+                .help("Compress large ZeroMQ messages sent over TCP"),
+        )
         .arg(
             Arg::new("ipc-file-mode")
                 .long("ipc-file-mode")
@@ -377,6 +477,46 @@ fn main() {
                 .action(ArgAction::SetTrue)
                 .help("Block outbound connections to local/internal IP address ranges"),
         )
+        .arg(
+            Arg::new("pool-max-idle")
+                .long("pool-max-idle")
+                .num_args(1)
+                .value_name("N")
+                .help("Maximum number of idle outbound connections per origin (0 for no limit)")
+                .default_value("0"),
+        )
+        .arg(
+            Arg::new("pool-min-warm")
+                .long("pool-min-warm")
+                .num_args(1)
+                .value_name("N")
+                .help("Number of idle outbound connections to keep open per recently used origin")
+                .default_value("0"),
+        )
+        .arg(
+            Arg::new("pool-max-total")
+                .long("pool-max-total")
+                .num_args(1)
+                .value_name("N")
+                .help("Maximum number of outbound connections per origin (0 for no limit)")
+                .default_value("0"),
+        )
+        .arg(
+            Arg::new("pool-warm-timeout")
+                .long("pool-warm-timeout")
+                .num_args(1)
+                .value_name("N")
+                .help("Stop keeping an origin warm after it is unused for this long (seconds)")
+                .default_value("600"),
+        )
+        .arg(
+            Arg::new("pool-origin")
+                .long("pool-origin")
+                .num_args(1)
+                .value_name("host[:port][,params...]")
+                .action(ArgAction::Append)
+                .help("Pool limits for an origin (max-idle, min-warm, max-total)"),
+        )
         .arg(
             Arg::new("sizes")
                 .long("sizes")
@@ -528,6 +668,12 @@ fn main() {
         .map(|v| v.to_owned())
         .collect();
 
+    let listen_reuseport = *matches.get_one("listen-reuseport").unwrap();
+
+    let listen_steer_cpu = *matches.get_one("listen-steer-cpu").unwrap();
+
+    let handoff_socket = matches.get_one::<String>("handoff-socket").cloned();
+
     let zclient_req_specs: Vec<String> = matches
         .get_many::<String>("zclient-req")
         .unwrap()
@@ -556,6 +702,10 @@ fn main() {
 
     let zserver_connect = *matches.get_one("zserver-connect").unwrap();
 
+    let zserver_batch = *matches.get_one("zserver-batch").unwrap();
+
+    let zmq_compression = *matches.get_one("zmq-compression").unwrap();
+
     let ipc_file_mode = matches
         .get_one::<String>("ipc-file-mode")
         .cloned()
@@ -575,6 +725,40 @@ fn main() {
 
     let deny_out_internal = *matches.get_one("deny-out-internal").unwrap();
 
+    let mut pool_limits = PoolLimits::default();
+
+    for (name, value) in [
+        ("pool-max-idle", &mut pool_limits.max_idle),
+        ("pool-min-warm", &mut pool_limits.min_warm),
+        ("pool-max-total", &mut pool_limits.max_total),
+    ] {
+        let v = matches.get_one::<String>(name).unwrap();
+
+        *value = match v.parse() {
+            Ok(x) => x,
+            Err(e) => {
+                error!("failed to parse {}: {}", name, e);
+                process::exit(1);
+            }
+        };
+    }
+
+    let pool_warm_timeout = matches.get_one::<String>("pool-warm-timeout").unwrap();
+
+    let pool_warm_timeout: usize = match pool_warm_timeout.parse() {
+        Ok(x) => x,
+        Err(e) => {
+            error!("failed to parse pool-warm-timeout: {}", e);
+            process::exit(1);
+        }
+    };
+
+    let pool_origins: Vec<String> = matches
+        .get_many::<String>("pool-origin")
+        .unwrap_or_default()
+        .map(|v| v.to_owned())
+        .collect();
+
     // if no zmq server specs are set (needed by client mode), specify
     // default listen configuration in order to enable server mode. this
     // means if zmq server specs are set, then server mode won't be enabled
@@ -596,16 +780,24 @@ fn main() {
         req_timeout,
         stream_timeout,
         listen,
+        listen_reuseport,
+        listen_steer_cpu,
         zclient_req_specs,
         zclient_stream_specs,
         zclient_connect,
         zserver_req_specs,
         zserver_stream_specs,
         zserver_connect,
+        zserver_batch,
+        zmq_compression,
         ipc_file_mode,
         tls_identities_dir: tls_identities_dir.to_string(),
         allow_compression,
         deny_out_internal,
+        pool_limits,
+        pool_origins,
+        pool_warm_timeout,
+        handoff_socket,
     };
 
     if let Err(e) = process_args_and_run(args) {
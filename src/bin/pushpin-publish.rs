@@ -22,9 +22,11 @@
 
 use clap::{Arg, ArgAction, Command};
 use pushpin::core::version;
-use pushpin::publish::{run, Action, Config, Content, Message};
+use pushpin::publish::{run, Action, Config, Content, Message, PubTopic};
 use std::env;
 use std::error::Error;
+use std::io;
+use std::io::BufRead;
 use std::process;
 
 const PROGRAM_NAME: &str = "pushpin-publish";
@@ -42,44 +44,83 @@ struct Args {
     hint: bool,
     close: bool,
     patch: bool,
+    binary: bool,
+    batch: bool,
     no_seq: bool,
+    conflate: bool,
+    delta: bool,
     no_eol: bool,
     spec: String,
     user: Option<String>,
+    pub_socket: bool,
+    hashed_topic: bool,
+}
+
+fn parse_content(s: String, patch: bool) -> Result<Content, Box<dyn Error>> {
+    if patch {
+        let v: serde_json::Value = serde_json::from_str(&s)?;
+
+        let arr = match v {
+            serde_json::Value::Array(arr) => arr,
+            _ => return Err("patch content must be a JSON array".into()),
+        };
+
+        Ok(Content::Patch(arr))
+    } else {
+        Ok(Content::Value(s))
+    }
 }
 
 fn process_args_and_run(args: Args) -> Result<(), Box<dyn Error>> {
-    let action = if args.hint {
-        Action::Hint
+    let mut actions = Vec::new();
+
+    if args.hint {
+        actions.push(Action::Hint);
     } else if args.close {
-        Action::Close
+        actions.push(Action::Close);
     } else {
         if args.code > 999 {
             return Err("code must be an integer between 0 and 999".into());
         }
 
-        let content = match args.content {
-            Some(s) => s,
-            None => return Err("must specify content".into()),
-        };
+        if let Some(content) = args.content {
+            actions.push(Action::Send(Message {
+                code: args.code,
+                content: parse_content(content, args.patch)?,
+            }));
+        }
 
-        let content = if args.patch {
-            let v: serde_json::Value = serde_json::from_str(&content)?;
+        if args.batch {
+            // each line of stdin is the content of one more item
+            for line in io::stdin().lock().lines() {
+                let line = line?;
 
-            let arr = match v {
-                serde_json::Value::Array(arr) => arr,
-                _ => return Err("patch content must be a JSON array".into()),
-            };
+                if line.is_empty() {
+                    continue;
+                }
 
-            Content::Patch(arr)
-        } else {
-            Content::Value(content)
-        };
+                actions.push(Action::Send(Message {
+                    code: args.code,
+                    content: parse_content(line, args.patch)?,
+                }));
+            }
+        }
+
+        if actions.is_empty() {
+            return Err("must specify content".into());
+        }
+    }
 
-        Action::Send(Message {
-            code: args.code,
-            content,
-        })
+    let pub_topic = if args.hashed_topic {
+        if !args.pub_socket {
+            return Err("hashed-topic requires pub".into());
+        }
+
+        Some(PubTopic::Hashed)
+    } else if args.pub_socket {
+        Some(PubTopic::Channel)
+    } else {
+        None
     };
 
     let mut headers = Vec::new();
@@ -117,11 +158,15 @@ fn process_args_and_run(args: Args) -> Result<(), Box<dyn Error>> {
         id: args.id,
         prev_id: args.prev_id,
         sender: args.sender,
-        action,
+        actions,
         headers,
         meta,
         no_seq: args.no_seq,
+        conflate: args.conflate,
+        delta: args.delta,
         eol: !args.no_eol,
+        binary: args.binary,
+        pub_topic,
     };
 
     run(&config)
@@ -214,12 +259,36 @@ fn main() {
                 .action(ArgAction::SetTrue)
                 .help("Content is JSON patch"),
         )
+        .arg(
+            Arg::new("binary")
+                .long("binary")
+                .action(ArgAction::SetTrue)
+                .help("Send WebSocket message as binary"),
+        )
+        .arg(
+            Arg::new("batch")
+                .long("batch")
+                .action(ArgAction::SetTrue)
+                .help("Read additional content from stdin, one item per line"),
+        )
         .arg(
             Arg::new("no-seq")
                 .long("no-seq")
                 .action(ArgAction::SetTrue)
                 .help("Bypass sequencing buffer"),
         )
+        .arg(
+            Arg::new("conflate")
+                .long("conflate")
+                .action(ArgAction::SetTrue)
+                .help("Allow replacing by newer items, per the handler's conflation rates"),
+        )
+        .arg(
+            Arg::new("delta")
+                .long("delta")
+                .action(ArgAction::SetTrue)
+                .help("Send JSON content as patches to subscribers that opted in"),
+        )
         .arg(
             Arg::new("no-eol")
                 .long("no-eol")
@@ -242,6 +311,18 @@ fn main() {
                 .value_name("user:pass")
                 .help("Authenticate using basic auth"),
         )
+        .arg(
+            Arg::new("pub")
+                .long("pub")
+                .action(ArgAction::SetTrue)
+                .help("Publish through a ZeroMQ PUB socket to the SUB spec"),
+        )
+        .arg(
+            Arg::new("hashed-topic")
+                .long("hashed-topic")
+                .action(ArgAction::SetTrue)
+                .help("Send under the hashed channel topic, with --pub"),
+        )
         .get_matches();
 
     let channel = matches.get_one::<String>("channel").unwrap().clone();
@@ -283,13 +364,20 @@ fn main() {
     let hint = *matches.get_one("hint").unwrap();
     let close = *matches.get_one("close").unwrap();
     let patch = *matches.get_one("patch").unwrap();
+    let binary = *matches.get_one("binary").unwrap();
+    let batch = *matches.get_one("batch").unwrap();
     let no_seq = *matches.get_one("no-seq").unwrap();
+    let conflate = *matches.get_one("conflate").unwrap();
+    let delta = *matches.get_one("delta").unwrap();
     let no_eol = *matches.get_one("no-eol").unwrap();
 
     let spec = matches.get_one::<String>("spec").unwrap().clone();
 
     let user = matches.get_one::<String>("user").cloned();
 
+    let pub_socket = *matches.get_one("pub").unwrap();
+    let hashed_topic = *matches.get_one("hashed-topic").unwrap();
+
     let args = Args {
         channel,
         content,
@@ -302,10 +390,16 @@ fn main() {
         hint,
         close,
         patch,
+        binary,
+        batch,
         no_seq,
+        conflate,
+        delta,
         no_eol,
         spec,
         user,
+        pub_socket,
+        hashed_topic,
     };
 
     if let Err(e) = process_args_and_run(args) {
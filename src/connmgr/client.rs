@@ -20,11 +20,12 @@ use crate::connmgr::connection::{
     client_req_connection, client_stream_connection, make_zhttp_response, ConnectionPool,
     StreamSharedData,
 };
-use crate::connmgr::counter::Counter;
+use crate::connmgr::counter::ShardedCounter;
 use crate::connmgr::resolver::Resolver;
 use crate::connmgr::tls::TlsConfigCache;
 use crate::connmgr::zhttppacket;
 use crate::connmgr::zhttpsocket::{self, SessionKey, FROM_MAX, REQ_ID_MAX};
+use crate::connmgr::PoolConfig;
 use crate::core::arena;
 use crate::core::buffer::TmpBuffer;
 use crate::core::channel::{self, AsyncLocalReceiver, AsyncLocalSender, AsyncReceiver};
@@ -484,7 +485,7 @@ struct ConnectionReqOpts {
 
 struct ConnectionStreamOpts {
     blocks_max: usize,
-    blocks_avail: Arc<Counter>,
+    blocks_avail: Arc<ShardedCounter>,
     messages_max: usize,
     allow_compression: bool,
     sender: channel::LocalSender<(Option<ArrayVec<u8, FROM_MAX>>, zmq::Message)>,
@@ -505,7 +506,7 @@ impl Worker {
         buffer_size: usize,
         body_buffer_size: usize,
         connection_blocks_max: usize,
-        blocks_avail: &Arc<Counter>,
+        blocks_avail: &Arc<ShardedCounter>,
         messages_max: usize,
         req_timeout: Duration,
         stream_timeout: Duration,
@@ -606,7 +607,7 @@ impl Worker {
         buffer_size: usize,
         body_buffer_size: usize,
         connection_blocks_max: usize,
-        blocks_avail: Arc<Counter>,
+        blocks_avail: Arc<ShardedCounter>,
         messages_max: usize,
         req_timeout: Duration,
         stream_timeout: Duration,
@@ -1023,7 +1024,7 @@ impl Worker {
         stream_maxconn: usize,
         conns: Rc<Connections>,
         connection_blocks_max: usize,
-        blocks_avail: Arc<Counter>,
+        blocks_avail: Arc<ShardedCounter>,
         messages_max: usize,
         allow_compression: bool,
         deny: Rc<Vec<IpNet>>,
@@ -1570,6 +1571,9 @@ impl Drop for Worker {
 
 pub struct Client {
     workers: Vec<Worker>,
+    resolver: Arc<Resolver>,
+    tls_config_cache: Arc<TlsConfigCache>,
+    pool: Arc<ConnectionPool>,
 }
 
 impl Client {
@@ -1588,6 +1592,7 @@ impl Client {
         stream_timeout: Duration,
         allow_compression: bool,
         deny: &[IpNet],
+        pool_config: &PoolConfig,
         zsockman: Arc<zhttpsocket::ServerSocketManager>,
         handle_bound: usize,
     ) -> Result<Self, String> {
@@ -1607,13 +1612,20 @@ impl Client {
             0
         };
 
-        let pool = Arc::new(ConnectionPool::new(pool_max));
+        let pool = Arc::new(ConnectionPool::new(
+            pool_max,
+            pool_config.clone(),
+            Arc::clone(&tls_config_cache),
+        ));
 
         if !deny.is_empty() {
             debug!("default policy: block outgoing connections to {:?}", deny);
         }
 
-        let blocks_avail = Arc::new(Counter::new(blocks_max - (stream_maxconn * 2)));
+        let blocks_avail = Arc::new(ShardedCounter::new(
+            blocks_max - (stream_maxconn * 2),
+            worker_count,
+        ));
 
         let mut workers = Vec::new();
 
@@ -1641,7 +1653,12 @@ impl Client {
             workers.push(w);
         }
 
-        Ok(Self { workers })
+        Ok(Self {
+            workers,
+            resolver,
+            tls_config_cache,
+            pool,
+        })
     }
 
     pub fn task_sizes() -> Vec<(String, usize)> {
@@ -1675,7 +1692,11 @@ impl Client {
 
             let resolver = Arc::new(Resolver::new(1, 1));
             let tls_config_cache = Arc::new(TlsConfigCache::new());
-            let pool = Arc::new(ConnectionPool::new(0));
+            let pool = Arc::new(ConnectionPool::new(
+                0,
+                PoolConfig::default(),
+                Arc::clone(&tls_config_cache),
+            ));
 
             let fut = Worker::req_connection_task(
                 stop,
@@ -1740,7 +1761,11 @@ impl Client {
 
             let resolver = Arc::new(Resolver::new(1, 1));
             let tls_config_cache = Arc::new(TlsConfigCache::new());
-            let pool = Arc::new(ConnectionPool::new(0));
+            let pool = Arc::new(ConnectionPool::new(
+                0,
+                PoolConfig::default(),
+                Arc::clone(&tls_config_cache),
+            ));
 
             let stream_shared_mem = Rc::new(arena::RcMemory::new(1));
 
@@ -1769,7 +1794,7 @@ impl Client {
                 },
                 ConnectionStreamOpts {
                     blocks_max: 2,
-                    blocks_avail: Arc::new(Counter::new(0)),
+                    blocks_avail: Arc::new(ShardedCounter::new(0, 1)),
                     messages_max: 0,
                     allow_compression: false,
                     sender,
@@ -1796,6 +1821,33 @@ impl Drop for Client {
         for w in self.workers.iter_mut() {
             w.stop();
         }
+
+        let stats = self.resolver.stats();
+
+        debug!(
+            "resolver cache: {} hits, {} negative hits, {} stale hits, {} misses ({} coalesced)",
+            stats.hits, stats.negative_hits, stats.stale_hits, stats.misses, stats.coalesced
+        );
+
+        let stats = self.tls_config_cache.handshake_stats();
+
+        debug!(
+            "tls client handshakes: {} resumed, {} full",
+            stats.resumed, stats.full
+        );
+
+        let stats = self.pool.stats();
+
+        debug!(
+            "connection pool: {} idle, {} warm origins, {} reused, {} missed, {} pre-connected, {} closed by probe, {} limited",
+            stats.idle,
+            stats.warm_origins,
+            stats.reused,
+            stats.missed,
+            stats.prewarmed,
+            stats.probe_closed,
+            stats.limited
+        );
     }
 }
 
@@ -1837,6 +1889,7 @@ impl TestClient {
             100,
             100,
             stream_maxconn,
+            false,
         );
 
         zsockman
@@ -1863,6 +1916,7 @@ impl TestClient {
             Duration::from_secs(5),
             false,
             &[],
+            &PoolConfig::default(),
             zsockman.clone(),
             100,
         )
@@ -34,7 +34,7 @@
 #![allow(clippy::collapsible_if)]
 #![allow(clippy::collapsible_else_if)]
 
-use crate::connmgr::counter::{Counter, CounterDec};
+use crate::connmgr::counter::{CounterDec, ShardedCounter};
 use crate::connmgr::pool::Pool;
 use crate::connmgr::resolver;
 use crate::connmgr::tls::{AsyncTlsStream, TlsConfigCache, TlsStream, TlsWaker, VerifyMode};
@@ -43,9 +43,10 @@ use crate::connmgr::track::{
 };
 use crate::connmgr::websocket;
 use crate::connmgr::zhttppacket;
+use crate::connmgr::{PoolConfig, PoolLimits};
 use crate::core::arena;
 use crate::core::buffer::{
-    Buffer, ContiguousBuffer, LimitBufsMut, TmpBuffer, VecRingBuffer, VECTORED_MAX,
+    Buffer, BufferPool, ContiguousBuffer, LimitBufsMut, TmpBuffer, VecRingBuffer, VECTORED_MAX,
 };
 use crate::core::channel::{AsyncLocalReceiver, AsyncLocalSender};
 use crate::core::defer::Defer;
@@ -69,7 +70,7 @@ use log::{debug, log, warn, Level};
 use sha1::{Digest, Sha1};
 use std::cell::{Ref, RefCell};
 use std::cmp;
-use std::collections::VecDeque;
+use std::collections::{HashMap, VecDeque};
 use std::convert::TryFrom;
 use std::future::Future;
 use std::io::{self, Read, Write};
@@ -80,6 +81,7 @@ use std::pin::Pin;
 use std::rc::Rc;
 use std::str;
 use std::str::FromStr;
+use std::sync::atomic::{AtomicU64, Ordering};
 use std::sync::{mpsc, Arc, Mutex};
 use std::task::Context;
 use std::task::Poll;
@@ -94,6 +96,9 @@ const WS_ACCEPT_MAX: usize = 28; // base64_encode(sha1_hash) = 28 bytes
 const REDIRECTS_MAX: usize = 8;
 const ZHTTP_SESSION_TIMEOUT: Duration = Duration::from_secs(60);
 const CONNECTION_POOL_TTL: Duration = Duration::from_secs(55);
+const POOL_PROBE_INTERVAL: Duration = Duration::from_secs(5);
+const PRECONNECT_TIMEOUT: Duration = Duration::from_secs(5);
+const PRECONNECT_RETRY: Duration = Duration::from_secs(10);
 
 pub trait CidProvider {
     fn get_new_assigned_cid(&mut self) -> ArrayString<32>;
@@ -358,6 +363,7 @@ enum Error {
     BadRequest,
     Tls,
     PolicyViolation,
+    ConnectionLimit,
     TooManyRedirects,
     ValueActive,
     StreamTimeout,
@@ -390,6 +396,7 @@ impl Error {
             Error::StreamTimeout => "connection-timeout",
             Error::Tls => "tls-error",
             Error::PolicyViolation => "policy-violation",
+            Error::ConnectionLimit => "remote-connection-failed",
             Error::TooManyRedirects => "too-many-redirects",
             Error::WebSocketRejectionTooLarge(_) => "rejection-too-large",
             _ => "undefined-condition",
@@ -687,6 +694,55 @@ async fn recv_nonzero<R: AsyncRead>(r: &mut R, buf: &mut VecRingBuffer) -> Resul
     Ok(())
 }
 
+struct RecvPooledFuture<'a, R: AsyncRead> {
+    r: &'a mut R,
+    tmp: &'a TmpBuffer,
+    max: usize,
+}
+
+impl<R: AsyncRead> Future for RecvPooledFuture<'_, R> {
+    type Output = Result<usize, io::Error>;
+
+    fn poll(mut self: Pin<&mut Self>, cx: &mut Context) -> Poll<Self::Output> {
+        let f = &mut *self;
+
+        f.tmp
+            .with_mut(|tmp| Pin::new(&mut *f.r).poll_read(cx, &mut tmp[..f.max]))
+    }
+}
+
+impl<R: AsyncRead> Drop for RecvPooledFuture<'_, R> {
+    fn drop(&mut self) {
+        self.r.cancel();
+    }
+}
+
+// like recv_nonzero, but for a buffer that has been released to the pool.
+// the read goes into the shared tmp buffer, and memory is only taken from
+// the pool once there is data to keep
+async fn recv_nonzero_pooled<R: AsyncRead>(
+    r: &mut R,
+    buf: &mut VecRingBuffer,
+    pool: &BufferPool,
+) -> Result<(), io::Error> {
+    let tmp = Rc::clone(buf.get_tmp());
+
+    let size = RecvPooledFuture {
+        r,
+        tmp: &tmp,
+        max: pool.buffer_size(),
+    }
+    .await?;
+
+    if size == 0 {
+        return Err(io::Error::from(io::ErrorKind::UnexpectedEof));
+    }
+
+    buf.acquire(pool);
+
+    tmp.with_mut(|tmp| buf.write_all(&tmp[..size]))
+}
+
 struct WebSocketRead<'a, R: AsyncRead> {
     stream: ReadHalf<'a, R>,
     buf: &'a mut VecRingBuffer,
@@ -743,10 +799,52 @@ impl<W: AsyncWrite, M> Drop for SendMessageContentFuture<'_, '_, W, M> {
     }
 }
 
+struct SendMessageDirectFuture<'a, 'b, W: AsyncWrite, M> {
+    w: &'a RefCell<WebSocketWrite<'b, W>>,
+    protocol: &'a websocket::Protocol<M>,
+    opcode: u8,
+    src: &'a [u8],
+}
+
+impl<W: AsyncWrite, M: AsRef<[u8]> + AsMut<[u8]>> Future for SendMessageDirectFuture<'_, '_, W, M> {
+    type Output = Result<usize, Error>;
+
+    fn poll(self: Pin<&mut Self>, cx: &mut Context) -> Poll<Self::Output> {
+        let f = &*self;
+
+        let w = &mut *f.w.borrow_mut();
+
+        let stream = &mut w.stream;
+
+        if !stream.is_writable() {
+            return Poll::Pending;
+        }
+
+        match f.protocol.send_message_direct(
+            &mut StdWriteWrapper::new(Pin::new(&mut w.stream), cx),
+            f.opcode,
+            f.src,
+        ) {
+            Ok(size) => Poll::Ready(Ok(size)),
+            Err(websocket::Error::Io(e)) if e.kind() == io::ErrorKind::WouldBlock => Poll::Pending,
+            Err(e) => Poll::Ready(Err(e.into())),
+        }
+    }
+}
+
+impl<W: AsyncWrite, M> Drop for SendMessageDirectFuture<'_, '_, W, M> {
+    fn drop(&mut self) {
+        self.w.borrow_mut().stream.cancel();
+    }
+}
+
+// if a pool is provided, the buffers are given back to it whenever they
+// are empty, so that idle connections don't hold on to them
 struct WebSocketHandler<'a, R: AsyncRead, W: AsyncWrite> {
     r: RefCell<WebSocketRead<'a, R>>,
     w: RefCell<WebSocketWrite<'a, W>>,
     protocol: websocket::Protocol<Vec<u8>>,
+    pool: Option<&'a BufferPool>,
 }
 
 impl<'a, R: AsyncRead, W: AsyncWrite> WebSocketHandler<'a, R, W> {
@@ -755,6 +853,7 @@ impl<'a, R: AsyncRead, W: AsyncWrite> WebSocketHandler<'a, R, W> {
         buf1: &'a mut VecRingBuffer,
         buf2: &'a mut VecRingBuffer,
         deflate_config: Option<(bool, VecRingBuffer)>,
+        pool: Option<&'a BufferPool>,
     ) -> Self {
         buf2.clear();
 
@@ -771,6 +870,7 @@ impl<'a, R: AsyncRead, W: AsyncWrite> WebSocketHandler<'a, R, W> {
                 block_size,
             }),
             protocol: websocket::Protocol::new(deflate_config),
+            pool,
         }
     }
 
@@ -782,7 +882,14 @@ impl<'a, R: AsyncRead, W: AsyncWrite> WebSocketHandler<'a, R, W> {
     async fn add_to_recv_buffer(&self) -> Result<(), Error> {
         let r = &mut *self.r.borrow_mut();
 
-        if let Err(e) = recv_nonzero(&mut r.stream, r.buf).await {
+        let ret = match self.pool {
+            Some(pool) if r.buf.release(pool) => {
+                recv_nonzero_pooled(&mut r.stream, r.buf, pool).await
+            }
+            _ => recv_nonzero(&mut r.stream, r.buf).await,
+        };
+
+        if let Err(e) = ret {
             if e.kind() == io::ErrorKind::WriteZero {
                 return Err(Error::BufferExceeded);
             }
@@ -815,11 +922,21 @@ impl<'a, R: AsyncRead, W: AsyncWrite> WebSocketHandler<'a, R, W> {
         }
     }
 
+    fn acquire_write_buffer(&self) {
+        if let Some(pool) = self.pool {
+            self.w.borrow_mut().buf.acquire(pool);
+        }
+    }
+
     fn accept_avail(&self) -> usize {
+        self.acquire_write_buffer();
+
         self.w.borrow().buf.remaining_capacity()
     }
 
     fn accept_body(&self, body: &[u8]) -> Result<(), Error> {
+        self.acquire_write_buffer();
+
         let w = &mut *self.w.borrow_mut();
 
         w.buf.write_all(body)?;
@@ -827,6 +944,47 @@ impl<'a, R: AsyncRead, W: AsyncWrite> WebSocketHandler<'a, R, W> {
         Ok(())
     }
 
+    // attempts to send a whole message straight from src, which may be
+    // shared with other connections, instead of copying it into the write
+    // buffer. this is only possible when nothing else is waiting to be
+    // sent. returns None if nothing was written and the message should be
+    // queued as usual. otherwise returns the number of bytes written, and
+    // if the message is still in progress the rest must be queued with
+    // accept_body
+    async fn try_send_message_direct(
+        &self,
+        opcode: u8,
+        src: &[u8],
+    ) -> Option<Result<usize, Error>> {
+        {
+            let w = &*self.w.borrow();
+
+            // a released buffer is empty and of block size
+            let avail = if w.buf.capacity() > 0 {
+                w.buf.remaining_capacity()
+            } else {
+                w.block_size
+            };
+
+            if !self.protocol.can_send_direct() || w.buf.len() > 0 || src.len() > avail {
+                return None;
+            }
+        }
+
+        let fut = SendMessageDirectFuture {
+            w: &self.w,
+            protocol: &self.protocol,
+            opcode,
+            src,
+        };
+
+        // ABR: poll_async doesn't block
+        match poll_async(fut).await {
+            Poll::Ready(ret) => Some(ret),
+            Poll::Pending => None,
+        }
+    }
+
     fn expand_write_buffer(&self, blocks_max: usize, blocks_avail: &mut CounterDec) -> usize {
         let w = &mut *self.w.borrow_mut();
 
@@ -867,6 +1025,10 @@ impl<'a, R: AsyncRead, W: AsyncWrite> WebSocketHandler<'a, R, W> {
 
             w.buf.read_commit(size);
 
+            if let Some(pool) = self.pool {
+                w.buf.release(pool);
+            }
+
             bytes_sent();
 
             return Ok((size, done));
@@ -874,6 +1036,16 @@ impl<'a, R: AsyncRead, W: AsyncWrite> WebSocketHandler<'a, R, W> {
     }
 }
 
+impl<R: AsyncRead, W: AsyncWrite> Drop for WebSocketHandler<'_, R, W> {
+    fn drop(&mut self) {
+        // the caller owns the buffers and expects them to be usable
+        if let Some(pool) = self.pool {
+            self.r.get_mut().buf.acquire(pool);
+            self.w.get_mut().buf.acquire(pool);
+        }
+    }
+}
+
 struct ZhttpStreamSessionOut<'a> {
     instance_id: &'a str,
     id: &'a str,
@@ -2542,6 +2714,7 @@ async fn stream_websocket<S, R1, R2>(
     stream: RefCell<&mut S>,
     buf1: &mut VecRingBuffer,
     buf2: &mut VecRingBuffer,
+    buf_pool: Option<&BufferPool>,
     blocks_max: usize,
     blocks_avail: &mut CounterDec<'_>,
     messages_max: usize,
@@ -2565,7 +2738,7 @@ where
         None => None,
     };
 
-    let handler = WebSocketHandler::new(io_split(&stream), buf1, buf2, deflate_config);
+    let handler = WebSocketHandler::new(io_split(&stream), buf1, buf2, deflate_config, buf_pool);
     let mut ws_in_tracker = MessageTracker::new(messages_max);
 
     let mut out_credits = 0;
@@ -2724,12 +2897,41 @@ where
                 match &zresp.get().get().ptype {
                     zhttppacket::ResponsePacket::Data(rdata) => match handler.state() {
                         websocket::State::Connected | websocket::State::PeerClosed => {
+                            let opcode = match &rdata.content_type {
+                                Some(zhttppacket::ContentType::Binary) => websocket::OPCODE_BINARY,
+                                _ => websocket::OPCODE_TEXT,
+                            };
+
+                            let mut body = rdata.body;
+
+                            // a complete message with nothing queued ahead of it
+                            // can be written from the packet without copying. the
+                            // packet may be shared by many connections
+                            if !rdata.more && ws_in_tracker.current().is_none() {
+                                // ABR: poll_async doesn't block
+                                if let Some(ret) =
+                                    handler.try_send_message_direct(opcode, body).await
+                                {
+                                    let size = ret?;
+
+                                    bytes_read();
+
+                                    out_credits += size as u32;
+
+                                    if !handler.is_sending_message() {
+                                        continue;
+                                    }
+
+                                    body = &body[size..];
+                                }
+                            }
+
                             let avail = handler.accept_avail();
 
-                            if let Err(e) = handler.accept_body(rdata.body) {
+                            if let Err(e) = handler.accept_body(body) {
                                 warn!(
                                     "received too much data from handler (size={}, credits={})",
-                                    rdata.body.len(),
+                                    body.len(),
                                     avail,
                                 );
 
@@ -2739,18 +2941,13 @@ where
                             out_credits +=
                                 handler.expand_write_buffer(blocks_max, blocks_avail) as u32;
 
-                            let opcode = match &rdata.content_type {
-                                Some(zhttppacket::ContentType::Binary) => websocket::OPCODE_BINARY,
-                                _ => websocket::OPCODE_TEXT,
-                            };
-
                             if !ws_in_tracker.in_progress() {
                                 if ws_in_tracker.start(opcode).is_err() {
                                     return Err(Error::BufferExceeded);
                                 }
                             }
 
-                            ws_in_tracker.extend(rdata.body.len());
+                            ws_in_tracker.extend(body.len());
 
                             if !rdata.more {
                                 ws_in_tracker.done();
@@ -2911,7 +3108,7 @@ where
         None => None,
     };
 
-    let handler = WebSocketHandler::new(io_split(&stream), buf1, buf2, deflate_config);
+    let handler = WebSocketHandler::new(io_split(&stream), buf1, buf2, deflate_config, None);
     let mut ws_in_tracker = MessageTracker::new(messages_max);
 
     let mut out_credits = 0;
@@ -3796,6 +3993,7 @@ async fn server_stream_handler<S, R1, R2>(
     secure: bool,
     buf1: &mut VecRingBuffer,
     buf2: &mut VecRingBuffer,
+    buf_pool: Option<&BufferPool>,
     blocks_max: usize,
     blocks_avail: &mut CounterDec<'_>,
     messages_max: usize,
@@ -3946,6 +4144,7 @@ where
             stream,
             buf1,
             buf2,
+            buf_pool,
             blocks_max,
             blocks_avail,
             messages_max,
@@ -3986,9 +4185,10 @@ async fn server_stream_connection_inner<P: CidProvider, S: AsyncRead + AsyncWrit
     secure: bool,
     buffer_size: usize,
     blocks_max: usize,
-    blocks_avail: &Counter,
+    blocks_avail: &ShardedCounter,
     messages_max: usize,
     rb_tmp: &Rc<TmpBuffer>,
+    buf_pool: &BufferPool,
     packet_buf: Rc<RefCell<Vec<u8>>>,
     tmp_buf: Rc<RefCell<Vec<u8>>>,
     stream_timeout_duration: Duration,
@@ -4032,6 +4232,7 @@ async fn server_stream_connection_inner<P: CidProvider, S: AsyncRead + AsyncWrit
                 secure,
                 &mut buf1,
                 &mut buf2,
+                Some(buf_pool),
                 blocks_max,
                 &mut blocks_avail,
                 messages_max,
@@ -4146,9 +4347,10 @@ pub async fn server_stream_connection<P: CidProvider, S: AsyncRead + AsyncWrite
     secure: bool,
     buffer_size: usize,
     blocks_max: usize,
-    blocks_avail: &Counter,
+    blocks_avail: &ShardedCounter,
     messages_max: usize,
     rb_tmp: &Rc<TmpBuffer>,
+    buf_pool: &BufferPool,
     packet_buf: Rc<RefCell<Vec<u8>>>,
     tmp_buf: Rc<RefCell<Vec<u8>>>,
     timeout: Duration,
@@ -4176,6 +4378,7 @@ pub async fn server_stream_connection<P: CidProvider, S: AsyncRead + AsyncWrite
             blocks_avail,
             messages_max,
             rb_tmp,
+            buf_pool,
             packet_buf,
             tmp_buf,
             timeout,
@@ -4236,32 +4439,199 @@ impl ConnectionPoolKey {
     }
 }
 
+#[derive(Clone, Eq, Hash, PartialEq)]
+struct OriginKey {
+    host: String,
+    port: u16,
+}
+
+type OriginTotals = Arc<Mutex<HashMap<OriginKey, usize>>>;
+
+// holds a place in an origin's connection limit while a connection is open,
+// whether in use or idle in the pool
+pub struct OriginSlot {
+    totals: OriginTotals,
+    key: OriginKey,
+}
+
+impl OriginSlot {
+    fn acquire(totals: &OriginTotals, limits: PoolLimits, host: &str, port: u16) -> Option<Self> {
+        let key = OriginKey {
+            host: host.to_string(),
+            port,
+        };
+
+        let mut t = totals.lock().unwrap();
+
+        let count = t.entry(key.clone()).or_insert(0);
+
+        if *count >= limits.max_total {
+            return None;
+        }
+
+        *count += 1;
+
+        Some(Self {
+            totals: Arc::clone(totals),
+            key,
+        })
+    }
+}
+
+impl Drop for OriginSlot {
+    fn drop(&mut self) {
+        let mut t = self.totals.lock().unwrap();
+
+        let count = t.get_mut(&self.key).unwrap();
+        *count -= 1;
+
+        if *count == 0 {
+            t.remove(&self.key);
+        }
+    }
+}
+
+struct PooledStream {
+    stream: Stream,
+    slot: Option<OriginSlot>,
+}
+
+struct WarmOrigin {
+    last_used: Instant,
+    retry_after: Option<Instant>,
+}
+
+struct ConnectionPoolState {
+    pool: Pool<ConnectionPoolKey, PooledStream>,
+    warm: HashMap<ConnectionPoolKey, WarmOrigin>,
+}
+
+#[derive(Default)]
+struct ConnectionPoolCounters {
+    reused: AtomicU64,
+    missed: AtomicU64,
+    prewarmed: AtomicU64,
+    probe_closed: AtomicU64,
+    limited: AtomicU64,
+}
+
+#[derive(Clone, Copy, Debug, Default, Eq, PartialEq)]
+pub struct ConnectionPoolStats {
+    pub idle: usize,
+    pub warm_origins: usize,
+    pub reused: u64,
+    pub missed: u64,
+    pub prewarmed: u64,
+    pub probe_closed: u64,
+    pub limited: u64,
+}
+
+// a parked connection should have nothing to read. anything else, including
+// eof, means it can't be reused
+fn is_reusable(stream: &mut Stream) -> bool {
+    matches!(stream.read(&mut [0]), Err(e) if e.kind() == io::ErrorKind::WouldBlock)
+}
+
+fn preconnect(key: &ConnectionPoolKey, tls_config_cache: &TlsConfigCache) -> Result<Stream, Error> {
+    let stream = std::net::TcpStream::connect_timeout(&key.addr, PRECONNECT_TIMEOUT)?;
+    stream.set_nodelay(true)?;
+
+    if !key.tls {
+        stream.set_nonblocking(true)?;
+
+        return Ok(Stream::Plain(stream));
+    }
+
+    // the handshake is done blocking, bounded by the socket timeouts. only
+    // fully verified connections are made, so they are safe to hand to any
+    // request for the origin
+    stream.set_read_timeout(Some(PRECONNECT_TIMEOUT))?;
+    stream.set_write_timeout(Some(PRECONNECT_TIMEOUT))?;
+
+    let mut stream = match TlsStream::connect(
+        &key.host,
+        key.addr.port(),
+        stream,
+        VerifyMode::Full,
+        tls_config_cache,
+    ) {
+        Ok(stream) => stream,
+        Err(_) => return Err(Error::Tls),
+    };
+
+    if stream.ensure_handshake().is_err() {
+        return Err(Error::Tls);
+    }
+
+    let inner = stream.get_inner();
+    inner.set_read_timeout(None)?;
+    inner.set_write_timeout(None)?;
+    inner.set_nonblocking(true)?;
+
+    Ok(Stream::Tls(stream))
+}
+
 pub struct ConnectionPool {
-    inner: Arc<Mutex<Pool<ConnectionPoolKey, Stream>>>,
+    inner: Arc<Mutex<ConnectionPoolState>>,
+    totals: OriginTotals,
+    config: Arc<PoolConfig>,
+    counters: Arc<ConnectionPoolCounters>,
     thread: Option<thread::JoinHandle<()>>,
     done: Option<mpsc::SyncSender<()>>,
 }
 
 impl ConnectionPool {
-    pub fn new(capacity: usize) -> Self {
-        let inner = Arc::new(Mutex::new(Pool::<ConnectionPoolKey, Stream>::new(capacity)));
+    pub fn new(capacity: usize, config: PoolConfig, tls_config_cache: Arc<TlsConfigCache>) -> Self {
+        let inner = Arc::new(Mutex::new(ConnectionPoolState {
+            pool: Pool::new(capacity),
+            warm: HashMap::new(),
+        }));
+
+        let totals = Arc::new(Mutex::new(HashMap::new()));
+        let config = Arc::new(config);
+        let counters = Arc::new(ConnectionPoolCounters::default());
 
         let (s, r) = mpsc::sync_channel(1);
 
         let thread = {
             let inner = Arc::clone(&inner);
+            let totals = Arc::clone(&totals);
+            let config = Arc::clone(&config);
+            let counters = Arc::clone(&counters);
 
             thread::Builder::new()
                 .name("connection-pool".into())
                 .spawn(move || {
+                    let mut next_probe = Instant::now() + POOL_PROBE_INTERVAL;
+
                     while let Err(mpsc::RecvTimeoutError::Timeout) =
                         r.recv_timeout(Duration::from_secs(1))
                     {
                         let now = Instant::now();
 
-                        while let Some((key, _)) = inner.lock().unwrap().expire(now) {
+                        while let Some((key, _)) = inner.lock().unwrap().pool.expire(now) {
                             debug!("closing idle connection to {:?} for {}", key.addr, key.host);
                         }
+
+                        if now >= next_probe {
+                            let closed = inner
+                                .lock()
+                                .unwrap()
+                                .pool
+                                .retain(|_, p| is_reusable(&mut p.stream));
+
+                            if closed > 0 {
+                                debug!("closed {} broken idle connections", closed);
+
+                                counters
+                                    .probe_closed
+                                    .fetch_add(closed as u64, Ordering::Relaxed);
+                            }
+
+                            next_probe = now + POOL_PROBE_INTERVAL;
+                        }
+
+                        Self::prewarm(&inner, &totals, &config, &counters, &tls_config_cache);
                     }
                 })
                 .unwrap()
@@ -4269,11 +4639,52 @@ impl ConnectionPool {
 
         Self {
             inner,
+            totals,
+            config,
+            counters,
             thread: Some(thread),
             done: Some(s),
         }
     }
 
+    pub fn stats(&self) -> ConnectionPoolStats {
+        let (idle, warm_origins) = {
+            let state = self.inner.lock().unwrap();
+
+            (state.pool.len(), state.warm.len())
+        };
+
+        ConnectionPoolStats {
+            idle,
+            warm_origins,
+            reused: self.counters.reused.load(Ordering::Relaxed),
+            missed: self.counters.missed.load(Ordering::Relaxed),
+            prewarmed: self.counters.prewarmed.load(Ordering::Relaxed),
+            probe_closed: self.counters.probe_closed.load(Ordering::Relaxed),
+            limited: self.counters.limited.load(Ordering::Relaxed),
+        }
+    }
+
+    // reserves a place for a new connection to the origin. returns Err if
+    // the origin is at its max total
+    #[allow(clippy::result_unit_err)]
+    pub fn acquire(&self, host: &str, port: u16) -> Result<Option<OriginSlot>, ()> {
+        let limits = self.config.limits(host, port);
+
+        if limits.max_total == 0 {
+            return Ok(None);
+        }
+
+        match OriginSlot::acquire(&self.totals, limits, host, port) {
+            Some(slot) => Ok(Some(slot)),
+            None => {
+                self.counters.limited.fetch_add(1, Ordering::Relaxed);
+
+                Err(())
+            }
+        }
+    }
+
     #[allow(clippy::result_large_err)]
     fn push(
         &self,
@@ -4281,24 +4692,54 @@ impl ConnectionPool {
         tls: bool,
         host: String,
         stream: Stream,
+        slot: Option<OriginSlot>,
         ttl: Duration,
     ) -> Result<(), Stream> {
-        self.inner.lock().unwrap().add(
-            ConnectionPoolKey::new(addr, tls, host),
-            stream,
-            Instant::now() + ttl,
-        )
+        let limits = self.config.limits(&host, addr.port());
+        let key = ConnectionPoolKey::new(addr, tls, host);
+
+        let state = &mut *self.inner.lock().unwrap();
+
+        if limits.max_idle > 0 && state.pool.count(&key) >= limits.max_idle {
+            return Err(stream);
+        }
+
+        let now = Instant::now();
+
+        let p = PooledStream { stream, slot };
+
+        if let Err(p) = state.pool.add(key.clone(), p, now + ttl) {
+            return Err(p.stream);
+        }
+
+        if limits.min_warm > 0 {
+            let w = state.warm.entry(key).or_insert(WarmOrigin {
+                last_used: now,
+                retry_after: None,
+            });
+
+            w.last_used = now;
+        }
+
+        Ok(())
     }
 
-    fn take(&self, addr: std::net::SocketAddr, tls: bool, host: &str) -> Option<Stream> {
+    fn take(
+        &self,
+        addr: std::net::SocketAddr,
+        tls: bool,
+        host: &str,
+    ) -> Option<(Stream, Option<OriginSlot>)> {
         let key = ConnectionPoolKey::new(addr, tls, host.to_string());
 
-        // take the first connection that returns WouldBlock when attempting a read.
-        // anything else is considered an error and the connection is discarded
-        while let Some(mut stream) = self.inner.lock().unwrap().take(&key) {
-            match stream.read(&mut [0]) {
-                Err(e) if e.kind() == io::ErrorKind::WouldBlock => return Some(stream),
-                _ => {}
+        // take the most recently parked connection that returns WouldBlock
+        // when attempting a read. anything else is considered an error and
+        // the connection is discarded
+        while let Some(mut p) = self.inner.lock().unwrap().pool.take_newest(&key) {
+            if is_reusable(&mut p.stream) {
+                self.counters.reused.fetch_add(1, Ordering::Relaxed);
+
+                return Some((p.stream, p.slot));
             }
 
             debug!(
@@ -4307,8 +4748,104 @@ impl ConnectionPool {
             );
         }
 
+        self.counters.missed.fetch_add(1, Ordering::Relaxed);
+
         None
     }
+
+    // opens connections to recently used origins that have fewer idle
+    // connections than their min warm
+    fn prewarm(
+        inner: &Mutex<ConnectionPoolState>,
+        totals: &OriginTotals,
+        config: &PoolConfig,
+        counters: &ConnectionPoolCounters,
+        tls_config_cache: &TlsConfigCache,
+    ) {
+        let now = Instant::now();
+
+        let wanted: Vec<(ConnectionPoolKey, PoolLimits, usize)> = {
+            let state = &mut *inner.lock().unwrap();
+
+            state
+                .warm
+                .retain(|_, w| now.saturating_duration_since(w.last_used) < config.warm_timeout);
+
+            let mut wanted = Vec::new();
+
+            for (key, w) in state.warm.iter() {
+                if let Some(t) = w.retry_after {
+                    if now < t {
+                        continue;
+                    }
+                }
+
+                let limits = config.limits(&key.host, key.addr.port());
+                let count = state.pool.count(key);
+
+                if count < limits.min_warm {
+                    wanted.push((key.clone(), limits, limits.min_warm - count));
+                }
+            }
+
+            wanted
+        };
+
+        for (key, limits, count) in wanted {
+            for _ in 0..count {
+                if inner.lock().unwrap().pool.is_full() {
+                    return;
+                }
+
+                let slot = if limits.max_total > 0 {
+                    match OriginSlot::acquire(totals, limits, &key.host, key.addr.port()) {
+                        Some(slot) => Some(slot),
+                        None => break,
+                    }
+                } else {
+                    None
+                };
+
+                // connect without holding the lock
+                let stream = match preconnect(&key, tls_config_cache) {
+                    Ok(stream) => stream,
+                    Err(e) => {
+                        debug!(
+                            "failed to pre-connect to {:?} for {}: {:?}",
+                            key.addr, key.host, e
+                        );
+
+                        let state = &mut *inner.lock().unwrap();
+
+                        if let Some(w) = state.warm.get_mut(&key) {
+                            w.retry_after = Some(Instant::now() + PRECONNECT_RETRY);
+                        }
+
+                        break;
+                    }
+                };
+
+                let p = PooledStream { stream, slot };
+
+                let expires = Instant::now() + CONNECTION_POOL_TTL;
+
+                if inner
+                    .lock()
+                    .unwrap()
+                    .pool
+                    .add(key.clone(), p, expires)
+                    .is_err()
+                {
+                    // filled up while connecting
+                    return;
+                }
+
+                debug!("pre-connected to {:?} for {}", key.addr, key.host);
+
+                counters.prewarmed.fetch_add(1, Ordering::Relaxed);
+            }
+        }
+    }
 }
 
 impl Drop for ConnectionPool {
@@ -4340,7 +4877,15 @@ async fn client_connect<'a>(
     deny: &[IpNet],
     pool: &ConnectionPool,
     tls_waker_data: &'a RefWakerData<TlsWaker>,
-) -> Result<(std::net::SocketAddr, bool, AsyncStream<'a>), Error> {
+) -> Result<
+    (
+        std::net::SocketAddr,
+        bool,
+        AsyncStream<'a>,
+        Option<OriginSlot>,
+    ),
+    Error,
+> {
     let use_tls = ["https", "wss"].contains(&uri.scheme());
 
     let uri_host = match uri.host_str() {
@@ -4374,77 +4919,91 @@ async fn client_connect<'a>(
 
         let addr = std::net::SocketAddr::new(addr, connect_port);
 
-        if let Some(stream) = pool.take(addr, use_tls, uri_host) {
-            reuse_stream = Some((addr, stream));
+        if let Some((stream, slot)) = pool.take(addr, use_tls, uri_host) {
+            reuse_stream = Some((addr, stream, slot));
             break;
         }
 
         addrs.push(addr);
     }
 
-    let (peer_addr, mut stream, is_new) = if let Some((peer_addr, stream)) = reuse_stream {
-        debug!(
-            "client-conn {}: reusing connection to {:?}",
-            log_id, peer_addr,
-        );
+    let (peer_addr, mut stream, slot, is_new) =
+        if let Some((peer_addr, stream, slot)) = reuse_stream {
+            debug!(
+                "client-conn {}: reusing connection to {:?}",
+                log_id, peer_addr,
+            );
+
+            let stream = match stream {
+                Stream::Plain(stream) => AsyncStream::Plain(AsyncTcpStream::from_std(stream)),
+                Stream::Tls(stream) => {
+                    AsyncStream::Tls(AsyncTlsStream::from_std(stream, tls_waker_data))
+                }
+            };
 
-        let stream = match stream {
-            Stream::Plain(stream) => AsyncStream::Plain(AsyncTcpStream::from_std(stream)),
-            Stream::Tls(stream) => {
-                AsyncStream::Tls(AsyncTlsStream::from_std(stream, tls_waker_data))
+            (peer_addr, stream, slot, false)
+        } else {
+            if addrs.is_empty() && denied {
+                return Err(Error::PolicyViolation);
             }
-        };
 
-        (peer_addr, stream, false)
-    } else {
-        if addrs.is_empty() && denied {
-            return Err(Error::PolicyViolation);
-        }
+            let slot = match pool.acquire(uri_host, connect_port) {
+                Ok(slot) => slot,
+                Err(()) => {
+                    debug!(
+                        "client-conn {}: connection limit reached for {}:{}",
+                        log_id, uri_host, connect_port
+                    );
 
-        debug!("client-conn {}: connecting to one of {:?}", log_id, addrs);
+                    return Err(Error::ConnectionLimit);
+                }
+            };
 
-        let stream = AsyncTcpStream::connect(&addrs).await?;
+            debug!("client-conn {}: connecting to one of {:?}", log_id, addrs);
 
-        let peer_addr = stream.peer_addr()?;
+            let stream = AsyncTcpStream::connect(&addrs).await?;
 
-        debug!("client-conn {}: connected to {}", log_id, peer_addr);
+            let peer_addr = stream.peer_addr()?;
 
-        let stream = if use_tls {
-            let host = if rdata.trust_connect_host {
-                connect_host
-            } else {
-                uri_host
-            };
+            debug!("client-conn {}: connected to {}", log_id, peer_addr);
 
-            let verify_mode = if rdata.ignore_tls_errors {
-                VerifyMode::None
-            } else {
-                VerifyMode::Full
-            };
+            let stream = if use_tls {
+                let host = if rdata.trust_connect_host {
+                    connect_host
+                } else {
+                    uri_host
+                };
 
-            let stream = match AsyncTlsStream::connect(
-                host,
-                stream,
-                verify_mode,
-                tls_waker_data,
-                tls_config_cache,
-            ) {
-                Ok(stream) => stream,
-                Err(e) => {
-                    debug!("client-conn {}: tls connect error: {}", log_id, e);
+                let verify_mode = if rdata.ignore_tls_errors {
+                    VerifyMode::None
+                } else {
+                    VerifyMode::Full
+                };
 
-                    return Err(Error::Tls);
-                }
+                let stream = match AsyncTlsStream::connect(
+                    host,
+                    peer_addr.port(),
+                    stream,
+                    verify_mode,
+                    tls_waker_data,
+                    tls_config_cache,
+                ) {
+                    Ok(stream) => stream,
+                    Err(e) => {
+                        debug!("client-conn {}: tls connect error: {}", log_id, e);
+
+                        return Err(Error::Tls);
+                    }
+                };
+
+                AsyncStream::Tls(stream)
+            } else {
+                AsyncStream::Plain(stream)
             };
 
-            AsyncStream::Tls(stream)
-        } else {
-            AsyncStream::Plain(stream)
+            (peer_addr, stream, slot, true)
         };
 
-        (peer_addr, stream, true)
-    };
-
     if let AsyncStream::Tls(stream) = &mut stream {
         if stream.inner().set_id(log_id).is_err() {
             warn!("client-conn {}: log id too long for TlsStream", log_id);
@@ -4461,7 +5020,7 @@ async fn client_connect<'a>(
         }
     }
 
-    Ok((peer_addr, use_tls, stream))
+    Ok((peer_addr, use_tls, stream, slot))
 }
 
 // return Some if fully valid redirect response, else return None.
@@ -4760,7 +5319,7 @@ async fn client_req_connect(
 
         let tls_waker_data = RefWakerData::new(TlsWaker::new());
 
-        let (peer_addr, using_tls, mut stream) = client_connect(
+        let (peer_addr, using_tls, mut stream, slot) = client_connect(
             log_id,
             rdata,
             url,
@@ -4816,6 +5375,7 @@ async fn client_req_connect(
                     using_tls,
                     url_host.to_string(),
                     stream.into_inner(),
+                    slot,
                     CONNECTION_POOL_TTL,
                 )
                 .is_ok()
@@ -5501,7 +6061,7 @@ async fn client_stream_connect<E, R1, R2>(
     buf2: &mut VecRingBuffer,
     buffer_size: usize,
     blocks_max: usize,
-    blocks_avail: &Counter,
+    blocks_avail: &ShardedCounter,
     messages_max: usize,
     allow_compression: bool,
     packet_buf: &RefCell<Vec<u8>>,
@@ -5618,7 +6178,7 @@ where
 
         let tls_waker_data = RefWakerData::new(TlsWaker::new());
 
-        let (peer_addr, using_tls, mut stream) = {
+        let (peer_addr, using_tls, mut stream, slot) = {
             let mut client_connect = pin!(client_connect(
                 log_id,
                 rdata,
@@ -5706,6 +6266,7 @@ where
                     using_tls,
                     url_host.to_string(),
                     stream.into_inner(),
+                    slot,
                     CONNECTION_POOL_TTL,
                 )
                 .is_ok()
@@ -5743,7 +6304,7 @@ async fn client_stream_connection_inner<E>(
     zreq: arena::Rc<zhttppacket::OwnedRequest>,
     buffer_size: usize,
     blocks_max: usize,
-    blocks_avail: &Counter,
+    blocks_avail: &ShardedCounter,
     messages_max: usize,
     rb_tmp: &Rc<TmpBuffer>,
     packet_buf: Rc<RefCell<Vec<u8>>>,
@@ -5893,7 +6454,7 @@ pub async fn client_stream_connection<E>(
     zreq: arena::Rc<zhttppacket::OwnedRequest>,
     buffer_size: usize,
     blocks_max: usize,
-    blocks_avail: &Counter,
+    blocks_avail: &ShardedCounter,
     messages_max: usize,
     rb_tmp: &Rc<TmpBuffer>,
     packet_buf: Rc<RefCell<Vec<u8>>>,
@@ -5959,6 +6520,7 @@ pub mod testutil {
     use super::*;
     use crate::core::buffer::TmpBuffer;
     use crate::core::channel;
+    use crate::core::task::CancellationSender;
     use crate::core::waker;
     use std::fmt;
     use std::future::Future;
@@ -6445,11 +7007,26 @@ pub mod testutil {
         resp_mem: Rc<arena::RcMemory<zhttppacket::OwnedResponse>>,
         rb_tmp: Rc<TmpBuffer>,
         packet_buf: Rc<RefCell<Vec<u8>>>,
+        req_data: &'static [u8],
     }
 
     #[allow(clippy::new_without_default)]
     impl BenchServerReqConnection {
         pub fn new() -> Self {
+            Self::with_request(
+                concat!(
+                    "GET /path HTTP/1.1\r\n",
+                    "Host: example.com\r\n",
+                    "Connection: close\r\n",
+                    "\r\n"
+                )
+                .as_bytes(),
+            )
+        }
+
+        // the request must fit in the connection's read buffer, and must
+        // ask for the connection to be closed
+        pub fn with_request(req_data: &'static [u8]) -> Self {
             Self {
                 reactor: Reactor::new(100),
                 msg_mem: Arc::new(arena::ArcMemory::new(1)),
@@ -6457,6 +7034,7 @@ pub mod testutil {
                 resp_mem: Rc::new(arena::RcMemory::new(1)),
                 rb_tmp: Rc::new(TmpBuffer::new(1024)),
                 packet_buf: Rc::new(RefCell::new(vec![0; 2048])),
+                req_data,
             }
         }
 
@@ -6499,13 +7077,7 @@ pub mod testutil {
 
             assert_eq!(check_poll(executor.step()), None);
 
-            let req_data = concat!(
-                "GET /path HTTP/1.1\r\n",
-                "Host: example.com\r\n",
-                "Connection: close\r\n",
-                "\r\n"
-            )
-            .as_bytes();
+            let req_data = self.req_data;
 
             sock.borrow_mut().add_readable(req_data);
             sock.borrow_mut().allow_write(1024);
@@ -6578,8 +7150,9 @@ pub mod testutil {
             secure,
             buf1,
             buf2,
+            None,
             2,
-            &mut CounterDec::new(&Counter::new(0)),
+            &mut CounterDec::new(&ShardedCounter::new(0, 1)),
             10,
             false,
             &packet_buf,
@@ -6733,6 +7306,7 @@ pub mod testutil {
         s_stream_from_conn: channel::LocalSender<(ArrayVec<u8, 64>, zmq::Message)>,
         r_to_conn: channel::LocalReceiver<(arena::Rc<zhttppacket::OwnedResponse>, usize)>,
         rb_tmp: Rc<TmpBuffer>,
+        buf_pool: Rc<BufferPool>,
         packet_buf: Rc<RefCell<Vec<u8>>>,
         tmp_buf: Rc<RefCell<Vec<u8>>>,
         shared: arena::Rc<StreamSharedData>,
@@ -6747,7 +7321,7 @@ pub mod testutil {
         let r_to_conn = TrackedAsyncLocalReceiver::new(AsyncLocalReceiver::new(r_to_conn), &f);
         let s_from_conn = AsyncLocalSender::new(s_from_conn);
         let s_stream_from_conn = AsyncLocalSender::new(s_stream_from_conn);
-        let buffer_size = 1024;
+        let buffer_size = buf_pool.buffer_size();
 
         let timeout = Duration::from_millis(5_000);
 
@@ -6760,9 +7334,10 @@ pub mod testutil {
             secure,
             buffer_size,
             2,
-            &Counter::new(0),
+            &ShardedCounter::new(0, 1),
             10,
             &rb_tmp,
+            &buf_pool,
             packet_buf,
             tmp_buf,
             timeout,
@@ -6783,6 +7358,7 @@ pub mod testutil {
         resp_mem: Rc<arena::RcMemory<zhttppacket::OwnedResponse>>,
         shared_mem: Rc<arena::RcMemory<StreamSharedData>>,
         rb_tmp: Rc<TmpBuffer>,
+        buf_pool: Rc<BufferPool>,
         packet_buf: Rc<RefCell<Vec<u8>>>,
         tmp_buf: Rc<RefCell<Vec<u8>>>,
     }
@@ -6797,6 +7373,7 @@ pub mod testutil {
                 resp_mem: Rc::new(arena::RcMemory::new(1)),
                 shared_mem: Rc::new(arena::RcMemory::new(1)),
                 rb_tmp: Rc::new(TmpBuffer::new(1024)),
+                buf_pool: Rc::new(BufferPool::new(1024, 1)),
                 packet_buf: Rc::new(RefCell::new(vec![0; 2048])),
                 tmp_buf: Rc::new(RefCell::new(vec![0; 1024])),
             }
@@ -6813,6 +7390,7 @@ pub mod testutil {
             let resp_mem = &self.resp_mem;
             let shared_mem = &self.shared_mem;
             let rb_tmp = &self.rb_tmp;
+            let buf_pool = &self.buf_pool;
             let packet_buf = &self.packet_buf;
             let tmp_buf = &self.tmp_buf;
 
@@ -6839,6 +7417,7 @@ pub mod testutil {
                     s_stream_from_conn,
                     r_to_conn,
                     rb_tmp.clone(),
+                    buf_pool.clone(),
                     packet_buf.clone(),
                     tmp_buf.clone(),
                     shared,
@@ -6894,6 +7473,182 @@ pub mod testutil {
             assert_eq!(str::from_utf8(&data).unwrap(), expected);
         }
     }
+
+    type BoxConnectionFuture<'a> = Pin<Box<dyn Future<Output = Result<(), Error>> + 'a>>;
+
+    pub struct BenchServerWsBroadcastConnection<'a> {
+        executor: StepExecutor<'a, BoxConnectionFuture<'a>>,
+        sock: Rc<RefCell<FakeSock>>,
+        s_to_conn: channel::LocalSender<(arena::Rc<zhttppacket::OwnedResponse>, usize)>,
+        r_stream_from_conn: channel::LocalReceiver<(ArrayVec<u8, 64>, zmq::Message)>,
+        _cancel: CancellationSender,
+    }
+
+    pub struct BenchServerWsBroadcastArgs<'a> {
+        conns: Vec<BenchServerWsBroadcastConnection<'a>>,
+    }
+
+    impl BenchServerWsBroadcastArgs<'_> {
+        pub fn len(&self) -> usize {
+            self.conns.len()
+        }
+
+        pub fn is_empty(&self) -> bool {
+            self.conns.is_empty()
+        }
+    }
+
+    // websocket connections that have completed the handshake and then all
+    // receive the same message, the way handler publishes are delivered.
+    // the args can also be kept around to measure idle connection memory
+    pub struct BenchServerWsBroadcast {
+        count: usize,
+        reactor: Reactor,
+        msg_mem: Arc<arena::ArcMemory<zmq::Message>>,
+        scratch_mem: Rc<arena::RcMemory<RefCell<zhttppacket::ParseScratch<'static>>>>,
+        resp_mem: Rc<arena::RcMemory<zhttppacket::OwnedResponse>>,
+        shared_mem: Rc<arena::RcMemory<StreamSharedData>>,
+        rb_tmp: Rc<TmpBuffer>,
+        buf_pool: Rc<BufferPool>,
+        packet_buf: Rc<RefCell<Vec<u8>>>,
+        tmp_buf: Rc<RefCell<Vec<u8>>>,
+    }
+
+    impl BenchServerWsBroadcast {
+        pub fn new(count: usize) -> Self {
+            Self {
+                count,
+                reactor: Reactor::new(count * 32),
+                msg_mem: Arc::new(arena::ArcMemory::new(2)),
+                scratch_mem: Rc::new(arena::RcMemory::new(2)),
+                resp_mem: Rc::new(arena::RcMemory::new(2)),
+                shared_mem: Rc::new(arena::RcMemory::new(count)),
+                rb_tmp: Rc::new(TmpBuffer::new(1024)),
+                buf_pool: Rc::new(BufferPool::new(1024, count * 2)),
+                packet_buf: Rc::new(RefCell::new(vec![0; 2048])),
+                tmp_buf: Rc::new(RefCell::new(vec![0; 1024])),
+            }
+        }
+
+        fn make_resp(&self, msg: &[u8]) -> arena::Rc<zhttppacket::OwnedResponse> {
+            let msg = arena::Arc::new(zmq::Message::from(msg), &self.msg_mem).unwrap();
+
+            let scratch = arena::Rc::new(
+                RefCell::new(zhttppacket::ParseScratch::new()),
+                &self.scratch_mem,
+            )
+            .unwrap();
+
+            let resp = zhttppacket::OwnedResponse::parse(msg, 0, scratch).unwrap();
+
+            arena::Rc::new(resp, &self.resp_mem).unwrap()
+        }
+
+        pub fn init(&self) -> BenchServerWsBroadcastArgs<'_> {
+            let reactor = &self.reactor;
+
+            let mut conns = Vec::with_capacity(self.count);
+
+            for _ in 0..self.count {
+                let sock = Rc::new(RefCell::new(FakeSock::new()));
+
+                let (s_to_conn, r_to_conn) =
+                    channel::local_channel(1, 1, &reactor.local_registration_memory());
+                let (s_from_conn, r_from_conn) =
+                    channel::local_channel(1, 1, &reactor.local_registration_memory());
+                let (s_stream_from_conn, r_stream_from_conn) =
+                    channel::local_channel(1, 1, &reactor.local_registration_memory());
+                let (cancel, token) = CancellationToken::new(&reactor.local_registration_memory());
+
+                let fut: BoxConnectionFuture = Box::pin(server_stream_connection_inner_fut(
+                    token,
+                    sock.clone(),
+                    false,
+                    s_from_conn,
+                    s_stream_from_conn,
+                    r_to_conn,
+                    self.rb_tmp.clone(),
+                    self.buf_pool.clone(),
+                    self.packet_buf.clone(),
+                    self.tmp_buf.clone(),
+                    arena::Rc::new(StreamSharedData::new(), &self.shared_mem).unwrap(),
+                ));
+
+                let mut executor = StepExecutor::new(reactor, fut);
+
+                let req_data = concat!(
+                    "GET /path HTTP/1.1\r\n",
+                    "Host: example.com\r\n",
+                    "Upgrade: websocket\r\n",
+                    "Sec-WebSocket-Version: 13\r\n",
+                    "Sec-WebSocket-Key: abcde\r\n",
+                    "\r\n"
+                )
+                .as_bytes();
+
+                sock.borrow_mut().add_readable(req_data);
+
+                assert_eq!(check_poll(executor.step()), None);
+
+                // request message
+                let _ = r_from_conn.try_recv().unwrap();
+
+                let msg = concat!(
+                    "T98:2:id,1:1,6:reason,19:Switching Protocols,3:seq,1:0#4:f",
+                    "rom,7:handler,4:code,3:101#7:credits,4:1024#}",
+                );
+
+                assert!(s_to_conn
+                    .try_send((self.make_resp(msg.as_bytes()), 0))
+                    .is_ok());
+
+                sock.borrow_mut().allow_write(1024);
+
+                assert_eq!(check_poll(executor.step()), None);
+
+                let data = sock.borrow_mut().take_writable();
+                assert!(data.starts_with(b"HTTP/1.1 101 "));
+
+                conns.push(BenchServerWsBroadcastConnection {
+                    executor,
+                    sock,
+                    s_to_conn,
+                    r_stream_from_conn,
+                    _cancel: cancel,
+                });
+            }
+
+            BenchServerWsBroadcastArgs { conns }
+        }
+
+        pub fn run(&self, args: &mut BenchServerWsBroadcastArgs) {
+            // no seq, so the same packet is valid for every connection
+            let msg = concat!(
+                "T64:4:from,7:handler,2:id,1:1,12:content-type,4:text,4:bo",
+                "dy,5:hello,}",
+            );
+
+            let resp = self.make_resp(msg.as_bytes());
+
+            for c in args.conns.iter_mut() {
+                assert!(c.s_to_conn.try_send((arena::Rc::clone(&resp), 0)).is_ok());
+            }
+
+            drop(resp);
+
+            for c in args.conns.iter_mut() {
+                c.sock.borrow_mut().allow_write(1024);
+
+                assert_eq!(check_poll(c.executor.step()), None);
+
+                let data = c.sock.borrow_mut().take_writable();
+                assert_eq!(data, b"\x81\x05hello");
+
+                // credits returned to the handler
+                while c.r_stream_from_conn.try_recv().is_ok() {}
+            }
+        }
+    }
 }
 
 #[cfg(test)]
@@ -7598,9 +8353,10 @@ mod tests {
             secure,
             buffer_size,
             3,
-            &Counter::new(1),
+            &ShardedCounter::new(1, 1),
             10,
             &rb_tmp,
+            &BufferPool::new(buffer_size, 1),
             packet_buf,
             tmp_buf,
             timeout,
@@ -9304,7 +10060,7 @@ mod tests {
             &mut buf1,
             &mut buf2,
             3,
-            &mut CounterDec::new(&Counter::new(1)),
+            &mut CounterDec::new(&ShardedCounter::new(1, 1)),
             10,
             allow_compression,
             &tmp_buf,
@@ -10419,6 +11175,107 @@ mod tests {
         assert_eq!(str::from_utf8(&content).unwrap(), "world");
     }
 
+    #[test]
+    fn connection_pool_limits() {
+        let listener = std::net::TcpListener::bind("127.0.0.1:0").unwrap();
+        let addr = listener.local_addr().unwrap();
+
+        let limits = PoolLimits {
+            max_idle: 1,
+            min_warm: 0,
+            max_total: 2,
+        };
+
+        let config = PoolConfig {
+            origins: vec![("example.com".to_string(), limits)],
+            ..Default::default()
+        };
+
+        let pool = ConnectionPool::new(10, config, Arc::new(TlsConfigCache::new()));
+
+        let connect = || {
+            let stream = std::net::TcpStream::connect(addr).unwrap();
+            stream.set_nonblocking(true).unwrap();
+
+            Stream::Plain(stream)
+        };
+
+        // origins without overrides are not limited
+        assert!(pool.acquire("other.com", addr.port()).unwrap().is_none());
+
+        let slot1 = pool.acquire("example.com", addr.port()).unwrap();
+        let slot2 = pool.acquire("example.com", addr.port()).unwrap();
+        assert!(slot1.is_some());
+        assert!(slot2.is_some());
+        assert!(pool.acquire("example.com", addr.port()).is_err());
+
+        let ttl = Duration::from_secs(60);
+
+        assert!(pool
+            .push(addr, false, "example.com".into(), connect(), slot1, ttl)
+            .is_ok());
+
+        // only one idle connection is kept, and the rejected one gives
+        // back its place
+        assert!(pool
+            .push(addr, false, "example.com".into(), connect(), slot2, ttl)
+            .is_err());
+        assert!(pool.acquire("example.com", addr.port()).unwrap().is_some());
+
+        let (_, slot) = pool.take(addr, false, "example.com").unwrap();
+        assert!(slot.is_some());
+        assert!(pool.take(addr, false, "example.com").is_none());
+
+        let stats = pool.stats();
+        assert_eq!(stats.reused, 1);
+        assert_eq!(stats.missed, 1);
+        assert_eq!(stats.limited, 1);
+    }
+
+    #[test]
+    fn connection_pool_prewarm() {
+        let listener = std::net::TcpListener::bind("127.0.0.1:0").unwrap();
+        let addr = listener.local_addr().unwrap();
+
+        let config = PoolConfig {
+            default: PoolLimits {
+                min_warm: 2,
+                ..Default::default()
+            },
+            ..Default::default()
+        };
+
+        let tls_config_cache = Arc::new(TlsConfigCache::new());
+        let pool = ConnectionPool::new(10, config, Arc::clone(&tls_config_cache));
+
+        let stream = std::net::TcpStream::connect(addr).unwrap();
+        stream.set_nonblocking(true).unwrap();
+
+        // using the origin marks it to be kept warm
+        assert!(pool
+            .push(
+                addr,
+                false,
+                "example.com".into(),
+                Stream::Plain(stream),
+                None,
+                Duration::from_secs(60)
+            )
+            .is_ok());
+
+        ConnectionPool::prewarm(
+            &pool.inner,
+            &pool.totals,
+            &pool.config,
+            &pool.counters,
+            &tls_config_cache,
+        );
+
+        let key = ConnectionPoolKey::new(addr, false, "example.com".into());
+        assert_eq!(pool.inner.lock().unwrap().pool.count(&key), 2);
+        assert_eq!(pool.stats().prewarmed, 1);
+    }
+
     #[test]
     fn bench_server_req_handler() {
         let t = BenchServerReqHandler::new();
@@ -10442,4 +11299,13 @@ mod tests {
         let t = BenchServerStreamConnection::new();
         t.run(&mut t.init());
     }
+
+    #[test]
+    fn bench_server_ws_broadcast() {
+        let t = BenchServerWsBroadcast::new(4);
+        let mut args = t.init();
+        assert_eq!(args.len(), 4);
+        t.run(&mut args);
+        t.run(&mut args);
+    }
 }
@@ -16,6 +16,10 @@
 
 use std::sync::atomic::{AtomicUsize, Ordering};
 
+// shards are aligned to this size so that each sits on its own cache line.
+// 128 rather than 64 since some cpus prefetch cache lines in pairs
+const SHARD_ALIGN: usize = 128;
+
 #[derive(Debug)]
 pub struct CounterError;
 
@@ -76,15 +80,147 @@ impl Counter {
 
         Ok(())
     }
+
+    pub fn value(&self) -> usize {
+        self.0.load(Ordering::Relaxed)
+    }
+
+    // decrements by up to max, returning the amount taken
+    fn take(&self, max: usize) -> usize {
+        let mut value = self.0.load(Ordering::Relaxed);
+
+        loop {
+            let amount = value.min(max);
+
+            if amount == 0 {
+                return 0;
+            }
+
+            match self.0.compare_exchange_weak(
+                value,
+                value - amount,
+                Ordering::Relaxed,
+                Ordering::Relaxed,
+            ) {
+                Ok(_) => return amount,
+                Err(v) => value = v,
+            }
+        }
+    }
+}
+
+static NEXT_SHARD_INDEX: AtomicUsize = AtomicUsize::new(0);
+
+thread_local! {
+    // assigned round-robin on first use, so that worker threads started
+    // together land on different shards
+    static SHARD_INDEX: usize = NEXT_SHARD_INDEX.fetch_add(1, Ordering::Relaxed);
+}
+
+#[repr(align(128))]
+struct Shard(Counter);
+
+const _: () = assert!(std::mem::align_of::<Shard>() == SHARD_ALIGN);
+
+/// A Counter split into per-thread shards, each on its own cache line, so that threads adjusting
+/// the count don't contend with each other in the common case. A thread decrements from its own
+/// shard first, and only takes from the other shards when its own doesn't have enough.
+/// Increments always go to the calling thread's shard.
+///
+/// The total across all shards must fit in a usize.
+pub struct ShardedCounter {
+    shards: Box<[Shard]>,
+}
+
+impl ShardedCounter {
+    /// Creates a counter with the given number of shards, typically one per worker thread. The
+    /// initial value is spread evenly across the shards.
+    pub fn new(value: usize, shards: usize) -> Self {
+        let shards = shards.max(1);
+
+        let per_shard = value / shards;
+        let remainder = value % shards;
+
+        let shards = (0..shards)
+            .map(|i| Shard(Counter::new(per_shard + if i < remainder { 1 } else { 0 })))
+            .collect();
+
+        Self { shards }
+    }
+
+    fn home(&self) -> usize {
+        SHARD_INDEX.with(|i| *i) % self.shards.len()
+    }
+
+    pub fn inc(&self, amount: usize) -> Result<(), CounterError> {
+        self.shards[self.home()].0.inc(amount)
+    }
+
+    pub fn dec(&self, amount: usize) -> Result<(), CounterError> {
+        let home = self.home();
+
+        if self.shards[home].0.dec(amount).is_ok() {
+            return Ok(());
+        }
+
+        self.dec_slow(home, amount)
+    }
+
+    #[cold]
+    fn dec_slow(&self, home: usize, amount: usize) -> Result<(), CounterError> {
+        let count = self.shards.len();
+        let mut taken = 0;
+
+        // start with the home shard, in case it was refilled after the fast
+        // path failed, then go around the others
+        for i in 0..count {
+            taken += self.shards[(home + i) % count].0.take(amount - taken);
+
+            if taken == amount {
+                return Ok(());
+            }
+        }
+
+        // not enough in total. put back what was taken
+        if taken > 0 {
+            assert!(self.shards[home].0.inc(taken).is_ok());
+        }
+
+        Err(CounterError)
+    }
+
+    /// Returns the sum of the shards from a single pass. This is cheap, but if other threads are
+    /// moving amounts between shards at the same time, the result may be off by those amounts.
+    pub fn approx_value(&self) -> usize {
+        self.shards.iter().map(|s| s.0.value()).sum()
+    }
+
+    /// Returns the sum of the shards, repeating passes until two in a row agree. The result is
+    /// exact whenever the counter is not being changed, and is a value the counter actually held
+    /// at some point when changes are infrequent. This can spin for a while under heavy
+    /// contention, so it is meant for reporting rather than hot paths.
+    pub fn value(&self) -> usize {
+        let mut prev = self.approx_value();
+
+        loop {
+            let cur = self.approx_value();
+
+            if cur == prev {
+                return cur;
+            }
+
+            prev = cur;
+        }
+    }
 }
 
 pub struct CounterDec<'a> {
-    counter: &'a Counter,
+    counter: &'a ShardedCounter,
     amount: usize,
 }
 
 impl<'a> CounterDec<'a> {
-    pub fn new(counter: &'a Counter) -> Self {
+    pub fn new(counter: &'a ShardedCounter) -> Self {
         Self { counter, amount: 0 }
     }
 
@@ -105,6 +241,8 @@ impl Drop for CounterDec<'_> {
 #[cfg(test)]
 mod tests {
     use super::*;
+    use std::sync::Arc;
+    use std::thread;
 
     #[test]
     fn counter() {
@@ -122,9 +260,57 @@ mod tests {
         assert!(c.inc(1).is_err());
     }
 
+    #[test]
+    fn sharded_counter() {
+        let c = ShardedCounter::new(5, 3);
+        assert_eq!(c.shards.len(), 3);
+        assert_eq!(c.value(), 5);
+
+        // takes from other shards when the home shard runs out
+        assert!(c.dec(4).is_ok());
+        assert_eq!(c.value(), 1);
+
+        // a failed dec leaves the value unchanged
+        assert!(c.dec(2).is_err());
+        assert_eq!(c.value(), 1);
+
+        assert!(c.dec(1).is_ok());
+        assert!(c.dec(1).is_err());
+        assert_eq!(c.approx_value(), 0);
+
+        assert!(c.inc(3).is_ok());
+        assert!(c.dec(3).is_ok());
+        assert_eq!(c.value(), 0);
+    }
+
+    #[test]
+    fn sharded_counter_threads() {
+        let c = Arc::new(ShardedCounter::new(100, 4));
+
+        let threads: Vec<_> = (0..8)
+            .map(|_| {
+                let c = Arc::clone(&c);
+
+                thread::spawn(move || {
+                    for _ in 0..1000 {
+                        if c.dec(3).is_ok() {
+                            assert!(c.inc(3).is_ok());
+                        }
+                    }
+                })
+            })
+            .collect();
+
+        for t in threads {
+            t.join().unwrap();
+        }
+
+        assert_eq!(c.value(), 100);
+    }
+
     #[test]
     fn counter_dec() {
-        let c = Counter::new(2);
+        let c = ShardedCounter::new(2, 2);
 
         {
             let mut c = CounterDec::new(&c);
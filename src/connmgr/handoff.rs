@@ -0,0 +1,427 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// hot restart support. a running instance serves its listening sockets on
+// a unix socket, and a new instance started with the same path takes them
+// over with SCM_RIGHTS instead of binding, so no incoming connection is
+// refused during an upgrade. once the new instance reports that it is
+// accepting, the old one is told to stop. connections already established
+// are not passed on, and close with the old instance as on any stop
+//
+// each message is a SOCK_SEQPACKET packet. the old instance sends one
+// "L<key>" packet per socket with the descriptor attached, then "E". the
+// new instance replies "R" when ready
+
+use log::{debug, info, warn};
+use socket2::{Domain, SockAddr, Socket, Type};
+use std::collections::HashMap;
+use std::fs;
+use std::io;
+use std::mem;
+use std::net::Shutdown;
+use std::os::unix::io::{AsRawFd, FromRawFd, OwnedFd, RawFd};
+use std::path::{Path, PathBuf};
+use std::ptr;
+use std::sync::{Arc, Mutex};
+use std::thread;
+use std::time::Duration;
+
+const PACKET_MAX: usize = 4096;
+const TIMEOUT: Duration = Duration::from_secs(10);
+
+fn send_packet(sock: &Socket, data: &[u8], fd: Option<RawFd>) -> io::Result<()> {
+    let mut iov = libc::iovec {
+        iov_base: data.as_ptr() as *mut libc::c_void,
+        iov_len: data.len(),
+    };
+
+    // room for one descriptor
+    let mut cmsg_buf = [0u64; 4];
+
+    let mut msg: libc::msghdr = unsafe { mem::zeroed() };
+    msg.msg_iov = &mut iov;
+    msg.msg_iovlen = 1;
+
+    if let Some(fd) = fd {
+        // SAFETY: the buffer is large enough for one descriptor, and the
+        // header is set up by the CMSG functions
+        unsafe {
+            let space = libc::CMSG_SPACE(mem::size_of::<RawFd>() as u32) as usize;
+            assert!(space <= mem::size_of_val(&cmsg_buf));
+
+            msg.msg_control = cmsg_buf.as_mut_ptr() as *mut libc::c_void;
+            msg.msg_controllen = space as _;
+
+            let cmsg = libc::CMSG_FIRSTHDR(&msg);
+            (*cmsg).cmsg_level = libc::SOL_SOCKET;
+            (*cmsg).cmsg_type = libc::SCM_RIGHTS;
+            (*cmsg).cmsg_len = libc::CMSG_LEN(mem::size_of::<RawFd>() as u32) as _;
+            ptr::write_unaligned(libc::CMSG_DATA(cmsg) as *mut RawFd, fd);
+        }
+    }
+
+    // SAFETY: msg points to valid buffers for the duration of the call
+    let ret = unsafe { libc::sendmsg(sock.as_raw_fd(), &msg, libc::MSG_NOSIGNAL) };
+
+    if ret < 0 {
+        return Err(io::Error::last_os_error());
+    }
+
+    Ok(())
+}
+
+// returns the packet size and any descriptor attached. a size of zero
+// means the peer closed the connection
+fn recv_packet(sock: &Socket, buf: &mut [u8]) -> io::Result<(usize, Option<OwnedFd>)> {
+    let mut iov = libc::iovec {
+        iov_base: buf.as_mut_ptr() as *mut libc::c_void,
+        iov_len: buf.len(),
+    };
+
+    let mut cmsg_buf = [0u64; 4];
+
+    let mut msg: libc::msghdr = unsafe { mem::zeroed() };
+    msg.msg_iov = &mut iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cmsg_buf.as_mut_ptr() as *mut libc::c_void;
+    msg.msg_controllen = mem::size_of_val(&cmsg_buf) as _;
+
+    // SAFETY: msg points to valid buffers for the duration of the call
+    let ret = unsafe { libc::recvmsg(sock.as_raw_fd(), &mut msg, libc::MSG_CMSG_CLOEXEC) };
+
+    if ret < 0 {
+        return Err(io::Error::last_os_error());
+    }
+
+    let mut fd = None;
+
+    // SAFETY: the control data was filled in by the kernel
+    unsafe {
+        let mut cmsg = libc::CMSG_FIRSTHDR(&msg);
+
+        while !cmsg.is_null() {
+            if (*cmsg).cmsg_level == libc::SOL_SOCKET && (*cmsg).cmsg_type == libc::SCM_RIGHTS {
+                let raw = ptr::read_unaligned(libc::CMSG_DATA(cmsg) as *const RawFd);
+
+                // take ownership so the descriptor is closed if unused
+                let owned = OwnedFd::from_raw_fd(raw);
+
+                if fd.is_none() {
+                    fd = Some(owned);
+                }
+            }
+
+            cmsg = libc::CMSG_NXTHDR(&msg, cmsg);
+        }
+    }
+
+    if msg.msg_flags & (libc::MSG_TRUNC | libc::MSG_CTRUNC) != 0 {
+        return Err(io::Error::new(
+            io::ErrorKind::InvalidData,
+            "handoff packet truncated",
+        ));
+    }
+
+    Ok((ret as usize, fd))
+}
+
+fn new_seqpacket() -> io::Result<Socket> {
+    // descriptors are created with close-on-exec set
+    Socket::new(Domain::UNIX, Type::from(libc::SOCK_SEQPACKET), None)
+}
+
+// sends the sockets and waits for the peer to be ready
+fn serve_one(sock: &Socket, sockets: &[(String, OwnedFd)]) -> io::Result<()> {
+    sock.set_read_timeout(Some(TIMEOUT))?;
+    sock.set_write_timeout(Some(TIMEOUT))?;
+
+    for (key, fd) in sockets {
+        let mut data = b"L".to_vec();
+        data.extend_from_slice(key.as_bytes());
+
+        send_packet(sock, &data, Some(fd.as_raw_fd()))?;
+    }
+
+    send_packet(sock, b"E", None)?;
+
+    let mut buf = [0; 16];
+    let (size, _) = recv_packet(sock, &mut buf)?;
+
+    if &buf[..size] != b"R" {
+        return Err(io::Error::new(
+            io::ErrorKind::InvalidData,
+            "peer did not become ready",
+        ));
+    }
+
+    Ok(())
+}
+
+struct ServerState {
+    stopping: bool,
+    done: Option<Box<dyn FnOnce() + Send>>,
+}
+
+// serves the given sockets to the next instance. on_done is called at most
+// once, after an instance has taken them over and is accepting
+pub struct HandoffServer {
+    listener: Arc<Socket>,
+    state: Arc<Mutex<ServerState>>,
+    thread: Option<thread::JoinHandle<()>>,
+}
+
+impl HandoffServer {
+    pub fn new<F>(path: &Path, sockets: Vec<(String, OwnedFd)>, on_done: F) -> io::Result<Self>
+    where
+        F: FnOnce() + Send + 'static,
+    {
+        // the path may be left over from an instance that handed off
+        match fs::remove_file(path) {
+            Ok(()) => {}
+            Err(e) if e.kind() == io::ErrorKind::NotFound => {}
+            Err(e) => return Err(e),
+        }
+
+        let listener = new_seqpacket()?;
+        listener.bind(&SockAddr::unix(path)?)?;
+        listener.listen(1)?;
+
+        let listener = Arc::new(listener);
+
+        let state = Arc::new(Mutex::new(ServerState {
+            stopping: false,
+            done: Some(Box::new(on_done)),
+        }));
+
+        let thread = {
+            let listener = Arc::clone(&listener);
+            let state = Arc::clone(&state);
+
+            thread::Builder::new()
+                .name("handoff".to_string())
+                .spawn(move || loop {
+                    let sock = match listener.accept() {
+                        Ok((sock, _)) => sock,
+                        Err(e) => {
+                            if !state.lock().unwrap().stopping {
+                                warn!("handoff accept failed: {}", e);
+                            }
+
+                            break;
+                        }
+                    };
+
+                    match serve_one(&sock, &sockets) {
+                        Ok(()) => {
+                            info!("listening sockets handed off");
+
+                            let done = state.lock().unwrap().done.take();
+                            if let Some(f) = done {
+                                f();
+                            }
+
+                            break;
+                        }
+                        Err(e) => warn!("handoff failed: {}", e),
+                    }
+                })?
+        };
+
+        Ok(Self {
+            listener,
+            state,
+            thread: Some(thread),
+        })
+    }
+}
+
+impl Drop for HandoffServer {
+    fn drop(&mut self) {
+        self.state.lock().unwrap().stopping = true;
+
+        // wakes the accept call
+        let _ = self.listener.shutdown(Shutdown::Both);
+
+        let thread = self.thread.take().unwrap();
+        thread.join().unwrap();
+    }
+}
+
+// sockets received from a running instance, keyed by listen spec
+pub struct Handoff {
+    sock: Socket,
+    sockets: HashMap<String, Vec<OwnedFd>>,
+}
+
+impl Handoff {
+    // returns None if there is no instance to take over from
+    pub fn take(path: &Path) -> io::Result<Option<Self>> {
+        let sock = new_seqpacket()?;
+
+        match sock.connect(&SockAddr::unix(path)?) {
+            Ok(()) => {}
+            Err(e)
+                if e.kind() == io::ErrorKind::NotFound
+                    || e.kind() == io::ErrorKind::ConnectionRefused =>
+            {
+                return Ok(None)
+            }
+            Err(e) => return Err(e),
+        }
+
+        sock.set_read_timeout(Some(TIMEOUT))?;
+        sock.set_write_timeout(Some(TIMEOUT))?;
+
+        let mut sockets: HashMap<String, Vec<OwnedFd>> = HashMap::new();
+        let mut buf = vec![0; PACKET_MAX];
+
+        loop {
+            let (size, fd) = recv_packet(&sock, &mut buf)?;
+
+            match (&buf[..size], fd) {
+                ([b'L', key @ ..], Some(fd)) => {
+                    let key = String::from_utf8_lossy(key).into_owned();
+                    sockets.entry(key).or_default().push(fd);
+                }
+                (b"E", None) => break,
+                _ => {
+                    return Err(io::Error::new(
+                        io::ErrorKind::InvalidData,
+                        "unexpected handoff packet",
+                    ))
+                }
+            }
+        }
+
+        debug!("received {} handoff keys", sockets.len());
+
+        Ok(Some(Self { sock, sockets }))
+    }
+
+    // removes and returns the sockets for a key
+    pub fn take_sockets(&mut self, key: &str) -> Vec<OwnedFd> {
+        self.sockets.remove(key).unwrap_or_default()
+    }
+
+    // tells the old instance to stop. any sockets not taken are closed
+    pub fn finish(self) -> io::Result<()> {
+        for key in self.sockets.keys() {
+            warn!("handoff socket {} not used", key);
+        }
+
+        send_packet(&self.sock, b"R", None)
+    }
+}
+
+pub fn tcp_key(addr: std::net::SocketAddr) -> String {
+    format!("tcp:{}", addr)
+}
+
+pub fn unix_key(path: &Path) -> String {
+    format!("unix:{}", path.display())
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::net::TcpListener;
+    use std::os::unix::io::AsFd;
+    use std::sync::mpsc;
+
+    fn test_path(name: &str) -> PathBuf {
+        std::env::temp_dir().join(format!("pushpin-handoff-{}-{}", std::process::id(), name))
+    }
+
+    #[test]
+    fn packets() {
+        let mut fds = [0; 2];
+        assert_eq!(
+            unsafe { libc::socketpair(libc::AF_UNIX, libc::SOCK_SEQPACKET, 0, fds.as_mut_ptr()) },
+            0
+        );
+
+        let a = unsafe { Socket::from_raw_fd(fds[0]) };
+        let b = unsafe { Socket::from_raw_fd(fds[1]) };
+
+        let l = TcpListener::bind("127.0.0.1:0").unwrap();
+
+        send_packet(&a, b"one", Some(l.as_raw_fd())).unwrap();
+        send_packet(&a, b"two", None).unwrap();
+
+        let mut buf = [0; 16];
+
+        let (size, fd) = recv_packet(&b, &mut buf).unwrap();
+        assert_eq!(&buf[..size], b"one");
+
+        // the received descriptor refers to the same socket
+        let l2 = TcpListener::from(fd.unwrap());
+        assert_eq!(l2.local_addr().unwrap(), l.local_addr().unwrap());
+
+        // boundaries are kept
+        let (size, fd) = recv_packet(&b, &mut buf).unwrap();
+        assert_eq!(&buf[..size], b"two");
+        assert!(fd.is_none());
+
+        drop(a);
+        assert_eq!(recv_packet(&b, &mut buf).unwrap().0, 0);
+    }
+
+    #[test]
+    fn take_over() {
+        let path = test_path("take");
+
+        assert!(Handoff::take(&path).unwrap().is_none());
+
+        let l = TcpListener::bind("127.0.0.1:0").unwrap();
+        let addr = l.local_addr().unwrap();
+        let key = tcp_key(addr);
+
+        let sockets = vec![(key.clone(), l.as_fd().try_clone_to_owned().unwrap())];
+
+        let (done_s, done_r) = mpsc::channel();
+        let server = HandoffServer::new(&path, sockets, move || done_s.send(()).unwrap()).unwrap();
+
+        let mut h = Handoff::take(&path).unwrap().unwrap();
+
+        assert!(h.take_sockets("tcp:127.0.0.1:1").is_empty());
+
+        let mut fds = h.take_sockets(&key);
+        assert_eq!(fds.len(), 1);
+
+        let l2 = TcpListener::from(fds.pop().unwrap());
+        assert_eq!(l2.local_addr().unwrap(), addr);
+
+        // no notification until the new instance is ready
+        assert!(done_r.try_recv().is_err());
+
+        h.finish().unwrap();
+        done_r.recv_timeout(Duration::from_secs(5)).unwrap();
+
+        drop(server);
+        fs::remove_file(&path).unwrap();
+    }
+
+    #[test]
+    fn stop_unused() {
+        let path = test_path("unused");
+
+        let server =
+            HandoffServer::new(&path, Vec::new(), || panic!("unexpected handoff")).unwrap();
+        drop(server);
+
+        fs::remove_file(&path).unwrap();
+    }
+}
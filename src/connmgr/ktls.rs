@@ -0,0 +1,704 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// kernel TLS transmit offload. once a handshake completes, the keys for
+// outgoing records are handed to the kernel, and application data can then
+// be written to the socket as plaintext. receiving stays in userspace.
+//
+// openssl doesn't expose its record sequence numbers, so offload is only
+// attempted where they are known: 1 after a TLS 1.2 handshake (the Finished
+// message), and 0 after a TLS 1.3 handshake if no session tickets were sent.
+// for TLS 1.3, the traffic secret is obtained through the keylog callback.
+// as a consequence, listeners with offload don't issue TLS 1.3 session
+// tickets, and clients can't resume sessions with them.
+//
+// after offload, openssl must not write records of its own, since the
+// kernel would encrypt them again as application data. its writes are sent
+// to a read-only BIO instead, so that an attempt (for example an alert or
+// a KeyUpdate response) fails the connection rather than corrupting it
+
+use openssl::error::ErrorStack;
+use openssl::ex_data::Index;
+use openssl::hash::MessageDigest;
+use openssl::pkey::PKey;
+use openssl::sign::Signer;
+use openssl::ssl::{Ssl, SslRef, SslVersion};
+use std::cmp;
+use std::fmt;
+use std::io;
+use std::os::raw::{c_int, c_void};
+use std::os::unix::io::RawFd;
+use std::sync::{Mutex, OnceLock};
+
+const MASTER_SECRET_LEN: usize = 48;
+const RANDOM_LEN: usize = 32;
+const TLS12_FIXED_IV_LEN: usize = 4;
+const TLS13_IV_LEN: usize = 12;
+
+const SSL_KEY_UPDATE_NONE: c_int = -1;
+
+extern "C" {
+    fn BIO_new_mem_buf(buf: *const c_void, len: c_int) -> *mut c_void;
+    fn SSL_set0_wbio(s: *mut c_void, wbio: *mut c_void);
+    fn SSL_get_key_update_type(s: *const c_void) -> c_int;
+}
+
+#[derive(Debug)]
+pub enum Error {
+    UnsupportedVersion,
+    UnsupportedCipher,
+    MissingSecret,
+    Ssl(ErrorStack),
+    Io(io::Error),
+}
+
+impl fmt::Display for Error {
+    fn fmt(&self, f: &mut fmt::Formatter<'_>) -> fmt::Result {
+        match self {
+            Self::UnsupportedVersion => write!(f, "unsupported protocol version"),
+            Self::UnsupportedCipher => write!(f, "unsupported cipher"),
+            Self::MissingSecret => write!(f, "traffic secret not available"),
+            Self::Ssl(e) => write!(f, "{}", e),
+            Self::Io(e) => write!(f, "{}", e),
+        }
+    }
+}
+
+impl From<ErrorStack> for Error {
+    fn from(e: ErrorStack) -> Self {
+        Self::Ssl(e)
+    }
+}
+
+#[derive(Debug)]
+struct TxKeys {
+    tls13: bool,
+    key: Vec<u8>,
+
+    // for TLS 1.2, only the first 4 bytes (the implicit part) are used
+    iv: [u8; TLS13_IV_LEN],
+
+    seq: u64,
+}
+
+#[derive(Default)]
+struct Secret(Mutex<Option<Vec<u8>>>);
+
+fn secret_index() -> Result<Index<Ssl, Secret>, ErrorStack> {
+    static INDEX: OnceLock<Index<Ssl, Secret>> = OnceLock::new();
+
+    if let Some(index) = INDEX.get() {
+        return Ok(*index);
+    }
+
+    let index = Ssl::new_ex_index()?;
+
+    Ok(*INDEX.get_or_init(|| index))
+}
+
+fn hmac(md: MessageDigest, key: &[u8], parts: &[&[u8]]) -> Result<Vec<u8>, ErrorStack> {
+    let key = PKey::hmac(key)?;
+    let mut signer = Signer::new(md, &key)?;
+
+    for p in parts {
+        signer.update(p)?;
+    }
+
+    signer.sign_to_vec()
+}
+
+// the TLS 1.2 PRF (RFC 5246 section 5)
+fn prf(
+    md: MessageDigest,
+    secret: &[u8],
+    label: &[u8],
+    seed: &[u8],
+    out: &mut [u8],
+) -> Result<(), ErrorStack> {
+    let mut a = hmac(md, secret, &[label, seed])?;
+    let mut pos = 0;
+
+    while pos < out.len() {
+        let block = hmac(md, secret, &[&a, label, seed])?;
+        let size = cmp::min(block.len(), out.len() - pos);
+
+        out[pos..(pos + size)].copy_from_slice(&block[..size]);
+        pos += size;
+
+        a = hmac(md, secret, &[&a])?;
+    }
+
+    Ok(())
+}
+
+// HKDF-Expand-Label with an empty context (RFC 8446 section 7.1). the length
+// must not exceed the digest size
+fn hkdf_expand_label(
+    md: MessageDigest,
+    secret: &[u8],
+    label: &[u8],
+    len: usize,
+) -> Result<Vec<u8>, ErrorStack> {
+    assert!(len <= md.size());
+
+    let mut info = Vec::new();
+    info.extend_from_slice(&(len as u16).to_be_bytes());
+    info.push((label.len() + 6) as u8);
+    info.extend_from_slice(b"tls13 ");
+    info.extend_from_slice(label);
+    info.push(0);
+
+    let mut out = hmac(md, secret, &[&info, &[1]])?;
+    out.truncate(len);
+
+    Ok(out)
+}
+
+fn tls12_keys(
+    md: MessageDigest,
+    key_len: usize,
+    server: bool,
+    master: &[u8],
+    client_random: &[u8],
+    server_random: &[u8],
+) -> Result<TxKeys, ErrorStack> {
+    let mut seed = Vec::with_capacity(RANDOM_LEN * 2);
+    seed.extend_from_slice(server_random);
+    seed.extend_from_slice(client_random);
+
+    // AEAD ciphers have no mac keys, so the block is the client and server
+    // write keys followed by the client and server implicit ivs
+    let mut block = vec![0; (key_len + TLS12_FIXED_IV_LEN) * 2];
+    prf(md, master, b"key expansion", &seed, &mut block)?;
+
+    let (key_pos, iv_pos) = if server {
+        (key_len, (key_len * 2) + TLS12_FIXED_IV_LEN)
+    } else {
+        (0, key_len * 2)
+    };
+
+    let mut iv = [0; TLS13_IV_LEN];
+    iv[..TLS12_FIXED_IV_LEN].copy_from_slice(&block[iv_pos..(iv_pos + TLS12_FIXED_IV_LEN)]);
+
+    Ok(TxKeys {
+        tls13: false,
+        key: block[key_pos..(key_pos + key_len)].to_vec(),
+        iv,
+        seq: 1,
+    })
+}
+
+fn tls13_keys(md: MessageDigest, key_len: usize, secret: &[u8]) -> Result<TxKeys, ErrorStack> {
+    let key = hkdf_expand_label(md, secret, b"key", key_len)?;
+
+    let mut iv = [0; TLS13_IV_LEN];
+    iv.copy_from_slice(&hkdf_expand_label(md, secret, b"iv", TLS13_IV_LEN)?);
+
+    Ok(TxKeys {
+        tls13: true,
+        key,
+        iv,
+        seq: 0,
+    })
+}
+
+fn tx_keys(ssl: &SslRef) -> Result<TxKeys, Error> {
+    let cipher = match ssl.current_cipher() {
+        Some(cipher) => cipher,
+        None => return Err(Error::UnsupportedCipher),
+    };
+
+    let name = cipher.standard_name().unwrap_or("");
+
+    let key_len = if name.contains("_AES_128_GCM_") {
+        16
+    } else if name.contains("_AES_256_GCM_") {
+        32
+    } else {
+        return Err(Error::UnsupportedCipher);
+    };
+
+    let md = match cipher.handshake_digest() {
+        Some(md) => md,
+        None => return Err(Error::UnsupportedCipher),
+    };
+
+    match ssl.version2() {
+        Some(SslVersion::TLS1_2) => {
+            let session = match ssl.session() {
+                Some(session) => session,
+                None => return Err(Error::MissingSecret),
+            };
+
+            let mut master = [0; MASTER_SECRET_LEN];
+            let mut client_random = [0; RANDOM_LEN];
+            let mut server_random = [0; RANDOM_LEN];
+
+            if session.master_key(&mut master) != MASTER_SECRET_LEN
+                || ssl.client_random(&mut client_random) != RANDOM_LEN
+                || ssl.server_random(&mut server_random) != RANDOM_LEN
+            {
+                return Err(Error::MissingSecret);
+            }
+
+            Ok(tls12_keys(
+                md,
+                key_len,
+                ssl.is_server(),
+                &master,
+                &client_random,
+                &server_random,
+            )?)
+        }
+        Some(SslVersion::TLS1_3) => {
+            let secret = match ssl.ex_data(secret_index()?) {
+                Some(secret) => secret.0.lock().unwrap().take(),
+                None => None,
+            };
+
+            match secret {
+                Some(secret) => Ok(tls13_keys(md, key_len, &secret)?),
+                None => Err(Error::MissingSecret),
+            }
+        }
+        _ => Err(Error::UnsupportedVersion),
+    }
+}
+
+fn parse_hex(s: &str) -> Option<Vec<u8>> {
+    if s.len() % 2 != 0 {
+        return None;
+    }
+
+    (0..s.len())
+        .step_by(2)
+        .map(|i| u8::from_str_radix(s.get(i..(i + 2))?, 16).ok())
+        .collect()
+}
+
+// to be installed on every context a connection may use. it keeps the
+// secret for the connection's own direction, and only for connections that
+// were prepared for offload
+pub fn keylog_callback(ssl: &SslRef, line: &str) {
+    let index = match secret_index() {
+        Ok(index) => index,
+        Err(_) => return,
+    };
+
+    let secret = match ssl.ex_data(index) {
+        Some(secret) => secret,
+        None => return,
+    };
+
+    let label = if ssl.is_server() {
+        "SERVER_TRAFFIC_SECRET_0"
+    } else {
+        "CLIENT_TRAFFIC_SECRET_0"
+    };
+
+    let mut parts = line.split(' ');
+
+    if parts.next() != Some(label) {
+        return;
+    }
+
+    // skip the client random
+    parts.next();
+
+    if let Some(value) = parts.next().and_then(parse_hex) {
+        *secret.0.lock().unwrap() = Some(value);
+    }
+}
+
+// must be called before the handshake
+pub fn prepare(ssl: &mut SslRef) -> Result<(), ErrorStack> {
+    ssl.set_ex_data(secret_index()?, Secret::default());
+
+    // session tickets would be sent with the same keys, and there'd be no
+    // way to know how many records were written
+    if ssl.is_server() {
+        ssl.set_num_tickets(0)?;
+    }
+
+    Ok(())
+}
+
+#[cfg(target_os = "linux")]
+fn set_tx(fd: RawFd, keys: &TxKeys) -> Result<(), io::Error> {
+    fn setsockopt<T>(
+        fd: RawFd,
+        level: libc::c_int,
+        name: libc::c_int,
+        value: &T,
+    ) -> Result<(), io::Error> {
+        let ret = unsafe {
+            libc::setsockopt(
+                fd,
+                level,
+                name,
+                value as *const T as *const libc::c_void,
+                std::mem::size_of::<T>() as libc::socklen_t,
+            )
+        };
+
+        if ret != 0 {
+            return Err(io::Error::last_os_error());
+        }
+
+        Ok(())
+    }
+
+    let info = libc::tls_crypto_info {
+        version: if keys.tls13 {
+            libc::TLS_1_3_VERSION
+        } else {
+            libc::TLS_1_2_VERSION
+        },
+        cipher_type: 0,
+    };
+
+    let (salt, iv) = if keys.tls13 {
+        (&keys.iv[..4], keys.iv[4..].to_vec())
+    } else {
+        // the explicit part of the nonce is the sequence number
+        (&keys.iv[..4], keys.seq.to_be_bytes().to_vec())
+    };
+
+    let rec_seq = keys.seq.to_be_bytes();
+
+    // fails if the tls module isn't available
+    setsockopt(fd, libc::SOL_TCP, libc::TCP_ULP, b"tls")?;
+
+    if keys.key.len() == 16 {
+        let mut v = libc::tls12_crypto_info_aes_gcm_128 {
+            info: libc::tls_crypto_info {
+                cipher_type: libc::TLS_CIPHER_AES_GCM_128,
+                ..info
+            },
+            iv: [0; libc::TLS_CIPHER_AES_GCM_128_IV_SIZE],
+            key: [0; libc::TLS_CIPHER_AES_GCM_128_KEY_SIZE],
+            salt: [0; libc::TLS_CIPHER_AES_GCM_128_SALT_SIZE],
+            rec_seq,
+        };
+
+        v.iv.copy_from_slice(&iv);
+        v.key.copy_from_slice(&keys.key);
+        v.salt.copy_from_slice(salt);
+
+        setsockopt(fd, libc::SOL_TLS, libc::TLS_TX, &v)
+    } else {
+        let mut v = libc::tls12_crypto_info_aes_gcm_256 {
+            info: libc::tls_crypto_info {
+                cipher_type: libc::TLS_CIPHER_AES_GCM_256,
+                ..info
+            },
+            iv: [0; libc::TLS_CIPHER_AES_GCM_256_IV_SIZE],
+            key: [0; libc::TLS_CIPHER_AES_GCM_256_KEY_SIZE],
+            salt: [0; libc::TLS_CIPHER_AES_GCM_256_SALT_SIZE],
+            rec_seq,
+        };
+
+        v.iv.copy_from_slice(&iv);
+        v.key.copy_from_slice(&keys.key);
+        v.salt.copy_from_slice(salt);
+
+        setsockopt(fd, libc::SOL_TLS, libc::TLS_TX, &v)
+    }
+}
+
+#[cfg(not(target_os = "linux"))]
+fn set_tx(_fd: RawFd, _keys: &TxKeys) -> Result<(), io::Error> {
+    Err(io::Error::from(io::ErrorKind::Unsupported))
+}
+
+// hands the transmit keys of a completed handshake to the kernel. on error,
+// the connection can continue in userspace
+pub fn enable_tx(fd: RawFd, ssl: &SslRef) -> Result<(), Error> {
+    let keys = tx_keys(ssl)?;
+
+    if let Err(e) = set_tx(fd, &keys) {
+        return Err(Error::Io(e));
+    }
+
+    block_ssl_writes(ssl)?;
+
+    Ok(())
+}
+
+// replaces the write side of the ssl's BIO pair with a read-only memory
+// BIO, so that writes fail. the read side is left as it is
+fn block_ssl_writes(ssl: &SslRef) -> Result<(), Error> {
+    static EMPTY: [u8; 1] = [0];
+
+    // SAFETY: the buffer is static and the BIO is read-only, so it's never
+    // written to
+    let bio = unsafe { BIO_new_mem_buf(EMPTY.as_ptr() as *const c_void, 0) };
+    if bio.is_null() {
+        return Err(Error::Ssl(ErrorStack::get()));
+    }
+
+    // SAFETY: an SslRef is a pointer to the SSL object. the SSL takes
+    // ownership of the new BIO and releases its reference to the old one,
+    // which it holds separately for the read side
+    unsafe { SSL_set0_wbio(ssl as *const SslRef as *mut c_void, bio) };
+
+    Ok(())
+}
+
+// whether the peer sent a KeyUpdate asking for ours. the new keys would
+// have to go to the kernel, which isn't supported, so the connection
+// can't continue
+pub fn key_update_pending(ssl: &SslRef) -> bool {
+    // SAFETY: an SslRef is a pointer to the SSL object, and the call only
+    // reads it
+    unsafe { SSL_get_key_update_type(ssl as *const SslRef as *const c_void) != SSL_KEY_UPDATE_NONE }
+}
+
+// sends a close_notify alert on an offloaded socket
+#[cfg(target_os = "linux")]
+pub fn send_close_notify(fd: RawFd) -> Result<(), io::Error> {
+    const ALERT_RECORD_TYPE: u8 = 21;
+
+    // level warning, description close_notify
+    let data = [1u8, 0];
+
+    let mut iov = libc::iovec {
+        iov_base: data.as_ptr() as *mut libc::c_void,
+        iov_len: data.len(),
+    };
+
+    // u64 for cmsghdr alignment
+    let mut control = [0u64; 4];
+
+    let mut msg: libc::msghdr = unsafe { std::mem::zeroed() };
+    msg.msg_iov = &mut iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.as_mut_ptr() as *mut libc::c_void;
+    msg.msg_controllen = unsafe { libc::CMSG_SPACE(1) } as _;
+
+    unsafe {
+        let cmsg = libc::CMSG_FIRSTHDR(&msg);
+        (*cmsg).cmsg_level = libc::SOL_TLS;
+        (*cmsg).cmsg_type = libc::TLS_SET_RECORD_TYPE;
+        (*cmsg).cmsg_len = libc::CMSG_LEN(1) as _;
+        *libc::CMSG_DATA(cmsg) = ALERT_RECORD_TYPE;
+    }
+
+    if unsafe { libc::sendmsg(fd, &msg, 0) } < 0 {
+        return Err(io::Error::last_os_error());
+    }
+
+    Ok(())
+}
+
+#[cfg(not(target_os = "linux"))]
+pub fn send_close_notify(_fd: RawFd) -> Result<(), io::Error> {
+    Err(io::Error::from(io::ErrorKind::Unsupported))
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use openssl::asn1::Asn1Time;
+    use openssl::ec::{EcGroup, EcKey};
+    use openssl::nid::Nid;
+    use openssl::ssl::{SslAcceptor, SslConnector, SslMethod, SslVerifyMode};
+    use openssl::symm::{encrypt_aead, Cipher};
+    use openssl::x509::X509;
+    use std::io::{Read, Write};
+    use std::net::{TcpListener, TcpStream};
+    use std::thread;
+
+    // what the kernel would write for an application data record
+    fn encrypt_record(keys: &TxKeys, plaintext: &[u8]) -> Vec<u8> {
+        let cipher = if keys.key.len() == 16 {
+            Cipher::aes_128_gcm()
+        } else {
+            Cipher::aes_256_gcm()
+        };
+
+        let seq = keys.seq.to_be_bytes();
+        let mut tag = [0; 16];
+
+        let mut out = vec![23, 3, 3];
+
+        if keys.tls13 {
+            let mut nonce = keys.iv;
+            for (i, b) in seq.iter().enumerate() {
+                nonce[4 + i] ^= b;
+            }
+
+            let mut inner = plaintext.to_vec();
+            inner.push(23);
+
+            let len = ((inner.len() + tag.len()) as u16).to_be_bytes();
+            let aad = [23, 3, 3, len[0], len[1]];
+
+            let ct = encrypt_aead(cipher, &keys.key, Some(&nonce), &aad, &inner, &mut tag).unwrap();
+
+            out.extend_from_slice(&len);
+            out.extend_from_slice(&ct);
+        } else {
+            let mut nonce = keys.iv;
+            nonce[4..].copy_from_slice(&seq);
+
+            let len = (plaintext.len() as u16).to_be_bytes();
+
+            let mut aad = seq.to_vec();
+            aad.extend_from_slice(&[23, 3, 3, len[0], len[1]]);
+
+            let ct =
+                encrypt_aead(cipher, &keys.key, Some(&nonce), &aad, plaintext, &mut tag).unwrap();
+
+            out.extend_from_slice(&((8 + ct.len() + tag.len()) as u16).to_be_bytes());
+            out.extend_from_slice(&seq);
+            out.extend_from_slice(&ct);
+        }
+
+        out.extend_from_slice(&tag);
+
+        out
+    }
+
+    fn acceptor() -> SslAcceptor {
+        let group = EcGroup::from_curve_name(Nid::X9_62_PRIME256V1).unwrap();
+        let key = PKey::from_ec_key(EcKey::generate(&group).unwrap()).unwrap();
+
+        let mut cert = X509::builder().unwrap();
+        cert.set_pubkey(&key).unwrap();
+        cert.set_not_before(&Asn1Time::days_from_now(0).unwrap())
+            .unwrap();
+        cert.set_not_after(&Asn1Time::days_from_now(1).unwrap())
+            .unwrap();
+        cert.sign(&key, MessageDigest::sha256()).unwrap();
+        let cert = cert.build();
+
+        let mut acceptor = SslAcceptor::mozilla_intermediate_v5(SslMethod::tls()).unwrap();
+        acceptor.set_certificate(&cert).unwrap();
+        acceptor.set_private_key(&key).unwrap();
+        acceptor.set_keylog_callback(keylog_callback);
+
+        acceptor.build()
+    }
+
+    // derives the server's transmit keys after a handshake, writes a record
+    // encrypted with them directly to the socket, and checks that the
+    // client can read it
+    fn check_keys(version: SslVersion, cipher: &str) {
+        let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+        let addr = listener.local_addr().unwrap();
+
+        let server = thread::spawn(move || {
+            let acceptor = acceptor();
+
+            let (stream, _) = listener.accept().unwrap();
+
+            let mut ssl = Ssl::new(acceptor.context()).unwrap();
+            prepare(&mut ssl).unwrap();
+
+            let mut stream = ssl.accept(stream).unwrap();
+
+            let keys = tx_keys(stream.ssl()).unwrap();
+
+            let record = encrypt_record(&keys, b"hello");
+            stream.get_mut().write_all(&record).unwrap();
+
+            // wait for the client to finish
+            let mut buf = [0; 1];
+            let _ = stream.get_mut().read(&mut buf);
+        });
+
+        let mut connector = SslConnector::builder(SslMethod::tls()).unwrap();
+        connector.set_verify(SslVerifyMode::NONE);
+        connector.set_min_proto_version(Some(version)).unwrap();
+        connector.set_max_proto_version(Some(version)).unwrap();
+
+        if version == SslVersion::TLS1_3 {
+            connector.set_ciphersuites(cipher).unwrap();
+        } else {
+            connector.set_cipher_list(cipher).unwrap();
+        }
+
+        let connector = connector.build();
+
+        let stream = TcpStream::connect(addr).unwrap();
+        let mut stream = connector
+            .configure()
+            .unwrap()
+            .verify_hostname(false)
+            .connect("localhost", stream)
+            .unwrap();
+
+        let mut buf = [0; 16];
+        let size = stream.read(&mut buf).unwrap();
+        assert_eq!(&buf[..size], b"hello");
+
+        drop(stream);
+
+        server.join().unwrap();
+    }
+
+    #[test]
+    fn derive_tls12() {
+        check_keys(SslVersion::TLS1_2, "ECDHE-ECDSA-AES128-GCM-SHA256");
+        check_keys(SslVersion::TLS1_2, "ECDHE-ECDSA-AES256-GCM-SHA384");
+    }
+
+    #[test]
+    fn derive_tls13() {
+        check_keys(SslVersion::TLS1_3, "TLS_AES_128_GCM_SHA256");
+        check_keys(SslVersion::TLS1_3, "TLS_AES_256_GCM_SHA384");
+    }
+
+    #[test]
+    fn unsupported_cipher() {
+        let listener = TcpListener::bind("127.0.0.1:0").unwrap();
+        let addr = listener.local_addr().unwrap();
+
+        let server = thread::spawn(move || {
+            let acceptor = acceptor();
+
+            let (stream, _) = listener.accept().unwrap();
+
+            let mut ssl = Ssl::new(acceptor.context()).unwrap();
+            prepare(&mut ssl).unwrap();
+
+            let stream = ssl.accept(stream).unwrap();
+
+            assert!(matches!(
+                tx_keys(stream.ssl()),
+                Err(Error::UnsupportedCipher)
+            ));
+        });
+
+        let mut connector = SslConnector::builder(SslMethod::tls()).unwrap();
+        connector.set_verify(SslVerifyMode::NONE);
+        connector
+            .set_ciphersuites("TLS_CHACHA20_POLY1305_SHA256")
+            .unwrap();
+        let connector = connector.build();
+
+        let stream = TcpStream::connect(addr).unwrap();
+        let _stream = connector
+            .configure()
+            .unwrap()
+            .verify_hostname(false)
+            .connect("localhost", stream)
+            .unwrap();
+
+        server.join().unwrap();
+    }
+}
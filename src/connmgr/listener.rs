@@ -21,12 +21,147 @@ use crate::core::net::{AsyncNetListener, NetAcceptFuture, NetListener, NetStream
 use crate::core::reactor::Reactor;
 use crate::core::select::{select_2, select_slice, Select2};
 use log::{debug, error};
+use mio::net::{TcpListener, UnixListener};
+use socket2::{Domain, Socket, Type};
+use std::cell::Cell;
 use std::cmp;
-use std::sync::mpsc;
+use std::io;
+use std::mem;
+use std::os::unix::io::{AsFd, AsRawFd, RawFd};
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::sync::{mpsc, Arc};
 use std::thread;
 
 const REACTOR_REGISTRATIONS_MAX: usize = 128;
 const EXECUTOR_TASKS_MAX: usize = 1;
+const REUSEPORT_BACKLOG: i32 = 1024;
+
+fn setsockopt<T>(fd: RawFd, level: libc::c_int, name: libc::c_int, value: &T) -> io::Result<()> {
+    let ret = unsafe {
+        libc::setsockopt(
+            fd,
+            level,
+            name,
+            value as *const T as *const libc::c_void,
+            mem::size_of::<T>() as libc::socklen_t,
+        )
+    };
+
+    if ret != 0 {
+        return Err(io::Error::last_os_error());
+    }
+
+    Ok(())
+}
+
+// binds a listening socket with SO_REUSEPORT set. binding the same address
+// once per worker gives each worker its own accept queue, and the kernel
+// spreads incoming connections across them
+pub fn bind_reuseport(addr: std::net::SocketAddr) -> io::Result<TcpListener> {
+    let domain = if addr.is_ipv4() {
+        Domain::IPV4
+    } else {
+        Domain::IPV6
+    };
+
+    let socket = Socket::new(domain, Type::STREAM, None)?;
+
+    socket.set_reuse_address(true)?;
+    setsockopt(
+        socket.as_raw_fd(),
+        libc::SOL_SOCKET,
+        libc::SO_REUSEPORT,
+        &(1 as libc::c_int),
+    )?;
+
+    socket.bind(&addr.into())?;
+    socket.listen(REUSEPORT_BACKLOG)?;
+    socket.set_nonblocking(true)?;
+
+    Ok(TcpListener::from_std(socket.into()))
+}
+
+// attaches a classic BPF program to a reuseport group that picks the socket
+// at index (cpu % count), where cpu is the one handling the incoming packet.
+// sockets are indexed in the order they started listening. the program
+// applies to the whole group, so it only needs to be set on one member
+#[cfg(target_os = "linux")]
+pub fn set_cpu_steering(l: &TcpListener, count: usize) -> io::Result<()> {
+    let stmt = |code: u32, k: u32| libc::sock_filter {
+        code: code as u16,
+        jt: 0,
+        jf: 0,
+        k,
+    };
+
+    let mut code = [
+        stmt(
+            libc::BPF_LD | libc::BPF_W | libc::BPF_ABS,
+            (libc::SKF_AD_OFF + libc::SKF_AD_CPU) as u32,
+        ),
+        stmt(libc::BPF_ALU | libc::BPF_MOD | libc::BPF_K, count as u32),
+        stmt(libc::BPF_RET | libc::BPF_A, 0),
+    ];
+
+    let prog = libc::sock_fprog {
+        len: code.len() as u16,
+        filter: code.as_mut_ptr(),
+    };
+
+    setsockopt(
+        l.as_raw_fd(),
+        libc::SOL_SOCKET,
+        libc::SO_ATTACH_REUSEPORT_CBPF,
+        &prog,
+    )
+}
+
+#[cfg(not(target_os = "linux"))]
+pub fn set_cpu_steering(_l: &TcpListener, _count: usize) -> io::Result<()> {
+    Err(io::Error::from(io::ErrorKind::Unsupported))
+}
+
+// unix sockets have no reuseport equivalent, so workers share the same
+// listening socket through separate descriptors
+pub fn try_clone_unix(l: &UnixListener) -> io::Result<UnixListener> {
+    let fd = l.as_fd().try_clone_to_owned()?;
+
+    Ok(UnixListener::from_std(fd.into()))
+}
+
+// returns the position of the writable sender with the lowest load,
+// scanning from start so that ties are broken in round-robin order. returns
+// start if no sender is writable
+fn least_loaded<F>(loads: &[Arc<AtomicUsize>], start: usize, is_writable: F) -> usize
+where
+    F: Fn(usize) -> bool,
+{
+    let mut best: Option<(usize, usize)> = None;
+
+    for i in 0..loads.len() {
+        let pos = (start + i) % loads.len();
+
+        if !is_writable(pos) {
+            continue;
+        }
+
+        let load = loads[pos].load(Ordering::Relaxed);
+
+        let better = match best {
+            Some((_, best_load)) => load < best_load,
+            None => true,
+        };
+
+        if better {
+            best = Some((pos, load));
+        }
+    }
+
+    match best {
+        Some((pos, _)) => pos,
+        None => start,
+    }
+}
 
 pub struct Listener {
     thread: Option<thread::JoinHandle<()>>,
@@ -34,11 +169,17 @@ pub struct Listener {
 }
 
 impl Listener {
+    // loads, if not empty, has an entry per sender holding the number of
+    // connections the receiving worker currently has. connections are then
+    // handed to the least loaded worker that is ready, rather than in turn
     pub fn new(
         name: &str,
         listeners: Vec<NetListener>,
         senders: Vec<channel::Sender<(usize, NetStream, SocketAddr)>>,
+        loads: Vec<Arc<AtomicUsize>>,
     ) -> Listener {
+        assert!(loads.is_empty() || loads.len() == senders.len());
+
         let (s, r) = channel::channel(1);
 
         let thread = thread::Builder::new()
@@ -47,7 +188,9 @@ impl Listener {
                 let reactor = Reactor::new(REACTOR_REGISTRATIONS_MAX);
                 let executor = Executor::new(EXECUTOR_TASKS_MAX);
 
-                executor.spawn(Self::run(r, listeners, senders)).unwrap();
+                executor
+                    .spawn(Self::run(r, listeners, senders, loads))
+                    .unwrap();
 
                 executor.run(|timeout| reactor.poll(timeout)).unwrap();
             })
@@ -63,6 +206,7 @@ impl Listener {
         stop: channel::Receiver<()>,
         listeners: Vec<NetListener>,
         senders: Vec<channel::Sender<(usize, NetStream, SocketAddr)>>,
+        loads: Vec<Arc<AtomicUsize>>,
     ) {
         let stop = channel::AsyncReceiver::new(stop);
 
@@ -143,6 +287,10 @@ impl Listener {
 
             let mut pending_sock = Some((pos, stream, peer_addr));
 
+            if !loads.is_empty() {
+                senders_pos = least_loaded(&loads, senders_pos, |i| senders[i].is_writable());
+            }
+
             for _ in 0..senders.len() {
                 let sender = &mut senders[senders_pos];
 
@@ -172,6 +320,69 @@ impl Listener {
     }
 }
 
+pub enum AcceptSource {
+    Channel(channel::Receiver<(usize, NetStream, SocketAddr)>),
+    Listeners(Vec<NetListener>),
+}
+
+// the worker side of accepting. connections either arrive from a Listener
+// thread, or are accepted directly from sockets owned by the worker
+pub enum Acceptor {
+    Channel(channel::AsyncReceiver<(usize, NetStream, SocketAddr)>),
+    Listeners {
+        listeners: Vec<AsyncNetListener>,
+        pos: Cell<usize>,
+    },
+}
+
+impl Acceptor {
+    pub fn new(source: AcceptSource) -> Self {
+        match source {
+            AcceptSource::Channel(r) => Self::Channel(channel::AsyncReceiver::new(r)),
+            AcceptSource::Listeners(listeners) => Self::Listeners {
+                listeners: listeners.into_iter().map(AsyncNetListener::new).collect(),
+                pos: Cell::new(0),
+            },
+        }
+    }
+
+    pub async fn accept(&self) -> Result<(usize, NetStream, SocketAddr), ()> {
+        match self {
+            Self::Channel(r) => r.recv().await.map_err(|_| ()),
+            Self::Listeners { listeners, pos } => {
+                let start = pos.get();
+
+                // start after the last listener that produced a connection,
+                // so a busy listener can't starve the others
+                let (b, a) = listeners.split_at(start);
+
+                let mut tasks: Vec<NetAcceptFuture> =
+                    a.iter().chain(b.iter()).map(|l| l.accept()).collect();
+                let mut scratch = Vec::with_capacity(tasks.len());
+
+                let (i, result) = select_slice(&mut tasks, &mut scratch).await;
+
+                let i = (start + i) % listeners.len();
+
+                pos.set((i + 1) % listeners.len());
+
+                match result {
+                    Ok((stream, peer_addr)) => {
+                        debug!("accepted connection from {}", peer_addr);
+
+                        Ok((i, stream, peer_addr))
+                    }
+                    Err(e) => {
+                        error!("accept error: {:?}", e);
+
+                        Err(())
+                    }
+                }
+            }
+        }
+    }
+}
+
 impl Drop for Listener {
     fn drop(&mut self) {
         // this should never fail. receiver won't disconnect unless
@@ -187,7 +398,6 @@ impl Drop for Listener {
 mod tests {
     use super::*;
     use crate::core::event;
-    use mio::net::TcpListener;
     use std::io::{Read, Write};
     use std::mem;
     use std::sync::mpsc;
@@ -210,7 +420,7 @@ mod tests {
             receivers.push(receiver);
         }
 
-        let _l = Listener::new("listener-test", listeners, senders);
+        let _l = Listener::new("listener-test", listeners, senders, Vec::new());
 
         let mut poller = event::Poller::new(1024).unwrap();
 
@@ -264,4 +474,68 @@ mod tests {
         client.read_to_end(&mut buf).unwrap();
         assert_eq!(&buf, b"hello");
     }
+
+    #[test]
+    fn test_accept_reuseport() {
+        let a = bind_reuseport("127.0.0.1:0".parse().unwrap()).unwrap();
+        let addr = a.local_addr().unwrap();
+
+        // second socket in the same group
+        let b = bind_reuseport(addr).unwrap();
+        assert_eq!(b.local_addr().unwrap(), addr);
+
+        // with a single slot, steering sends everything to the first socket
+        if cfg!(target_os = "linux") {
+            set_cpu_steering(&a, 1).unwrap();
+        }
+
+        let reactor = Reactor::new(2);
+        let executor = Executor::new(1);
+
+        let mut client = std::net::TcpStream::connect(addr).unwrap();
+
+        executor
+            .spawn(async move {
+                let acceptor = Acceptor::new(AcceptSource::Listeners(vec![NetListener::Tcp(a)]));
+
+                let (lnum, peer_client, _) = acceptor.accept().await.unwrap();
+
+                assert_eq!(lnum, 0);
+
+                let mut peer_client = match peer_client {
+                    NetStream::Tcp(s) => s,
+                    _ => unreachable!(),
+                };
+
+                peer_client.write(b"hello").unwrap();
+
+                mem::drop(b);
+            })
+            .unwrap();
+
+        executor.run(|timeout| reactor.poll(timeout)).unwrap();
+
+        let mut buf = Vec::new();
+        client.read_to_end(&mut buf).unwrap();
+        assert_eq!(&buf, b"hello");
+    }
+
+    #[test]
+    fn test_least_loaded() {
+        let loads: Vec<Arc<AtomicUsize>> = [3, 1, 2, 1]
+            .iter()
+            .map(|v| Arc::new(AtomicUsize::new(*v)))
+            .collect();
+
+        assert_eq!(least_loaded(&loads, 0, |_| true), 1);
+
+        // ties go to the first found from the start position
+        assert_eq!(least_loaded(&loads, 2, |_| true), 3);
+
+        // senders that aren't writable are skipped
+        assert_eq!(least_loaded(&loads, 0, |i| i != 1 && i != 3), 2);
+
+        // none writable
+        assert_eq!(least_loaded(&loads, 2, |_| false), 2);
+    }
 }
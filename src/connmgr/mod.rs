@@ -16,7 +16,8 @@
  */
 
 mod batch;
-mod counter;
+mod handoff;
+mod ktls;
 mod listener;
 mod pool;
 mod track;
@@ -25,24 +26,26 @@ mod zhttpsocket;
 
 pub mod client;
 pub mod connection;
+pub mod counter;
 pub mod resolver;
 pub mod server;
 pub mod tls;
 pub mod websocket;
 
 use self::client::Client;
+use self::handoff::{Handoff, HandoffServer};
 use self::server::{Server, MSG_RETAINED_PER_CONNECTION_MAX, MSG_RETAINED_PER_WORKER_MAX};
 use crate::core::zmq::SpecInfo;
 use ipnet::IpNet;
-use log::{debug, info};
+use log::{debug, info, warn};
 use signal_hook;
 use signal_hook::consts::TERM_SIGNALS;
-use signal_hook::iterator::Signals;
+use signal_hook::iterator::{Handle, Signals};
 use std::cmp;
 use std::error::Error;
 use std::path::PathBuf;
 use std::sync::atomic::AtomicBool;
-use std::sync::Arc;
+use std::sync::{Arc, Mutex};
 use std::time::Duration;
 
 const INIT_HWM: usize = 128;
@@ -84,6 +87,9 @@ pub enum ListenSpec {
         addr: std::net::SocketAddr,
         tls: bool,
         default_cert: Option<String>,
+
+        // offload encryption of outgoing data to the kernel when possible
+        ktls: bool,
     },
     Local {
         path: PathBuf,
@@ -98,6 +104,57 @@ pub struct ListenConfig {
     pub stream: bool,
 }
 
+// limits for pooled outbound connections to an origin. a max of 0 means
+// no limit
+#[derive(Clone, Copy, Debug, Default, Eq, PartialEq)]
+pub struct PoolLimits {
+    // idle connections kept for reuse
+    pub max_idle: usize,
+
+    // idle connections to keep open ahead of demand
+    pub min_warm: usize,
+
+    // connections open at once, in use or idle
+    pub max_total: usize,
+}
+
+#[derive(Clone, Debug)]
+pub struct PoolConfig {
+    pub default: PoolLimits,
+
+    // overrides of the default, matched by "host:port" or "host"
+    pub origins: Vec<(String, PoolLimits)>,
+
+    // how long to keep an origin warm after it was last used
+    pub warm_timeout: Duration,
+}
+
+impl Default for PoolConfig {
+    fn default() -> Self {
+        Self {
+            default: PoolLimits::default(),
+            origins: Vec::new(),
+            warm_timeout: Duration::from_secs(600),
+        }
+    }
+}
+
+impl PoolConfig {
+    pub fn limits(&self, host: &str, port: u16) -> PoolLimits {
+        let mut host_match = None;
+
+        for (origin, limits) in self.origins.iter() {
+            match origin.rsplit_once(':') {
+                Some((h, p)) if h == host && p.parse() == Ok(port) => return *limits,
+                None if origin == host => host_match = Some(*limits),
+                _ => {}
+            }
+        }
+
+        host_match.unwrap_or(self.default)
+    }
+}
+
 pub struct Config {
     pub instance_id: String,
     pub workers: usize,
@@ -111,21 +168,36 @@ pub struct Config {
     pub req_timeout: Duration,
     pub stream_timeout: Duration,
     pub listen: Vec<ListenConfig>,
+    pub listen_reuseport: bool,
+    pub listen_steer_cpu: bool,
     pub zclient_req: Vec<String>,
     pub zclient_stream: Vec<String>,
     pub zclient_connect: bool,
     pub zserver_req: Vec<String>,
     pub zserver_stream: Vec<String>,
     pub zserver_connect: bool,
+    pub zserver_batch: bool,
     pub ipc_file_mode: u32,
     pub certs_dir: PathBuf,
     pub allow_compression: bool,
     pub deny: Vec<IpNet>,
+    pub pool: PoolConfig,
+    pub handoff_socket: Option<PathBuf>,
+}
+
+#[derive(Default)]
+struct HandoffState {
+    done: bool,
+    signals: Option<Handle>,
 }
 
 pub struct App {
+    // declared first so it stops before the server is dropped
+    _handoff_server: Option<HandoffServer>,
+
     _server: Option<Server>,
     _client: Option<Client>,
+    handoff_state: Arc<Mutex<HandoffState>>,
 }
 
 impl App {
@@ -147,7 +219,16 @@ impl App {
 
         let maxconn = config.req_maxconn + config.stream_maxconn;
 
-        let server = if !config.listen.is_empty() {
+        // take over the sockets of a running instance, if any
+        let mut handoff = match &config.handoff_socket {
+            Some(path) => match Handoff::take(path) {
+                Ok(h) => h,
+                Err(e) => return Err(format!("failed to take over from {:?}: {}", path, e)),
+            },
+            None => None,
+        };
+
+        let mut server = if !config.listen.is_empty() {
             let mut any_req = false;
             let mut any_stream = false;
 
@@ -254,6 +335,9 @@ impl App {
                 config.allow_compression,
                 zsockman,
                 handle_bound,
+                config.listen_reuseport,
+                config.listen_steer_cpu,
+                handoff.as_mut(),
             )?)
         } else {
             None
@@ -269,6 +353,7 @@ impl App {
                 other_hwm,
                 handle_bound,
                 config.stream_maxconn,
+                config.zserver_batch,
             );
 
             if !config.zserver_req.is_empty() {
@@ -309,6 +394,7 @@ impl App {
                 config.stream_timeout,
                 config.allow_compression,
                 &config.deny,
+                &config.pool,
                 zsockman.clone(),
                 handle_bound,
             )?;
@@ -365,9 +451,48 @@ impl App {
             None
         };
 
+        let handoff_state = Arc::new(Mutex::new(HandoffState::default()));
+
+        let handoff_server = if let Some(path) = &config.handoff_socket {
+            if let Some(h) = handoff {
+                info!("took over from previous instance");
+
+                // the previous instance stops once we're accepting
+                if let Err(e) = h.finish() {
+                    warn!("failed to notify previous instance: {}", e);
+                }
+            }
+
+            let sockets = match &mut server {
+                Some(server) => server.take_handoff_sockets(),
+                None => Vec::new(),
+            };
+
+            let state = Arc::clone(&handoff_state);
+
+            let on_done = move || {
+                let mut state = state.lock().unwrap();
+
+                state.done = true;
+
+                if let Some(signals) = state.signals.take() {
+                    signals.close();
+                }
+            };
+
+            match HandoffServer::new(path, sockets, on_done) {
+                Ok(s) => Some(s),
+                Err(e) => return Err(format!("failed to bind {:?}: {}", path, e)),
+            }
+        } else {
+            None
+        };
+
         Ok(Self {
+            _handoff_server: handoff_server,
             _server: server,
             _client: client,
+            handoff_state,
         })
     }
 
@@ -388,9 +513,23 @@ impl App {
             signal_hook::flag::register(*signal_type, Arc::clone(&term_now)).unwrap();
         }
 
+        {
+            let mut state = self.handoff_state.lock().unwrap();
+
+            if state.done {
+                info!("handed off to new instance");
+                return;
+            }
+
+            // allow a handoff to interrupt the wait
+            state.signals = Some(signals.handle());
+        }
+
         // wait for termination
-        let signal_type = signals.into_iter().next().unwrap();
-        assert!(TERM_SIGNALS.contains(&signal_type));
+        match signals.into_iter().next() {
+            Some(signal_type) => assert!(TERM_SIGNALS.contains(&signal_type)),
+            None => info!("handed off to new instance"),
+        }
     }
 
     pub fn sizes() -> Vec<(String, usize)> {
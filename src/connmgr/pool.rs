@@ -56,8 +56,27 @@ where
         }
     }
 
+    pub fn len(&self) -> usize {
+        self.nodes.len()
+    }
+
+    pub fn is_full(&self) -> bool {
+        self.nodes.len() == self.nodes.capacity()
+    }
+
+    pub fn count<Q>(&self, key: &Q) -> usize
+    where
+        K: Borrow<Q>,
+        Q: Hash + Eq + ?Sized,
+    {
+        match self.by_key.get(key) {
+            Some(l) => l.iter(&self.nodes).count(),
+            None => 0,
+        }
+    }
+
     pub fn add(&mut self, key: K, value: V, expires: Instant) -> Result<(), V> {
-        if self.nodes.len() == self.nodes.capacity() {
+        if self.is_full() {
             return Err(value);
         }
 
@@ -85,26 +104,60 @@ where
         Ok(())
     }
 
+    // takes the oldest item for the key
     pub fn take<Q>(&mut self, key: &Q) -> Option<V>
     where
         K: Borrow<Q>,
         Q: Hash + Eq + ?Sized,
     {
-        let l = self.by_key.get_mut(key)?;
+        let nkey = self.by_key.get(key)?.head?;
 
-        let nkey = l.pop_front(&mut self.nodes)?;
+        let pi = self.remove_node(nkey);
 
-        if l.is_empty() {
-            self.by_key.remove(key);
-        }
+        self.wheel.remove(pi.timer_id);
+
+        Some(pi.value)
+    }
+
+    // takes the most recently added item for the key. preferring recent
+    // items lets the rest age out when fewer are needed
+    pub fn take_newest<Q>(&mut self, key: &Q) -> Option<V>
+    where
+        K: Borrow<Q>,
+        Q: Hash + Eq + ?Sized,
+    {
+        let nkey = self.by_key.get(key)?.tail?;
 
-        let pi = self.nodes.remove(nkey).value;
+        let pi = self.remove_node(nkey);
 
         self.wheel.remove(pi.timer_id);
 
         Some(pi.value)
     }
 
+    // removes the items for which f returns false, returning how many were
+    // removed
+    pub fn retain<F>(&mut self, mut f: F) -> usize
+    where
+        F: FnMut(&K, &mut V) -> bool,
+    {
+        let mut remove = Vec::new();
+
+        for (nkey, n) in self.nodes.iter_mut() {
+            if !f(&n.value.key, &mut n.value.value) {
+                remove.push(nkey);
+            }
+        }
+
+        for nkey in remove.iter() {
+            let pi = self.remove_node(*nkey);
+
+            self.wheel.remove(pi.timer_id);
+        }
+
+        remove.len()
+    }
+
     pub fn expire(&mut self, now: Instant) -> Option<(K, V)> {
         let ticks = self.get_ticks(now);
 
@@ -118,6 +171,13 @@ where
             None => return None,
         };
 
+        let pi = self.remove_node(nkey);
+
+        Some((pi.key, pi.value))
+    }
+
+    // removes the node from its list and the slab, but not from the wheel
+    fn remove_node(&mut self, nkey: usize) -> PoolItem<K, V> {
         let pi = &self.nodes[nkey].value;
 
         let l = self.by_key.get_mut(&pi.key).unwrap();
@@ -128,9 +188,7 @@ where
             self.by_key.remove(&pi.key);
         }
 
-        let pi = self.nodes.remove(nkey).value;
-
-        Some((pi.key, pi.value))
+        self.nodes.remove(nkey).value
     }
 
     fn get_ticks(&self, t: Instant) -> u64 {
@@ -164,6 +222,41 @@ mod tests {
         assert_eq!(pool.take(&2), None);
     }
 
+    #[test]
+    fn pool_take_newest() {
+        let mut pool = Pool::new(3);
+
+        let now = Instant::now();
+        pool.add(1, "a", now).unwrap();
+        pool.add(1, "b", now).unwrap();
+        pool.add(1, "c", now).unwrap();
+        assert_eq!(pool.count(&1), 3);
+
+        assert_eq!(pool.take_newest(&1), Some("c"));
+        assert_eq!(pool.take(&1), Some("a"));
+        assert_eq!(pool.take_newest(&1), Some("b"));
+        assert_eq!(pool.take_newest(&1), None);
+        assert_eq!(pool.count(&1), 0);
+    }
+
+    #[test]
+    fn pool_retain() {
+        let mut pool = Pool::new(3);
+
+        let now = Instant::now();
+        pool.add(1, "a", now + Duration::from_secs(1)).unwrap();
+        pool.add(1, "b", now + Duration::from_secs(1)).unwrap();
+        pool.add(2, "c", now + Duration::from_secs(1)).unwrap();
+
+        assert_eq!(pool.retain(|_, v| *v != "a" && *v != "c"), 2);
+        assert_eq!(pool.len(), 1);
+        assert_eq!(pool.count(&2), 0);
+
+        // removed items must not expire
+        assert_eq!(pool.expire(now + Duration::from_secs(5)), Some((1, "b")));
+        assert_eq!(pool.expire(now + Duration::from_secs(5)), None);
+    }
+
     #[test]
     fn pool_expire() {
         let mut pool = Pool::new(3);
@@ -15,26 +15,36 @@
  */
 
 use crate::core::event;
-use crate::core::list;
 use crate::core::reactor::CustomEvented;
 use crate::core::task::get_reactor;
 use arrayvec::{ArrayString, ArrayVec};
 use mio::Interest;
 use slab::Slab;
-use std::collections::VecDeque;
+use std::collections::{HashMap, VecDeque};
 use std::future::Future;
 use std::io;
 use std::net::{IpAddr, ToSocketAddrs};
 use std::pin::Pin;
-use std::sync::atomic::{AtomicBool, Ordering};
 use std::sync::{Arc, Condvar, Mutex};
 use std::task::{Context, Poll};
 use std::thread;
+use std::time::{Duration, Instant};
 
 pub const REGISTRATIONS_PER_QUERY: usize = 1;
 
 pub const ADDRS_MAX: usize = 16;
 
+// the system resolver doesn't report record TTLs, so results are cached for
+// fixed times
+pub const CACHE_TTL: Duration = Duration::from_secs(30);
+pub const CACHE_NEGATIVE_TTL: Duration = Duration::from_secs(5);
+
+// how long after expiring a successful result may still be returned, while
+// it is refreshed in the background
+pub const CACHE_STALE_MAX: Duration = Duration::from_secs(60);
+
+pub const CACHE_ENTRIES_MAX: usize = 1000;
+
 pub type Hostname = ArrayString<255>;
 pub type Addrs = ArrayVec<IpAddr, ADDRS_MAX>;
 
@@ -45,28 +55,147 @@ fn std_resolve(host: &str) -> Result<Addrs, io::Error> {
     }
 }
 
+#[derive(Clone, Copy)]
+pub struct CacheConfig {
+    pub ttl: Duration,
+    pub negative_ttl: Duration,
+    pub stale_max: Duration,
+    pub entries_max: usize,
+}
+
+impl Default for CacheConfig {
+    fn default() -> Self {
+        Self {
+            ttl: CACHE_TTL,
+            negative_ttl: CACHE_NEGATIVE_TTL,
+            stale_max: CACHE_STALE_MAX,
+            entries_max: CACHE_ENTRIES_MAX,
+        }
+    }
+}
+
+#[derive(Debug, Clone, Copy, Default, PartialEq)]
+pub struct ResolverStats {
+    // answered from an unexpired cached result
+    pub hits: u64,
+
+    // answered from an unexpired cached failure
+    pub negative_hits: u64,
+
+    // answered from an expired result while it was refreshed
+    pub stale_hits: u64,
+
+    // had to wait for a lookup
+    pub misses: u64,
+
+    // misses that joined a lookup already in progress for the same host
+    pub coalesced: u64,
+}
+
+type CachedResult = Result<Addrs, (io::ErrorKind, String)>;
+
+fn to_cached(result: &Result<Addrs, io::Error>) -> CachedResult {
+    match result {
+        Ok(addrs) => Ok(addrs.clone()),
+        Err(e) => Err((e.kind(), e.to_string())),
+    }
+}
+
+fn from_cached(result: &CachedResult) -> Result<Addrs, io::Error> {
+    match result {
+        Ok(addrs) => Ok(addrs.clone()),
+        Err((kind, msg)) => Err(io::Error::new(*kind, msg.clone())),
+    }
+}
+
+struct CacheEntry {
+    result: CachedResult,
+    expires: Instant,
+}
+
 struct QueryItem {
     host: Hostname,
     result: Option<Result<Addrs, io::Error>>,
     set_readiness: event::SetReadiness,
-    invalidated: Option<Arc<AtomicBool>>,
+}
+
+// a lookup of a host, shared by all of the queries waiting on it. refreshes
+// of stale entries have no waiters
+struct Lookup {
+    waiters: Vec<usize>,
+    started: bool,
+    abandoned: bool,
 }
 
 struct QueriesInner {
     stop: bool,
-    nodes: Slab<list::Node<QueryItem>>,
-    next: list::List,
+    nodes: Slab<QueryItem>,
+    next: VecDeque<Hostname>,
+    lookups: HashMap<Hostname, Lookup>,
+    cache: HashMap<Hostname, CacheEntry>,
+    cache_config: CacheConfig,
+    stats: ResolverStats,
     registrations: VecDeque<(event::Registration, event::SetReadiness)>,
     invalidated_count: u32,
 }
 
+impl QueriesInner {
+    fn start_lookup(&mut self, host: Hostname, waiter: Option<usize>) {
+        self.lookups.insert(
+            host,
+            Lookup {
+                waiters: waiter.into_iter().collect(),
+                started: false,
+                abandoned: false,
+            },
+        );
+
+        self.next.push_back(host);
+    }
+
+    fn cache_result(&mut self, host: Hostname, result: CachedResult, now: Instant) {
+        let config = &self.cache_config;
+
+        let ttl = if result.is_ok() {
+            config.ttl
+        } else {
+            config.negative_ttl
+        };
+
+        if config.entries_max == 0
+            || (ttl.is_zero() && (result.is_err() || config.stale_max.is_zero()))
+        {
+            return;
+        }
+
+        if self.cache.len() >= config.entries_max && !self.cache.contains_key(&host) {
+            let stale_max = config.stale_max;
+
+            self.cache.retain(|_, e| now < e.expires + stale_max);
+
+            if self.cache.len() >= config.entries_max {
+                let key = *self.cache.keys().next().unwrap();
+                self.cache.remove(&key);
+            }
+        }
+
+        self.cache.insert(
+            host,
+            CacheEntry {
+                result,
+                expires: now + ttl,
+            },
+        );
+    }
+}
+
 #[derive(Clone)]
 struct Queries {
     inner: Arc<(Mutex<QueriesInner>, Condvar)>,
 }
 
 impl Queries {
-    fn new(queries_max: usize) -> Self {
+    fn new(queries_max: usize, cache_config: CacheConfig) -> Self {
         let mut registrations = VecDeque::with_capacity(queries_max);
 
         for _ in 0..registrations.capacity() {
@@ -76,7 +205,11 @@ impl Queries {
         let inner = QueriesInner {
             stop: false,
             nodes: Slab::with_capacity(queries_max),
-            next: list::List::default(),
+            next: VecDeque::with_capacity(queries_max),
+            lookups: HashMap::with_capacity(queries_max),
+            cache: HashMap::new(),
+            cache_config,
+            stats: ResolverStats::default(),
             registrations,
             invalidated_count: 0,
         };
@@ -106,38 +239,91 @@ impl Queries {
 
         let (reg, sr) = queries.registrations.pop_back().unwrap();
 
-        let nkey = match Hostname::from(host) {
-            Ok(host) => {
-                let nkey = queries.nodes.insert(list::Node::new(QueryItem {
-                    host,
-                    result: None,
+        let host = match Hostname::from(host) {
+            Ok(host) => host,
+            Err(_) => {
+                sr.set_readiness(Interest::READABLE).unwrap();
+
+                let nkey = queries.nodes.insert(QueryItem {
+                    host: Hostname::new(),
+                    result: Some(Err(io::Error::from(io::ErrorKind::InvalidInput))),
                     set_readiness: sr,
-                    invalidated: None,
-                }));
+                });
 
-                queries.next.push_back(&mut queries.nodes, nkey);
+                return Ok((nkey, reg));
+            }
+        };
 
-                cvar.notify_one();
+        let now = Instant::now();
+        let stale_max = queries.cache_config.stale_max;
 
-                nkey
+        let cached = match queries.cache.get(&host) {
+            Some(e) if now < e.expires => Some((from_cached(&e.result), false)),
+            Some(e) if e.result.is_ok() && now < e.expires + stale_max => {
+                Some((from_cached(&e.result), true))
             }
-            Err(_) => {
+            _ => None,
+        };
+
+        let nkey = match cached {
+            Some((result, stale)) => {
+                if stale {
+                    queries.stats.stale_hits += 1;
+
+                    // refresh, unless already doing so. refreshes have no
+                    // query of their own, so limit them to the query count
+                    if !queries.lookups.contains_key(&host)
+                        && queries.lookups.len() < queries.nodes.capacity()
+                    {
+                        queries.start_lookup(host, None);
+
+                        cvar.notify_one();
+                    }
+                } else if result.is_ok() {
+                    queries.stats.hits += 1;
+                } else {
+                    queries.stats.negative_hits += 1;
+                }
+
                 sr.set_readiness(Interest::READABLE).unwrap();
 
-                queries.nodes.insert(list::Node::new(QueryItem {
-                    host: Hostname::new(),
-                    result: Some(Err(io::Error::from(io::ErrorKind::InvalidInput))),
+                queries.nodes.insert(QueryItem {
+                    host,
+                    result: Some(result),
+                    set_readiness: sr,
+                })
+            }
+            None => {
+                queries.stats.misses += 1;
+
+                let nkey = queries.nodes.insert(QueryItem {
+                    host,
+                    result: None,
                     set_readiness: sr,
-                    invalidated: None,
-                }))
+                });
+
+                match queries.lookups.get_mut(&host) {
+                    Some(lookup) => {
+                        lookup.waiters.push(nkey);
+
+                        queries.stats.coalesced += 1;
+                    }
+                    None => {
+                        queries.start_lookup(host, Some(nkey));
+
+                        cvar.notify_one();
+                    }
+                }
+
+                nkey
             }
         };
 
         Ok((nkey, reg))
     }
 
-    // block until a query is available, or stopped
-    fn get_next(&self, invalidated: &Arc<AtomicBool>) -> Option<(usize, Hostname)> {
+    // block until a lookup is available, or stopped
+    fn get_next(&self) -> Option<Hostname> {
         let (lock, cvar) = &*self.inner;
 
         let mut queries_guard = lock.lock().unwrap();
@@ -149,54 +335,64 @@ impl Queries {
                 return None;
             }
 
-            if let Some(nkey) = queries.next.pop_front(&mut queries.nodes) {
-                let qi = &mut queries.nodes[nkey].value;
+            if let Some(host) = queries.next.pop_front() {
+                queries.lookups.get_mut(&host).unwrap().started = true;
 
-                invalidated.store(false, Ordering::Relaxed);
-                qi.invalidated = Some(invalidated.clone());
-
-                return Some((nkey, qi.host));
+                return Some(host);
             }
 
             queries_guard = cvar.wait(queries_guard).unwrap();
         }
     }
 
-    fn set_result(
-        &self,
-        item_key: usize,
-        result: Result<Addrs, io::Error>,
-        invalidated: &AtomicBool,
-    ) {
-        let mut queries = self.inner.0.lock().unwrap();
+    fn set_result(&self, host: &Hostname, result: Result<Addrs, io::Error>) {
+        let queries = &mut *self.inner.0.lock().unwrap();
+
+        let lookup = queries.lookups.remove(host).unwrap();
 
-        if !invalidated.load(Ordering::Relaxed) {
-            let qi = &mut queries.nodes[item_key].value;
+        let result = to_cached(&result);
 
-            qi.result = Some(result);
-            qi.invalidated = None;
+        for nkey in lookup.waiters.iter() {
+            let qi = &mut queries.nodes[*nkey];
+
+            qi.result = Some(from_cached(&result));
             qi.set_readiness.set_readiness(Interest::READABLE).unwrap();
-        } else {
+        }
+
+        if lookup.abandoned && lookup.waiters.is_empty() {
             queries.invalidated_count += 1;
         }
+
+        // cached even if no one is waiting anymore, as the queries may be
+        // retried
+        queries.cache_result(*host, result, Instant::now());
     }
 
     fn take_result(&self, item_key: usize) -> Option<Result<Addrs, io::Error>> {
         let queries = &mut *self.inner.0.lock().unwrap();
 
-        queries.nodes[item_key].value.result.take()
+        queries.nodes[item_key].result.take()
     }
 
     fn remove(&self, item_key: usize, registration: event::Registration) {
         let queries = &mut *self.inner.0.lock().unwrap();
 
-        // remove from next list if present
-        queries.next.remove(&mut queries.nodes, item_key);
+        let qi = queries.nodes.remove(item_key);
 
-        let qi = queries.nodes.remove(item_key).value;
+        if let Some(lookup) = queries.lookups.get_mut(&qi.host) {
+            if let Some(pos) = lookup.waiters.iter().position(|k| *k == item_key) {
+                lookup.waiters.swap_remove(pos);
 
-        if let Some(invalidated) = &qi.invalidated {
-            invalidated.store(true, Ordering::Relaxed);
+                if lookup.waiters.is_empty() {
+                    if lookup.started {
+                        lookup.abandoned = true;
+                    } else {
+                        // no one needs it, so don't start it
+                        queries.lookups.remove(&qi.host);
+                        queries.next.retain(|h| *h != qi.host);
+                    }
+                }
+            }
         }
 
         queries
@@ -204,6 +400,12 @@ impl Queries {
             .push_back((registration, qi.set_readiness));
     }
 
+    fn stats(&self) -> ResolverStats {
+        let queries = &*self.inner.0.lock().unwrap();
+
+        queries.stats
+    }
+
     #[cfg(test)]
     fn invalidated_count(&self) -> u32 {
         let queries = &mut *self.inner.0.lock().unwrap();
@@ -218,12 +420,17 @@ struct ResolverInner {
 }
 
 impl ResolverInner {
-    fn new<F>(num_threads: usize, queries_max: usize, resolve_fn: Arc<F>) -> Self
+    fn new<F>(
+        num_threads: usize,
+        queries_max: usize,
+        cache_config: CacheConfig,
+        resolve_fn: Arc<F>,
+    ) -> Self
     where
         F: Fn(&str) -> Result<Addrs, io::Error> + Send + Sync + 'static,
     {
         let mut workers = Vec::with_capacity(num_threads);
-        let queries = Queries::new(queries_max);
+        let queries = Queries::new(queries_max, cache_config);
 
         for _ in 0..workers.capacity() {
             let queries = queries.clone();
@@ -231,21 +438,15 @@ impl ResolverInner {
 
             let thread = thread::Builder::new()
                 .name("resolver".to_string())
-                .spawn(move || {
-                    let invalidated = Arc::new(AtomicBool::new(false));
-
-                    loop {
-                        assert_eq!(Arc::strong_count(&invalidated), 1);
+                .spawn(move || loop {
+                    let host = match queries.get_next() {
+                        Some(host) => host,
+                        None => break,
+                    };
 
-                        let (item_key, host) = match queries.get_next(&invalidated) {
-                            Some(ret) => ret,
-                            None => break,
-                        };
+                    let ret = resolve_fn(host.as_str());
 
-                        let ret = resolve_fn(host.as_str());
-
-                        queries.set_result(item_key, ret, &invalidated);
-                    }
+                    queries.set_result(&host, ret);
                 })
                 .unwrap();
 
@@ -287,7 +488,12 @@ pub struct Resolver {
 
 impl Resolver {
     pub fn new(num_threads: usize, queries_max: usize) -> Self {
-        let inner = ResolverInner::new(num_threads, queries_max, Arc::new(std_resolve));
+        let inner = ResolverInner::new(
+            num_threads,
+            queries_max,
+            CacheConfig::default(),
+            Arc::new(std_resolve),
+        );
 
         Self { inner }
     }
@@ -296,6 +502,10 @@ impl Resolver {
     pub fn resolve(&self, host: &str) -> Result<Query, ()> {
         self.inner.resolve(host)
     }
+
+    pub fn stats(&self) -> ResolverStats {
+        self.inner.queries.stats()
+    }
 }
 
 pub struct Query {
@@ -416,6 +626,164 @@ mod tests {
     use crate::core::executor::Executor;
     use crate::core::reactor::Reactor;
 
+    fn wait_result(query: &Query) -> Result<Addrs, io::Error> {
+        let mut poller = event::Poller::new(1).unwrap();
+
+        poller
+            .register_custom(
+                query.get_read_registration(),
+                mio::Token(1),
+                Interest::READABLE,
+            )
+            .unwrap();
+
+        let result = loop {
+            if let Some(result) = query.process() {
+                break result;
+            }
+
+            poller.poll(None).unwrap();
+
+            for _ in poller.iter_events() {}
+        };
+
+        poller
+            .deregister_custom(query.get_read_registration())
+            .unwrap();
+
+        result
+    }
+
+    // resolves "good" to 127.0.0.1, fails anything else, and counts calls
+    fn counting_resolver(
+        queries_max: usize,
+        cache_config: CacheConfig,
+        gate: Arc<Mutex<()>>,
+    ) -> (ResolverInner, Arc<Mutex<u32>>) {
+        let calls = Arc::new(Mutex::new(0));
+
+        let resolve_fn = {
+            let calls = calls.clone();
+
+            Arc::new(move |host: &str| {
+                let _guard = gate.lock().unwrap();
+
+                *calls.lock().unwrap() += 1;
+
+                if host == "good" {
+                    let mut addrs = Addrs::new();
+                    addrs.push(IpAddr::from([127, 0, 0, 1]));
+
+                    Ok(addrs)
+                } else {
+                    Err(io::Error::from(io::ErrorKind::NotFound))
+                }
+            })
+        };
+
+        let inner = ResolverInner::new(1, queries_max, cache_config, resolve_fn);
+
+        (inner, calls)
+    }
+
+    #[test]
+    fn cache() {
+        let gate = Arc::new(Mutex::new(()));
+        let (inner, calls) = counting_resolver(2, CacheConfig::default(), gate);
+
+        for _ in 0..3 {
+            let query = inner.resolve("good").unwrap();
+            let addrs = wait_result(&query).unwrap();
+            assert_eq!(addrs.as_slice(), &[IpAddr::from([127, 0, 0, 1])]);
+        }
+
+        for _ in 0..2 {
+            let query = inner.resolve("bad").unwrap();
+            let e = wait_result(&query).unwrap_err();
+            assert_eq!(e.kind(), io::ErrorKind::NotFound);
+        }
+
+        assert_eq!(*calls.lock().unwrap(), 2);
+
+        let stats = inner.queries.stats();
+        assert_eq!(stats.misses, 2);
+        assert_eq!(stats.hits, 2);
+        assert_eq!(stats.negative_hits, 1);
+        assert_eq!(stats.stale_hits, 0);
+    }
+
+    #[test]
+    fn coalesce() {
+        let gate = Arc::new(Mutex::new(()));
+
+        let config = CacheConfig {
+            entries_max: 0,
+            ..Default::default()
+        };
+
+        let (inner, calls) = counting_resolver(3, config, gate.clone());
+
+        // hold lookups until all of the queries are added
+        let guard = gate.lock().unwrap();
+
+        let q1 = inner.resolve("good").unwrap();
+        let q2 = inner.resolve("good").unwrap();
+        let q3 = inner.resolve("bad").unwrap();
+
+        drop(guard);
+
+        assert!(wait_result(&q1).is_ok());
+        assert!(wait_result(&q2).is_ok());
+        assert!(wait_result(&q3).is_err());
+
+        assert_eq!(*calls.lock().unwrap(), 2);
+
+        let stats = inner.queries.stats();
+        assert_eq!(stats.misses, 3);
+        assert_eq!(stats.coalesced, 1);
+        assert_eq!(stats.hits, 0);
+    }
+
+    #[test]
+    fn stale() {
+        let gate = Arc::new(Mutex::new(()));
+
+        // expire immediately, but allow stale use
+        let config = CacheConfig {
+            ttl: Duration::ZERO,
+            negative_ttl: Duration::ZERO,
+            ..Default::default()
+        };
+
+        let (inner, calls) = counting_resolver(2, config, gate);
+
+        let query = inner.resolve("good").unwrap();
+        assert!(wait_result(&query).is_ok());
+        drop(query);
+
+        // returned right away, and refreshed in the background
+        let query = inner.resolve("good").unwrap();
+        assert!(query.process().unwrap().is_ok());
+        drop(query);
+
+        while *calls.lock().unwrap() < 2 {
+            thread::sleep(Duration::from_millis(1));
+        }
+
+        // failures are not cached when their ttl is zero
+        let query = inner.resolve("bad").unwrap();
+        assert!(wait_result(&query).is_err());
+        drop(query);
+
+        let query = inner.resolve("bad").unwrap();
+        assert!(wait_result(&query).is_err());
+
+        let stats = inner.queries.stats();
+        assert_eq!(stats.stale_hits, 1);
+        assert_eq!(stats.misses, 3);
+        assert_eq!(stats.negative_hits, 0);
+    }
+
     #[test]
     fn resolve() {
         let mut poller = event::Poller::new(1).unwrap();
@@ -481,7 +849,7 @@ mod tests {
             let (lock, cvar) = &*cond;
             let guard = lock.lock().unwrap();
 
-            let inner = ResolverInner::new(1, 1, resolve_fn);
+            let inner = ResolverInner::new(1, 1, CacheConfig::default(), resolve_fn);
 
             let query = inner.resolve("127.0.0.1").unwrap();
 
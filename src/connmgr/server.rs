@@ -19,14 +19,18 @@ use crate::connmgr::batch::{Batch, BatchKey};
 use crate::connmgr::connection::{
     server_req_connection, server_stream_connection, CidProvider, Identify, StreamSharedData,
 };
-use crate::connmgr::counter::Counter;
-use crate::connmgr::listener::Listener;
+use crate::connmgr::counter::ShardedCounter;
+use crate::connmgr::handoff::{self, Handoff};
+use crate::connmgr::listener::{
+    bind_reuseport, set_cpu_steering, try_clone_unix, AcceptSource, Acceptor, Listener,
+};
 use crate::connmgr::tls::{AsyncTlsStream, IdentityCache, TlsAcceptor, TlsStream, TlsWaker};
+use crate::connmgr::websocket;
 use crate::connmgr::zhttppacket;
 use crate::connmgr::zhttpsocket;
 use crate::connmgr::{ListenConfig, ListenSpec};
 use crate::core::arena;
-use crate::core::buffer::TmpBuffer;
+use crate::core::buffer::{BufferPool, TmpBuffer};
 use crate::core::channel::{self, AsyncLocalReceiver, AsyncLocalSender, AsyncReceiver};
 use crate::core::event;
 use crate::core::executor::{Executor, Spawner};
@@ -58,11 +62,12 @@ use std::io::Write;
 use std::mem;
 use std::net::{IpAddr, Ipv4Addr};
 use std::os::unix::fs::PermissionsExt;
-use std::os::unix::io::{FromRawFd, IntoRawFd};
+use std::os::unix::io::{AsFd, FromRawFd, IntoRawFd, OwnedFd};
 use std::path::Path;
 use std::pin::pin;
 use std::rc::Rc;
 use std::str::{self, FromStr};
+use std::sync::atomic::{AtomicUsize, Ordering};
 use std::sync::{mpsc, Arc};
 use std::thread;
 use std::time::Duration;
@@ -106,6 +111,10 @@ const KEEP_ALIVE_BATCHES: usize = KEEP_ALIVE_TIMEOUT_MS / KEEP_ALIVE_BATCH_MS;
 const BULK_PACKET_SIZE_MAX: usize = 65_000;
 const SHUTDOWN_TIMEOUT: Duration = Duration::from_millis(10_000);
 
+// spare buffers kept per worker for idle stream connections that become
+// active again. beyond this, released buffers are freed
+const BUFFER_POOL_MAX: usize = 1024;
+
 fn get_addr_and_offset(msg: &[u8]) -> Result<(&str, usize), ()> {
     let mut pos = None;
     for (i, b) in msg.iter().enumerate() {
@@ -616,12 +625,13 @@ struct ConnectionReqOpts {
 
 struct ConnectionStreamOpts {
     blocks_max: usize,
-    blocks_avail: Arc<Counter>,
+    blocks_avail: Arc<ShardedCounter>,
     messages_max: usize,
     allow_compression: bool,
     sender: channel::LocalSender<zmq::Message>,
     sender_stream: channel::LocalSender<(ArrayVec<u8, 64>, zmq::Message)>,
     stream_shared_mem: Rc<arena::RcMemory<StreamSharedData>>,
+    buf_pool: Rc<BufferPool>,
 }
 
 enum ConnectionModeOpts {
@@ -644,15 +654,17 @@ impl Worker {
         buffer_size: usize,
         body_buffer_size: usize,
         connection_blocks_max: usize,
-        blocks_avail: &Arc<Counter>,
+        blocks_avail: &Arc<ShardedCounter>,
         messages_max: usize,
         req_timeout: Duration,
         stream_timeout: Duration,
         allow_compression: bool,
-        req_acceptor: channel::Receiver<(usize, NetStream, SocketAddr)>,
-        stream_acceptor: channel::Receiver<(usize, NetStream, SocketAddr)>,
-        req_acceptor_tls: &[(bool, Option<String>)],
-        stream_acceptor_tls: &[(bool, Option<String>)],
+        req_acceptor: AcceptSource,
+        stream_acceptor: AcceptSource,
+        req_load: &Arc<AtomicUsize>,
+        stream_load: &Arc<AtomicUsize>,
+        req_acceptor_tls: &[(bool, Option<String>, bool)],
+        stream_acceptor_tls: &[(bool, Option<String>, bool)],
         identities: &Arc<IdentityCache>,
         zsockman: &Arc<zhttpsocket::ClientSocketManager>,
         handle_bound: usize,
@@ -664,6 +676,8 @@ impl Worker {
 
         let instance_id = String::from(instance_id);
         let blocks_avail = Arc::clone(blocks_avail);
+        let req_load = Arc::clone(req_load);
+        let stream_load = Arc::clone(stream_load);
         let req_acceptor_tls = req_acceptor_tls.to_owned();
         let stream_acceptor_tls = stream_acceptor_tls.to_owned();
         let identities = Arc::clone(identities);
@@ -709,6 +723,8 @@ impl Worker {
                         allow_compression,
                         req_acceptor,
                         stream_acceptor,
+                        req_load,
+                        stream_load,
                         req_acceptor_tls,
                         stream_acceptor_tls,
                         identities,
@@ -746,15 +762,17 @@ impl Worker {
         buffer_size: usize,
         body_buffer_size: usize,
         connection_blocks_max: usize,
-        blocks_avail: Arc<Counter>,
+        blocks_avail: Arc<ShardedCounter>,
         messages_max: usize,
         req_timeout: Duration,
         stream_timeout: Duration,
         allow_compression: bool,
-        req_acceptor: channel::Receiver<(usize, NetStream, SocketAddr)>,
-        stream_acceptor: channel::Receiver<(usize, NetStream, SocketAddr)>,
-        req_acceptor_tls: Vec<(bool, Option<String>)>,
-        stream_acceptor_tls: Vec<(bool, Option<String>)>,
+        req_acceptor: AcceptSource,
+        stream_acceptor: AcceptSource,
+        req_load: Arc<AtomicUsize>,
+        stream_load: Arc<AtomicUsize>,
+        req_acceptor_tls: Vec<(bool, Option<String>, bool)>,
+        stream_acceptor_tls: Vec<(bool, Option<String>, bool)>,
         identities: Arc<IdentityCache>,
         zsockman: Arc<zhttpsocket::ClientSocketManager>,
         handle_bound: usize,
@@ -762,8 +780,8 @@ impl Worker {
         let executor = Executor::current().unwrap();
         let reactor = Reactor::current().unwrap();
         let stop = AsyncReceiver::new(stop);
-        let req_acceptor = AsyncReceiver::new(req_acceptor);
-        let stream_acceptor = AsyncReceiver::new(stream_acceptor);
+        let req_acceptor = Acceptor::new(req_acceptor);
+        let stream_acceptor = Acceptor::new(stream_acceptor);
 
         debug!("server-worker {}: allocating buffers", id);
 
@@ -825,6 +843,8 @@ impl Worker {
 
         let stream_shared_mem = Rc::new(arena::RcMemory::new(stream_maxconn));
 
+        let buf_pool = Rc::new(BufferPool::new(buffer_size, BUFFER_POOL_MAX));
+
         let zreceiver_pool = Rc::new(ChannelPool::new(maxconn));
         for _ in 0..maxconn {
             zreceiver_pool.push(local_channel(RESP_SENDER_BOUND, 1));
@@ -859,6 +879,7 @@ impl Worker {
                     AsyncLocalReceiver::new(r_from_handle),
                     s_from_conn,
                     req_conns.clone(),
+                    req_load,
                     ConnectionOpts {
                         instance_id: instance_id.clone(),
                         buffer_size,
@@ -910,6 +931,7 @@ impl Worker {
                     AsyncLocalReceiver::new(r_from_handle),
                     s_from_conn,
                     stream_conns.clone(),
+                    stream_load,
                     ConnectionOpts {
                         instance_id: instance_id.clone(),
                         buffer_size,
@@ -926,6 +948,7 @@ impl Worker {
                         sender: zstream_out_sender,
                         sender_stream: zstream_out_stream_sender,
                         stream_shared_mem,
+                        buf_pool,
                     }),
                 ))
                 .unwrap();
@@ -1048,14 +1071,15 @@ impl Worker {
         id: usize,
         stop: AsyncLocalReceiver<()>,
         _done: AsyncLocalSender<()>,
-        acceptor: AsyncReceiver<(usize, NetStream, SocketAddr)>,
-        acceptor_tls: Vec<(bool, Option<String>)>,
+        acceptor: Acceptor,
+        acceptor_tls: Vec<(bool, Option<String>, bool)>,
         identities: Arc<IdentityCache>,
         spawner: Spawner,
         zreceiver_pool: Rc<ChannelPool<(arena::Rc<zhttppacket::OwnedResponse>, usize)>>,
         cdone: AsyncLocalReceiver<ConnectionDone>,
         s_cdone: channel::LocalSender<ConnectionDone>,
         conns: Rc<Connections>,
+        load: Arc<AtomicUsize>,
         opts: ConnectionOpts,
         mode_opts: ConnectionModeOpts,
     ) {
@@ -1064,7 +1088,7 @@ impl Worker {
         for config in acceptor_tls {
             if config.0 {
                 let default_cert = config.1.as_deref();
-                tls_acceptors.push(Some(TlsAcceptor::new(&identities, default_cert)));
+                tls_acceptors.push(Some(TlsAcceptor::new(&identities, default_cert, config.2)));
             } else {
                 tls_acceptors.push(None);
             }
@@ -1075,11 +1099,12 @@ impl Worker {
         debug!("server-worker {}: task started: {}", id, name);
 
         loop {
-            let acceptor_recv = if conns.count() < conns.max() {
-                Some(acceptor.recv())
+            let acceptor_recv = pin!(if conns.count() < conns.max() {
+                Some(acceptor.accept())
             } else {
                 None
-            };
+            });
+            let acceptor_recv = acceptor_recv.as_pin_mut();
 
             let (pos, mut stream, peer_addr) =
                 match select_3(stop.recv(), cdone.recv(), select_option(acceptor_recv)).await {
@@ -1089,6 +1114,7 @@ impl Worker {
                     Select3::R2(result) => match result {
                         Ok(done) => {
                             let zreceiver_sender = conns.remove(done.ckey);
+                            load.store(conns.count(), Ordering::Relaxed);
 
                             let zreceiver = zreceiver_sender
                                 .make_receiver(&reactor.local_registration_memory())
@@ -1208,12 +1234,16 @@ impl Worker {
                         sender: zstream_out_sender,
                         sender_stream: zstream_out_stream_sender,
                         stream_shared_mem: stream_opts.stream_shared_mem.clone(),
+                        buf_pool: stream_opts.buf_pool.clone(),
                     });
 
                     (ckey, conn_id, zstream_receiver, mode_opts, Some(shared))
                 }
             };
 
+            // published for the listener thread, if any, to balance by
+            load.store(conns.count(), Ordering::Relaxed);
+
             match mode_opts {
                 ConnectionModeOpts::Req(req_opts) => {
                     if spawner
@@ -1730,6 +1760,7 @@ impl Worker {
                         &stream_opts.blocks_avail,
                         stream_opts.messages_max,
                         &opts.rb_tmp,
+                        &stream_opts.buf_pool,
                         opts.packet_buf,
                         opts.tmp_buf,
                         opts.timeout,
@@ -1755,6 +1786,7 @@ impl Worker {
                         &stream_opts.blocks_avail,
                         stream_opts.messages_max,
                         &opts.rb_tmp,
+                        &stream_opts.buf_pool,
                         opts.packet_buf,
                         opts.tmp_buf,
                         opts.timeout,
@@ -1783,6 +1815,7 @@ impl Worker {
                     &stream_opts.blocks_avail,
                     stream_opts.messages_max,
                     &opts.rb_tmp,
+                    &stream_opts.buf_pool,
                     opts.packet_buf,
                     opts.tmp_buf,
                     opts.timeout,
@@ -1902,13 +1935,94 @@ impl Drop for Worker {
     }
 }
 
+// binds one socket per worker. the first socket resolves the port if it
+// was left to the system, and the rest of the group binds to that
+fn bind_reuseport_group(
+    addr: std::net::SocketAddr,
+    count: usize,
+    steer_cpu: bool,
+) -> Result<Vec<TcpListener>, io::Error> {
+    let first = bind_reuseport(addr)?;
+    let addr = first.local_addr()?;
+
+    let mut ls = vec![first];
+
+    for _ in 1..count {
+        ls.push(bind_reuseport(addr)?);
+    }
+
+    if steer_cpu {
+        match set_cpu_steering(&ls[0], count) {
+            Ok(()) => debug!("steering connections on {} by cpu", addr),
+            Err(e) => warn!("failed to set cpu steering on {}: {}", addr, e),
+        }
+    }
+
+    Ok(ls)
+}
+
+// uses listening sockets received from a previous instance, binding more to
+// the same address if the group is smaller than count
+fn take_over_group(fds: Vec<OwnedFd>, count: usize) -> Result<Vec<TcpListener>, io::Error> {
+    let mut ls = Vec::new();
+
+    for fd in fds {
+        let l = std::net::TcpListener::from(fd);
+        l.set_nonblocking(true)?;
+
+        ls.push(TcpListener::from_std(l));
+    }
+
+    let addr = ls[0].local_addr()?;
+
+    if ls.len() > count {
+        // connections queued on the dropped sockets are reset
+        warn!(
+            "received {} sockets for {}, using {}",
+            ls.len(),
+            addr,
+            count
+        );
+
+        ls.truncate(count);
+    }
+
+    while ls.len() < count {
+        ls.push(bind_reuseport(addr)?);
+    }
+
+    Ok(ls)
+}
+
+// with per-worker listeners, ls holds one listener per worker. otherwise it
+// holds a single listener for the listener thread
+fn add_listeners(
+    shared: &mut Vec<NetListener>,
+    per_worker: &mut [Vec<NetListener>],
+    ls: Vec<NetListener>,
+) {
+    if per_worker.is_empty() {
+        shared.extend(ls);
+    } else {
+        assert_eq!(ls.len(), per_worker.len());
+
+        for (l, v) in ls.into_iter().zip(per_worker.iter_mut()) {
+            v.push(l);
+        }
+    }
+}
+
 pub struct Server {
     addrs: Vec<SocketAddr>,
     workers: Vec<Worker>,
 
-    // underscore-prefixed because we never reference after construction
-    _req_listener: Listener,
-    _stream_listener: Listener,
+    // underscore-prefixed because we never reference after construction.
+    // not used if workers accept on their own sockets
+    _req_listener: Option<Listener>,
+    _stream_listener: Option<Listener>,
+
+    // duplicates of the listening sockets, for passing to a new instance
+    handoff_sockets: Vec<(String, OwnedFd)>,
 }
 
 impl Server {
@@ -1930,13 +2044,26 @@ impl Server {
         allow_compression: bool,
         zsockman: zhttpsocket::ClientSocketManager,
         handle_bound: usize,
+        reuseport: bool,
+        steer_cpu: bool,
+        mut handoff: Option<&mut Handoff>,
     ) -> Result<Self, String> {
         assert!(blocks_max >= stream_maxconn * 2);
 
         let identities = Arc::new(IdentityCache::new(certs_dir));
 
+        // shared by the listener threads, or split by worker if reuseport
         let mut req_listeners = Vec::new();
         let mut stream_listeners = Vec::new();
+        let mut worker_req_listeners: Vec<Vec<NetListener>> = Vec::new();
+        let mut worker_stream_listeners: Vec<Vec<NetListener>> = Vec::new();
+
+        if reuseport {
+            for _ in 0..worker_count {
+                worker_req_listeners.push(Vec::new());
+                worker_stream_listeners.push(Vec::new());
+            }
+        }
 
         let mut req_acceptor_tls = Vec::new();
         let mut stream_acceptor_tls = Vec::new();
@@ -1944,6 +2071,7 @@ impl Server {
         let zsockman = Arc::new(zsockman);
 
         let mut addrs = Vec::new();
+        let mut handoff_sockets = Vec::new();
 
         for lc in listen_addrs.iter() {
             match &lc.spec {
@@ -1951,24 +2079,51 @@ impl Server {
                     addr,
                     tls,
                     default_cert,
+                    ktls,
                 } => {
-                    let l = match TcpListener::bind(*addr) {
-                        Ok(l) => l,
+                    let key = handoff::tcp_key(*addr);
+
+                    let inherited = match handoff.as_mut() {
+                        Some(h) => h.take_sockets(&key),
+                        None => Vec::new(),
+                    };
+
+                    let ls = if !inherited.is_empty() {
+                        let count = if reuseport { worker_count } else { 1 };
+
+                        take_over_group(inherited, count)
+                    } else if reuseport {
+                        bind_reuseport_group(*addr, worker_count, steer_cpu)
+                    } else {
+                        TcpListener::bind(*addr).map(|l| vec![l])
+                    };
+
+                    let ls = match ls {
+                        Ok(ls) => ls,
                         Err(e) => return Err(format!("failed to bind {}: {}", addr, e)),
                     };
 
-                    let addr = l.local_addr().unwrap();
+                    let addr = ls[0].local_addr().unwrap();
 
                     info!("listening on {}", addr);
 
                     addrs.push(SocketAddr::Ip(addr));
 
+                    for l in ls.iter() {
+                        match l.as_fd().try_clone_to_owned() {
+                            Ok(fd) => handoff_sockets.push((key.clone(), fd)),
+                            Err(e) => return Err(format!("failed to clone {}: {}", addr, e)),
+                        }
+                    }
+
+                    let ls = ls.into_iter().map(NetListener::Tcp).collect();
+
                     if lc.stream {
-                        stream_listeners.push(NetListener::Tcp(l));
-                        stream_acceptor_tls.push((*tls, default_cert.clone()));
+                        add_listeners(&mut stream_listeners, &mut worker_stream_listeners, ls);
+                        stream_acceptor_tls.push((*tls, default_cert.clone(), *ktls));
                     } else {
-                        req_listeners.push(NetListener::Tcp(l));
-                        req_acceptor_tls.push((*tls, default_cert.clone()));
+                        add_listeners(&mut req_listeners, &mut worker_req_listeners, ls);
+                        req_acceptor_tls.push((*tls, default_cert.clone(), *ktls));
                     };
                 }
                 ListenSpec::Local {
@@ -1977,43 +2132,63 @@ impl Server {
                     user,
                     group,
                 } => {
-                    // ensure pipe file doesn't exist
-                    match fs::remove_file(path) {
-                        Ok(()) => {}
-                        Err(e) if e.kind() == io::ErrorKind::NotFound => {}
-                        Err(e) => panic!("{}", e),
-                    }
+                    let key = handoff::unix_key(path);
 
-                    let l = match UnixListener::bind(path) {
-                        Ok(l) => l,
-                        Err(e) => return Err(format!("failed to bind {:?}: {}", path, e)),
+                    let mut inherited = match handoff.as_mut() {
+                        Some(h) => h.take_sockets(&key),
+                        None => Vec::new(),
                     };
 
-                    if let Some(mode) = mode {
-                        let perms = fs::Permissions::from_mode(*mode);
+                    // the file is already set up if the socket is inherited
+                    let l = if !inherited.is_empty() {
+                        let l = std::os::unix::net::UnixListener::from(inherited.swap_remove(0));
 
-                        if let Err(e) = fs::set_permissions(path, perms) {
-                            return Err(format!("failed to set mode on {:?}: {}", path, e));
+                        if let Err(e) = l.set_nonblocking(true) {
+                            return Err(format!("failed to set up {:?}: {}", path, e));
                         }
-                    }
 
-                    if let Some(user) = user {
-                        if let Err(e) = set_user(path, user) {
-                            return Err(format!(
-                                "failed to set user {:?} on {:?}: {}",
-                                user, path, e
-                            ));
+                        UnixListener::from_std(l)
+                    } else {
+                        // ensure pipe file doesn't exist
+                        match fs::remove_file(path) {
+                            Ok(()) => {}
+                            Err(e) if e.kind() == io::ErrorKind::NotFound => {}
+                            Err(e) => panic!("{}", e),
+                        }
+
+                        let l = match UnixListener::bind(path) {
+                            Ok(l) => l,
+                            Err(e) => return Err(format!("failed to bind {:?}: {}", path, e)),
+                        };
+
+                        if let Some(mode) = mode {
+                            let perms = fs::Permissions::from_mode(*mode);
+
+                            if let Err(e) = fs::set_permissions(path, perms) {
+                                return Err(format!("failed to set mode on {:?}: {}", path, e));
+                            }
                         }
-                    }
 
-                    if let Some(group) = group {
-                        if let Err(e) = set_group(path, group) {
-                            return Err(format!(
-                                "failed to set group {:?} on {:?}: {}",
-                                group, path, e
-                            ));
+                        if let Some(user) = user {
+                            if let Err(e) = set_user(path, user) {
+                                return Err(format!(
+                                    "failed to set user {:?} on {:?}: {}",
+                                    user, path, e
+                                ));
+                            }
                         }
-                    }
+
+                        if let Some(group) = group {
+                            if let Err(e) = set_group(path, group) {
+                                return Err(format!(
+                                    "failed to set group {:?} on {:?}: {}",
+                                    group, path, e
+                                ));
+                            }
+                        }
+
+                        l
+                    };
 
                     let addr = l.local_addr().unwrap();
 
@@ -2021,29 +2196,70 @@ impl Server {
 
                     addrs.push(SocketAddr::Unix(addr));
 
+                    match l.as_fd().try_clone_to_owned() {
+                        Ok(fd) => handoff_sockets.push((key, fd)),
+                        Err(e) => return Err(format!("failed to clone {:?}: {}", path, e)),
+                    }
+
+                    let mut ls = Vec::new();
+
+                    if reuseport {
+                        for _ in 1..worker_count {
+                            match try_clone_unix(&l) {
+                                Ok(l) => ls.push(NetListener::Unix(l)),
+                                Err(e) => return Err(format!("failed to clone {:?}: {}", path, e)),
+                            }
+                        }
+                    }
+
+                    ls.insert(0, NetListener::Unix(l));
+
                     if lc.stream {
-                        stream_listeners.push(NetListener::Unix(l));
-                        stream_acceptor_tls.push((false, None));
+                        add_listeners(&mut stream_listeners, &mut worker_stream_listeners, ls);
+                        stream_acceptor_tls.push((false, None, false));
                     } else {
-                        req_listeners.push(NetListener::Unix(l));
-                        req_acceptor_tls.push((false, None));
+                        add_listeners(&mut req_listeners, &mut worker_req_listeners, ls);
+                        req_acceptor_tls.push((false, None, false));
                     };
                 }
             }
         }
 
-        let blocks_avail = Arc::new(Counter::new(blocks_max - (stream_maxconn * 2)));
+        let blocks_avail = Arc::new(ShardedCounter::new(
+            blocks_max - (stream_maxconn * 2),
+            worker_count,
+        ));
 
         let mut workers = Vec::new();
         let mut req_lsenders = Vec::new();
         let mut stream_lsenders = Vec::new();
+        let mut req_loads = Vec::new();
+        let mut stream_loads = Vec::new();
 
         for i in 0..worker_count {
-            // rendezvous channels
-            let (s, req_r) = channel::channel(0);
-            req_lsenders.push(s);
-            let (s, stream_r) = channel::channel(0);
-            stream_lsenders.push(s);
+            let req_load = Arc::new(AtomicUsize::new(0));
+            let stream_load = Arc::new(AtomicUsize::new(0));
+
+            let (req_r, stream_r) = if reuseport {
+                (
+                    AcceptSource::Listeners(mem::take(&mut worker_req_listeners[i])),
+                    AcceptSource::Listeners(mem::take(&mut worker_stream_listeners[i])),
+                )
+            } else {
+                // rendezvous channels
+                let (s, req_r) = channel::channel(0);
+                req_lsenders.push(s);
+                let (s, stream_r) = channel::channel(0);
+                stream_lsenders.push(s);
+
+                req_loads.push(Arc::clone(&req_load));
+                stream_loads.push(Arc::clone(&stream_load));
+
+                (
+                    AcceptSource::Channel(req_r),
+                    AcceptSource::Channel(stream_r),
+                )
+            };
 
             let w = Worker::new(
                 instance_id,
@@ -2060,6 +2276,8 @@ impl Server {
                 allow_compression,
                 req_r,
                 stream_r,
+                &req_load,
+                &stream_load,
                 &req_acceptor_tls,
                 &stream_acceptor_tls,
                 &identities,
@@ -2069,14 +2287,31 @@ impl Server {
             workers.push(w);
         }
 
-        let req_listener = Listener::new("listener-req", req_listeners, req_lsenders);
-        let stream_listener = Listener::new("listener-stream", stream_listeners, stream_lsenders);
+        let (req_listener, stream_listener) = if reuseport {
+            (None, None)
+        } else {
+            (
+                Some(Listener::new(
+                    "listener-req",
+                    req_listeners,
+                    req_lsenders,
+                    req_loads,
+                )),
+                Some(Listener::new(
+                    "listener-stream",
+                    stream_listeners,
+                    stream_lsenders,
+                    stream_loads,
+                )),
+            )
+        };
 
         Ok(Self {
             addrs,
             workers,
             _req_listener: req_listener,
             _stream_listener: stream_listener,
+            handoff_sockets,
         })
     }
 
@@ -2084,6 +2319,12 @@ impl Server {
         &self.addrs
     }
 
+    // returns the listening sockets keyed for a handoff. the server keeps
+    // accepting on its own descriptors
+    pub fn take_handoff_sockets(&mut self) -> Vec<(String, OwnedFd)> {
+        mem::take(&mut self.handoff_sockets)
+    }
+
     pub fn task_sizes() -> Vec<(String, usize)> {
         let req_task_size = {
             let reactor = Reactor::new(10);
@@ -2185,12 +2426,13 @@ impl Server {
                 },
                 ConnectionStreamOpts {
                     blocks_max: 2,
-                    blocks_avail: Arc::new(Counter::new(0)),
+                    blocks_avail: Arc::new(ShardedCounter::new(0, 1)),
                     messages_max: 0,
                     allow_compression: false,
                     sender,
                     sender_stream,
                     stream_shared_mem,
+                    buf_pool: Rc::new(BufferPool::new(1, 1)),
                 },
                 shared,
             );
@@ -2213,6 +2455,13 @@ impl Drop for Server {
         for w in self.workers.iter_mut() {
             w.stop();
         }
+
+        let stats = websocket::shared_deflate_stats();
+
+        debug!(
+            "shared deflate: {} messages compressed, {} deliveries reused",
+            stats.compressed, stats.reused
+        );
     }
 }
 
@@ -2289,6 +2538,7 @@ impl TestServer {
                         addr: addr1,
                         tls: false,
                         default_cert: None,
+                        ktls: false,
                     },
                     stream: false,
                 },
@@ -2297,6 +2547,7 @@ impl TestServer {
                         addr: addr2,
                         tls: false,
                         default_cert: None,
+                        ktls: false,
                     },
                     stream: true,
                 },
@@ -2305,6 +2556,9 @@ impl TestServer {
             false,
             zsockman,
             100,
+            false,
+            false,
+            None,
         )
         .unwrap();
 
@@ -2814,6 +3068,68 @@ impl Drop for TestServer {
     }
 }
 
+// the keep-alive work done by a worker each interval, for a given number
+// of stream connections to the same handler. this covers batching the
+// connections and serializing the multi-id packets, not sending them
+pub struct BenchKeepAliveBatch {
+    ids: Vec<ArrayString<32>>,
+    batch: RefCell<Batch>,
+}
+
+impl BenchKeepAliveBatch {
+    pub fn new(conns: usize) -> Self {
+        let count = conns.div_ceil(KEEP_ALIVE_BATCHES);
+
+        let mut ids = Vec::with_capacity(count);
+
+        for i in 0..count {
+            ids.push(ArrayString::from_str(&format!("0-0-{:x}", i)).unwrap());
+        }
+
+        Self {
+            ids,
+            batch: RefCell::new(Batch::new(count)),
+        }
+    }
+
+    // connections handled per interval
+    pub fn batch_size(&self) -> usize {
+        self.ids.len()
+    }
+
+    // returns the number of packets produced
+    pub fn run(&self) -> usize {
+        let batch = &mut *self.batch.borrow_mut();
+
+        for ckey in 0..self.ids.len() {
+            batch.add(b"handler", false, ckey).unwrap();
+        }
+
+        let mut count = 0;
+
+        while let Some(group) = batch.take_group(|ckey| Some((self.ids[ckey].as_bytes(), 0))) {
+            let zreq = zhttppacket::Request {
+                from: b"connmgr",
+                ids: group.ids(),
+                multi: true,
+                ptype: zhttppacket::RequestPacket::KeepAlive,
+                ptype_str: "",
+            };
+
+            let mut data = [0; BULK_PACKET_SIZE_MAX];
+
+            let size = zreq.serialize(&mut data).unwrap();
+
+            let msg = zmq::Message::from(&data[..size]);
+            assert!(!msg.is_empty());
+
+            count += 1;
+        }
+
+        count
+    }
+}
+
 #[cfg(test)]
 pub mod tests {
     use super::*;
@@ -3109,6 +3425,18 @@ pub mod tests {
         assert_eq!(size, 0);
     }
 
+    #[test]
+    fn test_keep_alive_batch() {
+        let t = BenchKeepAliveBatch::new(KEEP_ALIVE_BATCHES * 100);
+        assert_eq!(t.batch_size(), 100);
+
+        // all ids fit in one packet
+        assert_eq!(t.run(), 1);
+
+        // reusable
+        assert_eq!(t.run(), 1);
+    }
+
     #[cfg(target_arch = "x86_64")]
     #[cfg(debug_assertions)]
     #[test]
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+use crate::connmgr::ktls;
 use crate::core::event::{self, ReadinessExt};
 use crate::core::io::{AsyncRead, AsyncWrite};
 use crate::core::net::AsyncTcpStream;
@@ -24,10 +25,12 @@ use arrayvec::ArrayString;
 use log::debug;
 use mio::net::TcpStream;
 use openssl::error::ErrorStack;
+use openssl::ex_data::Index;
 use openssl::pkey::PKey;
 use openssl::ssl::{
-    self, HandshakeError, MidHandshakeSslStream, NameType, SniError, SslAcceptor, SslConnector,
-    SslContext, SslContextBuilder, SslFiletype, SslMethod, SslStream, SslVerifyMode,
+    self, HandshakeError, MidHandshakeSslStream, NameType, SniError, Ssl, SslAcceptor,
+    SslConnector, SslContext, SslContextBuilder, SslFiletype, SslMethod, SslOptions, SslRef,
+    SslSession, SslSessionCacheMode, SslStream, SslVerifyMode,
 };
 use openssl::x509::X509;
 use std::any::Any;
@@ -41,18 +44,20 @@ use std::io;
 use std::io::{Read, Write};
 use std::marker::PhantomData;
 use std::mem;
-use std::os::fd::{FromRawFd, IntoRawFd};
+use std::os::fd::{AsRawFd, FromRawFd, IntoRawFd, RawFd};
 use std::path;
 use std::path::{Path, PathBuf};
 use std::pin::Pin;
 use std::ptr;
 use std::str::FromStr;
-use std::sync::{Arc, Mutex, MutexGuard};
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, Mutex, MutexGuard, OnceLock};
 use std::task::{Context, Poll, Waker};
 use std::time::{Duration, Instant, SystemTime};
 
 const DOMAIN_LEN_MAX: usize = 253;
 const CONFIG_CACHE_TTL: Duration = Duration::from_secs(60);
+const SESSION_CACHE_MAX: usize = 10_000;
 
 enum IdentityError {
     InvalidName,
@@ -285,12 +290,22 @@ enum Stream<T> {
 
 pub struct TlsAcceptor {
     acceptor: SslAcceptor,
+    ktls: bool,
 }
 
 impl TlsAcceptor {
-    pub fn new(cache: &Arc<IdentityCache>, default_cert: Option<&str>) -> Self {
+    // if ktls is set, accepted streams attempt to offload encryption of
+    // outgoing data to the kernel after the handshake
+    pub fn new(cache: &Arc<IdentityCache>, default_cert: Option<&str>, ktls: bool) -> Self {
         let mut acceptor = SslAcceptor::mozilla_intermediate(SslMethod::tls()).unwrap();
 
+        if ktls {
+            acceptor.set_keylog_callback(ktls::keylog_callback);
+
+            // renegotiation would change the keys out from under the kernel
+            acceptor.set_options(SslOptions::NO_RENEGOTIATION);
+        }
+
         let cache = Arc::clone(cache);
         let default_cert: Option<String> = default_cert.map(|s| s.to_owned());
 
@@ -330,6 +345,7 @@ impl TlsAcceptor {
 
         Self {
             acceptor: acceptor.build(),
+            ktls,
         }
     }
 
@@ -395,6 +411,7 @@ impl TlsAcceptor {
 
         Self {
             acceptor: acceptor.build(),
+            ktls: false,
         }
     }
 
@@ -402,8 +419,16 @@ impl TlsAcceptor {
         &self,
         stream: mio::net::TcpStream,
     ) -> Result<TlsStream<mio::net::TcpStream>, ssl::Error> {
+        let fd = stream.as_raw_fd();
+
         let result = TlsStream::new(false, stream, |stream| {
-            let stream = match self.acceptor.accept(stream) {
+            let mut ssl = Ssl::new(self.acceptor.context())?;
+
+            if self.ktls {
+                ktls::prepare(&mut ssl)?;
+            }
+
+            let stream = match ssl.accept(stream) {
                 Ok(stream) => Stream::Ssl(stream),
                 Err(HandshakeError::SetupFailure(e)) => return Err(e.into()),
                 Err(HandshakeError::Failure(stream)) => return Err(stream.into_error()),
@@ -414,12 +439,20 @@ impl TlsAcceptor {
         });
 
         match result {
-            Ok(stream) => Ok(stream),
+            Ok(mut stream) => {
+                if self.ktls {
+                    stream.ktls_fd = Some(fd);
+                    stream.start_ktls();
+                }
+
+                Ok(stream)
+            }
             Err((_, e)) => Err(e),
         }
     }
 }
 
+#[derive(Clone, Copy, Debug, Eq, Hash, PartialEq)]
 pub enum VerifyMode {
     Full,
     None,
@@ -476,6 +509,7 @@ fn apply_wants(e: &ssl::Error, interests: &mut Option<mio::Interest>) {
 struct Connector {
     inner: Arc<SslConnector>,
     created: Instant,
+    generation: u64,
 }
 
 struct Connectors {
@@ -483,12 +517,107 @@ struct Connectors {
     verify_none: Option<Connector>,
 }
 
+// sessions are looked up by the server name and port, and by the verify
+// mode so that a session established without verification is never used to
+// skip verification later
+#[derive(Clone, Eq, Hash, PartialEq)]
+struct SessionKey {
+    domain: String,
+    port: u16,
+    verify_mode: VerifyMode,
+}
+
+struct SessionEntry {
+    session: SslSession,
+    generation: u64,
+    created: Instant,
+}
+
+#[derive(Default)]
+struct Sessions {
+    entries: HashMap<SessionKey, SessionEntry>,
+}
+
+impl Sessions {
+    fn get(&mut self, key: &SessionKey, generation: u64) -> Option<SslSession> {
+        let e = self.entries.get(key)?;
+
+        // a session may only be resumed with the context that created it
+        let lifetime = Duration::from_secs(e.session.timeout().max(0) as u64);
+
+        if e.generation != generation || e.created.elapsed() >= lifetime {
+            self.entries.remove(key);
+
+            return None;
+        }
+
+        Some(e.session.clone())
+    }
+
+    fn insert(&mut self, key: SessionKey, session: SslSession, generation: u64) {
+        if self.entries.len() >= SESSION_CACHE_MAX && !self.entries.contains_key(&key) {
+            self.entries.retain(|_, e| e.generation == generation);
+
+            if self.entries.len() >= SESSION_CACHE_MAX {
+                self.entries.clear();
+            }
+        }
+
+        self.entries.insert(
+            key,
+            SessionEntry {
+                session,
+                generation,
+                created: Instant::now(),
+            },
+        );
+    }
+}
+
+fn session_key_index() -> Result<Index<Ssl, SessionKey>, ErrorStack> {
+    static INDEX: OnceLock<Index<Ssl, SessionKey>> = OnceLock::new();
+
+    if let Some(index) = INDEX.get() {
+        return Ok(*index);
+    }
+
+    let index = Ssl::new_ex_index()?;
+
+    Ok(*INDEX.get_or_init(|| index))
+}
+
+#[derive(Default)]
+struct HandshakeCounters {
+    resumed: AtomicU64,
+    full: AtomicU64,
+}
+
+impl HandshakeCounters {
+    fn record(&self, ssl: &SslRef) {
+        if ssl.session_reused() {
+            self.resumed.fetch_add(1, Ordering::Relaxed);
+        } else {
+            self.full.fetch_add(1, Ordering::Relaxed);
+        }
+    }
+}
+
+#[derive(Clone, Copy, Debug, Default, Eq, PartialEq)]
+pub struct TlsHandshakeStats {
+    pub resumed: u64,
+    pub full: u64,
+}
+
 // represents a cache of reusable data among sessions. internally, this data
 // consists of SslConnectors for the purpose of caching root certs read from
 // disk. the type is given a vague name in order to avoid committing to what
-// exactly is cached.
+// exactly is cached. client sessions are cached too, so that connections to
+// the same server can resume instead of doing a full handshake.
 pub struct TlsConfigCache {
     connectors: Mutex<Connectors>,
+    next_generation: AtomicU64,
+    sessions: Arc<Mutex<Sessions>>,
+    handshakes: Arc<HandshakeCounters>,
 }
 
 impl Default for TlsConfigCache {
@@ -504,10 +633,23 @@ impl TlsConfigCache {
                 verify_full: None,
                 verify_none: None,
             }),
+            next_generation: AtomicU64::new(0),
+            sessions: Arc::new(Mutex::new(Sessions::default())),
+            handshakes: Arc::new(HandshakeCounters::default()),
         }
     }
 
-    fn get_connector(&self, verify_mode: VerifyMode) -> Result<Arc<SslConnector>, ErrorStack> {
+    pub fn handshake_stats(&self) -> TlsHandshakeStats {
+        TlsHandshakeStats {
+            resumed: self.handshakes.resumed.load(Ordering::Relaxed),
+            full: self.handshakes.full.load(Ordering::Relaxed),
+        }
+    }
+
+    fn get_connector(
+        &self,
+        verify_mode: VerifyMode,
+    ) -> Result<(Arc<SslConnector>, u64), ErrorStack> {
         let mut connectors = self
             .connectors
             .lock()
@@ -518,9 +660,11 @@ impl TlsConfigCache {
             VerifyMode::None => &mut connectors.verify_none,
         };
 
-        let connector = match slot {
-            Some(c) if c.created.elapsed() < CONFIG_CACHE_TTL => &c.inner,
+        let c = match slot {
+            Some(c) if c.created.elapsed() < CONFIG_CACHE_TTL => c,
             _ => {
+                let generation = self.next_generation.fetch_add(1, Ordering::Relaxed);
+
                 let mut builder = SslConnector::builder(SslMethod::tls())?;
 
                 match verify_mode {
@@ -528,16 +672,64 @@ impl TlsConfigCache {
                     VerifyMode::None => builder.set_verify(SslVerifyMode::NONE),
                 }
 
-                let c = slot.insert(Connector {
-                    inner: Arc::new(builder.build()),
-                    created: Instant::now(),
+                // sessions are stored by the callback rather than after the
+                // handshake, since tls 1.3 servers send tickets afterwards
+                let key_index = session_key_index()?;
+                let sessions = Arc::clone(&self.sessions);
+
+                builder.set_session_cache_mode(
+                    SslSessionCacheMode::CLIENT | SslSessionCacheMode::NO_INTERNAL,
+                );
+                builder.set_new_session_callback(move |ssl, session| {
+                    if let Some(key) = ssl.ex_data(key_index) {
+                        let mut sessions = sessions.lock().unwrap();
+
+                        sessions.insert(key.clone(), session, generation);
+                    }
                 });
 
-                &c.inner
+                slot.insert(Connector {
+                    inner: Arc::new(builder.build()),
+                    created: Instant::now(),
+                    generation,
+                })
             }
         };
 
-        Ok(Arc::clone(connector))
+        Ok((Arc::clone(&c.inner), c.generation))
+    }
+
+    fn connect<S>(
+        &self,
+        domain: &str,
+        port: u16,
+        stream: S,
+        verify_mode: VerifyMode,
+    ) -> Result<SslStream<S>, HandshakeError<S>>
+    where
+        S: Read + Write,
+    {
+        let (connector, generation) = self.get_connector(verify_mode)?;
+
+        let key = SessionKey {
+            domain: domain.to_string(),
+            port,
+            verify_mode,
+        };
+
+        let session = self.sessions.lock().unwrap().get(&key, generation);
+
+        let mut config = connector.configure()?;
+
+        if let Some(session) = &session {
+            // SAFETY: the session was created by this connector's context,
+            // as ensured by the generation check
+            unsafe { config.set_session(session)? };
+        }
+
+        config.set_ex_data(session_key_index()?, key);
+
+        config.connect(domain, stream)
     }
 }
 
@@ -546,6 +738,9 @@ pub struct TlsStream<T> {
     plain_stream: Box<Box<dyn ReadWrite>>,
     id: ArrayString<64>,
     client: bool,
+    handshakes: Option<Arc<HandshakeCounters>>,
+    ktls_fd: Option<RawFd>,
+    ktls_tx: bool,
     interests_for_handshake: Option<mio::Interest>,
     interests_for_shutdown: Option<mio::Interest>,
     interests_for_read: Option<mio::Interest>,
@@ -559,14 +754,13 @@ where
 {
     pub fn connect(
         domain: &str,
+        port: u16,
         stream: T,
         verify_mode: VerifyMode,
         config_cache: &TlsConfigCache,
     ) -> Result<Self, (T, ssl::Error)> {
-        Self::new(true, stream, |stream| {
-            let connector = config_cache.get_connector(verify_mode)?;
-
-            let stream = match connector.connect(domain, stream) {
+        let mut s = Self::new(true, stream, |stream| {
+            let stream = match config_cache.connect(domain, port, stream, verify_mode) {
                 Ok(stream) => Stream::Ssl(stream),
                 Err(HandshakeError::SetupFailure(e)) => return Err(e.into()),
                 Err(HandshakeError::Failure(stream)) => return Err(stream.into_error()),
@@ -574,7 +768,15 @@ where
             };
 
             Ok(stream)
-        })
+        })?;
+
+        s.handshakes = Some(Arc::clone(&config_cache.handshakes));
+
+        if let Stream::Ssl(stream) = &s.stream {
+            config_cache.handshakes.record(stream.ssl());
+        }
+
+        Ok(s)
     }
 
     pub fn get_inner<'a>(&'a mut self) -> &'a mut T {
@@ -623,9 +825,21 @@ where
             Stream::MidHandshakeSsl(_) => match mem::replace(&mut self.stream, Stream::NoSsl) {
                 Stream::MidHandshakeSsl(stream) => match stream.handshake() {
                     Ok(stream) => {
-                        debug!("{} {}: tls handshake success", self.log_prefix(), self.id);
+                        debug!(
+                            "{} {}: tls handshake success (resumed={})",
+                            self.log_prefix(),
+                            self.id,
+                            stream.ssl().session_reused()
+                        );
+
+                        if let Some(handshakes) = &self.handshakes {
+                            handshakes.record(stream.ssl());
+                        }
+
                         self.stream = Stream::Ssl(stream);
 
+                        self.start_ktls();
+
                         Ok(())
                     }
                     Err(HandshakeError::SetupFailure(e)) => Err(TlsStreamError::Ssl(e)),
@@ -646,6 +860,10 @@ where
         }
     }
 
+    pub fn is_ktls(&self) -> bool {
+        self.ktls_tx
+    }
+
     pub fn shutdown(&mut self) -> Result<(), io::Error> {
         self.interests_for_shutdown = None;
 
@@ -654,6 +872,22 @@ where
             _ => return Err(io::Error::from(io::ErrorKind::Other)),
         };
 
+        // openssl would encrypt the alert itself, so it needs to go
+        // through the kernel instead
+        if let (true, Some(fd)) = (self.ktls_tx, self.ktls_fd) {
+            if let Err(e) = ktls::send_close_notify(fd) {
+                if e.kind() == io::ErrorKind::WouldBlock {
+                    self.interests_for_shutdown = Some(mio::Interest::WRITABLE);
+                }
+
+                return Err(e);
+            }
+
+            debug!("{} {}: tls shutdown sent", self.log_prefix(), self.id);
+
+            return Ok(());
+        }
+
         if let Err(e) = stream.shutdown() {
             apply_wants(&e, &mut self.interests_for_shutdown);
 
@@ -727,6 +961,9 @@ where
             plain_stream: outer_box,
             id: ArrayString::from("<unknown>").unwrap(),
             client,
+            handshakes: None,
+            ktls_fd: None,
+            ktls_tx: false,
             interests_for_handshake: None,
             interests_for_shutdown: None,
             interests_for_read: None,
@@ -735,6 +972,38 @@ where
         })
     }
 
+    // offload must happen right after the handshake, before any
+    // application data is written
+    fn start_ktls(&mut self) {
+        let fd = match self.ktls_fd {
+            Some(fd) if !self.ktls_tx => fd,
+            _ => return,
+        };
+
+        let stream = match &self.stream {
+            Stream::Ssl(stream) => stream,
+            _ => return,
+        };
+
+        match ktls::enable_tx(fd, stream.ssl()) {
+            Ok(()) => {
+                debug!("{} {}: ktls enabled", self.log_prefix(), self.id);
+
+                self.ktls_tx = true;
+            }
+            Err(e) => {
+                debug!(
+                    "{} {}: ktls not enabled, encrypting in userspace: {}",
+                    self.log_prefix(),
+                    self.id,
+                    e
+                );
+
+                self.ktls_fd = None;
+            }
+        }
+    }
+
     fn log_prefix(&self) -> &'static str {
         if self.client {
             "client-conn"
@@ -762,7 +1031,20 @@ where
             _ => unreachable!(),
         };
 
-        match stream.ssl_read(buf) {
+        let ret = stream.ssl_read(buf);
+
+        // our response would have to be sent with updated keys
+        if self.ktls_tx && ktls::key_update_pending(stream.ssl()) {
+            debug!(
+                "{} {}: key update requested with ktls, closing",
+                self.log_prefix(),
+                self.id
+            );
+
+            return Err(TlsStreamError::Unusable);
+        }
+
+        match ret {
             Ok(size) => Ok(size),
             Err(e) if e.code() == ssl::ErrorCode::ZERO_RETURN => Ok(0),
             Err(e) => {
@@ -792,6 +1074,20 @@ where
             _ => unreachable!(),
         };
 
+        // the kernel frames and encrypts
+        if self.ktls_tx {
+            return match stream.get_mut().write(buf) {
+                Ok(size) => Ok(size),
+                Err(e) => {
+                    if e.kind() == io::ErrorKind::WouldBlock {
+                        self.interests_for_write = Some(mio::Interest::WRITABLE);
+                    }
+
+                    Err(TlsStreamError::Io(e))
+                }
+            };
+        }
+
         match stream.ssl_write(buf) {
             Ok(size) => Ok(size),
             Err(e) => {
@@ -996,6 +1292,7 @@ impl<'a: 'b, 'b> AsyncTlsStream<'a> {
 
     pub fn connect(
         domain: &str,
+        port: u16,
         stream: AsyncTcpStream,
         verify_mode: VerifyMode,
         waker_data: &'a RefWakerData<TlsWaker>,
@@ -1003,7 +1300,7 @@ impl<'a: 'b, 'b> AsyncTlsStream<'a> {
     ) -> Result<Self, ssl::Error> {
         let (registration, stream) = stream.into_evented().into_parts();
 
-        let stream = match TlsStream::connect(domain, stream, verify_mode, config_cache) {
+        let stream = match TlsStream::connect(domain, port, stream, verify_mode, config_cache) {
             Ok(stream) => stream,
             Err((mut stream, e)) => {
                 registration.deregister_io(&mut stream).unwrap();
@@ -1356,8 +1653,14 @@ mod tests {
     #[test]
     fn test_get_change_inner() {
         let a = ReadWriteA { a: 1 };
-        let mut stream =
-            TlsStream::connect("localhost", a, VerifyMode::Full, &TlsConfigCache::new()).unwrap();
+        let mut stream = TlsStream::connect(
+            "localhost",
+            443,
+            a,
+            VerifyMode::Full,
+            &TlsConfigCache::new(),
+        )
+        .unwrap();
         assert_eq!(stream.get_inner().a, 1);
         let mut stream = stream.change_inner(|_| ReadWriteB { b: 2 });
         assert_eq!(stream.get_inner().b, 2);
@@ -1366,11 +1669,16 @@ mod tests {
     #[test]
     fn test_connect_error() {
         let c = ReadWriteC { c: 1 };
-        let (stream, e) =
-            match TlsStream::connect("localhost", c, VerifyMode::Full, &TlsConfigCache::new()) {
-                Ok(_) => panic!("unexpected success"),
-                Err(ret) => ret,
-            };
+        let (stream, e) = match TlsStream::connect(
+            "localhost",
+            443,
+            c,
+            VerifyMode::Full,
+            &TlsConfigCache::new(),
+        ) {
+            Ok(_) => panic!("unexpected success"),
+            Err(ret) => ret,
+        };
         assert_eq!(stream.c, 1);
         assert_eq!(e.into_io_error().unwrap().kind(), io::ErrorKind::Other);
     }
@@ -1395,6 +1703,7 @@ mod tests {
                         let tls_waker_data = RefWakerData::new(TlsWaker::new());
                         let mut stream = AsyncTlsStream::connect(
                             "localhost",
+                            addr.port(),
                             stream,
                             VerifyMode::None,
                             &tls_waker_data,
@@ -1442,4 +1751,147 @@ mod tests {
 
         executor.run(|timeout| reactor.poll(timeout)).unwrap();
     }
+
+    #[test]
+    fn test_async_tlsstream_ktls() {
+        let reactor = Reactor::new(3); // 3 registrations
+        let executor = Executor::new(2); // 2 tasks
+
+        let spawner = executor.spawner();
+
+        executor
+            .spawn(async move {
+                let addr = "127.0.0.1:0".parse().unwrap();
+                let listener = AsyncTcpListener::bind(addr).expect("failed to bind");
+                let mut acceptor = TlsAcceptor::new_self_signed();
+                acceptor.ktls = true;
+                let addr = listener.local_addr().unwrap();
+
+                spawner
+                    .spawn(async move {
+                        let stream = AsyncTcpStream::connect(&[addr]).await.unwrap();
+                        let tls_waker_data = RefWakerData::new(TlsWaker::new());
+                        let mut stream = AsyncTlsStream::connect(
+                            "localhost",
+                            addr.port(),
+                            stream,
+                            VerifyMode::None,
+                            &tls_waker_data,
+                            &TlsConfigCache::new(),
+                        )
+                        .unwrap();
+
+                        let mut resp = [0u8; 1024];
+                        let mut resp = io::Cursor::new(&mut resp[..]);
+
+                        loop {
+                            let mut buf = [0; 1024];
+
+                            let size = stream.read(&mut buf).await.unwrap();
+                            if size == 0 {
+                                break;
+                            }
+
+                            resp.write(&buf[..size]).unwrap();
+                        }
+
+                        let size = resp.position() as usize;
+                        let resp = str::from_utf8(&resp.get_ref()[..size]).unwrap();
+
+                        assert_eq!(resp, "hello");
+                    })
+                    .unwrap();
+
+                let (stream, _) = listener.accept().await.unwrap();
+                let stream = acceptor.accept(stream).unwrap();
+
+                let tls_waker_data = RefWakerData::new(TlsWaker::new());
+                let mut stream = AsyncTlsStream::new(stream, &tls_waker_data);
+
+                stream.ensure_handshake().await.unwrap();
+
+                // whether or not the kernel took over, the peer sees the
+                // same stream
+                let size = stream.write("hello".as_bytes()).await.unwrap();
+                assert_eq!(size, 5);
+
+                stream.close().await.unwrap();
+            })
+            .unwrap();
+
+        executor.run(|timeout| reactor.poll(timeout)).unwrap();
+    }
+
+    #[test]
+    fn test_async_tlsstream_resume() {
+        let reactor = Reactor::new(3); // 3 registrations
+        let executor = Executor::new(2); // 2 tasks
+
+        let spawner = executor.spawner();
+
+        let config_cache = Arc::new(TlsConfigCache::new());
+
+        {
+            let config_cache = Arc::clone(&config_cache);
+
+            executor
+                .spawn(async move {
+                    let addr = "127.0.0.1:0".parse().unwrap();
+                    let listener = AsyncTcpListener::bind(addr).expect("failed to bind");
+                    let acceptor = TlsAcceptor::new_self_signed();
+                    let addr = listener.local_addr().unwrap();
+
+                    spawner
+                        .spawn(async move {
+                            for _ in 0..2 {
+                                let stream = AsyncTcpStream::connect(&[addr]).await.unwrap();
+                                let tls_waker_data = RefWakerData::new(TlsWaker::new());
+                                let mut stream = AsyncTlsStream::connect(
+                                    "localhost",
+                                    addr.port(),
+                                    stream,
+                                    VerifyMode::None,
+                                    &tls_waker_data,
+                                    &config_cache,
+                                )
+                                .unwrap();
+
+                                stream.ensure_handshake().await.unwrap();
+
+                                let size = stream.write("hello".as_bytes()).await.unwrap();
+                                assert_eq!(size, 5);
+
+                                // an unclean shutdown would make the session
+                                // unresumable
+                                stream.close().await.unwrap();
+                            }
+                        })
+                        .unwrap();
+
+                    for _ in 0..2 {
+                        let (stream, _) = listener.accept().await.unwrap();
+                        let stream = acceptor.accept(stream).unwrap();
+
+                        let tls_waker_data = RefWakerData::new(TlsWaker::new());
+                        let mut stream = AsyncTlsStream::new(stream, &tls_waker_data);
+
+                        let mut buf = [0; 1024];
+                        while stream.read(&mut buf).await.unwrap() > 0 {}
+
+                        stream.close().await.unwrap();
+                    }
+                })
+                .unwrap();
+        }
+
+        executor.run(|timeout| reactor.poll(timeout)).unwrap();
+
+        assert_eq!(
+            config_cache.handshake_stats(),
+            TlsHandshakeStats {
+                resumed: 1,
+                full: 1
+            }
+        );
+    }
 }
@@ -27,10 +27,14 @@ use miniz_oxide::{DataFormat, MZError, MZFlush, MZStatus};
 use std::ascii;
 use std::cell::{Cell, RefCell};
 use std::cmp;
+use std::collections::hash_map::DefaultHasher;
+use std::collections::VecDeque;
 use std::fmt;
+use std::hash::Hasher;
 use std::io;
 use std::io::Write;
 use std::mem::{self, MaybeUninit};
+use std::sync::atomic::{AtomicU64, Ordering};
 
 pub const WS_GUID: &str = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
 
@@ -55,6 +59,11 @@ const DEFAULT_MAX_WINDOW_BITS: u8 = 15;
 const DEFLATE_SUFFIX: [u8; 4] = [0x00, 0x00, 0xff, 0xff];
 const ENC_NEXT_BUF_SIZE: usize = DEFLATE_SUFFIX.len();
 
+// bounds for messages compressed through the shared cache
+const SHARED_DEFLATE_MIN: usize = 128;
+const SHARED_DEFLATE_MAX: usize = 65_536;
+const SHARED_DEFLATE_ENTRIES: usize = 8;
+
 struct Bufs<'a> {
     data: &'a [&'a [u8]],
 }
@@ -219,8 +228,26 @@ pub fn write_header(
 }
 
 pub fn apply_mask(buf: &mut [u8], mask: [u8; 4], offset: usize) {
-    for (i, c) in buf.iter_mut().enumerate() {
-        *c ^= mask[(offset + i) % 4];
+    // rotate the mask so that it lines up with the start of buf
+    let m = [
+        mask[offset % 4],
+        mask[(offset + 1) % 4],
+        mask[(offset + 2) % 4],
+        mask[(offset + 3) % 4],
+    ];
+
+    // xor a word at a time. the compiler turns this into vector code
+    let wide = u64::from_ne_bytes([m[0], m[1], m[2], m[3], m[0], m[1], m[2], m[3]]);
+
+    let mut chunks = buf.chunks_exact_mut(8);
+
+    for chunk in &mut chunks {
+        let v = u64::from_ne_bytes((&*chunk).try_into().unwrap()) ^ wide;
+        chunk.copy_from_slice(&v.to_ne_bytes());
+    }
+
+    for (i, c) in chunks.into_remainder().iter_mut().enumerate() {
+        *c ^= m[i % 4];
     }
 }
 
@@ -638,6 +665,176 @@ impl DeflateEncoder {
     }
 }
 
+static SHARED_DEFLATE_COMPRESSED: AtomicU64 = AtomicU64::new(0);
+static SHARED_DEFLATE_REUSED: AtomicU64 = AtomicU64::new(0);
+
+pub struct SharedDeflateStats {
+    // messages compressed into the shared cache
+    pub compressed: u64,
+
+    // deliveries that used an already compressed message
+    pub reused: u64,
+}
+
+pub fn shared_deflate_stats() -> SharedDeflateStats {
+    SharedDeflateStats {
+        compressed: SHARED_DEFLATE_COMPRESSED.load(Ordering::Relaxed),
+        reused: SHARED_DEFLATE_REUSED.load(Ordering::Relaxed),
+    }
+}
+
+struct SharedDeflateEntry {
+    hash: u64,
+    input: Vec<u8>,
+    output: Vec<u8>,
+}
+
+// a published message is typically sent to many connections with
+// identical content. for connections without context takeover, every
+// message is compressed from a fresh encoder state, so the output does not
+// depend on the connection and can be computed once and reused for all of
+// the connections on the thread
+struct SharedDeflateCache {
+    enc: DeflateEncoder,
+    entries: VecDeque<SharedDeflateEntry>,
+}
+
+impl SharedDeflateCache {
+    fn new() -> Self {
+        Self {
+            enc: DeflateEncoder::new(),
+            entries: VecDeque::new(),
+        }
+    }
+
+    // calls f with the compressed form of the concatenated bufs. f returns
+    // whether it used the output
+    fn with_compressed<F>(&mut self, src: &[&mut [u8]], f: F) -> Result<bool, io::Error>
+    where
+        F: FnOnce(&[u8]) -> bool,
+    {
+        let mut hasher = DefaultHasher::new();
+        for buf in src.iter() {
+            hasher.write(buf);
+        }
+        let hash = hasher.finish();
+
+        if let Some(pos) = self
+            .entries
+            .iter()
+            .position(|e| e.hash == hash && bufs_equal(&e.input, src))
+        {
+            let used = f(&self.entries[pos].output);
+
+            if used {
+                SHARED_DEFLATE_REUSED.fetch_add(1, Ordering::Relaxed);
+            }
+
+            return Ok(used);
+        }
+
+        let mut input = Vec::new();
+        for buf in src.iter() {
+            input.extend_from_slice(buf);
+        }
+
+        let mut output = Vec::new();
+
+        if let Err(e) = deflate_message(&mut self.enc, &input, &mut output) {
+            // start over with a clean encoder
+            self.enc = DeflateEncoder::new();
+
+            return Err(e);
+        }
+
+        self.enc.reset();
+
+        SHARED_DEFLATE_COMPRESSED.fetch_add(1, Ordering::Relaxed);
+
+        let used = f(&output);
+
+        if self.entries.len() >= SHARED_DEFLATE_ENTRIES {
+            self.entries.pop_back();
+        }
+
+        self.entries.push_front(SharedDeflateEntry {
+            hash,
+            input,
+            output,
+        });
+
+        Ok(used)
+    }
+}
+
+thread_local! {
+    static SHARED_DEFLATE: RefCell<SharedDeflateCache> = RefCell::new(SharedDeflateCache::new());
+}
+
+fn bufs_equal(data: &[u8], bufs: &[&mut [u8]]) -> bool {
+    let mut pos = 0;
+
+    for buf in bufs.iter() {
+        if data.len() - pos < buf.len() || data[pos..(pos + buf.len())] != **buf {
+            return false;
+        }
+
+        pos += buf.len();
+    }
+
+    pos == data.len()
+}
+
+// compress a complete message, without the deflate suffix
+fn deflate_message(
+    enc: &mut DeflateEncoder,
+    src: &[u8],
+    dest: &mut Vec<u8>,
+) -> Result<(), io::Error> {
+    let mut read = 0;
+
+    loop {
+        let start = dest.len();
+        dest.resize(start + (src.len() - read) + 64, 0);
+
+        let (r, w, end_ack) = enc.encode(&src[read..], true, &mut dest[start..])?;
+
+        dest.truncate(start + w);
+        read += r;
+
+        if end_ack {
+            break;
+        }
+    }
+
+    Ok(())
+}
+
+// for a connection without context takeover, try to fill dest with the
+// entire compressed message from the shared cache. returns whether the
+// message was written
+fn shared_deflate_to_ringbuffer<T: AsRef<[u8]> + AsMut<[u8]>>(
+    src: &[&mut [u8]],
+    src_len: usize,
+    dest: &mut RingBuffer<T>,
+) -> Result<bool, io::Error> {
+    if !(SHARED_DEFLATE_MIN..=SHARED_DEFLATE_MAX).contains(&src_len) || dest.len() > 0 {
+        return Ok(false);
+    }
+
+    SHARED_DEFLATE.with(|cache| {
+        cache.borrow_mut().with_compressed(src, |output| {
+            if output.len() > dest.remaining_capacity() {
+                return false;
+            }
+
+            dest.write_all(output).unwrap();
+
+            true
+        })
+    })
+}
+
 pub struct DeflateDecoder {
     dec: Box<InflateState>,
     suffix_pos: Option<usize>,
@@ -916,6 +1113,7 @@ struct SendingMessage {
     mask: Option<[u8; 4]>,
     frame_sent: bool,
     end_len: Option<usize>,
+    enc_started: bool,
     enc_output_end: bool,
 }
 
@@ -1151,10 +1349,73 @@ impl<T: AsRef<[u8]> + AsMut<[u8]>> Protocol<T> {
             mask,
             frame_sent: false,
             end_len: None,
+            enc_started: false,
             enc_output_end: false,
         });
     }
 
+    // whether a message can be sent with send_message_direct
+    pub fn can_send_direct(&self) -> bool {
+        self.deflate_state.is_none() && self.sending.message.borrow().is_none()
+    }
+
+    // sends a whole data message from src, uncompressed and unmasked. src
+    // is not modified, so it may be memory shared with other connections.
+    // if only part of the message could be written, the message remains in
+    // progress and the rest must be provided with send_message_content and
+    // end=true. returns the number of src bytes written
+    pub fn send_message_direct<W: Write>(
+        &self,
+        writer: &mut W,
+        opcode: u8,
+        src: &[u8],
+    ) -> Result<usize, Error> {
+        assert!(self.state.get() == State::Connected || self.state.get() == State::PeerClosed);
+        assert!(self.can_send_direct());
+        assert_eq!(opcode & 0x08, 0);
+
+        let sending_frame = &mut *self.sending.frame.borrow_mut();
+
+        assert!(sending_frame.is_none());
+
+        let mut header = ArrayVec::from([0; HEADER_SIZE_MAX]);
+
+        let size = write_header(true, false, opcode, src.len(), None, &mut header)?;
+        header.truncate(size);
+
+        let out = [header.as_slice(), src];
+
+        let ret = write_vectored_offset(writer, &out, 0);
+
+        if log_enabled!(log::Level::Trace) {
+            trace!("OUT sock {} -> {:?}", Bufs::new(&out), ret);
+        }
+
+        let sent = ret?;
+
+        let payload_written = sent.saturating_sub(header.len());
+
+        if sent < header.len() + src.len() {
+            *sending_frame = Some(SendingFrame {
+                opcode,
+                header,
+                payload_size: src.len(),
+                sent,
+            });
+
+            *self.sending.message.borrow_mut() = Some(SendingMessage {
+                opcode,
+                mask: None,
+                frame_sent: true,
+                end_len: Some(src.len() - payload_written),
+                enc_started: false,
+                enc_output_end: false,
+            });
+        }
+
+        Ok(payload_written)
+    }
+
     // returns (bytes read, done)
     // note: when compression is used, bytes may be buffered in the encoder
     // and may not be flushed to the writer until the encoder's buffer is
@@ -1212,6 +1473,20 @@ impl<T: AsRef<[u8]> + AsMut<[u8]>> Protocol<T> {
 
                 let mut read = 0;
 
+                // if the whole message is provided up front, it may be
+                // possible to use shared compressed output
+                if !msg.enc_started {
+                    msg.enc_started = true;
+
+                    if !state.allow_takeover
+                        && end
+                        && shared_deflate_to_ringbuffer(src, src_len, &mut state.enc_buf)?
+                    {
+                        read = src_len;
+                        msg.enc_output_end = true;
+                    }
+                }
+
                 if !msg.enc_output_end {
                     if src_len > 0 {
                         for (i, buf) in src.iter().enumerate() {
@@ -1760,6 +2035,23 @@ mod tests {
         let mut buf = [b'a', b'b', b'c', b'd', b'e'];
         apply_mask(&mut buf, [0x01, 0x02, 0x03, 0x04], 0);
         assert_eq!(buf, [0x60, 0x60, 0x60, 0x60, 0x64]);
+
+        let mask = [0x01, 0x02, 0x03, 0x04];
+
+        for offset in 0..4 {
+            for len in 0..40 {
+                let src: Vec<u8> = (0..len).map(|i| i as u8).collect();
+
+                let mut expected = src.clone();
+                for (i, c) in expected.iter_mut().enumerate() {
+                    *c ^= mask[(offset + i) % 4];
+                }
+
+                let mut buf = src.clone();
+                apply_mask(&mut buf, mask, offset);
+                assert_eq!(buf, expected, "offset={} len={}", offset, len);
+            }
+        }
     }
 
     #[test]
@@ -2070,6 +2362,55 @@ mod tests {
         assert_eq!(writer.data, b"\x81\x05hello");
     }
 
+    #[test]
+    fn test_send_message_direct() {
+        let p = Protocol::<[u8; 0]>::new(None);
+
+        let mut writer = MyWriter::new();
+
+        assert!(p.can_send_direct());
+
+        let size = p
+            .send_message_direct(&mut writer, OPCODE_TEXT, b"hello")
+            .unwrap();
+        assert_eq!(size, 5);
+        assert_eq!(writer.data, b"\x81\x05hello");
+        assert!(!p.is_sending_message());
+
+        // partial write leaves the rest of the message in progress
+        writer.data.clear();
+        writer.allow = 1;
+
+        let size = p
+            .send_message_direct(&mut writer, OPCODE_BINARY, b"hello")
+            .unwrap();
+        assert_eq!(size, 0);
+        assert!(p.is_sending_message());
+        assert!(!p.can_send_direct());
+
+        writer.allow = 3;
+
+        let (size, done) = p
+            .send_message_content(&mut writer, &mut [&mut make_buf(b"hello")], true)
+            .unwrap();
+        assert_eq!(size, 2);
+        assert_eq!(done, false);
+
+        writer.allow = 1024;
+
+        let (size, done) = p
+            .send_message_content(&mut writer, &mut [&mut make_buf(b"llo")], true)
+            .unwrap();
+        assert_eq!(size, 3);
+        assert_eq!(done, true);
+        assert_eq!(writer.data, b"\x82\x05hello");
+        assert!(p.can_send_direct());
+
+        let tmp = Rc::new(TmpBuffer::new(1024));
+        let p = Protocol::new(Some((false, VecRingBuffer::new(1024, &tmp))));
+        assert!(!p.can_send_direct());
+    }
+
     #[test]
     fn test_recv_frame() {
         let mut data = b"\x81\x05hello".to_vec();
@@ -2245,6 +2586,67 @@ mod tests {
         assert_eq!(end, true);
     }
 
+    #[test]
+    fn test_send_compressed_shared() {
+        let tmp = Rc::new(TmpBuffer::new(1024));
+
+        let mut msg = Vec::new();
+        for i in 0..50 {
+            write!(&mut msg, "hello {} ", i).unwrap();
+        }
+        assert!(msg.len() >= SHARED_DEFLATE_MIN);
+
+        let send = |allow_takeover| {
+            let p = Protocol::new(Some((allow_takeover, VecRingBuffer::new(1024, &tmp))));
+
+            let mut writer = MyWriter::new();
+
+            p.send_message_start(OPCODE_TEXT, None);
+
+            let mut src = msg.clone();
+            let (size, done) = p
+                .send_message_content(&mut writer, &mut [src.as_mut()], true)
+                .unwrap();
+            assert_eq!(size, msg.len());
+            assert_eq!(done, false);
+
+            let (size, done) = p.send_message_content(&mut writer, &mut [], true).unwrap();
+            assert_eq!(size, 0);
+            assert_eq!(done, true);
+
+            writer.data
+        };
+
+        let start = shared_deflate_stats();
+
+        let out1 = send(false);
+        let out2 = send(false);
+        assert_eq!(out1, out2);
+
+        let stats = shared_deflate_stats();
+        assert!(stats.compressed > start.compressed);
+        assert!(stats.reused > start.reused);
+
+        // same as compressing per connection
+        assert_eq!(send(true), out1);
+
+        let mut data = out1;
+        let mut rbuf = io::Cursor::new(data.as_mut());
+
+        let p = Protocol::new(Some((false, VecRingBuffer::new(1024, &tmp))));
+
+        let mut dest = [0; 1024];
+
+        let (opcode, size, end) = p
+            .recv_message_content(&mut rbuf, &mut dest)
+            .unwrap()
+            .unwrap();
+
+        assert_eq!(opcode, OPCODE_TEXT);
+        assert_eq!(&dest[..size], msg.as_slice());
+        assert_eq!(end, true);
+    }
+
     #[test]
     fn test_send_recv_compressed_fragmented() {
         let tmp = Rc::new(TmpBuffer::new(1024));
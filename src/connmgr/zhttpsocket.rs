@@ -35,7 +35,7 @@ use arrayvec::{ArrayString, ArrayVec};
 use log::{debug, error, log_enabled, trace, warn};
 use slab::Slab;
 use std::cell::{Cell, RefCell};
-use std::collections::HashMap;
+use std::collections::{HashMap, VecDeque};
 use std::convert::TryFrom;
 use std::fmt;
 use std::future::Future;
@@ -58,6 +58,8 @@ const STREAM_OUT_STREAM_DELAY: Duration = Duration::from_millis(50);
 const LOG_METADATA_MAX: usize = 1_000;
 const LOG_CONTENT_MAX: usize = 1_000;
 const EXECUTOR_TASKS_MAX: usize = 1;
+const BATCH_PACKETS_MAX: usize = 64;
+const BATCH_SIZE_MAX: usize = 65_000;
 
 struct Packet<'a> {
     map_frame: tnetstring::Frame<'a>,
@@ -193,6 +195,45 @@ impl fmt::Display for Packet<'_> {
     }
 }
 
+// returns the position of the packet type byte. messages sent without an
+// address are prefixed with one
+fn batch_prefix_len(routed: bool, msg: &[u8]) -> Option<usize> {
+    let pos = if routed {
+        0
+    } else {
+        msg.iter().position(|b| *b == b' ')? + 1
+    };
+
+    if msg.get(pos) == Some(&b'T') {
+        Some(pos)
+    } else {
+        None
+    }
+}
+
+// combines packets for the same destination into a single message
+// containing a list of them
+fn encode_batch(routed: bool, msgs: &[zmq::Message]) -> zmq::Message {
+    let prefix_len = batch_prefix_len(routed, &msgs[0]).unwrap();
+
+    let payload_len: usize = msgs.iter().map(|m| m.len() - (prefix_len + 1)).sum();
+    let payload_len_str = payload_len.to_string();
+
+    let mut v = Vec::with_capacity(prefix_len + payload_len_str.len() + payload_len + 3);
+
+    v.extend_from_slice(&msgs[0][..(prefix_len + 1)]);
+    v.extend_from_slice(payload_len_str.as_bytes());
+    v.push(b':');
+
+    for m in msgs {
+        v.extend_from_slice(&m[(prefix_len + 1)..]);
+    }
+
+    v.push(b']');
+
+    zmq::Message::from(v)
+}
+
 fn packet_to_string(data: &[u8]) -> String {
     if data.is_empty() {
         return String::from("<packet is 0 bytes>");
@@ -1071,6 +1112,7 @@ struct ServerStreamHandles {
     nodes: Slab<list::Node<ServerStreamPipe>>,
     list: list::List,
     recv_scratch: RefCell<RecvScratch<(Option<ArrayVec<u8, 64>>, zmq::Message)>>,
+    pending: RefCell<VecDeque<(Option<ArrayVec<u8, 64>>, zmq::Message)>>,
     check_send_any_scratch: RefCell<CheckSendScratch<(arena::Arc<zmq::Message>, Session)>>,
     send_direct_scratch: RefCell<Vec<bool>>,
     need_cleanup: Cell<bool>,
@@ -1084,6 +1126,7 @@ impl ServerStreamHandles {
             nodes: Slab::with_capacity(capacity),
             list: list::List::default(),
             recv_scratch: RefCell::new(RecvScratch::new(capacity)),
+            pending: RefCell::new(VecDeque::with_capacity(BATCH_PACKETS_MAX)),
             check_send_any_scratch: RefCell::new(CheckSendScratch::new(capacity)),
             send_direct_scratch: RefCell::new(Vec::with_capacity(capacity)),
             need_cleanup: Cell::new(false),
@@ -1109,6 +1152,12 @@ impl ServerStreamHandles {
 
     #[allow(clippy::await_holding_refcell_ref)]
     async fn recv(&self) -> (Option<ArrayVec<u8, 64>>, zmq::Message) {
+        // messages set aside by collect_batch() go first
+        let ret = self.pending.borrow_mut().pop_front();
+        if let Some(ret) = ret {
+            return ret;
+        }
+
         let mut scratch = self.recv_scratch.borrow_mut();
 
         let (mut tasks, slice_scratch) = scratch.get();
@@ -1146,6 +1195,66 @@ impl ServerStreamHandles {
         }
     }
 
+    // given a batch containing one message, appends messages that the
+    // handles have already queued for the same destination, up to the batch
+    // limits. messages for other destinations are set aside, in order, to be
+    // returned by subsequent calls to recv()
+    fn collect_batch(&self, addr: &Option<ArrayVec<u8, 64>>, batch: &mut Vec<zmq::Message>) {
+        assert_eq!(batch.len(), 1);
+
+        let prefix_len = match batch_prefix_len(addr.is_some(), &batch[0]) {
+            Some(n) => n,
+            None => return,
+        };
+
+        let mut pending = self.pending.borrow_mut();
+
+        for (_, p) in self.list.iter(&self.nodes) {
+            if !p.valid.get() {
+                continue;
+            }
+
+            while pending.len() < BATCH_PACKETS_MAX {
+                match p.pe.receiver.try_recv() {
+                    Ok(ret) => pending.push_back(ret),
+                    Err(mpsc::TryRecvError::Empty) => break,
+                    Err(mpsc::TryRecvError::Disconnected) => {
+                        p.valid.set(false);
+                        self.need_cleanup.set(true);
+                        break;
+                    }
+                }
+            }
+        }
+
+        let mut size = batch[0].len();
+
+        let mut i = 0;
+        while i < pending.len() {
+            let (paddr, pmsg) = &pending[i];
+
+            let same_dest = paddr == addr
+                && batch_prefix_len(addr.is_some(), pmsg) == Some(prefix_len)
+                && pmsg[..prefix_len] == batch[0][..prefix_len];
+
+            if !same_dest {
+                i += 1;
+                continue;
+            }
+
+            let item_size = pmsg.len() - (prefix_len + 1);
+
+            // stop at the first message that doesn't fit, to keep order
+            if batch.len() >= BATCH_PACKETS_MAX || size + item_size > BATCH_SIZE_MAX {
+                break;
+            }
+
+            size += item_size;
+
+            batch.push(pending.remove(i).unwrap().1);
+        }
+    }
+
     // waits until at least one handle is likely writable
     #[allow(clippy::await_holding_refcell_ref)]
     async fn check_send_any(&self) {
@@ -1952,6 +2061,9 @@ impl ServerSocketManager {
     //   the next), then the value here should be 4, because there would be
     //   no more than 4 dequeued messages alive at any one time. this number
     //   is needed to help size the internal arena
+    // if batch is set, outbound stream packets that are queued at the same
+    //   time for the same destination may be combined into one message
+    #[allow(clippy::too_many_arguments)]
     pub fn new(
         ctx: Arc<zmq::Context>,
         instance_id: &str,
@@ -1960,6 +2072,7 @@ impl ServerSocketManager {
         other_hwm: usize,
         handle_bound: usize,
         stream_maxconn: usize,
+        batch: bool,
     ) -> Self {
         let (s1, r1) = channel::channel(1);
         let (s2, r2) = channel::channel(1);
@@ -1993,6 +2106,7 @@ impl ServerSocketManager {
                         other_hwm,
                         handle_bound,
                         stream_maxconn,
+                        batch,
                     ))
                     .unwrap();
 
@@ -2089,6 +2203,7 @@ impl ServerSocketManager {
         other_hwm: usize,
         handle_bound: usize,
         stream_maxconn: usize,
+        batch: bool,
     ) {
         let control_sender = AsyncSender::new(control_sender);
         let control_receiver = AsyncReceiver::new(control_receiver);
@@ -2183,6 +2298,8 @@ impl ServerSocketManager {
         let mut req_in_msg = None;
         let mut stream_in_msg = None;
 
+        let mut stream_out_batch = Vec::with_capacity(BATCH_PACKETS_MAX);
+
         loop {
             let req_recv_routed = if req_in_msg.is_none() {
                 Some(req_sock.recv_routed())
@@ -2363,24 +2480,41 @@ impl ServerSocketManager {
                 },
                 // stream_handles_recv
                 Select10::R8((addr, msg)) => {
-                    if let Some(addr) = &addr {
-                        let h = vec![zmq::Message::from(addr.as_ref())];
+                    stream_out_batch.push(msg);
 
-                        if log_enabled!(log::Level::Trace) {
-                            trace!(
-                                "OUT server stream to={} {}",
-                                String::from_utf8_lossy(addr),
-                                packet_to_string(&msg)
-                            );
+                    if batch {
+                        stream_handles.collect_batch(&addr, &mut stream_out_batch);
+                    }
+
+                    if log_enabled!(log::Level::Trace) {
+                        for msg in stream_out_batch.iter() {
+                            if let Some(addr) = &addr {
+                                trace!(
+                                    "OUT server stream to={} {}",
+                                    String::from_utf8_lossy(addr),
+                                    packet_to_string(msg)
+                                );
+                            } else {
+                                trace!("OUT server stream {}", packet_to_string(msg));
+                            }
                         }
+                    }
+
+                    let msg = if stream_out_batch.len() > 1 {
+                        let msg = encode_batch(addr.is_some(), &stream_out_batch);
+                        stream_out_batch.clear();
+
+                        msg
+                    } else {
+                        stream_out_batch.pop().unwrap()
+                    };
+
+                    if let Some(addr) = &addr {
+                        let h = vec![zmq::Message::from(addr.as_ref())];
 
                         stream_out_send =
                             Some(ZmqFuture::SendTo(stream_socks.in_stream.send_to(h, msg)));
                     } else {
-                        if log_enabled!(log::Level::Trace) {
-                            trace!("OUT server stream {}", packet_to_string(&msg));
-                        }
-
                         stream_out_send = Some(ZmqFuture::Send(stream_socks.out.send(msg)));
                     }
                 }
@@ -3337,7 +3471,7 @@ mod tests {
         let zmq_context = Arc::new(zmq::Context::new());
 
         let mut zsockman =
-            ServerSocketManager::new(Arc::clone(&zmq_context), "test", 1, 100, 100, 100, 0);
+            ServerSocketManager::new(Arc::clone(&zmq_context), "test", 1, 100, 100, 100, 0, false);
 
         let h1 = zsockman.server_req_handle();
         let h2 = zsockman.server_req_handle();
@@ -3424,12 +3558,41 @@ mod tests {
         drop(zsockman);
     }
 
+    #[test]
+    fn test_encode_batch() {
+        assert_eq!(batch_prefix_len(true, b"T8:1:a,1:b,}"), Some(0));
+        assert_eq!(batch_prefix_len(true, b"hello"), None);
+        assert_eq!(
+            batch_prefix_len(false, b"test-handler T8:1:a,1:b,}"),
+            Some(13)
+        );
+        assert_eq!(batch_prefix_len(false, b"test-handler world"), None);
+        assert_eq!(batch_prefix_len(false, b"T8:1:a,1:b,}"), None);
+
+        let msgs = [
+            zmq::Message::from("T8:1:a,1:b,}".as_bytes()),
+            zmq::Message::from("T8:1:c,1:d,}".as_bytes()),
+        ];
+        let msg = encode_batch(true, &msgs);
+        assert_eq!(&msg[..], b"T22:8:1:a,1:b,}8:1:c,1:d,}]");
+
+        let msgs = [
+            zmq::Message::from("test-handler T8:1:a,1:b,}".as_bytes()),
+            zmq::Message::from("test-handler T8:1:c,1:d,}".as_bytes()),
+        ];
+        let msg = encode_batch(false, &msgs);
+        assert_eq!(&msg[..], b"test-handler T22:8:1:a,1:b,}8:1:c,1:d,}]");
+
+        let (frame, _) = tnetstring::parse_frame(&msg[14..]).unwrap();
+        assert_eq!(frame.ftype, tnetstring::FrameType::Array);
+    }
+
     #[test]
     fn test_server_stream() {
         let zmq_context = Arc::new(zmq::Context::new());
 
         let zsockman =
-            ServerSocketManager::new(Arc::clone(&zmq_context), "test", 1, 100, 100, 100, 2);
+            ServerSocketManager::new(Arc::clone(&zmq_context), "test", 1, 100, 100, 100, 2, false);
 
         let h1 = zsockman.server_stream_handle();
         let h2 = zsockman.server_stream_handle();
@@ -3702,6 +3865,61 @@ mod tests {
         };
         assert_eq!(rdata.body, b"hello b");
 
+        // one packet addressed to sessions on both handles
+        let req = {
+            let mut rdata = RequestData::new();
+            rdata.body = b"hello all";
+
+            let mut dest = [0; 1024];
+            let size = Request::new_data(
+                b"test-handler",
+                &[
+                    Id {
+                        id: b"a-1",
+                        seq: None,
+                    },
+                    Id {
+                        id: b"b-1",
+                        seq: None,
+                    },
+                ],
+                rdata,
+            )
+            .serialize(&mut dest)
+            .unwrap();
+
+            dest[..size].to_vec()
+        };
+
+        out_stream_sock
+            .send_multipart(["test".as_bytes(), &[], &req], 0)
+            .unwrap();
+
+        for (h, token) in [(&h1, mio::Token(2)), (&h2, mio::Token(4))] {
+            let msg = loop {
+                match h.recv_directed() {
+                    Ok(m) => break m,
+                    Err(e) if e.kind() == io::ErrorKind::WouldBlock => {
+                        wait_readable(&mut poller, token);
+                        continue;
+                    }
+                    Err(e) => panic!("recv: {}", e),
+                }
+            };
+
+            let msg = msg.get();
+            let mut scratch = ParseScratch::new();
+            let req = Request::parse(msg, &mut scratch).unwrap();
+
+            assert_eq!(req.ids.len(), 2);
+
+            let rdata = match req.ptype {
+                RequestPacket::Data(data) => data,
+                _ => panic!("expected data packet"),
+            };
+            assert_eq!(rdata.body, b"hello all");
+        }
+
         drop(sess_a);
         drop(sess_b);
         drop(h1);
@@ -0,0 +1,339 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// CPU affinity for threads. on Linux, memory is allocated from the NUMA node
+// of the CPU that first touches it, so pinning a thread before it starts
+// allocating also keeps its malloc arena local to that node
+
+use std::io;
+
+// parses a list such as "0-3,8,10-11". duplicates are removed and the
+// result is sorted
+pub fn parse_cpu_list(s: &str) -> Result<Vec<usize>, ()> {
+    let mut out = Vec::new();
+
+    for part in s.split(',') {
+        let part = part.trim();
+
+        let (start, end) = match part.split_once('-') {
+            Some((start, end)) => (start.trim(), end.trim()),
+            None => (part, part),
+        };
+
+        let start: usize = start.parse().map_err(|_| ())?;
+        let end: usize = end.parse().map_err(|_| ())?;
+
+        if start > end {
+            return Err(());
+        }
+
+        out.extend(start..=end);
+    }
+
+    out.sort_unstable();
+    out.dedup();
+
+    Ok(out)
+}
+
+// formats a sorted list in the form accepted by parse_cpu_list, collapsing
+// consecutive cpus into ranges
+pub fn format_cpu_list(cpus: &[usize]) -> String {
+    let mut out = String::new();
+    let mut i = 0;
+
+    while i < cpus.len() {
+        let start = cpus[i];
+        let mut end = start;
+
+        while i + 1 < cpus.len() && cpus[i + 1] == end + 1 {
+            end += 1;
+            i += 1;
+        }
+
+        if !out.is_empty() {
+            out.push(',');
+        }
+
+        if start == end {
+            out += &start.to_string();
+        } else {
+            out += &format!("{}-{}", start, end);
+        }
+
+        i += 1;
+    }
+
+    out
+}
+
+// splits cpus by the nodes they belong to, in node order. nodes left with no
+// cpus are dropped, and cpus not found in any node are grouped at the end.
+// with no node information, all cpus form a single group
+pub fn group_cpus_by_node(cpus: &[usize], nodes: &[Vec<usize>]) -> Vec<Vec<usize>> {
+    let mut out = Vec::new();
+    let mut rest: Vec<usize> = cpus.to_vec();
+
+    for node in nodes {
+        let group: Vec<usize> = cpus.iter().copied().filter(|c| node.contains(c)).collect();
+
+        if !group.is_empty() {
+            rest.retain(|c| !group.contains(c));
+            out.push(group);
+        }
+    }
+
+    if !rest.is_empty() {
+        out.push(rest);
+    }
+
+    out
+}
+
+// returns the cpus of each NUMA node in node order, or an empty list if the
+// node layout is not available
+#[cfg(target_os = "linux")]
+pub fn numa_node_cpus() -> Vec<Vec<usize>> {
+    let entries = match std::fs::read_dir("/sys/devices/system/node") {
+        Ok(entries) => entries,
+        Err(_) => return Vec::new(),
+    };
+
+    let mut nodes = Vec::new();
+
+    for entry in entries.flatten() {
+        let name = entry.file_name();
+
+        let id: usize = match name.to_str().and_then(|s| s.strip_prefix("node")) {
+            Some(id) => match id.parse() {
+                Ok(id) => id,
+                Err(_) => continue,
+            },
+            None => continue,
+        };
+
+        let list = match std::fs::read_to_string(entry.path().join("cpulist")) {
+            Ok(s) => s,
+            Err(_) => continue,
+        };
+
+        // memory-only nodes have an empty list
+        if let Ok(cpus) = parse_cpu_list(list.trim()) {
+            nodes.push((id, cpus));
+        }
+    }
+
+    nodes.sort_by_key(|(id, _)| *id);
+
+    nodes.into_iter().map(|(_, cpus)| cpus).collect()
+}
+
+#[cfg(not(target_os = "linux"))]
+pub fn numa_node_cpus() -> Vec<Vec<usize>> {
+    Vec::new()
+}
+
+#[cfg(target_os = "linux")]
+pub fn current_thread_cpus() -> Result<Vec<usize>, io::Error> {
+    let mut set: libc::cpu_set_t = unsafe { std::mem::zeroed() };
+
+    if unsafe { libc::sched_getaffinity(0, std::mem::size_of::<libc::cpu_set_t>(), &mut set) } != 0
+    {
+        return Err(io::Error::last_os_error());
+    }
+
+    let max = libc::CPU_SETSIZE as usize;
+
+    Ok((0..max)
+        .filter(|cpu| unsafe { libc::CPU_ISSET(*cpu, &set) })
+        .collect())
+}
+
+#[cfg(target_os = "linux")]
+pub fn set_current_thread_cpus(cpus: &[usize]) -> Result<(), io::Error> {
+    let max = libc::CPU_SETSIZE as usize;
+
+    if cpus.is_empty() || cpus.iter().any(|cpu| *cpu >= max) {
+        return Err(io::Error::from(io::ErrorKind::InvalidInput));
+    }
+
+    let mut set: libc::cpu_set_t = unsafe { std::mem::zeroed() };
+
+    for cpu in cpus {
+        unsafe { libc::CPU_SET(*cpu, &mut set) };
+    }
+
+    if unsafe { libc::sched_setaffinity(0, std::mem::size_of::<libc::cpu_set_t>(), &set) } != 0 {
+        return Err(io::Error::last_os_error());
+    }
+
+    Ok(())
+}
+
+#[cfg(not(target_os = "linux"))]
+pub fn current_thread_cpus() -> Result<Vec<usize>, io::Error> {
+    Err(io::Error::from(io::ErrorKind::Unsupported))
+}
+
+#[cfg(not(target_os = "linux"))]
+pub fn set_current_thread_cpus(_cpus: &[usize]) -> Result<(), io::Error> {
+    Err(io::Error::from(io::ErrorKind::Unsupported))
+}
+
+mod ffi {
+    use super::*;
+    use std::ffi::CStr;
+    use std::os::raw::{c_char, c_int};
+
+    // returns 0 on success, or -1 if the list is invalid or the affinity
+    // could not be set
+    #[allow(clippy::missing_safety_doc)]
+    #[no_mangle]
+    pub unsafe extern "C" fn cpu_affinity_set_current_thread(cpus: *const c_char) -> c_int {
+        let cpus = match CStr::from_ptr(cpus).to_str() {
+            Ok(s) => s,
+            Err(_) => return -1,
+        };
+
+        let cpus = match parse_cpu_list(cpus) {
+            Ok(cpus) => cpus,
+            Err(()) => return -1,
+        };
+
+        match set_current_thread_cpus(&cpus) {
+            Ok(()) => 0,
+            Err(_) => -1,
+        }
+    }
+
+    // writes the cpus available to the current thread to out, grouped by
+    // NUMA node, as cpu lists separated by spaces (e.g. "0-3,8 4-7"). out
+    // must have room for size bytes, including the terminating null. returns
+    // the number of cpus, or -1 if they could not be determined or the
+    // groups do not fit
+    #[allow(clippy::missing_safety_doc)]
+    #[no_mangle]
+    pub unsafe extern "C" fn cpu_topology_current_thread(out: *mut c_char, size: usize) -> c_int {
+        let cpus = match current_thread_cpus() {
+            Ok(cpus) if !cpus.is_empty() => cpus,
+            _ => return -1,
+        };
+
+        let groups: Vec<String> = group_cpus_by_node(&cpus, &numa_node_cpus())
+            .iter()
+            .map(|group| format_cpu_list(group))
+            .collect();
+
+        let s = groups.join(" ");
+
+        if s.len() >= size {
+            return -1;
+        }
+
+        let out = std::slice::from_raw_parts_mut(out as *mut u8, size);
+        out[..s.len()].copy_from_slice(s.as_bytes());
+        out[s.len()] = 0;
+
+        cpus.len() as c_int
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn parse() {
+        assert_eq!(parse_cpu_list("3"), Ok(vec![3]));
+        assert_eq!(parse_cpu_list("0-3,8"), Ok(vec![0, 1, 2, 3, 8]));
+        assert_eq!(parse_cpu_list(" 4 - 5 , 1, 4"), Ok(vec![1, 4, 5]));
+
+        assert_eq!(parse_cpu_list(""), Err(()));
+        assert_eq!(parse_cpu_list("1,"), Err(()));
+        assert_eq!(parse_cpu_list("3-1"), Err(()));
+        assert_eq!(parse_cpu_list("a"), Err(()));
+    }
+
+    #[test]
+    fn format() {
+        assert_eq!(format_cpu_list(&[]), "");
+        assert_eq!(format_cpu_list(&[3]), "3");
+        assert_eq!(format_cpu_list(&[0, 1, 2, 3, 8]), "0-3,8");
+        assert_eq!(format_cpu_list(&[1, 4, 5, 7]), "1,4-5,7");
+
+        let cpus = vec![0, 2, 3, 4, 9, 10];
+        assert_eq!(parse_cpu_list(&format_cpu_list(&cpus)), Ok(cpus));
+    }
+
+    #[test]
+    fn group_by_node() {
+        let nodes = vec![vec![0, 1, 2, 3], vec![4, 5, 6, 7], vec![8, 9]];
+
+        assert_eq!(
+            group_cpus_by_node(&[1, 2, 5, 6], &nodes),
+            vec![vec![1, 2], vec![5, 6]]
+        );
+
+        assert_eq!(
+            group_cpus_by_node(&[0, 8, 12], &nodes),
+            vec![vec![0], vec![8], vec![12]]
+        );
+
+        assert_eq!(group_cpus_by_node(&[0, 1], &[]), vec![vec![0, 1]]);
+        assert!(group_cpus_by_node(&[], &nodes).is_empty());
+    }
+
+    #[cfg(target_os = "linux")]
+    #[test]
+    fn topology() {
+        let mut buf = [0 as std::os::raw::c_char; 256];
+
+        let count = unsafe { ffi::cpu_topology_current_thread(buf.as_mut_ptr(), buf.len()) };
+        assert!(count > 0);
+
+        let s = unsafe { std::ffi::CStr::from_ptr(buf.as_ptr()) }
+            .to_str()
+            .unwrap();
+
+        let mut total = 0;
+        for group in s.split(' ') {
+            total += parse_cpu_list(group).unwrap().len();
+        }
+
+        assert_eq!(total, count as usize);
+
+        assert_eq!(
+            unsafe { ffi::cpu_topology_current_thread(buf.as_mut_ptr(), 1) },
+            -1
+        );
+    }
+
+    #[cfg(target_os = "linux")]
+    #[test]
+    fn set_current() {
+        std::thread::spawn(|| {
+            let cpus = current_thread_cpus().unwrap();
+            assert!(!cpus.is_empty());
+
+            set_current_thread_cpus(&cpus[..1]).unwrap();
+            assert_eq!(current_thread_cpus().unwrap(), &cpus[..1]);
+
+            assert!(set_current_thread_cpus(&[]).is_err());
+        })
+        .join()
+        .unwrap();
+    }
+}
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "arena.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// large enough for a request's session state. bigger allocations get a
+// block of their own, which is freed rather than pooled
+#define BLOCK_SIZE 16384
+#define BLOCK_POOL_MAX 256
+
+class Arena::Block
+{
+public:
+	Block *next;
+	size_t size; // usable bytes after the header
+
+	char *data() { return reinterpret_cast<char*>(this) + sizeof(Block); }
+};
+
+namespace {
+
+class BlockPool
+{
+public:
+	Arena::Block *first;
+	int count;
+
+	BlockPool() :
+		first(0),
+		count(0)
+	{
+	}
+
+	~BlockPool();
+};
+
+// arenas may be released after the pool during thread exit, so the pool's
+// state is tracked separately in a trivially destructible variable
+thread_local bool poolDestroyed = false;
+thread_local BlockPool pool;
+
+BlockPool::~BlockPool()
+{
+	while(first)
+	{
+		Arena::Block *b = first;
+		first = b->next;
+		free(b);
+	}
+
+	count = 0;
+	poolDestroyed = true;
+}
+
+}
+
+static Arena::Block *acquireBlock(size_t minSize)
+{
+	Arena::Block *b;
+
+	if(minSize <= BLOCK_SIZE && !poolDestroyed && pool.first)
+	{
+		b = pool.first;
+		pool.first = b->next;
+		--pool.count;
+	}
+	else
+	{
+		size_t size = minSize > BLOCK_SIZE ? minSize : BLOCK_SIZE;
+
+		b = static_cast<Arena::Block*>(malloc(sizeof(Arena::Block) + size));
+		if(!b)
+			throw std::bad_alloc();
+
+		b->size = size;
+	}
+
+	b->next = 0;
+
+	return b;
+}
+
+static void releaseBlock(Arena::Block *b)
+{
+	if(b->size != BLOCK_SIZE || poolDestroyed || pool.count >= BLOCK_POOL_MAX)
+	{
+		free(b);
+		return;
+	}
+
+	b->next = pool.first;
+	pool.first = b;
+	++pool.count;
+}
+
+Arena::Arena(Block *first, char *pos, char *end) :
+	blocks_(first),
+	pos_(pos),
+	end_(end),
+	used_(0),
+	refs_(1)
+{
+}
+
+Arena *Arena::create()
+{
+	// the arena lives at the start of its first block
+	Block *b = acquireBlock(BLOCK_SIZE);
+	char *start = b->data();
+
+	return new(start) Arena(b, start + sizeof(Arena), start + b->size);
+}
+
+void Arena::unref()
+{
+	assert(refs_ > 0);
+
+	if(--refs_ > 0)
+		return;
+
+	Block *b = blocks_;
+
+	// the arena itself lives in one of the blocks, so don't touch it after
+	// this point
+	this->~Arena();
+
+	while(b)
+	{
+		Block *next = b->next;
+		releaseBlock(b);
+		b = next;
+	}
+}
+
+void *Arena::allocate(size_t size, size_t align)
+{
+	uintptr_t p = ((uintptr_t)pos_ + (align - 1)) & ~(uintptr_t)(align - 1);
+
+	if(p + size > (uintptr_t)end_)
+	{
+		used_ += size;
+
+		// too big for a regular block. give it a block of its own and keep
+		// bumping from the current one
+		if(size + align > BLOCK_SIZE)
+		{
+			Block *b = acquireBlock(size + align);
+
+			b->next = blocks_->next;
+			blocks_->next = b;
+
+			p = ((uintptr_t)b->data() + (align - 1)) & ~(uintptr_t)(align - 1);
+
+			return (void *)p;
+		}
+
+		addBlock();
+
+		p = ((uintptr_t)pos_ + (align - 1)) & ~(uintptr_t)(align - 1);
+		pos_ = (char *)(p + size);
+
+		return (void *)p;
+	}
+
+	pos_ = (char *)(p + size);
+	used_ += size;
+
+	return (void *)p;
+}
+
+void Arena::addBlock()
+{
+	Block *b = acquireBlock(BLOCK_SIZE);
+
+	b->next = blocks_;
+	blocks_ = b;
+
+	pos_ = b->data();
+	end_ = pos_ + b->size;
+}
+
+void Arena::cleanup()
+{
+	if(poolDestroyed)
+		return;
+
+	while(pool.first)
+	{
+		Block *b = pool.first;
+		pool.first = b->next;
+		free(b);
+	}
+
+	pool.count = 0;
+}
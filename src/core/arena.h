@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <new>
+#include <utility>
+
+// bump allocator for objects that share a lifetime, such as those belonging
+// to a single request. freeing individual allocations is a no-op, and all
+// memory is released at once when the last reference is dropped. released
+// blocks are kept in a per-thread pool for reuse by later arenas. arenas are
+// not thread safe, and must be released on the thread that created them
+class Arena
+{
+public:
+	// returns an arena with one reference
+	static Arena *create();
+
+	void ref() { ++refs_; }
+	void unref();
+
+	void *allocate(size_t size, size_t align);
+
+	// objects created this way must be passed to destroy(), which runs the
+	// destructor. the memory stays with the arena
+	template <typename T, typename... Args> T *make(Args&&... args)
+	{
+		return new(allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+	}
+
+	template <typename T> void destroy(T *p)
+	{
+		if(p)
+			p->~T();
+	}
+
+	// bytes allocated from the arena, not including block overhead
+	size_t bytesUsed() const { return used_; }
+
+	// frees the calling thread's pooled blocks
+	static void cleanup();
+
+	// internal
+	class Block;
+
+private:
+	Block *blocks_;
+	char *pos_;
+	char *end_;
+	size_t used_;
+	int refs_;
+
+	Arena(Block *first, char *pos, char *end);
+	~Arena() = default;
+
+	void addBlock();
+};
+
+// standard allocator interface, for containers and std::allocate_shared.
+// each allocator holds a reference to the arena, so memory handed to a
+// control block or container stays valid for as long as they need it
+template <typename T> class ArenaAllocator
+{
+public:
+	typedef T value_type;
+
+	ArenaAllocator(Arena *arena) :
+		arena_(arena)
+	{
+		arena_->ref();
+	}
+
+	ArenaAllocator(const ArenaAllocator &other) :
+		arena_(other.arena_)
+	{
+		arena_->ref();
+	}
+
+	template <typename U> ArenaAllocator(const ArenaAllocator<U> &other) :
+		arena_(other.arena())
+	{
+		arena_->ref();
+	}
+
+	~ArenaAllocator()
+	{
+		arena_->unref();
+	}
+
+	ArenaAllocator & operator=(const ArenaAllocator &other)
+	{
+		other.arena_->ref();
+		arena_->unref();
+		arena_ = other.arena_;
+
+		return *this;
+	}
+
+	Arena *arena() const { return arena_; }
+
+	T *allocate(size_t n)
+	{
+		return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T *p, size_t n)
+	{
+		(void)p;
+		(void)n;
+	}
+
+	template <typename U> bool operator==(const ArenaAllocator<U> &other) const { return arena_ == other.arena(); }
+	template <typename U> bool operator!=(const ArenaAllocator<U> &other) const { return arena_ != other.arena(); }
+
+private:
+	Arena *arena_;
+};
+
+#endif
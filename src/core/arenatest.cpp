@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include "test.h"
+#include "arena.h"
+
+class Counted
+{
+public:
+	int *dtors;
+
+	Counted(int *_dtors) :
+		dtors(_dtors)
+	{
+	}
+
+	~Counted()
+	{
+		++(*dtors);
+	}
+};
+
+static void allocate()
+{
+	Arena *arena = Arena::create();
+
+	void *a = arena->allocate(10, 1);
+	void *b = arena->allocate(8, 8);
+	TEST_ASSERT(a != b);
+	TEST_ASSERT_EQ(((uintptr_t)b) % 8, (uintptr_t)0);
+
+	// larger than a block
+	void *c = arena->allocate(100000, 64);
+	TEST_ASSERT_EQ(((uintptr_t)c) % 64, (uintptr_t)0);
+
+	TEST_ASSERT_EQ(arena->bytesUsed(), (size_t)100018);
+
+	int dtors = 0;
+	Counted *obj = arena->make<Counted>(&dtors);
+	arena->destroy(obj);
+	TEST_ASSERT_EQ(dtors, 1);
+
+	arena->unref();
+
+	Arena::cleanup();
+}
+
+static void sharedLifetime()
+{
+	int dtors = 0;
+	std::weak_ptr<Counted> weak;
+
+	Arena *arena = Arena::create();
+
+	{
+		std::shared_ptr<Counted> p = std::allocate_shared<Counted>(ArenaAllocator<Counted>(arena), &dtors);
+		weak = p;
+
+		std::vector<int, ArenaAllocator<int>> v{ArenaAllocator<int>(arena)};
+		for(int n = 0; n < 10000; ++n)
+			v.push_back(n);
+
+		// the allocators keep the arena alive after the creator's
+		// reference is dropped
+		arena->unref();
+
+		TEST_ASSERT_EQ(v[9999], 9999);
+		TEST_ASSERT_EQ(dtors, 0);
+	}
+
+	TEST_ASSERT_EQ(dtors, 1);
+	TEST_ASSERT(weak.expired());
+
+	Arena::cleanup();
+}
+
+extern "C" int arena_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(allocate());
+	TEST_CATCH(sharedLifetime());
+
+	return 0;
+}
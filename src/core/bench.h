@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef PUSHPIN_BENCH_H
+#define PUSHPIN_BENCH_H
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+// runs scenarios and prints throughput and per-call latency. a call may
+// perform several operations, for example one publish delivered to many
+// subscribers, so ops/sec counts operations and percentiles are per call
+class Bench
+{
+public:
+	// scenarios whose names don't contain filter are skipped. null or empty
+	// runs everything
+	Bench(const char *filter) :
+		filter_(filter ? filter : "")
+	{
+	}
+
+	bool selected(const char *name) const
+	{
+		return filter_[0] == '\0' || strstr(name, filter_);
+	}
+
+	template <typename F>
+	void run(const char *name, int calls, int opsPerCall, F fn) const
+	{
+		if(!selected(name))
+			return;
+
+		// warm up caches and allocators
+		for(int n = 0; n < std::max(calls / 10, 1); ++n)
+			fn();
+
+		std::vector<long long> samples;
+		samples.reserve(calls);
+
+		long long total = 0;
+		for(int n = 0; n < calls; ++n)
+		{
+			auto start = std::chrono::steady_clock::now();
+			fn();
+			long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+			samples.push_back(ns);
+			total += ns;
+		}
+
+		std::sort(samples.begin(), samples.end());
+
+		double opsPerSec = total > 0 ? ((double)calls * opsPerCall * 1000000000.0) / (double)total : 0.0;
+
+		printf("%-40s %14.0f ops/sec   p50 %10.3f us   p99 %10.3f us\n",
+			name,
+			opsPerSec,
+			percentile(samples, 50) / 1000.0,
+			percentile(samples, 99) / 1000.0);
+		fflush(stdout);
+	}
+
+private:
+	const char *filter_;
+
+	static double percentile(const std::vector<long long> &sorted, int p)
+	{
+		if(sorted.empty())
+			return 0.0;
+
+		size_t i = std::min((sorted.size() * p) / 100, sorted.size() - 1);
+		return (double)sorted[i];
+	}
+};
+
+#endif
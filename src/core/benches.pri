@@ -0,0 +1,12 @@
+HEADERS += $$PWD/bench.h
+
+SOURCES += \
+	$$PWD/tnetstringbench.cpp \
+	$$PWD/ringqueuebench.cpp \
+	$$PWD/bufferlistbench.cpp \
+	$$PWD/httpheadersbench.cpp \
+	$$PWD/defercallbench.cpp \
+	$$PWD/fastsignalbench.cpp \
+	$$PWD/eventloopbench.cpp \
+	$$PWD/uuidutilbench.cpp \
+	$$PWD/statsmanagerbench.cpp
@@ -486,6 +486,59 @@ impl TmpBuffer {
     pub fn len(&self) -> usize {
         self.0.borrow().len()
     }
+
+    // the borrow ends when f returns, so this can't be used to hold on to
+    // the buffer across await points
+    pub fn with_mut<F, T>(&self, f: F) -> T
+    where
+        F: FnOnce(&mut [u8]) -> T,
+    {
+        f(&mut self.0.borrow_mut())
+    }
+}
+
+// recycles ring buffer memory, so that connections waiting with nothing
+// buffered can give their memory back and take it again when they have
+// something to hold. at most max buffers are kept; the rest are freed
+pub struct BufferPool {
+    size: usize,
+    max: usize,
+    bufs: RefCell<Vec<Vec<u8>>>,
+}
+
+#[allow(clippy::len_without_is_empty)]
+impl BufferPool {
+    pub fn new(size: usize, max: usize) -> Self {
+        Self {
+            size,
+            max,
+            bufs: RefCell::new(Vec::new()),
+        }
+    }
+
+    pub fn buffer_size(&self) -> usize {
+        self.size
+    }
+
+    pub fn len(&self) -> usize {
+        self.bufs.borrow().len()
+    }
+
+    pub fn get(&self) -> Vec<u8> {
+        match self.bufs.borrow_mut().pop() {
+            Some(buf) => buf,
+            None => vec![0; self.size],
+        }
+    }
+
+    // buffers of other sizes are dropped
+    pub fn put(&self, buf: Vec<u8>) {
+        let bufs = &mut *self.bufs.borrow_mut();
+
+        if buf.len() == self.size && bufs.len() < self.max {
+            bufs.push(buf);
+        }
+    }
 }
 
 // holds a Vec<u8> but only exposes the portion of it considered to be
@@ -805,6 +858,30 @@ impl RingBuffer<Vec<u8>> {
         other.set_inner(buf);
     }
 
+    // gives the inner buffer to the pool if nothing is buffered and the
+    // buffer is the pool's size. afterwards, the ringbuffer has a capacity
+    // of zero until acquire is called. returns true if released
+    pub fn release(&mut self, pool: &BufferPool) -> bool {
+        if self.len() > 0 || self.buf.len() != pool.buffer_size() {
+            return false;
+        }
+
+        pool.put(mem::take(&mut self.buf));
+        self.start = 0;
+        self.end = 0;
+
+        true
+    }
+
+    // takes a buffer from the pool, if the ringbuffer doesn't have one
+    pub fn acquire(&mut self, pool: &BufferPool) {
+        if self.buf.is_empty() {
+            self.buf = pool.get();
+            self.start = 0;
+            self.end = 0;
+        }
+    }
+
     pub fn resize(&mut self, size: usize) {
         if size == self.buf.len() {
             return;
@@ -1179,4 +1256,51 @@ mod tests {
         assert_eq!(size, 8);
         assert_eq!(&buf[..size], b"12345678");
     }
+
+    #[test]
+    fn test_release() {
+        let tmp = Rc::new(TmpBuffer::new(16));
+        let pool = BufferPool::new(8, 1);
+        let mut r = VecRingBuffer::new(8, &tmp);
+
+        r.write(b"1234").unwrap();
+
+        // can't release while holding data
+        assert!(!r.release(&pool));
+        assert_eq!(r.capacity(), 8);
+
+        let mut buf = [0; 4];
+        r.read(&mut buf).unwrap();
+
+        assert!(r.release(&pool));
+        assert_eq!(r.capacity(), 0);
+        assert_eq!(r.remaining_capacity(), 0);
+        assert_eq!(pool.len(), 1);
+
+        r.acquire(&pool);
+        assert_eq!(r.capacity(), 8);
+        assert_eq!(pool.len(), 0);
+
+        // acquiring again is a no-op
+        r.acquire(&pool);
+        assert_eq!(pool.len(), 0);
+
+        let size = r.write(b"5678").unwrap();
+        assert_eq!(size, 4);
+
+        let size = r.read(&mut buf).unwrap();
+        assert_eq!(&buf[..size], b"5678");
+
+        // buffers that were resized don't go back to the pool
+        r.resize(12);
+        assert!(!r.release(&pool));
+
+        r.resize(8);
+        assert!(r.release(&pool));
+
+        // pool is full, so the second buffer is freed
+        let mut r2 = VecRingBuffer::new(8, &tmp);
+        assert!(r2.release(&pool));
+        assert_eq!(pool.len(), 1);
+    }
 }
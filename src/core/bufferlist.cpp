@@ -21,33 +21,28 @@
 #include "bufferlist.h"
 
 #include <assert.h>
+#include <algorithm>
 
 BufferList::BufferList() :
 	size_(0),
-	offset_(0)
+	start_(0)
 {
 }
 
-void BufferList::findPos(int pos, int *bufferIndex, int *offset) const
+void BufferList::findPos(int pos, int *chunkIndex, int *offset) const
 {
 	assert(pos < size_);
 
-	int at = 0;
-	int curOffset = offset_;
+	qint64 at = start_ + pos;
 
-	while(true)
-	{
-		const QByteArray &buf = bufs_[at];
-		if(curOffset + pos < buf.size())
-			break;
-
-		++at;
-		pos -= (buf.size() - curOffset);
-		curOffset = 0;
-	}
+	// first chunk ending after the position
+	auto it = std::upper_bound(chunks_.begin(), chunks_.end(), at, [](qint64 v, const Chunk &c) {
+		return v < c.end;
+	});
+	assert(it != chunks_.end());
 
-	*bufferIndex = at;
-	*offset = curOffset + pos;
+	*chunkIndex = (int)(it - chunks_.begin());
+	*offset = it->offset + (int)(at - (it->end - it->size));
 }
 
 QByteArray BufferList::mid(int pos, int size) const
@@ -63,16 +58,20 @@ QByteArray BufferList::mid(int pos, int size) const
 	else
 		toRead = size_ - pos;
 
-	assert(!bufs_.isEmpty());
-
 	int at;
 	int offset;
 	findPos(pos, &at, &offset);
 
-	// if we're reading the exact size of the current buffer, cheaply
-	//   return it
-	if(offset == 0 && bufs_[at].size() == toRead)
-		return bufs_[at];
+	const Chunk &first = chunks_[at];
+
+	// if we're reading exactly an entire buffer, cheaply return it. a
+	// sliced chunk may start at 0 without covering all of its data
+	if(offset == 0 && first.size == first.data.size() && first.size == toRead)
+		return first.data;
+
+	// within one chunk, a single copy is enough
+	if(offset + toRead <= first.offset + first.size)
+		return first.data.mid(offset, toRead);
 
 	QByteArray out;
 	out.resize(toRead);
@@ -80,18 +79,58 @@ QByteArray BufferList::mid(int pos, int size) const
 
 	while(toRead > 0)
 	{
-		const QByteArray &buf = bufs_[at];
-		int bsize = qMin(buf.size() - offset, toRead);
-		memcpy(outp, buf.data() + offset, bsize);
+		const Chunk &c = chunks_[at];
+		int csize = qMin(c.offset + c.size - offset, toRead);
+		memcpy(outp, c.data.constData() + offset, csize);
 
-		if(offset + bsize >= buf.size())
-		{
-			++at;
-			offset = 0;
-		}
+		++at;
+		if(at < chunks_.count())
+			offset = chunks_[at].offset;
 
-		toRead -= bsize;
-		outp += bsize;
+		toRead -= csize;
+		outp += csize;
+	}
+
+	return out;
+}
+
+BufferList BufferList::slice(int pos, int size) const
+{
+	assert(pos >= 0);
+
+	BufferList out;
+
+	if(size_ == 0 || size == 0 || pos >= size_)
+		return out;
+
+	int toRead;
+	if(size > 0)
+		toRead = qMin(size, size_ - pos);
+	else
+		toRead = size_ - pos;
+
+	int at;
+	int offset;
+	findPos(pos, &at, &offset);
+
+	while(toRead > 0)
+	{
+		const Chunk &c = chunks_[at];
+
+		Chunk nc;
+		nc.data = c.data;
+		nc.offset = offset;
+		nc.size = qMin(c.offset + c.size - offset, toRead);
+		nc.end = out.size_ + nc.size;
+
+		out.chunks_ += nc;
+		out.size_ += nc.size;
+
+		++at;
+		if(at < chunks_.count())
+			offset = chunks_[at].offset;
+
+		toRead -= nc.size;
 	}
 
 	return out;
@@ -99,9 +138,9 @@ QByteArray BufferList::mid(int pos, int size) const
 
 void BufferList::clear()
 {
-	bufs_.clear();
+	chunks_.clear();
 	size_ = 0;
-	offset_ = 0;
+	start_ = 0;
 }
 
 void BufferList::append(const QByteArray &buf)
@@ -109,8 +148,33 @@ void BufferList::append(const QByteArray &buf)
 	if(buf.size() < 1)
 		return;
 
-	bufs_ += buf;
-	size_ += buf.size();
+	Chunk c;
+	c.data = buf;
+	c.offset = 0;
+	c.size = buf.size();
+	c.end = start_ + size_ + c.size;
+
+	chunks_ += c;
+	size_ += c.size;
+}
+
+void BufferList::append(const BufferList &other)
+{
+	if(&other == this)
+	{
+		BufferList copy = other;
+		append(copy);
+		return;
+	}
+
+	foreach(const Chunk &oc, other.chunks_)
+	{
+		Chunk c = oc;
+		c.end = start_ + size_ + c.size;
+
+		chunks_ += c;
+		size_ += c.size;
+	}
 }
 
 QByteArray BufferList::take(int size)
@@ -124,40 +188,119 @@ QByteArray BufferList::take(int size)
 	else
 		toRead = size_;
 
-	assert(!bufs_.isEmpty());
+	assert(!chunks_.isEmpty());
+
+	Chunk &first = chunks_.first();
 
-	// if we're reading the exact size of the first buffer, cheaply
-	//   return it
-	if(offset_ == 0 && bufs_.first().size() == toRead)
+	// if we're reading exactly an entire buffer, cheaply return it
+	if(first.offset == 0 && first.size == first.data.size() && first.size == toRead)
 	{
 		size_ -= toRead;
-		return bufs_.takeFirst();
+		start_ += toRead;
+		return chunks_.takeFirst().data;
+	}
+
+	// within one chunk, a single copy is enough
+	if(toRead <= first.size)
+	{
+		QByteArray out = first.data.mid(first.offset, toRead);
+		skip(toRead);
+		return out;
 	}
 
 	QByteArray out;
 	out.resize(toRead);
-	char *outp = out.data();
+	read(out.data(), toRead);
 
-	while(toRead > 0)
+	return out;
+}
+
+BufferList BufferList::takeList(int size)
+{
+	BufferList out = slice(0, size);
+	skip(out.size());
+
+	return out;
+}
+
+int BufferList::skip(int size)
+{
+	if(size_ == 0 || size == 0)
+		return 0;
+
+	int toSkip;
+	if(size > 0)
+		toSkip = qMin(size, size_);
+	else
+		toSkip = size_;
+
+	int left = toSkip;
+	while(left > 0)
 	{
-		const QByteArray &buf = bufs_.first();
-		int bsize = qMin(buf.size() - offset_, toRead);
-		memcpy(outp, buf.data() + offset_, bsize);
+		Chunk &c = chunks_.first();
 
-		if(offset_ + bsize >= buf.size())
+		if(left >= c.size)
 		{
-			bufs_.removeFirst();
-			offset_ = 0;
+			left -= c.size;
+			chunks_.removeFirst();
 		}
 		else
-			offset_ += bsize;
-
-		toRead -= bsize;
-		size_ -= bsize;
-		outp += bsize;
+		{
+			c.offset += left;
+			c.size -= left;
+			left = 0;
+		}
 	}
 
-	return out;
+	size_ -= toSkip;
+	start_ += toSkip;
+
+	return toSkip;
+}
+
+int BufferList::takeAppend(QByteArray *out, int size)
+{
+	if(size_ == 0 || size == 0)
+		return 0;
+
+	int toRead;
+	if(size > 0)
+		toRead = qMin(size, size_);
+	else
+		toRead = size_;
+
+	assert(!chunks_.isEmpty());
+
+	int start = out->size();
+	out->resize(start + toRead);
+	read(out->data() + start, toRead);
+
+	return toRead;
+}
+
+void BufferList::read(char *outp, int size)
+{
+	while(size > 0)
+	{
+		Chunk &c = chunks_.first();
+		int csize = qMin(c.size, size);
+		memcpy(outp, c.data.constData() + c.offset, csize);
+
+		if(csize >= c.size)
+		{
+			chunks_.removeFirst();
+		}
+		else
+		{
+			c.offset += csize;
+			c.size -= csize;
+		}
+
+		size -= csize;
+		size_ -= csize;
+		start_ += csize;
+		outp += csize;
+	}
 }
 
 QByteArray BufferList::toByteArray()
@@ -165,21 +308,58 @@ QByteArray BufferList::toByteArray()
 	if(size_ == 0)
 		return QByteArray();
 
+	if(chunks_.count() == 1 && chunks_.first().offset == 0 && chunks_.first().size == chunks_.first().data.size())
+		return chunks_.first().data;
+
 	QByteArray out;
-	while(!bufs_.isEmpty())
+	out.resize(size_);
+
+	char *outp = out.data();
+	foreach(const Chunk &c, chunks_)
 	{
-		if(offset_ > 0)
-		{
-			out += bufs_.first().mid(offset_);
-			offset_ = 0;
-			bufs_.removeFirst();
-		}
-		else
-			out += bufs_.takeFirst();
+		memcpy(outp, c.data.constData() + c.offset, c.size);
+		outp += c.size;
 	}
 
 	// keep the rewritten buffer as the only buffer
-	bufs_ += out;
+	Chunk c;
+	c.data = out;
+	c.offset = 0;
+	c.size = out.size();
+	c.end = start_ + size_;
+
+	chunks_.clear();
+	chunks_ += c;
+
+	return out;
+}
+
+QList<QByteArray> BufferList::chunks() const
+{
+	QList<QByteArray> out;
+	out.reserve(chunks_.count());
+
+	foreach(const Chunk &c, chunks_)
+	{
+		if(c.offset == 0 && c.size == c.data.size())
+			out += c.data;
+		else
+			out += c.data.mid(c.offset, c.size);
+	}
 
 	return out;
 }
+
+int BufferList::toIovec(struct iovec *vec, int max) const
+{
+	int count = qMin(max, (int)chunks_.count());
+
+	for(int n = 0; n < count; ++n)
+	{
+		const Chunk &c = chunks_[n];
+		vec[n].iov_base = (void *)(c.data.constData() + c.offset);
+		vec[n].iov_len = c.size;
+	}
+
+	return count;
+}
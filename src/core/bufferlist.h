@@ -21,9 +21,13 @@
 #ifndef BUFFERLIST_H
 #define BUFFERLIST_H
 
+#include <sys/uio.h>
 #include <QList>
 #include <QByteArray>
 
+// a byte stream kept as a list of shared chunks. appending, taking whole
+// chunks, slicing and exporting chunks don't copy data. each chunk caches
+// its end offset in the stream, so positions are found by binary search
 class BufferList
 {
 public:
@@ -34,24 +38,65 @@ public:
 
 	QByteArray mid(int pos, int size = -1) const;
 
+	// same as mid, but shares the underlying chunks instead of copying
+	BufferList slice(int pos, int size = -1) const;
+
 	void clear();
 	void append(const QByteArray &buf);
+	void append(const BufferList &other);
 	QByteArray take(int size = -1);
 
+	// same as take, but shares the underlying chunks instead of copying
+	BufferList takeList(int size = -1);
+
+	// discards up to size bytes from the front, or all if size is
+	// negative, and returns the number of bytes discarded
+	int skip(int size = -1);
+
+	// appends up to size bytes to out, or all if size is negative, and
+	// returns the number of bytes taken. lets callers assemble a message
+	// around the data with a single copy
+	int takeAppend(QByteArray *out, int size = -1);
+
 	QByteArray toByteArray(); // non-const because we rewrite the list
 
+	// returns the content as the underlying buffers, for writing without
+	// flattening. only partially read chunks are copied
+	QList<QByteArray> chunks() const;
+
+	// points up to max entries of vec at the content, for writev. returns
+	// the number of entries used. the entries are valid until the list is
+	// changed
+	int toIovec(struct iovec *vec, int max) const;
+
 	BufferList & operator+=(const QByteArray &buf)
 	{
 		append(buf);
 		return *this;
 	}
 
+	BufferList & operator+=(const BufferList &other)
+	{
+		append(other);
+		return *this;
+	}
+
 private:
-	QList<QByteArray> bufs_;
+	class Chunk
+	{
+	public:
+		QByteArray data;
+		int offset; // start of the unread part of data
+		int size; // bytes left from offset
+		qint64 end; // stream position following the chunk
+	};
+
+	QList<Chunk> chunks_;
 	int size_;
-	int offset_;
+	qint64 start_; // stream position of the first byte
 
-	void findPos(int pos, int *bufferIndex, int *offset) const;
+	void findPos(int pos, int *chunkIndex, int *offset) const;
+	void read(char *outp, int size);
 };
 
 #endif
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include <sys/uio.h>
+#include <vector>
+#include "bench.h"
+#include "bufferlist.h"
+
+// a 1MB stream made of small chunks, as arrives from a socket
+#define CHUNK_SIZE 256
+#define CHUNK_COUNT 4096
+#define READ_SIZE 16384
+
+static BufferList makeStream(const QByteArray &chunk)
+{
+	BufferList list;
+	for(int n = 0; n < CHUNK_COUNT; ++n)
+		list += chunk;
+
+	return list;
+}
+
+extern "C" void bufferlist_bench(const char *filter)
+{
+	Bench bench(filter);
+
+	if(!bench.selected("bufferlist/"))
+		return;
+
+	QByteArray chunk(CHUNK_SIZE, 'a');
+
+	bench.run("bufferlist/take-1mb", 200, 1, [&] {
+		BufferList list = makeStream(chunk);
+		while(!list.isEmpty())
+		{
+			QByteArray buf = list.take(READ_SIZE);
+			Q_UNUSED(buf);
+		}
+	});
+
+	bench.run("bufferlist/take-list-1mb", 200, 1, [&] {
+		BufferList list = makeStream(chunk);
+		while(!list.isEmpty())
+		{
+			BufferList buf = list.takeList(READ_SIZE);
+			Q_UNUSED(buf);
+		}
+	});
+
+	bench.run("bufferlist/to-byte-array-1mb", 200, 1, [&] {
+		BufferList list = makeStream(chunk);
+		QByteArray buf = list.toByteArray();
+		Q_UNUSED(buf);
+	});
+
+	bench.run("bufferlist/iovec-1mb", 200, 1, [&] {
+		BufferList list = makeStream(chunk);
+
+		std::vector<struct iovec> vec(CHUNK_COUNT);
+		int count = list.toIovec(vec.data(), (int)vec.size());
+		Q_UNUSED(count);
+	});
+
+	{
+		BufferList list = makeStream(chunk);
+		int pos = 0;
+
+		// small reads at positions spread over the stream
+		bench.run("bufferlist/mid-1mb", 100000, 1, [&] {
+			QByteArray buf = list.mid(pos, 100);
+			Q_UNUSED(buf);
+			pos = (pos + 7919) % (list.size() - 100);
+		});
+	}
+}
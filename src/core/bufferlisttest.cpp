@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "test.h"
+#include "bufferlist.h"
+
+static void takeAndMid()
+{
+	BufferList list;
+	TEST_ASSERT(list.isEmpty());
+
+	list += QByteArray("hello");
+	list += QByteArray(" ");
+	list += QByteArray("world");
+	TEST_ASSERT_EQ(list.size(), 11);
+
+	TEST_ASSERT_EQ(list.mid(3, 5), QByteArray("lo wo"));
+	TEST_ASSERT_EQ(list.take(2), QByteArray("he"));
+	TEST_ASSERT_EQ(list.size(), 9);
+	TEST_ASSERT_EQ(list.toByteArray(), QByteArray("llo world"));
+	TEST_ASSERT_EQ(list.take(), QByteArray("llo world"));
+	TEST_ASSERT(list.isEmpty());
+}
+
+static void chunks()
+{
+	QByteArray a("hello");
+	QByteArray b("world");
+
+	BufferList list;
+	list += a;
+	list += b;
+
+	QList<QByteArray> out = list.chunks();
+	TEST_ASSERT_EQ(out.count(), 2);
+
+	// whole buffers are shared rather than copied
+	TEST_ASSERT(out[0].constData() == a.constData());
+	TEST_ASSERT(out[1].constData() == b.constData());
+
+	// reading doesn't change the list
+	TEST_ASSERT_EQ(list.size(), 10);
+
+	list.take(2);
+	out = list.chunks();
+	TEST_ASSERT_EQ(out.count(), 2);
+	TEST_ASSERT_EQ(out[0], QByteArray("llo"));
+	TEST_ASSERT(out[1].constData() == b.constData());
+
+	BufferList empty;
+	TEST_ASSERT(empty.chunks().isEmpty());
+}
+
+static void takeAppend()
+{
+	BufferList list;
+	list += QByteArray("hello");
+	list += QByteArray(" ");
+	list += QByteArray("world");
+
+	QByteArray out("> ");
+	TEST_ASSERT_EQ(list.takeAppend(&out, 7), 7);
+	TEST_ASSERT_EQ(out, QByteArray("> hello w"));
+	TEST_ASSERT_EQ(list.size(), 4);
+
+	// more than available takes the rest
+	TEST_ASSERT_EQ(list.takeAppend(&out, 100), 4);
+	TEST_ASSERT_EQ(out, QByteArray("> hello world"));
+	TEST_ASSERT(list.isEmpty());
+
+	TEST_ASSERT_EQ(list.takeAppend(&out), 0);
+	TEST_ASSERT_EQ(out, QByteArray("> hello world"));
+}
+
+static void slices()
+{
+	QByteArray a("hello");
+	QByteArray b(" ");
+	QByteArray c("world");
+
+	BufferList list;
+	list += a;
+	list += b;
+	list += c;
+
+	BufferList s = list.slice(3, 5);
+	TEST_ASSERT_EQ(s.size(), 5);
+	TEST_ASSERT_EQ(s.toByteArray(), QByteArray("lo wo"));
+
+	// the original is unaffected, and whole chunks are shared
+	TEST_ASSERT_EQ(list.size(), 11);
+	s = list.slice(5);
+	TEST_ASSERT_EQ(s.chunks().count(), 2);
+	TEST_ASSERT(s.chunks()[1].constData() == c.constData());
+
+	BufferList t = list.takeList(7);
+	TEST_ASSERT_EQ(t.mid(0), QByteArray("hello w"));
+	TEST_ASSERT_EQ(list.size(), 4);
+	TEST_ASSERT_EQ(list.mid(1, 2), QByteArray("rl"));
+
+	// appending a list shares its chunks
+	t += list;
+	TEST_ASSERT_EQ(t.size(), 11);
+	TEST_ASSERT_EQ(t.mid(4, 4), QByteArray("o wo"));
+
+	TEST_ASSERT_EQ(t.skip(6), 6);
+	TEST_ASSERT_EQ(t.take(), QByteArray("world"));
+	TEST_ASSERT_EQ(t.skip(), 0);
+}
+
+static void partialChunk()
+{
+	QByteArray a("0123456789");
+
+	BufferList list;
+	list += a;
+
+	// the first chunk starts at the beginning of its data but only
+	// covers part of it
+	BufferList s = list.slice(0, 5);
+	s += QByteArray("abcde");
+	TEST_ASSERT_EQ(s.size(), 10);
+
+	TEST_ASSERT_EQ(s.mid(0, 10), QByteArray("01234abcde"));
+	TEST_ASSERT_EQ(s.take(10), QByteArray("01234abcde"));
+	TEST_ASSERT_EQ(s.size(), 0);
+
+	s = list.takeList(5);
+	s += QByteArray("abc");
+	TEST_ASSERT_EQ(s.take(5), QByteArray("01234"));
+	TEST_ASSERT_EQ(s.size(), 3);
+	TEST_ASSERT_EQ(s.take(), QByteArray("abc"));
+}
+
+static void iovecExport()
+{
+	BufferList list;
+	list += QByteArray("hello");
+	list += QByteArray("world");
+	list.skip(2);
+
+	struct iovec vec[4];
+	TEST_ASSERT_EQ(list.toIovec(vec, 4), 2);
+	TEST_ASSERT_EQ(QByteArray((const char *)vec[0].iov_base, vec[0].iov_len), QByteArray("llo"));
+	TEST_ASSERT_EQ(QByteArray((const char *)vec[1].iov_base, vec[1].iov_len), QByteArray("world"));
+
+	TEST_ASSERT_EQ(list.toIovec(vec, 1), 1);
+}
+
+static void manyChunks()
+{
+	BufferList list;
+	QByteArray all;
+
+	for(int n = 0; n < 1000; ++n)
+	{
+		QByteArray buf(1 + (n % 7), 'a' + (n % 26));
+		list += buf;
+		all += buf;
+	}
+
+	// positions are found the same way after reads from the front
+	for(int n = 0; n < 10; ++n)
+	{
+		TEST_ASSERT_EQ(list.size(), all.size());
+		TEST_ASSERT_EQ(list.mid(123, 456), all.mid(123, 456));
+		TEST_ASSERT_EQ(list.slice(50, 300).toByteArray(), all.mid(50, 300));
+		TEST_ASSERT_EQ(list.take(29), all.mid(0, 29));
+		all = all.mid(29);
+	}
+}
+
+extern "C" int bufferlist_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(takeAndMid());
+	TEST_CATCH(chunks());
+	TEST_CATCH(takeAppend());
+	TEST_CATCH(slices());
+	TEST_CATCH(partialChunk());
+	TEST_CATCH(iovecExport());
+	TEST_CATCH(manyChunks());
+
+	return 0;
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+use slab::Slab;
+use std::cmp;
+
+// growable slabs grow by their current size, within these bounds, so that
+// small slabs don't reallocate often and large ones don't overshoot much
+const CHUNK_MIN: usize = 1024;
+const CHUNK_MAX: usize = 65536;
+
+// how many entries a slab may hold. fixed capacities are allocated up
+// front. growable capacities start at the initial size and grow in chunks
+// on demand, up to the max
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct Capacity {
+    initial: usize,
+    max: usize,
+}
+
+impl Capacity {
+    pub fn fixed(max: usize) -> Self {
+        Self { initial: max, max }
+    }
+
+    // a max of None means unbounded
+    pub fn growable(initial: usize, max: Option<usize>) -> Self {
+        let max = max.unwrap_or(usize::MAX);
+
+        Self {
+            initial: cmp::min(initial, max),
+            max,
+        }
+    }
+
+    pub fn initial(&self) -> usize {
+        self.initial
+    }
+
+    pub fn max(&self) -> usize {
+        self.max
+    }
+
+    pub fn is_fixed(&self) -> bool {
+        self.initial == self.max
+    }
+
+    pub fn new_slab<T>(&self) -> Slab<T> {
+        Slab::with_capacity(self.initial)
+    }
+
+    // returns false if the slab is full. otherwise, ensures the next insert
+    // won't need to allocate
+    pub fn reserve<T>(&self, slab: &mut Slab<T>) -> bool {
+        let len = slab.len();
+
+        if len >= self.max {
+            return false;
+        }
+
+        if len == slab.capacity() {
+            let chunk = cmp::min(cmp::max(len, CHUNK_MIN), CHUNK_MAX);
+
+            slab.reserve(cmp::min(chunk, self.max - len));
+        }
+
+        true
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn fixed() {
+        let c = Capacity::fixed(2);
+        assert!(c.is_fixed());
+
+        let mut s = c.new_slab();
+        assert!(s.capacity() >= 2);
+
+        assert!(c.reserve(&mut s));
+        s.insert(1);
+        assert!(c.reserve(&mut s));
+        s.insert(2);
+        assert!(!c.reserve(&mut s));
+    }
+
+    #[test]
+    fn growable() {
+        let c = Capacity::growable(2, Some(CHUNK_MIN + 10));
+        assert!(!c.is_fixed());
+
+        let mut s = c.new_slab();
+        assert_eq!(s.capacity(), 2);
+
+        for i in 0..(CHUNK_MIN + 10) {
+            assert!(c.reserve(&mut s));
+            s.insert(i);
+        }
+
+        assert!(!c.reserve(&mut s));
+
+        // room freed up is reused
+        s.remove(0);
+        assert!(c.reserve(&mut s));
+        s.insert(0);
+        assert!(!c.reserve(&mut s));
+    }
+
+    #[test]
+    fn unbounded() {
+        let c = Capacity::growable(0, None);
+        assert_eq!(c.max(), usize::MAX);
+
+        let mut s = c.new_slab();
+
+        for i in 0..(CHUNK_MIN * 3) {
+            assert!(c.reserve(&mut s));
+            s.insert(i);
+        }
+
+        assert_eq!(s.len(), CHUNK_MIN * 3);
+    }
+}
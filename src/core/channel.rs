@@ -567,6 +567,18 @@ impl<T> AsyncReceiver<T> {
     pub fn recv(&self) -> RecvFuture<'_, T> {
         RecvFuture { r: self }
     }
+
+    // receives without waiting, for draining what is already queued
+    pub fn try_recv(&self) -> Result<T, mpsc::TryRecvError> {
+        match self.inner.try_recv() {
+            Err(mpsc::TryRecvError::Empty) => {
+                self.evented.registration().set_ready(false);
+
+                Err(mpsc::TryRecvError::Empty)
+            }
+            ret => ret,
+        }
+    }
 }
 
 pub struct AsyncLocalSender<T> {
@@ -18,17 +18,23 @@ HEADERS += \
 	$$PWD/test.h \
 	$$PWD/tnetstring.h \
 	$$PWD/httpheaders.h \
+	$$PWD/httpheaderindex.h \
 	$$PWD/zhttprequestpacket.h \
 	$$PWD/zhttpresponsepacket.h \
+	$$PWD/zhttpkeys.h \
 	$$PWD/log.h \
 	$$PWD/bufferlist.h \
+	$$PWD/ringqueue.h \
+	$$PWD/ridtable.h \
 	$$PWD/layertracker.h
 
 SOURCES += \
 	$$PWD/tnetstring.cpp \
 	$$PWD/httpheaders.cpp \
+	$$PWD/httpheaderindex.cpp \
 	$$PWD/zhttprequestpacket.cpp \
 	$$PWD/zhttpresponsepacket.cpp \
+	$$PWD/zhttpkeys.cpp \
 	$$PWD/log.cpp \
 	$$PWD/bufferlist.cpp \
 	$$PWD/layertracker.cpp
@@ -51,14 +57,24 @@ SOURCES += \
 
 HEADERS += \
 	$$PWD/callback.h \
+	$$PWD/fastsignal.h \
+	$$PWD/arena.h \
+	$$PWD/memorybudget.h \
+	$$PWD/objectstats.h \
 	$$PWD/config.h \
+	$$PWD/trace.h \
+	$$PWD/tracecontext.h \
 	$$PWD/timerwheel.h \
+	$$PWD/slabpool.h \
 	$$PWD/jwt.h \
+	$$PWD/gzip.h \
 	$$PWD/timer.h \
 	$$PWD/defercall.h \
 	$$PWD/socketnotifier.h \
 	$$PWD/event.h \
 	$$PWD/eventloop.h \
+	$$PWD/loopstats.h \
+	$$PWD/loopclock.h \
 	$$PWD/readwrite.h \
 	$$PWD/tcplistener.h \
 	$$PWD/tcpstream.h \
@@ -70,6 +86,7 @@ HEADERS += \
 	$$PWD/zutil.h \
 	$$PWD/httprequest.h \
 	$$PWD/websocket.h \
+	$$PWD/wscontrol.h \
 	$$PWD/zhttpmanager.h \
 	$$PWD/zhttprequest.h \
 	$$PWD/zwebsocket.h \
@@ -80,18 +97,33 @@ HEADERS += \
 	$$PWD/cors.h \
 	$$PWD/simplehttpserver.h \
 	$$PWD/stats.h \
+	$$PWD/latencyhistogram.h \
+	$$PWD/packetcapture.h \
+	$$PWD/topk.h \
+	$$PWD/flowwindow.h \
 	$$PWD/statsmanager.h \
-	$$PWD/settings.h
+	$$PWD/statsreportaggregator.h \
+	$$PWD/settings.h \
+	$$PWD/cputopology.h
 
 SOURCES += \
 	$$PWD/config.cpp \
+	$$PWD/trace.cpp \
+	$$PWD/tracecontext.cpp \
 	$$PWD/timerwheel.cpp \
 	$$PWD/jwt.cpp \
+	$$PWD/gzip.cpp \
 	$$PWD/timer.cpp \
 	$$PWD/defercall.cpp \
+	$$PWD/fastsignal.cpp \
+	$$PWD/arena.cpp \
+	$$PWD/memorybudget.cpp \
+	$$PWD/objectstats.cpp \
 	$$PWD/socketnotifier.cpp \
 	$$PWD/event.cpp \
 	$$PWD/eventloop.cpp \
+	$$PWD/loopstats.cpp \
+	$$PWD/loopclock.cpp \
 	$$PWD/tcplistener.cpp \
 	$$PWD/tcpstream.cpp \
 	$$PWD/unixlistener.cpp \
@@ -100,6 +132,7 @@ SOURCES += \
 	$$PWD/logutil.cpp \
 	$$PWD/uuidutil.cpp \
 	$$PWD/zutil.cpp \
+	$$PWD/wscontrol.cpp \
 	$$PWD/zhttpmanager.cpp \
 	$$PWD/zhttprequest.cpp \
 	$$PWD/zwebsocket.cpp \
@@ -109,5 +142,11 @@ SOURCES += \
 	$$PWD/cors.cpp \
 	$$PWD/simplehttpserver.cpp \
 	$$PWD/stats.cpp \
+	$$PWD/latencyhistogram.cpp \
+	$$PWD/packetcapture.cpp \
+	$$PWD/topk.cpp \
+	$$PWD/flowwindow.cpp \
 	$$PWD/statsmanager.cpp \
-	$$PWD/settings.cpp
+	$$PWD/statsreportaggregator.cpp \
+	$$PWD/settings.cpp \
+	$$PWD/cputopology.cpp
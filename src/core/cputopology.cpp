@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "cputopology.h"
+
+#include "log.h"
+#include "rust/bindings.h"
+
+namespace CpuTopology {
+
+static int currentThread(QStringList *groups)
+{
+	char buf[4096];
+	int count = ffi::cpu_topology_current_thread(buf, sizeof(buf));
+	if(count < 1)
+		return -1;
+
+	if(groups)
+		*groups = QString::fromUtf8(buf).split(' ');
+
+	return count;
+}
+
+int cpuCount()
+{
+	return qMax(currentThread(0), 1);
+}
+
+QStringList nodeCpus()
+{
+	QStringList groups;
+	if(currentThread(&groups) < 1)
+		return QStringList();
+
+	return groups;
+}
+
+int parseWorkers(const QString &value, int defaultValue)
+{
+	QString s = value.trimmed();
+
+	if(s.isEmpty())
+		return defaultValue;
+
+	if(s == "auto")
+		return cpuCount();
+
+	bool ok;
+	int x = s.toInt(&ok);
+	if(!ok || x < 0)
+		return -1;
+
+	// older configs may use 0 to mean a single worker
+	if(x == 0)
+	{
+		log_warning("workers=0 is treated as 1");
+		return 1;
+	}
+
+	return x;
+}
+
+QStringList autoWorkerCpus()
+{
+	QStringList groups = nodeCpus();
+	if(groups.count() < 2)
+		return QStringList();
+
+	QStringList out;
+
+	for(const QString &group : groups)
+	{
+		int size = 0;
+
+		for(const QString &part : group.split(','))
+		{
+			int dash = part.indexOf('-');
+			if(dash != -1)
+				size += part.mid(dash + 1).toInt() - part.left(dash).toInt() + 1;
+			else
+				++size;
+		}
+
+		for(int n = 0; n < size; ++n)
+			out += group;
+	}
+
+	return out;
+}
+
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef CPUTOPOLOGY_H
+#define CPUTOPOLOGY_H
+
+#include <QString>
+#include <QStringList>
+
+// cpus available to the process, as seen at startup from the main thread
+namespace CpuTopology {
+
+// number of cpus the process may run on, at least 1
+int cpuCount();
+
+// the available cpus grouped by NUMA node, as cpu lists (e.g. "0-3,8"). a
+// single group is returned if the node layout is not known
+QStringList nodeCpus();
+
+// parses a workers setting. "auto" means one worker per available cpu, and
+// 0 is accepted as 1. returns defaultValue if the value is blank, or -1 if
+// it is invalid
+int parseWorkers(const QString &value, int defaultValue = 1);
+
+// cpu sets to pin automatically sized workers to, suitable for taking in
+// turn. each node appears once per cpu it has, so workers are spread across
+// nodes in proportion to their size. empty if there is only one node
+QStringList autoWorkerCpus();
+
+}
+
+#endif
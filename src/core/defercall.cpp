@@ -22,6 +22,7 @@
 
 #include "defercall.h"
 
+#include <assert.h>
 #include <QObject>
 #include <QMetaObject>
 #include <boost/signals2.hpp>
@@ -114,11 +115,34 @@ private:
 
 }
 
+// idle calls kept for reuse, per thread
+#define CALL_POOL_MAX 1024
+
+namespace {
+
+// calls queued from other threads. these are rare, so they allocate
+class RemoteCall
+{
+public:
+	std::function<void ()> handler;
+	DeferCall *target;
+	std::weak_ptr<bool> alive;
+	RemoteCall *next;
+};
+
+}
+
 class DeferCall::Manager
 {
 public:
 	Manager() :
-		thread_(std::this_thread::get_id())
+		thread_(std::this_thread::get_id()),
+		first_(nullptr),
+		last_(nullptr),
+		nextSeq_(0),
+		pool_(nullptr),
+		poolSize_(0),
+		remoteHead_(nullptr)
 	{
 		timer_.setSingleShot(true);
 		timer_.timeout.connect(boost::bind(&Manager::timer_timeout, this));
@@ -126,26 +150,91 @@ public:
 		threadWake_.awake.connect(boost::bind(&Manager::threadWake_awake, this));
 	}
 
-	void add(const std::weak_ptr<Call> &c)
+	~Manager()
+	{
+		while(pool_)
+		{
+			Call *c = pool_;
+			pool_ = c->next;
+			delete c;
+		}
+
+		takeRemote(false);
+	}
+
+	Call *acquire()
 	{
-		std::lock_guard<std::mutex> guard(callsMutex_);
+		if(pool_)
+		{
+			Call *c = pool_;
+			pool_ = c->next;
+			--poolSize_;
 
-		calls_.push_back(c);
+			return c;
+		}
 
-		if(std::this_thread::get_id() == thread_)
+		return new Call;
+	}
+
+	void release(Call *c)
+	{
+		if(poolSize_ >= CALL_POOL_MAX)
 		{
-			if(!timer_.isActive())
-				timer_.start(0);
+			delete c;
+			return;
 		}
+
+		c->next = pool_;
+		pool_ = c;
+		++poolSize_;
+	}
+
+	// owning thread only
+	void add(Call *c)
+	{
+		c->seq = nextSeq_++;
+		c->prev = last_;
+		c->next = nullptr;
+
+		if(last_)
+			last_->next = c;
+		else
+			first_ = c;
+
+		last_ = c;
+
+		if(!timer_.isActive())
+			timer_.start(0);
+	}
+
+	// owning thread only
+	void remove(Call *c)
+	{
+		if(c->prev)
+			c->prev->next = c->next;
+		else
+			first_ = c->next;
+
+		if(c->next)
+			c->next->prev = c->prev;
 		else
+			last_ = c->prev;
+	}
+
+	// thread-safe
+	void addRemote(RemoteCall *r)
+	{
+		r->next = remoteHead_.load(std::memory_order_relaxed);
+		while(!remoteHead_.compare_exchange_weak(r->next, r, std::memory_order_release, std::memory_order_relaxed))
 		{
-			threadWake_.wake();
 		}
+
+		threadWake_.wake();
 	}
 
 	void flush()
 	{
-		while(!isCallsEmpty())
+		while(first_ || remoteHead_.load(std::memory_order_acquire))
 			process();
 	}
 
@@ -153,45 +242,74 @@ private:
 	std::thread::id thread_;
 	Timer timer_;
 	ThreadWake threadWake_;
-	std::mutex callsMutex_;
-	std::list<std::weak_ptr<Call>> calls_;
-
-	// thread-safe
-	bool isCallsEmpty()
+	Call *first_;
+	Call *last_;
+	unsigned long long nextSeq_;
+	Call *pool_;
+	int poolSize_;
+	std::atomic<RemoteCall*> remoteHead_;
+
+	// moves calls queued from other threads to their targets, in the
+	// order they were queued. calls whose target no longer exists are
+	// dropped
+	void takeRemote(bool queue)
 	{
-		std::lock_guard<std::mutex> guard(callsMutex_);
+		RemoteCall *r = remoteHead_.exchange(nullptr, std::memory_order_acquire);
+
+		// the stack is newest first
+		RemoteCall *ordered = nullptr;
+		while(r)
+		{
+			RemoteCall *next = r->next;
+			r->next = ordered;
+			ordered = r;
+			r = next;
+		}
 
-		return calls_.empty();
+		while(ordered)
+		{
+			RemoteCall *r = ordered;
+			ordered = r->next;
+
+			// targets are destroyed on this thread, so checking here is
+			// enough to know the target will outlive the queueing
+			if(queue && r->alive.lock())
+			{
+				r->target->remotePending_.fetch_sub(1, std::memory_order_relaxed);
+
+				Call *c = acquire();
+				c->set(std::move(r->handler));
+				r->target->queueLocal(c);
+			}
+
+			delete r;
+		}
 	}
 
-	// thread-safe
 	void process()
 	{
-		std::list<std::weak_ptr<Call>> ready;
+		takeRemote(true);
 
-		// lock to take list
-		{
-			std::lock_guard<std::mutex> guard(callsMutex_);
+		if(!last_)
+			return;
 
-			// process all calls queued so far, but not any that may get queued
-			// during processing
-			ready.swap(calls_);
-		}
+		// process all calls queued so far, but not any that may get queued
+		// during processing
+		unsigned long long lastSeq = last_->seq;
 
-		// process list while not locked
-		for(auto c : ready)
+		while(first_ && first_->seq <= lastSeq)
 		{
-			if(auto p = c.lock())
-			{
-				auto source = p->source.lock();
+			Call *c = first_;
+			remove(c);
 
-				// if call is valid then its source will be too
-				assert(source);
+			c->owner->unlinkOwned(c);
 
-				source->erase(p->sourceElement);
+			// the handler may delete the owner, which is fine since the
+			// call is no longer linked to it
+			c->invoke(c);
+			c->destroy(c);
 
-				p->handler();
-			}
+			release(c);
 		}
 	}
 
@@ -209,58 +327,71 @@ private:
 	}
 };
 
-std::list<std::shared_ptr<DeferCall::Call>>::size_type DeferCall::CallsList::size() const
+DeferCall::DeferCall() :
+	thread_(std::this_thread::get_id()),
+	alive_(std::make_shared<bool>(true)),
+	first_(nullptr),
+	pending_(0),
+	remotePending_(0)
 {
-	std::lock_guard<std::mutex> guard(mutex);
+	if(!localManager)
+	{
+		localManager = std::make_shared<Manager>();
 
-	return l.size();
+		std::lock_guard<std::mutex> guard(managerByThreadMutex);
+		managerByThread[thread_] = localManager;
+	}
 }
 
-std::list<std::shared_ptr<DeferCall::Call>>::iterator DeferCall::CallsList::append(const std::shared_ptr<DeferCall::Call> &c)
+DeferCall::~DeferCall()
 {
-	std::lock_guard<std::mutex> guard(mutex);
-
-	l.push_back(c);
+	// retract pending calls
+	while(first_)
+	{
+		Call *c = first_;
+		unlinkOwned(c);
 
-	// get an iterator to the element that was pushed
-	auto it = l.end();
-	--it;
+		Manager *manager = localManager.get();
+		assert(manager);
 
-	return it;
+		manager->remove(c);
+		c->destroy(c);
+		manager->release(c);
+	}
 }
 
-void DeferCall::CallsList::erase(std::list<std::shared_ptr<DeferCall::Call>>::iterator position)
+DeferCall::Call *DeferCall::acquireCall()
 {
-	std::lock_guard<std::mutex> guard(mutex);
+	Manager *manager = localManager.get();
+	assert(manager);
 
-	l.erase(position);
+	return manager->acquire();
 }
 
-DeferCall::DeferCall() :
-	thread_(std::this_thread::get_id()),
-	deferredCalls_(std::make_shared<CallsList>())
+void DeferCall::queueLocal(Call *c)
 {
-	if(!localManager)
-	{
-		localManager = std::make_shared<Manager>();
+	c->owner = this;
+	c->ownerPrev = nullptr;
+	c->ownerNext = first_;
 
-		std::lock_guard<std::mutex> guard(managerByThreadMutex);
-		managerByThread[thread_] = localManager;
-	}
-}
+	if(first_)
+		first_->ownerPrev = c;
+
+	first_ = c;
+	++pending_;
 
-DeferCall::~DeferCall() = default;
+	localManager->add(c);
+}
 
-void DeferCall::defer(std::function<void ()> handler)
+void DeferCall::queueRemote(std::function<void ()> &&handler)
 {
-	std::shared_ptr<Call> c = std::make_shared<Call>();
-	c->handler = handler;
-	c->source = deferredCalls_;
-	c->sourceElement = deferredCalls_->append(c);
+	RemoteCall *r = new RemoteCall;
+	r->handler = std::move(handler);
+	r->target = this;
+	r->alive = alive_;
 
-	Manager *manager = localManager.get();
+	Manager *manager;
 
-	if(std::this_thread::get_id() != thread_)
 	{
 		std::lock_guard<std::mutex> guard(managerByThreadMutex);
 		auto it = managerByThread.find(thread_);
@@ -269,9 +400,22 @@ void DeferCall::defer(std::function<void ()> handler)
 		manager = it->second.get();
 	}
 
-	// manager keeps a weak pointer, so we can invalidate pending calls by
-	// simply deleting them
-	manager->add(c);
+	remotePending_.fetch_add(1, std::memory_order_relaxed);
+
+	manager->addRemote(r);
+}
+
+void DeferCall::unlinkOwned(Call *c)
+{
+	if(c->ownerPrev)
+		c->ownerPrev->ownerNext = c->ownerNext;
+	else
+		first_ = c->ownerNext;
+
+	if(c->ownerNext)
+		c->ownerNext->ownerPrev = c->ownerPrev;
+
+	--pending_;
 }
 
 DeferCall *DeferCall::global()
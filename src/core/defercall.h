@@ -23,10 +23,14 @@
 #ifndef DEFERCALL_H
 #define DEFERCALL_H
 
+#include <atomic>
+#include <cstddef>
 #include <functional>
 #include <memory>
-#include <list>
+#include <new>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 #include <thread>
 #include <mutex>
 
@@ -43,9 +47,27 @@ public:
 	// to keep a DeferCall as a member variable, and only refer to the
 	// object's own data in the handler. that way, any references are
 	// guaranteed to live long enough.
-	void defer(std::function<void ()> handler);
+	//
+	// calls from the owning thread are queued without locking, and small
+	// handlers are stored without allocating. calls from other threads go
+	// through a lock-free queue and are handed over when the owning thread
+	// wakes
+	template <typename F>
+	void defer(F &&handler)
+	{
+		if(std::this_thread::get_id() == thread_)
+		{
+			Call *c = acquireCall();
+			c->set(std::forward<F>(handler));
+			queueLocal(c);
+		}
+		else
+		{
+			queueRemote(std::function<void ()>(std::forward<F>(handler)));
+		}
+	}
 
-	int pendingCount() const { return deferredCalls_->size(); }
+	int pendingCount() const { return pending_ + remotePending_.load(std::memory_order_relaxed); }
 
 	static DeferCall *global();
 	static void cleanup();
@@ -57,34 +79,65 @@ public:
 	}
 
 private:
-	class Call;
-
-	class CallsList
-	{
-	public:
-		// all methods thread-safe
-		std::list<std::shared_ptr<Call>>::size_type size() const;
-		std::list<std::shared_ptr<Call>>::iterator append(const std::shared_ptr<Call> &c);
-		void erase(std::list<std::shared_ptr<Call>>::iterator position);
-
-	private:
-		mutable std::mutex mutex;
-		std::list<std::shared_ptr<Call>> l;
-	};
-
 	class Call
 	{
 	public:
-		std::function<void ()> handler;
-		std::weak_ptr<CallsList> source;
-		std::list<std::shared_ptr<Call>>::iterator sourceElement;
+		// fits a few captured pointers, or a std::function
+		static const int StorageSize = 48;
+
+		alignas(std::max_align_t) unsigned char storage[StorageSize];
+		void (*invoke)(Call *c);
+		void (*destroy)(Call *c);
+		DeferCall *owner;
+		unsigned long long seq;
+
+		// position in the manager's queue
+		Call *prev;
+		Call *next;
+
+		// position in the owner's list
+		Call *ownerPrev;
+		Call *ownerNext;
+
+		template <typename F>
+		void set(F &&f)
+		{
+			typedef typename std::decay<F>::type T;
+
+			if constexpr(sizeof(T) <= StorageSize && alignof(T) <= alignof(std::max_align_t))
+			{
+				new(storage) T(std::forward<F>(f));
+
+				invoke = [](Call *c) { (*std::launder(reinterpret_cast<T *>(c->storage)))(); };
+				destroy = [](Call *c) { std::launder(reinterpret_cast<T *>(c->storage))->~T(); };
+			}
+			else
+			{
+				T *p = new T(std::forward<F>(f));
+				new(storage) T*(p);
+
+				invoke = [](Call *c) { (**std::launder(reinterpret_cast<T **>(c->storage)))(); };
+				destroy = [](Call *c) { delete *std::launder(reinterpret_cast<T **>(c->storage)); };
+			}
+		}
 	};
 
 	class Manager;
 	friend class Manager;
 
 	std::thread::id thread_;
-	std::shared_ptr<CallsList> deferredCalls_;
+	std::shared_ptr<bool> alive_;
+
+	// owning thread only
+	Call *first_;
+	int pending_;
+
+	std::atomic<int> remotePending_;
+
+	Call *acquireCall();
+	void queueLocal(Call *c);
+	void queueRemote(std::function<void ()> &&handler);
+	void unlinkOwned(Call *c);
 
 	static thread_local std::shared_ptr<Manager> localManager;
 	static thread_local std::unique_ptr<DeferCall> localInstance;
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "bench.h"
+#include "eventloop.h"
+#include "defercall.h"
+
+extern "C" void defercall_bench(const char *filter)
+{
+	Bench bench(filter);
+
+	if(!bench.selected("defercall/"))
+		return;
+
+	EventLoop loop(100);
+
+	{
+		DeferCall deferCall;
+		int count = 0;
+
+		// small captures fit in the pooled call storage
+		bench.run("defercall/local", 10000, 100, [&] {
+			for(int n = 0; n < 100; ++n)
+				deferCall.defer([&count] { ++count; });
+
+			loop.step();
+		});
+	}
+
+	{
+		DeferCall deferCall;
+		int count = 0;
+		char pad[64] = {0};
+
+		// captures larger than the inline storage fall back to the heap
+		bench.run("defercall/large-capture", 10000, 100, [&] {
+			for(int n = 0; n < 100; ++n)
+				deferCall.defer([&count, pad] { count += pad[0] + 1; });
+
+			loop.step();
+		});
+	}
+
+	{
+		int count = 0;
+
+		// calls retracted by the owner being destroyed
+		bench.run("defercall/retract", 10000, 100, [&] {
+			DeferCall deferCall;
+
+			for(int n = 0; n < 100; ++n)
+				deferCall.defer([&count] { ++count; });
+		});
+	}
+
+	DeferCall::cleanup();
+}
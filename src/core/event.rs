@@ -15,18 +15,35 @@
  */
 
 use crate::core::arena;
+use crate::core::capacity::Capacity;
 use crate::core::list;
+use crate::core::uring::UringPoller;
+use log::warn;
 use mio::event::Source;
+use mio::unix::SourceFd;
 use mio::{Events, Interest, Poll, Token, Waker};
 use slab::Slab;
 use std::cell::{Cell, RefCell};
 use std::io;
+use std::os::unix::io::{AsRawFd, RawFd};
 use std::rc::Rc;
+use std::sync::atomic::{AtomicBool, Ordering};
 use std::sync::{Arc, Mutex};
 use std::time::Duration;
 
 const EVENTS_MAX: usize = 1024;
 const LOCAL_BUDGET: u32 = 10;
+const URING_ENTRIES: u32 = 1024;
+
+static IO_URING_ENABLED: AtomicBool = AtomicBool::new(false);
+static IO_URING_WARNED: AtomicBool = AtomicBool::new(false);
+
+// selects io_uring for watching file descriptors registered with
+// Poller::register_fd. applies to pollers created afterwards, which fall
+// back to epoll if io_uring is unavailable
+pub fn set_io_uring_enabled(enabled: bool) {
+    IO_URING_ENABLED.store(enabled, Ordering::Relaxed);
+}
 
 pub fn can_move_mio_sockets_between_threads() -> bool {
     // on unix platforms, mio always uses epoll or kqueue, which support
@@ -69,6 +86,7 @@ struct SourceItem {
 
 struct RegisteredSources {
     nodes: Slab<list::Node<SourceItem>>,
+    capacity: Capacity,
     ready: list::List,
 }
 
@@ -77,10 +95,11 @@ struct LocalSources {
 }
 
 impl LocalSources {
-    fn new(max_sources: usize) -> Self {
+    fn new(capacity: Capacity) -> Self {
         Self {
             registered_sources: RefCell::new(RegisteredSources {
-                nodes: Slab::with_capacity(max_sources),
+                nodes: capacity.new_slab(),
+                capacity,
                 ready: list::List::default(),
             }),
         }
@@ -89,7 +108,7 @@ impl LocalSources {
     fn register(&self, subtoken: Token, interests: Interest) -> Result<usize, io::Error> {
         let sources = &mut *self.registered_sources.borrow_mut();
 
-        if sources.nodes.len() == sources.nodes.capacity() {
+        if !sources.capacity.reserve(&mut sources.nodes) {
             return Err(io::Error::from(io::ErrorKind::WriteZero));
         }
 
@@ -167,10 +186,11 @@ struct SyncSources {
 }
 
 impl SyncSources {
-    fn new(max_sources: usize, waker: Waker) -> Self {
+    fn new(capacity: Capacity, waker: Waker) -> Self {
         Self {
             registered_sources: Mutex::new(RegisteredSources {
-                nodes: Slab::with_capacity(max_sources),
+                nodes: capacity.new_slab(),
+                capacity,
                 ready: list::List::default(),
             }),
             waker,
@@ -180,7 +200,7 @@ impl SyncSources {
     fn register(&self, subtoken: Token, interests: Interest) -> Result<usize, io::Error> {
         let sources = &mut *self.registered_sources.lock().unwrap();
 
-        if sources.nodes.len() == sources.nodes.capacity() {
+        if !sources.capacity.reserve(&mut sources.nodes) {
             return Err(io::Error::from(io::ErrorKind::WriteZero));
         }
 
@@ -265,12 +285,12 @@ struct CustomSources {
 }
 
 impl CustomSources {
-    fn new(poll: &Poll, token: Token, max_sources: usize) -> Result<Self, io::Error> {
+    fn new(poll: &Poll, token: Token, capacity: Capacity) -> Result<Self, io::Error> {
         let waker = Waker::new(poll.registry(), token)?;
 
         Ok(Self {
-            local: Rc::new(LocalSources::new(max_sources)),
-            sync: Arc::new(SyncSources::new(max_sources, waker)),
+            local: Rc::new(LocalSources::new(capacity)),
+            sync: Arc::new(SyncSources::new(capacity, waker)),
             next_local_only: Cell::new(false),
         })
     }
@@ -527,6 +547,7 @@ impl Event {
 pub struct Poller {
     poll: Poll,
     events: Events,
+    uring: Option<UringPoller>,
     custom_sources: CustomSources,
     local_registration_memory: Rc<arena::RcMemory<LocalRegistrationEntry>>,
     local_budget: u32,
@@ -534,15 +555,51 @@ pub struct Poller {
 
 impl Poller {
     pub fn new(max_custom_sources: usize) -> Result<Self, io::Error> {
+        Self::new_with_capacity(Capacity::fixed(max_custom_sources))
+    }
+
+    // local registration memory can't move once allocated, so it stays at
+    // the initial capacity
+    pub fn new_with_capacity(custom_sources_capacity: Capacity) -> Result<Self, io::Error> {
+        Self::new_with_backend(
+            custom_sources_capacity,
+            IO_URING_ENABLED.load(Ordering::Relaxed),
+        )
+    }
+
+    pub fn new_with_backend(
+        custom_sources_capacity: Capacity,
+        io_uring: bool,
+    ) -> Result<Self, io::Error> {
         let poll = Poll::new()?;
         let events = Events::with_capacity(EVENTS_MAX);
-        let custom_sources = CustomSources::new(&poll, Token(0), max_custom_sources)?;
+        let custom_sources = CustomSources::new(&poll, Token(0), custom_sources_capacity)?;
+
+        // with io_uring, the epoll instance is watched by the ring, for
+        // sources other than plain file descriptors
+        let uring = if io_uring {
+            match UringPoller::new(URING_ENTRIES, poll.as_raw_fd()) {
+                Ok(uring) => Some(uring),
+                Err(e) => {
+                    if !IO_URING_WARNED.swap(true, Ordering::Relaxed) {
+                        warn!("io_uring unavailable, using epoll: {}", e);
+                    }
+
+                    None
+                }
+            }
+        } else {
+            None
+        };
 
         Ok(Self {
             poll,
             events,
+            uring,
             custom_sources,
-            local_registration_memory: Rc::new(arena::RcMemory::new(max_custom_sources)),
+            local_registration_memory: Rc::new(arena::RcMemory::new(
+                custom_sources_capacity.initial(),
+            )),
             local_budget: LOCAL_BUDGET,
         })
     }
@@ -570,6 +627,36 @@ impl Poller {
         self.poll.registry().deregister(source)
     }
 
+    pub fn is_io_uring(&self) -> bool {
+        self.uring.is_some()
+    }
+
+    pub fn register_fd(
+        &self,
+        fd: RawFd,
+        token: Token,
+        interests: Interest,
+    ) -> Result<(), io::Error> {
+        if token == Token(0) {
+            return Err(io::Error::from(io::ErrorKind::InvalidInput));
+        }
+
+        match &self.uring {
+            Some(uring) => uring.register(fd, token, interests),
+            None => self
+                .poll
+                .registry()
+                .register(&mut SourceFd(&fd), token, interests),
+        }
+    }
+
+    pub fn deregister_fd(&self, fd: RawFd) -> Result<(), io::Error> {
+        match &self.uring {
+            Some(uring) => uring.deregister(fd),
+            None => self.poll.registry().deregister(&mut SourceFd(&fd)),
+        }
+    }
+
     pub fn register_custom(
         &self,
         registration: &Registration,
@@ -616,7 +703,12 @@ impl Poller {
         if self.custom_sources.has_local_events() && self.local_budget > 0 {
             self.local_budget -= 1;
             self.custom_sources.set_next_local_only(true);
-            self.events.clear(); // don't reread previous mio events
+
+            // don't reread previous events
+            self.events.clear();
+            if let Some(uring) = &mut self.uring {
+                uring.clear_events();
+            }
 
             return Ok(());
         }
@@ -630,17 +722,44 @@ impl Poller {
             timeout
         };
 
+        let timeout = match &mut self.uring {
+            Some(uring) => {
+                if !uring.poll(timeout)? {
+                    self.events.clear();
+
+                    return Ok(());
+                }
+
+                // the epoll instance has events. read them without waiting
+                Some(Duration::from_millis(0))
+            }
+            None => timeout,
+        };
+
         loop {
             match self.poll.poll(&mut self.events, timeout) {
                 Err(e) if e.kind() == io::ErrorKind::Interrupted => {}
-                ret => break ret,
+                ret => break ret?,
             }
         }
+
+        if let Some(uring) = &mut self.uring {
+            // a full batch means there may be more
+            uring.set_inner_drained(self.events.iter().count() >= EVENTS_MAX);
+        }
+
+        Ok(())
     }
 
     pub fn iter_events(&self) -> EventsIterator<'_, '_> {
+        let fd_events = match &self.uring {
+            Some(uring) => uring.events(),
+            None => &[],
+        };
+
         EventsIterator {
             events: self.events.iter(),
+            fd_events: fd_events.iter(),
             custom_sources: &self.custom_sources,
             custom_left: EVENTS_MAX,
         }
@@ -649,6 +768,7 @@ impl Poller {
 
 pub struct EventsIterator<'a, 'b> {
     events: mio::event::Iter<'b>,
+    fd_events: std::slice::Iter<'a, (Token, Interest)>,
     custom_sources: &'a CustomSources,
     custom_left: usize,
 }
@@ -680,6 +800,13 @@ impl Iterator for EventsIterator<'_, '_> {
             }
         }
 
+        if let Some((token, readiness)) = self.fd_events.next() {
+            return Some(Event {
+                token: *token,
+                readiness: *readiness,
+            });
+        }
+
         if self.custom_left > 0 {
             self.custom_left -= 1;
 
@@ -744,6 +871,8 @@ pub mod ffi {
 #[cfg(test)]
 mod tests {
     use super::*;
+    use std::io::Write;
+    use std::os::unix::net::UnixStream;
     use std::time::Duration;
 
     #[test]
@@ -753,7 +882,7 @@ mod tests {
 
         let mut poll = Poll::new().unwrap();
 
-        let sources = CustomSources::new(&poll, token, 1).unwrap();
+        let sources = CustomSources::new(&poll, token, Capacity::fixed(1)).unwrap();
 
         assert_eq!(sources.has_events(), false);
         assert_eq!(sources.next_event(), None);
@@ -797,7 +926,7 @@ mod tests {
 
         let mut poll = Poll::new().unwrap();
 
-        let sources = CustomSources::new(&poll, token, 1).unwrap();
+        let sources = CustomSources::new(&poll, token, Capacity::fixed(1)).unwrap();
 
         assert_eq!(sources.has_events(), false);
         assert_eq!(sources.next_event(), None);
@@ -837,7 +966,7 @@ mod tests {
 
         let mut poll = Poll::new().unwrap();
 
-        let sources = CustomSources::new(&poll, token, 1).unwrap();
+        let sources = CustomSources::new(&poll, token, Capacity::fixed(1)).unwrap();
 
         assert_eq!(sources.has_events(), false);
         assert_eq!(sources.next_event(), None);
@@ -893,4 +1022,57 @@ mod tests {
         assert_eq!(event.is_readable(), true);
         assert_eq!(it.next(), None);
     }
+
+    #[test]
+    fn test_poller_io_uring() {
+        let fd_token = Token(1);
+        let custom_token = Token(2);
+
+        let mut poller = Poller::new_with_backend(Capacity::fixed(1), true).unwrap();
+
+        if !poller.is_io_uring() {
+            // not available to the test
+            return;
+        }
+
+        let (mut a, b) = UnixStream::pair().unwrap();
+
+        poller
+            .register_fd(b.as_raw_fd(), fd_token, Interest::READABLE)
+            .unwrap();
+
+        let (reg, sr) = Registration::new();
+
+        poller
+            .register_custom(&reg, custom_token, Interest::READABLE)
+            .unwrap();
+
+        poller.poll(Some(Duration::from_millis(0))).unwrap();
+        assert_eq!(poller.iter_events().next(), None);
+
+        a.write_all(b"hello").unwrap();
+
+        poller.poll(None).unwrap();
+
+        let mut it = poller.iter_events();
+
+        let event = it.next().unwrap();
+        assert_eq!(event.token(), fd_token);
+        assert_eq!(event.is_readable(), true);
+        assert_eq!(it.next(), None);
+
+        // custom sources wake the epoll instance, which the ring watches
+        sr.set_readiness(Interest::READABLE).unwrap();
+
+        poller.poll(None).unwrap();
+
+        let mut it = poller.iter_events();
+
+        let event = it.next().unwrap();
+        assert_eq!(event.token(), custom_token);
+        assert_eq!(event.is_readable(), true);
+        assert_eq!(it.next(), None);
+
+        poller.deregister_fd(b.as_raw_fd()).unwrap();
+    }
 }
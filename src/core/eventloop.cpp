@@ -17,15 +17,169 @@
 #include "eventloop.h"
 
 #include <assert.h>
+#include <deque>
+#include <vector>
+#include "latencyhistogram.h"
+#include "loopstats.h"
+#include "loopclock.h"
 
 static thread_local EventLoop *g_instance = nullptr;
 
-EventLoop::EventLoop(int capacity)
+// wraps callbacks in order to time them. wrappers are kept in a deque,
+// which keeps their addresses stable as it grows, and are reused so that
+// registering normally doesn't allocate
+class EventLoop::Instrumentation
+{
+public:
+	class Registration
+	{
+	public:
+		Instrumentation *owner;
+		int index;
+		int id;
+		LoopStats::Source source;
+		void (*cb)(void *, uint8_t);
+		void *ctx;
+		qint64 due; // timers only
+		int nextFree;
+	};
+
+	std::deque<Registration> slots;
+	std::vector<int> slotsById;
+	int freeHead;
+	int maxSlots; // 0 for unlimited
+
+	Instrumentation(int initialCapacity, int maxCapacity) :
+		freeHead(-1),
+		maxSlots(maxCapacity)
+	{
+		for(int n = 0; n < initialCapacity; ++n)
+			release(addSlot());
+	}
+
+	Registration *addSlot()
+	{
+		slots.emplace_back();
+
+		Registration *r = &slots.back();
+		r->owner = this;
+		r->index = (int)slots.size() - 1;
+
+		return r;
+	}
+
+	// returns null if there are no free slots
+	Registration *acquire(LoopStats::Source source, void (*cb)(void *, uint8_t), void *ctx)
+	{
+		if(freeHead == -1)
+		{
+			if(maxSlots > 0 && (int)slots.size() >= maxSlots)
+				return nullptr;
+
+			release(addSlot());
+		}
+
+		Registration *r = &slots[freeHead];
+		freeHead = r->nextFree;
+
+		r->id = -1;
+		r->source = source;
+		r->cb = cb;
+		r->ctx = ctx;
+		r->due = -1;
+
+		return r;
+	}
+
+	void release(Registration *r)
+	{
+		r->nextFree = freeHead;
+		freeHead = r->index;
+	}
+
+	void setId(int id, Registration *r)
+	{
+		if(id >= (int)slotsById.size())
+			slotsById.resize(id + 1, -1);
+
+		if(r)
+		{
+			r->id = id;
+			slotsById[id] = r->index;
+		}
+		else
+		{
+			slotsById[id] = -1;
+		}
+	}
+
+	void removeId(int id)
+	{
+		if(id < (int)slotsById.size() && slotsById[id] != -1)
+		{
+			release(&slots[slotsById[id]]);
+			slotsById[id] = -1;
+		}
+	}
+
+	static void cb_activated(void *ctx, uint8_t readiness)
+	{
+		Registration *r = (Registration *)ctx;
+
+		// the callback may deregister itself, so don't touch the
+		// registration after calling it
+		LoopStats::Source source = r->source;
+		void (*cb)(void *, uint8_t) = r->cb;
+		void *cbCtx = r->ctx;
+		qint64 due = r->due;
+
+		// timers are removed by the loop once activated, and the callback
+		// may register a new timer with the same id
+		if(source == LoopStats::TimerSource)
+			r->owner->removeId(r->id);
+
+		qint64 start = LatencyHistogram::now();
+
+		if(source == LoopStats::TimerSource && due >= 0)
+			LoopStats::recordTimerLag(start - due);
+
+		cb(cbCtx, readiness);
+
+		LoopStats::recordCallback(source, LatencyHistogram::now() - start);
+	}
+};
+
+// ctx is the instrumentation, if any
+static void cb_iteration(void *ctx, uint64_t usecs)
+{
+	// the next read sees the time after waiting for events
+	LoopClock::invalidate();
+
+	if(ctx)
+		LoopStats::recordIteration((qint64)usecs);
+}
+
+EventLoop::EventLoop(int capacity) :
+	EventLoop(capacity, capacity)
+{
+}
+
+EventLoop::EventLoop(int initialCapacity, int maxCapacity)
 {
 	// only one per thread allowed
 	assert(!g_instance);
 
-	inner_ = ffi::event_loop_create(capacity);
+	if(initialCapacity == maxCapacity)
+		inner_ = ffi::event_loop_create(maxCapacity);
+	else
+		inner_ = ffi::event_loop_create_growable(initialCapacity, maxCapacity);
+
+	if(LoopStats::enabled())
+		instr_ = std::make_unique<Instrumentation>(initialCapacity, maxCapacity);
+
+	ffi::event_loop_set_iteration_callback(inner_, cb_iteration, instr_.get());
+
+	LoopClock::setCached(true);
 
 	g_instance = this;
 }
@@ -34,6 +188,10 @@ EventLoop::~EventLoop()
 {
 	ffi::event_loop_destroy(inner_);
 
+	instr_.reset();
+
+	LoopClock::setCached(false);
+
 	g_instance = nullptr;
 }
 
@@ -41,6 +199,9 @@ std::optional<int> EventLoop::step()
 {
 	std::optional<int> code;
 
+	// don't carry over a time read outside of the loop
+	LoopClock::invalidate();
+
 	int x;
 	if(ffi::event_loop_step(inner_, &x) == 0)
 		code = x;
@@ -50,6 +211,8 @@ std::optional<int> EventLoop::step()
 
 int EventLoop::exec()
 {
+	LoopClock::invalidate();
+
 	return ffi::event_loop_exec(inner_);
 }
 
@@ -60,31 +223,77 @@ void EventLoop::exit(int code)
 
 int EventLoop::registerFd(int fd, uint8_t interest, void (*cb)(void *, uint8_t), void *ctx)
 {
+	Instrumentation::Registration *r = nullptr;
+	if(instr_ && (r = instr_->acquire(LoopStats::FdSource, cb, ctx)))
+	{
+		cb = Instrumentation::cb_activated;
+		ctx = r;
+	}
+
 	size_t id;
 
 	if(ffi::event_loop_register_fd(inner_, fd, interest, cb, ctx, &id) != 0)
+	{
+		if(r)
+			instr_->release(r);
+
 		return -1;
+	}
+
+	if(instr_)
+		instr_->setId((int)id, r);
 
 	return (int)id;
 }
 
-int EventLoop::registerTimer(int timeout, void (*cb)(void *, uint8_t), void *ctx)
+int EventLoop::registerTimer(int timeout, void (*cb)(void *, uint8_t), void *ctx, int slack)
 {
+	Instrumentation::Registration *r = nullptr;
+	if(instr_ && (r = instr_->acquire(LoopStats::TimerSource, cb, ctx)))
+	{
+		r->due = LatencyHistogram::now() + (qint64)timeout * 1000;
+		cb = Instrumentation::cb_activated;
+		ctx = r;
+	}
+
 	size_t id;
 
-	if(ffi::event_loop_register_timer(inner_, timeout, cb, ctx, &id) != 0)
+	if(ffi::event_loop_register_timer_with_slack(inner_, timeout, slack, cb, ctx, &id) != 0)
+	{
+		if(r)
+			instr_->release(r);
+
 		return -1;
+	}
+
+	if(instr_)
+		instr_->setId((int)id, r);
 
 	return (int)id;
 }
 
 std::tuple<int, std::unique_ptr<Event::SetReadiness>> EventLoop::registerCustom(void (*cb)(void *, uint8_t), void *ctx)
 {
+	Instrumentation::Registration *r = nullptr;
+	if(instr_ && (r = instr_->acquire(LoopStats::CustomSource, cb, ctx)))
+	{
+		cb = Instrumentation::cb_activated;
+		ctx = r;
+	}
+
 	size_t id;
 	ffi::SetReadiness *srRaw = nullptr;
 
 	if(ffi::event_loop_register_custom(inner_, cb, ctx, &id, &srRaw) != 0)
+	{
+		if(r)
+			instr_->release(r);
+
 		return std::tuple<int, std::unique_ptr<Event::SetReadiness>>();
+	}
+
+	if(instr_)
+		instr_->setId((int)id, r);
 
 	std::unique_ptr<Event::SetReadiness> sr(new Event::SetReadiness(srRaw));
 
@@ -94,9 +303,17 @@ std::tuple<int, std::unique_ptr<Event::SetReadiness>> EventLoop::registerCustom(
 void EventLoop::deregister(int id)
 {
 	assert(ffi::event_loop_deregister(inner_, id) == 0);
+
+	if(instr_)
+		instr_->removeId(id);
 }
 
 EventLoop *EventLoop::instance()
 {
 	return g_instance;
 }
+
+void EventLoop::setIoUringEnabled(bool on)
+{
+	ffi::event_loop_set_io_uring_enabled(on);
+}
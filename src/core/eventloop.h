@@ -26,6 +26,10 @@ class EventLoop
 {
 public:
 	EventLoop(int capacity);
+
+	// registrations are allocated on demand, up to maxCapacity or without
+	// limit if zero
+	EventLoop(int initialCapacity, int maxCapacity);
 	~EventLoop();
 
 	// disable copying
@@ -37,14 +41,25 @@ public:
 	void exit(int code);
 
 	int registerFd(int fd, uint8_t interest, void (*cb)(void *, uint8_t), void *ctx);
-	int registerTimer(int timeout, void (*cb)(void *, uint8_t), void *ctx);
+
+	// the timer may fire up to slack msecs late, to share a wakeup with
+	// other timers
+	int registerTimer(int timeout, void (*cb)(void *, uint8_t), void *ctx, int slack = 0);
+
 	std::tuple<int, std::unique_ptr<Event::SetReadiness>> registerCustom(void (*cb)(void *, uint8_t), void *ctx);
 	void deregister(int id);
 
 	static EventLoop *instance();
 
+	// watch fds with io_uring instead of epoll, when available. applies to
+	// event loops created afterwards
+	static void setIoUringEnabled(bool on);
+
 private:
+	class Instrumentation;
+
 	ffi::EventLoopRaw *inner_;
+	std::unique_ptr<Instrumentation> instr_;
 };
 
 #endif
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+use crate::core::capacity::Capacity;
 use crate::core::event::{self, ReadinessExt};
 use crate::core::list;
 use crate::core::reactor;
@@ -25,7 +26,7 @@ use std::os::fd::RawFd;
 use std::pin::Pin;
 use std::rc::{Rc, Weak};
 use std::task::{Context, Poll, Waker};
-use std::time::Duration;
+use std::time::{Duration, Instant};
 
 pub trait Callback {
     fn call(&mut self, readiness: event::Readiness);
@@ -72,6 +73,7 @@ struct Registration<C> {
 
 struct RegistrationsData<C> {
     nodes: Slab<list::Node<Registration<C>>>,
+    capacity: Capacity,
     activated: list::List,
     waker: Option<Waker>,
 }
@@ -84,10 +86,11 @@ struct Registrations<C> {
 }
 
 impl<C: Callback> Registrations<C> {
-    fn new(capacity: usize) -> Self {
+    fn new(capacity: Capacity) -> Self {
         Self {
             data: RefCell::new(RegistrationsData {
-                nodes: Slab::with_capacity(capacity),
+                nodes: capacity.new_slab(),
+                capacity,
                 activated: list::List::default(),
                 waker: None,
             }),
@@ -107,7 +110,7 @@ impl<C: Callback> Registrations<C> {
     {
         let data = &mut *self.data.borrow_mut();
 
-        if data.nodes.len() == data.nodes.capacity() {
+        if !data.capacity.reserve(&mut data.nodes) {
             return Err(RegistrationsError);
         }
 
@@ -255,10 +258,13 @@ impl<C: Callback> waker::RcWake for Activator<C> {
 #[derive(Debug)]
 pub struct EventLoopError;
 
+type IterationCallback = Box<dyn FnMut(Duration)>;
+
 pub struct EventLoop<C> {
     reactor: reactor::Reactor,
     exit_code: Cell<Option<i32>>,
     regs: Rc<Registrations<C>>,
+    iteration_callback: RefCell<Option<IterationCallback>>,
 }
 
 impl<C: Callback> EventLoop<C> {
@@ -266,17 +272,22 @@ impl<C: Callback> EventLoop<C> {
     // one already exists, registrations_max should be <= the max configured
     // in the reactor.
     pub fn new(registrations_max: usize) -> Self {
+        Self::new_with_capacity(Capacity::fixed(registrations_max))
+    }
+
+    pub fn new_with_capacity(capacity: Capacity) -> Self {
         let reactor = if let Some(reactor) = reactor::Reactor::current() {
             // use existing reactor if available
             reactor
         } else {
-            reactor::Reactor::new(registrations_max)
+            reactor::Reactor::new_with_capacity(capacity)
         };
 
         Self {
             reactor,
             exit_code: Cell::new(None),
-            regs: Rc::new(Registrations::new(registrations_max)),
+            regs: Rc::new(Registrations::new(capacity)),
+            iteration_callback: RefCell::new(None),
         }
     }
 
@@ -326,7 +337,20 @@ impl<C: Callback> EventLoop<C> {
     }
 
     pub fn register_timer(&self, timeout: Duration, callback: C) -> Result<usize, EventLoopError> {
-        let expires = self.reactor.now() + timeout;
+        self.register_timer_with_slack(timeout, Duration::from_millis(0), callback)
+    }
+
+    // the timer may fire up to slack later than timeout, so that it can
+    // share a wakeup with other timers
+    pub fn register_timer_with_slack(
+        &self,
+        timeout: Duration,
+        slack: Duration,
+        callback: C,
+    ) -> Result<usize, EventLoopError> {
+        let expires = self
+            .reactor
+            .coalesce_expires(self.reactor.now() + timeout, slack);
 
         let evented = match reactor::TimerEvented::new(expires, &self.reactor) {
             Ok(evented) => evented,
@@ -392,6 +416,16 @@ impl<C: Callback> EventLoop<C> {
         self.regs.remove(id).map_err(|_| EventLoopError)
     }
 
+    // called after each iteration with the time spent dispatching, not
+    // including the time spent waiting for events. must not be changed
+    // from within the callback
+    pub fn set_iteration_callback<F>(&self, f: Option<F>)
+    where
+        F: FnMut(Duration) + 'static,
+    {
+        *self.iteration_callback.borrow_mut() = f.map(|f| Box::new(f) as IterationCallback);
+    }
+
     fn poll_and_dispatch(&self, timeout: Option<Duration>) -> Option<i32> {
         // if exit code set, do a non-blocking poll
         let timeout = if self.exit_code.get().is_some() {
@@ -401,7 +435,18 @@ impl<C: Callback> EventLoop<C> {
         };
 
         self.reactor.poll(timeout).unwrap();
-        self.regs.dispatch_activated();
+
+        if self.iteration_callback.borrow().is_some() {
+            let start = Instant::now();
+
+            self.regs.dispatch_activated();
+
+            if let Some(f) = &mut *self.iteration_callback.borrow_mut() {
+                f(start.elapsed());
+            }
+        } else {
+            self.regs.dispatch_activated();
+        }
 
         self.exit_code.get()
     }
@@ -492,6 +537,28 @@ mod ffi {
         Box::into_raw(Box::new(l))
     }
 
+    // a max of zero means unbounded
+    #[no_mangle]
+    pub extern "C" fn event_loop_create_growable(
+        initial: libc::c_uint,
+        max: libc::c_uint,
+    ) -> *mut EventLoopRaw {
+        let max = if max > 0 { Some(max as usize) } else { None };
+
+        let l = EventLoopRaw(EventLoop::new_with_capacity(Capacity::growable(
+            initial as usize,
+            max,
+        )));
+
+        Box::into_raw(Box::new(l))
+    }
+
+    // applies to event loops created afterwards
+    #[no_mangle]
+    pub extern "C" fn event_loop_set_io_uring_enabled(enabled: bool) {
+        event::set_io_uring_enabled(enabled);
+    }
+
     #[allow(clippy::missing_safety_doc)]
     #[no_mangle]
     pub unsafe extern "C" fn event_loop_destroy(l: *mut EventLoopRaw) {
@@ -534,6 +601,28 @@ mod ffi {
         l.exit(code);
     }
 
+    #[allow(clippy::missing_safety_doc)]
+    #[no_mangle]
+    pub unsafe extern "C" fn event_loop_set_iteration_callback(
+        l: *mut EventLoopRaw,
+        cb: Option<unsafe extern "C" fn(*mut libc::c_void, u64)>,
+        ctx: *mut libc::c_void,
+    ) {
+        let l = l.as_mut().unwrap();
+
+        let f = cb.map(|cb| {
+            move |elapsed: Duration| {
+                let usecs = u64::try_from(elapsed.as_micros()).unwrap_or(u64::MAX);
+
+                // SAFETY: we assume caller guarantees that the callback is
+                // safe to call until it is unset
+                unsafe { cb(ctx, usecs) };
+            }
+        });
+
+        l.set_iteration_callback(f);
+    }
+
     #[allow(clippy::missing_safety_doc)]
     #[no_mangle]
     pub unsafe extern "C" fn event_loop_register_fd(
@@ -589,6 +678,36 @@ mod ffi {
         0
     }
 
+    #[allow(clippy::missing_safety_doc)]
+    #[no_mangle]
+    pub unsafe extern "C" fn event_loop_register_timer_with_slack(
+        l: *mut EventLoopRaw,
+        timeout: u64,
+        slack: u64,
+        cb: unsafe extern "C" fn(*mut libc::c_void, u8),
+        ctx: *mut libc::c_void,
+        out_id: *mut libc::size_t,
+    ) -> libc::c_int {
+        let l = l.as_mut().unwrap();
+
+        // SAFETY: we assume caller guarantees that the callback is safe to
+        // call for the lifetime of the registration
+        let cb = unsafe { RawCallback::new(cb, ctx) };
+
+        let id = match l.register_timer_with_slack(
+            Duration::from_millis(timeout),
+            Duration::from_millis(slack),
+            cb,
+        ) {
+            Ok(id) => id,
+            Err(_) => return -1,
+        };
+
+        out_id.write(id);
+
+        0
+    }
+
     #[allow(clippy::missing_safety_doc)]
     #[no_mangle]
     pub unsafe extern "C" fn event_loop_register_custom(
@@ -665,6 +784,28 @@ mod tests {
         }
     }
 
+    #[test]
+    fn iteration_callback() {
+        let l = EventLoop::<NoopCallback>::new(1);
+
+        let count = Rc::new(Cell::new(0));
+
+        {
+            let count = Rc::clone(&count);
+
+            l.set_iteration_callback(Some(move |_elapsed| count.set(count.get() + 1)));
+        }
+
+        l.step();
+        l.step();
+        assert_eq!(count.get(), 2);
+
+        l.set_iteration_callback(None::<fn(Duration)>);
+
+        l.step();
+        assert_eq!(count.get(), 2);
+    }
+
     #[test]
     fn fd() {
         let l = Rc::new(EventLoop::<Box<dyn Callback>>::new(1));
@@ -757,6 +898,36 @@ mod tests {
         l.deregister(id).unwrap();
     }
 
+    #[test]
+    fn growable() {
+        let l = EventLoop::<NoopCallback>::new_with_capacity(Capacity::growable(1, Some(3)));
+
+        let mut ids = Vec::new();
+
+        for _ in 0..3 {
+            ids.push(
+                l.register_timer(Duration::from_millis(1000), NoopCallback)
+                    .unwrap(),
+            );
+        }
+
+        // at the max
+        assert!(l
+            .register_timer(Duration::from_millis(1000), NoopCallback)
+            .is_err());
+
+        l.deregister(ids.pop().unwrap()).unwrap();
+
+        ids.push(
+            l.register_timer(Duration::from_millis(1000), NoopCallback)
+                .unwrap(),
+        );
+
+        for id in ids {
+            l.deregister(id).unwrap();
+        }
+    }
+
     #[test]
     fn custom() {
         let l = Rc::new(EventLoop::<Box<dyn Callback>>::new(1));
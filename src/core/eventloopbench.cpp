@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include <unistd.h>
+#include <memory>
+#include <functional>
+#include <vector>
+#include <QByteArray>
+#include <QCoreApplication>
+#include "bench.h"
+#include "eventloop.h"
+#include "timer.h"
+#include "socketnotifier.h"
+#include "defercall.h"
+
+#define TIMERS_MAX 100
+
+// the same scenarios run against each loop. process() runs one pass of the
+// loop, and is called until the expected activations have been dispatched
+static void dispatch(const Bench &bench, const char *mode, const std::function<void()> &process)
+{
+	QByteArray prefix = QByteArray("eventloop/") + mode;
+
+	{
+		DeferCall deferCall;
+		int count = 0;
+
+		bench.run((prefix + "/defer").constData(), 10000, 100, [&] {
+			for(int n = 0; n < 100; ++n)
+				deferCall.defer([&count] { ++count; });
+
+			int target = count + 100;
+			while(count < target)
+				process();
+		});
+	}
+
+	{
+		std::vector<std::unique_ptr<Timer>> timers;
+		std::vector<Connection> connections;
+		int count = 0;
+
+		for(int n = 0; n < TIMERS_MAX; ++n)
+		{
+			timers.push_back(std::make_unique<Timer>());
+			timers.back()->setSingleShot(true);
+			connections.push_back(timers.back()->timeout.connect([&count] { ++count; }));
+		}
+
+		bench.run((prefix + "/timer").constData(), 1000, TIMERS_MAX, [&] {
+			for(auto &t : timers)
+				t->start(0);
+
+			int target = count + TIMERS_MAX;
+			while(count < target)
+				process();
+		});
+	}
+
+	{
+		int fds[2];
+		if(pipe(fds) != 0)
+			return;
+
+		SocketNotifier sn(fds[0], SocketNotifier::Read);
+		int count = 0;
+
+		Connection c = sn.activated.connect([&](int, uint8_t) {
+			char buf[1];
+			if(read(fds[0], buf, 1) == 1)
+				++count;
+
+			sn.clearReadiness(SocketNotifier::Read);
+		});
+
+		sn.clearReadiness(SocketNotifier::Read);
+
+		bench.run((prefix + "/fd").constData(), 10000, 1, [&] {
+			if(write(fds[1], "x", 1) != 1)
+				return;
+
+			int target = count + 1;
+			while(count < target)
+				process();
+		});
+
+		c.disconnect();
+
+		close(fds[0]);
+		close(fds[1]);
+	}
+}
+
+extern "C" void eventloop_bench(const char *filter)
+{
+	Bench bench(filter);
+
+	if(!bench.selected("eventloop/"))
+		return;
+
+	{
+		EventLoop loop(TIMERS_MAX + 100);
+
+		dispatch(bench, "new", [&] { loop.step(); });
+
+		DeferCall::cleanup();
+	}
+
+	{
+		// the qt loop needs an application instance, and the timer
+		// subsystem initialized explicitly
+		int argc = 1;
+		char arg0[] = "bench";
+		char *argv[] = {arg0, 0};
+		QCoreApplication qapp(argc, argv);
+
+		Timer::init(TIMERS_MAX);
+
+		dispatch(bench, "qt", [] { QCoreApplication::processEvents(QEventLoop::AllEvents); });
+
+		// ensure deferred deletes are processed
+		QCoreApplication::instance()->sendPostedEvents();
+
+		DeferCall::cleanup();
+
+		Timer::deinit();
+	}
+}
@@ -25,6 +25,8 @@
 #include "test.h"
 #include "defercall.h"
 #include "eventloop.h"
+#include "loopstats.h"
+#include "loopclock.h"
 #include "socketnotifier.h"
 #include "timer.h"
 
@@ -120,11 +122,118 @@ static void custom()
 	state.loop.deregister(id);
 }
 
+static void instrumented()
+{
+	LoopStats::setEnabled(true);
+
+	quint64 timerCount = LoopStats::callbackCount(LoopStats::TimerSource);
+	quint64 customCount = LoopStats::callbackCount(LoopStats::CustomSource);
+
+	{
+		// each timeout re-registers, so a single slot must be reused
+		EventLoop loop(2);
+
+		Timer t;
+
+		int timeoutCount = 0;
+
+		t.timeout.connect([&] {
+			++timeoutCount;
+			if(timeoutCount == 3)
+				loop.exit(123);
+		});
+
+		t.start(0);
+
+		TEST_ASSERT_EQ(loop.exec(), 123);
+		TEST_ASSERT_EQ(timeoutCount, 3);
+
+		auto [id, sr] = loop.registerCustom([](void *ctx, uint8_t readiness) {
+			Q_UNUSED(readiness);
+
+			((EventLoop *)ctx)->exit(124);
+		}, (void *)&loop);
+
+		TEST_ASSERT(id >= 0);
+		TEST_ASSERT_EQ(sr->setReadiness(Event::Readable), 0);
+		TEST_ASSERT_EQ(loop.exec(), 124);
+
+		loop.deregister(id);
+	}
+
+	LoopStats::setEnabled(false);
+
+	TEST_ASSERT_EQ(LoopStats::callbackCount(LoopStats::TimerSource), timerCount + 3);
+	TEST_ASSERT_EQ(LoopStats::callbackCount(LoopStats::CustomSource), customCount + 1);
+}
+
+static void loopClock()
+{
+	// without a loop, the clock is read every time
+	qint64 start = LoopClock::msecsSinceEpoch();
+	usleep(5000);
+	TEST_ASSERT(LoopClock::msecsSinceEpoch() > start);
+
+	class State
+	{
+	public:
+		EventLoop loop;
+		qint64 first;
+		qint64 second;
+		qint64 precise;
+		qint64 afterPrecise;
+
+		State() :
+			loop(EventLoop(1)),
+			first(-1),
+			second(-1),
+			precise(-1),
+			afterPrecise(-1)
+		{
+		}
+	};
+
+	State state;
+
+	auto [id, sr] = state.loop.registerCustom([](void *ctx, uint8_t readiness) {
+		Q_UNUSED(readiness);
+
+		State *state = (State *)ctx;
+
+		state->first = LoopClock::msecsSinceEpoch();
+		usleep(5000);
+		state->second = LoopClock::msecsSinceEpoch();
+		state->precise = LoopClock::preciseMSecsSinceEpoch();
+		state->afterPrecise = LoopClock::msecsSinceEpoch();
+
+		state->loop.exit(123);
+	}, (void *)&state);
+
+	TEST_ASSERT(id >= 0);
+	TEST_ASSERT_EQ(sr->setReadiness(Event::Readable), 0);
+	TEST_ASSERT_EQ(state.loop.exec(), 123);
+
+	// the time is read once per iteration, unless asked for precisely
+	TEST_ASSERT(state.first > start);
+	TEST_ASSERT_EQ(state.second, state.first);
+	TEST_ASSERT(state.precise > state.first);
+	TEST_ASSERT_EQ(state.afterPrecise, state.precise);
+
+	// the next iteration reads the clock again
+	usleep(5000);
+	state.loop.step();
+	TEST_ASSERT(LoopClock::msecsSinceEpoch() > state.precise);
+
+	state.loop.deregister(id);
+}
+
 extern "C" int eventloop_test(ffi::TestException *out_ex)
 {
 	TEST_CATCH(socketNotifier());
 	TEST_CATCH(timer());
 	TEST_CATCH(custom());
+	TEST_CATCH(instrumented());
+	TEST_CATCH(loopClock());
 
 	return 0;
 }
@@ -0,0 +1,279 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "fastsignal.h"
+
+#define SLOT_POOL_MAX 4096
+
+namespace FastSignalPrivate {
+
+namespace {
+
+class SlotPool
+{
+public:
+	Slot *first;
+	int count;
+
+	SlotPool() :
+		first(0),
+		count(0)
+	{
+	}
+
+	~SlotPool();
+};
+
+// signals may be destroyed after the pool during thread exit, so the pool's
+// state is tracked separately in a trivially destructible variable
+thread_local bool poolDestroyed = false;
+thread_local SlotPool pool;
+
+SlotPool::~SlotPool()
+{
+	while(first)
+	{
+		Slot *s = first;
+		first = s->next;
+		delete s;
+	}
+
+	poolDestroyed = true;
+}
+
+}
+
+Slot *acquireSlot()
+{
+	Slot *s;
+
+	if(!poolDestroyed && pool.first)
+	{
+		s = pool.first;
+		pool.first = s->next;
+		--pool.count;
+	}
+	else
+	{
+		s = new Slot;
+	}
+
+	s->heap = 0;
+	s->invoke = 0;
+	s->destroy = 0;
+	s->active = true;
+	s->conn = 0;
+	s->prev = 0;
+	s->next = 0;
+
+	return s;
+}
+
+void releaseSlot(Slot *s)
+{
+	if(poolDestroyed || pool.count >= SLOT_POOL_MAX)
+	{
+		delete s;
+		return;
+	}
+
+	s->next = pool.first;
+	pool.first = s;
+	++pool.count;
+}
+
+SignalBase::SignalBase() :
+	first_(0),
+	last_(0),
+	removed_(0),
+	frame_(0)
+{
+}
+
+SignalBase::~SignalBase()
+{
+	for(Slot *s = first_; s; s = s->next)
+	{
+		if(s->conn)
+		{
+			s->conn->slot_ = 0;
+			s->conn = 0;
+		}
+	}
+
+	if(frame_)
+	{
+		// a slot is still running. hand the slots to the emission, to be
+		// released once it unwinds
+		frame_->destroyed = true;
+		frame_->orphans = first_;
+		return;
+	}
+
+	Slot *s = first_;
+	while(s)
+	{
+		Slot *next = s->next;
+		dispose(s);
+		s = next;
+	}
+}
+
+bool SignalBase::empty() const
+{
+	for(Slot *s = first_; s; s = s->next)
+	{
+		if(s->active)
+			return false;
+	}
+
+	return true;
+}
+
+void SignalBase::disconnectAll()
+{
+	Slot *s = first_;
+	while(s)
+	{
+		Slot *next = s->next;
+		disconnect(s);
+		s = next;
+	}
+}
+
+void SignalBase::append(Slot *s)
+{
+	s->prev = last_;
+	s->next = 0;
+
+	if(last_)
+		last_->next = s;
+	else
+		first_ = s;
+
+	last_ = s;
+}
+
+void SignalBase::disconnect(Slot *s)
+{
+	if(!s->active)
+		return;
+
+	s->active = false;
+
+	if(s->conn)
+	{
+		s->conn->slot_ = 0;
+		s->conn = 0;
+	}
+
+	// the slot may be running, or be the position of an emission, so leave
+	// it in place until emitting is done
+	if(frame_)
+	{
+		++removed_;
+		return;
+	}
+
+	if(s->prev)
+		s->prev->next = s->next;
+	else
+		first_ = s->next;
+
+	if(s->next)
+		s->next->prev = s->prev;
+	else
+		last_ = s->prev;
+
+	dispose(s);
+}
+
+void SignalBase::beginEmit(EmitFrame *frame)
+{
+	frame->destroyed = false;
+	frame->orphans = 0;
+	frame->prev = frame_;
+	frame_ = frame;
+}
+
+void SignalBase::endEmit(EmitFrame *frame)
+{
+	frame_ = frame->prev;
+
+	if(!frame_ && removed_ > 0)
+		sweep();
+}
+
+void SignalBase::finishDestroyedEmit(EmitFrame *frame)
+{
+	if(frame->prev)
+	{
+		// an outer emission of the same signal is still running a slot
+		frame->prev->destroyed = true;
+		frame->prev->orphans = frame->orphans;
+		return;
+	}
+
+	Slot *s = frame->orphans;
+	while(s)
+	{
+		Slot *next = s->next;
+		dispose(s);
+		s = next;
+	}
+}
+
+void SignalBase::dispose(Slot *s)
+{
+	s->destroy(s);
+	releaseSlot(s);
+}
+
+void SignalBase::sweep()
+{
+	Slot *s = first_;
+	while(s)
+	{
+		Slot *next = s->next;
+
+		if(!s->active)
+		{
+			if(s->prev)
+				s->prev->next = s->next;
+			else
+				first_ = s->next;
+
+			if(s->next)
+				s->next->prev = s->prev;
+			else
+				last_ = s->prev;
+
+			dispose(s);
+		}
+
+		s = next;
+	}
+
+	removed_ = 0;
+}
+
+}
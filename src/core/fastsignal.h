@@ -0,0 +1,340 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef FASTSIGNAL_H
+#define FASTSIGNAL_H
+
+#include <assert.h>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <boost/signals2.hpp>
+
+class Connection;
+
+namespace FastSignalPrivate {
+
+// a connected slot. slots are owned by their signal and recycled through a
+// per-thread pool, so connecting does not allocate in the steady state
+class Slot
+{
+public:
+	static const std::size_t StorageSize = 48;
+
+	alignas(std::max_align_t) unsigned char storage[StorageSize];
+	void *heap; // set if the callable didn't fit in storage
+	void (*invoke)(); // cast to the signal's invoker type before calling
+	void (*destroy)(Slot *s);
+	bool active;
+	Connection *conn;
+	Slot *prev;
+	Slot *next;
+
+	template <typename F>
+	F *callable()
+	{
+		return heap ? static_cast<F*>(heap) : reinterpret_cast<F*>(storage);
+	}
+
+	template <typename F>
+	void set(F &&f)
+	{
+		typedef typename std::decay<F>::type T;
+
+		if constexpr(sizeof(T) <= StorageSize && alignof(T) <= alignof(std::max_align_t))
+		{
+			new(storage) T(std::forward<F>(f));
+			heap = 0;
+			destroy = [](Slot *s) { s->callable<T>()->~T(); };
+		}
+		else
+		{
+			heap = new T(std::forward<F>(f));
+			destroy = [](Slot *s) { delete s->callable<T>(); };
+		}
+	}
+};
+
+Slot *acquireSlot();
+void releaseSlot(Slot *s);
+
+class EmitFrame
+{
+public:
+	bool destroyed;
+	Slot *orphans; // slots of a signal destroyed while emitting
+	EmitFrame *prev;
+};
+
+class SignalBase
+{
+public:
+	SignalBase(const SignalBase &) = delete;
+	SignalBase & operator=(const SignalBase &) = delete;
+
+	bool empty() const;
+
+	void disconnectAll();
+
+protected:
+	Slot *first_;
+	Slot *last_;
+	int removed_;
+	EmitFrame *frame_;
+
+	SignalBase();
+	~SignalBase();
+
+	void append(Slot *s);
+	void disconnect(Slot *s);
+
+	void beginEmit(EmitFrame *frame);
+	void endEmit(EmitFrame *frame);
+	static void finishDestroyedEmit(EmitFrame *frame);
+
+private:
+	friend class ::Connection;
+
+	static void dispose(Slot *s);
+	void sweep();
+};
+
+}
+
+// handle returned by FastSignal::connect. assign it to a Connection to be
+// able to disconnect, or drop it to stay connected for the life of the
+// signal. it must not be kept around
+class SlotRef
+{
+public:
+	SlotRef(SlotRef &&other) :
+		signal_(other.signal_),
+		slot_(other.slot_)
+	{
+		other.slot_ = 0;
+	}
+
+	SlotRef(const SlotRef &) = delete;
+	SlotRef & operator=(const SlotRef &) = delete;
+
+private:
+	template <typename... Args> friend class FastSignal;
+	friend class Connection;
+
+	FastSignalPrivate::SignalBase *signal_;
+	FastSignalPrivate::Slot *slot_;
+
+	SlotRef(FastSignalPrivate::SignalBase *signal, FastSignalPrivate::Slot *slot) :
+		signal_(signal),
+		slot_(slot)
+	{
+	}
+};
+
+// a single-threaded signal for hot paths. unlike boost::signals2 it does not
+// lock or allocate when connecting and emitting. slots may be disconnected,
+// and the signal may be destroyed, from within a slot. slots connected
+// during an emission are called starting with the next emission
+template <typename... Args>
+class FastSignal : public FastSignalPrivate::SignalBase
+{
+public:
+	FastSignal() = default;
+
+	template <typename F>
+	SlotRef connect(F &&f)
+	{
+		typedef typename std::decay<F>::type T;
+
+		FastSignalPrivate::Slot *s = FastSignalPrivate::acquireSlot();
+		s->set(std::forward<F>(f));
+		s->invoke = reinterpret_cast<void (*)()>(&invokeSlot<T>);
+		append(s);
+
+		return SlotRef(this, s);
+	}
+
+	void operator()(Args... args)
+	{
+		if(!first_)
+			return;
+
+		FastSignalPrivate::EmitFrame frame;
+		beginEmit(&frame);
+
+		// slots appended from here on are not part of this emission
+		FastSignalPrivate::Slot *end = last_;
+
+		for(FastSignalPrivate::Slot *s = first_;; s = s->next)
+		{
+			if(s->active)
+			{
+				reinterpret_cast<Invoker>(s->invoke)(s, args...);
+
+				if(frame.destroyed)
+				{
+					finishDestroyedEmit(&frame);
+					return;
+				}
+			}
+
+			if(s == end)
+				break;
+		}
+
+		endEmit(&frame);
+	}
+
+private:
+	typedef void (*Invoker)(FastSignalPrivate::Slot *s, Args... args);
+
+	template <typename T>
+	static void invokeSlot(FastSignalPrivate::Slot *s, Args... args)
+	{
+		(*s->callable<T>())(args...);
+	}
+};
+
+// disconnects on destruction, like boost::signals2::scoped_connection. it
+// can hold a connection to either a FastSignal or a boost signal, so it can
+// be used regardless of the kind of signal
+class Connection
+{
+public:
+	Connection() :
+		signal_(0),
+		slot_(0)
+	{
+	}
+
+	Connection(const boost::signals2::connection &c) :
+		boost_(c),
+		signal_(0),
+		slot_(0)
+	{
+	}
+
+	Connection(SlotRef &&ref) :
+		signal_(0),
+		slot_(0)
+	{
+		adopt(std::move(ref));
+	}
+
+	Connection(Connection &&other) :
+		signal_(0),
+		slot_(0)
+	{
+		take(other);
+	}
+
+	~Connection()
+	{
+		disconnect();
+	}
+
+	Connection(const Connection &) = delete;
+	Connection & operator=(const Connection &) = delete;
+
+	Connection & operator=(Connection &&other)
+	{
+		if(&other != this)
+		{
+			disconnect();
+			take(other);
+		}
+
+		return *this;
+	}
+
+	Connection & operator=(const boost::signals2::connection &c)
+	{
+		disconnect();
+		boost_ = c;
+
+		return *this;
+	}
+
+	Connection & operator=(SlotRef &&ref)
+	{
+		disconnect();
+		adopt(std::move(ref));
+
+		return *this;
+	}
+
+	bool connected() const
+	{
+		return slot_ || boost_.connected();
+	}
+
+	void disconnect()
+	{
+		if(slot_)
+		{
+			FastSignalPrivate::Slot *s = slot_;
+			slot_ = 0;
+			s->conn = 0;
+
+			signal_->disconnect(s);
+		}
+
+		if(boost_.connected())
+			boost_.disconnect();
+	}
+
+private:
+	friend class FastSignalPrivate::SignalBase;
+
+	boost::signals2::connection boost_;
+	FastSignalPrivate::SignalBase *signal_;
+	FastSignalPrivate::Slot *slot_;
+
+	void adopt(SlotRef &&ref)
+	{
+		if(!ref.slot_)
+			return;
+
+		assert(!ref.slot_->conn);
+
+		signal_ = ref.signal_;
+		slot_ = ref.slot_;
+		slot_->conn = this;
+		ref.slot_ = 0;
+	}
+
+	void take(Connection &other)
+	{
+		boost_ = other.boost_;
+		other.boost_ = boost::signals2::connection();
+
+		signal_ = other.signal_;
+		slot_ = other.slot_;
+		other.slot_ = 0;
+
+		if(slot_)
+			slot_->conn = this;
+	}
+};
+
+#endif
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include <boost/signals2.hpp>
+#include <boost/bind/bind.hpp>
+#include "bench.h"
+#include "fastsignal.h"
+
+class Receiver
+{
+public:
+	int count;
+
+	Receiver() :
+		count(0)
+	{
+	}
+
+	void onReady() { ++count; }
+};
+
+extern "C" void fastsignal_bench(const char *filter)
+{
+	Bench bench(filter);
+
+	if(!bench.selected("fastsignal/"))
+		return;
+
+	Receiver r;
+
+	{
+		boost::signals2::signal<void()> sig;
+		Connection c = sig.connect(boost::bind(&Receiver::onReady, &r));
+
+		bench.run("fastsignal/emit-signals2", 100000, 100, [&] {
+			for(int n = 0; n < 100; ++n)
+				sig();
+		});
+	}
+
+	{
+		FastSignal<> sig;
+		Connection c = sig.connect(boost::bind(&Receiver::onReady, &r));
+
+		bench.run("fastsignal/emit-fast", 100000, 100, [&] {
+			for(int n = 0; n < 100; ++n)
+				sig();
+		});
+	}
+
+	// a connection per request, made and dropped as the request comes and
+	// goes
+	{
+		boost::signals2::signal<void()> sig;
+
+		bench.run("fastsignal/connect-signals2", 100000, 1, [&] {
+			Connection c = sig.connect(boost::bind(&Receiver::onReady, &r));
+			sig();
+		});
+	}
+
+	{
+		FastSignal<> sig;
+
+		bench.run("fastsignal/connect-fast", 100000, 1, [&] {
+			Connection c = sig.connect(boost::bind(&Receiver::onReady, &r));
+			sig();
+		});
+	}
+}
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include <memory>
+#include <boost/bind/bind.hpp>
+#include "test.h"
+#include "fastsignal.h"
+
+class Counter
+{
+public:
+	int count;
+
+	Counter() :
+		count(0)
+	{
+	}
+
+	void add(int n) { count += n; }
+};
+
+static void connectEmit()
+{
+	FastSignal<int> sig;
+	Counter a, b;
+
+	// unheld connections stay connected for the life of the signal
+	sig.connect(boost::bind(&Counter::add, &a, boost::placeholders::_1));
+
+	{
+		Connection c = sig.connect(boost::bind(&Counter::add, &b, boost::placeholders::_1));
+		TEST_ASSERT(c.connected());
+
+		sig(2);
+		TEST_ASSERT_EQ(a.count, 2);
+		TEST_ASSERT_EQ(b.count, 2);
+	}
+
+	sig(3);
+	TEST_ASSERT_EQ(a.count, 5);
+	TEST_ASSERT_EQ(b.count, 2);
+
+	sig.disconnectAll();
+	TEST_ASSERT(sig.empty());
+
+	sig(1);
+	TEST_ASSERT_EQ(a.count, 5);
+}
+
+static void disconnectDuringEmit()
+{
+	FastSignal<> sig;
+	int first = 0;
+	int second = 0;
+	Connection c1, c2;
+
+	c1 = sig.connect([&] {
+		++first;
+		c1.disconnect();
+		c2.disconnect();
+	});
+	c2 = sig.connect([&] { ++second; });
+
+	sig();
+	sig();
+
+	TEST_ASSERT_EQ(first, 1);
+	TEST_ASSERT_EQ(second, 0);
+	TEST_ASSERT(sig.empty());
+
+	// slots connected during an emission wait for the next one
+	int later = 0;
+	Connection c3 = sig.connect([&] {
+		if(!c2.connected())
+			c2 = sig.connect([&] { ++later; });
+	});
+
+	sig();
+	TEST_ASSERT_EQ(later, 0);
+
+	sig();
+	TEST_ASSERT_EQ(later, 1);
+}
+
+static void destroyDuringEmit()
+{
+	FastSignal<> *sig = new FastSignal<>;
+	int calls = 0;
+
+	// capture enough to not fit in the inline storage
+	std::shared_ptr<int> held = std::make_shared<int>(0);
+	char pad[64] = {0};
+
+	Connection c = sig->connect([&calls, &sig, held, pad] {
+		++calls;
+		delete sig;
+		sig = 0;
+		Q_UNUSED(pad);
+	});
+	sig->connect([&] { ++calls; });
+
+	TEST_ASSERT_EQ(held.use_count(), 2);
+
+	(*sig)();
+
+	TEST_ASSERT_EQ(calls, 1);
+	TEST_ASSERT(!sig);
+	TEST_ASSERT(!c.connected());
+	TEST_ASSERT_EQ(held.use_count(), 1);
+
+	// connection outliving its signal is harmless
+	c.disconnect();
+}
+
+static void moveConnection()
+{
+	FastSignal<> sig;
+	int calls = 0;
+	Connection outer;
+
+	{
+		Connection c = sig.connect([&] { ++calls; });
+		outer = std::move(c);
+		TEST_ASSERT(!c.connected());
+	}
+
+	sig();
+	TEST_ASSERT_EQ(calls, 1);
+
+	outer.disconnect();
+	sig();
+	TEST_ASSERT_EQ(calls, 1);
+}
+
+static void boostConnection()
+{
+	boost::signals2::signal<void()> sig;
+	int calls = 0;
+
+	{
+		Connection c = sig.connect([&] { ++calls; });
+		sig();
+	}
+
+	sig();
+	TEST_ASSERT_EQ(calls, 1);
+}
+
+extern "C" int fastsignal_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(connectEmit());
+	TEST_CATCH(disconnectDuringEmit());
+	TEST_CATCH(destroyDuringEmit());
+	TEST_CATCH(moveConnection());
+	TEST_CATCH(boostConnection());
+
+	return 0;
+}
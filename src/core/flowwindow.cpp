@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "flowwindow.h"
+
+#include "memorybudget.h"
+
+static std::atomic<qint64> g_budget(0);
+static std::atomic<qint64> g_buffered(0);
+
+static std::atomic<qint64> *threadBuffered()
+{
+	static thread_local std::atomic<qint64> buffered(0);
+
+	return &buffered;
+}
+
+FlowWindow::FlowWindow() :
+	size_(BaseSize),
+	sinceResize_(0),
+	debt_(0)
+{
+}
+
+int FlowWindow::consumed(int bytes, bool drained)
+{
+	int credits = bytes;
+	sinceResize_ += bytes;
+
+	qint64 budget = g_budget.load(std::memory_order_relaxed);
+
+	if((budget > 0 && g_buffered.load(std::memory_order_relaxed) > budget) || MemoryBudget::exceeded())
+	{
+		if(size_ > BaseSize)
+		{
+			int newSize = qMax((int)BaseSize, size_ / 2);
+			debt_ += size_ - newSize;
+			size_ = newSize;
+			sinceResize_ = 0;
+		}
+	}
+	else if(drained && sinceResize_ >= size_ && size_ < MaxSize)
+	{
+		int newSize = qMin((int)MaxSize, size_ * 2);
+		credits += newSize - size_;
+		size_ = newSize;
+		sinceResize_ = 0;
+	}
+
+	// a shrunk window is paid for out of credits that would otherwise be
+	// returned to the sender
+	int pay = qMin(debt_, credits);
+	debt_ -= pay;
+	credits -= pay;
+
+	return credits;
+}
+
+void FlowWindow::setMemoryBudget(qint64 bytes)
+{
+	g_budget = bytes;
+}
+
+qint64 FlowWindow::bufferedBytes()
+{
+	return g_buffered.load(std::memory_order_relaxed);
+}
+
+void FlowWindow::addBuffered(int bytes)
+{
+	g_buffered.fetch_add(bytes, std::memory_order_relaxed);
+	threadBuffered()->fetch_add(bytes, std::memory_order_relaxed);
+
+	MemoryBudget::charge(MemoryBudget::Streams, bytes);
+}
+
+const std::atomic<qint64> *FlowWindow::threadBufferedBytes()
+{
+	return threadBuffered();
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef FLOWWINDOW_H
+#define FLOWWINDOW_H
+
+#include <atomic>
+#include <QtGlobal>
+
+// adaptive receive window for a zhttp stream. the window starts at the
+// base size and doubles whenever the reader drains a full window without
+// falling behind, which means the sender was waiting on credits. while
+// the process buffers more than the memory budget, windows shrink back
+// toward the base by withholding credits. the same happens while the
+// process-wide MemoryBudget is exceeded
+class FlowWindow
+{
+public:
+	enum
+	{
+		BaseSize = 200000,
+		MaxSize = 3200000
+	};
+
+	FlowWindow();
+
+	int size() const { return size_; }
+
+	// returns the credits to grant after the reader consumed bytes.
+	// drained is whether the reader emptied its buffer
+	int consumed(int bytes, bool drained);
+
+	// bytes received but not yet read, across all streams. a budget of
+	// zero means unlimited
+	static void setMemoryBudget(qint64 bytes);
+	static qint64 bufferedBytes();
+	static void addBuffered(int bytes);
+
+	// same, for streams on the calling thread only. the counter lives as
+	// long as the thread, for exporting as a gauge
+	static const std::atomic<qint64> *threadBufferedBytes();
+
+private:
+	int size_;
+	int sinceResize_;
+	int debt_;
+};
+
+#endif
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "test.h"
+#include "flowwindow.h"
+
+static void grow()
+{
+	FlowWindow w;
+	TEST_ASSERT_EQ(w.size(), (int)FlowWindow::BaseSize);
+
+	// reading without draining does not grow the window
+	TEST_ASSERT_EQ(w.consumed(FlowWindow::BaseSize, false), (int)FlowWindow::BaseSize);
+	TEST_ASSERT_EQ(w.size(), (int)FlowWindow::BaseSize);
+
+	// draining after a full window doubles it, granting the difference
+	TEST_ASSERT_EQ(w.consumed(1000, true), 1000 + (int)FlowWindow::BaseSize);
+	TEST_ASSERT_EQ(w.size(), (int)FlowWindow::BaseSize * 2);
+
+	// the window never exceeds the max
+	for(int n = 0; n < 10; ++n)
+		w.consumed(FlowWindow::MaxSize, true);
+	TEST_ASSERT_EQ(w.size(), (int)FlowWindow::MaxSize);
+}
+
+static void shrink()
+{
+	FlowWindow w;
+	w.consumed(FlowWindow::BaseSize, true);
+	TEST_ASSERT_EQ(w.size(), (int)FlowWindow::BaseSize * 2);
+
+	FlowWindow::setMemoryBudget(1);
+	FlowWindow::addBuffered(2);
+
+	// over budget, the window halves and the difference is withheld
+	TEST_ASSERT_EQ(w.consumed(150000, false), 0);
+	TEST_ASSERT_EQ(w.size(), (int)FlowWindow::BaseSize);
+	TEST_ASSERT_EQ(w.consumed(100000, false), 50000);
+
+	// never below the base
+	TEST_ASSERT_EQ(w.consumed(1000, true), 1000);
+	TEST_ASSERT_EQ(w.size(), (int)FlowWindow::BaseSize);
+
+	FlowWindow::addBuffered(-2);
+	FlowWindow::setMemoryBudget(0);
+
+	TEST_ASSERT_EQ((int)FlowWindow::bufferedBytes(), 0);
+	TEST_ASSERT_EQ((int)FlowWindow::threadBufferedBytes()->load(), 0);
+}
+
+extern "C" int flowwindow_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(grow());
+	TEST_CATCH(shrink());
+
+	return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "gzip.h"
+
+#include "rust/bindings.h"
+
+namespace Gzip {
+
+void Stream::add(const Run &run)
+{
+	crc_ = ffi::gzip_crc32_combine(crc_, run.crc, run.size);
+	size_ += run.size;
+}
+
+QByteArray Stream::trailer() const
+{
+	return Gzip::trailer(crc_, size_);
+}
+
+Run deflate(const QByteArray &data)
+{
+	Run run;
+
+	QByteArray out(ffi::gzip_deflate_run_bound(data.size()), 0);
+
+	ssize_t size = ffi::gzip_deflate_run((const quint8 *)data.constData(), data.size(), (quint8 *)out.data(), out.size());
+	if(size < 0)
+		return run;
+
+	out.truncate(size);
+
+	run.data = out;
+	run.crc = ffi::gzip_crc32(0, (const quint8 *)data.constData(), data.size());
+	run.size = data.size();
+
+	return run;
+}
+
+QByteArray header()
+{
+	// magic, deflate method, no flags, no mtime, no extra flags, unknown os
+	static const char h[] = { '\x1f', '\x8b', 8, 0, 0, 0, 0, 0, 0, '\xff' };
+
+	return QByteArray(h, sizeof(h));
+}
+
+QByteArray trailer(quint32 crc, qint64 size)
+{
+	QByteArray out(10, 0);
+	char *p = out.data();
+
+	// final block with fixed codes, containing only the end of block code
+	p[0] = 0x03;
+	p[1] = 0x00;
+
+	quint32 isize = (quint32)size; // the size modulo 2^32
+
+	for(int n = 0; n < 4; ++n)
+	{
+		p[2 + n] = (char)((crc >> (n * 8)) & 0xff);
+		p[6 + n] = (char)((isize >> (n * 8)) & 0xff);
+	}
+
+	return out;
+}
+
+QByteArray member(const Run &run)
+{
+	return header() + run.data + trailer(run.crc, run.size);
+}
+
+bool accepted(const HttpHeaders &requestHeaders)
+{
+	bool any = false;
+
+	// this is checked for every response, so read the values in place
+	// rather than parsing them into lists
+	HttpHeaderValueReader values(requestHeaders, "Accept-Encoding");
+	HttpHeaderView value;
+	while(values.next(&value))
+	{
+		HttpHeaderParameterReader params(value, HttpHeaders::ParseAllParameters);
+		if(!params.next())
+			continue;
+
+		HttpHeaderView coding = params.key();
+
+		bool haveQ = false;
+		QByteArray q;
+		while(params.next())
+		{
+			if(!haveQ && params.key().equalsIgnoreCase("q"))
+			{
+				q = params.valueUnescaped();
+				haveQ = true;
+			}
+		}
+
+		// malformed values are ignored entirely
+		if(params.isError())
+			continue;
+
+		bool allowed = true;
+		if(haveQ)
+		{
+			bool ok;
+			double qval = q.toDouble(&ok);
+			allowed = (ok && qval > 0);
+		}
+
+		// an explicit entry for gzip overrides a wildcard
+		if(coding.equalsIgnoreCase("gzip") || coding.equalsIgnoreCase("x-gzip"))
+			return allowed;
+		else if(coding == "*")
+			any = allowed;
+	}
+
+	return any;
+}
+
+}
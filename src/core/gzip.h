@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef GZIP_H
+#define GZIP_H
+
+#include <QByteArray>
+#include "httpheaders.h"
+
+// gzip encoding of content that is sent to many clients. data is
+// compressed into runs of deflate blocks that each end on a full flush, so
+// a run can be compressed once and then placed into any number of streams,
+// each made of a header, any sequence of runs, and a trailer
+namespace Gzip {
+
+class Run
+{
+public:
+	QByteArray data; // null if compression failed
+	quint32 crc; // of the uncompressed data
+	qint64 size; // of the uncompressed data
+
+	Run() :
+		crc(0),
+		size(0)
+	{
+	}
+};
+
+// keeps the checksum of the runs written to a stream
+class Stream
+{
+public:
+	Stream() :
+		crc_(0),
+		size_(0)
+	{
+	}
+
+	void add(const Run &run);
+	QByteArray trailer() const;
+
+private:
+	quint32 crc_;
+	qint64 size_;
+};
+
+Run deflate(const QByteArray &data);
+
+QByteArray header();
+
+// a final empty block, followed by the checksum and size of all the data
+QByteArray trailer(quint32 crc, qint64 size);
+
+// a complete stream holding a single run
+QByteArray member(const Run &run);
+
+// whether the request headers allow a gzip encoded response
+bool accepted(const HttpHeaders &requestHeaders);
+
+}
+
+#endif
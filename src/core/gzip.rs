@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// gzip building blocks for compressing published content once and sending
+// the result to many clients. data is compressed into self-contained runs
+// of deflate blocks that end on a full flush, so runs can be concatenated
+// in any order to form a stream. the gzip framing is left to the caller
+
+use miniz_oxide::deflate::core::{compress, create_comp_flags_from_zip_params, CompressorOxide};
+use miniz_oxide::deflate::core::{TDEFLFlush, TDEFLStatus};
+use miniz_oxide::deflate::CompressionLevel;
+
+const CRC_TABLE: [u32; 256] = {
+    let mut table = [0; 256];
+
+    let mut n = 0;
+    while n < 256 {
+        let mut c = n as u32;
+
+        let mut k = 0;
+        while k < 8 {
+            c = if c & 1 != 0 {
+                0xedb88320 ^ (c >> 1)
+            } else {
+                c >> 1
+            };
+            k += 1;
+        }
+
+        table[n] = c;
+        n += 1;
+    }
+
+    table
+};
+
+pub fn crc32(crc: u32, data: &[u8]) -> u32 {
+    let mut c = !crc;
+
+    for b in data {
+        c = CRC_TABLE[((c ^ *b as u32) & 0xff) as usize] ^ (c >> 8);
+    }
+
+    !c
+}
+
+fn gf2_matrix_times(mat: &[u32; 32], mut vec: u32) -> u32 {
+    let mut sum = 0;
+
+    let mut i = 0;
+    while vec != 0 {
+        if vec & 1 != 0 {
+            sum ^= mat[i];
+        }
+
+        vec >>= 1;
+        i += 1;
+    }
+
+    sum
+}
+
+fn gf2_matrix_square(square: &mut [u32; 32], mat: &[u32; 32]) {
+    for n in 0..32 {
+        square[n] = gf2_matrix_times(mat, mat[n]);
+    }
+}
+
+// crc of the concatenation of two runs of data, given the crc of each and
+// the length of the second. see crc32_combine() in zlib
+pub fn crc32_combine(mut crc1: u32, crc2: u32, mut len2: u64) -> u32 {
+    if len2 == 0 {
+        return crc1;
+    }
+
+    let mut even = [0; 32];
+    let mut odd = [0; 32];
+
+    // operator for one zero bit
+    odd[0] = 0xedb88320;
+    let mut row = 1;
+    for v in odd.iter_mut().skip(1) {
+        *v = row;
+        row <<= 1;
+    }
+
+    // operators for two and four zero bits
+    gf2_matrix_square(&mut even, &odd);
+    gf2_matrix_square(&mut odd, &even);
+
+    // apply len2 zero bytes to crc1
+    loop {
+        gf2_matrix_square(&mut even, &odd);
+        if len2 & 1 != 0 {
+            crc1 = gf2_matrix_times(&even, crc1);
+        }
+        len2 >>= 1;
+
+        if len2 == 0 {
+            break;
+        }
+
+        gf2_matrix_square(&mut odd, &even);
+        if len2 & 1 != 0 {
+            crc1 = gf2_matrix_times(&odd, crc1);
+        }
+        len2 >>= 1;
+
+        if len2 == 0 {
+            break;
+        }
+    }
+
+    crc1 ^ crc2
+}
+
+// the most a run of data can grow, allowing for stored blocks and the
+// flush marker
+pub fn deflate_run_bound(len: usize) -> usize {
+    len + (len >> 3) + 64
+}
+
+// compresses data into deflate blocks, none of them final, ending with a
+// full flush. returns the number of bytes written, or None if dest is too
+// small
+pub fn deflate_run(src: &[u8], dest: &mut [u8]) -> Option<usize> {
+    let mut enc = Box::new(CompressorOxide::new(create_comp_flags_from_zip_params(
+        CompressionLevel::DefaultLevel as i32,
+        -15,
+        0,
+    )));
+
+    let (status, read, written) = compress(&mut enc, src, dest, TDEFLFlush::Full);
+
+    if status != TDEFLStatus::Okay || read != src.len() || written == dest.len() {
+        // if the output was filled, there may be more pending
+        return None;
+    }
+
+    Some(written)
+}
+
+mod ffi {
+    use std::slice;
+
+    #[allow(clippy::missing_safety_doc)]
+    #[no_mangle]
+    pub unsafe extern "C" fn gzip_crc32(crc: u32, data: *const u8, len: libc::size_t) -> u32 {
+        if data.is_null() {
+            return crc;
+        }
+
+        super::crc32(crc, slice::from_raw_parts(data, len))
+    }
+
+    #[no_mangle]
+    pub extern "C" fn gzip_crc32_combine(crc1: u32, crc2: u32, len2: u64) -> u32 {
+        super::crc32_combine(crc1, crc2, len2)
+    }
+
+    #[no_mangle]
+    pub extern "C" fn gzip_deflate_run_bound(len: libc::size_t) -> libc::size_t {
+        super::deflate_run_bound(len)
+    }
+
+    // returns the number of bytes written, or -1 on error
+    #[allow(clippy::missing_safety_doc)]
+    #[no_mangle]
+    pub unsafe extern "C" fn gzip_deflate_run(
+        src: *const u8,
+        src_len: libc::size_t,
+        dest: *mut u8,
+        dest_len: libc::size_t,
+    ) -> libc::ssize_t {
+        if (src.is_null() && src_len > 0) || dest.is_null() {
+            return -1;
+        }
+
+        let src = if src_len > 0 {
+            slice::from_raw_parts(src, src_len)
+        } else {
+            &[]
+        };
+
+        let dest = slice::from_raw_parts_mut(dest, dest_len);
+
+        match super::deflate_run(src, dest) {
+            Some(size) => size as libc::ssize_t,
+            None => -1,
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use miniz_oxide::inflate::decompress_to_vec;
+
+    fn run(data: &[u8]) -> Vec<u8> {
+        let mut out = vec![0; deflate_run_bound(data.len())];
+        let size = deflate_run(data, &mut out).unwrap();
+        out.truncate(size);
+
+        out
+    }
+
+    #[test]
+    fn crc() {
+        assert_eq!(crc32(0, b""), 0);
+        assert_eq!(crc32(0, b"123456789"), 0xcbf43926);
+        assert_eq!(crc32(crc32(0, b"12345"), b"6789"), 0xcbf43926);
+    }
+
+    #[test]
+    fn crc_combine() {
+        let a = b"hello ";
+        let b = b"world, this is a longer second part";
+
+        let mut ab = Vec::new();
+        ab.extend_from_slice(a);
+        ab.extend_from_slice(b);
+
+        assert_eq!(
+            crc32_combine(crc32(0, a), crc32(0, b), b.len() as u64),
+            crc32(0, &ab)
+        );
+
+        assert_eq!(crc32_combine(crc32(0, a), 0, 0), crc32(0, a));
+    }
+
+    #[test]
+    fn runs() {
+        let a = b"hello hello hello hello";
+        let b: Vec<u8> = (0..10000).map(|i| (i % 251) as u8).collect();
+
+        // runs are independent, so they can be joined in any order
+        for parts in [vec![&a[..], &b[..]], vec![&b[..], &a[..]], vec![&b[..0]]] {
+            let mut stream = Vec::new();
+            let mut expected = Vec::new();
+
+            for p in &parts {
+                stream.extend(run(p));
+                expected.extend_from_slice(p);
+            }
+
+            // final empty fixed block
+            stream.extend_from_slice(&[0x03, 0x00]);
+
+            assert_eq!(decompress_to_vec(&stream).unwrap(), expected);
+        }
+    }
+
+    #[test]
+    fn run_dest_too_small() {
+        let data: Vec<u8> = (0..1000).map(|i| (i * 7919 % 256) as u8).collect();
+        let mut out = [0; 16];
+
+        assert_eq!(deflate_run(&data, &mut out), None);
+    }
+}
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "test.h"
+#include "gzip.h"
+
+static HttpHeaders acceptEncoding(const QByteArray &value)
+{
+	HttpHeaders h;
+	h += HttpHeader("Accept-Encoding", value);
+	return h;
+}
+
+static void accepted()
+{
+	TEST_ASSERT(!Gzip::accepted(HttpHeaders()));
+	TEST_ASSERT(Gzip::accepted(acceptEncoding("gzip")));
+	TEST_ASSERT(Gzip::accepted(acceptEncoding("deflate, GZIP;q=0.5")));
+	TEST_ASSERT(Gzip::accepted(acceptEncoding("*")));
+	TEST_ASSERT(!Gzip::accepted(acceptEncoding("br, deflate")));
+	TEST_ASSERT(!Gzip::accepted(acceptEncoding("gzip;q=0")));
+
+	// an explicit entry overrides the wildcard
+	TEST_ASSERT(!Gzip::accepted(acceptEncoding("*, gzip;q=0")));
+	TEST_ASSERT(Gzip::accepted(acceptEncoding("*;q=0, gzip")));
+}
+
+static void framing()
+{
+	QByteArray h = Gzip::header();
+	TEST_ASSERT_EQ(h.size(), 10);
+	TEST_ASSERT_EQ((quint8)h[0], 0x1f);
+	TEST_ASSERT_EQ((quint8)h[1], 0x8b);
+	TEST_ASSERT_EQ((quint8)h[2], 8);
+
+	QByteArray t = Gzip::trailer(0x04030201, 0x108070605LL);
+	TEST_ASSERT_EQ(t, QByteArray("\x03\x00\x01\x02\x03\x04\x05\x06\x07\x08", 10));
+
+	Gzip::Run run = Gzip::deflate("hello hello hello");
+	TEST_ASSERT(!run.data.isNull());
+	TEST_ASSERT_EQ(run.size, 17);
+
+	QByteArray m = Gzip::member(run);
+	TEST_ASSERT_EQ(m, h + run.data + Gzip::trailer(run.crc, run.size));
+}
+
+static void stream()
+{
+	Gzip::Stream s;
+	s.add(Gzip::deflate("hello "));
+	s.add(Gzip::deflate("world"));
+
+	// the checksum covers all runs, as if compressed together
+	Gzip::Run whole = Gzip::deflate("hello world");
+	TEST_ASSERT_EQ(s.trailer(), Gzip::trailer(whole.crc, whole.size));
+
+	TEST_ASSERT_EQ(Gzip::Stream().trailer(), Gzip::trailer(0, 0));
+}
+
+extern "C" int gzip_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(accepted());
+	TEST_CATCH(framing());
+	TEST_CATCH(stream());
+
+	return 0;
+}
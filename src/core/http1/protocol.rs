@@ -51,32 +51,38 @@ fn parse_as_int(src: &[u8]) -> Result<usize, io::Error> {
     Ok(x)
 }
 
-fn header_contains_param(value: &[u8], param: &[u8], ignore_case: bool) -> bool {
-    let param_str = str::from_utf8(param);
-    let param_str = match param_str {
-        Ok(param_str) => param_str,
-        Err(_) => {
-            return false;
+fn trim_ascii_whitespace(mut s: &[u8]) -> &[u8] {
+    while let [first, rest @ ..] = s {
+        if !first.is_ascii_whitespace() {
+            break;
         }
-    };
 
-    for part in value.split(|b| *b == b',') {
-        let part_str = str::from_utf8(part);
-        let part_str = match part_str {
-            Ok(part_str) => part_str,
-            Err(_) => {
-                continue;
-            }
-        };
+        s = rest;
+    }
 
-        let part_str = part_str.trim();
+    while let [rest @ .., last] = s {
+        if !last.is_ascii_whitespace() {
+            break;
+        }
+
+        s = rest;
+    }
+
+    s
+}
+
+// params are compared as bytes, so the value never needs utf8 validation.
+// a part that isn't valid utf8 can't equal an ascii param anyway
+fn header_contains_param(value: &[u8], param: &[u8], ignore_case: bool) -> bool {
+    for part in value.split(|b| *b == b',') {
+        let part = trim_ascii_whitespace(part);
 
         if ignore_case {
-            if part_str.eq_ignore_ascii_case(param_str) {
+            if part.eq_ignore_ascii_case(param) {
                 return true;
             }
         } else {
-            if part_str == param_str {
+            if part == param {
                 return true;
             }
         }
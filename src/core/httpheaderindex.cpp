@@ -0,0 +1,261 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "httpheaderindex.h"
+
+static const char *g_names[HttpHeaderIndex::NameCount] =
+{
+	"Host",
+	"Content-Type",
+	"Content-Length",
+	"Content-Encoding",
+	"Transfer-Encoding",
+	"Connection",
+	"Upgrade",
+	"Accept",
+	"Authorization",
+	"Cache-Control",
+	"Grip-Hold",
+	"Grip-Channel",
+	"Grip-Timeout",
+	"Grip-Keep-Alive",
+	"Grip-Expose-Headers",
+	"Grip-Set-Meta",
+	"Grip-Status",
+	"Grip-Link",
+	"Grip-Sig"
+};
+
+// FNV-1a, ignoring ascii case
+static uint nameHash(const char *s, int len)
+{
+	uint h = 2166136261u;
+
+	for(int n = 0; n < len; ++n)
+	{
+		uchar c = (uchar)s[n];
+		if(c >= 'A' && c <= 'Z')
+			c += 'a' - 'A';
+
+		h = (h ^ c) * 16777619u;
+	}
+
+	return h;
+}
+
+namespace {
+
+// open-addressed table of the well-known names by hash
+class NameTable
+{
+public:
+	enum { Size = 64 }; // power of two, well above NameCount
+
+	int slots[Size];
+
+	NameTable()
+	{
+		for(int n = 0; n < Size; ++n)
+			slots[n] = -1;
+
+		for(int n = 0; n < HttpHeaderIndex::NameCount; ++n)
+		{
+			uint pos = nameHash(g_names[n], qstrlen(g_names[n])) & (Size - 1);
+			while(slots[pos] != -1)
+				pos = (pos + 1) & (Size - 1);
+
+			slots[pos] = n;
+		}
+	}
+
+	HttpHeaderIndex::Name find(const QByteArray &key, uint hash) const
+	{
+		uint pos = hash & (Size - 1);
+		while(slots[pos] != -1)
+		{
+			int n = slots[pos];
+			if(qstricmp(g_names[n], key.data()) == 0)
+				return (HttpHeaderIndex::Name)n;
+
+			pos = (pos + 1) & (Size - 1);
+		}
+
+		return HttpHeaderIndex::Unknown;
+	}
+};
+
+}
+
+static const NameTable &nameTable()
+{
+	static NameTable t;
+
+	return t;
+}
+
+HttpHeaderIndex::HttpHeaderIndex(const HttpHeaders &headers) :
+	headers_(headers)
+{
+	const NameTable &table = nameTable();
+
+	int last[NameCount];
+	for(int n = 0; n < NameCount; ++n)
+	{
+		first_[n] = -1;
+		last[n] = -1;
+	}
+
+	next_.resize(headers_.count());
+	hashes_.resize(headers_.count());
+
+	for(int n = 0; n < headers_.count(); ++n)
+	{
+		const QByteArray &key = headers_[n].first;
+		uint hash = nameHash(key.data(), key.size());
+
+		next_[n] = -1;
+		hashes_[n] = hash;
+
+		Name name = table.find(key, hash);
+		if(name == Unknown)
+			continue;
+
+		if(last[name] != -1)
+			next_[last[name]] = n;
+		else
+			first_[name] = n;
+
+		last[name] = n;
+	}
+}
+
+bool HttpHeaderIndex::contains(const QByteArray &key) const
+{
+	uint hash = nameHash(key.data(), key.size());
+
+	return first(key, nameTable().find(key, hash), hash) != -1;
+}
+
+QByteArray HttpHeaderIndex::get(Name name) const
+{
+	int pos = first_[name];
+	if(pos == -1)
+		return QByteArray();
+
+	return headers_[pos].second;
+}
+
+QByteArray HttpHeaderIndex::get(const QByteArray &key) const
+{
+	uint hash = nameHash(key.data(), key.size());
+
+	int pos = first(key, nameTable().find(key, hash), hash);
+	if(pos == -1)
+		return QByteArray();
+
+	return headers_[pos].second;
+}
+
+HttpHeaderParameters HttpHeaderIndex::getAsParameters(const QByteArray &key, HttpHeaders::ParseMode mode) const
+{
+	QByteArray h = get(key);
+	if(h.isEmpty())
+		return HttpHeaderParameters();
+
+	return HttpHeaders::parseParameters(h, mode);
+}
+
+QByteArray HttpHeaderIndex::getAsFirstParameter(const QByteArray &key) const
+{
+	HttpHeaderParameters p = getAsParameters(key);
+	if(p.isEmpty())
+		return QByteArray();
+
+	return p[0].first;
+}
+
+QList<QByteArray> HttpHeaderIndex::getAll(const QByteArray &key, bool split) const
+{
+	QList<QByteArray> out;
+
+	uint hash = nameHash(key.data(), key.size());
+	Name name = nameTable().find(key, hash);
+
+	for(int pos = first(key, name, hash); pos != -1; pos = next(pos, key, name, hash))
+	{
+		const QByteArray &value = headers_[pos].second;
+
+		if(split)
+			out += HttpHeaders::split(value);
+		else
+			out += value;
+	}
+
+	return out;
+}
+
+QList<HttpHeaderParameters> HttpHeaderIndex::getAllAsParameters(const QByteArray &key, HttpHeaders::ParseMode mode, bool split) const
+{
+	QList<HttpHeaderParameters> out;
+
+	foreach(const QByteArray &h, getAll(key, split))
+	{
+		bool ok;
+		HttpHeaderParameters params = HttpHeaders::parseParameters(h, mode, &ok);
+		if(ok)
+			out += params;
+	}
+
+	return out;
+}
+
+HttpHeaderIndex::Name HttpHeaderIndex::lookupName(const QByteArray &key)
+{
+	return nameTable().find(key, nameHash(key.data(), key.size()));
+}
+
+int HttpHeaderIndex::first(const QByteArray &key, Name name, uint hash) const
+{
+	if(name != Unknown)
+		return first_[name];
+
+	return scan(0, key, hash);
+}
+
+int HttpHeaderIndex::next(int pos, const QByteArray &key, Name name, uint hash) const
+{
+	if(name != Unknown)
+		return next_[pos];
+
+	return scan(pos + 1, key, hash);
+}
+
+int HttpHeaderIndex::scan(int from, const QByteArray &key, uint hash) const
+{
+	for(int n = from; n < headers_.count(); ++n)
+	{
+		if(hashes_[n] == hash && qstricmp(headers_[n].first.data(), key.data()) == 0)
+			return n;
+	}
+
+	return -1;
+}
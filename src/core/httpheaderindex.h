@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef HTTPHEADERINDEX_H
+#define HTTPHEADERINDEX_H
+
+#include <QVarLengthArray>
+#include "httpheaders.h"
+
+// read-only view of a set of headers for code that looks up many names in
+// the same headers. the accessors match those of HttpHeaders, so callers
+// can switch by constructing an index in place of using the list directly.
+// well-known names are interned, and each has a precomputed chain of its
+// entries, making their lookups O(1) rather than a scan. other names fall
+// back to a scan that compares precomputed hashes first
+class HttpHeaderIndex
+{
+public:
+	enum Name
+	{
+		Unknown = -1,
+		Host,
+		ContentType,
+		ContentLength,
+		ContentEncoding,
+		TransferEncoding,
+		Connection,
+		Upgrade,
+		Accept,
+		Authorization,
+		CacheControl,
+		GripHold,
+		GripChannel,
+		GripTimeout,
+		GripKeepAlive,
+		GripExposeHeaders,
+		GripSetMeta,
+		GripStatus,
+		GripLink,
+		GripSig,
+		NameCount
+	};
+
+	HttpHeaderIndex(const HttpHeaders &headers);
+
+	const HttpHeaders &headers() const { return headers_; }
+
+	bool contains(Name name) const { return first_[name] != -1; }
+	bool contains(const QByteArray &key) const;
+	QByteArray get(Name name) const;
+	QByteArray get(const QByteArray &key) const;
+	HttpHeaderParameters getAsParameters(const QByteArray &key, HttpHeaders::ParseMode mode = HttpHeaders::NoParseFirstParameter) const;
+	QByteArray getAsFirstParameter(const QByteArray &key) const;
+	QList<QByteArray> getAll(const QByteArray &key, bool split = true) const;
+	QList<HttpHeaderParameters> getAllAsParameters(const QByteArray &key, HttpHeaders::ParseMode mode = HttpHeaders::NoParseFirstParameter, bool split = true) const;
+
+	// returns Unknown if the name is not well-known
+	static Name lookupName(const QByteArray &key);
+
+private:
+	enum { Prealloc = 32 };
+
+	HttpHeaders headers_;
+	int first_[NameCount];
+	QVarLengthArray<int, Prealloc> next_; // next entry with the same name, or -1
+	QVarLengthArray<uint, Prealloc> hashes_; // case-insensitive name hashes
+
+	int first(const QByteArray &key, Name name, uint hash) const;
+	int next(int pos, const QByteArray &key, Name name, uint hash) const;
+	int scan(int from, const QByteArray &key, uint hash) const;
+};
+
+#endif
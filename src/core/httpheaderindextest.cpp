@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "test.h"
+#include "httpheaderindex.h"
+
+static void lookup()
+{
+	HttpHeaders h;
+	h += HttpHeader("Host", "example.com");
+	h += HttpHeader("X-Fruit", "apple");
+	h += HttpHeader("grip-channel", "a, b");
+	h += HttpHeader("Content-Type", "text/plain; charset=utf-8");
+	h += HttpHeader("x-fruit", "banana");
+	h += HttpHeader("Grip-Channel", "c");
+
+	HttpHeaderIndex i(h);
+
+	TEST_ASSERT_EQ((int)HttpHeaderIndex::lookupName("content-TYPE"), (int)HttpHeaderIndex::ContentType);
+	TEST_ASSERT_EQ((int)HttpHeaderIndex::lookupName("X-Fruit"), (int)HttpHeaderIndex::Unknown);
+
+	// well-known names, with any case
+	TEST_ASSERT(i.contains(HttpHeaderIndex::Host));
+	TEST_ASSERT(i.contains("HOST"));
+	TEST_ASSERT_EQ(i.get(HttpHeaderIndex::Host), QByteArray("example.com"));
+	TEST_ASSERT_EQ(i.getAsFirstParameter("Content-Type"), QByteArray("text/plain"));
+	TEST_ASSERT(!i.contains(HttpHeaderIndex::Upgrade));
+	TEST_ASSERT(i.get("Upgrade").isNull());
+
+	QList<QByteArray> l = i.getAll("Grip-Channel");
+	TEST_ASSERT_EQ(l.count(), 3);
+	TEST_ASSERT_EQ(l[0], QByteArray("a"));
+	TEST_ASSERT_EQ(l[1], QByteArray("b"));
+	TEST_ASSERT_EQ(l[2], QByteArray("c"));
+
+	l = i.getAll("Grip-Channel", false);
+	TEST_ASSERT_EQ(l.count(), 2);
+	TEST_ASSERT_EQ(l[0], QByteArray("a, b"));
+
+	// other names
+	TEST_ASSERT(i.contains("x-FRUIT"));
+	TEST_ASSERT_EQ(i.get("X-Fruit"), QByteArray("apple"));
+	l = i.getAll("X-Fruit");
+	TEST_ASSERT_EQ(l.count(), 2);
+	TEST_ASSERT_EQ(l[1], QByteArray("banana"));
+	TEST_ASSERT(!i.contains("X-Vegetable"));
+
+	// results match the plain list
+	foreach(const HttpHeader &e, h)
+		TEST_ASSERT(i.getAll(e.first) == h.getAll(e.first));
+}
+
+extern "C" int httpheaderindex_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(lookup());
+
+	return 0;
+}
@@ -20,8 +20,10 @@
 
 #include "httpheaders.h"
 
+#include <string.h>
+
 // return position, end of string if not found, -1 on error
-static int findNonQuoted(const QByteArray &in, char c, int offset = 0)
+static int findNonQuoted(const HttpHeaderView &in, char c, int offset = 0)
 {
 	bool inQuote = false;
 
@@ -67,7 +69,7 @@ static int findNonQuoted(const QByteArray &in, char c, int offset = 0)
 }
 
 // search for one of many chars
-static int findNext(const QByteArray &in, const char *charList, int offset = 0)
+static int findNext(const HttpHeaderView &in, const char *charList, int offset = 0)
 {
 	int len = qstrlen(charList);
 	for(int n = offset; n < in.size(); ++n)
@@ -83,32 +85,75 @@ static int findNext(const QByteArray &in, const char *charList, int offset = 0)
 	return -1;
 }
 
+static bool isSpace(char c)
+{
+	return (c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r');
+}
+
 static QList<QByteArray> headerSplit(const QByteArray &in)
 {
 	QList<QByteArray> parts;
-	int pos = 0;
-	while(pos < in.size())
-	{
-		int end = findNonQuoted(in, ',', pos);
-		if(end != -1)
-		{
-			parts += in.mid(pos, end - pos).trimmed();
 
-			if(end < in.size())
-				pos = end + 1;
-			else
-				pos = in.size();
-		}
-		else
-		{
-			parts += in.mid(pos).trimmed();
+	HttpHeaderValueReader r(in);
+	HttpHeaderView part;
+	while(r.next(&part))
+		parts += part.toByteArray();
 
-			pos = in.size();
-		}
-	}
 	return parts;
 }
 
+HttpHeaderView HttpHeaderView::mid(int pos, int len) const
+{
+	if(pos >= size_)
+		return HttpHeaderView();
+
+	if(len < 0 || len > size_ - pos)
+		len = size_ - pos;
+
+	return HttpHeaderView(data_ + pos, len);
+}
+
+HttpHeaderView HttpHeaderView::trimmed() const
+{
+	int start = 0;
+	while(start < size_ && isSpace(data_[start]))
+		++start;
+
+	int end = size_;
+	while(end > start && isSpace(data_[end - 1]))
+		--end;
+
+	return HttpHeaderView(data_ + start, end - start);
+}
+
+int HttpHeaderView::indexOf(char c, int from) const
+{
+	for(int n = from; n < size_; ++n)
+	{
+		if(data_[n] == c)
+			return n;
+	}
+
+	return -1;
+}
+
+bool HttpHeaderView::equalsIgnoreCase(const char *s) const
+{
+	int len = qstrlen(s);
+	return (len == size_ && (size_ == 0 || qstrnicmp(data_, s, size_) == 0));
+}
+
+QByteArray HttpHeaderView::toByteArray() const
+{
+	return QByteArray(data_, size_);
+}
+
+bool HttpHeaderView::operator==(const char *s) const
+{
+	int len = qstrlen(s);
+	return (len == size_ && (size_ == 0 || memcmp(data_, s, size_) == 0));
+}
+
 bool HttpHeaderParameters::contains(const QByteArray &key) const
 {
 	for(int n = 0; n < count(); ++n)
@@ -241,6 +286,11 @@ void HttpHeaders::removeAll(const QByteArray &key)
 	}
 }
 
+QList<QByteArray> HttpHeaders::split(const QByteArray &value)
+{
+	return headerSplit(value);
+}
+
 QByteArray HttpHeaders::join(const QList<QByteArray> &values)
 {
 	QByteArray out;
@@ -262,107 +312,223 @@ HttpHeaderParameters HttpHeaders::parseParameters(const QByteArray &in, ParseMod
 {
 	HttpHeaderParameters out;
 
-	int start = 0;
-	if(mode == NoParseFirstParameter)
+	HttpHeaderParameterReader r(in, mode);
+	while(r.next())
+		out += HttpHeaderParameter(r.key().toByteArray(), r.valueUnescaped());
+
+	if(r.isError())
 	{
-		int at = in.indexOf(';');
-		if(at != -1)
+		if(ok)
+			*ok = false;
+		return HttpHeaderParameters();
+	}
+
+	if(ok)
+		*ok = true;
+
+	return out;
+}
+
+HttpHeaderValueReader::HttpHeaderValueReader(const HttpHeaderView &in) :
+	headers_(0),
+	key_(0),
+	index_(0),
+	cur_(in),
+	pos_(0)
+{
+}
+
+HttpHeaderValueReader::HttpHeaderValueReader(const HttpHeaders &headers, const char *key) :
+	headers_(&headers),
+	key_(key),
+	index_(0),
+	pos_(0)
+{
+}
+
+bool HttpHeaderValueReader::next(HttpHeaderView *out)
+{
+	while(pos_ >= cur_.size())
+	{
+		if(!headers_)
+			return false;
+
+		// move to the next header with a matching name
+		bool found = false;
+		while(index_ < headers_->count())
 		{
-			out += HttpHeaderParameter(in.mid(0, at).trimmed(), QByteArray());
-			start = at + 1;
+			const HttpHeader &h = headers_->at(index_++);
+			if(qstricmp(h.first.data(), key_) == 0)
+			{
+				cur_ = h.second;
+				pos_ = 0;
+				found = true;
+				break;
+			}
 		}
+
+		if(!found)
+			return false;
+	}
+
+	int end = findNonQuoted(cur_, ',', pos_);
+	if(end != -1)
+	{
+		*out = cur_.mid(pos_, end - pos_).trimmed();
+
+		if(end < cur_.size())
+			pos_ = end + 1;
 		else
+			pos_ = cur_.size();
+	}
+	else
+	{
+		*out = cur_.mid(pos_).trimmed();
+
+		pos_ = cur_.size();
+	}
+
+	return true;
+}
+
+HttpHeaderParameterReader::HttpHeaderParameterReader(const HttpHeaderView &in, HttpHeaders::ParseMode mode) :
+	in_(in),
+	mode_(mode),
+	pos_(0),
+	first_(true),
+	error_(false),
+	escaped_(false)
+{
+}
+
+bool HttpHeaderParameterReader::next()
+{
+	if(error_)
+		return false;
+
+	key_ = HttpHeaderView();
+	value_ = HttpHeaderView();
+	escaped_ = false;
+
+	if(first_)
+	{
+		first_ = false;
+
+		if(mode_ == HttpHeaders::NoParseFirstParameter)
 		{
-			out += HttpHeaderParameter(in.trimmed(), QByteArray());
-			start = in.size();
+			int at = in_.indexOf(';');
+			if(at != -1)
+			{
+				key_ = in_.mid(0, at).trimmed();
+				pos_ = at + 1;
+			}
+			else
+			{
+				key_ = in_.trimmed();
+				pos_ = in_.size();
+			}
+
+			return true;
 		}
 	}
 
-	while(start < in.size())
-	{
-		QByteArray var;
-		QByteArray val;
+	if(pos_ >= in_.size())
+		return false;
 
-		int at = findNext(in, "=;", start);
-		if(at != -1)
+	int start = pos_;
+
+	int at = findNext(in_, "=;", start);
+	if(at != -1)
+	{
+		key_ = in_.mid(start, at - start).trimmed();
+		if(in_[at] == '=')
 		{
-			var = in.mid(start, at - start).trimmed();
-			if(in[at] == '=')
+			++at;
+
+			if(at < in_.size() && in_[at] == '\"')
 			{
 				++at;
 
-				if(at < in.size() && in[at] == '\"')
+				int vstart = at;
+				bool complete = false;
+				for(int n = at; n < in_.size(); ++n)
 				{
-					++at;
-
-					bool complete = false;
-					for(int n = at; n < in.size(); ++n)
+					if(in_[n] == '\\')
 					{
-						if(in[n] == '\\')
-						{
-							if(n + 1 >= in.size())
-							{
-								if(ok)
-									*ok = false;
-								return HttpHeaderParameters();
-							}
-
-							++n;
-							val += in[n];
-						}
-						else if(in[n] == '\"')
+						if(n + 1 >= in_.size())
 						{
-							complete = true;
-							at = n + 1;
-							break;
+							error_ = true;
+							return false;
 						}
-						else
-							val += in[n];
-					}
 
-					if(!complete)
+						++n;
+						escaped_ = true;
+					}
+					else if(in_[n] == '\"')
 					{
-						if(ok)
-							*ok = false;
-						return HttpHeaderParameters();
+						value_ = in_.mid(vstart, n - vstart);
+						complete = true;
+						at = n + 1;
+						break;
 					}
+				}
+
+				if(!complete)
+				{
+					error_ = true;
+					return false;
+				}
 
-					at = in.indexOf(';', at);
-					if(at != -1)
-						start = at + 1;
-					else
-						start = in.size();
+				at = in_.indexOf(';', at);
+				if(at != -1)
+					pos_ = at + 1;
+				else
+					pos_ = in_.size();
+			}
+			else
+			{
+				int vstart = at;
+				at = in_.indexOf(';', vstart);
+				if(at != -1)
+				{
+					value_ = in_.mid(vstart, at - vstart).trimmed();
+					pos_ = at + 1;
 				}
 				else
 				{
-					int vstart = at;
-					at = in.indexOf(';', vstart);
-					if(at != -1)
-					{
-						val = in.mid(vstart, at - vstart).trimmed();
-						start = at + 1;
-					}
-					else
-					{
-						val = in.mid(vstart).trimmed();
-						start = in.size();
-					}
+					value_ = in_.mid(vstart).trimmed();
+					pos_ = in_.size();
 				}
 			}
-			else
-				start = at + 1;
 		}
 		else
-		{
-			var = in.mid(start).trimmed();
-			start = in.size();
-		}
-
-		out.append(HttpHeaderParameter(var, val));
+			pos_ = at + 1;
+	}
+	else
+	{
+		key_ = in_.mid(start).trimmed();
+		pos_ = in_.size();
 	}
 
-	if(ok)
-		*ok = true;
+	return true;
+}
+
+QByteArray HttpHeaderParameterReader::valueUnescaped() const
+{
+	if(!escaped_)
+		return value_.toByteArray();
+
+	QByteArray out;
+	out.reserve(value_.size());
+
+	for(int n = 0; n < value_.size(); ++n)
+	{
+		// escapes are always followed by a character
+		if(value_[n] == '\\')
+			++n;
+
+		out += value_[n];
+	}
 
 	return out;
 }
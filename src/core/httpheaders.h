@@ -25,6 +25,49 @@
 #include <QPair>
 #include <QList>
 
+// a range of bytes within a header value. nothing is copied, so a view is
+// only valid as long as the value it refers to is unchanged
+class HttpHeaderView
+{
+public:
+	HttpHeaderView() :
+		data_(0),
+		size_(0)
+	{
+	}
+
+	HttpHeaderView(const char *data, int size) :
+		data_(data),
+		size_(size)
+	{
+	}
+
+	HttpHeaderView(const QByteArray &in) :
+		data_(in.constData()),
+		size_(in.size())
+	{
+	}
+
+	const char *data() const { return data_; }
+	int size() const { return size_; }
+	bool isEmpty() const { return size_ == 0; }
+	char operator[](int pos) const { return data_[pos]; }
+
+	// if len is negative, returns everything from pos
+	HttpHeaderView mid(int pos, int len = -1) const;
+	HttpHeaderView trimmed() const;
+	int indexOf(char c, int from = 0) const;
+	bool equalsIgnoreCase(const char *s) const;
+	QByteArray toByteArray() const;
+
+	bool operator==(const char *s) const;
+	bool operator!=(const char *s) const { return !operator==(s); }
+
+private:
+	const char *data_;
+	int size_;
+};
+
 typedef QPair<QByteArray, QByteArray> HttpHeaderParameter;
 
 class HttpHeaderParameters : public QList<HttpHeaderParameter>
@@ -55,7 +98,64 @@ public:
 	void removeAll(const QByteArray &key);
 
 	static QByteArray join(const QList<QByteArray> &values);
+	static QList<QByteArray> split(const QByteArray &value);
 	static HttpHeaderParameters parseParameters(const QByteArray &in, ParseMode mode = NoParseFirstParameter, bool *ok = 0);
 };
 
+// iterates over comma-separated header values without copying them, the
+// same way HttpHeaders::split does
+class HttpHeaderValueReader
+{
+public:
+	HttpHeaderValueReader(const HttpHeaderView &in);
+
+	// iterates over the values of all headers with the given name, as
+	// HttpHeaders::getAll does. key must outlive the reader
+	HttpHeaderValueReader(const HttpHeaders &headers, const char *key);
+
+	// returns false when there are no more values
+	bool next(HttpHeaderView *out);
+
+private:
+	const HttpHeaders *headers_;
+	const char *key_;
+	int index_;
+	HttpHeaderView cur_;
+	int pos_;
+};
+
+// iterates over the parameters of a header value without copying them,
+// giving the same results as HttpHeaders::parseParameters. quoted values
+// have their quotes removed but any escapes left in place, so callers that
+// need the exact value should use valueUnescaped()
+class HttpHeaderParameterReader
+{
+public:
+	HttpHeaderParameterReader(const HttpHeaderView &in, HttpHeaders::ParseMode mode = HttpHeaders::NoParseFirstParameter);
+
+	// advances to the next parameter. returns false when there are no more
+	// or the value is malformed, in which case isError() is set. parameters
+	// returned before an error are not retracted, so callers that must
+	// ignore malformed values should hold off acting on them until the end
+	bool next();
+
+	bool isError() const { return error_; }
+	HttpHeaderView key() const { return key_; }
+	HttpHeaderView value() const { return value_; }
+	bool valueHasEscapes() const { return escaped_; }
+
+	// only needs to unescape if valueHasEscapes() is set
+	QByteArray valueUnescaped() const;
+
+private:
+	HttpHeaderView in_;
+	HttpHeaders::ParseMode mode_;
+	int pos_;
+	bool first_;
+	bool error_;
+	HttpHeaderView key_;
+	HttpHeaderView value_;
+	bool escaped_;
+};
+
 #endif
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "bench.h"
+#include "httpheaders.h"
+
+extern "C" void httpheaders_bench(const char *filter)
+{
+	Bench bench(filter);
+
+	if(!bench.selected("httpheaders/"))
+		return;
+
+	HttpHeaders headers;
+	headers += HttpHeader("Accept-Encoding", "br;q=1.0, gzip;q=0.8, *;q=0.1");
+	headers += HttpHeader("Grip-Link", "</stream/?after=1234>; rel=next; timeout=\"120\"");
+
+	bench.run("httpheaders/parse-params", 100000, 1, [&] {
+		QList<HttpHeaderParameters> params = headers.getAllAsParameters("Accept-Encoding", HttpHeaders::ParseAllParameters);
+		Q_UNUSED(params);
+	});
+
+	bench.run("httpheaders/read-params", 100000, 1, [&] {
+		int count = 0;
+
+		HttpHeaderValueReader values(headers, "Accept-Encoding");
+		HttpHeaderView value;
+		while(values.next(&value))
+		{
+			HttpHeaderParameterReader params(value, HttpHeaders::ParseAllParameters);
+			while(params.next())
+				++count;
+		}
+
+		Q_UNUSED(count);
+	});
+
+	bench.run("httpheaders/parse-link", 100000, 1, [&] {
+		HttpHeaderParameters params = headers.getAsParameters("Grip-Link");
+		Q_UNUSED(params);
+	});
+
+	bench.run("httpheaders/read-link", 100000, 1, [&] {
+		int count = 0;
+
+		HttpHeaderParameterReader params(headers.get("Grip-Link"));
+		while(params.next())
+			++count;
+
+		Q_UNUSED(count);
+	});
+}
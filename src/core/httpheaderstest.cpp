@@ -81,9 +81,82 @@ static void parseParameters()
 	TEST_ASSERT_EQ(params[0][1].second, QByteArray("gala"));
 }
 
+// reads parameters in place, formatted as "key=value|key=value"
+static QByteArray readParameters(const QByteArray &in, HttpHeaders::ParseMode mode)
+{
+	QByteArray out;
+
+	HttpHeaderParameterReader r(in, mode);
+	while(r.next())
+	{
+		if(!out.isEmpty())
+			out += '|';
+
+		out += r.key().toByteArray() + '=' + r.valueUnescaped();
+	}
+
+	if(r.isError())
+		return "error";
+
+	return out;
+}
+
+static void readers()
+{
+	TEST_ASSERT_EQ(readParameters("", HttpHeaders::NoParseFirstParameter), QByteArray("="));
+	TEST_ASSERT_EQ(readParameters("", HttpHeaders::ParseAllParameters), QByteArray());
+	TEST_ASSERT_EQ(readParameters("  apple  ", HttpHeaders::NoParseFirstParameter), QByteArray("apple="));
+	TEST_ASSERT_EQ(readParameters("apple;type = gala ;ripe", HttpHeaders::NoParseFirstParameter), QByteArray("apple=|type=gala|ripe="));
+	TEST_ASSERT_EQ(readParameters("apple; type=\"granny; smith\"", HttpHeaders::NoParseFirstParameter), QByteArray("apple=|type=granny; smith"));
+	TEST_ASSERT_EQ(readParameters("banana; type=\"\\\"yellow\\\"\"", HttpHeaders::NoParseFirstParameter), QByteArray("banana=|type=\"yellow\""));
+	TEST_ASSERT_EQ(readParameters("; a=1;;b", HttpHeaders::ParseAllParameters), QByteArray("=|a=1|=|b="));
+	TEST_ASSERT_EQ(readParameters("q=0.5", HttpHeaders::NoParseFirstParameter), QByteArray("q=0.5="));
+	TEST_ASSERT_EQ(readParameters("q=0.5", HttpHeaders::ParseAllParameters), QByteArray("q=0.5"));
+	TEST_ASSERT_EQ(readParameters("cherry; type=\"red", HttpHeaders::NoParseFirstParameter), QByteArray("error"));
+	TEST_ASSERT_EQ(readParameters("cherry; type=\"red\\", HttpHeaders::NoParseFirstParameter), QByteArray("error"));
+
+	// values are views into the original bytes
+	QByteArray in = "apple; type=\"gr\\\"anny\"; size=big";
+	HttpHeaderParameterReader r(in);
+	TEST_ASSERT(r.next());
+	TEST_ASSERT(r.key() == "apple");
+	TEST_ASSERT_EQ(r.key().data(), in.constData());
+	TEST_ASSERT(r.next());
+	TEST_ASSERT(r.key().equalsIgnoreCase("TYPE"));
+	TEST_ASSERT(r.value() == "gr\\\"anny");
+	TEST_ASSERT(r.valueHasEscapes());
+	TEST_ASSERT_EQ(r.valueUnescaped(), QByteArray("gr\"anny"));
+	TEST_ASSERT(r.next());
+	TEST_ASSERT(r.key() == "size");
+	TEST_ASSERT(r.value() == "big");
+	TEST_ASSERT(!r.valueHasEscapes());
+	TEST_ASSERT(!r.next());
+	TEST_ASSERT(!r.isError());
+
+	// values across headers are split the same as getAll
+	HttpHeaders h;
+	h += HttpHeader("Fruit", "apple, banana; type=\"a, b\"");
+	h += HttpHeader("Other", "x");
+	h += HttpHeader("fruit", ", cherry,");
+	h += HttpHeader("Fruit", "");
+	h += HttpHeader("Fruit", "\"date");
+
+	QList<QByteArray> expected = h.getAll("Fruit");
+	QList<QByteArray> actual;
+
+	HttpHeaderValueReader values(h, "Fruit");
+	HttpHeaderView value;
+	while(values.next(&value))
+		actual += value.toByteArray();
+
+	TEST_ASSERT_EQ(actual.count(), 5);
+	TEST_ASSERT(actual == expected);
+}
+
 extern "C" int httpheaders_test(ffi::TestException *out_ex)
 {
 	TEST_CATCH(parseParameters());
+	TEST_CATCH(readers());
 
 	return 0;
 }
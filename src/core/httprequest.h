@@ -28,6 +28,7 @@
 #include <QHostAddress>
 #include "httpheaders.h"
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 
 using Signal = boost::signals2::signal<void()>;
 using SignalInt = boost::signals2::signal<void(int)>;
@@ -87,12 +88,12 @@ public:
 	virtual QByteArray readBody(int size = -1) = 0; // takes from the buffer
 
 	// indicates input data and/or input finished
-	Signal readyRead;
+	FastSignal<> readyRead;
 	// indicates output data written and/or output finished
-	SignalInt bytesWritten;
-	Signal writeBytesChanged;
-	Signal paused;
-	Signal error;
+	FastSignal<int> bytesWritten;
+	FastSignal<> writeBytesChanged;
+	FastSignal<> paused;
+	FastSignal<> error;
 };
 
 #endif
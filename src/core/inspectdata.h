@@ -34,9 +34,11 @@ public:
 	QByteArray sid;
 	QHash<QByteArray, QByteArray> lastIds;
 	QVariant userData;
+	int maxAge; // seconds the result may be reused for, or -1
 
 	InspectData() :
-		doProxy(false)
+		doProxy(false),
+		maxAge(-1)
 	{
 	}
 };
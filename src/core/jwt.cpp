@@ -70,8 +70,11 @@ EncodingKey EncodingKey::fromFile(const QString &fileName)
 		return EncodingKey();
 	}
 
-	QByteArray data = f.readAll();
+	return fromFileData(f.readAll());
+}
 
+EncodingKey EncodingKey::fromFileData(const QByteArray &data)
+{
 	if(data.startsWith("-----BEGIN"))
 		return fromPem(data);
 	else
@@ -58,6 +58,10 @@ public:
 	static EncodingKey fromSecret(const QByteArray &key);
 	static EncodingKey fromPem(const QByteArray &key);
 	static EncodingKey fromFile(const QString &fileName);
+
+	// parses the contents of a key file, as read by fromFile()
+	static EncodingKey fromFileData(const QByteArray &data);
+
 	static EncodingKey fromConfigString(const QString &s, const QDir &baseDir = QDir());
 
 private:
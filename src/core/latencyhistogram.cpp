@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "latencyhistogram.h"
+
+#include <chrono>
+#include <QtAlgorithms>
+
+// the first bound is 2^FIRST_BOUND_BITS
+#define FIRST_BOUND_BITS 6
+
+LatencyHistogram::LatencyHistogram() :
+	sum_(0)
+{
+	for(int n = 0; n <= BoundsCount; ++n)
+		buckets_[n] = 0;
+}
+
+void LatencyHistogram::record(qint64 usecs)
+{
+	if(usecs < 0)
+		usecs = 0;
+
+	// index of the smallest bound >= usecs
+	int index = 0;
+	if(usecs > (1 << FIRST_BOUND_BITS))
+	{
+		int bits = 64 - qCountLeadingZeroBits((quint64)(usecs - 1));
+		index = qMin(bits - FIRST_BOUND_BITS, (int)BoundsCount);
+	}
+
+	buckets_[index].fetch_add(1, std::memory_order_relaxed);
+	sum_.fetch_add((quint64)usecs, std::memory_order_relaxed);
+}
+
+quint64 LatencyHistogram::cumulativeCount(int index) const
+{
+	quint64 total = 0;
+	for(int n = 0; n <= index && n <= BoundsCount; ++n)
+		total += buckets_[n].load(std::memory_order_relaxed);
+
+	return total;
+}
+
+quint64 LatencyHistogram::count() const
+{
+	return cumulativeCount(BoundsCount);
+}
+
+quint64 LatencyHistogram::sumUsecs() const
+{
+	return sum_.load(std::memory_order_relaxed);
+}
+
+qint64 LatencyHistogram::bound(int index)
+{
+	return (qint64)1 << (FIRST_BOUND_BITS + index);
+}
+
+void LatencyHistogram::writePrometheus(QString *out, const QString &name, const QString &labels) const
+{
+	QString prefix = labels.isEmpty() ? QString() : labels + ",";
+
+	// read the buckets once, so the lines are consistent with each other
+	quint64 total = 0;
+	for(int n = 0; n < BoundsCount; ++n)
+	{
+		total += buckets_[n].load(std::memory_order_relaxed);
+
+		QString le = QString::number((double)bound(n) / 1000000, 'f', 6);
+		*out += QString("%1_bucket{%2le=\"%3\"} %4\n").arg(name, prefix, le, QString::number(total));
+	}
+
+	total += buckets_[BoundsCount].load(std::memory_order_relaxed);
+	*out += QString("%1_bucket{%2le=\"+Inf\"} %3\n").arg(name, prefix, QString::number(total));
+
+	QString braced = labels.isEmpty() ? QString() : "{" + labels + "}";
+	*out += QString("%1_sum%2 %3\n").arg(name, braced, QString::number((double)sumUsecs() / 1000000, 'f', 6));
+	*out += QString("%1_count%2 %3\n").arg(name, braced, QString::number(total));
+}
+
+qint64 LatencyHistogram::now()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
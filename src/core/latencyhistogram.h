@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <atomic>
+#include <QString>
+
+// histogram of durations in microseconds, with power-of-two bucket bounds
+// from 64us to about 33s. recording is a few relaxed atomic increments, so
+// an instance can be shared by threads
+class LatencyHistogram
+{
+public:
+	enum { BoundsCount = 20 };
+
+	LatencyHistogram();
+
+	// disable copying
+	LatencyHistogram(const LatencyHistogram &) = delete;
+	LatencyHistogram & operator=(const LatencyHistogram &) = delete;
+
+	void record(qint64 usecs);
+
+	// counts are cumulative, as prometheus expects. index BoundsCount is
+	// the total
+	quint64 cumulativeCount(int index) const;
+	quint64 count() const;
+	quint64 sumUsecs() const;
+
+	// upper bound of bucket index, in microseconds
+	static qint64 bound(int index);
+
+	// appends _bucket, _sum and _count lines. labels is a comma-separated
+	// list of name="value" pairs, or empty
+	void writePrometheus(QString *out, const QString &name, const QString &labels) const;
+
+	// monotonic time in microseconds
+	static qint64 now();
+
+private:
+	std::atomic<quint64> buckets_[BoundsCount + 1];
+	std::atomic<quint64> sum_;
+};
+
+#endif
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "test.h"
+#include "latencyhistogram.h"
+
+static void buckets()
+{
+	LatencyHistogram h;
+
+	TEST_ASSERT_EQ(LatencyHistogram::bound(0), 64);
+	TEST_ASSERT_EQ(LatencyHistogram::bound(1), 128);
+
+	h.record(-5); // clamped to zero
+	h.record(64);
+	h.record(65);
+	h.record(128);
+	h.record(129);
+	h.record((qint64)100 * 1000 * 1000); // beyond the last bound
+
+	TEST_ASSERT_EQ(h.cumulativeCount(0), 2u);
+	TEST_ASSERT_EQ(h.cumulativeCount(1), 4u);
+	TEST_ASSERT_EQ(h.cumulativeCount(2), 5u);
+	TEST_ASSERT_EQ(h.cumulativeCount(LatencyHistogram::BoundsCount - 1), 5u);
+	TEST_ASSERT_EQ(h.count(), 6u);
+	TEST_ASSERT_EQ(h.sumUsecs(), (quint64)(64 + 65 + 128 + 129 + 100 * 1000 * 1000));
+}
+
+static void prometheus()
+{
+	LatencyHistogram h;
+	h.record(100);
+	h.record(1000);
+
+	QString out;
+	h.writePrometheus(&out, "latency_seconds", "stage=\"a\"");
+
+	TEST_ASSERT(out.contains("latency_seconds_bucket{stage=\"a\",le=\"0.000064\"} 0\n"));
+	TEST_ASSERT(out.contains("latency_seconds_bucket{stage=\"a\",le=\"0.000128\"} 1\n"));
+	TEST_ASSERT(out.contains("latency_seconds_bucket{stage=\"a\",le=\"0.001024\"} 2\n"));
+	TEST_ASSERT(out.contains("latency_seconds_bucket{stage=\"a\",le=\"+Inf\"} 2\n"));
+	TEST_ASSERT(out.contains("latency_seconds_sum{stage=\"a\"} 0.001100\n"));
+	TEST_ASSERT(out.contains("latency_seconds_count{stage=\"a\"} 2\n"));
+
+	out.clear();
+	h.writePrometheus(&out, "latency_seconds", QString());
+	TEST_ASSERT(out.contains("latency_seconds_bucket{le=\"+Inf\"} 2\n"));
+	TEST_ASSERT(out.contains("latency_seconds_count 2\n"));
+}
+
+extern "C" int latencyhistogram_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(buckets());
+	TEST_CATCH(prometheus());
+
+	return 0;
+}
@@ -21,41 +21,337 @@
 #include "log.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <QString>
-#include <QElapsedTimer>
 #include <QDateTime>
 #include <QMutex>
 
+#define ASYNC_CELLS 4096 // must be a power of two
+#define ASYNC_CELL_SIZE 512
+#define ASYNC_BATCH_MAX 64
+#define ASYNC_IDLE_WAIT 100
+
+// records written to the async queue. records too large for a cell are
+// copied to the heap
+class LogCell
+{
+public:
+	std::atomic<size_t> seq;
+	int size;
+	char *big;
+	char data[ASYNC_CELL_SIZE];
+};
+
+// bounded multi-producer queue. producers claim a cell with a CAS on the
+// enqueue position, and the single writer thread consumes in order
+class LogQueue
+{
+public:
+	LogCell *cells;
+	std::atomic<size_t> enqueuePos;
+	size_t dequeuePos;
+
+	LogQueue() :
+		cells(new LogCell[ASYNC_CELLS]),
+		enqueuePos(0),
+		dequeuePos(0)
+	{
+		for(size_t n = 0; n < ASYNC_CELLS; ++n)
+		{
+			cells[n].seq.store(n, std::memory_order_relaxed);
+			cells[n].big = 0;
+		}
+	}
+
+	~LogQueue()
+	{
+		delete [] cells;
+	}
+
+	// returns false if full
+	bool push(const char *buf, int size)
+	{
+		LogCell *c;
+		size_t pos = enqueuePos.load(std::memory_order_relaxed);
+
+		while(true)
+		{
+			c = &cells[pos & (ASYNC_CELLS - 1)];
+			size_t seq = c->seq.load(std::memory_order_acquire);
+			intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+
+			if(dif == 0)
+			{
+				if(enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if(dif < 0)
+			{
+				return false;
+			}
+			else
+			{
+				pos = enqueuePos.load(std::memory_order_relaxed);
+			}
+		}
+
+		if(size <= ASYNC_CELL_SIZE)
+		{
+			memcpy(c->data, buf, size);
+		}
+		else
+		{
+			c->big = (char *)malloc(size);
+			memcpy(c->big, buf, size);
+		}
+
+		c->size = size;
+		c->seq.store(pos + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	// writer only. returns null if the cell at offset isn't ready
+	LogCell *peek(size_t offset)
+	{
+		size_t pos = dequeuePos + offset;
+		LogCell *c = &cells[pos & (ASYNC_CELLS - 1)];
+
+		if(c->seq.load(std::memory_order_acquire) != pos + 1)
+			return 0;
+
+		return c;
+	}
+
+	// writer only
+	void pop()
+	{
+		LogCell *c = &cells[dequeuePos & (ASYNC_CELLS - 1)];
+
+		if(c->big)
+		{
+			free(c->big);
+			c->big = 0;
+		}
+
+		c->seq.store(dequeuePos + ASYNC_CELLS, std::memory_order_release);
+		++dequeuePos;
+	}
+};
+
 Q_GLOBAL_STATIC(QMutex, g_mutex)
-static int g_level = LOG_LEVEL_DEBUG;
-static QElapsedTimer g_time;
+static std::atomic<int> g_level(LOG_LEVEL_DEBUG);
+static std::atomic<qint64> g_clockStart(-1);
 static QString *g_filename;
 static FILE *g_file;
 
-static void log(const char *s)
+static std::atomic<LogQueue*> g_queue(nullptr);
+static std::thread *g_writer;
+static std::mutex g_wakeMutex;
+static std::condition_variable g_wakeCond;
+static std::atomic<bool> g_writerSleeping(false);
+static std::atomic<bool> g_writerStop(false);
+static std::atomic<quint64> g_dropped(0);
+
+static qint64 steadyMSecs()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// formatting a date is slow, so each thread keeps its last result. the date
+// part only changes once per second
+static const char *timestamp()
+{
+	static thread_local qint64 lastMSecs = -1;
+	static thread_local qint64 lastSecs = -1;
+	static thread_local char dateStr[32];
+	static thread_local char str[48];
+
+	qint64 start = g_clockStart.load(std::memory_order_relaxed);
+
+	if(start != -1)
+	{
+		qint64 elapsed = (steadyMSecs() - start) % (24 * 60 * 60 * 1000);
+		if(elapsed == lastMSecs)
+			return str;
+
+		lastMSecs = elapsed;
+		lastSecs = -1;
+
+		int ms = elapsed % 1000;
+		int secs = elapsed / 1000;
+		snprintf(str, sizeof(str), "%02d:%02d:%02d.%03d", secs / 3600, (secs / 60) % 60, secs % 60, ms);
+
+		return str;
+	}
+
+	qint64 now = QDateTime::currentMSecsSinceEpoch();
+	if(now == lastMSecs)
+		return str;
+
+	lastMSecs = now;
+
+	qint64 secs = now / 1000;
+	if(secs != lastSecs)
+	{
+		lastSecs = secs;
+
+		QByteArray date = QDateTime::fromMSecsSinceEpoch(secs * 1000).toString("yyyy-MM-dd HH:mm:ss").toLocal8Bit();
+		snprintf(dateStr, sizeof(dateStr), "%s", date.data());
+	}
+
+	snprintf(str, sizeof(str), "%s.%03d", dateStr, (int)(now % 1000));
+
+	return str;
+}
+
+static void writeAll(int fd, struct iovec *iov, int count)
+{
+	while(count > 0)
+	{
+		ssize_t ret = writev(fd, iov, count);
+		if(ret < 0)
+		{
+			if(errno == EINTR)
+				continue;
+
+			// nowhere to report to
+			return;
+		}
+
+		size_t left = (size_t)ret;
+
+		while(count > 0 && left >= iov->iov_len)
+		{
+			left -= iov->iov_len;
+			++iov;
+			--count;
+		}
+
+		if(count > 0)
+		{
+			iov->iov_base = (char *)iov->iov_base + left;
+			iov->iov_len -= left;
+		}
+	}
+}
+
+static void writerRun(LogQueue *queue)
 {
+	struct iovec iov[ASYNC_BATCH_MAX + 1];
+	quint64 reportedDropped = g_dropped.load(std::memory_order_relaxed);
+	char droppedStr[128];
+
+	while(true)
+	{
+		int count = 0;
+		for(; count < ASYNC_BATCH_MAX; ++count)
+		{
+			LogCell *c = queue->peek(count);
+			if(!c)
+				break;
+
+			iov[count].iov_base = c->big ? c->big : c->data;
+			iov[count].iov_len = c->size;
+		}
+
+		quint64 dropped = g_dropped.load(std::memory_order_relaxed);
+
+		if(count == 0 && dropped == reportedDropped)
+		{
+			if(g_writerStop.load())
+				break;
+
+			std::unique_lock<std::mutex> locker(g_wakeMutex);
+
+			g_writerSleeping.store(true);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			if(!queue->peek(0) && !g_writerStop.load())
+				g_wakeCond.wait_for(locker, std::chrono::milliseconds(ASYNC_IDLE_WAIT));
+
+			g_writerSleeping.store(false);
+			continue;
+		}
+
+		int iovCount = count;
+
+		if(dropped != reportedDropped)
+		{
+			int len = snprintf(droppedStr, sizeof(droppedStr), "[WARN] %s log queue full, dropped %llu records\n", timestamp(), (unsigned long long)(dropped - reportedDropped));
+			iov[iovCount].iov_base = droppedStr;
+			iov[iovCount].iov_len = qMin(len, (int)sizeof(droppedStr) - 1);
+			++iovCount;
+
+			reportedDropped = dropped;
+		}
+
+		{
+			// the file may be swapped or rotated meanwhile
+			QMutexLocker locker(g_mutex());
+
+			writeAll(fileno(g_file ? g_file : stdout), iov, iovCount);
+		}
+
+		for(int n = 0; n < count; ++n)
+			queue->pop();
+	}
+}
+
+static void output(const char *buf, int size)
+{
+	LogQueue *queue = g_queue.load(std::memory_order_acquire);
+	if(queue)
+	{
+		if(!queue->push(buf, size))
+		{
+			g_dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+
+		if(g_writerSleeping.load(std::memory_order_relaxed))
+		{
+			std::lock_guard<std::mutex> locker(g_wakeMutex);
+			g_wakeCond.notify_one();
+		}
+
+		return;
+	}
+
+	QMutexLocker locker(g_mutex());
+
 	FILE *out;
 	if(g_file)
 		out = g_file;
 	else
 		out = stdout;
-	fprintf(out, "%s\n", s);
+	fwrite(buf, 1, size, out);
 	fflush(out);
 }
 
-static void log(int level, const char *fmt, va_list ap)
+static void log(const char *s)
 {
-	g_mutex()->lock();
-	int current_level = g_level;
-	int elapsed;
-	if(g_time.isValid())
-		elapsed = g_time.elapsed();
-	else
-		elapsed = -1;
-	g_mutex()->unlock();
+	QByteArray buf(s);
+	buf += '\n';
 
-	if(level <= current_level)
+	output(buf.data(), buf.size());
+}
+
+static void log(int level, const char *fmt, va_list ap)
+{
+	if(level <= g_level.load(std::memory_order_relaxed))
 	{
 		QString str = QString::vasprintf(fmt, ap);
 
@@ -70,44 +366,32 @@ static void log(int level, const char *fmt, va_list ap)
 				lstr = "DEBUG"; break;
 		}
 
-		QString tstr;
-		if(elapsed != -1)
-		{
-			QTime t(0, 0);
-			t = t.addMSecs(elapsed);
-			tstr = t.toString("HH:mm:ss.zzz");
-		}
-		else
-		{
-			tstr = QDateTime::currentDateTime().toString("yyyy-MM-dd HH:mm:ss.zzz");
-		}
+		QByteArray buf;
+		buf += '[';
+		buf += lstr;
+		buf += "] ";
+		buf += timestamp();
+		buf += ' ';
+		buf += str.toLocal8Bit();
+		buf += '\n';
 
-		FILE *out;
-		if(g_file)
-			out = g_file;
-		else
-			out = stdout;
-		fprintf(out, "[%s] %s %s\n", lstr, qPrintable(tstr), qPrintable(str));
-		fflush(out);
+		output(buf.data(), buf.size());
 	}
 }
 
 void log_startClock()
 {
-	QMutexLocker locker(g_mutex());
-	g_time.start();
+	g_clockStart.store(steadyMSecs(), std::memory_order_relaxed);
 }
 
 int log_outputLevel()
 {
-	QMutexLocker locker(g_mutex());
-	return g_level;
+	return g_level.load(std::memory_order_relaxed);
 }
 
 void log_setOutputLevel(int level)
 {
-	QMutexLocker locker(g_mutex());
-	g_level = level;
+	g_level.store(level, std::memory_order_relaxed);
 }
 
 bool log_setFile(const QString &fname)
@@ -142,6 +426,49 @@ bool log_rotate()
 	return true;
 }
 
+void log_setAsync(bool enabled)
+{
+	if(enabled == (g_queue.load() != nullptr))
+		return;
+
+	if(enabled)
+	{
+		// flush anything written synchronously so far
+		{
+			QMutexLocker locker(g_mutex());
+			fflush(g_file ? g_file : stdout);
+		}
+
+		LogQueue *queue = new LogQueue;
+		g_writerStop.store(false);
+		g_writer = new std::thread(writerRun, queue);
+		g_queue.store(queue, std::memory_order_release);
+	}
+	else
+	{
+		// log synchronously from here on, and wait for the writer to
+		// drain what's queued
+		LogQueue *queue = g_queue.exchange(nullptr);
+
+		{
+			std::lock_guard<std::mutex> locker(g_wakeMutex);
+			g_writerStop.store(true);
+			g_wakeCond.notify_one();
+		}
+
+		g_writer->join();
+		delete g_writer;
+		g_writer = 0;
+
+		delete queue;
+	}
+}
+
+quint64 log_droppedCount()
+{
+	return g_dropped.load(std::memory_order_relaxed);
+}
+
 void log(int level, const char *fmt, ...)
 {
 	va_list ap;
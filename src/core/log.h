@@ -45,4 +45,10 @@ void log_debug(const char *fmt, ...);
 // log without prefixing or anything. useful for forwarding log data
 void log_raw(const char *line);
 
+// when enabled, records are queued and written by a background thread, and
+// records are dropped if the queue is full. disabling flushes the queue. must
+// not be toggled while other threads may be logging
+void log_setAsync(bool enabled);
+quint64 log_droppedCount();
+
 #endif
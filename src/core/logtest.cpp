@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include <thread>
+#include <vector>
+#include <QFile>
+#include <QTemporaryDir>
+#include "test.h"
+#include "log.h"
+
+static void async()
+{
+	QTemporaryDir dir;
+	TEST_ASSERT(dir.isValid());
+
+	QString fname = dir.filePath("test.log");
+	QString rotatedName = dir.filePath("test.log.1");
+
+	int level = log_outputLevel();
+	log_setOutputLevel(LOG_LEVEL_INFO);
+
+	TEST_ASSERT(log_setFile(fname));
+
+	log_setAsync(true);
+
+	std::vector<std::thread> threads;
+	for(int t = 0; t < 4; ++t)
+	{
+		threads.push_back(std::thread([=] {
+			for(int n = 0; n < 250; ++n)
+				log_info("thread %d record %d", t, n);
+		}));
+	}
+
+	for(std::thread &t : threads)
+		t.join();
+
+	// filtered before being queued
+	log_debug("not written");
+
+	log_setAsync(false);
+
+	// records written after rotating go to the new file
+	TEST_ASSERT(QFile::rename(fname, rotatedName));
+	TEST_ASSERT(log_rotate());
+
+	log_setAsync(true);
+	log_info("after rotate");
+
+	// larger than a queue cell
+	log_info("%s", qPrintable(QString(2000, 'x')));
+
+	log_setAsync(false);
+
+	log_setFile(QString());
+	log_setOutputLevel(level);
+
+	QFile f(rotatedName);
+	TEST_ASSERT(f.open(QIODevice::ReadOnly));
+	QList<QByteArray> lines = f.readAll().split('\n');
+
+	// fits in the queue, so nothing is dropped. the trailing newline
+	// leaves an empty element
+	TEST_ASSERT_EQ(lines.count(), 1001);
+	TEST_ASSERT(lines[0].startsWith("[INFO] "));
+	TEST_ASSERT(lines[0].contains(" record "));
+
+	QFile f2(fname);
+	TEST_ASSERT(f2.open(QIODevice::ReadOnly));
+	lines = f2.readAll().split('\n');
+	TEST_ASSERT_EQ(lines.count(), 3);
+	TEST_ASSERT(lines[0].endsWith(" after rotate"));
+	TEST_ASSERT(lines[1].endsWith(QByteArray(2000, 'x')));
+}
+
+extern "C" int log_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(async());
+
+	return 0;
+}
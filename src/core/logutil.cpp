@@ -66,6 +66,12 @@ static QString makeLastIdsStr(const HttpHeaders &headers)
 	return out;
 }
 
+static void appendTiming(QString *msg, const char *name, qint64 usecs)
+{
+	if(usecs >= 0)
+		*msg += QString(" %1=%2ms").arg(name, QString::number((double)usecs / 1000, 'f', 1));
+}
+
 static void logPacket(int level, const QString &message, const QVariant &data = QVariant(), int dataMax = -1, const QByteArray &content = QByteArray(), int contentMax = -1)
 {
 	QString out = message;
@@ -192,6 +198,15 @@ void logRequest(int level, const RequestData &data, const Config &config)
 	if(!lastIdsStr.isEmpty())
 		msg += ' ' + lastIdsStr;
 
+	if(data.timings)
+	{
+		appendTiming(&msg, "inspect", data.inspectTime);
+		appendTiming(&msg, "origin", data.originTime);
+		appendTiming(&msg, "accept", data.acceptTime);
+		appendTiming(&msg, "write-wait", data.writeWaitTime);
+		appendTiming(&msg, "total", data.totalTime);
+	}
+
 	log(level, "%s", qPrintable(msg));
 }
 
@@ -52,12 +52,27 @@ public:
 	void *sharedBy;
 	QHostAddress fromAddress;
 
+	// phase durations in microseconds, or -1 if unknown. only logged if
+	// timings is set
+	bool timings;
+	qint64 inspectTime;
+	qint64 originTime;
+	qint64 acceptTime;
+	qint64 writeWaitTime;
+	qint64 totalTime;
+
 	RequestData() :
 		status(Response),
 		responseBodySize(-1),
 		targetOverHttp(false),
 		retry(false),
-		sharedBy(0)
+		sharedBy(0),
+		timings(false),
+		inspectTime(-1),
+		originTime(-1),
+		acceptTime(-1),
+		writeWaitTime(-1),
+		totalTime(-1)
 	{
 	}
 };
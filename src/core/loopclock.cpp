@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "loopclock.h"
+
+#include <QDateTime>
+
+namespace LoopClock {
+
+static thread_local bool g_cached = false;
+static thread_local qint64 g_now = -1;
+
+qint64 msecsSinceEpoch()
+{
+	if(!g_cached)
+		return QDateTime::currentMSecsSinceEpoch();
+
+	if(g_now < 0)
+		g_now = QDateTime::currentMSecsSinceEpoch();
+
+	return g_now;
+}
+
+qint64 preciseMSecsSinceEpoch()
+{
+	qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+	if(g_cached)
+		g_now = now;
+
+	return now;
+}
+
+void setCached(bool on)
+{
+	g_cached = on;
+	g_now = -1;
+}
+
+void invalidate()
+{
+	g_now = -1;
+}
+
+}
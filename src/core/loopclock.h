@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef LOOPCLOCK_H
+#define LOOPCLOCK_H
+
+#include <QtGlobal>
+
+// wall clock time in msecs, read at most once per event loop iteration.
+// this is meant for bookkeeping, such as activity and expiration times,
+// where being behind by the length of one iteration doesn't matter, and
+// saves a clock read for every packet. threads without an EventLoop read
+// the clock every time
+namespace LoopClock {
+
+qint64 msecsSinceEpoch();
+
+// reads the clock and updates the cached value, for callers that need
+// the exact time
+qint64 preciseMSecsSinceEpoch();
+
+// used by EventLoop
+void setCached(bool on);
+void invalidate();
+
+}
+
+#endif
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "loopstats.h"
+
+#include <pthread.h>
+#include "log.h"
+#include "latencyhistogram.h"
+#include "statsmanager.h"
+
+namespace LoopStats {
+
+std::atomic<bool> g_enabled(false);
+
+static std::atomic<qint64> g_slowThreshold(0);
+static LatencyHistogram g_iterations;
+static LatencyHistogram g_callbacks[SourcesCount];
+static LatencyHistogram g_timerLag;
+
+static const char *sourceName(int source)
+{
+	switch(source)
+	{
+		case FdSource: return "fd";
+		case TimerSource: return "timer";
+		default: return "custom";
+	}
+}
+
+void setEnabled(bool on)
+{
+	g_enabled.store(on, std::memory_order_relaxed);
+}
+
+void setSlowCallbackThreshold(qint64 usecs)
+{
+	g_slowThreshold.store(usecs, std::memory_order_relaxed);
+}
+
+void recordIteration(qint64 usecs)
+{
+	g_iterations.record(usecs);
+}
+
+void recordCallback(Source source, qint64 usecs)
+{
+	g_callbacks[source].record(usecs);
+
+	qint64 threshold = g_slowThreshold.load(std::memory_order_relaxed);
+	if(threshold > 0 && usecs >= threshold)
+	{
+		// the thread name tells which worker was blocked
+		char name[32];
+		if(pthread_getname_np(pthread_self(), name, sizeof(name)) != 0)
+			name[0] = '\0';
+
+		log_warning("event loop: slow %s callback: %lldus, thread=%s", sourceName(source), (long long)usecs, name);
+	}
+}
+
+void recordTimerLag(qint64 usecs)
+{
+	g_timerLag.record(qMax(usecs, (qint64)0));
+}
+
+quint64 callbackCount(Source source)
+{
+	return g_callbacks[source].count();
+}
+
+void addToPrometheus(StatsManager *stats)
+{
+	stats->addPrometheusHistogram("eventloop_iteration_seconds", "Time spent dispatching callbacks per event loop iteration", QString(), &g_iterations);
+
+	for(int s = 0; s < SourcesCount; ++s)
+	{
+		QString labels = QString("type=\"%1\"").arg(sourceName(s));
+		stats->addPrometheusHistogram("eventloop_callback_seconds", "Time spent in an event loop callback", labels, &g_callbacks[s]);
+	}
+
+	stats->addPrometheusHistogram("eventloop_timer_lag_seconds", "Time between a timer's deadline and its callback running", QString(), &g_timerLag);
+}
+
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef LOOPSTATS_H
+#define LOOPSTATS_H
+
+#include <atomic>
+#include <QtGlobal>
+
+class StatsManager;
+
+// process-wide accounting of event loop activity: time spent dispatching
+// each iteration, time spent in callbacks per registration type, and how
+// late timers fire. shared by the loops of all threads. only loops created
+// while enabled are instrumented
+namespace LoopStats {
+
+enum Source
+{
+	FdSource,
+	TimerSource,
+	CustomSource,
+	SourcesCount
+};
+
+extern std::atomic<bool> g_enabled;
+
+inline bool enabled()
+{
+	return g_enabled.load(std::memory_order_relaxed);
+}
+
+void setEnabled(bool on);
+
+// callbacks that take at least this long are logged. 0 to disable
+void setSlowCallbackThreshold(qint64 usecs);
+
+void recordIteration(qint64 usecs);
+void recordCallback(Source source, qint64 usecs);
+void recordTimerLag(qint64 usecs);
+
+quint64 callbackCount(Source source);
+
+// exports the histograms through the stats manager's prometheus output
+void addToPrometheus(StatsManager *stats);
+
+}
+
+#endif
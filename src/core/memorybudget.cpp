@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "memorybudget.h"
+
+#include <QString>
+#include "statsmanager.h"
+
+static std::atomic<qint64> g_budget(0);
+static std::atomic<qint64> g_used(0);
+static std::atomic<qint64> g_pools[MemoryBudget::PoolCount];
+
+void MemoryBudget::setBudget(qint64 bytes)
+{
+	g_budget = bytes;
+}
+
+qint64 MemoryBudget::budget()
+{
+	return g_budget.load(std::memory_order_relaxed);
+}
+
+void MemoryBudget::charge(Pool pool, qint64 bytes)
+{
+	g_pools[pool].fetch_add(bytes, std::memory_order_relaxed);
+	g_used.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+qint64 MemoryBudget::used()
+{
+	return g_used.load(std::memory_order_relaxed);
+}
+
+qint64 MemoryBudget::used(Pool pool)
+{
+	return g_pools[pool].load(std::memory_order_relaxed);
+}
+
+bool MemoryBudget::exceeded()
+{
+	qint64 budget = g_budget.load(std::memory_order_relaxed);
+
+	return (budget > 0 && g_used.load(std::memory_order_relaxed) > budget);
+}
+
+const std::atomic<qint64> *MemoryBudget::counter(Pool pool)
+{
+	return &g_pools[pool];
+}
+
+const char *MemoryBudget::poolName(Pool pool)
+{
+	switch(pool)
+	{
+		case Streams: return "streams";
+		case PublishQueues: return "publish_queues";
+		default: return "";
+	}
+}
+
+void MemoryBudget::addToPrometheus(StatsManager *stats, const QString &extraLabels)
+{
+	for(int n = 0; n < PoolCount; ++n)
+	{
+		QString labels = QString("pool=\"%1\"").arg(poolName((Pool)n));
+		if(!extraLabels.isEmpty())
+			labels += "," + extraLabels;
+
+		stats->addPrometheusGauge("memory_pool_bytes", "Bytes held in buffers tracked by the memory budget", labels, &g_pools[n]);
+	}
+}
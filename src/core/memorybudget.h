@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef MEMORYBUDGET_H
+#define MEMORYBUDGET_H
+
+#include <atomic>
+#include <QtGlobal>
+
+class QString;
+class StatsManager;
+
+// process-wide accounting of buffered data. subsystems charge the bytes
+// they hold to a pool and release them when done. when the total exceeds
+// the budget, they apply backpressure: readers stop taking input, stream
+// windows shrink, and optional work is dropped. the counters may be
+// updated from any thread
+class MemoryBudget
+{
+public:
+	enum Pool
+	{
+		Streams, // response data received from origins, not yet read
+		PublishQueues, // published items queued for delivery to sessions
+		PoolCount
+	};
+
+	// a budget of zero means unlimited
+	static void setBudget(qint64 bytes);
+	static qint64 budget();
+
+	static void charge(Pool pool, qint64 bytes);
+	static void release(Pool pool, qint64 bytes) { charge(pool, -bytes); }
+
+	static qint64 used();
+	static qint64 used(Pool pool);
+
+	static bool exceeded();
+
+	// for exporting as a gauge. valid for the lifetime of the process
+	static const std::atomic<qint64> *counter(Pool pool);
+	static const char *poolName(Pool pool);
+
+	// registers a gauge per pool. extraLabels are appended to each
+	static void addToPrometheus(StatsManager *stats, const QString &extraLabels);
+};
+
+#endif
@@ -14,8 +14,10 @@
  * limitations under the License.
  */
 
+pub mod affinity;
 pub mod arena;
 pub mod buffer;
+pub mod capacity;
 pub mod channel;
 pub mod config;
 pub mod defer;
@@ -23,6 +25,7 @@ pub mod event;
 pub mod eventloop;
 pub mod executor;
 pub mod fs;
+pub mod gzip;
 pub mod http1;
 pub mod io;
 pub mod jwt;
@@ -37,6 +40,7 @@ pub mod test;
 pub mod time;
 pub mod timer;
 pub mod tnetstring;
+pub mod uring;
 pub mod waker;
 pub mod zmq;
 
@@ -136,6 +140,96 @@ mod tests {
         unsafe { ffi::eventloop_test(out_ex) == 0 }
     }
 
+    fn tnetstring_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::tnetstring_test(out_ex) == 0 }
+    }
+
+    fn latencyhistogram_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::latencyhistogram_test(out_ex) == 0 }
+    }
+
+    fn statsmanager_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::statsmanager_test(out_ex) == 0 }
+    }
+
+    fn trace_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::trace_test(out_ex) == 0 }
+    }
+
+    fn log_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::log_test(out_ex) == 0 }
+    }
+
+    fn bufferlist_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::bufferlist_test(out_ex) == 0 }
+    }
+
+    fn flowwindow_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::flowwindow_test(out_ex) == 0 }
+    }
+
+    fn httpheaderindex_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::httpheaderindex_test(out_ex) == 0 }
+    }
+
+    fn ringqueue_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::ringqueue_test(out_ex) == 0 }
+    }
+
+    fn ridtable_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::ridtable_test(out_ex) == 0 }
+    }
+
+    fn fastsignal_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::fastsignal_test(out_ex) == 0 }
+    }
+
+    fn arena_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::arena_test(out_ex) == 0 }
+    }
+
+    fn uuidutil_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::uuidutil_test(out_ex) == 0 }
+    }
+
+    fn gzip_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::gzip_test(out_ex) == 0 }
+    }
+
+    fn topk_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::topk_test(out_ex) == 0 }
+    }
+
+    fn objectstats_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::objectstats_test(out_ex) == 0 }
+    }
+
+    fn packetcapture_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::packetcapture_test(out_ex) == 0 }
+    }
+
+    fn tracecontext_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::tracecontext_test(out_ex) == 0 }
+    }
+
     #[test]
     fn httpheaders() {
         run_serial(httpheaders_test);
@@ -170,4 +264,94 @@ mod tests {
     fn eventloop() {
         run_serial(eventloop_test);
     }
+
+    #[test]
+    fn tnetstring() {
+        run_serial(tnetstring_test);
+    }
+
+    #[test]
+    fn latencyhistogram() {
+        run_serial(latencyhistogram_test);
+    }
+
+    #[test]
+    fn statsmanager() {
+        run_serial(statsmanager_test);
+    }
+
+    #[test]
+    fn trace() {
+        run_serial(trace_test);
+    }
+
+    #[test]
+    fn log() {
+        run_serial(log_test);
+    }
+
+    #[test]
+    fn bufferlist() {
+        run_serial(bufferlist_test);
+    }
+
+    #[test]
+    fn flowwindow() {
+        run_serial(flowwindow_test);
+    }
+
+    #[test]
+    fn httpheaderindex() {
+        run_serial(httpheaderindex_test);
+    }
+
+    #[test]
+    fn ringqueue() {
+        run_serial(ringqueue_test);
+    }
+
+    #[test]
+    fn ridtable() {
+        run_serial(ridtable_test);
+    }
+
+    #[test]
+    fn fastsignal() {
+        run_serial(fastsignal_test);
+    }
+
+    #[test]
+    fn arena() {
+        run_serial(arena_test);
+    }
+
+    #[test]
+    fn uuidutil() {
+        run_serial(uuidutil_test);
+    }
+
+    #[test]
+    fn gzip() {
+        run_serial(gzip_test);
+    }
+
+    #[test]
+    fn topk() {
+        run_serial(topk_test);
+    }
+
+    #[test]
+    fn objectstats() {
+        run_serial(objectstats_test);
+    }
+
+    #[test]
+    fn packetcapture() {
+        run_serial(packetcapture_test);
+    }
+
+    #[test]
+    fn tracecontext() {
+        run_serial(tracecontext_test);
+    }
 }
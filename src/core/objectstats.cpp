@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "objectstats.h"
+
+#include <stdint.h>
+#include <malloc.h>
+#include <QString>
+#include "statsmanager.h"
+
+// resolved at link time only if jemalloc is linked
+extern "C" int mallctl(const char *name, void *oldp, size_t *oldlenp, void *newp, size_t newlen) __attribute__((weak));
+
+static std::atomic<qint64> g_objects[ObjectStats::KindCount];
+static std::atomic<qint64> g_bytes[ObjectStats::KindCount];
+static std::atomic<qint64> g_allocator[ObjectStats::AllocatorStatCount];
+static std::atomic<const char *> g_allocatorName(0);
+
+void ObjectStats::add(Kind kind, qint64 objects, qint64 bytes)
+{
+	g_objects[kind].fetch_add(objects, std::memory_order_relaxed);
+	g_bytes[kind].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+qint64 ObjectStats::objects(Kind kind)
+{
+	return g_objects[kind].load(std::memory_order_relaxed);
+}
+
+qint64 ObjectStats::bytes(Kind kind)
+{
+	return g_bytes[kind].load(std::memory_order_relaxed);
+}
+
+const char *ObjectStats::kindName(Kind kind)
+{
+	switch(kind)
+	{
+		case HttpSessions: return "http_sessions";
+		case WsSessions: return "ws_sessions";
+		case StatsConnections: return "stats_connections";
+		case SequencerItems: return "sequencer_items";
+		case PublishLastIdEntries: return "publish_last_ids";
+		case RateLimiterBuckets: return "rate_limiter_buckets";
+		default: return "";
+	}
+}
+
+qint64 ObjectStats::stringBytes(const QString &s)
+{
+	// shared or empty strings own no data
+	if(s.isEmpty())
+		return 0;
+
+	return (qint64)s.capacity() * sizeof(QChar);
+}
+
+static bool readJemallocStat(const char *name, qint64 *out)
+{
+	size_t value = 0;
+	size_t len = sizeof(value);
+
+	if(mallctl(name, &value, &len, 0, 0) != 0)
+		return false;
+
+	*out = (qint64)value;
+	return true;
+}
+
+bool ObjectStats::updateAllocatorStats()
+{
+	qint64 allocated = 0;
+	qint64 mapped = 0;
+
+	if(mallctl)
+	{
+		// stats are cached until the epoch is advanced
+		uint64_t epoch = 1;
+		size_t len = sizeof(epoch);
+		mallctl("epoch", &epoch, &len, &epoch, len);
+
+		if(!readJemallocStat("stats.allocated", &allocated) || !readJemallocStat("stats.mapped", &mapped))
+			return false;
+
+		g_allocatorName = "jemalloc";
+	}
+	else
+	{
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+		struct mallinfo2 mi = mallinfo2();
+
+		allocated = (qint64)(mi.uordblks + mi.hblkhd);
+		mapped = (qint64)(mi.arena + mi.hblkhd);
+
+		g_allocatorName = "glibc";
+#else
+		return false;
+#endif
+	}
+
+	g_allocator[AllocatorAllocated] = allocated;
+	g_allocator[AllocatorMapped] = mapped;
+
+	return true;
+}
+
+const char *ObjectStats::allocatorName()
+{
+	return g_allocatorName.load(std::memory_order_relaxed);
+}
+
+qint64 ObjectStats::allocatorStat(AllocatorStat stat)
+{
+	return g_allocator[stat].load(std::memory_order_relaxed);
+}
+
+void ObjectStats::addToPrometheus(StatsManager *stats)
+{
+	for(int n = 0; n < KindCount; ++n)
+	{
+		QString labels = QString("kind=\"%1\"").arg(kindName((Kind)n));
+		stats->addPrometheusGauge("objects", "Live objects, by subsystem", labels, &g_objects[n]);
+	}
+
+	for(int n = 0; n < KindCount; ++n)
+	{
+		QString labels = QString("kind=\"%1\"").arg(kindName((Kind)n));
+		stats->addPrometheusGauge("object_bytes", "Estimated bytes held by live objects, by subsystem", labels, &g_bytes[n]);
+	}
+
+	stats->addPrometheusGauge("allocator_allocated_bytes", "Heap bytes in use, as reported by the allocator", QString(), &g_allocator[AllocatorAllocated]);
+	stats->addPrometheusGauge("allocator_mapped_bytes", "Heap bytes obtained from the system, as reported by the allocator", QString(), &g_allocator[AllocatorMapped]);
+}
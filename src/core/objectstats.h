@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef OBJECTSTATS_H
+#define OBJECTSTATS_H
+
+#include <atomic>
+#include <QtGlobal>
+
+class QString;
+class StatsManager;
+
+// process-wide counts of long-lived objects and estimated bytes, per
+// subsystem, for telling what is using memory without a heap profiler.
+// subsystems update the counters as objects come and go. estimates cover
+// the objects and the strings they own, not container overhead, which is
+// reflected in the allocator stats instead. the counters may be updated
+// from any thread
+class ObjectStats
+{
+public:
+	enum Kind
+	{
+		HttpSessions,
+		WsSessions,
+		StatsConnections,
+		SequencerItems,
+		PublishLastIdEntries,
+		RateLimiterBuckets,
+		KindCount
+	};
+
+	enum AllocatorStat
+	{
+		AllocatorAllocated, // in use by the application
+		AllocatorMapped, // obtained from the system
+		AllocatorStatCount
+	};
+
+	static void add(Kind kind, qint64 objects, qint64 bytes);
+	static void remove(Kind kind, qint64 objects, qint64 bytes) { add(kind, -objects, -bytes); }
+
+	static qint64 objects(Kind kind);
+	static qint64 bytes(Kind kind);
+	static const char *kindName(Kind kind);
+
+	// estimated heap bytes for a string's contents
+	static qint64 stringBytes(const QString &s);
+
+	// samples the allocator. uses jemalloc if it is linked, otherwise
+	// glibc malloc. returns false if neither is available. not cheap with
+	// many arenas, so call it periodically rather than per request
+	static bool updateAllocatorStats();
+
+	// name of the sampled allocator, or null if none
+	static const char *allocatorName();
+	static qint64 allocatorStat(AllocatorStat stat);
+
+	// registers gauges for the object kinds and the allocator
+	static void addToPrometheus(StatsManager *stats);
+};
+
+#endif
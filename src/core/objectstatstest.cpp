@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "test.h"
+#include "objectstats.h"
+
+static void counts()
+{
+	qint64 objects = ObjectStats::objects(ObjectStats::SequencerItems);
+	qint64 bytes = ObjectStats::bytes(ObjectStats::SequencerItems);
+
+	ObjectStats::add(ObjectStats::SequencerItems, 2, 100);
+	TEST_ASSERT_EQ(ObjectStats::objects(ObjectStats::SequencerItems), objects + 2);
+	TEST_ASSERT_EQ(ObjectStats::bytes(ObjectStats::SequencerItems), bytes + 100);
+
+	ObjectStats::remove(ObjectStats::SequencerItems, 2, 100);
+	TEST_ASSERT_EQ(ObjectStats::objects(ObjectStats::SequencerItems), objects);
+	TEST_ASSERT_EQ(ObjectStats::bytes(ObjectStats::SequencerItems), bytes);
+
+	TEST_ASSERT_EQ(QString(ObjectStats::kindName(ObjectStats::HttpSessions)), QString("http_sessions"));
+	TEST_ASSERT_EQ(ObjectStats::stringBytes(QString()), 0);
+	TEST_ASSERT(ObjectStats::stringBytes("hello") >= 10);
+}
+
+static void allocator()
+{
+	if(!ObjectStats::updateAllocatorStats())
+	{
+		// no supported allocator
+		TEST_ASSERT(!ObjectStats::allocatorName());
+		return;
+	}
+
+	TEST_ASSERT(ObjectStats::allocatorName());
+	TEST_ASSERT(ObjectStats::allocatorStat(ObjectStats::AllocatorAllocated) > 0);
+	TEST_ASSERT(ObjectStats::allocatorStat(ObjectStats::AllocatorMapped) > 0);
+}
+
+extern "C" int objectstats_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(counts());
+	TEST_CATCH(allocator());
+
+	return 0;
+}
@@ -143,6 +143,174 @@ QVariant RetryRequestPacket::toVariant() const
 	return obj;
 }
 
+void RetryRequestPacket::writeTo(TnetString::Writer &w) const
+{
+	w.startHash();
+
+	w.writeByteArray("requests");
+	w.startList();
+	foreach(const Request &r, requests)
+	{
+		w.startHash();
+
+		w.writeByteArray("rid");
+		w.startHash();
+		w.writeByteArray("sender");
+		w.writeByteArray(r.rid.first);
+		w.writeByteArray("id");
+		w.writeByteArray(r.rid.second);
+		w.end();
+
+		if(r.https)
+		{
+			w.writeByteArray("https");
+			w.writeBool(true);
+		}
+
+		if(!r.peerAddress.isNull())
+		{
+			w.writeByteArray("peer-address");
+			w.writeByteArray(r.peerAddress.toString().toUtf8());
+		}
+
+		if(r.debug)
+		{
+			w.writeByteArray("debug");
+			w.writeBool(true);
+		}
+
+		if(r.autoCrossOrigin)
+		{
+			w.writeByteArray("auto-cross-origin");
+			w.writeBool(true);
+		}
+
+		if(!r.jsonpCallback.isEmpty())
+		{
+			w.writeByteArray("jsonp-callback");
+			w.writeByteArray(r.jsonpCallback);
+		}
+
+		if(r.jsonpExtendedResponse)
+		{
+			w.writeByteArray("jsonp-extended-response");
+			w.writeBool(true);
+		}
+
+		if(r.unreportedTime > 0)
+		{
+			w.writeByteArray("unreported-time");
+			w.writeInt(r.unreportedTime);
+		}
+
+		w.writeByteArray("in-seq");
+		w.writeInt(r.inSeq);
+		w.writeByteArray("out-seq");
+		w.writeInt(r.outSeq);
+		w.writeByteArray("out-credits");
+		w.writeInt(r.outCredits);
+
+		if(r.routerResp)
+		{
+			w.writeByteArray("router-resp");
+			w.writeBool(true);
+		}
+
+		if(r.userData.isValid())
+		{
+			w.writeByteArray("user-data");
+			w.writeVariant(r.userData);
+		}
+
+		w.end();
+	}
+	w.end();
+
+	w.writeByteArray("request-data");
+	w.startHash();
+
+	w.writeByteArray("method");
+	w.writeByteArray(requestData.method.toLatin1());
+	w.writeByteArray("uri");
+	w.writeByteArray(requestData.uri.toEncoded());
+
+	w.writeByteArray("headers");
+	w.startList();
+	foreach(const HttpHeader &h, requestData.headers)
+	{
+		w.startList();
+		w.writeByteArray(h.first);
+		w.writeByteArray(h.second);
+		w.end();
+	}
+	w.end();
+
+	w.writeByteArray("body");
+	w.writeByteArray(requestData.body);
+
+	w.end();
+
+	if(haveInspectInfo)
+	{
+		w.writeByteArray("inspect");
+		w.startHash();
+
+		w.writeByteArray("no-proxy");
+		w.writeBool(!inspectInfo.doProxy);
+
+		if(!inspectInfo.sharingKey.isEmpty())
+		{
+			w.writeByteArray("sharing-key");
+			w.writeByteArray(inspectInfo.sharingKey);
+		}
+
+		if(!inspectInfo.sid.isEmpty())
+		{
+			w.writeByteArray("sid");
+			w.writeByteArray(inspectInfo.sid);
+		}
+
+		if(!inspectInfo.lastIds.isEmpty())
+		{
+			w.writeByteArray("last-ids");
+			w.startHash();
+
+			QHashIterator<QByteArray, QByteArray> it(inspectInfo.lastIds);
+			while(it.hasNext())
+			{
+				it.next();
+
+				w.writeByteArray(it.key());
+				w.writeByteArray(it.value());
+			}
+
+			w.end();
+		}
+
+		if(inspectInfo.userData.isValid())
+		{
+			w.writeByteArray("user-data");
+			w.writeVariant(inspectInfo.userData);
+		}
+
+		w.end();
+	}
+
+	if(!route.isEmpty())
+	{
+		w.writeByteArray("route");
+		w.writeByteArray(route);
+	}
+
+	if(retrySeq >= 0)
+	{
+		w.writeByteArray("retry-seq");
+		w.writeInt(retrySeq);
+	}
+
+	w.end();
+}
+
 bool RetryRequestPacket::fromVariant(const QVariant &in)
 {
 	if(typeId(in) != QMetaType::QVariantHash)
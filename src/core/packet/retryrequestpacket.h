@@ -27,6 +27,7 @@
 #include <QVariant>
 #include <QHostAddress>
 #include "httprequestdata.h"
+#include "tnetstring.h"
 
 class RetryRequestPacket
 {
@@ -94,6 +95,9 @@ public:
 
 	QVariant toVariant() const;
 	bool fromVariant(const QVariant &in);
+
+	// encodes directly into the writer's buffer, without building a variant
+	void writeTo(TnetString::Writer &w) const;
 };
 
 #endif
@@ -23,8 +23,141 @@
 
 #include "statspacket.h"
 
+#include <assert.h>
 #include "qtcompat.h"
 
+#define BINARY_VERSION 1
+#define BINARY_STRING_NULL 0xffff
+#define BINARY_STRING_MAX 0xfffe
+
+#define BINARY_CONN_DISCONNECTED 0x01
+#define BINARY_CONN_WEBSOCKET 0x02
+#define BINARY_CONN_SSL 0x04
+
+// integers are big endian. strings are prefixed with a 16-bit length, and
+// a length of BINARY_STRING_NULL means null
+static void writeU8(QByteArray *out, quint8 x)
+{
+	out->append((char)x);
+}
+
+static void writeU16(QByteArray *out, quint16 x)
+{
+	out->append((char)(x >> 8));
+	out->append((char)(x & 0xff));
+}
+
+static void writeI32(QByteArray *out, qint32 x)
+{
+	quint32 u = (quint32)x;
+
+	out->append((char)(u >> 24));
+	out->append((char)((u >> 16) & 0xff));
+	out->append((char)((u >> 8) & 0xff));
+	out->append((char)(u & 0xff));
+}
+
+static void writeString(QByteArray *out, const QByteArray &s)
+{
+	if(s.isNull())
+	{
+		writeU16(out, BINARY_STRING_NULL);
+		return;
+	}
+
+	int len = qMin((int)s.size(), BINARY_STRING_MAX);
+	writeU16(out, (quint16)len);
+	out->append(s.constData(), len);
+}
+
+namespace {
+
+class BinaryReader
+{
+public:
+	bool ok;
+
+	BinaryReader(const QByteArray &buf, int offset) :
+		ok(true),
+		buf_(buf),
+		pos_(offset)
+	{
+	}
+
+	bool atEnd() const { return pos_ >= buf_.size(); }
+
+	quint8 readU8()
+	{
+		if(!ensure(1))
+			return 0;
+
+		return (quint8)buf_[pos_++];
+	}
+
+	quint16 readU16()
+	{
+		if(!ensure(2))
+			return 0;
+
+		const uchar *p = (const uchar *)buf_.constData() + pos_;
+		pos_ += 2;
+
+		return (quint16)((p[0] << 8) | p[1]);
+	}
+
+	qint32 readI32()
+	{
+		if(!ensure(4))
+			return 0;
+
+		const uchar *p = (const uchar *)buf_.constData() + pos_;
+		pos_ += 4;
+
+		return (qint32)(((quint32)p[0] << 24) | ((quint32)p[1] << 16) | ((quint32)p[2] << 8) | (quint32)p[3]);
+	}
+
+	QByteArray readBytes(int len)
+	{
+		if(!ensure(len))
+			return QByteArray();
+
+		QByteArray out(buf_.constData() + pos_, len);
+		pos_ += len;
+
+		return out;
+	}
+
+	QByteArray readString()
+	{
+		quint16 len = readU16();
+		if(!ok || len == BINARY_STRING_NULL)
+			return QByteArray();
+
+		// distinguish empty from null
+		if(len == 0)
+			return QByteArray("");
+
+		return readBytes(len);
+	}
+
+private:
+	const QByteArray &buf_;
+	int pos_;
+
+	bool ensure(int len)
+	{
+		if(!ok || pos_ + len > buf_.size())
+		{
+			ok = false;
+			return false;
+		}
+
+		return true;
+	}
+};
+
+}
+
 static bool tryGetInt(const QVariantHash &obj, const QString &name, int *result)
 {
 	if(obj.contains(name))
@@ -156,12 +289,53 @@ QVariant StatsPacket::toVariant() const
 			obj["server-messages-received"] = serverMessagesReceived;
 		if(serverMessagesSent >= 0)
 			obj["server-messages-sent"] = serverMessagesSent;
+		if(filterCacheHits >= 0)
+			obj["filter-cache-hits"] = filterCacheHits;
+		if(filterCacheMisses >= 0)
+			obj["filter-cache-misses"] = filterCacheMisses;
+		if(idCacheDuplicates >= 0)
+			obj["id-cache-duplicates"] = idCacheDuplicates;
+		if(idCacheUncached >= 0)
+			obj["id-cache-uncached"] = idCacheUncached;
+		if(streamMessagesSent >= 0)
+			obj["stream-messages-sent"] = streamMessagesSent;
+		if(streamBodyWrites >= 0)
+			obj["stream-body-writes"] = streamBodyWrites;
+		if(messagesExpired >= 0)
+			obj["messages-expired"] = messagesExpired;
+		if(slowConsumerDrops >= 0)
+			obj["slow-consumer-drops"] = slowConsumerDrops;
+		if(slowConsumerDisconnects >= 0)
+			obj["slow-consumer-disconnects"] = slowConsumerDisconnects;
 	}
 	else if(type == Counts)
 	{
 		if(requestsReceived > 0)
 			obj["requests-received"] = requestsReceived;
 	}
+	else if(type == Messages)
+	{
+		QVariantList vtotals;
+
+		foreach(const MessageTotal &t, messageTotals)
+		{
+			QVariantHash vt;
+			vt["channel"] = t.channel;
+			vt["transport"] = t.transport;
+			vt["messages"] = qMax(t.messages, 0);
+			vt["count"] = qMax(t.count, 0);
+
+			if(t.blocks >= 0)
+				vt["blocks"] = t.blocks;
+
+			vtotals += vt;
+		}
+
+		obj["totals"] = vtotals;
+
+		if(duration >= 0)
+			obj["duration"] = duration;
+	}
 	else // ConnectionsMax
 	{
 		obj["max"] = qMax(connectionsMax, 0);
@@ -435,6 +609,24 @@ bool StatsPacket::fromVariant(const QByteArray &_type, const QVariant &in)
 			return false;
 		if(!tryGetInt(obj, "server-messages-sent", &serverMessagesSent))
 			return false;
+		if(!tryGetInt(obj, "filter-cache-hits", &filterCacheHits))
+			return false;
+		if(!tryGetInt(obj, "filter-cache-misses", &filterCacheMisses))
+			return false;
+		if(!tryGetInt(obj, "id-cache-duplicates", &idCacheDuplicates))
+			return false;
+		if(!tryGetInt(obj, "id-cache-uncached", &idCacheUncached))
+			return false;
+		if(!tryGetInt(obj, "stream-messages-sent", &streamMessagesSent))
+			return false;
+		if(!tryGetInt(obj, "stream-body-writes", &streamBodyWrites))
+			return false;
+		if(!tryGetInt(obj, "messages-expired", &messagesExpired))
+			return false;
+		if(!tryGetInt(obj, "slow-consumer-drops", &slowConsumerDrops))
+			return false;
+		if(!tryGetInt(obj, "slow-consumer-disconnects", &slowConsumerDisconnects))
+			return false;
 	}
 	else if(_type == "counts")
 	{
@@ -486,8 +678,186 @@ bool StatsPacket::fromVariant(const QByteArray &_type, const QVariant &in)
 			retrySeq = x;
 		}
 	}
+	else if(_type == "messages")
+	{
+		type = Messages;
+
+		if(!obj.contains("totals") || typeId(obj["totals"]) != QMetaType::QVariantList)
+			return false;
+
+		foreach(const QVariant &vt, obj["totals"].toList())
+		{
+			if(typeId(vt) != QMetaType::QVariantHash)
+				return false;
+
+			QVariantHash tobj = vt.toHash();
+
+			MessageTotal t;
+
+			if(!tobj.contains("channel") || typeId(tobj["channel"]) != QMetaType::QByteArray)
+				return false;
+
+			t.channel = tobj["channel"].toByteArray();
+
+			if(!tobj.contains("transport") || typeId(tobj["transport"]) != QMetaType::QByteArray)
+				return false;
+
+			t.transport = tobj["transport"].toByteArray();
+
+			if(!tryGetInt(tobj, "messages", &t.messages) || t.messages < 0)
+				return false;
+
+			if(!tryGetInt(tobj, "count", &t.count) || t.count < 0)
+				return false;
+
+			if(!tryGetInt(tobj, "blocks", &t.blocks))
+				return false;
+
+			messageTotals += t;
+		}
+
+		if(!tryGetInt(obj, "duration", &duration))
+			return false;
+	}
 	else
 		return false;
 
 	return true;
 }
+
+bool StatsPacket::canEncodeBinary(Type type)
+{
+	return (type == Message || type == Connected || type == Disconnected);
+}
+
+QByteArray StatsPacket::toBinary() const
+{
+	assert(canEncodeBinary(type));
+
+	QByteArray out;
+	out.reserve(64 + from.size() + route.size() + channel.size() + itemId.size() + connectionId.size());
+
+	writeU8(&out, BINARY_VERSION);
+	writeString(&out, from);
+	writeString(&out, route);
+
+	if(type == Message)
+	{
+		writeString(&out, channel);
+		writeString(&out, itemId);
+		writeString(&out, transport);
+		writeI32(&out, qMax(count, 0));
+		writeI32(&out, blocks >= 0 ? blocks : -1);
+	}
+	else // Connected, Disconnected
+	{
+		writeString(&out, connectionId);
+
+		quint8 flags = 0;
+		if(type == Disconnected)
+			flags |= BINARY_CONN_DISCONNECTED;
+		if(connectionType == WebSocket)
+			flags |= BINARY_CONN_WEBSOCKET;
+		if(ssl)
+			flags |= BINARY_CONN_SSL;
+
+		writeU8(&out, flags);
+		writeI32(&out, type == Connected ? qMax(ttl, 0) : -1);
+
+		if(type == Connected && peerAddress.protocol() == QAbstractSocket::IPv4Protocol)
+		{
+			writeU8(&out, 4);
+			writeI32(&out, (qint32)peerAddress.toIPv4Address());
+		}
+		else if(type == Connected && peerAddress.protocol() == QAbstractSocket::IPv6Protocol)
+		{
+			Q_IPV6ADDR a = peerAddress.toIPv6Address();
+
+			writeU8(&out, 16);
+			out.append((const char *)a.c, 16);
+		}
+		else
+		{
+			writeU8(&out, 0);
+		}
+	}
+
+	return out;
+}
+
+bool StatsPacket::fromBinary(const QByteArray &_type, const QByteArray &in, int offset)
+{
+	BinaryReader r(in, offset);
+
+	if(r.readU8() != BINARY_VERSION || !r.ok)
+		return false;
+
+	QByteArray _from = r.readString();
+	QByteArray _route = r.readString();
+
+	if(_type == "message")
+	{
+		type = Message;
+
+		channel = r.readString();
+		itemId = r.readString();
+		transport = r.readString();
+		count = r.readI32();
+		blocks = r.readI32();
+
+		if(!r.ok || channel.isNull() || transport.isNull() || count < 0)
+			return false;
+	}
+	else if(_type == "conn")
+	{
+		connectionId = r.readString();
+
+		quint8 flags = r.readU8();
+		type = (flags & BINARY_CONN_DISCONNECTED) ? Disconnected : Connected;
+
+		int _ttl = r.readI32();
+
+		quint8 addrLen = r.readU8();
+		if(addrLen == 4)
+		{
+			peerAddress = QHostAddress((quint32)r.readI32());
+		}
+		else if(addrLen == 16)
+		{
+			QByteArray a = r.readBytes(16);
+			if(r.ok)
+				peerAddress = QHostAddress((const quint8 *)a.constData());
+		}
+		else if(addrLen != 0)
+		{
+			return false;
+		}
+
+		if(!r.ok || connectionId.isNull())
+			return false;
+
+		if(type == Connected)
+		{
+			connectionType = (flags & BINARY_CONN_WEBSOCKET) ? WebSocket : Http;
+			ssl = (flags & BINARY_CONN_SSL);
+
+			if(_ttl < 0)
+				return false;
+
+			ttl = _ttl;
+		}
+	}
+	else
+		return false;
+
+	if(!r.atEnd())
+		return false;
+
+	if(!_from.isEmpty())
+		from = _from;
+
+	if(!_route.isEmpty())
+		route = _route;
+
+	return true;
+}
@@ -25,6 +25,7 @@
 #define STATSPACKET_H
 
 #include <QByteArray>
+#include <QList>
 #include <QVariant>
 #include <QHostAddress>
 
@@ -42,6 +43,7 @@ public:
 		Report,
 		Counts,
 		ConnectionsMax,
+		Messages
 	};
 
 	enum ConnectionType
@@ -50,6 +52,24 @@ public:
 		WebSocket
 	};
 
+	// publish counts for one channel and transport, aggregated over a window
+	class MessageTotal
+	{
+	public:
+		QByteArray channel;
+		QByteArray transport;
+		int messages;
+		int count;
+		int blocks;
+
+		MessageTotal() :
+			messages(0),
+			count(0),
+			blocks(-1)
+		{
+		}
+	};
+
 	Type type;
 	QByteArray from;
 	QByteArray route;
@@ -73,7 +93,7 @@ public:
 	int httpResponseMessagesSent; // report
 	int blocksReceived; // report
 	int blocksSent; // report
-	int duration; // report
+	int duration; // report, messages
 	int requestsReceived; // counts
 	int clientHeaderBytesReceived; // report
 	int clientHeaderBytesSent; // report
@@ -87,6 +107,16 @@ public:
 	int serverContentBytesSent; // report
 	int serverMessagesReceived; // report
 	int serverMessagesSent; // report
+	int filterCacheHits; // report
+	int filterCacheMisses; // report
+	int idCacheDuplicates; // report
+	int idCacheUncached; // report
+	int streamMessagesSent; // report
+	int streamBodyWrites; // report
+	int messagesExpired; // report
+	int slowConsumerDrops; // report
+	int slowConsumerDisconnects; // report
+	QList<MessageTotal> messageTotals; // messages
 
 	StatsPacket() :
 		type((Type)-1),
@@ -117,12 +147,28 @@ public:
 		serverContentBytesReceived(-1),
 		serverContentBytesSent(-1),
 		serverMessagesReceived(-1),
-		serverMessagesSent(-1)
+		serverMessagesSent(-1),
+		filterCacheHits(-1),
+		filterCacheMisses(-1),
+		idCacheDuplicates(-1),
+		idCacheUncached(-1),
+		streamMessagesSent(-1),
+		streamBodyWrites(-1),
+		messagesExpired(-1),
+		slowConsumerDrops(-1),
+		slowConsumerDisconnects(-1)
 	{
 	}
 
 	QVariant toVariant() const;
 	bool fromVariant(const QByteArray &type, const QVariant &in);
+
+	// compact fixed-layout encoding, only available for the high volume
+	// conn and message packets. the data begins with a version byte.
+	// fromBinary decodes from offset to the end of the buffer
+	static bool canEncodeBinary(Type type);
+	QByteArray toBinary() const;
+	bool fromBinary(const QByteArray &type, const QByteArray &in, int offset = 0);
 };
 
 #endif
@@ -236,6 +236,9 @@ QVariant WsControlPacket::toVariant() const
 		if(!item.keepAliveMode.isEmpty())
 			vitem["keep-alive-mode"] = item.keepAliveMode;
 
+		if(!item.coalesce.isEmpty())
+			vitem["coalesce"] = item.coalesce;
+
 		vitems += vitem;
 	}
 
@@ -243,6 +246,159 @@ QVariant WsControlPacket::toVariant() const
 	return obj;
 }
 
+void WsControlPacket::writeTo(TnetString::Writer &w) const
+{
+	w.startHash();
+
+	w.writeByteArray("from");
+	w.writeByteArray(from);
+
+	w.writeByteArray("items");
+	w.startList();
+	foreach(const Item &item, items)
+	{
+		w.startHash();
+
+		w.writeByteArray("cid");
+		w.writeByteArray(item.cid);
+
+		const char *typeStr = 0;
+		switch(item.type)
+		{
+			case Item::Here:           typeStr = "here"; break;
+			case Item::KeepAlive:      typeStr = "keep-alive"; break;
+			case Item::Gone:           typeStr = "gone"; break;
+			case Item::Grip:           typeStr = "grip"; break;
+			case Item::KeepAliveSetup: typeStr = "keep-alive-setup"; break;
+			case Item::Cancel:         typeStr = "cancel"; break;
+			case Item::Send:           typeStr = "send"; break;
+			case Item::NeedKeepAlive:  typeStr = "need-keep-alive"; break;
+			case Item::Subscribe:      typeStr = "subscribe"; break;
+			case Item::Refresh:        typeStr = "refresh"; break;
+			case Item::Close:          typeStr = "close"; break;
+			case Item::Detach:         typeStr = "detach"; break;
+			case Item::Ack:            typeStr = "ack"; break;
+			default:
+				assert(0);
+		}
+		w.writeByteArray("type");
+		w.writeByteArray(typeStr);
+
+		if(!item.requestId.isEmpty())
+		{
+			w.writeByteArray("req-id");
+			w.writeByteArray(item.requestId);
+		}
+
+		if(!item.uri.isEmpty())
+		{
+			w.writeByteArray("uri");
+			w.writeByteArray(item.uri.toEncoded());
+		}
+
+		if(!item.contentType.isEmpty())
+		{
+			w.writeByteArray("content-type");
+			w.writeByteArray(item.contentType);
+		}
+
+		if(!item.message.isNull())
+		{
+			w.writeByteArray("message");
+			w.writeByteArray(item.message);
+		}
+
+		if(item.queue)
+		{
+			w.writeByteArray("queue");
+			w.writeBool(true);
+		}
+
+		if(item.code >= 0)
+		{
+			w.writeByteArray("code");
+			w.writeInt(item.code);
+		}
+
+		if(!item.reason.isEmpty())
+		{
+			w.writeByteArray("reason");
+			w.writeByteArray(item.reason);
+		}
+
+		if(item.debug)
+		{
+			w.writeByteArray("debug");
+			w.writeBool(true);
+		}
+
+		if(!item.route.isEmpty())
+		{
+			w.writeByteArray("route");
+			w.writeByteArray(item.route);
+		}
+
+		if(item.separateStats)
+		{
+			w.writeByteArray("separate-stats");
+			w.writeBool(true);
+		}
+
+		if(!item.channelPrefix.isEmpty())
+		{
+			w.writeByteArray("channel-prefix");
+			w.writeByteArray(item.channelPrefix);
+		}
+
+		if(item.logLevel >= 0)
+		{
+			w.writeByteArray("log-level");
+			w.writeInt(item.logLevel);
+		}
+
+		if(item.trusted)
+		{
+			w.writeByteArray("trusted");
+			w.writeBool(true);
+		}
+
+		if(!item.channel.isEmpty())
+		{
+			w.writeByteArray("channel");
+			w.writeByteArray(item.channel);
+		}
+
+		if(item.ttl >= 0)
+		{
+			w.writeByteArray("ttl");
+			w.writeInt(item.ttl);
+		}
+
+		if(item.timeout >= 0)
+		{
+			w.writeByteArray("timeout");
+			w.writeInt(item.timeout);
+		}
+
+		if(!item.keepAliveMode.isEmpty())
+		{
+			w.writeByteArray("keep-alive-mode");
+			w.writeByteArray(item.keepAliveMode);
+		}
+
+		if(!item.coalesce.isEmpty())
+		{
+			w.writeByteArray("coalesce");
+			w.writeByteArray(item.coalesce);
+		}
+
+		w.end();
+	}
+	w.end();
+
+	w.end();
+}
+
 bool WsControlPacket::fromVariant(const QVariant &in)
 {
 	if(typeId(in) != QMetaType::QVariantHash)
@@ -457,8 +613,215 @@ bool WsControlPacket::fromVariant(const QVariant &in)
 				item.keepAliveMode = keepAliveMode;
 		}
 
+		if(vitem.contains("coalesce"))
+		{
+			if(typeId(vitem["coalesce"]) != QMetaType::QByteArray)
+				return false;
+
+			item.coalesce = vitem["coalesce"].toByteArray();
+		}
+
 		items += item;
 	}
 
 	return true;
 }
+
+bool WsControlPacket::fromView(const TnetString::View &in)
+{
+	if(!in.isValid() || in.type() != TnetString::Hash)
+		return false;
+
+	bool haveFrom = false;
+	bool haveItems = false;
+
+	TnetString::View::Iterator it(in);
+	while(it.next())
+	{
+		const TnetString::View &k = it.key();
+		const TnetString::View &v = it.value();
+
+		if(k.equals("from"))
+		{
+			bool ok;
+			from = v.toByteArray(&ok);
+			if(!ok)
+				return false;
+
+			haveFrom = true;
+		}
+		else if(k.equals("items"))
+		{
+			if(v.type() != TnetString::List)
+				return false;
+
+			items.clear();
+
+			TnetString::View::Iterator iit(v);
+			while(iit.next())
+			{
+				Item item;
+				if(!parseItem(iit.value(), &item))
+					return false;
+
+				items += item;
+			}
+
+			if(iit.isError())
+				return false;
+
+			haveItems = true;
+		}
+	}
+
+	if(it.isError())
+		return false;
+
+	return (haveFrom && haveItems);
+}
+
+bool WsControlPacket::parseItem(const TnetString::View &in, Item *item)
+{
+	if(in.type() != TnetString::Hash)
+		return false;
+
+	bool haveCid = false;
+	bool haveType = false;
+
+	TnetString::View::Iterator it(in);
+	while(it.next())
+	{
+		const TnetString::View &k = it.key();
+		const TnetString::View &v = it.value();
+		bool ok = true;
+
+		if(k.equals("cid"))
+		{
+			item->cid = v.toByteArray(&ok);
+			haveCid = true;
+		}
+		else if(k.equals("type"))
+		{
+			if(v.equals("here"))
+				item->type = Item::Here;
+			else if(v.equals("keep-alive"))
+				item->type = Item::KeepAlive;
+			else if(v.equals("gone"))
+				item->type = Item::Gone;
+			else if(v.equals("grip"))
+				item->type = Item::Grip;
+			else if(v.equals("keep-alive-setup"))
+				item->type = Item::KeepAliveSetup;
+			else if(v.equals("cancel"))
+				item->type = Item::Cancel;
+			else if(v.equals("send"))
+				item->type = Item::Send;
+			else if(v.equals("need-keep-alive"))
+				item->type = Item::NeedKeepAlive;
+			else if(v.equals("subscribe"))
+				item->type = Item::Subscribe;
+			else if(v.equals("refresh"))
+				item->type = Item::Refresh;
+			else if(v.equals("close"))
+				item->type = Item::Close;
+			else if(v.equals("detach"))
+				item->type = Item::Detach;
+			else if(v.equals("ack"))
+				item->type = Item::Ack;
+			else
+				ok = false;
+
+			haveType = true;
+		}
+		else if(k.equals("req-id"))
+		{
+			item->requestId = v.toByteArray(&ok);
+		}
+		else if(k.equals("uri"))
+		{
+			item->uri = QUrl::fromEncoded(v.toByteArray(&ok), QUrl::StrictMode);
+		}
+		else if(k.equals("content-type"))
+		{
+			QByteArray contentType = v.toByteArray(&ok);
+			if(!contentType.isEmpty())
+				item->contentType = contentType;
+		}
+		else if(k.equals("message"))
+		{
+			item->message = v.toByteArray(&ok);
+		}
+		else if(k.equals("queue"))
+		{
+			item->queue = v.toBool(&ok);
+		}
+		else if(k.equals("code"))
+		{
+			item->code = v.toInt(&ok);
+		}
+		else if(k.equals("reason"))
+		{
+			item->reason = v.toByteArray(&ok);
+		}
+		else if(k.equals("debug"))
+		{
+			item->debug = v.toBool(&ok);
+		}
+		else if(k.equals("route"))
+		{
+			QByteArray route = v.toByteArray(&ok);
+			if(!route.isEmpty())
+				item->route = route;
+		}
+		else if(k.equals("separate-stats"))
+		{
+			item->separateStats = v.toBool(&ok);
+		}
+		else if(k.equals("channel-prefix"))
+		{
+			QByteArray channelPrefix = v.toByteArray(&ok);
+			if(!channelPrefix.isEmpty())
+				item->channelPrefix = channelPrefix;
+		}
+		else if(k.equals("log-level"))
+		{
+			item->logLevel = v.toInt(&ok);
+		}
+		else if(k.equals("trusted"))
+		{
+			item->trusted = v.toBool(&ok);
+		}
+		else if(k.equals("channel"))
+		{
+			QByteArray channel = v.toByteArray(&ok);
+			if(!channel.isEmpty())
+				item->channel = channel;
+		}
+		else if(k.equals("ttl"))
+		{
+			item->ttl = qMax((int)v.toInt(&ok), 0);
+		}
+		else if(k.equals("timeout"))
+		{
+			item->timeout = qMax((int)v.toInt(&ok), 0);
+		}
+		else if(k.equals("keep-alive-mode"))
+		{
+			QByteArray keepAliveMode = v.toByteArray(&ok);
+			if(!keepAliveMode.isEmpty())
+				item->keepAliveMode = keepAliveMode;
+		}
+		else if(k.equals("coalesce"))
+		{
+			item->coalesce = v.toByteArray(&ok);
+		}
+
+		if(!ok)
+			return false;
+	}
+
+	if(it.isError())
+		return false;
+
+	return (haveCid && haveType);
+}
@@ -28,6 +28,7 @@
 #include <QList>
 #include <QVariant>
 #include <QUrl>
+#include "tnetstring.h"
 
 class WsControlPacket
 {
@@ -71,6 +72,7 @@ public:
 		int ttl;
 		int timeout;
 		QByteArray keepAliveMode;
+		QByteArray coalesce; // send only. "latest" or "patch", keyed by channel
 
 		Item() :
 			type((Type)-1),
@@ -91,6 +93,15 @@ public:
 
 	QVariant toVariant() const;
 	bool fromVariant(const QVariant &in);
+
+	// encodes directly into the writer's buffer, without building a variant
+	void writeTo(TnetString::Writer &w) const;
+
+	// decodes directly from tnetstring data, without building a variant
+	bool fromView(const TnetString::View &in);
+
+private:
+	static bool parseItem(const TnetString::View &in, Item *item);
 };
 
 #endif
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "packetcapture.h"
+
+#include <chrono>
+#include <QtEndian>
+#include <QFile>
+#include "log.h"
+#include "timer.h"
+
+#define FILE_HEADER "PPCAP001"
+#define BUFFER_MAX (64 * 1024)
+#define FLUSH_INTERVAL 1000
+
+static void appendUInt32(QByteArray *buf, quint32 x)
+{
+	char data[4];
+	qToBigEndian(x, data);
+	buf->append(data, 4);
+}
+
+static void appendUInt64(QByteArray *buf, quint64 x)
+{
+	char data[8];
+	qToBigEndian(x, data);
+	buf->append(data, 8);
+}
+
+PacketCapture::PacketCapture() :
+	failed_(false)
+{
+	flushTimer_ = std::make_unique<Timer>();
+	flushTimer_->setSingleShot(true);
+	// safe to not track, since flushTimer_ can't outlive this
+	flushTimer_->timeout.connect([this] {
+		flush();
+	});
+}
+
+PacketCapture::~PacketCapture()
+{
+	flush();
+}
+
+bool PacketCapture::open(const QString &fileName, QString *errorMessage)
+{
+	flush();
+
+	file_ = std::make_unique<QFile>(fileName);
+	if(!file_->open(QFile::WriteOnly | QFile::Append))
+	{
+		if(errorMessage)
+			*errorMessage = QString("failed to open %1 for writing: %2").arg(fileName, file_->errorString());
+
+		file_.reset();
+		return false;
+	}
+
+	failed_ = false;
+
+	if(file_->size() == 0)
+		buf_ += fileHeader();
+
+	return true;
+}
+
+void PacketCapture::write(Source source, const QList<QByteArray> &message)
+{
+	if(!file_ || failed_)
+		return;
+
+	// replaying needs the spacing between messages, so use the wall clock
+	// rather than the iteration's cached time
+	qint64 usecs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+	appendUInt64(&buf_, (quint64)usecs);
+	buf_ += (char)source;
+	buf_ += (char)qMin(message.count(), 255);
+
+	for(int n = 0; n < message.count() && n < 255; ++n)
+	{
+		const QByteArray &part = message[n];
+		appendUInt32(&buf_, (quint32)part.size());
+		buf_ += part;
+	}
+
+	if(buf_.size() >= BUFFER_MAX)
+		flush();
+	else if(!flushTimer_->isActive())
+		flushTimer_->start(FLUSH_INTERVAL);
+}
+
+void PacketCapture::flush()
+{
+	flushTimer_->stop();
+
+	if(!file_ || buf_.isEmpty())
+		return;
+
+	if(!failed_ && (file_->write(buf_) != buf_.size() || !file_->flush()))
+	{
+		// stop capturing rather than writing a truncated record
+		log_error("capture: failed to write to %s: %s", qPrintable(file_->fileName()), qPrintable(file_->errorString()));
+		failed_ = true;
+	}
+
+	buf_.clear();
+}
+
+QByteArray PacketCapture::fileHeader()
+{
+	return QByteArray(FILE_HEADER);
+}
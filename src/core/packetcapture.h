@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef PACKETCAPTURE_H
+#define PACKETCAPTURE_H
+
+#include <memory>
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+class QFile;
+class Timer;
+
+// appends received zmq messages to a file with their arrival times, so that
+// traffic can be replayed later (see tools/replay.py). writes are buffered
+// in memory and flushed when the buffer fills or a second after the first
+// unflushed message
+//
+// the file starts with the 8 bytes "PPCAP001", followed by records of:
+//   timestamp: 8 bytes, microseconds since the epoch
+//   source: 1 byte
+//   part count: 1 byte
+//   for each part, size: 4 bytes, followed by the data
+// integers are big endian
+class PacketCapture
+{
+public:
+	enum Source
+	{
+		ZhttpClientIn = 1, // responses to a zhttp client
+		ZhttpServerIn = 2, // requests to a zhttp server, over the pull socket
+		ZhttpServerInStream = 3, // same, over the router socket
+		PublishPull = 4, // publishes over the pull socket
+		PublishSub = 5 // publishes over the sub socket
+	};
+
+	PacketCapture();
+	~PacketCapture();
+
+	// appends to the file if it exists
+	bool open(const QString &fileName, QString *errorMessage = 0);
+
+	void write(Source source, const QList<QByteArray> &message);
+	void flush();
+
+	static QByteArray fileHeader();
+
+private:
+	std::unique_ptr<QFile> file_;
+	std::unique_ptr<Timer> flushTimer_;
+	QByteArray buf_;
+	bool failed_;
+};
+
+#endif
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include <QtEndian>
+#include <QFile>
+#include <QTemporaryDir>
+#include "test.h"
+#include "timer.h"
+#include "packetcapture.h"
+
+static QByteArray readFile(const QString &fileName)
+{
+	QFile file(fileName);
+	if(!file.open(QFile::ReadOnly))
+		return QByteArray();
+
+	return file.readAll();
+}
+
+static void format()
+{
+	Timer::init(2);
+
+	QTemporaryDir dir;
+	TEST_ASSERT(dir.isValid());
+
+	QString fname = dir.filePath("test.cap");
+
+	{
+		PacketCapture c;
+		TEST_ASSERT(c.open(fname));
+
+		c.write(PacketCapture::PublishPull, QList<QByteArray>() << "hello");
+
+		// buffered until flushed
+		TEST_ASSERT(readFile(fname).isEmpty());
+
+		c.write(PacketCapture::ZhttpServerInStream, QList<QByteArray>() << "peer" << QByteArray() << "T0:~");
+		c.flush();
+
+		QByteArray data = readFile(fname);
+		TEST_ASSERT(data.startsWith(PacketCapture::fileHeader()));
+
+		int pos = PacketCapture::fileHeader().size();
+		TEST_ASSERT_EQ(data.size(), pos + (10 + 4 + 5) + (10 + 4 + 4 + 4 + 0 + 4 + 4));
+
+		quint64 t1 = qFromBigEndian<quint64>(data.constData() + pos);
+		TEST_ASSERT(t1 > 0);
+		TEST_ASSERT_EQ((int)data[pos + 8], (int)PacketCapture::PublishPull);
+		TEST_ASSERT_EQ((int)data[pos + 9], 1);
+		TEST_ASSERT_EQ(qFromBigEndian<quint32>(data.constData() + pos + 10), (quint32)5);
+		TEST_ASSERT_EQ(data.mid(pos + 14, 5), QByteArray("hello"));
+		pos += 19;
+
+		quint64 t2 = qFromBigEndian<quint64>(data.constData() + pos);
+		TEST_ASSERT(t2 >= t1);
+		TEST_ASSERT_EQ((int)data[pos + 8], (int)PacketCapture::ZhttpServerInStream);
+		TEST_ASSERT_EQ((int)data[pos + 9], 3);
+		TEST_ASSERT_EQ(qFromBigEndian<quint32>(data.constData() + pos + 18), (quint32)0);
+		TEST_ASSERT_EQ(data.mid(pos + 26, 4), QByteArray("T0:~"));
+	}
+
+	int size = readFile(fname).size();
+
+	{
+		// reopening appends, without another header
+		PacketCapture c;
+		TEST_ASSERT(c.open(fname));
+		c.write(PacketCapture::PublishSub, QList<QByteArray>() << "apple" << "item");
+	}
+
+	QByteArray data = readFile(fname);
+	TEST_ASSERT_EQ(data.size(), size + 10 + 4 + 5 + 4 + 4);
+	TEST_ASSERT_EQ(data.indexOf(PacketCapture::fileHeader(), 1), -1);
+
+	{
+		PacketCapture c;
+		TEST_ASSERT(!c.open(dir.filePath("missing/test.cap")));
+	}
+
+	Timer::deinit();
+}
+
+extern "C" int packetcapture_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(format());
+
+	return 0;
+}
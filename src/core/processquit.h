@@ -24,10 +24,10 @@
 #define PROCESSQUIT_H
 
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 
 using Signal = boost::signals2::signal<void()>;
 using SignalInt = boost::signals2::signal<void(int)>;
-using Connection = boost::signals2::scoped_connection;
 
 /**
    \brief Listens for termination requests
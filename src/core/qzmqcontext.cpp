@@ -41,4 +41,9 @@ Context::~Context()
 	wzmq_term(context_);
 }
 
+bool Context::setIoThreadCpus(const QString &cpus)
+{
+	return wzmq_set_io_thread_cpus(cpus.toUtf8().data()) == 0;
+}
+
 }
@@ -24,6 +24,8 @@
 #ifndef QZMQCONTEXT_H
 #define QZMQCONTEXT_H
 
+#include <QString>
+
 namespace QZmq {
 
 class Context
@@ -35,6 +37,11 @@ public:
 	// the zmq context
 	void *context() { return context_; }
 
+	// pin the I/O threads of contexts created afterwards to the given cpus,
+	// e.g. "0-3,8". an empty string disables pinning. returns false if the
+	// list is invalid
+	static bool setIoThreadCpus(const QString &cpus);
+
 private:
 	void *context_;
 };
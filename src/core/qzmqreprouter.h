@@ -25,12 +25,12 @@
 #define QZMQREPROUTER_H
 
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 
 class QString;
 
 using Signal = boost::signals2::signal<void()>;
 using SignalInt = boost::signals2::signal<void(int)>;
-using Connection = boost::signals2::scoped_connection;
 
 namespace QZmq {
 
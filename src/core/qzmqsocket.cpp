@@ -25,21 +25,89 @@
 #include "qzmqsocket.h"
 
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
+#include <atomic>
 #include <QStringList>
 #include <QMutex>
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 #include "rust/bindings.h"
+#include "ringqueue.h"
 #include "qzmqcontext.h"
 #include "timer.h"
 #include "socketnotifier.h"
 
-using Connection = boost::signals2::scoped_connection;
-
 using namespace ffi;
 
 namespace QZmq {
 
+// frames smaller than this are copied, which is cheaper than the
+//   bookkeeping needed to share them
+#define ZERO_COPY_SIZE_MIN 1024
+
+// compressed frames start with this prefix, followed by the output of
+//   qCompress (the uncompressed size as a 32-bit big-endian integer and a
+//   zlib stream). the rust side uses the same layout
+#define COMPRESSED_FRAME_PREFIX "\x00ZL1"
+#define COMPRESSED_FRAME_PREFIX_SIZE 4
+#define COMPRESSED_FRAME_HEADER_SIZE (COMPRESSED_FRAME_PREFIX_SIZE + 4)
+
+// smaller frames don't compress well enough to be worth it
+#define COMPRESS_SIZE_MIN 256
+
+#define DECOMPRESS_SIZE_MAX (16 * 1024 * 1024)
+
+#define COMPRESS_LEVEL 1
+
+static std::atomic<bool> g_tcpCompression(false);
+
+// returns a null array if the frame is too small or doesn't compress
+static QByteArray compressFrame(const QByteArray &data)
+{
+	if(data.size() < COMPRESS_SIZE_MIN || data.size() > DECOMPRESS_SIZE_MAX)
+		return QByteArray();
+
+	QByteArray z = qCompress(data, COMPRESS_LEVEL);
+	if(COMPRESSED_FRAME_PREFIX_SIZE + z.size() >= data.size())
+		return QByteArray();
+
+	QByteArray out;
+	out.reserve(COMPRESSED_FRAME_PREFIX_SIZE + z.size());
+	out += QByteArray(COMPRESSED_FRAME_PREFIX, COMPRESSED_FRAME_PREFIX_SIZE);
+	out += z;
+
+	return out;
+}
+
+static bool isCompressedFrame(const QByteArray &data)
+{
+	return (data.size() > COMPRESSED_FRAME_HEADER_SIZE && memcmp(data.constData(), COMPRESSED_FRAME_PREFIX, COMPRESSED_FRAME_PREFIX_SIZE) == 0);
+}
+
+static bool decompressFrame(const QByteArray &data, QByteArray *out)
+{
+	const uchar *p = (const uchar *)data.constData() + COMPRESSED_FRAME_PREFIX_SIZE;
+	int size = (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+	if(size < 0 || size > DECOMPRESS_SIZE_MAX)
+		return false;
+
+	*out = qUncompress(p, data.size() - COMPRESSED_FRAME_PREFIX_SIZE);
+	if(out->size() != size)
+		return false;
+
+	return true;
+}
+
+// may be called from a zmq thread. QByteArray reference counting is atomic,
+//   so it's safe to drop our reference there
+static void releaseHeld(void *data, void *hint)
+{
+	Q_UNUSED(data);
+
+	delete (QByteArray *)hint;
+}
+
 static int get_fd(void *sock)
 {
 	int fd;
@@ -120,6 +188,7 @@ static void set_immediate(void *sock, bool on)
 #if (WZMQ_VERSION_MAJOR >= 4) || ((WZMQ_VERSION_MAJOR >= 3) && (WZMQ_VERSION_MINOR >= 2))
 
 #define USE_MSG_IO
+#define USE_SEND_DATA
 
 static bool get_rcvmore(void *sock)
 {
@@ -370,13 +439,15 @@ public:
 	void *sock;
 	std::unique_ptr<SocketNotifier> sn_read;
 	bool canWrite, canRead;
-	QList< QList<QByteArray> > pendingWrites;
+	RingQueue< QList<QByteArray> > pendingWrites;
 	int pendingWritten;
 	std::unique_ptr<Timer> updateTimer;
 	Connection updateTimerConnection;
 	bool pendingUpdate;
 	int shutdownWaitTime;
 	bool writeQueueEnabled;
+	bool compress;
+	bool firstPartRouted;
 
 	Private(Socket *_q, Socket::Type type, Context *_context) :
 		q(_q),
@@ -385,7 +456,9 @@ public:
 		pendingWritten(0),
 		pendingUpdate(false),
 		shutdownWaitTime(-1),
-		writeQueueEnabled(true)
+		writeQueueEnabled(true),
+		compress(false),
+		firstPartRouted(type == Socket::Router || type == Socket::Pub || type == Socket::XPub)
 	{
 		if(_context)
 		{
@@ -410,6 +483,7 @@ public:
 			case Socket::Pull: ztype = WZMQ_PULL; break;
 			case Socket::Pub: ztype = WZMQ_PUB; break;
 			case Socket::Sub: ztype = WZMQ_SUB; break;
+			case Socket::XPub: ztype = WZMQ_XPUB; break;
 			default:
 				assert(0);
 		}
@@ -461,13 +535,14 @@ public:
 
 			bool ok = true;
 
-			do
-			{
-				wzmq_msg_t msg;
+			// reuse one message for all parts. receiving replaces its content
+			wzmq_msg_t msg;
 
-				int ret = wzmq_msg_init(&msg);
-				assert(ret == 0);
+			int ret = wzmq_msg_init(&msg);
+			assert(ret == 0);
 
+			do
+			{
 #ifdef USE_MSG_IO
 				ret = wzmq_msg_recv(&msg, sock, WZMQ_DONTWAIT);
 #else
@@ -476,21 +551,29 @@ public:
 
 				if(ret < 0)
 				{
-					ret = wzmq_msg_close(&msg);
-					assert(ret == 0);
-
 					ok = false;
 					break;
 				}
 
-				QByteArray buf((const char *)wzmq_msg_data(&msg), wzmq_msg_size(&msg));
+				// QByteArray can't adopt memory it didn't allocate, so this
+				// is the one copy on the receive side
+				QByteArray part((const char *)wzmq_msg_data(&msg), wzmq_msg_size(&msg));
 
-				ret = wzmq_msg_close(&msg);
-				assert(ret == 0);
+				if(isCompressedFrame(part))
+				{
+					QByteArray data;
+					if(!decompressFrame(part, &data))
+						ok = false;
 
-				out += buf;
+					part = data;
+				}
+
+				out += part;
 			} while(get_rcvmore(sock));
 
+			ret = wzmq_msg_close(&msg);
+			assert(ret == 0);
+
 			processEvents();
 
 			if((canWrite && !pendingWrites.isEmpty()) || canRead)
@@ -507,20 +590,67 @@ public:
 
 	void write(const QList<QByteArray> &message)
 	{
-		assert(!message.isEmpty());
+		writeMessages(QList< QList<QByteArray> >() << message);
+	}
+
+	// subscriptions match on the start of the first part, and router
+	//   sockets take it as the peer address, so it is left as is
+	QList<QByteArray> encode(const QList<QByteArray> &message) const
+	{
+		QList<QByteArray> out = message;
 
+		for(int n = (firstPartRouted ? 1 : 0); n < out.count(); ++n)
+		{
+			QByteArray z = compressFrame(out[n]);
+			if(!z.isNull())
+				out[n] = z;
+		}
+
+		return out;
+	}
+
+	void writeMessages(const QList< QList<QByteArray> > &messages)
+	{
+		if(compress)
+		{
+			QList< QList<QByteArray> > encoded;
+			encoded.reserve(messages.count());
+
+			foreach(const QList<QByteArray> &message, messages)
+				encoded += encode(message);
+
+			writeEncodedMessages(encoded);
+		}
+		else
+		{
+			writeEncodedMessages(messages);
+		}
+	}
+
+	void writeEncodedMessages(const QList< QList<QByteArray> > &messages)
+	{
 		if(writeQueueEnabled)
 		{
-			pendingWrites += message;
+			pendingWrites.reserve(pendingWrites.count() + messages.count());
+
+			foreach(const QList<QByteArray> &message, messages)
+			{
+				assert(!message.isEmpty());
+
+				pendingWrites += message;
+			}
 
 			if(canWrite)
 				update();
 		}
 		else
 		{
-			if(zmqWrite(message))
+			foreach(const QList<QByteArray> &message, messages)
 			{
-				++pendingWritten;
+				assert(!message.isEmpty());
+
+				if(zmqWrite(message))
+					++pendingWritten;
 			}
 
 			processEvents();
@@ -552,6 +682,21 @@ public:
 		{
 			const QByteArray &buf = message[n];
 
+#ifdef USE_SEND_DATA
+			if(buf.size() >= ZERO_COPY_SIZE_MIN)
+			{
+				// hand the buffer to zmq as-is, keeping a reference to it
+				//   until zmq releases it
+				QByteArray *held = new QByteArray(buf);
+
+				int ret = wzmq_send_data(sock, (void *)held->constData(), held->size(), releaseHeld, held, WZMQ_DONTWAIT | (n + 1 < message.count() ? WZMQ_SNDMORE : 0));
+				if(ret < 0)
+					return false;
+
+				continue;
+			}
+#endif
+
 			wzmq_msg_t msg;
 
 			int ret = wzmq_msg_init_size(&msg, buf.size());
@@ -582,20 +727,24 @@ public:
 
 	void tryWrite()
 	{
-		while(canWrite && !pendingWrites.isEmpty())
+		if(!canWrite || pendingWrites.isEmpty())
+			return;
+
+		// write as much as zmq will accept, then check events once for the
+		//   whole batch rather than after every message
+		while(!pendingWrites.isEmpty() && zmqWrite(pendingWrites.first()))
 		{
-			// whether this write succeeds or not, we assume we
-			//   can't write afterwards
-			canWrite = false;
+			pendingWrites.removeFirst();
+			++pendingWritten;
+		}
 
-			if(zmqWrite(pendingWrites.first()))
-			{
-				pendingWrites.removeFirst();
-				++pendingWritten;
-			}
+		canWrite = false;
+		processEvents();
 
-			processEvents();
-		}
+		// a write failed even though the socket is writable. try again
+		//   later rather than spinning
+		if(canWrite && !pendingWrites.isEmpty())
+			update();
 	}
 
 	void doUpdate()
@@ -737,10 +886,23 @@ void Socket::setTcpKeepAliveParameters(int idle, int count, int interval)
 	set_tcp_keepalive_intvl(d->sock, interval);
 }
 
+void Socket::setCompressionEnabled(bool enable)
+{
+	d->compress = enable;
+}
+
+void Socket::setTcpCompressionEnabled(bool enable)
+{
+	g_tcpCompression = enable;
+}
+
 void Socket::connectToAddress(const QString &addr)
 {
 	int ret = wzmq_connect(d->sock, addr.toUtf8().data());
 	assert(ret == 0);
+
+	if(g_tcpCompression && addr.startsWith("tcp://"))
+		d->compress = true;
 }
 
 bool Socket::bind(const QString &addr)
@@ -749,6 +911,9 @@ bool Socket::bind(const QString &addr)
 	if(ret != 0)
 		return false;
 
+	if(g_tcpCompression && addr.startsWith("tcp://"))
+		d->compress = true;
+
 	return true;
 }
 
@@ -772,4 +937,9 @@ void Socket::write(const QList<QByteArray> &message)
 	d->write(message);
 }
 
+void Socket::writeMessages(const QList< QList<QByteArray> > &messages)
+{
+	d->writeMessages(messages);
+}
+
 }
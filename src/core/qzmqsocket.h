@@ -28,12 +28,12 @@
 #include <QByteArray>
 #include <QList>
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 
 class QString;
 
 using Signal = boost::signals2::signal<void()>;
 using SignalInt = boost::signals2::signal<void(int)>;
-using Connection = boost::signals2::scoped_connection;
 
 namespace QZmq {
 
@@ -52,7 +52,8 @@ public:
 		Push,
 		Pull,
 		Pub,
-		Sub
+		Sub,
+		XPub
 	};
 
 	Socket(Type type);
@@ -92,6 +93,15 @@ public:
 	void setTcpKeepAliveEnabled(bool on);
 	void setTcpKeepAliveParameters(int idle = -1, int count = -1, int interval = -1);
 
+	// compress large frames when writing, except for the first frame of
+	//   router and pub sockets. frames are always decompressed when read.
+	//   default disabled
+	void setCompressionEnabled(bool enable);
+
+	// enables compression on sockets that connect or bind to tcp
+	//   addresses afterwards, process-wide
+	static void setTcpCompressionEnabled(bool enable);
+
 	void connectToAddress(const QString &addr);
 	bool bind(const QString &addr);
 
@@ -104,10 +114,18 @@ public:
 	bool canWriteImmediately() const;
 
 	QList<QByteArray> read();
+
+	// large frames are shared with zmq rather than copied, and may be
+	//   referenced after this returns. they must own their data, i.e. not
+	//   be created with QByteArray::fromRawData()
 	void write(const QList<QByteArray> &message);
 
-	Signal readyRead;
-	SignalInt messagesWritten;
+	// writes many messages at once. messagesWritten is emitted once for
+	//   however many of them were written in a pass
+	void writeMessages(const QList< QList<QByteArray> > &messages);
+
+	FastSignal<> readyRead;
+	FastSignal<int> messagesWritten;
 
 private:
 	Socket(const Socket &) = delete;
@@ -24,11 +24,26 @@
 
 #include "qzmqvalve.h"
 
+#include <chrono>
 #include "qzmqsocket.h"
 #include "defercall.h"
 
+#define DEFAULT_MAX_READ_USECS 10000
+
+// how far the budget of a valve can grow while it's the only one with a
+//   backlog
+#define BOOST_MAX 8
+
 namespace QZmq {
 
+// valves in this thread that yielded with messages still waiting
+static thread_local int backloggedValves = 0;
+
+static qint64 nowUsecs()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 class Valve::Private
 {
 public:
@@ -37,7 +52,12 @@ public:
 	bool isOpen;
 	bool pendingRead;
 	int maxReadsPerEvent;
-	boost::signals2::scoped_connection rrConnection;
+	int maxReadUsecsPerEvent;
+	int weight;
+	int boost;
+	bool backlogged;
+	Valve::Stats stats;
+	Connection rrConnection;
 	DeferCall deferCall;
 
 	Private(Valve *_q) :
@@ -45,8 +65,30 @@ public:
 		sock(0),
 		isOpen(false),
 		pendingRead(false),
-		maxReadsPerEvent(100)
+		maxReadsPerEvent(100),
+		maxReadUsecsPerEvent(DEFAULT_MAX_READ_USECS),
+		weight(1),
+		boost(1),
+		backlogged(false)
+	{
+	}
+
+	~Private()
 	{
+		setBacklogged(false);
+	}
+
+	void setBacklogged(bool on)
+	{
+		if(on == backlogged)
+			return;
+
+		backlogged = on;
+
+		if(backlogged)
+			++backloggedValves;
+		else
+			--backloggedValves;
 	}
 
 	void setup(QZmq::Socket *_sock)
@@ -68,26 +110,49 @@ public:
 	{
 		std::weak_ptr<Private> self = q->d;
 
+		// a valve that keeps hitting its budget while no other valve is
+		//   waiting is given more each time, so a lone flood drains in
+		//   fewer passes. as soon as another valve backs up, shares go back
+		//   to being in proportion to weight
+		if(backlogged && backloggedValves == 1)
+			boost = qMin(boost * 2, BOOST_MAX);
+		else
+			boost = 1;
+
+		int maxReads = maxReadsPerEvent * weight * boost;
+		qint64 maxUsecs = (qint64)maxReadUsecsPerEvent * weight * boost;
+
+		qint64 start = nowUsecs();
+
 		int count = 0;
 		while(isOpen && sock->canRead())
 		{
-			if(count >= maxReadsPerEvent)
+			if(count >= maxReads || (maxUsecs > 0 && count > 0 && nowUsecs() - start >= maxUsecs))
 			{
+				setBacklogged(true);
+				++stats.deferrals;
+				stats.usecs += nowUsecs() - start;
+
 				queueRead();
 				return;
 			}
 
 			QList<QByteArray> msg = sock->read();
 
+			++count;
+
 			if(!msg.isEmpty())
 			{
+				++stats.reads;
+
 				q->readyRead(msg);
 				if(self.expired())
 					return;
 			}
-
-			++count;
 		}
+
+		setBacklogged(false);
+		stats.usecs += nowUsecs() - start;
 	}
 
 	void sock_readyRead()
@@ -118,11 +183,26 @@ bool Valve::isOpen() const
 	return d->isOpen;
 }
 
+Valve::Stats Valve::stats() const
+{
+	return d->stats;
+}
+
 void Valve::setMaxReadsPerEvent(int max)
 {
 	d->maxReadsPerEvent = max;
 }
 
+void Valve::setMaxReadTimePerEvent(int usecs)
+{
+	d->maxReadUsecsPerEvent = usecs;
+}
+
+void Valve::setWeight(int weight)
+{
+	d->weight = qMax(weight, 1);
+}
+
 void Valve::open()
 {
 	if(!d->isOpen)
@@ -136,6 +216,7 @@ void Valve::open()
 void Valve::close()
 {
 	d->isOpen = false;
+	d->setBacklogged(false);
 }
 
 }
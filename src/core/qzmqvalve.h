@@ -25,12 +25,13 @@
 #ifndef QZMQVALVE_H
 #define QZMQVALVE_H
 
+#include <QtGlobal>
 #include <QByteArray>
 #include <QList>
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 
 using SignalList = boost::signals2::signal<void(const QList<QByteArray>&)>;
-using Connection = boost::signals2::scoped_connection;
 
 namespace QZmq {
 
@@ -39,12 +40,33 @@ class Socket;
 class Valve
 {
 public:
+	class Stats
+	{
+	public:
+		quint64 reads;
+		quint64 deferrals;
+		quint64 usecs;
+
+		Stats() :
+			reads(0),
+			deferrals(0),
+			usecs(0)
+		{
+		}
+	};
+
 	Valve(QZmq::Socket *sock);
 	~Valve();
 
 	bool isOpen() const;
+	Stats stats() const;
 
+	// a valve reads up to the count or the time budget, whichever is hit
+	//   first, and then yields to other work. both are multiplied by the
+	//   weight, so busier sockets can be given a larger share
 	void setMaxReadsPerEvent(int max);
+	void setMaxReadTimePerEvent(int usecs); // 0 for no limit
+	void setWeight(int weight);
 
 	void open();
 	void close();
@@ -15,6 +15,7 @@
  */
 
 use crate::core::arena;
+use crate::core::capacity::Capacity;
 use crate::core::event;
 use crate::core::event::ReadinessExt;
 use crate::core::timer::TimerWheel;
@@ -46,6 +47,19 @@ fn ticks_to_duration(t: u64) -> Duration {
     Duration::from_millis(t * TICK_DURATION_MS)
 }
 
+// round ticks up to a multiple of the largest power of two that fits within
+// the slack. timers with similar deadlines then share a tick, and since the
+// boundaries nest, timers with different amounts of slack do too
+fn coalesce_ticks(ticks: u64, slack_ticks: u64) -> u64 {
+    if slack_ticks < 2 {
+        return ticks;
+    }
+
+    let step = 1 << (63 - slack_ticks.leading_zeros());
+
+    ticks.div_ceil(step) * step
+}
+
 enum WakerInterest {
     Single(Waker, mio::Interest),
     Separate(Waker, Waker),
@@ -354,6 +368,13 @@ impl Registration {
         poll.deregister(source)
     }
 
+    pub fn deregister_fd(&self, fd: RawFd) -> Result<(), io::Error> {
+        let reactor = self.reactor.upgrade().expect("reactor is gone");
+        let poll = &reactor.poll.borrow();
+
+        poll.deregister_fd(fd)
+    }
+
     pub fn deregister_custom(&self, handle: &event::Registration) -> Result<(), io::Error> {
         let reactor = self.reactor.upgrade().expect("reactor is gone");
         let poll = &reactor.poll.borrow();
@@ -496,6 +517,7 @@ struct TimerData {
 
 struct ReactorData {
     registrations: RefCell<Slab<RegistrationData>>,
+    capacity: Capacity,
     poll: RefCell<event::Poller>,
     timer: RefCell<TimerData>,
     budget: RefCell<Option<u32>>,
@@ -512,15 +534,24 @@ impl Reactor {
     }
 
     pub fn new_with_time(registrations_max: usize, start_time: Instant) -> Self {
+        Self::new_with_capacity_and_time(Capacity::fixed(registrations_max), start_time)
+    }
+
+    pub fn new_with_capacity(capacity: Capacity) -> Self {
+        Self::new_with_capacity_and_time(capacity, Instant::now())
+    }
+
+    pub fn new_with_capacity_and_time(capacity: Capacity, start_time: Instant) -> Self {
         let timer_data = TimerData {
-            wheel: TimerWheel::new(registrations_max),
+            wheel: TimerWheel::new_with_capacity(capacity),
             start: start_time,
             current_ticks: 0,
         };
 
         let inner = Rc::new(ReactorData {
-            registrations: RefCell::new(Slab::with_capacity(registrations_max)),
-            poll: RefCell::new(event::Poller::new(registrations_max).unwrap()),
+            registrations: RefCell::new(capacity.new_slab()),
+            capacity,
+            poll: RefCell::new(event::Poller::new_with_capacity(capacity).unwrap()),
             timer: RefCell::new(timer_data),
             budget: RefCell::new(None),
         });
@@ -546,7 +577,7 @@ impl Reactor {
     {
         let registrations = &mut *self.inner.registrations.borrow_mut();
 
-        if registrations.len() == registrations.capacity() {
+        if !self.inner.capacity.reserve(registrations) {
             return Err(io::Error::from(io::ErrorKind::WriteZero));
         }
 
@@ -574,6 +605,41 @@ impl Reactor {
         })
     }
 
+    pub fn register_fd(
+        &self,
+        fd: RawFd,
+        interest: mio::Interest,
+    ) -> Result<Registration, io::Error> {
+        let registrations = &mut *self.inner.registrations.borrow_mut();
+
+        if !self.inner.capacity.reserve(registrations) {
+            return Err(io::Error::from(io::ErrorKind::WriteZero));
+        }
+
+        let key = registrations.insert(RegistrationData {
+            readiness: None,
+            waker: None,
+            timer_key: None,
+            waker_persistent: false,
+        });
+
+        if let Err(e) = self
+            .inner
+            .poll
+            .borrow()
+            .register_fd(fd, mio::Token(key + 1), interest)
+        {
+            registrations.remove(key);
+
+            return Err(e);
+        }
+
+        Ok(Registration {
+            reactor: Rc::downgrade(&self.inner),
+            key,
+        })
+    }
+
     pub fn register_custom(
         &self,
         handle: &event::Registration,
@@ -581,7 +647,7 @@ impl Reactor {
     ) -> Result<Registration, io::Error> {
         let registrations = &mut *self.inner.registrations.borrow_mut();
 
-        if registrations.len() == registrations.capacity() {
+        if !self.inner.capacity.reserve(registrations) {
             return Err(io::Error::from(io::ErrorKind::WriteZero));
         }
 
@@ -616,7 +682,7 @@ impl Reactor {
     ) -> Result<Registration, io::Error> {
         let registrations = &mut *self.inner.registrations.borrow_mut();
 
-        if registrations.len() == registrations.capacity() {
+        if !self.inner.capacity.reserve(registrations) {
             return Err(io::Error::from(io::ErrorKind::WriteZero));
         }
 
@@ -647,7 +713,7 @@ impl Reactor {
     pub fn register_timer(&self, expires: Instant) -> Result<Registration, io::Error> {
         let registrations = &mut *self.inner.registrations.borrow_mut();
 
-        if registrations.len() == registrations.capacity() {
+        if !self.inner.capacity.reserve(registrations) {
             return Err(io::Error::from(io::ErrorKind::WriteZero));
         }
 
@@ -707,6 +773,17 @@ impl Reactor {
         timer.start + ticks_to_duration(timer.current_ticks)
     }
 
+    // returns an expiration no earlier than the one given and no more than
+    // slack later, aligned so that it can be shared with other timers
+    pub fn coalesce_expires(&self, expires: Instant, slack: Duration) -> Instant {
+        let timer = &*self.inner.timer.borrow();
+
+        let ticks = duration_to_ticks_round_up(expires.saturating_duration_since(timer.start));
+        let slack_ticks = duration_to_ticks_round_down(slack);
+
+        timer.start + ticks_to_duration(coalesce_ticks(ticks, slack_ticks))
+    }
+
     pub fn set_budget(&self, budget: Option<u32>) {
         *self.inner.budget.borrow_mut() = budget;
     }
@@ -923,7 +1000,7 @@ pub struct FdEvented {
 
 impl FdEvented {
     pub fn new(fd: RawFd, interest: mio::Interest, reactor: &Reactor) -> Result<Self, io::Error> {
-        let registration = reactor.register_io(&mut mio::unix::SourceFd(&fd), interest)?;
+        let registration = reactor.register_fd(fd, interest)?;
 
         Ok(Self { registration, fd })
     }
@@ -939,9 +1016,7 @@ impl FdEvented {
 
 impl Drop for FdEvented {
     fn drop(&mut self) {
-        self.registration()
-            .deregister_io(&mut mio::unix::SourceFd(&self.fd))
-            .unwrap();
+        self.registration().deregister_fd(self.fd).unwrap();
     }
 }
 
@@ -1227,4 +1302,46 @@ mod tests {
         assert_eq!(evented.registration().pull_from_budget(), false);
         assert_eq!(waker.was_waked(), true);
     }
+
+    #[test]
+    fn test_coalesce_ticks() {
+        // no slack
+        assert_eq!(coalesce_ticks(7, 0), 7);
+        assert_eq!(coalesce_ticks(7, 1), 7);
+
+        // slack rounds down to a power of two
+        assert_eq!(coalesce_ticks(7, 3), 8);
+        assert_eq!(coalesce_ticks(8, 3), 8);
+        assert_eq!(coalesce_ticks(9, 3), 10);
+        assert_eq!(coalesce_ticks(9, 10), 16);
+        assert_eq!(coalesce_ticks(17, 10), 24);
+
+        // nearby deadlines share a tick
+        for t in 33..=64 {
+            assert_eq!(coalesce_ticks(t, 32), 64);
+        }
+    }
+
+    #[test]
+    fn test_reactor_coalesce_expires() {
+        let now = Instant::now();
+        let reactor = Reactor::new_with_time(1, now);
+
+        let expires = now + Duration::from_millis(15);
+
+        assert_eq!(
+            reactor.coalesce_expires(expires, Duration::from_millis(0)),
+            now + Duration::from_millis(20)
+        );
+
+        assert_eq!(
+            reactor.coalesce_expires(expires, Duration::from_millis(40)),
+            now + Duration::from_millis(40)
+        );
+
+        assert_eq!(
+            reactor.coalesce_expires(now + Duration::from_millis(35), Duration::from_millis(40)),
+            now + Duration::from_millis(40)
+        );
+    }
 }
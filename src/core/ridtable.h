@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef RIDTABLE_H
+#define RIDTABLE_H
+
+#include <string.h>
+#include <vector>
+#include <unordered_map>
+#include <QByteArray>
+#include <QPair>
+
+namespace RidTableUtil {
+
+typedef QPair<QByteArray, QByteArray> Rid;
+
+// 64-bit multiply-and-fold mixing in the style of wyhash, reading 8 bytes
+// at a time
+inline quint64 mix(quint64 a, quint64 b)
+{
+#ifdef __SIZEOF_INT128__
+	__uint128_t r = (__uint128_t)a * b;
+	return (quint64)r ^ (quint64)(r >> 64);
+#else
+	quint64 r = a * b;
+	return r ^ (r >> 32);
+#endif
+}
+
+inline quint64 hashBytes(const char *data, int size, quint64 seed)
+{
+	const quint64 k0 = 0xa0761d6478bd642full;
+	const quint64 k1 = 0xe7037ed1a0b428dbull;
+
+	quint64 h = seed ^ k0;
+
+	int n = 0;
+	for(; n + 8 <= size; n += 8)
+	{
+		quint64 w;
+		memcpy(&w, data + n, 8);
+		h = mix(h ^ w, k1);
+	}
+
+	quint64 w = 0;
+	memcpy(&w, data + n, size - n);
+
+	return mix(h ^ w ^ (quint64)size, k1);
+}
+
+class RidHash
+{
+public:
+	size_t operator()(const Rid &rid) const
+	{
+		quint64 h = hashBytes(rid.first.constData(), rid.first.size(), 0);
+		return (size_t)hashBytes(rid.second.constData(), rid.second.size(), h);
+	}
+};
+
+}
+
+// sessions keyed by ids chosen by peers. both parts of the key are hashed
+// in one pass, rather than combining two separate QByteArray hashes
+template <typename T> class RidHashTable
+{
+public:
+	typedef RidTableUtil::Rid Rid;
+
+	int count() const { return (int)map_.size(); }
+	bool isEmpty() const { return map_.empty(); }
+
+	bool contains(const Rid &rid) const
+	{
+		return map_.find(rid) != map_.end();
+	}
+
+	T *value(const Rid &rid) const
+	{
+		auto it = map_.find(rid);
+		return it != map_.end() ? it->second : 0;
+	}
+
+	void insert(const Rid &rid, T *p)
+	{
+		map_[rid] = p;
+	}
+
+	void remove(const Rid &rid)
+	{
+		map_.erase(rid);
+	}
+
+private:
+	std::unordered_map<Rid, T*, RidTableUtil::RidHash> map_;
+};
+
+// sessions with locally generated ids. an id is a random prefix, shared
+// by the table, followed by the index of a slot and the slot's generation
+// in hex, so a lookup is an array access and a comparison. the generation
+// changes whenever a slot is freed, so old ids don't match new sessions
+template <typename T> class ClientSlotTable
+{
+public:
+	// prefix must be unique to this table across restarts
+	ClientSlotTable(const QByteArray &prefix) :
+		prefix_(prefix),
+		count_(0)
+	{
+	}
+
+	int count() const { return count_; }
+	bool isEmpty() const { return count_ == 0; }
+
+	// returns the id assigned to p
+	QByteArray insert(T *p)
+	{
+		int index;
+		if(!freeSlots_.empty())
+		{
+			index = freeSlots_.back();
+			freeSlots_.pop_back();
+		}
+		else
+		{
+			index = (int)slots_.size();
+			slots_.push_back(Slot());
+		}
+
+		Slot &s = slots_[index];
+		s.p = p;
+		++count_;
+
+		QByteArray id = prefix_;
+		id.resize(prefix_.size() + 16);
+		writeHex(id.data() + prefix_.size(), (quint32)index);
+		writeHex(id.data() + prefix_.size() + 8, s.generation);
+
+		return id;
+	}
+
+	T *value(const QByteArray &id) const
+	{
+		int index = find(id);
+		return index != -1 ? slots_[index].p : 0;
+	}
+
+	bool remove(const QByteArray &id)
+	{
+		int index = find(id);
+		if(index == -1)
+			return false;
+
+		Slot &s = slots_[index];
+		s.p = 0;
+		++s.generation;
+		freeSlots_.push_back(index);
+		--count_;
+
+		return true;
+	}
+
+private:
+	class Slot
+	{
+	public:
+		T *p;
+		quint32 generation;
+
+		Slot() :
+			p(0),
+			generation(0)
+		{
+		}
+	};
+
+	QByteArray prefix_;
+	std::vector<Slot> slots_;
+	std::vector<int> freeSlots_;
+	int count_;
+
+	static void writeHex(char *out, quint32 x)
+	{
+		static const char *chars = "0123456789abcdef";
+
+		for(int n = 7; n >= 0; --n)
+		{
+			out[n] = chars[x & 0xf];
+			x >>= 4;
+		}
+	}
+
+	static bool readHex(const char *in, quint32 *x)
+	{
+		quint32 v = 0;
+
+		for(int n = 0; n < 8; ++n)
+		{
+			char c = in[n];
+
+			int d;
+			if(c >= '0' && c <= '9')
+				d = c - '0';
+			else if(c >= 'a' && c <= 'f')
+				d = c - 'a' + 10;
+			else
+				return false;
+
+			v = (v << 4) | d;
+		}
+
+		*x = v;
+		return true;
+	}
+
+	// returns the slot index of a live session, or -1
+	int find(const QByteArray &id) const
+	{
+		int psize = prefix_.size();
+
+		if(id.size() != psize + 16 || memcmp(id.constData(), prefix_.constData(), psize) != 0)
+			return -1;
+
+		quint32 index, generation;
+		if(!readHex(id.constData() + psize, &index) || !readHex(id.constData() + psize + 8, &generation))
+			return -1;
+
+		if(index >= slots_.size())
+			return -1;
+
+		const Slot &s = slots_[index];
+		if(s.generation != generation || !s.p)
+			return -1;
+
+		return (int)index;
+	}
+};
+
+#endif
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "test.h"
+#include "ridtable.h"
+
+class Session
+{
+public:
+	int n;
+
+	Session(int _n) :
+		n(_n)
+	{
+	}
+};
+
+static void clientSlots()
+{
+	ClientSlotTable<Session> table("abcd1234-r");
+	Session a(1), b(2);
+
+	QByteArray ida = table.insert(&a);
+	QByteArray idb = table.insert(&b);
+	TEST_ASSERT(ida != idb);
+	TEST_ASSERT(ida.startsWith("abcd1234-r"));
+	TEST_ASSERT_EQ(table.count(), 2);
+
+	TEST_ASSERT_EQ(table.value(ida), &a);
+	TEST_ASSERT_EQ(table.value(idb), &b);
+
+	// foreign or malformed ids
+	TEST_ASSERT(!table.value("abcd1234-w0000000000000000"));
+	TEST_ASSERT(!table.value("abcd1234-r00000000000000"));
+	TEST_ASSERT(!table.value("abcd1234-r0000000z00000000"));
+	TEST_ASSERT(!table.value("abcd1234-r0000ffff00000000"));
+
+	TEST_ASSERT(table.remove(ida));
+	TEST_ASSERT(!table.remove(ida));
+	TEST_ASSERT(!table.value(ida));
+	TEST_ASSERT_EQ(table.count(), 1);
+
+	// the slot is reused, but the old id must not match the new session
+	Session c(3);
+	QByteArray idc = table.insert(&c);
+	TEST_ASSERT(idc != ida);
+	TEST_ASSERT(!table.value(ida));
+	TEST_ASSERT_EQ(table.value(idc), &c);
+
+	table.remove(idb);
+	table.remove(idc);
+	TEST_ASSERT(table.isEmpty());
+}
+
+static void hashTable()
+{
+	typedef RidHashTable<Session>::Rid Rid;
+
+	RidHashTable<Session> table;
+	Session a(1), b(2);
+
+	table.insert(Rid("peer1", "id1"), &a);
+	table.insert(Rid("peer2", "id1"), &b);
+	TEST_ASSERT_EQ(table.count(), 2);
+
+	TEST_ASSERT_EQ(table.value(Rid("peer1", "id1")), &a);
+	TEST_ASSERT_EQ(table.value(Rid("peer2", "id1")), &b);
+	TEST_ASSERT(!table.contains(Rid("peer1", "id2")));
+
+	// the boundary between the parts matters
+	TEST_ASSERT(!table.contains(Rid("peer1i", "d1")));
+
+	table.remove(Rid("peer1", "id1"));
+	TEST_ASSERT(!table.contains(Rid("peer1", "id1")));
+	TEST_ASSERT_EQ(table.count(), 1);
+
+	// ids of various lengths hash consistently
+	QByteArray longId(100, 'x');
+	table.insert(Rid("peer3", longId), &a);
+	TEST_ASSERT_EQ(table.value(Rid("peer3", QByteArray(100, 'x'))), &a);
+}
+
+extern "C" int ridtable_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(clientSlots());
+	TEST_CATCH(hashTable());
+
+	return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef RINGQUEUE_H
+#define RINGQUEUE_H
+
+#include <assert.h>
+#include <memory>
+#include <utility>
+
+// fifo queue stored in a circular array. unlike QList, elements are not
+// allocated individually, and the storage is reused as elements are
+// taken, so a queue that is steadily filled and drained does not allocate.
+// T must be default-constructible. emptied slots are reset to T() so they
+// don't hold on to resources
+template <typename T> class RingQueue
+{
+public:
+	RingQueue() :
+		capacity_(0),
+		start_(0),
+		count_(0)
+	{
+	}
+
+	int count() const { return count_; }
+	bool isEmpty() const { return count_ == 0; }
+
+	T & operator[](int i) { assert(i >= 0 && i < count_); return slots_[index(i)]; }
+	const T & operator[](int i) const { assert(i >= 0 && i < count_); return slots_[index(i)]; }
+
+	T & first() { return (*this)[0]; }
+	const T & first() const { return (*this)[0]; }
+
+	T & last() { return (*this)[count_ - 1]; }
+	const T & last() const { return (*this)[count_ - 1]; }
+
+	void append(const T &value)
+	{
+		reserveOne();
+		slots_[index(count_)] = value;
+		++count_;
+	}
+
+	void append(T &&value)
+	{
+		reserveOne();
+		slots_[index(count_)] = std::move(value);
+		++count_;
+	}
+
+	RingQueue & operator+=(const T &value) { append(value); return *this; }
+	RingQueue & operator+=(T &&value) { append(std::move(value)); return *this; }
+
+	T takeFirst()
+	{
+		assert(count_ > 0);
+
+		T value = std::move(slots_[start_]);
+		removeFirst();
+
+		return value;
+	}
+
+	void removeFirst()
+	{
+		assert(count_ > 0);
+
+		slots_[start_] = T();
+		start_ = (start_ + 1) % capacity_;
+		--count_;
+
+		if(count_ == 0)
+			start_ = 0;
+	}
+
+	void clear()
+	{
+		while(count_ > 0)
+			removeFirst();
+	}
+
+	// grows the storage ahead of time so that appending up to size
+	// elements in total won't reallocate
+	void reserve(int size)
+	{
+		if(size > capacity_)
+			resize(size);
+	}
+
+private:
+	std::unique_ptr<T[]> slots_;
+	int capacity_;
+	int start_;
+	int count_;
+
+	int index(int i) const
+	{
+		return (start_ + i) % capacity_;
+	}
+
+	void reserveOne()
+	{
+		if(count_ < capacity_)
+			return;
+
+		resize(capacity_ > 0 ? capacity_ * 2 : 8);
+	}
+
+	void resize(int capacity)
+	{
+		// unwrap into larger storage
+		std::unique_ptr<T[]> slots(new T[capacity]);
+		for(int n = 0; n < count_; ++n)
+			slots[n] = std::move(slots_[index(n)]);
+
+		slots_ = std::move(slots);
+		capacity_ = capacity;
+		start_ = 0;
+	}
+};
+
+#endif
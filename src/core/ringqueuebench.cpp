@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include <QList>
+#include "bench.h"
+#include "websocket.h"
+#include "ringqueue.h"
+
+template <typename Q> static int relay(Q &in, Q &out, const QByteArray &data, int burst)
+{
+	for(int n = 0; n < burst; ++n)
+		in += WebSocket::Frame(WebSocket::Frame::Text, data, false);
+
+	// move each frame to the other side, the way frames pass from a
+	// socket to the peer session
+	while(!in.isEmpty())
+		out += in.takeFirst();
+
+	int size = 0;
+	while(!out.isEmpty())
+		size += out.takeFirst().data.size();
+
+	return size;
+}
+
+extern "C" void ringqueue_bench(const char *filter)
+{
+	Bench bench(filter);
+
+	QByteArray data(100, 'a');
+
+	{
+		QList<WebSocket::Frame> in, out;
+
+		bench.run("ringqueue/frames-qlist", 100000, 1, [&] {
+			int size = relay(in, out, data, 16);
+			Q_UNUSED(size);
+		});
+	}
+
+	{
+		RingQueue<WebSocket::Frame> in, out;
+
+		bench.run("ringqueue/frames-ring", 100000, 1, [&] {
+			int size = relay(in, out, data, 16);
+			Q_UNUSED(size);
+		});
+	}
+}
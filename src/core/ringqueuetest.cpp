@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include <QByteArray>
+#include "test.h"
+#include "ringqueue.h"
+
+static void fifo()
+{
+	RingQueue<int> q;
+	TEST_ASSERT(q.isEmpty());
+
+	for(int n = 0; n < 5; ++n)
+		q += n;
+
+	TEST_ASSERT_EQ(q.count(), 5);
+	TEST_ASSERT_EQ(q.first(), 0);
+	TEST_ASSERT_EQ(q[4], 4);
+	TEST_ASSERT_EQ(q.last(), 4);
+
+	TEST_ASSERT_EQ(q.takeFirst(), 0);
+	TEST_ASSERT_EQ(q.takeFirst(), 1);
+	TEST_ASSERT_EQ(q.count(), 3);
+}
+
+static void wrapAndGrow()
+{
+	RingQueue<int> q;
+
+	// advance the start so the contents wrap around the storage
+	for(int n = 0; n < 6; ++n)
+		q += n;
+	for(int n = 0; n < 4; ++n)
+		q.removeFirst();
+
+	for(int n = 6; n < 20; ++n)
+		q += n;
+
+	TEST_ASSERT_EQ(q.count(), 16);
+	for(int n = 4; n < 20; ++n)
+		TEST_ASSERT_EQ(q.takeFirst(), n);
+
+	TEST_ASSERT(q.isEmpty());
+}
+
+static void reserve()
+{
+	RingQueue<int> q;
+
+	for(int n = 0; n < 3; ++n)
+		q += n;
+	q.removeFirst();
+
+	// reserving keeps the contents and their order
+	q.reserve(100);
+	for(int n = 3; n < 100; ++n)
+		q += n;
+
+	TEST_ASSERT_EQ(q.count(), 99);
+	for(int n = 1; n < 100; ++n)
+		TEST_ASSERT_EQ(q.takeFirst(), n);
+}
+
+static void releaseSlots()
+{
+	RingQueue<QByteArray> q;
+
+	QByteArray a("hello");
+	q += a;
+	TEST_ASSERT(!a.isDetached());
+
+	// a taken element must not stay referenced by the queue
+	QByteArray b = q.takeFirst();
+	b.clear();
+	TEST_ASSERT(a.isDetached());
+
+	q += a;
+	q.clear();
+	TEST_ASSERT(a.isDetached());
+	TEST_ASSERT(q.isEmpty());
+}
+
+extern "C" int ringqueue_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(fifo());
+	TEST_CATCH(wrapAndGrow());
+	TEST_CATCH(reserve());
+	TEST_CATCH(releaseSlots());
+
+	return 0;
+}
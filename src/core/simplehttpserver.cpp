@@ -34,6 +34,34 @@
 #include "unixstream.h"
 #include "httpheaders.h"
 
+// longest chunk-size line accepted, including extensions
+#define CHUNK_LINE_MAX 1024
+
+static bool hasConnectionToken(const HttpHeaders &headers, const char *token)
+{
+	foreach(const QByteArray &v, headers.getAll("Connection"))
+	{
+		if(qstricmp(v.trimmed().data(), token) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+static QByteArray uriPath(const QByteArray &uri)
+{
+	QByteArray path = uri;
+
+	int at = path.indexOf('?');
+	if(at != -1)
+		path.truncate(at);
+
+	if(path.length() > 1 && path[path.length() - 1] == '/')
+		path.truncate(path.length() - 1);
+
+	return path;
+}
+
 class SimpleHttpRequest::Private
 {
 public:
@@ -58,8 +86,19 @@ public:
 	HttpHeaders reqHeaders;
 	QByteArray reqBody;
 	int contentLength;
+	bool chunked;
+	bool chunkTrailer;
 	int headersSizeMax;
 	int bodySizeMax;
+	bool persistent;
+	bool reused;
+	const QSet<QByteArray> *streamingPaths;
+	bool streaming;
+	bool bodyFinished;
+	bool responseStarted;
+	bool bodyReadyPending;
+	Connection readReadyConnection;
+	Connection writeReadyConnection;
 	DeferCall deferCall;
 
 	Private(SimpleHttpRequest *_q, int headersSizeMax, int bodySizeMax) :
@@ -67,8 +106,17 @@ public:
 		state(ReadHeader),
 		version1dot0(false),
 		contentLength(0),
+		chunked(false),
+		chunkTrailer(false),
 		headersSizeMax(headersSizeMax),
-		bodySizeMax(bodySizeMax)
+		bodySizeMax(bodySizeMax),
+		persistent(false),
+		reused(false),
+		streamingPaths(0),
+		streaming(false),
+		bodyFinished(false),
+		responseStarted(false),
+		bodyReadyPending(false)
 	{
 	}
 
@@ -79,22 +127,53 @@ public:
 
 	void cleanup()
 	{
+		readReadyConnection.disconnect();
+		writeReadyConnection.disconnect();
 		stream.reset();
 	}
 
-	void start(std::unique_ptr<ReadWrite> _stream)
+	// buffered contains any bytes already read past the end of a previous
+	//   request on the same connection
+	void start(std::unique_ptr<ReadWrite> _stream, const QByteArray &buffered = QByteArray(), bool _reused = false)
 	{
 		stream = std::move(_stream);
+		inBuf = buffered;
+		reused = _reused;
 
-		stream->readReady.connect(boost::bind(&Private::stream_readReady, this));
-		stream->writeReady.connect(boost::bind(&Private::stream_writeReady, this));
+		readReadyConnection = stream->readReady.connect(boost::bind(&Private::stream_readReady, this));
+		writeReadyConnection = stream->writeReady.connect(boost::bind(&Private::stream_writeReady, this));
 
 		deferCall.defer([&] { process(); });
 	}
 
+	// a connection kept open after the response keeps its stream, and can
+	//   be handed to a new request
+	bool canReuse() const
+	{
+		return state == Finished && stream;
+	}
+
+	std::unique_ptr<ReadWrite> takeStream()
+	{
+		readReadyConnection.disconnect();
+		writeReadyConnection.disconnect();
+
+		return std::move(stream);
+	}
+
+	// a reused connection that hasn't received any of its next request
+	bool isIdle() const
+	{
+		return reused && state == ReadHeader && inBuf.isEmpty();
+	}
+
 	void respond(int code, const QByteArray &reason, const HttpHeaders &headers, const QByteArray &body)
 	{
-		if(state != WriteBody)
+		// a streamed request can be rejected while its body is arriving
+		if(state == ReadBody && streaming && !responseStarted)
+			state = WriteBody;
+
+		if(state != WriteBody || responseStarted)
 			return;
 
 		HttpHeaders outHeaders = headers;
@@ -102,7 +181,10 @@ public:
 		outHeaders.removeAll("Transfer-Encoding");
 		outHeaders.removeAll("Content-Length");
 
-		outHeaders += HttpHeader("Connection", "close");
+		if(!persistent)
+			outHeaders += HttpHeader("Connection", "close");
+		else if(version1dot0)
+			outHeaders += HttpHeader("Connection", "keep-alive");
 		outHeaders += HttpHeader("Content-Length", QByteArray::number(body.size()));
 
 		QByteArray respData = "HTTP/";
@@ -131,11 +213,73 @@ public:
 		respond(code, reason, headers, body.toUtf8());
 	}
 
+	QByteArray takeBody()
+	{
+		QByteArray out = reqBody;
+		reqBody.clear();
+
+		// reading may have stopped for lack of room
+		if(state == ReadBody && !out.isEmpty())
+			deferCall.defer([&] { process(); });
+
+		return out;
+	}
+
+	void beginResponse(int code, const QByteArray &reason, const HttpHeaders &headers)
+	{
+		if(!streaming || responseStarted || (state != ReadBody && state != WriteBody))
+			return;
+
+		responseStarted = true;
+
+		HttpHeaders outHeaders = headers;
+		outHeaders.removeAll("Connection");
+		outHeaders.removeAll("Transfer-Encoding");
+		outHeaders.removeAll("Content-Length");
+
+		// the response may end before the request body does
+		outHeaders += HttpHeader("Connection", "close");
+		outHeaders += HttpHeader("Transfer-Encoding", "chunked");
+
+		QByteArray respData = "HTTP/1.1 " + QByteArray::number(code) + " " + reason + "\r\n";
+		foreach(const HttpHeader &h, outHeaders)
+			respData += h.first + ": " + h.second + "\r\n";
+		respData += "\r\n";
+
+		outBuf += respData;
+
+		deferCall.defer([&] { process(); });
+	}
+
+	void writeBody(const QByteArray &data)
+	{
+		if(!responseStarted || state == WaitForWritten || data.isEmpty())
+			return;
+
+		outBuf += QByteArray::number(data.size(), 16) + "\r\n" + data + "\r\n";
+
+		deferCall.defer([&] { process(); });
+	}
+
+	void endResponse()
+	{
+		if(!responseStarted || state == WaitForWritten)
+			return;
+
+		outBuf += "0\r\n\r\n";
+		state = WaitForWritten;
+
+		deferCall.defer([&] { process(); });
+	}
+
 	Signal ready;
 
 private:
 	void respondError(int code, const QByteArray &reason, const QString &body)
 	{
+		// the rest of the input can't be trusted to start a new request
+		persistent = false;
+
 		state = WriteBody;
 		respond(code, reason, body + '\n');
 	}
@@ -150,6 +294,21 @@ private:
 		respondError(411, "Length Required", body);
 	}
 
+	void writeContinue()
+	{
+		if(reqHeaders.get("Expect") == "100-continue")
+		{
+			QByteArray respData = "HTTP/";
+			if(version1dot0)
+				respData += "1.0 ";
+			else
+				respData += "1.1 ";
+			respData += "100 Continue\r\n\r\n";
+
+			outBuf += respData;
+		}
+	}
+
 	bool processHeaderData(const QByteArray &headerData)
 	{
 		QList<QByteArray> lines;
@@ -208,6 +367,12 @@ private:
 			reqHeaders += HttpHeader(name, val);
 		}
 
+		// HTTP/1.1 connections persist unless the client says otherwise
+		if(version1dot0)
+			persistent = hasConnectionToken(reqHeaders, "keep-alive");
+		else
+			persistent = !hasConnectionToken(reqHeaders, "close");
+
 		//log_debug("httpserver: IN method=[%s] uri=[%s] 1.1=%s", qPrintable(method), uri.data(), version1dot0 ? "no" : "yes");
 		//foreach(const HttpHeader &h, reqHeaders)
 		//	log_debug("httpserver:   [%s] [%s]", h.first.data(), h.second.data());
@@ -216,6 +381,84 @@ private:
 		return true;
 	}
 
+	// decodes the chunks buffered in inBuf into reqBody, leaving any
+	//   partial chunk. returns 1 once the last chunk and trailer have been
+	//   read, 0 if more input is needed, -1 on bad encoding, -2 if the
+	//   body would be too large, or 2 if a streamed body needs to be taken
+	//   before the next chunk fits
+	int decodeChunks()
+	{
+		int pos = 0;
+		int ret = 0;
+
+		while(ret == 0)
+		{
+			int end = inBuf.indexOf("\r\n", pos);
+			if(end == -1)
+			{
+				if(inBuf.size() - pos > CHUNK_LINE_MAX)
+					ret = -1;
+				break;
+			}
+
+			if(chunkTrailer)
+			{
+				// trailer fields are ignored, up to the empty line
+				if(end == pos)
+					ret = 1;
+
+				pos = end + 2;
+				continue;
+			}
+
+			QByteArray line = inBuf.mid(pos, end - pos);
+			int x = line.indexOf(';');
+			if(x != -1)
+				line.truncate(x);
+
+			bool ok;
+			int size = line.trimmed().toInt(&ok, 16);
+			if(!ok || size < 0)
+			{
+				ret = -1;
+				break;
+			}
+
+			if(size == 0)
+			{
+				chunkTrailer = true;
+				pos = end + 2;
+				continue;
+			}
+
+			if(size > bodySizeMax - reqBody.size())
+			{
+				ret = (streaming && !reqBody.isEmpty() ? 2 : -2);
+				break;
+			}
+
+			int dataStart = end + 2;
+
+			// wait for the whole chunk and its line ending
+			if(inBuf.size() < dataStart + size + 2)
+				break;
+
+			if(inBuf[dataStart + size] != '\r' || inBuf[dataStart + size + 1] != '\n')
+			{
+				ret = -1;
+				break;
+			}
+
+			reqBody.append(inBuf.constData() + dataStart, size);
+			pos = dataStart + size + 2;
+		}
+
+		if(pos > 0)
+			inBuf = inBuf.mid(pos);
+
+		return ret;
+	}
+
 	void error(const QString &msg)
 	{
 		log_debug("httpserver error: %s", qPrintable(msg));
@@ -234,27 +477,8 @@ private:
 	{
 		if(state == ReadHeader)
 		{
-			QByteArray buf = stream->read(headersSizeMax - inBuf.size());
-
-			if(buf.isNull())
-			{
-				int e = stream->errorCondition();
-				if(e == EAGAIN)
-					return false;
-
-				error(QString("read error: %1").arg(e));
-				return true;
-			}
-
-			if(buf.isEmpty())
-			{
-				error("client closed unexpectedly");
-				return true;
-			}
-
-			inBuf += buf;
-
-			// look for double newline
+			// look for double newline. requests pipelined behind the
+			//   previous one may already be buffered
 			int at = -1;
 			int next = 0;
 			for(int n = 0; n < inBuf.size(); ++n)
@@ -273,11 +497,45 @@ private:
 				}
 			}
 
-			if(at != -1)
+			if(at == -1)
+			{
+				if(inBuf.size() >= headersSizeMax)
+				{
+					inBuf.clear();
+					respondBadRequest("Request header too large.");
+					return true;
+				}
+
+				QByteArray buf = stream->read(headersSizeMax - inBuf.size());
+
+				if(buf.isNull())
+				{
+					int e = stream->errorCondition();
+					if(e == EAGAIN)
+						return false;
+
+					error(QString("read error: %1").arg(e));
+					return true;
+				}
+
+				if(buf.isEmpty())
+				{
+					// closing between requests is normal
+					if(isIdle())
+						doFinish();
+					else
+						error("client closed unexpectedly");
+
+					return true;
+				}
+
+				inBuf += buf;
+				return true;
+			}
+			else
 			{
 				QByteArray headerData = inBuf.mid(0, at);
-				reqBody = inBuf.mid(next);
-				inBuf.clear();
+				inBuf = inBuf.mid(next);
 
 				if(!processHeaderData(headerData))
 				{
@@ -285,8 +543,35 @@ private:
 					return true;
 				}
 
+				if(reqHeaders.contains("Transfer-Encoding"))
+				{
+					QList<QByteArray> codings = reqHeaders.getAll("Transfer-Encoding");
+
+					// chunked must be the final coding, and is the only one
+					//   supported
+					if(codings.count() != 1 || qstricmp(codings.first().trimmed().data(), "chunked") != 0 || reqHeaders.contains("Content-Length"))
+					{
+						respondBadRequest("Unsupported Transfer-Encoding.");
+						return true;
+					}
+
+					chunked = true;
+					writeContinue();
+
+					state = ReadBody;
+
+					if(streamingPaths && streamingPaths->contains(uriPath(uri)))
+					{
+						streaming = true;
+						persistent = false;
+						ready();
+					}
+
+					return true;
+				}
+
 				bool methodAssumesBody = (method != "HEAD" && method != "GET" && method != "DELETE" && method != "OPTIONS");
-				if(!reqHeaders.contains("Content-Length") && (reqHeaders.contains("Transfer-Encoding") || methodAssumesBody))
+				if(!reqHeaders.contains("Content-Length") && methodAssumesBody)
 				{
 					respondLengthRequired("Request requires Content-Length.");
 					return true;
@@ -296,7 +581,7 @@ private:
 				{
 					bool ok;
 					contentLength = reqHeaders.get("Content-Length").toInt(&ok);
-					if(!ok)
+					if(!ok || contentLength < 0)
 					{
 						respondBadRequest("Bad Content-Length.");
 						return true;
@@ -308,17 +593,12 @@ private:
 						return true;
 					}
 
-					if(reqHeaders.get("Expect") == "100-continue")
-					{
-						QByteArray respData = "HTTP/";
-						if(version1dot0)
-							respData += "1.0 ";
-						else
-							respData += "1.1 ";
-						respData += "100 Continue\r\n\r\n";
-
-						outBuf += respData;
-					}
+					// anything past the body belongs to the next request
+					reqBody = inBuf.left(contentLength);
+					inBuf = inBuf.mid(contentLength);
+					reqBody.reserve(contentLength);
+
+					writeContinue();
 
 					state = ReadBody;
 					return true;
@@ -329,12 +609,6 @@ private:
 					ready();
 				}
 			}
-			else if(inBuf.size() >= headersSizeMax)
-			{
-				inBuf.clear();
-				respondBadRequest("Request header too large.");
-				return true;
-			}
 		}
 		else if(state == ReadBody)
 		{
@@ -357,9 +631,47 @@ private:
 				return true;
 			}
 
-			if(reqBody.size() < contentLength)
+			if(chunked)
 			{
-				QByteArray buf = stream->read(bodySizeMax - reqBody.size() + 1);
+				int prevSize = reqBody.size();
+
+				int ret = decodeChunks();
+				if(ret < 0)
+				{
+					QString msg = (ret == -1 ? "Bad chunked encoding." : "Request body too large.");
+
+					// too late for an error response
+					if(responseStarted)
+					{
+						error(msg);
+						return true;
+					}
+
+					respondBadRequest(msg);
+					return true;
+				}
+
+				if(streaming && (reqBody.size() > prevSize || ret == 1))
+					signalBodyReady();
+
+				if(ret == 1)
+				{
+					state = WriteBody;
+
+					if(streaming)
+						bodyFinished = true;
+					else
+						ready();
+
+					return true;
+				}
+				else if(ret == 2)
+				{
+					// wait for the body to be taken
+					return false;
+				}
+
+				QByteArray buf = stream->read();
 
 				if(buf.isNull())
 				{
@@ -377,13 +689,33 @@ private:
 					return true;
 				}
 
-				reqBody += buf;
+				inBuf += buf;
+				return true;
 			}
 
-			if(reqBody.size() > contentLength)
+			if(reqBody.size() < contentLength)
 			{
-				respondBadRequest("Request body exceeded Content-Length.");
-				return true;
+				// don't read past the body, so that a pipelined request
+				//   stays in the stream
+				QByteArray buf = stream->read(contentLength - reqBody.size());
+
+				if(buf.isNull())
+				{
+					int e = stream->errorCondition();
+					if(e == EAGAIN)
+						return false;
+
+					error(QString("read error: %1").arg(e));
+					return true;
+				}
+
+				if(buf.isEmpty())
+				{
+					error("client closed unexpectedly");
+					return true;
+				}
+
+				reqBody += buf;
 			}
 
 			if(reqBody.size() == contentLength)
@@ -392,11 +724,38 @@ private:
 				ready();
 			}
 		}
+		else if(state == WriteBody && streaming)
+		{
+			// the body is done, but the response is still being written
+			if(outBuf.isEmpty())
+				return false;
+
+			int ret = stream->write(outBuf);
+
+			if(ret < 0)
+			{
+				int e = stream->errorCondition();
+				if(e == EAGAIN)
+					return false;
+
+				error(QString("write error: %1").arg(e));
+				return true;
+			}
+
+			outBuf = outBuf.mid(ret);
+		}
 		else if(state == WaitForWritten)
 		{
 			if(outBuf.isEmpty())
 			{
-				doFinish();
+				if(persistent)
+				{
+					// keep the stream for the next request
+					state = Closed;
+				}
+				else
+					doFinish();
+
 				return true;
 			}
 
@@ -418,9 +777,22 @@ private:
 		return true;
 	}
 
+	void signalBodyReady()
+	{
+		if(bodyReadyPending)
+			return;
+
+		bodyReadyPending = true;
+
+		deferCall.defer([&] {
+			bodyReadyPending = false;
+			q->bodyReady();
+		});
+	}
+
 	void process()
 	{
-		while((state == ReadHeader || state == ReadBody || state == WaitForWritten) && step()) {}
+		while((state == ReadHeader || state == ReadBody || state == WaitForWritten || (state == WriteBody && streaming)) && step()) {}
 
 		if(state == Closed)
 		{
@@ -480,6 +852,36 @@ void SimpleHttpRequest::respond(int code, const QByteArray &reason, const QStrin
 	d->respond(code, reason, body);
 }
 
+bool SimpleHttpRequest::isStreaming() const
+{
+	return d->streaming;
+}
+
+QByteArray SimpleHttpRequest::takeBody()
+{
+	return d->takeBody();
+}
+
+bool SimpleHttpRequest::isBodyFinished() const
+{
+	return d->bodyFinished;
+}
+
+void SimpleHttpRequest::beginResponse(int code, const QByteArray &reason, const HttpHeaders &headers)
+{
+	d->beginResponse(code, reason, headers);
+}
+
+void SimpleHttpRequest::writeBody(const QByteArray &data)
+{
+	d->writeBody(data);
+}
+
+void SimpleHttpRequest::endResponse()
+{
+	d->endResponse();
+}
+
 class SimpleHttpServerPrivate
 {
 public:
@@ -492,6 +894,7 @@ public:
 	int connectionsMax;
 	int headersSizeMax;
 	int bodySizeMax;
+	QSet<QByteArray> streamingPaths;
 	map<SimpleHttpRequest*, Connection> finishedConnections;
 	map<SimpleHttpRequest*, Connection> readyConnections;
 	DeferCall deferCall;
@@ -525,6 +928,36 @@ public:
 		return (accepting.count() + pending.count() + active.count() < connectionsMax);
 	}
 
+	SimpleHttpRequest *findIdle() const
+	{
+		foreach(SimpleHttpRequest *req, accepting)
+		{
+			if(req->d->isIdle())
+				return req;
+		}
+
+		return nullptr;
+	}
+
+	void addRequest(std::unique_ptr<ReadWrite> s, const QByteArray &buffered = QByteArray(), bool reused = false)
+	{
+		SimpleHttpRequest *req = new SimpleHttpRequest(headersSizeMax, bodySizeMax);
+		req->d->streamingPaths = &streamingPaths;
+		readyConnections[req] = req->d->ready.connect(boost::bind(&SimpleHttpServerPrivate::req_ready, this, req->d->q));
+		finishedConnections[req] = req->finished.connect(boost::bind(&SimpleHttpServerPrivate::req_finished, this, req));
+		accepting += req;
+		req->d->start(std::move(s), buffered, reused);
+	}
+
+	void removeIdle(SimpleHttpRequest *req)
+	{
+		accepting.remove(req);
+		readyConnections.erase(req);
+		finishedConnections.erase(req);
+
+		delete req;
+	}
+
 	bool listen(const QHostAddress &addr, int port)
 	{
 		assert(!listener);
@@ -574,7 +1007,9 @@ public:
 
 	void listener_streamsReady()
 	{
-		while(canAccept())
+		// when full, persistent connections waiting for their next request
+		//   give way to new connections
+		while(canAccept() || findIdle())
 		{
 			std::unique_ptr<ReadWrite> s;
 
@@ -595,11 +1030,10 @@ public:
 
 			if(s)
 			{
-				SimpleHttpRequest *req = new SimpleHttpRequest(headersSizeMax, bodySizeMax);
-				readyConnections[req] = req->d->ready.connect(boost::bind(&SimpleHttpServerPrivate::req_ready, this, req->d->q));
-				finishedConnections[req] = req->finished.connect(boost::bind(&SimpleHttpServerPrivate::req_finished, this, req));
-				accepting += req;
-				req->d->start(std::move(s));
+				if(!canAccept())
+					removeIdle(findIdle());
+
+				addRequest(std::move(s));
 			}
 		}
 	}
@@ -619,6 +1053,11 @@ public:
 		if(active.contains(req))
 		{
 			active.remove(req);
+
+			// continue the connection with a new request object, as the
+			//   owner of this one is about to delete it
+			if(req->d->canReuse())
+				addRequest(req->d->takeStream(), req->d->inBuf, true);
 		}
 		else
 		{
@@ -658,6 +1097,11 @@ bool SimpleHttpServer::listenLocal(const QString &name)
 	return d->listenLocal(name);
 }
 
+void SimpleHttpServer::setStreamingPaths(const QSet<QByteArray> &paths)
+{
+	d->streamingPaths = paths;
+}
+
 SimpleHttpRequest *SimpleHttpServer::takeNext()
 {
 	if(!d->pending.isEmpty())
@@ -25,14 +25,15 @@
 #define SIMPLEHTTPSERVER_H
 
 #include <QHostAddress>
+#include <QSet>
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 #include <map>
 
 #define SOCKETNOTIFIERS_PER_SIMPLEHTTPREQUEST 1
 
 using std::map;
 using Signal = boost::signals2::signal<void()>;
-using Connection = boost::signals2::scoped_connection;
 
 class HttpHeaders;
 
@@ -51,6 +52,21 @@ public:
 	void respond(int code, const QByteArray &reason, const HttpHeaders &headers, const QByteArray &body);
 	void respond(int code, const QByteArray &reason, const QString &body);
 
+	// streamed requests are handed over once their headers are read, see
+	// SimpleHttpServer::setStreamingPaths. the body is taken in pieces as
+	// it arrives. reading from the connection stops while the taken body
+	// would exceed the max body size, so a reader that stops taking
+	// pushes back on the client. the response is chunked, and may be
+	// written while the body is still being received. respond() can be
+	// used instead, to reject the request before beginning a response
+	bool isStreaming() const;
+	QByteArray takeBody();
+	bool isBodyFinished() const;
+	void beginResponse(int code, const QByteArray &reason, const HttpHeaders &headers);
+	void writeBody(const QByteArray &data);
+	void endResponse();
+
+	Signal bodyReady;
 	Signal finished;
 
 private:
@@ -70,6 +86,11 @@ public:
 
 	bool listen(const QHostAddress &addr, int port);
 	bool listenLocal(const QString &name);
+
+	// requests to these paths with a chunked body are streamed. the query
+	// and any trailing slash are ignored when matching
+	void setStreamingPaths(const QSet<QByteArray> &paths);
+
 	SimpleHttpRequest *takeNext();
 
 	Signal requestReady;
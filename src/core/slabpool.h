@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef SLABPOOL_H
+#define SLABPOOL_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <new>
+#include <vector>
+
+// allocates objects of a single type from large chunks, instead of one heap
+// allocation per object. released slots are reused, and memory is only
+// returned when the pool is destroyed. objects never move, so pointers stay
+// valid until release() is called. any objects still allocated when the
+// pool is destroyed are not destructed
+template <typename T, int ChunkSize = 1024> class SlabPool
+{
+public:
+	SlabPool() :
+		count_(0)
+	{
+	}
+
+	~SlabPool()
+	{
+		for(T *chunk : chunks_)
+			::operator delete(chunk);
+	}
+
+	SlabPool(const SlabPool &) = delete;
+	SlabPool & operator=(const SlabPool &) = delete;
+
+	int count() const { return count_; }
+	int capacity() const { return (int)chunks_.size() * ChunkSize; }
+
+	// bytes held by the pool, including unused slots
+	size_t memoryUsage() const
+	{
+		return (chunks_.size() * ChunkSize * sizeof(T)) + (free_.capacity() * sizeof(T*)) + (chunks_.capacity() * sizeof(T*));
+	}
+
+	T *create()
+	{
+		if(free_.empty())
+			addChunk();
+
+		T *p = free_.back();
+		free_.pop_back();
+
+		++count_;
+
+		return new(p) T();
+	}
+
+	void release(T *obj)
+	{
+		assert(count_ > 0);
+
+		obj->~T();
+		free_.push_back(obj);
+
+		--count_;
+	}
+
+private:
+	std::vector<T*> chunks_;
+	std::vector<T*> free_;
+	int count_;
+
+	void addChunk()
+	{
+		T *chunk = static_cast<T*>(::operator new(sizeof(T) * ChunkSize));
+		chunks_.push_back(chunk);
+
+		// push in reverse so slots are handed out in address order
+		for(int n = ChunkSize - 1; n >= 0; --n)
+			free_.push_back(chunk + n);
+	}
+};
+
+#endif
@@ -19,6 +19,7 @@
 
 #include <QSocketNotifier>
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 
 class EventLoop;
 
@@ -50,7 +51,7 @@ public:
 	uint8_t readiness() const { return readiness_; }
 	void clearReadiness(uint8_t readiness);
 
-	boost::signals2::signal<void(int, uint8_t)> activated;
+	FastSignal<int, uint8_t> activated;
 
 private:
 	int socket_;
@@ -27,7 +27,7 @@
 #include <assert.h>
 #include <string.h>
 
-#define STATS_COUNTERS_MAX 12
+#define STATS_COUNTERS_MAX 21
 
 namespace Stats {
 
@@ -45,6 +45,15 @@ enum Counter {
     ServerContentBytesSent     =  9,
     ServerMessagesReceived     = 10,
     ServerMessagesSent         = 11,
+    FilterCacheHits            = 12,
+    FilterCacheMisses          = 13,
+    IdCacheDuplicates          = 14,
+    IdCacheUncached            = 15,
+    StreamMessagesSent         = 16,
+    StreamBodyWrites           = 17,
+    MessagesExpired            = 18,
+    SlowConsumerDrops          = 19,
+    SlowConsumerDisconnects    = 20,
 };
 
 class Counters
@@ -24,12 +24,17 @@
 #include "statsmanager.h"
 
 #include <assert.h>
+#include <memory>
+#include <vector>
 #include <QVector>
-#include <QDateTime>
+#include <QRandomGenerator>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include "qzmqsocket.h"
 #include "timerwheel.h"
+#include "slabpool.h"
+#include "latencyhistogram.h"
+#include "objectstats.h"
 #include "log.h"
 #include "defercall.h"
 #include "tnetstring.h"
@@ -37,6 +42,8 @@
 #include "simplehttpserver.h"
 #include "zutil.h"
 #include "timer.h"
+#include "loopclock.h"
+#include "statsreportaggregator.h"
 
 // make this somewhat big since PUB is lossy
 #define OUT_HWM 200000
@@ -46,10 +53,26 @@
 #define EXTERNAL_CONNECTIONS_MAX_INTERVAL 10000
 #define EXPIRE_MAX 10000
 
+// in spread refresh mode, expirations are processed on this interval, with
+// at least this many per batch
+#define SPREAD_INTERVAL 100
+#define SPREAD_BATCH_MIN 100
+
 #define SHOULD_PROCESS_TIME(x) (x * 3 / 4)
 
 #define TICK_DURATION_MS 10
 
+// flush aggregated message counts early if there are this many
+#define MESSAGE_TOTALS_MAX 10000
+
+// prometheus output is rendered ahead of time, at most this often
+#define PROMETHEUS_RENDER_INTERVAL 1000
+
+// limit on labeled per-route series, to bound the exposition size
+#define PROMETHEUS_ROUTES_MAX 10000
+
+#define TOP_CHANNELS_DECAY_INTERVAL 60000
+
 static qint64 durationToTicksRoundDown(qint64 msec)
 {
 	return msec / TICK_DURATION_MS;
@@ -60,6 +83,26 @@ static qint64 durationToTicksRoundUp(qint64 msec)
 	return (msec + TICK_DURATION_MS - 1) / TICK_DURATION_MS;
 }
 
+static QByteArray escapePrometheusLabelValue(const QByteArray &in)
+{
+	QByteArray out;
+	out.reserve(in.size());
+
+	for(char c : in)
+	{
+		if(c == '\\')
+			out += "\\\\";
+		else if(c == '"')
+			out += "\\\"";
+		else if(c == '\n')
+			out += "\\n";
+		else
+			out += c;
+	}
+
+	return out;
+}
+
 class StatsManager::Private
 {
 public:
@@ -82,6 +125,39 @@ public:
 		}
 	};
 
+	class ConnectionInfo;
+
+	class ConnectionLinks
+	{
+	public:
+		ConnectionInfo *prev;
+		ConnectionInfo *next;
+
+		ConnectionLinks() :
+			prev(0),
+			next(0)
+		{
+		}
+	};
+
+	// intrusive list of connections, linked through one of the
+	// ConnectionLinks members of ConnectionInfo
+	class ConnectionList
+	{
+	public:
+		ConnectionInfo *first;
+		int count;
+
+		ConnectionList() :
+			first(0),
+			count(0)
+		{
+		}
+	};
+
+	// connections are allocated from a pool and indexed without any
+	// per-connection containers. routeId and from share their data with
+	// the keys of the route and source tables
 	class ConnectionInfo : public TimerBase
 	{
 	public:
@@ -98,6 +174,8 @@ public:
 		QByteArray from; // external or linger source
 		int ttl; // external
 		qint64 lastActive; // external
+		ConnectionLinks routeLinks;
+		ConnectionLinks bucketLinks; // local only
 
 		ConnectionInfo() :
 			ssl(false),
@@ -112,6 +190,18 @@ public:
 		}
 	};
 
+	class RouteConnections
+	{
+	public:
+		ConnectionList local;
+		ConnectionList external;
+
+		bool isEmpty() const
+		{
+			return (local.count == 0 && external.count == 0);
+		}
+	};
+
 	class Subscription : public TimerBase
 	{
 	public:
@@ -121,12 +211,16 @@ public:
 		qint64 lastRefresh;
 		int refreshBucket;
 		bool linger;
+		qint64 lastSent;
+		quint32 sentSubscriberCount;
 
 		Subscription() :
 			subscriberCount(0),
 			lastRefresh(-1),
 			refreshBucket(-1),
-			linger(false)
+			linger(false),
+			lastSent(-1),
+			sentSubscriberCount(0)
 		{
 		}
 	};
@@ -302,19 +396,19 @@ public:
 			lastUpdate = now;
 		}
 
-		void addMessageSent(const QString &transport, int blocks, qint64 now)
+		void addMessageSent(const QString &transport, int blocks, quint32 count, qint64 now)
 		{
-			++messagesSent;
+			messagesSent += count;
 
 			if(transport == "http-response")
-				++httpResponseMessagesSent;
+				httpResponseMessagesSent += count;
 
 			if(blocks > 0)
 			{
 				if(blocksSent < 0)
 					blocksSent = 0;
 
-				blocksSent += blocks;
+				blocksSent += blocks * (int)count;
 			}
 
 			lastUpdate = now;
@@ -384,7 +478,53 @@ public:
 		}
 	};
 
+	class PrometheusHistogram
+	{
+	public:
+		QString name;
+		QString help;
+		QString labels;
+		const LatencyHistogram *histogram;
+	};
+
+	class PrometheusCounter
+	{
+	public:
+		QString name;
+		QString help;
+		QString labels;
+		const std::atomic<quint64> *counter; // null if gauge
+		const std::atomic<qint64> *gauge;
+	};
+
+	// cumulative per-route values for labeled prometheus series. unlike
+	// reports, these are never reset. each route keeps its rendered sample
+	// lines, which are only regenerated when its values change
+	class PrometheusRoute
+	{
+	public:
+		QByteArray labels;
+		quint32 connectionsMax;
+		quint64 connectionsMinutes;
+		quint64 messagesReceived;
+		QVector<quint64> messagesSent; // indexed by transport
+		bool dirty;
+		QVector<QByteArray> lines; // indexed by route metric
+
+		// created on first use, since most routes are not proxied
+		std::unique_ptr<LatencyHistogram[]> requestTimings; // indexed by phase
+
+		PrometheusRoute() :
+			connectionsMax(0),
+			connectionsMinutes(0),
+			messagesReceived(0),
+			dirty(true)
+		{
+		}
+	};
+
 	typedef QPair<QString, QString> SubscriptionKey;
+	typedef QPair<QByteArray, QByteArray> MessageTotalKey;
 
 	StatsManager *q;
 	int connectionsMax;
@@ -393,6 +533,11 @@ public:
 	int ipcFileMode;
 	QString spec;
 	Format outputFormat;
+	MessageMode messageMode;
+	int messageInterval;
+	QHash<MessageTotalKey, int> messageTotalIndexes;
+	QList<StatsPacket::MessageTotal> messageTotals;
+	qint64 messageTotalsStartTime;
 	bool connectionSend;
 	bool connectionsMaxSend;
 	int connectionTtl;
@@ -401,19 +546,32 @@ public:
 	int subscriptionTtl;
 	int subscriptionLinger;
 	int reportInterval;
+	StatsReportAggregator *reportAggregator;
+	bool reportAggregatorSend;
+	RefreshMode refreshMode;
 	std::unique_ptr<QZmq::Socket> sock;
 	std::unique_ptr<SimpleHttpServer> prometheusServer;
 	int prometheusConnectionsMax;
 	QString prometheusPrefix;
 	QList<PrometheusMetric> prometheusMetrics;
+	QList<PrometheusHistogram> prometheusHistograms;
+	QList<PrometheusCounter> prometheusCounters;
+	QList<PrometheusMetric> prometheusRouteMetrics;
+	QHash<QByteArray, int> prometheusRouteIndexes;
+	std::vector<PrometheusRoute> prometheusRoutes;
+	QList<QByteArray> prometheusTransports;
+	bool prometheusDirty;
+	bool prometheusRoutesMaxWarned;
+	QByteArray prometheusBody;
+	std::unique_ptr<TopK> topChannels[ChannelMetricsCount];
 	QHash<QByteArray, quint32> routeActivity;
+	SlabPool<ConnectionInfo> connectionPool;
 	QHash<QByteArray, ConnectionInfo*> connectionInfoById;
-	QHash<QByteArray, QSet<ConnectionInfo*> > connectionInfoByRoute;
+	QHash<QByteArray, RouteConnections> connectionsByRoute;
 	QHash<QByteArray, RetryInfo> retryInfoBySource;
-	QVector<QSet<ConnectionInfo*> > connectionInfoRefreshBuckets;
+	QVector<ConnectionList> connectionInfoRefreshBuckets;
 	int currentConnectionInfoRefreshBucket;
 	QHash<QByteArray, QHash<QByteArray, ConnectionInfo*> > externalConnectionInfoByFrom;
-	QHash<QByteArray, QSet<ConnectionInfo*> > externalConnectionInfoByRoute;
 	QHash<SubscriptionKey, Subscription*> subscriptionsByKey;
 	QVector<QSet<Subscription*> > subscriptionRefreshBuckets;
 	int currentSubscriptionRefreshBucket;
@@ -428,10 +586,18 @@ public:
 	std::unique_ptr<Timer> reportTimer;
 	std::unique_ptr<Timer> refreshTimer;
 	std::unique_ptr<Timer> externalConnectionsMaxTimer;
+	std::unique_ptr<Timer> prometheusRenderTimer;
+	std::unique_ptr<Timer> messageTimer;
+	std::unique_ptr<Timer> spreadTimer;
+	std::unique_ptr<Timer> topChannelsTimer;
 	Connection activityTimerConnection;
 	Connection reportTimerConnection;
 	Connection refreshTimerConnection;
 	Connection externalConnectionsMaxTimerConnection;
+	Connection prometheusRenderTimerConnection;
+	Connection messageTimerConnection;
+	Connection spreadTimerConnection;
+	Connection topChannelsTimerConnection;
 	Connection promServerConnection;
 
 	Private(StatsManager *_q, int _connectionsMax, int _subscriptionsMax, int _prometheusConnectionsMax) :
@@ -440,6 +606,9 @@ public:
 		subscriptionsMax(_subscriptionsMax),
 		ipcFileMode(-1),
 		outputFormat(TnetStringFormat),
+		messageMode(EachMessage),
+		messageInterval(1000),
+		messageTotalsStartTime(-1),
 		connectionSend(false),
 		connectionsMaxSend(false),
 		connectionTtl(120 * 1000),
@@ -448,7 +617,12 @@ public:
 		subscriptionTtl(60 * 1000),
 		subscriptionLinger(60 * 1000),
 		reportInterval(10 * 1000),
+		reportAggregator(0),
+		reportAggregatorSend(false),
+		refreshMode(BucketRefresh),
 		prometheusConnectionsMax(_prometheusConnectionsMax),
+		prometheusDirty(true),
+		prometheusRoutesMaxWarned(false),
 		currentConnectionInfoRefreshBucket(0),
 		currentSubscriptionRefreshBucket(0),
 		wheel(TimerWheel((_connectionsMax * 2) + _subscriptionsMax))
@@ -457,6 +631,10 @@ public:
 		activityTimerConnection = activityTimer->timeout.connect(boost::bind(&Private::activity_timeout, this));
 		activityTimer->setSingleShot(true);
 
+		messageTimer = std::make_unique<Timer>();
+		messageTimerConnection = messageTimer->timeout.connect(boost::bind(&Private::message_timeout, this));
+		messageTimer->setSingleShot(true);
+
 		refreshTimer = std::make_unique<Timer>();
 		refreshTimerConnection = refreshTimer->timeout.connect(boost::bind(&Private::refresh_timeout, this));
 		refreshTimer->start(REFRESH_INTERVAL);
@@ -474,20 +652,32 @@ public:
 		prometheusMetrics += PrometheusMetric(PrometheusMetric::MessageReceived, "message_received", "counter", "Number of messages received by the publish API");
 		prometheusMetrics += PrometheusMetric(PrometheusMetric::MessageSent,"message_sent", "counter", "Number of messages sent to clients");
 
-		startTime = QDateTime::currentMSecsSinceEpoch();
+		prometheusRouteMetrics += PrometheusMetric(PrometheusMetric::ConnectionConnected, "route_connection_connected", "gauge", "Number of concurrent connections, by route");
+		prometheusRouteMetrics += PrometheusMetric(PrometheusMetric::ConnectionMinute, "route_connection_minute", "counter", "Number of minutes clients have been connected, by route");
+		prometheusRouteMetrics += PrometheusMetric(PrometheusMetric::MessageReceived, "route_message_received", "counter", "Number of messages received by the publish API, by route");
+		prometheusRouteMetrics += PrometheusMetric(PrometheusMetric::MessageSent, "route_message_sent", "counter", "Number of messages sent to clients, by route and transport");
+
+		prometheusTransports += "http-response";
+		prometheusTransports += "http-stream";
+		prometheusTransports += "ws-message";
+
+		startTime = LoopClock::msecsSinceEpoch();
 
 		connectionsMaxes.lastRefresh = startTime;
 	}
 
 	~Private()
 	{
-		qDeleteAll(connectionInfoById);
+		foreach(ConnectionInfo *c, connectionInfoById)
+			destroyConnection(c);
 
 		QMutableHashIterator<QByteArray, QHash<QByteArray, ConnectionInfo*> > it(externalConnectionInfoByFrom);
 		while(it.hasNext())
 		{
 			it.next();
-			qDeleteAll(it.value());
+
+			foreach(ConnectionInfo *c, it.value())
+				destroyConnection(c);
 		}
 
 		qDeleteAll(subscriptionsByKey);
@@ -557,23 +747,93 @@ public:
 			}
 		}
 
+		prometheusRenderTimer = std::make_unique<Timer>();
+		prometheusRenderTimerConnection = prometheusRenderTimer->timeout.connect(boost::bind(&Private::prometheusRender_timeout, this));
+		prometheusRenderTimer->start(PROMETHEUS_RENDER_INTERVAL);
+
 		return true;
 	}
 
+	static void connectionListInsert(ConnectionList *list, ConnectionInfo *c, ConnectionLinks ConnectionInfo::*links)
+	{
+		ConnectionLinks &l = c->*links;
+
+		assert(!l.prev && !l.next && list->first != c);
+
+		l.next = list->first;
+		if(list->first)
+			(list->first->*links).prev = c;
+
+		list->first = c;
+		++list->count;
+	}
+
+	static void connectionListRemove(ConnectionList *list, ConnectionInfo *c, ConnectionLinks ConnectionInfo::*links)
+	{
+		ConnectionLinks &l = c->*links;
+
+		if(l.prev)
+			(l.prev->*links).next = l.next;
+		else
+			list->first = l.next;
+
+		if(l.next)
+			(l.next->*links).prev = l.prev;
+
+		l.prev = 0;
+		l.next = 0;
+
+		--list->count;
+	}
+
+	ConnectionInfo *createConnection()
+	{
+		ObjectStats::add(ObjectStats::StatsConnections, 1, sizeof(ConnectionInfo));
+
+		return connectionPool.create();
+	}
+
+	void destroyConnection(ConnectionInfo *c)
+	{
+		connectionPool.release(c);
+
+		ObjectStats::remove(ObjectStats::StatsConnections, 1, sizeof(ConnectionInfo));
+	}
+
+	// returns the route's entry, and points routeId at the table's copy of
+	// the route id
+	RouteConnections & getOrCreateRouteConnections(QByteArray *routeId)
+	{
+		QHash<QByteArray, RouteConnections>::iterator it = connectionsByRoute.find(*routeId);
+		if(it == connectionsByRoute.end())
+			it = connectionsByRoute.insert(*routeId, RouteConnections());
+
+		*routeId = it.key();
+
+		return it.value();
+	}
+
 	void setupConnectionBuckets()
 	{
 		int shouldProcessTime = SHOULD_PROCESS_TIME(connectionTtl);
-		QVector<QSet<ConnectionInfo*> > newBuckets(qMax(shouldProcessTime / REFRESH_INTERVAL, 1));
+		QVector<ConnectionList> newBuckets(qMax(shouldProcessTime / REFRESH_INTERVAL, 1));
 
 		// rebalance (NOTE: this algorithm is not optimal)
 		int nextBucketIndex = 0;
 		for(int n = 0; n < connectionInfoRefreshBuckets.count(); ++n)
 		{
-			foreach(ConnectionInfo *c, connectionInfoRefreshBuckets[n])
+			ConnectionInfo *c = connectionInfoRefreshBuckets[n].first;
+			while(c)
 			{
-				newBuckets[nextBucketIndex++] += c;
+				ConnectionInfo *next = c->bucketLinks.next;
+
+				c->bucketLinks = ConnectionLinks();
+				c->refreshBucket = nextBucketIndex;
+				connectionListInsert(&newBuckets[nextBucketIndex++], c, &ConnectionInfo::bucketLinks);
 				if(nextBucketIndex >= newBuckets.count())
 					nextBucketIndex = 0;
+
+				c = next;
 			}
 		}
 
@@ -615,6 +875,11 @@ public:
 			reportTimerConnection.disconnect();
 			reportTimer.reset();
 		}
+		else if(reportTimer)
+		{
+			// interval changed
+			reportTimer->start(reportInterval);
+		}
 	}
 
 	int smallestConnectionInfoRefreshBucket()
@@ -624,10 +889,10 @@ public:
 
 		for(int n = 0; n < connectionInfoRefreshBuckets.count(); ++n)
 		{
-			if(best == -1 || connectionInfoRefreshBuckets[n].count() < bestSize)
+			if(best == -1 || connectionInfoRefreshBuckets[n].count < bestSize)
 			{
 				best = n;
-				bestSize = connectionInfoRefreshBuckets[n].count();
+				bestSize = connectionInfoRefreshBuckets[n].count;
 			}
 		}
 
@@ -683,27 +948,42 @@ public:
 	{
 		connectionInfoById[c->id] = c;
 
-		QSet<ConnectionInfo*> &cs = connectionInfoByRoute[c->routeId];
-		cs += c;
+		RouteConnections &rc = getOrCreateRouteConnections(&c->routeId);
+		connectionListInsert(&rc.local, c, &ConnectionInfo::routeLinks);
 
 		assert(c->lastRefresh >= 0);
-		wheelAdd(c->lastRefresh + SHOULD_PROCESS_TIME(connectionTtl), c);
 
-		c->refreshBucket = smallestConnectionInfoRefreshBucket();
-		connectionInfoRefreshBuckets[c->refreshBucket] += c;
+		if(refreshMode == SpreadRefresh)
+		{
+			// the wheel refreshes the connection. the first refresh happens
+			// at a random point within the window, and subsequent ones a
+			// full window apart, so that refreshes of connections added
+			// together don't stay clustered
+			int window = SHOULD_PROCESS_TIME(connectionTtl);
+			qint64 offset = window > 0 ? QRandomGenerator::global()->bounded(window) + 1 : 0;
+
+			wheelAdd(c->lastRefresh + offset, c);
+		}
+		else
+		{
+			wheelAdd(c->lastRefresh + SHOULD_PROCESS_TIME(connectionTtl), c);
+
+			c->refreshBucket = smallestConnectionInfoRefreshBucket();
+			connectionListInsert(&connectionInfoRefreshBuckets[c->refreshBucket], c, &ConnectionInfo::bucketLinks);
+		}
 	}
 
 	void removeConnection(ConnectionInfo *c)
 	{
 		connectionInfoById.remove(c->id);
 
-		if(connectionInfoByRoute.contains(c->routeId))
+		QHash<QByteArray, RouteConnections>::iterator it = connectionsByRoute.find(c->routeId);
+		if(it != connectionsByRoute.end())
 		{
-			QSet<ConnectionInfo*> &cs = connectionInfoByRoute[c->routeId];
-			cs.remove(c);
+			connectionListRemove(&it.value().local, c, &ConnectionInfo::routeLinks);
 
-			if(cs.isEmpty())
-				connectionInfoByRoute.remove(c->routeId);
+			if(it.value().isEmpty())
+				connectionsByRoute.erase(it);
 		}
 
 		if(c->retrySeq >= 0)
@@ -720,17 +1000,30 @@ public:
 		if(c->lastRefresh >= 0)
 		{
 			wheelRemove(c);
-			connectionInfoRefreshBuckets[c->refreshBucket].remove(c);
+			removeFromRefreshBucket(c);
 		}
 	}
 
+	void removeFromRefreshBucket(ConnectionInfo *c)
+	{
+		if(c->refreshBucket < 0)
+			return;
+
+		connectionListRemove(&connectionInfoRefreshBuckets[c->refreshBucket], c, &ConnectionInfo::bucketLinks);
+		c->refreshBucket = -1;
+	}
+
 	void insertExternalConnection(ConnectionInfo *c)
 	{
-		QHash<QByteArray, ConnectionInfo*> &extConnectionInfoById = externalConnectionInfoByFrom[c->from];
-		extConnectionInfoById[c->id] = c;
+		QHash<QByteArray, QHash<QByteArray, ConnectionInfo*> >::iterator it = externalConnectionInfoByFrom.find(c->from);
+		if(it == externalConnectionInfoByFrom.end())
+			it = externalConnectionInfoByFrom.insert(c->from, QHash<QByteArray, ConnectionInfo*>());
 
-		QSet<ConnectionInfo*> &cs = externalConnectionInfoByRoute[c->routeId];
-		cs += c;
+		c->from = it.key();
+		it.value()[c->id] = c;
+
+		RouteConnections &rc = getOrCreateRouteConnections(&c->routeId);
+		connectionListInsert(&rc.external, c, &ConnectionInfo::routeLinks);
 
 		assert(c->lastActive >= 0);
 		wheelAdd(c->lastActive + connectionTtl, c);
@@ -749,13 +1042,13 @@ public:
 		if(extConnectionInfoById.isEmpty())
 			externalConnectionInfoByFrom.remove(c->from);
 
-		if(externalConnectionInfoByRoute.contains(c->routeId))
+		QHash<QByteArray, RouteConnections>::iterator it = connectionsByRoute.find(c->routeId);
+		if(it != connectionsByRoute.end())
 		{
-			QSet<ConnectionInfo*> &cs = externalConnectionInfoByRoute[c->routeId];
-			cs.remove(c);
+			connectionListRemove(&it.value().external, c, &ConnectionInfo::routeLinks);
 
-			if(cs.isEmpty())
-				externalConnectionInfoByRoute.remove(c->routeId);
+			if(it.value().isEmpty())
+				connectionsByRoute.erase(it);
 		}
 
 		wheelRemove(c);
@@ -788,7 +1081,7 @@ public:
 		foreach(ConnectionInfo *c, toRemove)
 		{
 			removeConnection(c);
-			delete c;
+			destroyConnection(c);
 		}
 	}
 
@@ -825,7 +1118,7 @@ public:
 		{
 			report = new Report;
 			report->routeId = routeId;
-			report->startTime = QDateTime::currentMSecsSinceEpoch();
+			report->startTime = LoopClock::msecsSinceEpoch();
 			reports[routeId] = report;
 		}
 
@@ -836,10 +1129,68 @@ public:
 	{
 		// subtract the current total from the combined report
 		combinedReport.connectionsMax -= report->connectionsMax;
+		prometheusDirty = true;
 
 		reports.remove(report->routeId);
 	}
 
+	// returns null if prometheus is not enabled or the series limit has been
+	// reached. the route is marked for re-rendering
+	PrometheusRoute *getOrCreatePrometheusRoute(const QByteArray &routeId)
+	{
+		if(!prometheusServer)
+			return 0;
+
+		// combined values change along with the route's
+		prometheusDirty = true;
+
+		int index = prometheusRouteIndexes.value(routeId, -1);
+		if(index == -1)
+		{
+			if((int)prometheusRoutes.size() >= PROMETHEUS_ROUTES_MAX)
+			{
+				if(!prometheusRoutesMaxWarned)
+				{
+					log_warning("stats: prometheus route limit reached (%d), further routes will not get labeled series", PROMETHEUS_ROUTES_MAX);
+					prometheusRoutesMaxWarned = true;
+				}
+
+				return 0;
+			}
+
+			index = (int)prometheusRoutes.size();
+			prometheusRoutes.push_back(PrometheusRoute());
+			prometheusRoutes.back().labels = "route=\"" + escapePrometheusLabelValue(routeId) + "\"";
+			prometheusRouteIndexes.insert(routeId, index);
+		}
+
+		PrometheusRoute *r = &prometheusRoutes[index];
+		r->dirty = true;
+
+		return r;
+	}
+
+	int prometheusTransportIndex(const QString &transport)
+	{
+		QByteArray t = transport.toUtf8();
+
+		int index = prometheusTransports.indexOf(t);
+		if(index == -1)
+		{
+			index = prometheusTransports.count();
+			prometheusTransports += t;
+		}
+
+		return index;
+	}
+
+	void addPrometheusConnectionsMinutes(const QByteArray &routeId, quint32 mins)
+	{
+		PrometheusRoute *r = getOrCreatePrometheusRoute(routeId);
+		if(r)
+			r->connectionsMinutes += mins;
+	}
+
 	ConnectionsMax & getOrCreateConnectionsMax(const QByteArray &routeId)
 	{
 		if(!connectionsMaxes.maxes.contains(routeId))
@@ -857,6 +1208,8 @@ public:
 			prefix = "activity";
 		else if(packet.type == StatsPacket::Message)
 			prefix = "message";
+		else if(packet.type == StatsPacket::Messages)
+			prefix = "messages";
 		else if(packet.type == StatsPacket::Connected || packet.type == StatsPacket::Disconnected)
 			prefix = "conn";
 		else if(packet.type == StatsPacket::Subscribed || packet.type == StatsPacket::Unsubscribed)
@@ -868,10 +1221,18 @@ public:
 		else // ConnectionsMax
 			prefix = "conn-max";
 
-		QVariant vpacket = packet.toVariant();
+		bool binary = (outputFormat == BinaryFormat && StatsPacket::canEncodeBinary(packet.type));
+
+		QVariant vpacket;
+		if(!binary || log_outputLevel() >= LOG_LEVEL_DEBUG)
+			vpacket = packet.toVariant();
 
 		QByteArray buf;
-		if(outputFormat == TnetStringFormat)
+		if(binary)
+		{
+			buf = prefix + " B" + packet.toBinary();
+		}
+		else if(outputFormat == TnetStringFormat || outputFormat == BinaryFormat)
 		{
 			buf = prefix + " T" + TnetString::fromVariant(vpacket);
 		}
@@ -919,6 +1280,72 @@ public:
 		write(p);
 	}
 
+	void aggregateMessage(const QString &channel, const QString &transport, quint32 count, int blocks)
+	{
+		if(!sock)
+			return;
+
+		MessageTotalKey key(channel.toUtf8(), transport.toUtf8());
+
+		int index = messageTotalIndexes.value(key, -1);
+		if(index == -1)
+		{
+			index = messageTotals.count();
+
+			StatsPacket::MessageTotal t;
+			t.channel = key.first;
+			t.transport = key.second;
+			messageTotals += t;
+
+			messageTotalIndexes.insert(key, index);
+		}
+
+		StatsPacket::MessageTotal &t = messageTotals[index];
+		++t.messages;
+		t.count += count;
+
+		if(blocks >= 0)
+		{
+			if(t.blocks < 0)
+				t.blocks = 0;
+
+			t.blocks += blocks;
+		}
+
+		if(messageTotalsStartTime < 0)
+			messageTotalsStartTime = LoopClock::msecsSinceEpoch();
+
+		if(messageTotals.count() >= MESSAGE_TOTALS_MAX)
+		{
+			messageTimer->stop();
+			sendMessageTotals();
+		}
+		else if(!messageTimer->isActive())
+		{
+			messageTimer->start(messageInterval);
+		}
+	}
+
+	void sendMessageTotals()
+	{
+		if(messageTotals.isEmpty())
+			return;
+
+		if(sock)
+		{
+			StatsPacket p;
+			p.type = StatsPacket::Messages;
+			p.from = instanceId;
+			p.messageTotals = messageTotals;
+			p.duration = LoopClock::msecsSinceEpoch() - messageTotalsStartTime;
+			write(p);
+		}
+
+		messageTotalIndexes.clear();
+		messageTotals.clear();
+		messageTotalsStartTime = -1;
+	}
+
 	void sendConnected(ConnectionInfo *c)
 	{
 		if(!sock || !connectionSend)
@@ -954,6 +1381,9 @@ public:
 
 	void sendSubscribed(Subscription *s)
 	{
+		s->lastSent = LoopClock::msecsSinceEpoch();
+		s->sentSubscriberCount = s->subscriberCount;
+
 		if(!sock)
 			return;
 
@@ -999,8 +1429,15 @@ public:
 
 	void updateConnectionsMax(const QByteArray &routeId, qint64 now)
 	{
-		quint32 localConns = connectionInfoByRoute.value(routeId).count();
-		quint32 extConns = externalConnectionInfoByRoute.value(routeId).count();
+		quint32 localConns = 0;
+		quint32 extConns = 0;
+
+		QHash<QByteArray, RouteConnections>::const_iterator it = connectionsByRoute.constFind(routeId);
+		if(it != connectionsByRoute.constEnd())
+		{
+			localConns = it.value().local.count;
+			extConns = it.value().external.count;
+		}
 
 		quint32 extConnsMax = 0;
 		if(externalConnectionsMaxes.contains(routeId))
@@ -1049,6 +1486,10 @@ public:
 			// add the new total to the combined report
 			combinedReport.connectionsMax += report->connectionsMax;
 			combinedReport.lastUpdate = now;
+
+			PrometheusRoute *r = getOrCreatePrometheusRoute(routeId);
+			if(r)
+				r->connectionsMax = report->connectionsMax;
 		}
 	}
 
@@ -1068,15 +1509,77 @@ public:
 
 			report->addConnectionsMinutes(mins, now);
 			combinedReport.addConnectionsMinutes(mins, now);
+			addPrometheusConnectionsMinutes(c->routeId, mins);
 		}
 	}
 
-	void handleExpirations(qint64 now)
+	void updateWheel(qint64 now)
+	{
+		// time must go forward
+		if(now > startTime)
+		{
+			quint64 currentTicks = (quint64)durationToTicksRoundDown(now - startTime);
+
+			wheel.update(currentTicks);
+		}
+	}
+
+	// the number of wheel expirations to process per spread interval. this
+	// is twice the average rate needed to get through every timer within a
+	// refresh window, so backlogs drain while batches stay bounded
+	int spreadBatchMax() const
+	{
+		int window = qMin(SHOULD_PROCESS_TIME(connectionTtl), SHOULD_PROCESS_TIME(subscriptionTtl));
+		int intervals = qMax(window / SPREAD_INTERVAL, 1);
+		int timers = connectionPool.count() + subscriptionsByKey.count();
+
+		return qMax((timers / intervals) * 2, SPREAD_BATCH_MIN);
+	}
+
+	void setRefreshMode(RefreshMode mode)
+	{
+		if(mode == refreshMode)
+			return;
+
+		refreshMode = mode;
+
+		if(refreshMode == SpreadRefresh)
+		{
+			spreadTimer = std::make_unique<Timer>();
+			spreadTimerConnection = spreadTimer->timeout.connect(boost::bind(&Private::spread_timeout, this));
+			spreadTimer->start(SPREAD_INTERVAL);
+
+			// take existing connections out of the buckets. their wheel
+			// timers are already set and will refresh them from now on
+			for(int n = 0; n < connectionInfoRefreshBuckets.count(); ++n)
+			{
+				ConnectionList &bucket = connectionInfoRefreshBuckets[n];
+				while(bucket.first)
+					removeFromRefreshBucket(bucket.first);
+			}
+		}
+		else
+		{
+			spreadTimerConnection.disconnect();
+			spreadTimer.reset();
+
+			foreach(ConnectionInfo *c, connectionInfoById)
+			{
+				if(c->lastRefresh >= 0)
+				{
+					c->refreshBucket = smallestConnectionInfoRefreshBucket();
+					connectionListInsert(&connectionInfoRefreshBuckets[c->refreshBucket], c, &ConnectionInfo::bucketLinks);
+				}
+			}
+		}
+	}
+
+	void handleExpirations(qint64 now, int max = EXPIRE_MAX)
 	{
 		QList<QByteArray> refreshedConnIds;
 		QSet<QByteArray> routesUpdated;
 
-		for(int i = 0; i < EXPIRE_MAX; ++i)
+		for(int i = 0; i < max; ++i)
 		{
 			TimerWheel::Expired expired = wheel.takeExpired();
 
@@ -1100,7 +1603,7 @@ public:
 						// in linger mode, next refresh is set to the time we should
 						//   delete the connection rather than refresh
 
-						connectionInfoRefreshBuckets[c->refreshBucket].remove(c);
+						removeFromRefreshBucket(c);
 						c->lastRefresh = -1;
 
 						// note: we don't send a disconnect message when the
@@ -1108,7 +1611,7 @@ public:
 						//   owns the connection now
 
 						removeConnection(c);
-						delete c;
+						destroyConnection(c);
 					}
 					else
 					{
@@ -1130,7 +1633,7 @@ public:
 					routesUpdated += c->routeId;
 					updateConnectionsMinutes(c, now);
 					removeExternalConnection(c);
-					delete c;
+					destroyConnection(c);
 
 					break;
 				}
@@ -1180,8 +1683,8 @@ public:
 		QList<QByteArray> refreshedIds;
 
 		// process the current bucket
-		const QSet<ConnectionInfo*> &bucket = connectionInfoRefreshBuckets[currentConnectionInfoRefreshBucket];
-		foreach(ConnectionInfo *c, bucket)
+		const ConnectionList &bucket = connectionInfoRefreshBuckets[currentConnectionInfoRefreshBucket];
+		for(ConnectionInfo *c = bucket.first; c; c = c->bucketLinks.next)
 		{
 			// don't bucket-process lingered connections
 			if(c->linger)
@@ -1318,8 +1821,17 @@ public:
 		counters.inc(Stats::ServerContentBytesSent, qMax(packet.serverContentBytesSent, 0));
 		counters.inc(Stats::ServerMessagesReceived, qMax(packet.serverMessagesReceived, 0));
 		counters.inc(Stats::ServerMessagesSent, qMax(packet.serverMessagesSent, 0));
-
-		qint64 now = QDateTime::currentMSecsSinceEpoch();
+		counters.inc(Stats::FilterCacheHits, qMax(packet.filterCacheHits, 0));
+		counters.inc(Stats::FilterCacheMisses, qMax(packet.filterCacheMisses, 0));
+		counters.inc(Stats::IdCacheDuplicates, qMax(packet.idCacheDuplicates, 0));
+		counters.inc(Stats::IdCacheUncached, qMax(packet.idCacheUncached, 0));
+		counters.inc(Stats::StreamMessagesSent, qMax(packet.streamMessagesSent, 0));
+		counters.inc(Stats::StreamBodyWrites, qMax(packet.streamBodyWrites, 0));
+		counters.inc(Stats::MessagesExpired, qMax(packet.messagesExpired, 0));
+		counters.inc(Stats::SlowConsumerDrops, qMax(packet.slowConsumerDrops, 0));
+		counters.inc(Stats::SlowConsumerDisconnects, qMax(packet.slowConsumerDisconnects, 0));
+
+		qint64 now = LoopClock::msecsSinceEpoch();
 
 		report->addCounters(counters, now);
 		combinedReport.addCounters(counters, now);
@@ -1335,6 +1847,7 @@ public:
 
 			r.connectionsMinutes += mins;
 			combinedReport.addConnectionsMinutes(mins, now);
+			addPrometheusConnectionsMinutes(packet.route, mins);
 		}
 	}
 
@@ -1369,6 +1882,15 @@ public:
 		p.serverContentBytesSent = report->counters.get(Stats::ServerContentBytesSent);
 		p.serverMessagesReceived = report->counters.get(Stats::ServerMessagesReceived);
 		p.serverMessagesSent = report->counters.get(Stats::ServerMessagesSent);
+		p.filterCacheHits = report->counters.get(Stats::FilterCacheHits);
+		p.filterCacheMisses = report->counters.get(Stats::FilterCacheMisses);
+		p.idCacheDuplicates = report->counters.get(Stats::IdCacheDuplicates);
+		p.idCacheUncached = report->counters.get(Stats::IdCacheUncached);
+		p.streamMessagesSent = report->counters.get(Stats::StreamMessagesSent);
+		p.streamBodyWrites = report->counters.get(Stats::StreamBodyWrites);
+		p.messagesExpired = report->counters.get(Stats::MessagesExpired);
+		p.slowConsumerDrops = report->counters.get(Stats::SlowConsumerDrops);
+		p.slowConsumerDisconnects = report->counters.get(Stats::SlowConsumerDisconnects);
 
 		report->startTime = now;
 		report->connectionsMaxStale = true;
@@ -1388,7 +1910,7 @@ public:
 	{
 		Report *report = getOrCreateReport(routeId);
 
-		qint64 now = QDateTime::currentMSecsSinceEpoch();
+		qint64 now = LoopClock::msecsSinceEpoch();
 
 		StatsPacket p = reportToPacket(report, routeId, now);
 
@@ -1398,12 +1920,35 @@ public:
 			delete report;
 		}
 
-		if(sock)
+		if(reportAggregator)
+			sendAggregatedReports(QList<StatsPacket>() << p);
+		else if(sock)
 			write(p);
 
 		q->reported(QList<StatsPacket>() << p);
 	}
 
+	void sendAggregatedReports(const QList<StatsPacket> &packets)
+	{
+		reportAggregator->add(packets);
+
+		if(!reportAggregatorSend)
+			return;
+
+		// includes whatever the other managers handed over since the last
+		// interval
+		QList<StatsPacket> merged = reportAggregator->take();
+
+		if(!sock)
+			return;
+
+		foreach(StatsPacket p, merged)
+		{
+			p.from = instanceId;
+			write(p);
+		}
+	}
+
 	StatsPacket getConnMaxPacket(const QByteArray &routeId, ConnectionsMax *cm, qint64 now)
 	{
 		quint32 value = cm->valueToSend();
@@ -1442,7 +1987,7 @@ private:
 			combinedCounts = Counts();
 		}
 
-		qint64 now = QDateTime::currentMSecsSinceEpoch();
+		qint64 now = LoopClock::msecsSinceEpoch();
 
 		QSet<QByteArray> needSendNext;
 
@@ -1467,7 +2012,7 @@ private:
 
 	void report_timeout()
 	{
-		qint64 now = QDateTime::currentMSecsSinceEpoch();
+		qint64 now = LoopClock::msecsSinceEpoch();
 
 		QList<StatsPacket> reportPackets;
 		QList<Report*> toDelete;
@@ -1491,7 +2036,7 @@ private:
 				toDelete += report;
 			}
 
-			if(sock)
+			if(sock && !reportAggregator)
 				write(p);
 
 			reportPackets += p;
@@ -1503,24 +2048,40 @@ private:
 			delete report;
 		}
 
+		if(reportAggregator)
+			sendAggregatedReports(reportPackets);
+
 		if(!reportPackets.isEmpty())
 			q->reported(reportPackets);
+
+		q->reportIntervalElapsed();
+	}
+
+	void message_timeout()
+	{
+		sendMessageTotals();
+	}
+
+	void spread_timeout()
+	{
+		qint64 currentTime = LoopClock::msecsSinceEpoch();
+
+		updateWheel(currentTime);
+
+		handleExpirations(currentTime, spreadBatchMax());
 	}
 
 	void refresh_timeout()
 	{
-		qint64 currentTime = QDateTime::currentMSecsSinceEpoch();
+		qint64 currentTime = LoopClock::msecsSinceEpoch();
 
-		// time must go forward
-		if(currentTime > startTime)
+		if(refreshMode == BucketRefresh)
 		{
-			quint64 currentTicks = (quint64)durationToTicksRoundDown(currentTime - startTime);
+			updateWheel(currentTime);
 
-			wheel.update(currentTicks);
+			handleExpirations(currentTime);
 		}
 
-		handleExpirations(currentTime);
-
 		refreshConnections(currentTime);
 		refreshSubscriptions(currentTime);
 		refreshConnectionsMaxes(currentTime);
@@ -1528,45 +2089,278 @@ private:
 
 	void externalConnectionsMax_timeout()
 	{
-		qint64 currentTime = QDateTime::currentMSecsSinceEpoch();
+		qint64 currentTime = LoopClock::msecsSinceEpoch();
 
 		expireExternalConnectionsMaxes(currentTime);
 	}
 
-	void prometheus_requestReady()
+	void setTopChannels(int count)
 	{
-		SimpleHttpRequest *req = prometheusServer->takeNext();
+		topChannelsTimerConnection.disconnect();
+		topChannelsTimer.reset();
 
-		QString data;
+		for(int n = 0; n < ChannelMetricsCount; ++n)
+			topChannels[n].reset();
 
-		foreach(const PrometheusMetric &m, prometheusMetrics)
+		if(count > 0)
 		{
-			QVariant value;
+			for(int n = 0; n < ChannelMetricsCount; ++n)
+				topChannels[n] = std::make_unique<TopK>(count);
+
+			topChannelsTimer = std::make_unique<Timer>();
+			topChannelsTimerConnection = topChannelsTimer->timeout.connect(boost::bind(&Private::topChannels_timeout, this));
+			topChannelsTimer->start(TOP_CHANNELS_DECAY_INTERVAL);
+		}
+
+		prometheusDirty = true;
+	}
+
+	void addPublish(const QString &channel, quint32 recipients, qint64 bytes)
+	{
+		if(!topChannels[0])
+			return;
+
+		topChannels[ChannelPublishes]->add(channel);
+
+		if(recipients > 0)
+			topChannels[ChannelRecipients]->add(channel, recipients);
+
+		if(bytes > 0)
+			topChannels[ChannelBytes]->add(channel, (quint64)bytes);
+
+		if(prometheusServer)
+			prometheusDirty = true;
+	}
+
+	void topChannels_timeout()
+	{
+		for(int n = 0; n < ChannelMetricsCount; ++n)
+			topChannels[n]->decay();
+
+		prometheusDirty = true;
+	}
+
+	void renderPrometheusTopChannels(QByteArray *body, const QByteArray &prefix)
+	{
+		static const char *names[ChannelMetricsCount] = { "top_channel_published", "top_channel_recipients", "top_channel_bytes" };
+		static const char *helps[ChannelMetricsCount] =
+		{
+			"Messages published, for the busiest channels",
+			"Message recipients, for the busiest channels",
+			"Bytes sent to recipients, for the busiest channels"
+		};
+
+		for(int n = 0; n < ChannelMetricsCount; ++n)
+		{
+			QByteArray name = prefix + names[n];
+
+			// counts are decayed, so they are exposed as gauges
+			*body += "# HELP " + name + ' ' + helps[n] + " (halved every minute)\n";
+			*body += "# TYPE " + name + " gauge\n";
+
+			foreach(const TopK::Item &i, topChannels[n]->items())
+				*body += name + "{channel=\"" + escapePrometheusLabelValue(i.key.toUtf8()) + "\"} " + QByteArray::number(i.count) + '\n';
+		}
+	}
+
+	void renderPrometheusRoute(PrometheusRoute *r, const QList<QByteArray> &names)
+	{
+		r->lines.resize(prometheusRouteMetrics.count());
+
+		for(int n = 0; n < prometheusRouteMetrics.count(); ++n)
+		{
+			const PrometheusMetric &m = prometheusRouteMetrics[n];
+			QByteArray &out = r->lines[n];
+
+			out.clear();
+
+			if(m.mtype == PrometheusMetric::MessageSent)
+			{
+				for(int i = 0; i < r->messagesSent.count(); ++i)
+				{
+					if(r->messagesSent[i] == 0)
+						continue;
+
+					out += names[n] + '{' + r->labels + ",transport=\"" + prometheusTransports[i] + "\"} " + QByteArray::number(r->messagesSent[i]) + '\n';
+				}
+
+				continue;
+			}
+
+			quint64 value = 0;
 
 			switch(m.mtype)
 			{
-				case PrometheusMetric::RequestReceived: value = QVariant(combinedReport.requestsReceived); break;
-				case PrometheusMetric::ConnectionConnected: value = QVariant(combinedReport.connectionsMax); break;
-				case PrometheusMetric::ConnectionMinute: value = QVariant(combinedReport.connectionsMinutes); break;
-				case PrometheusMetric::MessageReceived: value = QVariant(combinedReport.messagesReceived); break;
-				case PrometheusMetric::MessageSent: value = QVariant(combinedReport.messagesSent); break;
+				case PrometheusMetric::ConnectionConnected: value = r->connectionsMax; break;
+				case PrometheusMetric::ConnectionMinute: value = r->connectionsMinutes; break;
+				case PrometheusMetric::MessageReceived: value = r->messagesReceived; break;
+				default: break;
 			}
 
-			if(value.isNull())
+			out += names[n] + '{' + r->labels + "} " + QByteArray::number(value) + '\n';
+		}
+
+		r->dirty = false;
+	}
+
+	void renderPrometheusRequestTimings(QByteArray *body)
+	{
+		static const char *phaseNames[StatsManager::RequestPhasesCount] =
+		{
+			"inspect",
+			"origin",
+			"accept",
+			"write_wait",
+			"total"
+		};
+
+		QString name = prometheusPrefix + "route_request_phase_seconds";
+		QString out;
+
+		for(const PrometheusRoute &r : prometheusRoutes)
+		{
+			if(!r.requestTimings)
 				continue;
 
-			data += QString(
-			"# HELP %1%2 %3\n"
-			"# TYPE %4%5 %6\n"
-			"%7%8 %9\n"
-			).arg(prometheusPrefix, m.name, m.help, prometheusPrefix, m.name, m.type, prometheusPrefix, m.name, value.toString());
+			QString labels = QString::fromUtf8(r.labels);
+
+			for(int n = 0; n < StatsManager::RequestPhasesCount; ++n)
+			{
+				const LatencyHistogram &h = r.requestTimings[n];
+				if(h.count() > 0)
+					h.writePrometheus(&out, name, labels + ",phase=\"" + phaseNames[n] + '"');
+			}
+		}
+
+		if(out.isEmpty())
+			return;
+
+		*body += "# HELP " + name.toUtf8() + " Duration of the phases of proxied requests, by route\n";
+		*body += "# TYPE " + name.toUtf8() + " histogram\n";
+		*body += out.toUtf8();
+	}
+
+	// renders the whole exposition into prometheusBody. only routes whose
+	// values changed since the last render are formatted again, and the
+	// rest are copied from their cached lines
+	void renderPrometheus()
+	{
+		QByteArray prefix = prometheusPrefix.toUtf8();
+
+		QByteArray body;
+		body.reserve(prometheusBody.size());
+
+		foreach(const PrometheusMetric &m, prometheusMetrics)
+		{
+			quint64 value = 0;
+
+			switch(m.mtype)
+			{
+				case PrometheusMetric::RequestReceived: value = combinedReport.requestsReceived; break;
+				case PrometheusMetric::ConnectionConnected: value = combinedReport.connectionsMax; break;
+				case PrometheusMetric::ConnectionMinute: value = combinedReport.connectionsMinutes; break;
+				case PrometheusMetric::MessageReceived: value = combinedReport.messagesReceived; break;
+				case PrometheusMetric::MessageSent: value = combinedReport.messagesSent; break;
+			}
+
+			QByteArray name = prefix + m.name.toUtf8();
+
+			body += "# HELP " + name + ' ' + m.help.toUtf8() + '\n';
+			body += "# TYPE " + name + ' ' + m.type.toUtf8() + '\n';
+			body += name + ' ' + QByteArray::number(value) + '\n';
+		}
+
+		if(!prometheusRoutes.empty())
+		{
+			QList<QByteArray> names;
+			foreach(const PrometheusMetric &m, prometheusRouteMetrics)
+				names += prefix + m.name.toUtf8();
+
+			for(PrometheusRoute &r : prometheusRoutes)
+			{
+				if(r.dirty)
+					renderPrometheusRoute(&r, names);
+			}
+
+			for(int n = 0; n < prometheusRouteMetrics.count(); ++n)
+			{
+				const PrometheusMetric &m = prometheusRouteMetrics[n];
+
+				body += "# HELP " + names[n] + ' ' + m.help.toUtf8() + '\n';
+				body += "# TYPE " + names[n] + ' ' + m.type.toUtf8() + '\n';
+
+				for(const PrometheusRoute &r : prometheusRoutes)
+					body += r.lines[n];
+			}
+
+			renderPrometheusRequestTimings(&body);
+		}
+
+		if(topChannels[0])
+			renderPrometheusTopChannels(&body, prefix);
+
+		QString hdata;
+		QString lastName;
+		foreach(const PrometheusHistogram &h, prometheusHistograms)
+		{
+			if(h.name != lastName)
+			{
+				hdata += QString(
+				"# HELP %1%2 %3\n"
+				"# TYPE %4%5 histogram\n"
+				).arg(prometheusPrefix, h.name, h.help, prometheusPrefix, h.name);
+
+				lastName = h.name;
+			}
+
+			h.histogram->writePrometheus(&hdata, prometheusPrefix + h.name, h.labels);
 		}
 
+		lastName.clear();
+		foreach(const PrometheusCounter &c, prometheusCounters)
+		{
+			if(c.name != lastName)
+			{
+				hdata += QString(
+				"# HELP %1%2 %3\n"
+				"# TYPE %4%5 %6\n"
+				).arg(prometheusPrefix, c.name, c.help, prometheusPrefix, c.name, c.counter ? "counter" : "gauge");
+
+				lastName = c.name;
+			}
+
+			QString value = c.counter ? QString::number(c.counter->load(std::memory_order_relaxed)) : QString::number(c.gauge->load(std::memory_order_relaxed));
+
+			QString labels = c.labels.isEmpty() ? QString() : ('{' + c.labels + '}');
+			hdata += prometheusPrefix + c.name + labels + ' ' + value + '\n';
+		}
+
+		body += hdata.toUtf8();
+
+		prometheusBody = body;
+		prometheusDirty = false;
+	}
+
+	void prometheusRender_timeout()
+	{
+		// histograms and counters are updated from other threads without
+		// notifying us, so if there are any we render on every interval
+		if(prometheusDirty || !prometheusHistograms.isEmpty() || !prometheusCounters.isEmpty())
+			renderPrometheus();
+	}
+
+	void prometheus_requestReady()
+	{
+		SimpleHttpRequest *req = prometheusServer->takeNext();
+
+		if(prometheusBody.isEmpty())
+			renderPrometheus();
+
 		req->finished.connect([=] { DeferCall::deleteLater(req); });
 
 		HttpHeaders headers;
 		headers += HttpHeader("Content-Type", "text/plain");
-		req->respond(200, "OK", headers, data.toUtf8());
+		req->respond(200, "OK", headers, prometheusBody);
 	}
 };
 
@@ -1639,11 +2433,43 @@ void StatsManager::setReportInterval(int secs)
 	d->setupReportTimer();
 }
 
+void StatsManager::setReportAggregator(StatsReportAggregator *aggregator, bool send)
+{
+	d->reportAggregator = aggregator;
+	d->reportAggregatorSend = send;
+}
+
+void StatsManager::setRefreshMode(RefreshMode mode)
+{
+	d->setRefreshMode(mode);
+}
+
 void StatsManager::setOutputFormat(Format format)
 {
 	d->outputFormat = format;
 }
 
+void StatsManager::setMessageMode(MessageMode mode)
+{
+	if(d->messageMode == AggregateMessages && mode != AggregateMessages)
+	{
+		d->messageTimer->stop();
+		d->sendMessageTotals();
+	}
+
+	d->messageMode = mode;
+}
+
+void StatsManager::setMessageInterval(int msecs)
+{
+	d->messageInterval = qMax(msecs, 1);
+}
+
+void StatsManager::setTopChannels(int count)
+{
+	d->setTopChannels(count);
+}
+
 bool StatsManager::setPrometheusPort(const QString &port)
 {
 	return d->setPrometheusPort(port);
@@ -1652,6 +2478,47 @@ bool StatsManager::setPrometheusPort(const QString &port)
 void StatsManager::setPrometheusPrefix(const QString &prefix)
 {
 	d->prometheusPrefix = prefix;
+
+	for(Private::PrometheusRoute &r : d->prometheusRoutes)
+		r.dirty = true;
+
+	d->prometheusDirty = true;
+	d->prometheusBody.clear();
+}
+
+void StatsManager::addPrometheusHistogram(const QString &name, const QString &help, const QString &labels, const LatencyHistogram *histogram)
+{
+	Private::PrometheusHistogram h;
+	h.name = name;
+	h.help = help;
+	h.labels = labels;
+	h.histogram = histogram;
+
+	d->prometheusHistograms += h;
+}
+
+void StatsManager::addPrometheusCounter(const QString &name, const QString &help, const QString &labels, const std::atomic<quint64> *counter)
+{
+	Private::PrometheusCounter c;
+	c.name = name;
+	c.help = help;
+	c.labels = labels;
+	c.counter = counter;
+	c.gauge = 0;
+
+	d->prometheusCounters += c;
+}
+
+void StatsManager::addPrometheusGauge(const QString &name, const QString &help, const QString &labels, const std::atomic<qint64> *gauge)
+{
+	Private::PrometheusCounter c;
+	c.name = name;
+	c.help = help;
+	c.labels = labels;
+	c.counter = 0;
+	c.gauge = gauge;
+
+	d->prometheusCounters += c;
 }
 
 void StatsManager::addActivity(const QByteArray &routeId, quint32 count)
@@ -1667,12 +2534,20 @@ void StatsManager::addActivity(const QByteArray &routeId, quint32 count)
 
 void StatsManager::addMessage(const QString &channel, const QString &itemId, const QString &transport, quint32 count, int blocks)
 {
-	d->sendMessage(channel, itemId, transport, count, blocks);
+	if(d->messageMode == AggregateMessages)
+		d->aggregateMessage(channel, transport, count, blocks);
+	else
+		d->sendMessage(channel, itemId, transport, count, blocks);
+}
+
+void StatsManager::addPublish(const QString &channel, quint32 recipients, qint64 bytes)
+{
+	d->addPublish(channel, recipients, bytes);
 }
 
 void StatsManager::addConnection(const QByteArray &id, const QByteArray &routeId, ConnectionType type, const QHostAddress &peerAddress, bool ssl, bool quiet, int reportOffset)
 {
-	qint64 now = QDateTime::currentMSecsSinceEpoch();
+	qint64 now = LoopClock::msecsSinceEpoch();
 
 	bool replacing = false;
 	qint64 lastReport = now;
@@ -1699,7 +2574,7 @@ void StatsManager::addConnection(const QByteArray &id, const QByteArray &routeId
 				lastReport = other->lastReport;
 
 				d->removeExternalConnection(other);
-				delete other;
+				d->destroyConnection(other);
 
 				break;
 			}
@@ -1717,10 +2592,10 @@ void StatsManager::addConnection(const QByteArray &id, const QByteArray &routeId
 		lastReport = c->lastReport;
 
 		d->removeConnection(c);
-		delete c;
+		d->destroyConnection(c);
 	}
 
-	c = new Private::ConnectionInfo;
+	c = d->createConnection();
 	c->timerType = Private::TimerBase::Type::Connection;
 	c->id = id;
 	c->routeId = routeId;
@@ -1743,6 +2618,7 @@ void StatsManager::addConnection(const QByteArray &id, const QByteArray &routeId
 			// minutes are rounded up so count one immediately
 			report->addConnectionsMinutes(1, now);
 			d->combinedReport.addConnectionsMinutes(1, now);
+			d->addPrometheusConnectionsMinutes(c->routeId, 1);
 		}
 	}
 
@@ -1756,7 +2632,7 @@ int StatsManager::removeConnection(const QByteArray &id, bool linger, const QByt
 	if(!c)
 		return 0;
 
-	qint64 now = QDateTime::currentMSecsSinceEpoch();
+	qint64 now = LoopClock::msecsSinceEpoch();
 	QByteArray routeId = c->routeId;
 	int unreportedTime = 0;
 
@@ -1769,12 +2645,13 @@ int StatsManager::removeConnection(const QByteArray &id, bool linger, const QByt
 		{
 			c->linger = true;
 
-			if(!d->retryInfoBySource.contains(source))
-				d->retryInfoBySource.insert(source, Private::RetryInfo());
+			QHash<QByteArray, Private::RetryInfo>::iterator it = d->retryInfoBySource.find(source);
+			if(it == d->retryInfoBySource.end())
+				it = d->retryInfoBySource.insert(source, Private::RetryInfo());
 
-			Private::RetryInfo &ri = d->retryInfoBySource[source];
+			Private::RetryInfo &ri = it.value();
 
-			c->from = source;
+			c->from = it.key();
 			c->retrySeq = (qint64)ri.nextSeq++;
 
 			ri.connectionInfoBySeq.insert((quint64)c->retrySeq, c);
@@ -1793,7 +2670,7 @@ int StatsManager::removeConnection(const QByteArray &id, bool linger, const QByt
 
 		d->sendDisconnected(c);
 		d->removeConnection(c);
-		delete c;
+		d->destroyConnection(c);
 	}
 
 	d->updateConnectionsMax(routeId, now);
@@ -1816,7 +2693,7 @@ void StatsManager::addSubscription(const QString &mode, const QString &channel,
 	Private::Subscription *s = d->subscriptionsByKey.value(subKey);
 	if(!s)
 	{
-		qint64 now = QDateTime::currentMSecsSinceEpoch();
+		qint64 now = LoopClock::msecsSinceEpoch();
 
 		// add the subscription if we didn't have it
 		s = new Private::Subscription;
@@ -1837,19 +2714,35 @@ void StatsManager::addSubscription(const QString &mode, const QString &channel,
 
 		if(s->linger)
 		{
-			qint64 now = QDateTime::currentMSecsSinceEpoch();
+			qint64 now = LoopClock::msecsSinceEpoch();
 
 			// if this was a lingering subscription, return it to normal
 			s->linger = false;
 
-			s->lastRefresh = now;
-			d->wheelAdd(s->lastRefresh + SHOULD_PROCESS_TIME(d->subscriptionTtl), s);
+			if(s->lastSent >= 0 && now < s->lastSent + SHOULD_PROCESS_TIME(d->subscriptionTtl))
+			{
+				// the unsubscribe was never sent, so receivers still
+				//   consider the subscription valid. resume the refresh
+				//   schedule rather than announcing it again, unless the
+				//   subscriber count differs from what was sent
+				if(s->subscriberCount != s->sentSubscriberCount)
+					s->lastRefresh = now - SHOULD_PROCESS_TIME(d->subscriptionTtl);
+				else
+					s->lastRefresh = s->lastSent;
+
+				d->wheelAdd(s->lastRefresh + SHOULD_PROCESS_TIME(d->subscriptionTtl), s);
+			}
+			else
+			{
+				s->lastRefresh = now;
+				d->wheelAdd(s->lastRefresh + SHOULD_PROCESS_TIME(d->subscriptionTtl), s);
 
-			d->sendSubscribed(s);
+				d->sendSubscribed(s);
+			}
 		}
 		else if(s->subscriberCount != oldSubscriberCount)
 		{
-			qint64 now = QDateTime::currentMSecsSinceEpoch();
+			qint64 now = LoopClock::msecsSinceEpoch();
 
 			// process soon
 			s->lastRefresh = now - SHOULD_PROCESS_TIME(d->subscriptionTtl);
@@ -1869,7 +2762,7 @@ void StatsManager::removeSubscription(const QString &mode, const QString &channe
 	{
 		if(!s->linger)
 		{
-			qint64 now = QDateTime::currentMSecsSinceEpoch();
+			qint64 now = LoopClock::msecsSinceEpoch();
 
 			s->linger = true;
 
@@ -1897,23 +2790,49 @@ void StatsManager::addMessageReceived(const QByteArray &routeId, int blocks)
 
 	Private::Report *report = d->getOrCreateReport(routeId);
 
-	qint64 now = QDateTime::currentMSecsSinceEpoch();
+	qint64 now = LoopClock::msecsSinceEpoch();
 
 	report->addMessageReceived(blocks, now);
 	d->combinedReport.addMessageReceived(blocks, now);
+
+	Private::PrometheusRoute *r = d->getOrCreatePrometheusRoute(routeId);
+	if(r)
+		++r->messagesReceived;
 }
 
-void StatsManager::addMessageSent(const QByteArray &routeId, const QString &transport, int blocks)
+void StatsManager::addMessageSent(const QByteArray &routeId, const QString &transport, int blocks, quint32 count)
 {
 	if(d->reportInterval <= 0)
 		return;
 
 	Private::Report *report = d->getOrCreateReport(routeId);
 
-	qint64 now = QDateTime::currentMSecsSinceEpoch();
+	qint64 now = LoopClock::msecsSinceEpoch();
+
+	report->addMessageSent(transport, blocks, count, now);
+	d->combinedReport.addMessageSent(transport, blocks, count, now);
 
-	report->addMessageSent(transport, blocks, now);
-	d->combinedReport.addMessageSent(transport, blocks, now);
+	Private::PrometheusRoute *r = d->getOrCreatePrometheusRoute(routeId);
+	if(r)
+	{
+		int index = d->prometheusTransportIndex(transport);
+		if(r->messagesSent.count() <= index)
+			r->messagesSent.resize(index + 1);
+
+		r->messagesSent[index] += count;
+	}
+}
+
+void StatsManager::addRequestTiming(const QByteArray &routeId, RequestPhase phase, qint64 usecs)
+{
+	Private::PrometheusRoute *r = d->getOrCreatePrometheusRoute(routeId);
+	if(!r)
+		return;
+
+	if(!r->requestTimings)
+		r->requestTimings = std::make_unique<LatencyHistogram[]>(RequestPhasesCount);
+
+	r->requestTimings[phase].record(usecs);
 }
 
 void StatsManager::incCounter(const QByteArray &routeId, Stats::Counter c, quint32 count)
@@ -1923,7 +2842,7 @@ void StatsManager::incCounter(const QByteArray &routeId, Stats::Counter c, quint
 
 	Private::Report *report = d->getOrCreateReport(routeId);
 
-	qint64 now = QDateTime::currentMSecsSinceEpoch();
+	qint64 now = LoopClock::msecsSinceEpoch();
 
 	report->incCounter(c, count, now);
 	d->combinedReport.incCounter(c, count, now);
@@ -1931,10 +2850,11 @@ void StatsManager::incCounter(const QByteArray &routeId, Stats::Counter c, quint
 
 void StatsManager::addRequestsReceived(quint32 count)
 {
-	qint64 now = QDateTime::currentMSecsSinceEpoch();
+	qint64 now = LoopClock::msecsSinceEpoch();
 
 	d->combinedCounts.requestsReceived += count;
 	d->combinedReport.addRequestsReceived(count, now);
+	d->prometheusDirty = true;
 
 	if(!d->activityTimer->isActive())
 		d->activityTimer->start(ACTIVITY_TIMEOUT);
@@ -1945,6 +2865,14 @@ bool StatsManager::checkConnection(const QByteArray &id) const
 	return d->connectionInfoById.contains(id);
 }
 
+QList<TopK::Item> StatsManager::topChannels(ChannelMetric metric) const
+{
+	if(!d->topChannels[metric])
+		return QList<TopK::Item>();
+
+	return d->topChannels[metric]->items();
+}
+
 bool StatsManager::processExternalPacket(const StatsPacket &packet, bool mergeConnectionReport)
 {
 	if(d->reportInterval <= 0)
@@ -1952,7 +2880,7 @@ bool StatsManager::processExternalPacket(const StatsPacket &packet, bool mergeCo
 
 	if(packet.type == StatsPacket::Connected || packet.type == StatsPacket::Disconnected)
 	{
-		qint64 now = QDateTime::currentMSecsSinceEpoch();
+		qint64 now = LoopClock::msecsSinceEpoch();
 
 		bool replacing = false;
 		qint64 lastReport = now;
@@ -1975,7 +2903,7 @@ bool StatsManager::processExternalPacket(const StatsPacket &packet, bool mergeCo
 				lastReport = c->lastReport;
 
 				d->removeConnection(c);
-				delete c;
+				d->destroyConnection(c);
 			}
 		}
 
@@ -2002,7 +2930,7 @@ bool StatsManager::processExternalPacket(const StatsPacket &packet, bool mergeCo
 		foreach(Private::ConnectionInfo *c, toDelete)
 		{
 			d->removeExternalConnection(c);
-			delete c;
+			d->destroyConnection(c);
 		}
 
 		QHash<QByteArray, Private::ConnectionInfo*> &extConnectionInfoById = d->externalConnectionInfoByFrom[packet.from];
@@ -2013,7 +2941,7 @@ bool StatsManager::processExternalPacket(const StatsPacket &packet, bool mergeCo
 			Private::ConnectionInfo *c = extConnectionInfoById.value(packet.connectionId);
 			if(!c)
 			{
-				c = new Private::ConnectionInfo;
+				c = d->createConnection();
 				c->timerType = Private::TimerBase::Type::ExternalConnection;
 				c->id = packet.connectionId;
 				c->routeId = packet.route;
@@ -2035,6 +2963,7 @@ bool StatsManager::processExternalPacket(const StatsPacket &packet, bool mergeCo
 					// minutes are rounded up so count one immediately
 					report->addConnectionsMinutes(1, now);
 					d->combinedReport.addConnectionsMinutes(1, now);
+					d->addPrometheusConnectionsMinutes(c->routeId, 1);
 				}
 			}
 			else
@@ -2056,7 +2985,7 @@ bool StatsManager::processExternalPacket(const StatsPacket &packet, bool mergeCo
 
 				d->updateConnectionsMinutes(c, now);
 				d->removeExternalConnection(c);
-				delete c;
+				d->destroyConnection(c);
 
 				d->updateConnectionsMax(routeId, now);
 			}
@@ -2066,7 +2995,7 @@ bool StatsManager::processExternalPacket(const StatsPacket &packet, bool mergeCo
 	}
 	else if(packet.type == StatsPacket::ConnectionsMax)
 	{
-		qint64 now = QDateTime::currentMSecsSinceEpoch();
+		qint64 now = LoopClock::msecsSinceEpoch();
 
 		d->mergeExternalConnectionsMax(packet, now);
 
@@ -2111,7 +3040,7 @@ StatsPacket StatsManager::getConnMaxPacket(const QByteArray &routeId)
 {
 	Private::ConnectionsMax &cm = d->getOrCreateConnectionsMax(routeId);
 
-	qint64 now = QDateTime::currentMSecsSinceEpoch();
+	qint64 now = LoopClock::msecsSinceEpoch();
 
 	return d->getConnMaxPacket(routeId, &cm, now);
 }
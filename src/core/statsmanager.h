@@ -24,11 +24,15 @@
 #ifndef STATSMANAGER_H
 #define STATSMANAGER_H
 
+#include <atomic>
 #include "packet/statspacket.h"
 #include "stats.h"
+#include "topk.h"
 #include <boost/signals2.hpp>
 
 class QHostAddress;
+class LatencyHistogram;
+class StatsReportAggregator;
 
 class StatsManager
 {
@@ -42,7 +46,39 @@ public:
 	enum Format
 	{
 		TnetStringFormat,
-		JsonFormat
+		JsonFormat,
+		BinaryFormat // conn and message packets only, others use tnetstring
+	};
+
+	enum MessageMode
+	{
+		EachMessage,
+		AggregateMessages
+	};
+
+	enum RefreshMode
+	{
+		BucketRefresh,
+		SpreadRefresh
+	};
+
+	enum ChannelMetric
+	{
+		ChannelPublishes,
+		ChannelRecipients,
+		ChannelBytes,
+		ChannelMetricsCount
+	};
+
+	// phases of a proxied request, for timing histograms
+	enum RequestPhase
+	{
+		InspectPhase, // inspect round trip to the handler
+		OriginPhase, // origin request start to response headers
+		AcceptPhase, // accept round trip to the handler
+		WriteWaitPhase, // time the origin was not read due to slow clients
+		TotalPhase,
+		RequestPhasesCount
 	};
 
 	StatsManager(int connectionsMax, int subscriptionsMax, int prometheusConnectionsMax);
@@ -60,15 +96,53 @@ public:
 	void setSubscriptionTtl(int secs);
 	void setSubscriptionLinger(int secs);
 	void setReportInterval(int secs);
+
+	// hand reports to the aggregator rather than sending them. if send is
+	// true, this manager sends the merged reports of all the managers that
+	// share the aggregator, once per interval. the aggregator must outlive
+	// the manager
+	void setReportAggregator(StatsReportAggregator *aggregator, bool send);
+
+	// in spread mode, connection refreshes are scheduled individually on
+	// the timer wheel rather than in per-second buckets, and processed in
+	// small bounded batches
+	void setRefreshMode(RefreshMode mode);
 	void setOutputFormat(Format format);
+
+	// in aggregate mode, addMessage() counts are summed per channel and
+	// transport and sent as a single messages packet every interval.
+	// item ids are not included
+	void setMessageMode(MessageMode mode);
+	void setMessageInterval(int msecs);
+
+	// track this many of the busiest channels by each metric, using a
+	// fixed amount of memory regardless of how many channels there are.
+	// counts are halved every minute. 0 to disable
+	void setTopChannels(int count);
 	bool setPrometheusPort(const QString &port);
 	void setPrometheusPrefix(const QString &prefix);
 
+	// histograms with the same name must be added consecutively, and must
+	// outlive the stats manager. the name gets the prometheus prefix
+	void addPrometheusHistogram(const QString &name, const QString &help, const QString &labels, const LatencyHistogram *histogram);
+
+	// same rules as for histograms. the counter may be updated from any
+	// thread
+	void addPrometheusCounter(const QString &name, const QString &help, const QString &labels, const std::atomic<quint64> *counter);
+	void addPrometheusGauge(const QString &name, const QString &help, const QString &labels, const std::atomic<qint64> *gauge);
+
 	// routeId may be empty for non-identified route
 
 	void addActivity(const QByteArray &routeId, quint32 count = 1);
+
+	// recorded into a prometheus histogram per route and phase
+	void addRequestTiming(const QByteArray &routeId, RequestPhase phase, qint64 usecs);
 	void addMessage(const QString &channel, const QString &itemId, const QString &transport, quint32 count = 1, int blocks = -1);
 
+	// for top channels. called once per published item, with the total
+	// recipients and bytes sent across transports
+	void addPublish(const QString &channel, quint32 recipients, qint64 bytes);
+
 	void addConnection(const QByteArray &id, const QByteArray &routeId, ConnectionType type, const QHostAddress &peerAddress, bool ssl, bool quiet, int reportOffset = -1);
 	int removeConnection(const QByteArray &id, bool linger, const QByteArray &source = QByteArray()); // return unreported time
 
@@ -83,7 +157,8 @@ public:
 
 	// for reporting and combined
 	void addMessageReceived(const QByteArray &routeId, int blocks = -1);
-	void addMessageSent(const QByteArray &routeId, const QString &transport, int blocks = -1);
+	// blocks is per message
+	void addMessageSent(const QByteArray &routeId, const QString &transport, int blocks = -1, quint32 count = 1);
 	void incCounter(const QByteArray &routeId, Stats::Counter c, quint32 count = 1);
 
 	// for combined only
@@ -91,6 +166,9 @@ public:
 
 	bool checkConnection(const QByteArray &id) const;
 
+	// heaviest first. empty if top channels are disabled
+	QList<TopK::Item> topChannels(ChannelMetric metric) const;
+
 	// conn, conn-max, and report packets received from the proxy should be
 	// passed into this method. returns true if the packet should not also be
 	// forwarded on
@@ -111,6 +189,9 @@ public:
 	boost::signals2::signal<void(const QList<StatsPacket>&)> reported;
 	boost::signals2::signal<void(const StatsPacket&)> connMax;
 
+	// emitted on every report interval, even if there was nothing to report
+	boost::signals2::signal<void()> reportIntervalElapsed;
+
 private:
 	class Private;
 	friend class Private;
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+
+#include <stdio.h>
+#include <vector>
+#include <QFile>
+#include <QHostAddress>
+#include "bench.h"
+#include "eventloop.h"
+#include "defercall.h"
+#include "statsmanager.h"
+
+// returns -1 if the resident size can't be determined
+static qint64 residentBytes()
+{
+	QFile f("/proc/self/statm");
+	if(!f.open(QIODevice::ReadOnly))
+		return -1;
+
+	QList<QByteArray> parts = f.readAll().split(' ');
+	if(parts.count() < 2)
+		return -1;
+
+	return parts[1].toLongLong() * 4096;
+}
+
+extern "C" void statsmanager_bench(const char *filter)
+{
+	Bench bench(filter);
+
+	if(!bench.selected("statsmanager/"))
+		return;
+
+	EventLoop loop(100);
+
+	const int count = 100000;
+
+	QHostAddress addr("192.168.1.1");
+
+	std::vector<QByteArray> ids;
+	std::vector<QByteArray> routeIds;
+	for(int n = 0; n < count; ++n)
+	{
+		ids.push_back("conn-" + QByteArray::number(n));
+		routeIds.push_back("route-" + QByteArray::number(n % 100));
+	}
+
+	if(bench.selected("statsmanager/100k-conns-memory"))
+	{
+		StatsManager stats(count, 0, 0);
+
+		qint64 before = residentBytes();
+
+		for(int n = 0; n < count; ++n)
+			stats.addConnection(ids[n], routeIds[n], StatsManager::Http, addr, false, true);
+
+		qint64 after = residentBytes();
+
+		long long perConn = (before >= 0 && after >= before) ? (long long)((after - before) / count) : -1;
+
+		printf("%-40s %14lld bytes/conn\n", "statsmanager/100k-conns-memory", perConn);
+		fflush(stdout);
+	}
+
+	{
+		StatsManager stats(count, 0, 0);
+
+		bench.run("statsmanager/add-remove-100k-conns", 10, count * 2, [&] {
+			for(int n = 0; n < count; ++n)
+				stats.addConnection(ids[n], routeIds[n], StatsManager::Http, addr, false, true);
+
+			for(int n = 0; n < count; ++n)
+				stats.removeConnection(ids[n], false);
+		});
+	}
+
+	DeferCall::cleanup();
+}
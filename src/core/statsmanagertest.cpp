@@ -0,0 +1,337 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include <QHostAddress>
+#include <QSet>
+#include <QTest>
+#include "test.h"
+#include "timer.h"
+#include "defercall.h"
+#include "packet/statspacket.h"
+#include "statsmanager.h"
+#include "statsreportaggregator.h"
+
+namespace {
+
+class LoopState
+{
+public:
+	LoopState()
+	{
+		Timer::init(100);
+	}
+
+	~LoopState()
+	{
+		DeferCall::cleanup();
+		Timer::deinit();
+	}
+};
+
+}
+
+static int connectionCount(StatsManager *stats, const QByteArray &routeId)
+{
+	// the first call resets the max to the current value
+	stats->getConnMaxPacket(routeId);
+
+	return stats->getConnMaxPacket(routeId).connectionsMax;
+}
+
+static StatsPacket externalPacket(StatsPacket::Type type, const QByteArray &id, const QByteArray &routeId)
+{
+	StatsPacket p;
+	p.type = type;
+	p.from = "proxy";
+	p.route = routeId;
+	p.connectionId = id;
+	p.connectionType = StatsPacket::Http;
+	p.ttl = 120;
+
+	return p;
+}
+
+static void binaryPackets()
+{
+	StatsPacket m;
+	m.type = StatsPacket::Message;
+	m.from = "handler";
+	m.channel = "apple";
+	m.itemId = "1";
+	m.transport = "ws-message";
+	m.count = 3;
+	m.blocks = 12;
+
+	TEST_ASSERT(StatsPacket::canEncodeBinary(m.type));
+
+	StatsPacket out;
+	TEST_ASSERT(out.fromBinary("message", m.toBinary()));
+	TEST_ASSERT(out.type == StatsPacket::Message);
+	TEST_ASSERT_EQ(out.from, QByteArray("handler"));
+	TEST_ASSERT(out.route.isEmpty());
+	TEST_ASSERT_EQ(out.channel, QByteArray("apple"));
+	TEST_ASSERT_EQ(out.itemId, QByteArray("1"));
+	TEST_ASSERT_EQ(out.transport, QByteArray("ws-message"));
+	TEST_ASSERT_EQ(out.count, 3);
+	TEST_ASSERT_EQ(out.blocks, 12);
+
+	// a null item id stays null
+	m.itemId = QByteArray();
+	out = StatsPacket();
+	TEST_ASSERT(out.fromBinary("message", m.toBinary()));
+	TEST_ASSERT(out.itemId.isNull());
+
+	StatsPacket c;
+	c.type = StatsPacket::Connected;
+	c.from = "proxy";
+	c.route = "r1";
+	c.connectionId = "conn-1";
+	c.connectionType = StatsPacket::WebSocket;
+	c.peerAddress = QHostAddress("192.168.1.1");
+	c.ssl = true;
+	c.ttl = 120;
+
+	// decodes at an offset, as with a prefixed message
+	QByteArray buf = "conn B" + c.toBinary();
+
+	out = StatsPacket();
+	TEST_ASSERT(out.fromBinary("conn", buf, 6));
+	TEST_ASSERT(out.type == StatsPacket::Connected);
+	TEST_ASSERT_EQ(out.route, QByteArray("r1"));
+	TEST_ASSERT_EQ(out.connectionId, QByteArray("conn-1"));
+	TEST_ASSERT(out.connectionType == StatsPacket::WebSocket);
+	TEST_ASSERT(out.peerAddress == QHostAddress("192.168.1.1"));
+	TEST_ASSERT(out.ssl);
+	TEST_ASSERT_EQ(out.ttl, 120);
+
+	c.peerAddress = QHostAddress("2001:db8::1");
+	out = StatsPacket();
+	TEST_ASSERT(out.fromBinary("conn", c.toBinary()));
+	TEST_ASSERT(out.peerAddress == QHostAddress("2001:db8::1"));
+
+	StatsPacket d;
+	d.type = StatsPacket::Disconnected;
+	d.connectionId = "conn-1";
+
+	out = StatsPacket();
+	TEST_ASSERT(out.fromBinary("conn", d.toBinary()));
+	TEST_ASSERT(out.type == StatsPacket::Disconnected);
+	TEST_ASSERT_EQ(out.connectionId, QByteArray("conn-1"));
+
+	// truncated data and unknown versions are rejected
+	QByteArray data = m.toBinary();
+	out = StatsPacket();
+	TEST_ASSERT(!out.fromBinary("message", data.mid(0, data.size() - 1)));
+
+	data[0] = 2;
+	TEST_ASSERT(!out.fromBinary("message", data));
+
+	TEST_ASSERT(!StatsPacket::canEncodeBinary(StatsPacket::Report));
+}
+
+static void connections()
+{
+	LoopState loop;
+	StatsManager stats(100, 0, 0);
+	stats.setConnectionsMaxSendEnabled(true);
+
+	QHostAddress addr("192.168.1.1");
+
+	stats.addConnection("a", "r1", StatsManager::Http, addr, false, true);
+	stats.addConnection("b", "r1", StatsManager::Http, addr, false, true);
+	stats.addConnection("c", "r2", StatsManager::WebSocket, addr, false, true);
+
+	TEST_ASSERT(stats.checkConnection("a"));
+	TEST_ASSERT(!stats.checkConnection("d"));
+	TEST_ASSERT_EQ(connectionCount(&stats, "r1"), 2);
+	TEST_ASSERT_EQ(connectionCount(&stats, "r2"), 1);
+
+	stats.removeConnection("b", false);
+	TEST_ASSERT(!stats.checkConnection("b"));
+	TEST_ASSERT_EQ(connectionCount(&stats, "r1"), 1);
+
+	// lingering connections are still counted
+	stats.removeConnection("a", true, "proxy");
+	TEST_ASSERT(stats.checkConnection("a"));
+	TEST_ASSERT_EQ(connectionCount(&stats, "r1"), 1);
+
+	// replacing a lingering connection doesn't double count
+	stats.addConnection("a", "r1", StatsManager::Http, addr, false, true);
+	TEST_ASSERT_EQ(connectionCount(&stats, "r1"), 1);
+
+	// rebalances the refresh buckets
+	stats.setConnectionTtl(30);
+
+	stats.processExternalPacket(externalPacket(StatsPacket::Connected, "x", "r2"), false);
+	TEST_ASSERT_EQ(connectionCount(&stats, "r2"), 2);
+
+	// an external connection is replaced by a local one with the same id
+	stats.addConnection("x", "r2", StatsManager::Http, addr, false, true);
+	TEST_ASSERT_EQ(connectionCount(&stats, "r2"), 2);
+
+	stats.processExternalPacket(externalPacket(StatsPacket::Connected, "y", "r2"), false);
+	TEST_ASSERT_EQ(connectionCount(&stats, "r2"), 3);
+
+	stats.processExternalPacket(externalPacket(StatsPacket::Disconnected, "y", "r2"), false);
+	TEST_ASSERT_EQ(connectionCount(&stats, "r2"), 2);
+
+	stats.removeConnection("a", false);
+	stats.removeConnection("c", false);
+	stats.removeConnection("x", false);
+	TEST_ASSERT_EQ(connectionCount(&stats, "r1"), 0);
+	TEST_ASSERT_EQ(connectionCount(&stats, "r2"), 0);
+}
+
+static void spreadRefresh()
+{
+	const int count = 300;
+
+	LoopState loop;
+	StatsManager stats(count, 0, 0);
+	stats.setConnectionTtl(1);
+	stats.setRefreshMode(StatsManager::SpreadRefresh);
+
+	QSet<QByteArray> refreshed;
+	int batchMax = 0;
+
+	stats.connectionsRefreshed.connect([&](const QList<QByteArray> &ids) {
+		foreach(const QByteArray &id, ids)
+			refreshed += id;
+
+		batchMax = qMax(batchMax, (int)ids.count());
+	});
+
+	QHostAddress addr("192.168.1.1");
+
+	for(int n = 0; n < count; ++n)
+		stats.addConnection("conn-" + QByteArray::number(n), "r1", StatsManager::Http, addr, false, true);
+
+	// every connection gets refreshed within the window
+	for(int n = 0; n < 200 && refreshed.count() < count; ++n)
+		QTest::qWait(10);
+
+	TEST_ASSERT_EQ(refreshed.count(), count);
+
+	// batches are bounded by the minimum batch size at this scale
+	TEST_ASSERT(batchMax <= 100);
+
+	TEST_ASSERT_EQ(connectionCount(&stats, "r1"), count);
+}
+
+static void topChannels()
+{
+	LoopState loop;
+	StatsManager stats(100, 0, 0);
+
+	// disabled by default
+	stats.addPublish("a", 1, 10);
+	TEST_ASSERT(stats.topChannels(StatsManager::ChannelPublishes).isEmpty());
+
+	stats.setTopChannels(2);
+
+	stats.addPublish("a", 1, 100);
+	stats.addPublish("b", 50, 500);
+	stats.addPublish("b", 50, 500);
+	stats.addPublish("c", 0, 0);
+	stats.addPublish("c", 0, 0);
+	stats.addPublish("c", 0, 0);
+
+	QList<TopK::Item> items = stats.topChannels(StatsManager::ChannelPublishes);
+	TEST_ASSERT_EQ(items.count(), 2);
+	TEST_ASSERT_EQ(items[0].key, QString("c"));
+	TEST_ASSERT_EQ(items[0].count, 3u);
+	TEST_ASSERT_EQ(items[1].key, QString("b"));
+
+	items = stats.topChannels(StatsManager::ChannelRecipients);
+	TEST_ASSERT_EQ(items.count(), 2);
+	TEST_ASSERT_EQ(items[0].key, QString("b"));
+	TEST_ASSERT_EQ(items[0].count, 100u);
+	TEST_ASSERT_EQ(items[1].key, QString("a"));
+
+	items = stats.topChannels(StatsManager::ChannelBytes);
+	TEST_ASSERT_EQ(items[0].key, QString("b"));
+	TEST_ASSERT_EQ(items[0].count, 1000u);
+}
+
+static void reportAggregator()
+{
+	LoopState loop;
+	StatsReportAggregator agg;
+
+	StatsManager a(100, 0, 0);
+	a.setInstanceId("proxy_0");
+	a.setReportAggregator(&agg, false);
+
+	StatsManager b(100, 0, 0);
+	b.setInstanceId("proxy_1");
+	b.setReportAggregator(&agg, false);
+
+	a.addMessageReceived("r1");
+	a.incCounter("r1", Stats::ClientContentBytesSent, 10);
+	a.flushReport("r1");
+
+	b.addMessageReceived("r1", 2);
+	b.incCounter("r1", Stats::ClientContentBytesSent, 5);
+	b.flushReport("r1");
+
+	b.addMessageReceived("r2");
+	b.flushReport("r2");
+
+	QList<StatsPacket> reports = agg.take();
+	TEST_ASSERT_EQ(reports.count(), 2);
+
+	StatsPacket r1 = (reports[0].route == "r1" ? reports[0] : reports[1]);
+	TEST_ASSERT(r1.type == StatsPacket::Report);
+	TEST_ASSERT(r1.from.isEmpty());
+	TEST_ASSERT_EQ(r1.messagesReceived, 2);
+	TEST_ASSERT_EQ(r1.blocksReceived, 2);
+	TEST_ASSERT_EQ(r1.clientContentBytesSent, 15);
+
+	// taking clears
+	TEST_ASSERT(agg.take().isEmpty());
+
+	// unset fields stay unset
+	StatsPacket p;
+	p.type = StatsPacket::Report;
+	p.messagesSent = 3;
+	p.duration = 1000;
+
+	StatsPacket other;
+	other.type = StatsPacket::Report;
+	other.duration = 2000;
+
+	StatsReportAggregator::merge(&p, other);
+	TEST_ASSERT_EQ(p.messagesSent, 3);
+	TEST_ASSERT_EQ(p.blocksSent, -1);
+	TEST_ASSERT_EQ(p.duration, 2000);
+}
+
+extern "C" int statsmanager_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(binaryPackets());
+	TEST_CATCH(connections());
+	TEST_CATCH(spreadRefresh());
+	TEST_CATCH(topChannels());
+	TEST_CATCH(reportAggregator());
+
+	return 0;
+}
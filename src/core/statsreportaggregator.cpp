@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "statsreportaggregator.h"
+
+// fields that are summed across managers. the connections max of each
+// manager is for its own connections, so the sum is the process total
+static int StatsPacket::* const sumFields[] =
+{
+	&StatsPacket::connectionsMax,
+	&StatsPacket::connectionsMinutes,
+	&StatsPacket::messagesReceived,
+	&StatsPacket::messagesSent,
+	&StatsPacket::httpResponseMessagesSent,
+	&StatsPacket::blocksReceived,
+	&StatsPacket::blocksSent,
+	&StatsPacket::clientHeaderBytesReceived,
+	&StatsPacket::clientHeaderBytesSent,
+	&StatsPacket::clientContentBytesReceived,
+	&StatsPacket::clientContentBytesSent,
+	&StatsPacket::clientMessagesReceived,
+	&StatsPacket::clientMessagesSent,
+	&StatsPacket::serverHeaderBytesReceived,
+	&StatsPacket::serverHeaderBytesSent,
+	&StatsPacket::serverContentBytesReceived,
+	&StatsPacket::serverContentBytesSent,
+	&StatsPacket::serverMessagesReceived,
+	&StatsPacket::serverMessagesSent,
+	&StatsPacket::filterCacheHits,
+	&StatsPacket::filterCacheMisses,
+	&StatsPacket::idCacheDuplicates,
+	&StatsPacket::idCacheUncached,
+	&StatsPacket::streamMessagesSent,
+	&StatsPacket::streamBodyWrites,
+	&StatsPacket::messagesExpired,
+	&StatsPacket::slowConsumerDrops,
+	&StatsPacket::slowConsumerDisconnects
+};
+
+void StatsReportAggregator::add(const QList<StatsPacket> &packets)
+{
+	std::lock_guard<std::mutex> guard(mutex_);
+
+	foreach(const StatsPacket &p, packets)
+	{
+		if(p.type != StatsPacket::Report)
+			continue;
+
+		QHash<QByteArray, StatsPacket>::iterator it = reports_.find(p.route);
+		if(it == reports_.end())
+		{
+			StatsPacket &r = reports_[p.route];
+			r = p;
+			r.from.clear();
+		}
+		else
+		{
+			merge(&it.value(), p);
+		}
+	}
+}
+
+QList<StatsPacket> StatsReportAggregator::take()
+{
+	QHash<QByteArray, StatsPacket> reports;
+
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		reports.swap(reports_);
+	}
+
+	return reports.values();
+}
+
+void StatsReportAggregator::merge(StatsPacket *p, const StatsPacket &other)
+{
+	// negative means unset
+	for(int StatsPacket::* f : sumFields)
+	{
+		if(other.*f < 0)
+			continue;
+
+		if(p->*f < 0)
+			p->*f = 0;
+
+		p->*f += other.*f;
+	}
+
+	p->duration = qMax(p->duration, other.duration);
+}
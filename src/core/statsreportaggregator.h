@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef STATSREPORTAGGREGATOR_H
+#define STATSREPORTAGGREGATOR_H
+
+#include <mutex>
+#include <QHash>
+#include "packet/statspacket.h"
+
+// merges the report packets of stats managers running in different threads,
+// so that one of them can send a single report per route for the process.
+// managers count into their own thread-local reports as before, and hand
+// them over once per report interval, so the lock is rarely taken and never
+// on the counting path
+class StatsReportAggregator
+{
+public:
+	// thread-safe
+	void add(const QList<StatsPacket> &packets);
+
+	// returns one packet per route, with from unset, and clears. thread-safe
+	QList<StatsPacket> take();
+
+	// sums the report fields of other into p. durations are the longer
+	// of the two
+	static void merge(StatsPacket *p, const StatsPacket &other);
+
+private:
+	std::mutex mutex_;
+	QHash<QByteArray, StatsPacket> reports_;
+};
+
+#endif
@@ -5,4 +5,22 @@ SOURCES += \
 	$$PWD/defercalltest.cpp \
 	$$PWD/tcpstreamtest.cpp \
 	$$PWD/unixstreamtest.cpp \
-	$$PWD/eventlooptest.cpp
+	$$PWD/eventlooptest.cpp \
+	$$PWD/tnetstringtest.cpp \
+	$$PWD/latencyhistogramtest.cpp \
+	$$PWD/statsmanagertest.cpp \
+	$$PWD/tracetest.cpp \
+	$$PWD/logtest.cpp \
+	$$PWD/bufferlisttest.cpp \
+	$$PWD/flowwindowtest.cpp \
+	$$PWD/httpheaderindextest.cpp \
+	$$PWD/ringqueuetest.cpp \
+	$$PWD/ridtabletest.cpp \
+	$$PWD/fastsignaltest.cpp \
+	$$PWD/arenatest.cpp \
+	$$PWD/uuidutiltest.cpp \
+	$$PWD/gziptest.cpp \
+	$$PWD/topktest.cpp \
+	$$PWD/objectstatstest.cpp \
+	$$PWD/packetcapturetest.cpp \
+	$$PWD/tracecontexttest.cpp
@@ -28,6 +28,7 @@
 #include <QTimer>
 #include "timerwheel.h"
 #include "eventloop.h"
+#include "trace.h"
 
 #define TICK_DURATION_MS 10
 #define UPDATE_TICKS_MAX 1000
@@ -48,12 +49,26 @@ static qint64 ticksToDuration(qint64 ticks)
 	return ticks * TICK_DURATION_MS;
 }
 
+// round up to a multiple of the largest power of two within the slack, the
+// same way the rust-based eventloop does
+static qint64 coalesceTicks(qint64 ticks, qint64 slackTicks)
+{
+	if(slackTicks < 2)
+		return ticks;
+
+	qint64 step = 1;
+	while(step * 2 <= slackTicks)
+		step *= 2;
+
+	return ((ticks + step - 1) / step) * step;
+}
+
 class TimerManager
 {
 public:
-	TimerManager(int capacity);
+	TimerManager(int initialCapacity, int maxCapacity);
 
-	int add(int msec, Timer *r);
+	int add(int msec, int slack, Timer *r);
 	void remove(int key);
 
 private:
@@ -66,8 +81,8 @@ private:
 	void updateTimeout(qint64 currentTime);
 };
 
-TimerManager::TimerManager(int capacity) :
-	wheel_(TimerWheel(capacity))
+TimerManager::TimerManager(int initialCapacity, int maxCapacity) :
+	wheel_(initialCapacity, maxCapacity)
 {
 	startTime_ = QDateTime::currentMSecsSinceEpoch();
 	currentTicks_ = 0;
@@ -82,7 +97,7 @@ TimerManager::TimerManager(int capacity) :
 	t_->setSingleShot(true);
 }
 
-int TimerManager::add(int msec, Timer *r)
+int TimerManager::add(int msec, int slack, Timer *r)
 {
 	qint64 currentTime = QDateTime::currentMSecsSinceEpoch();
 
@@ -97,7 +112,7 @@ int TimerManager::add(int msec, Timer *r)
 		// expireTime must be >= startTime_
 		qint64 expireTime = qMax(currentTime + msec, startTime_);
 
-		expiresTicks = durationToTicksRoundUp(expireTime - startTime_);
+		expiresTicks = coalesceTicks(durationToTicksRoundUp(expireTime - startTime_), durationToTicksRoundDown(slack));
 	}
 
 	int id = wheel_.add(expiresTicks, (size_t)r);
@@ -187,6 +202,7 @@ Timer::Timer() :
 	loop_(EventLoop::instance()),
 	singleShot_(false),
 	interval_(0),
+	slack_(0),
 	timerId_(-1)
 {
 }
@@ -211,6 +227,11 @@ void Timer::setInterval(int msec)
 	interval_ = msec;
 }
 
+void Timer::setSlack(int msec)
+{
+	slack_ = msec;
+}
+
 void Timer::start(int msec)
 {
 	setInterval(msec);
@@ -225,7 +246,7 @@ void Timer::start()
 	{
 		// if the rust-based eventloop is available, use it
 
-		int id = loop_->registerTimer(interval_, Timer::cb_timer_activated, this);
+		int id = loop_->registerTimer(interval_, Timer::cb_timer_activated, this, slack_);
 		assert(id >= 0);
 
 		timerId_ = id;
@@ -237,7 +258,7 @@ void Timer::start()
 		// must call Timer::init first
 		assert(g_manager);
 
-		int id = g_manager->add(interval_, this);
+		int id = g_manager->add(interval_, slack_, this);
 		assert(id >= 0);
 
 		timerId_ = id;
@@ -276,6 +297,8 @@ void Timer::timerReady()
 {
 	timerId_ = -1;
 
+	TRACE_EVENT(TimerFire, 0);
+
 	if(!singleShot_)
 	{
 		start();
@@ -285,10 +308,15 @@ void Timer::timerReady()
 }
 
 void Timer::init(int capacity)
+{
+	init(capacity, capacity);
+}
+
+void Timer::init(int initialCapacity, int maxCapacity)
 {
 	assert(!g_manager);
 
-	g_manager = new TimerManager(capacity);
+	g_manager = new TimerManager(initialCapacity, maxCapacity);
 }
 
 void Timer::deinit()
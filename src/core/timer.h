@@ -25,6 +25,7 @@
 #define TIMER_H
 
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 
 using Signal = boost::signals2::signal<void()>;
 
@@ -41,6 +42,11 @@ public:
 
 	void setSingleShot(bool singleShot);
 	void setInterval(int msec);
+
+	// allow the timer to fire up to msec late, so that its expiration can
+	// be grouped with those of other timers. takes effect on the next start
+	void setSlack(int msec);
+
 	void start(int msec);
 	void start();
 	void stop();
@@ -48,10 +54,14 @@ public:
 	// initialization is thread local
 	static void init(int capacity);
 
+	// timer slots are allocated on demand, up to maxCapacity or without
+	// limit if zero
+	static void init(int initialCapacity, int maxCapacity);
+
 	// only call if there are no active timers
 	static void deinit();
 
-	Signal timeout;
+	FastSignal<> timeout;
 
 private:
 	friend class TimerManager;
@@ -59,6 +69,7 @@ private:
 	EventLoop *loop_;
 	bool singleShot_;
 	int interval_;
+	int slack_;
 	int timerId_;
 
 	static void cb_timer_activated(void *ctx, uint8_t readiness);
@@ -16,6 +16,7 @@
 
 // adapted from http://25thandclement.com/~william/projects/timeout.c.html (MIT licensed)
 
+use crate::core::capacity::Capacity;
 use crate::core::list;
 use slab::Slab;
 use std::cmp;
@@ -133,6 +134,7 @@ struct Timer {
 
 pub struct TimerWheel {
     nodes: Slab<list::Node<Timer>>,
+    capacity: Capacity,
     wheel: [[list::List; WHEEL_LEN]; WHEEL_NUM],
     expired: list::List,
     pending: [u64; WHEEL_NUM],
@@ -141,8 +143,13 @@ pub struct TimerWheel {
 
 impl TimerWheel {
     pub fn new(capacity: usize) -> Self {
+        Self::new_with_capacity(Capacity::fixed(capacity))
+    }
+
+    pub fn new_with_capacity(capacity: Capacity) -> Self {
         Self {
-            nodes: Slab::with_capacity(capacity),
+            nodes: capacity.new_slab(),
+            capacity,
             wheel: [[list::List::default(); WHEEL_LEN]; WHEEL_NUM],
             expired: list::List::default(),
             pending: [0; WHEEL_NUM],
@@ -152,7 +159,7 @@ impl TimerWheel {
 
     #[allow(clippy::result_unit_err)]
     pub fn add(&mut self, expires: u64, user_data: usize) -> Result<usize, ()> {
-        if self.nodes.len() == self.nodes.capacity() {
+        if !self.capacity.reserve(&mut self.nodes) {
             return Err(());
         }
 
@@ -340,6 +347,19 @@ mod ffi {
         Box::into_raw(Box::new(wheel))
     }
 
+    // a max of zero means unbounded
+    #[no_mangle]
+    pub extern "C" fn timer_wheel_create_growable(
+        initial: libc::c_uint,
+        max: libc::c_uint,
+    ) -> *mut TimerWheel {
+        let max = if max > 0 { Some(max as usize) } else { None };
+
+        let wheel = TimerWheel::new_with_capacity(Capacity::growable(initial as usize, max));
+
+        Box::into_raw(Box::new(wheel))
+    }
+
     #[allow(clippy::missing_safety_doc)]
     #[no_mangle]
     pub unsafe extern "C" fn timer_wheel_destroy(wheel: *mut TimerWheel) {
@@ -646,4 +666,22 @@ mod tests {
             assert_eq!(w.timeout(), None);
         }
     }
+
+    #[test]
+    fn test_growable() {
+        let mut w = TimerWheel::new_with_capacity(Capacity::growable(1, Some(3)));
+
+        let t1 = w.add(1, 1).unwrap();
+        let t2 = w.add(2, 2).unwrap();
+        let t3 = w.add(3, 3).unwrap();
+        assert!(w.add(4, 4).is_err());
+
+        w.update(3);
+        assert_eq!(w.take_expired(), Some((t1, 1)));
+        assert_eq!(w.take_expired(), Some((t2, 2)));
+        assert_eq!(w.take_expired(), Some((t3, 3)));
+        assert_eq!(w.take_expired(), None);
+
+        assert!(w.add(5, 5).is_ok());
+    }
 }
@@ -79,11 +79,38 @@ static void zeroTimeoutQt()
 	Timer::deinit();
 }
 
+static void slack()
+{
+	EventLoop loop(2);
+
+	Timer a, b;
+	a.setSingleShot(true);
+	b.setSingleShot(true);
+	a.setSlack(40);
+	b.setSlack(40);
+
+	int aCount = 0;
+	int bCount = 0;
+
+	a.timeout.connect([&] { ++aCount; });
+	b.timeout.connect([&] { ++bCount; });
+
+	// different deadlines, but within the slack of a shared tick
+	a.start(15);
+	b.start(35);
+
+	while(aCount == 0 && bCount == 0)
+		loop.step();
+
+	TEST_ASSERT_EQ(aCount, 1);
+	TEST_ASSERT_EQ(bCount, 1);
+}
 
 extern "C" int timer_test(ffi::TestException *out_ex)
 {
 	TEST_CATCH(zeroTimeout());
 	TEST_CATCH(zeroTimeoutQt());
+	TEST_CATCH(slack());
 
 	return 0;
 }
@@ -29,6 +29,14 @@ TimerWheel::TimerWheel(int capacity)
 	raw_ = ffi::timer_wheel_create(capacity);
 }
 
+TimerWheel::TimerWheel(int initialCapacity, int maxCapacity)
+{
+	if(initialCapacity == maxCapacity)
+		raw_ = ffi::timer_wheel_create(maxCapacity);
+	else
+		raw_ = ffi::timer_wheel_create_growable(initialCapacity, maxCapacity);
+}
+
 TimerWheel::~TimerWheel()
 {
 	ffi::timer_wheel_destroy(raw_);
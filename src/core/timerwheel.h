@@ -40,6 +40,9 @@ public:
 	};
 
 	TimerWheel(int capacity);
+
+	// grows on demand up to maxCapacity, or without limit if zero
+	TimerWheel(int initialCapacity, int maxCapacity);
 	~TimerWheel();
 
 	// disable copying
@@ -22,6 +22,9 @@
 #include "tnetstring.h"
 
 #include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 #include "qtcompat.h"
 
 namespace TnetString {
@@ -351,6 +354,429 @@ QVariantList toList(const QByteArray &in, int offset, int dataOffset, int dataSi
 	return out;
 }
 
+// like check(), but doesn't allocate and doesn't read at or beyond limit
+static bool checkBounded(const QByteArray &in, int offset, int limit, Type *type, int *dataOffset, int *dataSize)
+{
+	const char *p = in.constData();
+
+	int at = offset;
+	qint64 size = 0;
+	while(at < limit && p[at] != ':')
+	{
+		char c = p[at];
+		if(c < '0' || c > '9' || at - offset >= 10)
+			return false;
+
+		size = (size * 10) + (c - '0');
+		++at;
+	}
+
+	if(at >= limit || at == offset)
+		return false;
+
+	qint64 typeAt = at + 1 + size;
+	if(typeAt >= limit)
+		return false;
+
+	Type type_;
+	switch(p[typeAt])
+	{
+		case ',': type_ = ByteArray; break;
+		case '#': type_ = Int; break;
+		case '^': type_ = Double; break;
+		case '!': type_ = Bool; break;
+		case '~': type_ = Null; break;
+		case '}': type_ = Hash; break;
+		case ']': type_ = List; break;
+		default: return false;
+	}
+
+	*type = type_;
+	*dataOffset = at + 1;
+	*dataSize = (int)size;
+	return true;
+}
+
+View::View() :
+	in_(0),
+	type_(Null),
+	offset_(0),
+	dataOffset_(0),
+	dataSize_(0)
+{
+}
+
+View::View(const QByteArray &in, int offset) :
+	View(&in, offset, in.size())
+{
+}
+
+View::View(const QByteArray *in, int offset, int limit) :
+	in_(0),
+	type_(Null),
+	offset_(offset),
+	dataOffset_(0),
+	dataSize_(0)
+{
+	if(offset >= 0 && checkBounded(*in, offset, limit, &type_, &dataOffset_, &dataSize_))
+		in_ = in;
+}
+
+QByteArray View::encoded() const
+{
+	if(!in_)
+		return QByteArray();
+
+	return in_->mid(offset_, end() - offset_);
+}
+
+bool View::equals(const char *str) const
+{
+	if(!in_ || type_ != ByteArray)
+		return false;
+
+	int len = strlen(str);
+	return (len == dataSize_ && memcmp(in_->constData() + dataOffset_, str, len) == 0);
+}
+
+QByteArray View::toByteArray(bool *ok) const
+{
+	if(!in_ || type_ != ByteArray)
+	{
+		if(ok)
+			*ok = false;
+		return QByteArray();
+	}
+
+	if(ok)
+		*ok = true;
+	return in_->mid(dataOffset_, dataSize_);
+}
+
+qint64 View::toInt(bool *ok) const
+{
+	if(in_ && type_ == Double)
+	{
+		bool ok_;
+		double d = toDouble(&ok_);
+
+		// the cast is only defined for values within range. the check
+		// also rejects nan
+		if(!ok_ || !(d >= -9223372036854775808.0 && d < 9223372036854775808.0))
+		{
+			if(ok)
+				*ok = false;
+			return 0;
+		}
+
+		if(ok)
+			*ok = true;
+		return (qint64)d;
+	}
+
+	if(!in_ || type_ != Int || dataSize_ < 1)
+	{
+		if(ok)
+			*ok = false;
+		return 0;
+	}
+
+	const char *p = in_->constData() + dataOffset_;
+	int at = 0;
+
+	bool neg = false;
+	if(p[0] == '-' || p[0] == '+')
+	{
+		neg = (p[0] == '-');
+		++at;
+	}
+
+	if(at >= dataSize_ || dataSize_ - at > 19)
+	{
+		if(ok)
+			*ok = false;
+		return 0;
+	}
+
+	quint64 x = 0;
+	for(; at < dataSize_; ++at)
+	{
+		char c = p[at];
+		if(c < '0' || c > '9')
+		{
+			if(ok)
+				*ok = false;
+			return 0;
+		}
+
+		x = (x * 10) + (c - '0');
+	}
+
+	// 19 digits can't overflow x, but can exceed the signed range
+	if(x > (neg ? (quint64)INT64_MAX + 1 : (quint64)INT64_MAX))
+	{
+		if(ok)
+			*ok = false;
+		return 0;
+	}
+
+	if(ok)
+		*ok = true;
+
+	// negate without overflowing for INT64_MIN
+	if(neg && x > 0)
+		return -(qint64)(x - 1) - 1;
+
+	return (qint64)x;
+}
+
+double View::toDouble(bool *ok) const
+{
+	if(!in_ || (type_ != Double && type_ != Int))
+	{
+		if(ok)
+			*ok = false;
+		return 0;
+	}
+
+	// raw data doesn't copy
+	QByteArray val = QByteArray::fromRawData(in_->constData() + dataOffset_, dataSize_);
+	bool ok_;
+	double x = val.toDouble(&ok_);
+	if(!ok_)
+		x = 0;
+	if(ok)
+		*ok = ok_;
+	return x;
+}
+
+bool View::toBool(bool *ok) const
+{
+	if(in_ && type_ == Bool)
+	{
+		const char *p = in_->constData() + dataOffset_;
+
+		if(dataSize_ == 4 && memcmp(p, "true", 4) == 0)
+		{
+			if(ok)
+				*ok = true;
+			return true;
+		}
+		else if(dataSize_ == 5 && memcmp(p, "false", 5) == 0)
+		{
+			if(ok)
+				*ok = true;
+			return false;
+		}
+	}
+
+	if(ok)
+		*ok = false;
+	return false;
+}
+
+QVariant View::toVariant(bool *ok) const
+{
+	if(!in_)
+	{
+		if(ok)
+			*ok = false;
+		return QVariant();
+	}
+
+	return TnetString::toVariant(*in_, dataOffset_, type_, dataOffset_, dataSize_, ok);
+}
+
+View::Iterator::Iterator(const View &container) :
+	container_(container),
+	at_(container.dataOffset_),
+	error_(!container.isValid() || (container.type_ != Hash && container.type_ != List))
+{
+}
+
+bool View::Iterator::next()
+{
+	if(error_)
+		return false;
+
+	int limit = container_.dataOffset_ + container_.dataSize_;
+	if(at_ >= limit)
+		return false;
+
+	if(container_.type_ == Hash)
+	{
+		key_ = View(container_.in_, at_, limit);
+		if(!key_.isValid() || key_.type_ != ByteArray)
+		{
+			error_ = true;
+			return false;
+		}
+
+		at_ = key_.end();
+	}
+
+	value_ = View(container_.in_, at_, limit);
+	if(!value_.isValid())
+	{
+		error_ = true;
+		return false;
+	}
+
+	at_ = value_.end();
+	return true;
+}
+
+// room for a 10 digit length and the separator
+#define WRITER_PREFIX_MAX 11
+
+Writer::Writer(QByteArray *out) :
+	out_(out)
+{
+}
+
+void Writer::writeRaw(const char *data, int size, char type)
+{
+	char prefix[WRITER_PREFIX_MAX + 1];
+	int len = snprintf(prefix, sizeof(prefix), "%d:", size);
+
+	out_->append(prefix, len);
+	out_->append(data, size);
+	out_->append(type);
+}
+
+void Writer::writeByteArray(const QByteArray &in)
+{
+	writeRaw(in.constData(), in.size(), ',');
+}
+
+void Writer::writeByteArray(const char *in)
+{
+	writeRaw(in, strlen(in), ',');
+}
+
+void Writer::writeInt(qint64 in)
+{
+	char val[32];
+	int len = snprintf(val, sizeof(val), "%lld", (long long)in);
+	writeRaw(val, len, '#');
+}
+
+void Writer::writeDouble(double in)
+{
+	QByteArray val = QByteArray::number(in);
+	writeRaw(val.constData(), val.size(), '^');
+}
+
+void Writer::writeBool(bool in)
+{
+	if(in)
+		writeRaw("true", 4, '!');
+	else
+		writeRaw("false", 5, '!');
+}
+
+void Writer::writeNull()
+{
+	out_->append("0:~", 3);
+}
+
+void Writer::writeVariant(const QVariant &in)
+{
+	switch(typeId(in))
+	{
+		case QMetaType::QByteArray:
+			writeByteArray(in.toByteArray());
+			break;
+		case QMetaType::Double:
+			writeDouble(in.toDouble());
+			break;
+		case QMetaType::Bool:
+			writeBool(in.toBool());
+			break;
+		case QMetaType::UnknownType:
+			writeNull();
+			break;
+		case QMetaType::QVariantHash:
+		{
+			startHash();
+
+			QVariantHash hash = in.toHash();
+			QHashIterator<QString, QVariant> it(hash);
+			while(it.hasNext())
+			{
+				it.next();
+				writeByteArray(it.key().toUtf8());
+				writeVariant(it.value());
+			}
+
+			end();
+			break;
+		}
+		case QMetaType::QVariantList:
+		{
+			startList();
+
+			foreach(const QVariant &v, in.toList())
+				writeVariant(v);
+
+			end();
+			break;
+		}
+		default:
+			if(canConvert(in, QMetaType::LongLong))
+			{
+				writeInt(in.toLongLong());
+				break;
+			}
+
+			// unsupported type
+			assert(0);
+	}
+}
+
+void Writer::start(char type)
+{
+	Container c;
+	c.pos = out_->size();
+	c.type = type;
+	containers_ += c;
+
+	// reserve space for the largest prefix. the unused part is removed
+	// when the container is ended
+	out_->resize(c.pos + WRITER_PREFIX_MAX);
+}
+
+void Writer::startHash()
+{
+	start('}');
+}
+
+void Writer::startList()
+{
+	start(']');
+}
+
+void Writer::end()
+{
+	assert(!containers_.isEmpty());
+
+	Container c = containers_.takeLast();
+
+	int dataStart = c.pos + WRITER_PREFIX_MAX;
+	int size = out_->size() - dataStart;
+
+	char prefix[WRITER_PREFIX_MAX + 1];
+	int len = snprintf(prefix, sizeof(prefix), "%d:", size);
+
+	// backpatch the prefix and close the gap
+	char *p = out_->data();
+	memmove(p + c.pos + len, p + dataStart, size);
+	memcpy(p + c.pos, prefix, len);
+	out_->resize(c.pos + len + size);
+
+	out_->append(c.type);
+}
+
 QString byteArrayToEscapedString(const QByteArray &in)
 {
 	QString out;
@@ -22,6 +22,7 @@
 #define TNETSTRING_H
 
 #include <QVariant>
+#include <QVector>
 
 namespace TnetString {
 
@@ -56,6 +57,109 @@ QVariantList toList(const QByteArray &in, int offset, int dataOffset, int dataSi
 QVariant toVariant(const QByteArray &in, int offset, Type type, int dataOffset, int dataSize, bool *ok = 0);
 QVariant toVariant(const QByteArray &in, int offset = 0, bool *ok = 0);
 
+// non-allocating access to an encoded value. a view refers into the buffer
+// it was created from, which must outlive it. nested values are checked as
+// they are visited, so an iterator that fails sets its error flag
+class View
+{
+public:
+	class Iterator;
+
+	View();
+	View(const QByteArray &in, int offset = 0);
+
+	bool isValid() const { return in_ != 0; }
+	Type type() const { return type_; }
+
+	// position of the value, including its length prefix
+	int offset() const { return offset_; }
+
+	// position after the value
+	int end() const { return dataOffset_ + dataSize_ + 1; }
+
+	// copy of the value as encoded
+	QByteArray encoded() const;
+
+	bool equals(const char *str) const;
+
+	// for byte arrays, the bytes of the value within the buffer
+	const char *data() const { return in_ ? in_->constData() + dataOffset_ : 0; }
+	int size() const { return dataSize_; }
+
+	QByteArray toByteArray(bool *ok = 0) const;
+	qint64 toInt(bool *ok = 0) const;
+	double toDouble(bool *ok = 0) const;
+	bool toBool(bool *ok = 0) const;
+
+	// decodes the value and anything nested within it
+	QVariant toVariant(bool *ok = 0) const;
+
+private:
+	const QByteArray *in_;
+	Type type_;
+	int offset_;
+	int dataOffset_;
+	int dataSize_;
+
+	View(const QByteArray *in, int offset, int limit);
+};
+
+class View::Iterator
+{
+public:
+	Iterator(const View &container);
+
+	// for hashes, advances to the next key and value. for lists,
+	// advances to the next value
+	bool next();
+
+	bool isError() const { return error_; }
+	const View &key() const { return key_; }
+	const View &value() const { return value_; }
+
+private:
+	View container_;
+	int at_;
+	bool error_;
+	View key_;
+	View value_;
+};
+
+// streaming encoder. values are appended directly to the output buffer,
+// and the length prefixes of containers are filled in when they are ended
+class Writer
+{
+public:
+	Writer(QByteArray *out);
+
+	void writeByteArray(const QByteArray &in);
+	void writeByteArray(const char *in);
+	void writeInt(qint64 in);
+	void writeDouble(double in);
+	void writeBool(bool in);
+	void writeNull();
+	void writeVariant(const QVariant &in);
+
+	// containers can be nested, and must be ended in reverse order
+	void startHash();
+	void startList();
+	void end();
+
+private:
+	class Container
+	{
+	public:
+		int pos;
+		char type;
+	};
+
+	QByteArray *out_;
+	QVector<Container> containers_;
+
+	void writeRaw(const char *data, int size, char type);
+	void start(char type);
+};
+
 QString byteArrayToEscapedString(const QByteArray &in);
 
 // pass >= 0 for pretty print, -1 for compact
@@ -22,7 +22,7 @@ use std::str;
 use thiserror::Error;
 
 const F64_SIZE_MAX: usize = 64;
-const OPS_MAX: usize = 1_000;
+pub const OPS_MAX: usize = 1_000;
 
 const TRUE_BYTES: &[u8] = b"true";
 const FALSE_BYTES: &[u8] = b"false";
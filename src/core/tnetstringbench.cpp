@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include <QVariant>
+#include "bench.h"
+#include "tnetstring.h"
+
+static QVariantHash publishMessage(int contentSize)
+{
+	QVariantHash format;
+	format["content"] = QByteArray(contentSize, 'a');
+
+	QVariantHash formats;
+	formats["http-stream"] = format;
+
+	QVariantHash item;
+	item["channel"] = QByteArray("test");
+	item["id"] = QByteArray("an-item-id");
+	item["prev-id"] = QByteArray("a-prev-id");
+	item["formats"] = formats;
+
+	QVariantHash msg;
+	msg["items"] = QVariantList() << item;
+
+	return msg;
+}
+
+static int scanView(const TnetString::View &v)
+{
+	int count = 1;
+
+	if(v.type() == TnetString::Hash || v.type() == TnetString::List)
+	{
+		TnetString::View::Iterator it(v);
+		while(it.next())
+			count += scanView(it.value());
+	}
+
+	return count;
+}
+
+extern "C" void tnetstring_bench(const char *filter)
+{
+	Bench bench(filter);
+
+	QVariantHash msg = publishMessage(1000);
+	QByteArray encoded = TnetString::fromVariant(msg);
+	QByteArray content(1000, 'a');
+
+	bench.run("tnetstring/encode-variant", 100000, 1, [&] {
+		QByteArray out = TnetString::fromVariant(msg);
+		Q_UNUSED(out);
+	});
+
+	bench.run("tnetstring/encode-writer", 100000, 1, [&] {
+		QByteArray out;
+		TnetString::Writer w(&out);
+		w.startHash();
+		w.writeByteArray("items");
+		w.startList();
+		w.startHash();
+		w.writeByteArray("channel");
+		w.writeByteArray("test");
+		w.writeByteArray("id");
+		w.writeByteArray("an-item-id");
+		w.writeByteArray("prev-id");
+		w.writeByteArray("a-prev-id");
+		w.writeByteArray("formats");
+		w.startHash();
+		w.writeByteArray("http-stream");
+		w.startHash();
+		w.writeByteArray("content");
+		w.writeByteArray(content);
+		w.end();
+		w.end();
+		w.end();
+		w.end();
+		w.end();
+	});
+
+	bench.run("tnetstring/decode-variant", 100000, 1, [&] {
+		QVariant v = TnetString::toVariant(encoded);
+		Q_UNUSED(v);
+	});
+
+	bench.run("tnetstring/decode-view", 100000, 1, [&] {
+		TnetString::View v(encoded);
+		int n = scanView(v);
+		Q_UNUSED(n);
+	});
+}
@@ -0,0 +1,515 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include <string.h>
+#include "test.h"
+#include "tnetstring.h"
+#include "zhttprequestpacket.h"
+#include "zhttpresponsepacket.h"
+#include "zhttpkeys.h"
+#include "packet/wscontrolpacket.h"
+
+static void viewValues()
+{
+	QVariantList list;
+	list += QByteArray("apple");
+	list += 42;
+
+	QVariantHash hash;
+	hash["str"] = QByteArray("hello");
+	hash["int"] = -17;
+	hash["double"] = 1.5;
+	hash["bool"] = true;
+	hash["null"] = QVariant();
+	hash["list"] = list;
+
+	QByteArray data = "T" + TnetString::fromVariant(hash);
+
+	TnetString::View v(data, 1);
+	TEST_ASSERT(v.isValid());
+	TEST_ASSERT(v.type() == TnetString::Hash);
+	TEST_ASSERT_EQ(v.end(), data.size());
+
+	int count = 0;
+	TnetString::View::Iterator it(v);
+	while(it.next())
+	{
+		const TnetString::View &k = it.key();
+		const TnetString::View &val = it.value();
+		bool ok;
+
+		if(k.equals("str"))
+		{
+			TEST_ASSERT(val.equals("hello"));
+			TEST_ASSERT(!val.equals("hell"));
+			TEST_ASSERT_EQ(val.toByteArray(&ok), QByteArray("hello"));
+			TEST_ASSERT(ok);
+
+			// wrong type
+			val.toInt(&ok);
+			TEST_ASSERT(!ok);
+		}
+		else if(k.equals("int"))
+		{
+			TEST_ASSERT_EQ(val.toInt(&ok), -17);
+			TEST_ASSERT(ok);
+		}
+		else if(k.equals("double"))
+		{
+			TEST_ASSERT_EQ(val.toDouble(&ok), 1.5);
+			TEST_ASSERT(ok);
+		}
+		else if(k.equals("bool"))
+		{
+			TEST_ASSERT_EQ(val.toBool(&ok), true);
+			TEST_ASSERT(ok);
+		}
+		else if(k.equals("null"))
+		{
+			TEST_ASSERT(val.type() == TnetString::Null);
+		}
+		else if(k.equals("list"))
+		{
+			TnetString::View::Iterator lit(val);
+
+			TEST_ASSERT(lit.next());
+			TEST_ASSERT(lit.value().equals("apple"));
+			TEST_ASSERT(lit.next());
+			TEST_ASSERT_EQ(lit.value().toInt(), 42);
+			TEST_ASSERT(!lit.next());
+			TEST_ASSERT(!lit.isError());
+
+			TEST_ASSERT_EQ(val.toVariant(), QVariant(list));
+		}
+
+		++count;
+	}
+
+	TEST_ASSERT(!it.isError());
+	TEST_ASSERT_EQ(count, 6);
+}
+
+static void viewMalformed()
+{
+	// length runs past the end
+	TEST_ASSERT(!TnetString::View(QByteArray("10:abc,")).isValid());
+
+	// missing length
+	TEST_ASSERT(!TnetString::View(QByteArray(":abc,")).isValid());
+
+	// bad type
+	TEST_ASSERT(!TnetString::View(QByteArray("3:abc?")).isValid());
+
+	// nested value runs past the end of its container
+	QByteArray data("8:3:abc,9:x,}");
+	TnetString::View v(data);
+	TEST_ASSERT(!v.isValid());
+
+	data = "10:3:abc,9:x,}";
+	v = TnetString::View(data);
+	TEST_ASSERT(v.isValid());
+
+	TnetString::View::Iterator it(v);
+	TEST_ASSERT(!it.next());
+	TEST_ASSERT(it.isError());
+
+	// keys must be strings
+	data = "8:1:1#1:x,}";
+	v = TnetString::View(data);
+	TEST_ASSERT(v.isValid());
+
+	it = TnetString::View::Iterator(v);
+	TEST_ASSERT(!it.next());
+	TEST_ASSERT(it.isError());
+}
+
+static void viewIntRange()
+{
+	bool ok;
+
+	QByteArray data("19:9223372036854775807#");
+	TEST_ASSERT_EQ(TnetString::View(data).toInt(&ok), Q_INT64_C(9223372036854775807));
+	TEST_ASSERT(ok);
+
+	data = "20:-9223372036854775808#";
+	TEST_ASSERT_EQ(TnetString::View(data).toInt(&ok), (qint64)(-Q_INT64_C(9223372036854775807) - 1));
+	TEST_ASSERT(ok);
+
+	// out of range values fit in 19 digits but must not wrap
+	data = "19:9223372036854775808#";
+	TnetString::View(data).toInt(&ok);
+	TEST_ASSERT(!ok);
+
+	data = "19:9999999999999999999#";
+	TnetString::View(data).toInt(&ok);
+	TEST_ASSERT(!ok);
+
+	data = "20:-9223372036854775809#";
+	TnetString::View(data).toInt(&ok);
+	TEST_ASSERT(!ok);
+
+	// doubles are truncated, if within range
+	data = "4:-2.5^";
+	TEST_ASSERT_EQ(TnetString::View(data).toInt(&ok), -2);
+	TEST_ASSERT(ok);
+
+	data = "6:1.0e30^";
+	TnetString::View(data).toInt(&ok);
+	TEST_ASSERT(!ok);
+}
+
+static void requestPacket()
+{
+	ZhttpRequestPacket in;
+	in.from = "client";
+	in.ids += ZhttpRequestPacket::Id("a", 1);
+	in.ids += ZhttpRequestPacket::Id("b", 5);
+	in.type = ZhttpRequestPacket::Data;
+	in.credits = 1000;
+	in.more = true;
+	in.stream = true;
+	in.method = "POST";
+	in.uri = QUrl("http://example.com/path?a=b");
+	in.headers += HttpHeader("Content-Type", "text/plain");
+	in.headers += HttpHeader("X-Foo", "bar");
+	in.body = "hello world";
+	in.userData = QVariantHash({{"key", QByteArray("value")}});
+	in.peerAddress = QHostAddress("192.168.1.1");
+	in.peerPort = 1234;
+	in.multi = true;
+
+	QByteArray data = TnetString::fromVariant(in.toVariant());
+
+	ZhttpRequestPacket p;
+	TEST_ASSERT(p.fromView(TnetString::View(data)));
+	TEST_ASSERT_EQ(p.from, in.from);
+	TEST_ASSERT_EQ(p.ids.count(), 2);
+	TEST_ASSERT_EQ(p.ids[0].id, QByteArray("a"));
+	TEST_ASSERT_EQ(p.ids[0].seq, 1);
+	TEST_ASSERT_EQ(p.ids[1].id, QByteArray("b"));
+	TEST_ASSERT_EQ(p.ids[1].seq, 5);
+	TEST_ASSERT(p.type == ZhttpRequestPacket::Data);
+	TEST_ASSERT_EQ(p.credits, 1000);
+	TEST_ASSERT(p.more);
+	TEST_ASSERT(p.stream);
+	TEST_ASSERT_EQ(p.method, QString("POST"));
+	TEST_ASSERT_EQ(p.uri, in.uri);
+	TEST_ASSERT_EQ(p.headers.count(), 2);
+	TEST_ASSERT_EQ(p.headers.get("X-Foo"), QByteArray("bar"));
+	TEST_ASSERT_EQ(p.body, in.body);
+	TEST_ASSERT_EQ(p.userData, in.userData);
+	TEST_ASSERT(p.peerAddress == in.peerAddress);
+	TEST_ASSERT_EQ(p.peerPort, 1234);
+	TEST_ASSERT(p.multi);
+
+	// single id with separate seq
+	in = ZhttpRequestPacket();
+	in.ids += ZhttpRequestPacket::Id("a", 7);
+	in.type = ZhttpRequestPacket::Error;
+	in.condition = "bad-request";
+
+	data = TnetString::fromVariant(in.toVariant());
+
+	TEST_ASSERT(p.fromView(TnetString::View(data)));
+	TEST_ASSERT_EQ(p.ids.count(), 1);
+	TEST_ASSERT_EQ(p.ids[0].id, QByteArray("a"));
+	TEST_ASSERT_EQ(p.ids[0].seq, 7);
+	TEST_ASSERT(p.type == ZhttpRequestPacket::Error);
+	TEST_ASSERT_EQ(p.condition, QByteArray("bad-request"));
+
+	// wrong field type
+	QVariantHash vh = in.toVariant().toHash();
+	vh["credits"] = QByteArray("x");
+	data = TnetString::fromVariant(vh);
+	TEST_ASSERT(!p.fromView(TnetString::View(data)));
+}
+
+static void responsePacket()
+{
+	ZhttpResponsePacket in;
+	in.from = "server";
+	in.ids += ZhttpResponsePacket::Id("a", 3);
+	in.type = ZhttpResponsePacket::Data;
+	in.code = 200;
+	in.reason = "OK";
+	in.headers += HttpHeader("Content-Type", "text/plain");
+	in.body = "hello";
+	in.credits = 200;
+
+	QByteArray data = "T" + TnetString::fromVariant(in.toVariant());
+
+	ZhttpResponsePacket p;
+	TEST_ASSERT(p.fromView(TnetString::View(data, 1)));
+	TEST_ASSERT_EQ(p.from, in.from);
+	TEST_ASSERT_EQ(p.ids.count(), 1);
+	TEST_ASSERT_EQ(p.ids[0].id, QByteArray("a"));
+	TEST_ASSERT_EQ(p.ids[0].seq, 3);
+	TEST_ASSERT_EQ(p.code, 200);
+	TEST_ASSERT_EQ(p.reason, QByteArray("OK"));
+	TEST_ASSERT_EQ(p.headers.get("Content-Type"), QByteArray("text/plain"));
+	TEST_ASSERT_EQ(p.body, in.body);
+	TEST_ASSERT_EQ(p.credits, 200);
+}
+
+static void packetKeys()
+{
+	const char *names[] = {
+		"from", "id", "seq", "type", "condition", "credits", "more",
+		"stream", "router-resp", "max-size", "timeout", "method", "uri",
+		"headers", "body", "content-type", "code", "reason", "user-data",
+		"peer-address", "peer-port", "connect-host", "connect-port",
+		"ignore-policies", "trust-connect-host", "ignore-tls-errors",
+		"follow-redirects", "passthrough", "ext"
+	};
+
+	// names are listed in enum order
+	for(int n = 0; n < (int)(sizeof(names) / sizeof(names[0])); ++n)
+		TEST_ASSERT_EQ((int)ZhttpKeys::lookup(names[n], strlen(names[n])), n);
+
+	// same length and dispatch character as known names
+	TEST_ASSERT(ZhttpKeys::lookup("ix", 2) == ZhttpKeys::Unknown);
+	TEST_ASSERT(ZhttpKeys::lookup("connect-hose", 12) == ZhttpKeys::Unknown);
+	TEST_ASSERT(ZhttpKeys::lookup("", 0) == ZhttpKeys::Unknown);
+
+	const char *types[] = {
+		"error", "credit", "keep-alive", "cancel", "handoff-start",
+		"handoff-proceed", "close", "ping", "pong"
+	};
+
+	for(int n = 0; n < (int)(sizeof(types) / sizeof(types[0])); ++n)
+		TEST_ASSERT_EQ((int)ZhttpKeys::lookupType(types[n], strlen(types[n])), n + 1);
+
+	TEST_ASSERT(ZhttpKeys::lookupType("data", 4) == ZhttpKeys::UnknownType);
+
+	// only byte arrays are names
+	QByteArray data = TnetString::fromInt(4);
+	TEST_ASSERT(ZhttpKeys::lookup(TnetString::View(data)) == ZhttpKeys::Unknown);
+
+	// every request field, and unknown fields are skipped
+	QVariantHash vh;
+	vh["from"] = QByteArray("client");
+	vh["id"] = QByteArray("a");
+	vh["seq"] = 2;
+	vh["type"] = QByteArray("keep-alive");
+	vh["router-resp"] = true;
+	vh["max-size"] = 100;
+	vh["timeout"] = 5000;
+	vh["connect-host"] = QByteArray("example.com");
+	vh["connect-port"] = 8080;
+	vh["ignore-policies"] = true;
+	vh["trust-connect-host"] = true;
+	vh["ignore-tls-errors"] = true;
+	vh["follow-redirects"] = true;
+	vh["passthrough"] = QByteArray("pt");
+	vh["content-type"] = QByteArray("text");
+	vh["x-unknown"] = QByteArray("ignored");
+	data = TnetString::fromHash(vh);
+
+	ZhttpRequestPacket p;
+	TEST_ASSERT(p.fromView(TnetString::View(data)));
+	TEST_ASSERT(p.type == ZhttpRequestPacket::KeepAlive);
+	TEST_ASSERT_EQ(p.ids.count(), 1);
+	TEST_ASSERT_EQ(p.ids[0].seq, 2);
+	TEST_ASSERT(p.routerResp);
+	TEST_ASSERT_EQ(p.maxSize, 100);
+	TEST_ASSERT_EQ(p.timeout, 5000);
+	TEST_ASSERT_EQ(p.connectHost, QString("example.com"));
+	TEST_ASSERT_EQ(p.connectPort, 8080);
+	TEST_ASSERT(p.ignorePolicies);
+	TEST_ASSERT(p.trustConnectHost);
+	TEST_ASSERT(p.ignoreTlsErrors);
+	TEST_ASSERT(p.followRedirects);
+	TEST_ASSERT_EQ(p.passthrough, QVariant(QByteArray("pt")));
+	TEST_ASSERT_EQ(p.contentType, QByteArray("text"));
+
+	// unknown type
+	vh["type"] = QByteArray("pang");
+	data = TnetString::fromHash(vh);
+	TEST_ASSERT(!p.fromView(TnetString::View(data)));
+}
+
+static void wsControlPacket()
+{
+	WsControlPacket in;
+	in.from = "handler";
+
+	WsControlPacket::Item i;
+	i.cid = "c1";
+	i.type = WsControlPacket::Item::Send;
+	i.contentType = "text";
+	i.message = "hello";
+	i.queue = true;
+	in.items += i;
+
+	i = WsControlPacket::Item();
+	i.cid = "c2";
+	i.type = WsControlPacket::Item::KeepAliveSetup;
+	i.timeout = 30;
+	i.keepAliveMode = "idle";
+	in.items += i;
+
+	QByteArray data = TnetString::fromVariant(in.toVariant());
+
+	WsControlPacket p;
+	TEST_ASSERT(p.fromView(TnetString::View(data)));
+	TEST_ASSERT_EQ(p.from, in.from);
+	TEST_ASSERT_EQ(p.items.count(), 2);
+	TEST_ASSERT_EQ(p.items[0].cid, QByteArray("c1"));
+	TEST_ASSERT(p.items[0].type == WsControlPacket::Item::Send);
+	TEST_ASSERT_EQ(p.items[0].contentType, QByteArray("text"));
+	TEST_ASSERT_EQ(p.items[0].message, QByteArray("hello"));
+	TEST_ASSERT(p.items[0].queue);
+	TEST_ASSERT_EQ(p.items[1].cid, QByteArray("c2"));
+	TEST_ASSERT(p.items[1].type == WsControlPacket::Item::KeepAliveSetup);
+	TEST_ASSERT_EQ(p.items[1].timeout, 30);
+	TEST_ASSERT_EQ(p.items[1].keepAliveMode, QByteArray("idle"));
+
+	// from is required
+	QVariantHash vh = in.toVariant().toHash();
+	vh.remove("from");
+	data = TnetString::fromVariant(vh);
+	TEST_ASSERT(!p.fromView(TnetString::View(data)));
+}
+
+static void writerValues()
+{
+	QByteArray data;
+	TnetString::Writer w(&data);
+	w.startList();
+	w.writeByteArray("hello");
+	w.writeInt(-42);
+	w.writeBool(true);
+	w.writeNull();
+	w.startHash();
+	w.writeByteArray("key");
+	w.writeByteArray(QByteArray(100, 'x'));
+	w.end();
+	w.startList();
+	w.end();
+	w.end();
+
+	QVariantList expected;
+	expected += QByteArray("hello");
+	expected += -42;
+	expected += true;
+	expected += QVariant();
+	QVariantHash h;
+	h["key"] = QByteArray(100, 'x');
+	expected += h;
+	expected += QVariantList();
+
+	TEST_ASSERT_EQ(data, TnetString::fromVariant(expected));
+
+	// appends after existing content
+	data = "T";
+	TnetString::Writer w2(&data);
+	w2.writeVariant(expected);
+	TEST_ASSERT_EQ(data, "T" + TnetString::fromVariant(expected));
+}
+
+static void writerPackets()
+{
+	ZhttpRequestPacket req;
+	req.from = "client";
+	req.ids += ZhttpRequestPacket::Id("a", 1);
+	req.ids += ZhttpRequestPacket::Id("b", 5);
+	req.type = ZhttpRequestPacket::Data;
+	req.credits = 1000;
+	req.method = "GET";
+	req.uri = QUrl("http://example.com/path");
+	req.headers += HttpHeader("X-Foo", "bar");
+	req.body = "hello world";
+	req.userData = QVariantHash({{"key", QByteArray("value")}});
+
+	QByteArray data;
+	TnetString::Writer w(&data);
+	req.writeTo(w);
+
+	ZhttpRequestPacket preq;
+	TEST_ASSERT(preq.fromView(TnetString::View(data)));
+	TEST_ASSERT_EQ(preq.from, req.from);
+	TEST_ASSERT_EQ(preq.ids.count(), 2);
+	TEST_ASSERT_EQ(preq.ids[1].id, QByteArray("b"));
+	TEST_ASSERT_EQ(preq.ids[1].seq, 5);
+	TEST_ASSERT_EQ(preq.credits, 1000);
+	TEST_ASSERT_EQ(preq.method, QString("GET"));
+	TEST_ASSERT_EQ(preq.uri, req.uri);
+	TEST_ASSERT_EQ(preq.headers.get("X-Foo"), QByteArray("bar"));
+	TEST_ASSERT_EQ(preq.body, req.body);
+	TEST_ASSERT_EQ(preq.userData, req.userData);
+
+	ZhttpResponsePacket resp;
+	resp.from = "server";
+	resp.ids += ZhttpResponsePacket::Id("a", 3);
+	resp.type = ZhttpResponsePacket::Data;
+	resp.code = 200;
+	resp.reason = "OK";
+	resp.headers += HttpHeader("Content-Type", "text/plain");
+	resp.body = "hello";
+
+	data = "T";
+	TnetString::Writer w2(&data);
+	resp.writeTo(w2);
+
+	ZhttpResponsePacket presp;
+	TEST_ASSERT(presp.fromView(TnetString::View(data, 1)));
+	TEST_ASSERT_EQ(presp.ids[0].seq, 3);
+	TEST_ASSERT_EQ(presp.code, 200);
+	TEST_ASSERT_EQ(presp.reason, QByteArray("OK"));
+	TEST_ASSERT_EQ(presp.headers.get("Content-Type"), QByteArray("text/plain"));
+	TEST_ASSERT_EQ(presp.body, resp.body);
+
+	WsControlPacket ws;
+	ws.from = "handler";
+	WsControlPacket::Item i;
+	i.cid = "c1";
+	i.type = WsControlPacket::Item::Send;
+	i.message = "hello";
+	i.ttl = 10;
+	ws.items += i;
+
+	data.clear();
+	TnetString::Writer w3(&data);
+	ws.writeTo(w3);
+
+	WsControlPacket pws;
+	TEST_ASSERT(pws.fromView(TnetString::View(data)));
+	TEST_ASSERT_EQ(pws.items.count(), 1);
+	TEST_ASSERT(pws.items[0].type == WsControlPacket::Item::Send);
+	TEST_ASSERT_EQ(pws.items[0].message, QByteArray("hello"));
+	TEST_ASSERT_EQ(pws.items[0].ttl, 10);
+}
+
+extern "C" int tnetstring_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(viewValues());
+	TEST_CATCH(viewMalformed());
+	TEST_CATCH(viewIntRange());
+	TEST_CATCH(requestPacket());
+	TEST_CATCH(responsePacket());
+	TEST_CATCH(packetKeys());
+	TEST_CATCH(wsControlPacket());
+	TEST_CATCH(writerValues());
+	TEST_CATCH(writerPackets());
+
+	return 0;
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "topk.h"
+
+#include <assert.h>
+#include <algorithm>
+
+#define DEPTH_MAX 8
+
+// one seed per sketch row
+static const quint64 seeds[DEPTH_MAX] =
+{
+	0x9e3779b97f4a7c15, 0xbf58476d1ce4e5b9, 0x94d049bb133111eb, 0xd6e8feb86659fd93,
+	0xa0761d6478bd642f, 0xe7037ed1a0b428db, 0x8ebc6af09c88c6e3, 0x589965cc75374cc3
+};
+
+// splitmix64 finalizer. the string hash is computed once and mixed with
+// each row's seed, so that keys colliding in one row are unlikely to
+// collide in the others
+static quint64 mix(quint64 x)
+{
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+	return x ^ (x >> 31);
+}
+
+TopK::TopK(int capacity, int width, int depth) :
+	capacity_(capacity),
+	width_(width),
+	depth_(depth),
+	counters_((size_t)width * depth, 0)
+{
+	assert(capacity_ > 0);
+	assert(width_ > 0);
+	assert(depth_ > 0 && depth_ <= DEPTH_MAX);
+
+	heap_.reserve(capacity_);
+	positions_.reserve(capacity_);
+}
+
+void TopK::buckets(const QString &key, int *out) const
+{
+	quint64 h = qHash(key);
+
+	for(int n = 0; n < depth_; ++n)
+		out[n] = n * width_ + (int)(mix(h + seeds[n]) % width_);
+}
+
+// conservative update: only the smallest counters are raised, which
+// reduces overcounting. returns the new estimate
+quint64 TopK::increment(const QString &key, quint64 amount)
+{
+	int pos[DEPTH_MAX];
+	buckets(key, pos);
+
+	quint64 est = counters_[pos[0]];
+	for(int n = 1; n < depth_; ++n)
+		est = std::min(est, counters_[pos[n]]);
+
+	est += amount;
+
+	for(int n = 0; n < depth_; ++n)
+	{
+		if(counters_[pos[n]] < est)
+			counters_[pos[n]] = est;
+	}
+
+	return est;
+}
+
+void TopK::add(const QString &key, quint64 amount)
+{
+	quint64 est = increment(key, amount);
+
+	QHash<QString, int>::iterator it = positions_.find(key);
+	if(it != positions_.end())
+	{
+		int pos = it.value();
+		heap_[pos].count = est;
+
+		// counts only grow, which moves an item away from the root
+		siftDown(pos);
+		return;
+	}
+
+	if((int)heap_.size() < capacity_)
+	{
+		heap_.push_back(Item(key, est));
+		positions_.insert(key, (int)heap_.size() - 1);
+		siftUp((int)heap_.size() - 1);
+		return;
+	}
+
+	// replace the lightest tracked key
+	if(est > heap_[0].count)
+	{
+		positions_.remove(heap_[0].key);
+		heap_[0] = Item(key, est);
+		positions_.insert(key, 0);
+		siftDown(0);
+	}
+}
+
+quint64 TopK::estimate(const QString &key) const
+{
+	int pos[DEPTH_MAX];
+	buckets(key, pos);
+
+	quint64 est = counters_[pos[0]];
+	for(int n = 1; n < depth_; ++n)
+		est = std::min(est, counters_[pos[n]]);
+
+	return est;
+}
+
+void TopK::decay()
+{
+	for(quint64 &c : counters_)
+		c >>= 1;
+
+	// halving keeps the heap order
+	for(Item &i : heap_)
+		i.count >>= 1;
+}
+
+QList<TopK::Item> TopK::items() const
+{
+	QList<Item> out;
+
+	for(const Item &i : heap_)
+	{
+		if(i.count > 0)
+			out += i;
+	}
+
+	std::sort(out.begin(), out.end(), [](const Item &a, const Item &b) {
+		return a.count > b.count;
+	});
+
+	return out;
+}
+
+void TopK::swapItems(int a, int b)
+{
+	std::swap(heap_[a], heap_[b]);
+	positions_[heap_[a].key] = a;
+	positions_[heap_[b].key] = b;
+}
+
+void TopK::siftUp(int pos)
+{
+	while(pos > 0)
+	{
+		int parent = (pos - 1) / 2;
+		if(heap_[parent].count <= heap_[pos].count)
+			break;
+
+		swapItems(parent, pos);
+		pos = parent;
+	}
+}
+
+void TopK::siftDown(int pos)
+{
+	int size = (int)heap_.size();
+
+	while(true)
+	{
+		int smallest = pos;
+		int left = pos * 2 + 1;
+		int right = left + 1;
+
+		if(left < size && heap_[left].count < heap_[smallest].count)
+			smallest = left;
+
+		if(right < size && heap_[right].count < heap_[smallest].count)
+			smallest = right;
+
+		if(smallest == pos)
+			break;
+
+		swapItems(pos, smallest);
+		pos = smallest;
+	}
+}
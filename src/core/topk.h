@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef TOPK_H
+#define TOPK_H
+
+#include <vector>
+#include <QString>
+#include <QHash>
+#include <QList>
+
+// tracks the heaviest keys of a stream in bounded memory. amounts are
+// summed in a count-min sketch, and the keys with the largest estimates
+// are kept in a min-heap of fixed capacity. estimates never undercount,
+// and overcount by a small fraction of the total
+class TopK
+{
+public:
+	class Item
+	{
+	public:
+		QString key;
+		quint64 count;
+
+		Item() :
+			count(0)
+		{
+		}
+
+		Item(const QString &_key, quint64 _count) :
+			key(_key),
+			count(_count)
+		{
+		}
+	};
+
+	// width and depth are the sketch dimensions. memory use is about
+	// width * depth * 8 bytes, plus the tracked keys
+	TopK(int capacity, int width = 2048, int depth = 4);
+
+	int capacity() const { return capacity_; }
+
+	void add(const QString &key, quint64 amount = 1);
+	quint64 estimate(const QString &key) const;
+
+	// halves all counts, so that the tracked keys follow recent activity
+	void decay();
+
+	// heaviest first. keys whose counts have decayed to zero are omitted
+	QList<Item> items() const;
+
+private:
+	int capacity_;
+	int width_;
+	int depth_;
+	std::vector<quint64> counters_;
+	std::vector<Item> heap_;
+	QHash<QString, int> positions_; // k=key, v=heap index
+
+	void buckets(const QString &key, int *out) const;
+	quint64 increment(const QString &key, quint64 amount);
+	void swapItems(int a, int b);
+	void siftUp(int pos);
+	void siftDown(int pos);
+};
+
+#endif
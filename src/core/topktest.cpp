@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "test.h"
+#include "topk.h"
+
+static void heaviest()
+{
+	TopK t(3);
+
+	t.add("apple", 5);
+	t.add("banana", 1);
+	t.add("cherry", 3);
+	t.add("durian", 2);
+
+	// banana is the lightest and is dropped for durian
+	QList<TopK::Item> items = t.items();
+	TEST_ASSERT_EQ(items.count(), 3);
+	TEST_ASSERT_EQ(items[0].key, QString("apple"));
+	TEST_ASSERT_EQ(items[0].count, 5u);
+	TEST_ASSERT_EQ(items[1].key, QString("cherry"));
+	TEST_ASSERT_EQ(items[2].key, QString("durian"));
+
+	// a key that overtakes a tracked one replaces it
+	t.add("banana", 5);
+	items = t.items();
+	TEST_ASSERT_EQ(items.count(), 3);
+	TEST_ASSERT_EQ(items[0].key, QString("banana"));
+	TEST_ASSERT_EQ(items[0].count, 6u);
+	TEST_ASSERT_EQ(items[2].key, QString("cherry"));
+
+	// tracked keys keep accumulating
+	t.add("cherry", 10);
+	items = t.items();
+	TEST_ASSERT_EQ(items[0].key, QString("cherry"));
+	TEST_ASSERT_EQ(items[0].count, 13u);
+}
+
+static void manyKeys()
+{
+	TopK t(5, 256, 4);
+
+	// far more keys than the sketch is wide, with a few heavy ones
+	for(int n = 0; n < 10000; ++n)
+	{
+		t.add(QString("light%1").arg(n));
+
+		if(n % 10 == 0)
+			t.add("heavy1");
+		if(n % 20 == 0)
+			t.add("heavy2");
+	}
+
+	QList<TopK::Item> items = t.items();
+	TEST_ASSERT_EQ(items.count(), 5);
+	TEST_ASSERT_EQ(items[0].key, QString("heavy1"));
+	TEST_ASSERT_EQ(items[1].key, QString("heavy2"));
+
+	// estimates never undercount
+	TEST_ASSERT(items[0].count >= 1000u);
+	TEST_ASSERT(items[1].count >= 500u);
+	TEST_ASSERT(t.estimate("light7") >= 1u);
+}
+
+static void decay()
+{
+	TopK t(2);
+
+	t.add("apple", 8);
+	t.add("banana", 2);
+
+	t.decay();
+
+	QList<TopK::Item> items = t.items();
+	TEST_ASSERT_EQ(items.count(), 2);
+	TEST_ASSERT_EQ(items[0].count, 4u);
+	TEST_ASSERT_EQ(items[1].count, 1u);
+	TEST_ASSERT_EQ(t.estimate("apple"), 4u);
+
+	// counts that reach zero are omitted
+	t.decay();
+	items = t.items();
+	TEST_ASSERT_EQ(items.count(), 1);
+	TEST_ASSERT_EQ(items[0].key, QString("apple"));
+	TEST_ASSERT_EQ(items[0].count, 2u);
+}
+
+extern "C" int topk_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(heaviest());
+	TEST_CATCH(manyKeys());
+	TEST_CATCH(decay());
+
+	return 0;
+}
@@ -0,0 +1,465 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "trace.h"
+
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <QMutex>
+#include <QCoreApplication>
+#include "tracecontext.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TRACE_HAVE_TSC
+#endif
+
+#define RING_SIZE 8192 // must be a power of two
+#define SPAN_RING_SIZE 1024 // must be a power of two
+
+namespace Trace {
+
+std::atomic<bool> g_enabled(false);
+
+namespace {
+
+class Record
+{
+public:
+	quint64 time;
+	quint32 arg;
+	quint16 event;
+	quint16 reserved;
+};
+
+class SpanRecord
+{
+public:
+	quint64 start;
+	quint64 end;
+	quint16 span;
+	quint8 traceId[TRACE_ID_SIZE];
+	quint8 spanId[TRACE_SPAN_ID_SIZE];
+	quint8 parentId[TRACE_SPAN_ID_SIZE];
+};
+
+class Ring
+{
+public:
+	int id;
+	std::atomic<quint64> pos;
+	Record records[RING_SIZE];
+	std::atomic<quint64> spanPos;
+	SpanRecord spans[SPAN_RING_SIZE];
+
+	Ring(int _id) :
+		id(_id),
+		pos(0),
+		spanPos(0)
+	{
+	}
+};
+
+class Entry
+{
+public:
+	quint64 time;
+	quint32 arg;
+	quint16 event;
+	int tid;
+	int span; // index into the copied spans, or -1 for events
+};
+
+struct Calibration
+{
+	quint64 ticks;
+	qint64 ns;
+};
+
+const char *eventNames[EventsCount] =
+{
+	"packet_in",
+	"packet_out",
+	"publish",
+	"publish",
+	"limiter_batch",
+	"timer_fire"
+};
+
+const char *spanNames[SpansCount] =
+{
+	"proxy_request",
+	"handler_accept",
+	"publish_delivery"
+};
+
+QMutex g_mutex;
+std::vector<Ring*> g_rings;
+int g_nextId = 1;
+Calibration g_base = {0, 0};
+
+qint64 steadyNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline quint64 ticks()
+{
+#ifdef TRACE_HAVE_TSC
+	return __rdtsc();
+#else
+	return (quint64)steadyNs();
+#endif
+}
+
+class RingHolder
+{
+public:
+	Ring *ring;
+
+	RingHolder() :
+		ring(0)
+	{
+	}
+
+	~RingHolder()
+	{
+		if(!ring)
+			return;
+
+		QMutexLocker locker(&g_mutex);
+
+		g_rings.erase(std::remove(g_rings.begin(), g_rings.end(), ring), g_rings.end());
+		delete ring;
+	}
+};
+
+thread_local RingHolder t_holder;
+
+Ring *createRing()
+{
+	QMutexLocker locker(&g_mutex);
+
+	Ring *r = new Ring(g_nextId++);
+	g_rings.push_back(r);
+
+	return r;
+}
+
+Ring *threadRing()
+{
+	Ring *r = t_holder.ring;
+	if(!r)
+	{
+		r = createRing();
+		t_holder.ring = r;
+	}
+
+	return r;
+}
+
+QByteArray toHex(const quint8 *data, int size)
+{
+	return QByteArray((const char *)data, size).toHex();
+}
+
+void appendChromeSpan(QByteArray *out, const Entry &e, const SpanRecord &s, double us, double durUs, qint64 pid)
+{
+	out->append("{\"name\":\"");
+	out->append(spanNames[s.span]);
+	out->append("\",\"ph\":\"X\",\"ts\":");
+	out->append(QByteArray::number(us, 'f', 3));
+	out->append(",\"dur\":");
+	out->append(QByteArray::number(durUs, 'f', 3));
+	out->append(",\"pid\":");
+	out->append(QByteArray::number(pid));
+	out->append(",\"tid\":");
+	out->append(QByteArray::number(e.tid));
+	out->append(",\"args\":{\"trace_id\":\"");
+	out->append(toHex(s.traceId, TRACE_ID_SIZE));
+	out->append("\",\"span_id\":\"");
+	out->append(toHex(s.spanId, TRACE_SPAN_ID_SIZE));
+	out->append("\",\"parent_id\":\"");
+	out->append(toHex(s.parentId, TRACE_SPAN_ID_SIZE));
+	out->append("\"}}");
+}
+
+void appendChrome(QByteArray *out, const Entry &e, double us, qint64 pid)
+{
+	const char *ph;
+	if(e.event == PublishBegin)
+		ph = "B";
+	else if(e.event == PublishEnd)
+		ph = "E";
+	else
+		ph = "i";
+
+	out->append("{\"name\":\"");
+	out->append(eventNames[e.event]);
+	out->append("\",\"ph\":\"");
+	out->append(ph);
+	out->append("\",\"ts\":");
+	out->append(QByteArray::number(us, 'f', 3));
+	out->append(",\"pid\":");
+	out->append(QByteArray::number(pid));
+	out->append(",\"tid\":");
+	out->append(QByteArray::number(e.tid));
+	if(ph[0] == 'i')
+		out->append(",\"s\":\"t\"");
+	out->append(",\"args\":{\"arg\":");
+	out->append(QByteArray::number(e.arg));
+	out->append("}}");
+}
+
+void appendPerf(QByteArray *out, const Entry &e, qint64 ns, qint64 pid)
+{
+	if(ns < 0)
+		ns = 0;
+
+	const char *suffix = "";
+	if(e.event == PublishBegin)
+		suffix = "_begin";
+	else if(e.event == PublishEnd)
+		suffix = "_end";
+
+	out->append(QByteArray("pushpin ") + QByteArray::number(pid) + '/' + QByteArray::number(e.tid) + " [000] ");
+	out->append(QByteArray::number(ns / 1000000000) + '.' + QByteArray::number((ns / 1000) % 1000000).rightJustified(6, '0'));
+	out->append(": trace:");
+	out->append(eventNames[e.event]);
+	out->append(suffix);
+	out->append(": arg=");
+	out->append(QByteArray::number(e.arg));
+	out->append('\n');
+}
+
+void appendPerfSpan(QByteArray *out, const Entry &e, const SpanRecord &s, qint64 ns, qint64 durNs, qint64 pid)
+{
+	if(ns < 0)
+		ns = 0;
+
+	out->append(QByteArray("pushpin ") + QByteArray::number(pid) + '/' + QByteArray::number(e.tid) + " [000] ");
+	out->append(QByteArray::number(ns / 1000000000) + '.' + QByteArray::number((ns / 1000) % 1000000).rightJustified(6, '0'));
+	out->append(": trace:");
+	out->append(spanNames[s.span]);
+	out->append(": trace_id=");
+	out->append(toHex(s.traceId, TRACE_ID_SIZE));
+	out->append(" span_id=");
+	out->append(toHex(s.spanId, TRACE_SPAN_ID_SIZE));
+	out->append(" parent_id=");
+	out->append(toHex(s.parentId, TRACE_SPAN_ID_SIZE));
+	out->append(" dur_us=");
+	out->append(QByteArray::number(durNs / 1000));
+	out->append('\n');
+}
+
+}
+
+void setEnabled(bool on)
+{
+	if(on)
+	{
+		QMutexLocker locker(&g_mutex);
+
+		g_base.ticks = ticks();
+		g_base.ns = steadyNs();
+	}
+
+	g_enabled.store(on, std::memory_order_relaxed);
+}
+
+void record(Event e, quint32 arg)
+{
+	Ring *r = threadRing();
+
+	// only the owning thread writes, so a relaxed load of our own position
+	// is enough. the release store publishes the record to readers
+	quint64 p = r->pos.load(std::memory_order_relaxed);
+
+	Record &rec = r->records[p & (RING_SIZE - 1)];
+	rec.time = ticks();
+	rec.arg = arg;
+	rec.event = (quint16)e;
+
+	r->pos.store(p + 1, std::memory_order_release);
+}
+
+quint64 timestamp()
+{
+	return ticks();
+}
+
+void recordSpan(Span s, const TraceContext &ctx, quint64 start)
+{
+	Ring *r = threadRing();
+
+	quint64 p = r->spanPos.load(std::memory_order_relaxed);
+
+	SpanRecord &rec = r->spans[p & (SPAN_RING_SIZE - 1)];
+	rec.start = start;
+	rec.end = ticks();
+	rec.span = (quint16)s;
+	memcpy(rec.traceId, ctx.traceId(), TRACE_ID_SIZE);
+	memcpy(rec.spanId, ctx.spanId(), TRACE_SPAN_ID_SIZE);
+	memcpy(rec.parentId, ctx.parentId(), TRACE_SPAN_ID_SIZE);
+
+	r->spanPos.store(p + 1, std::memory_order_release);
+}
+
+QByteArray dump(Format format)
+{
+	std::vector<Entry> entries;
+	std::vector<SpanRecord> spans;
+	Calibration base;
+
+	{
+		QMutexLocker locker(&g_mutex);
+
+		base = g_base;
+
+		std::vector<Record> copy(RING_SIZE);
+
+		for(Ring *r : g_rings)
+		{
+			quint64 end = r->pos.load(std::memory_order_acquire);
+			quint64 copyStart = end > RING_SIZE ? end - RING_SIZE : 0;
+
+			for(quint64 n = copyStart; n < end; ++n)
+				copy[n - copyStart] = r->records[n & (RING_SIZE - 1)];
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+
+			// anything the writer lapped while we were copying is suspect
+			quint64 after = r->pos.load(std::memory_order_relaxed);
+			quint64 start = copyStart;
+			if(after > RING_SIZE && after - RING_SIZE > start)
+				start = after - RING_SIZE;
+
+			for(quint64 n = start; n < end; ++n)
+			{
+				const Record &rec = copy[n - copyStart];
+				if(rec.event >= EventsCount)
+					continue;
+
+				Entry e;
+				e.time = rec.time;
+				e.arg = rec.arg;
+				e.event = rec.event;
+				e.tid = r->id;
+				e.span = -1;
+				entries.push_back(e);
+			}
+
+			// spans are copied the same way
+			std::vector<SpanRecord> spanCopy;
+
+			end = r->spanPos.load(std::memory_order_acquire);
+			copyStart = end > SPAN_RING_SIZE ? end - SPAN_RING_SIZE : 0;
+
+			spanCopy.reserve(end - copyStart);
+			for(quint64 n = copyStart; n < end; ++n)
+				spanCopy.push_back(r->spans[n & (SPAN_RING_SIZE - 1)]);
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+
+			after = r->spanPos.load(std::memory_order_relaxed);
+			start = copyStart;
+			if(after > SPAN_RING_SIZE && after - SPAN_RING_SIZE > start)
+				start = after - SPAN_RING_SIZE;
+
+			for(quint64 n = start; n < end; ++n)
+			{
+				const SpanRecord &rec = spanCopy[n - copyStart];
+				if(rec.span >= SpansCount)
+					continue;
+
+				Entry e;
+				e.time = rec.start;
+				e.arg = 0;
+				e.event = 0;
+				e.tid = r->id;
+				e.span = (int)spans.size();
+				entries.push_back(e);
+
+				spans.push_back(rec);
+			}
+		}
+	}
+
+	std::stable_sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+		return a.time < b.time;
+	});
+
+	// convert ticks to nanoseconds using the rate observed since tracing
+	// was enabled
+	quint64 nowTicks = ticks();
+	qint64 nowNs = steadyNs();
+
+	double nsPerTick = 1.0;
+	if(nowTicks > base.ticks && nowNs > base.ns)
+		nsPerTick = (double)(nowNs - base.ns) / (double)(nowTicks - base.ticks);
+
+	qint64 pid = QCoreApplication::applicationPid();
+
+	QByteArray out;
+
+	if(format == ChromeFormat)
+		out += "{\"traceEvents\":[";
+
+	bool first = true;
+	for(const Entry &e : entries)
+	{
+		qint64 ns = base.ns + (qint64)(((double)e.time - (double)base.ticks) * nsPerTick);
+
+		if(format == ChromeFormat && !first)
+			out += ',';
+
+		if(e.span >= 0)
+		{
+			const SpanRecord &s = spans[e.span];
+			qint64 durNs = s.end > s.start ? (qint64)((double)(s.end - s.start) * nsPerTick) : 0;
+
+			if(format == ChromeFormat)
+				appendChromeSpan(&out, e, s, (double)ns / 1000.0, (double)durNs / 1000.0, pid);
+			else
+				appendPerfSpan(&out, e, s, ns, durNs, pid);
+		}
+		else if(format == ChromeFormat)
+		{
+			appendChrome(&out, e, (double)ns / 1000.0, pid);
+		}
+		else
+		{
+			appendPerf(&out, e, ns, pid);
+		}
+
+		first = false;
+	}
+
+	if(format == ChromeFormat)
+		out += "]}";
+
+	return out;
+}
+
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <QByteArray>
+
+// lightweight event tracing for hot paths. events are recorded into a fixed
+// size ring owned by the calling thread, so recording takes no locks and
+// doesn't allocate. old events are overwritten once a ring is full. the
+// rings of all threads can be dumped on demand. spans of sampled
+// distributed traces are kept in a separate ring per thread, along with
+// their trace context, so that they can be joined with those of other
+// processes
+
+class TraceContext;
+
+namespace Trace {
+
+enum Event
+{
+	PacketIn,
+	PacketOut,
+	PublishBegin,
+	PublishEnd,
+	LimiterBatch,
+	TimerFire,
+	EventsCount
+};
+
+enum Span
+{
+	ProxyRequest,
+	HandlerAccept,
+	PublishDelivery,
+	SpansCount
+};
+
+enum Format
+{
+	ChromeFormat,
+	PerfFormat
+};
+
+extern std::atomic<bool> g_enabled;
+
+inline bool enabled()
+{
+	return g_enabled.load(std::memory_order_relaxed);
+}
+
+void setEnabled(bool on);
+
+// call via TRACE_EVENT so the enabled check is inlined
+void record(Event e, quint32 arg);
+
+// returns the current time in the units spans are recorded in
+quint64 timestamp();
+
+// records a span that began at start (as returned by timestamp()) and ends
+// now. ctx is the span's own context. call via TRACE_SPAN
+void recordSpan(Span s, const TraceContext &ctx, quint64 start);
+
+// safe to call while other threads are recording. events that may have been
+// overwritten during the copy are skipped
+QByteArray dump(Format format);
+
+}
+
+#define TRACE_EVENT(e, arg) \
+	do { \
+		if(Trace::enabled()) \
+			Trace::record(Trace::e, (quint32)(arg)); \
+	} while(0)
+
+#define TRACE_SPAN(s, ctx, start) \
+	do { \
+		if(Trace::enabled() && (ctx).isSampled()) \
+			Trace::recordSpan(Trace::s, (ctx), (start)); \
+	} while(0)
+
+#endif
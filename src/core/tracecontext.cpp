@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "tracecontext.h"
+
+#include <string.h>
+#include <QRandomGenerator>
+
+static bool isZero(const quint8 *p, int size)
+{
+	for(int n = 0; n < size; ++n)
+	{
+		if(p[n] != 0)
+			return false;
+	}
+
+	return true;
+}
+
+static int hexValue(char c)
+{
+	if(c >= '0' && c <= '9')
+		return c - '0';
+	else if(c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	else
+		return -1; // uppercase is not allowed
+}
+
+static bool parseHex(const char *in, quint8 *out, int size)
+{
+	for(int n = 0; n < size; ++n)
+	{
+		int hi = hexValue(in[n * 2]);
+		int lo = hexValue(in[n * 2 + 1]);
+		if(hi < 0 || lo < 0)
+			return false;
+
+		out[n] = (quint8)((hi << 4) | lo);
+	}
+
+	return true;
+}
+
+static void appendHex(QByteArray *out, const quint8 *in, int size)
+{
+	static const char digits[] = "0123456789abcdef";
+
+	for(int n = 0; n < size; ++n)
+	{
+		out->append(digits[in[n] >> 4]);
+		out->append(digits[in[n] & 0x0f]);
+	}
+}
+
+static void generateId(quint8 *out, int size)
+{
+	quint32 buf[TRACE_ID_SIZE / 4];
+
+	// ids must not be all zeros
+	do
+	{
+		QRandomGenerator::global()->fillRange(buf, size / 4);
+		memcpy(out, buf, size);
+	} while(isZero(out, size));
+}
+
+TraceContext::TraceContext() :
+	valid_(false),
+	flags_(0)
+{
+	memset(traceId_, 0, TRACE_ID_SIZE);
+	memset(spanId_, 0, TRACE_SPAN_ID_SIZE);
+	memset(parentId_, 0, TRACE_SPAN_ID_SIZE);
+}
+
+TraceContext TraceContext::createChild() const
+{
+	if(!valid_)
+		return TraceContext();
+
+	TraceContext c = *this;
+	memcpy(c.parentId_, spanId_, TRACE_SPAN_ID_SIZE);
+	generateId(c.spanId_, TRACE_SPAN_ID_SIZE);
+
+	return c;
+}
+
+QByteArray TraceContext::toHeader() const
+{
+	if(!valid_)
+		return QByteArray();
+
+	QByteArray out;
+	out.reserve(55);
+
+	out += "00-";
+	appendHex(&out, traceId_, TRACE_ID_SIZE);
+	out += '-';
+	appendHex(&out, spanId_, TRACE_SPAN_ID_SIZE);
+	out += '-';
+	appendHex(&out, &flags_, 1);
+
+	return out;
+}
+
+TraceContext TraceContext::fromHeader(const QByteArray &value)
+{
+	// version-traceid-spanid-flags, with future versions possibly
+	// appending more fields
+	if(value.size() < 55)
+		return TraceContext();
+
+	const char *p = value.constData();
+
+	if(p[2] != '-' || p[35] != '-' || p[52] != '-')
+		return TraceContext();
+
+	quint8 version;
+	if(!parseHex(p, &version, 1) || version == 0xff)
+		return TraceContext();
+
+	if(version == 0 && value.size() != 55)
+		return TraceContext();
+
+	if(value.size() > 55 && p[55] != '-')
+		return TraceContext();
+
+	TraceContext c;
+
+	if(!parseHex(p + 3, c.traceId_, TRACE_ID_SIZE) || !parseHex(p + 36, c.spanId_, TRACE_SPAN_ID_SIZE) || !parseHex(p + 53, &c.flags_, 1))
+		return TraceContext();
+
+	if(isZero(c.traceId_, TRACE_ID_SIZE) || isZero(c.spanId_, TRACE_SPAN_ID_SIZE))
+		return TraceContext();
+
+	c.valid_ = true;
+
+	return c;
+}
+
+TraceContext TraceContext::createRoot(bool sampled)
+{
+	TraceContext c;
+	generateId(c.traceId_, TRACE_ID_SIZE);
+	generateId(c.spanId_, TRACE_SPAN_ID_SIZE);
+	c.flags_ = sampled ? 0x01 : 0x00;
+	c.valid_ = true;
+
+	return c;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef TRACECONTEXT_H
+#define TRACECONTEXT_H
+
+#include <QByteArray>
+
+#define TRACE_ID_SIZE 16
+#define TRACE_SPAN_ID_SIZE 8
+
+// a position within a distributed trace, as carried by the w3c traceparent
+// header. the span id identifies the current span, and the parent id the
+// span it was created from (all zeros for the first span seen locally)
+class TraceContext
+{
+public:
+	TraceContext();
+
+	bool isValid() const { return valid_; }
+	bool isSampled() const { return (flags_ & 0x01) != 0; }
+
+	const quint8 *traceId() const { return traceId_; }
+	const quint8 *spanId() const { return spanId_; }
+	const quint8 *parentId() const { return parentId_; }
+
+	// returns a context for a new span in the same trace, whose parent is
+	// this context's span
+	TraceContext createChild() const;
+
+	QByteArray toHeader() const;
+
+	// returns an invalid context if the value is malformed. unknown
+	// versions are accepted as long as the version 00 fields parse
+	static TraceContext fromHeader(const QByteArray &value);
+
+	// starts a new trace
+	static TraceContext createRoot(bool sampled);
+
+private:
+	bool valid_;
+	quint8 flags_;
+	quint8 traceId_[TRACE_ID_SIZE];
+	quint8 spanId_[TRACE_SPAN_ID_SIZE];
+	quint8 parentId_[TRACE_SPAN_ID_SIZE];
+};
+
+#endif
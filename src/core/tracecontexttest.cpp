@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include <string.h>
+#include "test.h"
+#include "tracecontext.h"
+
+static void parse()
+{
+	TraceContext c = TraceContext::fromHeader("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01");
+	TEST_ASSERT(c.isValid());
+	TEST_ASSERT(c.isSampled());
+	TEST_ASSERT_EQ(c.traceId()[0], 0x4b);
+	TEST_ASSERT_EQ(c.spanId()[7], 0xb7);
+	TEST_ASSERT_EQ(c.toHeader(), QByteArray("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01"));
+
+	c = TraceContext::fromHeader("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-00");
+	TEST_ASSERT(c.isValid());
+	TEST_ASSERT(!c.isSampled());
+
+	// future versions may append fields
+	c = TraceContext::fromHeader("01-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01-extra");
+	TEST_ASSERT(c.isValid());
+	TEST_ASSERT_EQ(c.toHeader(), QByteArray("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01"));
+
+	// version 00 must be exact
+	TEST_ASSERT(!TraceContext::fromHeader("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01-extra").isValid());
+
+	// invalid version
+	TEST_ASSERT(!TraceContext::fromHeader("ff-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01").isValid());
+
+	// uppercase
+	TEST_ASSERT(!TraceContext::fromHeader("00-4BF92F3577B34DA6A3CE929D0E0E4736-00f067aa0ba902b7-01").isValid());
+
+	// zero ids
+	TEST_ASSERT(!TraceContext::fromHeader("00-00000000000000000000000000000000-00f067aa0ba902b7-01").isValid());
+	TEST_ASSERT(!TraceContext::fromHeader("00-4bf92f3577b34da6a3ce929d0e0e4736-0000000000000000-01").isValid());
+
+	TEST_ASSERT(!TraceContext::fromHeader("").isValid());
+	TEST_ASSERT(!TraceContext::fromHeader("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7").isValid());
+
+	TEST_ASSERT(TraceContext().toHeader().isEmpty());
+}
+
+static void child()
+{
+	TraceContext parent = TraceContext::fromHeader("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01");
+
+	TraceContext c = parent.createChild();
+	TEST_ASSERT(c.isValid());
+	TEST_ASSERT(c.isSampled());
+
+	QByteArray h = c.toHeader();
+	TEST_ASSERT_EQ(h.size(), 55);
+	TEST_ASSERT(h.startsWith("00-4bf92f3577b34da6a3ce929d0e0e4736-"));
+	TEST_ASSERT(h != parent.toHeader());
+	TEST_ASSERT(memcmp(c.parentId(), parent.spanId(), TRACE_SPAN_ID_SIZE) == 0);
+
+	TEST_ASSERT(!TraceContext().createChild().isValid());
+
+	TraceContext r = TraceContext::createRoot(false);
+	TEST_ASSERT(r.isValid());
+	TEST_ASSERT(!r.isSampled());
+	TEST_ASSERT(TraceContext::fromHeader(r.toHeader()).isValid());
+}
+
+extern "C" int tracecontext_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(parse());
+	TEST_CATCH(child());
+
+	return 0;
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "test.h"
+#include "trace.h"
+#include "tracecontext.h"
+
+static void recordDump()
+{
+	Trace::setEnabled(true);
+
+	TRACE_EVENT(PublishBegin, 0);
+	TRACE_EVENT(PacketOut, 123);
+	TRACE_EVENT(PublishEnd, 4);
+
+	Trace::setEnabled(false);
+
+	// ignored while disabled
+	TRACE_EVENT(LimiterBatch, 7);
+
+	QByteArray chrome = Trace::dump(Trace::ChromeFormat);
+	TEST_ASSERT(chrome.startsWith("{\"traceEvents\":["));
+	TEST_ASSERT(chrome.endsWith("]}"));
+	TEST_ASSERT(chrome.contains("\"name\":\"publish\",\"ph\":\"B\""));
+	TEST_ASSERT(chrome.contains("\"name\":\"publish\",\"ph\":\"E\""));
+	TEST_ASSERT(chrome.contains("\"name\":\"packet_out\",\"ph\":\"i\""));
+	TEST_ASSERT(chrome.contains("\"args\":{\"arg\":123}"));
+	TEST_ASSERT(!chrome.contains("limiter_batch"));
+
+	QByteArray perf = Trace::dump(Trace::PerfFormat);
+	QList<QByteArray> lines = perf.split('\n');
+	TEST_ASSERT(lines.count() >= 4);
+	TEST_ASSERT(lines[lines.count() - 4].endsWith("trace:publish_begin: arg=0"));
+	TEST_ASSERT(lines[lines.count() - 3].endsWith("trace:packet_out: arg=123"));
+	TEST_ASSERT(lines[lines.count() - 2].endsWith("trace:publish_end: arg=4"));
+}
+
+static void wrap()
+{
+	Trace::setEnabled(true);
+
+	for(int n = 0; n < 20000; ++n)
+		TRACE_EVENT(TimerFire, n);
+
+	Trace::setEnabled(false);
+
+	QByteArray perf = Trace::dump(Trace::PerfFormat);
+
+	// only the most recent events are kept
+	TEST_ASSERT(perf.count("trace:timer_fire:") < 20000);
+	TEST_ASSERT(perf.contains("trace:timer_fire: arg=19999\n"));
+	TEST_ASSERT(!perf.contains("trace:timer_fire: arg=0\n"));
+}
+
+static void spans()
+{
+	TraceContext sampled = TraceContext::fromHeader("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01").createChild();
+	TraceContext unsampled = TraceContext::fromHeader("00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-00").createChild();
+
+	Trace::setEnabled(true);
+
+	quint64 start = Trace::timestamp();
+	TRACE_SPAN(ProxyRequest, sampled, start);
+	TRACE_SPAN(HandlerAccept, unsampled, start);
+
+	Trace::setEnabled(false);
+
+	// ignored while disabled
+	TRACE_SPAN(PublishDelivery, sampled, start);
+
+	QByteArray chrome = Trace::dump(Trace::ChromeFormat);
+	TEST_ASSERT(chrome.contains("\"name\":\"proxy_request\",\"ph\":\"X\""));
+	TEST_ASSERT(chrome.contains("\"trace_id\":\"4bf92f3577b34da6a3ce929d0e0e4736\""));
+	TEST_ASSERT(chrome.contains("\"parent_id\":\"00f067aa0ba902b7\""));
+	TEST_ASSERT(!chrome.contains("handler_accept"));
+	TEST_ASSERT(!chrome.contains("publish_delivery"));
+
+	QByteArray perf = Trace::dump(Trace::PerfFormat);
+	TEST_ASSERT(perf.contains("trace:proxy_request: trace_id=4bf92f3577b34da6a3ce929d0e0e4736 span_id="));
+	TEST_ASSERT(perf.contains(" parent_id=00f067aa0ba902b7 dur_us="));
+}
+
+extern "C" int trace_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(recordDump());
+	TEST_CATCH(wrap());
+	TEST_CATCH(spans());
+
+	return 0;
+}
@@ -0,0 +1,771 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// minimal io_uring support, used as a readiness backend. file descriptors
+// are watched with multishot poll requests, and changes to registrations are
+// queued in the submission ring and submitted together with the next wait,
+// rather than costing a syscall each
+
+use mio::{Interest, Token};
+use slab::Slab;
+use std::cell::{Cell, RefCell};
+use std::collections::HashMap;
+use std::io;
+use std::mem;
+use std::os::unix::io::RawFd;
+use std::ptr;
+use std::sync::atomic::{AtomicU32, Ordering};
+use std::time::Duration;
+
+const IORING_OFF_SQ_RING: libc::off_t = 0;
+const IORING_OFF_SQES: libc::off_t = 0x10000000;
+
+const IORING_OP_POLL_ADD: u8 = 6;
+const IORING_OP_POLL_REMOVE: u8 = 7;
+
+const IORING_POLL_ADD_MULTI: u32 = 1 << 0;
+const IORING_CQE_F_MORE: u32 = 1 << 1;
+
+const IORING_ENTER_GETEVENTS: u32 = 1 << 0;
+const IORING_ENTER_EXT_ARG: u32 = 1 << 3;
+
+const IORING_FEAT_SINGLE_MMAP: u32 = 1 << 0;
+const IORING_FEAT_EXT_ARG: u32 = 1 << 8;
+
+// introduced in the same kernel release as multishot poll (5.13), which has
+// no feature flag of its own
+const IORING_FEAT_RSRC_TAGS: u32 = 1 << 10;
+
+const REQUIRED_FEATURES: u32 =
+    IORING_FEAT_SINGLE_MMAP | IORING_FEAT_EXT_ARG | IORING_FEAT_RSRC_TAGS;
+
+#[repr(C)]
+#[derive(Default)]
+struct SqringOffsets {
+    head: u32,
+    tail: u32,
+    ring_mask: u32,
+    ring_entries: u32,
+    flags: u32,
+    dropped: u32,
+    array: u32,
+    resv1: u32,
+    user_addr: u64,
+}
+
+#[repr(C)]
+#[derive(Default)]
+struct CqringOffsets {
+    head: u32,
+    tail: u32,
+    ring_mask: u32,
+    ring_entries: u32,
+    overflow: u32,
+    cqes: u32,
+    flags: u32,
+    resv1: u32,
+    user_addr: u64,
+}
+
+#[repr(C)]
+#[derive(Default)]
+struct Params {
+    sq_entries: u32,
+    cq_entries: u32,
+    flags: u32,
+    sq_thread_cpu: u32,
+    sq_thread_idle: u32,
+    features: u32,
+    wq_fd: u32,
+    resv: [u32; 3],
+    sq_off: SqringOffsets,
+    cq_off: CqringOffsets,
+}
+
+#[repr(C)]
+#[derive(Default)]
+struct Sqe {
+    opcode: u8,
+    flags: u8,
+    ioprio: u16,
+    fd: i32,
+    off: u64,
+    addr: u64,
+    len: u32,
+    op_flags: u32,
+    user_data: u64,
+    buf_index: u16,
+    personality: u16,
+    file_index: i32,
+    addr3: u64,
+    pad: u64,
+}
+
+#[repr(C)]
+#[derive(Clone, Copy)]
+struct Cqe {
+    user_data: u64,
+    res: i32,
+    flags: u32,
+}
+
+#[repr(C)]
+struct GeteventsArg {
+    sigmask: u64,
+    sigmask_sz: u32,
+    pad: u32,
+    ts: u64,
+}
+
+struct Ring {
+    fd: RawFd,
+    ring_ptr: *mut libc::c_void,
+    ring_len: usize,
+    sqes_ptr: *mut libc::c_void,
+    sqes_len: usize,
+    sq_head: *const AtomicU32,
+    sq_tail: *const AtomicU32,
+    sq_mask: u32,
+    sq_entries: u32,
+    sq_array: *mut u32,
+    cq_head: *const AtomicU32,
+    cq_tail: *const AtomicU32,
+    cq_mask: u32,
+    cqes: *const Cqe,
+}
+
+impl Ring {
+    fn new(entries: u32) -> Result<Self, io::Error> {
+        let mut p = Params::default();
+
+        // SAFETY: p is a valid io_uring_params struct
+        let ret =
+            unsafe { libc::syscall(libc::SYS_io_uring_setup, entries, &mut p as *mut Params) };
+        if ret < 0 {
+            return Err(io::Error::last_os_error());
+        }
+
+        let fd = ret as RawFd;
+
+        if p.features & REQUIRED_FEATURES != REQUIRED_FEATURES {
+            // SAFETY: fd was returned by io_uring_setup
+            unsafe { libc::close(fd) };
+
+            return Err(io::Error::from(io::ErrorKind::Unsupported));
+        }
+
+        let sq_len = p.sq_off.array as usize + p.sq_entries as usize * mem::size_of::<u32>();
+        let cq_len = p.cq_off.cqes as usize + p.cq_entries as usize * mem::size_of::<Cqe>();
+        let ring_len = sq_len.max(cq_len);
+        let sqes_len = p.sq_entries as usize * mem::size_of::<Sqe>();
+
+        // SAFETY: mapping the rings of the fd we own, as documented
+        let ring_ptr = unsafe {
+            libc::mmap(
+                ptr::null_mut(),
+                ring_len,
+                libc::PROT_READ | libc::PROT_WRITE,
+                libc::MAP_SHARED | libc::MAP_POPULATE,
+                fd,
+                IORING_OFF_SQ_RING,
+            )
+        };
+
+        if ring_ptr == libc::MAP_FAILED {
+            let e = io::Error::last_os_error();
+
+            // SAFETY: fd was returned by io_uring_setup
+            unsafe { libc::close(fd) };
+
+            return Err(e);
+        }
+
+        // SAFETY: as above
+        let sqes_ptr = unsafe {
+            libc::mmap(
+                ptr::null_mut(),
+                sqes_len,
+                libc::PROT_READ | libc::PROT_WRITE,
+                libc::MAP_SHARED | libc::MAP_POPULATE,
+                fd,
+                IORING_OFF_SQES,
+            )
+        };
+
+        if sqes_ptr == libc::MAP_FAILED {
+            let e = io::Error::last_os_error();
+
+            // SAFETY: ring_ptr was mapped above, and fd was returned by
+            // io_uring_setup
+            unsafe {
+                libc::munmap(ring_ptr, ring_len);
+                libc::close(fd);
+            }
+
+            return Err(e);
+        }
+
+        let base = ring_ptr as *mut u8;
+
+        // SAFETY: the offsets provided by the kernel are within the mapping
+        unsafe {
+            Ok(Self {
+                fd,
+                ring_ptr,
+                ring_len,
+                sqes_ptr,
+                sqes_len,
+                sq_head: base.add(p.sq_off.head as usize) as *const AtomicU32,
+                sq_tail: base.add(p.sq_off.tail as usize) as *const AtomicU32,
+                sq_mask: *(base.add(p.sq_off.ring_mask as usize) as *const u32),
+                sq_entries: p.sq_entries,
+                sq_array: base.add(p.sq_off.array as usize) as *mut u32,
+                cq_head: base.add(p.cq_off.head as usize) as *const AtomicU32,
+                cq_tail: base.add(p.cq_off.tail as usize) as *const AtomicU32,
+                cq_mask: *(base.add(p.cq_off.ring_mask as usize) as *const u32),
+                cqes: base.add(p.cq_off.cqes as usize) as *const Cqe,
+            })
+        }
+    }
+
+    fn sq_head(&self) -> &AtomicU32 {
+        // SAFETY: points into the mapping, which lives as long as self
+        unsafe { &*self.sq_head }
+    }
+
+    fn sq_tail(&self) -> &AtomicU32 {
+        // SAFETY: as above
+        unsafe { &*self.sq_tail }
+    }
+
+    fn cq_head(&self) -> &AtomicU32 {
+        // SAFETY: as above
+        unsafe { &*self.cq_head }
+    }
+
+    fn cq_tail(&self) -> &AtomicU32 {
+        // SAFETY: as above
+        unsafe { &*self.cq_tail }
+    }
+
+    fn pending_submit(&self) -> u32 {
+        let head = self.sq_head().load(Ordering::Acquire);
+        let tail = self.sq_tail().load(Ordering::Relaxed);
+
+        tail.wrapping_sub(head)
+    }
+
+    fn has_completions(&self) -> bool {
+        self.cq_tail().load(Ordering::Acquire) != self.cq_head().load(Ordering::Relaxed)
+    }
+
+    fn push(&mut self, sqe: Sqe) -> Result<(), io::Error> {
+        while self.pending_submit() >= self.sq_entries {
+            // ring is full. submit what we have without waiting
+            self.enter(self.pending_submit(), 0, 0, None)?;
+        }
+
+        let tail = self.sq_tail().load(Ordering::Relaxed);
+        let index = tail & self.sq_mask;
+
+        // SAFETY: index is within the rings, and the kernel does not read
+        // the entry until the tail is advanced
+        unsafe {
+            ptr::write((self.sqes_ptr as *mut Sqe).add(index as usize), sqe);
+            ptr::write(self.sq_array.add(index as usize), index);
+        }
+
+        self.sq_tail()
+            .store(tail.wrapping_add(1), Ordering::Release);
+
+        Ok(())
+    }
+
+    fn enter(
+        &self,
+        to_submit: u32,
+        min_complete: u32,
+        flags: u32,
+        arg: Option<&GeteventsArg>,
+    ) -> Result<(), io::Error> {
+        let (arg_ptr, arg_size) = match arg {
+            Some(arg) => (
+                arg as *const GeteventsArg as *const libc::c_void,
+                mem::size_of::<GeteventsArg>(),
+            ),
+            None => (ptr::null(), 0),
+        };
+
+        // SAFETY: fd is our ring, and arg, if any, is valid for the call
+        let ret = unsafe {
+            libc::syscall(
+                libc::SYS_io_uring_enter,
+                self.fd,
+                to_submit,
+                min_complete,
+                flags,
+                arg_ptr,
+                arg_size,
+            )
+        };
+
+        if ret < 0 {
+            let e = io::Error::last_os_error();
+
+            // timing out or being interrupted is a normal wakeup, and busy
+            // means completions need to be reaped first
+            return match e.raw_os_error() {
+                Some(libc::ETIME) | Some(libc::EINTR) | Some(libc::EBUSY) | Some(libc::EAGAIN) => {
+                    Ok(())
+                }
+                _ => Err(e),
+            };
+        }
+
+        Ok(())
+    }
+
+    // submit any queued entries, and wait for at least one completion
+    fn wait(&self, timeout: Option<Duration>) -> Result<(), io::Error> {
+        let to_submit = self.pending_submit();
+
+        if self.has_completions() || timeout == Some(Duration::from_millis(0)) {
+            if to_submit > 0 {
+                self.enter(to_submit, 0, 0, None)?;
+            }
+
+            return Ok(());
+        }
+
+        match timeout {
+            Some(timeout) => {
+                let ts = libc::timespec {
+                    tv_sec: timeout.as_secs() as libc::time_t,
+                    tv_nsec: timeout.subsec_nanos() as libc::c_long,
+                };
+
+                let arg = GeteventsArg {
+                    sigmask: 0,
+                    sigmask_sz: 0,
+                    pad: 0,
+                    ts: &ts as *const libc::timespec as u64,
+                };
+
+                self.enter(
+                    to_submit,
+                    1,
+                    IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                    Some(&arg),
+                )
+            }
+            None => self.enter(to_submit, 1, IORING_ENTER_GETEVENTS, None),
+        }
+    }
+
+    fn reap(&self, out: &mut Vec<Cqe>) {
+        let mut head = self.cq_head().load(Ordering::Relaxed);
+        let tail = self.cq_tail().load(Ordering::Acquire);
+
+        while head != tail {
+            // SAFETY: entries between head and tail are written by the kernel
+            // and stay valid until head is advanced
+            out.push(unsafe { *self.cqes.add((head & self.cq_mask) as usize) });
+
+            head = head.wrapping_add(1);
+        }
+
+        self.cq_head().store(head, Ordering::Release);
+    }
+}
+
+impl Drop for Ring {
+    fn drop(&mut self) {
+        // SAFETY: the mappings and fd are owned by self
+        unsafe {
+            libc::munmap(self.sqes_ptr, self.sqes_len);
+            libc::munmap(self.ring_ptr, self.ring_len);
+            libc::close(self.fd);
+        }
+    }
+}
+
+// user data values not belonging to a registration
+const USER_DATA_INNER: u64 = 0;
+const USER_DATA_REMOVE: u64 = u64::MAX;
+
+fn poll_mask(interest: Interest) -> u32 {
+    let mut mask = 0;
+
+    if interest.is_readable() {
+        mask |= (libc::POLLIN | libc::POLLPRI | libc::POLLRDHUP) as u32;
+    }
+
+    if interest.is_writable() {
+        mask |= libc::POLLOUT as u32;
+    }
+
+    mask
+}
+
+// errors and hangups are reported as whatever the registration is
+// interested in, so the owner attempts I/O and finds out
+fn readiness_from_mask(mask: u32, interest: Interest) -> Option<Interest> {
+    let failed = mask & (libc::POLLERR | libc::POLLHUP) as u32 != 0;
+
+    let readable = interest.is_readable()
+        && (failed || mask & (libc::POLLIN | libc::POLLPRI | libc::POLLRDHUP) as u32 != 0);
+
+    let writable = interest.is_writable() && (failed || mask & libc::POLLOUT as u32 != 0);
+
+    match (readable, writable) {
+        (true, true) => Some(Interest::READABLE | Interest::WRITABLE),
+        (true, false) => Some(Interest::READABLE),
+        (false, true) => Some(Interest::WRITABLE),
+        (false, false) => None,
+    }
+}
+
+fn poll_add(fd: RawFd, mask: u32, user_data: u64) -> Sqe {
+    Sqe {
+        opcode: IORING_OP_POLL_ADD,
+        fd,
+        len: IORING_POLL_ADD_MULTI,
+        op_flags: mask,
+        user_data,
+        ..Default::default()
+    }
+}
+
+fn poll_remove(target: u64) -> Sqe {
+    Sqe {
+        opcode: IORING_OP_POLL_REMOVE,
+        fd: -1,
+        addr: target,
+        user_data: USER_DATA_REMOVE,
+        ..Default::default()
+    }
+}
+
+struct FdEntry {
+    fd: RawFd,
+    token: Token,
+    interest: Interest,
+    generation: u32,
+    armed: bool,
+}
+
+impl FdEntry {
+    fn user_data(&self, key: usize) -> u64 {
+        ((self.generation as u64) << 32) | (key as u64 + 1)
+    }
+}
+
+// watches file descriptors using io_uring, plus one inner descriptor (the
+// epoll instance used for everything else) whose readiness is reported
+// separately
+pub struct UringPoller {
+    ring: RefCell<Ring>,
+    fds: RefCell<Slab<FdEntry>>,
+    keys: RefCell<HashMap<RawFd, usize>>,
+    next_generation: Cell<u32>,
+    inner_fd: RawFd,
+    inner_armed: bool,
+    inner_ready: bool,
+    rearm: Vec<(usize, u32)>,
+    completions: Vec<Cqe>,
+    events: Vec<(Token, Interest)>,
+}
+
+impl UringPoller {
+    pub fn new(entries: u32, inner_fd: RawFd) -> Result<Self, io::Error> {
+        let ring = Ring::new(entries)?;
+
+        Ok(Self {
+            ring: RefCell::new(ring),
+            fds: RefCell::new(Slab::new()),
+            keys: RefCell::new(HashMap::new()),
+            next_generation: Cell::new(0),
+            inner_fd,
+            inner_armed: false,
+            inner_ready: false,
+            rearm: Vec::new(),
+            completions: Vec::new(),
+            events: Vec::new(),
+        })
+    }
+
+    pub fn register(&self, fd: RawFd, token: Token, interest: Interest) -> Result<(), io::Error> {
+        let keys = &mut *self.keys.borrow_mut();
+
+        if keys.contains_key(&fd) {
+            return Err(io::Error::from(io::ErrorKind::AlreadyExists));
+        }
+
+        let fds = &mut *self.fds.borrow_mut();
+
+        let generation = self.next_generation.get();
+        self.next_generation.set(generation.wrapping_add(1));
+
+        let entry = fds.vacant_entry();
+        let key = entry.key();
+
+        let e = entry.insert(FdEntry {
+            fd,
+            token,
+            interest,
+            generation,
+            armed: true,
+        });
+
+        if let Err(e) =
+            self.ring
+                .borrow_mut()
+                .push(poll_add(fd, poll_mask(interest), e.user_data(key)))
+        {
+            fds.remove(key);
+
+            return Err(e);
+        }
+
+        keys.insert(fd, key);
+
+        Ok(())
+    }
+
+    pub fn deregister(&self, fd: RawFd) -> Result<(), io::Error> {
+        let key = match self.keys.borrow_mut().remove(&fd) {
+            Some(key) => key,
+            None => return Err(io::Error::from(io::ErrorKind::NotFound)),
+        };
+
+        let e = self.fds.borrow_mut().remove(key);
+
+        // any completions still on their way won't match the generation
+        if e.armed {
+            self.ring.borrow_mut().push(poll_remove(e.user_data(key)))?;
+        }
+
+        Ok(())
+    }
+
+    // returns true if the inner descriptor became readable
+    pub fn poll(&mut self, timeout: Option<Duration>) -> Result<bool, io::Error> {
+        let ring = self.ring.get_mut();
+        let fds = self.fds.get_mut();
+
+        // multishot requests can be ended by the kernel, e.g. if the
+        // completion ring overflows
+        for (key, generation) in self.rearm.drain(..) {
+            if let Some(e) = fds.get_mut(key) {
+                if e.generation == generation && !e.armed {
+                    ring.push(poll_add(e.fd, poll_mask(e.interest), e.user_data(key)))?;
+                    e.armed = true;
+                }
+            }
+        }
+
+        if !self.inner_armed {
+            ring.push(poll_add(
+                self.inner_fd,
+                poll_mask(Interest::READABLE),
+                USER_DATA_INNER,
+            ))?;
+
+            self.inner_armed = true;
+        }
+
+        // the inner descriptor may still have events from last time
+        let timeout = if self.inner_ready {
+            Some(Duration::from_millis(0))
+        } else {
+            timeout
+        };
+
+        ring.wait(timeout)?;
+
+        self.events.clear();
+        self.completions.clear();
+        ring.reap(&mut self.completions);
+
+        for c in self.completions.iter() {
+            if c.user_data == USER_DATA_REMOVE {
+                continue;
+            }
+
+            let more = c.flags & IORING_CQE_F_MORE != 0;
+
+            if c.user_data == USER_DATA_INNER {
+                if !more {
+                    self.inner_armed = false;
+                }
+
+                if c.res > 0 {
+                    self.inner_ready = true;
+                }
+
+                continue;
+            }
+
+            let key = ((c.user_data & 0xffffffff) - 1) as usize;
+            let generation = (c.user_data >> 32) as u32;
+
+            let e = match fds.get_mut(key) {
+                Some(e) if e.generation == generation => e,
+                _ => continue, // stale
+            };
+
+            if c.res < 0 {
+                // the request failed. let the owner find out, and don't
+                // retry
+                e.armed = false;
+
+                self.events
+                    .push((e.token, Interest::READABLE | Interest::WRITABLE));
+
+                continue;
+            }
+
+            if !more {
+                e.armed = false;
+                self.rearm.push((key, generation));
+            }
+
+            if let Some(readiness) = readiness_from_mask(c.res as u32, e.interest) {
+                self.events.push((e.token, readiness));
+            }
+        }
+
+        Ok(self.inner_ready)
+    }
+
+    // called once the inner descriptor has been read. set more if it may
+    // still have events
+    pub fn set_inner_drained(&mut self, more: bool) {
+        self.inner_ready = more;
+    }
+
+    pub fn clear_events(&mut self) {
+        self.events.clear();
+    }
+
+    pub fn events(&self) -> &[(Token, Interest)] {
+        &self.events
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::io::Write;
+    use std::os::unix::io::AsRawFd;
+    use std::os::unix::net::UnixStream;
+
+    fn new_poller(inner_fd: RawFd) -> Option<UringPoller> {
+        match UringPoller::new(8, inner_fd) {
+            Ok(p) => Some(p),
+            Err(_) => None, // io_uring not available to the test
+        }
+    }
+
+    #[test]
+    fn readiness() {
+        let (mut a, b) = UnixStream::pair().unwrap();
+        let (_inner, inner_peer) = UnixStream::pair().unwrap();
+
+        let Some(mut poller) = new_poller(inner_peer.as_raw_fd()) else {
+            return;
+        };
+
+        poller
+            .register(
+                b.as_raw_fd(),
+                Token(1),
+                Interest::READABLE | Interest::WRITABLE,
+            )
+            .unwrap();
+
+        // duplicate
+        assert_eq!(
+            poller
+                .register(b.as_raw_fd(), Token(2), Interest::READABLE)
+                .unwrap_err()
+                .kind(),
+            io::ErrorKind::AlreadyExists
+        );
+
+        // initially writable only
+        let inner_ready = poller.poll(Some(Duration::from_millis(1000))).unwrap();
+        assert!(!inner_ready);
+        assert_eq!(poller.events(), &[(Token(1), Interest::WRITABLE)]);
+
+        a.write_all(b"hello").unwrap();
+
+        let mut readable = false;
+        for _ in 0..10 {
+            poller.poll(Some(Duration::from_millis(1000))).unwrap();
+
+            if poller
+                .events()
+                .iter()
+                .any(|(t, r)| *t == Token(1) && r.is_readable())
+            {
+                readable = true;
+                break;
+            }
+        }
+        assert!(readable);
+
+        poller.deregister(b.as_raw_fd()).unwrap();
+        assert_eq!(
+            poller.deregister(b.as_raw_fd()).unwrap_err().kind(),
+            io::ErrorKind::NotFound
+        );
+
+        // no more events after deregistering
+        a.write_all(b"world").unwrap();
+        poller.poll(Some(Duration::from_millis(10))).unwrap();
+        assert!(poller.events().is_empty());
+    }
+
+    #[test]
+    fn inner() {
+        let (mut inner, inner_peer) = UnixStream::pair().unwrap();
+
+        let Some(mut poller) = new_poller(inner_peer.as_raw_fd()) else {
+            return;
+        };
+
+        assert!(!poller.poll(Some(Duration::from_millis(0))).unwrap());
+
+        inner.write_all(b"x").unwrap();
+
+        let mut ready = false;
+        for _ in 0..10 {
+            if poller.poll(Some(Duration::from_millis(1000))).unwrap() {
+                ready = true;
+                break;
+            }
+        }
+        assert!(ready);
+        assert!(poller.events().is_empty());
+
+        // stays ready until drained
+        assert!(poller.poll(None).unwrap());
+
+        poller.set_inner_drained(false);
+        assert!(!poller.poll(Some(Duration::from_millis(0))).unwrap());
+    }
+}
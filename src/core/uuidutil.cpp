@@ -22,15 +22,148 @@
 
 #include "uuidutil.h"
 
-#include <QUuid>
+#include <QByteArray>
+#include <QRandomGenerator>
 
 namespace UuidUtil {
 
+namespace {
+
+inline quint64 rotl(quint64 x, int b)
+{
+	return (x << b) | (x >> (64 - b));
+}
+
+inline void sipRound(quint64 &v0, quint64 &v1, quint64 &v2, quint64 &v3)
+{
+	v0 += v1;
+	v1 = rotl(v1, 13);
+	v1 ^= v0;
+	v0 = rotl(v0, 32);
+	v2 += v3;
+	v3 = rotl(v3, 16);
+	v3 ^= v2;
+	v0 += v3;
+	v3 = rotl(v3, 21);
+	v3 ^= v0;
+	v2 += v1;
+	v1 = rotl(v1, 17);
+	v1 ^= v2;
+	v2 = rotl(v2, 32);
+}
+
+// siphash-2-4 of a single 64-bit word
+quint64 sipHash(quint64 k0, quint64 k1, quint64 m)
+{
+	quint64 v0 = k0 ^ 0x736f6d6570736575ull;
+	quint64 v1 = k1 ^ 0x646f72616e646f6dull;
+	quint64 v2 = k0 ^ 0x6c7967656e657261ull;
+	quint64 v3 = k1 ^ 0x7465646279746573ull;
+
+	v3 ^= m;
+	sipRound(v0, v1, v2, v3);
+	sipRound(v0, v1, v2, v3);
+	v0 ^= m;
+
+	// final block holds only the message length
+	quint64 b = (quint64)8 << 56;
+	v3 ^= b;
+	sipRound(v0, v1, v2, v3);
+	sipRound(v0, v1, v2, v3);
+	v0 ^= b;
+
+	v2 ^= 0xff;
+	for(int n = 0; n < 4; ++n)
+		sipRound(v0, v1, v2, v3);
+
+	return v0 ^ v1 ^ v2 ^ v3;
+}
+
+class Generator
+{
+public:
+	Generator() :
+		counter_(0)
+	{
+		QRandomGenerator *rng = QRandomGenerator::system();
+		k0_ = rng->generate64();
+		k1_ = rng->generate64();
+	}
+
+	// fills 16 bytes
+	void next(quint8 *out)
+	{
+		quint64 a = sipHash(k0_, k1_, counter_++);
+		quint64 b = sipHash(k0_, k1_, counter_++);
+
+		for(int n = 0; n < 8; ++n)
+		{
+			out[n] = (quint8)(a >> (n * 8));
+			out[8 + n] = (quint8)(b >> (n * 8));
+		}
+	}
+
+private:
+	quint64 k0_;
+	quint64 k1_;
+	quint64 counter_;
+};
+
+static thread_local Generator g_generator;
+
+}
+
 QByteArray createUuid()
 {
-	QByteArray out = QUuid::createUuid().toString().toLatin1();
-	if(out[0] == '{' && out[out.length() - 1] == '}')
-		out = out.mid(1, out.length() - 2);
+	quint8 b[16];
+	g_generator.next(b);
+
+	// version 4, variant 1
+	b[6] = (b[6] & 0x0f) | 0x40;
+	b[8] = (b[8] & 0x3f) | 0x80;
+
+	static const char *hex = "0123456789abcdef";
+
+	QByteArray out(36, '-');
+	char *p = out.data();
+
+	int at = 0;
+	for(int n = 0; n < 16; ++n)
+	{
+		if(n == 4 || n == 6 || n == 8 || n == 10)
+			++at; // keep the dash
+
+		p[at++] = hex[b[n] >> 4];
+		p[at++] = hex[b[n] & 0x0f];
+	}
+
+	return out;
+}
+
+QByteArray createId()
+{
+	quint8 b[16];
+	g_generator.next(b);
+
+	static const char *chars = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+	QByteArray out(22, 0);
+	char *p = out.data();
+
+	// 5 groups of 3 bytes, then the last byte in 2 characters
+	int at = 0;
+	for(int n = 0; n < 15; n += 3)
+	{
+		quint32 v = ((quint32)b[n] << 16) | ((quint32)b[n + 1] << 8) | b[n + 2];
+		p[at++] = chars[(v >> 18) & 0x3f];
+		p[at++] = chars[(v >> 12) & 0x3f];
+		p[at++] = chars[(v >> 6) & 0x3f];
+		p[at++] = chars[v & 0x3f];
+	}
+
+	p[at++] = chars[b[15] >> 2];
+	p[at++] = chars[(b[15] & 0x03) << 4];
+
 	return out;
 }
 
@@ -27,8 +27,16 @@ class QByteArray;
 
 namespace UuidUtil {
 
+// returns a random id in UUID format (version 4), without braces. ids are
+// generated from a per-thread key, drawn once from the system random
+// source, and a counter. they are unpredictable to anyone without the key,
+// but are much cheaper to make than with QUuid
 QByteArray createUuid();
 
+// same as above, but encoded in 22 characters of url-safe base64, for ids
+// that don't need to look like UUIDs
+QByteArray createId();
+
 }
 
 #endif
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include <QUuid>
+#include "bench.h"
+#include "uuidutil.h"
+
+extern "C" void uuidutil_bench(const char *filter)
+{
+	Bench bench(filter);
+
+	if(!bench.selected("uuidutil/"))
+		return;
+
+	int total = 0;
+
+	// how ids were made before
+	bench.run("uuidutil/create-quuid", 100000, 1, [&] {
+		QByteArray out = QUuid::createUuid().toString().toLatin1();
+		if(out[0] == '{' && out[out.length() - 1] == '}')
+			out = out.mid(1, out.length() - 2);
+		total += out.size();
+	});
+
+	bench.run("uuidutil/create-uuid", 100000, 1, [&] {
+		total += UuidUtil::createUuid().size();
+	});
+
+	bench.run("uuidutil/create-id", 100000, 1, [&] {
+		total += UuidUtil::createId().size();
+	});
+
+	Q_UNUSED(total);
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include <QSet>
+#include "test.h"
+#include "uuidutil.h"
+
+static bool isHex(char c)
+{
+	return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f');
+}
+
+static void uuidFormat()
+{
+	QSet<QByteArray> seen;
+
+	for(int n = 0; n < 1000; ++n)
+	{
+		QByteArray id = UuidUtil::createUuid();
+		TEST_ASSERT_EQ(id.size(), 36);
+
+		for(int i = 0; i < id.size(); ++i)
+		{
+			if(i == 8 || i == 13 || i == 18 || i == 23)
+				TEST_ASSERT_EQ(id[i], '-');
+			else
+				TEST_ASSERT(isHex(id[i]));
+		}
+
+		// version 4, variant 1
+		TEST_ASSERT_EQ(id[14], '4');
+		TEST_ASSERT(id[19] == '8' || id[19] == '9' || id[19] == 'a' || id[19] == 'b');
+
+		TEST_ASSERT(!seen.contains(id));
+		seen += id;
+	}
+}
+
+static void compactFormat()
+{
+	QSet<QByteArray> seen;
+
+	for(int n = 0; n < 1000; ++n)
+	{
+		QByteArray id = UuidUtil::createId();
+		TEST_ASSERT_EQ(id.size(), 22);
+
+		for(char c : id)
+			TEST_ASSERT((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '_');
+
+		TEST_ASSERT(!seen.contains(id));
+		seen += id;
+	}
+}
+
+extern "C" int uuidutil_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(uuidFormat());
+	TEST_CATCH(compactFormat());
+
+	return 0;
+}
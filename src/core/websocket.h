@@ -28,6 +28,7 @@
 #include <QHostAddress>
 #include "httpheaders.h"
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 
 using Signal = boost::signals2::signal<void()>;
 
@@ -70,6 +71,12 @@ public:
 		QByteArray data;
 		bool more;
 
+		Frame() :
+			type(Text),
+			more(false)
+		{
+		}
+
 		Frame(Type _type, const QByteArray &_data, bool _more) :
 			type(_type),
 			data(_data),
@@ -108,15 +115,27 @@ public:
 
 	virtual void writeFrame(const Frame &frame) = 0;
 	virtual Frame readFrame() = 0;
+
+	// like readFrame, but fragments of the same data message that directly
+	//   follow the frame and are already available are joined to it, up to
+	//   maxSize bytes of content. at least one frame is always read, and the
+	//   more flag of the result tells whether the message continues
+	virtual Frame readMessage(int maxSize) { Q_UNUSED(maxSize); return readFrame(); }
+
+	// like writeFrame, but a continuation may be joined to the previous
+	//   fragment of its message if that hasn't been sent yet. framesWritten
+	//   then counts the joined fragments as one frame
+	virtual void writeMessage(const Frame &frame) { writeFrame(frame); }
+
 	virtual void close(int code = -1, const QString &reason = QString()) = 0;
 
-	Signal connected;
-	Signal readyRead;
-	boost::signals2::signal<void(int, int)> framesWritten;
-	Signal writeBytesChanged;
-	Signal peerClosed; // emitted only if peer closes before we do
-	Signal closed; // emitted after peer acks our close, or immediately if we were acking
-	Signal error;
+	FastSignal<> connected;
+	FastSignal<> readyRead;
+	FastSignal<int, int> framesWritten;
+	FastSignal<> writeBytesChanged;
+	FastSignal<> peerClosed; // emitted only if peer closes before we do
+	FastSignal<> closed; // emitted after peer acks our close, or immediately if we were acking
+	FastSignal<> error;
 };
 
 #endif
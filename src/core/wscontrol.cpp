@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "wscontrol.h"
+
+#include <QJsonDocument>
+#include <QJsonArray>
+
+namespace WsControl {
+
+bool concatPatches(const QByteArray &first, const QByteArray &second, QByteArray *out)
+{
+	QJsonParseError e;
+
+	QJsonDocument a = QJsonDocument::fromJson(first, &e);
+	if(e.error != QJsonParseError::NoError || !a.isArray())
+		return false;
+
+	QJsonDocument b = QJsonDocument::fromJson(second, &e);
+	if(e.error != QJsonParseError::NoError || !b.isArray())
+		return false;
+
+	QJsonArray ops = a.array();
+	foreach(const QJsonValue &v, b.array())
+		ops += v;
+
+	*out = QJsonDocument(ops).toJson(QJsonDocument::Compact);
+	return true;
+}
+
+}
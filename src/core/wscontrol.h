@@ -23,6 +23,8 @@
 #ifndef WSCONTROL_H
 #define WSCONTROL_H
 
+#include <QByteArray>
+
 namespace WsControl {
 
 enum KeepAliveMode
@@ -32,6 +34,10 @@ enum KeepAliveMode
 	Interval
 };
 
+// appends the operations of the json patch second to those of first. returns
+// false if either is not a json array
+bool concatPatches(const QByteArray &first, const QByteArray &second, QByteArray *out);
+
 }
 
 #endif
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+
+#include "zhttpkeys.h"
+
+#include <string.h>
+
+namespace ZhttpKeys {
+
+// the size of name is known at compile time, and callers have already
+// checked that it matches
+template <int N>
+static inline bool is(const char *data, const char (&name)[N])
+{
+	return memcmp(data, name, N - 1) == 0;
+}
+
+Key lookup(const char *data, int size)
+{
+	switch(size)
+	{
+		case 2:
+			if(is(data, "id"))
+				return Id;
+			break;
+		case 3:
+			switch(data[0])
+			{
+				case 's': return is(data, "seq") ? Seq : Unknown;
+				case 'u': return is(data, "uri") ? Uri : Unknown;
+				case 'e': return is(data, "ext") ? Ext : Unknown;
+			}
+			break;
+		case 4:
+			switch(data[0])
+			{
+				case 'f': return is(data, "from") ? From : Unknown;
+				case 't': return is(data, "type") ? Type : Unknown;
+				case 'm': return is(data, "more") ? More : Unknown;
+				case 'b': return is(data, "body") ? Body : Unknown;
+				case 'c': return is(data, "code") ? Code : Unknown;
+			}
+			break;
+		case 6:
+			switch(data[0])
+			{
+				case 's': return is(data, "stream") ? Stream : Unknown;
+				case 'm': return is(data, "method") ? Method : Unknown;
+				case 'r': return is(data, "reason") ? Reason : Unknown;
+			}
+			break;
+		case 7:
+			switch(data[0])
+			{
+				case 'c': return is(data, "credits") ? Credits : Unknown;
+				case 'h': return is(data, "headers") ? Headers : Unknown;
+				case 't': return is(data, "timeout") ? Timeout : Unknown;
+			}
+			break;
+		case 8:
+			if(is(data, "max-size"))
+				return MaxSize;
+			break;
+		case 9:
+			switch(data[0])
+			{
+				case 'c': return is(data, "condition") ? Condition : Unknown;
+				case 'u': return is(data, "user-data") ? UserData : Unknown;
+				case 'p': return is(data, "peer-port") ? PeerPort : Unknown;
+			}
+			break;
+		case 11:
+			switch(data[0])
+			{
+				case 'r': return is(data, "router-resp") ? RouterResp : Unknown;
+				case 'p': return is(data, "passthrough") ? Passthrough : Unknown;
+			}
+			break;
+		case 12:
+			// connect-host and connect-port differ only near the end
+			switch(data[8])
+			{
+				case 't': return is(data, "content-type") ? ContentType : Unknown;
+				case 'r': return is(data, "peer-address") ? PeerAddress : Unknown;
+				case 'h': return is(data, "connect-host") ? ConnectHost : Unknown;
+				case 'p': return is(data, "connect-port") ? ConnectPort : Unknown;
+			}
+			break;
+		case 15:
+			if(is(data, "ignore-policies"))
+				return IgnorePolicies;
+			break;
+		case 16:
+			if(is(data, "follow-redirects"))
+				return FollowRedirects;
+			break;
+		case 17:
+			if(is(data, "ignore-tls-errors"))
+				return IgnoreTlsErrors;
+			break;
+		case 18:
+			if(is(data, "trust-connect-host"))
+				return TrustConnectHost;
+			break;
+	}
+
+	return Unknown;
+}
+
+TypeValue lookupType(const char *data, int size)
+{
+	switch(size)
+	{
+		case 4:
+			switch(data[1])
+			{
+				case 'i': return is(data, "ping") ? PingType : UnknownType;
+				case 'o': return is(data, "pong") ? PongType : UnknownType;
+			}
+			break;
+		case 5:
+			switch(data[0])
+			{
+				case 'e': return is(data, "error") ? ErrorType : UnknownType;
+				case 'c': return is(data, "close") ? CloseType : UnknownType;
+			}
+			break;
+		case 6:
+			switch(data[1])
+			{
+				case 'r': return is(data, "credit") ? CreditType : UnknownType;
+				case 'a': return is(data, "cancel") ? CancelType : UnknownType;
+			}
+			break;
+		case 10:
+			if(is(data, "keep-alive"))
+				return KeepAliveType;
+			break;
+		case 13:
+			if(is(data, "handoff-start"))
+				return HandoffStartType;
+			break;
+		case 15:
+			if(is(data, "handoff-proceed"))
+				return HandoffProceedType;
+			break;
+	}
+
+	return UnknownType;
+}
+
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+
+#ifndef ZHTTPKEYS_H
+#define ZHTTPKEYS_H
+
+#include "tnetstring.h"
+
+// field names and type values of zhttp packets, for the decoders. a name is
+// matched by dispatching on its length and a distinguishing character, so
+// each field costs at most one comparison rather than one per known name
+namespace ZhttpKeys {
+
+enum Key
+{
+	Unknown = -1,
+	From,
+	Id,
+	Seq,
+	Type,
+	Condition,
+	Credits,
+	More,
+	Stream,
+	RouterResp,
+	MaxSize,
+	Timeout,
+	Method,
+	Uri,
+	Headers,
+	Body,
+	ContentType,
+	Code,
+	Reason,
+	UserData,
+	PeerAddress,
+	PeerPort,
+	ConnectHost,
+	ConnectPort,
+	IgnorePolicies,
+	TrustConnectHost,
+	IgnoreTlsErrors,
+	FollowRedirects,
+	Passthrough,
+	Ext
+};
+
+// values match the Type enums of ZhttpRequestPacket and
+// ZhttpResponsePacket, which share their order
+enum TypeValue
+{
+	UnknownType = -1,
+	ErrorType = 1,
+	CreditType,
+	KeepAliveType,
+	CancelType,
+	HandoffStartType,
+	HandoffProceedType,
+	CloseType,
+	PingType,
+	PongType
+};
+
+Key lookup(const char *data, int size);
+TypeValue lookupType(const char *data, int size);
+
+// returns Unknown if the view is not a byte array
+inline Key lookup(const TnetString::View &v)
+{
+	return v.type() == TnetString::ByteArray ? lookup(v.data(), v.size()) : Unknown;
+}
+
+inline TypeValue lookupType(const TnetString::View &v)
+{
+	return v.type() == TnetString::ByteArray ? lookupType(v.data(), v.size()) : UnknownType;
+}
+
+}
+
+#endif
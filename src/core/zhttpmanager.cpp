@@ -31,10 +31,15 @@
 #include "tnetstring.h"
 #include "zhttprequestpacket.h"
 #include "zhttpresponsepacket.h"
+#include "ridtable.h"
+#include "uuidutil.h"
 #include "log.h"
 #include "zutil.h"
 #include "logutil.h"
 #include "timer.h"
+#include "defercall.h"
+#include "trace.h"
+#include "packetcapture.h"
 
 #define OUT_HWM 100
 #define IN_HWM 100
@@ -54,6 +59,13 @@
 // needs to match the peer
 #define ZHTTP_IDS_MAX 128
 
+// room for headers and other fields, beyond the body
+#define PACKET_OVERHEAD_ESTIMATE 512
+
+// instances known to be reachable through the router socket. if a lot of
+// instances come and go, the set is simply cleared and relearned
+#define ROUTER_INSTANCES_MAX 1000
+
 class ZhttpManager::Private
 {
 public:
@@ -70,6 +82,15 @@ public:
 		SessionType type;
 		union { ZhttpRequest *req; ZWebSocket *sock; } p;
 		int refreshBucket;
+		qint64 lastActivityTick;
+	};
+
+	// data or credit packets for the same peer, differing only in their ids
+	class PendingBatch
+	{
+	public:
+		ZhttpResponsePacket packet;
+		bool routerResp;
 	};
 
 	ZhttpManager *q;
@@ -94,16 +115,26 @@ public:
 	QByteArray instanceId;
 	int ipcFileMode;
 	bool doBind;
-	QHash<ZhttpRequest::Rid, ZhttpRequest*> clientReqsByRid;
-	QHash<ZhttpRequest::Rid, ZhttpRequest*> serverReqsByRid;
+	bool routeByInstance;
+	bool serverInPaused;
+	QSet<QByteArray> routerInstances;
+	std::unique_ptr<PacketCapture> capture;
+	ClientSlotTable<ZhttpRequest> clientReqs;
+	RidHashTable<ZhttpRequest> serverReqsByRid;
 	QList<ZhttpRequest*> serverPendingReqs;
-	QHash<ZWebSocket::Rid, ZWebSocket*> clientSocksByRid;
-	QHash<ZWebSocket::Rid, ZWebSocket*> serverSocksByRid;
+	ClientSlotTable<ZWebSocket> clientSocks;
+	RidHashTable<ZWebSocket> serverSocksByRid;
 	QList<ZWebSocket*> serverPendingSocks;
 	std::unique_ptr<Timer> refreshTimer;
 	QHash<void*, KeepAliveRegistration*> keepAliveRegistrations;
 	QSet<KeepAliveRegistration*> sessionRefreshBuckets[ZHTTP_REFRESH_BUCKETS];
 	int currentSessionRefreshBucket;
+	qint64 refreshTicks;
+	quint64 keepAlivesSent;
+	quint64 keepAlivesElided;
+	QHash<QByteArray, PendingBatch> pendingBatches;
+	bool batchFlushPending;
+	DeferCall deferCall;
 	Connection cosConnection;
 	Connection cossConnection;
 	Connection sosConnection;
@@ -118,7 +149,15 @@ public:
 		q(_q),
 		ipcFileMode(-1),
 		doBind(false),
-		currentSessionRefreshBucket(0)
+		routeByInstance(true),
+		serverInPaused(false),
+		clientReqs(UuidUtil::createUuid().left(8) + "-r"),
+		clientSocks(UuidUtil::createUuid().left(8) + "-w"),
+		currentSessionRefreshBucket(0),
+		refreshTicks(0),
+		keepAlivesSent(0),
+		keepAlivesElided(0),
+		batchFlushPending(false)
 	{
 		refreshTimer = std::make_unique<Timer>();
 		refreshTimerConnection = refreshTimer->timeout.connect(boost::bind(&Private::refresh_timeout, this));
@@ -126,6 +165,8 @@ public:
 
 	~Private()
 	{
+		flushBatches();
+
 		while(!serverPendingReqs.isEmpty())
 		{
 			ZhttpRequest *req = serverPendingReqs.takeFirst();
@@ -140,9 +181,9 @@ public:
 			delete sock;
 		}
 
-		assert(clientReqsByRid.isEmpty());
+		assert(clientReqs.isEmpty());
 		assert(serverReqsByRid.isEmpty());
-		assert(clientSocksByRid.isEmpty());
+		assert(clientSocks.isEmpty());
 		assert(serverSocksByRid.isEmpty());
 		assert(keepAliveRegistrations.isEmpty());
 	}
@@ -273,11 +314,25 @@ public:
 		server_in_valve = std::make_unique<QZmq::Valve>(server_in_sock.get());
 		serverConnection = server_in_valve->readyRead.connect(boost::bind(&Private::server_in_readyRead, this, boost::placeholders::_1));
 
-		server_in_valve->open();
+		updateServerInValve();
 
 		return true;
 	}
 
+	// read new sessions only while not paused and under the pending limit.
+	//   while the valve is closed, the socket stops granting credit to the
+	//   sender, which then distributes new sessions to other peers
+	void updateServerInValve()
+	{
+		if(!server_in_valve)
+			return;
+
+		if(!serverInPaused && serverPendingReqs.count() + serverPendingSocks.count() < PENDING_MAX)
+			server_in_valve->open();
+		else
+			server_in_valve->close();
+	}
+
 	bool setupServerInStream()
 	{
 		serverStreamConnection.disconnect();
@@ -357,25 +412,41 @@ public:
 		}
 	}
 
+	// encodes the packet after the prefix, in a buffer sized up front so
+	// that the body doesn't need to be copied more than once
+	template <typename T>
+	static QByteArray serialize(const QByteArray &prefix, const T &packet)
+	{
+		QByteArray buf;
+		buf.reserve(prefix.size() + packet.body.size() + PACKET_OVERHEAD_ESTIMATE);
+		buf += prefix;
+
+		TnetString::Writer w(&buf);
+		packet.writeTo(w);
+
+		return buf;
+	}
+
 	void write(SessionType type, const ZhttpRequestPacket &packet)
 	{
 		assert(client_out_sock || client_req_sock);
 		const char *logprefix = logPrefixForType(type);
 
-		QVariant vpacket = packet.toVariant();
-		QByteArray buf = QByteArray("T") + TnetString::fromVariant(vpacket);
+		QByteArray buf = serialize("T", packet);
+
+		TRACE_EVENT(PacketOut, buf.size());
 
 		if(client_out_sock)
 		{
 			if(log_outputLevel() >= LOG_LEVEL_DEBUG)
-				LogUtil::logVariantWithContent(LOG_LEVEL_DEBUG, vpacket, "body", "%s client: OUT", logprefix);
+				LogUtil::logVariantWithContent(LOG_LEVEL_DEBUG, packet.toVariant(), "body", "%s client: OUT", logprefix);
 
 			client_out_sock->write(QList<QByteArray>() << buf);
 		}
 		else
 		{
 			if(log_outputLevel() >= LOG_LEVEL_DEBUG)
-				LogUtil::logVariantWithContent(LOG_LEVEL_DEBUG, vpacket, "body", "%s client req: OUT", logprefix);
+				LogUtil::logVariantWithContent(LOG_LEVEL_DEBUG, packet.toVariant(), "body", "%s client req: OUT", logprefix);
 
 			client_req_sock->write(QList<QByteArray>() << QByteArray() << buf);
 		}
@@ -386,11 +457,12 @@ public:
 		assert(client_out_stream_sock);
 		const char *logprefix = logPrefixForType(type);
 
-		QVariant vpacket = packet.toVariant();
-		QByteArray buf = QByteArray("T") + TnetString::fromVariant(vpacket);
+		QByteArray buf = serialize("T", packet);
+
+		TRACE_EVENT(PacketOut, buf.size());
 
 		if(log_outputLevel() >= LOG_LEVEL_DEBUG)
-			LogUtil::logVariantWithContent(LOG_LEVEL_DEBUG, vpacket, "body", "%s client: OUT %s", logprefix, instanceAddress.data());
+			LogUtil::logVariantWithContent(LOG_LEVEL_DEBUG, packet.toVariant(), "body", "%s client: OUT %s", logprefix, instanceAddress.data());
 
 		QList<QByteArray> msg;
 		msg += instanceAddress;
@@ -404,14 +476,25 @@ public:
 		assert(server_out_sock);
 		const char *logprefix = logPrefixForType(type);
 
-		QVariant vpacket = packet.toVariant();
+		// anything already queued for the peer must go out first
+		flushBatch(instanceAddress);
+
+		// peers that have sent to us over the router socket can be sent to
+		//   directly, even for sessions that didn't ask for it, rather than
+		//   going through pub/sub where every subscriber sees the message.
+		//   peers that never use the router socket, such as older versions,
+		//   keep receiving via pub/sub
+		if(!routerResp && routeByInstance && routerInstances.contains(instanceAddress))
+			routerResp = true;
 
 		if(routerResp)
 		{
-			QByteArray buf = "T" + TnetString::fromVariant(vpacket);
+			QByteArray buf = serialize("T", packet);
+
+			TRACE_EVENT(PacketOut, buf.size());
 
 			if(log_outputLevel() >= LOG_LEVEL_DEBUG)
-				LogUtil::logVariantWithContent(LOG_LEVEL_DEBUG, vpacket, "body", "%s server: OUT (router) %s", logprefix, instanceAddress.data());
+				LogUtil::logVariantWithContent(LOG_LEVEL_DEBUG, packet.toVariant(), "body", "%s server: OUT (router) %s", logprefix, instanceAddress.data());
 
 			QList<QByteArray> msg;
 			msg += instanceAddress;
@@ -421,15 +504,117 @@ public:
 		}
 		else
 		{
-			QByteArray buf = instanceAddress + " T" + TnetString::fromVariant(vpacket);
+			QByteArray buf = serialize(instanceAddress + " T", packet);
+
+			TRACE_EVENT(PacketOut, buf.size());
 
 			if(log_outputLevel() >= LOG_LEVEL_DEBUG)
-				LogUtil::logVariantWithContent(LOG_LEVEL_DEBUG, vpacket, "body", "%s server: OUT %s", logprefix, instanceAddress.data());
+				LogUtil::logVariantWithContent(LOG_LEVEL_DEBUG, packet.toVariant(), "body", "%s server: OUT %s", logprefix, instanceAddress.data());
 
 			server_out_sock->write(QList<QByteArray>() << buf);
 		}
 	}
 
+	static bool isBatchable(const ZhttpResponsePacket &packet)
+	{
+		if(packet.ids.count() != 1)
+			return false;
+
+		// includes initial responses, such as the timeout responses of
+		//   holds expiring together
+		if(packet.type == ZhttpResponsePacket::Data)
+			return (packet.credits == -1);
+
+		if(packet.code != -1)
+			return false;
+
+		// credit grants for request bodies. sessions reading at the same
+		//   pace grant the same amounts and can share a packet
+		return (packet.type == ZhttpResponsePacket::Credit);
+	}
+
+	static bool sameContent(const ZhttpResponsePacket &a, const ZhttpResponsePacket &b)
+	{
+		if(a.type != b.type || a.credits != b.credits)
+			return false;
+
+		if(a.from != b.from || a.more != b.more || a.multi != b.multi || a.contentType != b.contentType)
+			return false;
+
+		if(a.code != b.code || a.reason != b.reason || a.headers != b.headers)
+			return false;
+
+		// bodies of a fanned-out publish normally share their data
+		if(a.body.size() != b.body.size())
+			return false;
+
+		if(a.body.constData() != b.body.constData() && a.body != b.body)
+			return false;
+
+		return (a.userData == b.userData);
+	}
+
+	// data or credit packets to the same peer with the same content are
+	// collected until the event loop is returned to, and then sent as one
+	// packet carrying all of the ids
+	void writeBatched(SessionType type, const ZhttpResponsePacket &packet, const QByteArray &instanceAddress, bool routerResp)
+	{
+		if(type != HttpSession || !isBatchable(packet))
+		{
+			write(type, packet, instanceAddress, routerResp);
+			return;
+		}
+
+		QHash<QByteArray, PendingBatch>::iterator it = pendingBatches.find(instanceAddress);
+		if(it != pendingBatches.end())
+		{
+			PendingBatch &b = it.value();
+
+			if(b.routerResp == routerResp && b.packet.ids.count() < ZHTTP_IDS_MAX && sameContent(b.packet, packet))
+			{
+				b.packet.ids += packet.ids.first();
+				return;
+			}
+
+			flushBatch(instanceAddress);
+		}
+
+		PendingBatch b;
+		b.packet = packet;
+		b.routerResp = routerResp;
+		pendingBatches.insert(instanceAddress, b);
+
+		if(!batchFlushPending)
+		{
+			batchFlushPending = true;
+			deferCall.defer([&]() {
+				batchFlushPending = false;
+				flushBatches();
+			});
+		}
+	}
+
+	void flushBatch(const QByteArray &instanceAddress)
+	{
+		QHash<QByteArray, PendingBatch>::iterator it = pendingBatches.find(instanceAddress);
+		if(it == pendingBatches.end())
+			return;
+
+		PendingBatch b = it.value();
+		pendingBatches.erase(it);
+
+		write(HttpSession, b.packet, instanceAddress, b.routerResp);
+	}
+
+	void flushBatches()
+	{
+		while(!pendingBatches.isEmpty())
+		{
+			QByteArray instanceAddress = pendingBatches.begin().key();
+			flushBatch(instanceAddress);
+		}
+	}
+
 	static const char *logPrefixForType(SessionType type)
 	{
 		switch(type)
@@ -454,6 +639,7 @@ public:
 
 		keepAliveRegistrations.insert(p, r);
 
+		r->lastActivityTick = refreshTicks;
 		r->refreshBucket = smallestSessionRefreshBucket();
 		sessionRefreshBuckets[r->refreshBucket] += r;
 
@@ -473,6 +659,13 @@ public:
 		setupKeepAlive();
 	}
 
+	void keepAliveActivity(void *p)
+	{
+		KeepAliveRegistration *r = keepAliveRegistrations.value(p);
+		if(r)
+			r->lastActivityTick = refreshTicks;
+	}
+
 	void setupKeepAlive()
 	{
 		if(!keepAliveRegistrations.isEmpty())
@@ -491,6 +684,8 @@ public:
 		zreq.ids = ids;
 		zreq.type = ZhttpRequestPacket::KeepAlive;
 		write(type, zreq, zhttpAddress);
+
+		keepAlivesSent += ids.count();
 	}
 
 	void writeKeepAlive(SessionType type, const QList<ZhttpResponsePacket::Id> &ids, const QByteArray &zhttpAddress, bool routerResp)
@@ -500,6 +695,8 @@ public:
 		zresp.ids = ids;
 		zresp.type = ZhttpResponsePacket::KeepAlive;
 		write(type, zresp, zhttpAddress, routerResp);
+
+		keepAlivesSent += ids.count();
 	}
 
 	void client_out_messagesWritten(int count)
@@ -524,6 +721,10 @@ public:
 		while(client_req_sock->canRead())
 		{
 			QList<QByteArray> msg = client_req_sock->read();
+
+			if(capture)
+				capture->write(PacketCapture::ZhttpClientIn, msg);
+
 			if(msg.count() != 2)
 			{
 				log_warning("zhttp/zws client req: received message with parts != 2, skipping");
@@ -537,18 +738,18 @@ public:
 				continue;
 			}
 
-			QVariant data = TnetString::toVariant(dataRaw.mid(1));
-			if(data.isNull())
+			TnetString::View data(dataRaw, 1);
+			if(!data.isValid())
 			{
 				log_warning("zhttp/zws client req: received message with invalid format (tnetstring parse failed), skipping");
 				continue;
 			}
 
 			if(log_outputLevel() >= LOG_LEVEL_DEBUG)
-				LogUtil::logVariantWithContent(LOG_LEVEL_DEBUG, data, "body", "zhttp/zws client req: IN");
+				LogUtil::logVariantWithContent(LOG_LEVEL_DEBUG, data.toVariant(), "body", "zhttp/zws client req: IN");
 
 			ZhttpResponsePacket p;
-			if(!p.fromVariant(data))
+			if(!p.fromView(data))
 			{
 				log_warning("zhttp/zws client req: received message with invalid format (parse failed), skipping");
 				continue;
@@ -562,7 +763,7 @@ public:
 
 			const ZhttpResponsePacket::Id &id = p.ids.first();
 
-			ZhttpRequest *req = clientReqsByRid.value(ZhttpRequest::Rid(instanceId, id.id));
+			ZhttpRequest *req = clientReqs.value(id.id);
 			if(req)
 			{
 				req->handle(id.id, id.seq, p);
@@ -578,31 +779,57 @@ public:
 		}
 	}
 
-	void processClientIn(const QByteArray &receiver, const QByteArray &msg)
+	// the packet starts at offset within msg. the sender may combine
+	// several packets into one message, as a list
+	void processClientIn(const QByteArray &receiver, const QByteArray &msg, int offset = 0)
 	{
-		if(msg.length() < 1 || msg[0] != 'T')
+		TRACE_EVENT(PacketIn, msg.size() - offset);
+
+		if(msg.length() < offset + 1 || msg[offset] != 'T')
 		{
 			log_warning("zhttp/zws client: received message with invalid format (missing type), skipping");
 			return;
 		}
 
-		QVariant data = TnetString::toVariant(msg.mid(1));
-		if(data.isNull())
+		TnetString::View data(msg, offset + 1);
+		if(!data.isValid())
 		{
 			log_warning("zhttp/zws client: received message with invalid format (tnetstring parse failed), skipping");
 			return;
 		}
 
+		if(data.type() != TnetString::List)
+		{
+			processClientPacket(receiver, data);
+			return;
+		}
+
+		std::weak_ptr<Private> self = q->d;
+
+		TnetString::View::Iterator it(data);
+		while(it.next())
+		{
+			processClientPacket(receiver, it.value());
+			if(self.expired())
+				return;
+		}
+
+		if(it.isError())
+			log_warning("zhttp/zws client: received message with invalid format (tnetstring parse failed), skipping rest");
+	}
+
+	void processClientPacket(const QByteArray &receiver, const TnetString::View &data)
+	{
 		if(log_outputLevel() >= LOG_LEVEL_DEBUG)
 		{
 			if(!receiver.isEmpty())
-				LogUtil::logVariantWithContent(LOG_LEVEL_DEBUG, data, "body", "zhttp/zws client: IN %s", receiver.data());
+				LogUtil::logVariantWithContent(LOG_LEVEL_DEBUG, data.toVariant(), "body", "zhttp/zws client: IN %s", receiver.data());
 			else
-				LogUtil::logVariantWithContent(LOG_LEVEL_DEBUG, data, "body", "zhttp/zws client: IN");
+				LogUtil::logVariantWithContent(LOG_LEVEL_DEBUG, data.toVariant(), "body", "zhttp/zws client: IN");
 		}
 
 		ZhttpResponsePacket p;
-		if(!p.fromVariant(data))
+		if(!p.fromView(data))
 		{
 			log_warning("zhttp/zws client: received message with invalid format (parse failed), skipping");
 			return;
@@ -613,7 +840,7 @@ public:
 		foreach(const ZhttpResponsePacket::Id &id, p.ids)
 		{
 			// is this for a websocket?
-			ZWebSocket *sock = clientSocksByRid.value(ZWebSocket::Rid(instanceId, id.id));
+			ZWebSocket *sock = clientSocks.value(id.id);
 			if(sock)
 			{
 				sock->handle(id.id, id.seq, p);
@@ -624,7 +851,7 @@ public:
 			}
 
 			// is this for an http request?
-			ZhttpRequest *req = clientReqsByRid.value(ZhttpRequest::Rid(instanceId, id.id));
+			ZhttpRequest *req = clientReqs.value(id.id);
 			if(req)
 			{
 				req->handle(id.id, id.seq, p);
@@ -640,6 +867,9 @@ public:
 
 	void client_out_stream_readyRead(const QList<QByteArray> &msg)
 	{
+		if(capture)
+			capture->write(PacketCapture::ZhttpClientIn, msg);
+
 		if(msg.count() != 3)
 		{
 			log_warning("zhttp/zws client: received router message with parts != 3, skipping");
@@ -651,6 +881,9 @@ public:
 
 	void client_in_readyRead(const QList<QByteArray> &msg)
 	{
+		if(capture)
+			capture->write(PacketCapture::ZhttpClientIn, msg);
+
 		if(msg.count() != 1)
 		{
 			log_warning("zhttp/zws client: received pub message with parts != 1, skipping");
@@ -665,13 +898,17 @@ public:
 		}
 
 		QByteArray receiver = msg[0].mid(0, at);
-		QByteArray dataRaw = msg[0].mid(at + 1);
 
-		processClientIn(receiver, dataRaw);
+		processClientIn(receiver, msg[0], at + 1);
 	}
 
 	void server_in_readyRead(const QList<QByteArray> &msg)
 	{
+		TRACE_EVENT(PacketIn, msg.isEmpty() ? 0 : msg.last().size());
+
+		if(capture)
+			capture->write(PacketCapture::ZhttpServerIn, msg);
+
 		if(msg.count() != 1)
 		{
 			log_warning("zhttp/zws server: received message with parts != 1, skipping");
@@ -684,18 +921,18 @@ public:
 			return;
 		}
 
-		QVariant data = TnetString::toVariant(msg[0].mid(1));
-		if(data.isNull())
+		TnetString::View data(msg[0], 1);
+		if(!data.isValid())
 		{
 			log_warning("zhttp/zws server: received message with invalid format (tnetstring parse failed), skipping");
 			return;
 		}
 
 		if(log_outputLevel() >= LOG_LEVEL_DEBUG)
-			LogUtil::logVariantWithContent(LOG_LEVEL_DEBUG, data, "body", "zhttp/zws server: IN");
+			LogUtil::logVariantWithContent(LOG_LEVEL_DEBUG, data.toVariant(), "body", "zhttp/zws server: IN");
 
 		ZhttpRequestPacket p;
-		if(!p.fromVariant(data))
+		if(!p.fromView(data))
 		{
 			log_warning("zhttp/zws server: received message with invalid format (parse failed), skipping");
 			return;
@@ -737,8 +974,7 @@ public:
 			serverSocksByRid.insert(rid, sock);
 			serverPendingSocks += sock;
 
-			if(serverPendingReqs.count() + serverPendingSocks.count() >= PENDING_MAX)
-				server_in_valve->close();
+			updateServerInValve();
 
 			q->socketReady();
 		}
@@ -764,8 +1000,7 @@ public:
 			serverReqsByRid.insert(rid, req);
 			serverPendingReqs += req;
 
-			if(serverPendingReqs.count() + serverPendingSocks.count() >= PENDING_MAX)
-				server_in_valve->close();
+			updateServerInValve();
 
 			q->requestReady();
 		}
@@ -779,6 +1014,11 @@ public:
 
 	void server_in_stream_readyRead(const QList<QByteArray> &msg)
 	{
+		TRACE_EVENT(PacketIn, msg.isEmpty() ? 0 : msg.last().size());
+
+		if(capture)
+			capture->write(PacketCapture::ZhttpServerInStream, msg);
+
 		if(msg.count() != 3)
 		{
 			log_warning("zhttp/zws server: received message with parts != 3, skipping");
@@ -791,23 +1031,32 @@ public:
 			return;
 		}
 
-		QVariant data = TnetString::toVariant(msg[2].mid(1));
-		if(data.isNull())
+		TnetString::View data(msg[2], 1);
+		if(!data.isValid())
 		{
 			log_warning("zhttp/zws server: received message with invalid format (tnetstring parse failed), skipping");
 			return;
 		}
 
 		if(log_outputLevel() >= LOG_LEVEL_DEBUG)
-			LogUtil::logVariantWithContent(LOG_LEVEL_DEBUG, data, "body", "zhttp/zws server: IN stream");
+			LogUtil::logVariantWithContent(LOG_LEVEL_DEBUG, data.toVariant(), "body", "zhttp/zws server: IN stream");
 
 		ZhttpRequestPacket p;
-		if(!p.fromVariant(data))
+		if(!p.fromView(data))
 		{
 			log_warning("zhttp/zws server: received message with invalid format (parse failed), skipping");
 			return;
 		}
 
+		// the sender's socket identity is how the router socket reaches it
+		if(!p.from.isEmpty() && msg[0] == p.from && !routerInstances.contains(p.from))
+		{
+			if(routerInstances.count() >= ROUTER_INSTANCES_MAX)
+				routerInstances.clear();
+
+			routerInstances += p.from;
+		}
+
 		std::weak_ptr<Private> self = q->d;
 
 		foreach(const ZhttpRequestPacket::Id &id, p.ids)
@@ -843,10 +1092,32 @@ public:
 		QHash<QByteArray, QList<KeepAliveRegistration*> > clientSessionsBySender[2]; // index corresponds to type
 		QHash<QByteArray, QList<KeepAliveRegistration*> > serverSessionsBySender[4]; // index corresponds to type and response mode
 
+		++refreshTicks;
+
 		// process the current bucket
 		const QSet<KeepAliveRegistration*> &bucket = sessionRefreshBuckets[currentSessionRefreshBucket];
 		foreach(KeepAliveRegistration *r, bucket)
 		{
+			// each bucket comes around once per ZHTTP_SHOULD_PROCESS. if the
+			//   session sent something more recently than that, the peer
+			//   has already been refreshed. skip the keep alive and look at
+			//   the session again once a full interval has passed since its
+			//   last packet
+			qint64 idle = refreshTicks - r->lastActivityTick;
+			if(idle < ZHTTP_REFRESH_BUCKETS)
+			{
+				int next = (currentSessionRefreshBucket + ZHTTP_REFRESH_BUCKETS - (int)idle) % ZHTTP_REFRESH_BUCKETS;
+				if(next != r->refreshBucket)
+				{
+					sessionRefreshBuckets[r->refreshBucket].remove(r);
+					r->refreshBucket = next;
+					sessionRefreshBuckets[next] += r;
+				}
+
+				++keepAlivesElided;
+				continue;
+			}
+
 			QPair<QByteArray, QByteArray> rid;
 			bool isServer;
 			if(r->type == HttpSession)
@@ -1006,9 +1277,9 @@ ZhttpManager::~ZhttpManager() = default;
 int ZhttpManager::connectionCount() const
 {
 	int total = 0;
-	total += d->clientReqsByRid.count();
+	total += d->clientReqs.count();
 	total += d->serverReqsByRid.count();
-	total += d->clientSocksByRid.count();
+	total += d->clientSocks.count();
 	total += d->serverSocksByRid.count();
 	return total;
 }
@@ -1043,6 +1314,33 @@ void ZhttpManager::setBind(bool enable)
 	d->doBind = enable;
 }
 
+void ZhttpManager::setRouteByInstance(bool enable)
+{
+	d->routeByInstance = enable;
+}
+
+void ZhttpManager::setServerInPaused(bool paused)
+{
+	d->serverInPaused = paused;
+	d->updateServerInValve();
+}
+
+bool ZhttpManager::setCaptureFile(const QString &fileName, QString *errorMessage)
+{
+	if(fileName.isEmpty())
+	{
+		d->capture.reset();
+		return true;
+	}
+
+	std::unique_ptr<PacketCapture> capture = std::make_unique<PacketCapture>();
+	if(!capture->open(fileName, errorMessage))
+		return false;
+
+	d->capture = std::move(capture);
+	return true;
+}
+
 bool ZhttpManager::setClientOutSpecs(const QStringList &specs)
 {
 	d->client_out_specs = specs;
@@ -1110,7 +1408,7 @@ ZhttpRequest *ZhttpManager::takeNextRequest()
 			continue;
 		}
 
-		d->server_in_valve->open();
+		d->updateServerInValve();
 	}
 
 	req->startServer();
@@ -1145,7 +1443,7 @@ ZWebSocket *ZhttpManager::takeNextSocket()
 			continue;
 		}
 
-		d->server_in_valve->open();
+		d->updateServerInValve();
 	}
 
 	sock->startServer();
@@ -1159,12 +1457,16 @@ ZhttpRequest *ZhttpManager::createRequestFromState(const ZhttpRequest::ServerSta
 	return req;
 }
 
+QByteArray ZhttpManager::linkClient(ZhttpRequest *req)
+{
+	return d->clientReqs.insert(req);
+}
+
 void ZhttpManager::link(ZhttpRequest *req)
 {
-	if(req->isServer())
-		d->serverReqsByRid.insert(req->rid(), req);
-	else
-		d->clientReqsByRid.insert(req->rid(), req);
+	assert(req->isServer());
+
+	d->serverReqsByRid.insert(req->rid(), req);
 }
 
 void ZhttpManager::unlink(ZhttpRequest *req)
@@ -1172,15 +1474,19 @@ void ZhttpManager::unlink(ZhttpRequest *req)
 	if(req->isServer())
 		d->serverReqsByRid.remove(req->rid());
 	else
-		d->clientReqsByRid.remove(req->rid());
+		d->clientReqs.remove(req->rid().second);
+}
+
+QByteArray ZhttpManager::linkClient(ZWebSocket *sock)
+{
+	return d->clientSocks.insert(sock);
 }
 
 void ZhttpManager::link(ZWebSocket *sock)
 {
-	if(sock->isServer())
-		d->serverSocksByRid.insert(sock->rid(), sock);
-	else
-		d->clientSocksByRid.insert(sock->rid(), sock);
+	assert(sock->isServer());
+
+	d->serverSocksByRid.insert(sock->rid(), sock);
 }
 
 void ZhttpManager::unlink(ZWebSocket *sock)
@@ -1188,7 +1494,7 @@ void ZhttpManager::unlink(ZWebSocket *sock)
 	if(sock->isServer())
 		d->serverSocksByRid.remove(sock->rid());
 	else
-		d->clientSocksByRid.remove(sock->rid());
+		d->clientSocks.remove(sock->rid().second);
 }
 
 bool ZhttpManager::canWriteImmediately() const
@@ -1213,7 +1519,7 @@ void ZhttpManager::writeHttp(const ZhttpRequestPacket &packet, const QByteArray
 
 void ZhttpManager::writeHttp(const ZhttpResponsePacket &packet, const QByteArray &instanceAddress, bool routerResp)
 {
-	d->write(Private::HttpSession, packet, instanceAddress, routerResp);
+	d->writeBatched(Private::HttpSession, packet, instanceAddress, routerResp);
 }
 
 void ZhttpManager::writeWs(const ZhttpRequestPacket &packet)
@@ -1251,6 +1557,26 @@ void ZhttpManager::unregisterKeepAlive(ZWebSocket *sock)
 	d->unregisterKeepAlive(sock);
 }
 
+void ZhttpManager::keepAliveActivity(ZhttpRequest *req)
+{
+	d->keepAliveActivity(req);
+}
+
+void ZhttpManager::keepAliveActivity(ZWebSocket *sock)
+{
+	d->keepAliveActivity(sock);
+}
+
+quint64 ZhttpManager::keepAlivesSent() const
+{
+	return d->keepAlivesSent;
+}
+
+quint64 ZhttpManager::keepAlivesElided() const
+{
+	return d->keepAlivesElided;
+}
+
 int ZhttpManager::estimateRequestHeaderBytes(const QString &method, const QUrl &uri, const HttpHeaders &headers)
 {
 	int total = method.toUtf8().length();
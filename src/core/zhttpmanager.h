@@ -27,6 +27,7 @@
 #include "zhttprequest.h"
 #include "zwebsocket.h"
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 
 using Signal = boost::signals2::signal<void()>;
 
@@ -49,6 +50,18 @@ public:
 	void setIpcFileMode(int mode);
 	void setBind(bool enable);
 
+	// send server responses over the router socket to any instance that
+	//   has been seen on it, instead of only when a session requests it.
+	//   enabled by default
+	void setRouteByInstance(bool enable);
+
+	// stop reading new sessions from the server in socket, leaving them to
+	//   other peers of the sender. existing sessions are not affected
+	void setServerInPaused(bool paused);
+
+	// record received packets to a file, for replaying. empty to stop
+	bool setCaptureFile(const QString &fileName, QString *errorMessage = 0);
+
 	bool setClientOutSpecs(const QStringList &specs);
 	bool setClientOutStreamSpecs(const QStringList &specs);
 	bool setClientInSpecs(const QStringList &specs);
@@ -71,8 +84,12 @@ public:
 	static int estimateRequestHeaderBytes(const QString &method, const QUrl &uri, const HttpHeaders &headers);
 	static int estimateResponseHeaderBytes(int code, const QByteArray &reason, const HttpHeaders &headers);
 
-	Signal requestReady;
-	Signal socketReady;
+	// keep alives are skipped for sessions that sent packets recently
+	quint64 keepAlivesSent() const;
+	quint64 keepAlivesElided() const;
+
+	FastSignal<> requestReady;
+	FastSignal<> socketReady;
 
 private:
 	class Private;
@@ -81,8 +98,10 @@ private:
 
 	friend class ZhttpRequest;
 	friend class ZWebSocket;
+	QByteArray linkClient(ZhttpRequest *req); // returns the assigned id
 	void link(ZhttpRequest *req);
 	void unlink(ZhttpRequest *req);
+	QByteArray linkClient(ZWebSocket *sock); // returns the assigned id
 	void link(ZWebSocket *sock);
 	void unlink(ZWebSocket *sock);
 	bool canWriteImmediately() const;
@@ -97,6 +116,8 @@ private:
 	void unregisterKeepAlive(ZhttpRequest *req);
 	void registerKeepAlive(ZWebSocket *sock);
 	void unregisterKeepAlive(ZWebSocket *sock);
+	void keepAliveActivity(ZhttpRequest *req);
+	void keepAliveActivity(ZWebSocket *sock);
 };
 
 #endif
@@ -27,15 +27,16 @@
 #include "zhttprequestpacket.h"
 #include "zhttpresponsepacket.h"
 #include "bufferlist.h"
+#include "flowwindow.h"
 #include "log.h"
 #include "timer.h"
 #include "defercall.h"
 #include "zhttpmanager.h"
-#include "uuidutil.h"
 
 #define IDEAL_CREDITS 200000
 #define SESSION_EXPIRE 60000
 #define KEEPALIVE_INTERVAL 45000
+#define TIMER_SLACK 500
 #define REQ_BUF_MAX 1000000
 
 class ZhttpRequest::Private
@@ -89,6 +90,8 @@ public:
 	QByteArray responseReason;
 	HttpHeaders responseHeaders;
 	BufferList responseBodyBuf;
+	FlowWindow inWindow; // client only
+	int inBuffered; // received but unread response bytes, for accounting
 	QVariant userData;
 	bool pausing;
 	bool paused;
@@ -123,6 +126,7 @@ public:
 		outCredits(0),
 		bodyFinished(false),
 		pendingInCredits(0),
+		inBuffered(0),
 		haveRequestBody(false),
 		haveResponseValues(false),
 		pausing(false),
@@ -139,9 +143,11 @@ public:
 		expireTimer = std::make_unique<Timer>();
 		expireTimer->timeout.connect(boost::bind(&Private::expire_timeout, this));
 		expireTimer->setSingleShot(true);
+		expireTimer->setSlack(TIMER_SLACK);
 
 		keepAliveTimer = std::make_unique<Timer>();
 		keepAliveTimer->timeout.connect(boost::bind(&Private::keepAlive_timeout, this));
+		keepAliveTimer->setSlack(TIMER_SLACK);
 	}
 
 	~Private()
@@ -150,6 +156,8 @@ public:
 			tryCancel();
 
 		cleanup();
+
+		FlowWindow::addBuffered(-inBuffered);
 	}
 
 	void cleanup()
@@ -397,7 +405,10 @@ public:
 			if(out.isEmpty())
 				return out;
 
-			pendingInCredits += out.size();
+			inBuffered -= out.size();
+			FlowWindow::addBuffered(-out.size());
+
+			pendingInCredits += inWindow.consumed(out.size(), responseBodyBuf.isEmpty());
 
 			if(state == ClientReceiving)
 				tryWrite(); // this should not emit signals in current state
@@ -454,7 +465,11 @@ public:
 		}
 		else if(state == ClientReceiving)
 		{
-			if(pendingInCredits > 0)
+			// hold back small grants while the reader is still working
+			//   through its buffer, so that a stream read in pieces doesn't
+			//   send a credit packet per read. emptying the buffer always
+			//   releases whatever is held
+			if(pendingInCredits > 0 && (responseBodyBuf.isEmpty() || pendingInCredits >= inWindow.size() / 4))
 			{
 				// if we have no data to send but we need to send credits, do at least that
 				ZhttpRequestPacket p;
@@ -750,12 +765,17 @@ public:
 			}
 			else
 			{
-				if(responseBodyBuf.size() + packet.body.size() > IDEAL_CREDITS)
+				// the window may have shrunk after the server was granted
+				// credits, so only the largest window is a violation
+				if(responseBodyBuf.size() + packet.body.size() > FlowWindow::MaxSize)
 					log_warning("zhttp client: id=%s server is sending too fast", id.data());
 			}
 
 			responseBodyBuf += packet.body;
 
+			inBuffered += packet.body.size();
+			FlowWindow::addBuffered(packet.body.size());
+
 			if(packet.more)
 			{
 				if(!doReq && packet.credits > 0)
@@ -848,6 +868,8 @@ public:
 				manager->writeHttp(out, toAddress);
 			}
 		}
+
+		manager->keepAliveActivity(q);
 	}
 
 	void writePacket(const ZhttpResponsePacket &packet)
@@ -860,6 +882,8 @@ public:
 		out.userData = userData;
 		
 		manager->writeHttp(out, rid.first, routerResp);
+
+		manager->keepAliveActivity(q);
 	}
 
 	void writeCancel()
@@ -1025,7 +1049,7 @@ public:
 					p.passthrough = passthrough;
 				if(quiet)
 					p.quiet = true;
-				p.credits = IDEAL_CREDITS;
+				p.credits = inWindow.size();
 				p.multi = true;
 				writePacket(p);
 
@@ -1400,9 +1424,8 @@ QByteArray ZhttpRequest::readBody(int size)
 void ZhttpRequest::setupClient(ZhttpManager *manager, bool req)
 {
 	d->manager = manager;
-	d->rid = Rid(manager->instanceId(), UuidUtil::createUuid());
 	d->doReq = req;
-	d->manager->link(this);
+	d->rid = Rid(manager->instanceId(), manager->linkClient(this));
 }
 
 bool ZhttpRequest::setupServer(ZhttpManager *manager, const QByteArray &id, int seq, const ZhttpRequestPacket &packet)
@@ -27,11 +27,10 @@
 #include <QVariant>
 #include "httprequest.h"
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 
 #define TIMERS_PER_ZHTTPREQUEST 3
 
-using Connection = boost::signals2::scoped_connection;
-
 class ZhttpRequestPacket;
 class ZhttpResponsePacket;
 class ZhttpManager;
@@ -24,6 +24,7 @@
 #include <stdio.h>
 #include "qtcompat.h"
 #include "tnetstring.h"
+#include "zhttpkeys.h"
 
 QVariant ZhttpRequestPacket::toVariant() const
 {
@@ -172,6 +173,254 @@ QVariant ZhttpRequestPacket::toVariant() const
 	return obj;
 }
 
+template <typename T>
+static void writeIds(TnetString::Writer &w, const QList<T> &ids)
+{
+	if(ids.count() == 1)
+	{
+		const T &id = ids.first();
+		if(!id.id.isEmpty())
+		{
+			w.writeByteArray("id");
+			w.writeByteArray(id.id);
+		}
+		if(id.seq != -1)
+		{
+			w.writeByteArray("seq");
+			w.writeInt(id.seq);
+		}
+	}
+	else
+	{
+		w.writeByteArray("id");
+		w.startList();
+		foreach(const T &id, ids)
+		{
+			w.startHash();
+			if(!id.id.isEmpty())
+			{
+				w.writeByteArray("id");
+				w.writeByteArray(id.id);
+			}
+			if(id.seq != -1)
+			{
+				w.writeByteArray("seq");
+				w.writeInt(id.seq);
+			}
+			w.end();
+		}
+		w.end();
+	}
+}
+
+static void writeHeaders(TnetString::Writer &w, const HttpHeaders &headers)
+{
+	w.writeByteArray("headers");
+	w.startList();
+	foreach(const HttpHeader &h, headers)
+	{
+		w.startList();
+		w.writeByteArray(h.first);
+		w.writeByteArray(h.second);
+		w.end();
+	}
+	w.end();
+}
+
+static const char *typeToString(int type)
+{
+	switch(type)
+	{
+		case ZhttpRequestPacket::Error:          return "error";
+		case ZhttpRequestPacket::Credit:         return "credit";
+		case ZhttpRequestPacket::KeepAlive:      return "keep-alive";
+		case ZhttpRequestPacket::Cancel:         return "cancel";
+		case ZhttpRequestPacket::HandoffStart:   return "handoff-start";
+		case ZhttpRequestPacket::HandoffProceed: return "handoff-proceed";
+		case ZhttpRequestPacket::Close:          return "close";
+		case ZhttpRequestPacket::Ping:           return "ping";
+		case ZhttpRequestPacket::Pong:           return "pong";
+		default: return 0;
+	}
+}
+void ZhttpRequestPacket::writeTo(TnetString::Writer &w) const
+{
+	w.startHash();
+
+	if(!from.isEmpty())
+	{
+		w.writeByteArray("from");
+		w.writeByteArray(from);
+	}
+
+	if(!ids.isEmpty())
+		writeIds(w, ids);
+
+	const char *typeStr = typeToString(type);
+	if(typeStr)
+	{
+		w.writeByteArray("type");
+		w.writeByteArray(typeStr);
+	}
+
+	if(type == Error && !condition.isEmpty())
+	{
+		w.writeByteArray("condition");
+		w.writeByteArray(condition);
+	}
+
+	if(credits != -1)
+	{
+		w.writeByteArray("credits");
+		w.writeInt(credits);
+	}
+
+	if(more)
+	{
+		w.writeByteArray("more");
+		w.writeBool(true);
+	}
+
+	if(stream)
+	{
+		w.writeByteArray("stream");
+		w.writeBool(true);
+	}
+
+	if(routerResp)
+	{
+		w.writeByteArray("router-resp");
+		w.writeBool(true);
+	}
+
+	if(maxSize != -1)
+	{
+		w.writeByteArray("max-size");
+		w.writeInt(maxSize);
+	}
+
+	if(timeout != -1)
+	{
+		w.writeByteArray("timeout");
+		w.writeInt(timeout);
+	}
+
+	if(!method.isEmpty())
+	{
+		w.writeByteArray("method");
+		w.writeByteArray(method.toLatin1());
+	}
+
+	if(!uri.isEmpty())
+	{
+		w.writeByteArray("uri");
+		w.writeByteArray(uri.toEncoded());
+	}
+
+	if(!headers.isEmpty())
+		writeHeaders(w, headers);
+
+	if(!body.isNull())
+	{
+		w.writeByteArray("body");
+		w.writeByteArray(body);
+	}
+
+	if(!contentType.isEmpty())
+	{
+		w.writeByteArray("content-type");
+		w.writeByteArray(contentType);
+	}
+
+	if(code != -1)
+	{
+		w.writeByteArray("code");
+		w.writeInt(code);
+	}
+
+	if(userData.isValid())
+	{
+		w.writeByteArray("user-data");
+		w.writeVariant(userData);
+	}
+
+	if(!peerAddress.isNull())
+	{
+		w.writeByteArray("peer-address");
+		w.writeByteArray(peerAddress.toString().toUtf8());
+	}
+
+	if(peerPort != -1)
+	{
+		w.writeByteArray("peer-port");
+		w.writeByteArray(QByteArray::number(peerPort));
+	}
+
+	if(!connectHost.isEmpty())
+	{
+		w.writeByteArray("connect-host");
+		w.writeByteArray(connectHost.toUtf8());
+	}
+
+	if(connectPort != -1)
+	{
+		w.writeByteArray("connect-port");
+		w.writeInt(connectPort);
+	}
+
+	if(ignorePolicies)
+	{
+		w.writeByteArray("ignore-policies");
+		w.writeBool(true);
+	}
+
+	if(trustConnectHost)
+	{
+		w.writeByteArray("trust-connect-host");
+		w.writeBool(true);
+	}
+
+	if(ignoreTlsErrors)
+	{
+		w.writeByteArray("ignore-tls-errors");
+		w.writeBool(true);
+	}
+
+	if(followRedirects)
+	{
+		w.writeByteArray("follow-redirects");
+		w.writeBool(true);
+	}
+
+	if(passthrough.isValid())
+	{
+		w.writeByteArray("passthrough");
+		w.writeVariant(passthrough);
+	}
+
+	if(multi || quiet)
+	{
+		w.writeByteArray("ext");
+		w.startHash();
+
+		if(multi)
+		{
+			w.writeByteArray("multi");
+			w.writeBool(true);
+		}
+
+		if(quiet)
+		{
+			w.writeByteArray("quiet");
+			w.writeBool(true);
+		}
+
+		w.end();
+	}
+
+	w.end();
+}
+
 bool ZhttpRequestPacket::fromVariant(const QVariant &in)
 {
 	if(typeId(in) != QMetaType::QVariantHash)
@@ -499,3 +748,255 @@ bool ZhttpRequestPacket::fromVariant(const QVariant &in)
 
 	return true;
 }
+
+template <typename T>
+static bool parseIds(const TnetString::View &in, QList<T> *ids)
+{
+	ids->clear();
+
+	if(in.type() == TnetString::ByteArray)
+	{
+		*ids += T(in.toByteArray());
+		return true;
+	}
+
+	if(in.type() != TnetString::List)
+		return false;
+
+	TnetString::View::Iterator it(in);
+	while(it.next())
+	{
+		const TnetString::View &v = it.value();
+		if(v.type() != TnetString::Hash)
+			return false;
+
+		T id;
+
+		TnetString::View::Iterator fit(v);
+		while(fit.next())
+		{
+			bool ok;
+
+			if(fit.key().equals("id"))
+			{
+				id.id = fit.value().toByteArray(&ok);
+				if(!ok)
+					return false;
+			}
+			else if(fit.key().equals("seq"))
+			{
+				id.seq = fit.value().toInt(&ok);
+				if(!ok)
+					return false;
+			}
+		}
+
+		if(fit.isError())
+			return false;
+
+		*ids += id;
+	}
+
+	return !it.isError();
+}
+
+static bool parseHeaders(const TnetString::View &in, HttpHeaders *headers)
+{
+	headers->clear();
+
+	if(in.type() != TnetString::List)
+		return false;
+
+	TnetString::View::Iterator it(in);
+	while(it.next())
+	{
+		TnetString::View::Iterator hit(it.value());
+
+		if(!hit.next())
+			return false;
+
+		bool ok;
+		QByteArray name = hit.value().toByteArray(&ok);
+		if(!ok)
+			return false;
+
+		if(!hit.next())
+			return false;
+
+		QByteArray value = hit.value().toByteArray(&ok);
+		if(!ok)
+			return false;
+
+		if(hit.next() || hit.isError())
+			return false;
+
+		*headers += HttpHeader(name, value);
+	}
+
+	return !it.isError();
+}
+
+// type values are converted by casting
+static_assert((int)ZhttpRequestPacket::Error == (int)ZhttpKeys::ErrorType && (int)ZhttpRequestPacket::Pong == (int)ZhttpKeys::PongType, "zhttp type values must match");
+
+bool ZhttpRequestPacket::fromView(const TnetString::View &in)
+{
+	if(!in.isValid() || in.type() != TnetString::Hash)
+		return false;
+
+	*this = ZhttpRequestPacket();
+	type = Data;
+
+	// decoded out of order, then applied below
+	bool haveSeq = false;
+	int seq = -1;
+	QByteArray errorCondition;
+
+	TnetString::View::Iterator it(in);
+	while(it.next())
+	{
+		const TnetString::View &k = it.key();
+		const TnetString::View &v = it.value();
+		bool ok = true;
+
+		switch(ZhttpKeys::lookup(k))
+		{
+			case ZhttpKeys::From:
+				from = v.toByteArray(&ok);
+				break;
+			case ZhttpKeys::Id:
+				ok = parseIds(v, &ids);
+				break;
+			case ZhttpKeys::Seq:
+				seq = v.toInt(&ok);
+				haveSeq = true;
+				break;
+			case ZhttpKeys::Type:
+			{
+				ZhttpKeys::TypeValue t = ZhttpKeys::lookupType(v);
+				if(t != ZhttpKeys::UnknownType)
+					type = (Type)t;
+				else
+					ok = false;
+				break;
+			}
+			case ZhttpKeys::Condition:
+				errorCondition = v.toByteArray(&ok);
+				break;
+			case ZhttpKeys::Credits:
+				credits = v.toInt(&ok);
+				break;
+			case ZhttpKeys::More:
+				more = v.toBool(&ok);
+				break;
+			case ZhttpKeys::Stream:
+				stream = v.toBool(&ok);
+				break;
+			case ZhttpKeys::RouterResp:
+				routerResp = v.toBool(&ok);
+				break;
+			case ZhttpKeys::MaxSize:
+				maxSize = v.toInt(&ok);
+				break;
+			case ZhttpKeys::Timeout:
+				timeout = v.toInt(&ok);
+				break;
+			case ZhttpKeys::Method:
+				method = QString::fromLatin1(v.toByteArray(&ok));
+				break;
+			case ZhttpKeys::Uri:
+				uri = QUrl::fromEncoded(v.toByteArray(&ok), QUrl::StrictMode);
+				break;
+			case ZhttpKeys::Headers:
+				ok = parseHeaders(v, &headers);
+				break;
+			case ZhttpKeys::Body:
+				body = v.toByteArray(&ok);
+				break;
+			case ZhttpKeys::ContentType:
+				contentType = v.toByteArray(&ok);
+				break;
+			case ZhttpKeys::Code:
+				code = v.toInt(&ok);
+				break;
+			case ZhttpKeys::UserData:
+				userData = v.toVariant(&ok);
+				break;
+			case ZhttpKeys::PeerAddress:
+				peerAddress = QHostAddress(QString::fromUtf8(v.toByteArray(&ok)));
+				break;
+			case ZhttpKeys::PeerPort:
+				peerPort = v.toInt(&ok);
+				break;
+			case ZhttpKeys::ConnectHost:
+				connectHost = QString::fromUtf8(v.toByteArray(&ok));
+				break;
+			case ZhttpKeys::ConnectPort:
+				connectPort = v.toInt(&ok);
+				break;
+			case ZhttpKeys::IgnorePolicies:
+				ignorePolicies = v.toBool(&ok);
+				break;
+			case ZhttpKeys::TrustConnectHost:
+				trustConnectHost = v.toBool(&ok);
+				break;
+			case ZhttpKeys::IgnoreTlsErrors:
+				ignoreTlsErrors = v.toBool(&ok);
+				break;
+			case ZhttpKeys::FollowRedirects:
+				followRedirects = v.toBool(&ok);
+				break;
+			case ZhttpKeys::Passthrough:
+				passthrough = v.toVariant(&ok);
+				break;
+			case ZhttpKeys::Ext:
+			{
+				if(v.type() != TnetString::Hash)
+					return false;
+
+				TnetString::View::Iterator eit(v);
+				while(eit.next())
+				{
+					bool ok_;
+
+					if(eit.key().equals("multi"))
+					{
+						bool b = eit.value().toBool(&ok_);
+						if(ok_)
+							multi = b;
+					}
+					else if(eit.key().equals("quiet"))
+					{
+						bool b = eit.value().toBool(&ok_);
+						if(ok_)
+							quiet = b;
+					}
+				}
+
+				ok = !eit.isError();
+				break;
+			}
+			default:
+				break;
+		}
+
+		if(!ok)
+			return false;
+	}
+
+	if(it.isError())
+		return false;
+
+	if(haveSeq)
+	{
+		if(ids.isEmpty())
+			ids += Id();
+
+		ids.first().seq = seq;
+	}
+
+	if(type == Error)
+		condition = errorCondition;
+
+	return true;
+}
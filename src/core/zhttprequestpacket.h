@@ -26,6 +26,7 @@
 #include <QVariant>
 #include <QHostAddress>
 #include "httpheaders.h"
+#include "tnetstring.h"
 
 class ZhttpRequestPacket
 {
@@ -120,6 +121,12 @@ public:
 
 	QVariant toVariant() const;
 	bool fromVariant(const QVariant &in);
+
+	// encodes directly into the writer's buffer, without building a variant
+	void writeTo(TnetString::Writer &w) const;
+
+	// decodes directly from tnetstring data, without building a variant
+	bool fromView(const TnetString::View &in);
 };
 
 #endif
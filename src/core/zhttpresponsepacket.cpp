@@ -22,6 +22,7 @@
 #include "zhttpresponsepacket.h"
 
 #include "qtcompat.h"
+#include "zhttpkeys.h"
 
 QVariant ZhttpResponsePacket::toVariant() const
 {
@@ -121,6 +122,158 @@ QVariant ZhttpResponsePacket::toVariant() const
 	return obj;
 }
 
+template <typename T>
+static void writeIds(TnetString::Writer &w, const QList<T> &ids)
+{
+	if(ids.count() == 1)
+	{
+		const T &id = ids.first();
+		if(!id.id.isEmpty())
+		{
+			w.writeByteArray("id");
+			w.writeByteArray(id.id);
+		}
+		if(id.seq != -1)
+		{
+			w.writeByteArray("seq");
+			w.writeInt(id.seq);
+		}
+	}
+	else
+	{
+		w.writeByteArray("id");
+		w.startList();
+		foreach(const T &id, ids)
+		{
+			w.startHash();
+			if(!id.id.isEmpty())
+			{
+				w.writeByteArray("id");
+				w.writeByteArray(id.id);
+			}
+			if(id.seq != -1)
+			{
+				w.writeByteArray("seq");
+				w.writeInt(id.seq);
+			}
+			w.end();
+		}
+		w.end();
+	}
+}
+
+static void writeHeaders(TnetString::Writer &w, const HttpHeaders &headers)
+{
+	w.writeByteArray("headers");
+	w.startList();
+	foreach(const HttpHeader &h, headers)
+	{
+		w.startList();
+		w.writeByteArray(h.first);
+		w.writeByteArray(h.second);
+		w.end();
+	}
+	w.end();
+}
+
+static const char *typeToString(int type)
+{
+	switch(type)
+	{
+		case ZhttpResponsePacket::Error:          return "error";
+		case ZhttpResponsePacket::Credit:         return "credit";
+		case ZhttpResponsePacket::KeepAlive:      return "keep-alive";
+		case ZhttpResponsePacket::Cancel:         return "cancel";
+		case ZhttpResponsePacket::HandoffStart:   return "handoff-start";
+		case ZhttpResponsePacket::HandoffProceed: return "handoff-proceed";
+		case ZhttpResponsePacket::Close:          return "close";
+		case ZhttpResponsePacket::Ping:           return "ping";
+		case ZhttpResponsePacket::Pong:           return "pong";
+		default: return 0;
+	}
+}
+void ZhttpResponsePacket::writeTo(TnetString::Writer &w) const
+{
+	w.startHash();
+
+	if(!from.isEmpty())
+	{
+		w.writeByteArray("from");
+		w.writeByteArray(from);
+	}
+
+	if(!ids.isEmpty())
+		writeIds(w, ids);
+
+	const char *typeStr = typeToString(type);
+	if(typeStr)
+	{
+		w.writeByteArray("type");
+		w.writeByteArray(typeStr);
+	}
+
+	if(type == Error && !condition.isEmpty())
+	{
+		w.writeByteArray("condition");
+		w.writeByteArray(condition);
+	}
+
+	if(credits != -1)
+	{
+		w.writeByteArray("credits");
+		w.writeInt(credits);
+	}
+
+	if(more)
+	{
+		w.writeByteArray("more");
+		w.writeBool(true);
+	}
+
+	if(code != -1)
+	{
+		w.writeByteArray("code");
+		w.writeInt(code);
+
+		if(type == Data || (type == Error && condition == "rejected"))
+		{
+			w.writeByteArray("reason");
+			w.writeByteArray(reason);
+
+			writeHeaders(w, headers);
+		}
+	}
+
+	if(!body.isNull())
+	{
+		w.writeByteArray("body");
+		w.writeByteArray(body);
+	}
+
+	if(!contentType.isEmpty())
+	{
+		w.writeByteArray("content-type");
+		w.writeByteArray(contentType);
+	}
+
+	if(userData.isValid())
+	{
+		w.writeByteArray("user-data");
+		w.writeVariant(userData);
+	}
+
+	if(multi)
+	{
+		w.writeByteArray("ext");
+		w.startHash();
+		w.writeByteArray("multi");
+		w.writeBool(true);
+		w.end();
+	}
+
+	w.end();
+}
+
 bool ZhttpResponsePacket::fromVariant(const QVariant &in)
 {
 	if(typeId(in) != QMetaType::QVariantHash)
@@ -324,3 +477,206 @@ bool ZhttpResponsePacket::fromVariant(const QVariant &in)
 
 	return true;
 }
+
+template <typename T>
+static bool parseIds(const TnetString::View &in, QList<T> *ids)
+{
+	ids->clear();
+
+	if(in.type() == TnetString::ByteArray)
+	{
+		*ids += T(in.toByteArray());
+		return true;
+	}
+
+	if(in.type() != TnetString::List)
+		return false;
+
+	TnetString::View::Iterator it(in);
+	while(it.next())
+	{
+		const TnetString::View &v = it.value();
+		if(v.type() != TnetString::Hash)
+			return false;
+
+		T id;
+
+		TnetString::View::Iterator fit(v);
+		while(fit.next())
+		{
+			bool ok;
+
+			if(fit.key().equals("id"))
+			{
+				id.id = fit.value().toByteArray(&ok);
+				if(!ok)
+					return false;
+			}
+			else if(fit.key().equals("seq"))
+			{
+				id.seq = fit.value().toInt(&ok);
+				if(!ok)
+					return false;
+			}
+		}
+
+		if(fit.isError())
+			return false;
+
+		*ids += id;
+	}
+
+	return !it.isError();
+}
+
+static bool parseHeaders(const TnetString::View &in, HttpHeaders *headers)
+{
+	headers->clear();
+
+	if(in.type() != TnetString::List)
+		return false;
+
+	TnetString::View::Iterator it(in);
+	while(it.next())
+	{
+		TnetString::View::Iterator hit(it.value());
+
+		if(!hit.next())
+			return false;
+
+		bool ok;
+		QByteArray name = hit.value().toByteArray(&ok);
+		if(!ok)
+			return false;
+
+		if(!hit.next())
+			return false;
+
+		QByteArray value = hit.value().toByteArray(&ok);
+		if(!ok)
+			return false;
+
+		if(hit.next() || hit.isError())
+			return false;
+
+		*headers += HttpHeader(name, value);
+	}
+
+	return !it.isError();
+}
+
+// type values are converted by casting
+static_assert((int)ZhttpResponsePacket::Error == (int)ZhttpKeys::ErrorType && (int)ZhttpResponsePacket::Pong == (int)ZhttpKeys::PongType, "zhttp type values must match");
+
+bool ZhttpResponsePacket::fromView(const TnetString::View &in)
+{
+	if(!in.isValid() || in.type() != TnetString::Hash)
+		return false;
+
+	*this = ZhttpResponsePacket();
+	type = Data;
+
+	// decoded out of order, then applied below
+	bool haveSeq = false;
+	int seq = -1;
+	QByteArray errorCondition;
+
+	TnetString::View::Iterator it(in);
+	while(it.next())
+	{
+		const TnetString::View &k = it.key();
+		const TnetString::View &v = it.value();
+		bool ok = true;
+
+		switch(ZhttpKeys::lookup(k))
+		{
+			case ZhttpKeys::From:
+				from = v.toByteArray(&ok);
+				break;
+			case ZhttpKeys::Id:
+				ok = parseIds(v, &ids);
+				break;
+			case ZhttpKeys::Seq:
+				seq = v.toInt(&ok);
+				haveSeq = true;
+				break;
+			case ZhttpKeys::Type:
+			{
+				ZhttpKeys::TypeValue t = ZhttpKeys::lookupType(v);
+				if(t != ZhttpKeys::UnknownType)
+					type = (Type)t;
+				else
+					ok = false;
+				break;
+			}
+			case ZhttpKeys::Condition:
+				errorCondition = v.toByteArray(&ok);
+				break;
+			case ZhttpKeys::Credits:
+				credits = v.toInt(&ok);
+				break;
+			case ZhttpKeys::More:
+				more = v.toBool(&ok);
+				break;
+			case ZhttpKeys::Code:
+				code = v.toInt(&ok);
+				break;
+			case ZhttpKeys::Reason:
+				reason = v.toByteArray(&ok);
+				break;
+			case ZhttpKeys::Headers:
+				ok = parseHeaders(v, &headers);
+				break;
+			case ZhttpKeys::Body:
+				body = v.toByteArray(&ok);
+				break;
+			case ZhttpKeys::ContentType:
+				contentType = v.toByteArray(&ok);
+				break;
+			case ZhttpKeys::UserData:
+				userData = v.toVariant(&ok);
+				break;
+			case ZhttpKeys::Ext:
+			{
+				if(v.type() != TnetString::Hash)
+					return false;
+
+				TnetString::View::Iterator eit(v);
+				while(eit.next())
+				{
+					if(eit.key().equals("multi"))
+					{
+						bool ok_;
+						bool b = eit.value().toBool(&ok_);
+						if(ok_)
+							multi = b;
+					}
+				}
+
+				ok = !eit.isError();
+				break;
+			}
+			default:
+				break;
+		}
+
+		if(!ok)
+			return false;
+	}
+
+	if(it.isError())
+		return false;
+
+	if(haveSeq)
+	{
+		if(ids.isEmpty())
+			ids += Id();
+
+		ids.first().seq = seq;
+	}
+
+	if(type == Error)
+		condition = errorCondition;
+
+	return true;
+}
@@ -23,6 +23,7 @@
 
 #include <QVariant>
 #include "httpheaders.h"
+#include "tnetstring.h"
 
 class ZhttpResponsePacket
 {
@@ -90,6 +91,12 @@ public:
 
 	QVariant toVariant() const;
 	bool fromVariant(const QVariant &in);
+
+	// encodes directly into the writer's buffer, without building a variant
+	void writeTo(TnetString::Writer &w) const;
+
+	// decodes directly from tnetstring data, without building a variant
+	bool fromView(const TnetString::View &in);
 };
 
 #endif
@@ -18,6 +18,14 @@
 use crate::core::reactor::{FdEvented, TimerEvented};
 use crate::core::task::get_reactor;
 use arrayvec::ArrayVec;
+use miniz_oxide::deflate::core::{
+    compress, create_comp_flags_from_zip_params, CompressorOxide, TDEFLFlush, TDEFLStatus,
+};
+use miniz_oxide::inflate::core::inflate_flags::{
+    TINFL_FLAG_PARSE_ZLIB_HEADER, TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF,
+};
+use miniz_oxide::inflate::core::{decompress, DecompressorOxide};
+use miniz_oxide::inflate::TINFLStatus;
 use std::cell::Cell;
 use std::cell::RefCell;
 use std::fmt;
@@ -26,6 +34,7 @@ use std::future::Future;
 use std::io;
 use std::os::unix::fs::PermissionsExt;
 use std::pin::Pin;
+use std::sync::atomic::{AtomicBool, Ordering};
 use std::task::{Context, Poll};
 use std::time::Duration;
 
@@ -34,6 +43,134 @@ const MULTIPART_HEADERS_MAX: usize = 8;
 // 1 for the zmq fd, and potentially 1 for the retry timer
 pub const REGISTRATIONS_PER_ZMQSOCKET: usize = 2;
 
+// compressed frames start with this, followed by the uncompressed size as a
+// 32-bit big-endian integer and a zlib stream. this is the layout of Qt's
+// qCompress with a prefix, so the C++ side can read and write it too. the
+// prefix can't begin a tnetstring, text address or zmq generated identity
+const COMPRESSED_FRAME_PREFIX: &[u8] = b"\x00ZL1";
+const COMPRESSED_FRAME_HEADER_SIZE: usize = COMPRESSED_FRAME_PREFIX.len() + 4;
+
+// smaller frames don't compress well enough to be worth it
+const COMPRESS_SIZE_MIN: usize = 256;
+
+const DECOMPRESS_SIZE_MAX: usize = 16 * 1024 * 1024;
+
+// favor speed. most of the gain on zhttp packets comes from repeated header
+// names and values, which even the fastest level finds
+const COMPRESS_LEVEL: i32 = 1;
+
+static TCP_COMPRESSION_ENABLED: AtomicBool = AtomicBool::new(false);
+
+thread_local! {
+    // setting up a compressor costs more than compressing a typical
+    // packet, so each thread keeps one around
+    static COMPRESSOR: RefCell<Box<CompressorOxide>> = RefCell::new(Box::new(
+        CompressorOxide::new(create_comp_flags_from_zip_params(COMPRESS_LEVEL, 1, 0)),
+    ));
+
+    static DECOMPRESSOR: RefCell<Box<DecompressorOxide>> =
+        RefCell::new(Box::default());
+}
+
+// compress large frames sent on sockets that use tcp specs. applies to
+// specs applied afterwards. frames are decompressed on receipt regardless,
+// so receivers should be upgraded before senders enable this
+pub fn set_tcp_compression_enabled(enabled: bool) {
+    TCP_COMPRESSION_ENABLED.store(enabled, Ordering::Relaxed);
+}
+
+// returns None if the frame is too small or doesn't compress
+pub fn compress_frame(data: &[u8]) -> Option<Vec<u8>> {
+    if data.len() < COMPRESS_SIZE_MIN || data.len() > DECOMPRESS_SIZE_MAX {
+        return None;
+    }
+
+    // anything that doesn't fit in the size of the input isn't worth sending
+    let mut out = vec![0; data.len()];
+    out[..COMPRESSED_FRAME_PREFIX.len()].copy_from_slice(COMPRESSED_FRAME_PREFIX);
+    out[COMPRESSED_FRAME_PREFIX.len()..COMPRESSED_FRAME_HEADER_SIZE]
+        .copy_from_slice(&(data.len() as u32).to_be_bytes());
+
+    let size = COMPRESSOR.with(|c| {
+        let c = &mut *c.borrow_mut();
+        c.reset();
+
+        match compress(
+            c,
+            data,
+            &mut out[COMPRESSED_FRAME_HEADER_SIZE..],
+            TDEFLFlush::Finish,
+        ) {
+            (TDEFLStatus::Done, _, size) => Some(size),
+            _ => None,
+        }
+    })?;
+
+    let size = COMPRESSED_FRAME_HEADER_SIZE + size;
+
+    if size >= data.len() {
+        return None;
+    }
+
+    out.truncate(size);
+
+    Some(out)
+}
+
+pub fn is_compressed_frame(data: &[u8]) -> bool {
+    data.len() > COMPRESSED_FRAME_HEADER_SIZE && data.starts_with(COMPRESSED_FRAME_PREFIX)
+}
+
+pub fn decompress_frame(data: &[u8]) -> Result<Vec<u8>, ()> {
+    if !is_compressed_frame(data) {
+        return Err(());
+    }
+
+    let mut size = [0; 4];
+    size.copy_from_slice(&data[COMPRESSED_FRAME_PREFIX.len()..COMPRESSED_FRAME_HEADER_SIZE]);
+    let size = u32::from_be_bytes(size) as usize;
+
+    if size > DECOMPRESS_SIZE_MAX {
+        return Err(());
+    }
+
+    let mut out = vec![0; size];
+
+    let done = DECOMPRESSOR.with(|d| {
+        let d = &mut *d.borrow_mut();
+        d.init();
+
+        // output beyond the declared size makes this fail with HasMoreOutput
+        match decompress(
+            d,
+            &data[COMPRESSED_FRAME_HEADER_SIZE..],
+            &mut out,
+            0,
+            TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF,
+        ) {
+            (TINFLStatus::Done, _, written) => written == size,
+            _ => false,
+        }
+    });
+
+    if !done {
+        return Err(());
+    }
+
+    Ok(out)
+}
+
+fn decode_frame(msg: zmq::Message) -> Result<zmq::Message, zmq::Error> {
+    if !is_compressed_frame(&msg) {
+        return Ok(msg);
+    }
+
+    match decompress_frame(&msg) {
+        Ok(data) => Ok(zmq::Message::from(data)),
+        Err(()) => Err(zmq::Error::EINVAL),
+    }
+}
+
 fn trim_prefix<'a>(s: &'a str, prefix: &str) -> Result<&'a str, ()> {
     if let Some(s) = s.strip_prefix(prefix) {
         Ok(s)
@@ -143,6 +280,11 @@ pub struct ZmqSocket {
     inner: zmq::Socket,
     events: Cell<zmq::PollEvents>,
     specs: RefCell<Vec<ActiveSpec>>,
+    compress: Cell<bool>,
+
+    // subscribers match on the start of the first frame, which must stay
+    // readable
+    prefix_routed: bool,
 }
 
 impl ZmqSocket {
@@ -151,6 +293,25 @@ impl ZmqSocket {
             inner: ctx.socket(socket_type).unwrap(),
             events: Cell::new(zmq::PollEvents::empty()),
             specs: RefCell::new(Vec::new()),
+            compress: Cell::new(false),
+            prefix_routed: socket_type == zmq::PUB || socket_type == zmq::XPUB,
+        }
+    }
+
+    // compress large content frames when sending. received frames are
+    // always decompressed
+    pub fn set_compression_enabled(&self, enabled: bool) {
+        self.compress.set(enabled);
+    }
+
+    fn encode_frame(&self, msg: zmq::Message) -> zmq::Message {
+        if !self.compress.get() {
+            return msg;
+        }
+
+        match compress_frame(&msg) {
+            Some(data) => zmq::Message::from(data),
+            None => msg,
         }
     }
 
@@ -178,6 +339,12 @@ impl ZmqSocket {
     pub fn send(&self, msg: zmq::Message, flags: i32) -> Result<(), zmq::Error> {
         let flags = flags & zmq::DONTWAIT;
 
+        let msg = if self.prefix_routed {
+            msg
+        } else {
+            self.encode_frame(msg)
+        };
+
         if let Err(e) = self.inner.send(msg, flags) {
             self.update_events();
             return Err(e);
@@ -216,7 +383,7 @@ impl ZmqSocket {
             return Err(e);
         }
 
-        self.send(content, flags)
+        self.send(self.encode_frame(content), flags)
     }
 
     pub fn recv(&self, flags: i32) -> Result<zmq::Message, zmq::Error> {
@@ -240,7 +407,7 @@ impl ZmqSocket {
 
         self.update_events();
 
-        Ok(msg)
+        decode_frame(msg)
     }
 
     pub fn recv_routed(&self, flags: i32) -> Result<(MultipartHeader, zmq::Message), zmq::Error> {
@@ -304,7 +471,7 @@ impl ZmqSocket {
 
         self.update_events();
 
-        Ok((header, msg))
+        Ok((header, decode_frame(msg)?))
     }
 
     pub fn apply_specs(&self, new_specs: &[SpecInfo]) -> Result<(), ZmqSocketError> {
@@ -444,6 +611,12 @@ impl ZmqSocket {
             specs.push(s.unwrap());
         }
 
+        if TCP_COMPRESSION_ENABLED.load(Ordering::Relaxed)
+            && specs.iter().any(|s| s.spec.spec.starts_with("tcp://"))
+        {
+            self.compress.set(true);
+        }
+
         Ok(())
     }
 }
@@ -714,9 +887,13 @@ impl Drop for ZmqRecvRoutedFuture<'_> {
 }
 
 mod ffi {
+    use crate::core::affinity;
+    use log::warn;
     use std::ffi::CStr;
+    use std::mem;
     use std::ptr;
     use std::slice;
+    use std::sync::Mutex;
 
     pub const WZMQ_PAIR: libc::c_int = 0;
     pub const WZMQ_PUB: libc::c_int = 1;
@@ -800,12 +977,70 @@ mod ffi {
         }
     }
 
+    static IO_THREAD_CPUS: Mutex<Vec<usize>> = Mutex::new(Vec::new());
+
+    // libzmq starts the I/O threads of a context when its first socket is
+    // created, and new threads inherit the affinity of their creator. so, to
+    // place the I/O threads, pin the calling thread while creating a socket
+    fn start_io_threads(ctx: &zmq::Context, cpus: &[usize]) {
+        let prev = match affinity::current_thread_cpus() {
+            Ok(prev) => prev,
+            Err(e) => {
+                warn!("failed to get thread affinity: {}", e);
+                return;
+            }
+        };
+
+        if let Err(e) = affinity::set_current_thread_cpus(cpus) {
+            warn!("failed to set zmq I/O thread affinity: {}", e);
+            return;
+        }
+
+        if let Err(e) = ctx.socket(zmq::PAIR) {
+            warn!("failed to start zmq I/O threads: {}", e);
+        }
+
+        if let Err(e) = affinity::set_current_thread_cpus(&prev) {
+            warn!("failed to restore thread affinity: {}", e);
+        }
+    }
+
+    // applies to contexts created afterwards. returns 0 on success, or -1 if
+    // the list is invalid. an empty list disables pinning
+    #[allow(clippy::missing_safety_doc)]
+    #[no_mangle]
+    pub unsafe extern "C" fn wzmq_set_io_thread_cpus(cpus: *const libc::c_char) -> libc::c_int {
+        let cpus = match CStr::from_ptr(cpus).to_str() {
+            Ok(s) => s,
+            Err(_) => return -1,
+        };
+
+        let cpus = if cpus.is_empty() {
+            Vec::new()
+        } else {
+            match affinity::parse_cpu_list(cpus) {
+                Ok(cpus) => cpus,
+                Err(()) => return -1,
+            }
+        };
+
+        *IO_THREAD_CPUS.lock().unwrap() = cpus;
+
+        0
+    }
+
     #[no_mangle]
     pub extern "C" fn wzmq_init(_io_threads: libc::c_int) -> *mut () {
         let ctx = zmq::Context::new();
 
         // NOTE: io_threads is ignored since zmq 0.9 doesn't provide a way to specify it
 
+        let cpus = IO_THREAD_CPUS.lock().unwrap().clone();
+
+        if !cpus.is_empty() {
+            start_io_threads(&ctx, &cpus);
+        }
+
         Box::into_raw(Box::new(ctx)) as *mut ()
     }
 
@@ -1432,6 +1667,52 @@ mod ffi {
 
         size as libc::c_int
     }
+
+    /// Sends a frame without copying it. `ffn` is called with `data` and
+    /// `hint` once the buffer is no longer needed, possibly from another
+    /// thread, including when sending fails.
+    #[allow(clippy::missing_safety_doc)]
+    #[no_mangle]
+    pub unsafe extern "C" fn wzmq_send_data(
+        socket: *mut (),
+        data: *mut libc::c_void,
+        size: libc::size_t,
+        ffn: unsafe extern "C" fn(*mut libc::c_void, *mut libc::c_void),
+        hint: *mut libc::c_void,
+        flags: libc::c_int,
+    ) -> libc::c_int {
+        let sock = match (socket as *mut zmq::Socket).as_mut() {
+            Some(sock) => sock,
+            None => {
+                ffn(data, hint);
+                return -1;
+            }
+        };
+
+        let mut msg = mem::MaybeUninit::<zmq_sys::zmq_msg_t>::uninit();
+
+        if zmq_sys::zmq_msg_init_data(msg.as_mut_ptr(), data, size, Some(ffn), hint) != 0 {
+            let e = zmq_sys::zmq_errno();
+            ffn(data, hint);
+            set_errno(e);
+            return -1;
+        }
+
+        let ret =
+            zmq_sys::zmq_msg_send(msg.as_mut_ptr(), sock.as_mut_ptr(), convert_io_flags(flags));
+
+        if ret < 0 {
+            let e = zmq_sys::zmq_errno();
+
+            // releases the buffer
+            zmq_sys::zmq_msg_close(msg.as_mut_ptr());
+
+            set_errno(e);
+            return -1;
+        }
+
+        ret
+    }
 }
 
 #[cfg(test)]
@@ -1479,6 +1760,44 @@ mod tests {
         assert_eq!(s.events().contains(zmq::POLLOUT), false);
     }
 
+    #[test]
+    fn compressed_frames() {
+        let data = b"Host: example.com\r\nUser-Agent: curl/8.5.0\r\nAccept: */*\r\n".repeat(8);
+
+        let c = compress_frame(&data).unwrap();
+        assert!(c.len() < data.len());
+        assert!(is_compressed_frame(&c));
+        assert_eq!(decompress_frame(&c).unwrap(), data);
+
+        // small frames are left alone
+        assert!(compress_frame(b"T4:test,").is_none());
+        assert!(!is_compressed_frame(b"T4:test,"));
+
+        // zmq generated identities start with a zero byte
+        assert!(!is_compressed_frame(b"\x00\x6b\x8b\x45\x67"));
+
+        let mut bad = c.clone();
+        bad[COMPRESSED_FRAME_HEADER_SIZE - 1] ^= 0xff;
+        assert!(decompress_frame(&bad).is_err());
+
+        let mut bad = c.clone();
+        bad.truncate(c.len() - 4);
+        assert!(decompress_frame(&bad).is_err());
+
+        let context = zmq::Context::new();
+
+        let s = ZmqSocket::new(&context, zmq::PUSH);
+        s.set_compression_enabled(true);
+        s.inner().bind("inproc://compressed-frames").unwrap();
+
+        let r = ZmqSocket::new(&context, zmq::PULL);
+        r.inner().connect("inproc://compressed-frames").unwrap();
+
+        s.send(zmq::Message::from(&data[..]), 0).unwrap();
+
+        assert_eq!(r.recv(0).unwrap(), zmq::Message::from(&data[..]));
+    }
+
     #[test]
     fn async_send_recv() {
         let reactor = Reactor::new(2);
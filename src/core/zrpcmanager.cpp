@@ -25,6 +25,7 @@
 
 #include <assert.h>
 #include <QStringList>
+#include <QSet>
 #include <QFile>
 #include "qzmqsocket.h"
 #include "qzmqvalve.h"
@@ -35,6 +36,8 @@
 #include "packet/zrpcresponsepacket.h"
 #include "zrpcrequest.h"
 #include "zutil.h"
+#include "timer.h"
+#include "defercall.h"
 
 #define OUT_HWM 100
 #define IN_HWM 100
@@ -44,6 +47,12 @@
 
 #define PENDING_MAX 100
 
+// packets per message, whether requests or responses
+#define BATCH_MAX 32
+
+// peers known to accept batched responses
+#define BATCH_PEERS_MAX 1000
+
 class ZrpcManager::Private
 {
 public:
@@ -54,11 +63,19 @@ public:
 		ZrpcRequestPacket packet;
 	};
 
+	class PendingResponses
+	{
+	public:
+		QList<QByteArray> headers;
+		QList<QByteArray> bufs;
+	};
+
 	ZrpcManager *q;
 	QByteArray instanceId;
 	int ipcFileMode;
 	bool doBind;
 	int timeout;
+	int batchWindow;
 	QStringList clientSpecs;
 	QStringList serverSpecs;
 	std::unique_ptr<QZmq::Socket> clientSock;
@@ -67,20 +84,34 @@ public:
 	std::unique_ptr<QZmq::Valve> serverValve;
 	QHash<QByteArray, ZrpcRequest*> clientReqsById;
 	QList<PendingItem> pending;
+	QList<QByteArray> pendingRequests;
+	bool requestFlushPending;
+	std::unique_ptr<Timer> batchTimer;
+	QSet<QByteArray> batchPeers;
+	QHash<QByteArray, PendingResponses> pendingResponses;
+	bool responseFlushPending;
 	Connection clientValveConnection;
 	Connection serverValveConnection;
+	Connection batchTimerConnection;
+	DeferCall deferCall;
 
 	Private(ZrpcManager *_q) :
 		q(_q),
 		ipcFileMode(-1),
 		doBind(false),
-		timeout(-1)
+		timeout(-1),
+		batchWindow(-1),
+		requestFlushPending(false),
+		responseFlushPending(false)
 	{
 	}
 
 	~Private()
 	{
 		assert(clientReqsById.isEmpty());
+
+		while(!pendingResponses.isEmpty())
+			flushResponses(pendingResponses.begin().key());
 	}
 
 	bool setupClient()
@@ -89,6 +120,8 @@ public:
 		clientValve.reset();
 		clientSock.reset();
 
+		pendingRequests.clear();
+
 		clientSock = std::make_unique<QZmq::Socket>(QZmq::Socket::Dealer);
 
 		clientSock->setSendHwm(OUT_HWM);
@@ -115,6 +148,9 @@ public:
 		serverValve.reset();
 		serverSock.reset();
 
+		batchPeers.clear();
+		pendingResponses.clear();
+
 		serverSock = std::make_unique<QZmq::Socket>(QZmq::Socket::Router);
 
 		serverSock->setReceiveHwm(IN_HWM);
@@ -148,7 +184,69 @@ public:
 		if(log_outputLevel() >= LOG_LEVEL_DEBUG)
 			log_debug("zrpc client: OUT %s", qPrintable(TnetString::variantToString(vpacket, -1)));
 
-		clientSock->write(QList<QByteArray>() << QByteArray() << buf);
+		if(batchWindow < 0)
+		{
+			clientSock->write(QList<QByteArray>() << QByteArray() << buf);
+			return;
+		}
+
+		pendingRequests += buf;
+
+		if(pendingRequests.count() >= BATCH_MAX)
+		{
+			flushRequests();
+			return;
+		}
+
+		if(!requestFlushPending)
+		{
+			requestFlushPending = true;
+
+			if(batchWindow > 0)
+			{
+				if(!batchTimer)
+				{
+					batchTimer = std::make_unique<Timer>();
+					batchTimerConnection = batchTimer->timeout.connect(boost::bind(&Private::flushRequests, this));
+					batchTimer->setSingleShot(true);
+				}
+
+				batchTimer->start(batchWindow);
+			}
+			else
+			{
+				deferCall.defer([&] { flushRequests(); });
+			}
+		}
+	}
+
+	// requests written within the batch window go out as one message with
+	// a part per request
+	void flushRequests()
+	{
+		requestFlushPending = false;
+
+		if(batchTimer)
+			batchTimer->stop();
+
+		if(pendingRequests.isEmpty() || !clientSock)
+			return;
+
+		QList<QByteArray> message;
+		message += QByteArray();
+		message += pendingRequests;
+		pendingRequests.clear();
+
+		clientSock->write(message);
+	}
+
+	static QByteArray peerKey(const QList<QByteArray> &headers)
+	{
+		QByteArray out;
+		foreach(const QByteArray &h, headers)
+			out += QByteArray::number(h.size()) + ':' + h;
+
+		return out;
 	}
 
 	void write(const QList<QByteArray> &headers, const ZrpcResponsePacket &packet)
@@ -161,18 +259,63 @@ public:
 		if(log_outputLevel() >= LOG_LEVEL_DEBUG)
 			log_debug("zrpc server: OUT %s", qPrintable(TnetString::variantToString(vpacket, -1)));
 
+		// only peers that have sent batches are sent batches
+		QByteArray key = peerKey(headers);
+		if(!batchPeers.contains(key))
+		{
+			QList<QByteArray> message;
+			message += headers;
+			message += QByteArray();
+			message += buf;
+			serverSock->write(message);
+			return;
+		}
+
+		PendingResponses &r = pendingResponses[key];
+		if(r.bufs.isEmpty())
+			r.headers = headers;
+
+		r.bufs += buf;
+
+		if(r.bufs.count() >= BATCH_MAX)
+		{
+			flushResponses(key);
+			return;
+		}
+
+		if(!responseFlushPending)
+		{
+			responseFlushPending = true;
+			deferCall.defer([&] {
+				responseFlushPending = false;
+
+				while(!pendingResponses.isEmpty())
+					flushResponses(pendingResponses.begin().key());
+			});
+		}
+	}
+
+	void flushResponses(const QByteArray &key)
+	{
+		QHash<QByteArray, PendingResponses>::iterator it = pendingResponses.find(key);
+		if(it == pendingResponses.end())
+			return;
+
+		PendingResponses r = it.value();
+		pendingResponses.erase(it);
+
 		QList<QByteArray> message;
-		message += headers;
+		message += r.headers;
 		message += QByteArray();
-		message += buf;
+		message += r.bufs;
 		serverSock->write(message);
 	}
 
 	void client_readyRead(const QList<QByteArray> &message)
 	{
-		if(message.count() != 2)
+		if(message.count() < 2)
 		{
-			log_warning("zrpc client: received message with parts != 2, skipping");
+			log_warning("zrpc client: received message with parts < 2, skipping");
 			return;
 		}
 
@@ -182,7 +325,14 @@ public:
 			return;
 		}
 
-		QVariant data = TnetString::toVariant(message[1]);
+		// a batch carries one response per part
+		for(int n = 1; n < message.count(); ++n)
+			handleResponse(message[n]);
+	}
+
+	void handleResponse(const QByteArray &buf)
+	{
+		QVariant data = TnetString::toVariant(buf);
 		if(data.isNull())
 		{
 			log_warning("zrpc client: received message with invalid format (tnetstring parse failed), skipping");
@@ -213,17 +363,44 @@ public:
 	{
 		QZmq::ReqMessage req(message);
 
-		if(req.content().count() != 1)
+		if(req.content().isEmpty())
 		{
-			log_warning("zrpc server: received message with parts != 1, skipping");
+			log_warning("zrpc server: received message with no content parts, skipping");
 			return;
 		}
 
-		QVariant data = TnetString::toVariant(req.content()[0]);
+		if(req.content().count() > 1)
+		{
+			QByteArray key = peerKey(req.headers());
+			if(batchPeers.count() < BATCH_PEERS_MAX)
+				batchPeers += key;
+		}
+
+		bool added = false;
+
+		// a batch carries one request per part
+		foreach(const QByteArray &buf, req.content())
+		{
+			if(handleRequest(req.headers(), buf))
+				added = true;
+		}
+
+		if(!added)
+			return;
+
+		if(pending.count() >= PENDING_MAX)
+			serverValve->close();
+
+		q->requestReady();
+	}
+
+	bool handleRequest(const QList<QByteArray> &headers, const QByteArray &buf)
+	{
+		QVariant data = TnetString::toVariant(buf);
 		if(data.isNull())
 		{
 			log_warning("zrpc server: received message with invalid format (tnetstring parse failed), skipping");
-			return;
+			return false;
 		}
 
 		if(log_outputLevel() >= LOG_LEVEL_DEBUG)
@@ -233,18 +410,15 @@ public:
 		if(!p.fromVariant(data))
 		{
 			log_warning("zrpc server: received message with invalid format (parse failed), skipping");
-			return;
+			return false;
 		}
 
 		PendingItem i;
-		i.headers = req.headers();
+		i.headers = headers;
 		i.packet = p;
 		pending += i;
 
-		if(pending.count() >= PENDING_MAX)
-			serverValve->close();
-
-		q->requestReady();
+		return true;
 	}
 };
 
@@ -283,6 +457,11 @@ void ZrpcManager::setTimeout(int ms)
 	d->timeout = ms;
 }
 
+void ZrpcManager::setBatchWindow(int ms)
+{
+	d->batchWindow = ms;
+}
+
 bool ZrpcManager::setClientSpecs(const QStringList &specs)
 {
 	d->clientSpecs = specs;
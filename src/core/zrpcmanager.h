@@ -46,6 +46,12 @@ public:
 	void setIpcFileMode(int mode);
 	void setBind(bool enable);
 	void setTimeout(int ms);
+
+	// collect requests written within the window and send them as one
+	// message. zero batches within the current event loop iteration, and
+	// negative (the default) disables batching. the server must support
+	// batches
+	void setBatchWindow(int ms);
 	void setUnavailableOnTimeout(bool enable);
 
 	bool setClientSpecs(const QStringList &specs);
@@ -25,6 +25,7 @@
 
 #include <assert.h>
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 #include "packet/zrpcrequestpacket.h"
 #include "packet/zrpcresponsepacket.h"
 #include "zrpcmanager.h"
@@ -33,8 +34,6 @@
 #include "timer.h"
 #include "defercall.h"
 
-using Connection = boost::signals2::scoped_connection;
-
 class ZrpcRequest::Private
 {
 public:
@@ -135,6 +134,27 @@ public:
 		q->finished();
 	}
 
+	void complete(bool _success, const QVariant &value, ErrorCondition _condition, const QByteArray &_conditionString)
+	{
+		cleanup();
+
+		success = _success;
+		result = value;
+
+		if(success)
+		{
+			q->onSuccess();
+		}
+		else
+		{
+			condition = _condition;
+			conditionString = _conditionString;
+			q->onError();
+		}
+
+		q->finished();
+	}
+
 	void doStart()
 	{
 		if(!manager->canWriteImmediately())
@@ -254,6 +274,11 @@ void ZrpcRequest::setError(ErrorCondition condition, const QVariant &result)
 	d->result = result;
 }
 
+void ZrpcRequest::complete(bool success, const QVariant &result, ErrorCondition condition, const QByteArray &conditionString)
+{
+	d->complete(success, result, condition, conditionString);
+}
+
 void ZrpcRequest::onSuccess()
 {
 	// by default, do nothing
@@ -266,7 +291,7 @@ void ZrpcRequest::onError()
 
 void ZrpcRequest::setupClient(ZrpcManager *manager)
 {
-	d->id = UuidUtil::createUuid();
+	d->id = UuidUtil::createId();
 	d->manager = manager;
 	d->manager->link(this);
 }
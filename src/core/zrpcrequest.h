@@ -26,6 +26,7 @@
 
 #include <QVariant>
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 
 using Signal = boost::signals2::signal<void()>;
 
@@ -62,13 +63,17 @@ public:
 
 	void setError(ErrorCondition condition, const QVariant &result = QVariant());
 
-	Signal finished;
-	Signal destroyed;
+	FastSignal<> finished;
+	FastSignal<> destroyed;
 
 protected:
 	virtual void onSuccess();
 	virtual void onError();
 
+	// finishes a request that was not started, with a response delivered
+	// some other way, such as within the response to a batch
+	void complete(bool success, const QVariant &result, ErrorCondition condition = ErrorGeneric, const QByteArray &conditionString = QByteArray());
+
 private:
 	class Private;
 	Private *d;
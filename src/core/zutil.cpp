@@ -75,8 +75,11 @@ bool setupSocket(QZmq::Socket *sock, const QStringList &specs, bool bind, int ip
 {
 	if(bind)
 	{
-		if(!bindSpec(sock, specs[0], ipcFileMode, errorMessage))
-			return false;
+		foreach(const QString &spec, specs)
+		{
+			if(!bindSpec(sock, spec, ipcFileMode, errorMessage))
+				return false;
+		}
 	}
 	else
 	{
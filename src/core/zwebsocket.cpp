@@ -30,11 +30,15 @@
 #include "timer.h"
 #include "defercall.h"
 #include "zhttpmanager.h"
-#include "uuidutil.h"
+#include "ringqueue.h"
 
 #define IDEAL_CREDITS 200000
 #define SESSION_EXPIRE 60000
 #define KEEPALIVE_INTERVAL 45000
+#define TIMER_SLACK 500
+
+// limit of content joined into one outgoing fragment by writeMessage
+#define MESSAGE_JOIN_MAX 65536
 
 class ZWebSocket::Private
 {
@@ -84,8 +88,8 @@ public:
 	ErrorCondition errorCondition;
 	std::unique_ptr<Timer> expireTimer;
 	std::unique_ptr<Timer> keepAliveTimer;
-	QList<Frame> inFrames;
-	QList<Frame> outFrames;
+	RingQueue<Frame> inFrames;
+	RingQueue<Frame> outFrames;
 	int inSize;
 	int outSize;
 	int inContentType;
@@ -125,9 +129,11 @@ public:
 		expireTimer = std::make_unique<Timer>();
 		expireTimer->timeout.connect(boost::bind(&Private::expire_timeout, this));
 		expireTimer->setSingleShot(true);
+		expireTimer->setSlack(TIMER_SLACK);
 
 		keepAliveTimer = std::make_unique<Timer>();
 		keepAliveTimer->timeout.connect(boost::bind(&Private::keepAlive_timeout, this));
+		keepAliveTimer->setSlack(TIMER_SLACK);
 	}
 
 	~Private()
@@ -295,6 +301,33 @@ public:
 		return f;
 	}
 
+	Frame readMessage(int maxSize)
+	{
+		Frame f = inFrames.takeFirst();
+		inSize -= f.data.size();
+		pendingInCredits += f.data.size();
+
+		if(f.type == Frame::Text || f.type == Frame::Binary || f.type == Frame::Continuation)
+		{
+			while(f.more && !inFrames.isEmpty())
+			{
+				const Frame &next = inFrames.first();
+				if(next.type != Frame::Continuation || f.data.size() + next.data.size() > maxSize)
+					break;
+
+				f.data += next.data;
+				f.more = next.more;
+
+				inSize -= next.data.size();
+				pendingInCredits += next.data.size();
+				inFrames.removeFirst();
+			}
+		}
+
+		update();
+		return f;
+	}
+
 	void writeFrame(const Frame &frame)
 	{
 		if(state != Connected && state != ConnectedPeerClosed)
@@ -305,6 +338,30 @@ public:
 		update();
 	}
 
+	void writeMessage(const Frame &frame)
+	{
+		if(state != Connected && state != ConnectedPeerClosed)
+			return;
+
+		if(frame.type == Frame::Continuation && !outFrames.isEmpty())
+		{
+			Frame &last = outFrames.last();
+
+			// the last fragment is still queued, so it can be sent as one
+			//   packet together with this one
+			if((last.type == Frame::Text || last.type == Frame::Binary || last.type == Frame::Continuation) && last.more && last.data.size() + frame.data.size() <= MESSAGE_JOIN_MAX)
+			{
+				last.data += frame.data;
+				last.more = frame.more;
+				outSize += frame.data.size();
+				update();
+				return;
+			}
+		}
+
+		writeFrame(frame);
+	}
+
 	void close(int code, const QString &reason)
 	{
 		if((state != Connected && state != ConnectedPeerClosed) || outClosed)
@@ -756,6 +813,8 @@ public:
 			assert(!toAddress.isEmpty());
 			manager->writeWs(out, toAddress);
 		}
+
+		manager->keepAliveActivity(q);
 	}
 
 	void writePacket(const ZhttpResponsePacket &packet)
@@ -768,6 +827,8 @@ public:
 		out.userData = userData;
 
 		manager->writeWs(out, rid.first, routerResp);
+
+		manager->keepAliveActivity(q);
 	}
 
 	void writeFrameInternal(const Frame &frame, int credits = -1)
@@ -1246,6 +1307,16 @@ WebSocket::Frame ZWebSocket::readFrame()
 	return d->readFrame();
 }
 
+WebSocket::Frame ZWebSocket::readMessage(int maxSize)
+{
+	return d->readMessage(maxSize);
+}
+
+void ZWebSocket::writeMessage(const Frame &frame)
+{
+	d->writeMessage(frame);
+}
+
 void ZWebSocket::close(int code, const QString &reason)
 {
 	d->close(code, reason);
@@ -1254,8 +1325,7 @@ void ZWebSocket::close(int code, const QString &reason)
 void ZWebSocket::setupClient(ZhttpManager *manager)
 {
 	d->manager = manager;
-	d->rid = Rid(manager->instanceId(), UuidUtil::createUuid());
-	d->manager->link(this);
+	d->rid = Rid(manager->instanceId(), manager->linkClient(this));
 }
 
 bool ZWebSocket::setupServer(ZhttpManager *manager, const QByteArray &id, int seq, const ZhttpRequestPacket &packet)
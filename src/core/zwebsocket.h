@@ -26,8 +26,7 @@
 
 #include "websocket.h"
 #include <boost/signals2.hpp>
-
-using Connection = boost::signals2::scoped_connection;
+#include "fastsignal.h"
 
 class ZhttpRequestPacket;
 class ZhttpResponsePacket;
@@ -74,6 +73,8 @@ public:
 
 	virtual void writeFrame(const Frame &frame);
 	virtual Frame readFrame();
+	virtual Frame readMessage(int maxSize);
+	virtual void writeMessage(const Frame &frame);
 	virtual void close(int code = -1, const QString &reason = QString());
 
 private:
@@ -0,0 +1,22 @@
+TEMPLATE = lib
+CONFIG -= app_bundle
+CONFIG += staticlib c++17
+QT -= gui
+QT *= network
+TARGET = pushpin-cppbench
+
+cpp_build_dir = $$OUT_PWD
+
+MOC_DIR = $$cpp_build_dir/bench-moc
+OBJECTS_DIR = $$cpp_build_dir/bench-obj
+
+include($$cpp_build_dir/conf.pri)
+
+SRC_DIR = $$PWD
+
+INCLUDEPATH += $$SRC_DIR/../target/include
+INCLUDEPATH += $$SRC_DIR/core
+
+include(core/benches.pri)
+include(proxy/benches.pri)
+include(handler/benches.pri)
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "channelatoms.h"
+
+#include <assert.h>
+
+int ChannelAtoms::acquire(const QString &channel)
+{
+	int id = ids_.value(channel, -1);
+	if(id == -1)
+	{
+		if(!freeIds_.empty())
+		{
+			id = freeIds_.back();
+			freeIds_.pop_back();
+		}
+		else
+		{
+			id = (int)atoms_.size();
+			atoms_.push_back(Atom());
+		}
+
+		Atom &a = atoms_[id];
+		a.name = channel;
+		a.utf8 = channel.toUtf8();
+
+		ids_.insert(channel, id);
+	}
+
+	++atoms_[id].refs;
+
+	return id;
+}
+
+void ChannelAtoms::release(int id)
+{
+	assert(id >= 0 && id < (int)atoms_.size());
+
+	Atom &a = atoms_[id];
+	assert(a.refs > 0);
+
+	if(--a.refs > 0)
+		return;
+
+	ids_.remove(a.name);
+
+	// release the memory, but keep the slot for reuse
+	a = Atom();
+	freeIds_.push_back(id);
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef CHANNELATOMS_H
+#define CHANNELATOMS_H
+
+#include <vector>
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+
+// interns channel names to small integer ids, shared by the structures of
+// an engine that index by channel. each name is stored once, along with its
+// utf-8 form. ids are reference counted, and an id is freed for reuse when
+// its last reference is released
+class ChannelAtoms
+{
+public:
+	// returns the id of the channel, adding it if needed, and takes a
+	// reference to it
+	int acquire(const QString &channel);
+
+	void release(int id);
+
+	// returns -1 if the channel has no id
+	int find(const QString &channel) const { return ids_.value(channel, -1); }
+
+	const QString & name(int id) const { return atoms_[id].name; }
+	const QByteArray & utf8(int id) const { return atoms_[id].utf8; }
+
+	int count() const { return ids_.count(); }
+
+	// one more than the largest id ever handed out
+	int capacity() const { return (int)atoms_.size(); }
+
+private:
+	class Atom
+	{
+	public:
+		QString name;
+		QByteArray utf8;
+		int refs;
+
+		Atom() :
+			refs(0)
+		{
+		}
+	};
+
+	QHash<QString, int> ids_;
+	std::vector<Atom> atoms_;
+	std::vector<int> freeIds_;
+};
+
+#endif
@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef CHANNELINDEX_H
+#define CHANNELINDEX_H
+
+#include <assert.h>
+#include <memory>
+#include <vector>
+#include <QString>
+#include <QHash>
+#include "channelatoms.h"
+
+// maps channels to their subscribers. channel names are interned to dense
+// ids, and the subscribers of each channel are kept in a contiguous array
+// that can be iterated in place. removal swaps with the last element, so
+// subscriber order is not preserved. indexes can share an atom table, so
+// that each channel name is stored once and looked up once for all of them
+template <typename T> class ChannelIndex
+{
+public:
+	typedef std::vector<T*> Subscribers;
+
+	// if atoms is null, the index uses its own table
+	ChannelIndex(ChannelAtoms *atoms = 0) :
+		atoms_(atoms)
+	{
+		if(!atoms_)
+		{
+			ownAtoms_ = std::make_unique<ChannelAtoms>();
+			atoms_ = ownAtoms_.get();
+		}
+	}
+
+	bool contains(const QString &channel) const
+	{
+		return subscribers(channel) != 0;
+	}
+
+	int channelCount() const
+	{
+		return (int)(entries_.size() - freeEntries_.size());
+	}
+
+	int count(const QString &channel) const
+	{
+		const Subscribers *subs = subscribers(channel);
+		return subs ? (int)subs->size() : 0;
+	}
+
+	// returns null if the channel has no subscribers. the returned array is
+	// invalidated by any change to the index, so callers that may cause
+	// subscriptions to change while iterating need to copy it first
+	const Subscribers *subscribers(const QString &channel) const
+	{
+		return subscribersById(atoms_->find(channel));
+	}
+
+	// same as above, for an id from the atom table. avoids looking up the
+	// name again when checking several indexes that share a table
+	const Subscribers *subscribersById(int id) const
+	{
+		int pos = entryPos(id);
+		if(pos == -1)
+			return 0;
+
+		return &entries_[pos].subs;
+	}
+
+	// returns the number of subscribers of the channel after adding
+	int add(const QString &channel, T *s)
+	{
+		int pos = entryPos(atoms_->find(channel));
+		if(pos == -1)
+		{
+			// the index holds one reference to the atom while the channel
+			// has subscribers
+			int id = atoms_->acquire(channel);
+
+			if(!freeEntries_.empty())
+			{
+				pos = freeEntries_.back();
+				freeEntries_.pop_back();
+			}
+			else
+			{
+				pos = (int)entries_.size();
+				entries_.push_back(Entry());
+			}
+
+			if(id >= (int)positions_.size())
+				positions_.resize(id + 1, -1);
+
+			positions_[id] = pos;
+		}
+
+		Entry &e = entries_[pos];
+
+		if(!e.positions.contains(s))
+		{
+			e.positions.insert(s, (int)e.subs.size());
+			e.subs.push_back(s);
+		}
+
+		return (int)e.subs.size();
+	}
+
+	// returns the number of subscribers remaining, or -1 if the subscriber
+	// was not found. the channel is dropped when its last subscriber is
+	// removed
+	int remove(const QString &channel, T *s)
+	{
+		int id = atoms_->find(channel);
+		int epos = entryPos(id);
+		if(epos == -1)
+			return -1;
+
+		Entry &e = entries_[epos];
+
+		typename QHash<T*, int>::iterator it = e.positions.find(s);
+		if(it == e.positions.end())
+			return -1;
+
+		int pos = it.value();
+		e.positions.erase(it);
+
+		assert(pos < (int)e.subs.size());
+
+		T *last = e.subs.back();
+		e.subs.pop_back();
+
+		if(last != s)
+		{
+			e.subs[pos] = last;
+			e.positions[last] = pos;
+		}
+
+		int remaining = (int)e.subs.size();
+
+		if(remaining == 0)
+		{
+			// release the memory, but keep the slot for reuse
+			e = Entry();
+			freeEntries_.push_back(epos);
+
+			positions_[id] = -1;
+			atoms_->release(id);
+		}
+
+		return remaining;
+	}
+
+private:
+	class Entry
+	{
+	public:
+		Subscribers subs;
+		QHash<T*, int> positions;
+	};
+
+	std::unique_ptr<ChannelAtoms> ownAtoms_;
+	ChannelAtoms *atoms_;
+	std::vector<int> positions_; // k=atom id, v=entry position or -1
+	std::vector<Entry> entries_;
+	std::vector<int> freeEntries_;
+
+	int entryPos(int id) const
+	{
+		if(id < 0 || id >= (int)positions_.size())
+			return -1;
+
+		return positions_[id];
+	}
+};
+
+#endif
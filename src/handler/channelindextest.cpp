@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "test.h"
+#include "channelindex.h"
+
+class Sub
+{
+public:
+	int id;
+
+	Sub(int _id) :
+		id(_id)
+	{
+	}
+};
+
+static bool has(const ChannelIndex<Sub>::Subscribers *subs, Sub *s)
+{
+	if(!subs)
+		return false;
+
+	for(Sub *i : *subs)
+	{
+		if(i == s)
+			return true;
+	}
+
+	return false;
+}
+
+static void addRemove()
+{
+	ChannelIndex<Sub> index;
+	Sub a(1), b(2), c(3);
+
+	TEST_ASSERT(!index.contains("apple"));
+	TEST_ASSERT(!index.subscribers("apple"));
+	TEST_ASSERT_EQ(index.count("apple"), 0);
+
+	TEST_ASSERT_EQ(index.add("apple", &a), 1);
+	TEST_ASSERT_EQ(index.add("apple", &b), 2);
+	TEST_ASSERT_EQ(index.add("apple", &c), 3);
+
+	// adding twice is a no-op
+	TEST_ASSERT_EQ(index.add("apple", &b), 3);
+
+	TEST_ASSERT_EQ(index.add("banana", &a), 1);
+	TEST_ASSERT_EQ(index.channelCount(), 2);
+
+	// remove from the middle
+	TEST_ASSERT_EQ(index.remove("apple", &a), 2);
+	TEST_ASSERT(!has(index.subscribers("apple"), &a));
+	TEST_ASSERT(has(index.subscribers("apple"), &b));
+	TEST_ASSERT(has(index.subscribers("apple"), &c));
+
+	// not present
+	TEST_ASSERT_EQ(index.remove("apple", &a), -1);
+	TEST_ASSERT_EQ(index.remove("cherry", &a), -1);
+
+	// moved element is still tracked correctly
+	TEST_ASSERT_EQ(index.remove("apple", &c), 1);
+	TEST_ASSERT_EQ(index.remove("apple", &b), 0);
+	TEST_ASSERT(!index.contains("apple"));
+	TEST_ASSERT_EQ(index.channelCount(), 1);
+
+	TEST_ASSERT(has(index.subscribers("banana"), &a));
+}
+
+static void reuseSlots()
+{
+	ChannelIndex<Sub> index;
+	Sub a(1), b(2);
+
+	index.add("apple", &a);
+	index.remove("apple", &a);
+
+	// the freed slot must not carry over old subscribers
+	TEST_ASSERT_EQ(index.add("banana", &b), 1);
+	TEST_ASSERT(has(index.subscribers("banana"), &b));
+	TEST_ASSERT(!has(index.subscribers("banana"), &a));
+	TEST_ASSERT(!index.contains("apple"));
+}
+
+static void sharedAtoms()
+{
+	ChannelAtoms atoms;
+	ChannelIndex<Sub> a(&atoms), b(&atoms);
+	Sub x(1), y(2);
+
+	a.add("apple", &x);
+	b.add("apple", &y);
+	b.add("banana", &y);
+
+	// one id per name, whichever index added it
+	TEST_ASSERT_EQ(atoms.count(), 2);
+
+	int id = atoms.find("apple");
+	TEST_ASSERT(id >= 0);
+	TEST_ASSERT_EQ(atoms.name(id), QString("apple"));
+	TEST_ASSERT_EQ(atoms.utf8(id), QByteArray("apple"));
+	TEST_ASSERT(has(a.subscribersById(id), &x));
+	TEST_ASSERT(has(b.subscribersById(id), &y));
+
+	// no subscribers in a, though the name is known
+	TEST_ASSERT(!a.subscribersById(atoms.find("banana")));
+	TEST_ASSERT(!a.subscribersById(-1));
+
+	// the name is kept until no index uses it
+	a.remove("apple", &x);
+	TEST_ASSERT_EQ(atoms.find("apple"), id);
+	b.remove("apple", &y);
+	TEST_ASSERT_EQ(atoms.find("apple"), -1);
+	TEST_ASSERT_EQ(atoms.count(), 1);
+
+	// freed ids are reused
+	TEST_ASSERT_EQ(atoms.acquire("cherry"), id);
+	atoms.release(id);
+	TEST_ASSERT_EQ(atoms.capacity(), 2);
+}
+
+extern "C" int channelindex_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(addRemove());
+	TEST_CATCH(reuseSlots());
+	TEST_CATCH(sharedAtoms());
+
+	return 0;
+}
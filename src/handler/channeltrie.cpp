@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "channeltrie.h"
+
+#include <assert.h>
+
+ChannelTrie::ChannelTrie() :
+	count_(0)
+{
+	nodes_.push_back(Node());
+}
+
+bool ChannelTrie::contains(const QString &prefix) const
+{
+	int pos = find(prefix);
+
+	return (pos != -1 && nodes_[pos].refs > 0);
+}
+
+int ChannelTrie::add(const QString &prefix)
+{
+	int pos = 0;
+
+	for(QChar c : prefix)
+	{
+		int next = nodes_[pos].children.value(c, -1);
+		if(next == -1)
+		{
+			if(!freeNodes_.empty())
+			{
+				next = freeNodes_.back();
+				freeNodes_.pop_back();
+			}
+			else
+			{
+				next = (int)nodes_.size();
+				nodes_.push_back(Node());
+			}
+
+			nodes_[pos].children.insert(c, next);
+		}
+
+		pos = next;
+	}
+
+	Node &n = nodes_[pos];
+
+	if(n.refs == 0)
+		++count_;
+
+	return ++n.refs;
+}
+
+int ChannelTrie::remove(const QString &prefix)
+{
+	std::vector<int> path;
+	path.reserve(prefix.length() + 1);
+
+	int pos = 0;
+	path.push_back(pos);
+
+	for(QChar c : prefix)
+	{
+		pos = nodes_[pos].children.value(c, -1);
+		if(pos == -1)
+			return -1;
+
+		path.push_back(pos);
+	}
+
+	Node &n = nodes_[pos];
+	if(n.refs == 0)
+		return -1;
+
+	int remaining = --n.refs;
+	if(remaining > 0)
+		return remaining;
+
+	--count_;
+
+	// free the nodes that no longer lead anywhere, from the end back
+	for(int i = prefix.length(); i > 0; --i)
+	{
+		Node &cur = nodes_[path[i]];
+		if(cur.refs > 0 || !cur.children.isEmpty())
+			break;
+
+		// release the memory, but keep the slot for reuse
+		cur = Node();
+		freeNodes_.push_back(path[i]);
+
+		nodes_[path[i - 1]].children.remove(prefix[i - 1]);
+	}
+
+	return 0;
+}
+
+QList<QString> ChannelTrie::prefixesOf(const QString &channel) const
+{
+	QList<QString> out;
+
+	if(count_ == 0)
+		return out;
+
+	int pos = 0;
+	if(nodes_[pos].refs > 0)
+		out += QString();
+
+	for(int i = 0; i < channel.length(); ++i)
+	{
+		pos = nodes_[pos].children.value(channel[i], -1);
+		if(pos == -1)
+			break;
+
+		if(nodes_[pos].refs > 0)
+			out += channel.left(i + 1);
+	}
+
+	return out;
+}
+
+int ChannelTrie::find(const QString &prefix) const
+{
+	int pos = 0;
+
+	for(QChar c : prefix)
+	{
+		pos = nodes_[pos].children.value(c, -1);
+		if(pos == -1)
+			return -1;
+	}
+
+	return pos;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef CHANNELTRIE_H
+#define CHANNELTRIE_H
+
+#include <vector>
+#include <QString>
+#include <QList>
+#include <QHash>
+
+// a set of channel prefixes, each reference counted. finding the stored
+// prefixes of a channel walks the trie once along the channel name, so the
+// cost depends on the length of the name rather than the number of
+// prefixes stored
+class ChannelTrie
+{
+public:
+	ChannelTrie();
+
+	// number of distinct prefixes
+	int count() const { return count_; }
+	bool isEmpty() const { return count_ == 0; }
+
+	bool contains(const QString &prefix) const;
+
+	// returns the reference count of the prefix after adding
+	int add(const QString &prefix);
+
+	// returns the remaining reference count, or -1 if the prefix was not
+	// found. nodes that no longer lead to a prefix are freed
+	int remove(const QString &prefix);
+
+	// returns the stored prefixes of the channel, shortest first. a
+	// channel counts as a prefix of itself
+	QList<QString> prefixesOf(const QString &channel) const;
+
+private:
+	class Node
+	{
+	public:
+		QHash<QChar, int> children; // v=node position
+		int refs;
+
+		Node() :
+			refs(0)
+		{
+		}
+	};
+
+	std::vector<Node> nodes_; // the root is at position 0
+	std::vector<int> freeNodes_;
+	int count_;
+
+	int find(const QString &prefix) const;
+};
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "test.h"
+#include "channeltrie.h"
+
+static void addRemove()
+{
+	ChannelTrie trie;
+
+	TEST_ASSERT(trie.isEmpty());
+	TEST_ASSERT(!trie.contains("ticker."));
+	TEST_ASSERT_EQ(trie.remove("ticker."), -1);
+
+	TEST_ASSERT_EQ(trie.add("ticker."), 1);
+	TEST_ASSERT_EQ(trie.add("ticker."), 2);
+	TEST_ASSERT_EQ(trie.add("ticker.us."), 1);
+	TEST_ASSERT_EQ(trie.count(), 2);
+
+	// inner nodes are not prefixes
+	TEST_ASSERT(trie.contains("ticker."));
+	TEST_ASSERT(!trie.contains("ticker"));
+	TEST_ASSERT(!trie.contains("ticker.us"));
+
+	TEST_ASSERT_EQ(trie.remove("ticker"), -1);
+	TEST_ASSERT_EQ(trie.remove("ticker."), 1);
+	TEST_ASSERT_EQ(trie.remove("ticker."), 0);
+	TEST_ASSERT(!trie.contains("ticker."));
+	TEST_ASSERT_EQ(trie.count(), 1);
+
+	// longer prefix is still reachable after the shorter one is gone
+	TEST_ASSERT(trie.contains("ticker.us."));
+	TEST_ASSERT_EQ(trie.remove("ticker.us."), 0);
+	TEST_ASSERT(trie.isEmpty());
+
+	// freed nodes are reused
+	TEST_ASSERT_EQ(trie.add("apple"), 1);
+	TEST_ASSERT(trie.contains("apple"));
+}
+
+static void prefixesOf()
+{
+	ChannelTrie trie;
+
+	trie.add("ticker.");
+	trie.add("ticker.us.");
+	trie.add("ticker.us.aapl");
+	trie.add("news.");
+
+	QList<QString> out = trie.prefixesOf("ticker.us.aapl");
+	TEST_ASSERT_EQ(out.count(), 3);
+	TEST_ASSERT_EQ(out[0], QString("ticker."));
+	TEST_ASSERT_EQ(out[1], QString("ticker.us."));
+	TEST_ASSERT_EQ(out[2], QString("ticker.us.aapl"));
+
+	out = trie.prefixesOf("ticker.eu.sap");
+	TEST_ASSERT_EQ(out.count(), 1);
+	TEST_ASSERT_EQ(out[0], QString("ticker."));
+
+	TEST_ASSERT(trie.prefixesOf("ticker").isEmpty());
+	TEST_ASSERT(trie.prefixesOf("sports.").isEmpty());
+
+	// the empty prefix matches everything
+	trie.add("");
+	out = trie.prefixesOf("sports.");
+	TEST_ASSERT_EQ(out.count(), 1);
+	TEST_ASSERT(out[0].isEmpty());
+}
+
+extern "C" int channeltrie_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(addRemove());
+	TEST_CATCH(prefixesOf());
+
+	return 0;
+}
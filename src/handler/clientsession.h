@@ -23,9 +23,16 @@
 #ifndef CLIENTSESSION_H
 #define CLIENTSESSION_H
 
+#include <QString>
+#include <QHash>
+
 class ClientSession
 {
 public:
+	// k=channel, v=version of the last delta document sent, or 0 if the
+	//   next one must be a snapshot. maintained by HandlerEngine
+	QHash<QString, quint64> deltaVersions;
+
 	virtual ~ClientSession() = default;
 };
 
@@ -48,20 +48,37 @@ ConnCheckWorker::ConnCheckWorker(ZrpcRequest *req, ZrpcManager *proxyControlClie
 			respondError("bad-request");
 			return;
 		}
-
-		cids_ += QString::fromUtf8(vid.toByteArray());
 	}
 
-	foreach(const QString &cid, cids_)
+	cids_.reserve(vids.count());
+
+	// ids stay as byte arrays, the form used by the connection table, and
+	// are checked as they are read
+	QSet<QByteArray> seen;
+	seen.reserve(vids.count());
+	foreach(const QVariant &vid, vids)
 	{
-		if(!stats->checkConnection(cid.toUtf8()))
+		QByteArray cid = vid.toByteArray();
+
+		if(seen.contains(cid))
+			continue;
+
+		seen += cid;
+		cids_ += cid;
+
+		if(!stats->checkConnection(cid))
 			missing_ += cid;
 	}
 
 	if(!missing_.isEmpty())
 	{
+		CidSet missing;
+		missing.reserve(missing_.count());
+		foreach(const QByteArray &cid, missing_)
+			missing += QString::fromUtf8(cid);
+
 		// ask the proxy about any cids we don't know about
-		connCheck_ = std::unique_ptr<Deferred>(ControlRequest::connCheck(proxyControlClient, missing_));
+		connCheck_ = std::unique_ptr<Deferred>(ControlRequest::connCheck(proxyControlClient, missing));
 		finishedConnection_ = connCheck_->finished.connect(boost::bind(&ConnCheckWorker::proxyConnCheck_finished, this, boost::placeholders::_1));
 		return;
 	}
@@ -77,12 +94,13 @@ void ConnCheckWorker::respondError(const QByteArray &condition)
 
 void ConnCheckWorker::doFinish()
 {
-	foreach(const QString &cid, missing_)
-		cids_.remove(cid);
-
 	QVariantList result;
-	foreach(const QString &cid, cids_)
-		result += cid.toUtf8();
+	result.reserve(cids_.count() - missing_.count());
+	foreach(const QByteArray &cid, cids_)
+	{
+		if(!missing_.contains(cid))
+			result += cid;
+	}
 
 	req_->respond(result);
 	setFinished(true);
@@ -95,7 +113,7 @@ void ConnCheckWorker::proxyConnCheck_finished(const DeferredResult &result)
 		CidSet found = result.value.value<CidSet>();
 
 		foreach(const QString &cid, found)
-			missing_.remove(cid);
+			missing_.remove(cid.toUtf8());
 
 		doFinish();
 	}
@@ -25,13 +25,14 @@
 #define CONNCHECKWORKER_H
 
 #include <QByteArray>
+#include <QList>
+#include <QSet>
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 #include "zrpcrequest.h"
 #include "deferred.h"
 #include "cidset.h"
 
-using Connection = boost::signals2::scoped_connection;
-
 class ZrpcManager;
 class StatsManager;
 
@@ -42,8 +43,8 @@ public:
 
 private:
 	std::unique_ptr<ZrpcRequest> req_;
-	CidSet cids_;
-	CidSet missing_;
+	QList<QByteArray> cids_; // in request order, without duplicates
+	QSet<QByteArray> missing_;
 	std::unique_ptr<Deferred> connCheck_;
 	Connection finishedConnection_;
 
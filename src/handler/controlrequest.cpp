@@ -98,6 +98,20 @@ public:
 		req->start("refresh", args);
 	}
 
+	Refresh(ZrpcManager *controlClient, const QList<QByteArray> &cids)
+	{
+		req = std::make_unique<ZrpcRequest>(controlClient);
+		finishedConnection = req->finished.connect(boost::bind(&Refresh::req_finished, this));
+
+		QVariantList vcids;
+		foreach(const QByteArray &cid, cids)
+			vcids += cid;
+
+		QVariantHash args;
+		args["cids"] = vcids;
+		req->start("refresh", args);
+	}
+
 private:
 	std::unique_ptr<ZrpcRequest> req;
 	Connection finishedConnection;
@@ -147,6 +161,11 @@ Deferred *refresh(ZrpcManager *controlClient, const QByteArray &cid)
 	return new Refresh(controlClient, cid);
 }
 
+Deferred *refreshMany(ZrpcManager *controlClient, const QList<QByteArray> &cids)
+{
+	return new Refresh(controlClient, cids);
+}
+
 Deferred *report(ZrpcManager *controlClient, const StatsPacket &packet)
 {
 	return new Report(controlClient, packet);
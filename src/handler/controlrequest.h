@@ -25,10 +25,9 @@
 #define CONTROLREQUEST_H
 
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 #include "cidset.h"
 
-using Connection = boost::signals2::scoped_connection;
-
 class ZrpcManager;
 class StatsPacket;
 class Deferred;
@@ -37,6 +36,10 @@ namespace ControlRequest {
 
 Deferred *connCheck(ZrpcManager *controlClient, const CidSet &cids);
 Deferred *refresh(ZrpcManager *controlClient, const QByteArray &cid);
+
+// refreshes several connections with one request. cids not known to the
+// proxy are skipped
+Deferred *refreshMany(ZrpcManager *controlClient, const QList<QByteArray> &cids);
 Deferred *report(ZrpcManager *controlClient, const StatsPacket &packet);
 
 }
@@ -25,7 +25,9 @@
 
 Deferred::Deferred()
 {
-	qRegisterMetaType<DeferredResult>();
+	// registration takes a lock, so only do it once
+	static const int resultType = qRegisterMetaType<DeferredResult>();
+	Q_UNUSED(resultType);
 }
 
 Deferred::~Deferred()
@@ -25,7 +25,7 @@
 #define DEFERRED_H
 
 #include <QVariant>
-#include <boost/signals2.hpp>
+#include "fastsignal.h"
 #include "defercall.h"
 
 class DeferredResult
@@ -53,7 +53,9 @@ class Deferred
 public:
 	virtual ~Deferred();
 
-	boost::signals2::signal<void(const DeferredResult&)> finished;
+	// slots come from a per-thread pool, so chaining steps doesn't allocate
+	//   a signal connection for each of them
+	FastSignal<const DeferredResult&> finished;
 
 protected:
 	Deferred();
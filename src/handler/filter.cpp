@@ -26,6 +26,7 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 #include "log.h"
+#include "loopclock.h"
 #include "format.h"
 #include "idformat.h"
 #include "zhttpmanager.h"
@@ -33,8 +34,59 @@
 
 #define REQUEST_TIMEOUT_SECS 10
 
+// max cached http filter results, per thread
+#define HTTP_FILTER_CACHE_MAX 10000
+
+// recent build-id results, per thread
+#define BUILD_ID_CACHE_MAX 4
+
 namespace {
 
+Filter::SendAction skipSelfAction(const Filter::Context &context)
+{
+	QString user = context.subscriptionMeta.value(QStringLiteral("user"));
+	QString sender = context.publishMeta.value(QStringLiteral("sender"));
+	if(!user.isEmpty() && !sender.isEmpty() && sender == user)
+		return Filter::Drop;
+
+	return Filter::Send;
+}
+
+// scans the comma-separated list in place rather than splitting it
+Filter::SendAction skipUsersAction(const Filter::Context &context)
+{
+	QString user = context.subscriptionMeta.value(QStringLiteral("user"));
+	if(user.isEmpty())
+		return Filter::Send;
+
+	QString skipUsers = context.publishMeta.value(QStringLiteral("skip_users"));
+	QStringView v(skipUsers);
+
+	int start = 0;
+	while(start < v.size())
+	{
+		int end = v.indexOf(u',', start);
+		if(end == -1)
+			end = v.size();
+
+		if(v.mid(start, end - start).trimmed() == user)
+			return Filter::Drop;
+
+		start = end + 1;
+	}
+
+	return Filter::Send;
+}
+
+Filter::SendAction requireSubAction(const Filter::Context &context)
+{
+	QString requireSub = context.publishMeta.value(QStringLiteral("require_sub"));
+	if(!requireSub.isEmpty() && !context.prevIds.contains(requireSub))
+		return Filter::Drop;
+
+	return Filter::Send;
+}
+
 class SkipSelfFilter : public Filter, public Filter::MessageFilter
 {
 public:
@@ -55,12 +107,7 @@ public:
 
 	virtual SendAction sendAction() const
 	{
-		QString user = context().subscriptionMeta.value("user");
-		QString sender = context().publishMeta.value("sender");
-		if(!user.isEmpty() && !sender.isEmpty() && sender == user)
-			return Drop;
-
-		return Send;
+		return skipSelfAction(context());
 	}
 };
 
@@ -84,20 +131,7 @@ public:
 
 	virtual SendAction sendAction() const
 	{
-		QString user = context().subscriptionMeta.value("user");
-
-		QStringList skip_users;
-		foreach(const QString &part, context().publishMeta.value("skip_users").split(','))
-		{
-			QString s = part.trimmed();
-			if(!s.isEmpty())
-				skip_users += s;
-		}
-
-		if(!user.isEmpty() && skip_users.contains(user))
-			return Drop;
-
-		return Send;
+		return skipUsersAction(context());
 	}
 };
 
@@ -121,22 +155,38 @@ public:
 
 	virtual SendAction sendAction() const
 	{
-		QString require_sub = context().publishMeta.value("require_sub");
-		if(!require_sub.isEmpty() && !context().prevIds.keys().contains(require_sub))
-			return Drop;
-
-		return Send;
+		return requireSubAction(context());
 	}
 };
 
+class BuildIdCache
+{
+public:
+	class Entry
+	{
+	public:
+		QByteArray id;
+		bool hex;
+		QByteArray content;
+		QByteArray out;
+	};
+
+	QList<Entry> entries; // most recently used first
+};
+
+static thread_local BuildIdCache buildIdCache;
+
 class BuildIdFilter : public Filter, public Filter::MessageFilter
 {
 public:
 	IdFormat::ContentRenderer *idContentRenderer;
+	QByteArray renderedId;
+	bool renderedHex;
 
 	BuildIdFilter() :
 		Filter("build-id"),
-		idContentRenderer(0)
+		idContentRenderer(0),
+		renderedHex(false)
 	{
 	}
 
@@ -156,20 +206,15 @@ public:
 				return false;
 			}
 
-			QHash<QString, QByteArray> idTemplateVars;
-			QHashIterator<QString, QString> it(context().prevIds);
-			while(it.hasNext())
-			{
-				it.next();
-				idTemplateVars.insert(it.key(), it.value().toUtf8());
-			}
-
 			QString _error;
 			QByteArray id;
 
-			if(!idTemplateVars.isEmpty())
+			if(!context().prevIds.isEmpty())
 			{
-				id = IdFormat::renderId(idFormat.toUtf8(), idTemplateVars, &_error);
+				std::shared_ptr<const IdFormat::Template> t = IdFormat::Template::cached(idFormat.toUtf8(), &_error);
+				if(t)
+					id = t->render(context().prevIds, &_error);
+
 				if(id.isNull())
 				{
 					setError(QString("failed to render ID: %1").arg(_error));
@@ -194,6 +239,8 @@ public:
 			}
 
 			idContentRenderer = new IdFormat::ContentRenderer(id, hex);
+			renderedId = id;
+			renderedHex = hex;
 		}
 
 		return true;
@@ -205,7 +252,51 @@ public:
 
 		Result r;
 		r.sendAction = sendAction();
-		r.content = process(content);
+
+		// subscribers of a fan-out usually render the same id into the
+		// same content, so the last results are kept
+		if(ensureInit())
+		{
+			QList<BuildIdCache::Entry> &entries = buildIdCache.entries;
+
+			int at = -1;
+			for(int n = 0; n < entries.count(); ++n)
+			{
+				const BuildIdCache::Entry &e = entries[n];
+				if(e.hex == renderedHex && e.id == renderedId && e.content == content)
+				{
+					at = n;
+					break;
+				}
+			}
+
+			if(at >= 0)
+			{
+				if(at > 0)
+					entries.move(at, 0);
+
+				r.content = entries.first().out;
+			}
+			else
+			{
+				r.content = process(content);
+
+				if(!r.content.isNull())
+				{
+					BuildIdCache::Entry e;
+					e.id = renderedId;
+					e.hex = renderedHex;
+					e.content = content;
+					e.out = r.content;
+
+					if(entries.count() >= BUILD_ID_CACHE_MAX)
+						entries.removeLast();
+
+					entries.prepend(e);
+				}
+			}
+		}
+
 		finished(r);
 	}
 
@@ -312,6 +403,79 @@ public:
 
 class HttpFilterInner;
 
+// http filter state shared by all filters on the thread. concurrent
+// callouts with the same key share one request, and results the filter
+// service marks cacheable are kept until they expire
+class HttpFilterShared
+{
+public:
+	class CachedResult
+	{
+	public:
+		Filter::MessageFilter::Result result;
+		qint64 expires;
+	};
+
+	QHash<QByteArray, std::weak_ptr<HttpFilterInner>> inFlight;
+	QHash<QByteArray, CachedResult> results;
+	quint32 hits;
+	quint32 misses;
+
+	HttpFilterShared() :
+		hits(0),
+		misses(0)
+	{
+	}
+
+	static HttpFilterShared *instance()
+	{
+		static thread_local HttpFilterShared s;
+		return &s;
+	}
+
+	bool getResult(const QByteArray &key, Filter::MessageFilter::Result *result)
+	{
+		auto it = results.find(key);
+		if(it == results.end())
+			return false;
+
+		if(it.value().expires <= LoopClock::msecsSinceEpoch())
+		{
+			results.erase(it);
+			return false;
+		}
+
+		*result = it.value().result;
+		return true;
+	}
+
+	void addResult(const QByteArray &key, const Filter::MessageFilter::Result &result, int maxAge)
+	{
+		qint64 now = LoopClock::msecsSinceEpoch();
+
+		if(results.count() >= HTTP_FILTER_CACHE_MAX)
+		{
+			auto it = results.begin();
+			while(it != results.end())
+			{
+				if(it.value().expires <= now)
+					it = results.erase(it);
+				else
+					++it;
+			}
+
+			// still full
+			if(results.count() >= HTTP_FILTER_CACHE_MAX)
+				return;
+		}
+
+		CachedResult c;
+		c.result = result;
+		c.expires = now + (qint64)maxAge * 1000;
+		results.insert(key, c);
+	}
+};
+
 class HttpFilter : public Filter::MessageFilter
 {
 public:
@@ -321,6 +485,8 @@ public:
 		Modify
 	};
 
+	Mode mode;
+	QByteArray content;
 	std::shared_ptr<HttpFilterInner> inner;
 	boost::signals2::scoped_connection finishedConnection;
 
@@ -348,6 +514,8 @@ class HttpFilterInner
 {
 public:
 	HttpFilter::Mode mode;
+	QByteArray key;
+	int maxAge;
 	std::unique_ptr<ZhttpRequest> req;
 	QUrl uri;
 	HttpHeaders headers;
@@ -358,13 +526,51 @@ public:
 
 	boost::signals2::signal<void(const Filter::MessageFilter::Result&)> finished;
 
-	HttpFilterInner(HttpFilter::Mode _mode) :
+	HttpFilterInner(HttpFilter::Mode _mode, const QByteArray &_key) :
 		mode(_mode),
+		key(_key),
+		maxAge(-1),
 		haveResponseHeader(false),
 		responseSizeMax(-1)
 	{
 	}
 
+	~HttpFilterInner()
+	{
+		// all sharing filters went away before the request finished
+		HttpFilterShared *shared = HttpFilterShared::instance();
+
+		auto it = shared->inFlight.find(key);
+		if(it != shared->inFlight.end() && it.value().expired())
+			shared->inFlight.erase(it);
+	}
+
+	// returns -1 if the response must not be cached
+	static int cacheMaxAge(const HttpHeaders &headers)
+	{
+		int maxAge = -1;
+		int sharedMaxAge = -1;
+
+		foreach(const QByteArray &v, headers.getAll("Cache-Control"))
+		{
+			QByteArray d = v.trimmed().toLower();
+
+			if(d == "no-store" || d == "no-cache")
+				return -1;
+
+			if(d.startsWith("max-age="))
+				maxAge = d.mid(8).toInt();
+			else if(d.startsWith("s-maxage="))
+				sharedMaxAge = d.mid(9).toInt();
+		}
+
+		// we are a shared cache
+		if(sharedMaxAge >= 0)
+			maxAge = sharedMaxAge;
+
+		return (maxAge > 0 ? maxAge : -1);
+	}
+
 	void setup(ZhttpManager *zhttpOut, const QUrl &_uri, const HttpHeaders &_headers, const QVariant &passthroughData, const QByteArray &content, int _responseSizeMax)
 	{
 		uri = _uri;
@@ -432,6 +638,8 @@ public:
 		if(!req->isFinished())
 			return;
 
+		maxAge = cacheMaxAge(req->responseHeaders());
+
 		Filter::MessageFilter::Result r;
 
 		if(req->responseHeaders().get("Action") == "drop")
@@ -504,6 +712,16 @@ public:
 	{
 		req.reset();
 
+		HttpFilterShared *shared = HttpFilterShared::instance();
+
+		// later callouts with the same key start a new request
+		auto it = shared->inFlight.find(key);
+		if(it != shared->inFlight.end() && it.value().lock().get() == this)
+			shared->inFlight.erase(it);
+
+		if(r.errorMessage.isNull() && maxAge > 0)
+			shared->addResult(key, r, maxAge);
+
 		finished(r);
 	}
 };
@@ -518,15 +736,15 @@ bool HttpFilter::RequestAction::execute()
 	return true;
 }
 
-HttpFilter::HttpFilter(Mode mode)
+HttpFilter::HttpFilter(Mode _mode) :
+	mode(_mode)
 {
-	inner = std::make_shared<HttpFilterInner>(mode);
-
-	finishedConnection = inner->finished.connect(boost::bind(&HttpFilter::inner_finished, this, boost::placeholders::_1));
 }
 
-void HttpFilter::start(const Filter::Context &context, const QByteArray &content)
+void HttpFilter::start(const Filter::Context &context, const QByteArray &_content)
 {
+	content = _content;
+
 	QUrl url = QUrl(context.subscriptionMeta.value("url"), QUrl::StrictMode);
 	if(!url.isValid())
 	{
@@ -609,6 +827,42 @@ void HttpFilter::start(const Filter::Context &context, const QByteArray &content
 		}
 	}
 
+	// identical callouts get identical responses. check mode doesn't send
+	// the content, so it isn't part of the key
+	QByteArray callKey = QByteArray::number((int)mode) + '\n' + destUri.toEncoded() + '\n';
+	callKey += context.route.toUtf8() + '\n';
+	callKey += QByteArray(passthroughData.contains("prefer-internal") ? "1" : "0") + (context.trusted ? "1" : "0") + '\n';
+	callKey += QByteArray::number(context.responseSizeMax) + '\n';
+	foreach(const HttpHeader &h, headers)
+		callKey += h.first + ": " + h.second + '\n';
+	if(mode == Modify)
+		callKey += content;
+
+	HttpFilterShared *shared = HttpFilterShared::instance();
+
+	Result cached;
+	if(shared->getResult(callKey, &cached))
+	{
+		++shared->hits;
+		inner_finished(cached);
+		return;
+	}
+
+	inner = shared->inFlight.value(callKey).lock();
+	if(inner)
+	{
+		// join the request already in progress
+		++shared->hits;
+		finishedConnection = inner->finished.connect(boost::bind(&HttpFilter::inner_finished, this, boost::placeholders::_1));
+		return;
+	}
+
+	++shared->misses;
+
+	inner = std::make_shared<HttpFilterInner>(mode, callKey);
+	finishedConnection = inner->finished.connect(boost::bind(&HttpFilter::inner_finished, this, boost::placeholders::_1));
+	shared->inFlight.insert(callKey, inner);
+
 	inner->setup(context.zhttpOut, destUri, headers, passthroughData, content, context.responseSizeMax);
 
 	QString key = QString::fromUtf8(destUri.toEncoded());
@@ -620,6 +874,10 @@ void HttpFilter::start(const Filter::Context &context, const QByteArray &content
 		// the limiter shouldn't have an hwm, but let's handle the error
 		// here in case one is ever added
 
+		shared->inFlight.remove(callKey);
+		finishedConnection.disconnect();
+		inner.reset();
+
 		Result r;
 		r.errorMessage = "network request limit reached";
 		finished(r);
@@ -627,11 +885,36 @@ void HttpFilter::start(const Filter::Context &context, const QByteArray &content
 	}
 }
 
-void HttpFilter::inner_finished(const Result &r)
+void HttpFilter::inner_finished(const Result &_r)
 {
+	Result r = _r;
+
+	// the result may come from a callout made for other content
+	if(mode == Check && r.errorMessage.isNull() && r.sendAction == Filter::Send)
+		r.content = content;
+
 	finished(r);
 }
 
+Filter::MessageFilter *createBuildIdFilter() { return new BuildIdFilter; }
+Filter::MessageFilter *createVarSubstFilter() { return new VarSubstFilter; }
+Filter::MessageFilter *createHttpCheckFilter() { return new HttpFilter(HttpFilter::Check); }
+Filter::MessageFilter *createHttpModifyFilter() { return new HttpFilter(HttpFilter::Modify); }
+
+Filter::MessageFilterPlan::Factory stageFactory(const QString &name)
+{
+	if(name == "build-id")
+		return createBuildIdFilter;
+	else if(name == "var-subst")
+		return createVarSubstFilter;
+	else if(name == "http-check")
+		return createHttpCheckFilter;
+	else if(name == "http-modify")
+		return createHttpModifyFilter;
+	else
+		return 0;
+}
+
 }
 
 Filter::MessageFilter::~MessageFilter() = default;
@@ -707,6 +990,17 @@ Filter::MessageFilter *Filter::createMessageFilter(const QString &name)
 		return 0;
 }
 
+void Filter::takeHttpCacheCounts(quint32 *hits, quint32 *misses)
+{
+	HttpFilterShared *shared = HttpFilterShared::instance();
+
+	*hits = shared->hits;
+	*misses = shared->misses;
+
+	shared->hits = 0;
+	shared->misses = 0;
+}
+
 QStringList Filter::names()
 {
 	return (QStringList()
@@ -739,6 +1033,92 @@ Filter::Targets Filter::targets(const QString &name)
 		return Filter::Targets(0);
 }
 
+Filter::MessageFilterPlan::MessageFilterPlan(const QStringList &filterNames) :
+	needsPrevIds_(false),
+	skipsSelf_(false),
+	skipsUsers_(false)
+{
+	foreach(const QString &name, filterNames)
+	{
+		if(name == "skip-self")
+		{
+			checks_.push_back(SkipSelf);
+			skipsSelf_ = true;
+		}
+		else if(name == "skip-users")
+		{
+			checks_.push_back(SkipUsers);
+			skipsUsers_ = true;
+		}
+		else if(name == "require-sub")
+		{
+			checks_.push_back(RequireSub);
+			needsPrevIds_ = true;
+		}
+		else
+		{
+			Factory f = stageFactory(name);
+			if(!f)
+				continue;
+
+			stages_.push_back(f);
+
+			// stages may look at anything in the context
+			needsPrevIds_ = true;
+		}
+
+		if(targets(name) & MessageContent)
+			contentFilters_ += name;
+	}
+}
+
+std::shared_ptr<const Filter::MessageFilterPlan> Filter::MessageFilterPlan::get(const QStringList &filterNames)
+{
+	// per thread, so engine workers don't contend. the number of distinct
+	// filter lists is bounded by the small set of filter names
+	static thread_local QHash<QStringList, std::shared_ptr<const MessageFilterPlan>> cache;
+
+	auto it = cache.find(filterNames);
+	if(it != cache.end())
+		return it.value();
+
+	std::shared_ptr<const MessageFilterPlan> plan(new MessageFilterPlan(filterNames));
+	cache.insert(filterNames, plan);
+
+	return plan;
+}
+
+Filter::SendAction Filter::MessageFilterPlan::checkDelivery(const Filter::Context &context, bool userChecksApplied) const
+{
+	for(Check c : checks_)
+	{
+		SendAction a = Send;
+
+		switch(c)
+		{
+			case SkipSelf: a = userChecksApplied ? Send : skipSelfAction(context); break;
+			case SkipUsers: a = userChecksApplied ? Send : skipUsersAction(context); break;
+			case RequireSub: a = requireSubAction(context); break;
+		}
+
+		if(a == Drop)
+			return Drop;
+	}
+
+	return Send;
+}
+
+void Filter::MessageFilterPlan::createStages(std::vector<std::unique_ptr<MessageFilter>> *out) const
+{
+	for(Factory f : stages_)
+		out->emplace_back(std::unique_ptr<MessageFilter>(f()));
+}
+
+Filter::MessageFilterStack::MessageFilterStack(const MessageFilterPlan &plan)
+{
+	plan.createStages(&filters_);
+}
+
 Filter::MessageFilterStack::MessageFilterStack(const QStringList &filterNames)
 {
 	assert(filterNames.count() <= MESSAGEFILTERSTACK_SIZE_MAX);
@@ -99,11 +99,58 @@ public:
 		boost::signals2::signal<void(const Result&)> finished;
 	};
 
+	// a filter list compiled once and shared by every session subscribed
+	// with it. delivery checks that only look at the context (skip-self,
+	// skip-users, require-sub) are evaluated inline by checkDelivery. the
+	// remaining filters are stages, run through a MessageFilterStack
+	class MessageFilterPlan
+	{
+	public:
+		typedef MessageFilter *(*Factory)();
+
+		// returns a cached plan. unknown names are ignored
+		static std::shared_ptr<const MessageFilterPlan> get(const QStringList &filterNames);
+
+		const QStringList & contentFilters() const { return contentFilters_; }
+		bool hasChecks() const { return !checks_.empty(); }
+		bool skipsSelf() const { return skipsSelf_; }
+		bool skipsUsers() const { return skipsUsers_; }
+		bool hasStages() const { return !stages_.empty(); }
+		bool needsPrevIds() const { return needsPrevIds_; }
+
+		// if userChecksApplied is set, skip-self and skip-users are assumed
+		// to have passed already
+		SendAction checkDelivery(const Filter::Context &context, bool userChecksApplied = false) const;
+
+		void createStages(std::vector<std::unique_ptr<MessageFilter>> *out) const;
+
+	private:
+		enum Check
+		{
+			SkipSelf,
+			SkipUsers,
+			RequireSub
+		};
+
+		std::vector<Check> checks_;
+		std::vector<Factory> stages_;
+		QStringList contentFilters_;
+		bool needsPrevIds_;
+		bool skipsSelf_;
+		bool skipsUsers_;
+
+		MessageFilterPlan(const QStringList &filterNames);
+	};
+
 	class MessageFilterStack : public MessageFilter
 	{
 	public:
 		MessageFilterStack(const QStringList &filterNames);
 
+		// only the stages of the plan are run. the caller is expected to
+		// have already applied its checks
+		MessageFilterStack(const MessageFilterPlan &plan);
+
 		// reimplemented
 		virtual void start(const Filter::Context &context, const QByteArray &content = QByteArray());
 
@@ -137,6 +184,10 @@ public:
 	static Filter *create(const QString &name);
 	static MessageFilter *createMessageFilter(const QString &name);
 	static QStringList names();
+
+	// returns and resets the http filter cache counters of the thread.
+	// joining an in-flight callout counts as a hit
+	static void takeHttpCacheCounts(quint32 *hits, quint32 *misses);
 	static Targets targets(const QString &name);
 
 protected:
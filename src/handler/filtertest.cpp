@@ -41,8 +41,10 @@ class HttpFilterServer
 public:
 	std::unique_ptr<ZhttpManager> zhttpIn;
 	std::unordered_map<ZhttpRequest*, std::unique_ptr<ZhttpRequest>> reqs;
+	int requestCount;
 
-	HttpFilterServer(const QDir &workDir)
+	HttpFilterServer(const QDir &workDir) :
+		requestCount(0)
 	{
 		zhttpIn = std::make_unique<ZhttpManager>();
 		zhttpIn->setInstanceId("filter-test-server");
@@ -108,6 +110,8 @@ public:
 
 	void handle(ZhttpRequest *req)
 	{
+		++requestCount;
+
 		if(req->requestMethod() != "POST")
 		{
 			respondError(req, 400, "Bad Request", "Method must be POST\n");
@@ -146,6 +150,13 @@ public:
 			else
 				respondOk(req, 204, true, "");
 		}
+		else if(uri.path() == "/filter/cached")
+		{
+			HttpHeaders headers;
+			headers += HttpHeader("Cache-Control", "max-age=60");
+
+			respond(req, 200, "OK", headers, "");
+		}
 		else if(uri.path() == "/filter/large")
 		{
 			respondOk(req, 200, true, QByteArray(1001, 'a'));
@@ -248,6 +259,45 @@ static void messageFilters()
 	}
 }
 
+static void messageFilterPlan()
+{
+	QStringList filterNames = QStringList() << "skip-users" << "require-sub" << "var-subst";
+
+	std::shared_ptr<const Filter::MessageFilterPlan> plan = Filter::MessageFilterPlan::get(filterNames);
+	TEST_ASSERT(plan->hasChecks());
+	TEST_ASSERT(plan->hasStages());
+	TEST_ASSERT(plan->contentFilters() == QStringList() << "var-subst");
+
+	// same list shares the same plan
+	TEST_ASSERT(Filter::MessageFilterPlan::get(filterNames) == plan);
+
+	Filter::Context context;
+	context.subscriptionMeta["user"] = "bob";
+	context.publishMeta["skip_users"] = "alice, bobby ,carol";
+	TEST_ASSERT_EQ(plan->checkDelivery(context), Filter::Send);
+
+	context.publishMeta["skip_users"] = "alice, bob ,carol";
+	TEST_ASSERT_EQ(plan->checkDelivery(context), Filter::Drop);
+
+	// already excluded by the engine
+	TEST_ASSERT(plan->skipsUsers());
+	TEST_ASSERT(!plan->skipsSelf());
+	TEST_ASSERT_EQ(plan->checkDelivery(context, true), Filter::Send);
+
+	context.publishMeta.clear();
+	context.publishMeta["require_sub"] = "test";
+	TEST_ASSERT_EQ(plan->checkDelivery(context), Filter::Drop);
+
+	context.prevIds["test"] = QString();
+	TEST_ASSERT_EQ(plan->checkDelivery(context), Filter::Send);
+
+	plan = Filter::MessageFilterPlan::get(QStringList() << "skip-self" << "bogus");
+	TEST_ASSERT(plan->hasChecks());
+	TEST_ASSERT(!plan->hasStages());
+	TEST_ASSERT(!plan->needsPrevIds());
+	TEST_ASSERT(plan->contentFilters().isEmpty());
+}
+
 static void httpCheck()
 {
 	TestQCoreApplication qapp;
@@ -286,6 +336,79 @@ static void httpCheck()
 	}
 }
 
+static void httpShared()
+{
+	TestQCoreApplication qapp;
+	TestState state;
+
+	QStringList filterNames = QStringList() << "http-check";
+
+	Filter::Context context;
+	context.subscriptionMeta["url"] = "/filter/accept";
+	context.zhttpOut = state.zhttpOut.get();
+	context.currentUri = "http://localhost/";
+	context.limiter = state.limiter;
+
+	quint32 hits, misses;
+	Filter::takeHttpCacheCounts(&hits, &misses);
+
+	// concurrent identical callouts share one request
+	{
+		Filter::MessageFilterStack a(filterNames);
+		Filter::MessageFilterStack b(filterNames);
+
+		int finished = 0;
+		Filter::MessageFilter::Result ra, rb;
+
+		a.finished.connect([&](const Filter::MessageFilter::Result &r) {
+			++finished;
+			ra = r;
+		});
+
+		b.finished.connect([&](const Filter::MessageFilter::Result &r) {
+			++finished;
+			rb = r;
+		});
+
+		a.start(context, "hello");
+		b.start(context, "world");
+
+		while(finished < 2)
+			QTest::qWait(10);
+
+		TEST_ASSERT_EQ(state.filterServer->requestCount, 1);
+		TEST_ASSERT_EQ(ra.sendAction, Filter::Send);
+		TEST_ASSERT_EQ(ra.content, "hello");
+		TEST_ASSERT_EQ(rb.sendAction, Filter::Send);
+		TEST_ASSERT_EQ(rb.content, "world");
+	}
+
+	Filter::takeHttpCacheCounts(&hits, &misses);
+	TEST_ASSERT_EQ(hits, 1u);
+	TEST_ASSERT_EQ(misses, 1u);
+
+	// cacheable results are reused
+	context.subscriptionMeta["url"] = "/filter/cached";
+
+	{
+		auto r = runMessageFilters(filterNames, context, "hello");
+		TEST_ASSERT(r.errorMessage.isNull());
+		TEST_ASSERT_EQ(r.content, "hello");
+	}
+
+	{
+		auto r = runMessageFilters(filterNames, context, "world");
+		TEST_ASSERT(r.errorMessage.isNull());
+		TEST_ASSERT_EQ(r.content, "world");
+	}
+
+	TEST_ASSERT_EQ(state.filterServer->requestCount, 2);
+
+	Filter::takeHttpCacheCounts(&hits, &misses);
+	TEST_ASSERT_EQ(hits, 1u);
+	TEST_ASSERT_EQ(misses, 1u);
+}
+
 static void httpModify()
 {
 	TestQCoreApplication qapp;
@@ -333,7 +456,9 @@ static void httpModify()
 extern "C" int filter_test(ffi::TestException *out_ex)
 {
 	TEST_CATCH(messageFilters());
+	TEST_CATCH(messageFilterPlan());
 	TEST_CATCH(httpCheck());
+	TEST_CATCH(httpShared());
 	TEST_CATCH(httpModify());
 
 	return 0;
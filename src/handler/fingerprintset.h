@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef FINGERPRINTSET_H
+#define FINGERPRINTSET_H
+
+#include <assert.h>
+#include <vector>
+#include <QtGlobal>
+
+// set of 64-bit fingerprints in a flat open-addressing table, using linear
+// probing with backward-shift removal. the table never grows: it holds at
+// most capacity() entries, keeping the load factor at 3/4 or less. zero
+// marks an empty slot, so a fingerprint of zero is stored as one
+class FingerprintSet
+{
+public:
+	FingerprintSet() :
+		count_(0),
+		shift_(64)
+	{
+	}
+
+	// clears the set. slots must be a power of two, or zero
+	void reset(int slots)
+	{
+		assert((slots & (slots - 1)) == 0);
+
+		slots_.assign(slots, 0);
+		count_ = 0;
+
+		int bits = 0;
+		while((1 << bits) < slots)
+			++bits;
+
+		shift_ = 64 - bits;
+	}
+
+	int count() const { return count_; }
+	int capacity() const { return ((int)slots_.size() / 4) * 3; }
+
+	// approximate memory used by the table per entry at capacity
+	static int bytesPerEntry() { return (sizeof(quint64) * 4) / 3; }
+
+	bool contains(quint64 fp) const
+	{
+		if(slots_.empty())
+			return false;
+
+		fp = normalize(fp);
+
+		for(size_t i = home(fp);; i = next(i))
+		{
+			if(slots_[i] == fp)
+				return true;
+
+			if(slots_[i] == 0)
+				return false;
+		}
+	}
+
+	// returns false if already present or the set is full
+	bool insert(quint64 fp)
+	{
+		if(count_ >= capacity())
+			return false;
+
+		fp = normalize(fp);
+
+		size_t i = home(fp);
+		for(; slots_[i] != 0; i = next(i))
+		{
+			if(slots_[i] == fp)
+				return false;
+		}
+
+		slots_[i] = fp;
+		++count_;
+
+		return true;
+	}
+
+	bool remove(quint64 fp)
+	{
+		if(slots_.empty())
+			return false;
+
+		fp = normalize(fp);
+
+		size_t i = home(fp);
+		for(; slots_[i] != fp; i = next(i))
+		{
+			if(slots_[i] == 0)
+				return false;
+		}
+
+		// shift back any following entries that would otherwise become
+		// unreachable from their home slot
+		for(size_t j = next(i); slots_[j] != 0; j = next(j))
+		{
+			size_t k = home(slots_[j]);
+
+			bool stays = (i < j) ? (k > i && k <= j) : (k > i || k <= j);
+			if(!stays)
+			{
+				slots_[i] = slots_[j];
+				i = j;
+			}
+		}
+
+		slots_[i] = 0;
+		--count_;
+
+		return true;
+	}
+
+private:
+	std::vector<quint64> slots_;
+	int count_;
+	int shift_;
+
+	static quint64 normalize(quint64 fp)
+	{
+		return fp != 0 ? fp : 1;
+	}
+
+	// fingerprints are hashes already, but spread them again so the top
+	// bits are usable as the slot index
+	size_t home(quint64 fp) const
+	{
+		if(shift_ >= 64)
+			return 0;
+
+		return (size_t)((fp * Q_UINT64_C(0x9e3779b97f4a7c15)) >> shift_);
+	}
+
+	size_t next(size_t i) const
+	{
+		return (i + 1) & (slots_.size() - 1);
+	}
+};
+
+#endif
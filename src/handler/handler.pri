@@ -6,12 +6,21 @@ HEADERS += \
 	$$PWD/detectrule.h \
 	$$PWD/lastids.h \
 	$$PWD/cidset.h \
+	$$PWD/channelatoms.h \
+	$$PWD/channelindex.h \
+	$$PWD/channeltrie.h \
+	$$PWD/fingerprintset.h \
+	$$PWD/slowconsumer.h \
 	$$PWD/sessionrequest.h \
+	$$PWD/sessionupdatebuffer.h \
+	$$PWD/sessioncache.h \
 	$$PWD/requeststate.h \
 	$$PWD/wscontrolmessage.h \
 	$$PWD/publishformat.h \
 	$$PWD/publishitem.h \
+	$$PWD/publishlatency.h \
 	$$PWD/instruct.h \
+	$$PWD/instructcache.h \
 	$$PWD/format.h \
 	$$PWD/idformat.h \
 	$$PWD/clientsession.h \
@@ -19,11 +28,15 @@ HEADERS += \
 	$$PWD/httpsessionupdatemanager.h \
 	$$PWD/wssession.h \
 	$$PWD/publishlastids.h \
+	$$PWD/publishhistory.h \
+	$$PWD/statesnapshot.h \
 	$$PWD/controlrequest.h \
 	$$PWD/conncheckworker.h \
 	$$PWD/refreshworker.h \
 	$$PWD/ratelimiter.h \
 	$$PWD/sequencer.h \
+	$$PWD/publishconflater.h \
+	$$PWD/publishstream.h \
 	$$PWD/filter.h \
 	$$PWD/filterstack.h \
 	$$PWD/handlerengine.h \
@@ -35,23 +48,33 @@ SOURCES += \
 	$$PWD/variantutil.cpp \
 	$$PWD/jsonpointer.cpp \
 	$$PWD/jsonpatch.cpp \
+	$$PWD/channelatoms.cpp \
+	$$PWD/channeltrie.cpp \
 	$$PWD/sessionrequest.cpp \
+	$$PWD/sessionupdatebuffer.cpp \
+	$$PWD/sessioncache.cpp \
 	$$PWD/requeststate.cpp \
 	$$PWD/wscontrolmessage.cpp \
 	$$PWD/publishformat.cpp \
 	$$PWD/publishitem.cpp \
+	$$PWD/publishlatency.cpp \
 	$$PWD/instruct.cpp \
+	$$PWD/instructcache.cpp \
 	$$PWD/format.cpp \
 	$$PWD/idformat.cpp \
 	$$PWD/httpsession.cpp \
 	$$PWD/httpsessionupdatemanager.cpp \
 	$$PWD/wssession.cpp \
 	$$PWD/publishlastids.cpp \
+	$$PWD/publishhistory.cpp \
+	$$PWD/statesnapshot.cpp \
 	$$PWD/controlrequest.cpp \
 	$$PWD/conncheckworker.cpp \
 	$$PWD/refreshworker.cpp \
 	$$PWD/ratelimiter.cpp \
 	$$PWD/sequencer.cpp \
+	$$PWD/publishconflater.cpp \
+	$$PWD/publishstream.cpp \
 	$$PWD/filter.cpp \
 	$$PWD/filterstack.cpp \
 	$$PWD/handlerengine.cpp \
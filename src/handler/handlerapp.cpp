@@ -24,28 +24,45 @@
 #include "handlerapp.h"
 
 #include <assert.h>
+#include <atomic>
+#include <list>
+#include <thread>
+#include <pthread.h>
 #include <QCoreApplication>
 #include <QCommandLineParser>
 #include <QStringList>
 #include <QFile>
 #include <QFileInfo>
 #include <QDir>
+#include <QMutex>
+#include <QWaitCondition>
 #include "timer.h"
 #include "defercall.h"
 #include "eventloop.h"
+#include "loopstats.h"
+#include "memorybudget.h"
 #include "processquit.h"
+#include "filewatcher.h"
+#include "qzmqsocket.h"
 #include "log.h"
 #include "simplehttpserver.h"
 #include "httpsession.h"
 #include "wssession.h"
-#include "httpsessionupdatemanager.h"
 #include "settings.h"
+#include "cputopology.h"
 #include "handlerengine.h"
 #include "config.h"
 
 #define DEFAULT_HTTP_MAX_HEADERS_SIZE 10000
 #define DEFAULT_HTTP_MAX_BODY_SIZE 1000000
 
+#define SHARD_PUBLISH_SPEC "inproc://handler-shard-publish"
+#define SHARD_STATS_SPEC "inproc://handler-shard-stats"
+#define SHARD_STATE_SPEC "inproc://handler-shard-state"
+
+// registrations allocated at startup when growing on demand
+#define REGISTRATIONS_INITIAL 10000
+
 static void trimlist(QStringList *list)
 {
 	for(int n = 0; n < list->count(); ++n)
@@ -82,6 +99,59 @@ static QString firstSpec(const QString &s, int peerCount)
 	return s;
 }
 
+// settings that HandlerEngine::reload() can apply to a running engine
+static void readReloadableSettings(const Settings &settings, HandlerEngine::Configuration *config)
+{
+	config->messageRate = settings.value("handler/message_rate", -1).toInt();
+	config->messageHwm = settings.value("handler/message_hwm", -1).toInt();
+	config->messageWait = settings.value("handler/message_wait", 5000).toInt();
+	config->messageWaitAdaptive = settings.value("handler/message_wait_adaptive", false).toBool();
+
+	config->conflateRates.clear();
+	QStringList conflateRates = settings.value("handler/conflate_rates").toStringList();
+	trimlist(&conflateRates);
+	foreach(const QString &s, conflateRates)
+	{
+		// prefix=rate. the prefix may be empty, to cover all channels
+		int at = s.lastIndexOf('=');
+		bool ok = false;
+		int rate = (at != -1 ? s.mid(at + 1).trimmed().toInt(&ok) : 0);
+		if(!ok)
+		{
+			log_warning("invalid entry in conflate_rates: %s", qPrintable(s));
+			continue;
+		}
+
+		config->conflateRates.insert(s.left(at).trimmed(), rate);
+	}
+	config->idCacheTtl = settings.value("handler/id_cache_ttl", 0).toInt();
+	config->connectionSubscriptionMax = settings.value("handler/connection_subscription_max", 20).toInt();
+	config->subscriptionLinger = settings.value("handler/subscription_linger", 60).toInt();
+	config->statsConnectionTtl = settings.value("global/stats_connection_ttl", 120).toInt();
+	config->statsSubscriptionTtl = settings.value("handler/stats_subscription_ttl", 60).toInt();
+	config->statsReportInterval = settings.value("handler/stats_report_interval", 10).toInt();
+	config->statsMessageInterval = settings.value("handler/stats_message_interval", 1000).toInt();
+	config->publishLogSampleRate = settings.value("handler/publish_log_sample_rate", 100).toInt();
+}
+
+static int timersMaxForConfig(const HandlerEngine::Configuration &config)
+{
+	// includes worst-case subscriptions. update registrations share a
+	// single timer
+	int timersPerSession = qMax(TIMERS_PER_HTTPSESSION, TIMERS_PER_WSSESSION) +
+		(config.connectionSubscriptionMax * TIMERS_PER_SUBSCRIPTION);
+
+	// enough timers for sessions, plus an extra 100 for misc
+	return (config.connectionsMax * timersPerSession) + 100;
+}
+
+// the worst case stays the limit either way. without preallocation, only
+// part of it is allocated up front and the rest as needed
+static int initialCapacity(int max, bool preallocate)
+{
+	return (preallocate ? max : qMin(max, REGISTRATIONS_INITIAL));
+}
+
 enum CommandLineParseResult
 {
 	CommandLineOk,
@@ -177,6 +247,208 @@ static CommandLineParseResult parseCommandLine(QCommandLineParser *parser, ArgsD
 	return CommandLineOk;
 }
 
+class EngineThread
+{
+public:
+	std::thread thread;
+	QMutex m;
+	QWaitCondition w;
+	HandlerEngine::Configuration config;
+	bool newEventLoop;
+	bool preallocate;
+	std::unique_ptr<EventLoop> loop;
+	std::unique_ptr<QEventLoop> qloop;
+	std::unique_ptr<DeferCall> deferCall;
+	std::unique_ptr<HandlerEngine> engine;
+	std::atomic<bool> drained;
+
+	EngineThread(const HandlerEngine::Configuration &_config, bool _newEventLoop, bool _preallocate) :
+		config(_config),
+		newEventLoop(_newEventLoop),
+		preallocate(_preallocate),
+		drained(false)
+	{
+	}
+
+	~EngineThread()
+	{
+		stop();
+		thread.join();
+	}
+
+	bool start()
+	{
+		QString name = "handler-worker-" + QString::number(config.shardIndex);
+
+		QMutexLocker locker(&m);
+
+		thread = std::thread([=] {
+#ifdef Q_OS_MAC
+			pthread_setname_np(name.toUtf8().data());
+#else
+			pthread_setname_np(pthread_self(), name.toUtf8().data());
+#endif
+
+			run();
+		});
+
+		w.wait(&m);
+		return (bool)engine;
+	}
+
+	void stop()
+	{
+		QMutexLocker locker(&m);
+
+		if(engine)
+		{
+			deferCall->defer([=] {
+				// NOTE: called from worker thread
+				{
+					QMutexLocker locker(&m);
+					engine.reset();
+				}
+
+				log_debug("worker %d: stopped", config.shardIndex);
+
+				exitLoop(0);
+			});
+		}
+	}
+
+	void recover()
+	{
+		QMutexLocker locker(&m);
+
+		if(engine)
+		{
+			deferCall->defer([=] {
+				// NOTE: called from worker thread
+				if(engine)
+					engine->recover();
+			});
+		}
+	}
+
+	void drain()
+	{
+		QMutexLocker locker(&m);
+
+		if(engine)
+		{
+			deferCall->defer([=] {
+				// NOTE: called from worker thread
+				if(engine)
+				{
+					engine->drained.connect([=] {
+						drained = true;
+					});
+
+					engine->drain();
+				}
+			});
+		}
+		else
+		{
+			drained = true;
+		}
+	}
+
+	bool isDrained() const
+	{
+		return drained;
+	}
+
+	void reload(const HandlerEngine::Configuration &newConfig)
+	{
+		QMutexLocker locker(&m);
+
+		if(engine)
+		{
+			deferCall->defer([=] {
+				// NOTE: called from worker thread
+				if(engine)
+					engine->reload(newConfig);
+			});
+		}
+	}
+
+	void run()
+	{
+		// will unlock during exec
+		m.lock();
+
+		int timersMax = timersMaxForConfig(config);
+
+		if(newEventLoop)
+		{
+			log_debug("worker %d: using new event loop", config.shardIndex);
+
+			// workers have no control or prometheus servers, so only an
+			// extra 100 for misc
+			int socketNotifiersMax = 100;
+
+			int registrationsMax = timersMax + socketNotifiersMax;
+			loop = std::make_unique<EventLoop>(initialCapacity(registrationsMax, preallocate), registrationsMax);
+		}
+		else
+		{
+			// for qt event loop, timer subsystem must be explicitly initialized
+			Timer::init(initialCapacity(timersMax, preallocate), timersMax);
+
+			qloop = std::make_unique<QEventLoop>();
+		}
+
+		deferCall = std::make_unique<DeferCall>();
+
+		deferCall->defer([=] {
+			engine = std::make_unique<HandlerEngine>();
+
+			if(engine->start(config))
+			{
+				log_debug("worker %d: started", config.shardIndex);
+			}
+			else
+			{
+				engine.reset();
+				exitLoop(1);
+			}
+
+			// unblock start()
+			w.wakeOne();
+			m.unlock();
+		});
+
+		if(newEventLoop)
+			loop->exec();
+		else
+			qloop->exec();
+
+		if(!newEventLoop)
+		{
+			// ensure deferred deletes are processed
+			QCoreApplication::instance()->sendPostedEvents();
+		}
+
+		// deinit here, after all event loop activity has completed
+
+		deferCall.reset();
+		DeferCall::cleanup();
+
+		if(!newEventLoop)
+			Timer::deinit();
+	}
+
+private:
+	void exitLoop(int code)
+	{
+		if(newEventLoop)
+			loop->exit(code);
+		else
+			qloop->exit(code);
+	}
+};
+
 class HandlerApp::Private
 {
 public:
@@ -256,7 +528,9 @@ public:
 		QStringList condure_out_specs = settings.value("proxy/condure_out_specs").toStringList();
 		trimlist(&condure_out_specs);
 		connmgr_out_specs += condure_out_specs;
-		int proxyWorkerCount = settings.value("proxy/workers", 1).toInt();
+		// must resolve the same way as in the proxy for the specs to match
+		QString proxyWorkersStr = settings.value("proxy/workers").toString();
+		int proxyWorkerCount = CpuTopology::parseWorkers(proxyWorkersStr);
 		QStringList m2a_in_stream_specs = settings.value("handler/m2a_in_stream_specs").toStringList();
 		trimlist(&m2a_in_stream_specs);
 		QStringList m2a_out_specs = settings.value("handler/m2a_out_specs").toStringList();
@@ -288,6 +562,10 @@ public:
 		trimlist(&ws_control_stream_specs);
 		QString stats_spec = settings.value("handler/stats_spec").toString();
 		QString command_spec = settings.value("handler/command_spec").toString();
+		QString subscription_spec = settings.value("handler/subscription_spec").toString();
+		QString relay_spec = settings.value("handler/relay_spec").toString();
+		QString state_file = settings.value("handler/state_file").toString();
+		QString capture_file = settings.value("handler/capture_file").toString();
 		QString state_spec = settings.value("handler/state_spec").toString();
 		QStringList proxy_stats_specs = settings.value("handler/proxy_stats_specs").toStringList();
 		trimlist(&proxy_stats_specs);
@@ -302,6 +580,7 @@ public:
 		if(!push_in_sub_spec.isEmpty())
 			push_in_sub_specs += push_in_sub_spec;
 		bool push_in_sub_connect = settings.value("handler/push_in_sub_connect").toBool();
+		bool push_in_sub_hashed_topics = settings.value("handler/push_in_sub_hashed_topics", false).toBool();
 		QString push_in_http_addr = settings.value("handler/push_in_http_addr").toString();
 		int push_in_http_port = settings.adjustedPort("handler/push_in_http_port");
 		int push_in_http_max_headers_size = settings.value("handler/push_in_http_max_headers_size", DEFAULT_HTTP_MAX_HEADERS_SIZE).toInt();
@@ -309,23 +588,40 @@ public:
 		bool ok;
 		int ipcFileMode = settings.value("handler/ipc_file_mode", -1).toString().toInt(&ok, 8);
 		bool shareAll = settings.value("handler/share_all").toBool();
-		int messageRate = settings.value("handler/message_rate", -1).toInt();
-		int messageHwm = settings.value("handler/message_hwm", -1).toInt();
 		int messageBlockSize = settings.value("handler/message_block_size", -1).toInt();
-		int messageWait = settings.value("handler/message_wait", 5000).toInt();
-		int idCacheTtl = settings.value("handler/id_cache_ttl", 0).toInt();
+		int fanoutChunkSize = settings.value("handler/fanout_chunk_size", 1000).toInt();
+		int fanoutChunkTime = settings.value("handler/fanout_chunk_time", 5000).toInt();
+		QString idCacheMode = settings.value("handler/id_cache_mode", "exact").toString();
+		int idCacheMemoryMax = settings.value("handler/id_cache_memory_max", 64).toInt();
+		int messageHistoryDepth = settings.value("handler/message_history_depth", 0).toInt();
+		int messageHistoryMemoryMax = settings.value("handler/message_history_memory_max", 64).toInt();
+		int drainRate = settings.value("handler/drain_rate", 0).toInt();
+		int drainTimeout = settings.value("handler/drain_timeout", 30).toInt();
+		int recoverRate = settings.value("handler/recover_rate", 0).toInt();
+		QString slowConsumerAction = settings.value("handler/slow_consumer_action").toString();
+		int slowConsumerQueueBytes = settings.value("handler/slow_consumer_queue_bytes", 0).toInt();
+		int slowConsumerQueueAge = settings.value("handler/slow_consumer_queue_age", 0).toInt();
 		bool updateOnFirstSubscription = settings.value("handler/update_on_first_subscription", true).toBool();
+		bool nextLinkPrefetch = settings.value("handler/next_link_prefetch", false).toBool();
 		int clientMaxconn = settings.value("runner/client_maxconn", 50000).toInt();
-		int connectionSubscriptionMax = settings.value("handler/connection_subscription_max", 20).toInt();
-		int subscriptionLinger = settings.value("handler/subscription_linger", 60).toInt();
 		int statsConnectionSend = settings.value("global/stats_connection_send", true).toBool();
-		int statsConnectionTtl = settings.value("global/stats_connection_ttl", 120).toInt();
-		int statsSubscriptionTtl = settings.value("handler/stats_subscription_ttl", 60).toInt();
-		int statsReportInterval = settings.value("handler/stats_report_interval", 10).toInt();
+		QString statsRefreshMode = settings.value("handler/stats_refresh_mode", "buckets").toString();
 		QString statsFormat = settings.value("handler/stats_format").toString();
+		QString statsMessageMode = settings.value("handler/stats_message_mode", "each").toString();
+		int statsTopChannels = settings.value("handler/stats_top_channels", 0).toInt();
 		QString prometheusPort = settings.value("handler/prometheus_port").toString();
 		QString prometheusPrefix = settings.value("handler/prometheus_prefix").toString();
+		QString publishLogMode = settings.value("handler/publish_log_mode", "all").toString();
 		bool newEventLoop = settings.value("handler/new_event_loop", false).toBool();
+		bool preallocate = settings.value("handler/preallocate_registrations", false).toBool();
+		bool logAsync = settings.value("global/log_async", false).toBool();
+		bool loopStats = settings.value("global/loop_stats", false).toBool();
+		int loopStatsSlowCallback = settings.value("global/loop_stats_slow_callback", 0).toInt();
+		bool ioUring = settings.value("global/io_uring", false).toBool();
+		bool zmqCompression = settings.value("global/zmq_compression", false).toBool();
+		int memoryBudget = settings.value("global/memory_budget", 0).toInt();
+		QString workersStr = settings.value("handler/workers").toString();
+		int workerCount = CpuTopology::parseWorkers(workersStr);
 
 		if(m2a_in_stream_specs.isEmpty() || m2a_out_specs.isEmpty())
 		{
@@ -333,6 +629,18 @@ public:
 			return 1;
 		}
 
+		if(proxyWorkerCount < 1)
+		{
+			log_error("invalid proxy workers: %s", qPrintable(proxyWorkersStr));
+			return 1;
+		}
+
+		if(workerCount < 1)
+		{
+			log_error("invalid workers: %s", qPrintable(workersStr));
+			return 1;
+		}
+
 		if(proxy_inspect_specs.isEmpty() || proxy_accept_specs.isEmpty() || proxy_retry_out_specs.isEmpty())
 		{
 			log_error("must set proxy_inspect_specs, proxy_accept_specs, and proxy_retry_out_specs");
@@ -362,48 +670,124 @@ public:
 		config.wsControlStreamSpecs = expandSpecs(ws_control_stream_specs, proxyWorkerCount);
 		config.statsSpec = stats_spec;
 		config.commandSpec = command_spec;
+		config.subscriptionSpec = subscription_spec;
+		config.relaySpec = relay_spec;
+		config.stateFile = state_file;
+		config.captureFile = capture_file;
 		config.stateSpec = state_spec;
 		config.proxyStatsSpecs = expandSpecs(proxy_stats_specs, proxyWorkerCount);
 		config.proxyCommandSpec = firstSpec(proxy_command_spec, proxyWorkerCount);
 		config.pushInSpec = push_in_spec;
 		config.pushInSubSpecs = push_in_sub_specs;
 		config.pushInSubConnect = push_in_sub_connect;
+		config.pushInSubHashedTopics = push_in_sub_hashed_topics;
 		config.pushInHttpAddr = QHostAddress(push_in_http_addr);
 		config.pushInHttpPort = push_in_http_port;
 		config.pushInHttpMaxHeadersSize = push_in_http_max_headers_size;
 		config.pushInHttpMaxBodySize = push_in_http_max_body_size;
 		config.ipcFileMode = ipcFileMode;
 		config.shareAll = shareAll;
-		config.messageRate = messageRate;
-		config.messageHwm = messageHwm;
 		config.messageBlockSize = messageBlockSize;
-		config.messageWait = messageWait;
-		config.idCacheTtl = idCacheTtl;
+		config.fanoutChunkSize = fanoutChunkSize;
+		config.fanoutChunkTime = fanoutChunkTime;
+		config.idCacheMode = idCacheMode;
+		config.idCacheMemoryMax = idCacheMemoryMax;
+		config.messageHistoryDepth = messageHistoryDepth;
+		config.messageHistoryMemoryMax = messageHistoryMemoryMax;
+		config.drainRate = drainRate > 0 ? qMax(drainRate / workerCount, 1) : -1;
+		config.drainTimeout = drainTimeout;
+		config.recoverRate = recoverRate > 0 ? qMax(recoverRate / workerCount, 1) : -1;
+		config.slowConsumerAction = slowConsumerAction;
+		config.slowConsumerQueueBytes = slowConsumerQueueBytes;
+		config.slowConsumerQueueAge = slowConsumerQueueAge;
 		config.updateOnFirstSubscription = updateOnFirstSubscription;
-		config.connectionsMax = clientMaxconn;
-		config.connectionSubscriptionMax = connectionSubscriptionMax;
-		config.subscriptionLinger = subscriptionLinger;
+		config.nextLinkPrefetch = nextLinkPrefetch;
+		config.connectionsMax = clientMaxconn / workerCount;
 		config.statsConnectionSend = statsConnectionSend;
-		config.statsConnectionTtl = statsConnectionTtl;
-		config.statsSubscriptionTtl = statsSubscriptionTtl;
-		config.statsReportInterval = statsReportInterval;
+		config.statsRefreshMode = statsRefreshMode;
 		config.statsFormat = statsFormat;
+		config.statsMessageMode = statsMessageMode;
+		config.statsTopChannels = statsTopChannels;
 		config.prometheusPort = prometheusPort;
 		config.prometheusPrefix = prometheusPrefix;
+		config.publishLogMode = publishLogMode;
+		readReloadableSettings(settings, &config);
+
+		if(logAsync)
+			log_setAsync(true);
+
+		// must be set before any event loops are created
+		LoopStats::setEnabled(loopStats && newEventLoop);
+		LoopStats::setSlowCallbackThreshold((qint64)loopStatsSlowCallback * 1000);
+		EventLoop::setIoUringEnabled(ioUring && newEventLoop);
+
+		// must be set before any sockets are set up
+		QZmq::Socket::setTcpCompressionEnabled(zmqCompression);
 
-		return runLoop(config, newEventLoop);
+		MemoryBudget::setBudget((qint64)memoryBudget * 1024 * 1024);
+
+		return runLoop(config, configFile, workerCount, newEventLoop, preallocate);
 	}
 
 private:
-	static int runLoop(const HandlerEngine::Configuration &config, bool newEventLoop)
+	static int runLoop(const HandlerEngine::Configuration &_config, const QString &configFile, int workerCount, bool newEventLoop, bool preallocate)
 	{
-		// includes worst-case subscriptions and update registrations
-		int timersPerSession = qMax(TIMERS_PER_HTTPSESSION, TIMERS_PER_WSSESSION) +
-			(config.connectionSubscriptionMax * TIMERS_PER_SUBSCRIPTION) +
-			TIMERS_PER_UNIQUE_UPDATE_REGISTRATION;
+		HandlerEngine::Configuration config = _config;
+
+		// the engine in the main thread owns the publish ingress and the
+		// control interfaces, and relays published items to the workers.
+		// sessions are spread across all engines by the zmq peers
+		QList<HandlerEngine::Configuration> workerConfigs;
+
+		for(int n = 1; n < workerCount; ++n)
+		{
+			HandlerEngine::Configuration wconfig = config;
+
+			QString statsSpec = QString(SHARD_STATS_SPEC "-%1").arg(n);
+
+			wconfig.shardIndex = n;
+			wconfig.instanceId += '_' + QByteArray::number(n);
+			wconfig.commandSpec = QString();
+			wconfig.subscriptionSpec = QString();
+			wconfig.relaySpec = QString();
+
+			// each engine has its own sessions
+			if(!config.stateFile.isEmpty())
+				wconfig.stateFile = config.stateFile + '-' + QString::number(n);
+			wconfig.captureFile = QString();
+
+			// only the main engine binds the state spec. the shards send
+			// their state requests through it
+			wconfig.stateSpec = QString();
+			if(!config.stateSpec.isEmpty())
+				wconfig.shardStateSpec = SHARD_STATE_SPEC;
+
+			wconfig.pushInSpec = QString();
+			wconfig.pushInSubSpecs = QStringList() << SHARD_PUBLISH_SPEC;
+			wconfig.pushInSubConnect = true;
+			wconfig.pushInSubHashedTopics = false;
+			wconfig.pushInHttpPort = -1;
+			wconfig.proxyStatsSpecs = QStringList();
+			wconfig.prometheusPort = QString();
+
+			// stats are merged by the main engine, which expects tnetstrings
+			wconfig.statsSpec = statsSpec;
+			wconfig.statsFormat = QString();
+
+			config.proxyStatsSpecs += statsSpec;
+
+			workerConfigs += wconfig;
+		}
 
-		// enough timers for sessions, plus an extra 100 for misc
-		int timersMax = (config.connectionsMax * timersPerSession) + 100;
+		if(!workerConfigs.isEmpty())
+		{
+			config.shardPublishSpec = SHARD_PUBLISH_SPEC;
+
+			if(!config.stateSpec.isEmpty())
+				config.shardStateSpec = SHARD_STATE_SPEC;
+		}
+
+		int timersMax = timersMaxForConfig(config);
 
 		std::unique_ptr<EventLoop> loop;
 
@@ -416,26 +800,52 @@ private:
 			int socketNotifiersMax = (SOCKETNOTIFIERS_PER_SIMPLEHTTPREQUEST * (CONTROL_CONNECTIONS_MAX + PROMETHEUS_CONNECTIONS_MAX)) + 100;
 
 			int registrationsMax = timersMax + socketNotifiersMax;
-			loop = std::make_unique<EventLoop>(registrationsMax);
+			loop = std::make_unique<EventLoop>(initialCapacity(registrationsMax, preallocate), registrationsMax);
 		}
 		else
 		{
 			// for qt event loop, timer subsystem must be explicitly initialized
-			Timer::init(timersMax);
+			Timer::init(initialCapacity(timersMax, preallocate), timersMax);
 		}
 
 		std::unique_ptr<HandlerEngine> engine;
+		std::list<EngineThread*> threads;
+		std::unique_ptr<FileWatcher> configWatcher;
+		std::unique_ptr<Timer> drainTimer;
+
+		// only the fields read by readReloadableSettings() are used by the
+		// engines, so the main engine's config can be passed to all of them
+		auto reloadSettings = [&] {
+			HandlerEngine::Configuration newConfig = config;
+			readReloadableSettings(Settings(configFile), &newConfig);
+
+			engine->reload(newConfig);
+
+			for(EngineThread *t : threads)
+				t->reload(newConfig);
+		};
 
 		DeferCall deferCall;
 		deferCall.defer([&] {
 			engine = std::make_unique<HandlerEngine>();
 
-			ProcessQuit::instance()->quit.connect([&] {
-				log_info("stopping...");
-		
-				// remove the handler, so if we get another signal then we crash out
-				ProcessQuit::cleanup();
+			engine->recoverRequested.connect([&] {
+				for(EngineThread *t : threads)
+					t->recover();
+			});
 
+			auto stop = [&] {
+				drainTimer.reset();
+
+				for(EngineThread *t : threads)
+					t->stop();
+
+				for(EngineThread *t : threads)
+					delete t;
+
+				threads.clear();
+
+				configWatcher.reset();
 				engine.reset();
 
 				log_debug("stopped");
@@ -444,12 +854,49 @@ private:
 					loop->exit(0);
 				else
 					QCoreApplication::exit(0);
+			};
+
+			ProcessQuit::instance()->quit.connect([&, stop] {
+				log_info("stopping...");
+		
+				// remove the handler, so if we get another signal then we crash out
+				ProcessQuit::cleanup();
+
+				if(config.drainRate <= 0)
+				{
+					stop();
+					return;
+				}
+
+				// close sessions gradually before stopping, so that clients
+				// don't all reconnect at the same moment
+				engine->drain();
+				for(EngineThread *t : threads)
+					t->drain();
+
+				drainTimer = std::make_unique<Timer>();
+				drainTimer->timeout.connect([&, stop] {
+					if(!engine->isDrained())
+						return;
+
+					for(EngineThread *t : threads)
+					{
+						if(!t->isDrained())
+							return;
+					}
+
+					drainTimer->stop();
+
+					// defer, so the timer isn't deleted during its own signal
+					deferCall.defer(stop);
+				});
+				drainTimer->start(100);
 			});
 
 			ProcessQuit::instance()->hup.connect([&] {
 				log_info("reloading");
 				log_rotate();
-				engine->reload();
+				reloadSettings();
 			});
 
 			if(!engine->start(config))
@@ -464,6 +911,45 @@ private:
 				return;
 			}
 
+			foreach(const HandlerEngine::Configuration &wconfig, workerConfigs)
+			{
+				EngineThread *t = new EngineThread(wconfig, newEventLoop, preallocate);
+				if(!t->start())
+				{
+					delete t;
+
+					for(EngineThread *t : threads)
+						delete t;
+
+					threads.clear();
+
+					engine.reset();
+
+					if(newEventLoop)
+						loop->exit(1);
+					else
+						QCoreApplication::exit(1);
+
+					return;
+				}
+
+				threads.push_back(t);
+			}
+
+			configWatcher = std::make_unique<FileWatcher>();
+			if(configWatcher->start(configFile))
+			{
+				configWatcher->fileChanged.connect([&] {
+					log_info("config file changed, reloading");
+					reloadSettings();
+				});
+			}
+			else
+			{
+				log_warning("unable to watch config file: %s", qPrintable(configFile));
+				configWatcher.reset();
+			}
+
 			log_info("started");
 		});
 
@@ -496,5 +982,10 @@ HandlerApp::~HandlerApp() = default;
 
 int HandlerApp::run()
 {
-	return Private::run();
+	int ret = Private::run();
+
+	// flush any queued log records
+	log_setAsync(false);
+
+	return ret;
 }
@@ -0,0 +1,395 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include <memory>
+#include <vector>
+#include <QStringList>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include "bench.h"
+#include "eventloop.h"
+#include "defercall.h"
+#include "tnetstring.h"
+#include "publishformat.h"
+#include "publishitem.h"
+#include "publishlastids.h"
+#include "sequencer.h"
+#include "ratelimiter.h"
+#include "channelindex.h"
+#include "filter.h"
+#include "instruct.h"
+#include "instructcache.h"
+#include "jsonpatch.h"
+
+namespace {
+
+// stands in for a session. delivery shares the prepared item, as the
+// engine does
+class Sub
+{
+public:
+	Filter::Context context;
+	std::shared_ptr<const PublishItem> last;
+	int received;
+
+	Sub() :
+		received(0)
+	{
+	}
+};
+
+class Fanout
+{
+public:
+	ChannelIndex<Sub> index;
+	std::vector<std::unique_ptr<Sub>> subs;
+	std::shared_ptr<const Filter::MessageFilterPlan> plan;
+
+	void addSubs(int channels, int subsPerChannel)
+	{
+		for(int c = 0; c < channels; ++c)
+		{
+			QString channel = QString("channel-%1").arg(c);
+
+			for(int n = 0; n < subsPerChannel; ++n)
+			{
+				Sub *s = new Sub;
+				s->context.subscriptionMeta["user"] = QString("user-%1").arg(subs.size());
+				subs.push_back(std::unique_ptr<Sub>(s));
+
+				index.add(channel, s);
+			}
+		}
+	}
+
+	int publish(const QString &channel, const std::shared_ptr<const PublishItem> &item)
+	{
+		const ChannelIndex<Sub>::Subscribers *targets = index.subscribers(channel);
+		if(!targets)
+			return 0;
+
+		int sent = 0;
+
+		for(Sub *s : *targets)
+		{
+			if(plan)
+			{
+				s->context.publishMeta = item->meta;
+
+				if(plan->checkDelivery(s->context) == Filter::Drop)
+					continue;
+			}
+
+			s->last = item;
+			++s->received;
+			++sent;
+		}
+
+		return sent;
+	}
+};
+
+class CountAction : public RateLimiter::Action
+{
+public:
+	int *count;
+
+	CountAction(int *_count) :
+		count(_count)
+	{
+	}
+
+	virtual bool execute()
+	{
+		++(*count);
+		return true;
+	}
+};
+
+}
+
+// compares decoding through a variant with decoding directly
+static void publishItem(const Bench &bench)
+{
+	QVariantHash hs;
+	hs["content"] = QByteArray("hello world\n");
+	QVariantHash formats;
+	formats["http-stream"] = hs;
+	QVariantHash data;
+	data["channel"] = QByteArray("apple");
+	data["id"] = QByteArray("item1");
+	data["formats"] = formats;
+
+	QByteArray buf = TnetString::fromVariant(data);
+
+	bench.run("publishitem/decode-variant", 20000, 1, [&] {
+		bool ok;
+		QVariant v = TnetString::toVariant(buf, 0, &ok);
+		PublishItem i = PublishItem::fromVariant(v, QString(), &ok);
+		Q_UNUSED(i);
+	});
+
+	bench.run("publishitem/decode-view", 20000, 1, [&] {
+		bool ok;
+		PublishItem i = PublishItem::fromView(TnetString::View(buf), QString(), &ok);
+		Q_UNUSED(i);
+	});
+}
+
+static std::shared_ptr<const PublishItem> makeItem(const QString &channel, const QString &id = QString())
+{
+	auto item = std::make_shared<PublishItem>();
+	item->channel = channel;
+	item->id = id;
+
+	PublishFormat f(PublishFormat::HttpStream);
+	f.body = QByteArray(100, 'a');
+	item->formats.insert(PublishFormat::HttpStream, f);
+
+	item->meta["sender"] = "user-0";
+	item->meta["skip_users"] = "user-1,user-2";
+
+	return item;
+}
+
+static void fanout(const Bench &bench)
+{
+	{
+		Fanout f;
+		f.addSubs(1, 100000);
+
+		auto item = makeItem("channel-0");
+
+		bench.run("fanout/1ch-100k-subs", 50, 100000, [&] {
+			f.publish("channel-0", item);
+		});
+
+		f.plan = Filter::MessageFilterPlan::get(QStringList() << "skip-self" << "skip-users" << "require-sub");
+
+		bench.run("fanout/1ch-100k-subs-filters", 50, 100000, [&] {
+			f.publish("channel-0", item);
+		});
+	}
+
+	{
+		Fanout f;
+		f.addSubs(100000, 1);
+
+		std::vector<QString> channels;
+		std::vector<std::shared_ptr<const PublishItem>> items;
+		for(int n = 0; n < 1000; ++n)
+		{
+			channels.push_back(QString("channel-%1").arg(n * 100));
+			items.push_back(makeItem(channels.back()));
+		}
+
+		int next = 0;
+
+		bench.run("fanout/100k-ch-1-sub", 100000, 1, [&] {
+			f.publish(channels[next], items[next]);
+			next = (next + 1) % (int)channels.size();
+		});
+	}
+
+	{
+		ChannelIndex<Sub> index;
+		std::vector<Sub> subs(1000);
+		QString channel = "channel-0";
+
+		bench.run("fanout/subscribe-unsubscribe-1k", 100, 2000, [&] {
+			for(Sub &s : subs)
+				index.add(channel, &s);
+
+			for(Sub &s : subs)
+				index.remove(channel, &s);
+		});
+	}
+}
+
+static void sequencer(const Bench &bench)
+{
+	{
+		PublishLastIds lastIds(1000000);
+		Sequencer seq(&lastIds);
+		seq.setIdCacheTtl(60);
+
+		int ready = 0;
+		seq.itemReady.connect([&](const PublishItem &) {
+			++ready;
+		});
+
+		PublishItem item = *makeItem("channel-0");
+		int next = 0;
+
+		bench.run("sequencer/id-cache-ttl", 100000, 1, [&] {
+			item.id = QString::number(next++);
+			seq.addItem(item);
+		});
+
+		bench.run("sequencer/id-cache-ttl-duplicate", 100000, 1, [&] {
+			item.id = QString::number(next % 1000);
+			seq.addItem(item);
+		});
+	}
+
+	{
+		PublishLastIds lastIds(1000000);
+		Sequencer seq(&lastIds);
+		seq.setIdCacheTtl(60);
+		seq.setIdCacheMemoryMax(64 * 1024 * 1024);
+		seq.setIdCacheMode(Sequencer::CompactIds);
+
+		PublishItem item = *makeItem("channel-0");
+		int next = 0;
+
+		bench.run("sequencer/id-cache-ttl-compact", 100000, 1, [&] {
+			item.id = QString::number(next++);
+			seq.addItem(item);
+		});
+	}
+}
+
+static void rateLimiter(const Bench &bench, EventLoop *loop)
+{
+	RateLimiter limiter;
+
+	std::vector<QString> keys;
+	for(int n = 0; n < 1000; ++n)
+		keys.push_back(QString("key-%1").arg(n));
+
+	bench.run("ratelimiter/10k-actions-1k-keys", 50, 10000, [&] {
+		int count = 0;
+
+		for(int n = 0; n < 10000; ++n)
+			limiter.addAction(keys[n % keys.size()], new CountAction(&count));
+
+		while(count < 10000)
+			loop->step();
+	});
+}
+
+static void instruct(const Bench &bench)
+{
+	// a typical long-poll hold, among the usual origin headers
+	HttpResponseData data;
+	data.code = 200;
+	data.reason = "OK";
+	data.headers += HttpHeader("Date", "Tue, 14 Oct 2025 12:00:00 GMT");
+	data.headers += HttpHeader("Server", "origin");
+	data.headers += HttpHeader("Content-Type", "application/json");
+	data.headers += HttpHeader("Cache-Control", "no-cache");
+	data.headers += HttpHeader("Set-Cookie", "session=abc123; Path=/; HttpOnly");
+	data.headers += HttpHeader("Grip-Hold", "response");
+	data.headers += HttpHeader("Grip-Channel", "updates-42; prev-id=7");
+	data.headers += HttpHeader("Grip-Channel", "global");
+	data.headers += HttpHeader("Grip-Timeout", "30");
+	data.headers += HttpHeader("Grip-Set-Meta", "user=\"alice\"");
+	data.headers += HttpHeader("Grip-Link", "</poll?after=7>; rel=next");
+	data.body = "{\"items\":[]}";
+
+	bench.run("instruct/parse-response-hold", 100000, 1, [&] {
+		bool ok;
+		Instruct i = Instruct::fromResponse(data, &ok);
+		Q_UNUSED(i);
+	});
+
+	InstructCache cache(100);
+
+	bench.run("instruct/parse-response-hold-cached", 100000, 1, [&] {
+		bool ok;
+		Instruct i = cache.fromResponse(data, &ok);
+		Q_UNUSED(i);
+	});
+
+	HttpResponseData idata;
+	idata.code = 200;
+	idata.reason = "OK";
+	idata.headers += HttpHeader("Content-Type", "application/grip-instruct");
+	idata.body = "{\"hold\":{\"mode\":\"response\",\"channels\":[{\"name\":\"updates-42\"}],\"timeout\":30},\"response\":{\"code\":200,\"headers\":{\"Content-Type\":\"application/json\"},\"body\":\"{}\"}}";
+
+	bench.run("instruct/parse-instruct-body", 100000, 1, [&] {
+		bool ok;
+		Instruct i = Instruct::fromResponse(idata, &ok);
+		Q_UNUSED(i);
+	});
+}
+
+// compares reparsing a ~200KB body for each subscriber with patching a
+// retained parse
+static void jsonPatch(const Bench &bench)
+{
+	QVariantList items;
+	for(int n = 0; n < 2000; ++n)
+	{
+		QVariantMap item;
+		item["id"] = n;
+		item["name"] = QString("item %1").arg(n);
+		item["tags"] = QVariantList() << "apple" << "banana" << "cherry";
+		item["description"] = QString(40, 'x');
+		items += item;
+	}
+
+	QVariantMap data;
+	data["items"] = items;
+
+	QByteArray body = QJsonDocument(QJsonObject::fromVariantMap(data)).toJson(QJsonDocument::Compact);
+
+	QVariantMap op;
+	op["op"] = "replace";
+	op["path"] = "/items/1000/name";
+	op["value"] = "updated";
+
+	QVariantList ops;
+	ops += op;
+
+	bench.run("jsonpatch/reparse-200k", 20, 1, [&] {
+		QVariant v = QJsonDocument::fromJson(body).object().toVariantMap();
+		v = JsonPatch::patch(v, ops);
+		QByteArray out = QJsonDocument(QJsonObject::fromVariantMap(v.toMap())).toJson(QJsonDocument::Compact);
+		Q_UNUSED(out);
+	});
+
+	QVariant parsed = QJsonDocument::fromJson(body).object().toVariantMap();
+
+	bench.run("jsonpatch/retained-200k", 20, 1, [&] {
+		QVariant v = parsed;
+		JsonPatch::patchInPlace(&v, ops);
+		QByteArray out = QJsonDocument(QJsonObject::fromVariantMap(v.toMap())).toJson(QJsonDocument::Compact);
+		Q_UNUSED(out);
+	});
+}
+
+extern "C" void handler_bench(const char *filter)
+{
+	EventLoop loop(1000);
+
+	Bench bench(filter);
+
+	publishItem(bench);
+	fanout(bench);
+	sequencer(bench);
+	rateLimiter(bench, &loop);
+	instruct(bench);
+	jsonPatch(bench);
+
+	DeferCall::cleanup();
+}
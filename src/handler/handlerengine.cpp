@@ -25,6 +25,12 @@
 
 #include <assert.h>
 #include <algorithm>
+#include <atomic>
+#include <list>
+#include <QElapsedTimer>
+#include <QDateTime>
+#include <QFile>
+#include <QRandomGenerator>
 #include <QUrlQuery>
 #include <QJsonDocument>
 #include <QJsonObject>
@@ -35,8 +41,11 @@
 #include "qtcompat.h"
 #include "tnetstring.h"
 #include "timer.h"
+#include "loopclock.h"
 #include "defercall.h"
 #include "log.h"
+#include "trace.h"
+#include "tracecontext.h"
 #include "logutil.h"
 #include "packet/httprequestdata.h"
 #include "packet/httpresponsedata.h"
@@ -49,6 +58,8 @@
 #include "zrpcrequest.h"
 #include "zhttpmanager.h"
 #include "zhttprequest.h"
+#include "latencyhistogram.h"
+#include "loopstats.h"
 #include "statsmanager.h"
 #include "deferred.h"
 #include "simplehttpserver.h"
@@ -57,12 +68,19 @@
 #include "lastids.h"
 #include "cidset.h"
 #include "sessionrequest.h"
+#include "sessionupdatebuffer.h"
+#include "sessioncache.h"
+#include "instructcache.h"
 #include "requeststate.h"
 #include "wscontrolmessage.h"
 #include "publishformat.h"
 #include "publishitem.h"
+#include "publishlatency.h"
+#include "packetcapture.h"
 #include "jsonpointer.h"
+#include "jsonpatch.h"
 #include "publishlastids.h"
+#include "publishhistory.h"
 #include "instruct.h"
 #include "httpsession.h"
 #include "wssession.h"
@@ -72,7 +90,15 @@
 #include "ratelimiter.h"
 #include "httpsessionupdatemanager.h"
 #include "sequencer.h"
+#include "publishconflater.h"
+#include "publishstream.h"
 #include "filterstack.h"
+#include "channelatoms.h"
+#include "channelindex.h"
+#include "channeltrie.h"
+#include "memorybudget.h"
+#include "objectstats.h"
+#include "statesnapshot.h"
 
 #define DEFAULT_HWM 101000
 #define SUB_SNDHWM 0 // infinite
@@ -84,9 +110,62 @@
 #define DEFAULT_WS_SENDDELAYED_TIMEOUT 1
 #define SUBSCRIBED_DELAY 1000
 
+#define FANOUT_TIME_CHECK_INTERVAL 64
+
+// channels tracked individually by aggregated publish logging. beyond
+// this, counts are combined into a single line
+#define PUBLISH_LOG_CHANNELS_MAX 1000
+
 #define INSPECT_WORKERS_MAX 10
 #define ACCEPT_WORKERS_MAX 10
 
+// max requests carried by a single accept-batch request
+#define ACCEPT_BATCH_ITEMS_MAX 1000
+
+// how long the proxy may reuse inspect results not involving sessions
+#define INSPECT_MAX_AGE 10
+
+// max idle publish actions kept for reuse
+#define PUBLISH_ACTION_POOL_MAX 100000
+
+// initial output buffer sizing, beyond any content
+#define RETRY_PACKET_OVERHEAD_ESTIMATE 1024
+#define WSCONTROL_ITEM_OVERHEAD_ESTIMATE 256
+
+// last-id updates are batched for up to this long (ms), or until this many
+// sessions are pending. beyond the max, updates for new sessions are dropped
+#define SESSION_UPDATE_FLUSH_INTERVAL 50
+#define SESSION_UPDATE_FLUSH_SIZE 1000
+#define SESSION_UPDATE_PENDING_MAX 100000
+
+// sessions whose last-ids are known locally. entries are dropped after the
+// ttl (ms), to pick up changes made by other handlers
+#define SESSION_CACHE_MAX 100000
+#define SESSION_CACHE_TTL 10000
+
+// distinct sets of grip headers to keep parsed
+#define INSTRUCT_CACHE_MAX 10000
+
+// how often to check whether paused publish input can resume
+#define MEMORY_BUDGET_CHECK_INTERVAL 100
+
+// average time between drain passes. each pass is delayed by a random
+// amount around this, so that closes from many instances don't line up
+#define DRAIN_INTERVAL 100
+
+// how often a paced recover updates the next wave of sessions
+#define RECOVER_INTERVAL 100
+
+// ndjson publish bodies are handed on in batches of this many items
+#define NDJSON_PUBLISH_BATCH_MAX 100
+
+// items a streaming publisher may send ahead of acknowledgements
+#define PUBLISH_STREAM_WINDOW 1000
+
+// streaming publishers are paused while this many publish jobs are waiting
+// to be fanned out
+#define PUBLISH_STREAM_BACKLOG_MAX 10
+
 using namespace VariantUtil;
 
 static QList<PublishItem> parseItems(const QVariantList &vitems, bool *ok = 0, QString *errorMessage = 0)
@@ -116,19 +195,23 @@ class InspectWorker : public Deferred
 public:
 	std::unique_ptr<ZrpcRequest> req;
 	ZrpcManager *stateClient;
+	SessionCache *sessionCache;
 	bool shareAll;
 	HttpRequestData requestData;
 	bool truncated;
+	bool getSession;
 	bool autoShare;
 	QString sid;
 	LastIds lastIds;
-	std::map<Deferred*, std::unique_ptr<Deferred>> deferreds;
+	std::unique_ptr<Deferred> pending; // the step in progress, if any
 
-	InspectWorker(ZrpcRequest *_req, ZrpcManager *_stateClient, bool _shareAll) :
+	InspectWorker(ZrpcRequest *_req, ZrpcManager *_stateClient, SessionCache *_sessionCache, bool _shareAll) :
 		req(_req),
 		stateClient(_stateClient),
+		sessionCache(_sessionCache),
 		shareAll(_shareAll),
 		truncated(false),
+		getSession(false),
 		autoShare(false)
 	{
 		if(req->method() == "inspect")
@@ -200,7 +283,7 @@ public:
 				truncated = args["truncated"].toBool();
 			}
 
-			bool getSession = false;
+			getSession = false;
 			if(args.contains("get-session"))
 			{
 				if(typeId(args["get-session"]) != QMetaType::Bool)
@@ -228,12 +311,10 @@ public:
 			{
 				// determine session info
 
-				auto d = std::unique_ptr<Deferred>(SessionRequest::detectRulesGet(stateClient, requestData.uri.host().toUtf8(), requestData.uri.path(QUrl::FullyEncoded).toUtf8()));
+				pending = std::unique_ptr<Deferred>(SessionRequest::detectRulesGet(stateClient, requestData.uri.host().toUtf8(), requestData.uri.path(QUrl::FullyEncoded).toUtf8()));
 
-				// safe to not track, since d can't outlive this
-				d->finished.connect(boost::bind(&InspectWorker::sessionDetectRulesGet_finished, this, d.get(), boost::placeholders::_1));
-
-				deferreds[d.get()] = std::move(d);
+				// safe to not track, since pending can't outlive this
+				pending->finished.connect(boost::bind(&InspectWorker::sessionDetectRulesGet_finished, this, boost::placeholders::_1));
 				return;
 			}
 
@@ -298,13 +379,18 @@ private:
 			}
 		}
 
+		// without session detection, the result depends only on the
+		//   method, uri and headers, and may be reused by the proxy
+		if(!getSession)
+			result["max-age"] = INSPECT_MAX_AGE;
+
 		req->respond(result);
 		setFinished(true);
 	}
 
-	void sessionDetectRulesGet_finished(Deferred *d, const DeferredResult &result)
+	void sessionDetectRulesGet_finished(const DeferredResult &result)
 	{
-		deferreds.erase(d);
+		pending.reset();
 
 		if(result.success)
 		{
@@ -352,12 +438,17 @@ private:
 
 			if(!sid.isEmpty())
 			{
-				auto d = std::unique_ptr<Deferred>(SessionRequest::getLastIds(stateClient, sid));
+				// known sessions are answered locally
+				if(sessionCache && sessionCache->get(sid, &lastIds, LoopClock::msecsSinceEpoch()))
+				{
+					doFinish();
+					return;
+				}
 
-				// safe to not track, since d can't outlive this
-				d->finished.connect(boost::bind(&InspectWorker::sessionGetLastIds_finished, this, d.get(), boost::placeholders::_1));
+				pending = std::unique_ptr<Deferred>(SessionRequest::getLastIds(stateClient, sid));
 
-				deferreds[d.get()] = std::move(d);
+				// safe to not track, since pending can't outlive this
+				pending->finished.connect(boost::bind(&InspectWorker::sessionGetLastIds_finished, this, boost::placeholders::_1));
 				return;
 			}
 		}
@@ -370,13 +461,16 @@ private:
 		doFinish();
 	}
 
-	void sessionGetLastIds_finished(Deferred *d, const DeferredResult &result)
+	void sessionGetLastIds_finished(const DeferredResult &result)
 	{
-		deferreds.erase(d);
+		pending.reset();
 
 		if(result.success)
 		{
 			lastIds = result.value.value<LastIds>();
+
+			if(sessionCache)
+				sessionCache->set(sid, lastIds, LoopClock::msecsSinceEpoch());
 		}
 		else
 		{
@@ -395,19 +489,53 @@ private:
 
 class Subscription;
 
+// the last documents published with delta to a channel
+class DeltaDocuments
+{
+public:
+	quint64 version;
+	QHash<PublishFormat::Type, QVariant> docs;
+
+	DeltaDocuments() :
+		version(0)
+	{
+	}
+};
+
 class CommonState
 {
 public:
 	QHash<ZhttpRequest::Rid, std::shared_ptr<HttpSession>> httpSessions;
 	QHash<QString, std::shared_ptr<WsSession>> wsSessions;
-	QHash<QString, QSet<HttpSession*> > responseSessionsByChannel;
-	QHash<QString, QSet<HttpSession*> > streamSessionsByChannel;
-	QHash<QString, QSet<WsSession*> > wsSessionsByChannel;
+	ChannelAtoms channelAtoms; // shared by the indexes and subscriptions
+	ChannelIndex<HttpSession> responseSessionsByChannel;
+	ChannelIndex<HttpSession> streamSessionsByChannel;
+	ChannelIndex<WsSession> wsSessionsByChannel;
+	ChannelIndex<HttpSession> responseSessionsByPrefix;
+	ChannelIndex<HttpSession> streamSessionsByPrefix;
+	ChannelTrie channelPrefixes; // one reference per index holding the prefix
+	QHash<QString, QSet<WsSession*>> wsSessionsByUser; // k=user meta
 	PublishLastIds publishLastIds;
+	PublishHistory publishHistory;
 	QHash<QString, Subscription*> subs;
+	QHash<QString, Subscription*> prefixSubs; // k=prefix
+	QHash<QString, DeltaDocuments> deltaDocs; // k=channel
+	quint64 lastDeltaVersion; // versions are unique across channels
+	SessionCache *sessionCache;
+	SessionUpdateBuffer *sessionUpdates;
+	InstructCache *instructCache;
 
 	CommonState() :
-		publishLastIds(1000000)
+		responseSessionsByChannel(&channelAtoms),
+		streamSessionsByChannel(&channelAtoms),
+		wsSessionsByChannel(&channelAtoms),
+		responseSessionsByPrefix(&channelAtoms),
+		streamSessionsByPrefix(&channelAtoms),
+		publishLastIds(1000000),
+		lastDeltaVersion(0),
+		sessionCache(0),
+		sessionUpdates(0),
+		instructCache(0)
 	{
 	}
 };
@@ -416,6 +544,8 @@ class AcceptWorker : public Deferred
 {
 public:
 	std::unique_ptr<ZrpcRequest> req;
+	QVariantHash reqArgs;
+	QByteArray reqFrom;
 	ZrpcManager *stateClient;
 	CommonState *cs;
 	ZhttpManager *zhttpIn;
@@ -430,6 +560,7 @@ public:
 	int logLevel;
 	QStringList implicitChannels;
 	bool trusted;
+	bool compressPublished;
 	QHash<ZhttpRequest::Rid, RequestState> requestStates;
 	HttpRequestData requestData;
 	HttpRequestData origRequestData;
@@ -440,12 +571,21 @@ public:
 	QString sid;
 	LastIds lastIds;
 	QList<std::shared_ptr<HttpSession>> sessions;
+	QList<PublishItem> replayItems;
 	int connectionSubscriptionMax;
 	QSet<QByteArray> needRemoveFromStats;
-	std::map<Deferred*, std::unique_ptr<Deferred>> deferreds;
-
-	AcceptWorker(ZrpcRequest *_req, ZrpcManager *_stateClient, CommonState *_cs, ZhttpManager *_zhttpIn, ZhttpManager *_zhttpOut, StatsManager *_stats, RateLimiter *_updateLimiter, const std::shared_ptr<RateLimiter> &_filterLimiter, const std::shared_ptr<HttpSessionUpdateManager> &_httpSessionUpdateManager, int _connectionSubscriptionMax) :
+	std::unique_ptr<Deferred> pending; // the step in progress, if any
+	bool batched; // state calls are made by the batch, see AcceptBatchWorker
+	QList<DetectRule> pendingRules;
+	TraceContext trace;
+	quint64 traceStart;
+
+	// req may be null for items of a batch, in which case args and from
+	// are provided directly and the outcome is reported via itemResponded
+	AcceptWorker(ZrpcRequest *_req, const QVariantHash &_args, const QByteArray &_from, ZrpcManager *_stateClient, CommonState *_cs, ZhttpManager *_zhttpIn, ZhttpManager *_zhttpOut, StatsManager *_stats, RateLimiter *_updateLimiter, const std::shared_ptr<RateLimiter> &_filterLimiter, const std::shared_ptr<HttpSessionUpdateManager> &_httpSessionUpdateManager, int _connectionSubscriptionMax) :
 		req(_req),
+		reqArgs(_args),
+		reqFrom(_from),
 		stateClient(_stateClient),
 		cs(_cs),
 		zhttpIn(_zhttpIn),
@@ -456,16 +596,27 @@ public:
 		httpSessionUpdateManager(_httpSessionUpdateManager),
 		logLevel(-1),
 		trusted(false),
+		compressPublished(false),
 		haveInspectInfo(false),
 		responseSent(false),
-		connectionSubscriptionMax(_connectionSubscriptionMax)
+		connectionSubscriptionMax(_connectionSubscriptionMax),
+		batched(false),
+		traceStart(0)
 	{
+		if(req)
+		{
+			reqArgs = req->args();
+			reqFrom = req->from();
+		}
 	}
 
 	~AcceptWorker()
 	{
 		foreach(const QByteArray &cid, needRemoveFromStats)
 			stats->removeConnection(cid, false);
+
+		if(trace.isValid())
+			TRACE_SPAN(HandlerAccept, trace, traceStart);
 	}
 
 	// NOTE: to ensure sequential processing of conn-max packets, this
@@ -474,7 +625,7 @@ public:
 	// asynchronously
 	void start()
 	{
-		QVariantHash args = req->args();
+		const QVariantHash &args = reqArgs;
 
 		// process conn-max packets before doing anything else
 		if(args.contains("conn-max"))
@@ -579,6 +730,17 @@ public:
 			trusted = args["trusted"].toBool();
 		}
 
+		if(args.contains("publish-compress"))
+		{
+			if(typeId(args["publish-compress"]) != QMetaType::Bool)
+			{
+				respondError("bad-request");
+				return;
+			}
+
+			compressPublished = args["publish-compress"].toBool();
+		}
+
 		// parse requests
 
 		if(!args.contains("requests") || typeId(args["requests"]) != QMetaType::QVariantList)
@@ -599,24 +761,40 @@ public:
 			requestStates.insert(rs.rid, rs);
 		}
 
-		// parse request-data
+		// parse orig-request-data
 
-		requestData = parseRequestData(args, "request-data");
-		if(requestData.method.isEmpty())
+		origRequestData = parseRequestData(args, "orig-request-data");
+		if(origRequestData.method.isEmpty())
 		{
 			respondError("bad-request");
 			return;
 		}
 
-		// parse orig-request-data
+		// parse request-data. the sender may leave out headers or body that
+		//   are the same as in orig-request-data
 
-		origRequestData = parseRequestData(args, "orig-request-data");
-		if(origRequestData.method.isEmpty())
+		requestData = parseRequestData(args, "request-data", &origRequestData);
+		if(requestData.method.isEmpty())
 		{
 			respondError("bad-request");
 			return;
 		}
 
+		// the proxy's span is the parent. sessions and retries are based
+		//   on the original request, so that is where our span goes
+		if(Trace::enabled())
+		{
+			TraceContext parent = TraceContext::fromHeader(requestData.headers.get("traceparent"));
+			if(parent.isSampled())
+			{
+				trace = parent.createChild();
+				traceStart = Trace::timestamp();
+
+				origRequestData.headers.removeAll("traceparent");
+				origRequestData.headers += HttpHeader("traceparent", trace.toHeader());
+			}
+		}
+
 		// parse response
 
 		if(!args.contains("response") || typeId(args["response"]) != QMetaType::QVariantHash)
@@ -810,14 +988,21 @@ public:
 
 		if(useSession && stateClient)
 		{
-			if(!rules.isEmpty())
+			if(batched)
 			{
-				auto d = std::unique_ptr<Deferred>(SessionRequest::detectRulesSet(stateClient, rules));
+				// the batch stores the rules of all its items at once
+				// and then calls continueAfterRules
+				pendingRules = rules;
+				rulesReady();
+				return;
+			}
 
-				// safe to not track, since d can't outlive this
-				d->finished.connect(boost::bind(&AcceptWorker::sessionDetectRulesSet_finished, this, d.get(), boost::placeholders::_1));
+			if(!rules.isEmpty())
+			{
+				pending = std::unique_ptr<Deferred>(SessionRequest::detectRulesSet(stateClient, rules));
 
-				deferreds[d.get()] = std::move(d);
+				// safe to not track, since pending can't outlive this
+				pending->finished.connect(boost::bind(&AcceptWorker::sessionDetectRulesSet_finished, this, boost::placeholders::_1));
 			}
 			else
 			{
@@ -838,11 +1023,32 @@ public:
 		return out;
 	}
 
+	// items the sessions missed, from the publish history
+	QList<PublishItem> takeReplayItems()
+	{
+		QList<PublishItem> out;
+		out.swap(replayItems);
+		return out;
+	}
+
+	void continueAfterRules()
+	{
+		afterSetRules();
+	}
+
+	void continueAfterSessions()
+	{
+		afterSessionCalls();
+	}
+
 	Signal sessionsReady;
 	boost::signals2::signal<void(const QByteArray &,const RetryRequestPacket&)> retryPacketReady;
+	Signal rulesReady;
+	Signal createOrUpdateReady;
+	boost::signals2::signal<void(bool, const QByteArray &, const QVariant &)> itemResponded;
 
 private:
-	static HttpRequestData parseRequestData(const QVariantHash &args, const QString &field)
+	static HttpRequestData parseRequestData(const QVariantHash &args, const QString &field, const HttpRequestData *base = 0)
 	{
 		if(!args.contains(field) || typeId(args[field]) != QMetaType::QVariantHash)
 			return HttpRequestData();
@@ -862,32 +1068,58 @@ private:
 		if(!out.uri.isValid())
 			return HttpRequestData();
 
-		if(!rd.contains("headers") || typeId(rd["headers"]) != QMetaType::QVariantList)
-			return HttpRequestData();
-
-		foreach(const QVariant &vheader, rd["headers"].toList())
+		if(!rd.contains("headers") && base)
 		{
-			if(typeId(vheader) != QMetaType::QVariantList)
+			out.headers = base->headers;
+		}
+		else
+		{
+			if(!rd.contains("headers") || typeId(rd["headers"]) != QMetaType::QVariantList)
 				return HttpRequestData();
 
-			QVariantList vlist = vheader.toList();
-			if(vlist.count() != 2 || typeId(vlist[0]) != QMetaType::QByteArray || typeId(vlist[1]) != QMetaType::QByteArray)
-				return HttpRequestData();
+			foreach(const QVariant &vheader, rd["headers"].toList())
+			{
+				if(typeId(vheader) != QMetaType::QVariantList)
+					return HttpRequestData();
+
+				QVariantList vlist = vheader.toList();
+				if(vlist.count() != 2 || typeId(vlist[0]) != QMetaType::QByteArray || typeId(vlist[1]) != QMetaType::QByteArray)
+					return HttpRequestData();
 
-			out.headers += HttpHeader(vlist[0].toByteArray(), vlist[1].toByteArray());
+				out.headers += HttpHeader(vlist[0].toByteArray(), vlist[1].toByteArray());
+			}
 		}
 
-		if(!rd.contains("body") || typeId(rd["body"]) != QMetaType::QByteArray)
-			return HttpRequestData();
+		if(!rd.contains("body") && base)
+		{
+			out.body = base->body;
+		}
+		else
+		{
+			if(!rd.contains("body") || typeId(rd["body"]) != QMetaType::QByteArray)
+				return HttpRequestData();
 
-		out.body = rd["body"].toByteArray();
+			out.body = rd["body"].toByteArray();
+		}
 
 		return out;
 	}
 
+	void respond(const QVariant &result)
+	{
+		if(req)
+			req->respond(result);
+		else
+			itemResponded(true, QByteArray(), result);
+	}
+
 	void respondError(const QByteArray &condition, const QVariant &result = QVariant())
 	{
-		req->respondError(condition, result);
+		if(req)
+			req->respondError(condition, result);
+		else
+			itemResponded(false, condition, result);
+
 		setFinished(true);
 	}
 
@@ -895,12 +1127,32 @@ private:
 	{
 		if(!sid.isEmpty())
 		{
-			auto d = std::unique_ptr<Deferred>(SessionRequest::createOrUpdate(stateClient, sid, lastIds));
+			qint64 now = LoopClock::msecsSinceEpoch();
 
-			// safe to not track, since d can't outlive this
-			d->finished.connect(boost::bind(&AcceptWorker::sessionCreateOrUpdate_finished, this, d.get(), boost::placeholders::_1));
+			LastIds cached;
+			if(cs->sessionCache && cs->sessionCache->get(sid, &cached, now))
+			{
+				// the session is known to exist, so the write can be
+				// batched instead of waited on
+				cs->sessionCache->update(sid, lastIds, now);
+				cs->sessionUpdates->add(sid, lastIds);
 
-			deferreds[d.get()] = std::move(d);
+				afterSessionCalls();
+				return;
+			}
+
+			if(batched)
+			{
+				// the batch creates or updates the sessions of all its
+				// items at once and then calls continueAfterSessions
+				createOrUpdateReady();
+				return;
+			}
+
+			pending = std::unique_ptr<Deferred>(SessionRequest::createOrUpdate(stateClient, sid, lastIds));
+
+			// safe to not track, since pending can't outlive this
+			pending->finished.connect(boost::bind(&AcceptWorker::sessionCreateOrUpdate_finished, this, boost::placeholders::_1));
 		}
 		else
 		{
@@ -912,7 +1164,7 @@ private:
 	{
 		bool ok;
 		QString errorMessage;
-		Instruct instruct = Instruct::fromResponse(responseData, &ok, &errorMessage);
+		Instruct instruct = cs->instructCache->fromResponse(responseData, &ok, &errorMessage);
 		if(!ok)
 		{
 			respondError("bad-format", errorMessage.toUtf8());
@@ -950,9 +1202,7 @@ private:
 				QByteArray body = fs.process(instruct.response.body);
 				if(body.isNull())
 				{
-					req->respondError("bad-format", QString("filter error: %1").arg(fs.errorMessage()).toUtf8());
-
-					setFinished(true);
+					respondError("bad-format", QString("filter error: %1").arg(fs.errorMessage()).toUtf8());
 					return;
 				}
 
@@ -975,23 +1225,22 @@ private:
 				result["response"] = vresponse;
 			}
 
-			req->respond(result);
+			respond(result);
 
 			setFinished(true);
 			return;
 		}
 
-		QByteArray reqFrom = req->from();
-
 		QVariantHash result;
 		result["accepted"] = true;
-		req->respond(result);
+		respond(result);
 
 		log_debug("accepting %d requests from %s", requestStates.count(), reqFrom.data());
 
 		if(instruct.holdMode == Instruct::ResponseHold)
 		{
-			bool conflict = false;
+			QStringList conflicting;
+			bool replay = true;
 			foreach(const Instruct::Channel &c, instruct.channels)
 			{
 				if(!c.prevId.isNull())
@@ -1001,18 +1250,31 @@ private:
 					QString lastId = cs->publishLastIds.value(name);
 					if(!lastId.isNull() && lastId != c.prevId)
 					{
-						log_debug("last ID inconsistency (got=%s, expected=%s), retrying", qPrintable(c.prevId), qPrintable(lastId));
-						cs->publishLastIds.remove(name);
-						conflict = true;
+						conflicting += name;
 
-						// NOTE: don't exit loop here. we want to clear
-						//   the last ids of all conflicting channels
+						// if the missed items are still in the history, they
+						//   can be sent to the sessions instead of retrying
+						if(replay && !cs->publishHistory.itemsAfter(name, c.prevId, &replayItems))
+							replay = false;
 					}
 				}
 			}
 
-			if(conflict)
+			if(!conflicting.isEmpty() && replay)
+			{
+				log_debug("last ID inconsistency, replaying %d items from history", replayItems.count());
+			}
+			else if(!conflicting.isEmpty())
 			{
+				replayItems.clear();
+
+				// clear the last ids of all conflicting channels
+				foreach(const QString &name, conflicting)
+				{
+					log_debug("last ID inconsistency on %s, retrying", qPrintable(name));
+					cs->publishLastIds.remove(name);
+				}
+
 				RetryRequestPacket rp;
 
 				foreach(const RequestState &rs, requestStates)
@@ -1130,6 +1392,7 @@ private:
 			adata.sid = sid;
 			adata.responseSent = responseSent;
 			adata.trusted = trusted;
+			adata.compressPublished = compressPublished;
 			adata.haveInspectInfo = haveInspectInfo;
 			adata.inspectInfo = inspectInfo;
 
@@ -1146,9 +1409,9 @@ private:
 		setFinished(true);
 	}
 
-	void sessionDetectRulesSet_finished(Deferred *d, const DeferredResult &result)
+	void sessionDetectRulesSet_finished(const DeferredResult &result)
 	{
-		deferreds.erase(d);
+		pending.reset();
 
 		if(!result.success)
 			log_error("couldn't store detection rules: condition=%d", result.value.toInt());
@@ -1156,9 +1419,9 @@ private:
 		afterSetRules();
 	}
 
-	void sessionCreateOrUpdate_finished(Deferred *d, const DeferredResult &result)
+	void sessionCreateOrUpdate_finished(const DeferredResult &result)
 	{
-		deferreds.erase(d);
+		pending.reset();
 
 		if(!result.success)
 			log_error("couldn't create/update session: condition=%d", result.value.toInt());
@@ -1167,92 +1430,561 @@ private:
 	}
 };
 
-class Subscription
+// handles an accept-batch request, where each item carries the args of an
+// accept request. the detection rules of all items are stored with a single
+// state call, as are the sessions, and retry packets are written together
+// once all items finish
+class AcceptBatchWorker : public Deferred
 {
 public:
-	Subscription(const QString &channel) :
-		channel_(channel)
+	class Item
 	{
-	}
+	public:
+		std::unique_ptr<AcceptWorker> worker;
+		bool responded;
+		QVariantHash result;
 
-	const QString & channel() const
+		Item() :
+			responded(false)
+		{
+		}
+	};
+
+	std::unique_ptr<ZrpcRequest> req;
+	ZrpcManager *stateClient;
+	CommonState *cs;
+	ZhttpManager *zhttpIn;
+	ZhttpManager *zhttpOut;
+	StatsManager *stats;
+	RateLimiter *updateLimiter;
+	std::shared_ptr<RateLimiter> filterLimiter;
+	std::shared_ptr<HttpSessionUpdateManager> httpSessionUpdateManager;
+	int connectionSubscriptionMax;
+	std::vector<Item> items;
+	int pendingResponses;
+	int pendingItems;
+	QList<AcceptWorker*> waitingRules;
+	QList<AcceptWorker*> waitingSessions;
+	QList<RetryRequestPacket> retryPackets;
+	std::unique_ptr<Deferred> rulesRequest;
+	std::unique_ptr<Deferred> sessionsRequest;
+
+	AcceptBatchWorker(ZrpcRequest *_req, ZrpcManager *_stateClient, CommonState *_cs, ZhttpManager *_zhttpIn, ZhttpManager *_zhttpOut, StatsManager *_stats, RateLimiter *_updateLimiter, const std::shared_ptr<RateLimiter> &_filterLimiter, const std::shared_ptr<HttpSessionUpdateManager> &_httpSessionUpdateManager, int _connectionSubscriptionMax) :
+		req(_req),
+		stateClient(_stateClient),
+		cs(_cs),
+		zhttpIn(_zhttpIn),
+		zhttpOut(_zhttpOut),
+		stats(_stats),
+		updateLimiter(_updateLimiter),
+		filterLimiter(_filterLimiter),
+		httpSessionUpdateManager(_httpSessionUpdateManager),
+		connectionSubscriptionMax(_connectionSubscriptionMax),
+		pendingResponses(0),
+		pendingItems(0)
 	{
-		return channel_;
 	}
 
+	// NOTE: like AcceptWorker, any conn-max packets contained within the
+	// items are processed before returning
 	void start()
 	{
-		timer_ = std::make_unique<Timer>();
-		timer_->timeout.connect(boost::bind(&Subscription::timer_timeout, this));
-		timer_->setSingleShot(true);
-		timer_->start(SUBSCRIBED_DELAY);
+		QVariantHash args = req->args();
+
+		if(!args.contains("items") || typeId(args["items"]) != QMetaType::QVariantList)
+		{
+			respondError("bad-request");
+			return;
+		}
+
+		QVariantList vitems = args["items"].toList();
+
+		if(vitems.isEmpty() || vitems.count() > ACCEPT_BATCH_ITEMS_MAX)
+		{
+			respondError("bad-request");
+			return;
+		}
+
+		foreach(const QVariant &vitem, vitems)
+		{
+			if(typeId(vitem) != QMetaType::QVariantHash)
+			{
+				respondError("bad-request");
+				return;
+			}
+		}
+
+		QByteArray reqFrom = req->from();
+
+		items.resize(vitems.count());
+		pendingResponses = vitems.count();
+		pendingItems = vitems.count();
+
+		for(int n = 0; n < vitems.count(); ++n)
+		{
+			AcceptWorker *w = new AcceptWorker(0, vitems[n].toHash(), reqFrom, stateClient, cs, zhttpIn, zhttpOut, stats, updateLimiter, filterLimiter, httpSessionUpdateManager, connectionSubscriptionMax);
+			w->batched = true;
+
+			// safe to not track, since w can't outlive this
+			w->finished.connect(boost::bind(&AcceptBatchWorker::item_finished, this, n, boost::placeholders::_1));
+			w->sessionsReady.connect(boost::bind(&AcceptBatchWorker::item_sessionsReady, this, w));
+			w->retryPacketReady.connect(boost::bind(&AcceptBatchWorker::item_retryPacketReady, this, boost::placeholders::_2));
+			w->rulesReady.connect(boost::bind(&AcceptBatchWorker::item_rulesReady, this, w));
+			w->createOrUpdateReady.connect(boost::bind(&AcceptBatchWorker::item_createOrUpdateReady, this, w));
+			w->itemResponded.connect(boost::bind(&AcceptBatchWorker::item_responded, this, n, boost::placeholders::_1, boost::placeholders::_2, boost::placeholders::_3));
+
+			items[n].worker = std::unique_ptr<AcceptWorker>(w);
+		}
+
+		// items run synchronously until they need the state service, so
+		// once they have all been started, the rules of the batch are known
+		for(Item &i : items)
+			i.worker->start();
+
+		if(waitingRules.isEmpty())
+			return;
+
+		QList<DetectRule> rules;
+		foreach(AcceptWorker *w, waitingRules)
+			rules += w->pendingRules;
+
+		if(!rules.isEmpty())
+		{
+			rulesRequest = std::unique_ptr<Deferred>(SessionRequest::detectRulesSet(stateClient, rules));
+			rulesRequest->finished.connect(boost::bind(&AcceptBatchWorker::sessionDetectRulesSet_finished, this, boost::placeholders::_1));
+		}
+		else
+		{
+			afterSetRules();
+		}
 	}
 
-	Signal subscribed;
+	boost::signals2::signal<void(AcceptWorker*)> sessionsReady;
+	boost::signals2::signal<void(const QByteArray &, const QList<RetryRequestPacket>&)> retryPacketsReady;
 
 private:
-	QString channel_;
-	std::unique_ptr<Timer> timer_;
-
-	void timer_timeout()
+	void respondError(const QByteArray &condition)
 	{
-		subscribed();
+		req->respondError(condition);
+		setFinished(true);
 	}
-};
 
-class HandlerEngine::Private
-{
-public:
-	class PublishAction : public RateLimiter::Action
+	void afterSetRules()
 	{
-	public:
-		std::weak_ptr<HandlerEngine::Private> ep;
-		std::weak_ptr<ClientSession> target;
-		PublishItem item;
-		QList<QByteArray> exposeHeaders;
+		QList<AcceptWorker*> workers;
+		workers.swap(waitingRules);
 
-		PublishAction(const std::weak_ptr<HandlerEngine::Private> _ep, const std::weak_ptr<ClientSession> _target, const PublishItem &_item, const QList<QByteArray> &_exposeHeaders = QList<QByteArray>()) :
-			ep(_ep),
-			target(_target),
-			item(_item),
-			exposeHeaders(_exposeHeaders)
-		{
-		}
+		foreach(AcceptWorker *w, workers)
+			w->continueAfterRules();
 
-		virtual bool execute()
-		{
-			auto epl = ep.lock();
-			if(!epl)
-				return false;
+		// items continue synchronously until they need their session
+		// stored, so the sessions of the batch are now known
+		if(waitingSessions.isEmpty())
+			return;
 
-			auto targetl = target.lock();
-			if(!targetl)
-				return false;
+		QHash<QString, LastIds> sidLastIds;
+		foreach(AcceptWorker *w, waitingSessions)
+		{
+			LastIds &lastIds = sidLastIds[w->sid];
 
-			epl->publishSend(targetl, item, exposeHeaders);
-			return true;
+			QHashIterator<QString, QString> it(w->lastIds);
+			while(it.hasNext())
+			{
+				it.next();
+				lastIds.insert(it.key(), it.value());
+			}
 		}
-	};
 
-	struct WSSessionConnections {
-		Connection sendConnection;
-		Connection expConnection;
-		Connection errorConnection;
-	};
+		sessionsRequest = std::unique_ptr<Deferred>(SessionRequest::createOrUpdateMany(stateClient, sidLastIds));
+		sessionsRequest->finished.connect(boost::bind(&AcceptBatchWorker::sessionCreateOrUpdateMany_finished, this, boost::placeholders::_1));
+	}
 
-	HandlerEngine *q;
-	Configuration config;
-	std::unique_ptr<ZhttpManager> zhttpIn;
-	std::unique_ptr<ZhttpManager> zhttpOut;
-	std::unique_ptr<ZrpcManager> inspectServer;
+	void item_rulesReady(AcceptWorker *w)
+	{
+		waitingRules += w;
+	}
+
+	void item_createOrUpdateReady(AcceptWorker *w)
+	{
+		waitingSessions += w;
+	}
+
+	void item_responded(int index, bool success, const QByteArray &condition, const QVariant &value)
+	{
+		Item &i = items[index];
+		if(i.responded)
+			return;
+
+		i.responded = true;
+		i.result["success"] = success;
+		if(!condition.isEmpty())
+			i.result["condition"] = condition;
+		if(value.isValid())
+			i.result["value"] = value;
+
+		--pendingResponses;
+		if(pendingResponses == 0)
+		{
+			QVariantList results;
+			for(const Item &other : items)
+				results += other.result;
+
+			QVariantHash result;
+			result["results"] = results;
+			req->respond(result);
+		}
+	}
+
+	void item_sessionsReady(AcceptWorker *w)
+	{
+		sessionsReady(w);
+	}
+
+	void item_retryPacketReady(const RetryRequestPacket &packet)
+	{
+		retryPackets += packet;
+	}
+
+	void item_finished(int index, const DeferredResult &result)
+	{
+		Q_UNUSED(result);
+
+		items[index].worker.reset();
+
+		--pendingItems;
+		if(pendingItems == 0)
+		{
+			if(!retryPackets.isEmpty())
+				retryPacketsReady(req->from(), retryPackets);
+
+			setFinished(true);
+		}
+	}
+
+	void sessionDetectRulesSet_finished(const DeferredResult &result)
+	{
+		rulesRequest.reset();
+
+		if(!result.success)
+			log_error("couldn't store detection rules: condition=%d", result.value.toInt());
+
+		afterSetRules();
+	}
+
+	void sessionCreateOrUpdateMany_finished(const DeferredResult &result)
+	{
+		sessionsRequest.reset();
+
+		if(!result.success)
+			log_error("couldn't create/update sessions: condition=%d", result.value.toInt());
+
+		QList<AcceptWorker*> workers;
+		workers.swap(waitingSessions);
+
+		foreach(AcceptWorker *w, workers)
+			w->continueAfterSessions();
+	}
+};
+
+// passes a state request from a shard on to the state service, and the
+// response back
+class StateRelayWorker : public Deferred
+{
+public:
+	StateRelayWorker(ZrpcRequest *_req, ZrpcManager *stateClient) :
+		req(_req)
+	{
+		out = std::make_unique<ZrpcRequest>(stateClient);
+		finishedConnection = out->finished.connect(boost::bind(&StateRelayWorker::out_finished, this));
+		out->start(req->method(), req->args());
+	}
+
+private:
+	std::unique_ptr<ZrpcRequest> req;
+	std::unique_ptr<ZrpcRequest> out;
+	Connection finishedConnection;
+
+	void out_finished()
+	{
+		if(out->success())
+			req->respond(out->result());
+		else
+			req->respondError(out->errorConditionString(), out->result());
+
+		setFinished(true);
+	}
+};
+
+class Subscription
+{
+public:
+	Subscription(ChannelAtoms *atoms, const QString &channel) :
+		atoms_(atoms),
+		atom_(atoms->acquire(channel))
+	{
+	}
+
+	~Subscription()
+	{
+		atoms_->release(atom_);
+	}
+
+	const QString & channel() const
+	{
+		return atoms_->name(atom_);
+	}
+
+	const QByteArray & channelUtf8() const
+	{
+		return atoms_->utf8(atom_);
+	}
+
+	void start()
+	{
+		timer_ = std::make_unique<Timer>();
+		timer_->timeout.connect(boost::bind(&Subscription::timer_timeout, this));
+		timer_->setSingleShot(true);
+		timer_->start(SUBSCRIBED_DELAY);
+	}
+
+	Signal subscribed;
+
+private:
+	ChannelAtoms *atoms_;
+	int atom_;
+	std::unique_ptr<Timer> timer_;
+
+	void timer_timeout()
+	{
+		subscribed();
+	}
+};
+
+class HandlerEngine::Private
+{
+public:
+	// there is one action per recipient, so they are recycled through a
+	// free list rather than allocated for every delivery
+	class PublishAction : public RateLimiter::Action
+	{
+	public:
+		std::vector<PublishAction*> *freeList;
+		std::weak_ptr<HandlerEngine::Private> ep;
+		std::weak_ptr<ClientSession> target;
+		std::shared_ptr<const PublishItem> item;
+		QList<QByteArray> exposeHeaders;
+
+		PublishAction(std::vector<PublishAction*> *_freeList) :
+			freeList(_freeList)
+		{
+		}
+
+		static PublishAction *take(std::vector<PublishAction*> *freeList, const std::weak_ptr<HandlerEngine::Private> &ep, const std::weak_ptr<ClientSession> &target, const std::shared_ptr<const PublishItem> &item, const QList<QByteArray> &exposeHeaders = QList<QByteArray>())
+		{
+			PublishAction *a;
+			if(!freeList->empty())
+			{
+				a = freeList->back();
+				freeList->pop_back();
+			}
+			else
+			{
+				a = new PublishAction(freeList);
+			}
+
+			a->ep = ep;
+			a->target = target;
+			a->item = item;
+			a->exposeHeaders = exposeHeaders;
+
+			return a;
+		}
+
+		virtual void release()
+		{
+			if(freeList->size() >= PUBLISH_ACTION_POOL_MAX)
+			{
+				delete this;
+				return;
+			}
+
+			// don't hold on to the payload or the session
+			target.reset();
+			item.reset();
+			exposeHeaders.clear();
+
+			freeList->push_back(this);
+		}
+
+		virtual bool execute()
+		{
+			auto epl = ep.lock();
+			if(!epl)
+				return false;
+
+			auto targetl = target.lock();
+			if(!targetl)
+				return false;
+
+			// items with a prev-id still go to the session, so that it
+			// can keep following the id chain while dropping them
+			if(item->isExpired() && item->prevId.isEmpty())
+			{
+				epl->publishExpired(targetl);
+				return false;
+			}
+
+			PublishLatency::record(PublishLatency::Dequeued, item->format.type, item->receiveTime);
+
+			epl->publishSend(targetl, item, exposeHeaders);
+			return true;
+		}
+	};
+
+	// per-format state of a publish delivery
+	class PublishDelivery
+	{
+	public:
+		std::shared_ptr<const PublishItem> item;
+		QList<QByteArray> exposeHeaders;
+		int size;
+		int blocks;
+		int receivers;
+
+		// for delta items, the payloads of subscribers that opted in. the
+		// patch is null if there is no previous document or if it wouldn't
+		// be smaller than the snapshot
+		std::shared_ptr<const PublishItem> deltaPatch;
+		std::shared_ptr<const PublishItem> deltaSnapshot;
+		quint64 deltaBase;
+		quint64 deltaVersion;
+
+		// messages sent per stats route. reported once per job rather
+		// than once per receiver
+		std::vector<std::pair<QByteArray, int>> sent;
+		QHash<QByteArray, int> sentIndexes;
+
+		PublishDelivery() :
+			size(0),
+			blocks(-1),
+			receivers(0),
+			deltaBase(0),
+			deltaVersion(0)
+		{
+		}
+
+		void addSent(const QByteArray &routeId)
+		{
+			// receivers of the same route tend to be adjacent
+			if(!sent.empty() && sent.back().first == routeId)
+			{
+				++sent.back().second;
+				return;
+			}
+
+			QHash<QByteArray, int>::iterator it = sentIndexes.find(routeId);
+			if(it != sentIndexes.end())
+			{
+				++sent[it.value()].second;
+				return;
+			}
+
+			sentIndexes.insert(routeId, (int)sent.size());
+			sent.push_back(std::pair<QByteArray, int>(routeId, 1));
+		}
+	};
+
+	class PublishTarget
+	{
+	public:
+		PublishFormat::Type type;
+		ZhttpRequest::Rid rid; // http-response, http-stream
+		QString cid; // ws-message
+
+		PublishTarget(PublishFormat::Type _type, const ZhttpRequest::Rid &_rid) :
+			type(_type),
+			rid(_rid)
+		{
+		}
+
+		PublishTarget(const QString &_cid) :
+			type(PublishFormat::WebSocketMessage),
+			cid(_cid)
+		{
+		}
+	};
+
+	// a publish item being fanned out to its subscribers
+	class PublishJob
+	{
+	public:
+		PublishItem item;
+		PublishDelivery response;
+		PublishDelivery stream;
+		PublishDelivery ws;
+		QSet<QString> sids;
+		std::vector<PublishTarget> targets; // only used for chunked delivery
+		size_t next;
+		TraceContext trace; // valid if the publisher's trace is sampled
+		quint64 traceStart;
+
+		PublishJob() :
+			next(0),
+			traceStart(0)
+		{
+		}
+	};
+
+	enum PublishLogMode
+	{
+		PublishLogAll,
+		PublishLogSample,
+		PublishLogAggregate
+	};
+
+	class PublishLogCount
+	{
+	public:
+		int items;
+		qint64 receivers;
+
+		PublishLogCount() :
+			items(0),
+			receivers(0)
+		{
+		}
+	};
+
+	struct WSSessionConnections {
+		Connection sendConnection;
+		Connection expConnection;
+		Connection errorConnection;
+	};
+
+	HandlerEngine *q;
+	Configuration config;
+	std::unique_ptr<ZhttpManager> zhttpIn;
+	std::unique_ptr<ZhttpManager> zhttpOut;
+	std::unique_ptr<ZrpcManager> inspectServer;
 	std::unique_ptr<ZrpcManager> acceptServer;
 	std::unique_ptr<ZrpcManager> stateClient;
+	std::unique_ptr<ZrpcManager> stateRelayServer;
 	std::unique_ptr<ZrpcManager> controlServer;
 	std::unique_ptr<ZrpcManager> proxyControlClient;
+	std::unique_ptr<SessionUpdateBuffer> sessionUpdates;
+	std::unique_ptr<SessionCache> sessionCache; // must outlive stats
+	std::unique_ptr<InstructCache> instructCache; // must outlive stats
+	std::unique_ptr<PacketCapture> capture;
 	std::unique_ptr<QZmq::Socket> inPullSock;
 	std::unique_ptr<QZmq::Valve> inPullValve;
 	std::unique_ptr<QZmq::Socket> inSubSock;
 	std::unique_ptr<QZmq::Valve> inSubValve;
+	std::unique_ptr<QZmq::Socket> shardPublishSock;
+	std::unique_ptr<QZmq::Valve> shardPublishValve;
+	std::unique_ptr<QZmq::Socket> subscriptionSock;
+	std::unique_ptr<QZmq::Socket> relaySock;
+	std::unique_ptr<QZmq::Valve> relayValve;
+	QHash<QByteArray, int> subscriptionDirectory; // k=channel, v=holders (self and/or shards)
 	std::unique_ptr<QZmq::Socket> retrySock;
 	std::unique_ptr<QZmq::Socket> wsControlInitSock;
 	std::unique_ptr<QZmq::Valve> wsControlInitValve;
@@ -1263,34 +1995,79 @@ public:
 	std::unique_ptr<QZmq::Valve> proxyStatsValve;
 	std::unique_ptr<SimpleHttpServer> controlHttpServer;
 	std::unique_ptr<StatsManager> stats;
+	std::vector<PublishAction*> freePublishActions;
 	std::unique_ptr<RateLimiter> publishLimiter;
+	SlowConsumerPolicy slowConsumerPolicy;
 	std::unique_ptr<RateLimiter> updateLimiter;
 	std::shared_ptr<RateLimiter> filterLimiter;
 	std::shared_ptr<HttpSessionUpdateManager> httpSessionUpdateManager;
+	std::unique_ptr<PublishConflater> conflater;
 	std::unique_ptr<Sequencer> sequencer;
 	CommonState cs;
 	QSet<InspectWorker*> inspectWorkers;
+	QSet<PublishStream*> publishStreams;
 	QSet<AcceptWorker*> acceptWorkers;
+	QSet<AcceptBatchWorker*> acceptBatchWorkers;
 	std::unique_ptr<Deferred> report;
 	std::map<Deferred*, std::unique_ptr<Deferred>> deferreds;
 	Connection inspectReqReadyConnection;
 	Connection acceptReqReadyConnection;
 	Connection controlReqReadyConnection;
+	Connection stateRelayReqReadyConnection;
 	Connection controlServerConnection;
 	Connection itemReadyConnection;
+	Connection conflatedItemReadyConnection;
 	map<Subscription*, Connection> subscribedConnection;
 	Connection connectionsRefreshedConnection;
 	Connection unsubscribedConnection;
 	Connection reportedConnection;
+	Connection reportIntervalConnection;
 	map<WsSession*, WSSessionConnections> wsSessionConnectionMap;
 	Connection pullConnection;
 	Connection controlInitValveConnection;
 	Connection controlStreamValveConnection;
 	Connection inSubValveConnection;
+	Connection shardPublishValveConnection;
+	Connection relayValveConnection;
 	Connection proxyStatConnection;
+	std::unique_ptr<Timer> budgetTimer;
+	Connection budgetTimerConnection;
+	std::list<std::unique_ptr<PublishJob>> publishJobs;
+	PublishLogMode publishLogMode;
+	int publishLogSampleRate;
+	int startConnectionSubscriptionMax;
+	quint64 publishLogSeq;
+	QHash<QString, PublishLogCount> publishLogCounts;
+	PublishLogCount publishLogOther;
+	bool started;
+	bool draining;
+	bool drained;
+	double drainCredit;
+	qint64 drainDeadline;
+	std::unique_ptr<Timer> drainTimer;
+	Connection drainTimerConnection;
+	std::list<std::weak_ptr<HttpSession>> recoverQueue;
+	double recoverCredit;
+	std::unique_ptr<Timer> recoverTimer;
+	Connection recoverTimerConnection;
+	std::atomic<qint64> recoverPending;
+	std::atomic<quint64> recoverUpdated;
+	DeferCall deferCall;
 
 	Private(HandlerEngine *_q) :
-		q(_q)
+		q(_q),
+		started(false),
+		draining(false),
+		drained(false),
+		drainCredit(0),
+		drainDeadline(-1),
+		recoverCredit(0),
+		recoverPending(0),
+		recoverUpdated(0),
+		publishLogMode(PublishLogAll),
+		publishLogSampleRate(1),
+		startConnectionSubscriptionMax(0),
+		publishLogSeq(0)
 	{
 		qRegisterMetaType<DetectRuleList>();
 
@@ -1300,23 +2077,41 @@ public:
 
 		httpSessionUpdateManager = std::make_shared<HttpSessionUpdateManager>();
 
+		instructCache = std::make_unique<InstructCache>(INSTRUCT_CACHE_MAX);
+		cs.instructCache = instructCache.get();
+
 		sequencer = std::make_unique<Sequencer>(&cs.publishLastIds);
 		itemReadyConnection = sequencer->itemReady.connect(boost::bind(&Private::sequencer_itemReady, this, boost::placeholders::_1));
+
+		conflater = std::make_unique<PublishConflater>();
+		conflatedItemReadyConnection = conflater->itemReady.connect(boost::bind(&Private::conflater_itemReady, this, boost::placeholders::_1));
 	}
 
 	~Private()
 	{
+		if(started && !config.stateFile.isEmpty())
+			saveState();
+
+		// queued actions return to the free list as the limiter goes away
+		publishLimiter.reset();
+		for(PublishAction *a : freePublishActions)
+			delete a;
+
 		qDeleteAll(inspectWorkers);
 		qDeleteAll(acceptWorkers);
+		qDeleteAll(acceptBatchWorkers);
+		qDeleteAll(publishStreams);
 		deferreds.clear();
 		cs.wsSessions.clear();
 		cs.httpSessions.clear();
 		qDeleteAll(cs.subs);
+		qDeleteAll(cs.prefixSubs);
 	}
 
 	bool start(const Configuration &_config)
 	{
 		config = _config;
+		startConnectionSubscriptionMax = config.connectionSubscriptionMax;
 
 		publishLimiter->setRate(config.messageRate);
 		publishLimiter->setHwm(config.messageHwm);
@@ -1327,7 +2122,51 @@ public:
 		filterLimiter->setRate(100);
 
 		sequencer->setWaitMax(config.messageWait);
+		sequencer->setAdaptiveWait(config.messageWaitAdaptive);
 		sequencer->setIdCacheTtl(config.idCacheTtl);
+		conflater->setRates(config.conflateRates);
+
+		if(config.messageHistoryDepth > 0)
+			cs.publishHistory.setLimits(config.messageHistoryDepth, (qint64)qMax(config.messageHistoryMemoryMax, 1) * 1024 * 1024);
+
+		if(config.idCacheMode == "compact")
+		{
+			sequencer->setIdCacheMemoryMax((qint64)qMax(config.idCacheMemoryMax, 1) * 1024 * 1024);
+			sequencer->setIdCacheMode(Sequencer::CompactIds);
+		}
+		else if(!config.idCacheMode.isEmpty() && config.idCacheMode != "exact")
+		{
+			log_error("invalid id_cache_mode: %s", qPrintable(config.idCacheMode));
+			return false;
+		}
+
+		if(!SlowConsumerPolicy::parseAction(config.slowConsumerAction, &slowConsumerPolicy.action))
+		{
+			log_error("invalid slow_consumer_action: %s", qPrintable(config.slowConsumerAction));
+			return false;
+		}
+
+		slowConsumerPolicy.queueBytesMax = qMax(config.slowConsumerQueueBytes, 0);
+		slowConsumerPolicy.queueAgeMax = qMax(config.slowConsumerQueueAge, 0);
+
+		if(config.publishLogMode == "sample")
+		{
+			publishLogMode = PublishLogSample;
+			publishLogSampleRate = qMax(config.publishLogSampleRate, 1);
+		}
+		else if(config.publishLogMode == "aggregate")
+		{
+			// counts are flushed on the stats report interval
+			if(config.statsReportInterval > 0)
+				publishLogMode = PublishLogAggregate;
+			else
+				log_warning("publish_log_mode=aggregate requires stats_report_interval, logging all publishes");
+		}
+		else if(!config.publishLogMode.isEmpty() && config.publishLogMode != "all")
+		{
+			log_error("invalid publish_log_mode: %s", qPrintable(config.publishLogMode));
+			return false;
+		}
 
 		zhttpIn = std::make_unique<ZhttpManager>();
 		zhttpIn->setInstanceId(config.instanceId);
@@ -1375,20 +2214,53 @@ public:
 			log_debug("accept server: %s", qPrintable(config.acceptSpecs.join(", ")));
 		}
 
-		if(!config.stateSpec.isEmpty())
+		QString stateSpec = config.stateSpec;
+		bool stateRelayed = false;
+
+		// shards reach the state service through the main engine
+		if(config.shardIndex > 0 && !config.shardStateSpec.isEmpty())
+		{
+			stateSpec = config.shardStateSpec;
+			stateRelayed = true;
+		}
+
+		if(!stateSpec.isEmpty())
 		{
 			stateClient = std::make_unique<ZrpcManager>();
-			stateClient->setBind(true);
+			stateClient->setBind(!stateRelayed);
 			stateClient->setIpcFileMode(config.ipcFileMode);
-			stateClient->setTimeout(STATE_RPC_TIMEOUT);
 
-			if(!stateClient->setClientSpecs(QStringList() << config.stateSpec))
+			// wait longer than the main engine, so that its timeout error
+			// is what gets relayed
+			stateClient->setTimeout(stateRelayed ? STATE_RPC_TIMEOUT * 2 : STATE_RPC_TIMEOUT);
+
+			if(!stateClient->setClientSpecs(QStringList() << stateSpec))
+			{
+				// zrpcmanager logs error
+				return false;
+			}
+
+			sessionUpdates = std::make_unique<SessionUpdateBuffer>(stateClient.get(), SESSION_UPDATE_FLUSH_INTERVAL, SESSION_UPDATE_FLUSH_SIZE, SESSION_UPDATE_PENDING_MAX);
+			sessionCache = std::make_unique<SessionCache>(SESSION_CACHE_MAX, SESSION_CACHE_TTL);
+			cs.sessionUpdates = sessionUpdates.get();
+			cs.sessionCache = sessionCache.get();
+
+			log_debug("state client: %s", qPrintable(stateSpec));
+		}
+
+		if(config.shardIndex == 0 && stateClient && !config.shardStateSpec.isEmpty())
+		{
+			stateRelayServer = std::make_unique<ZrpcManager>();
+			stateRelayServer->setBind(true);
+			stateRelayReqReadyConnection = stateRelayServer->requestReady.connect(boost::bind(&Private::stateRelayServer_requestReady, this));
+
+			if(!stateRelayServer->setServerSpecs(QStringList() << config.shardStateSpec))
 			{
 				// zrpcmanager logs error
 				return false;
 			}
 
-			log_debug("state client: %s", qPrintable(config.stateSpec));
+			log_debug("state relay server: %s", qPrintable(config.shardStateSpec));
 		}
 
 		if(!config.commandSpec.isEmpty())
@@ -1407,6 +2279,20 @@ public:
 			log_debug("control server: %s", qPrintable(config.commandSpec));
 		}
 
+		if(!config.captureFile.isEmpty())
+		{
+			capture = std::make_unique<PacketCapture>();
+
+			QString errorMessage;
+			if(!capture->open(config.captureFile, &errorMessage))
+			{
+				log_error("capture: %s", qPrintable(errorMessage));
+				return false;
+			}
+
+			log_info("capturing publishes to %s", qPrintable(config.captureFile));
+		}
+
 		if(!config.pushInSpec.isEmpty())
 		{
 			inPullSock = std::make_unique<QZmq::Socket>(QZmq::Socket::Pull);
@@ -1425,10 +2311,67 @@ public:
 			log_debug("in pull: %s", qPrintable(config.pushInSpec));
 		}
 
-		if(!config.pushInSubSpecs.isEmpty())
+		if(!config.shardPublishSpec.isEmpty())
 		{
-			inSubSock = std::make_unique<QZmq::Socket>(QZmq::Socket::Sub);
-			inSubSock->setSendHwm(SUB_SNDHWM);
+			// xpub, so the subscriptions of the shards can be read back
+			shardPublishSock = std::make_unique<QZmq::Socket>(QZmq::Socket::XPub);
+			shardPublishSock->setHwm(DEFAULT_HWM);
+			shardPublishSock->setShutdownWaitTime(0);
+
+			QString errorMessage;
+			if(!ZUtil::setupSocket(shardPublishSock.get(), config.shardPublishSpec, true, config.ipcFileMode, &errorMessage))
+			{
+				log_error("%s", qPrintable(errorMessage));
+				return false;
+			}
+
+			shardPublishValve = std::make_unique<QZmq::Valve>(shardPublishSock.get());
+			shardPublishValveConnection = shardPublishValve->readyRead.connect(boost::bind(&Private::peerSubscriptions_readyRead, this, boost::placeholders::_1));
+
+			log_debug("shard publish: %s", qPrintable(config.shardPublishSpec));
+		}
+
+		if(!config.subscriptionSpec.isEmpty())
+		{
+			subscriptionSock = std::make_unique<QZmq::Socket>(QZmq::Socket::Pub);
+			subscriptionSock->setHwm(DEFAULT_HWM);
+			subscriptionSock->setShutdownWaitTime(0);
+
+			QString errorMessage;
+			if(!ZUtil::setupSocket(subscriptionSock.get(), config.subscriptionSpec, true, config.ipcFileMode, &errorMessage))
+			{
+				log_error("%s", qPrintable(errorMessage));
+				return false;
+			}
+
+			log_debug("subscription: %s", qPrintable(config.subscriptionSpec));
+		}
+
+		if(!config.relaySpec.isEmpty())
+		{
+			// downstream instances connect their SUB sockets here, and
+			// their subscriptions are added to our own
+			relaySock = std::make_unique<QZmq::Socket>(QZmq::Socket::XPub);
+			relaySock->setHwm(DEFAULT_HWM);
+			relaySock->setShutdownWaitTime(0);
+
+			QString errorMessage;
+			if(!ZUtil::setupSocket(relaySock.get(), config.relaySpec, true, config.ipcFileMode, &errorMessage))
+			{
+				log_error("%s", qPrintable(errorMessage));
+				return false;
+			}
+
+			relayValve = std::make_unique<QZmq::Valve>(relaySock.get());
+			relayValveConnection = relayValve->readyRead.connect(boost::bind(&Private::peerSubscriptions_readyRead, this, boost::placeholders::_1));
+
+			log_debug("relay: %s", qPrintable(config.relaySpec));
+		}
+
+		if(!config.pushInSubSpecs.isEmpty())
+		{
+			inSubSock = std::make_unique<QZmq::Socket>(QZmq::Socket::Sub);
+			inSubSock->setSendHwm(SUB_SNDHWM);
 			inSubSock->setShutdownWaitTime(0);
 
 			QString errorMessage;
@@ -1519,6 +2462,7 @@ public:
 		connectionsRefreshedConnection = stats->connectionsRefreshed.connect(boost::bind(&Private::stats_connectionsRefreshed, this, boost::placeholders::_1));
 		unsubscribedConnection = stats->unsubscribed.connect(boost::bind(&Private::stats_unsubscribed, this, boost::placeholders::_1, boost::placeholders::_2));
 		reportedConnection = stats->reported.connect(boost::bind(&Private::stats_reported, this, boost::placeholders::_1));
+		reportIntervalConnection = stats->reportIntervalElapsed.connect(boost::bind(&Private::stats_reportIntervalElapsed, this));
 
 		stats->setConnectionSendEnabled(config.statsConnectionSend);
 		stats->setConnectionTtl(config.statsConnectionTtl);
@@ -1526,15 +2470,43 @@ public:
 		stats->setSubscriptionLinger(config.subscriptionLinger);
 		stats->setReportInterval(config.statsReportInterval);
 
+		if(config.statsRefreshMode == "spread")
+		{
+			stats->setRefreshMode(StatsManager::SpreadRefresh);
+		}
+		else if(!config.statsRefreshMode.isEmpty() && config.statsRefreshMode != "buckets")
+		{
+			log_error("invalid stats_refresh_mode: %s", qPrintable(config.statsRefreshMode));
+			return false;
+		}
+
 		if(config.statsFormat == "json")
 		{
 			stats->setOutputFormat(StatsManager::JsonFormat);
 		}
+		else if(config.statsFormat == "binary")
+		{
+			stats->setOutputFormat(StatsManager::BinaryFormat);
+		}
 		else
 		{
 			stats->setOutputFormat(StatsManager::TnetStringFormat);
 		}
 
+		if(config.statsMessageMode == "aggregate")
+		{
+			stats->setMessageMode(StatsManager::AggregateMessages);
+			stats->setMessageInterval(config.statsMessageInterval);
+		}
+		else if(!config.statsMessageMode.isEmpty() && config.statsMessageMode != "each")
+		{
+			log_error("invalid stats_message_mode: %s", qPrintable(config.statsMessageMode));
+			return false;
+		}
+
+		if(config.statsTopChannels > 0)
+			stats->setTopChannels(config.statsTopChannels);
+
 		if(!config.statsSpec.isEmpty())
 		{
 			stats->setInstanceId(config.instanceId);
@@ -1552,6 +2524,33 @@ public:
 		if(!config.prometheusPort.isEmpty())
 		{
 			stats->setPrometheusPrefix(config.prometheusPrefix);
+			PublishLatency::addToPrometheus(stats.get());
+			MemoryBudget::addToPrometheus(stats.get(), QString());
+			ObjectStats::addToPrometheus(stats.get());
+			ObjectStats::updateAllocatorStats();
+			SessionUpdateBuffer::addToPrometheus(stats.get());
+			Sequencer::addToPrometheus(stats.get());
+			PublishConflater::addToPrometheus(stats.get());
+
+			QList<QPair<QString, const RateLimiter*>> limiters;
+			limiters += QPair<QString, const RateLimiter*>("publish", publishLimiter.get());
+			limiters += QPair<QString, const RateLimiter*>("update", updateLimiter.get());
+			limiters += QPair<QString, const RateLimiter*>("filter", filterLimiter.get());
+			RateLimiter::addToPrometheus(stats.get(), limiters);
+
+			if(sessionCache)
+			{
+				stats->addPrometheusCounter("session_cache_hits_total", "Session lookups answered from the local cache", QString(), sessionCache->hits());
+				stats->addPrometheusCounter("session_cache_misses_total", "Session lookups that went to the state service", QString(), sessionCache->misses());
+			}
+
+			stats->addPrometheusCounter("instruct_cache_hits_total", "Accepted responses whose grip headers were already parsed", QString(), instructCache->hits());
+			stats->addPrometheusCounter("instruct_cache_misses_total", "Accepted responses whose grip headers had to be parsed", QString(), instructCache->misses());
+			stats->addPrometheusGauge("recover_sessions_pending", "Sessions waiting to be updated by a paced recover", QString(), &recoverPending);
+			stats->addPrometheusCounter("recover_sessions_updated_total", "Sessions updated by paced recovers", QString(), &recoverUpdated);
+
+			if(LoopStats::enabled())
+				LoopStats::addToPrometheus(stats.get());
 
 			if(!stats->setPrometheusPort(config.prometheusPort))
 			{
@@ -1602,15 +2601,25 @@ public:
 		{
 			controlHttpServer = std::make_unique<SimpleHttpServer>(CONTROL_CONNECTIONS_MAX, config.pushInHttpMaxHeadersSize, config.pushInHttpMaxBodySize);
 			controlServerConnection = controlHttpServer->requestReady.connect(boost::bind(&Private::controlHttpServer_requestReady, this));
+			controlHttpServer->setStreamingPaths(QSet<QByteArray>() << "/publish/stream");
 			controlHttpServer->listen(config.pushInHttpAddr, config.pushInHttpPort);
 
 			log_info("http control server: %s:%d", qPrintable(config.pushInHttpAddr.toString()), config.pushInHttpPort);
 		}
 
+		// before reading any input, so that packets for restored sessions
+		// find them
+		if(!config.stateFile.isEmpty())
+			restoreState();
+
 		if(inPullValve)
 			inPullValve->open();
 		if(inSubValve)
 			inSubValve->open();
+		if(shardPublishValve)
+			shardPublishValve->open();
+		if(relayValve)
+			relayValve->open();
 		if(wsControlInitValve)
 			wsControlInitValve->open();
 		if(wsControlStreamValve)
@@ -1618,16 +2627,238 @@ public:
 		if(proxyStatsValve)
 			proxyStatsValve->open();
 
+		started = true;
+
 		return true;
 	}
 
-	void reload()
+	// applies the settings that can change while running. anything else,
+	// such as specs, needs a restart
+	void reload(const Configuration &newConfig)
+	{
+		if(newConfig.messageRate != config.messageRate)
+		{
+			config.messageRate = newConfig.messageRate;
+			publishLimiter->setRate(config.messageRate);
+			log_info("message_rate changed to %d", config.messageRate);
+		}
+
+		if(newConfig.messageHwm != config.messageHwm)
+		{
+			config.messageHwm = newConfig.messageHwm;
+			publishLimiter->setHwm(config.messageHwm);
+			log_info("message_hwm changed to %d", config.messageHwm);
+		}
+
+		if(newConfig.messageWait != config.messageWait)
+		{
+			config.messageWait = newConfig.messageWait;
+			sequencer->setWaitMax(config.messageWait);
+			log_info("message_wait changed to %d", config.messageWait);
+		}
+
+		if(newConfig.messageWaitAdaptive != config.messageWaitAdaptive)
+		{
+			config.messageWaitAdaptive = newConfig.messageWaitAdaptive;
+			sequencer->setAdaptiveWait(config.messageWaitAdaptive);
+			log_info("message_wait_adaptive changed to %s", config.messageWaitAdaptive ? "true" : "false");
+		}
+
+		if(newConfig.conflateRates != config.conflateRates)
+		{
+			config.conflateRates = newConfig.conflateRates;
+			conflater->setRates(config.conflateRates);
+			log_info("conflate_rates changed, %d rules", (int)config.conflateRates.count());
+		}
+
+		if(newConfig.idCacheTtl != config.idCacheTtl)
+		{
+			config.idCacheTtl = newConfig.idCacheTtl;
+			sequencer->setIdCacheTtl(config.idCacheTtl);
+			log_info("id_cache_ttl changed to %d", config.idCacheTtl);
+		}
+
+		if(newConfig.connectionSubscriptionMax != config.connectionSubscriptionMax)
+		{
+			// timers and stats were sized for the value at startup
+			if(newConfig.connectionSubscriptionMax > startConnectionSubscriptionMax)
+			{
+				log_warning("connection_subscription_max can't be raised above %d without a restart", startConnectionSubscriptionMax);
+			}
+			else
+			{
+				config.connectionSubscriptionMax = newConfig.connectionSubscriptionMax;
+				log_info("connection_subscription_max changed to %d", config.connectionSubscriptionMax);
+			}
+		}
+
+		if(newConfig.subscriptionLinger != config.subscriptionLinger)
+		{
+			config.subscriptionLinger = newConfig.subscriptionLinger;
+			stats->setSubscriptionLinger(config.subscriptionLinger);
+			log_info("subscription_linger changed to %d", config.subscriptionLinger);
+		}
+
+		if(newConfig.statsConnectionTtl != config.statsConnectionTtl)
+		{
+			config.statsConnectionTtl = newConfig.statsConnectionTtl;
+			stats->setConnectionTtl(config.statsConnectionTtl);
+			log_info("stats_connection_ttl changed to %d", config.statsConnectionTtl);
+		}
+
+		if(newConfig.statsSubscriptionTtl != config.statsSubscriptionTtl)
+		{
+			config.statsSubscriptionTtl = newConfig.statsSubscriptionTtl;
+			stats->setSubscriptionTtl(config.statsSubscriptionTtl);
+			log_info("stats_subscription_ttl changed to %d", config.statsSubscriptionTtl);
+		}
+
+		if(newConfig.statsReportInterval != config.statsReportInterval)
+		{
+			// aggregated publish counts are flushed by the report timer
+			if(newConfig.statsReportInterval <= 0 && publishLogMode == PublishLogAggregate)
+			{
+				log_warning("publish_log_mode=aggregate requires stats_report_interval, keeping %d", config.statsReportInterval);
+			}
+			else
+			{
+				config.statsReportInterval = newConfig.statsReportInterval;
+				stats->setReportInterval(config.statsReportInterval);
+				log_info("stats_report_interval changed to %d", config.statsReportInterval);
+			}
+		}
+
+		if(newConfig.statsMessageInterval != config.statsMessageInterval)
+		{
+			config.statsMessageInterval = newConfig.statsMessageInterval;
+			stats->setMessageInterval(config.statsMessageInterval);
+			log_info("stats_message_interval changed to %d", config.statsMessageInterval);
+		}
+
+		if(newConfig.publishLogSampleRate != config.publishLogSampleRate)
+		{
+			config.publishLogSampleRate = newConfig.publishLogSampleRate;
+			if(publishLogMode == PublishLogSample)
+				publishLogSampleRate = qMax(config.publishLogSampleRate, 1);
+			log_info("publish_log_sample_rate changed to %d", config.publishLogSampleRate);
+		}
+	}
+
+	void recover()
+	{
+		recoverCommand();
+	}
+
+	void drain()
+	{
+		if(draining)
+			return;
+
+		draining = true;
+
+		if(config.drainTimeout >= 0)
+			drainDeadline = QDateTime::currentMSecsSinceEpoch() + (qint64)config.drainTimeout * 1000;
+
+		log_info("draining %d http sessions and %d ws sessions", cs.httpSessions.count(), cs.wsSessions.count());
+
+		drainTimer = std::make_unique<Timer>();
+		drainTimer->setSingleShot(true);
+		drainTimerConnection = drainTimer->timeout.connect(boost::bind(&Private::drainTimer_timeout, this));
+
+		startDrainTimer();
+	}
+
+	bool isDrained() const
 	{
-		// nothing to do
+		return drained;
 	}
 
 private:
+	void startDrainTimer()
+	{
+		drainTimer->start(DRAIN_INTERVAL / 2 + (int)QRandomGenerator::global()->bounded(DRAIN_INTERVAL));
+	}
+
+	void drainTimer_timeout()
+	{
+		// sessions that arrive while draining are included. a rate of 0 or
+		// less means everything at once
+		QList<std::shared_ptr<HttpSession>> httpSessions;
+		foreach(const std::shared_ptr<HttpSession> &hs, cs.httpSessions)
+			httpSessions += hs;
+
+		QList<std::shared_ptr<WsSession>> wsSessions;
+		foreach(const std::shared_ptr<WsSession> &s, cs.wsSessions)
+		{
+			if(!s->closed)
+				wsSessions += s;
+		}
+
+		if(httpSessions.isEmpty() && wsSessions.isEmpty())
+		{
+			log_info("drained");
+
+			drained = true;
+			q->drained();
+			return;
+		}
+
+		if(drainDeadline >= 0 && QDateTime::currentMSecsSinceEpoch() >= drainDeadline)
+		{
+			log_warning("drain timed out with %d http sessions and %d ws sessions left", httpSessions.count(), wsSessions.count());
+
+			drained = true;
+			q->drained();
+			return;
+		}
+
+		int max;
+		if(config.drainRate > 0)
+		{
+			drainCredit += (double)config.drainRate * DRAIN_INTERVAL / 1000;
+			max = (int)drainCredit;
+			drainCredit -= max;
+		}
+		else
+		{
+			max = httpSessions.count() + wsSessions.count();
+		}
+
+		// spread the closes over the sessions in random order, so that no
+		// part of the key space reconnects all at once
+		std::shuffle(httpSessions.begin(), httpSessions.end(), *QRandomGenerator::global());
+		std::shuffle(wsSessions.begin(), wsSessions.end(), *QRandomGenerator::global());
+
+		int closed = 0;
+
+		for(int n = 0; n < wsSessions.count() && closed < max; ++n)
+		{
+			// service restart, a hint to reconnect
+			wsSessions[n]->sendClose(1012);
+			++closed;
+		}
+
+		for(int n = 0; n < httpSessions.count() && closed < max; ++n)
+		{
+			// busy sessions are retried on a later pass
+			if(httpSessions[n]->drain())
+				++closed;
+		}
+
+		startDrainTimer();
+	}
+
+
 	void handlePublishItem(const PublishItem &item)
+	{
+		// items held for conflation come back through conflater_itemReady
+		if(!conflater->addItem(item))
+			return;
+
+		sequenceItem(item);
+	}
+
+	void sequenceItem(const PublishItem &item)
 	{
 		// only sequence if someone is listening, because we
 		//   clear lastId on unsubscribe and don't want it to
@@ -1638,6 +2869,68 @@ private:
 		sequencer->addItem(item, seq);
 	}
 
+	void handlePublishItems(QList<PublishItem> &items)
+	{
+		qint64 now = LatencyHistogram::now();
+		for(int n = 0; n < items.count(); ++n)
+			items[n].receiveTime = now;
+
+		if(items.count() == 1)
+		{
+			handlePublishItem(items.first());
+			return;
+		}
+
+		if(conflater->isEnabled())
+		{
+			QList<PublishItem> passed;
+			foreach(const PublishItem &item, items)
+			{
+				if(conflater->addItem(item))
+					passed += item;
+			}
+
+			items = passed;
+		}
+
+		QList<bool> seq;
+		foreach(const PublishItem &item, items)
+			seq += (!item.noSeq && cs.subs.contains(item.channel));
+
+		sequencer->addItems(items, seq);
+	}
+
+	void conflater_itemReady(const PublishItem &item)
+	{
+		sequenceItem(item);
+	}
+
+	bool relaying() const
+	{
+		return (shardPublishSock || relaySock);
+	}
+
+	// passes an item on, as received, to the shards and to downstream
+	// instances. both subscribe by channel, so each item only reaches the
+	// peers that have subscribers for it
+	void relayItem(const PublishItem &item, const QByteArray &data)
+	{
+		if(!relaying())
+			return;
+
+		QList<QByteArray> msg;
+		msg += item.channel.toUtf8();
+		msg += data;
+
+		if(shardPublishSock)
+			shardPublishSock->write(msg);
+
+		// an item may arrive at a relay by more than one path. the shards
+		// deduplicate on their own, but downstream only needs one copy
+		if(relaySock && !sequencer->isCachedId(item))
+			relaySock->write(msg);
+	}
+
 	void writeRetryPacket(const QByteArray &instanceAddress, const RetryRequestPacket &packet)
 	{
 		if(!retrySock)
@@ -1646,15 +2939,51 @@ private:
 			return;
 		}
 
-		QVariant vout = packet.toVariant();
-
 		if(log_outputLevel() >= LOG_LEVEL_DEBUG)
-			log_debug("OUT retry: to=%s %s", instanceAddress.data(), qPrintable(TnetString::variantToString(vout, -1)));
+			log_debug("OUT retry: to=%s %s", instanceAddress.data(), qPrintable(TnetString::variantToString(packet.toVariant(), -1)));
+
+		QByteArray buf;
+		buf.reserve(packet.requestData.body.size() + RETRY_PACKET_OVERHEAD_ESTIMATE);
+		TnetString::Writer w(&buf);
+		packet.writeTo(w);
 
 		QList<QByteArray> msg;
 		msg += instanceAddress;
 		msg += QByteArray();
-		msg += TnetString::fromVariant(vout);
+		msg += buf;
+		retrySock->write(msg);
+	}
+
+	// writes several packets as a list in a single message
+	void writeRetryPackets(const QByteArray &instanceAddress, const QList<RetryRequestPacket> &packets)
+	{
+		if(!retrySock)
+		{
+			log_error("retry: can't write, no socket");
+			return;
+		}
+
+		int size = 0;
+		foreach(const RetryRequestPacket &packet, packets)
+		{
+			if(log_outputLevel() >= LOG_LEVEL_DEBUG)
+				log_debug("OUT retry: to=%s %s", instanceAddress.data(), qPrintable(TnetString::variantToString(packet.toVariant(), -1)));
+
+			size += packet.requestData.body.size() + RETRY_PACKET_OVERHEAD_ESTIMATE;
+		}
+
+		QByteArray buf;
+		buf.reserve(size);
+		TnetString::Writer w(&buf);
+		w.startList();
+		foreach(const RetryRequestPacket &packet, packets)
+			packet.writeTo(w);
+		w.end();
+
+		QList<QByteArray> msg;
+		msg += instanceAddress;
+		msg += QByteArray();
+		msg += buf;
 		retrySock->write(msg);
 	}
 
@@ -1670,15 +2999,22 @@ private:
 		out.from = config.instanceId;
 		out.items = items;
 
-		QVariant vout = out.toVariant();
-
 		if(log_outputLevel() >= LOG_LEVEL_DEBUG)
-			log_debug("OUT wscontrol: to=%s %s", instanceAddress.data(), qPrintable(TnetString::variantToString(vout, -1)));
+			log_debug("OUT wscontrol: to=%s %s", instanceAddress.data(), qPrintable(TnetString::variantToString(out.toVariant(), -1)));
+
+		int size = 0;
+		foreach(const WsControlPacket::Item &item, items)
+			size += item.message.size() + WSCONTROL_ITEM_OVERHEAD_ESTIMATE;
+
+		QByteArray buf;
+		buf.reserve(size);
+		TnetString::Writer w(&buf);
+		out.writeTo(w);
 
 		QList<QByteArray> msg;
 		msg += instanceAddress;
 		msg += QByteArray();
-		msg += TnetString::fromVariant(vout);
+		msg += buf;
 		wsControlStreamSock->write(msg);
 	}
 
@@ -1686,16 +3022,14 @@ private:
 	{
 		if(!cs.subs.contains(channel))
 		{
-			Subscription *sub = new Subscription(channel);
+			Subscription *sub = new Subscription(&cs.channelAtoms, channel);
 			subscribedConnection[sub] = sub->subscribed.connect(boost::bind(&Private::sub_subscribed, this, sub));
-			cs.subs.insert(channel, sub);
+
+			// key by the interned name, so the map shares its storage
+			cs.subs.insert(sub->channel(), sub);
 			sub->start();
 
-			if(inSubSock)
-			{
-				log_debug("SUB socket subscribe: %s", qPrintable(channel));
-				inSubSock->subscribe(channel.toUtf8());
-			}
+			subscribeUpstream(sub->channelUtf8());
 		}
 	}
 
@@ -1706,21 +3040,238 @@ private:
 			Subscription *sub = cs.subs[channel];
 			cs.subs.remove(channel);
 			subscribedConnection.erase(sub);
-			delete sub;
+
+			unsubscribeUpstream(sub->channelUtf8());
 
 			sequencer->clearPendingForChannel(channel);
 			cs.publishLastIds.remove(channel);
+			cs.publishHistory.remove(channel);
+			cs.deltaDocs.remove(channel);
+
+			// last, since channel may refer to the subscription's name
+			delete sub;
+		}
+	}
+
+	// subscriptions on the SUB sockets match messages by prefix already,
+	// so a prefix is subscribed to as is. prefix channels don't follow
+	// ids, so there are no sequencing or history to set up
+	void addPrefixSub(const QString &prefix)
+	{
+		if(!cs.prefixSubs.contains(prefix))
+		{
+			Subscription *sub = new Subscription(&cs.channelAtoms, prefix);
+			cs.prefixSubs.insert(sub->channel(), sub);
 
-			if(inSubSock)
+			subscribeUpstream(sub->channelUtf8());
+		}
+	}
+
+	void removePrefixSub(const QString &prefix)
+	{
+		Subscription *sub = cs.prefixSubs.take(prefix);
+		if(!sub)
+			return;
+
+		unsubscribeUpstream(sub->channelUtf8());
+
+		// drop the documents only reached through the prefix
+		QHash<QString, DeltaDocuments>::iterator it = cs.deltaDocs.begin();
+		while(it != cs.deltaDocs.end())
+		{
+			if(it.key().startsWith(prefix) && !cs.subs.contains(it.key()))
+				it = cs.deltaDocs.erase(it);
+			else
+				++it;
+		}
+
+		delete sub;
+	}
+
+	void subscribeUpstream(const QByteArray &channel)
+	{
+		if(config.shardIndex == 0)
+		{
+			directoryAdd(channel);
+		}
+		else if(inSubSock)
+		{
+			log_debug("SUB socket subscribe: %s", channel.data());
+			inSubSock->subscribe(channel);
+		}
+	}
+
+	void unsubscribeUpstream(const QByteArray &channel)
+	{
+		if(config.shardIndex == 0)
+		{
+			directoryRemove(channel);
+		}
+		else if(inSubSock)
+		{
+			log_debug("SUB socket unsubscribe: %s", channel.data());
+			inSubSock->unsubscribe(channel);
+		}
+	}
+
+	// the directory holds the channels subscribed anywhere in this
+	// instance or below it, counting this engine's own subscriptions, the
+	// shards' and the downstream relays' once each. the SUB socket and the exported events follow a channel
+	// only as it first appears and finally goes away
+	void directoryAdd(const QByteArray &channel)
+	{
+		int &holders = subscriptionDirectory[channel];
+		if(++holders > 1)
+			return;
+
+		if(inSubSock)
+		{
+			log_debug("SUB socket subscribe: %s", channel.data());
+			inSubSock->subscribe(inSubTopic(channel));
+		}
+
+		writeSubscriptionEvent(true, channel);
+	}
+
+	void directoryRemove(const QByteArray &channel)
+	{
+		QHash<QByteArray, int>::iterator it = subscriptionDirectory.find(channel);
+		if(it == subscriptionDirectory.end())
+			return;
+
+		if(--it.value() > 0)
+			return;
+
+		subscriptionDirectory.erase(it);
+
+		if(inSubSock)
+		{
+			log_debug("SUB socket unsubscribe: %s", channel.data());
+			inSubSock->unsubscribe(inSubTopic(channel));
+		}
+
+		writeSubscriptionEvent(false, channel);
+	}
+
+	// with hashed topics, channels whose topics collide share a
+	// subscription. the SUB socket counts repeated subscriptions, so
+	// each channel can still subscribe and unsubscribe on its own
+	QByteArray inSubTopic(const QByteArray &channel) const
+	{
+		if(config.pushInSubHashedTopics)
+			return HandlerEngine::hashedTopic(channel);
+
+		return channel;
+	}
+
+	void writeSubscriptionEvent(bool subscribed, const QByteArray &channel)
+	{
+		if(!subscriptionSock)
+			return;
+
+		// same framing as the subscription messages of an XPUB socket
+		QByteArray buf;
+		buf += (char)(subscribed ? 1 : 0);
+		buf += channel;
+
+		subscriptionSock->write(QList<QByteArray>() << buf);
+	}
+
+	void addWsSessionUser(WsSession *s)
+	{
+		QString user = s->meta.value("user");
+		if(!user.isEmpty())
+			cs.wsSessionsByUser[user] += s;
+	}
+
+	void removeWsSessionUser(WsSession *s)
+	{
+		QString user = s->meta.value("user");
+		if(user.isEmpty())
+			return;
+
+		auto it = cs.wsSessionsByUser.find(user);
+		if(it == cs.wsSessionsByUser.end())
+			return;
+
+		it.value().remove(s);
+		if(it.value().isEmpty())
+			cs.wsSessionsByUser.erase(it);
+	}
+
+	// returns the ws sessions of the channel that skip-self or skip-users
+	// would drop. only the sessions of the named users are looked at, so
+	// this is cheap no matter how many subscribers the channel has
+	QSet<WsSession*> excludedWsSessions(const PublishItem &item) const
+	{
+		QSet<WsSession*> out;
+
+		if(cs.wsSessionsByUser.isEmpty())
+			return out;
+
+		QString sender = item.meta.value("sender");
+		QStringList skipUsers;
+		foreach(const QString &part, item.meta.value("skip_users").split(','))
+		{
+			QString u = part.trimmed();
+			if(!u.isEmpty())
+				skipUsers += u;
+		}
+
+		QStringList users = skipUsers;
+		if(!sender.isEmpty() && !users.contains(sender))
+			users += sender;
+
+		foreach(const QString &user, users)
+		{
+			auto it = cs.wsSessionsByUser.find(user);
+			if(it == cs.wsSessionsByUser.end())
+				continue;
+
+			bool isSender = (user == sender);
+			bool isSkipped = skipUsers.contains(user);
+
+			foreach(WsSession *s, it.value())
 			{
-				log_debug("SUB socket unsubscribe: %s", qPrintable(channel));
-				inSubSock->unsubscribe(channel.toUtf8());
+				if(!s->channels.contains(item.channel))
+					continue;
+
+				std::shared_ptr<const Filter::MessageFilterPlan> plan = Filter::MessageFilterPlan::get(s->channelFilters.value(item.channel));
+
+				if((isSender && plan->skipsSelf()) || (isSkipped && plan->skipsUsers()))
+					out += s;
 			}
 		}
+
+		return out;
+	}
+
+	std::shared_ptr<WsSession> addWsSession(const QByteArray &peer, const QString &cid, int ttl, const QUrl &uri)
+	{
+		std::shared_ptr<WsSession> s = std::make_shared<WsSession>();
+		wsSessionConnectionMap[s.get()] = {
+			s->send.connect(boost::bind(&Private::wssession_send, this, boost::placeholders::_1, s.get())),
+			s->expired.connect(boost::bind(&Private::wssession_expired, this, s.get())),
+			s->error.connect(boost::bind(&Private::wssession_error, this, s.get()))
+		};
+		s->peer = peer;
+		s->cid = cid;
+		s->ttl = ttl;
+		s->requestData.uri = uri;
+		s->zhttpOut = zhttpOut.get();
+		s->stats = stats.get();
+		s->filterLimiter = filterLimiter;
+		s->slowConsumerPolicy = slowConsumerPolicy;
+		s->refreshExpiration();
+		cs.wsSessions.insert(s->cid, s);
+		log_debug("added ws session: %s", qPrintable(s->cid));
+
+		return s;
 	}
 
 	void removeWsSession(WsSession *s)
 	{
+		removeWsSessionUser(s);
 		removeSessionChannels(s);
 
 		log_debug("removed ws session: %s", qPrintable(s->cid));
@@ -1729,6 +3280,112 @@ private:
 		cs.wsSessions.remove(s->cid);
 	}
 
+	// http sessions are not saved. their zhttp sequence state changes with
+	// every packet sent, and the proxy's retry and recover paths already
+	// handle them. websocket sessions only need their subscriptions
+	void saveState()
+	{
+		StateSnapshot snap;
+		snap.time = QDateTime::currentMSecsSinceEpoch();
+
+		foreach(const std::shared_ptr<WsSession> &s, cs.wsSessions)
+		{
+			if(s->closed)
+				continue;
+
+			StateSnapshot::WsSessionState ss;
+			ss.peer = s->peer;
+			ss.cid = s->cid;
+			ss.ttl = s->ttl;
+			ss.uri = s->requestData.uri;
+			ss.route = s->route;
+			ss.statsRoute = s->statsRoute;
+			ss.debug = s->debug;
+			ss.targetTrusted = s->targetTrusted;
+			ss.channelPrefix = s->channelPrefix;
+			ss.logLevel = s->logLevel;
+			ss.sid = s->sid;
+			ss.meta = s->meta;
+			ss.channels = s->channels;
+			ss.implicitChannels = s->implicitChannels;
+			ss.channelFilters = s->channelFilters;
+			ss.keepAliveType = s->keepAliveType;
+			ss.keepAliveMessage = s->keepAliveMessage;
+			snap.wsSessions += ss;
+		}
+
+		snap.lastIds = cs.publishLastIds.entries();
+
+		QString errorMessage;
+		if(!snap.save(config.stateFile, &errorMessage))
+		{
+			log_error("state: %s", qPrintable(errorMessage));
+			return;
+		}
+
+		log_info("state: saved %d ws sessions and %d last ids to %s", snap.wsSessions.count(), snap.lastIds.count(), qPrintable(config.stateFile));
+	}
+
+	void restoreState()
+	{
+		if(!QFile::exists(config.stateFile))
+			return;
+
+		StateSnapshot snap;
+		QString errorMessage;
+		bool ok = snap.load(config.stateFile, &errorMessage);
+
+		// a snapshot is only good for the restart right after it was
+		// written, and must not be applied again after a crash
+		QFile::remove(config.stateFile);
+
+		if(!ok)
+		{
+			log_warning("state: %s, ignoring", qPrintable(errorMessage));
+			return;
+		}
+
+		for(int n = 0; n < snap.lastIds.count(); ++n)
+			cs.publishLastIds.set(snap.lastIds[n].first, snap.lastIds[n].second);
+
+		foreach(const StateSnapshot::WsSessionState &ss, snap.wsSessions)
+		{
+			if(cs.wsSessions.contains(ss.cid))
+				continue;
+
+			// sessions the proxy no longer has expire after the ttl, as
+			// no keep-alives arrive for them
+			std::shared_ptr<WsSession> s = addWsSession(ss.peer, ss.cid, ss.ttl, ss.uri);
+			s->route = ss.route;
+			s->statsRoute = ss.statsRoute;
+			s->statsRouteId = s->statsRoute.toUtf8();
+			s->debug = ss.debug;
+			s->targetTrusted = ss.targetTrusted;
+			s->channelPrefix = ss.channelPrefix;
+			if(ss.logLevel >= 0)
+				s->logLevel = ss.logLevel;
+			s->sid = ss.sid;
+			s->meta = ss.meta;
+			s->implicitChannels = ss.implicitChannels;
+			s->channelFilters = ss.channelFilters;
+			s->keepAliveType = ss.keepAliveType;
+			s->keepAliveMessage = ss.keepAliveMessage;
+
+			addWsSessionUser(s.get());
+
+			foreach(const QString &channel, ss.channels)
+			{
+				s->channels += channel;
+
+				int count = cs.wsSessionsByChannel.add(channel, s.get());
+				stats->addSubscription("ws", channel, count);
+				addSub(channel);
+			}
+		}
+
+		log_info("state: restored %d ws sessions and %d last ids from %s", snap.wsSessions.count(), snap.lastIds.count(), qPrintable(config.stateFile));
+	}
+
 	void httpControlRespond(SimpleHttpRequest *req, int code, const QByteArray &reason, const QString &body, const QByteArray &contentType = QByteArray(), const HttpHeaders &headers = HttpHeaders(), int items = -1)
 	{
 		HttpHeaders outHeaders = headers;
@@ -1747,7 +3404,7 @@ private:
 		log_debug("%s", qPrintable(msg));
 	}
 
-	void publishSend(const std::shared_ptr<ClientSession> &target, const PublishItem &item, const QList<QByteArray> &exposeHeaders)
+	void publishSend(const std::shared_ptr<ClientSession> &target, const std::shared_ptr<const PublishItem> &item, const QList<QByteArray> &exposeHeaders)
 	{
 		if(auto hs = std::dynamic_pointer_cast<HttpSession>(target))
 			hs->publish(item, exposeHeaders);
@@ -1755,37 +3412,248 @@ private:
 			s->publish(item);
 	}
 
-	int blocksForData(int size) const
+	void publishExpired(const std::shared_ptr<ClientSession> &target)
+	{
+		if(auto hs = std::dynamic_pointer_cast<HttpSession>(target))
+			stats->incCounter(hs->statsRouteId(), Stats::MessagesExpired);
+		else if(auto s = std::dynamic_pointer_cast<WsSession>(target))
+			stats->incCounter(s->statsRouteId, Stats::MessagesExpired);
+	}
+
+	// returns a single-format copy of the item, ready to be shared by all
+	//   subscribers of the given format. for http-response, grip headers are
+	//   stripped and any exposed headers are returned separately
+	static std::shared_ptr<const PublishItem> preparePublishItem(const PublishItem &item, PublishFormat::Type type, QList<QByteArray> *exposeHeaders = 0)
+	{
+		auto i = std::make_shared<PublishItem>(item);
+		i->format = item.formats.value(type);
+
+		// only the chosen format is delivered
+		i->formats.clear();
+
+		// ws sessions are indexed by user, and skip-self/skip-users are
+		// applied during fan-out
+		i->userFiltersApplied = (type == PublishFormat::WebSocketMessage);
+
+		if(type == PublishFormat::HttpResponse)
+		{
+			PublishFormat &f = i->format;
+
+			if(exposeHeaders)
+				*exposeHeaders = f.headers.getAll("Grip-Expose-Headers");
+
+			// remove grip headers from the push
+			for(int n = 0; n < f.headers.count(); ++n)
+			{
+				// strip out grip headers
+				if(qstrnicmp(f.headers[n].first.data(), "Grip-", 5) == 0)
+				{
+					f.headers.removeAt(n);
+					--n; // adjust position
+				}
+			}
+		}
+
+		return i;
+	}
+
+	void logPublishHwmExceeded(const QString &statsRoute) const
+	{
+		if(!statsRoute.isEmpty())
+			log_warning("exceeded publish hwm (%d) for route %s, dropping message", config.messageHwm, qPrintable(statsRoute));
+		else
+			log_warning("exceeded publish hwm (%d), dropping message", config.messageHwm);
+	}
+
+	int blocksForData(int size) const
+	{
+		if(config.messageBlockSize <= 0)
+			return -1;
+
+		return (size + config.messageBlockSize - 1) / config.messageBlockSize;
+	}
+
+	void updateSessions(const QString &channel = QString())
+	{
+		if(!channel.isNull())
+		{
+			// copy, since updating may change subscriptions
+			ChannelIndex<HttpSession>::Subscribers sessions;
+
+			QList<QString> prefixes = cs.channelPrefixes.prefixesOf(channel);
+			ChannelIndex<HttpSession>::Subscribers merged;
+
+			const ChannelIndex<HttpSession>::Subscribers *subs = cs.responseSessionsByChannel.subscribers(channel);
+			if(!prefixes.isEmpty())
+				subs = addPrefixSubscribers(subs, cs.responseSessionsByPrefix, prefixes, &merged);
+
+			if(subs)
+				sessions = *subs;
+
+			subs = cs.streamSessionsByChannel.subscribers(channel);
+			if(!prefixes.isEmpty())
+				subs = addPrefixSubscribers(subs, cs.streamSessionsByPrefix, prefixes, &merged);
+
+			if(subs)
+				sessions.insert(sessions.end(), subs->begin(), subs->end());
+
+			for(HttpSession *hs : sessions)
+				hs->update();
+		}
+		else
+		{
+			foreach(const std::shared_ptr<HttpSession> &hs, cs.httpSessions)
+				hs->update();
+		}
+	}
+
+	// returns the number of sessions left to update, which is 0 unless the
+	// recover is paced
+	int recoverCommand()
+	{
+		cs.publishLastIds.clear();
+		cs.publishHistory.clear();
+
+		if(config.recoverRate <= 0)
+		{
+			updateSessions();
+			return 0;
+		}
+
+		// a recover while one is in progress starts over with all sessions
+
+		std::vector<std::pair<QByteArray, std::shared_ptr<HttpSession>>> sessions;
+		sessions.reserve(cs.httpSessions.count());
+		foreach(const std::shared_ptr<HttpSession> &hs, cs.httpSessions)
+			sessions.emplace_back(hs->nextLinkUri().toEncoded(), hs);
+
+		// sessions sharing a next link land in the same wave, so that the
+		// update limiter can combine their requests
+		std::stable_sort(sessions.begin(), sessions.end(), [](const auto &a, const auto &b) {
+			return a.first < b.first;
+		});
+
+		recoverQueue.clear();
+		for(const auto &i : sessions)
+			recoverQueue.push_back(i.second);
+
+		recoverPending = (qint64)recoverQueue.size();
+		recoverCredit = 0;
+
+		log_info("recovering %d http sessions at %d/s", (int)recoverQueue.size(), config.recoverRate);
+
+		if(!recoverTimer)
+		{
+			recoverTimer = std::make_unique<Timer>();
+			recoverTimer->setSingleShot(true);
+			recoverTimerConnection = recoverTimer->timeout.connect(boost::bind(&Private::recoverTimer_timeout, this));
+		}
+
+		recoverTimer_timeout();
+
+		return (int)recoverQueue.size();
+	}
+
+	void recoverTimer_timeout()
+	{
+		recoverCredit += (double)config.recoverRate * RECOVER_INTERVAL / 1000;
+		int max = (int)recoverCredit;
+		recoverCredit -= max;
+
+		int updated = 0;
+
+		while(!recoverQueue.empty() && updated < max)
+		{
+			// sessions that ended since the recover started are skipped
+			std::shared_ptr<HttpSession> hs = recoverQueue.front().lock();
+			recoverQueue.pop_front();
+
+			if(!hs)
+				continue;
+
+			hs->update();
+			++updated;
+		}
+
+		recoverPending = (qint64)recoverQueue.size();
+		recoverUpdated += updated;
+
+		if(recoverQueue.empty())
+		{
+			log_info("recover finished");
+
+			recoverTimer->stop();
+			return;
+		}
+
+		recoverTimer->start(RECOVER_INTERVAL);
+	}
+
+	int controlRecover()
+	{
+		int pending = recoverCommand();
+
+		q->recoverRequested();
+
+		return pending;
+	}
+
+	// prefix subscriptions are reported to stats under the prefix
+	// followed by '*', so they don't mix with a channel of the same name
+	static QString prefixStatsChannel(const QString &prefix)
 	{
-		if(config.messageBlockSize <= 0)
-			return -1;
-
-		return (size + config.messageBlockSize - 1) / config.messageBlockSize;
+		return prefix + '*';
 	}
 
-	void updateSessions(const QString &channel = QString())
+	// returns the subscribers of a channel merged with those of its
+	// matching prefixes, without duplicates, using out as storage if
+	// needed. returns null if there are none
+	static const ChannelIndex<HttpSession>::Subscribers *addPrefixSubscribers(const ChannelIndex<HttpSession>::Subscribers *subs, const ChannelIndex<HttpSession> &sessionsByPrefix, const QList<QString> &prefixes, ChannelIndex<HttpSession>::Subscribers *out)
 	{
-		if(!channel.isNull())
+		QSet<HttpSession*> seen;
+
+		if(subs && !subs->empty())
 		{
-			QSet<HttpSession*> sessions = cs.responseSessionsByChannel.value(channel);
-			foreach(HttpSession *hs, sessions)
-				hs->update();
+			if(subs != out)
+				*out = *subs;
 
-			sessions = cs.streamSessionsByChannel.value(channel);
-			foreach(HttpSession *hs, sessions)
-				hs->update();
+			for(HttpSession *hs : *out)
+				seen += hs;
 		}
 		else
 		{
-			foreach(const std::shared_ptr<HttpSession> &hs, cs.httpSessions)
-				hs->update();
+			out->clear();
+		}
+
+		foreach(const QString &prefix, prefixes)
+		{
+			const ChannelIndex<HttpSession>::Subscribers *psubs = sessionsByPrefix.subscribers(prefix);
+			if(!psubs)
+				continue;
+
+			// the common case of a single source needs no copying
+			if(out->empty() && prefixes.count() == 1)
+				return psubs;
+
+			for(HttpSession *hs : *psubs)
+			{
+				if(!seen.contains(hs))
+				{
+					seen += hs;
+					out->push_back(hs);
+				}
+			}
 		}
+
+		return (!out->empty() ? out : 0);
 	}
 
-	void recoverCommand()
+	ChannelIndex<HttpSession> *sessionIndex(Instruct::HoldMode mode, bool prefix)
 	{
-		cs.publishLastIds.clear();
-		updateSessions();
+		if(mode == Instruct::ResponseHold)
+			return (prefix ? &cs.responseSessionsByPrefix : &cs.responseSessionsByChannel);
+		else // StreamHold
+			return (prefix ? &cs.streamSessionsByPrefix : &cs.streamSessionsByChannel);
 	}
 
 	void removeSessionChannel(HttpSession *hs, const QString &channel)
@@ -1793,63 +3661,49 @@ private:
 		Instruct::HoldMode mode = hs->holdMode();
 		assert(mode == Instruct::ResponseHold || mode == Instruct::StreamHold);
 
-		QHash<QString, QSet<HttpSession*> > *sessionsByChannel;
-		QString modeStr;
+		QString modeStr = (mode == Instruct::ResponseHold ? "response" : "stream");
 
-		if(mode == Instruct::ResponseHold)
-		{
-			sessionsByChannel = &cs.responseSessionsByChannel;
-			modeStr = "response";
-		}
-		else // StreamHold
+		// the session no longer has the channel, so it is not known which
+		// kind it was. a session holds a name as one kind only
+		QString statsChannel = channel;
+		int remaining = sessionIndex(mode, false)->remove(channel, hs);
+		if(remaining < 0)
 		{
-			sessionsByChannel = &cs.streamSessionsByChannel;
-			modeStr = "stream";
-		}
-
-		if(!sessionsByChannel->contains(channel))
-			return;
+			remaining = sessionIndex(mode, true)->remove(channel, hs);
+			if(remaining < 0)
+				return;
 
-		QSet<HttpSession*> &cur = (*sessionsByChannel)[channel];
-		if(!cur.contains(hs))
-			return;
+			if(remaining == 0)
+				cs.channelPrefixes.remove(channel);
 
-		cur.remove(hs);
+			statsChannel = prefixStatsChannel(channel);
+		}
 
-		if(!cur.isEmpty())
+		if(remaining > 0)
 		{
-			stats->addSubscription(modeStr, channel, cur.count());
+			stats->addSubscription(modeStr, statsChannel, remaining);
 		}
 		else
 		{
-			sessionsByChannel->remove(channel);
-
 			// linger the unsub in case client long-polls again
 			bool linger = (mode == Instruct::ResponseHold);
 
-			stats->removeSubscription(modeStr, channel, linger);
+			stats->removeSubscription(modeStr, statsChannel, linger);
 		}
 	}
 
 	void removeSessionChannel(WsSession *s, const QString &channel)
 	{
-		if(!cs.wsSessionsByChannel.contains(channel))
+		int remaining = cs.wsSessionsByChannel.remove(channel, s);
+		if(remaining < 0)
 			return;
 
-		QSet<WsSession*> &cur = cs.wsSessionsByChannel[channel];
-		if(!cur.contains(s))
-			return;
-
-		cur.remove(s);
-
-		if(!cur.isEmpty())
+		if(remaining > 0)
 		{
-			stats->addSubscription("ws", channel, cur.count());
+			stats->addSubscription("ws", channel, remaining);
 		}
 		else
 		{
-			cs.wsSessionsByChannel.remove(channel);
-
 			stats->removeSubscription("ws", channel, false);
 		}
 	}
@@ -1890,7 +3744,7 @@ private:
 		if(!req)
 			return;
 
-		InspectWorker *w = new InspectWorker(req, stateClient.get(), config.shareAll);
+		InspectWorker *w = new InspectWorker(req, stateClient.get(), sessionCache.get(), config.shareAll);
 
 		// safe to not track, since w can't outlive this
 		w->finished.connect(boost::bind(&Private::inspectWorker_finished, this, w, boost::placeholders::_1));
@@ -1900,7 +3754,7 @@ private:
 
 	void acceptServer_requestReady()
 	{
-		if(acceptWorkers.count() >= ACCEPT_WORKERS_MAX)
+		if(acceptWorkers.count() + acceptBatchWorkers.count() >= ACCEPT_WORKERS_MAX)
 			return;
 
 		ZrpcRequest *req = acceptServer->takeNext();
@@ -1914,7 +3768,7 @@ private:
 			// accept request immediately before returning to the event loop.
 			// the start() call will do this
 
-			AcceptWorker *w = new AcceptWorker(req, stateClient.get(), &cs, zhttpIn.get(), zhttpOut.get(), stats.get(), updateLimiter.get(), filterLimiter, httpSessionUpdateManager, config.connectionSubscriptionMax);
+			AcceptWorker *w = new AcceptWorker(req, QVariantHash(), QByteArray(), stateClient.get(), &cs, zhttpIn.get(), zhttpOut.get(), stats.get(), updateLimiter.get(), filterLimiter, httpSessionUpdateManager, config.connectionSubscriptionMax);
 
 			// safe to not track, since w can't outlive this
 			w->finished.connect(boost::bind(&Private::acceptWorker_finished, this, w, boost::placeholders::_1));
@@ -1925,6 +3779,19 @@ private:
 
 			w->start();
 		}
+		else if(req->method() == "accept-batch")
+		{
+			AcceptBatchWorker *w = new AcceptBatchWorker(req, stateClient.get(), &cs, zhttpIn.get(), zhttpOut.get(), stats.get(), updateLimiter.get(), filterLimiter, httpSessionUpdateManager, config.connectionSubscriptionMax);
+
+			// safe to not track, since w can't outlive this
+			w->finished.connect(boost::bind(&Private::acceptBatchWorker_finished, this, w, boost::placeholders::_1));
+			w->sessionsReady.connect(boost::bind(&Private::acceptWorker_sessionsReady, this, boost::placeholders::_1));
+			w->retryPacketsReady.connect(boost::bind(&Private::acceptBatchWorker_retryPacketsReady, this, boost::placeholders::_1, boost::placeholders::_2));
+
+			acceptBatchWorkers += w;
+
+			w->start();
+		}
 		else if(req->method() == "conn-max")
 		{
 			QVariantHash args = req->args();
@@ -1955,6 +3822,20 @@ private:
 		}
 	}
 
+	void stateRelayServer_requestReady()
+	{
+		ZrpcRequest *req = stateRelayServer->takeNext();
+		if(!req)
+			return;
+
+		auto d = std::make_unique<StateRelayWorker>(req, stateClient.get());
+
+		// safe to not track, since d can't outlive this
+		d->finished.connect(boost::bind(&Private::deferred_finished, this, d.get(), boost::placeholders::_1));
+
+		deferreds[d.get()] = std::move(d);
+	}
+
 	void controlServer_requestReady()
 	{
 		ZrpcRequest *req = controlServer->takeNext();
@@ -1982,13 +3863,97 @@ private:
 				out["publish-pull"] = config.pushInSpec.toUtf8();
 			if(!config.pushInSubSpecs.isEmpty() && !config.pushInSubConnect)
 				out["publish-sub"] = config.pushInSubSpecs[0].toUtf8();
+			if(!config.subscriptionSpec.isEmpty())
+				out["subscription"] = config.subscriptionSpec.toUtf8();
+			req->respond(out);
+			delete req;
+		}
+		else if(req->method() == "get-subscriptions")
+		{
+			// a snapshot, to be combined with the subscription events
+			QVariantList channels;
+			for(auto it = subscriptionDirectory.cbegin(); it != subscriptionDirectory.cend(); ++it)
+				channels += it.key();
+
+			QVariantHash out;
+			out["channels"] = channels;
+			req->respond(out);
+			delete req;
+		}
+		else if(req->method() == "get-memory-stats")
+		{
+			QVariantHash objects;
+			for(int n = 0; n < ObjectStats::KindCount; ++n)
+			{
+				ObjectStats::Kind kind = (ObjectStats::Kind)n;
+
+				QVariantHash v;
+				v["count"] = ObjectStats::objects(kind);
+				v["bytes"] = ObjectStats::bytes(kind);
+				objects[ObjectStats::kindName(kind)] = v;
+			}
+
+			QVariantHash pools;
+			for(int n = 0; n < MemoryBudget::PoolCount; ++n)
+				pools[MemoryBudget::poolName((MemoryBudget::Pool)n)] = MemoryBudget::used((MemoryBudget::Pool)n);
+
+			QVariantHash out;
+			out["objects"] = objects;
+			out["pools"] = pools;
+
+			if(ObjectStats::updateAllocatorStats())
+			{
+				QVariantHash allocator;
+				allocator["name"] = QByteArray(ObjectStats::allocatorName());
+				allocator["allocated"] = ObjectStats::allocatorStat(ObjectStats::AllocatorAllocated);
+				allocator["mapped"] = ObjectStats::allocatorStat(ObjectStats::AllocatorMapped);
+				out["allocator"] = allocator;
+			}
+
+			req->respond(out);
+			delete req;
+		}
+		else if(req->method() == "get-top-channels")
+		{
+			const char *names[StatsManager::ChannelMetricsCount] = { "published", "recipients", "bytes" };
+
+			QVariantHash out;
+			out["enabled"] = config.statsTopChannels > 0;
+
+			for(int n = 0; n < StatsManager::ChannelMetricsCount; ++n)
+			{
+				QVariantList vitems;
+				foreach(const TopK::Item &i, stats->topChannels((StatsManager::ChannelMetric)n))
+				{
+					QVariantHash vitem;
+					vitem["channel"] = i.key.toUtf8();
+					vitem["count"] = (qint64)i.count;
+					vitems += vitem;
+				}
+
+				out[names[n]] = vitems;
+			}
+
 			req->respond(out);
 			delete req;
 		}
 		else if(req->method() == "recover")
 		{
-			recoverCommand();
-			req->respond();
+			// progress is for this engine only. other engines sharing the
+			// workload pace their own sessions
+			QVariantHash out;
+			out["pending"] = controlRecover();
+			out["rate"] = qMax(config.recoverRate, 0);
+			req->respond(out);
+			delete req;
+		}
+		else if(req->method() == "get-recover-status")
+		{
+			QVariantHash out;
+			out["active"] = !recoverQueue.empty();
+			out["pending"] = (qint64)recoverPending;
+			out["updated"] = (qint64)recoverUpdated;
+			req->respond(out);
 			delete req;
 		}
 		else if(req->method() == "refresh")
@@ -2033,8 +3998,58 @@ private:
 			req->respond();
 			delete req;
 
-			foreach(const PublishItem &item, items)
-				handlePublishItem(item);
+			if(relaying())
+			{
+				for(int n = 0; n < items.count(); ++n)
+					relayItem(items[n], 'T' + TnetString::fromVariant(vitems[n]));
+			}
+
+			handlePublishItems(items);
+		}
+		else if(req->method() == "trace")
+		{
+			QVariantHash args = req->args();
+
+			if(args.contains("enable"))
+			{
+				if(typeId(args["enable"]) != QMetaType::Bool)
+				{
+					req->respondError("bad-request", "Invalid format: object contains 'enable' with wrong type");
+					delete req;
+					return;
+				}
+
+				Trace::setEnabled(args["enable"].toBool());
+			}
+
+			QVariantHash out;
+			out["enabled"] = Trace::enabled();
+			req->respond(out);
+			delete req;
+		}
+		else if(req->method() == "trace-dump")
+		{
+			QVariantHash args = req->args();
+
+			QByteArray format = args.value("format", QByteArray("chrome")).toByteArray();
+
+			Trace::Format f;
+			if(format == "chrome")
+				f = Trace::ChromeFormat;
+			else if(format == "perf")
+				f = Trace::PerfFormat;
+			else
+			{
+				req->respondError("bad-request", "Invalid format: unknown trace format");
+				delete req;
+				return;
+			}
+
+			QVariantHash out;
+			out["format"] = format;
+			out["data"] = Trace::dump(f);
+			req->respond(out);
+			delete req;
 		}
 		else
 		{
@@ -2045,221 +4060,509 @@ private:
 
 	void sequencer_itemReady(const PublishItem &item)
 	{
-		QList<HttpSession*> responseSessions;
-		QList<HttpSession*> streamSessions;
-		QList<WsSession*> wsSessions;
-		QSet<QString> sids;
+		TRACE_EVENT(PublishBegin, 0);
+
+		auto job = std::make_unique<PublishJob>();
+		job->item = item;
+
+		if(Trace::enabled() && !item.traceParent.isEmpty())
+		{
+			TraceContext parent = TraceContext::fromHeader(item.traceParent.toUtf8());
+			if(parent.isSampled())
+			{
+				job->trace = parent.createChild();
+				job->traceStart = Trace::timestamp();
+			}
+		}
+
+		PublishLatency::recordFormats(PublishLatency::Sequenced, item);
+
+		cs.publishHistory.add(item);
+
+		int largestBlocks = -1;
+		if(item.size >= 0)
+		{
+			largestBlocks = blocksForData(item.size);
+		}
+		else
+		{
+			QHashIterator<PublishFormat::Type, PublishFormat> it(item.formats);
+			while(it.hasNext())
+			{
+				it.next();
+				largestBlocks = qMax(blocksForData(it.value().body.size()), largestBlocks);
+			}
+		}
+
+		// always add for non-identified route
+		stats->addMessageReceived(QByteArray(), largestBlocks);
+
+		const ChannelIndex<HttpSession>::Subscribers *responseSessions = 0;
+		const ChannelIndex<HttpSession>::Subscribers *streamSessions = 0;
+		const ChannelIndex<WsSession>::Subscribers *wsSessions = 0;
+		QSet<WsSession*> wsExcluded;
+		int total = 0;
+
+		// the indexes share an atom table, so the channel is looked up once
+		int channelAtom = cs.channelAtoms.find(item.channel);
+
+		// prefix subscribers are merged in. the merged arrays are owned
+		//   here and only built when a prefix matches
+		QList<QString> prefixes = cs.channelPrefixes.prefixesOf(item.channel);
+		ChannelIndex<HttpSession>::Subscribers mergedResponseSessions;
+		ChannelIndex<HttpSession>::Subscribers mergedStreamSessions;
+
+		if(item.formats.contains(PublishFormat::HttpResponse))
+		{
+			responseSessions = cs.responseSessionsByChannel.subscribersById(channelAtom);
+			if(!prefixes.isEmpty())
+				responseSessions = addPrefixSubscribers(responseSessions, cs.responseSessionsByPrefix, prefixes, &mergedResponseSessions);
+
+			if(responseSessions)
+			{
+				// FIXME: if bodyPatch is used then body is empty. we should
+				//   really be calculating blocks after applying patch
+
+				prepareDelivery(&job->response, item, PublishFormat::HttpResponse);
+				total += (int)responseSessions->size();
+			}
+		}
+
+		if(item.formats.contains(PublishFormat::HttpStream))
+		{
+			streamSessions = cs.streamSessionsByChannel.subscribersById(channelAtom);
+			if(!prefixes.isEmpty())
+				streamSessions = addPrefixSubscribers(streamSessions, cs.streamSessionsByPrefix, prefixes, &mergedStreamSessions);
+
+			if(streamSessions)
+			{
+				prepareDelivery(&job->stream, item, PublishFormat::HttpStream);
+				total += (int)streamSessions->size();
+			}
+		}
+
+		if(item.formats.contains(PublishFormat::WebSocketMessage))
+		{
+			wsSessions = cs.wsSessionsByChannel.subscribersById(channelAtom);
+			if(wsSessions)
+			{
+				prepareDelivery(&job->ws, item, PublishFormat::WebSocketMessage);
+				wsExcluded = excludedWsSessions(item);
+				total += (int)wsSessions->size() - wsExcluded.count();
+			}
+		}
+
+		if(item.delta)
+			prepareDeltas(job.get());
+
+		if(publishJobs.empty() && (config.fanoutChunkSize <= 0 || total <= config.fanoutChunkSize))
+		{
+			// small enough to deliver right away. the subscriber arrays are
+			//   iterated in place. queueing actions and updating stats does
+			//   not change subscriptions
+
+			if(responseSessions)
+			{
+				log_debug("relaying to %d http-response subscribers", (int)responseSessions->size());
+
+				for(HttpSession *hsp : *responseSessions)
+				{
+					assert(hsp->holdMode() == Instruct::ResponseHold);
+					assert(hsp->matchesChannel(item.channel));
+
+					deliver(job.get(), cs.httpSessions[hsp->rid()], PublishFormat::HttpResponse);
+				}
+			}
+
+			if(streamSessions)
+			{
+				for(HttpSession *hsp : *streamSessions)
+				{
+					// note: we used to assert that the session was currently a
+					//   stream hold and subscribed to the target channel,
+					//   however with the new grip-link stuff it is possible for
+					//   the session to temporarily switch to NoHold, and for
+					//   channels to become unsubscribed. so we'll do a
+					//   conditional statement instead
+					if(!hsp->matchesChannel(item.channel))
+						continue;
+
+					deliver(job.get(), cs.httpSessions[hsp->rid()], PublishFormat::HttpStream);
+				}
+
+				log_debug("relayed to %d http-stream subscribers", job->stream.receivers);
+			}
+
+			if(wsSessions)
+			{
+				log_debug("relaying to %d ws-message subscribers", (int)wsSessions->size());
+
+				for(WsSession *sp : *wsSessions)
+				{
+					assert(sp->channels.contains(item.channel));
+
+					if(!wsExcluded.isEmpty() && wsExcluded.contains(sp))
+						continue;
+
+					deliver(job.get(), cs.wsSessions[sp->cid]);
+				}
+			}
+
+			finishPublishJob(job.get());
+
+			TRACE_EVENT(PublishEnd, total);
+			return;
+		}
+
+		// too many subscribers to handle in one pass, or there are earlier
+		//   items still being delivered. take a snapshot of the targets and
+		//   deliver in chunks. sessions are looked up again at delivery
+		//   time, so any that go away in the meantime are skipped
+
+		job->targets.reserve(total);
+
+		if(responseSessions)
+		{
+			for(HttpSession *hsp : *responseSessions)
+				job->targets.push_back(PublishTarget(PublishFormat::HttpResponse, hsp->rid()));
+		}
+
+		if(streamSessions)
+		{
+			for(HttpSession *hsp : *streamSessions)
+				job->targets.push_back(PublishTarget(PublishFormat::HttpStream, hsp->rid()));
+		}
+
+		if(wsSessions)
+		{
+			for(WsSession *sp : *wsSessions)
+			{
+				if(!wsExcluded.isEmpty() && wsExcluded.contains(sp))
+					continue;
+
+				job->targets.push_back(PublishTarget(sp->cid));
+			}
+		}
+
+		log_debug("queuing delivery to %d subscribers, channel=%s", total, qPrintable(item.channel));
+
+		publishJobs.push_back(std::move(job));
+
+		// items are delivered in order, so only the first job schedules work
+		if(publishJobs.size() == 1)
+			deferCall.defer([=] { processPublishJobs(); });
+
+		TRACE_EVENT(PublishEnd, 0);
+	}
+
+	void prepareDelivery(PublishDelivery *d, const PublishItem &item, PublishFormat::Type type)
+	{
+		// prepare the payload once. it is shared, read-only, by all of the
+		//   actions and session queues
+		d->item = preparePublishItem(item, type, &d->exposeHeaders);
+
+		if(item.size >= 0)
+			d->size = item.size;
+		else
+			d->size = d->item->format.body.size();
+
+		d->blocks = blocksForData(d->size);
+	}
+
+	// a delta message as a single-format item, based on the prepared one
+	static std::shared_ptr<const PublishItem> prepareDeltaItem(const PublishItem &base, const QVariantMap &message)
+	{
+		auto i = std::make_shared<PublishItem>(base);
+		i->size = -1;
+
+		PublishFormat &f = i->format;
+		f.body = QJsonDocument::fromVariant(message).toJson(QJsonDocument::Compact);
+
+		if(f.type == PublishFormat::HttpStream)
+		{
+			// one message per line
+			f.body += '\n';
+		}
+		else
+		{
+			f.messageType = PublishFormat::Text;
+
+			// combining queued messages would break the version chain
+			f.coalesce = PublishFormat::NoCoalesce;
+		}
+
+		return i;
+	}
+
+	// parses the json bodies of a delta item and prepares the payloads of
+	//   subscribers that opted in. the documents are kept for computing the
+	//   next patch. a format with no subscribers or a body that isn't json
+	//   loses its document, so the next delivery of it is a snapshot
+	void prepareDeltas(PublishJob *job)
+	{
+		const QString &channel = job->item.channel;
+
+		if(!job->stream.item && !job->ws.item)
+		{
+			cs.deltaDocs.remove(channel);
+			return;
+		}
 
-		int largestBlocks = -1;
-		if(item.size >= 0)
-			largestBlocks = blocksForData(item.size);
+		DeltaDocuments &dd = cs.deltaDocs[channel];
+		quint64 base = dd.version;
+		dd.version = ++cs.lastDeltaVersion;
 
-		if(item.formats.contains(PublishFormat::HttpResponse))
+		PublishDelivery *deliveries[] = { &job->stream, &job->ws };
+		for(PublishDelivery *d : deliveries)
 		{
-			if(item.size < 0)
-				largestBlocks = qMax(blocksForData(item.formats[PublishFormat::HttpResponse].body.size()), largestBlocks);
+			if(!d->item)
+				continue;
+
+			PublishFormat::Type type = d->item->format.type;
 
-			QSet<HttpSession*> sessions = cs.responseSessionsByChannel.value(item.channel);
-			foreach(HttpSession *hs, sessions)
+			QJsonParseError e;
+			QJsonDocument jdoc = QJsonDocument::fromJson(d->item->format.body, &e);
+			if(d->item->format.action != PublishFormat::Send || e.error != QJsonParseError::NoError)
 			{
-				assert(hs->holdMode() == Instruct::ResponseHold);
-				assert(hs->channels().contains(item.channel));
+				log_debug("delta item has no json body, channel=%s", qPrintable(channel));
+				dd.docs.remove(type);
+				continue;
+			}
 
-				responseSessions += hs;
+			QVariant doc = jdoc.toVariant();
 
-				if(!hs->sid().isEmpty())
-					sids += hs->sid();
-			}
-		}
+			QVariantMap snapshot;
+			snapshot["version"] = (qint64)dd.version;
+			snapshot["snapshot"] = doc;
 
-		if(item.formats.contains(PublishFormat::HttpStream))
-		{
-			if(item.size < 0)
-				largestBlocks = qMax(blocksForData(item.formats[PublishFormat::HttpStream].body.size()), largestBlocks);
+			d->deltaBase = base;
+			d->deltaVersion = dd.version;
+			d->deltaSnapshot = prepareDeltaItem(*d->item, snapshot);
 
-			QSet<HttpSession*> sessions = cs.streamSessionsByChannel.value(item.channel);
-			foreach(HttpSession *hs, sessions)
+			QHash<PublishFormat::Type, QVariant>::iterator it = dd.docs.find(type);
+			if(it != dd.docs.end())
 			{
-				// note: we used to assert that the session was currently a
-				//   stream hold and subscribed to the target channel,
-				//   however with the new grip-link stuff it is possible for
-				//   the session to temporarily switch to NoHold, and for
-				//   channels to become unsubscribed. so we'll do a
-				//   conditional statement instead
-				if(!hs->channels().contains(item.channel))
-					continue;
+				QVariantMap patch;
+				patch["version"] = (qint64)dd.version;
+				patch["base"] = (qint64)base;
+				patch["patch"] = JsonPatch::diff(it.value(), doc);
 
-				streamSessions += hs;
+				std::shared_ptr<const PublishItem> i = prepareDeltaItem(*d->item, patch);
+				if(i->format.body.size() < d->deltaSnapshot->format.body.size())
+					d->deltaPatch = i;
 
-				if(!hs->sid().isEmpty())
-					sids += hs->sid();
+				it.value() = doc;
+			}
+			else
+			{
+				dd.docs.insert(type, doc);
 			}
 		}
 
-		if(item.formats.contains(PublishFormat::WebSocketMessage))
-		{
-			if(item.size < 0)
-				largestBlocks = qMax(blocksForData(item.formats[PublishFormat::WebSocketMessage].body.size()), largestBlocks);
+		if(dd.docs.isEmpty())
+			cs.deltaDocs.remove(channel);
+	}
 
-			QSet<WsSession*> wsbc = cs.wsSessionsByChannel.value(item.channel);
-			foreach(WsSession *s, wsbc)
-			{
-				assert(s->channels.contains(item.channel));
+	// sessions that opted in get a patch if they received the previous
+	//   version, or else the full document
+	static std::shared_ptr<const PublishItem> deltaItem(const PublishDelivery &d, ClientSession *s, const QString &channel)
+	{
+		quint64 &version = s->deltaVersions[channel];
+		bool haveBase = (d.deltaPatch && version == d.deltaBase);
+		version = d.deltaVersion;
 
-				wsSessions += s;
+		return haveBase ? d.deltaPatch : d.deltaSnapshot;
+	}
 
-				if(!s->sid.isEmpty())
-					sids += s->sid;
-			}
-		}
+	static RateLimiter::Priority publishPriority(const PublishItem &item)
+	{
+		return item.highPriority ? RateLimiter::High : RateLimiter::Normal;
+	}
 
-		// always add for non-identified route
-		stats->addMessageReceived(QByteArray(), largestBlocks);
+	void deliver(PublishJob *job, const std::shared_ptr<HttpSession> &hs, PublishFormat::Type type)
+	{
+		PublishDelivery &d = (type == PublishFormat::HttpResponse ? job->response : job->stream);
 
-		if(!responseSessions.isEmpty())
-		{
-			PublishItem i = item;
-			i.format = item.formats.value(PublishFormat::HttpResponse);
-			i.formats.clear();
+		if(!hs->sid().isEmpty())
+			job->sids += hs->sid();
 
-			PublishFormat &f = i.format;
+		QString statsRoute = hs->statsRoute();
 
-			QList<QByteArray> exposeHeaders = f.headers.getAll("Grip-Expose-Headers");
+		const QString &channel = job->item.channel;
+		bool delta = (d.deltaSnapshot && hs->isDeltaChannel(channel));
+		std::shared_ptr<const PublishItem> item = (delta ? deltaItem(d, hs.get(), channel) : d.item);
 
-			// remove grip headers from the push
-			for(int n = 0; n < f.headers.count(); ++n)
-			{
-				// strip out grip headers
-				if(qstrnicmp(f.headers[n].first.data(), "Grip-", 5) == 0)
-				{
-					f.headers.removeAt(n);
-					--n; // adjust position
-				}
-			}
+		PublishAction *a = PublishAction::take(&freePublishActions, q->d, hs, item, d.exposeHeaders);
+		if(!publishLimiter->addAction(statsRoute, a, d.blocks != -1 ? d.blocks : 1, publishPriority(*d.item)))
+		{
+			a->release();
+			logPublishHwmExceeded(statsRoute);
 
-			log_debug("relaying to %d http-response subscribers", responseSessions.count());
+			// the next delivery needs to be a snapshot
+			if(delta)
+				hs->deltaVersions[channel] = 0;
+		}
 
-			// FIXME: if bodyPatch is used then body is empty. we should
-			//   really be calculating blocks after applying patch
+		d.addSent(hs->statsRouteId());
 
-			int blocks;
-			if(item.size >= 0)
-				blocks = blocksForData(item.size);
-			else
-				blocks = blocksForData(f.body.size());
+		++d.receivers;
+	}
 
-			foreach(HttpSession *hsp, responseSessions)
-			{
-				std::shared_ptr<HttpSession> &hs = cs.httpSessions[hsp->rid()];
+	void deliver(PublishJob *job, const std::shared_ptr<WsSession> &s)
+	{
+		PublishDelivery &d = job->ws;
 
-				QString statsRoute = hs->statsRoute();
+		if(!s->sid.isEmpty())
+			job->sids += s->sid;
 
-				if(!publishLimiter->addAction(statsRoute, new PublishAction(q->d, hs, i, exposeHeaders), blocks != -1 ? blocks : 1))
-				{
-					if(!statsRoute.isEmpty())
-						log_warning("exceeded publish hwm (%d) for route %s, dropping message", config.messageHwm, qPrintable(statsRoute));
-					else
-						log_warning("exceeded publish hwm (%d), dropping message", config.messageHwm);
-				}
+		QString statsRoute = s->statsRoute;
 
-				stats->addMessageSent(statsRoute.toUtf8(), "http-response", blocks);
-			}
+		const QString &channel = job->item.channel;
+		bool delta = (d.deltaSnapshot && s->deltaChannels.contains(channel));
+		std::shared_ptr<const PublishItem> item = (delta ? deltaItem(d, s.get(), channel) : d.item);
+
+		PublishAction *a = PublishAction::take(&freePublishActions, q->d, s, item);
+		if(!publishLimiter->addAction(statsRoute, a, d.blocks != -1 ? d.blocks : 1, publishPriority(*d.item)))
+		{
+			a->release();
+			logPublishHwmExceeded(statsRoute);
 
-			stats->addMessage(i.channel, i.id, "http-response", responseSessions.count(), blocks != -1 ? blocks * responseSessions.count() : -1);
+			// the next delivery needs to be a snapshot
+			if(delta)
+				s->deltaVersions[channel] = 0;
 		}
 
-		if(!streamSessions.isEmpty())
+		d.addSent(s->statsRouteId);
+
+		++d.receivers;
+	}
+
+	void deliver(PublishJob *job, const PublishTarget &t)
+	{
+		const QString &channel = job->item.channel;
+
+		if(t.type == PublishFormat::WebSocketMessage)
+		{
+			std::shared_ptr<WsSession> s = cs.wsSessions.value(t.cid);
+			if(!s || !s->channels.contains(channel))
+				return;
+
+			deliver(job, s);
+		}
+		else
 		{
-			PublishItem i = item;
-			i.format = item.formats.value(PublishFormat::HttpStream);
-			i.formats.clear();
+			std::shared_ptr<HttpSession> hs = cs.httpSessions.value(t.rid);
+			if(!hs || !hs->matchesChannel(channel))
+				return;
 
-			PublishFormat &f = i.format;
+			if(t.type == PublishFormat::HttpResponse && hs->holdMode() != Instruct::ResponseHold)
+				return;
 
-			log_debug("relaying to %d http-stream subscribers", streamSessions.count());
+			deliver(job, hs, t.type);
+		}
+	}
 
-			int blocks;
-			if(item.size >= 0)
-				blocks = blocksForData(item.size);
-			else
-				blocks = blocksForData(f.body.size());
+	void processPublishJobs()
+	{
+		QElapsedTimer elapsed;
+		elapsed.start();
 
-			foreach(HttpSession *hsp, streamSessions)
-			{
-				std::shared_ptr<HttpSession> &hs = cs.httpSessions[hsp->rid()];
+		int processed = 0;
 
-				QString statsRoute = hs->statsRoute();
+		TRACE_EVENT(PublishBegin, 0);
 
-				if(!publishLimiter->addAction(statsRoute, new PublishAction(q->d, hs, i), blocks != -1 ? blocks : 1))
+		while(!publishJobs.empty())
+		{
+			PublishJob *job = publishJobs.front().get();
+
+			while(job->next < job->targets.size())
+			{
+				if(processed > 0 && publishChunkExhausted(processed, elapsed))
 				{
-					if(!statsRoute.isEmpty())
-						log_warning("exceeded publish hwm (%d) for route %s, dropping message", config.messageHwm, qPrintable(statsRoute));
-					else
-						log_warning("exceeded publish hwm (%d), dropping message", config.messageHwm);
+					// resume after other events have had a chance
+					deferCall.defer([=] { processPublishJobs(); });
+
+					TRACE_EVENT(PublishEnd, processed);
+					return;
 				}
 
-				stats->addMessageSent(statsRoute.toUtf8(), "http-stream", blocks);
+				deliver(job, job->targets[job->next++]);
+				++processed;
 			}
 
-			stats->addMessage(i.channel, i.id, "http-stream", streamSessions.count(), blocks != -1 ? blocks * streamSessions.count() : -1);
+			finishPublishJob(job);
+			publishJobs.pop_front();
 		}
 
-		if(!wsSessions.isEmpty())
-		{
-			PublishItem i = item;
-			i.format = item.formats.value(PublishFormat::WebSocketMessage);
-			i.formats.clear();
+		if(!publishStreams.isEmpty())
+			updatePublishStreams();
+
+		TRACE_EVENT(PublishEnd, processed);
+	}
 
-			PublishFormat &f = i.format;
+	bool publishChunkExhausted(int processed, const QElapsedTimer &elapsed) const
+	{
+		if(config.fanoutChunkSize > 0 && processed >= config.fanoutChunkSize)
+			return true;
 
-			log_debug("relaying to %d ws-message subscribers", wsSessions.count());
+		// reading the clock isn't free, so only check it periodically
+		if(config.fanoutChunkTime > 0 && processed % FANOUT_TIME_CHECK_INTERVAL == 0 && elapsed.nsecsElapsed() / 1000 >= config.fanoutChunkTime)
+			return true;
 
-			int blocks;
-			if(item.size >= 0)
-				blocks = blocksForData(item.size);
-			else
-				blocks = blocksForData(f.body.size());
+		return false;
+	}
 
-			foreach(WsSession *sp, wsSessions)
-			{
-				std::shared_ptr<WsSession> &s = cs.wsSessions[sp->cid];
+	void flushMessagesSent(PublishDelivery *d, const QString &transport)
+	{
+		for(const std::pair<QByteArray, int> &i : d->sent)
+			stats->addMessageSent(i.first, transport, d->blocks, i.second);
 
-				QString statsRoute = s->statsRoute;
+		d->sent.clear();
+		d->sentIndexes.clear();
+	}
 
-				if(!publishLimiter->addAction(statsRoute, new PublishAction(q->d, s, i), blocks != -1 ? blocks : 1))
-				{
-					if(!statsRoute.isEmpty())
-						log_warning("exceeded publish hwm (%d) for route %s, dropping message", config.messageHwm, qPrintable(statsRoute));
-					else
-						log_warning("exceeded publish hwm (%d), dropping message", config.messageHwm);
-				}
+	void finishPublishJob(PublishJob *job)
+	{
+		const PublishItem &item = job->item;
 
-				stats->addMessageSent(statsRoute.toUtf8(), "ws-message", blocks);
-			}
+		flushMessagesSent(&job->response, "http-response");
+		flushMessagesSent(&job->stream, "http-stream");
+		flushMessagesSent(&job->ws, "ws-message");
 
-			stats->addMessage(i.channel, i.id, "ws-message", wsSessions.count(), blocks != -1 ? blocks * wsSessions.count() : -1);
-		}
+		if(job->response.receivers > 0)
+			stats->addMessage(item.channel, item.id, "http-response", job->response.receivers, job->response.blocks != -1 ? job->response.blocks * job->response.receivers : -1);
+
+		if(job->stream.receivers > 0)
+			stats->addMessage(item.channel, item.id, "http-stream", job->stream.receivers, job->stream.blocks != -1 ? job->stream.blocks * job->stream.receivers : -1);
 
-		int receivers = responseSessions.count() + streamSessions.count() + wsSessions.count();
-		log_info("publish channel=%s receivers=%d", qPrintable(item.channel), receivers);
+		if(job->ws.receivers > 0)
+			stats->addMessage(item.channel, item.id, "ws-message", job->ws.receivers, job->ws.blocks != -1 ? job->ws.blocks * job->ws.receivers : -1);
+
+		int receivers = job->response.receivers + job->stream.receivers + job->ws.receivers;
+		logPublish(item.channel, receivers);
+
+		if(job->trace.isValid())
+			TRACE_SPAN(PublishDelivery, job->trace, job->traceStart);
+
+		qint64 bytes = (qint64)job->response.size * job->response.receivers + (qint64)job->stream.size * job->stream.receivers + (qint64)job->ws.size * job->ws.receivers;
+		stats->addPublish(item.channel, receivers, bytes);
+
+		const QSet<QString> &sids = job->sids;
 
 		if(!item.id.isNull() && !sids.isEmpty() && stateClient)
 		{
-			// update sessions' last-id
-			QHash<QString, LastIds> sidLastIds;
+			// update sessions' last-id. only the latest id per channel
+			// matters, so these are merged and sent in batches
+			LastIds lastIds;
+			lastIds[item.channel] = item.id;
+
+			qint64 now = LoopClock::msecsSinceEpoch();
+
 			foreach(const QString &sid, sids)
 			{
-				LastIds lastIds;
-				lastIds[item.channel] = item.id;
-				sidLastIds[sid] = lastIds;
+				sessionUpdates->add(sid, lastIds);
+				sessionCache->update(sid, lastIds, now);
 			}
-
-			auto d = std::unique_ptr<Deferred>(SessionRequest::updateMany(stateClient.get(), sidLastIds));
-
-			// safe to not track, since d can't outlive this
-			d->finished.connect(boost::bind(&Private::sessionUpdateMany_finished, this, d.get(), boost::placeholders::_1));
-
-			deferreds[d.get()] = std::move(d);
 		}
 	}
 
@@ -2309,6 +4612,17 @@ private:
 		acceptServer_requestReady();
 	}
 
+	void acceptBatchWorker_finished(AcceptBatchWorker *w, const DeferredResult &result)
+	{
+		Q_UNUSED(result);
+
+		acceptBatchWorkers.remove(w);
+		delete w;
+
+		// try to read again
+		acceptServer_requestReady();
+	}
+
 	void deferred_finished(Deferred *d, const DeferredResult &result)
 	{
 		Q_UNUSED(result);
@@ -2333,11 +4647,27 @@ private:
 			hs->subscribeCallback().add(Private::hs_subscribe_cb, this);
 			hs->unsubscribeCallback().add(Private::hs_unsubscribe_cb, this);
 			hs->finishedCallback().add(Private::hs_finished_cb, this);
+			hs->setSlowConsumerPolicy(slowConsumerPolicy);
+			hs->setNextLinkPrefetch(config.nextLinkPrefetch);
 
 			cs.httpSessions.insert(hs->rid(), hs);
 
 			hs->start();
 		}
+
+		QList<PublishItem> replayItems = w->takeReplayItems();
+		foreach(const PublishItem &item, replayItems)
+		{
+			if(!item.formats.contains(PublishFormat::HttpResponse))
+				continue;
+
+			QList<QByteArray> exposeHeaders;
+			std::shared_ptr<const PublishItem> i = preparePublishItem(item, PublishFormat::HttpResponse, &exposeHeaders);
+
+			// sessions ignore items that don't follow their prev-id
+			foreach(const std::shared_ptr<HttpSession> &hs, sessions)
+				hs->publish(i, exposeHeaders);
+		}
 	}
 
 	void acceptWorker_retryPacketReady(const QByteArray &instanceAddress, const RetryRequestPacket &packet)
@@ -2345,12 +4675,20 @@ private:
 		writeRetryPacket(instanceAddress, packet);
 	}
 
+	void acceptBatchWorker_retryPacketsReady(const QByteArray &instanceAddress, const QList<RetryRequestPacket> &packets)
+	{
+		if(packets.count() == 1)
+			writeRetryPacket(instanceAddress, packets.first());
+		else
+			writeRetryPackets(instanceAddress, packets);
+	}
+
 	void stats_connectionsRefreshed(const QList<QByteArray> &ids)
 	{
 		if(stateClient)
 		{
-			// find sids of the connections
-			QHash<QString, LastIds> sidLastIds;
+			// refresh the sids of the connections. an update with no ids
+			// merges into any pending one for the same sid
 			foreach(const QByteArray &id, ids)
 			{
 				int at = id.indexOf(':');
@@ -2359,17 +4697,7 @@ private:
 
 				HttpSession *hs = cs.httpSessions.value(rid).get();
 				if(hs && !hs->sid().isEmpty())
-					sidLastIds[hs->sid()] = LastIds();
-			}
-
-			if(!sidLastIds.isEmpty())
-			{
-				auto d = std::unique_ptr<Deferred>(SessionRequest::updateMany(stateClient.get(), sidLastIds));
-
-				// safe to not track, since d can't outlive this
-				d->finished.connect(boost::bind(&Private::sessionUpdateMany_finished, this, d.get(), boost::placeholders::_1));
-
-				deferreds[d.get()] = std::move(d);
+					sessionUpdates->add(hs->sid(), LastIds());
 			}
 		}
 	}
@@ -2381,12 +4709,117 @@ private:
 
 		Q_UNUSED(mode);
 
+		if(channel.endsWith('*'))
+		{
+			QString prefix = channel.left(channel.length() - 1);
+			if(!cs.responseSessionsByPrefix.contains(prefix) && !cs.streamSessionsByPrefix.contains(prefix))
+				removePrefixSub(prefix);
+		}
+
 		if(!cs.responseSessionsByChannel.contains(channel) && !cs.streamSessionsByChannel.contains(channel) && !cs.wsSessionsByChannel.contains(channel))
 			removeSub(channel);
 	}
 
+	void logPublish(const QString &channel, int receivers)
+	{
+		// avoid the bookkeeping if the lines would be dropped anyway
+		if(log_outputLevel() < LOG_LEVEL_INFO)
+			return;
+
+		switch(publishLogMode)
+		{
+			case PublishLogAll:
+				log_info("publish channel=%s receivers=%d", qPrintable(channel), receivers);
+				break;
+			case PublishLogSample:
+				if(publishLogSeq++ % publishLogSampleRate == 0)
+					log_info("publish channel=%s receivers=%d sample=1/%d", qPrintable(channel), receivers, publishLogSampleRate);
+				break;
+			case PublishLogAggregate:
+			{
+				PublishLogCount *c;
+
+				QHash<QString, PublishLogCount>::iterator it = publishLogCounts.find(channel);
+				if(it != publishLogCounts.end())
+					c = &it.value();
+				else if(publishLogCounts.count() < PUBLISH_LOG_CHANNELS_MAX)
+					c = &publishLogCounts[channel];
+				else
+					c = &publishLogOther;
+
+				++(c->items);
+				c->receivers += receivers;
+				break;
+			}
+		}
+	}
+
+	void flushPublishLog()
+	{
+		QHashIterator<QString, PublishLogCount> it(publishLogCounts);
+		while(it.hasNext())
+		{
+			it.next();
+			const PublishLogCount &c = it.value();
+
+			log_info("publish channel=%s items=%d receivers=%lld", qPrintable(it.key()), c.items, c.receivers);
+		}
+
+		if(publishLogOther.items > 0)
+			log_info("publish channel=(other) items=%d receivers=%lld", publishLogOther.items, publishLogOther.receivers);
+
+		publishLogCounts.clear();
+		publishLogOther = PublishLogCount();
+	}
+
+	void stats_reportIntervalElapsed()
+	{
+		if(publishLogMode == PublishLogAggregate)
+			flushPublishLog();
+
+		ObjectStats::updateAllocatorStats();
+
+		quint32 hits, misses;
+		Filter::takeHttpCacheCounts(&hits, &misses);
+
+		if(hits > 0)
+			stats->incCounter(QByteArray(), Stats::FilterCacheHits, hits);
+
+		if(misses > 0)
+			stats->incCounter(QByteArray(), Stats::FilterCacheMisses, misses);
+
+		quint32 duplicates, uncached;
+		sequencer->takeIdCacheCounts(&duplicates, &uncached);
+
+		if(duplicates > 0)
+			stats->incCounter(QByteArray(), Stats::IdCacheDuplicates, duplicates);
+
+		if(uncached > 0)
+			stats->incCounter(QByteArray(), Stats::IdCacheUncached, uncached);
+
+		if(config.idCacheTtl > 0)
+		{
+			int capacity = sequencer->idCacheCapacity();
+			if(capacity >= 0)
+				log_debug("id cache: %d/%d entries", sequencer->idCacheCount(), capacity);
+			else
+				log_debug("id cache: %d entries", sequencer->idCacheCount());
+		}
+
+		log_debug("last ids: %d/%d entries, %llu evicted", cs.publishLastIds.count(), cs.publishLastIds.capacity(), (unsigned long long)cs.publishLastIds.evictions());
+
+		log_debug("channel atoms: %d/%d entries", cs.channelAtoms.count(), cs.channelAtoms.capacity());
+
+		if(cs.publishHistory.isEnabled())
+			log_debug("publish history: %d items in %d channels, %lld bytes, %llu evicted", cs.publishHistory.itemCount(), cs.publishHistory.channelCount(), (long long)cs.publishHistory.memoryUsed(), (unsigned long long)cs.publishHistory.evictions());
+	}
+
 	void stats_reported(const QList<StatsPacket> &packets)
 	{
+		// other shards are merged into the report of the first shard
+		if(config.shardIndex > 0)
+			return;
+
 		// only one outstanding report at a time
 		if(report)
 			return;
@@ -2422,107 +4855,282 @@ private:
 			QJsonDocument doc = QJsonDocument::fromJson(message.mid(1), &e);
 			if(e.error != QJsonParseError::NoError)
 			{
-				if(errorMessage)
-					*errorMessage = QString("received message with invalid format (json parse failed)");
-				if(ok)
-					*ok = false;
-				return data;
+				if(errorMessage)
+					*errorMessage = QString("received message with invalid format (json parse failed)");
+				if(ok)
+					*ok = false;
+				return data;
+			}
+
+			if(doc.isObject())
+			{
+				data = doc.object().toVariantMap();
+			}
+			else
+			{
+				if(errorMessage)
+					*errorMessage = QString("received message with invalid format (not a valid json object)");
+				if(ok)
+					*ok = false;
+				return data;
+			}
+		}
+		else
+		{
+			int offset = 0;
+			if(message.length() > 0 && message[0] == 'T') {
+				offset = 1;
+			}
+
+			data = TnetString::toVariant(message, offset, &ok_);
+			if(!ok_)
+			{
+				if(errorMessage)
+					*errorMessage = QString("received message with invalid format (tnetstring parse failed)");
+				if(ok)
+					*ok = false;
+				return data;
+			}
+		}
+		if(ok)
+			*ok = true;
+		return data;
+	}
+
+	// a message holds either a single item, or an object with an 'items'
+	// list. tnetstring input is decoded directly into the items. json input
+	// is decoded through a variant. if encodedItems is set, it receives each
+	// item on its own, in the same encoding as the message
+	bool parsePublishMessage(const QByteArray &message, const QString &channel, const char *logPrefix, QList<PublishItem> *items, QList<QByteArray> *encodedItems = 0)
+	{
+		bool ok = true;
+		QString errorMessage;
+		QVariant data;
+
+		if(message.length() > 0 && message[0] == 'J')
+		{
+			data = parseJsonOrTnetstring(message, &ok, &errorMessage);
+			if(!ok)
+			{
+				log_warning("%s: %s, skipping", logPrefix, qPrintable(errorMessage));
+				return false;
+			}
+
+			QVariantMap mdata = data.toMap();
+
+			if(mdata.contains("items"))
+			{
+				if(typeId(mdata["items"]) != QMetaType::QVariantList)
+				{
+					log_warning("%s: received message with invalid format: object contains 'items' with wrong type, skipping", logPrefix);
+					return false;
+				}
+
+				foreach(const QVariant &vitem, mdata["items"].toList())
+				{
+					*items += PublishItem::fromVariant(vitem, channel, &ok, &errorMessage);
+					if(!ok)
+						break;
+
+					if(encodedItems)
+					{
+						QJsonDocument doc(QJsonObject::fromVariantMap(vitem.toMap()));
+						*encodedItems += 'J' + doc.toJson(QJsonDocument::Compact);
+					}
+				}
+			}
+			else
+			{
+				*items += PublishItem::fromVariant(data, channel, &ok, &errorMessage);
+
+				if(encodedItems)
+					*encodedItems += message;
+			}
+		}
+		else
+		{
+			int offset = (message.length() > 0 && message[0] == 'T') ? 1 : 0;
+
+			TnetString::View view(message, offset);
+			if(!view.isValid())
+			{
+				log_warning("%s: received message with invalid format (tnetstring parse failed), skipping", logPrefix);
+				return false;
+			}
+
+			if(log_outputLevel() >= LOG_LEVEL_DEBUG)
+				data = view.toVariant();
+
+			TnetString::View vitems;
+			if(view.type() == TnetString::Hash)
+			{
+				TnetString::View::Iterator it(view);
+				while(it.next())
+				{
+					if(it.key().equals("items"))
+					{
+						vitems = it.value();
+						break;
+					}
+				}
 			}
 
-			if(doc.isObject())
+			if(vitems.isValid())
 			{
-				data = doc.object().toVariantMap();
+				if(vitems.type() != TnetString::List)
+				{
+					log_warning("%s: received message with invalid format: object contains 'items' with wrong type, skipping", logPrefix);
+					return false;
+				}
+
+				TnetString::View::Iterator it(vitems);
+				while(it.next())
+				{
+					*items += PublishItem::fromView(it.value(), channel, &ok, &errorMessage);
+					if(!ok)
+						break;
+
+					if(encodedItems)
+						*encodedItems += 'T' + it.value().encoded();
+				}
+
+				if(ok && it.isError())
+				{
+					ok = false;
+					errorMessage = "'items' has invalid format";
+				}
 			}
 			else
 			{
-				if(errorMessage)
-					*errorMessage = QString("received message with invalid format (not a valid json object)");
-				if(ok)
-					*ok = false;
-				return data;
+				*items += PublishItem::fromView(view, channel, &ok, &errorMessage);
+
+				if(encodedItems)
+					*encodedItems += message;
 			}
 		}
-		else
+
+		if(log_outputLevel() >= LOG_LEVEL_DEBUG)
 		{
-			int offset = 0;
-			if(message.length() > 0 && message[0] == 'T') {
-				offset = 1;
-			}
+			if(!channel.isEmpty())
+				log_debug("%s: channel=%s %s", logPrefix, qPrintable(channel), qPrintable(TnetString::variantToString(data, -1)));
+			else
+				log_debug("%s: %s", logPrefix, qPrintable(TnetString::variantToString(data, -1)));
+		}
 
-			data = TnetString::toVariant(message, offset, &ok_);
-			if(!ok_)
-			{
-				if(errorMessage)
-					*errorMessage = QString("received message with invalid format (tnetstring parse failed)");
-				if(ok)
-					*ok = false;
-				return data;
-			}
+		if(!ok)
+		{
+			log_warning("%s: received message with invalid format: %s, skipping", logPrefix, qPrintable(errorMessage));
+			return false;
 		}
-		if(ok)
-			*ok = true;
-		return data;
+
+		return true;
 	}
 
 	void inPull_readyRead(const QList<QByteArray> &message)
 	{
+		if(capture)
+			capture->write(PacketCapture::PublishPull, message);
+
 		if(message.count() != 1)
 		{
 			log_warning("IN pull: received message with parts != 1, skipping");
 			return;
 		}
 
-		bool ok;
-		QString errorMessage;
-		QVariant data = parseJsonOrTnetstring(message[0], &ok, &errorMessage);
-		if(!ok)
-		{
-			log_warning("IN pull: %s, skipping", qPrintable(errorMessage));
+		QList<PublishItem> items;
+		QList<QByteArray> encodedItems;
+		if(!parsePublishMessage(message[0], QString(), "IN pull", &items, relaying() ? &encodedItems : 0))
 			return;
-		}
-
-		if(log_outputLevel() >= LOG_LEVEL_DEBUG)
-			log_debug("IN pull: %s", qPrintable(TnetString::variantToString(data, -1)));
 
-		PublishItem item = PublishItem::fromVariant(data, QString(), &ok, &errorMessage);
-		if(!ok)
+		if(relaying())
 		{
-			log_warning("IN pull: received message with invalid format: %s, skipping", qPrintable(errorMessage));
-			return;
+			for(int n = 0; n < items.count(); ++n)
+				relayItem(items[n], encodedItems[n]);
 		}
 
-		handlePublishItem(item);
+		handlePublishItems(items);
+
+		checkMemoryBudget();
 	}
 
 	void inSub_readyRead(const QList<QByteArray> &message)
 	{
-		if(message.count() != 2)
+		if(capture)
+			capture->write(PacketCapture::PublishSub, message);
+
+		// with hashed topics, the topic comes first, followed by the
+		// channel and the content
+		int parts = (config.pushInSubHashedTopics ? 3 : 2);
+
+		if(message.count() != parts)
 		{
-			log_warning("IN sub: received message with parts != 2, skipping");
+			log_warning("IN sub: received message with parts != %d, skipping", parts);
 			return;
 		}
 
-		bool ok;
-		QString errorMessage;
-		QVariant data = parseJsonOrTnetstring(message[1], &ok, &errorMessage);
-		if(!ok) {
-			log_warning("IN sub: %s, skipping", qPrintable(errorMessage));
+		const QByteArray &channelData = message[parts - 2];
+
+		if(config.pushInSubHashedTopics && !subscriptionDirectory.contains(channelData))
+		{
+			// the topic is shared with a channel we are subscribed to
+			log_debug("IN sub: dropping message for unsubscribed channel %s", channelData.data());
 			return;
 		}
 
-		QString channel = QString::fromUtf8(message[0]);
+		QString channel = QString::fromUtf8(channelData);
 
-		if(log_outputLevel() >= LOG_LEVEL_DEBUG)
-			log_debug("IN sub: channel=%s %s", qPrintable(channel), qPrintable(TnetString::variantToString(data, -1)));
+		QList<PublishItem> items;
+		QList<QByteArray> encodedItems;
+		if(!parsePublishMessage(message[parts - 1], channel, "IN sub", &items, relaying() ? &encodedItems : 0))
+			return;
 
-		PublishItem item = PublishItem::fromVariant(data, channel, &ok, &errorMessage);
-		if(!ok)
+		if(relaying())
 		{
-			log_warning("IN sub: received message with invalid format: %s, skipping", qPrintable(errorMessage));
+			for(int n = 0; n < items.count(); ++n)
+				relayItem(items[n], encodedItems[n]);
+		}
+
+		handlePublishItems(items);
+
+		checkMemoryBudget();
+	}
+
+	// stop reading publishes while over the memory budget. zmq queues and
+	// then drops at the hwm, pushing back on publishers
+	void checkMemoryBudget()
+	{
+		if(!MemoryBudget::exceeded() || (budgetTimer && budgetTimer->isActive()))
 			return;
+
+		log_warning("over memory budget, pausing publish input");
+
+		if(inPullValve)
+			inPullValve->close();
+		if(inSubValve)
+			inSubValve->close();
+
+		if(!budgetTimer)
+		{
+			budgetTimer = std::make_unique<Timer>();
+			budgetTimerConnection = budgetTimer->timeout.connect(boost::bind(&Private::budgetTimer_timeout, this));
 		}
 
-		handlePublishItem(item);
+		budgetTimer->start(MEMORY_BUDGET_CHECK_INTERVAL);
+	}
+
+	void budgetTimer_timeout()
+	{
+		if(MemoryBudget::exceeded())
+			return;
+
+		log_info("under memory budget, resuming publish input");
+
+		budgetTimer->stop();
+
+		if(inPullValve)
+			inPullValve->open();
+		if(inSubValve)
+			inSubValve->open();
 	}
 
 	void wsControlInit_readyRead(const QList<QByteArray> &message)
@@ -2551,19 +5159,18 @@ private:
 
 	void wsControlIn_readyRead(const QByteArray &message)
 	{
-		bool ok;
-		QVariant data = TnetString::toVariant(message, 0, &ok);
-		if(!ok)
+		TnetString::View data(message);
+		if(!data.isValid())
 		{
 			log_warning("IN wscontrol: received message with invalid format (tnetstring parse failed), skipping");
 			return;
 		}
 
 		if(log_outputLevel() >= LOG_LEVEL_DEBUG)
-			log_debug("IN wscontrol: %s", qPrintable(TnetString::variantToString(data, -1)));
+			log_debug("IN wscontrol: %s", qPrintable(TnetString::variantToString(data.toVariant(), -1)));
 
 		WsControlPacket packet;
-		if(!packet.fromVariant(data))
+		if(!packet.fromView(data))
 		{
 			log_warning("IN wscontrol: received message with invalid format, skipping");
 			return;
@@ -2574,6 +5181,11 @@ private:
 
 		QList<WsControlPacket::Item> outItems;
 
+		// channels joined by sessions of this packet. the stats and
+		//   upstream subscription of each are updated once, after all items
+		QStringList joinedChannels;
+		QSet<QString> joinedSet;
+
 		foreach(const WsControlPacket::Item &item, packet.items)
 		{
 			if(item.type != WsControlPacket::Item::Ack && !item.requestId.isEmpty())
@@ -2590,27 +5202,12 @@ private:
 			{
 				std::shared_ptr<WsSession> s = cs.wsSessions.value(item.cid);
 				if(!s)
-				{
-					s = std::make_shared<WsSession>();
-					wsSessionConnectionMap[s.get()] = {
-						s->send.connect(boost::bind(&Private::wssession_send, this, boost::placeholders::_1, s.get())),
-						s->expired.connect(boost::bind(&Private::wssession_expired, this, s.get())),
-						s->error.connect(boost::bind(&Private::wssession_error, this, s.get()))
-					};
-					s->peer = packet.from;
-					s->cid = QString::fromUtf8(item.cid);
-					s->ttl = item.ttl;
-					s->requestData.uri = item.uri;
-					s->zhttpOut = zhttpOut.get();
-					s->filterLimiter = filterLimiter;
-					s->refreshExpiration();
-					cs.wsSessions.insert(s->cid, s);
-					log_debug("added ws session: %s", qPrintable(s->cid));
-				}
+					s = addWsSession(packet.from, QString::fromUtf8(item.cid), item.ttl, item.uri);
 
 				s->debug = item.debug;
 				s->route = item.route;
 				s->statsRoute = item.separateStats ? item.route : QString();
+				s->statsRouteId = s->statsRoute.toUtf8();
 				s->targetTrusted = item.trusted;
 				s->channelPrefix = QString::fromUtf8(item.channelPrefix);
 				if(item.logLevel >= 0)
@@ -2635,12 +5232,14 @@ private:
 				continue;
 			}
 
+			// any item shows the proxy still has the connection, so the
+			// proxy only sends keep-alives for sessions that are quiet
 			if(item.type == WsControlPacket::Item::KeepAlive)
-			{
 				s->ttl = item.ttl;
-				s->refreshExpiration();
-			}
-			else if(item.type == WsControlPacket::Item::Gone || item.type == WsControlPacket::Item::Cancel)
+
+			s->refreshExpiration();
+
+			if(item.type == WsControlPacket::Item::Gone || item.type == WsControlPacket::Item::Cancel)
 			{
 				removeWsSession(s);
 			}
@@ -2681,15 +5280,22 @@ private:
 						s->channels += channel;
 						s->channelFilters[channel] = cm.filters;
 
-						if(!cs.wsSessionsByChannel.contains(channel))
-							cs.wsSessionsByChannel.insert(channel, QSet<WsSession*>());
+						// resubscribing starts over with a snapshot
+						s->deltaVersions.remove(channel);
+						if(cm.delta)
+							s->deltaChannels += channel;
+						else
+							s->deltaChannels.remove(channel);
 
-						cs.wsSessionsByChannel[channel] += s;
+						cs.wsSessionsByChannel.add(channel, s);
 
 						log_debug("ws session %s subscribed to %s", qPrintable(s->cid), qPrintable(channel));
 
-						stats->addSubscription("ws", channel, cs.wsSessionsByChannel.value(channel).count());
-						addSub(channel);
+						if(!joinedSet.contains(channel))
+						{
+							joinedSet += channel;
+							joinedChannels += channel;
+						}
 
 						log_info("subscribe %s channel=%s", qPrintable(s->requestData.uri.toString(QUrl::FullyEncoded)), qPrintable(channel));
 					}
@@ -2707,6 +5313,8 @@ private:
 					{
 						s->channels.remove(channel);
 						s->channelFilters.remove(channel);
+						s->deltaChannels.remove(channel);
+						s->deltaVersions.remove(channel);
 
 						removeSessionChannel(s, channel);
 					}
@@ -2732,10 +5340,14 @@ private:
 				}
 				else if(cm.type == WsControlMessage::SetMeta)
 				{
+					removeWsSessionUser(s.get());
+
 					if(!cm.metaValue.isNull())
 						s->meta[cm.metaName] = cm.metaValue;
 					else
 						s->meta.remove(cm.metaName);
+
+					addWsSessionUser(s.get());
 				}
 				else if(cm.type == WsControlMessage::KeepAlive)
 				{
@@ -2806,7 +5418,7 @@ private:
 
 					outItems += i;
 
-					stats->addActivity(s->statsRoute.toUtf8(), 1);
+					stats->addActivity(s->statsRouteId, 1);
 				}
 			}
 			else if(item.type == WsControlPacket::Item::Subscribe)
@@ -2815,15 +5427,15 @@ private:
 				s->channels += channel;
 				s->implicitChannels += channel;
 
-				if(!cs.wsSessionsByChannel.contains(channel))
-					cs.wsSessionsByChannel.insert(channel, QSet<WsSession*>());
-
-				cs.wsSessionsByChannel[channel] += s;
+				cs.wsSessionsByChannel.add(channel, s);
 
 				log_debug("ws session %s subscribed to %s", qPrintable(s->cid), qPrintable(channel));
 
-				stats->addSubscription("ws", channel, cs.wsSessionsByChannel.value(channel).count());
-				addSub(channel);
+				if(!joinedSet.contains(channel))
+				{
+					joinedSet += channel;
+					joinedChannels += channel;
+				}
 
 				log_info("subscribe %s channel=%s", qPrintable(s->requestData.uri.toString(QUrl::FullyEncoded)), qPrintable(channel));
 			}
@@ -2834,6 +5446,17 @@ private:
 			}
 		}
 
+		foreach(const QString &channel, joinedChannels)
+		{
+			// sessions may have left again within the packet
+			int count = cs.wsSessionsByChannel.count(channel);
+			if(count > 0)
+			{
+				stats->addSubscription("ws", channel, count);
+				addSub(channel);
+			}
+		}
+
 		if(!outItems.isEmpty())
 			writeWsControlItems(packet.from, outItems);
 
@@ -2861,6 +5484,25 @@ private:
 		}
 	}
 
+	void peerSubscriptions_readyRead(const QList<QByteArray> &message)
+	{
+		// an XPUB socket only passes along the first subscription to a
+		// channel and the last unsubscription, across all of its peers
+		if(message.count() != 1 || message[0].isEmpty())
+		{
+			log_warning("IN peer subscription: received message with invalid format, skipping");
+			return;
+		}
+
+		const QByteArray &m = message[0];
+		QByteArray channel = m.mid(1);
+
+		if(m[0] == 1)
+			directoryAdd(channel);
+		else if(m[0] == 0)
+			directoryRemove(channel);
+	}
+
 	void proxyStats_readyRead(const QList<QByteArray> &message)
 	{
 		if(message.count() != 1)
@@ -2878,27 +5520,43 @@ private:
 
 		QByteArray type = message[0].mid(0, at);
 
-		if(at + 1 >= message[0].length() || message[0][at + 1] != 'T')
-		{
-			log_warning("IN proxy stats: received message with unsupported format, skipping");
-			return;
-		}
+		char format = at + 1 < message[0].length() ? message[0][at + 1] : 0;
 
-		bool ok;
-		QVariant data = TnetString::toVariant(message[0], at + 2, &ok);
-		if(!ok)
+		StatsPacket p;
+
+		if(format == 'B')
 		{
-			log_warning("IN proxy stats: received message with invalid format (tnetstring parse failed), skipping");
-			return;
+			if(!p.fromBinary(type, message[0], at + 2))
+			{
+				log_warning("IN proxy stats: received message with invalid format (binary parse failed), skipping");
+				return;
+			}
+
+			if(log_outputLevel() >= LOG_LEVEL_DEBUG)
+				log_debug("IN proxy stats: %s %s", type.data(), qPrintable(TnetString::variantToString(p.toVariant(), -1)));
 		}
+		else if(format == 'T')
+		{
+			bool ok;
+			QVariant data = TnetString::toVariant(message[0], at + 2, &ok);
+			if(!ok)
+			{
+				log_warning("IN proxy stats: received message with invalid format (tnetstring parse failed), skipping");
+				return;
+			}
 
-		if(log_outputLevel() >= LOG_LEVEL_DEBUG)
-			log_debug("IN proxy stats: %s %s", type.data(), qPrintable(TnetString::variantToString(data, -1)));
+			if(log_outputLevel() >= LOG_LEVEL_DEBUG)
+				log_debug("IN proxy stats: %s %s", type.data(), qPrintable(TnetString::variantToString(data, -1)));
 
-		StatsPacket p;
-		if(!p.fromVariant(type, data))
+			if(!p.fromVariant(type, data))
+			{
+				log_warning("IN proxy stats: received message with invalid format, skipping");
+				return;
+			}
+		}
+		else
 		{
-			log_warning("IN proxy stats: received message with invalid format, skipping");
+			log_warning("IN proxy stats: received message with unsupported format, skipping");
 			return;
 		}
 
@@ -2932,6 +5590,11 @@ private:
 				}
 			}
 		}
+		else if(p.type == StatsPacket::Message || p.type == StatsPacket::Messages || p.type == StatsPacket::Subscribed || p.type == StatsPacket::Unsubscribed)
+		{
+			// only sent by other handler shards. forward the packet
+			stats->sendPacket(p);
+		}
 		else if(p.type == StatsPacket::Report)
 		{
 			bool mergeConnectionReport = !stats->connectionSendEnabled();
@@ -2990,7 +5653,13 @@ private:
 		}
 		else if(path == "/publish")
 		{
-			if(req->requestMethod() == "POST")
+			QByteArray contentType = headers.getAsFirstParameter("Content-Type");
+
+			if(req->requestMethod() == "POST" && (contentType == "application/x-ndjson" || contentType == "application/ndjson"))
+			{
+				controlPublishNdjson(req, responseContentType);
+			}
+			else if(req->requestMethod() == "POST")
 			{
 				QJsonParseError e;
 				QJsonDocument doc = QJsonDocument::fromJson(req->requestBody(), &e);
@@ -3045,8 +5714,33 @@ private:
 					httpControlRespond(req, 200, "OK", message + "\n", responseContentType, HttpHeaders(), items.count());
 				}
 
-				foreach(const PublishItem &item, items)
-					handlePublishItem(item);
+				if(relaying())
+				{
+					for(int n = 0; n < items.count(); ++n)
+					{
+						QJsonDocument doc(QJsonObject::fromVariantMap(vitems[n].toMap()));
+						relayItem(items[n], 'J' + doc.toJson(QJsonDocument::Compact));
+					}
+				}
+
+				handlePublishItems(items);
+			}
+			else
+			{
+				HttpHeaders headers;
+				headers += HttpHeader("Allow", "POST");
+				httpControlRespond(req, 405, "Method Not Allowed", "Method not allowed: " + req->requestMethod() + ".\n", QByteArray(), headers);
+			}
+		}
+		else if(path == "/publish/stream")
+		{
+			if(req->isStreaming())
+			{
+				controlPublishStream(req);
+			}
+			else if(req->requestMethod() == "POST")
+			{
+				httpControlRespond(req, 400, "Bad Request", "Streaming publish requires a chunked request body.\n");
 			}
 			else
 			{
@@ -3072,7 +5766,7 @@ private:
 					httpControlRespond(req, 200, "OK", message + "\n", responseContentType, HttpHeaders());
 				}
 
-				recoverCommand();
+				controlRecover();
 			}
 			else
 			{
@@ -3087,38 +5781,168 @@ private:
 		}
 	}
 
+	// one item per line. items are decoded and published in small batches
+	//   as the body is read, rather than building the whole list first. on
+	//   error, the items before the bad line stay published
+	void controlPublishNdjson(SimpleHttpRequest *req, const QByteArray &responseContentType)
+	{
+		QByteArray body = req->requestBody();
+
+		QList<PublishItem> batch;
+		int count = 0;
+		int lineNum = 0;
+		QString errorMessage;
+
+		int at = 0;
+		while(at < body.size())
+		{
+			int end = body.indexOf('\n', at);
+			if(end == -1)
+				end = body.size();
+
+			QByteArray line = body.mid(at, end - at).trimmed();
+			at = end + 1;
+			++lineNum;
+
+			if(line.isEmpty())
+				continue;
+
+			QJsonParseError e;
+			QJsonDocument doc = QJsonDocument::fromJson(line, &e);
+			if(e.error != QJsonParseError::NoError || !doc.isObject())
+			{
+				errorMessage = QString("line %1 is not a JSON object").arg(lineNum);
+				break;
+			}
+
+			bool ok;
+			PublishItem item = PublishItem::fromVariant(doc.object().toVariantMap(), QString(), &ok, &errorMessage);
+			if(!ok)
+			{
+				errorMessage = QString("line %1: %2").arg(QString::number(lineNum), errorMessage);
+				break;
+			}
+
+			relayItem(item, 'J' + line);
+
+			batch += item;
+			++count;
+
+			if(batch.count() >= NDJSON_PUBLISH_BATCH_MAX)
+			{
+				handlePublishItems(batch);
+				batch.clear();
+			}
+		}
+
+		if(!batch.isEmpty())
+			handlePublishItems(batch);
+
+		if(!errorMessage.isEmpty())
+		{
+			httpControlRespond(req, 400, "Bad Request", QString("Invalid format: %1 (%2 items published)\n").arg(errorMessage, QString::number(count)), QByteArray(), HttpHeaders(), count);
+			return;
+		}
+
+		QString message = "Published";
+		if(responseContentType == "application/json")
+		{
+			QVariantMap obj;
+			obj["message"] = message;
+			QString out = QJsonDocument(QJsonObject::fromVariantMap(obj)).toJson(QJsonDocument::Compact);
+			httpControlRespond(req, 200, "OK", out + "\n", responseContentType, HttpHeaders(), count);
+		}
+		else // text/plain
+		{
+			httpControlRespond(req, 200, "OK", message + "\n", responseContentType, HttpHeaders(), count);
+		}
+	}
+
+	void controlPublishStream(SimpleHttpRequest *req)
+	{
+		log_debug("control: %s %s stream", qPrintable(req->requestMethod()), req->requestUri().data());
+
+		PublishStream *ps = new PublishStream(req, PUBLISH_STREAM_WINDOW, config.pushInHttpMaxBodySize);
+		ps->itemsReady.connect(boost::bind(&Private::publishStream_itemsReady, this, boost::placeholders::_1, boost::placeholders::_2));
+		ps->finished.connect(boost::bind(&Private::publishStream_finished, this, ps));
+		publishStreams += ps;
+
+		ps->start();
+		ps->setPaused(publishBacklogged());
+	}
+
+	bool publishBacklogged() const
+	{
+		return ((int)publishJobs.size() >= PUBLISH_STREAM_BACKLOG_MAX);
+	}
+
+	// streaming publishers are held back while fan-out is behind
+	void updatePublishStreams()
+	{
+		bool paused = publishBacklogged();
+
+		foreach(PublishStream *ps, publishStreams)
+			ps->setPaused(paused);
+	}
+
+	void publishStream_itemsReady(const QList<PublishItem> &items, const QList<QByteArray> &lines)
+	{
+		for(int n = 0; n < items.count(); ++n)
+			relayItem(items[n], 'J' + lines[n]);
+
+		handlePublishItems(items);
+
+		updatePublishStreams();
+	}
+
+	void publishStream_finished(PublishStream *ps)
+	{
+		publishStreams.remove(ps);
+
+		// called from a signal of the stream
+		DeferCall::deleteLater(ps);
+	}
+
 	void hs_subscribe(HttpSession *hs, const QString &channel)
 	{
 		Instruct::HoldMode mode = hs->holdMode();
 		assert(mode == Instruct::ResponseHold || mode == Instruct::StreamHold);
 
-		QHash<QString, QSet<HttpSession*> > *sessionsByChannel;
+		bool prefix = hs->isPrefixChannel(channel);
 		QString modeStr;
 
 		if(mode == Instruct::ResponseHold)
 		{
-			log_debug("adding response hold on %s", qPrintable(channel));
+			log_debug("adding response hold on %s%s", qPrintable(channel), prefix ? " (prefix)" : "");
 
-			sessionsByChannel = &cs.responseSessionsByChannel;
 			modeStr = "response";
 		}
 		else // StreamHold
 		{
-			log_debug("adding stream hold on %s", qPrintable(channel));
+			log_debug("adding stream hold on %s%s", qPrintable(channel), prefix ? " (prefix)" : "");
 
-			sessionsByChannel = &cs.streamSessionsByChannel;
 			modeStr = "stream";
 		}
 
-		if(!sessionsByChannel->contains(channel))
-			sessionsByChannel->insert(channel, QSet<HttpSession*>());
+		int count = sessionIndex(mode, prefix)->add(channel, hs);
 
-		(*sessionsByChannel)[channel] += hs;
+		if(prefix)
+		{
+			if(count == 1)
+				cs.channelPrefixes.add(channel);
 
-		stats->addSubscription(modeStr, channel, sessionsByChannel->value(channel).count());
-		addSub(channel);
+			stats->addSubscription(modeStr, prefixStatsChannel(channel), count);
+			addPrefixSub(channel);
+		}
+		else
+		{
+			stats->addSubscription(modeStr, channel, count);
+			addSub(channel);
+		}
 
 		QString msg = QString("subscribe %1 channel=%2").arg(hs->requestUri().toString(QUrl::FullyEncoded), channel);
+		if(prefix)
+			msg += " prefix";
 		if(hs->isRetry())
 			msg += " retry";
 
@@ -3170,6 +5994,19 @@ private:
 	}
 };
 
+QByteArray HandlerEngine::hashedTopic(const QByteArray &channel)
+{
+	quint32 h = 0x811c9dc5;
+
+	for(int n = 0; n < channel.size(); ++n)
+	{
+		h ^= (quint8)channel[n];
+		h *= 0x01000193;
+	}
+
+	return QByteArray::number(h, 16).rightJustified(8, '0');
+}
+
 HandlerEngine::HandlerEngine()
 {
 	d = std::make_shared<Private>(this);
@@ -3182,7 +6019,22 @@ bool HandlerEngine::start(const Configuration &config)
 	return d->start(config);
 }
 
-void HandlerEngine::reload()
+void HandlerEngine::reload(const Configuration &config)
+{
+	d->reload(config);
+}
+
+void HandlerEngine::recover()
+{
+	d->recover();
+}
+
+void HandlerEngine::drain()
+{
+	d->drain();
+}
+
+bool HandlerEngine::isDrained() const
 {
-	d->reload();
+	return d->isDrained();
 }
@@ -27,6 +27,7 @@
 #include <QStringList>
 #include <QHostAddress>
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 #include <map>
 
 #define TIMERS_PER_SUBSCRIPTION 1
@@ -36,7 +37,6 @@
 
 using std::map;
 using Signal = boost::signals2::signal<void()>;
-using Connection = boost::signals2::scoped_connection;
 
 class HandlerEngine
 {
@@ -64,6 +64,14 @@ public:
 		QString pushInSpec;
 		QStringList pushInSubSpecs;
 		bool pushInSubConnect;
+		bool pushInSubHashedTopics;
+		QString shardPublishSpec;
+		QString shardStateSpec;
+		QString subscriptionSpec;
+		QString relaySpec;
+		QString stateFile;
+		QString captureFile;
+		int shardIndex;
 		QHostAddress pushInHttpAddr;
 		int pushInHttpPort;
 		int pushInHttpMaxHeadersSize;
@@ -74,8 +82,23 @@ public:
 		int messageHwm;
 		int messageBlockSize;
 		int messageWait;
+		bool messageWaitAdaptive;
+		QHash<QString, int> conflateRates; // k=channel prefix, v=max items per second
+		int fanoutChunkSize;
+		int fanoutChunkTime;
 		int idCacheTtl;
+		QString idCacheMode;
+		int idCacheMemoryMax;
+		int messageHistoryDepth;
+		int messageHistoryMemoryMax;
+		int drainRate;
+		int drainTimeout;
+		int recoverRate;
+		QString slowConsumerAction;
+		int slowConsumerQueueBytes;
+		int slowConsumerQueueAge;
 		bool updateOnFirstSubscription;
+		bool nextLinkPrefetch;
 		int connectionsMax;
 		int connectionSubscriptionMax;
 		int subscriptionLinger;
@@ -83,12 +106,20 @@ public:
 		int statsConnectionTtl;
 		int statsSubscriptionTtl;
 		int statsReportInterval;
+		QString statsRefreshMode;
 		QString statsFormat;
+		QString statsMessageMode;
+		int statsMessageInterval;
+		int statsTopChannels;
 		QString prometheusPort;
 		QString prometheusPrefix;
+		QString publishLogMode;
+		int publishLogSampleRate;
 
 		Configuration() :
 			pushInSubConnect(false),
+			pushInSubHashedTopics(false),
+			shardIndex(0),
 			pushInHttpPort(-1),
 			pushInHttpMaxHeadersSize(-1),
 			pushInHttpMaxBodySize(-1),
@@ -98,15 +129,30 @@ public:
 			messageHwm(-1),
 			messageBlockSize(-1),
 			messageWait(-1),
+			messageWaitAdaptive(false),
+			fanoutChunkSize(-1),
+			fanoutChunkTime(-1),
 			idCacheTtl(-1),
+			idCacheMemoryMax(-1),
+			messageHistoryDepth(-1),
+			messageHistoryMemoryMax(-1),
+			drainRate(-1),
+			drainTimeout(-1),
+			recoverRate(-1),
+			slowConsumerQueueBytes(-1),
+			slowConsumerQueueAge(-1),
 			updateOnFirstSubscription(false),
+			nextLinkPrefetch(false),
 			connectionsMax(-1),
 			connectionSubscriptionMax(-1),
 			subscriptionLinger(-1),
 			statsConnectionSend(false),
 			statsConnectionTtl(-1),
 			statsSubscriptionTtl(-1),
-			statsReportInterval(-1)
+			statsReportInterval(-1),
+			statsMessageInterval(-1),
+			statsTopChannels(0),
+			publishLogSampleRate(-1)
 		{
 		}
 	};
@@ -115,7 +161,30 @@ public:
 	~HandlerEngine();
 
 	bool start(const Configuration &config);
-	void reload();
+
+	// applies the settings that can be changed without a restart, such as
+	// rates and stats intervals. other fields of config are ignored
+	void reload(const Configuration &config);
+
+	void recover();
+
+	// closes held http sessions and ws sessions gradually, at the
+	// configured drain rate. drained is emitted once none are left, or
+	// when the drain timeout is reached
+	void drain();
+	bool isDrained() const;
+
+	// emitted when a recover command is received, so that other engines
+	// sharing the workload can be told to recover as well
+	Signal recoverRequested;
+
+	Signal drained;
+
+	// the topic a channel is subscribed to on the SUB socket when hashed
+	// topics are enabled: the 32-bit FNV-1a hash of the channel, as 8
+	// lowercase hex digits. publishers send it as the first part of each
+	// message, followed by the channel and the content
+	static QByteArray hashedTopic(const QByteArray &channel);
 
 private:
 	class Private;
@@ -57,6 +57,8 @@ public:
 	std::unique_ptr<QZmq::Socket> proxyAcceptSock;
 	std::unique_ptr<QZmq::Valve> proxyAcceptValve;
 	std::unique_ptr<QZmq::Socket> publishPushSock;
+	std::unique_ptr<QZmq::Socket> subscriptionSock;
+	std::unique_ptr<QZmq::Valve> subscriptionValve;
 
 	QDir workDir;
 	bool acceptSuccess;
@@ -67,10 +69,12 @@ public:
 	bool serverFailed;
 	int serverOutSeq;
 	QByteArray requestBody;
+	QList<QByteArray> subscriptionEvents;
 	Connection zhttpClientInValveConnection;
 	Connection zhttpServerInValveConnection;
 	Connection zhttpServerInStreamValveConnection;
 	Connection proxyAcceptValveConnection;
+	Connection subscriptionValveConnection;
 
 	Wrapper(QDir _workDir) :
 		workDir(_workDir),
@@ -108,6 +112,10 @@ public:
 		// publish sockets
 
 		publishPushSock = std::make_unique<QZmq::Socket>(QZmq::Socket::Push);
+
+		subscriptionSock = std::make_unique<QZmq::Socket>(QZmq::Socket::Sub);
+		subscriptionValve = std::make_unique<QZmq::Valve>(subscriptionSock.get());
+		subscriptionValveConnection = subscriptionValve->readyRead.connect(boost::bind(&Wrapper::subscription_readyRead, this, boost::placeholders::_1));
 	}
 
 	void startHttp()
@@ -135,6 +143,10 @@ public:
 	void startPublish()
 	{
 		publishPushSock->connectToAddress("ipc://" + workDir.filePath("publish-pull"));
+
+		subscriptionSock->connectToAddress("ipc://" + workDir.filePath("subscription"));
+		subscriptionSock->subscribe(QByteArray());
+		subscriptionValve->open();
 	}
 
 	void reset()
@@ -147,6 +159,7 @@ public:
 		serverFailed = false;
 		serverOutSeq = 0;
 		requestBody.clear();
+		subscriptionEvents.clear();
 	}
 
 	void zhttpClientIn_readyRead(const QList<QByteArray> &message)
@@ -159,17 +172,21 @@ public:
 		zresp.fromVariant(v);
 		if(zresp.type == ZhttpResponsePacket::Data)
 		{
-			if(!responses.contains(zresp.ids.first().id))
+			// data may be addressed to several requests at once
+			foreach(const ZhttpResponsePacket::Id &id, zresp.ids)
 			{
-				HttpResponseData rd;
-				rd.code = zresp.code;
-				rd.reason = zresp.reason;
-				rd.headers = zresp.headers;
-				responses[zresp.ids.first().id] = rd;
+				if(!responses.contains(id.id))
+				{
+					HttpResponseData rd;
+					rd.code = zresp.code;
+					rd.reason = zresp.reason;
+					rd.headers = zresp.headers;
+					responses[id.id] = rd;
+				}
+
+				responses[id.id].body += zresp.body;
 			}
 
-			responses[zresp.ids.first().id].body += zresp.body;
-
 			if(!zresp.more)
 				finished = true;
 		}
@@ -244,6 +261,11 @@ public:
 		serverOutSeq = 0;
 	}
 
+	void subscription_readyRead(const QList<QByteArray> &message)
+	{
+		subscriptionEvents += message[0];
+	}
+
 	void proxyAccept_readyRead(const QList<QByteArray> &_message)
 	{
 		QZmq::ReqMessage message(_message);
@@ -291,6 +313,7 @@ public:
 		config.clientInSpecs = QStringList() << ("ipc://" + workDir.filePath("server-out"));
 		config.acceptSpecs = QStringList() << ("ipc://" + workDir.filePath("accept"));
 		config.pushInSpec = ("ipc://" + workDir.filePath("publish-pull"));
+		config.subscriptionSpec = ("ipc://" + workDir.filePath("subscription"));
 		config.connectionSubscriptionMax = 20;
 		config.connectionsMax = 20;
 		TEST_ASSERT(engine->start(config));
@@ -405,6 +428,128 @@ static void acceptNoHold(Wrapper *wrapper, std::function<void (int)> loop_wait)
 	TEST_ASSERT_EQ(wrapper->acceptValue["response"].toHash()["body"].toByteArray(), QByteArray("hello world\n"));
 }
 
+static void acceptBatchNoHold(Wrapper *wrapper, std::function<void (int)> loop_wait)
+{
+	wrapper->reset();
+
+	QVariantList items;
+
+	for(int n = 0; n < 2; ++n)
+	{
+		QVariantHash rid;
+		rid["sender"] = QByteArray("test-client");
+		rid["id"] = QByteArray::number(n + 1);
+
+		QVariantHash reqState;
+		reqState["rid"] = rid;
+		reqState["in-seq"] = 1;
+		reqState["out-seq"] = 1;
+		reqState["out-credits"] = 1000;
+
+		QVariantHash req;
+		req["method"] = QByteArray("GET");
+		req["uri"] = QByteArray("http://example.com/path");
+		req["headers"] = QVariantList();
+		req["body"] = QByteArray();
+
+		QVariantHash resp;
+		resp["code"] = 200;
+		resp["reason"] = QByteArray("OK");
+		resp["headers"] = QVariantList();
+		resp["body"] = QByteArray("hello " + QByteArray::number(n + 1) + "\n");
+
+		QVariantHash args;
+		args["requests"] = QVariantList() << reqState;
+		args["request-data"] = req;
+		args["orig-request-data"] = req;
+		args["response"] = resp;
+
+		items += args;
+	}
+
+	QVariantHash args;
+	args["items"] = items;
+
+	QVariantHash data;
+	data["id"] = QByteArray("1");
+	data["method"] = QByteArray("accept-batch");
+	data["args"] = args;
+
+	QByteArray buf = TnetString::fromVariant(data);
+	wrapper->proxyAcceptSock->write(QList<QByteArray>() << QByteArray() << buf);
+	while(!wrapper->acceptSuccess)
+		loop_wait(10);
+
+	// one result per item, in order
+	QVariantList results = wrapper->acceptValue["results"].toList();
+	TEST_ASSERT_EQ(results.count(), 2);
+
+	for(int n = 0; n < 2; ++n)
+	{
+		QVariantHash i = results[n].toHash();
+		TEST_ASSERT(i["success"].toBool());
+
+		QVariantHash value = i["value"].toHash();
+		TEST_ASSERT(!value.value("accepted").toBool());
+		TEST_ASSERT_EQ(value["response"].toHash()["body"].toByteArray(), QByteArray("hello " + QByteArray::number(n + 1) + "\n"));
+	}
+}
+
+static void acceptNoHoldCompact(Wrapper *wrapper, std::function<void (int)> loop_wait)
+{
+	wrapper->reset();
+
+	QByteArray id = "1";
+
+	QVariantHash rid;
+	rid["sender"] = QByteArray("test-client");
+	rid["id"] = id;
+
+	QVariantHash reqState;
+	reqState["rid"] = rid;
+	reqState["in-seq"] = 1;
+	reqState["out-seq"] = 1;
+	reqState["out-credits"] = 1000;
+
+	QVariantHash origReq;
+	origReq["method"] = QByteArray("POST");
+	origReq["uri"] = QByteArray("http://example.com/path");
+	QVariantList reqHeaders;
+	reqHeaders += QVariant(QVariantList() << QByteArray("Content-Type") << QByteArray("text/plain"));
+	origReq["headers"] = reqHeaders;
+	origReq["body"] = QByteArray("hello\n");
+
+	// headers and body left out, to be taken from orig-request-data
+	QVariantHash req;
+	req["method"] = QByteArray("POST");
+	req["uri"] = QByteArray("http://example.com/path");
+
+	QVariantHash resp;
+	resp["code"] = 200;
+	resp["reason"] = QByteArray("OK");
+	resp["headers"] = QVariantList();
+	resp["body"] = QByteArray("hello world\n");
+
+	QVariantHash args;
+	args["requests"] = QVariantList() << reqState;
+	args["request-data"] = req;
+	args["orig-request-data"] = origReq;
+	args["response"] = resp;
+
+	QVariantHash data;
+	data["id"] = id;
+	data["method"] = QByteArray("accept");
+	data["args"] = args;
+
+	QByteArray buf = TnetString::fromVariant(data);
+	wrapper->proxyAcceptSock->write(QList<QByteArray>() << QByteArray() << buf);
+	while(!wrapper->acceptSuccess)
+		loop_wait(10);
+
+	TEST_ASSERT(!wrapper->acceptValue.value("accepted").toBool());
+	TEST_ASSERT_EQ(wrapper->acceptValue["response"].toHash()["body"].toByteArray(), QByteArray("hello world\n"));
+}
+
 static void acceptNoHoldResponseSent(Wrapper *wrapper, std::function<void (int)> loop_wait)
 {
 	wrapper->reset();
@@ -622,6 +767,11 @@ static void publishResponse(Wrapper *wrapper, std::function<void (int)> loop_wai
 	while(!wrapper->acceptSuccess)
 		loop_wait(10);
 
+	// the new channel is announced to the subscription directory
+	QByteArray subEvent = QByteArray(1, 1) + "apple";
+	while(!wrapper->subscriptionEvents.contains(subEvent))
+		loop_wait(10);
+
 	data.clear();
 
 	QVariantHash hr;
@@ -730,6 +880,213 @@ static void publishStream(Wrapper *wrapper, std::function<void (int)> loop_wait)
 	TEST_ASSERT_EQ(wrapper->responses.value(id).body, QByteArray("stream open\nhello world\n"));
 }
 
+static void publishStreamPrefix(Wrapper *wrapper, std::function<void (int)> loop_wait)
+{
+	wrapper->reset();
+
+	QByteArray id = "9";
+
+	QVariantHash rid;
+	rid["sender"] = QByteArray("test-client");
+	rid["id"] = id;
+
+	QVariantHash reqState;
+	reqState["rid"] = rid;
+	reqState["in-seq"] = 1;
+	reqState["out-seq"] = 1;
+	reqState["out-credits"] = 1000;
+
+	QVariantHash req;
+	req["method"] = QByteArray("GET");
+	req["uri"] = QByteArray("http://example.com/path");
+	QVariantList reqHeaders;
+	req["headers"] = reqHeaders;
+	req["body"] = QByteArray();
+
+	QVariantHash resp;
+	resp["code"] = 200;
+	resp["reason"] = QByteArray("OK");
+	QVariantList respHeaders;
+	respHeaders += QVariant(QVariantList() << QByteArray("Content-Type") << QByteArray("text/plain"));
+	respHeaders += QVariant(QVariantList() << QByteArray("Grip-Hold") << QByteArray("stream"));
+	respHeaders += QVariant(QVariantList() << QByteArray("Grip-Channel") << QByteArray("fruit.; prefix"));
+	resp["headers"] = respHeaders;
+	resp["body"] = QByteArray("stream open\n");
+
+	QVariantHash args;
+	args["requests"] = QVariantList() << reqState;
+	args["request-data"] = req;
+	args["orig-request-data"] = req;
+	args["response"] = resp;
+
+	QVariantHash data;
+	data["id"] = id;
+	data["method"] = QByteArray("accept");
+	data["args"] = args;
+
+	QByteArray buf = TnetString::fromVariant(data);
+	wrapper->proxyAcceptSock->write(QList<QByteArray>() << QByteArray() << buf);
+	while(!wrapper->acceptSuccess)
+		loop_wait(10);
+
+	// not matched by the prefix
+	data.clear();
+
+	{
+		QVariantHash hs;
+		hs["content"] = QByteArray("hello carrot\n");
+
+		QVariantHash formats;
+		formats["http-stream"] = hs;
+
+		data["channel"] = QByteArray("vegetable.carrot");
+		data["formats"] = formats;
+	}
+
+	buf = TnetString::fromVariant(data);
+	wrapper->publishPushSock->write(QList<QByteArray>() << buf);
+
+	data.clear();
+
+	{
+		QVariantHash hs;
+		hs["content"] = QByteArray("hello apple\n");
+
+		QVariantHash formats;
+		formats["http-stream"] = hs;
+
+		data["channel"] = QByteArray("fruit.apple");
+		data["formats"] = formats;
+	}
+
+	buf = TnetString::fromVariant(data);
+	wrapper->publishPushSock->write(QList<QByteArray>() << buf);
+
+	data.clear();
+
+	{
+		QVariantHash hs;
+		hs["action"] = QByteArray("close");
+
+		QVariantHash formats;
+		formats["http-stream"] = hs;
+
+		data["channel"] = QByteArray("fruit.banana");
+		data["formats"] = formats;
+	}
+
+	buf = TnetString::fromVariant(data);
+	wrapper->publishPushSock->write(QList<QByteArray>() << buf);
+
+	while(!wrapper->finished)
+		loop_wait(10);
+
+	TEST_ASSERT(wrapper->responses.contains(id));
+	TEST_ASSERT_EQ(wrapper->responses.value(id).body, QByteArray("stream open\nhello apple\n"));
+}
+
+static void publishStreamDelta(Wrapper *wrapper, std::function<void (int)> loop_wait)
+{
+	wrapper->reset();
+
+	QByteArray id = "10";
+
+	QVariantHash rid;
+	rid["sender"] = QByteArray("test-client");
+	rid["id"] = id;
+
+	QVariantHash reqState;
+	reqState["rid"] = rid;
+	reqState["in-seq"] = 1;
+	reqState["out-seq"] = 1;
+	reqState["out-credits"] = 1000;
+
+	QVariantHash req;
+	req["method"] = QByteArray("GET");
+	req["uri"] = QByteArray("http://example.com/path");
+	QVariantList reqHeaders;
+	req["headers"] = reqHeaders;
+	req["body"] = QByteArray();
+
+	QVariantHash resp;
+	resp["code"] = 200;
+	resp["reason"] = QByteArray("OK");
+	QVariantList respHeaders;
+	respHeaders += QVariant(QVariantList() << QByteArray("Content-Type") << QByteArray("text/plain"));
+	respHeaders += QVariant(QVariantList() << QByteArray("Grip-Hold") << QByteArray("stream"));
+	respHeaders += QVariant(QVariantList() << QByteArray("Grip-Channel") << QByteArray("state; delta"));
+	resp["headers"] = respHeaders;
+	resp["body"] = QByteArray("stream open\n");
+
+	QVariantHash args;
+	args["requests"] = QVariantList() << reqState;
+	args["request-data"] = req;
+	args["orig-request-data"] = req;
+	args["response"] = resp;
+
+	QVariantHash data;
+	data["id"] = id;
+	data["method"] = QByteArray("accept");
+	data["args"] = args;
+
+	QByteArray buf = TnetString::fromVariant(data);
+	wrapper->proxyAcceptSock->write(QList<QByteArray>() << QByteArray() << buf);
+	while(!wrapper->acceptSuccess)
+		loop_wait(10);
+
+	// large enough for a patch to be smaller than the document
+	QByteArray text(100, 'x');
+
+	QList<QByteArray> docs;
+	docs += "{\"a\":\"" + text + "\",\"b\":2}";
+	docs += "{\"a\":\"" + text + "\",\"b\":3}";
+
+	foreach(const QByteArray &doc, docs)
+	{
+		data.clear();
+
+		QVariantHash hs;
+		hs["content"] = doc;
+
+		QVariantHash formats;
+		formats["http-stream"] = hs;
+
+		data["channel"] = QByteArray("state");
+		data["formats"] = formats;
+		data["delta"] = true;
+
+		buf = TnetString::fromVariant(data);
+		wrapper->publishPushSock->write(QList<QByteArray>() << buf);
+	}
+
+	data.clear();
+
+	{
+		QVariantHash hs;
+		hs["action"] = QByteArray("close");
+
+		QVariantHash formats;
+		formats["http-stream"] = hs;
+
+		data["channel"] = QByteArray("state");
+		data["formats"] = formats;
+	}
+
+	buf = TnetString::fromVariant(data);
+	wrapper->publishPushSock->write(QList<QByteArray>() << buf);
+
+	while(!wrapper->finished)
+		loop_wait(10);
+
+	// a snapshot for the new subscriber, then a patch
+	QByteArray expected = "stream open\n";
+	expected += "{\"snapshot\":{\"a\":\"" + text + "\",\"b\":2},\"version\":1}\n";
+	expected += "{\"base\":1,\"patch\":[{\"op\":\"replace\",\"path\":\"/b\",\"value\":3}],\"version\":2}\n";
+
+	TEST_ASSERT(wrapper->responses.contains(id));
+	TEST_ASSERT_EQ(wrapper->responses.value(id).body, expected);
+}
+
 static void publishStreamReorder(Wrapper *wrapper, std::function<void (int)> loop_wait)
 {
 	wrapper->reset();
@@ -875,15 +1232,122 @@ static void publishStreamReorder(Wrapper *wrapper, std::function<void (int)> loo
 	TEST_ASSERT_EQ(wrapper->responses.value(id).body, QByteArray("stream open\none\ntwo\nthree\nfour\n"));
 }
 
+static void publishStreamBatch(Wrapper *wrapper, std::function<void (int)> loop_wait)
+{
+	wrapper->reset();
+
+	QByteArray id = "8";
+
+	QVariantHash rid;
+	rid["sender"] = QByteArray("test-client");
+	rid["id"] = id;
+
+	QVariantHash reqState;
+	reqState["rid"] = rid;
+	reqState["in-seq"] = 1;
+	reqState["out-seq"] = 1;
+	reqState["out-credits"] = 1000;
+
+	QVariantHash req;
+	req["method"] = QByteArray("GET");
+	req["uri"] = QByteArray("http://example.com/path");
+	QVariantList reqHeaders;
+	req["headers"] = reqHeaders;
+	req["body"] = QByteArray();
+
+	QVariantHash resp;
+	resp["code"] = 200;
+	resp["reason"] = QByteArray("OK");
+	QVariantList respHeaders;
+	respHeaders += QVariant(QVariantList() << QByteArray("Content-Type") << QByteArray("text/plain"));
+	respHeaders += QVariant(QVariantList() << QByteArray("Grip-Hold") << QByteArray("stream"));
+	respHeaders += QVariant(QVariantList() << QByteArray("Grip-Channel") << QByteArray("apple"));
+	resp["headers"] = respHeaders;
+	resp["body"] = QByteArray("stream open\n");
+
+	QVariantHash args;
+	args["requests"] = QVariantList() << reqState;
+	args["request-data"] = req;
+	args["orig-request-data"] = req;
+	args["response"] = resp;
+
+	QVariantHash data;
+	data["id"] = id;
+	data["method"] = QByteArray("accept");
+	data["args"] = args;
+
+	QByteArray buf = TnetString::fromVariant(data);
+	wrapper->proxyAcceptSock->write(QList<QByteArray>() << QByteArray() << buf);
+	while(!wrapper->acceptSuccess)
+		loop_wait(10);
+
+	// several items in one message, delivered in order
+	QVariantList items;
+
+	const char *contents[] = { "one\n", "two\n", "three\n" };
+	for(const char *content : contents)
+	{
+		QVariantHash hs;
+		hs["content"] = QByteArray(content);
+
+		QVariantHash formats;
+		formats["http-stream"] = hs;
+
+		QVariantHash item;
+		item["channel"] = QByteArray("apple");
+		item["formats"] = formats;
+		items += item;
+	}
+
+	{
+		QVariantHash hs;
+		hs["action"] = QByteArray("close");
+
+		QVariantHash formats;
+		formats["http-stream"] = hs;
+
+		QVariantHash item;
+		item["channel"] = QByteArray("apple");
+		item["formats"] = formats;
+		items += item;
+	}
+
+	data.clear();
+	data["items"] = items;
+
+	buf = TnetString::fromVariant(data);
+	wrapper->publishPushSock->write(QList<QByteArray>() << buf);
+
+	while(!wrapper->finished)
+		loop_wait(10);
+
+	TEST_ASSERT(wrapper->responses.contains(id));
+	TEST_ASSERT_EQ(wrapper->responses.value(id).body, QByteArray("stream open\none\ntwo\nthree\n"));
+}
+
+static void hashedTopic()
+{
+	// FNV-1a test vectors, same as pushpin-publish
+	TEST_ASSERT_EQ(HandlerEngine::hashedTopic(""), QByteArray("811c9dc5"));
+	TEST_ASSERT_EQ(HandlerEngine::hashedTopic("a"), QByteArray("e40c292c"));
+	TEST_ASSERT_EQ(HandlerEngine::hashedTopic("foobar"), QByteArray("bf9cf968"));
+}
+
 extern "C" int handlerengine_test(ffi::TestException *out_ex)
 {
+	TEST_CATCH(hashedTopic());
 	TEST_CATCH(runWithEventLoops(acceptNoHold));
+	TEST_CATCH(runWithEventLoops(acceptNoHoldCompact));
+	TEST_CATCH(runWithEventLoops(acceptBatchNoHold));
 	TEST_CATCH(runWithEventLoops(acceptNoHoldResponseSent));
 	TEST_CATCH(runWithEventLoops(acceptNoHoldNext));
 	TEST_CATCH(runWithEventLoops(acceptNoHoldNextResponseSent));
 	TEST_CATCH(runWithEventLoops(publishResponse));
 	TEST_CATCH(runWithEventLoops(publishStream));
 	TEST_CATCH(runWithEventLoops(publishStreamReorder));
+	TEST_CATCH(runWithEventLoops(publishStreamPrefix));
+	TEST_CATCH(runWithEventLoops(publishStreamDelta));
+	TEST_CATCH(runWithEventLoops(publishStreamBatch));
 
 	return 0;
 }
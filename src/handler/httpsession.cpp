@@ -37,16 +37,21 @@
 #include "zhttpmanager.h"
 #include "zhttprequest.h"
 #include "cors.h"
+#include "gzip.h"
 #include "jsonpatch.h"
+#include "publishlatency.h"
 #include "statsmanager.h"
 #include "logutil.h"
 #include "variantutil.h"
 #include "publishitem.h"
 #include "publishformat.h"
 #include "ratelimiter.h"
+#include "memorybudget.h"
+#include "objectstats.h"
 #include "publishlastids.h"
 #include "httpsessionupdatemanager.h"
 #include "filterstack.h"
+#include "slowconsumer.h"
 
 #define RETRY_TIMEOUT 1000
 #define RETRY_MAX 5
@@ -54,51 +59,255 @@
 #define KEEPALIVE_RAND_MAX 1000
 #define UPDATES_PER_ACTION_MAX 100
 #define PUBLISH_QUEUE_MAX 100
+#define BODY_PATCH_CACHE_MAX 4
+#define JSONP_CACHE_MAX 4
 
-static QByteArray applyBodyPatch(const QByteArray &in, const QVariantList &bodyPatch)
+// subscribers to the same hold usually share the original response body,
+// so bodies are parsed once and kept, and the result of applying a
+// publish's patch is serialized once and reused for each subscriber
+class BodyPatchCache
 {
-	QByteArray body;
+public:
+	class Entry
+	{
+	public:
+		QByteArray in;
+		QVariant parsed; // invalid if not a JSON object or array
+		bool havePatched;
+		QVariantList patch;
+		QByteArray out;
+	};
 
+	QList<Entry> entries; // most recently used first
+};
+
+static thread_local BodyPatchCache bodyPatchCache;
+
+static QVariant parseBody(const QByteArray &in)
+{
 	QJsonParseError e;
 	QJsonDocument doc = QJsonDocument::fromJson(in, &e);
-	if(e.error == QJsonParseError::NoError && (doc.isObject() || doc.isArray()))
+	if(e.error != QJsonParseError::NoError || (!doc.isObject() && !doc.isArray()))
+		return QVariant();
+
+	if(doc.isObject())
+		return doc.object().toVariantMap();
+	else // isArray
+		return doc.array().toVariantList();
+}
+
+static QByteArray patchBody(const QByteArray &in, const QVariant &parsed, const QVariantList &bodyPatch)
+{
+	QByteArray body;
+
+	// shares the parsed form, and only the patched paths are copied
+	QVariant vbody = parsed;
+
+	QString errorMessage;
+	if(!JsonPatch::patchInPlace(&vbody, bodyPatch, &errorMessage))
+		vbody = QVariant();
+	if(vbody.isValid())
+		vbody = VariantUtil::convertToJsonStyle(vbody);
+	if(vbody.isValid() && (typeId(vbody) == QMetaType::QVariantMap || typeId(vbody) == QMetaType::QVariantList))
+	{
+		QJsonDocument doc;
+		if(typeId(vbody) == QMetaType::QVariantMap)
+			doc = QJsonDocument(QJsonObject::fromVariantMap(vbody.toMap()));
+		else // List
+			doc = QJsonDocument(QJsonArray::fromVariantList(vbody.toList()));
+
+		body = doc.toJson(QJsonDocument::Compact);
+
+		if(in.endsWith("\r\n"))
+			body += "\r\n";
+		else if(in.endsWith("\n"))
+			body += '\n';
+	}
+	else
+	{
+		log_debug("httpsession: failed to apply JSON patch: %s", qPrintable(errorMessage));
+	}
+
+	return body;
+}
+
+static QByteArray applyBodyPatch(const QByteArray &in, const QVariantList &bodyPatch)
+{
+	QList<BodyPatchCache::Entry> &entries = bodyPatchCache.entries;
+
+	int at = -1;
+	for(int n = 0; n < entries.count(); ++n)
+	{
+		if(entries[n].in == in)
+		{
+			at = n;
+			break;
+		}
+	}
+
+	if(at < 0)
+	{
+		BodyPatchCache::Entry e;
+		e.in = in;
+		e.parsed = parseBody(in);
+		e.havePatched = false;
+
+		if(entries.count() >= BODY_PATCH_CACHE_MAX)
+			entries.removeLast();
+
+		entries.prepend(e);
+	}
+	else if(at > 0)
+	{
+		entries.move(at, 0);
+	}
+
+	BodyPatchCache::Entry &e = entries.first();
+
+	if(!e.parsed.isValid())
 	{
-		QVariant vbody;
-		if(doc.isObject())
-			vbody = doc.object().toVariantMap();
-		else // isArray
-			vbody = doc.array().toVariantList();
+		log_debug("httpsession: failed to parse original response body as JSON");
+		return QByteArray();
+	}
+
+	// compares cheaply when the patch comes from the same publish
+	if(!e.havePatched || e.patch != bodyPatch)
+	{
+		e.out = patchBody(in, e.parsed, bodyPatch);
+		e.patch = bodyPatch;
+		e.havePatched = true;
+	}
+
+	return e.out;
+}
+
+// timeout responses of holds on the same route are rendered identically
+// for every session, so the wrapped result is kept and reused
+class JsonpCache
+{
+public:
+	class Entry
+	{
+	public:
+		QByteArray callback;
+		bool extended;
+		int inCode;
+		QByteArray inReason;
+		HttpHeaders inHeaders;
+		QByteArray inBody;
+		QByteArray outBody;
+	};
+
+	QList<Entry> entries; // most recently used first
+};
+
+static thread_local JsonpCache jsonpCache;
 
-		QString errorMessage;
-		vbody = JsonPatch::patch(vbody, bodyPatch, &errorMessage);
-		if(vbody.isValid())
-			vbody = VariantUtil::convertToJsonStyle(vbody);
-		if(vbody.isValid() && (typeId(vbody) == QMetaType::QVariantMap || typeId(vbody) == QMetaType::QVariantList))
+static QByteArray renderJsonpBody(const QByteArray &callback, bool extended, int code, const QByteArray &reason, const HttpHeaders &headers, QByteArray *body)
+{
+	if(extended)
+	{
+		QVariantMap result;
+		result["code"] = code;
+		result["reason"] = QString::fromUtf8(reason);
+
+		// need to compact headers into a map
+		QVariantMap vheaders;
+		foreach(const HttpHeader &h, headers)
 		{
-			QJsonDocument doc;
-			if(typeId(vbody) == QMetaType::QVariantMap)
-				doc = QJsonDocument(QJsonObject::fromVariantMap(vbody.toMap()));
-			else // List
-				doc = QJsonDocument(QJsonArray::fromVariantList(vbody.toList()));
+			// don't add the same header name twice. we'll collect all values for a single header
+			bool found = false;
+			QMapIterator<QString, QVariant> it(vheaders);
+			while(it.hasNext())
+			{
+				it.next();
+				const QString &name = it.key();
 
-			body = doc.toJson(QJsonDocument::Compact);
+				QByteArray uname = name.toUtf8();
+				if(qstricmp(uname.data(), h.first.data()) == 0)
+				{
+					found = true;
+					break;
+				}
+			}
+			if(found)
+				continue;
 
-			if(in.endsWith("\r\n"))
-				body += "\r\n";
-			else if(in.endsWith("\n"))
-				body += '\n';
+			QList<QByteArray> values = headers.getAll(h.first);
+			QString mergedValue;
+			for(int n = 0; n < values.count(); ++n)
+			{
+				mergedValue += QString::fromUtf8(values[n]);
+				if(n + 1 < values.count())
+					mergedValue += ", ";
+			}
+			vheaders[h.first] = mergedValue;
 		}
-		else
+		result["headers"] = vheaders;
+
+		result["body"] = QString::fromUtf8(*body);
+
+		QByteArray resultJson = QJsonDocument(QJsonObject::fromVariantMap(result)).toJson(QJsonDocument::Compact);
+
+		*body = "/**/" + callback + '(' + resultJson + ");\n";
+	}
+	else
+	{
+		if(body->endsWith("\r\n"))
+			body->truncate(body->size() - 2);
+		else if(body->endsWith("\n"))
+			body->truncate(body->size() - 1);
+		*body = "/**/" + callback + '(' + *body + ");\n";
+	}
+
+	return *body;
+}
+
+// wraps the response for a JSONP request. the rendered body is cached by
+// its inputs, since the same template is used by many sessions
+static void renderJsonp(const QByteArray &callback, bool extended, int *code, QByteArray *reason, HttpHeaders *headers, QByteArray *body)
+{
+	QList<JsonpCache::Entry> &entries = jsonpCache.entries;
+
+	int at = -1;
+	for(int n = 0; n < entries.count(); ++n)
+	{
+		const JsonpCache::Entry &e = entries[n];
+		if(e.extended == extended && e.inCode == *code && e.callback == callback && e.inBody == *body && e.inReason == *reason && e.inHeaders == *headers)
 		{
-			log_debug("httpsession: failed to apply JSON patch: %s", qPrintable(errorMessage));
+			at = n;
+			break;
 		}
 	}
+
+	if(at < 0)
+	{
+		JsonpCache::Entry e;
+		e.callback = callback;
+		e.extended = extended;
+		e.inCode = *code;
+		e.inReason = *reason;
+		e.inHeaders = *headers;
+		e.inBody = *body;
+		e.outBody = renderJsonpBody(callback, extended, *code, *reason, *headers, body);
+
+		if(entries.count() >= JSONP_CACHE_MAX)
+			entries.removeLast();
+
+		entries.prepend(e);
+	}
 	else
 	{
-		log_debug("httpsession: failed to parse original response body as JSON");
+		if(at > 0)
+			entries.move(at, 0);
+
+		*body = entries.first().outBody;
 	}
 
-	return body;
+	headers->removeAll("Content-Type");
+	*headers += HttpHeader("Content-Type", "application/javascript");
+	*code = 200;
+	*reason = "OK";
 }
 
 class HttpSession::Private
@@ -140,17 +349,68 @@ public:
 		}
 	};
 
+	// each queued item charges its body to the memory budget, for as long
+	// as it is queued
 	class QueuedItem
 	{
 	public:
-		PublishItem item;
+		std::shared_ptr<const PublishItem> item;
 		QList<QByteArray> exposeHeaders;
 
-		QueuedItem(const PublishItem &_item, const QList<QByteArray> &_exposeHeaders = QList<QByteArray>()) :
+		QueuedItem(const std::shared_ptr<const PublishItem> &_item, const QList<QByteArray> &_exposeHeaders = QList<QByteArray>()) :
 			item(_item),
-			exposeHeaders(_exposeHeaders)
+			exposeHeaders(_exposeHeaders),
+			charged_(item->format.body.size())
+		{
+			MemoryBudget::charge(MemoryBudget::PublishQueues, charged_);
+		}
+
+		QueuedItem(const QueuedItem &other) :
+			item(other.item),
+			exposeHeaders(other.exposeHeaders),
+			charged_(other.charged_)
 		{
+			MemoryBudget::charge(MemoryBudget::PublishQueues, charged_);
+		}
+
+		QueuedItem(QueuedItem &&other) :
+			item(std::move(other.item)),
+			exposeHeaders(std::move(other.exposeHeaders)),
+			charged_(other.charged_)
+		{
+			other.charged_ = 0;
+		}
+
+		~QueuedItem()
+		{
+			MemoryBudget::release(MemoryBudget::PublishQueues, charged_);
+		}
+
+		QueuedItem & operator=(const QueuedItem &other)
+		{
+			MemoryBudget::charge(MemoryBudget::PublishQueues, other.charged_ - charged_);
+
+			item = other.item;
+			exposeHeaders = other.exposeHeaders;
+			charged_ = other.charged_;
+
+			return *this;
 		}
+
+		QueuedItem & operator=(QueuedItem &&other)
+		{
+			MemoryBudget::release(MemoryBudget::PublishQueues, charged_);
+
+			item = std::move(other.item);
+			exposeHeaders = std::move(other.exposeHeaders);
+			charged_ = other.charged_;
+			other.charged_ = 0;
+
+			return *this;
+		}
+
+	private:
+		qint64 charged_;
 	};
 
 	friend class UpdateAction;
@@ -159,6 +419,7 @@ public:
 	State state;
 	std::unique_ptr<ZhttpRequest> req;
 	AcceptData adata;
+	QByteArray statsRouteId; // adata.statsRoute, encoded once for stats calls
 	Instruct instruct;
 	int logLevel;
 	QHash<QString, Instruct::Channel> channels;
@@ -172,6 +433,10 @@ public:
 	PublishLastIds *publishLastIds;
 	std::shared_ptr<HttpSessionUpdateManager> updateManager;
 	BufferList firstInstructResponse;
+	bool nextLinkPrefetch;
+	std::unique_ptr<ZhttpRequest> prefetchReq; // the page after the one in outReq
+	QUrl prefetchUri;
+	bool havePrefetchHeaders;
 	bool haveOutReqHeaders;
 	int sentOutReqData;
 	int retries;
@@ -184,6 +449,10 @@ public:
 	UpdateAction *pendingAction;
 	QList<QueuedItem> publishQueue;
 	bool inProcessPublishQueue;
+	QByteArray pendingStreamBody;
+	int pendingStreamMessages;
+	bool gzipStream; // the stream body is gzip encoded
+	Gzip::Stream gzip;
 	QByteArray retryToAddress;
 	RetryRequestPacket retryPacket;
 	LogUtil::Config logConfig;
@@ -191,6 +460,7 @@ public:
 	FilterStack *responseFilters;
 	QSet<QString> activeChannels;
 	int connectionSubscriptionMax;
+	SlowConsumerPolicy slowConsumerPolicy;
 	bool connectionStatsActive;
 	Callback<std::tuple<HttpSession *, const QString &>> subscribeCallback;
 	Callback<std::tuple<HttpSession *, const QString &>> unsubscribeCallback;
@@ -201,6 +471,8 @@ public:
 	Connection pausedConnection;
 	Connection readyReadOutConnection;
 	Connection errorOutConnection;
+	Connection readyReadPrefetchConnection;
+	Connection errorPrefetchConnection;
 	Connection timerConnection;
 	Connection retryTimerConnection;
 	Connection messageFiltersFinishedConnection;
@@ -216,12 +488,16 @@ public:
 		filterLimiter(_filterLimiter),
 		publishLastIds(_publishLastIds),
 		updateManager(_updateManager),
+		nextLinkPrefetch(false),
+		havePrefetchHeaders(false),
 		haveOutReqHeaders(false),
 		sentOutReqData(0),
 		retries(0),
 		needUpdate(false),
 		pendingAction(0),
 		inProcessPublishQueue(false),
+		pendingStreamMessages(0),
+		gzipStream(false),
 		responseFilters(0),
 		connectionSubscriptionMax(_connectionSubscriptionMax),
 		connectionStatsActive(true)
@@ -240,6 +516,7 @@ public:
 		retryTimer->setSingleShot(true);
 
 		adata = _adata;
+		statsRouteId = adata.statsRoute.toUtf8();
 		instruct = _instruct;
 
 		if(adata.logLevel >= 0)
@@ -255,11 +532,15 @@ public:
 		// instructions from next link fetches
 		if(!instruct.goneLink.isEmpty())
 			goneUri = currentUri.resolved(instruct.goneLink);
+
+		ObjectStats::add(ObjectStats::HttpSessions, 1, sizeof(HttpSession) + sizeof(Private));
 	}
 
 	~Private()
 	{
 		cleanup();
+
+		ObjectStats::remove(ObjectStats::HttpSessions, 1, sizeof(HttpSession) + sizeof(Private));
 	}
 
 	void start()
@@ -300,10 +581,20 @@ public:
 			if(adata.autoCrossOrigin)
 				Cors::applyCorsHeaders(req->requestHeaders(), &headers);
 
+			if(canCompress(headers))
+			{
+				headers += HttpHeader("Content-Encoding", "gzip");
+				headers += HttpHeader("Vary", "Accept-Encoding");
+				gzipStream = true;
+			}
+
 			incCounter(Stats::ClientHeaderBytesSent, ZhttpManager::estimateResponseHeaderBytes(instruct.response.code, instruct.response.reason, headers));
 
 			req->beginResponse(instruct.response.code, instruct.response.reason, headers);
 
+			if(gzipStream)
+				writeRawBody(Gzip::header());
+
 			if(!instruct.response.body.isEmpty())
 			{
 				// apply ResponseContent filters of all channels
@@ -413,9 +704,9 @@ public:
 		}
 	}
 
-	void publish(const PublishItem &item, const QList<QByteArray> &exposeHeaders)
+	void publish(const std::shared_ptr<const PublishItem> &item, const QList<QByteArray> &exposeHeaders)
 	{
-		const PublishFormat &f = item.format;
+		const PublishFormat &f = item->format;
 
 		if(f.type == PublishFormat::HttpResponse)
 		{
@@ -423,7 +714,7 @@ public:
 
 			if(state == SendingQueue || state == Holding)
 			{
-				if(publishQueue.count() < PUBLISH_QUEUE_MAX)
+				if(publishQueue.count() < PUBLISH_QUEUE_MAX && !MemoryBudget::exceeded())
 				{
 					publishQueue += QueuedItem(item, exposeHeaders);
 
@@ -432,7 +723,7 @@ public:
 				}
 				else
 				{
-					log_debug("httpsession: publish queue at max, dropping");
+					log_debug("httpsession: publish queue at max or over memory budget, dropping");
 				}
 			}
 		}
@@ -440,22 +731,51 @@ public:
 		{
 			if(state == WaitingToUpdate || state == Proxying || state == SendingQueue || state == Holding)
 			{
-				if(publishQueue.count() < PUBLISH_QUEUE_MAX)
+				if(publishQueue.count() < PUBLISH_QUEUE_MAX && !MemoryBudget::exceeded())
 				{
 					publishQueue += QueuedItem(item);
 
 					if(state == Holding)
 						sendQueue();
+					else if(state == SendingQueue && !inProcessPublishQueue)
+						applySlowConsumerPolicy();
 				}
 				else
 				{
-					log_debug("httpsession: publish queue at max, dropping");
+					log_debug("httpsession: publish queue at max or over memory budget, dropping");
 				}
 			}
 		}
 	}
 
 private:
+	void applySlowConsumerPolicy()
+	{
+		// the first item may be running through the filters
+		int start = messageFilters ? 1 : 0;
+
+		int queuedBytes = 0;
+		int dropped = slowConsumerPolicy.apply(&publishQueue, start, [](const QueuedItem &qi) -> const PublishItem & { return *qi.item; }, &queuedBytes);
+
+		if(dropped > 0)
+		{
+			log_debug("httpsession: slow consumer, dropped %d queued messages", dropped);
+			incCounter(Stats::SlowConsumerDrops, dropped);
+		}
+		else if(dropped < 0)
+		{
+			log_info("httpsession: slow consumer, disconnecting: route=%s queued=%d bytes=%d", qPrintable(adata.statsRoute), publishQueue.count(), queuedBytes);
+			incCounter(Stats::SlowConsumerDisconnects);
+
+			messageFiltersFinishedConnection.disconnect();
+			messageFilters.reset();
+
+			prepareToClose();
+			flushStreamBody();
+			endBody();
+		}
+	}
+
 	void cleanup()
 	{
 		cancelActivities();
@@ -481,6 +801,15 @@ private:
 		responseFilters = 0;
 	}
 
+	void cleanupPrefetch()
+	{
+		readyReadPrefetchConnection.disconnect();
+		errorPrefetchConnection.disconnect();
+		prefetchReq.reset();
+		prefetchUri.clear();
+		havePrefetchHeaders = false;
+	}
+
 	void cancelAction()
 	{
 		if(pendingAction)
@@ -493,6 +822,7 @@ private:
 	void cancelActivities()
 	{
 		cleanupOutReq();
+		cleanupPrefetch();
 		cancelAction();
 
 		publishQueue.clear();
@@ -501,6 +831,7 @@ private:
 		retryTimer->stop();
 
 		updateManager->unregisterSession(q);
+		updateManager->unregisterHoldTimeout(q);
 	}
 
 	void setupKeepAlive()
@@ -565,6 +896,7 @@ private:
 
 			// stop activity while pausing
 			timer->stop();
+			updateManager->unregisterHoldTimeout(q);
 
 			pausedConnection = req->paused.connect(boost::bind(&Private::req_paused, this));
 			req->pause();
@@ -611,7 +943,9 @@ private:
 			bool found = false;
 			foreach(const Instruct::Channel &c, instruct.channels)
 			{
-				if(adata.channelPrefix + c.name == name)
+				// a channel that changes to or from a prefix is subscribed
+				// again, since it is indexed differently
+				if(adata.channelPrefix + c.name == name && c.prefix == it.value().prefix)
 				{
 					found = true;
 					break;
@@ -639,6 +973,7 @@ private:
 				// update channel properties
 				channels[name].prevId = c.prevId;
 				channels[name].filters = c.filters;
+				channels[name].delta = c.delta;
 			}
 		}
 
@@ -662,12 +997,10 @@ private:
 		{
 			state = Holding;
 
-			// set timeout
+			// set timeout. holds are expired in bulk by the update
+			// manager, rather than each with its own timer
 			if(instruct.timeout >= 0)
-			{
-				timer->setSingleShot(true);
-				timer->start(instruct.timeout * 1000);
-			}
+				updateManager->registerHoldTimeout(q, instruct.timeout * 1000);
 		}
 		else // StreamHold
 		{
@@ -711,16 +1044,17 @@ private:
 			while(!publishQueue.isEmpty())
 			{
 				const QueuedItem &qi = publishQueue.first();
-				const PublishItem &item = qi.item;
+				const PublishItem &item = *qi.item;
 
-				if(!channels.contains(item.channel))
+				QHash<QString, Instruct::Channel>::const_iterator cit = findChannel(item.channel);
+				if(cit == channels.constEnd())
 				{
 					// we don't care about this channel anymore
 					publishQueue.removeFirst();
 					continue;
 				}
 
-				Instruct::Channel &channel = channels[item.channel];
+				const Instruct::Channel &channel = cit.value();
 
 				if(!channel.prevId.isNull() && channel.prevId != item.prevId)
 				{
@@ -738,6 +1072,24 @@ private:
 		}
 	}
 
+	// returns the channel that a publish is for: the channel itself, or
+	// else the longest prefix channel that matches it
+	QHash<QString, Instruct::Channel>::const_iterator findChannel(const QString &name) const
+	{
+		QHash<QString, Instruct::Channel>::const_iterator it = channels.constFind(name);
+		if(it != channels.constEnd())
+			return it;
+
+		QHash<QString, Instruct::Channel>::const_iterator best = channels.constEnd();
+		for(it = channels.constBegin(); it != channels.constEnd(); ++it)
+		{
+			if(it.value().prefix && name.startsWith(it.key()) && (best == channels.constEnd() || it.key().length() > best.key().length()))
+				best = it;
+		}
+
+		return best;
+	}
+
 	void sendQueue()
 	{
 		state = SendingQueue;
@@ -750,19 +1102,22 @@ private:
 		assert(!inProcessPublishQueue);
 		inProcessPublishQueue = true;
 
-		while(state == SendingQueue && !publishQueue.isEmpty() && req->writeBytesAvailable() > 0 && !messageFilters)
+		// stream messages are combined into pendingStreamBody while the
+		// credits allow, and written together after the loop
+		while(state == SendingQueue && !publishQueue.isEmpty() && req->writeBytesAvailable() - pendingStreamBody.size() > 0 && !messageFilters)
 		{
 			const QueuedItem &qi = publishQueue.first();
-			const PublishItem &item = qi.item;
+			const PublishItem &item = *qi.item;
 
-			if(!channels.contains(item.channel))
+			QHash<QString, Instruct::Channel>::const_iterator cit = findChannel(item.channel);
+			if(cit == channels.constEnd())
 			{
 				log_debug("httpsession: received publish for channel with no subscription, dropping");
 				publishQueue.removeFirst();
 				continue;
 			}
 
-			Instruct::Channel &channel = channels[item.channel];
+			const Instruct::Channel &channel = cit.value();
 
 			if(!channel.prevId.isNull())
 			{
@@ -778,17 +1133,25 @@ private:
 				}
 			}
 
+			if(item.isExpired())
+			{
+				// dropped the same way as by a filter, so the id chain is
+				// still followed
+				incCounter(Stats::MessagesExpired);
+
+				QueuedItem qi = publishQueue.takeFirst();
+				processItem(*qi.item, Filter::Drop, QByteArray(), qi.exposeHeaders);
+				continue;
+			}
+
 			const PublishFormat &f = item.format;
 
+			std::shared_ptr<const Filter::MessageFilterPlan> plan = Filter::MessageFilterPlan::get(channel.filters);
+
 			if(f.haveContentFilters)
 			{
 				// ensure content filters match
-				QStringList contentFilters;
-				foreach(const QString &f, channels[item.channel].filters)
-				{
-					if(Filter::targets(f) & Filter::MessageContent)
-						contentFilters += f;
-				}
+				const QStringList &contentFilters = plan->contentFilters();
 				if(contentFilters != f.contentFilters)
 				{
 					publishQueue.removeFirst();
@@ -810,22 +1173,35 @@ private:
 			else
 				body = f.body;
 
-			messageFilters = std::make_unique<Filter::MessageFilterStack>(channels[item.channel].filters);
-			messageFiltersFinishedConnection = messageFilters->finished.connect(boost::bind(&Private::messageFiltersFinished, this, boost::placeholders::_1));
+			Filter::Context fc;
 
-			QHash<QString, QString> prevIds;
-			QHashIterator<QString, Instruct::Channel> it(channels);
-			while(it.hasNext())
+			if(plan->needsPrevIds())
 			{
-				it.next();
-				const Instruct::Channel &c = it.value();
-				prevIds[c.name] = c.prevId;
+				QHashIterator<QString, Instruct::Channel> it(channels);
+				while(it.hasNext())
+				{
+					it.next();
+					const Instruct::Channel &c = it.value();
+					fc.prevIds[c.name] = c.prevId;
+				}
 			}
 
-			Filter::Context fc;
-			fc.prevIds = prevIds;
 			fc.subscriptionMeta = instruct.meta;
 			fc.publishMeta = item.meta;
+
+			Filter::SendAction sendAction = plan->hasChecks() ? plan->checkDelivery(fc) : Filter::Send;
+
+			if(sendAction == Filter::Drop || !plan->hasStages())
+			{
+				// nothing asynchronous to run
+				QueuedItem qi = publishQueue.takeFirst();
+				processItem(*qi.item, sendAction, body, qi.exposeHeaders);
+				continue;
+			}
+
+			messageFilters = std::make_unique<Filter::MessageFilterStack>(*plan);
+			messageFiltersFinishedConnection = messageFilters->finished.connect(boost::bind(&Private::messageFiltersFinished, this, boost::placeholders::_1));
+
 			fc.zhttpOut = outZhttp;
 			fc.currentUri = currentUri;
 			fc.route = adata.route;
@@ -838,6 +1214,8 @@ private:
 			messageFilters->start(fc, body);
 		}
 
+		flushStreamBody();
+
 		if(!messageFilters)
 		{
 			// the state changed, the queue is empty, or the client buffer is full
@@ -891,7 +1269,9 @@ private:
 			update(needUpdatePriority);
 	}
 
-	void respond(int _code, const QByteArray &_reason, const HttpHeaders &_headers, const QByteArray &_body)
+	// if run is provided, it is the gzip encoding of the body, which is sent
+	// instead
+	void respond(int _code, const QByteArray &_reason, const HttpHeaders &_headers, const QByteArray &_body, const Gzip::Run *run = 0)
 	{
 		prepareToClose();
 
@@ -906,65 +1286,7 @@ private:
 		{
 			if(!adata.jsonpCallback.isEmpty())
 			{
-				if(adata.jsonpExtendedResponse)
-				{
-					QVariantMap result;
-					result["code"] = code;
-					result["reason"] = QString::fromUtf8(reason);
-
-					// need to compact headers into a map
-					QVariantMap vheaders;
-					foreach(const HttpHeader &h, headers)
-					{
-						// don't add the same header name twice. we'll collect all values for a single header
-						bool found = false;
-						QMapIterator<QString, QVariant> it(vheaders);
-						while(it.hasNext())
-						{
-							it.next();
-							const QString &name = it.key();
-
-							QByteArray uname = name.toUtf8();
-							if(qstricmp(uname.data(), h.first.data()) == 0)
-							{
-								found = true;
-								break;
-							}
-						}
-						if(found)
-							continue;
-
-						QList<QByteArray> values = headers.getAll(h.first);
-						QString mergedValue;
-						for(int n = 0; n < values.count(); ++n)
-						{
-							mergedValue += QString::fromUtf8(values[n]);
-							if(n + 1 < values.count())
-								mergedValue += ", ";
-						}
-						vheaders[h.first] = mergedValue;
-					}
-					result["headers"] = vheaders;
-
-					result["body"] = QString::fromUtf8(body);
-
-					QByteArray resultJson = QJsonDocument(QJsonObject::fromVariantMap(result)).toJson(QJsonDocument::Compact);
-
-					body = "/**/" + adata.jsonpCallback + '(' + resultJson + ");\n";
-				}
-				else
-				{
-					if(body.endsWith("\r\n"))
-						body.truncate(body.size() - 2);
-					else if(body.endsWith("\n"))
-						body.truncate(body.size() - 1);
-					body = "/**/" + adata.jsonpCallback + '(' + body + ");\n";
-				}
-
-				headers.removeAll("Content-Type");
-				headers += HttpHeader("Content-Type", "application/javascript");
-				code = 200;
-				reason = "OK";
+				renderJsonp(adata.jsonpCallback, adata.jsonpExtendedResponse, &code, &reason, &headers, &body);
 			}
 			else
 			{
@@ -972,6 +1294,13 @@ private:
 			}
 		}
 
+		if(run && body.constData() == _body.constData())
+		{
+			headers += HttpHeader("Content-Encoding", "gzip");
+			headers += HttpHeader("Vary", "Accept-Encoding");
+			body = Gzip::member(*run);
+		}
+
 		incCounter(Stats::ClientHeaderBytesSent, ZhttpManager::estimateResponseHeaderBytes(code, reason, headers));
 
 		req->beginResponse(code, reason, headers);
@@ -979,7 +1308,7 @@ private:
 		req->endBody();
 	}
 
-	void respond(int code, const QByteArray &reason, const HttpHeaders &_headers, const QByteArray &body, const QList<QByteArray> &exposeHeaders)
+	void respond(int code, const QByteArray &reason, const HttpHeaders &_headers, const QByteArray &body, const QList<QByteArray> &exposeHeaders, const Gzip::Run *run = 0)
 	{
 		// inherit headers from the timeout response
 		HttpHeaders headers = instruct.response.headers;
@@ -1013,7 +1342,7 @@ private:
 			}
 		}
 
-		respond(code, reason, headers, body);
+		respond(code, reason, headers, body, run);
 	}
 
 	void doFinish(bool retry = false)
@@ -1136,15 +1465,26 @@ private:
 	}
 
 	void prepareOutReq(const QUrl &destUri, bool autoShare = false)
+	{
+		outReq = createOutReq(currentUri, destUri, autoShare);
+		connectOutReq();
+	}
+
+	void connectOutReq()
 	{
 		haveOutReqHeaders = false;
 		sentOutReqData = 0;
 
-		outReq.reset(outZhttp->createRequest());
 		readyReadOutConnection = outReq->readyRead.connect(boost::bind(&Private::outReq_readyRead, this));
 		errorOutConnection = outReq->error.connect(boost::bind(&Private::outReq_error, this));
+	}
+
+	// fromUri is the page the request's link came from
+	std::unique_ptr<ZhttpRequest> createOutReq(const QUrl &fromUri, const QUrl &destUri, bool autoShare)
+	{
+		std::unique_ptr<ZhttpRequest> r(outZhttp->createRequest());
 
-		int currentPort = currentUri.port(currentUri.scheme() == "https" ? 443 : 80);
+		int currentPort = fromUri.port(fromUri.scheme() == "https" ? 443 : 80);
 		int destPort = destUri.port(destUri.scheme() == "https" ? 443 : 80);
 
 		QVariantHash passthroughData;
@@ -1157,7 +1497,7 @@ private:
 		//   different service, then we can't make this assumption and need
 		//   to make the request over the network. note that such a request
 		//   could still end up looping back to us
-		if(destUri.scheme() == currentUri.scheme() && destUri.host() == currentUri.host() && destPort == currentPort)
+		if(destUri.scheme() == fromUri.scheme() && destUri.host() == fromUri.host() && destPort == currentPort)
 		{
 			// tell the proxy that we prefer the request to be handled
 			//   internally, using the same route
@@ -1171,7 +1511,83 @@ private:
 		// share requests to the same URI
 		passthroughData["auto-share"] = autoShare;
 
-		outReq->setPassthroughData(passthroughData);
+		r->setPassthroughData(passthroughData);
+
+		return r;
+	}
+
+	HttpHeaders nextLinkHeaders() const
+	{
+		HttpHeaders headers;
+		foreach(const Instruct::Channel &c, channels.values())
+		{
+			if(!c.prevId.isNull())
+				headers += HttpHeader("Grip-Last", c.name.toUtf8() + "; last-id=" + c.prevId.toUtf8());
+		}
+
+		// keep link requests in the client's trace
+		QByteArray traceParent = adata.requestData.headers.get("traceparent");
+		if(!traceParent.isEmpty())
+			headers += HttpHeader("traceparent", traceParent);
+
+		return headers;
+	}
+
+	// for paged streams, the page after the one being received is
+	//   requested right away rather than once the current page is sent.
+	//   its body waits in the request, which stops granting credits once
+	//   its receive window is full, so buffering is bounded. requests for
+	//   the same uri are shared across sessions like regular next links
+	void startPrefetch()
+	{
+		cleanupPrefetch();
+
+		if(!nextLinkPrefetch || !outZhttp || instruct.holdMode != Instruct::NoHold || instruct.nextLink.isEmpty())
+			return;
+
+		// nextUri is the page being received
+		prefetchUri = nextUri.resolved(instruct.nextLink);
+
+		log_debug("httpsession: prefetch: %s", qPrintable(prefetchUri.toString()));
+
+		prefetchReq = createOutReq(nextUri, prefetchUri, true);
+		readyReadPrefetchConnection = prefetchReq->readyRead.connect(boost::bind(&Private::prefetchReq_readyRead, this));
+		errorPrefetchConnection = prefetchReq->error.connect(boost::bind(&Private::prefetchReq_error, this));
+
+		prefetchReq->start("GET", prefetchUri, nextLinkHeaders());
+		prefetchReq->endBody();
+	}
+
+	// returns true if a prefetch for uri became outReq
+	bool takePrefetch(const QUrl &uri)
+	{
+		if(!prefetchReq)
+			return false;
+
+		if(prefetchUri != uri)
+		{
+			cleanupPrefetch();
+			return false;
+		}
+
+		bool haveHeaders = havePrefetchHeaders;
+
+		outReq = std::move(prefetchReq);
+		cleanupPrefetch();
+		connectOutReq();
+
+		// the response may have arrived already, in which case there
+		//   won't be another signal for it
+		if(haveHeaders)
+		{
+			ZhttpRequest *r = outReq.get();
+			deferCall.defer([=] {
+				if(outReq.get() == r)
+					outReq_readyRead();
+			});
+		}
+
+		return true;
 	}
 
 	void requestNextLink()
@@ -1185,16 +1601,15 @@ private:
 			return;
 		}
 
-		prepareOutReq(nextUri, true);
-
-		HttpHeaders headers;
-		foreach(const Instruct::Channel &c, channels.values())
+		if(takePrefetch(nextUri))
 		{
-			if(!c.prevId.isNull())
-				headers += HttpHeader("Grip-Last", c.name.toUtf8() + "; last-id=" + c.prevId.toUtf8());
+			log_debug("httpsession: next: using prefetched request");
+			return;
 		}
 
-		outReq->start("GET", nextUri, headers);
+		prepareOutReq(nextUri, true);
+
+		outReq->start("GET", nextUri, nextLinkHeaders());
 		outReq->endBody();
 	}
 
@@ -1340,7 +1755,7 @@ private:
 			{
 				prepareToClose();
 
-				req->endBody();
+				endBody();
 			}
 		}
 	}
@@ -1384,12 +1799,90 @@ private:
 
 	void incCounter(Stats::Counter c, int count = 1)
 	{
-		stats->incCounter(adata.statsRoute.toUtf8(), c, count);
+		stats->incCounter(statsRouteId, c, count);
+	}
+
+	// whether content can be gzip encoded when sent with the given headers
+	bool canCompress(const HttpHeaders &headers) const
+	{
+		if(!adata.compressPublished || headers.contains("Content-Encoding"))
+			return false;
+
+		// jsonp responses are rewritten
+		if(adata.autoCrossOrigin && !adata.jsonpCallback.isEmpty())
+			return false;
+
+		return Gzip::accepted(req->requestHeaders());
+	}
+
+	// content of a stream message, encoded for the stream. if the content
+	// is the published body, its shared encoding is used
+	QByteArray encodeStreamContent(const PublishItem &item, const QByteArray &content)
+	{
+		if(!gzipStream || content.isEmpty())
+			return content;
+
+		if(content.constData() == item.format.body.constData())
+		{
+			const Gzip::Run &run = item.gzipBody();
+			gzip.add(run);
+			return run.data;
+		}
+
+		Gzip::Run run = Gzip::deflate(content);
+		gzip.add(run);
+		return run.data;
 	}
 
 	void writeBody(const QByteArray &body)
 	{
+		// keep the order of anything combined so far
+		flushStreamBody();
+
+		if(gzipStream && !body.isEmpty())
+		{
+			Gzip::Run run = Gzip::deflate(body);
+			gzip.add(run);
+			writeRawBody(run.data);
+			return;
+		}
+
+		writeRawBody(body);
+	}
+
+	void writeRawBody(const QByteArray &body)
+	{
+		incCounter(Stats::ClientContentBytesSent, body.size());
+
+		req->writeBody(body);
+	}
+
+	void endBody()
+	{
+		if(gzipStream)
+		{
+			flushStreamBody();
+
+			writeRawBody(gzip.trailer());
+			gzipStream = false;
+		}
+
+		req->endBody();
+	}
+
+	void flushStreamBody()
+	{
+		if(pendingStreamMessages == 0)
+			return;
+
+		QByteArray body = pendingStreamBody;
+		int count = pendingStreamMessages;
+		pendingStreamBody.clear();
+		pendingStreamMessages = 0;
+
 		incCounter(Stats::ClientContentBytesSent, body.size());
+		incCounter(Stats::StreamMessagesSent, count);
+		incCounter(Stats::StreamBodyWrites);
 
 		req->writeBody(body);
 	}
@@ -1412,7 +1905,16 @@ private:
 		}
 		else
 		{
-			processItem(qi.item, result.sendAction, result.content, qi.exposeHeaders);
+			Filter::SendAction sendAction = result.sendAction;
+
+			// filters may take a while
+			if(sendAction != Filter::Drop && qi.item->isExpired())
+			{
+				incCounter(Stats::MessagesExpired);
+				sendAction = Filter::Drop;
+			}
+
+			processItem(*qi.item, sendAction, result.content, qi.exposeHeaders);
 		}
 
 		// if filters finished asynchronously then we need to resume processing
@@ -1424,10 +1926,15 @@ private:
 	{
 		const PublishFormat &f = item.format;
 
-		Instruct::Channel &channel = channels[item.channel];
+		QHash<QString, Instruct::Channel>::const_iterator cit = findChannel(item.channel);
+		assert(cit != channels.constEnd());
+
+		// the channel the item was matched by, which differs from the
+		// item's channel for prefix channels
+		QString channelName = cit.key();
 
-		if(!channel.prevId.isNull())
-			channel.prevId = item.id;
+		if(!cit.value().prevId.isNull())
+			channels[channelName].prevId = item.id;
 
 		if(instruct.holdMode == Instruct::ResponseHold)
 		{
@@ -1439,7 +1946,15 @@ private:
 
 			if(f.action == PublishFormat::Send)
 			{
-				respond(f.code, f.reason, f.headers, content, exposeHeaders);
+				// the published body is compressed once for all sessions.
+				// content that was changed by filters is sent as is
+				const Gzip::Run *run = 0;
+				if(!content.isEmpty() && content.constData() == f.body.constData() && canCompress(f.headers) && canCompress(instruct.response.headers))
+					run = &item.gzipBody();
+
+				respond(f.code, f.reason, f.headers, content, exposeHeaders, run);
+
+				PublishLatency::record(PublishLatency::Written, f.type, item.receiveTime);
 			}
 			else if(f.action == PublishFormat::Hint)
 			{
@@ -1453,14 +1968,19 @@ private:
 
 			if(f.action == PublishFormat::Send)
 			{
-				writeBody(content);
+				// written by processPublishQueue, along with any other
+				// messages sent in the same pass
+				pendingStreamBody += encodeStreamContent(item, content);
+				++pendingStreamMessages;
+
+				PublishLatency::record(PublishLatency::Written, f.type, item.receiveTime);
 
 				// restart keep alive timer
 				adjustKeepAlive();
 
 				if(!nextUri.isEmpty() && instruct.nextLinkTimeout >= 0)
 				{
-					activeChannels += item.channel;
+					activeChannels += channelName;
 					if(activeChannels.count() == channels.count())
 					{
 						activeChannels.clear();
@@ -1480,7 +2000,8 @@ private:
 			else if(f.action == PublishFormat::Close)
 			{
 				prepareToClose();
-				req->endBody();
+				flushStreamBody();
+				endBody();
 			}
 		}
 	}
@@ -1507,7 +2028,7 @@ private:
 			if(adata.debug)
 				writeBody("\n\n" + errorMessage.toUtf8() + '\n');
 
-			req->endBody();
+			endBody();
 		}
 	}
 
@@ -1602,12 +2123,28 @@ private:
 				fc.subscriptionMeta = instruct.meta;
 
 				responseFilters = new FilterStack(fc, allFilters);
+
+				startPrefetch();
 			}
 		}
 
 		tryProcessOutReq();
 	}
 
+	void prefetchReq_readyRead()
+	{
+		// the rest is read once the request becomes outReq
+		havePrefetchHeaders = true;
+		readyReadPrefetchConnection.disconnect();
+	}
+
+	void prefetchReq_error()
+	{
+		log_debug("httpsession: prefetch failed, will request when needed");
+
+		cleanupPrefetch();
+	}
+
 	void outReq_error()
 	{
 		logRequestError(outReq->requestMethod(), outReq->requestUri(), outReq->requestHeaders());
@@ -1652,12 +2189,43 @@ private:
 		}
 	}
 
+	void holdTimeout()
+	{
+		if(instruct.holdMode != Instruct::ResponseHold)
+			return;
+
+		// send timeout response
+		respond(instruct.response.code, instruct.response.reason, instruct.response.headers, instruct.response.body);
+	}
+
+	bool drain()
+	{
+		if(state != Holding)
+			return false;
+
+		if(instruct.holdMode == Instruct::ResponseHold)
+		{
+			holdTimeout();
+		}
+		else if(instruct.holdMode == Instruct::StreamHold)
+		{
+			prepareToClose();
+			flushStreamBody();
+			endBody();
+		}
+		else
+		{
+			return false;
+		}
+
+		return true;
+	}
+
 	void timer_timeout()
 	{
 		if(instruct.holdMode == Instruct::ResponseHold)
 		{
-			// send timeout response
-			respond(instruct.response.code, instruct.response.reason, instruct.response.headers, instruct.response.body);
+			holdTimeout();
 		}
 		else if(instruct.holdMode == Instruct::StreamHold)
 		{
@@ -1665,7 +2233,7 @@ private:
 
 			setupKeepAlive();
 
-			stats->addActivity(adata.statsRoute.toUtf8(), 1);
+			stats->addActivity(statsRouteId, 1);
 		}
 	}
 
@@ -1703,6 +2271,11 @@ QUrl HttpSession::requestUri() const
 	return d->req->requestUri();
 }
 
+QUrl HttpSession::nextLinkUri() const
+{
+	return d->nextUri;
+}
+
 bool HttpSession::isRetry() const
 {
 	return d->adata.isRetry;
@@ -1713,6 +2286,11 @@ QString HttpSession::statsRoute() const
 	return d->adata.statsRoute;
 }
 
+const QByteArray & HttpSession::statsRouteId() const
+{
+	return d->statsRouteId;
+}
+
 QString HttpSession::sid() const
 {
 	return d->adata.sid;
@@ -1723,6 +2301,25 @@ QHash<QString, Instruct::Channel> HttpSession::channels() const
 	return d->channels;
 }
 
+bool HttpSession::matchesChannel(const QString &channel) const
+{
+	return d->findChannel(channel) != d->channels.constEnd();
+}
+
+bool HttpSession::isPrefixChannel(const QString &channel) const
+{
+	QHash<QString, Instruct::Channel>::const_iterator it = d->channels.constFind(channel);
+
+	return (it != d->channels.constEnd() && it.value().prefix);
+}
+
+bool HttpSession::isDeltaChannel(const QString &channel) const
+{
+	QHash<QString, Instruct::Channel>::const_iterator it = d->findChannel(channel);
+
+	return (it != d->channels.constEnd() && it.value().delta);
+}
+
 QHash<QString, QString> HttpSession::meta() const
 {
 	return d->instruct.meta;
@@ -1748,7 +2345,27 @@ void HttpSession::update()
 	d->update(Private::LowPriority);
 }
 
-void HttpSession::publish(const PublishItem &item, const QList<QByteArray> &exposeHeaders)
+void HttpSession::holdTimeout()
+{
+	d->holdTimeout();
+}
+
+bool HttpSession::drain()
+{
+	return d->drain();
+}
+
+void HttpSession::setSlowConsumerPolicy(const SlowConsumerPolicy &policy)
+{
+	d->slowConsumerPolicy = policy;
+}
+
+void HttpSession::setNextLinkPrefetch(bool enabled)
+{
+	d->nextLinkPrefetch = enabled;
+}
+
+void HttpSession::publish(const std::shared_ptr<const PublishItem> &item, const QList<QByteArray> &exposeHeaders)
 {
 	d->publish(item, exposeHeaders);
 }
@@ -25,6 +25,7 @@
 #define HTTPSESSION_H
 
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 #include "packet/httprequestdata.h"
 #include "packet/httpresponsedata.h"
 #include "callback.h"
@@ -42,8 +43,6 @@
 // a few more just in case
 #define TIMERS_PER_HTTPSESSION ((TIMERS_PER_ZHTTPREQUEST * 2) + 2 + TIMERS_PER_MESSAGEFILTERSTACK + 4)
 
-using Connection = boost::signals2::scoped_connection;
-
 class ZhttpManager;
 class StatsManager;
 class PublishItem;
@@ -51,6 +50,7 @@ class RateLimiter;
 class PublishLastIds;
 class HttpSessionUpdateManager;
 class RetryRequestPacket;
+class SlowConsumerPolicy;
 
 class HttpSession : public ClientSession
 {
@@ -74,6 +74,7 @@ public:
 		QSet<QString> implicitChannels;
 		bool trusted;
 		bool responseSent;
+		bool compressPublished; // gzip published content if the client accepts it
 		QString sid;
 		bool haveInspectInfo;
 		InspectData inspectInfo;
@@ -87,6 +88,7 @@ public:
 			logLevel(-1),
 			trusted(false),
 			responseSent(false),
+			compressPublished(false),
 			haveInspectInfo(false)
 		{
 		}
@@ -98,17 +100,47 @@ public:
 	Instruct::HoldMode holdMode() const;
 	ZhttpRequest::Rid rid() const;
 	QUrl requestUri() const;
+
+	// the link requested when the session is updated, if any
+	QUrl nextLinkUri() const;
+
 	bool isRetry() const;
 	QString statsRoute() const;
+	const QByteArray & statsRouteId() const; // statsRoute as utf-8
 	QString sid() const;
 	QHash<QString, Instruct::Channel> channels() const;
+
+	// whether a publish to the channel reaches this session, through the
+	// channel itself or a prefix channel
+	bool matchesChannel(const QString &channel) const;
+
+	bool isPrefixChannel(const QString &channel) const;
+
+	// whether a publish to the channel is received through a channel
+	// subscribed with delta
+	bool isDeltaChannel(const QString &channel) const;
+
 	QHash<QString, QString> meta() const;
 	QByteArray retryToAddress() const;
 	RetryRequestPacket retryPacket() const;
 
+	// applies while stream messages wait for the client to read
+	void setSlowConsumerPolicy(const SlowConsumerPolicy &policy);
+
+	// whether the next page of a paged stream is requested while the
+	// current one is still being sent
+	void setNextLinkPrefetch(bool enabled);
+
 	void start();
 	void update();
-	void publish(const PublishItem &item, const QList<QByteArray> &exposeHeaders = QList<QByteArray>());
+	void holdTimeout();
+
+	// ends a held session early: a response hold gets its timeout response
+	// and a stream is closed. returns false if the session is busy, in
+	// which case it can be tried again later
+	bool drain();
+	// the item is shared with other sessions and must not be modified
+	void publish(const std::shared_ptr<const PublishItem> &item, const QList<QByteArray> &exposeHeaders = QList<QByteArray>());
 
 	// NOTE: for performance reasons we use callbacks instead of signals/slots
 	Callback<std::tuple<HttpSession *, const QString &>> & subscribeCallback();
@@ -23,139 +23,426 @@
 
 #include "httpsessionupdatemanager.h"
 
+#include <assert.h>
+#include <vector>
+#include <QMap>
 #include <QUrl>
+#include <QDateTime>
+#include <QRandomGenerator>
 #include "timer.h"
+#include "timerwheel.h"
 #include "defercall.h"
 #include "httpsession.h"
 
+#define TICK_DURATION_MS 10
+#define WHEEL_CAPACITY_MIN 64
+
+// bucket timeouts are extended by a random amount, up to this fraction of
+// the timeout, so that sessions registered at the same time with different
+// uris don't all refresh together
+#define JITTER_DIVISOR 10
+#define JITTER_MAX 5000
+
+// hold timeouts are rounded up to a multiple of this many ticks
+#define HOLD_SLOT_TICKS 10
+
+static qint64 durationToTicksRoundDown(qint64 msec)
+{
+	return msec / TICK_DURATION_MS;
+}
+
+static qint64 durationToTicksRoundUp(qint64 msec)
+{
+	return (msec + TICK_DURATION_MS - 1) / TICK_DURATION_MS;
+}
+
 class HttpSessionUpdateManager::Private
 {
 public:
 	class Bucket
 	{
 	public:
-		QPair<int, QUrl> key;
+		quint64 key;
+		int uriId;
+		int timeout;
+		quint64 expires;
+		int timerKey;
 		QSet<HttpSession*> sessions;
 		QSet<HttpSession*> deferredSessions;
-		std::unique_ptr<Timer> timer;
+	};
+
+	class Uri
+	{
+	public:
+		QByteArray encoded;
+		int refs;
 	};
 
 	HttpSessionUpdateManager *q;
-	QHash<QPair<int, QUrl>, Bucket*> buckets;
-	QHash<Timer*, Bucket*> bucketsByTimer;
-	QHash<HttpSession*, Bucket*> bucketsBySession;
+	std::unique_ptr<TimerWheel> wheel;
+	int wheelCapacity;
+	std::unique_ptr<Timer> timer;
+	qint64 startTime;
+	quint64 currentTicks;
+	std::vector<Bucket> bucketsPool;
+	std::vector<int> freeBuckets;
+	int bucketCount;
+	QHash<quint64, int> buckets;
+	QHash<HttpSession*, int> bucketsBySession;
+	QHash<QByteArray, int> uriIds;
+	std::vector<Uri> uris;
+	std::vector<int> freeUris;
+	QMap<quint64, QSet<HttpSession*>> holdSlots;
+	QHash<HttpSession*, quint64> holdSlotsBySession;
+	QSet<HttpSession*> expiringHolds;
 
 	Private(HttpSessionUpdateManager *_q) :
-		q(_q)
+		q(_q),
+		wheelCapacity(WHEEL_CAPACITY_MIN),
+		currentTicks(0),
+		bucketCount(0)
+	{
+		wheel = std::make_unique<TimerWheel>(wheelCapacity);
+		startTime = QDateTime::currentMSecsSinceEpoch();
+
+		timer = std::make_unique<Timer>();
+		timer->setSingleShot(true);
+		timer->timeout.connect(boost::bind(&Private::timer_timeout, this));
+	}
+
+	static quint64 bucketKey(int timeout, int uriId)
+	{
+		return ((quint64)(quint32)timeout << 32) | (quint32)uriId;
+	}
+
+	int internUri(const QUrl &uri)
+	{
+		QUrl tmp = uri;
+		tmp.setQuery(QString()); // remove the query part
+		QByteArray encoded = tmp.toEncoded();
+
+		int id = uriIds.value(encoded, -1);
+		if(id < 0)
+		{
+			if(!freeUris.empty())
+			{
+				id = freeUris.back();
+				freeUris.pop_back();
+			}
+			else
+			{
+				id = (int)uris.size();
+				uris.push_back(Uri());
+			}
+
+			Uri &u = uris[id];
+			u.encoded = encoded;
+			u.refs = 0;
+
+			uriIds.insert(encoded, id);
+		}
+
+		return id;
+	}
+
+	// no-op while buckets still reference the uri
+	void releaseUri(int id)
+	{
+		Uri &u = uris[id];
+
+		if(u.refs > 0)
+			return;
+
+		uriIds.remove(u.encoded);
+		u.encoded.clear();
+		freeUris.push_back(id);
+	}
+
+	void updateWheel(qint64 now)
 	{
+		// time must go forward
+		if(now > startTime)
+		{
+			currentTicks = (quint64)durationToTicksRoundDown(now - startTime);
+			wheel->update(currentTicks);
+		}
+	}
+
+	void updateTimer(qint64 now)
+	{
+		qint64 timeoutTicks = wheel->timeout();
+
+		if(!holdSlots.isEmpty())
+		{
+			qint64 holdTicks = qMax((qint64)holdSlots.firstKey() - (qint64)currentTicks, (qint64)0);
+			if(timeoutTicks < 0 || holdTicks < timeoutTicks)
+				timeoutTicks = holdTicks;
+		}
+
+		if(timeoutTicks < 0)
+		{
+			timer->stop();
+			return;
+		}
+
+		qint64 ticksSinceUpdate = qMax(durationToTicksRoundDown(now - startTime) - (qint64)currentTicks, (qint64)0);
+		timeoutTicks = qMax(timeoutTicks - ticksSinceUpdate, (qint64)0);
+
+		timer->start(timeoutTicks * TICK_DURATION_MS);
+	}
+
+	void ensureWheelCapacity()
+	{
+		if(bucketCount < wheelCapacity)
+			return;
+
+		// rebuild with room to grow. this is rare, as the capacity only
+		// increases
+		wheelCapacity *= 2;
+		wheel = std::make_unique<TimerWheel>(wheelCapacity);
+		wheel->update(currentTicks);
+
+		for(int n = 0; n < (int)bucketsPool.size(); ++n)
+		{
+			Bucket &b = bucketsPool[n];
+			if(b.timerKey >= 0)
+			{
+				b.timerKey = wheel->add(b.expires, (size_t)n);
+				assert(b.timerKey >= 0);
+			}
+		}
 	}
 
-	~Private()
+	void startBucket(int index, qint64 now)
 	{
-		qDeleteAll(buckets);
+		Bucket &b = bucketsPool[index];
+
+		qint64 timeout = (qint64)b.timeout * 1000;
+		qint64 jitterMax = qMin(timeout / JITTER_DIVISOR, (qint64)JITTER_MAX);
+		if(jitterMax > 0)
+			timeout += QRandomGenerator::global()->generate() % jitterMax;
+
+		// expires must be >= startTime
+		qint64 expireTime = qMax(now + timeout, startTime);
+
+		b.expires = (quint64)durationToTicksRoundUp(expireTime - startTime);
+		b.timerKey = wheel->add(b.expires, (size_t)index);
+		assert(b.timerKey >= 0);
+
+		updateTimer(now);
 	}
 
-	void removeBucket(Bucket *bucket)
+	void removeBucket(int index)
 	{
-		foreach(HttpSession *hs, bucket->sessions)
+		Bucket &b = bucketsPool[index];
+
+		foreach(HttpSession *hs, b.sessions)
 			bucketsBySession.remove(hs);
 
-		bucketsByTimer.remove(bucket->timer.get());
-		buckets.remove(bucket->key);
-		delete bucket;
+		if(b.timerKey >= 0)
+		{
+			wheel->remove(b.timerKey);
+			b.timerKey = -1;
+		}
+
+		buckets.remove(b.key);
+		b.sessions.clear();
+		b.deferredSessions.clear();
+
+		--uris[b.uriId].refs;
+		releaseUri(b.uriId);
+
+		freeBuckets.push_back(index);
+		--bucketCount;
 	}
 
 	void registerSession(HttpSession *hs, int timeout, const QUrl &uri, bool resetTimeout)
 	{
-		QUrl tmp = uri;
-		tmp.setQuery(QString()); // remove the query part
-		QPair<int, QUrl> key(timeout, tmp);
+		int uriId = internUri(uri);
+		quint64 key = bucketKey(timeout, uriId);
 
-		Bucket *bucket = buckets.value(key);
-		if(bucket)
+		int index = buckets.value(key, -1);
+		if(index >= 0)
 		{
-			if(bucket->sessions.contains(hs))
+			Bucket &b = bucketsPool[index];
+
+			if(b.sessions.contains(hs))
 			{
 				if(resetTimeout)
 				{
 					// flag for later processing
-					bucket->deferredSessions += hs;
+					b.deferredSessions += hs;
 				}
 			}
 			else
 			{
 				// move the session to this bucket
 				unregisterSession(hs);
-				bucket->sessions += hs;
-				bucketsBySession[hs] = bucket;
+				bucketsPool[index].sessions += hs;
+				bucketsBySession[hs] = index;
 			}
 		}
 		else
 		{
 			// bucket doesn't exist. make it and put this session in it
 
+			// reference the uri first, in case unregistering releases it
+			++uris[uriId].refs;
+
 			unregisterSession(hs);
 
-			bucket = new Bucket;
-			bucket->key = key;
-			bucket->sessions += hs;
-			bucket->timer = std::make_unique<Timer>();
-			bucket->timer->timeout.connect(boost::bind(&Private::timer_timeout, this, bucket->timer.get()));
+			ensureWheelCapacity();
 
-			buckets[key] = bucket;
-			bucketsByTimer[bucket->timer.get()] = bucket;
-			bucketsBySession[hs] = bucket;
+			if(!freeBuckets.empty())
+			{
+				index = freeBuckets.back();
+				freeBuckets.pop_back();
+			}
+			else
+			{
+				index = (int)bucketsPool.size();
+				bucketsPool.push_back(Bucket());
+			}
+
+			++bucketCount;
+
+			Bucket &b = bucketsPool[index];
+			b.key = key;
+			b.uriId = uriId;
+			b.timeout = timeout;
+			b.sessions += hs;
 
-			bucket->timer->start(timeout * 1000);
+			buckets[key] = index;
+			bucketsBySession[hs] = index;
+
+			startBucket(index, QDateTime::currentMSecsSinceEpoch());
 		}
 	}
 
 	void unregisterSession(HttpSession *hs)
 	{
-		Bucket *bucket = bucketsBySession.value(hs);
-		if(!bucket)
+		int index = bucketsBySession.value(hs, -1);
+		if(index < 0)
 			return;
 
-		bucket->sessions.remove(hs);
-		bucket->deferredSessions.remove(hs);
+		Bucket &b = bucketsPool[index];
+
+		b.sessions.remove(hs);
+		b.deferredSessions.remove(hs);
 		bucketsBySession.remove(hs);
 
-		if(bucket->sessions.isEmpty())
-			removeBucket(bucket);
+		if(b.sessions.isEmpty())
+			removeBucket(index);
 	}
 
-private:
-	void timer_timeout(Timer *timer)
+	void registerHoldTimeout(HttpSession *hs, int msecs)
+	{
+		unregisterHoldTimeout(hs);
+
+		qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+		// expires must be >= startTime
+		qint64 expireTime = qMax(now + msecs, startTime);
+
+		quint64 slot = (quint64)durationToTicksRoundUp(expireTime - startTime);
+		slot = ((slot + HOLD_SLOT_TICKS - 1) / HOLD_SLOT_TICKS) * HOLD_SLOT_TICKS;
+
+		holdSlots[slot] += hs;
+		holdSlotsBySession.insert(hs, slot);
+
+		updateTimer(now);
+	}
+
+	void unregisterHoldTimeout(HttpSession *hs)
 	{
-		Bucket *bucket = bucketsByTimer.value(timer);
-		if(!bucket)
+		// may be called for sessions of a slot being expired
+		expiringHolds.remove(hs);
+
+		QHash<HttpSession*, quint64>::iterator it = holdSlotsBySession.find(hs);
+		if(it == holdSlotsBySession.end())
 			return;
 
+		QMap<quint64, QSet<HttpSession*>>::iterator sit = holdSlots.find(it.value());
+		assert(sit != holdSlots.end());
+
+		sit.value().remove(hs);
+		if(sit.value().isEmpty())
+			holdSlots.erase(sit);
+
+		holdSlotsBySession.erase(it);
+
+		// the timer is left alone. if it fires early, it is rescheduled
+	}
+
+private:
+	void timer_timeout()
+	{
+		qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+		updateWheel(now);
+
 		QSet<HttpSession*> sessions;
 
-		if(!bucket->deferredSessions.isEmpty())
+		while(true)
 		{
-			foreach(HttpSession *hs, bucket->sessions)
+			TimerWheel::Expired expired = wheel->takeExpired();
+			if(expired.key < 0)
+				break;
+
+			int index = (int)expired.userData;
+			Bucket &b = bucketsPool[index];
+			b.timerKey = -1;
+
+			if(!b.deferredSessions.isEmpty())
 			{
-				if(!bucket->deferredSessions.contains(hs))
+				foreach(HttpSession *hs, b.sessions)
 				{
-					sessions += hs;
-					bucketsBySession.remove(hs);
+					if(!b.deferredSessions.contains(hs))
+					{
+						sessions += hs;
+						bucketsBySession.remove(hs);
+					}
 				}
-			}
 
-			bucket->sessions = bucket->deferredSessions;
-			bucket->deferredSessions.clear();
-			bucket->timer->start();
+				b.sessions = b.deferredSessions;
+				b.deferredSessions.clear();
+				startBucket(index, now);
+			}
+			else
+			{
+				sessions += b.sessions;
+				removeBucket(index);
+			}
 		}
-		else
+
+		while(!holdSlots.isEmpty() && holdSlots.firstKey() <= currentTicks)
 		{
-			sessions = bucket->sessions;
-			removeBucket(bucket);
+			QMap<quint64, QSet<HttpSession*>>::iterator it = holdSlots.begin();
+
+			foreach(HttpSession *hs, it.value())
+			{
+				holdSlotsBySession.remove(hs);
+				expiringHolds += hs;
+			}
+
+			holdSlots.erase(it);
 		}
 
+		updateTimer(now);
+
 		foreach(HttpSession *hs, sessions)
 			hs->update();
+
+		// sessions expiring together respond in the same pass, so that
+		// their identical responses can share zhttp packets
+		while(!expiringHolds.isEmpty())
+		{
+			QSet<HttpSession*>::iterator it = expiringHolds.begin();
+			HttpSession *hs = *it;
+			expiringHolds.erase(it);
+
+			hs->holdTimeout();
+		}
 	}
 };
 
@@ -178,3 +465,13 @@ void HttpSessionUpdateManager::unregisterSession(HttpSession *hs)
 {
 	d->unregisterSession(hs);
 }
+
+void HttpSessionUpdateManager::registerHoldTimeout(HttpSession *hs, int msecs)
+{
+	d->registerHoldTimeout(hs, msecs);
+}
+
+void HttpSessionUpdateManager::unregisterHoldTimeout(HttpSession *hs)
+{
+	d->unregisterHoldTimeout(hs);
+}
@@ -24,8 +24,6 @@
 #ifndef HTTPSESSIONUPDATEMANAGER_H
 #define HTTPSESSIONUPDATEMANAGER_H
 
-#define TIMERS_PER_UNIQUE_UPDATE_REGISTRATION 1
-
 class QUrl;
 class HttpSession;
 
@@ -40,6 +38,12 @@ public:
 
 	void unregisterSession(HttpSession *hs);
 
+	// hold timeouts are grouped into coarse slots, and all sessions of a
+	// slot are expired in a single pass. replaces any existing timeout
+	void registerHoldTimeout(HttpSession *hs, int msecs);
+
+	void unregisterHoldTimeout(HttpSession *hs);
+
 private:
 	class Private;
 	Private *d;
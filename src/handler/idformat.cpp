@@ -25,6 +25,8 @@
 #include <ctype.h>
 #include "format.h"
 
+#define TEMPLATE_CACHE_MAX 1000
+
 namespace IdFormat {
 
 class IdFormatHandler : public Format::Handler
@@ -152,4 +154,138 @@ QByteArray renderId(const QByteArray &data, const QHash<QString, QByteArray> &va
 	return Format::process(data, &handler, 0, error);
 }
 
+// accepts any directive, for checking the syntax of a format
+class SyntaxHandler : public Format::Handler
+{
+public:
+	virtual QByteArray handle(char type, const QByteArray &arg, QString *error) const
+	{
+		Q_UNUSED(type);
+		Q_UNUSED(arg);
+		Q_UNUSED(error);
+
+		return QByteArray("");
+	}
+};
+
+std::shared_ptr<const Template> Template::compile(const QByteArray &format, QString *error)
+{
+	// the syntax is checked by the general processor, so that errors are
+	// reported the same way. the parse below can then assume valid input
+	SyntaxHandler syntax;
+	if(Format::process(format, &syntax, 0, error).isNull())
+		return std::shared_ptr<const Template>();
+
+	auto t = std::make_shared<Template>();
+	t->format_ = format;
+
+	Segment cur;
+	cur.type = 0;
+
+	for(int n = 0; n < format.length(); ++n)
+	{
+		char c = format.at(n);
+
+		if(c != '%')
+		{
+			cur.literal += c;
+			continue;
+		}
+
+		++n;
+		c = format.at(n);
+
+		if(c == '%')
+		{
+			cur.literal += c;
+			continue;
+		}
+
+		Segment d;
+
+		if(c == '(')
+		{
+			for(++n; format.at(n) != ')'; ++n)
+			{
+				if(format.at(n) == '\\')
+					++n;
+
+				d.arg += format.at(n);
+			}
+
+			++n;
+			c = format.at(n);
+		}
+
+		if(!cur.literal.isEmpty())
+		{
+			t->segments_ += cur;
+			cur.literal.clear();
+		}
+
+		d.type = c;
+		t->segments_ += d;
+	}
+
+	if(!cur.literal.isEmpty())
+		t->segments_ += cur;
+
+	return t;
+}
+
+std::shared_ptr<const Template> Template::cached(const QByteArray &format, QString *error)
+{
+	static thread_local QHash<QByteArray, std::shared_ptr<const Template>> cache;
+
+	std::shared_ptr<const Template> t = cache.value(format);
+	if(t)
+		return t;
+
+	t = compile(format, error);
+	if(!t)
+		return t;
+
+	// formats come from subscription meta, and there are normally few of
+	// them. clear rather than grow without bound
+	if(cache.count() >= TEMPLATE_CACHE_MAX)
+		cache.clear();
+
+	cache.insert(format, t);
+
+	return t;
+}
+
+QByteArray Template::render(const QHash<QString, QString> &vars, QString *error) const
+{
+	QByteArray out("");
+
+	foreach(const Segment &s, segments_)
+	{
+		if(s.type == 0)
+		{
+			out += s.literal;
+			continue;
+		}
+
+		QHash<QString, QString>::const_iterator it = (s.type == 's' && !s.arg.isNull()) ? vars.find(QString::fromUtf8(s.arg)) : vars.end();
+		if(it == vars.end() || it.value().isNull())
+		{
+			// let the general processor produce the error message
+			QHash<QString, QByteArray> bvars;
+			QHashIterator<QString, QString> vit(vars);
+			while(vit.hasNext())
+			{
+				vit.next();
+				bvars.insert(vit.key(), vit.value().toUtf8());
+			}
+
+			return renderId(format_, bvars, error);
+		}
+
+		out += it.value().toUtf8();
+	}
+
+	return out;
+}
+
 }
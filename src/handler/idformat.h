@@ -23,9 +23,11 @@
 #ifndef IDFORMAT_H
 #define IDFORMAT_H
 
+#include <memory>
 #include <QByteArray>
 #include <QString>
 #include <QHash>
+#include <QList>
 
 namespace IdFormat {
 
@@ -51,6 +53,34 @@ private:
 
 QByteArray renderId(const QByteArray &data, const QHash<QString, QByteArray> &vars, QString *error = 0);
 
+// an id format parsed ahead of time, so that rendering only needs to
+// substitute the variables
+class Template
+{
+public:
+	// returns null on error
+	static std::shared_ptr<const Template> compile(const QByteArray &format, QString *error = 0);
+
+	// returns a template shared by all users of the format, compiling it
+	// on first use
+	static std::shared_ptr<const Template> cached(const QByteArray &format, QString *error = 0);
+
+	// returns null array on error
+	QByteArray render(const QHash<QString, QString> &vars, QString *error = 0) const;
+
+private:
+	class Segment
+	{
+	public:
+		QByteArray literal;
+		char type; // 0 for literal
+		QByteArray arg;
+	};
+
+	QByteArray format_;
+	QList<Segment> segments_;
+};
+
 }
 
 #endif
@@ -39,6 +39,29 @@ static void renderId()
 	TEST_ASSERT_EQ(ret, QByteArray("My name is Alice and I eat apples 10% of the time."));
 }
 
+static void renderTemplate()
+{
+	QHash<QString, QString> vars;
+	vars["name"] = "Alice";
+	vars["food\\fruit(type)"] = "apples";
+
+	QByteArray sformat = "My name is %(name)s and I eat %(food\\\\fruit(type\\))s 10%% of the time.";
+	std::shared_ptr<const IdFormat::Template> t = IdFormat::Template::compile(sformat);
+	TEST_ASSERT(t);
+	TEST_ASSERT_EQ(t->render(vars), QByteArray("My name is Alice and I eat apples 10% of the time."));
+
+	// same instance for the same format
+	TEST_ASSERT(IdFormat::Template::cached(sformat) == IdFormat::Template::cached(sformat));
+
+	QString error;
+	t = IdFormat::Template::compile("%(name)s %(nope)s");
+	TEST_ASSERT(t);
+	TEST_ASSERT(t->render(vars, &error).isNull());
+	TEST_ASSERT_EQ(error, QString("No such variable 'nope' at position 16"));
+
+	TEST_ASSERT(!IdFormat::Template::compile("unterminated %(name"));
+}
+
 static void renderContent()
 {
 	QByteArray id = "C3PO";
@@ -83,6 +106,7 @@ static void renderContentIncremental()
 extern "C" int idformat_test(ffi::TestException *out_ex)
 {
 	TEST_CATCH(renderId());
+	TEST_CATCH(renderTemplate());
 	TEST_CATCH(renderContent());
 	TEST_CATCH(renderContentIncremental());
 
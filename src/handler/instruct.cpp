@@ -30,6 +30,7 @@
 #include "variantutil.h"
 #include "statusreasons.h"
 #include "filter.h"
+#include "httpheaderindex.h"
 
 #define DEFAULT_RESPONSE_TIMEOUT 55
 #define MINIMUM_RESPONSE_TIMEOUT 5
@@ -96,6 +97,99 @@ static QByteArray unescape(const QByteArray &in)
 	return out;
 }
 
+static bool applyStatus(const QByteArray &statusHeader, HttpResponseData *response, bool *ok, QString *errorMessage)
+{
+	if(statusHeader.isEmpty())
+		return true;
+
+	QByteArray codeStr;
+	QByteArray reason;
+
+	int at = statusHeader.indexOf(' ');
+	if(at != -1)
+	{
+		codeStr = statusHeader.mid(0, at);
+		reason = statusHeader.mid(at + 1);
+	}
+	else
+	{
+		codeStr = statusHeader;
+	}
+
+	bool _ok;
+	response->code = codeStr.toInt(&_ok);
+	if(!_ok || response->code < 0 || response->code > 999)
+	{
+		setError(ok, errorMessage, "Grip-Status contains invalid status code");
+		return false;
+	}
+
+	response->reason = reason;
+
+	return true;
+}
+
+static bool isExposed(const QByteArray &name, const QList<QByteArray> &exposeHeaders)
+{
+	foreach(const QByteArray &e, exposeHeaders)
+	{
+		if(qstricmp(e.data(), name.data()) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+HttpResponseData Instruct::applyResponse(const HttpResponseData &response, const QByteArray &statusHeader, const QList<QByteArray> &exposeHeaders, bool *ok, QString *errorMessage)
+{
+	HttpResponseData newResponse;
+	newResponse.code = response.code;
+	newResponse.reason = response.reason;
+	newResponse.body = response.body;
+
+	if(!applyStatus(statusHeader, &newResponse, ok, errorMessage))
+		return HttpResponseData();
+
+	foreach(const HttpHeader &h, response.headers)
+	{
+		// strip out grip headers
+		if(qstrnicmp(h.first.data(), "Grip-", 5) == 0)
+			continue;
+
+		if(!exposeHeaders.isEmpty() && !isExposed(h.first, exposeHeaders))
+			continue;
+
+		newResponse.headers += h;
+	}
+
+	if(newResponse.reason.isEmpty())
+		newResponse.reason = StatusReasons::getReason(newResponse.code);
+
+	if(ok)
+		*ok = true;
+	return newResponse;
+}
+
+// returns the values of all the given headers, split and parsed as with
+// HttpHeaders::getAllAsParameters
+static QList<HttpHeaderParameters> parseAll(const QList<QByteArray> &values, HttpHeaders::ParseMode mode = HttpHeaders::NoParseFirstParameter)
+{
+	QList<HttpHeaderParameters> out;
+
+	foreach(const QByteArray &value, values)
+	{
+		foreach(const QByteArray &part, HttpHeaders::split(value))
+		{
+			bool ok;
+			HttpHeaderParameters params = HttpHeaders::parseParameters(part, mode, &ok);
+			if(ok)
+				out += params;
+		}
+	}
+
+	return out;
+}
+
 Instruct Instruct::fromResponse(const HttpResponseData &response, bool *ok, QString *errorMessage)
 {
 	HoldMode holdMode = NoHold;
@@ -108,9 +202,56 @@ Instruct Instruct::fromResponse(const HttpResponseData &response, bool *ok, QStr
 	QHash<QString, QString> meta;
 	HttpResponseData newResponse;
 
-	if(response.headers.contains("Grip-Hold"))
+	// classify the headers in a single pass. grip headers are collected by
+	// kind, and the rest are kept for the client response. for the kinds
+	// read once, the first value wins, as with HttpHeaders::get
+	quint32 present = 0; // bit per HttpHeaderIndex::Name
+	QByteArray firstValues[HttpHeaderIndex::NameCount];
+	QList<QByteArray> gripChannelValues;
+	QList<QByteArray> gripExposeValues;
+	QList<QByteArray> gripSetMetaValues;
+	QList<QByteArray> gripLinkValues;
+	HttpHeaders passHeaders;
+
+	foreach(const HttpHeader &h, response.headers)
 	{
-		QByteArray gripHoldStr = response.headers.get("Grip-Hold");
+		bool isGrip = (qstrnicmp(h.first.data(), "Grip-", 5) == 0);
+
+		if(!isGrip)
+			passHeaders += h;
+
+		// besides grip headers, only the first content type is of
+		// interest, so skip the lookup for anything else
+		if(!isGrip && ((present & (1 << HttpHeaderIndex::ContentType)) || h.first.size() != 12))
+			continue;
+
+		HttpHeaderIndex::Name name = HttpHeaderIndex::lookupName(h.first);
+
+		switch(name)
+		{
+			case HttpHeaderIndex::GripChannel: gripChannelValues += h.second; break;
+			case HttpHeaderIndex::GripExposeHeaders: gripExposeValues += h.second; break;
+			case HttpHeaderIndex::GripSetMeta: gripSetMetaValues += h.second; break;
+			case HttpHeaderIndex::GripLink: gripLinkValues += h.second; break;
+			case HttpHeaderIndex::GripHold:
+			case HttpHeaderIndex::GripTimeout:
+			case HttpHeaderIndex::GripKeepAlive:
+			case HttpHeaderIndex::GripStatus:
+			case HttpHeaderIndex::ContentType:
+				if(!(present & (1 << name)))
+					firstValues[name] = h.second;
+				break;
+			default:
+				break;
+		}
+
+		if(name != HttpHeaderIndex::Unknown)
+			present |= (1 << name);
+	}
+
+	if(present & (1 << HttpHeaderIndex::GripHold))
+	{
+		const QByteArray &gripHoldStr = firstValues[HttpHeaderIndex::GripHold];
 		if(gripHoldStr == "response")
 		{
 			holdMode = ResponseHold;
@@ -126,7 +267,7 @@ Instruct Instruct::fromResponse(const HttpResponseData &response, bool *ok, QStr
 		}
 	}
 
-	QList<HttpHeaderParameters> gripChannels = response.headers.getAllAsParameters("Grip-Channel");
+	QList<HttpHeaderParameters> gripChannels = parseAll(gripChannelValues);
 	foreach(const HttpHeaderParameters &gripChannel, gripChannels)
 	{
 		if(gripChannel.isEmpty())
@@ -146,6 +287,16 @@ Instruct Instruct::fromResponse(const HttpResponseData &response, bool *ok, QStr
 			const HttpHeaderParameter &param = gripChannel[n];
 			if(param.first == "filter")
 				c.filters += QString::fromUtf8(param.second);
+			else if(param.first == "prefix")
+				c.prefix = true;
+			else if(param.first == "delta")
+				c.delta = true;
+		}
+
+		if(c.prefix && !c.prevId.isNull())
+		{
+			setError(ok, errorMessage, QString("prev-id can't be used with prefix channel '%1'").arg(c.name));
+			return Instruct();
 		}
 
 		if(c.filters.count() > MESSAGEFILTERSTACK_SIZE_MAX)
@@ -157,10 +308,10 @@ Instruct Instruct::fromResponse(const HttpResponseData &response, bool *ok, QStr
 		channels += c;
 	}
 
-	if(response.headers.contains("Grip-Timeout"))
+	if(present & (1 << HttpHeaderIndex::GripTimeout))
 	{
 		bool x;
-		timeout = response.headers.get("Grip-Timeout").toInt(&x);
+		timeout = firstValues[HttpHeaderIndex::GripTimeout].toInt(&x);
 		if(!x)
 		{
 			setError(ok, errorMessage, "failed to parse Grip-Timeout");
@@ -174,9 +325,12 @@ Instruct Instruct::fromResponse(const HttpResponseData &response, bool *ok, QStr
 		}
 	}
 
-	exposeHeaders = response.headers.getAll("Grip-Expose-Headers");
+	foreach(const QByteArray &value, gripExposeValues)
+		exposeHeaders += HttpHeaders::split(value);
 
-	HttpHeaderParameters keepAliveParams = response.headers.getAsParameters("Grip-Keep-Alive");
+	HttpHeaderParameters keepAliveParams;
+	if(!firstValues[HttpHeaderIndex::GripKeepAlive].isEmpty())
+		keepAliveParams = HttpHeaders::parseParameters(firstValues[HttpHeaderIndex::GripKeepAlive]);
 	if(!keepAliveParams.isEmpty())
 	{
 		QByteArray val = keepAliveParams[0].first;
@@ -247,7 +401,7 @@ Instruct Instruct::fromResponse(const HttpResponseData &response, bool *ok, QStr
 		}
 	}
 
-	QList<HttpHeaderParameters> metaParams = response.headers.getAllAsParameters("Grip-Set-Meta", HttpHeaders::ParseAllParameters);
+	QList<HttpHeaderParameters> metaParams = parseAll(gripSetMetaValues, HttpHeaders::ParseAllParameters);
 	foreach(const HttpHeaderParameters &metaParam, metaParams)
 	{
 		if(metaParam.isEmpty())
@@ -262,40 +416,30 @@ Instruct Instruct::fromResponse(const HttpResponseData &response, bool *ok, QStr
 		meta[key] = val;
 	}
 
-	newResponse = response;
-
-	QByteArray statusHeader = response.headers.get("Grip-Status");
-	if(!statusHeader.isEmpty())
-	{
-		QByteArray codeStr;
-		QByteArray reason;
+	newResponse.code = response.code;
+	newResponse.reason = response.reason;
+	newResponse.body = response.body;
 
-		int at = statusHeader.indexOf(' ');
-		if(at != -1)
-		{
-			codeStr = statusHeader.mid(0, at);
-			reason = statusHeader.mid(at + 1);
-		}
-		else
-		{
-			codeStr = statusHeader;
-		}
+	if(!applyStatus(firstValues[HttpHeaderIndex::GripStatus], &newResponse, ok, errorMessage))
+		return Instruct();
 
-		bool _ok;
-		newResponse.code = codeStr.toInt(&_ok);
-		if(!_ok || newResponse.code < 0 || newResponse.code > 999)
+	if(!exposeHeaders.isEmpty())
+	{
+		foreach(const HttpHeader &h, passHeaders)
 		{
-			setError(ok, errorMessage, "Grip-Status contains invalid status code");
-			return Instruct();
+			if(isExposed(h.first, exposeHeaders))
+				newResponse.headers += h;
 		}
-
-		newResponse.reason = reason;
+	}
+	else
+	{
+		newResponse.headers = passHeaders;
 	}
 
 	QUrl nextLink;
 	int nextLinkTimeout = -1;
 	QUrl goneLink;
-	foreach(const HttpHeaderParameters &params, response.headers.getAllAsParameters("Grip-Link"))
+	foreach(const HttpHeaderParameters &params, parseAll(gripLinkValues))
 	{
 		if(params.count() < 2)
 			continue;
@@ -346,34 +490,15 @@ Instruct Instruct::fromResponse(const HttpResponseData &response, bool *ok, QStr
 		}
 	}
 
-	newResponse.headers.clear();
-	foreach(const HttpHeader &h, response.headers)
+	QByteArray contentTypeValue;
+	if(!firstValues[HttpHeaderIndex::ContentType].isEmpty())
 	{
-		// strip out grip headers
-		if(qstrnicmp(h.first.data(), "Grip-", 5) == 0)
-			continue;
-
-		if(!exposeHeaders.isEmpty())
-		{
-			bool found = false;
-			foreach(const QByteArray &e, exposeHeaders)
-			{
-				if(qstricmp(e.data(), h.first.data()) == 0)
-				{
-					found = true;
-					break;
-				}
-			}
-
-			if(!found)
-				continue;
-		}
-
-		newResponse.headers += HttpHeader(h.first, h.second);
+		HttpHeaderParameters params = HttpHeaders::parseParameters(firstValues[HttpHeaderIndex::ContentType]);
+		if(!params.isEmpty())
+			contentTypeValue = params[0].first;
 	}
 
-	QByteArray contentType = response.headers.getAsFirstParameter("Content-Type");
-	if(contentType == "application/grip-instruct")
+	if(contentTypeValue == "application/grip-instruct")
 	{
 		if(response.code != 200)
 		{
@@ -489,6 +614,36 @@ Instruct Instruct::fromResponse(const HttpResponseData &response, bool *ok, QStr
 					c.filters += filter;
 				}
 
+				if(keyedObjectContains(vchannel, "prefix"))
+				{
+					QVariant vprefix = keyedObjectGetValue(vchannel, "prefix");
+					if(typeId(vprefix) != QMetaType::Bool)
+					{
+						setError(ok, errorMessage, QString("%1 contains 'prefix' with wrong type").arg(cpn));
+						return Instruct();
+					}
+
+					c.prefix = vprefix.toBool();
+				}
+
+				if(keyedObjectContains(vchannel, "delta"))
+				{
+					QVariant vdelta = keyedObjectGetValue(vchannel, "delta");
+					if(typeId(vdelta) != QMetaType::Bool)
+					{
+						setError(ok, errorMessage, QString("%1 contains 'delta' with wrong type").arg(cpn));
+						return Instruct();
+					}
+
+					c.delta = vdelta.toBool();
+				}
+
+				if(c.prefix && !c.prevId.isNull())
+				{
+					setError(ok, errorMessage, QString("prev-id can't be used with prefix channel '%1'").arg(c.name));
+					return Instruct();
+				}
+
 				channels += c;
 			}
 
@@ -54,6 +54,20 @@ public:
 		QString name;
 		QString prevId;
 		QStringList filters;
+
+		// if set, name is a prefix that matches every channel starting
+		// with it. prefix channels don't track a prev-id
+		bool prefix;
+
+		// if set, json items published with delta are received as patches
+		// against the previous document, see HandlerEngine
+		bool delta;
+
+		Channel() :
+			prefix(false),
+			delta(false)
+		{
+		}
 	};
 
 	HoldMode holdMode;
@@ -79,6 +93,11 @@ public:
 	}
 
 	static Instruct fromResponse(const HttpResponseData &response, bool *ok = 0, QString *errorMessage = 0);
+
+	// the response to send to the client: grip headers stripped, only the
+	// exposed headers kept if any are listed, and the status overridden by
+	// a Grip-Status value if not empty
+	static HttpResponseData applyResponse(const HttpResponseData &response, const QByteArray &statusHeader, const QList<QByteArray> &exposeHeaders, bool *ok = 0, QString *errorMessage = 0);
 };
 
 #endif
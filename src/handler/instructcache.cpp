@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "instructcache.h"
+
+InstructCache::InstructCache(int maxCapacity) :
+	maxCapacity_(maxCapacity),
+	hits_(0),
+	misses_(0)
+{
+}
+
+Instruct InstructCache::fromResponse(const HttpResponseData &response, bool *ok, QString *errorMessage)
+{
+	// the key is the grip headers, in order
+	QByteArray key;
+	QByteArray statusHeader;
+	bool statusFound = false;
+
+	foreach(const HttpHeader &h, response.headers)
+	{
+		if(qstrnicmp(h.first.data(), "Grip-", 5) == 0)
+		{
+			key += h.first + ':' + h.second + '\n';
+
+			if(!statusFound && qstricmp(h.first.data(), "Grip-Status") == 0)
+			{
+				statusHeader = h.second;
+				statusFound = true;
+			}
+		}
+		else if(qstricmp(h.first.data(), "Content-Type") == 0 && h.second.startsWith("application/grip-instruct"))
+		{
+			// the instructions are in the body
+			return Instruct::fromResponse(response, ok, errorMessage);
+		}
+	}
+
+	QHash<QByteArray, Entry>::const_iterator it = entries_.constFind(key);
+	if(it != entries_.constEnd())
+	{
+		const Entry &e = it.value();
+
+		Instruct i = e.instruct;
+
+		bool responseOk;
+		i.response = Instruct::applyResponse(response, e.statusHeader, i.exposeHeaders, &responseOk, errorMessage);
+		if(!responseOk)
+		{
+			if(ok)
+				*ok = false;
+			return Instruct();
+		}
+
+		++hits_;
+
+		if(ok)
+			*ok = true;
+		return i;
+	}
+
+	++misses_;
+
+	bool parseOk;
+	Instruct i = Instruct::fromResponse(response, &parseOk, errorMessage);
+	if(!parseOk)
+	{
+		if(ok)
+			*ok = false;
+		return Instruct();
+	}
+
+	// keeping the hottest entries isn't worth the bookkeeping. the set of
+	// distinct grip headers is usually small, so just start over
+	if(entries_.count() >= maxCapacity_)
+		entries_.clear();
+
+	Entry e;
+	e.instruct = i;
+	e.instruct.response = HttpResponseData();
+	e.statusHeader = statusHeader;
+	entries_.insert(key, e);
+
+	if(ok)
+		*ok = true;
+	return i;
+}
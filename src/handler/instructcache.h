@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef INSTRUCTCACHE_H
+#define INSTRUCTCACHE_H
+
+#include <atomic>
+#include <QByteArray>
+#include <QHash>
+#include "instruct.h"
+
+// memoizes Instruct::fromResponse by the response's grip headers. clients
+// that poll repeatedly tend to get the same grip headers from the origin
+// each time, so for those only the client response needs to be rebuilt.
+// responses with grip-instruct content are not cached
+class InstructCache
+{
+public:
+	InstructCache(int maxCapacity);
+
+	Instruct fromResponse(const HttpResponseData &response, bool *ok = 0, QString *errorMessage = 0);
+
+	int count() const { return entries_.count(); }
+
+	// counters may be read from any thread
+	const std::atomic<quint64> *hits() const { return &hits_; }
+	const std::atomic<quint64> *misses() const { return &misses_; }
+
+private:
+	class Entry
+	{
+	public:
+		Instruct instruct; // with an empty response
+		QByteArray statusHeader;
+	};
+
+	QHash<QByteArray, Entry> entries_;
+	int maxCapacity_;
+	std::atomic<quint64> hits_;
+	std::atomic<quint64> misses_;
+};
+
+#endif
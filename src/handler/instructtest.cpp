@@ -25,6 +25,7 @@
 #include "httpheaders.h"
 #include "packet/httpresponsedata.h"
 #include "instruct.h"
+#include "instructcache.h"
 
 static void noHold()
 {
@@ -223,6 +224,78 @@ static void streamHold()
 	TEST_ASSERT_EQ(i.response.body, QByteArray("hello world"));
 }
 
+static void prefixChannels()
+{
+	HttpResponseData data;
+	data.code = 200;
+	data.reason = "OK";
+	data.headers += HttpHeader("Grip-Hold", "stream");
+	data.headers += HttpHeader("Grip-Channel", "ticker.; prefix, apple");
+
+	Instruct i;
+	bool ok;
+	i = Instruct::fromResponse(data, &ok);
+	TEST_ASSERT(ok);
+	TEST_ASSERT_EQ(i.channels.count(), 2);
+	TEST_ASSERT_EQ(i.channels[0].name, QString("ticker."));
+	TEST_ASSERT(i.channels[0].prefix);
+	TEST_ASSERT_EQ(i.channels[1].name, QString("apple"));
+	TEST_ASSERT(!i.channels[1].prefix);
+
+	// prefix channels can't follow an id chain
+	data.headers.clear();
+	data.headers += HttpHeader("Grip-Hold", "stream");
+	data.headers += HttpHeader("Grip-Channel", "ticker.; prefix; prev-id=item1");
+
+	i = Instruct::fromResponse(data, &ok);
+	TEST_ASSERT(!ok);
+
+	data.headers.clear();
+	data.headers += HttpHeader("Content-Type", "application/grip-instruct");
+	data.body = "{\"hold\":{\"mode\":\"stream\",\"channels\":[{\"name\":\"ticker.\",\"prefix\":true},{\"name\":\"apple\",\"prefix\":false}]},\"response\":{\"body\":\"hello world\"}}";
+
+	i = Instruct::fromResponse(data, &ok);
+	TEST_ASSERT(ok);
+	TEST_ASSERT_EQ(i.channels.count(), 2);
+	TEST_ASSERT(i.channels[0].prefix);
+	TEST_ASSERT(!i.channels[1].prefix);
+
+	data.body = "{\"hold\":{\"mode\":\"stream\",\"channels\":[{\"name\":\"ticker.\",\"prefix\":\"yes\"}]},\"response\":{\"body\":\"hello world\"}}";
+
+	i = Instruct::fromResponse(data, &ok);
+	TEST_ASSERT(!ok);
+}
+
+static void deltaChannels()
+{
+	HttpResponseData data;
+	data.code = 200;
+	data.reason = "OK";
+	data.headers += HttpHeader("Grip-Hold", "stream");
+	data.headers += HttpHeader("Grip-Channel", "state; delta, apple");
+
+	Instruct i;
+	bool ok;
+	i = Instruct::fromResponse(data, &ok);
+	TEST_ASSERT(ok);
+	TEST_ASSERT_EQ(i.channels.count(), 2);
+	TEST_ASSERT(i.channels[0].delta);
+	TEST_ASSERT(!i.channels[1].delta);
+
+	data.headers.clear();
+	data.headers += HttpHeader("Content-Type", "application/grip-instruct");
+	data.body = "{\"hold\":{\"mode\":\"stream\",\"channels\":[{\"name\":\"state\",\"delta\":true}]},\"response\":{\"body\":\"hello world\"}}";
+
+	i = Instruct::fromResponse(data, &ok);
+	TEST_ASSERT(ok);
+	TEST_ASSERT(i.channels[0].delta);
+
+	data.body = "{\"hold\":{\"mode\":\"stream\",\"channels\":[{\"name\":\"state\",\"delta\":1}]},\"response\":{\"body\":\"hello world\"}}";
+
+	i = Instruct::fromResponse(data, &ok);
+	TEST_ASSERT(!ok);
+}
+
 static void streamHoldKeepAlive()
 {
 	HttpResponseData data;
@@ -293,13 +366,68 @@ static void streamHoldKeepAlive()
 	TEST_ASSERT(i.keepAliveTimeout > 0);
 }
 
+static void cached()
+{
+	InstructCache cache(10);
+
+	HttpResponseData data;
+	data.code = 200;
+	data.reason = "OK";
+	data.headers += HttpHeader("Content-Type", "text/plain");
+	data.headers += HttpHeader("Grip-Hold", "response");
+	data.headers += HttpHeader("Grip-Channel", "test");
+	data.headers += HttpHeader("Grip-Status", "404");
+	data.body = "timeout 1";
+
+	bool ok;
+	Instruct i = cache.fromResponse(data, &ok);
+	TEST_ASSERT(ok);
+	TEST_ASSERT_EQ(cache.misses()->load(), 1u);
+
+	// same grip headers, different everything else
+	data.headers[0] = HttpHeader("Content-Type", "text/html");
+	data.body = "timeout 2";
+
+	i = cache.fromResponse(data, &ok);
+	TEST_ASSERT(ok);
+	TEST_ASSERT_EQ(cache.hits()->load(), 1u);
+	TEST_ASSERT_EQ(i.holdMode, Instruct::ResponseHold);
+	TEST_ASSERT_EQ(i.channels.count(), 1);
+	TEST_ASSERT_EQ(i.channels[0].name, QString("test"));
+	TEST_ASSERT_EQ(i.response.code, 404);
+	TEST_ASSERT_EQ(i.response.reason, QByteArray("Not Found"));
+	TEST_ASSERT_EQ(i.response.headers.get("Content-Type"), QByteArray("text/html"));
+	TEST_ASSERT(!i.response.headers.contains("Grip-Channel"));
+	TEST_ASSERT_EQ(i.response.body, QByteArray("timeout 2"));
+
+	// different grip headers
+	data.headers += HttpHeader("Grip-Timeout", "120");
+
+	i = cache.fromResponse(data, &ok);
+	TEST_ASSERT(ok);
+	TEST_ASSERT_EQ(cache.misses()->load(), 2u);
+	TEST_ASSERT_EQ(i.timeout, 120);
+	TEST_ASSERT_EQ(cache.count(), 2);
+
+	// errors are not cached
+	data.headers.clear();
+	data.headers += HttpHeader("Grip-Hold", "bogus");
+
+	i = cache.fromResponse(data, &ok);
+	TEST_ASSERT(!ok);
+	TEST_ASSERT_EQ(cache.count(), 2);
+}
+
 extern "C" int instruct_test(ffi::TestException *out_ex)
 {
 	TEST_CATCH(noHold());
 	TEST_CATCH(responseHold());
 	TEST_CATCH(responseHoldChannelParams());
 	TEST_CATCH(streamHold());
+	TEST_CATCH(prefixChannels());
+	TEST_CATCH(deltaChannels());
 	TEST_CATCH(streamHoldKeepAlive());
+	TEST_CATCH(cached());
 
 	return 0;
 }
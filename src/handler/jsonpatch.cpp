@@ -294,9 +294,9 @@ static bool compareJsonValues(const QVariant &a, const QVariant &b)
 	return _compareJsonValues(ca, cb);
 }
 
-QVariant patch(const QVariant &data, const QVariantList &ops, QString *errorMessage)
+bool patchInPlace(QVariant *data, const QVariantList &ops, QString *errorMessage)
 {
-	QVariant out = data;
+	QVariant &out = *data;
 
 	foreach(const QVariant &vop, ops)
 	{
@@ -304,7 +304,7 @@ QVariant patch(const QVariant &data, const QVariantList &ops, QString *errorMess
 		{
 			if(errorMessage)
 				*errorMessage = "invalid op";
-			return QVariant();
+			return false;
 		}
 
 		QString pn = "op";
@@ -312,11 +312,11 @@ QVariant patch(const QVariant &data, const QVariantList &ops, QString *errorMess
 		bool ok;
 		QString type = getString(vop, pn, "op", true, &ok, errorMessage);
 		if(!ok)
-			return QVariant();
+			return false;
 
 		QString path = getString(vop, pn, "path", true, &ok, errorMessage);
 		if(!ok)
-			return QVariant();
+			return false;
 
 		JsonPointer ptr;
 
@@ -325,7 +325,7 @@ QVariant patch(const QVariant &data, const QVariantList &ops, QString *errorMess
 		{
 			ptr = JsonPointer::resolve(&out, path, errorMessage);
 			if(ptr.isNull())
-				return QVariant();
+				return false;
 		}
 
 		if(type == "add")
@@ -334,7 +334,7 @@ QVariant patch(const QVariant &data, const QVariantList &ops, QString *errorMess
 			{
 				if(errorMessage)
 					*errorMessage = "op does not contain 'value'";
-				return QVariant();
+				return false;
 			}
 
 			QVariant value = keyedObjectGetValue(vop, "value");
@@ -346,11 +346,11 @@ QVariant patch(const QVariant &data, const QVariantList &ops, QString *errorMess
 			{
 				if(errorMessage)
 					*errorMessage = "location does not exist";
-				return QVariant();
+				return false;
 			}
 
 			if(!ptr.remove())
-				return QVariant();
+				return false;
 		}
 		else if(type == "replace")
 		{
@@ -358,7 +358,7 @@ QVariant patch(const QVariant &data, const QVariantList &ops, QString *errorMess
 			{
 				if(errorMessage)
 					*errorMessage = "op does not contain 'value'";
-				return QVariant();
+				return false;
 			}
 
 			QVariant value = keyedObjectGetValue(vop, "value");
@@ -367,7 +367,7 @@ QVariant patch(const QVariant &data, const QVariantList &ops, QString *errorMess
 			{
 				if(errorMessage)
 					*errorMessage = "location does not exist";
-				return QVariant();
+				return false;
 			}
 
 			ptr.setValue(value);
@@ -376,31 +376,31 @@ QVariant patch(const QVariant &data, const QVariantList &ops, QString *errorMess
 		{
 			QString from = getString(vop, pn, "from", true, &ok, errorMessage);
 			if(!ok)
-				return QVariant();
+				return false;
 
 			if(JsonPointer::isWithin(path, from))
 			{
 				if(errorMessage)
 					*errorMessage = "cannot move location into itself";
-				return QVariant();
+				return false;
 			}
 
 			JsonPointer fromPtr = JsonPointer::resolve(&out, from, errorMessage);
 			if(fromPtr.isNull())
-				return QVariant();
+				return false;
 
 			if(!fromPtr.exists())
 			{
 				if(errorMessage)
 					*errorMessage = "location does not exist";
-				return QVariant();
+				return false;
 			}
 
 			QVariant value = fromPtr.take();
 
 			ptr = JsonPointer::resolve(&out, path, errorMessage);
 			if(ptr.isNull())
-				return QVariant();
+				return false;
 
 			ptr.setValue(value);
 		}
@@ -408,22 +408,22 @@ QVariant patch(const QVariant &data, const QVariantList &ops, QString *errorMess
 		{
 			QString from = getString(vop, pn, "from", true, &ok, errorMessage);
 			if(!ok)
-				return QVariant();
+				return false;
 
 			JsonPointer fromPtr = JsonPointer::resolve(&out, from, errorMessage);
 			if(fromPtr.isNull())
-				return QVariant();
+				return false;
 
 			if(!fromPtr.exists())
 			{
 				if(errorMessage)
 					*errorMessage = "location does not exist";
-				return QVariant();
+				return false;
 			}
 
 			ptr = JsonPointer::resolve(&out, path, errorMessage);
 			if(ptr.isNull())
-				return QVariant();
+				return false;
 
 			ptr.setValue(fromPtr.value());
 		}
@@ -433,7 +433,7 @@ QVariant patch(const QVariant &data, const QVariantList &ops, QString *errorMess
 			{
 				if(errorMessage)
 					*errorMessage = "op does not contain 'value'";
-				return QVariant();
+				return false;
 			}
 
 			QVariant value = keyedObjectGetValue(vop, "value");
@@ -443,18 +443,122 @@ QVariant patch(const QVariant &data, const QVariantList &ops, QString *errorMess
 			{
 				if(errorMessage)
 					*errorMessage = "tested values are not equal";
-				return QVariant();
+				return false;
 			}
 		}
 		else
 		{
 			if(errorMessage)
 				*errorMessage = QString("unsupported op: %1").arg(type);
-			return QVariant();
+			return false;
 		}
 	}
 
+	return true;
+}
+
+QVariant patch(const QVariant &data, const QVariantList &ops, QString *errorMessage)
+{
+	QVariant out = data;
+	if(!patchInPlace(&out, ops, errorMessage))
+		return QVariant();
+
 	return out;
 }
 
+static QString escapeToken(const QString &in)
+{
+	QString out = in;
+	out.replace('~', "~0");
+	out.replace('/', "~1");
+	return out;
+}
+
+static QVariantMap makeOp(const QString &type, const QString &path, const QVariant &value = QVariant())
+{
+	QVariantMap op;
+	op["op"] = type;
+	op["path"] = path;
+	if(type != "remove")
+		op["value"] = value;
+	return op;
+}
+
+static bool isNumber(const QVariant &in)
+{
+	QMetaType::Type type = typeId(in);
+	return (type == QMetaType::Int || type == QMetaType::UInt || type == QMetaType::LongLong || type == QMetaType::ULongLong || type == QMetaType::Double || type == QMetaType::Float);
+}
+
+// unlike compareJsonValues, numbers are compared exactly
+static bool sameValue(const QVariant &a, const QVariant &b)
+{
+	if(isNumber(a) && isNumber(b))
+		return (a.toDouble() == b.toDouble());
+
+	if(typeId(a) != typeId(b))
+		return false;
+
+	return (a == b);
+}
+
+static void diff(const QVariant &from, const QVariant &to, const QString &path, QVariantList *ops)
+{
+	if(typeId(from) == QMetaType::QVariantMap && typeId(to) == QMetaType::QVariantMap)
+	{
+		QVariantMap fm = from.toMap();
+		QVariantMap tm = to.toMap();
+
+		QMapIterator<QString, QVariant> it(fm);
+		while(it.hasNext())
+		{
+			it.next();
+
+			if(!tm.contains(it.key()))
+				*ops += makeOp("remove", path + '/' + escapeToken(it.key()));
+		}
+
+		QMapIterator<QString, QVariant> tit(tm);
+		while(tit.hasNext())
+		{
+			tit.next();
+			QString childPath = path + '/' + escapeToken(tit.key());
+
+			QVariantMap::const_iterator fit = fm.constFind(tit.key());
+			if(fit == fm.constEnd())
+				*ops += makeOp("add", childPath, tit.value());
+			else
+				diff(fit.value(), tit.value(), childPath, ops);
+		}
+	}
+	else if(typeId(from) == QMetaType::QVariantList && typeId(to) == QMetaType::QVariantList)
+	{
+		QVariantList fl = from.toList();
+		QVariantList tl = to.toList();
+
+		int common = qMin(fl.count(), tl.count());
+
+		for(int n = 0; n < common; ++n)
+			diff(fl[n], tl[n], path + '/' + QString::number(n), ops);
+
+		for(int n = common; n < tl.count(); ++n)
+			*ops += makeOp("add", path + '/' + QString::number(n), tl[n]);
+
+		// remove from the end, so earlier indexes stay valid
+		for(int n = fl.count() - 1; n >= common; --n)
+			*ops += makeOp("remove", path + '/' + QString::number(n));
+	}
+	else if(!sameValue(from, to))
+	{
+		*ops += makeOp("replace", path, to);
+	}
+}
+
+QVariantList diff(const QVariant &from, const QVariant &to)
+{
+	QVariantList ops;
+	diff(convertToJsonStyle(from), convertToJsonStyle(to), QString(), &ops);
+	return ops;
+}
+
 }
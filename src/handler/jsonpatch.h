@@ -29,6 +29,17 @@ namespace JsonPatch {
 
 QVariant patch(const QVariant &data, const QVariantList &ops, QString *errorMessage = 0);
 
+// modifies data directly. only the parts of the document along the patched
+// paths are copied, and only if shared. on failure, data is left partially
+// patched
+bool patchInPlace(QVariant *data, const QVariantList &ops, QString *errorMessage = 0);
+
+// returns the ops that turn from into to, using only add, remove and
+// replace. objects are compared key by key and arrays index by index, so
+// moved elements show up as replacements. returns an empty list if the
+// documents are equal
+QVariantList diff(const QVariant &from, const QVariant &to);
+
 }
 
 #endif
@@ -21,6 +21,8 @@
  * $FANOUT_END_LICENSE$
  */
 
+#include <QJsonDocument>
+#include <QJsonObject>
 #include "test.h"
 #include "qtcompat.h"
 #include "jsonpatch.h"
@@ -92,9 +94,108 @@ static void patch()
 	TEST_ASSERT_EQ(data["fruit"].toList()[0].toMap().value("grapes").toInt(), 5);
 }
 
+static QVariantMap replaceOp(const QString &path, const QVariant &value)
+{
+	QVariantMap op;
+	op["op"] = "replace";
+	op["path"] = path;
+	op["value"] = value;
+	return op;
+}
+
+static void patchInPlace()
+{
+	QVariantMap inner;
+	inner["a"] = 1;
+	inner["b"] = 2;
+	QVariantMap data;
+	data["inner"] = inner;
+	data["list"] = QVariantList() << "x" << "y";
+
+	// patching a copy must not affect the original
+	QVariant orig = data;
+	QVariant out = orig;
+
+	QVariantList ops;
+	ops += replaceOp("/inner/a", 10);
+	ops += replaceOp("/list/1", "z");
+	TEST_ASSERT(JsonPatch::patchInPlace(&out, ops));
+
+	TEST_ASSERT_EQ(out.toMap()["inner"].toMap()["a"].toInt(), 10);
+	TEST_ASSERT_EQ(out.toMap()["inner"].toMap()["b"].toInt(), 2);
+	TEST_ASSERT_EQ(out.toMap()["list"].toList()[1].toString(), QString("z"));
+
+	TEST_ASSERT_EQ(orig.toMap()["inner"].toMap()["a"].toInt(), 1);
+	TEST_ASSERT_EQ(orig.toMap()["list"].toList()[1].toString(), QString("y"));
+
+	// a failing op leaves the document patched up to that point
+	ops.clear();
+	ops += replaceOp("/inner/b", 20);
+	ops += replaceOp("/missing/c", 30);
+	QString msg;
+	TEST_ASSERT(!JsonPatch::patchInPlace(&out, ops, &msg));
+	TEST_ASSERT(!msg.isEmpty());
+	TEST_ASSERT_EQ(out.toMap()["inner"].toMap()["b"].toInt(), 20);
+}
+
+static QVariant parseJson(const char *s)
+{
+	return QJsonDocument::fromJson(QByteArray(s)).toVariant();
+}
+
+static void diff()
+{
+	QVariant from = parseJson("{\"a\": 1, \"b\": {\"c\": \"x\", \"d/e\": true}, \"list\": [1, 2, 3], \"gone\": null}");
+	QVariant to = parseJson("{\"a\": 1.5, \"b\": {\"c\": \"x\", \"d/e\": false}, \"list\": [1, 4], \"new\": [\"y\"]}");
+
+	QVariantList ops = JsonPatch::diff(from, to);
+
+	// unchanged values produce no ops
+	for(const QVariant &op : ops)
+	{
+		QString path = op.toMap().value("path").toString();
+		TEST_ASSERT(path != "/b/c" && path != "/list/0");
+	}
+
+	TEST_ASSERT_EQ(ops.count(), 6);
+
+	// removals of keys come first
+	QVariantMap op = ops[0].toMap();
+	TEST_ASSERT_EQ(op["op"].toString(), QString("remove"));
+	TEST_ASSERT_EQ(op["path"].toString(), QString("/gone"));
+
+	op = ops[1].toMap();
+	TEST_ASSERT_EQ(op["op"].toString(), QString("replace"));
+	TEST_ASSERT_EQ(op["path"].toString(), QString("/a"));
+
+	// keys are escaped
+	op = ops[2].toMap();
+	TEST_ASSERT_EQ(op["path"].toString(), QString("/b/d~1e"));
+
+	QVariant out = JsonPatch::patch(from, ops);
+	TEST_ASSERT(out.isValid());
+	TEST_ASSERT_EQ(QJsonDocument::fromVariant(out).toJson(QJsonDocument::Compact), QJsonDocument::fromVariant(to).toJson(QJsonDocument::Compact));
+
+	// arrays that grow
+	from = parseJson("[1]");
+	to = parseJson("[1, 2, 3]");
+	out = JsonPatch::patch(from, JsonPatch::diff(from, to));
+	TEST_ASSERT_EQ(QJsonDocument::fromVariant(out).toJson(QJsonDocument::Compact), QByteArray("[1,2,3]"));
+
+	// equal documents
+	TEST_ASSERT(JsonPatch::diff(to, to).isEmpty());
+
+	// different root types replace the whole document
+	ops = JsonPatch::diff(parseJson("[1]"), parseJson("{\"a\": 1}"));
+	TEST_ASSERT_EQ(ops.count(), 1);
+	TEST_ASSERT_EQ(ops[0].toMap()["path"].toString(), QString());
+}
+
 extern "C" int jsonpatch_test(ffi::TestException *out_ex)
 {
 	TEST_CATCH(patch());
+	TEST_CATCH(patchInPlace());
+	TEST_CATCH(diff());
 
 	return 0;
 }
@@ -100,9 +100,11 @@ JsonPointer::ExecStatus JsonPointer::execute(QVariant *i, int refIndex, Func fun
 				if(!h.contains(ref.name))
 					return ExecError;
 
+				// drop the variant's reference so h can be modified in place
+				*i = QVariant();
+
 				ExecStatus ret = execute(&h[ref.name], refIndex + 1, func, data);
-				if(ret == ExecChanged)
-					*i = h;
+				*i = h;
 				return ret;
 			}
 			else // Map
@@ -111,9 +113,11 @@ JsonPointer::ExecStatus JsonPointer::execute(QVariant *i, int refIndex, Func fun
 				if(!m.contains(ref.name))
 					return ExecError;
 
+				// drop the variant's reference so m can be modified in place
+				*i = QVariant();
+
 				ExecStatus ret = execute(&m[ref.name], refIndex + 1, func, data);
-				if(ret == ExecChanged)
-					*i = m;
+				*i = m;
 				return ret;
 			}
 		}
@@ -123,9 +127,11 @@ JsonPointer::ExecStatus JsonPointer::execute(QVariant *i, int refIndex, Func fun
 			if(ref.index < 0 || ref.index >= l.count())
 				return ExecError;
 
+			// drop the variant's reference so l can be modified in place
+			*i = QVariant();
+
 			ExecStatus ret = execute(&l[ref.index], refIndex + 1, func, data);
-			if(ret == ExecChanged)
-				*i = l;
+			*i = l;
 			return ret;
 		}
 	}
@@ -232,6 +238,8 @@ QVariant JsonPointer::value() const
 		return QVariant();
 }
 
+// containers are released from their variant before being modified, so
+// that a container not shared elsewhere is changed without a copy
 static bool removeFunc(QVariant *v, const JsonPointer::Ref &ref, void *data)
 {
 	QVariant &ret = *((QVariant *)data);
@@ -249,6 +257,7 @@ static bool removeFunc(QVariant *v, const JsonPointer::Ref &ref, void *data)
 			if(h.contains(ref.name))
 			{
 				ret = true;
+				*v = QVariant();
 				h.remove(ref.name);
 				*v = h;
 				return true;
@@ -262,6 +271,7 @@ static bool removeFunc(QVariant *v, const JsonPointer::Ref &ref, void *data)
 			if(m.contains(ref.name))
 			{
 				ret = true;
+				*v = QVariant();
 				m.remove(ref.name);
 				*v = m;
 				return true;
@@ -276,6 +286,7 @@ static bool removeFunc(QVariant *v, const JsonPointer::Ref &ref, void *data)
 		if(ref.index >= 0 && ref.index < l.count())
 		{
 			ret = true;
+			*v = QVariant();
 			l.removeAt(ref.index);
 			*v = l;
 			return true;
@@ -311,6 +322,7 @@ static bool takeFunc(QVariant *v, const JsonPointer::Ref &ref, void *data)
 			if(h.contains(ref.name))
 			{
 				ret = h.value(ref.name);
+				*v = QVariant();
 				h.remove(ref.name);
 				*v = h;
 				return true;
@@ -324,6 +336,7 @@ static bool takeFunc(QVariant *v, const JsonPointer::Ref &ref, void *data)
 			if(m.contains(ref.name))
 			{
 				ret = m.value(ref.name);
+				*v = QVariant();
 				m.remove(ref.name);
 				*v = m;
 				return true;
@@ -337,7 +350,8 @@ static bool takeFunc(QVariant *v, const JsonPointer::Ref &ref, void *data)
 		QVariantList l = v->toList();
 		if(ref.index >= 0 && ref.index < l.count())
 		{
-			ret = l[ref.index];
+			ret = l.at(ref.index);
+			*v = QVariant();
 			l.removeAt(ref.index);
 			*v = l;
 			return true;
@@ -371,6 +385,7 @@ static bool setValueFunc(QVariant *v, const JsonPointer::Ref &ref, void *_data)
 		if(typeId(*v) == QMetaType::QVariantHash)
 		{
 			QVariantHash h = v->toHash();
+			*v = QVariant();
 			h[ref.name] = data.first;
 			*v = h;
 			data.second = true;
@@ -379,6 +394,7 @@ static bool setValueFunc(QVariant *v, const JsonPointer::Ref &ref, void *_data)
 		else // Map
 		{
 			QVariantMap m = v->toMap();
+			*v = QVariant();
 			m[ref.name] = data.first;
 			*v = m;
 			data.second = true;
@@ -391,6 +407,7 @@ static bool setValueFunc(QVariant *v, const JsonPointer::Ref &ref, void *_data)
 		if(ref.index == -1)
 		{
 			// append
+			*v = QVariant();
 			l += data.first;
 			*v = l;
 			data.second = true;
@@ -398,6 +415,7 @@ static bool setValueFunc(QVariant *v, const JsonPointer::Ref &ref, void *_data)
 		}
 		else if(ref.index >= 0 && ref.index < l.count())
 		{
+			*v = QVariant();
 			l[ref.index] = data.first;
 			*v = l;
 			data.second = true;
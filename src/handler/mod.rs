@@ -54,6 +54,56 @@ mod tests {
         unsafe { ffi::handlerengine_test(out_ex) == 0 }
     }
 
+    fn channelindex_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::channelindex_test(out_ex) == 0 }
+    }
+
+    fn ratelimiter_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::ratelimiter_test(out_ex) == 0 }
+    }
+
+    fn sequencer_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::sequencer_test(out_ex) == 0 }
+    }
+
+    fn publishlastids_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::publishlastids_test(out_ex) == 0 }
+    }
+
+    fn sessioncache_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::sessioncache_test(out_ex) == 0 }
+    }
+
+    fn publishhistory_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::publishhistory_test(out_ex) == 0 }
+    }
+
+    fn statesnapshot_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::statesnapshot_test(out_ex) == 0 }
+    }
+
+    fn slowconsumer_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::slowconsumer_test(out_ex) == 0 }
+    }
+
+    fn channeltrie_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::channeltrie_test(out_ex) == 0 }
+    }
+
+    fn publishconflater_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::publishconflater_test(out_ex) == 0 }
+    }
+
     #[test]
     fn filter() {
         run_serial(filter_test);
@@ -88,4 +138,54 @@ mod tests {
     fn handlerengine() {
         run_serial(handlerengine_test);
     }
+
+    #[test]
+    fn channelindex() {
+        run_serial(channelindex_test);
+    }
+
+    #[test]
+    fn ratelimiter() {
+        run_serial(ratelimiter_test);
+    }
+
+    #[test]
+    fn sequencer() {
+        run_serial(sequencer_test);
+    }
+
+    #[test]
+    fn publishlastids() {
+        run_serial(publishlastids_test);
+    }
+
+    #[test]
+    fn sessioncache() {
+        run_serial(sessioncache_test);
+    }
+
+    #[test]
+    fn publishhistory() {
+        run_serial(publishhistory_test);
+    }
+
+    #[test]
+    fn statesnapshot() {
+        run_serial(statesnapshot_test);
+    }
+
+    #[test]
+    fn slowconsumer() {
+        run_serial(slowconsumer_test);
+    }
+
+    #[test]
+    fn channeltrie() {
+        run_serial(channeltrie_test);
+    }
+
+    #[test]
+    fn publishconflater() {
+        run_serial(publishconflater_test);
+    }
 }
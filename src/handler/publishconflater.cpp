@@ -0,0 +1,264 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "publishconflater.h"
+
+#include <assert.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include "timer.h"
+#include "loopclock.h"
+#include "publishitem.h"
+#include "channeltrie.h"
+#include "statsmanager.h"
+
+static std::atomic<quint64> g_replaced(0);
+static std::atomic<quint64> g_delayed(0);
+
+class PublishConflater::Private
+{
+public:
+	class ChannelState
+	{
+	public:
+		qint64 due; // end of the interval of the last item passed on
+		bool held;
+		PublishItem item;
+
+		ChannelState() :
+			due(0),
+			held(false)
+		{
+		}
+	};
+
+	PublishConflater *q;
+	QHash<QString, int> rates;
+	ChannelTrie prefixes;
+	QHash<QString, ChannelState> channels;
+
+	// each channel state has one entry, at its due time. channels are
+	// forgotten at the end of an interval without a held item
+	std::multimap<qint64, QString> dueChannels;
+
+	std::unique_ptr<Timer> timer;
+	int heldCount;
+
+	Private(PublishConflater *_q) :
+		q(_q),
+		heldCount(0)
+	{
+		timer = std::make_unique<Timer>();
+		timer->setSingleShot(true);
+		timer->timeout.connect(boost::bind(&Private::timer_timeout, this));
+	}
+
+	void setRates(const QHash<QString, int> &_rates)
+	{
+		// release what is held before the rates change
+		release(-1);
+
+		rates = _rates;
+		prefixes = ChannelTrie();
+
+		QHashIterator<QString, int> it(rates);
+		while(it.hasNext())
+		{
+			it.next();
+			prefixes.add(it.key());
+		}
+	}
+
+	// returns the interval in msecs, or 0 for no limit
+	int intervalFor(const QString &channel) const
+	{
+		QList<QString> matches = prefixes.prefixesOf(channel);
+		if(matches.isEmpty())
+			return 0;
+
+		int rate = rates.value(matches.last());
+		if(rate <= 0)
+			return 0;
+
+		return qMax(1000 / rate, 1);
+	}
+
+	bool addItem(const PublishItem &item)
+	{
+		if(!item.conflate || rates.isEmpty())
+			return true;
+
+		int interval = intervalFor(item.channel);
+		if(interval <= 0)
+			return true;
+
+		qint64 now = LoopClock::msecsSinceEpoch();
+
+		QHash<QString, ChannelState>::iterator it = channels.find(item.channel);
+		if(it == channels.end())
+		{
+			// nothing passed on within the interval
+			ChannelState s;
+			s.due = now + interval;
+			channels.insert(item.channel, s);
+			addDue(s.due, item.channel);
+
+			return true;
+		}
+
+		ChannelState &s = it.value();
+
+		if(s.held)
+		{
+			// the held item is replaced. it keeps the prev-id of the first
+			// item it replaced, so the id chain is unbroken
+			QString prevId = s.item.prevId;
+			s.item = item;
+			s.item.prevId = prevId;
+
+			++g_replaced;
+		}
+		else
+		{
+			s.held = true;
+			s.item = item;
+			++heldCount;
+
+			++g_delayed;
+		}
+
+		return false;
+	}
+
+	void addDue(qint64 due, const QString &channel)
+	{
+		bool first = (dueChannels.empty() || due < dueChannels.begin()->first);
+
+		dueChannels.insert(std::make_pair(due, channel));
+
+		if(first)
+			updateTimer();
+	}
+
+	void updateTimer()
+	{
+		if(dueChannels.empty())
+		{
+			timer->stop();
+			return;
+		}
+
+		qint64 now = LoopClock::msecsSinceEpoch();
+		timer->start((int)qMax(dueChannels.begin()->first - now, (qint64)0));
+	}
+
+	// releases held items that are due by the given time, or all of them
+	// if time is negative
+	void release(qint64 time)
+	{
+		QList<PublishItem> ready;
+		qint64 now = LoopClock::msecsSinceEpoch();
+
+		while(!dueChannels.empty() && (time < 0 || dueChannels.begin()->first <= time))
+		{
+			QString channel = dueChannels.begin()->second;
+			dueChannels.erase(dueChannels.begin());
+
+			QHash<QString, ChannelState>::iterator it = channels.find(channel);
+			assert(it != channels.end());
+
+			ChannelState &s = it.value();
+
+			if(s.held && time >= 0)
+			{
+				// the held item starts a new interval
+				ready += s.item;
+				s.item = PublishItem();
+				s.held = false;
+				--heldCount;
+
+				s.due = now + intervalFor(channel);
+				dueChannels.insert(std::make_pair(s.due, channel));
+			}
+			else
+			{
+				if(s.held)
+				{
+					ready += s.item;
+					--heldCount;
+				}
+
+				channels.erase(it);
+			}
+		}
+
+		assert(time >= 0 || heldCount == 0);
+
+		updateTimer();
+
+		// emit last, since handlers may add items
+		foreach(const PublishItem &item, ready)
+			q->itemReady(item);
+	}
+
+	void timer_timeout()
+	{
+		release(LoopClock::msecsSinceEpoch());
+	}
+};
+
+PublishConflater::PublishConflater()
+{
+	d = new Private(this);
+}
+
+PublishConflater::~PublishConflater()
+{
+	delete d;
+}
+
+void PublishConflater::setRates(const QHash<QString, int> &rates)
+{
+	d->setRates(rates);
+}
+
+bool PublishConflater::isEnabled() const
+{
+	return !d->rates.isEmpty();
+}
+
+bool PublishConflater::addItem(const PublishItem &item)
+{
+	return d->addItem(item);
+}
+
+int PublishConflater::heldCount() const
+{
+	return d->heldCount;
+}
+
+void PublishConflater::addToPrometheus(StatsManager *stats)
+{
+	stats->addPrometheusCounter("conflater_delayed_total", "Items held back to keep their channel under its conflation rate", QString(), &g_delayed);
+	stats->addPrometheusCounter("conflater_replaced_total", "Held items replaced by a newer item of the same channel", QString(), &g_replaced);
+}
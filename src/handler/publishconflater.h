@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef PUBLISHCONFLATER_H
+#define PUBLISHCONFLATER_H
+
+#include <QHash>
+#include <boost/signals2.hpp>
+
+class QString;
+class PublishItem;
+class StatsManager;
+
+// limits the rate of items per channel, for items that ask for it with
+// the conflate flag. an item arriving sooner than the rate allows is held,
+// replacing any item already held for the channel, so that the latest
+// wins. the held item is released when the interval ends. the rate of a
+// channel is the one of its longest matching prefix
+class PublishConflater
+{
+public:
+	PublishConflater();
+	~PublishConflater();
+
+	// k=channel prefix, v=max items per second. a rate of 0 or less turns
+	// conflation off for channels under the prefix. held items are
+	// released
+	void setRates(const QHash<QString, int> &rates);
+
+	bool isEnabled() const;
+
+	// returns true if the item should be passed on now. otherwise the item
+	// is held, and later emitted by itemReady
+	bool addItem(const PublishItem &item);
+
+	int heldCount() const;
+
+	boost::signals2::signal<void(const PublishItem&)> itemReady;
+
+	// counts are shared by all instances
+	static void addToPrometheus(StatsManager *stats);
+
+private:
+	class Private;
+	friend class Private;
+	Private *d;
+};
+
+#endif
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include <qtestsupport_core.h>
+#include "test.h"
+#include "timer.h"
+#include "defercall.h"
+#include "publishitem.h"
+#include "publishconflater.h"
+
+namespace {
+
+class LoopState
+{
+public:
+	LoopState()
+	{
+		Timer::init(100);
+	}
+
+	~LoopState()
+	{
+		DeferCall::cleanup();
+		Timer::deinit();
+	}
+};
+
+class TestState
+{
+public:
+	LoopState loop;
+	PublishConflater conflater;
+	QStringList out;
+
+	TestState()
+	{
+		conflater.itemReady.connect([this](const PublishItem &item) {
+			out += item.channel + ":" + item.prevId + ":" + item.id;
+		});
+	}
+};
+
+}
+
+static PublishItem makeItem(const QString &channel, const QString &id, const QString &prevId = QString(), bool conflate = true)
+{
+	PublishItem i;
+	i.channel = channel;
+	i.id = id;
+	i.prevId = prevId;
+	i.conflate = conflate;
+	return i;
+}
+
+static void latestWins()
+{
+	TestState s;
+
+	QHash<QString, int> rates;
+	rates["scores."] = 10;
+	s.conflater.setRates(rates);
+	TEST_ASSERT(s.conflater.isEnabled());
+
+	TEST_ASSERT(s.conflater.addItem(makeItem("scores.a", "1")));
+	TEST_ASSERT(!s.conflater.addItem(makeItem("scores.a", "2", "1")));
+	TEST_ASSERT(!s.conflater.addItem(makeItem("scores.a", "3", "2")));
+	TEST_ASSERT_EQ(s.conflater.heldCount(), 1);
+
+	// other channels have their own interval
+	TEST_ASSERT(s.conflater.addItem(makeItem("scores.b", "1")));
+
+	// not opted in, or not covered by a rate
+	TEST_ASSERT(s.conflater.addItem(makeItem("scores.a", "4", QString(), false)));
+	TEST_ASSERT(s.conflater.addItem(makeItem("news.a", "1")));
+
+	for(int n = 0; n < 100 && s.out.isEmpty(); ++n)
+		QTest::qWait(10);
+
+	// the held item keeps the prev-id of the item it replaced
+	TEST_ASSERT(s.out == QStringList() << "scores.a:1:3");
+	TEST_ASSERT_EQ(s.conflater.heldCount(), 0);
+
+	// the release started a new interval
+	TEST_ASSERT(!s.conflater.addItem(makeItem("scores.a", "5")));
+
+	// changing the rates releases held items
+	s.out.clear();
+	s.conflater.setRates(QHash<QString, int>());
+	TEST_ASSERT(s.out == QStringList() << "scores.a::5");
+	TEST_ASSERT(!s.conflater.isEnabled());
+	TEST_ASSERT(s.conflater.addItem(makeItem("scores.a", "6")));
+}
+
+static void longestPrefix()
+{
+	TestState s;
+
+	QHash<QString, int> rates;
+	rates[""] = 10;
+	rates["live."] = 0;
+	s.conflater.setRates(rates);
+
+	TEST_ASSERT(s.conflater.addItem(makeItem("apple", "1")));
+	TEST_ASSERT(!s.conflater.addItem(makeItem("apple", "2")));
+
+	// turned off under the longer prefix
+	TEST_ASSERT(s.conflater.addItem(makeItem("live.a", "1")));
+	TEST_ASSERT(s.conflater.addItem(makeItem("live.a", "2")));
+}
+
+extern "C" int publishconflater_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(latestWins());
+	TEST_CATCH(longestPrefix());
+
+	return 0;
+}
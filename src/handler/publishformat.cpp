@@ -372,6 +372,27 @@ PublishFormat PublishFormat::fromVariant(Type type, const QVariant &in, bool *ok
 				}
 			}
 
+			QString coalesceStr = getString(in, pn, "coalesce", false, &ok_, errorMessage);
+			if(!ok_)
+			{
+				if(ok)
+					*ok = false;
+				return PublishFormat();
+			}
+
+			if(!coalesceStr.isNull())
+			{
+				if(coalesceStr == "latest")
+					out.coalesce = CoalesceLatest;
+				else if(coalesceStr == "patch")
+					out.coalesce = CoalescePatch;
+				else
+				{
+					setError(ok, errorMessage, QString("%1 contains 'coalesce' with unknown value").arg(pn));
+					return PublishFormat();
+				}
+			}
+
 			if(keyedObjectContains(in, "content-filters"))
 			{
 				QVariant vfilters = keyedObjectGetValue(in, "content-filters");
@@ -486,3 +507,443 @@ PublishFormat PublishFormat::fromVariant(Type type, const QVariant &in, bool *ok
 		*ok = true;
 	return out;
 }
+
+static bool viewToInt(const TnetString::View &in, int *out)
+{
+	bool ok;
+
+	// mirror the conversions the variant path allows
+	if(in.type() == TnetString::ByteArray)
+		*out = in.toByteArray().toInt();
+	else if(in.type() == TnetString::Bool)
+		*out = in.toBool() ? 1 : 0;
+	else
+	{
+		*out = (int)in.toInt(&ok);
+		return ok;
+	}
+
+	return true;
+}
+
+static bool parseContentFilters(const TnetString::View &in, QStringList *filters, const QString &pn, bool *ok, QString *errorMessage)
+{
+	if(in.type() != TnetString::List)
+	{
+		setError(ok, errorMessage, QString("%1 contains 'content-filters' with wrong type").arg(pn));
+		return false;
+	}
+
+	TnetString::View::Iterator it(in);
+	while(it.next())
+	{
+		if(it.value().type() != TnetString::ByteArray)
+		{
+			setError(ok, errorMessage, "content-filters contains element with wrong type");
+			return false;
+		}
+
+		*filters += QString::fromUtf8(it.value().toByteArray());
+	}
+
+	if(it.isError())
+	{
+		setError(ok, errorMessage, QString("%1 contains 'content-filters' with invalid format").arg(pn));
+		return false;
+	}
+
+	return true;
+}
+
+static bool parseHeaders(const TnetString::View &in, HttpHeaders *headers, const QString &pn, bool *ok, QString *errorMessage)
+{
+	if(in.type() == TnetString::List)
+	{
+		TnetString::View::Iterator it(in);
+		while(it.next())
+		{
+			const TnetString::View &vheader = it.value();
+			if(vheader.type() != TnetString::List)
+			{
+				setError(ok, errorMessage, "headers contains element with wrong type");
+				return false;
+			}
+
+			TnetString::View parts[2];
+			int count = 0;
+
+			TnetString::View::Iterator hit(vheader);
+			while(hit.next())
+			{
+				if(count < 2)
+					parts[count] = hit.value();
+				++count;
+			}
+
+			if(hit.isError())
+			{
+				setError(ok, errorMessage, "headers contains element with invalid format");
+				return false;
+			}
+
+			if(count != 2)
+			{
+				setError(ok, errorMessage, "headers contains list with wrong number of elements");
+				return false;
+			}
+
+			if(parts[0].type() != TnetString::ByteArray)
+			{
+				setError(ok, errorMessage, "header contains name element with wrong type");
+				return false;
+			}
+
+			if(parts[1].type() != TnetString::ByteArray)
+			{
+				setError(ok, errorMessage, "header contains value element with wrong type");
+				return false;
+			}
+
+			*headers += HttpHeader(parts[0].toByteArray(), parts[1].toByteArray());
+		}
+
+		if(it.isError())
+		{
+			setError(ok, errorMessage, QString("%1 contains 'headers' with invalid format").arg(pn));
+			return false;
+		}
+	}
+	else if(in.type() == TnetString::Hash)
+	{
+		TnetString::View::Iterator it(in);
+		while(it.next())
+		{
+			if(it.value().type() != TnetString::ByteArray)
+			{
+				QString key = QString::fromUtf8(it.key().toByteArray());
+				setError(ok, errorMessage, QString("headers contains '%1' with wrong type").arg(key));
+				return false;
+			}
+
+			*headers += HttpHeader(it.key().toByteArray(), it.value().toByteArray());
+		}
+
+		if(it.isError())
+		{
+			setError(ok, errorMessage, QString("%1 contains 'headers' with invalid format").arg(pn));
+			return false;
+		}
+	}
+	else
+	{
+		setError(ok, errorMessage, QString("%1 contains 'headers' with wrong type").arg(pn));
+		return false;
+	}
+
+	return true;
+}
+
+PublishFormat PublishFormat::fromView(Type type, const TnetString::View &in, bool *ok, QString *errorMessage)
+{
+	QString pn;
+	if(type == HttpResponse)
+		pn = "'http-response'";
+	else if(type == HttpStream)
+		pn = "'http-stream'";
+	else // WebSocketMessage
+		pn = "'ws-message'";
+
+	if(!in.isValid() || in.type() != TnetString::Hash)
+	{
+		setError(ok, errorMessage, QString("%1 is not an object").arg(pn));
+		return PublishFormat();
+	}
+
+	// collect the fields in one pass, then interpret them
+	TnetString::View vaction, vcode, vreason, vheaders, vfilters, vbody, vbodyPatch, vcontent, vcontentBin, vtype, vcoalesce;
+
+	TnetString::View::Iterator it(in);
+	while(it.next())
+	{
+		const TnetString::View &k = it.key();
+		const TnetString::View &v = it.value();
+
+		if(k.equals("action"))
+			vaction = v;
+		else if(k.equals("code"))
+			vcode = v;
+		else if(k.equals("reason"))
+			vreason = v;
+		else if(k.equals("headers"))
+			vheaders = v;
+		else if(k.equals("content-filters"))
+			vfilters = v;
+		else if(k.equals("body"))
+			vbody = v;
+		else if(k.equals("body-patch"))
+			vbodyPatch = v;
+		else if(k.equals("content"))
+			vcontent = v;
+		else if(k.equals("content-bin"))
+			vcontentBin = v;
+		else if(k.equals("type"))
+			vtype = v;
+		else if(k.equals("coalesce"))
+			vcoalesce = v;
+	}
+
+	if(it.isError())
+	{
+		setError(ok, errorMessage, QString("%1 has invalid format").arg(pn));
+		return PublishFormat();
+	}
+
+	PublishFormat out(type);
+
+	if(vaction.isValid() && vaction.type() != TnetString::ByteArray)
+	{
+		setError(ok, errorMessage, QString("%1 contains 'action' with wrong type").arg(pn));
+		return PublishFormat();
+	}
+
+	if(vreason.isValid() && vreason.type() != TnetString::ByteArray)
+	{
+		setError(ok, errorMessage, QString("%1 contains 'reason' with wrong type").arg(pn));
+		return PublishFormat();
+	}
+
+	if(!vaction.isValid() || vaction.equals("send")) // default
+	{
+		out.action = Send;
+	}
+	else if(vaction.equals("hint"))
+	{
+		out.action = Hint;
+	}
+	else if(vaction.equals("close"))
+	{
+		out.action = Close;
+	}
+	else if(vaction.equals("refresh"))
+	{
+		out.action = Refresh;
+	}
+	else
+	{
+		if(ok)
+			*ok = false;
+		return PublishFormat();
+	}
+
+	if(type == HttpResponse)
+	{
+		if(out.action == Send)
+		{
+			if(vcode.isValid())
+			{
+				if(!viewToInt(vcode, &out.code))
+				{
+					setError(ok, errorMessage, QString("%1 contains 'code' with wrong type").arg(pn));
+					return PublishFormat();
+				}
+
+				if(out.code < 0 || out.code > 999)
+				{
+					setError(ok, errorMessage, QString("%1 contains 'code' with invalid value").arg(pn));
+					return PublishFormat();
+				}
+			}
+			else
+				out.code = 200;
+
+			QByteArray reason;
+			if(vreason.isValid())
+				reason = vreason.toByteArray();
+
+			if(!reason.isEmpty())
+				out.reason = reason;
+			else
+				out.reason = StatusReasons::getReason(out.code);
+
+			if(vheaders.isValid() && !parseHeaders(vheaders, &out.headers, pn, ok, errorMessage))
+				return PublishFormat();
+
+			if(vfilters.isValid())
+			{
+				if(!parseContentFilters(vfilters, &out.contentFilters, pn, ok, errorMessage))
+					return PublishFormat();
+
+				out.haveContentFilters = true;
+			}
+
+			if(vbody.isValid())
+			{
+				if(vbody.type() != TnetString::ByteArray)
+				{
+					setError(ok, errorMessage, QString("%1 contains 'body' with wrong type").arg(pn));
+					return PublishFormat();
+				}
+
+				out.body = vbody.toByteArray();
+			}
+			else if(vbodyPatch.isValid())
+			{
+				bool ok_;
+				QVariant v = vbodyPatch.toVariant(&ok_);
+				if(!ok_ || typeId(v) != QMetaType::QVariantList)
+				{
+					setError(ok, errorMessage, QString("%1 contains 'body-patch' with wrong type").arg(pn));
+					return PublishFormat();
+				}
+
+				out.bodyPatch = v.toList();
+				out.haveBodyPatch = true;
+			}
+			else
+			{
+				setError(ok, errorMessage, QString("%1 does not contain 'body' or 'body-patch'").arg(pn));
+				return PublishFormat();
+			}
+		}
+	}
+	else if(type == HttpStream)
+	{
+		if(out.action == Send)
+		{
+			if(vfilters.isValid())
+			{
+				if(!parseContentFilters(vfilters, &out.contentFilters, pn, ok, errorMessage))
+					return PublishFormat();
+
+				out.haveContentFilters = true;
+			}
+
+			if(vcontent.isValid())
+			{
+				if(vcontent.type() != TnetString::ByteArray)
+				{
+					setError(ok, errorMessage, QString("%1 contains 'content' with wrong type").arg(pn));
+					return PublishFormat();
+				}
+
+				out.body = vcontent.toByteArray();
+			}
+			else
+			{
+				setError(ok, errorMessage, QString("%1 does not contain 'content'").arg(pn));
+				return PublishFormat();
+			}
+		}
+	}
+	else if(type == WebSocketMessage)
+	{
+		if(out.action == Send)
+		{
+			if(vtype.isValid())
+			{
+				if(vtype.type() != TnetString::ByteArray)
+				{
+					setError(ok, errorMessage, QString("%1 contains 'type' with wrong type").arg(pn));
+					return PublishFormat();
+				}
+
+				if(vtype.equals("text"))
+					out.messageType = Text;
+				else if(vtype.equals("binary"))
+					out.messageType = Binary;
+				else if(vtype.equals("ping"))
+					out.messageType = Ping;
+				else if(vtype.equals("pong"))
+					out.messageType = Pong;
+				else
+				{
+					setError(ok, errorMessage, QString("%1 contains 'type' with unknown value").arg(pn));
+					return PublishFormat();
+				}
+			}
+
+			if(vcoalesce.isValid())
+			{
+				if(vcoalesce.type() != TnetString::ByteArray)
+				{
+					setError(ok, errorMessage, QString("%1 contains 'coalesce' with wrong type").arg(pn));
+					return PublishFormat();
+				}
+
+				if(vcoalesce.equals("latest"))
+					out.coalesce = CoalesceLatest;
+				else if(vcoalesce.equals("patch"))
+					out.coalesce = CoalescePatch;
+				else
+				{
+					setError(ok, errorMessage, QString("%1 contains 'coalesce' with unknown value").arg(pn));
+					return PublishFormat();
+				}
+			}
+
+			if(vfilters.isValid())
+			{
+				if(!parseContentFilters(vfilters, &out.contentFilters, pn, ok, errorMessage))
+					return PublishFormat();
+
+				out.haveContentFilters = true;
+			}
+
+			if(vcontentBin.isValid())
+			{
+				if(vcontentBin.type() != TnetString::ByteArray)
+				{
+					setError(ok, errorMessage, QString("%1 contains 'content-bin' with wrong type").arg(pn));
+					return PublishFormat();
+				}
+
+				out.body = vcontentBin.toByteArray();
+
+				if(((int)out.messageType) == -1)
+					out.messageType = Binary;
+			}
+			else if(vcontent.isValid())
+			{
+				if(vcontent.type() != TnetString::ByteArray)
+				{
+					setError(ok, errorMessage, QString("%1 contains 'content' with wrong type").arg(pn));
+					return PublishFormat();
+				}
+
+				out.body = vcontent.toByteArray();
+
+				if(((int)out.messageType) == -1)
+					out.messageType = Text;
+			}
+			else if(out.messageType == Text || out.messageType == Binary || ((int)out.messageType) == -1)
+			{
+				setError(ok, errorMessage, QString("%1 does not contain 'content' or 'content-bin'").arg(pn));
+				return PublishFormat();
+			}
+		}
+		else if(out.action == Close)
+		{
+			if(vcode.isValid())
+			{
+				if(!viewToInt(vcode, &out.code))
+				{
+					setError(ok, errorMessage, QString("%1 contains 'code' with wrong type").arg(pn));
+					return PublishFormat();
+				}
+
+				if(out.code < 0)
+				{
+					setError(ok, errorMessage, QString("%1 contains 'code' with invalid value").arg(pn));
+					return PublishFormat();
+				}
+			}
+
+			if(vreason.isValid())
+				out.reason = vreason.toByteArray();
+		}
+	}
+
+	if(ok)
+		*ok = true;
+	return out;
+}
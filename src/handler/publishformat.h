@@ -27,6 +27,7 @@
 #include <QString>
 #include <QVariant>
 #include "httpheaders.h"
+#include "tnetstring.h"
 
 class PublishFormat
 {
@@ -54,6 +55,14 @@ public:
 		Pong
 	};
 
+	// how a slow consumer may combine queued messages of the same channel
+	enum Coalesce
+	{
+		NoCoalesce,
+		CoalesceLatest, // only the most recent message is kept
+		CoalescePatch // messages are json patches, concatenated
+	};
+
 	Type type;
 	Action action; // response/stream/ws
 	int code; // response/ws
@@ -63,6 +72,7 @@ public:
 	bool haveBodyPatch; // response
 	QVariantList bodyPatch; // response
 	MessageType messageType; // ws
+	Coalesce coalesce; // ws
 	bool haveContentFilters;
 	QStringList contentFilters; // response/stream/ws
 
@@ -72,6 +82,7 @@ public:
 		code(-1),
 		haveBodyPatch(false),
 		messageType((MessageType)-1),
+		coalesce(NoCoalesce),
 		haveContentFilters(false)
 	{
 	}
@@ -82,11 +93,15 @@ public:
 		code(-1),
 		haveBodyPatch(false),
 		messageType((MessageType)-1),
+		coalesce(NoCoalesce),
 		haveContentFilters(false)
 	{
 	}
 
 	static PublishFormat fromVariant(Type type, const QVariant &in, bool *ok = 0, QString *errorMessage = 0);
+
+	// decodes directly from tnetstring data, without building a variant
+	static PublishFormat fromView(Type type, const TnetString::View &in, bool *ok = 0, QString *errorMessage = 0);
 };
 
 #endif
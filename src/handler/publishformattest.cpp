@@ -23,6 +23,8 @@
 
 #include "test.h"
 #include <QVariant>
+#include "tnetstring.h"
+#include "wscontrol.h"
 #include "publishformat.h"
 
 static void responseFormat()
@@ -123,11 +125,50 @@ static void webSocketMessageFormat()
 	TEST_ASSERT_EQ(f.code, 1001);
 }
 
+static void webSocketMessageCoalesce()
+{
+	QVariantHash data;
+	data["content"] = QByteArray("[]");
+
+	bool ok;
+	PublishFormat f = PublishFormat::fromVariant(PublishFormat::WebSocketMessage, data, &ok);
+	TEST_ASSERT(ok);
+	TEST_ASSERT_EQ((int)f.coalesce, (int)PublishFormat::NoCoalesce);
+
+	data["coalesce"] = QByteArray("latest");
+
+	f = PublishFormat::fromVariant(PublishFormat::WebSocketMessage, data, &ok);
+	TEST_ASSERT(ok);
+	TEST_ASSERT_EQ((int)f.coalesce, (int)PublishFormat::CoalesceLatest);
+
+	data["coalesce"] = QByteArray("patch");
+
+	QByteArray buf = TnetString::fromVariant(data);
+	f = PublishFormat::fromView(PublishFormat::WebSocketMessage, TnetString::View(buf), &ok);
+	TEST_ASSERT(ok);
+	TEST_ASSERT_EQ((int)f.coalesce, (int)PublishFormat::CoalescePatch);
+
+	data["coalesce"] = QByteArray("bogus");
+
+	f = PublishFormat::fromVariant(PublishFormat::WebSocketMessage, data, &ok);
+	TEST_ASSERT(!ok);
+
+	buf = TnetString::fromVariant(data);
+	f = PublishFormat::fromView(PublishFormat::WebSocketMessage, TnetString::View(buf), &ok);
+	TEST_ASSERT(!ok);
+
+	QByteArray out;
+	TEST_ASSERT(WsControl::concatPatches("[{\"op\":\"add\"}]", "[{\"op\":\"remove\"}]", &out));
+	TEST_ASSERT_EQ(out, QByteArray("[{\"op\":\"add\"},{\"op\":\"remove\"}]"));
+	TEST_ASSERT(!WsControl::concatPatches("[]", "{}", &out));
+}
+
 extern "C" int publishformat_test(ffi::TestException *out_ex)
 {
 	TEST_CATCH(responseFormat());
 	TEST_CATCH(streamFormat());
 	TEST_CATCH(webSocketMessageFormat());
+	TEST_CATCH(webSocketMessageCoalesce());
 
 	return 0;
 }
@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "publishhistory.h"
+
+#include <assert.h>
+
+// rough per-item bookkeeping cost, on top of the payload
+#define ITEM_OVERHEAD 256
+
+PublishHistory::PublishHistory(int depth, qint64 memoryMax) :
+	head_(-1),
+	tail_(-1),
+	depth_(depth),
+	memoryMax_(memoryMax),
+	memoryUsed_(0),
+	itemCount_(0),
+	evictions_(0)
+{
+}
+
+void PublishHistory::setLimits(int depth, qint64 memoryMax)
+{
+	depth_ = depth;
+	memoryMax_ = memoryMax;
+
+	if(depth_ <= 0)
+	{
+		clear();
+		return;
+	}
+
+	foreach(int pos, table_)
+	{
+		Channel &c = channels_[pos];
+		while((int)c.entries.size() > depth_)
+			popOldest(pos);
+	}
+
+	enforceMemoryMax();
+}
+
+void PublishHistory::add(const PublishItem &item)
+{
+	if(depth_ <= 0)
+		return;
+
+	if(item.id.isNull())
+	{
+		remove(item.channel);
+		return;
+	}
+
+	int size = itemSize(item);
+
+	// an item larger than the whole history can't be kept, and the
+	// history can no longer continue from the channel's last id
+	if(memoryMax_ > 0 && size > memoryMax_)
+	{
+		remove(item.channel);
+		return;
+	}
+
+	int pos = table_.value(item.channel, -1);
+	if(pos >= 0)
+	{
+		Channel &c = channels_[pos];
+
+		// restart if the item doesn't continue the run
+		if(!c.entries.empty() && c.entries.back().item.id != item.prevId)
+		{
+			while(!c.entries.empty())
+				popOldest(pos);
+		}
+
+		if(pos != head_)
+		{
+			unlink(pos);
+			link(pos);
+		}
+	}
+	else
+	{
+		if(!freeChannels_.empty())
+		{
+			pos = freeChannels_.back();
+			freeChannels_.pop_back();
+		}
+		else
+		{
+			pos = (int)channels_.size();
+			channels_.push_back(Channel());
+		}
+
+		channels_[pos].name = item.channel;
+		link(pos);
+
+		table_.insert(item.channel, pos);
+	}
+
+	Channel &c = channels_[pos];
+
+	Entry e;
+	e.item = item;
+	e.size = size;
+	c.entries.push_back(e);
+	memoryUsed_ += size;
+	++itemCount_;
+
+	while((int)c.entries.size() > depth_)
+		popOldest(pos);
+
+	enforceMemoryMax();
+}
+
+void PublishHistory::remove(const QString &channel)
+{
+	int pos = table_.value(channel, -1);
+	if(pos >= 0)
+		removeAt(pos);
+}
+
+void PublishHistory::clear()
+{
+	table_.clear();
+	channels_.clear();
+	freeChannels_.clear();
+	head_ = -1;
+	tail_ = -1;
+	memoryUsed_ = 0;
+	itemCount_ = 0;
+}
+
+bool PublishHistory::itemsAfter(const QString &channel, const QString &prevId, QList<PublishItem> *out) const
+{
+	int pos = table_.value(channel, -1);
+	if(pos < 0 || prevId.isNull())
+		return false;
+
+	const std::deque<Entry> &entries = channels_[pos].entries;
+
+	// search from the newest, since callers are usually only a few
+	// items behind
+	int n = (int)entries.size() - 1;
+	for(; n >= 0; --n)
+	{
+		if(entries[n].item.id == prevId)
+			break;
+	}
+
+	if(n < 0)
+		return false;
+
+	for(++n; n < (int)entries.size(); ++n)
+		*out += entries[n].item;
+
+	return true;
+}
+
+int PublishHistory::itemSize(const PublishItem &item)
+{
+	int size = ITEM_OVERHEAD + (item.channel.size() + item.id.size() + item.prevId.size()) * 2;
+
+	QHashIterator<PublishFormat::Type, PublishFormat> it(item.formats);
+	while(it.hasNext())
+	{
+		it.next();
+		const PublishFormat &f = it.value();
+
+		size += f.body.size() + f.reason.size();
+
+		foreach(const HttpHeader &h, f.headers)
+			size += h.first.size() + h.second.size();
+	}
+
+	QHashIterator<QString, QString> mit(item.meta);
+	while(mit.hasNext())
+	{
+		mit.next();
+		size += (mit.key().size() + mit.value().size()) * 2;
+	}
+
+	return size;
+}
+
+void PublishHistory::popOldest(int pos)
+{
+	Channel &c = channels_[pos];
+	assert(!c.entries.empty());
+
+	memoryUsed_ -= c.entries.front().size;
+	--itemCount_;
+	c.entries.pop_front();
+}
+
+void PublishHistory::removeAt(int pos)
+{
+	Channel &c = channels_[pos];
+
+	while(!c.entries.empty())
+		popOldest(pos);
+
+	table_.remove(c.name);
+	unlink(pos);
+
+	// release the memory, but keep the slot for reuse
+	c = Channel();
+	freeChannels_.push_back(pos);
+}
+
+void PublishHistory::enforceMemoryMax()
+{
+	if(memoryMax_ <= 0)
+		return;
+
+	while(memoryUsed_ > memoryMax_)
+	{
+		assert(tail_ >= 0);
+		int pos = tail_;
+
+		popOldest(pos);
+		++evictions_;
+
+		if(channels_[pos].entries.empty())
+			removeAt(pos);
+	}
+}
+
+void PublishHistory::link(int pos)
+{
+	Channel &c = channels_[pos];
+	c.prev = -1;
+	c.next = head_;
+
+	if(head_ >= 0)
+		channels_[head_].prev = pos;
+	else
+		tail_ = pos;
+
+	head_ = pos;
+}
+
+void PublishHistory::unlink(int pos)
+{
+	Channel &c = channels_[pos];
+
+	if(c.prev >= 0)
+		channels_[c.prev].next = c.next;
+	else
+		head_ = c.next;
+
+	if(c.next >= 0)
+		channels_[c.next].prev = c.prev;
+	else
+		tail_ = c.prev;
+}
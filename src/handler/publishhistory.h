@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef PUBLISHHISTORY_H
+#define PUBLISHHISTORY_H
+
+#include <deque>
+#include <vector>
+#include <QString>
+#include <QList>
+#include <QHash>
+#include "publishitem.h"
+
+// recently published items of each channel, so that a request holding with
+// an old prev-id can be sent what it missed instead of being retried. each
+// channel keeps a consecutive run of ids, up to a depth. when the total size
+// goes over the memory max, the oldest items of the least recently published
+// channels are dropped. a depth of zero disables the history
+class PublishHistory
+{
+public:
+	PublishHistory(int depth = 0, qint64 memoryMax = 0);
+
+	void setLimits(int depth, qint64 memoryMax);
+
+	bool isEnabled() const { return depth_ > 0; }
+
+	// items must be added in publish order. an item that doesn't follow the
+	// last id of its channel restarts the channel's history, and an item
+	// without an id clears it
+	void add(const PublishItem &item);
+
+	void remove(const QString &channel);
+	void clear();
+
+	// appends the items published after prevId, in order, and returns true.
+	// returns false if prevId is not in the channel's history, in which
+	// case nothing is appended
+	bool itemsAfter(const QString &channel, const QString &prevId, QList<PublishItem> *out) const;
+
+	int channelCount() const { return table_.count(); }
+	int itemCount() const { return itemCount_; }
+	qint64 memoryUsed() const { return memoryUsed_; }
+
+	// number of items removed to stay under the memory max, since
+	// construction
+	quint64 evictions() const { return evictions_; }
+
+private:
+	class Entry
+	{
+	public:
+		PublishItem item;
+		int size;
+	};
+
+	class Channel
+	{
+	public:
+		QString name;
+		std::deque<Entry> entries;
+		int prev; // more recently published
+		int next; // less recently published
+	};
+
+	QHash<QString, int> table_;
+	std::vector<Channel> channels_;
+	std::vector<int> freeChannels_;
+	int head_; // most recently published
+	int tail_; // least recently published
+	int depth_;
+	qint64 memoryMax_;
+	qint64 memoryUsed_;
+	int itemCount_;
+	quint64 evictions_;
+
+	static int itemSize(const PublishItem &item);
+
+	void popOldest(int pos);
+	void removeAt(int pos);
+	void enforceMemoryMax();
+	void link(int pos);
+	void unlink(int pos);
+};
+
+#endif
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "test.h"
+#include "publishhistory.h"
+
+static PublishItem makeItem(const QString &channel, const QString &id, const QString &prevId, int bodySize = 10)
+{
+	PublishItem i;
+	i.channel = channel;
+	i.id = id;
+	i.prevId = prevId;
+
+	PublishFormat f(PublishFormat::HttpResponse);
+	f.body = QByteArray(bodySize, 'a');
+	i.formats.insert(f.type, f);
+
+	return i;
+}
+
+static void catchUp()
+{
+	PublishHistory h(10, 0);
+
+	h.add(makeItem("apple", "1", QString()));
+	h.add(makeItem("apple", "2", "1"));
+	h.add(makeItem("apple", "3", "2"));
+
+	QList<PublishItem> items;
+	TEST_ASSERT(h.itemsAfter("apple", "1", &items));
+	TEST_ASSERT_EQ(items.count(), 2);
+	TEST_ASSERT_EQ(items[0].id, QString("2"));
+	TEST_ASSERT_EQ(items[1].id, QString("3"));
+
+	// up to date
+	items.clear();
+	TEST_ASSERT(h.itemsAfter("apple", "3", &items));
+	TEST_ASSERT(items.isEmpty());
+
+	// unknown
+	TEST_ASSERT(!h.itemsAfter("apple", "0", &items));
+	TEST_ASSERT(!h.itemsAfter("banana", "1", &items));
+	TEST_ASSERT(items.isEmpty());
+
+	// a gap restarts the channel
+	h.add(makeItem("apple", "5", "4"));
+	TEST_ASSERT(!h.itemsAfter("apple", "1", &items));
+	TEST_ASSERT(h.itemsAfter("apple", "5", &items));
+	TEST_ASSERT_EQ(h.itemCount(), 1);
+
+	// an item without an id clears it
+	h.add(makeItem("apple", QString(), "5"));
+	TEST_ASSERT_EQ(h.channelCount(), 0);
+	TEST_ASSERT_EQ(h.memoryUsed(), 0);
+}
+
+static void depth()
+{
+	PublishHistory h(2, 0);
+
+	h.add(makeItem("apple", "1", QString()));
+	h.add(makeItem("apple", "2", "1"));
+	h.add(makeItem("apple", "3", "2"));
+	TEST_ASSERT_EQ(h.itemCount(), 2);
+
+	QList<PublishItem> items;
+	TEST_ASSERT(!h.itemsAfter("apple", "1", &items));
+	TEST_ASSERT(h.itemsAfter("apple", "2", &items));
+	TEST_ASSERT_EQ(items.count(), 1);
+}
+
+static void memoryMax()
+{
+	PublishHistory h(10, 0);
+
+	h.add(makeItem("apple", "1", QString(), 1000));
+	int itemSize = (int)h.memoryUsed();
+
+	// room for three items
+	h.setLimits(10, itemSize * 3 + 100);
+
+	h.add(makeItem("apple", "2", "1", 1000));
+	h.add(makeItem("banana", "1", QString(), 1000));
+	TEST_ASSERT_EQ(h.evictions(), 0);
+
+	// the least recently published channel loses its oldest item
+	h.add(makeItem("banana", "2", "1", 1000));
+	TEST_ASSERT_EQ(h.evictions(), 1);
+	TEST_ASSERT(h.memoryUsed() <= itemSize * 3 + 100);
+
+	QList<PublishItem> items;
+	TEST_ASSERT(!h.itemsAfter("apple", "1", &items));
+	TEST_ASSERT(h.itemsAfter("apple", "2", &items));
+	TEST_ASSERT(h.itemsAfter("banana", "1", &items));
+
+	h.add(makeItem("banana", "3", "2", 1000));
+	h.add(makeItem("banana", "4", "3", 1000));
+	TEST_ASSERT_EQ(h.channelCount(), 1);
+	TEST_ASSERT(!h.itemsAfter("apple", "2", &items));
+
+	// items that can't fit at all aren't kept
+	h.add(makeItem("banana", "5", "4", itemSize * 4));
+	TEST_ASSERT_EQ(h.channelCount(), 0);
+	TEST_ASSERT_EQ(h.memoryUsed(), 0);
+}
+
+extern "C" int publishhistory_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(catchUp());
+	TEST_CATCH(depth());
+	TEST_CATCH(memoryMax());
+
+	return 0;
+}
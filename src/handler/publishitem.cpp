@@ -23,11 +23,44 @@
 
 #include "publishitem.h"
 
+#include <limits.h>
 #include "qtcompat.h"
+#include "latencyhistogram.h"
 #include "variantutil.h"
 
 using namespace VariantUtil;
 
+static bool parsePriority(const QString &s, bool *high)
+{
+	if(s == "normal")
+		*high = false;
+	else if(s == "high")
+		*high = true;
+	else
+		return false;
+
+	return true;
+}
+
+bool PublishItem::isExpired() const
+{
+	if(ttl < 0 || receiveTime < 0)
+		return false;
+
+	return LatencyHistogram::now() - receiveTime >= (qint64)ttl * 1000000;
+}
+
+const Gzip::Run & PublishItem::gzipBody() const
+{
+	if(!gzipBody_.have)
+	{
+		gzipBody_.run = Gzip::deflate(format.body);
+		gzipBody_.have = true;
+	}
+
+	return gzipBody_.run;
+}
+
 PublishItem PublishItem::fromVariant(const QVariant &vitem, const QString &channel, bool *ok, QString *errorMessage)
 {
 	QString pn = "publish item object";
@@ -72,6 +105,14 @@ PublishItem PublishItem::fromVariant(const QVariant &vitem, const QString &chann
 		return PublishItem();
 	}
 
+	item.traceParent = getString(vitem, pn, "trace-parent", false, &ok_, errorMessage);
+	if(!ok_)
+	{
+		if(ok)
+			*ok = false;
+		return PublishItem();
+	}
+
 	QVariant vformats = getKeyedObject(vitem, pn, "formats", false, &ok_, errorMessage);
 	if(!ok_)
 	{
@@ -205,13 +246,15 @@ PublishItem PublishItem::fromVariant(const QVariant &vitem, const QString &chann
 			return PublishItem();
 		}
 
-		item.size = vsize.toInt();
-
-		if(item.size < 0)
+		// range checked before narrowing, so that large values can't wrap
+		qint64 size = vsize.toLongLong();
+		if(size < 0 || size > INT_MAX)
 		{
 			setError(ok, errorMessage, QString("%1 contains 'size' with invalid value").arg(pn));
 			return PublishItem();
 		}
+
+		item.size = (int)size;
 	}
 
 	if(keyedObjectContains(vitem, "no-seq"))
@@ -226,6 +269,349 @@ PublishItem PublishItem::fromVariant(const QVariant &vitem, const QString &chann
 		item.noSeq = vnoSeq.toBool();
 	}
 
+	if(keyedObjectContains(vitem, "conflate"))
+	{
+		QVariant vconflate = keyedObjectGetValue(vitem, "conflate");
+		if(typeId(vconflate) != QMetaType::Bool)
+		{
+			setError(ok, errorMessage, QString("%1 contains 'conflate' with wrong type").arg(pn));
+			return PublishItem();
+		}
+
+		item.conflate = vconflate.toBool();
+	}
+
+	if(keyedObjectContains(vitem, "delta"))
+	{
+		QVariant vdelta = keyedObjectGetValue(vitem, "delta");
+		if(typeId(vdelta) != QMetaType::Bool)
+		{
+			setError(ok, errorMessage, QString("%1 contains 'delta' with wrong type").arg(pn));
+			return PublishItem();
+		}
+
+		item.delta = vdelta.toBool();
+	}
+
+	if(keyedObjectContains(vitem, "priority"))
+	{
+		QString priority = getString(vitem, pn, "priority", true, &ok_, errorMessage);
+		if(!ok_)
+		{
+			if(ok)
+				*ok = false;
+			return PublishItem();
+		}
+
+		if(!parsePriority(priority, &item.highPriority))
+		{
+			setError(ok, errorMessage, QString("%1 contains 'priority' with invalid value").arg(pn));
+			return PublishItem();
+		}
+	}
+
+	if(keyedObjectContains(vitem, "ttl"))
+	{
+		QVariant vttl = keyedObjectGetValue(vitem, "ttl");
+		if(!canConvert(vttl, QMetaType::Int))
+		{
+			setError(ok, errorMessage, QString("%1 contains 'ttl' with wrong type").arg(pn));
+			return PublishItem();
+		}
+
+		// range checked before narrowing, so that large values can't wrap
+		qint64 ttl = vttl.toLongLong();
+		if(ttl < 1 || ttl > INT_MAX)
+		{
+			setError(ok, errorMessage, QString("%1 contains 'ttl' with invalid value").arg(pn));
+			return PublishItem();
+		}
+
+		item.ttl = (int)ttl;
+	}
+
+	setSuccess(ok, errorMessage);
+	return item;
+}
+
+static bool viewToString(const TnetString::View &in, QString *out)
+{
+	if(in.type() != TnetString::ByteArray)
+		return false;
+
+	*out = QString::fromUtf8(in.toByteArray());
+	return true;
+}
+
+PublishItem PublishItem::fromView(const TnetString::View &in, const QString &channel, bool *ok, QString *errorMessage)
+{
+	QString pn = "publish item object";
+
+	if(!in.isValid() || in.type() != TnetString::Hash)
+	{
+		setError(ok, errorMessage, QString("%1 is not an object").arg(pn));
+		return PublishItem();
+	}
+
+	// collect the fields in one pass, then interpret them
+	TnetString::View vchannel, vid, vprevId, vtraceParent, vformats, vmeta, vsize, vnoSeq, vconflate, vdelta, vpriority, vttl;
+	TnetString::View vformatList[3];
+
+	TnetString::View::Iterator it(in);
+	while(it.next())
+	{
+		const TnetString::View &k = it.key();
+		const TnetString::View &v = it.value();
+
+		if(k.equals("channel"))
+			vchannel = v;
+		else if(k.equals("id"))
+			vid = v;
+		else if(k.equals("prev-id"))
+			vprevId = v;
+		else if(k.equals("trace-parent"))
+			vtraceParent = v;
+		else if(k.equals("formats"))
+			vformats = v;
+		else if(k.equals("http-response"))
+			vformatList[PublishFormat::HttpResponse] = v;
+		else if(k.equals("http-stream"))
+			vformatList[PublishFormat::HttpStream] = v;
+		else if(k.equals("ws-message"))
+			vformatList[PublishFormat::WebSocketMessage] = v;
+		else if(k.equals("meta"))
+			vmeta = v;
+		else if(k.equals("size"))
+			vsize = v;
+		else if(k.equals("no-seq"))
+			vnoSeq = v;
+		else if(k.equals("conflate"))
+			vconflate = v;
+		else if(k.equals("delta"))
+			vdelta = v;
+		else if(k.equals("priority"))
+			vpriority = v;
+		else if(k.equals("ttl"))
+			vttl = v;
+	}
+
+	if(it.isError())
+	{
+		setError(ok, errorMessage, QString("%1 has invalid format").arg(pn));
+		return PublishItem();
+	}
+
+	PublishItem item;
+
+	if(!channel.isEmpty())
+	{
+		item.channel = channel;
+	}
+	else
+	{
+		if(!vchannel.isValid())
+		{
+			setError(ok, errorMessage, QString("%1 does not contain 'channel'").arg(pn));
+			return PublishItem();
+		}
+
+		if(!viewToString(vchannel, &item.channel))
+		{
+			setError(ok, errorMessage, QString("%1 contains 'channel' with wrong type").arg(pn));
+			return PublishItem();
+		}
+	}
+
+	if(vid.isValid() && !viewToString(vid, &item.id))
+	{
+		setError(ok, errorMessage, QString("%1 contains 'id' with wrong type").arg(pn));
+		return PublishItem();
+	}
+
+	if(vprevId.isValid() && !viewToString(vprevId, &item.prevId))
+	{
+		setError(ok, errorMessage, QString("%1 contains 'prev-id' with wrong type").arg(pn));
+		return PublishItem();
+	}
+
+	if(vtraceParent.isValid() && !viewToString(vtraceParent, &item.traceParent))
+	{
+		setError(ok, errorMessage, QString("%1 contains 'trace-parent' with wrong type").arg(pn));
+		return PublishItem();
+	}
+
+	if(vformats.isValid())
+	{
+		if(vformats.type() != TnetString::Hash)
+		{
+			setError(ok, errorMessage, QString("%1 contains 'formats' with wrong type").arg(pn));
+			return PublishItem();
+		}
+
+		// formats object takes precedence over top-level formats
+		for(int n = 0; n < 3; ++n)
+			vformatList[n] = TnetString::View();
+
+		TnetString::View::Iterator fit(vformats);
+		while(fit.next())
+		{
+			const TnetString::View &k = fit.key();
+
+			if(k.equals("http-response"))
+				vformatList[PublishFormat::HttpResponse] = fit.value();
+			else if(k.equals("http-stream"))
+				vformatList[PublishFormat::HttpStream] = fit.value();
+			else if(k.equals("ws-message"))
+				vformatList[PublishFormat::WebSocketMessage] = fit.value();
+		}
+
+		if(fit.isError())
+		{
+			setError(ok, errorMessage, QString("%1 contains 'formats' with invalid format").arg(pn));
+			return PublishItem();
+		}
+	}
+
+	for(int n = 0; n < 3; ++n)
+	{
+		if(!vformatList[n].isValid())
+			continue;
+
+		bool ok_;
+		PublishFormat f = PublishFormat::fromView((PublishFormat::Type)n, vformatList[n], &ok_, errorMessage);
+		if(!ok_)
+		{
+			if(ok)
+				*ok = false;
+			return PublishItem();
+		}
+
+		item.formats.insert(f.type, f);
+	}
+
+	if(item.formats.isEmpty())
+	{
+		setError(ok, errorMessage, "no formats specified");
+		return PublishItem();
+	}
+
+	if(vmeta.isValid())
+	{
+		if(vmeta.type() != TnetString::Hash)
+		{
+			setError(ok, errorMessage, QString("%1 contains 'meta' with wrong type").arg(pn));
+			return PublishItem();
+		}
+
+		TnetString::View::Iterator mit(vmeta);
+		while(mit.next())
+		{
+			QString key = QString::fromUtf8(mit.key().toByteArray());
+
+			QString val;
+			if(!viewToString(mit.value(), &val))
+			{
+				setError(ok, errorMessage, QString("'meta' contains '%1' with wrong type").arg(key));
+				return PublishItem();
+			}
+
+			item.meta[key] = val;
+		}
+
+		if(mit.isError())
+		{
+			setError(ok, errorMessage, QString("%1 contains 'meta' with invalid format").arg(pn));
+			return PublishItem();
+		}
+	}
+
+	if(vsize.isValid())
+	{
+		bool ok_;
+		qint64 size = vsize.toInt(&ok_);
+		if(!ok_)
+		{
+			setError(ok, errorMessage, QString("%1 contains 'size' with wrong type").arg(pn));
+			return PublishItem();
+		}
+
+		if(size < 0 || size > INT_MAX)
+		{
+			setError(ok, errorMessage, QString("%1 contains 'size' with invalid value").arg(pn));
+			return PublishItem();
+		}
+
+		item.size = (int)size;
+	}
+
+	if(vnoSeq.isValid())
+	{
+		bool ok_;
+		item.noSeq = vnoSeq.toBool(&ok_);
+		if(!ok_)
+		{
+			setError(ok, errorMessage, QString("%1 contains 'no-seq' with wrong type").arg(pn));
+			return PublishItem();
+		}
+	}
+
+	if(vconflate.isValid())
+	{
+		bool ok_;
+		item.conflate = vconflate.toBool(&ok_);
+		if(!ok_)
+		{
+			setError(ok, errorMessage, QString("%1 contains 'conflate' with wrong type").arg(pn));
+			return PublishItem();
+		}
+	}
+
+	if(vdelta.isValid())
+	{
+		bool ok_;
+		item.delta = vdelta.toBool(&ok_);
+		if(!ok_)
+		{
+			setError(ok, errorMessage, QString("%1 contains 'delta' with wrong type").arg(pn));
+			return PublishItem();
+		}
+	}
+
+	if(vpriority.isValid())
+	{
+		QString priority;
+		if(!viewToString(vpriority, &priority))
+		{
+			setError(ok, errorMessage, QString("%1 contains 'priority' with wrong type").arg(pn));
+			return PublishItem();
+		}
+
+		if(!parsePriority(priority, &item.highPriority))
+		{
+			setError(ok, errorMessage, QString("%1 contains 'priority' with invalid value").arg(pn));
+			return PublishItem();
+		}
+	}
+
+	if(vttl.isValid())
+	{
+		bool ok_;
+		qint64 ttl = vttl.toInt(&ok_);
+		if(!ok_)
+		{
+			setError(ok, errorMessage, QString("%1 contains 'ttl' with wrong type").arg(pn));
+			return PublishItem();
+		}
+
+		if(ttl < 1 || ttl > INT_MAX)
+		{
+			setError(ok, errorMessage, QString("%1 contains 'ttl' with invalid value").arg(pn));
+			return PublishItem();
+		}
+
+		item.ttl = (int)ttl;
+	}
+
 	setSuccess(ok, errorMessage);
 	return item;
 }
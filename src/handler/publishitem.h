@@ -26,6 +26,7 @@
 #include <QString>
 #include <QHash>
 #include <QVariant>
+#include "gzip.h"
 #include "publishformat.h"
 
 class PublishItem
@@ -38,16 +39,73 @@ public:
 	QHash<QString, QString> meta;
 	int size;
 	bool noSeq;
+	bool highPriority; // delivered ahead of normal items on the same route
+	bool conflate; // may be replaced by a newer item, see PublishConflater
+	bool delta; // json body that may be sent as a patch to opted in subscribers
+	int ttl; // seconds after receipt to drop the item if undelivered, or -1
+	QString traceParent; // w3c traceparent of the publisher, if any
 
 	PublishFormat format; // for single format items
 
+	// set by the engine when skip-self and skip-users have already been
+	// evaluated for every recipient
+	bool userFiltersApplied;
+
+	// monotonic time the engine received the item, from
+	// LatencyHistogram::now(). -1 if unknown
+	qint64 receiveTime;
+
 	PublishItem() :
 		size(-1),
-		noSeq(false)
+		noSeq(false),
+		highPriority(false),
+		conflate(false),
+		delta(false),
+		ttl(-1),
+		userFiltersApplied(false),
+		receiveTime(-1)
 	{
 	}
 
+	// returns false if there is no ttl or the receive time is unknown
+	bool isExpired() const;
+
+	// format.body compressed as a gzip run. it is made on first use and
+	// kept, so that all subscribers share one compression
+	const Gzip::Run & gzipBody() const;
+
 	static PublishItem fromVariant(const QVariant &vitem, const QString &channel = QString(), bool *ok = 0, QString *errorMessage = 0);
+
+	// decodes directly from tnetstring data, without building a variant
+	static PublishItem fromView(const TnetString::View &in, const QString &channel = QString(), bool *ok = 0, QString *errorMessage = 0);
+
+private:
+	// not carried over by copies, since a copy may change the format
+	class GzipCache
+	{
+	public:
+		bool have;
+		Gzip::Run run;
+
+		GzipCache() :
+			have(false)
+		{
+		}
+
+		GzipCache(const GzipCache &) :
+			have(false)
+		{
+		}
+
+		GzipCache & operator=(const GzipCache &)
+		{
+			have = false;
+			run = Gzip::Run();
+			return *this;
+		}
+	};
+
+	mutable GzipCache gzipBody_;
 };
 
 #endif
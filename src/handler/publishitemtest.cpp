@@ -22,6 +22,8 @@
  */
 
 #include "test.h"
+#include "tnetstring.h"
+#include "latencyhistogram.h"
 #include "publishformat.h"
 #include "publishitem.h"
 
@@ -89,10 +91,226 @@ static void parseItemJsonStyle()
 	TEST_ASSERT_EQ(i.formats.value(PublishFormat::HttpStream).body, QByteArray("hello world"));
 }
 
+static QVariantHash sampleItem()
+{
+	QVariantHash meta;
+	meta["foo"] = QByteArray("bar");
+
+	QVariantHash hr;
+	hr["code"] = 201;
+	hr["headers"] = QVariantList() << QVariant(QVariantList() << QByteArray("Content-Type") << QByteArray("text/plain"));
+	hr["body"] = QByteArray("hello world\n");
+
+	QVariantHash hs;
+	hs["content"] = QByteArray("hello world\n");
+	hs["content-filters"] = QVariantList() << QByteArray("skip-self");
+
+	QVariantHash ws;
+	ws["content-bin"] = QByteArray("\x01\x02", 2);
+
+	QVariantHash formats;
+	formats["http-response"] = hr;
+	formats["http-stream"] = hs;
+	formats["ws-message"] = ws;
+
+	QVariantHash data;
+	data["channel"] = QByteArray("apple");
+	data["id"] = QByteArray("item1");
+	data["prev-id"] = QByteArray("item0");
+	data["meta"] = meta;
+	data["formats"] = formats;
+	data["size"] = 100;
+
+	return data;
+}
+
+static void parseItemView()
+{
+	QByteArray buf = TnetString::fromVariant(sampleItem());
+
+	bool ok;
+	PublishItem i = PublishItem::fromView(TnetString::View(buf), QString(), &ok);
+	TEST_ASSERT(ok);
+	TEST_ASSERT_EQ(i.channel, QString("apple"));
+	TEST_ASSERT_EQ(i.id, QString("item1"));
+	TEST_ASSERT_EQ(i.prevId, QString("item0"));
+	TEST_ASSERT_EQ(i.meta.value("foo"), QString("bar"));
+	TEST_ASSERT_EQ(i.size, 100);
+	TEST_ASSERT_EQ(i.formats.count(), 3);
+
+	PublishFormat hr = i.formats.value(PublishFormat::HttpResponse);
+	TEST_ASSERT_EQ(hr.code, 201);
+	TEST_ASSERT_EQ(hr.reason, QByteArray("Created"));
+	TEST_ASSERT_EQ(hr.headers.get("Content-Type"), QByteArray("text/plain"));
+	TEST_ASSERT_EQ(hr.body, QByteArray("hello world\n"));
+
+	PublishFormat hs = i.formats.value(PublishFormat::HttpStream);
+	TEST_ASSERT(hs.haveContentFilters);
+	TEST_ASSERT(hs.contentFilters == (QStringList() << "skip-self"));
+	TEST_ASSERT_EQ(hs.body, QByteArray("hello world\n"));
+
+	PublishFormat ws = i.formats.value(PublishFormat::WebSocketMessage);
+	TEST_ASSERT(ws.messageType == PublishFormat::Binary);
+	TEST_ASSERT_EQ(ws.body, QByteArray("\x01\x02", 2));
+
+	// channel passed separately, formats at the top level
+	QVariantHash hsOnly;
+	hsOnly["content"] = QByteArray("hi");
+	QVariantHash data;
+	data["http-stream"] = hsOnly;
+	buf = TnetString::fromVariant(data);
+
+	i = PublishItem::fromView(TnetString::View(buf), "banana", &ok);
+	TEST_ASSERT(ok);
+	TEST_ASSERT_EQ(i.channel, QString("banana"));
+	TEST_ASSERT_EQ(i.formats.value(PublishFormat::HttpStream).body, QByteArray("hi"));
+
+	// errors match the variant path
+	QString errorMessage;
+	i = PublishItem::fromView(TnetString::View(buf), QString(), &ok, &errorMessage);
+	TEST_ASSERT(!ok);
+	TEST_ASSERT_EQ(errorMessage, QString("publish item object does not contain 'channel'"));
+
+	data = sampleItem();
+	data["size"] = -1;
+	buf = TnetString::fromVariant(data);
+	i = PublishItem::fromView(TnetString::View(buf), QString(), &ok, &errorMessage);
+	TEST_ASSERT(!ok);
+	TEST_ASSERT_EQ(errorMessage, QString("publish item object contains 'size' with invalid value"));
+
+	data = sampleItem();
+	data["formats"] = QVariantHash();
+	buf = TnetString::fromVariant(data);
+	i = PublishItem::fromView(TnetString::View(buf), QString(), &ok, &errorMessage);
+	TEST_ASSERT(!ok);
+	TEST_ASSERT_EQ(errorMessage, QString("no formats specified"));
+}
+
+static void parsePriority()
+{
+	QVariantHash data = sampleItem();
+
+	bool ok;
+	PublishItem i = PublishItem::fromVariant(data, QString(), &ok);
+	TEST_ASSERT(ok);
+	TEST_ASSERT(!i.highPriority);
+
+	data["priority"] = QByteArray("high");
+	QByteArray buf = TnetString::fromVariant(data);
+
+	i = PublishItem::fromVariant(data, QString(), &ok);
+	TEST_ASSERT(ok);
+	TEST_ASSERT(i.highPriority);
+
+	i = PublishItem::fromView(TnetString::View(buf), QString(), &ok);
+	TEST_ASSERT(ok);
+	TEST_ASSERT(i.highPriority);
+
+	data["priority"] = QByteArray("normal");
+	i = PublishItem::fromVariant(data, QString(), &ok);
+	TEST_ASSERT(ok);
+	TEST_ASSERT(!i.highPriority);
+
+	data["priority"] = QByteArray("urgent");
+	buf = TnetString::fromVariant(data);
+
+	QString errorMessage;
+	i = PublishItem::fromVariant(data, QString(), &ok, &errorMessage);
+	TEST_ASSERT(!ok);
+	TEST_ASSERT_EQ(errorMessage, QString("publish item object contains 'priority' with invalid value"));
+
+	i = PublishItem::fromView(TnetString::View(buf), QString(), &ok, &errorMessage);
+	TEST_ASSERT(!ok);
+	TEST_ASSERT_EQ(errorMessage, QString("publish item object contains 'priority' with invalid value"));
+}
+
+static void parseSize()
+{
+	QVariantHash data = sampleItem();
+	data["size"] = 100;
+	QByteArray buf = TnetString::fromVariant(data);
+
+	bool ok;
+	PublishItem i = PublishItem::fromVariant(data, QString(), &ok);
+	TEST_ASSERT(ok);
+	TEST_ASSERT_EQ(i.size, 100);
+
+	i = PublishItem::fromView(TnetString::View(buf), QString(), &ok);
+	TEST_ASSERT(ok);
+	TEST_ASSERT_EQ(i.size, 100);
+
+	// too large for an int, rather than wrapped to a small value
+	data["size"] = Q_INT64_C(4294967297);
+	buf = TnetString::fromVariant(data);
+
+	QString errorMessage;
+	i = PublishItem::fromVariant(data, QString(), &ok, &errorMessage);
+	TEST_ASSERT(!ok);
+	TEST_ASSERT_EQ(errorMessage, QString("publish item object contains 'size' with invalid value"));
+
+	i = PublishItem::fromView(TnetString::View(buf), QString(), &ok, &errorMessage);
+	TEST_ASSERT(!ok);
+	TEST_ASSERT_EQ(errorMessage, QString("publish item object contains 'size' with invalid value"));
+}
+
+static void parseTtl()
+{
+	QVariantHash data = sampleItem();
+	data["ttl"] = 5;
+	QByteArray buf = TnetString::fromVariant(data);
+
+	bool ok;
+	PublishItem i = PublishItem::fromVariant(data, QString(), &ok);
+	TEST_ASSERT(ok);
+	TEST_ASSERT_EQ(i.ttl, 5);
+
+	i = PublishItem::fromView(TnetString::View(buf), QString(), &ok);
+	TEST_ASSERT(ok);
+	TEST_ASSERT_EQ(i.ttl, 5);
+
+	// not expired until received long enough ago
+	TEST_ASSERT(!i.isExpired());
+	i.receiveTime = LatencyHistogram::now();
+	TEST_ASSERT(!i.isExpired());
+	i.receiveTime = LatencyHistogram::now() - 6000000;
+	TEST_ASSERT(i.isExpired());
+
+	i.ttl = -1;
+	TEST_ASSERT(!i.isExpired());
+
+	data["ttl"] = 0;
+	buf = TnetString::fromVariant(data);
+
+	QString errorMessage;
+	i = PublishItem::fromVariant(data, QString(), &ok, &errorMessage);
+	TEST_ASSERT(!ok);
+	TEST_ASSERT_EQ(errorMessage, QString("publish item object contains 'ttl' with invalid value"));
+
+	i = PublishItem::fromView(TnetString::View(buf), QString(), &ok, &errorMessage);
+	TEST_ASSERT(!ok);
+	TEST_ASSERT_EQ(errorMessage, QString("publish item object contains 'ttl' with invalid value"));
+
+	// too large for an int, rather than wrapped to 1
+	data["ttl"] = Q_INT64_C(4294967297);
+	buf = TnetString::fromVariant(data);
+
+	i = PublishItem::fromVariant(data, QString(), &ok, &errorMessage);
+	TEST_ASSERT(!ok);
+	TEST_ASSERT_EQ(errorMessage, QString("publish item object contains 'ttl' with invalid value"));
+
+	i = PublishItem::fromView(TnetString::View(buf), QString(), &ok, &errorMessage);
+	TEST_ASSERT(!ok);
+	TEST_ASSERT_EQ(errorMessage, QString("publish item object contains 'ttl' with invalid value"));
+}
+
 extern "C" int publishitem_test(ffi::TestException *out_ex)
 {
 	TEST_CATCH(parseItem());
 	TEST_CATCH(parseItemJsonStyle());
+	TEST_CATCH(parseItemView());
+	TEST_CATCH(parsePriority());
+	TEST_CATCH(parseSize());
+	TEST_CATCH(parseTtl());
 
 	return 0;
 }
@@ -23,63 +23,168 @@
 #include "publishlastids.h"
 
 #include <assert.h>
+#include "objectstats.h"
 
 PublishLastIds::PublishLastIds(int maxCapacity) :
-	maxCapacity_(maxCapacity)
+	head_(-1),
+	tail_(-1),
+	maxCapacity_(maxCapacity),
+	evictions_(0),
+	bytes_(0)
 {
 }
 
-void PublishLastIds::set(const QString &channel, const QString &id)
+PublishLastIds::~PublishLastIds()
 {
-	QDateTime now = QDateTime::currentDateTimeUtc();
+	ObjectStats::remove(ObjectStats::PublishLastIdEntries, table_.count(), bytes_);
+}
 
-	if(table_.contains(channel))
+void PublishLastIds::set(const QString &channel, const QString &id)
+{
+	QHash<QString, int>::iterator it = table_.find(channel);
+	if(it != table_.end())
 	{
-		Item &i = table_[channel];
-		recentlyUsed_.remove(TimeStringPair(i.time, channel));
+		int pos = it.value();
+		Item &i = items_[pos];
+
+		qint64 before = ObjectStats::stringBytes(i.id);
 		i.id = id;
-		i.time = now;
-		recentlyUsed_.insert(TimeStringPair(i.time, channel), i);
+		qint64 delta = ObjectStats::stringBytes(i.id) - before;
+
+		bytes_ += delta;
+		ObjectStats::add(ObjectStats::PublishLastIdEntries, 0, delta);
+
+		if(pos != head_)
+		{
+			unlink(pos);
+			link(pos);
+		}
 	}
 	else
 	{
 		while(!table_.isEmpty() && table_.count() >= maxCapacity_)
 		{
 			// remove oldest
-			QMutableMapIterator<TimeStringPair, Item> it(recentlyUsed_);
-			assert(it.hasNext());
-			it.next();
-			QString channel = it.value().channel;
-			it.remove();
-			table_.remove(channel);
+			assert(tail_ >= 0);
+			int pos = tail_;
+			table_.remove(items_[pos].channel);
+			unlink(pos);
+			release(pos);
+			++evictions_;
+		}
+
+		int pos;
+		if(!freeItems_.empty())
+		{
+			pos = freeItems_.back();
+			freeItems_.pop_back();
+		}
+		else
+		{
+			pos = (int)items_.size();
+			items_.push_back(Item());
 		}
 
-		Item i;
+		Item &i = items_[pos];
 		i.channel = channel;
 		i.id = id;
-		i.time = now;
-		table_.insert(channel, i);
-		recentlyUsed_.insert(TimeStringPair(i.time, channel), i);
+		link(pos);
+
+		table_.insert(channel, pos);
+
+		qint64 bytes = itemBytes(i);
+		bytes_ += bytes;
+		ObjectStats::add(ObjectStats::PublishLastIdEntries, 1, bytes);
 	}
 }
 
 void PublishLastIds::remove(const QString &channel)
 {
-	if(table_.contains(channel))
+	QHash<QString, int>::iterator it = table_.find(channel);
+	if(it != table_.end())
 	{
-		Item &i = table_[channel];
-		recentlyUsed_.remove(TimeStringPair(i.time, channel));
-		table_.remove(channel);
+		int pos = it.value();
+		table_.erase(it);
+		unlink(pos);
+		release(pos);
 	}
 }
 
 void PublishLastIds::clear()
 {
-	recentlyUsed_.clear();
+	ObjectStats::remove(ObjectStats::PublishLastIdEntries, table_.count(), bytes_);
+	bytes_ = 0;
+
 	table_.clear();
+	items_.clear();
+	freeItems_.clear();
+	head_ = -1;
+	tail_ = -1;
 }
 
 QString PublishLastIds::value(const QString &channel)
 {
-	return table_.value(channel).id;
+	int pos = table_.value(channel, -1);
+	if(pos < 0)
+		return QString();
+
+	return items_[pos].id;
+}
+
+QList<QPair<QString, QString>> PublishLastIds::entries() const
+{
+	QList<QPair<QString, QString>> out;
+
+	for(int pos = tail_; pos >= 0; pos = items_[pos].prev)
+		out += QPair<QString, QString>(items_[pos].channel, items_[pos].id);
+
+	return out;
+}
+
+void PublishLastIds::link(int pos)
+{
+	Item &i = items_[pos];
+	i.prev = -1;
+	i.next = head_;
+
+	if(head_ >= 0)
+		items_[head_].prev = pos;
+	else
+		tail_ = pos;
+
+	head_ = pos;
+}
+
+void PublishLastIds::unlink(int pos)
+{
+	Item &i = items_[pos];
+
+	if(i.prev >= 0)
+		items_[i.prev].next = i.next;
+	else
+		head_ = i.next;
+
+	if(i.next >= 0)
+		items_[i.next].prev = i.prev;
+	else
+		tail_ = i.prev;
+}
+
+void PublishLastIds::release(int pos)
+{
+	Item &i = items_[pos];
+
+	qint64 bytes = itemBytes(i);
+	bytes_ -= bytes;
+	ObjectStats::remove(ObjectStats::PublishLastIdEntries, 1, bytes);
+
+	i.channel.clear();
+	i.id.clear();
+	freeItems_.push_back(pos);
+}
+
+qint64 PublishLastIds::itemBytes(const Item &i)
+{
+	// the table key shares its data with the item's channel
+	return sizeof(Item) + sizeof(QString) + sizeof(int) + ObjectStats::stringBytes(i.channel) + ObjectStats::stringBytes(i.id);
 }
@@ -23,35 +23,62 @@
 #ifndef PUBLISHLASTIDS_H
 #define PUBLISHLASTIDS_H
 
+#include <vector>
 #include <QString>
-#include <QDateTime>
-#include <QMap>
+#include <QList>
+#include <QPair>
 #include <QHash>
 
-// cache with LRU expiration
+// cache with LRU expiration. entries live in a flat array, linked in order
+// of use, so set() and remove() are O(1)
 class PublishLastIds
 {
 public:
 	PublishLastIds(int maxCapacity);
+	~PublishLastIds();
+
+	// disable copying
+	PublishLastIds(const PublishLastIds &) = delete;
+	PublishLastIds & operator=(const PublishLastIds &) = delete;
+
 	void set(const QString &channel, const QString &id);
 	void remove(const QString &channel);
 	void clear();
 	QString value(const QString &channel);
 
-private:
-	typedef QPair<QDateTime, QString> TimeStringPair;
+	// (channel, id) pairs, least recently used first, so that calling set()
+	// with each in turn rebuilds the same order
+	QList<QPair<QString, QString>> entries() const;
+
+	int count() const { return table_.count(); }
+	int capacity() const { return maxCapacity_; }
 
+	// number of entries removed to make room, since construction
+	quint64 evictions() const { return evictions_; }
+
+private:
 	class Item
 	{
 	public:
 		QString channel;
 		QString id;
-		QDateTime time;
+		int prev; // more recently used
+		int next; // less recently used
 	};
 
-	QHash<QString, Item> table_;
-	QMap<TimeStringPair, Item> recentlyUsed_;
+	QHash<QString, int> table_;
+	std::vector<Item> items_;
+	std::vector<int> freeItems_;
+	int head_; // most recently used
+	int tail_; // least recently used
 	int maxCapacity_;
+	quint64 evictions_;
+	qint64 bytes_; // estimate, for object stats
+
+	void link(int pos);
+	void unlink(int pos);
+	void release(int pos);
+	static qint64 itemBytes(const Item &i);
 };
 
 #endif
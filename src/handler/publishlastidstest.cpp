@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "test.h"
+#include "publishlastids.h"
+
+static void setRemove()
+{
+	PublishLastIds ids(10);
+
+	TEST_ASSERT(ids.value("apple").isNull());
+
+	ids.set("apple", "1");
+	ids.set("banana", "2");
+	TEST_ASSERT_EQ(ids.value("apple"), QString("1"));
+	TEST_ASSERT_EQ(ids.value("banana"), QString("2"));
+
+	ids.set("apple", "3");
+	TEST_ASSERT_EQ(ids.value("apple"), QString("3"));
+	TEST_ASSERT_EQ(ids.count(), 2);
+
+	ids.remove("apple");
+	TEST_ASSERT(ids.value("apple").isNull());
+	TEST_ASSERT_EQ(ids.count(), 1);
+
+	// freed entry is reused
+	ids.set("cherry", "4");
+	TEST_ASSERT_EQ(ids.value("cherry"), QString("4"));
+	TEST_ASSERT_EQ(ids.value("banana"), QString("2"));
+
+	ids.clear();
+	TEST_ASSERT_EQ(ids.count(), 0);
+	TEST_ASSERT(ids.value("banana").isNull());
+}
+
+static void evictOldest()
+{
+	PublishLastIds ids(3);
+
+	ids.set("apple", "1");
+	ids.set("banana", "1");
+	ids.set("cherry", "1");
+
+	// touching apple makes banana the oldest
+	ids.set("apple", "2");
+	ids.set("date", "1");
+
+	TEST_ASSERT(ids.value("banana").isNull());
+	TEST_ASSERT_EQ(ids.value("apple"), QString("2"));
+	TEST_ASSERT_EQ(ids.value("cherry"), QString("1"));
+	TEST_ASSERT_EQ(ids.value("date"), QString("1"));
+	TEST_ASSERT_EQ(ids.count(), 3);
+	TEST_ASSERT_EQ(ids.evictions(), 1u);
+
+	ids.set("elderberry", "1");
+	TEST_ASSERT(ids.value("cherry").isNull());
+	TEST_ASSERT_EQ(ids.evictions(), 2u);
+}
+
+extern "C" int publishlastids_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(setRemove());
+	TEST_CATCH(evictOldest());
+
+	return 0;
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "publishlatency.h"
+
+#include "latencyhistogram.h"
+#include "statsmanager.h"
+
+#define TRANSPORTS_COUNT 3
+
+namespace PublishLatency {
+
+static LatencyHistogram g_histograms[StagesCount][TRANSPORTS_COUNT];
+
+static int transportIndex(PublishFormat::Type type)
+{
+	switch(type)
+	{
+		case PublishFormat::HttpResponse: return 0;
+		case PublishFormat::HttpStream: return 1;
+		case PublishFormat::WebSocketMessage: return 2;
+	}
+
+	return -1;
+}
+
+static const char *transportName(int index)
+{
+	switch(index)
+	{
+		case 0: return "http-response";
+		case 1: return "http-stream";
+		default: return "ws-message";
+	}
+}
+
+static const char *stageName(int stage)
+{
+	switch(stage)
+	{
+		case Sequenced: return "sequenced";
+		case Dequeued: return "dequeued";
+		default: return "written";
+	}
+}
+
+void record(Stage stage, PublishFormat::Type type, qint64 receiveTime)
+{
+	if(receiveTime < 0)
+		return;
+
+	int t = transportIndex(type);
+	if(t < 0)
+		return;
+
+	g_histograms[stage][t].record(LatencyHistogram::now() - receiveTime);
+}
+
+void recordFormats(Stage stage, const PublishItem &item)
+{
+	if(item.receiveTime < 0 || item.formats.isEmpty())
+		return;
+
+	qint64 elapsed = LatencyHistogram::now() - item.receiveTime;
+
+	QHashIterator<PublishFormat::Type, PublishFormat> it(item.formats);
+	while(it.hasNext())
+	{
+		it.next();
+
+		int t = transportIndex(it.key());
+		if(t >= 0)
+			g_histograms[stage][t].record(elapsed);
+	}
+}
+
+void addToPrometheus(StatsManager *stats)
+{
+	for(int s = 0; s < StagesCount; ++s)
+	{
+		for(int t = 0; t < TRANSPORTS_COUNT; ++t)
+		{
+			QString labels = QString("stage=\"%1\",transport=\"%2\"").arg(stageName(s), transportName(t));
+			stats->addPrometheusHistogram("publish_latency_seconds", "Time from a publish being received to reaching a delivery stage", labels, &g_histograms[s][t]);
+		}
+	}
+}
+
+}
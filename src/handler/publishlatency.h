@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef PUBLISHLATENCY_H
+#define PUBLISHLATENCY_H
+
+#include "publishformat.h"
+#include "publishitem.h"
+
+class LatencyHistogram;
+class StatsManager;
+
+// process-wide histograms of the time from a publish being received to
+// reaching each stage, per transport. shared by all handler workers
+namespace PublishLatency {
+
+enum Stage
+{
+	Sequenced, // released by the sequencer
+	Dequeued, // taken from the publish rate limiter
+	Written, // written to the client session
+	StagesCount
+};
+
+// receiveTime is from LatencyHistogram::now(). no-op if receiveTime < 0
+void record(Stage stage, PublishFormat::Type type, qint64 receiveTime);
+
+// records for each format of the item
+void recordFormats(Stage stage, const PublishItem &item);
+
+// exports the histograms through the stats manager's prometheus output
+void addToPrometheus(StatsManager *stats);
+
+}
+
+#endif
@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "publishstream.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include "log.h"
+#include "defercall.h"
+#include "httpheaders.h"
+#include "simplehttpserver.h"
+#include "publishitem.h"
+
+#define BATCH_MAX 100
+
+class PublishStream::Private
+{
+public:
+	PublishStream *q;
+	SimpleHttpRequest *req;
+	int window;
+	int lineSizeMax;
+	QByteArray buf; // start of a line not yet complete
+	int lineNum;
+	int received;
+	int published;
+	int ackedReceived;
+	int ackedWindow;
+	bool paused;
+	bool ended;
+	Connection bodyReadyConnection;
+	Connection finishedConnection;
+	DeferCall deferCall;
+
+	Private(PublishStream *_q, SimpleHttpRequest *_req, int _window, int _lineSizeMax) :
+		q(_q),
+		req(_req),
+		window(_window),
+		lineSizeMax(_lineSizeMax),
+		lineNum(0),
+		received(0),
+		published(0),
+		ackedReceived(-1),
+		ackedWindow(-1),
+		paused(false),
+		ended(false)
+	{
+		bodyReadyConnection = req->bodyReady.connect(boost::bind(&Private::req_bodyReady, this));
+		finishedConnection = req->finished.connect(boost::bind(&Private::req_finished, this));
+	}
+
+	~Private()
+	{
+		bodyReadyConnection.disconnect();
+		finishedConnection.disconnect();
+
+		// may be called from a signal of the request
+		DeferCall::deleteLater(req);
+	}
+
+	void start()
+	{
+		HttpHeaders headers;
+		headers += HttpHeader("Content-Type", "application/x-ndjson");
+		req->beginResponse(200, "OK", headers);
+
+		sendAck();
+
+		readBody();
+	}
+
+	void setPaused(bool on)
+	{
+		if(paused == on)
+			return;
+
+		paused = on;
+
+		sendAck();
+
+		// whatever arrived while paused won't be signaled again
+		if(!paused)
+			deferCall.defer([=] { readBody(); });
+	}
+
+	void write(const QVariantMap &obj)
+	{
+		req->writeBody(QJsonDocument(QJsonObject::fromVariantMap(obj)).toJson(QJsonDocument::Compact) + '\n');
+	}
+
+	void sendAck()
+	{
+		if(ended)
+			return;
+
+		int w = (paused ? 0 : window);
+		if(received == ackedReceived && w == ackedWindow)
+			return;
+
+		QVariantMap obj;
+		obj["acked"] = received;
+		obj["window"] = w;
+		write(obj);
+
+		ackedReceived = received;
+		ackedWindow = w;
+	}
+
+	void sendError(const QString &message)
+	{
+		QVariantMap obj;
+		obj["error"] = message;
+		write(obj);
+	}
+
+	void end()
+	{
+		ended = true;
+		req->endResponse();
+	}
+
+	// returns false if the line isn't an item
+	bool parseLine(const QByteArray &line, PublishItem *item)
+	{
+		QJsonParseError e;
+		QJsonDocument doc = QJsonDocument::fromJson(line, &e);
+		if(e.error != QJsonParseError::NoError || !doc.isObject())
+		{
+			sendError(QString("line %1 is not a JSON object").arg(lineNum));
+			return false;
+		}
+
+		bool ok;
+		QString errorMessage;
+		*item = PublishItem::fromVariant(doc.object().toVariantMap(), QString(), &ok, &errorMessage);
+		if(!ok)
+		{
+			sendError(QString("line %1: %2").arg(QString::number(lineNum), errorMessage));
+			return false;
+		}
+
+		return true;
+	}
+
+	void readBody()
+	{
+		if(paused || ended)
+			return;
+
+		buf += req->takeBody();
+
+		bool finished = req->isBodyFinished();
+
+		// the last line of the body may lack a line ending
+		if(finished && !buf.isEmpty() && !buf.endsWith('\n'))
+			buf += '\n';
+
+		QList<PublishItem> batch;
+		QList<QByteArray> lines;
+
+		int at = 0;
+		while(true)
+		{
+			int end = buf.indexOf('\n', at);
+			if(end == -1)
+				break;
+
+			QByteArray line = buf.mid(at, end - at).trimmed();
+			at = end + 1;
+			++lineNum;
+
+			if(line.isEmpty())
+				continue;
+
+			++received;
+
+			PublishItem item;
+			if(!parseLine(line, &item))
+				continue;
+
+			batch += item;
+			lines += line;
+
+			if(batch.count() >= BATCH_MAX)
+			{
+				emitItems(batch, lines);
+				batch.clear();
+				lines.clear();
+			}
+		}
+
+		buf = buf.mid(at);
+
+		if(!batch.isEmpty())
+			emitItems(batch, lines);
+
+		if(buf.size() > lineSizeMax)
+		{
+			sendAck();
+			sendError(QString("line %1 is too long").arg(lineNum + 1));
+			end();
+			return;
+		}
+
+		sendAck();
+
+		if(finished)
+			end();
+	}
+
+	void emitItems(const QList<PublishItem> &batch, const QList<QByteArray> &lines)
+	{
+		published += batch.count();
+
+		q->itemsReady(batch, lines);
+	}
+
+	void req_bodyReady()
+	{
+		readBody();
+	}
+
+	void req_finished()
+	{
+		log_debug("publish stream finished, received=%d published=%d", received, published);
+
+		q->finished();
+	}
+};
+
+PublishStream::PublishStream(SimpleHttpRequest *req, int window, int lineSizeMax)
+{
+	d = new Private(this, req, window, lineSizeMax);
+}
+
+PublishStream::~PublishStream()
+{
+	delete d;
+}
+
+int PublishStream::received() const
+{
+	return d->received;
+}
+
+int PublishStream::published() const
+{
+	return d->published;
+}
+
+bool PublishStream::isPaused() const
+{
+	return d->paused;
+}
+
+void PublishStream::setPaused(bool on)
+{
+	d->setPaused(on);
+}
+
+void PublishStream::start()
+{
+	d->start();
+}
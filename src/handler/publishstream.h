@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef PUBLISHSTREAM_H
+#define PUBLISHSTREAM_H
+
+#include <QList>
+#include <QByteArray>
+#include <boost/signals2.hpp>
+
+class PublishItem;
+class SimpleHttpRequest;
+
+using Signal = boost::signals2::signal<void()>;
+
+// a long-lived publish connection. the request body is a chunked stream of
+// items, one json object per line, and the response is a chunked stream of
+// acknowledgements, also one json object per line:
+//
+//   {"acked": N, "window": W}
+//
+// acked is the number of items received so far, including any that failed
+// to parse, and window is the number of items the publisher may send
+// beyond that. a bad item is reported with {"error": "line N: ..."} just
+// before the acknowledgement that covers it, and the stream carries on
+class PublishStream
+{
+public:
+	// takes ownership of the request, which must be streaming
+	PublishStream(SimpleHttpRequest *req, int window, int lineSizeMax);
+	~PublishStream();
+
+	int received() const;
+	int published() const;
+
+	// while paused, the body is not read, which pushes back on the
+	// publisher through the connection. the publisher is also sent a
+	// window of zero, and the full window again when resumed
+	bool isPaused() const;
+	void setPaused(bool on);
+
+	void start();
+
+	// parsed items and their lines, in batches
+	boost::signals2::signal<void(const QList<PublishItem>&, const QList<QByteArray>&)> itemsReady;
+
+	Signal finished;
+
+private:
+	class Private;
+	friend class Private;
+	Private *d;
+};
+
+#endif
@@ -23,46 +23,124 @@
 
 #include "ratelimiter.h"
 
-#include <QList>
-#include <QMap>
+#include <assert.h>
+#include <atomic>
+#include <vector>
+#include <QString>
+#include <QStringList>
+#include <QHash>
 #include "timer.h"
 #include "defercall.h"
+#include "trace.h"
+#include "memorybudget.h"
+#include "objectstats.h"
+#include "latencyhistogram.h"
+#include "statsmanager.h"
 
 #define MIN_BATCH_INTERVAL 25
 
+// keys are interned to bucket slots, and buckets with pending work are
+// linked into a ring that is walked round-robin. queued actions live in a
+// pooled node array, so steady-state operation doesn't allocate. each
+// bucket has a queue per priority, and its turn goes to the highest
+// priority queue with pending actions
 class RateLimiter::Private
 {
 public:
-	class ActionItem
+	class ActionNode
 	{
 	public:
 		Action *action;
 		int weight;
+		qint64 queuedTime; // usecs
+		int next;
 
-		ActionItem(Action *_action = 0, int _weight = 0) :
-			action(_action),
-			weight(_weight)
+		ActionNode() :
+			action(0),
+			weight(0),
+			queuedTime(0),
+			next(-1)
+		{
+		}
+	};
+
+	// read by the prometheus endpoint
+	class Metrics
+	{
+	public:
+		std::atomic<qint64> weight; // queued across buckets
+		std::atomic<qint64> actions; // queued
+		std::atomic<qint64> buckets; // keys with pending work
+		std::atomic<quint64> executed;
+		std::atomic<quint64> dropped;
+		LatencyHistogram wait; // from being queued to executing
+
+		Metrics() :
+			weight(0),
+			actions(0),
+			buckets(0),
+			executed(0),
+			dropped(0)
 		{
 		}
 	};
 
+	class Queue
+	{
+	public:
+		int head; // first action node
+		int tail; // last action node
+
+		Queue() :
+			head(-1),
+			tail(-1)
+		{
+		}
+
+		bool isEmpty() const { return head == -1; }
+	};
+
+	static const int PriorityCount = High + 1;
+
 	class Bucket
 	{
 	public:
-		QList<ActionItem> actions;
+		QString key;
+		Queue queues[PriorityCount];
 		int weight;
 		int debt;
+		int prev; // ring links
+		int next;
 
 		Bucket() :
 			weight(0),
-			debt(0)
+			debt(0),
+			prev(-1),
+			next(-1)
 		{
 		}
 
-		~Bucket()
+		bool isEmpty() const
 		{
-			foreach(const ActionItem &i, actions)
-				delete i.action;
+			for(int n = 0; n < PriorityCount; ++n)
+			{
+				if(!queues[n].isEmpty())
+					return false;
+			}
+
+			return true;
+		}
+
+		// returns the highest priority queue with pending actions
+		Queue *nextQueue()
+		{
+			for(int n = PriorityCount - 1; n >= 0; --n)
+			{
+				if(!queues[n].isEmpty())
+					return &queues[n];
+			}
+
+			return 0;
 		}
 	};
 
@@ -70,19 +148,28 @@ public:
 	int rate;
 	int hwm;
 	bool batchWaitEnabled;
-	QMap<QString, Bucket> buckets;
-	QString lastKey;
+	QHash<QString, int> bucketIds;
+	std::vector<Bucket> buckets;
+	std::vector<int> freeBuckets;
+	std::vector<ActionNode> nodes;
+	int freeNode;
+	int activeCount;
+	int current; // next bucket to process, or -1 if none
 	std::unique_ptr<Timer> timer;
 	bool firstPass;
 	int batchInterval;
 	int batchSize;
 	bool lastBatchEmpty;
+	Metrics metrics;
 
 	Private(RateLimiter *_q) :
 		q(_q),
 		rate(-1),
 		hwm(-1),
 		batchWaitEnabled(false),
+		freeNode(-1),
+		activeCount(0),
+		current(-1),
 		batchInterval(-1),
 		batchSize(-1),
 		lastBatchEmpty(false)
@@ -91,6 +178,31 @@ public:
 		timer->timeout.connect(boost::bind(&Private::timeout, this));
 	}
 
+	~Private()
+	{
+		QHashIterator<QString, int> it(bucketIds);
+		while(it.hasNext())
+		{
+			it.next();
+
+			const Bucket &b = buckets[it.value()];
+
+			for(int p = 0; p < PriorityCount; ++p)
+			{
+				for(int n = b.queues[p].head; n != -1; n = nodes[n].next)
+					nodes[n].action->release();
+			}
+
+			ObjectStats::remove(ObjectStats::RateLimiterBuckets, 1, bucketBytes(b));
+		}
+	}
+
+	static qint64 bucketBytes(const Bucket &b)
+	{
+		// the table key shares its data with the bucket's key
+		return sizeof(Bucket) + sizeof(QString) + sizeof(int) + ObjectStats::stringBytes(b.key);
+	}
+
 	void setRate(int actionsPerSecond)
 	{
 		if(actionsPerSecond > 0)
@@ -118,25 +230,161 @@ public:
 		setup();
 	}
 
-	bool addAction(const QString &key, int weight, Action *action)
+	bool addAction(const QString &key, int weight, Priority priority, Action *action)
 	{
-		Bucket &bucket = buckets[key];
-		if(hwm > 0 && bucket.weight + weight > hwm)
+		int id = bucketIds.value(key, -1);
+
+		int bucketWeight = (id != -1 ? buckets[id].weight : 0);
+		if(priority == Normal && hwm > 0 && bucketWeight + weight > hwm)
+		{
+			++metrics.dropped;
 			return false;
+		}
 
-		bucket.actions += ActionItem(action, weight);
+		// queued actions hold on to their payloads, so shed new work while
+		// the process is over its memory budget
+		if(MemoryBudget::exceeded())
+		{
+			++metrics.dropped;
+			return false;
+		}
+
+		if(id == -1)
+			id = addBucket(key);
+
+		int n = allocNode();
+		nodes[n].action = action;
+		nodes[n].weight = weight;
+		nodes[n].queuedTime = LatencyHistogram::now();
+
+		Bucket &bucket = buckets[id];
+		Queue &queue = bucket.queues[priority];
+
+		if(queue.tail != -1)
+			nodes[queue.tail].next = n;
+		else
+			queue.head = n;
+
+		queue.tail = n;
 		bucket.weight += weight;
 
+		metrics.weight += weight;
+		++metrics.actions;
+
 		setup();
 		return true;
 	}
 
+	Action *lastAction(const QString &key) const
+	{
+		int id = bucketIds.value(key, -1);
+		if(id == -1)
+			return 0;
+
+		const Queue &queue = buckets[id].queues[Normal];
+		if(queue.tail == -1)
+			return 0;
+
+		return nodes[queue.tail].action;
+	}
+
 private:
+	int allocNode()
+	{
+		if(freeNode != -1)
+		{
+			int n = freeNode;
+			freeNode = nodes[n].next;
+			nodes[n].next = -1;
+			return n;
+		}
+
+		nodes.push_back(ActionNode());
+		return (int)nodes.size() - 1;
+	}
+
+	void releaseNode(int n)
+	{
+		nodes[n].action = 0;
+		nodes[n].next = freeNode;
+		freeNode = n;
+	}
+
+	int addBucket(const QString &key)
+	{
+		int id;
+		if(!freeBuckets.empty())
+		{
+			id = freeBuckets.back();
+			freeBuckets.pop_back();
+		}
+		else
+		{
+			buckets.push_back(Bucket());
+			id = (int)buckets.size() - 1;
+		}
+
+		Bucket &b = buckets[id];
+		b.key = key;
+
+		// link in at the end of the current round
+		if(current == -1)
+		{
+			b.prev = id;
+			b.next = id;
+			current = id;
+		}
+		else
+		{
+			Bucket &c = buckets[current];
+			b.prev = c.prev;
+			b.next = current;
+			buckets[c.prev].next = id;
+			c.prev = id;
+		}
+
+		bucketIds.insert(key, id);
+		++activeCount;
+		metrics.buckets = activeCount;
+
+		ObjectStats::add(ObjectStats::RateLimiterBuckets, 1, bucketBytes(b));
+
+		return id;
+	}
+
+	void removeBucket(int id)
+	{
+		Bucket &b = buckets[id];
+
+		assert(b.isEmpty());
+
+		if(b.next == id)
+		{
+			current = -1;
+		}
+		else
+		{
+			buckets[b.prev].next = b.next;
+			buckets[b.next].prev = b.prev;
+
+			if(current == id)
+				current = b.next;
+		}
+
+		ObjectStats::remove(ObjectStats::RateLimiterBuckets, 1, bucketBytes(b));
+
+		bucketIds.remove(b.key);
+		b = Bucket();
+		freeBuckets.push_back(id);
+		--activeCount;
+		metrics.buckets = activeCount;
+	}
+
 	void setup()
 	{
 		if(rate > 0)
 		{
-			if(!buckets.isEmpty() || !lastBatchEmpty)
+			if(activeCount > 0 || !lastBatchEmpty)
 			{
 				if(timer->isActive())
 				{
@@ -173,7 +421,7 @@ private:
 		}
 		else
 		{
-			if(!buckets.isEmpty())
+			if(activeCount > 0)
 			{
 				if(timer->isActive())
 				{
@@ -197,7 +445,7 @@ private:
 	// return false if self destroyed
 	bool processBatch()
 	{
-		if(buckets.isEmpty())
+		if(activeCount == 0)
 		{
 			lastBatchEmpty = true;
 			return true;
@@ -205,39 +453,42 @@ private:
 
 		lastBatchEmpty = false;
 
-		QMap<QString, Bucket>::iterator it;
+		std::weak_ptr<Private> self = q->d;
 
-		if(!lastKey.isNull())
+		int processed = 0;
+		while((batchSize < 1 || processed < batchSize) && current != -1)
 		{
-			it = buckets.find(lastKey);
+			int id = current;
 
-			if(it == buckets.end())
-				it = buckets.begin();
-		}
-		else
-		{
-			it = buckets.begin();
-		}
+			if(buckets[id].debt <= 0)
+			{
+				Bucket &bucket = buckets[id];
 
-		std::weak_ptr<Private> self = q->d;
+				Queue *queue = bucket.nextQueue();
+				assert(queue);
 
-		int processed = 0;
-		while((batchSize < 1 || processed < batchSize) && it != buckets.end())
-		{
-			Bucket &bucket = it.value();
+				int n = queue->head;
 
-			QString key = it.key();
+				Action *action = nodes[n].action;
+				int weight = nodes[n].weight;
+				qint64 queuedTime = nodes[n].queuedTime;
 
-			if(bucket.debt <= 0)
-			{
-				ActionItem ai = bucket.actions.takeFirst();
-				Action *action = ai.action;
-				int weight = ai.weight;
+				queue->head = nodes[n].next;
+				if(queue->head == -1)
+					queue->tail = -1;
 
 				bucket.weight -= weight;
 
+				releaseNode(n);
+
+				metrics.weight -= weight;
+				--metrics.actions;
+				++metrics.executed;
+				metrics.wait.record(LatencyHistogram::now() - queuedTime);
+
+				// may add actions, so references must be taken again after
 				bool ret = action->execute();
-				delete action;
+				action->release();
 
 				if(self.expired())
 					return false;
@@ -251,31 +502,30 @@ private:
 
 					if(batchSize >= 1 && processed > batchSize)
 					{
-						bucket.debt += processed - batchSize;
+						buckets[id].debt += processed - batchSize;
 					}
 				}
 			}
 			else
 			{
-				--bucket.debt;
+				--buckets[id].debt;
 				++processed;
 			}
 
-			if(bucket.actions.isEmpty() && bucket.debt <= 0)
+			Bucket &bucket = buckets[id];
+
+			if(bucket.isEmpty() && bucket.debt <= 0)
 			{
-				lastKey = key;
-				it = buckets.erase(it);
+				// advances current
+				removeBucket(id);
 			}
 			else
 			{
-				++it;
-				if(it == buckets.end())
-					it = buckets.begin();
+				current = bucket.next;
 			}
 		}
 
-		if(it != buckets.end())
-			lastKey = it.key();
+		TRACE_EVENT(LimiterBatch, processed);
 
 		return true;
 	}
@@ -313,19 +563,38 @@ void RateLimiter::setBatchWaitEnabled(bool on)
 	d->batchWaitEnabled = on;
 }
 
-bool RateLimiter::addAction(const QString &key, Action *action, int weight)
+bool RateLimiter::addAction(const QString &key, Action *action, int weight, Priority priority)
 {
-	return d->addAction(key, weight, action);
+	return d->addAction(key, weight, priority, action);
 }
 
 RateLimiter::Action *RateLimiter::lastAction(const QString &key) const
 {
-	if(d->buckets.contains(key))
-	{
-		const Private::Bucket &bucket = d->buckets[key];
-		if(!bucket.actions.isEmpty())
-			return bucket.actions.last().action;
-	}
+	return d->lastAction(key);
+}
+
+void RateLimiter::addToPrometheus(StatsManager *stats, const QList<QPair<QString, const RateLimiter*>> &limiters)
+{
+	// metrics of the same name must be added consecutively
+	QStringList labels;
+	for(int n = 0; n < limiters.count(); ++n)
+		labels += QString("limiter=\"%1\"").arg(limiters[n].first);
+
+	for(int n = 0; n < limiters.count(); ++n)
+		stats->addPrometheusGauge("rate_limiter_queued_weight", "Weight of the actions queued in a rate limiter", labels[n], &limiters[n].second->d->metrics.weight);
+
+	for(int n = 0; n < limiters.count(); ++n)
+		stats->addPrometheusGauge("rate_limiter_queued_actions", "Actions queued in a rate limiter", labels[n], &limiters[n].second->d->metrics.actions);
+
+	for(int n = 0; n < limiters.count(); ++n)
+		stats->addPrometheusGauge("rate_limiter_buckets", "Keys with actions queued in a rate limiter", labels[n], &limiters[n].second->d->metrics.buckets);
+
+	for(int n = 0; n < limiters.count(); ++n)
+		stats->addPrometheusCounter("rate_limiter_executed_total", "Actions executed by a rate limiter", labels[n], &limiters[n].second->d->metrics.executed);
+
+	for(int n = 0; n < limiters.count(); ++n)
+		stats->addPrometheusCounter("rate_limiter_dropped_total", "Actions refused by a rate limiter, due to its hwm or the memory budget", labels[n], &limiters[n].second->d->metrics.dropped);
 
-	return 0;
+	for(int n = 0; n < limiters.count(); ++n)
+		stats->addPrometheusHistogram("rate_limiter_wait_seconds", "Time actions wait in a rate limiter before executing", labels[n], &limiters[n].second->d->metrics.wait);
 }
@@ -25,8 +25,11 @@
 #define RATELIMITER_H
 
 #include <memory>
+#include <QList>
+#include <QPair>
 
 class QString;
+class StatsManager;
 
 class RateLimiter
 {
@@ -37,6 +40,18 @@ public:
 		virtual ~Action() {}
 
 		virtual bool execute() = 0;
+
+		// called when the limiter is done with the action. the default
+		// deletes it, but actions may be recycled instead
+		virtual void release() { delete this; }
+	};
+
+	// high priority actions run before the normal actions queued under the
+	// same key, and are admitted even if the key is at its hwm
+	enum Priority
+	{
+		Normal,
+		High
 	};
 
 	RateLimiter();
@@ -46,9 +61,16 @@ public:
 	void setHwm(int hwm);
 	void setBatchWaitEnabled(bool on);
 
-	bool addAction(const QString &key, Action *action, int weight = 1);
+	bool addAction(const QString &key, Action *action, int weight = 1, Priority priority = Normal);
+
+	// returns the last normal priority action queued under the key
 	Action *lastAction(const QString &key) const;
 
+	// registers the queue depth, drain, drop and wait metrics of each
+	// limiter, labeled with its name. the limiters must outlive the stats
+	// manager
+	static void addToPrometheus(StatsManager *stats, const QList<QPair<QString, const RateLimiter*>> &limiters);
+
 private:
 	class Private;
 	std::shared_ptr<Private> d;
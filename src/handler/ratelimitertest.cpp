@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+
+#include <functional>
+#include <qtestsupport_core.h>
+#include "test.h"
+#include "timer.h"
+#include "defercall.h"
+#include "ratelimiter.h"
+
+namespace {
+
+class RecordAction : public RateLimiter::Action
+{
+public:
+	QStringList *out;
+	QString name;
+	std::function<void ()> onExecute;
+
+	RecordAction(QStringList *_out, const QString &_name, std::function<void ()> _onExecute = std::function<void ()>()) :
+		out(_out),
+		name(_name),
+		onExecute(_onExecute)
+	{
+	}
+
+	virtual bool execute()
+	{
+		*out += name;
+
+		if(onExecute)
+			onExecute();
+
+		return true;
+	}
+};
+
+class TestState
+{
+public:
+	TestState()
+	{
+		Timer::init(100);
+	}
+
+	~TestState()
+	{
+		DeferCall::cleanup();
+		Timer::deinit();
+	}
+};
+
+}
+
+static void waitFor(const QStringList &out, int count)
+{
+	for(int n = 0; n < 100 && out.count() < count; ++n)
+		QTest::qWait(10);
+}
+
+static void roundRobin()
+{
+	TestQCoreApplication qapp;
+	TestState state;
+
+	RateLimiter limiter;
+	QStringList out;
+
+	TEST_ASSERT(limiter.addAction("a", new RecordAction(&out, "a1")));
+	TEST_ASSERT(limiter.addAction("a", new RecordAction(&out, "a2")));
+	TEST_ASSERT(limiter.addAction("b", new RecordAction(&out, "b1")));
+
+	waitFor(out, 3);
+
+	TEST_ASSERT(out == QStringList() << "a1" << "b1" << "a2");
+}
+
+static void hwm()
+{
+	TestQCoreApplication qapp;
+	TestState state;
+
+	RateLimiter limiter;
+	limiter.setHwm(2);
+
+	QStringList out;
+
+	RecordAction *last = new RecordAction(&out, "a2");
+
+	TEST_ASSERT(limiter.addAction("a", new RecordAction(&out, "a1")));
+	TEST_ASSERT(limiter.addAction("a", last));
+	TEST_ASSERT(limiter.lastAction("a") == last);
+	TEST_ASSERT(!limiter.lastAction("b"));
+
+	RecordAction *rejected = new RecordAction(&out, "a3");
+	TEST_ASSERT(!limiter.addAction("a", rejected));
+	delete rejected;
+
+	// other keys are unaffected
+	TEST_ASSERT(limiter.addAction("b", new RecordAction(&out, "b1")));
+
+	waitFor(out, 3);
+
+	TEST_ASSERT(out == QStringList() << "a1" << "b1" << "a2");
+	TEST_ASSERT(!limiter.lastAction("a"));
+}
+
+static void priority()
+{
+	TestQCoreApplication qapp;
+	TestState state;
+
+	RateLimiter limiter;
+	limiter.setHwm(2);
+
+	QStringList out;
+
+	RecordAction *last = new RecordAction(&out, "a2");
+
+	TEST_ASSERT(limiter.addAction("a", new RecordAction(&out, "a1")));
+	TEST_ASSERT(limiter.addAction("a", last));
+
+	// admitted past the hwm, and not returned as the last action
+	TEST_ASSERT(limiter.addAction("a", new RecordAction(&out, "h1"), 1, RateLimiter::High));
+	TEST_ASSERT(limiter.addAction("a", new RecordAction(&out, "h2"), 1, RateLimiter::High));
+	TEST_ASSERT(limiter.lastAction("a") == last);
+
+	TEST_ASSERT(limiter.addAction("b", new RecordAction(&out, "b1")));
+
+	waitFor(out, 5);
+
+	// high priority actions jump the queue of their own key only
+	TEST_ASSERT(out == QStringList() << "h1" << "b1" << "h2" << "a1" << "a2");
+}
+
+static void addDuringExecute()
+{
+	TestQCoreApplication qapp;
+	TestState state;
+
+	RateLimiter limiter;
+	QStringList out;
+
+	TEST_ASSERT(limiter.addAction("a", new RecordAction(&out, "a1", [&] {
+		// enough new keys to force the internal arrays to grow
+		for(int n = 0; n < 100; ++n)
+			limiter.addAction(QString("k%1").arg(n), new RecordAction(&out, QString("k%1").arg(n)));
+
+		limiter.addAction("a", new RecordAction(&out, "a2"));
+	})));
+
+	waitFor(out, 102);
+
+	TEST_ASSERT_EQ(out.count(), 102);
+	TEST_ASSERT_EQ(out.first(), QString("a1"));
+	TEST_ASSERT(out.contains("a2"));
+	TEST_ASSERT(out.contains("k99"));
+}
+
+extern "C" int ratelimiter_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(roundRobin());
+	TEST_CATCH(hwm());
+	TEST_CATCH(priority());
+	TEST_CATCH(addDuringExecute());
+
+	return 0;
+}
@@ -29,7 +29,12 @@
 #include "statsmanager.h"
 #include "wssession.h"
 
-RefreshWorker::RefreshWorker(ZrpcRequest *req, ZrpcManager *proxyControlClient, QHash<QString, QSet<WsSession*> > *wsSessionsByChannel) :
+// connections of a channel are refreshed in batches of this size, with
+// up to this many requests in flight
+#define REFRESH_BATCH_SIZE 100
+#define REFRESH_BATCHES_MAX 4
+
+RefreshWorker::RefreshWorker(ZrpcRequest *req, ZrpcManager *proxyControlClient, const ChannelIndex<WsSession> *wsSessionsByChannel) :
 	ignoreErrors_(false),
 	proxyControlClient_(proxyControlClient),
 	req_(req)
@@ -58,15 +63,15 @@ RefreshWorker::RefreshWorker(ZrpcRequest *req, ZrpcManager *proxyControlClient,
 
 		QString channel = QString::fromUtf8(args["channel"].toByteArray());
 
-		QSet<WsSession*> wsbc = wsSessionsByChannel->value(channel);
-		foreach(WsSession *s, wsbc)
+		if(const ChannelIndex<WsSession>::Subscribers *wsbc = wsSessionsByChannel->subscribers(channel))
 		{
-			cids_ += s->cid;
+			for(WsSession *s : *wsbc)
+				cids_ += s->cid;
 		}
 
 		ignoreErrors_ = true;
 
-		refreshNextCid();
+		refreshNextBatches();
 	}
 	else
 	{
@@ -94,6 +99,39 @@ void RefreshWorker::refreshNextCid()
 	finishedConnection_ = refresh_->finished.connect(boost::bind(&RefreshWorker::proxyRefresh_finished, this, boost::placeholders::_1));
 }
 
+void RefreshWorker::refreshNextBatches()
+{
+	while(!cids_.isEmpty() && (int)batches_.size() < REFRESH_BATCHES_MAX)
+	{
+		QList<QByteArray> batch;
+		while(!cids_.isEmpty() && batch.count() < REFRESH_BATCH_SIZE)
+			batch += cids_.takeFirst().toUtf8();
+
+		auto d = std::unique_ptr<Deferred>(ControlRequest::refreshMany(proxyControlClient_, batch));
+
+		// safe to not track, since d can't outlive this
+		d->finished.connect(boost::bind(&RefreshWorker::proxyRefreshBatch_finished, this, d.get(), boost::placeholders::_1));
+
+		batches_[d.get()] = std::move(d);
+	}
+
+	if(batches_.empty())
+	{
+		req_->respond();
+		setFinished(true);
+	}
+}
+
+void RefreshWorker::proxyRefreshBatch_finished(Deferred *d, const DeferredResult &result)
+{
+	// errors are ignored for channel refreshes
+	Q_UNUSED(result);
+
+	batches_.erase(d);
+
+	refreshNextBatches();
+}
+
 void RefreshWorker::proxyRefresh_finished(const DeferredResult &result)
 {
 	if(result.success || ignoreErrors_)
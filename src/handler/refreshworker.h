@@ -24,14 +24,15 @@
 #ifndef REFRESHWORKER_H
 #define REFRESHWORKER_H
 
+#include <map>
 #include <QByteArray>
 #include <QHash>
 #include <QSet>
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 #include "deferred.h"
 #include "zrpcrequest.h"
-
-using Connection = boost::signals2::scoped_connection;
+#include "channelindex.h"
 
 class ZrpcManager;
 class StatsManager;
@@ -40,7 +41,7 @@ class WsSession;
 class RefreshWorker : public Deferred
 {
 public:
-	RefreshWorker(ZrpcRequest *req, ZrpcManager *proxyControlClient, QHash<QString, QSet<WsSession*> > *wsSessionsByChannel);
+	RefreshWorker(ZrpcRequest *req, ZrpcManager *proxyControlClient, const ChannelIndex<WsSession> *wsSessionsByChannel);
 
 private:
 	QStringList cids_;
@@ -49,10 +50,13 @@ private:
 	std::unique_ptr<ZrpcRequest> req_;
 	std::unique_ptr<Deferred> refresh_;
 	Connection finishedConnection_;
+	std::map<Deferred*, std::unique_ptr<Deferred>> batches_;
 
 	void refreshNextCid();
+	void refreshNextBatches();
 	void respondError(const QByteArray &condition);
 	void proxyRefresh_finished(const DeferredResult &result);
+	void proxyRefreshBatch_finished(Deferred *d, const DeferredResult &result);
 };
 
 #endif
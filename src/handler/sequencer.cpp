@@ -23,16 +23,65 @@
 
 #include "sequencer.h"
 
-#include <QDateTime>
+#include <assert.h>
+#include <atomic>
+#include <vector>
+#include <QSet>
 #include "log.h"
 #include "timer.h"
+#include "loopclock.h"
+#include "timerwheel.h"
+#include "objectstats.h"
 #include "defercall.h"
 #include "publishitem.h"
 #include "publishlastids.h"
+#include "fingerprintset.h"
+#include "latencyhistogram.h"
+#include "statsmanager.h"
 
 #define CHANNEL_PENDING_MAX 100
 #define DEFAULT_PENDING_EXPIRE 5000
-#define EXPIRE_INTERVAL 1000
+#define DEFAULT_ID_CACHE_MEMORY_MAX (64 * 1024 * 1024)
+
+// expirations are grouped into buckets of this granularity, with one wheel
+// timer per bucket rather than per item
+#define EXPIRE_TICK_MS 100
+#define EXPIRE_BUCKETS_MAX 20000
+
+// adaptive waiting. once a channel has enough gap outcomes and they are
+// mostly losses, its wait shrinks to a multiple of the delay that recovered
+// gaps needed. a gap with more items held behind it than recovered gaps
+// ever had is taken as lost
+#define REORDER_HISTORY_MAX 10000
+#define ADAPTIVE_SAMPLES_MIN 4
+#define ADAPTIVE_LOSS_THRESHOLD 192 // out of 256
+#define ADAPTIVE_WAIT_MIN 200
+#define ADAPTIVE_DISTANCE_MIN 8
+
+static std::atomic<quint64> g_reordered(0);
+static std::atomic<quint64> g_reorderDistance(0);
+static std::atomic<quint64> g_expired(0);
+static std::atomic<quint64> g_releasedEarly(0);
+static LatencyHistogram g_reorderDelay;
+
+static qint64 durationToTicksRoundDown(qint64 msec)
+{
+	return msec / EXPIRE_TICK_MS;
+}
+
+static qint64 durationToTicksRoundUp(qint64 msec)
+{
+	return (msec + EXPIRE_TICK_MS - 1) / EXPIRE_TICK_MS;
+}
+
+// 64 bits even where qHash is 32 bits
+static quint64 idFingerprint(const QString &channel, const QString &id)
+{
+	quint64 a = (quint64)qHash(id, qHash(channel));
+	quint64 b = (quint64)qHash(channel, qHash(id));
+
+	return a ^ (b << 32) ^ (b >> 32);
+}
 
 class Sequencer::Private
 {
@@ -40,86 +89,619 @@ public:
 	class PendingItem
 	{
 	public:
-		qint64 time;
+		int bucket;
+		PendingItem *prev;
+		PendingItem *next;
 		PublishItem item;
+		qint64 since;
+		qint64 bytes;
+
+		PendingItem(int _bucket, const PublishItem &_item, qint64 _since) :
+			bucket(_bucket),
+			prev(0),
+			next(0),
+			item(_item),
+			since(_since),
+			bytes(sizeof(PendingItem))
+		{
+			// the payloads are shared with the caller, but are kept alive
+			// by the item while it is pending
+			foreach(const PublishFormat &f, item.formats)
+				bytes += f.body.size();
+
+			ObjectStats::add(ObjectStats::SequencerItems, 1, bytes);
+		}
+
+		~PendingItem()
+		{
+			ObjectStats::remove(ObjectStats::SequencerItems, 1, bytes);
+		}
 	};
 
 	class ChannelPendingItems
 	{
 	public:
 		QHash<QString, PendingItem*> itemsByPrevId;
+	};
 
-		~ChannelPendingItems()
+	// outcomes of past gaps in a channel
+	class ReorderHistory
+	{
+	public:
+		int samples; // saturates at ADAPTIVE_SAMPLES_MIN
+		int lossScore; // moving average of losses, out of 256
+		qint64 delay; // decaying max of recovery delay, in msecs
+		int distance; // decaying max of items held behind a recovered gap
+
+		ReorderHistory() :
+			samples(0),
+			lossScore(0),
+			delay(0),
+			distance(0)
 		{
-			qDeleteAll(itemsByPrevId);
 		}
 	};
 
 	class CachedId
 	{
 	public:
-		qint64 expireTime;
 		QString channel;
 		QString id;
+		int next;
+	};
+
+	// a bucket holds either pending items or cached ids, in insertion order
+	class ExpireBucket
+	{
+	public:
+		bool pending;
+		quint64 ticks;
+		int timerKey;
+		bool expiring;
+		PendingItem *pendingFirst;
+		PendingItem *pendingLast;
+		int idFirst;
+		int idLast;
+		std::vector<quint64> fingerprints;
 	};
 
 	Sequencer *q;
 	PublishLastIds *lastIds;
 	QHash<QString, ChannelPendingItems> pendingItemsByChannel;
-	QMap<QPair<qint64, PendingItem*>, PendingItem*> pendingItemsByTime;
 	std::unique_ptr<Timer> expireTimer;
 	int pendingExpireMSecs;
+	bool adaptiveWait;
+	QHash<QString, ReorderHistory> reorderHistory;
 	int idCacheTtl;
-	QHash<QPair<QString, QString>, CachedId*> idCacheById;
-	QMap<QPair<qint64, CachedId*>, CachedId*> idCacheByExpireTime;
+	TimerWheel wheel;
+	qint64 startTime;
+	quint64 currentTicks;
+	std::vector<ExpireBucket> buckets;
+	std::vector<int> freeBuckets;
+	int lastPendingBucket;
+	int lastIdBucket;
+	QHash<quint64, int> pendingBucketsByTicks;
+	QHash<quint64, int> idCacheByFingerprint;
+	std::vector<CachedId> cachedIds;
+	std::vector<int> freeCachedIds;
+	IdCacheMode idCacheMode;
+	qint64 idCacheMemoryMax;
+	FingerprintSet compactIds;
+	quint32 idCacheDuplicates;
+	quint32 idCacheUncached;
 
 	Private(Sequencer *_q, PublishLastIds *_publishLastIds) :
 		q(_q),
 		lastIds(_publishLastIds),
 		pendingExpireMSecs(DEFAULT_PENDING_EXPIRE),
-		idCacheTtl(-1)
+		adaptiveWait(false),
+		idCacheTtl(-1),
+		wheel(EXPIRE_BUCKETS_MAX),
+		currentTicks(0),
+		lastPendingBucket(-1),
+		lastIdBucket(-1),
+		idCacheMode(ExactIds),
+		idCacheMemoryMax(DEFAULT_ID_CACHE_MEMORY_MAX),
+		idCacheDuplicates(0),
+		idCacheUncached(0)
 	{
+		startTime = LoopClock::msecsSinceEpoch();
+
 		expireTimer = std::make_unique<Timer>();
+		expireTimer->setSingleShot(true);
 		expireTimer->timeout.connect(boost::bind(&Private::expireTimer_timeout, this));
 	}
 
 	~Private()
 	{
-		qDeleteAll(idCacheById);
+		QHashIterator<QString, ChannelPendingItems> it(pendingItemsByChannel);
+		while(it.hasNext())
+		{
+			it.next();
+			qDeleteAll(it.value().itemsByPrevId);
+		}
 	}
 
-	void addItem(const PublishItem &item, bool seq)
+	// returns <0 if there is no capacity for a new bucket. items may then be
+	// added to an existing bucket of the same kind, which expires earlier
+	// than requested
+	int getBucket(bool pending, qint64 expireTime)
+	{
+		int &last = (pending ? lastPendingBucket : lastIdBucket);
+
+		quint64 ticks = (quint64)durationToTicksRoundUp(qMax(expireTime - startTime, (qint64)0));
+
+		// expiration times only move forward for a fixed ttl, so matching
+		// the most recently created bucket is usually enough. adaptive
+		// waits vary per channel, so pending buckets are also indexed
+		if(last >= 0 && buckets[last].ticks == ticks)
+			return last;
+
+		if(pending)
+		{
+			int index = pendingBucketsByTicks.value(ticks, -1);
+			if(index >= 0)
+				return index;
+		}
+
+		int index;
+		if(!freeBuckets.empty())
+		{
+			index = freeBuckets.back();
+			freeBuckets.pop_back();
+		}
+		else
+		{
+			index = (int)buckets.size();
+			buckets.push_back(ExpireBucket());
+		}
+
+		int key = wheel.add(ticks, (size_t)index);
+		if(key < 0)
+		{
+			freeBuckets.push_back(index);
+			return last;
+		}
+
+		ExpireBucket &b = buckets[index];
+		b.pending = pending;
+		b.ticks = ticks;
+		b.timerKey = key;
+		b.expiring = false;
+		b.pendingFirst = 0;
+		b.pendingLast = 0;
+		b.idFirst = -1;
+		b.idLast = -1;
+		b.fingerprints.clear();
+
+		if(pending)
+			pendingBucketsByTicks.insert(ticks, index);
+
+		last = index;
+
+		return index;
+	}
+
+	void freeBucket(int index)
+	{
+		ExpireBucket &b = buckets[index];
+
+		if(b.timerKey >= 0)
+		{
+			wheel.remove(b.timerKey);
+			b.timerKey = -1;
+		}
+
+		if(b.pending)
+		{
+			QHash<quint64, int>::iterator it = pendingBucketsByTicks.find(b.ticks);
+			if(it != pendingBucketsByTicks.end() && it.value() == index)
+				pendingBucketsByTicks.erase(it);
+		}
+
+		if(lastPendingBucket == index)
+			lastPendingBucket = -1;
+
+		if(lastIdBucket == index)
+			lastIdBucket = -1;
+
+		freeBuckets.push_back(index);
+	}
+
+	void unlinkPending(PendingItem *i)
 	{
-		qint64 now = QDateTime::currentMSecsSinceEpoch();
+		ExpireBucket &b = buckets[i->bucket];
+
+		if(i->prev)
+			i->prev->next = i->next;
+		else
+			b.pendingFirst = i->next;
 
-		while(!idCacheByExpireTime.isEmpty())
+		if(i->next)
+			i->next->prev = i->prev;
+		else
+			b.pendingLast = i->prev;
+
+		if(!b.pendingFirst && !b.expiring)
+			freeBucket(i->bucket);
+	}
+
+	void updateWheel(qint64 now)
+	{
+		// time must go forward
+		if(now > startTime)
 		{
-			QMap<QPair<qint64, CachedId*>, CachedId*>::iterator it = idCacheByExpireTime.begin();
-			CachedId *i = it.value();
+			currentTicks = (quint64)durationToTicksRoundDown(now - startTime);
+			wheel.update(currentTicks);
+		}
+	}
 
-			if(i->expireTime > now)
+	void updateTimer(qint64 now)
+	{
+		// cached ids are expired lazily as items are added, so the timer
+		// is only needed when there are pending items
+		if(pendingItemsByChannel.isEmpty())
+		{
+			expireTimer->stop();
+			return;
+		}
+
+		qint64 timeoutTicks = wheel.timeout();
+		if(timeoutTicks < 0)
+		{
+			expireTimer->stop();
+			return;
+		}
+
+		qint64 ticksSinceUpdate = qMax(durationToTicksRoundDown(now - startTime) - (qint64)currentTicks, (qint64)0);
+		timeoutTicks = qMax(timeoutTicks - ticksSinceUpdate, (qint64)0);
+
+		expireTimer->start(timeoutTicks * EXPIRE_TICK_MS);
+	}
+
+	void addItem(const PublishItem &item, bool seq)
+	{
+		qint64 now = LoopClock::msecsSinceEpoch();
+
+		processExpired(now);
+		addItem(item, seq, now);
+	}
+
+	void addItems(const QList<PublishItem> &items, const QList<bool> &seq)
+	{
+		assert(seq.count() == items.count());
+
+		// expire once for the whole batch
+		qint64 now = LoopClock::msecsSinceEpoch();
+
+		processExpired(now);
+
+		for(int n = 0; n < items.count(); ++n)
+			addItem(items[n], seq[n], now);
+	}
+
+	void processExpired(qint64 now)
+	{
+		updateWheel(now);
+
+		while(true)
+		{
+			TimerWheel::Expired expired = wheel.takeExpired();
+			if(expired.key < 0)
 				break;
 
-			idCacheById.remove(QPair<QString, QString>(i->channel, i->id));
-			idCacheByExpireTime.erase(it);
-			delete i;
+			int index = (int)expired.userData;
+			buckets[index].timerKey = -1;
+
+			if(buckets[index].pending)
+				expirePending(index, now);
+			else
+				expireIds(index);
+		}
+	}
+
+	void resetIdCache()
+	{
+		for(int n = 0; n < (int)buckets.size(); ++n)
+		{
+			ExpireBucket &b = buckets[n];
+			if(!b.pending && b.timerKey >= 0)
+				freeBucket(n);
+		}
+
+		idCacheByFingerprint.clear();
+		cachedIds.clear();
+		freeCachedIds.clear();
+
+		if(idCacheMode == CompactIds)
+		{
+			// each entry takes table space plus its place in an expiry
+			// bucket
+			qint64 entryBytes = FingerprintSet::bytesPerEntry() + sizeof(quint64);
+
+			int slots = 1;
+			while(slots < (1 << 30) && (qint64)slots * 2 * entryBytes * 3 / 4 <= idCacheMemoryMax)
+				slots *= 2;
+
+			compactIds.reset(slots);
+		}
+		else
+		{
+			compactIds.reset(0);
+		}
+	}
+
+	void expireIds(int index)
+	{
+		std::vector<quint64> &fingerprints = buckets[index].fingerprints;
+		for(quint64 fp : fingerprints)
+			compactIds.remove(fp);
+		fingerprints.clear();
+
+		int pos = buckets[index].idFirst;
+		while(pos >= 0)
+		{
+			CachedId &i = cachedIds[pos];
+			int next = i.next;
+
+			idCacheByFingerprint.remove(idFingerprint(i.channel, i.id));
+			i.channel.clear();
+			i.id.clear();
+			freeCachedIds.push_back(pos);
+
+			pos = next;
+		}
+
+		freeBucket(index);
+	}
+
+	void expirePending(int index, qint64 now)
+	{
+		// sending an item may release or expire other pending items,
+		// including ones in this bucket, so keep the bucket until done
+		buckets[index].expiring = true;
+
+		while(buckets[index].pendingFirst)
+		{
+			PendingItem *i = buckets[index].pendingFirst;
+
+			log_debug("timing out item channel=[%s] id=[%s]", qPrintable(i->item.channel), qPrintable(i->item.id));
+
+			PublishItem item = i->item;
+			removePending(i);
+
+			++g_expired;
+			recordLost(item.channel);
+
+			sendItem(item, false, now);
+		}
+
+		freeBucket(index);
+	}
+
+	// removes from the channel and the bucket, and deletes
+	void removePending(PendingItem *i)
+	{
+		QHash<QString, ChannelPendingItems>::iterator it = pendingItemsByChannel.find(i->item.channel);
+		assert(it != pendingItemsByChannel.end());
+
+		it.value().itemsByPrevId.remove(i->item.prevId);
+		if(it.value().itemsByPrevId.isEmpty())
+			pendingItemsByChannel.erase(it);
+
+		unlinkPending(i);
+		delete i;
+	}
+
+	ReorderHistory &historyFor(const QString &channel)
+	{
+		QHash<QString, ReorderHistory>::iterator it = reorderHistory.find(channel);
+		if(it != reorderHistory.end())
+			return it.value();
+
+		// forget everything rather than tracking recency. channels with
+		// gaps relearn quickly
+		if(reorderHistory.count() >= REORDER_HISTORY_MAX)
+			reorderHistory.clear();
+
+		return reorderHistory[channel];
+	}
+
+	void recordRecovered(const QString &channel, qint64 delay, int distance)
+	{
+		if(!adaptiveWait)
+			return;
+
+		ReorderHistory &h = historyFor(channel);
+
+		if(h.samples < ADAPTIVE_SAMPLES_MIN)
+			++h.samples;
+
+		h.lossScore -= h.lossScore / 4;
+
+		// rise immediately, decay slowly
+		h.delay = (delay >= h.delay ? delay : h.delay - (h.delay - delay) / 8);
+		h.distance = (distance >= h.distance ? distance : h.distance - (h.distance - distance) / 8);
+	}
+
+	void recordLost(const QString &channel)
+	{
+		if(!adaptiveWait)
+			return;
+
+		ReorderHistory &h = historyFor(channel);
+
+		if(h.samples < ADAPTIVE_SAMPLES_MIN)
+			++h.samples;
+
+		h.lossScore += (256 - h.lossScore + 3) / 4;
+	}
+
+	int pendingWait(const QString &channel) const
+	{
+		if(!adaptiveWait)
+			return pendingExpireMSecs;
+
+		QHash<QString, ReorderHistory>::const_iterator it = reorderHistory.find(channel);
+		if(it == reorderHistory.end())
+			return pendingExpireMSecs;
+
+		const ReorderHistory &h = it.value();
+		if(h.samples < ADAPTIVE_SAMPLES_MIN || h.lossScore < ADAPTIVE_LOSS_THRESHOLD)
+			return pendingExpireMSecs;
+
+		return (int)qMin(qMax(h.delay * 2, (qint64)ADAPTIVE_WAIT_MIN), (qint64)pendingExpireMSecs);
+	}
+
+	// number of held items at which the oldest gap is released
+	int pendingDistanceMax(const QString &channel) const
+	{
+		QHash<QString, ReorderHistory>::const_iterator it = reorderHistory.find(channel);
+		if(it == reorderHistory.end() || it.value().samples < ADAPTIVE_SAMPLES_MIN)
+			return CHANNEL_PENDING_MAX;
+
+		return qMin(qMax(it.value().distance * 2, ADAPTIVE_DISTANCE_MIN), CHANNEL_PENDING_MAX);
+	}
+
+	// sends the oldest item that directly follows a gap, along with any
+	// items chained after it
+	void releaseOldestGap(const QString &channel, qint64 now)
+	{
+		QHash<QString, ChannelPendingItems>::iterator it = pendingItemsByChannel.find(channel);
+		if(it == pendingItemsByChannel.end())
+			return;
+
+		const QHash<QString, PendingItem*> &items = it.value().itemsByPrevId;
+
+		QSet<QString> ids;
+		foreach(PendingItem *i, items)
+			ids += i->item.id;
+
+		PendingItem *oldest = 0;
+		foreach(PendingItem *i, items)
+		{
+			if(ids.contains(i->item.prevId))
+				continue;
+
+			if(!oldest || i->since < oldest->since)
+				oldest = i;
 		}
 
-		if(!item.id.isNull() && idCacheTtl > 0)
+		// every held item follows another held item. can't happen unless
+		// ids repeat, but release something anyway
+		if(!oldest)
+			oldest = items.begin().value();
+
+		log_debug("sequencer: gap for channel [%s] before id [%s] looks lost, releasing", qPrintable(channel), qPrintable(oldest->item.id));
+
+		PublishItem item = oldest->item;
+		removePending(oldest);
+
+		++g_releasedEarly;
+		recordLost(channel);
+
+		sendItem(item, false, now);
+	}
+
+	bool isCachedId(const PublishItem &item) const
+	{
+		if(item.id.isNull() || idCacheTtl <= 0)
+			return false;
+
+		quint64 fp = idFingerprint(item.channel, item.id);
+
+		if(idCacheMode == CompactIds)
+			return compactIds.contains(fp);
+
+		int pos = idCacheByFingerprint.value(fp, -1);
+		if(pos < 0)
+			return false;
+
+		const CachedId &i = cachedIds[pos];
+		return (i.id == item.id && i.channel == item.channel);
+	}
+
+	void addItem(const PublishItem &item, bool seq, qint64 now)
+	{
+		if(!item.id.isNull() && idCacheTtl > 0 && idCacheMode == CompactIds)
 		{
-			QPair<QString, QString> idKey(item.channel, item.id);
-			if(idCacheById.contains(idKey))
+			quint64 fp = idFingerprint(item.channel, item.id);
+
+			if(compactIds.contains(fp))
 			{
-				// we've seen this ID recently, drop the message
+				// we've seen this ID recently (or a colliding one), drop
+				++idCacheDuplicates;
 				return;
 			}
 
-			CachedId *i = new CachedId;
-			i->expireTime = now + (idCacheTtl * 1000);
-			i->channel = item.channel;
-			i->id = item.id;
-			idCacheById.insert(idKey, i);
-			idCacheByExpireTime.insert(QPair<qint64, CachedId*>(i->expireTime, i), i);
+			int bucket = -1;
+			if(compactIds.count() < compactIds.capacity())
+				bucket = getBucket(false, now + (idCacheTtl * 1000));
+
+			if(bucket >= 0)
+			{
+				compactIds.insert(fp);
+				buckets[bucket].fingerprints.push_back(fp);
+			}
+			else
+			{
+				++idCacheUncached;
+			}
+		}
+		else if(!item.id.isNull() && idCacheTtl > 0)
+		{
+			quint64 fp = idFingerprint(item.channel, item.id);
+
+			int pos = idCacheByFingerprint.value(fp, -1);
+			if(pos >= 0)
+			{
+				const CachedId &i = cachedIds[pos];
+				if(i.id == item.id && i.channel == item.channel)
+				{
+					// we've seen this ID recently, drop the message
+					++idCacheDuplicates;
+					return;
+				}
+
+				// fingerprint collision. leave the existing entry, which
+				// means this ID won't be deduplicated
+				++idCacheUncached;
+			}
+			else
+			{
+				int bucket = getBucket(false, now + (idCacheTtl * 1000));
+				if(bucket >= 0)
+				{
+					if(!freeCachedIds.empty())
+					{
+						pos = freeCachedIds.back();
+						freeCachedIds.pop_back();
+					}
+					else
+					{
+						pos = (int)cachedIds.size();
+						cachedIds.push_back(CachedId());
+					}
+
+					CachedId &i = cachedIds[pos];
+					i.channel = item.channel;
+					i.id = item.id;
+					i.next = -1;
+
+					ExpireBucket &b = buckets[bucket];
+					if(b.idLast >= 0)
+						cachedIds[b.idLast].next = pos;
+					else
+						b.idFirst = pos;
+					b.idLast = pos;
+
+					idCacheByFingerprint.insert(fp, pos);
+				}
+				else
+				{
+					++idCacheUncached;
+				}
+			}
 		}
 
 		if(!seq)
@@ -128,6 +710,11 @@ public:
 			return;
 		}
 
+		sequenceItem(item, now);
+	}
+
+	void sequenceItem(const PublishItem &item, qint64 now)
+	{
 		QString lastId = lastIds->value(item.channel);
 
 		if(!lastId.isNull() && !item.prevId.isNull() && lastId != item.prevId)
@@ -140,46 +727,80 @@ public:
 				return;
 			}
 
-			if(channelPendingItems.itemsByPrevId.count() >= CHANNEL_PENDING_MAX)
+			int held = channelPendingItems.itemsByPrevId.count();
+
+			if(adaptiveWait && held > 0 && held >= pendingDistanceMax(item.channel))
+			{
+				// releasing may bring the channel up to this item
+				releaseOldestGap(item.channel, now);
+				sequenceItem(item, now);
+				return;
+			}
+
+			if(held >= CHANNEL_PENDING_MAX)
 			{
 				log_debug("sequencer: too many pending items for channel [%s], dropping", qPrintable(item.channel));
 				return;
 			}
 
-			PendingItem *i = new PendingItem;
-			i->time = now;
-			i->item = item;
+			int wait = pendingWait(item.channel);
+
+			int bucket = getBucket(true, now + wait);
+			if(bucket < 0)
+			{
+				if(channelPendingItems.itemsByPrevId.isEmpty())
+					pendingItemsByChannel.remove(item.channel);
+
+				log_debug("sequencer: no capacity to hold item for channel [%s], sending", qPrintable(item.channel));
+				sendItem(item, false, now);
+				return;
+			}
+
+			PendingItem *i = new PendingItem(bucket, item, now);
+
+			ExpireBucket &b = buckets[bucket];
+			i->prev = b.pendingLast;
+			if(b.pendingLast)
+				b.pendingLast->next = i;
+			else
+				b.pendingFirst = i;
+			b.pendingLast = i;
 
 			channelPendingItems.itemsByPrevId.insert(item.prevId, i);
-			pendingItemsByTime.insert(QPair<qint64, PendingItem*>(i->time, i), i);
 
-			if(!expireTimer->isActive())
-				expireTimer->start(EXPIRE_INTERVAL);
+			// with a fixed wait, pending buckets are created in expiration
+			// order, so an active timer is already due no later than this
+			// one. a shorter wait may be due sooner
+			if(!expireTimer->isActive() || wait < pendingExpireMSecs)
+				updateTimer(now);
 			return;
 		}
 
-		sendItem(item);
+		sendItem(item, true, now);
 	}
 
 	void clear(const QString &channel)
 	{
-		if(!pendingItemsByChannel.contains(channel))
+		QHash<QString, ChannelPendingItems>::iterator it = pendingItemsByChannel.find(channel);
+		if(it == pendingItemsByChannel.end())
 			return;
 
-		ChannelPendingItems &channelPendingItems = pendingItemsByChannel[channel];
-		QHashIterator<QString, PendingItem*> it(channelPendingItems.itemsByPrevId);
-		while(it.hasNext())
-		{
-			it.next();
-			PendingItem *i = it.value();
+		QHash<QString, PendingItem*> items = it.value().itemsByPrevId;
+		pendingItemsByChannel.erase(it);
 
-			pendingItemsByTime.remove(QPair<qint64, PendingItem*>(i->time, i));
+		foreach(PendingItem *i, items)
+		{
+			unlinkPending(i);
+			delete i;
 		}
 
-		pendingItemsByChannel.remove(channel);
+		if(pendingItemsByChannel.isEmpty())
+			expireTimer->stop();
 	}
 
-	void sendItem(const PublishItem &item)
+	// recovered means the item filled a gap, rather than being sent
+	// because the gap was given up on
+	void sendItem(const PublishItem &item, bool recovered, qint64 now)
 	{
 		if(!item.id.isNull())
 			lastIds->set(item.channel, item.id);
@@ -188,73 +809,59 @@ public:
 
 		q->itemReady(item);
 
-		if(pendingItemsByChannel.contains(item.channel))
-		{
-			ChannelPendingItems &channelPendingItems = pendingItemsByChannel[item.channel];
-			QString id = item.id;
+		QString id = item.id;
+		int released = 0;
+		qint64 delayMax = 0;
 
-			while(!id.isNull() && !channelPendingItems.itemsByPrevId.isEmpty())
-			{
-				PendingItem *i = channelPendingItems.itemsByPrevId.value(id);
-				if(!i)
-					break;
-
-				PublishItem pitem = i->item;
-				channelPendingItems.itemsByPrevId.remove(i->item.prevId);
-				pendingItemsByTime.remove(QPair<qint64, PendingItem*>(i->time, i));
-				delete i;
-
-				if(!pitem.id.isNull())
-					lastIds->set(pitem.channel, pitem.id);
-				else
-					lastIds->remove(pitem.channel);
+		while(!id.isNull())
+		{
+			QHash<QString, ChannelPendingItems>::iterator it = pendingItemsByChannel.find(item.channel);
+			if(it == pendingItemsByChannel.end())
+				break;
 
-				q->itemReady(pitem);
+			PendingItem *i = it.value().itemsByPrevId.value(id);
+			if(!i)
+				break;
 
-				id = pitem.id;
-			}
+			PublishItem pitem = i->item;
+			qint64 delay = qMax(now - i->since, (qint64)0);
+			removePending(i);
 
-			if(channelPendingItems.itemsByPrevId.isEmpty())
+			if(recovered)
 			{
-				pendingItemsByChannel.remove(item.channel);
-
-				if(pendingItemsByChannel.isEmpty())
-					expireTimer->stop();
+				++g_reordered;
+				g_reorderDelay.record(delay * 1000);
+				delayMax = qMax(delayMax, delay);
 			}
-		}
-	}
 
-	void expireTimer_timeout()
-	{
-		qint64 now = QDateTime::currentMSecsSinceEpoch();
-		qint64 threshold = now - pendingExpireMSecs;
+			++released;
 
-		while(!pendingItemsByTime.isEmpty())
-		{
-			QMap<QPair<qint64, PendingItem*>, PendingItem*>::iterator it = pendingItemsByTime.begin();
-			PendingItem *i = it.value();
+			if(!pitem.id.isNull())
+				lastIds->set(pitem.channel, pitem.id);
+			else
+				lastIds->remove(pitem.channel);
 
-			if(i->time > threshold)
-				break;
+			q->itemReady(pitem);
 
-			log_debug("timing out item channel=[%s] id=[%s]", qPrintable(i->item.channel), qPrintable(i->item.id));
+			id = pitem.id;
+		}
 
-			PublishItem item = i->item;
-			ChannelPendingItems &channelPendingItems = pendingItemsByChannel[i->item.channel];
-			channelPendingItems.itemsByPrevId.remove(i->item.prevId);
-			pendingItemsByTime.erase(it);
-			delete i;
+		if(recovered && released > 0)
+		{
+			g_reorderDistance += released;
+			recordRecovered(item.channel, delayMax, released);
+		}
 
-			if(channelPendingItems.itemsByPrevId.isEmpty())
-			{
-				pendingItemsByChannel.remove(item.channel);
+		if(pendingItemsByChannel.isEmpty())
+			expireTimer->stop();
+	}
 
-				if(pendingItemsByChannel.isEmpty())
-					expireTimer->stop();
-			}
+	void expireTimer_timeout()
+	{
+		qint64 now = LoopClock::msecsSinceEpoch();
 
-			sendItem(item);
-		}
+		processExpired(now);
+		updateTimer(now);
 	}
 };
 
@@ -273,17 +880,83 @@ void Sequencer::setWaitMax(int msecs)
 	d->pendingExpireMSecs = msecs;
 }
 
+void Sequencer::setAdaptiveWait(bool enabled)
+{
+	d->adaptiveWait = enabled;
+
+	if(!enabled)
+		d->reorderHistory.clear();
+}
+
 void Sequencer::setIdCacheTtl(int secs)
 {
 	d->idCacheTtl = secs;
 }
 
+void Sequencer::setIdCacheMode(IdCacheMode mode)
+{
+	d->idCacheMode = mode;
+	d->resetIdCache();
+}
+
+void Sequencer::setIdCacheMemoryMax(qint64 bytes)
+{
+	d->idCacheMemoryMax = bytes;
+
+	if(d->idCacheMode == CompactIds)
+		d->resetIdCache();
+}
+
+int Sequencer::idCacheCount() const
+{
+	if(d->idCacheMode == CompactIds)
+		return d->compactIds.count();
+	else
+		return d->idCacheByFingerprint.count();
+}
+
+int Sequencer::idCacheCapacity() const
+{
+	if(d->idCacheMode == CompactIds)
+		return d->compactIds.capacity();
+	else
+		return -1;
+}
+
+void Sequencer::takeIdCacheCounts(quint32 *duplicates, quint32 *uncached)
+{
+	*duplicates = d->idCacheDuplicates;
+	*uncached = d->idCacheUncached;
+
+	d->idCacheDuplicates = 0;
+	d->idCacheUncached = 0;
+}
+
+bool Sequencer::isCachedId(const PublishItem &item) const
+{
+	return d->isCachedId(item);
+}
+
 void Sequencer::addItem(const PublishItem &item, bool seq)
 {
 	d->addItem(item, seq);
 }
 
+void Sequencer::addItems(const QList<PublishItem> &items, const QList<bool> &seq)
+{
+	d->addItems(items, seq);
+}
+
 void Sequencer::clearPendingForChannel(const QString &channel)
 {
 	d->clear(channel);
 }
+
+void Sequencer::addToPrometheus(StatsManager *stats)
+{
+	stats->addPrometheusCounter("sequencer_reordered_total", "Out-of-order items released once their gap was filled", QString(), &g_reordered);
+	stats->addPrometheusCounter("sequencer_reorder_distance_total", "Sum over filled gaps of the number of items held behind them", QString(), &g_reorderDistance);
+	stats->addPrometheusCounter("sequencer_expired_total", "Out-of-order items sent after waiting the full time for their gap", QString(), &g_expired);
+	stats->addPrometheusCounter("sequencer_released_early_total", "Out-of-order items sent early because their gap was taken as lost", QString(), &g_releasedEarly);
+	stats->addPrometheusHistogram("sequencer_reorder_delay_seconds", "Time out-of-order items were held before their gap was filled", QString(), &g_reorderDelay);
+}
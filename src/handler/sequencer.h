@@ -24,30 +24,71 @@
 #ifndef SEQUENCER_H
 #define SEQUENCER_H
 
+#include <QList>
 #include <boost/signals2.hpp>
 
 class QString;
 
 class PublishLastIds;
 class PublishItem;
+class StatsManager;
 
 class Sequencer
 {
 public:
+	enum IdCacheMode
+	{
+		// keep the channel and id strings
+		ExactIds,
+
+		// keep only 64-bit fingerprints, within a memory limit
+		CompactIds
+	};
+
 	Sequencer(PublishLastIds *publishLastIds);
 	~Sequencer();
 
 	void setWaitMax(int msecs);
+
+	// learn per channel how long gaps take to fill, and wait less than the
+	// max where gaps are usually never filled. also releases a gap early
+	// when more items are held behind it than filled gaps ever had
+	void setAdaptiveWait(bool enabled);
+
 	void setIdCacheTtl(int secs);
 
+	// clears the id cache
+	void setIdCacheMode(IdCacheMode mode);
+	void setIdCacheMemoryMax(qint64 bytes);
+
+	int idCacheCount() const;
+
+	// returns -1 if unbounded
+	int idCacheCapacity() const;
+
+	// duplicates are items dropped because their id was cached. uncached
+	// are ids that could not be cached due to capacity. resets the counts
+	void takeIdCacheCounts(quint32 *duplicates, quint32 *uncached);
+
+	// returns true if the item's id is in the cache, without adding it or
+	// counting it. ids past their ttl may be reported until the next add
+	bool isCachedId(const PublishItem &item) const;
+
 	// seq = false means ID cache handling only
 	// note: may emit signals
 	void addItem(const PublishItem &item, bool seq = true);
 
+	// same as calling addItem for each item, with seq[n] applying to
+	// items[n], but with the per-call bookkeeping done once
+	void addItems(const QList<PublishItem> &items, const QList<bool> &seq);
+
 	void clearPendingForChannel(const QString &channel);
 
 	boost::signals2::signal<void(const PublishItem&)> itemReady;
 
+	// counts are shared by all instances
+	static void addToPrometheus(StatsManager *stats);
+
 private:
 	class Private;
 	friend class Private;
@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include <qtestsupport_core.h>
+#include "test.h"
+#include "timer.h"
+#include "defercall.h"
+#include "publishitem.h"
+#include "publishlastids.h"
+#include "sequencer.h"
+#include "fingerprintset.h"
+
+namespace {
+
+class LoopState
+{
+public:
+	LoopState()
+	{
+		Timer::init(100);
+	}
+
+	~LoopState()
+	{
+		DeferCall::cleanup();
+		Timer::deinit();
+	}
+};
+
+class TestState
+{
+public:
+	LoopState loop;
+	PublishLastIds lastIds;
+	Sequencer seq;
+	QStringList out;
+
+	TestState() :
+		lastIds(100),
+		seq(&lastIds)
+	{
+		seq.itemReady.connect([this](const PublishItem &item) {
+			out += item.channel + ":" + item.id;
+		});
+	}
+};
+
+}
+
+static PublishItem makeItem(const QString &channel, const QString &id, const QString &prevId = QString())
+{
+	PublishItem i;
+	i.channel = channel;
+	i.id = id;
+	i.prevId = prevId;
+	return i;
+}
+
+static void idCache()
+{
+	TestState s;
+	s.seq.setIdCacheTtl(60);
+
+	s.seq.addItem(makeItem("apple", "1"), false);
+	s.seq.addItem(makeItem("apple", "1"), false);
+	s.seq.addItem(makeItem("banana", "1"), false);
+	s.seq.addItem(makeItem("apple", "2"), false);
+
+	TEST_ASSERT(s.out == QStringList() << "apple:1" << "banana:1" << "apple:2");
+
+	// lookups don't add, or count as duplicates
+	TEST_ASSERT(s.seq.isCachedId(makeItem("apple", "1")));
+	TEST_ASSERT(!s.seq.isCachedId(makeItem("cherry", "1")));
+	TEST_ASSERT(!s.seq.isCachedId(makeItem("cherry", "1")));
+	TEST_ASSERT(!s.seq.isCachedId(makeItem("apple", QString())));
+
+	quint32 duplicates, uncached;
+	s.seq.takeIdCacheCounts(&duplicates, &uncached);
+	TEST_ASSERT_EQ(duplicates, 1u);
+}
+
+static void compactIdCache()
+{
+	TestState s;
+	s.seq.setIdCacheTtl(60);
+	s.seq.setIdCacheMemoryMax(1024);
+	s.seq.setIdCacheMode(Sequencer::CompactIds);
+
+	TEST_ASSERT(s.seq.idCacheCapacity() > 0);
+
+	s.seq.addItem(makeItem("apple", "1"), false);
+	s.seq.addItem(makeItem("apple", "1"), false);
+	s.seq.addItem(makeItem("banana", "1"), false);
+
+	TEST_ASSERT(s.out == QStringList() << "apple:1" << "banana:1");
+	TEST_ASSERT_EQ(s.seq.idCacheCount(), 2);
+	TEST_ASSERT(s.seq.isCachedId(makeItem("banana", "1")));
+
+	// fill past capacity. ids that don't fit are delivered but not cached
+	int capacity = s.seq.idCacheCapacity();
+	for(int n = 0; n < capacity; ++n)
+		s.seq.addItem(makeItem("cherry", QString::number(n)), false);
+
+	TEST_ASSERT_EQ(s.seq.idCacheCount(), capacity);
+
+	quint32 duplicates, uncached;
+	s.seq.takeIdCacheCounts(&duplicates, &uncached);
+	TEST_ASSERT_EQ(duplicates, 1u);
+	TEST_ASSERT_EQ(uncached, 2u);
+
+	s.seq.takeIdCacheCounts(&duplicates, &uncached);
+	TEST_ASSERT_EQ(duplicates, 0u);
+	TEST_ASSERT_EQ(uncached, 0u);
+}
+
+static void fingerprintSet()
+{
+	FingerprintSet set;
+	set.reset(16);
+	TEST_ASSERT_EQ(set.capacity(), 12);
+
+	// at this load there are probe chains that removal must keep intact
+	for(int n = 1; n <= 12; ++n)
+		TEST_ASSERT(set.insert(n * 1000));
+
+	TEST_ASSERT_EQ(set.count(), 12);
+	TEST_ASSERT(!set.insert(13000));
+
+	for(int n = 1; n <= 12; n += 2)
+		TEST_ASSERT(set.remove(n * 1000));
+
+	TEST_ASSERT(!set.remove(1000));
+	TEST_ASSERT_EQ(set.count(), 6);
+
+	for(int n = 1; n <= 12; ++n)
+	{
+		if(n % 2 == 0)
+			TEST_ASSERT(set.contains(n * 1000));
+		else
+			TEST_ASSERT(!set.contains(n * 1000));
+	}
+
+	// already present
+	TEST_ASSERT(!set.insert(2000));
+
+	// zero is usable
+	TEST_ASSERT(set.insert(0));
+	TEST_ASSERT(set.contains(0));
+}
+
+static void ordering()
+{
+	TestState s;
+	s.lastIds.set("apple", "1");
+
+	s.seq.addItem(makeItem("apple", "3", "2"));
+	TEST_ASSERT(s.out.isEmpty());
+
+	s.seq.addItem(makeItem("apple", "2", "1"));
+	TEST_ASSERT(s.out == QStringList() << "apple:2" << "apple:3");
+	TEST_ASSERT_EQ(s.lastIds.value("apple"), QString("3"));
+}
+
+static void pendingTimeout()
+{
+	TestState s;
+	s.seq.setWaitMax(100);
+	s.lastIds.set("apple", "1");
+
+	s.seq.addItem(makeItem("apple", "3", "2"));
+	TEST_ASSERT(s.out.isEmpty());
+
+	for(int n = 0; n < 100 && s.out.isEmpty(); ++n)
+		QTest::qWait(10);
+
+	TEST_ASSERT(s.out == QStringList() << "apple:3");
+}
+
+static void adaptiveWait()
+{
+	TestState s;
+	s.seq.setWaitMax(100);
+	s.seq.setAdaptiveWait(true);
+
+	// gaps that are never filled
+	for(int n = 0; n < 5; ++n)
+	{
+		s.lastIds.set("apple", "1");
+		s.out.clear();
+
+		s.seq.addItem(makeItem("apple", "3", "2"));
+
+		for(int i = 0; i < 100 && s.out.isEmpty(); ++i)
+			QTest::qWait(10);
+
+		TEST_ASSERT(s.out == QStringList() << "apple:3");
+	}
+
+	// the wait no longer follows the max
+	s.seq.setWaitMax(5000);
+	s.lastIds.set("apple", "1");
+	s.out.clear();
+
+	s.seq.addItem(makeItem("apple", "3", "2"));
+
+	for(int n = 0; n < 100 && s.out.isEmpty(); ++n)
+		QTest::qWait(10);
+
+	TEST_ASSERT(s.out == QStringList() << "apple:3");
+
+	// too many items behind a gap releases it without waiting
+	s.lastIds.set("apple", "1");
+	s.out.clear();
+
+	QStringList expected;
+	for(int n = 3; n < 11; ++n)
+	{
+		s.seq.addItem(makeItem("apple", QString::number(n), QString::number(n - 1)));
+		expected += "apple:" + QString::number(n);
+	}
+
+	TEST_ASSERT(s.out.isEmpty());
+
+	s.seq.addItem(makeItem("apple", "11", "10"));
+	expected += "apple:11";
+
+	TEST_ASSERT(s.out == expected);
+	TEST_ASSERT_EQ(s.lastIds.value("apple"), QString("11"));
+
+	// channels without history wait as before
+	s.lastIds.set("banana", "1");
+	s.out.clear();
+
+	s.seq.addItem(makeItem("banana", "3", "2"));
+	QTest::qWait(500);
+	TEST_ASSERT(s.out.isEmpty());
+
+	s.seq.addItem(makeItem("banana", "2", "1"));
+	TEST_ASSERT(s.out == QStringList() << "banana:2" << "banana:3");
+}
+
+static void clearPending()
+{
+	TestState s;
+	s.lastIds.set("apple", "1");
+
+	s.seq.addItem(makeItem("apple", "3", "2"));
+	s.seq.clearPendingForChannel("apple");
+
+	s.seq.addItem(makeItem("apple", "2", "1"));
+	TEST_ASSERT(s.out == QStringList() << "apple:2");
+}
+
+extern "C" int sequencer_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(idCache());
+	TEST_CATCH(compactIdCache());
+	TEST_CATCH(fingerprintSet());
+	TEST_CATCH(ordering());
+	TEST_CATCH(pendingTimeout());
+	TEST_CATCH(adaptiveWait());
+	TEST_CATCH(clearPending());
+
+	return 0;
+}
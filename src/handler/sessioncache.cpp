@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "sessioncache.h"
+
+#include <assert.h>
+
+SessionCache::SessionCache(int maxCapacity, int ttl) :
+	head_(-1),
+	tail_(-1),
+	maxCapacity_(maxCapacity),
+	ttl_(ttl),
+	hits_(0),
+	misses_(0)
+{
+}
+
+void SessionCache::set(const QString &sid, const LastIds &lastIds, qint64 now)
+{
+	int pos = table_.value(sid, -1);
+	if(pos < 0)
+	{
+		while(!table_.isEmpty() && table_.count() >= maxCapacity_)
+		{
+			// remove oldest
+			assert(tail_ >= 0);
+			int tpos = tail_;
+			table_.remove(items_[tpos].sid);
+			unlink(tpos);
+			release(tpos);
+		}
+
+		if(!freeItems_.empty())
+		{
+			pos = freeItems_.back();
+			freeItems_.pop_back();
+		}
+		else
+		{
+			pos = (int)items_.size();
+			items_.push_back(Item());
+		}
+
+		items_[pos].sid = sid;
+		link(pos);
+
+		table_.insert(sid, pos);
+	}
+	else
+	{
+		touch(pos);
+	}
+
+	Item &i = items_[pos];
+	i.lastIds = lastIds;
+	i.expires = now + ttl_;
+}
+
+void SessionCache::update(const QString &sid, const LastIds &lastIds, qint64 now)
+{
+	int pos = find(sid, now);
+	if(pos < 0)
+		return;
+
+	LastIds &cur = items_[pos].lastIds;
+
+	QHashIterator<QString, QString> it(lastIds);
+	while(it.hasNext())
+	{
+		it.next();
+		cur.insert(it.key(), it.value());
+	}
+
+	touch(pos);
+}
+
+void SessionCache::remove(const QString &sid)
+{
+	QHash<QString, int>::iterator it = table_.find(sid);
+	if(it != table_.end())
+	{
+		int pos = it.value();
+		table_.erase(it);
+		unlink(pos);
+		release(pos);
+	}
+}
+
+bool SessionCache::get(const QString &sid, LastIds *lastIds, qint64 now)
+{
+	int pos = find(sid, now);
+	if(pos < 0)
+	{
+		++misses_;
+		return false;
+	}
+
+	*lastIds = items_[pos].lastIds;
+	touch(pos);
+
+	++hits_;
+	return true;
+}
+
+int SessionCache::find(const QString &sid, qint64 now)
+{
+	int pos = table_.value(sid, -1);
+	if(pos < 0)
+		return -1;
+
+	if(now >= items_[pos].expires)
+	{
+		table_.remove(sid);
+		unlink(pos);
+		release(pos);
+		return -1;
+	}
+
+	return pos;
+}
+
+void SessionCache::touch(int pos)
+{
+	if(pos != head_)
+	{
+		unlink(pos);
+		link(pos);
+	}
+}
+
+void SessionCache::link(int pos)
+{
+	Item &i = items_[pos];
+	i.prev = -1;
+	i.next = head_;
+
+	if(head_ >= 0)
+		items_[head_].prev = pos;
+	else
+		tail_ = pos;
+
+	head_ = pos;
+}
+
+void SessionCache::unlink(int pos)
+{
+	Item &i = items_[pos];
+
+	if(i.prev >= 0)
+		items_[i.prev].next = i.next;
+	else
+		head_ = i.next;
+
+	if(i.next >= 0)
+		items_[i.next].prev = i.prev;
+	else
+		tail_ = i.prev;
+}
+
+void SessionCache::release(int pos)
+{
+	Item &i = items_[pos];
+	i.sid.clear();
+	i.lastIds.clear();
+	freeItems_.push_back(pos);
+}
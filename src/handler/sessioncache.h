@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef SESSIONCACHE_H
+#define SESSIONCACHE_H
+
+#include <vector>
+#include <atomic>
+#include <QString>
+#include <QHash>
+#include "lastids.h"
+
+// local copy of session last-ids, so the handler can answer for sessions
+// it already knows about without asking the state service. entries are
+// loaded from getLastIds results and kept current by the handler's own
+// writes. since other writers may exist, entries expire after a fixed
+// time regardless of use. LRU expiration bounds the size
+class SessionCache
+{
+public:
+	SessionCache(int maxCapacity, int ttl); // ttl in ms
+
+	// replaces any existing entry
+	void set(const QString &sid, const LastIds &lastIds, qint64 now);
+
+	// merges into an existing entry. no-op if the sid is not cached, since
+	// the other channels' ids are unknown
+	void update(const QString &sid, const LastIds &lastIds, qint64 now);
+
+	void remove(const QString &sid);
+
+	// returns false if not cached or expired. counts a hit or a miss
+	bool get(const QString &sid, LastIds *lastIds, qint64 now);
+
+	int count() const { return table_.count(); }
+
+	// counters may be read from any thread
+	const std::atomic<quint64> *hits() const { return &hits_; }
+	const std::atomic<quint64> *misses() const { return &misses_; }
+
+private:
+	class Item
+	{
+	public:
+		QString sid;
+		LastIds lastIds;
+		qint64 expires;
+		int prev; // more recently used
+		int next; // less recently used
+	};
+
+	QHash<QString, int> table_;
+	std::vector<Item> items_;
+	std::vector<int> freeItems_;
+	int head_; // most recently used
+	int tail_; // least recently used
+	int maxCapacity_;
+	int ttl_;
+	std::atomic<quint64> hits_;
+	std::atomic<quint64> misses_;
+
+	// returns the position of a live entry, or -1. expired entries are
+	// removed
+	int find(const QString &sid, qint64 now);
+	void touch(int pos);
+	void link(int pos);
+	void unlink(int pos);
+	void release(int pos);
+};
+
+#endif
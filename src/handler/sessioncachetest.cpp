@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "test.h"
+#include "sessioncache.h"
+
+static LastIds ids(const QString &channel, const QString &id)
+{
+	LastIds out;
+	out.insert(channel, id);
+	return out;
+}
+
+static void setUpdate()
+{
+	SessionCache cache(10, 1000);
+	LastIds out;
+
+	TEST_ASSERT(!cache.get("s1", &out, 0));
+
+	// updates don't create entries
+	cache.update("s1", ids("apple", "1"), 0);
+	TEST_ASSERT(!cache.get("s1", &out, 0));
+
+	cache.set("s1", ids("apple", "1"), 0);
+	cache.update("s1", ids("banana", "2"), 10);
+	cache.update("s1", ids("apple", "3"), 20);
+
+	TEST_ASSERT(cache.get("s1", &out, 30));
+	TEST_ASSERT_EQ(out.count(), 2);
+	TEST_ASSERT_EQ(out.value("apple"), QString("3"));
+	TEST_ASSERT_EQ(out.value("banana"), QString("2"));
+
+	TEST_ASSERT_EQ(cache.hits()->load(), 1u);
+	TEST_ASSERT_EQ(cache.misses()->load(), 2u);
+
+	cache.remove("s1");
+	TEST_ASSERT(!cache.get("s1", &out, 30));
+	TEST_ASSERT_EQ(cache.count(), 0);
+}
+
+static void expire()
+{
+	SessionCache cache(10, 1000);
+	LastIds out;
+
+	cache.set("s1", ids("apple", "1"), 0);
+
+	// use doesn't extend the lifetime
+	TEST_ASSERT(cache.get("s1", &out, 500));
+	cache.update("s1", ids("apple", "2"), 900);
+	TEST_ASSERT(!cache.get("s1", &out, 1000));
+	TEST_ASSERT_EQ(cache.count(), 0);
+
+	// setting again does
+	cache.set("s1", ids("apple", "1"), 1000);
+	TEST_ASSERT(cache.get("s1", &out, 1999));
+}
+
+static void evictOldest()
+{
+	SessionCache cache(2, 1000);
+	LastIds out;
+
+	cache.set("s1", LastIds(), 0);
+	cache.set("s2", LastIds(), 0);
+
+	// touching s1 makes s2 the oldest
+	TEST_ASSERT(cache.get("s1", &out, 0));
+	cache.set("s3", LastIds(), 0);
+
+	TEST_ASSERT(!cache.get("s2", &out, 0));
+	TEST_ASSERT(cache.get("s1", &out, 0));
+	TEST_ASSERT(cache.get("s3", &out, 0));
+	TEST_ASSERT_EQ(cache.count(), 2);
+}
+
+extern "C" int sessioncache_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(setUpdate());
+	TEST_CATCH(expire());
+	TEST_CATCH(evictOldest());
+
+	return 0;
+}
@@ -23,6 +23,7 @@
 
 #include "sessionrequest.h"
 
+#include <list>
 #include <QVariant>
 #include "qtcompat.h"
 #include "zrpcmanager.h"
@@ -32,6 +33,32 @@
 
 namespace SessionRequest {
 
+static QVariantHash sidLastIdsToVariant(const QHash<QString, LastIds> &sidLastIds)
+{
+	QVariantHash vsidLastIds;
+
+	QHashIterator<QString, LastIds> it(sidLastIds);
+	while(it.hasNext())
+	{
+		it.next();
+		const QString &sid = it.key();
+		const LastIds &lastIds = it.value();
+
+		QVariantHash vlastIds;
+
+		QHashIterator<QString, QString> it(lastIds);
+		while(it.hasNext())
+		{
+			it.next();
+			vlastIds.insert(it.key(), it.value().toUtf8());
+		}
+
+		vsidLastIds.insert(sid, vlastIds);
+	}
+
+	return vsidLastIds;
+}
+
 class DetectRulesSet : public Deferred
 {
 public:
@@ -206,37 +233,94 @@ private:
 	}
 };
 
-class UpdateMany : public Deferred
+class CreateOrUpdateMany : public Deferred
 {
 public:
-	UpdateMany(ZrpcManager *stateClient, const QHash<QString, LastIds> &sidLastIds)
+	CreateOrUpdateMany(ZrpcManager *_stateClient, const QHash<QString, LastIds> &_sidLastIds) :
+		stateClient(_stateClient),
+		sidLastIds(_sidLastIds),
+		pendingSingles(0),
+		singlesFailed(false)
 	{
 		req = std::make_unique<ZrpcRequest>(stateClient);
-		finishedConnection = req->finished.connect(boost::bind(&UpdateMany::req_finished, this));
+		finishedConnection = req->finished.connect(boost::bind(&CreateOrUpdateMany::req_finished, this));
 
-		QVariantHash vsidLastIds;
+		QVariantHash args;
+		args["sid-last-ids"] = sidLastIdsToVariant(sidLastIds);
+		req->start("session-create-or-update-many", args);
+	}
 
-		QHashIterator<QString, LastIds> it(sidLastIds);
-		while(it.hasNext())
-		{
-			it.next();
-			const QString &sid = it.key();
-			const LastIds &lastIds = it.value();
+private:
+	ZrpcManager *stateClient;
+	QHash<QString, LastIds> sidLastIds;
+	std::unique_ptr<ZrpcRequest> req;
+	Connection finishedConnection;
+	std::list<std::unique_ptr<Deferred>> singles;
+	int pendingSingles;
+	bool singlesFailed;
+	QVariant singlesError;
 
-			QVariantHash vlastIds;
+	void req_finished()
+	{
+		if(req->success())
+		{
+			setFinished(true);
+			return;
+		}
 
-			QHashIterator<QString, QString> it(lastIds);
+		if(req->errorConditionString() == "method-not-found")
+		{
+			// the state service predates this method. fall back to
+			// one call per session
+			QHashIterator<QString, LastIds> it(sidLastIds);
 			while(it.hasNext())
 			{
 				it.next();
-				vlastIds.insert(it.key(), it.value().toUtf8());
+
+				auto d = std::make_unique<CreateOrUpdate>(stateClient, it.key(), it.value());
+
+				// safe to not track, since d can't outlive this
+				d->finished.connect(boost::bind(&CreateOrUpdateMany::single_finished, this, boost::placeholders::_1));
+
+				singles.push_back(std::move(d));
+				++pendingSingles;
 			}
 
-			vsidLastIds.insert(sid, vlastIds);
+			return;
+		}
+
+		setFinished(false, req->errorCondition());
+	}
+
+	void single_finished(const DeferredResult &result)
+	{
+		if(!result.success && !singlesFailed)
+		{
+			singlesFailed = true;
+			singlesError = result.value;
+		}
+
+		--pendingSingles;
+		if(pendingSingles == 0)
+		{
+			if(singlesFailed)
+				setFinished(false, singlesError);
+			else
+				setFinished(true);
 		}
+	}
+};
+
+class UpdateMany : public Deferred
+{
+public:
+	UpdateMany(ZrpcManager *stateClient, const QHash<QString, LastIds> &sidLastIds)
+	{
+		req = std::make_unique<ZrpcRequest>(stateClient);
+		finishedConnection = req->finished.connect(boost::bind(&UpdateMany::req_finished, this));
 
 		QVariantHash args;
-		args["sid-last-ids"] = vsidLastIds;
+		args["sid-last-ids"] = sidLastIdsToVariant(sidLastIds);
 		req->start("session-update-many", args);
 	}
 
@@ -326,6 +410,11 @@ Deferred *createOrUpdate(ZrpcManager *stateClient, const QString &sid, const Las
 	return new CreateOrUpdate(stateClient, sid, lastIds);
 }
 
+Deferred *createOrUpdateMany(ZrpcManager *stateClient, const QHash<QString, LastIds> &sidLastIds)
+{
+	return new CreateOrUpdateMany(stateClient, sidLastIds);
+}
+
 Deferred *updateMany(ZrpcManager *stateClient, const QHash<QString, LastIds> &sidLastIds)
 {
 	return new UpdateMany(stateClient, sidLastIds);
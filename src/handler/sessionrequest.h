@@ -29,8 +29,7 @@
 #include <QHash>
 #include "lastids.h"
 #include <boost/signals2.hpp>
-
-using Connection = boost::signals2::scoped_connection;
+#include "fastsignal.h"
 
 class ZrpcManager;
 class Deferred;
@@ -41,6 +40,7 @@ namespace SessionRequest {
 Deferred *detectRulesSet(ZrpcManager *stateClient, const QList<DetectRule> &rules);
 Deferred *detectRulesGet(ZrpcManager *stateClient, const QString &domain, const QByteArray &path);
 Deferred *createOrUpdate(ZrpcManager *stateClient, const QString &sid, const LastIds &lastIds);
+Deferred *createOrUpdateMany(ZrpcManager *stateClient, const QHash<QString, LastIds> &sidLastIds);
 Deferred *updateMany(ZrpcManager *stateClient, const QHash<QString, LastIds> &sidLastIds);
 Deferred *getLastIds(ZrpcManager *stateClient, const QString &sid);
 
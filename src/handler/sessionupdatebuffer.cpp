@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "sessionupdatebuffer.h"
+
+#include <atomic>
+#include <memory>
+#include "timer.h"
+#include "defercall.h"
+#include "log.h"
+#include "deferred.h"
+#include "sessionrequest.h"
+#include "statsmanager.h"
+
+static std::atomic<quint64> g_merges(0);
+static std::atomic<quint64> g_flushes(0);
+static std::atomic<quint64> g_dropped(0);
+
+class SessionUpdateBuffer::Private
+{
+public:
+	ZrpcManager *stateClient;
+	int flushInterval;
+	int flushSize;
+	int maxSize;
+	QHash<QString, LastIds> pending;
+	std::unique_ptr<Timer> timer;
+	std::unique_ptr<Deferred> inFlight;
+	Connection finishedConnection;
+	DeferCall deferCall;
+
+	Private(ZrpcManager *_stateClient, int _flushInterval, int _flushSize, int _maxSize) :
+		stateClient(_stateClient),
+		flushInterval(_flushInterval),
+		flushSize(_flushSize),
+		maxSize(_maxSize)
+	{
+		timer = std::make_unique<Timer>();
+		timer->setSingleShot(true);
+		timer->timeout.connect(boost::bind(&Private::flush, this));
+	}
+
+	void add(const QString &sid, const LastIds &lastIds)
+	{
+		QHash<QString, LastIds>::iterator it = pending.find(sid);
+		if(it != pending.end())
+		{
+			LastIds &cur = it.value();
+
+			QHashIterator<QString, QString> lit(lastIds);
+			while(lit.hasNext())
+			{
+				lit.next();
+				cur.insert(lit.key(), lit.value());
+			}
+
+			++g_merges;
+			return;
+		}
+
+		if(pending.count() >= maxSize)
+		{
+			++g_dropped;
+			log_debug("session update buffer full, dropping update for sid=%s", qPrintable(sid));
+			return;
+		}
+
+		pending.insert(sid, lastIds);
+
+		schedule();
+	}
+
+	void schedule()
+	{
+		if(inFlight || pending.isEmpty())
+			return;
+
+		if(pending.count() >= flushSize)
+		{
+			timer->stop();
+
+			// flush outside of the caller's stack
+			deferCall.defer([=] { flush(); });
+		}
+		else if(!timer->isActive())
+		{
+			timer->start(flushInterval);
+		}
+	}
+
+	void flush()
+	{
+		if(inFlight || pending.isEmpty())
+			return;
+
+		timer->stop();
+
+		QHash<QString, LastIds> sidLastIds;
+		sidLastIds.swap(pending);
+
+		inFlight = std::unique_ptr<Deferred>(SessionRequest::updateMany(stateClient, sidLastIds));
+		finishedConnection = inFlight->finished.connect(boost::bind(&Private::inFlight_finished, this, boost::placeholders::_1));
+
+		++g_flushes;
+	}
+
+	void inFlight_finished(const DeferredResult &result)
+	{
+		finishedConnection.disconnect();
+		inFlight.reset();
+
+		if(!result.success)
+			log_error("couldn't update session: condition=%d", result.value.toInt());
+
+		schedule();
+	}
+};
+
+SessionUpdateBuffer::SessionUpdateBuffer(ZrpcManager *stateClient, int flushInterval, int flushSize, int maxSize)
+{
+	d = new Private(stateClient, flushInterval, flushSize, maxSize);
+}
+
+SessionUpdateBuffer::~SessionUpdateBuffer()
+{
+	delete d;
+}
+
+void SessionUpdateBuffer::add(const QString &sid, const LastIds &lastIds)
+{
+	d->add(sid, lastIds);
+}
+
+int SessionUpdateBuffer::pendingCount() const
+{
+	return d->pending.count();
+}
+
+void SessionUpdateBuffer::addToPrometheus(StatsManager *stats)
+{
+	stats->addPrometheusCounter("session_update_merges_total", "Session last-id updates merged into a pending update", QString(), &g_merges);
+	stats->addPrometheusCounter("session_update_flushes_total", "Batched session update requests sent", QString(), &g_flushes);
+	stats->addPrometheusCounter("session_update_dropped_total", "Session updates dropped because the buffer was full", QString(), &g_dropped);
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef SESSIONUPDATEBUFFER_H
+#define SESSIONUPDATEBUFFER_H
+
+#include <QString>
+#include <QHash>
+#include "lastids.h"
+
+class ZrpcManager;
+class StatsManager;
+
+// write-behind buffer for session last-id updates. updates are merged per
+// sid, with later ids replacing earlier ones per channel, and sent with
+// updateMany after a short interval or once enough sids are pending. at
+// most one request is in flight. while one is, updates keep merging, and
+// updates for new sids are dropped once the buffer is full
+class SessionUpdateBuffer
+{
+public:
+	SessionUpdateBuffer(ZrpcManager *stateClient, int flushInterval, int flushSize, int maxSize);
+	~SessionUpdateBuffer();
+
+	void add(const QString &sid, const LastIds &lastIds);
+
+	int pendingCount() const;
+
+	// counters are shared by all instances in the process
+	static void addToPrometheus(StatsManager *stats);
+
+private:
+	class Private;
+	Private *d;
+};
+
+#endif
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef SLOWCONSUMER_H
+#define SLOWCONSUMER_H
+
+#include <QList>
+#include <QSet>
+#include <QString>
+#include "latencyhistogram.h"
+#include "publishitem.h"
+
+// limits on how far a session's publish queue may fall behind, and what to
+// do once it does. a queue is lagging if it holds more than queueBytesMax
+// bytes of content, or if its oldest item was received more than
+// queueAgeMax milliseconds ago
+class SlowConsumerPolicy
+{
+public:
+	enum Action
+	{
+		None,
+		DropOldest, // drop from the front until within the limits
+		Coalesce, // keep only the newest item of each channel
+		Disconnect // close the session, so the client reconnects
+	};
+
+	Action action;
+	int queueBytesMax; // 0 for no limit
+	int queueAgeMax; // 0 for no limit
+
+	SlowConsumerPolicy() :
+		action(None),
+		queueBytesMax(0),
+		queueAgeMax(0)
+	{
+	}
+
+	bool isEnabled() const
+	{
+		return action != None && (queueBytesMax > 0 || queueAgeMax > 0);
+	}
+
+	// returns false if the name is not recognized
+	static bool parseAction(const QString &s, Action *action)
+	{
+		if(s.isEmpty() || s == "none")
+			*action = None;
+		else if(s == "drop-oldest")
+			*action = DropOldest;
+		else if(s == "coalesce")
+			*action = Coalesce;
+		else if(s == "disconnect")
+			*action = Disconnect;
+		else
+			return false;
+
+		return true;
+	}
+
+	// items before start are in use and are never dropped, though they
+	// count toward the byte limit. getItem returns the PublishItem of a
+	// queue entry. returns the number of items dropped, or -1 if the
+	// session should be disconnected
+	template <typename T, typename GetItem>
+	int apply(QList<T> *queue, int start, GetItem getItem, int *queuedBytes = 0) const
+	{
+		if(!isEnabled() || start >= queue->count())
+			return 0;
+
+		int bytes = 0;
+		for(const T &i : *queue)
+			bytes += getItem(i).format.body.size();
+
+		if(queuedBytes)
+			*queuedBytes = bytes;
+
+		qint64 now = queueAgeMax > 0 ? LatencyHistogram::now() : -1;
+
+		if(!isLagging(bytes, getItem(queue->at(start)).receiveTime, now))
+			return 0;
+
+		int dropped = 0;
+
+		if(action == DropOldest)
+		{
+			// the newest item is always kept
+			while(queue->count() - start > 1 && isLagging(bytes, getItem(queue->at(start)).receiveTime, now))
+			{
+				bytes -= getItem(queue->at(start)).format.body.size();
+				queue->removeAt(start);
+				++dropped;
+			}
+		}
+		else if(action == Coalesce)
+		{
+			QSet<QString> seen;
+
+			for(int n = queue->count() - 1; n >= start; --n)
+			{
+				const PublishItem &item = getItem(queue->at(n));
+
+				if(seen.contains(item.channel))
+				{
+					bytes -= item.format.body.size();
+					queue->removeAt(n);
+					++dropped;
+				}
+				else
+				{
+					seen += item.channel;
+				}
+			}
+		}
+		else // Disconnect
+		{
+			return -1;
+		}
+
+		if(queuedBytes)
+			*queuedBytes = bytes;
+
+		return dropped;
+	}
+
+private:
+	bool isLagging(int bytes, qint64 oldestReceiveTime, qint64 now) const
+	{
+		if(queueBytesMax > 0 && bytes > queueBytesMax)
+			return true;
+
+		if(queueAgeMax > 0 && oldestReceiveTime >= 0 && now - oldestReceiveTime > (qint64)queueAgeMax * 1000)
+			return true;
+
+		return false;
+	}
+};
+
+#endif
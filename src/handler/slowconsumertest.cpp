@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "test.h"
+#include "latencyhistogram.h"
+#include "publishitem.h"
+#include "slowconsumer.h"
+
+static PublishItem makeItem(const QString &channel, const QByteArray &body, qint64 receiveTime = -1)
+{
+	PublishItem i;
+	i.channel = channel;
+	i.format.body = body;
+	i.receiveTime = receiveTime;
+	return i;
+}
+
+static const PublishItem & getItem(const PublishItem &i)
+{
+	return i;
+}
+
+static QString bodies(const QList<PublishItem> &queue)
+{
+	QStringList out;
+	for(const PublishItem &i : queue)
+		out += QString::fromUtf8(i.format.body);
+
+	return out.join(",");
+}
+
+static void disabled()
+{
+	SlowConsumerPolicy p;
+
+	QList<PublishItem> queue;
+	queue += makeItem("a", "1");
+	queue += makeItem("a", "2");
+
+	TEST_ASSERT(!p.isEnabled());
+	TEST_ASSERT_EQ(p.apply(&queue, 0, getItem), 0);
+
+	// an action with no limits does nothing either
+	p.action = SlowConsumerPolicy::Disconnect;
+	TEST_ASSERT(!p.isEnabled());
+	TEST_ASSERT_EQ(p.apply(&queue, 0, getItem), 0);
+	TEST_ASSERT_EQ(queue.count(), 2);
+}
+
+static void dropOldest()
+{
+	SlowConsumerPolicy p;
+	p.action = SlowConsumerPolicy::DropOldest;
+	p.queueBytesMax = 4;
+
+	QList<PublishItem> queue;
+	queue += makeItem("a", "11");
+	queue += makeItem("a", "22");
+
+	// within the limit
+	TEST_ASSERT_EQ(p.apply(&queue, 0, getItem), 0);
+
+	queue += makeItem("b", "33");
+	queue += makeItem("a", "44");
+
+	int bytes = 0;
+	TEST_ASSERT_EQ(p.apply(&queue, 0, getItem, &bytes), 2);
+	TEST_ASSERT_EQ(bodies(queue), QString("33,44"));
+	TEST_ASSERT_EQ(bytes, 4);
+
+	// the item in use is kept, though it counts
+	queue += makeItem("a", "55");
+	TEST_ASSERT_EQ(p.apply(&queue, 1, getItem), 1);
+	TEST_ASSERT_EQ(bodies(queue), QString("33,55"));
+
+	// the newest item is kept even if it's too big by itself
+	queue.clear();
+	queue += makeItem("a", "1");
+	queue += makeItem("a", "123456");
+	TEST_ASSERT_EQ(p.apply(&queue, 0, getItem), 1);
+	TEST_ASSERT_EQ(bodies(queue), QString("123456"));
+}
+
+static void dropByAge()
+{
+	SlowConsumerPolicy p;
+	p.action = SlowConsumerPolicy::DropOldest;
+	p.queueAgeMax = 1000;
+
+	qint64 now = LatencyHistogram::now();
+
+	QList<PublishItem> queue;
+	queue += makeItem("a", "1", now - 5000000);
+	queue += makeItem("a", "2", now - 3000000);
+	queue += makeItem("a", "3", now);
+	queue += makeItem("a", "4", now);
+
+	TEST_ASSERT_EQ(p.apply(&queue, 0, getItem), 2);
+	TEST_ASSERT_EQ(bodies(queue), QString("3,4"));
+}
+
+static void coalesce()
+{
+	SlowConsumerPolicy p;
+	p.action = SlowConsumerPolicy::Coalesce;
+	p.queueBytesMax = 2;
+
+	QList<PublishItem> queue;
+	queue += makeItem("a", "1");
+	queue += makeItem("b", "2");
+	queue += makeItem("a", "3");
+	queue += makeItem("b", "4");
+	queue += makeItem("a", "5");
+
+	// the first item is in use
+	TEST_ASSERT_EQ(p.apply(&queue, 1, getItem), 2);
+	TEST_ASSERT_EQ(bodies(queue), QString("1,4,5"));
+}
+
+static void disconnect()
+{
+	SlowConsumerPolicy p;
+	p.action = SlowConsumerPolicy::Disconnect;
+	p.queueBytesMax = 2;
+
+	QList<PublishItem> queue;
+	queue += makeItem("a", "1");
+	queue += makeItem("a", "2");
+	TEST_ASSERT_EQ(p.apply(&queue, 0, getItem), 0);
+
+	queue += makeItem("a", "3");
+	TEST_ASSERT_EQ(p.apply(&queue, 0, getItem), -1);
+	TEST_ASSERT_EQ(queue.count(), 3);
+}
+
+static void parseAction()
+{
+	SlowConsumerPolicy::Action a;
+
+	TEST_ASSERT(SlowConsumerPolicy::parseAction(QString(), &a));
+	TEST_ASSERT(a == SlowConsumerPolicy::None);
+	TEST_ASSERT(SlowConsumerPolicy::parseAction("drop-oldest", &a));
+	TEST_ASSERT(a == SlowConsumerPolicy::DropOldest);
+	TEST_ASSERT(SlowConsumerPolicy::parseAction("coalesce", &a));
+	TEST_ASSERT(a == SlowConsumerPolicy::Coalesce);
+	TEST_ASSERT(SlowConsumerPolicy::parseAction("disconnect", &a));
+	TEST_ASSERT(a == SlowConsumerPolicy::Disconnect);
+	TEST_ASSERT(!SlowConsumerPolicy::parseAction("evict", &a));
+}
+
+extern "C" int slowconsumer_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(disabled());
+	TEST_CATCH(dropOldest());
+	TEST_CATCH(dropByAge());
+	TEST_CATCH(coalesce());
+	TEST_CATCH(disconnect());
+	TEST_CATCH(parseAction());
+
+	return 0;
+}
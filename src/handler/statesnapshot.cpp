@@ -0,0 +1,378 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "statesnapshot.h"
+
+#include <QFile>
+#include <QSaveFile>
+#include "qtcompat.h"
+#include "tnetstring.h"
+
+#define SNAPSHOT_VERSION 1
+
+static QVariantList toList(const QSet<QString> &in)
+{
+	QVariantList out;
+	foreach(const QString &s, in)
+		out += s.toUtf8();
+	return out;
+}
+
+static QVariantHash toHash(const QHash<QString, QString> &in)
+{
+	QVariantHash out;
+	QHashIterator<QString, QString> it(in);
+	while(it.hasNext())
+	{
+		it.next();
+		out[it.key()] = it.value().toUtf8();
+	}
+	return out;
+}
+
+static bool getString(const QVariantHash &in, const QString &key, bool required, QString *out)
+{
+	if(!in.contains(key))
+		return !required;
+
+	if(typeId(in[key]) != QMetaType::QByteArray)
+		return false;
+
+	*out = QString::fromUtf8(in[key].toByteArray());
+	return true;
+}
+
+static bool getBytes(const QVariantHash &in, const QString &key, QByteArray *out)
+{
+	if(!in.contains(key))
+		return true;
+
+	if(typeId(in[key]) != QMetaType::QByteArray)
+		return false;
+
+	*out = in[key].toByteArray();
+	return true;
+}
+
+static bool getInt(const QVariantHash &in, const QString &key, int *out)
+{
+	if(!in.contains(key))
+		return true;
+
+	if(!canConvert(in[key], QMetaType::Int))
+		return false;
+
+	*out = in[key].toInt();
+	return true;
+}
+
+static bool getBool(const QVariantHash &in, const QString &key, bool *out)
+{
+	if(!in.contains(key))
+		return true;
+
+	if(typeId(in[key]) != QMetaType::Bool)
+		return false;
+
+	*out = in[key].toBool();
+	return true;
+}
+
+static bool getStringSet(const QVariantHash &in, const QString &key, QSet<QString> *out)
+{
+	if(!in.contains(key))
+		return true;
+
+	if(typeId(in[key]) != QMetaType::QVariantList)
+		return false;
+
+	foreach(const QVariant &v, in[key].toList())
+	{
+		if(typeId(v) != QMetaType::QByteArray)
+			return false;
+
+		*out += QString::fromUtf8(v.toByteArray());
+	}
+
+	return true;
+}
+
+static bool getStringHash(const QVariantHash &in, const QString &key, QHash<QString, QString> *out)
+{
+	if(!in.contains(key))
+		return true;
+
+	if(typeId(in[key]) != QMetaType::QVariantHash)
+		return false;
+
+	QHashIterator<QString, QVariant> it(in[key].toHash());
+	while(it.hasNext())
+	{
+		it.next();
+
+		if(typeId(it.value()) != QMetaType::QByteArray)
+			return false;
+
+		out->insert(it.key(), QString::fromUtf8(it.value().toByteArray()));
+	}
+
+	return true;
+}
+
+QVariant StateSnapshot::toVariant() const
+{
+	QVariantList vsessions;
+	foreach(const WsSessionState &s, wsSessions)
+	{
+		QVariantHash vs;
+		vs["peer"] = s.peer;
+		vs["cid"] = s.cid.toUtf8();
+		vs["ttl"] = s.ttl;
+		vs["uri"] = s.uri.toEncoded();
+
+		if(!s.route.isEmpty())
+			vs["route"] = s.route.toUtf8();
+
+		if(!s.statsRoute.isEmpty())
+			vs["stats-route"] = s.statsRoute.toUtf8();
+
+		if(s.debug)
+			vs["debug"] = true;
+
+		if(s.targetTrusted)
+			vs["trusted"] = true;
+
+		if(!s.channelPrefix.isEmpty())
+			vs["channel-prefix"] = s.channelPrefix.toUtf8();
+
+		if(s.logLevel >= 0)
+			vs["log-level"] = s.logLevel;
+
+		if(!s.sid.isEmpty())
+			vs["sid"] = s.sid.toUtf8();
+
+		if(!s.meta.isEmpty())
+			vs["meta"] = toHash(s.meta);
+
+		if(!s.channels.isEmpty())
+			vs["channels"] = toList(s.channels);
+
+		if(!s.implicitChannels.isEmpty())
+			vs["implicit-channels"] = toList(s.implicitChannels);
+
+		if(!s.channelFilters.isEmpty())
+		{
+			QVariantHash vfilters;
+			QHashIterator<QString, QStringList> it(s.channelFilters);
+			while(it.hasNext())
+			{
+				it.next();
+
+				QVariantList vlist;
+				foreach(const QString &f, it.value())
+					vlist += f.toUtf8();
+
+				vfilters[it.key()] = vlist;
+			}
+
+			vs["channel-filters"] = vfilters;
+		}
+
+		if(!s.keepAliveMessage.isNull())
+		{
+			vs["keep-alive-type"] = s.keepAliveType;
+			vs["keep-alive-message"] = s.keepAliveMessage;
+		}
+
+		vsessions += vs;
+	}
+
+	QVariantList vlastIds;
+	for(int n = 0; n < lastIds.count(); ++n)
+		vlastIds += QVariant(QVariantList() << lastIds[n].first.toUtf8() << lastIds[n].second.toUtf8());
+
+	QVariantHash out;
+	out["version"] = SNAPSHOT_VERSION;
+	out["time"] = time;
+	out["ws-sessions"] = vsessions;
+	out["last-ids"] = vlastIds;
+
+	return out;
+}
+
+bool StateSnapshot::fromVariant(const QVariant &in)
+{
+	if(typeId(in) != QMetaType::QVariantHash)
+		return false;
+
+	QVariantHash obj = in.toHash();
+
+	// snapshots are only read by the same build that wrote them, but be
+	// safe across upgrades and start fresh on a mismatch
+	if(!obj.contains("version") || !canConvert(obj["version"], QMetaType::Int) || obj["version"].toInt() != SNAPSHOT_VERSION)
+		return false;
+
+	if(!obj.contains("time") || !canConvert(obj["time"], QMetaType::LongLong))
+		return false;
+
+	time = obj["time"].toLongLong();
+
+	wsSessions.clear();
+	lastIds.clear();
+
+	if(obj.contains("ws-sessions"))
+	{
+		if(typeId(obj["ws-sessions"]) != QMetaType::QVariantList)
+			return false;
+
+		foreach(const QVariant &v, obj["ws-sessions"].toList())
+		{
+			if(typeId(v) != QMetaType::QVariantHash)
+				return false;
+
+			QVariantHash vs = v.toHash();
+			WsSessionState s;
+
+			if(!getBytes(vs, "peer", &s.peer) || s.peer.isEmpty())
+				return false;
+
+			if(!getString(vs, "cid", true, &s.cid) || !getInt(vs, "ttl", &s.ttl))
+				return false;
+
+			QByteArray uri;
+			if(!getBytes(vs, "uri", &uri))
+				return false;
+
+			s.uri = QUrl::fromEncoded(uri, QUrl::StrictMode);
+
+			if(!getString(vs, "route", false, &s.route) ||
+				!getString(vs, "stats-route", false, &s.statsRoute) ||
+				!getBool(vs, "debug", &s.debug) ||
+				!getBool(vs, "trusted", &s.targetTrusted) ||
+				!getString(vs, "channel-prefix", false, &s.channelPrefix) ||
+				!getInt(vs, "log-level", &s.logLevel) ||
+				!getString(vs, "sid", false, &s.sid) ||
+				!getStringHash(vs, "meta", &s.meta) ||
+				!getStringSet(vs, "channels", &s.channels) ||
+				!getStringSet(vs, "implicit-channels", &s.implicitChannels) ||
+				!getBytes(vs, "keep-alive-type", &s.keepAliveType) ||
+				!getBytes(vs, "keep-alive-message", &s.keepAliveMessage))
+			{
+				return false;
+			}
+
+			if(vs.contains("channel-filters"))
+			{
+				if(typeId(vs["channel-filters"]) != QMetaType::QVariantHash)
+					return false;
+
+				QHashIterator<QString, QVariant> it(vs["channel-filters"].toHash());
+				while(it.hasNext())
+				{
+					it.next();
+
+					if(typeId(it.value()) != QMetaType::QVariantList)
+						return false;
+
+					QStringList filters;
+					foreach(const QVariant &f, it.value().toList())
+					{
+						if(typeId(f) != QMetaType::QByteArray)
+							return false;
+
+						filters += QString::fromUtf8(f.toByteArray());
+					}
+
+					s.channelFilters[it.key()] = filters;
+				}
+			}
+
+			wsSessions += s;
+		}
+	}
+
+	if(obj.contains("last-ids"))
+	{
+		if(typeId(obj["last-ids"]) != QMetaType::QVariantList)
+			return false;
+
+		foreach(const QVariant &v, obj["last-ids"].toList())
+		{
+			if(typeId(v) != QMetaType::QVariantList)
+				return false;
+
+			QVariantList pair = v.toList();
+			if(pair.count() != 2 || typeId(pair[0]) != QMetaType::QByteArray || typeId(pair[1]) != QMetaType::QByteArray)
+				return false;
+
+			lastIds += QPair<QString, QString>(QString::fromUtf8(pair[0].toByteArray()), QString::fromUtf8(pair[1].toByteArray()));
+		}
+	}
+
+	return true;
+}
+
+bool StateSnapshot::save(const QString &fileName, QString *errorMessage) const
+{
+	QSaveFile file(fileName);
+	if(!file.open(QFile::WriteOnly))
+	{
+		if(errorMessage)
+			*errorMessage = QString("failed to open %1: %2").arg(fileName, file.errorString());
+		return false;
+	}
+
+	file.write(TnetString::fromVariant(toVariant()));
+
+	if(!file.commit())
+	{
+		if(errorMessage)
+			*errorMessage = QString("failed to write %1: %2").arg(fileName, file.errorString());
+		return false;
+	}
+
+	return true;
+}
+
+bool StateSnapshot::load(const QString &fileName, QString *errorMessage)
+{
+	QFile file(fileName);
+	if(!file.open(QFile::ReadOnly))
+	{
+		if(errorMessage)
+			*errorMessage = QString("failed to open %1: %2").arg(fileName, file.errorString());
+		return false;
+	}
+
+	QByteArray buf = file.readAll();
+
+	bool ok;
+	QVariant data = TnetString::toVariant(buf, 0, &ok);
+	if(!ok || !fromVariant(data))
+	{
+		if(errorMessage)
+			*errorMessage = QString("invalid format in %1").arg(fileName);
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef STATESNAPSHOT_H
+#define STATESNAPSHOT_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QPair>
+#include <QHash>
+#include <QSet>
+#include <QUrl>
+#include <QVariant>
+
+// handler state saved on shutdown and loaded on start, so that a restart
+// doesn't drop the websocket sessions that the proxy still has open
+class StateSnapshot
+{
+public:
+	class WsSessionState
+	{
+	public:
+		QByteArray peer;
+		QString cid;
+		int ttl;
+		QUrl uri;
+		QString route;
+		QString statsRoute;
+		bool debug;
+		bool targetTrusted;
+		QString channelPrefix;
+		int logLevel;
+		QString sid;
+		QHash<QString, QString> meta;
+		QSet<QString> channels;
+		QSet<QString> implicitChannels;
+		QHash<QString, QStringList> channelFilters;
+		QByteArray keepAliveType;
+		QByteArray keepAliveMessage;
+
+		WsSessionState() :
+			ttl(-1),
+			debug(false),
+			targetTrusted(false),
+			logLevel(-1)
+		{
+		}
+	};
+
+	qint64 time; // msecs since epoch, when saved
+	QList<WsSessionState> wsSessions;
+	QList<QPair<QString, QString>> lastIds; // least recently used first
+
+	StateSnapshot() :
+		time(-1)
+	{
+	}
+
+	QVariant toVariant() const;
+	bool fromVariant(const QVariant &in);
+
+	// written to a temporary file and renamed, so a crash while saving
+	// leaves any previous snapshot intact
+	bool save(const QString &fileName, QString *errorMessage = 0) const;
+	bool load(const QString &fileName, QString *errorMessage = 0);
+};
+
+#endif
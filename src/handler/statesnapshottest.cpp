@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include <QDir>
+#include <QFile>
+#include "test.h"
+#include "publishlastids.h"
+#include "statesnapshot.h"
+
+static QString workFile(const QString &name)
+{
+	QDir outDir(qgetenv("OUT_DIR"));
+	QDir workDir(QDir::current().relativeFilePath(outDir.filePath("test-work")));
+	return workDir.filePath(name);
+}
+
+static void saveLoad()
+{
+	StateSnapshot snap;
+	snap.time = 1000;
+
+	StateSnapshot::WsSessionState ss;
+	ss.peer = "proxy_1";
+	ss.cid = "abc";
+	ss.ttl = 60;
+	ss.uri = QUrl("ws://example.com/path?a=b");
+	ss.route = "r";
+	ss.targetTrusted = true;
+	ss.sid = "s1";
+	ss.meta["user"] = "alice";
+	ss.channels += "apple";
+	ss.channels += "banana";
+	ss.implicitChannels += "banana";
+	ss.channelFilters["apple"] = QStringList() << "skip-self";
+	ss.keepAliveType = "text";
+	ss.keepAliveMessage = "ping";
+	snap.wsSessions += ss;
+
+	PublishLastIds ids(10);
+	ids.set("apple", "1");
+	ids.set("banana", "2");
+	ids.set("apple", "3");
+	snap.lastIds = ids.entries();
+
+	TEST_ASSERT_EQ(snap.lastIds.count(), 2);
+	TEST_ASSERT_EQ(snap.lastIds[0].first, QString("banana"));
+
+	QString fileName = workFile("state-snapshot");
+	TEST_ASSERT(snap.save(fileName));
+
+	StateSnapshot out;
+	TEST_ASSERT(out.load(fileName));
+	QFile::remove(fileName);
+
+	TEST_ASSERT_EQ(out.time, 1000);
+	TEST_ASSERT_EQ(out.wsSessions.count(), 1);
+
+	const StateSnapshot::WsSessionState &os = out.wsSessions[0];
+	TEST_ASSERT_EQ(os.peer, QByteArray("proxy_1"));
+	TEST_ASSERT_EQ(os.cid, QString("abc"));
+	TEST_ASSERT_EQ(os.ttl, 60);
+	TEST_ASSERT_EQ(os.uri, ss.uri);
+	TEST_ASSERT_EQ(os.route, QString("r"));
+	TEST_ASSERT(!os.debug);
+	TEST_ASSERT(os.targetTrusted);
+	TEST_ASSERT_EQ(os.logLevel, -1);
+	TEST_ASSERT_EQ(os.sid, QString("s1"));
+	TEST_ASSERT_EQ(os.meta.value("user"), QString("alice"));
+	TEST_ASSERT(os.channels == ss.channels);
+	TEST_ASSERT(os.implicitChannels == ss.implicitChannels);
+	TEST_ASSERT(os.channelFilters == ss.channelFilters);
+	TEST_ASSERT_EQ(os.keepAliveMessage, QByteArray("ping"));
+
+	// restoring in order keeps the most recently used last
+	PublishLastIds restored(2);
+	for(int n = 0; n < out.lastIds.count(); ++n)
+		restored.set(out.lastIds[n].first, out.lastIds[n].second);
+	restored.set("cherry", "1");
+
+	TEST_ASSERT(restored.value("banana").isNull());
+	TEST_ASSERT_EQ(restored.value("apple"), QString("3"));
+}
+
+static void invalid()
+{
+	QString fileName = workFile("state-snapshot-invalid");
+
+	StateSnapshot snap;
+	TEST_ASSERT(!snap.load(fileName));
+
+	QFile file(fileName);
+	TEST_ASSERT(file.open(QFile::WriteOnly));
+	file.write("5:hello,");
+	file.close();
+
+	QString errorMessage;
+	TEST_ASSERT(!snap.load(fileName, &errorMessage));
+	TEST_ASSERT(!errorMessage.isEmpty());
+	QFile::remove(fileName);
+}
+
+extern "C" int statesnapshot_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(saveLoad());
+	TEST_CATCH(invalid());
+
+	return 0;
+}
@@ -5,4 +5,14 @@ SOURCES += \
 	$$PWD/idformattest.cpp \
 	$$PWD/publishformattest.cpp \
 	$$PWD/publishitemtest.cpp \
-	$$PWD/handlerenginetest.cpp
+	$$PWD/handlerenginetest.cpp \
+	$$PWD/channelindextest.cpp \
+	$$PWD/ratelimitertest.cpp \
+	$$PWD/sequencertest.cpp \
+	$$PWD/publishlastidstest.cpp \
+	$$PWD/sessioncachetest.cpp \
+	$$PWD/publishhistorytest.cpp \
+	$$PWD/statesnapshottest.cpp \
+	$$PWD/slowconsumertest.cpp \
+	$$PWD/channeltrietest.cpp \
+	$$PWD/publishconflatertest.cpp
@@ -111,6 +111,18 @@ WsControlMessage WsControlMessage::fromVariant(const QVariant &in, bool *ok, QSt
 
 				out.filters += filter;
 			}
+
+			if(keyedObjectContains(in, "delta"))
+			{
+				QVariant vdelta = keyedObjectGetValue(in, "delta");
+				if(typeId(vdelta) != QMetaType::Bool)
+				{
+					setError(ok, errorMessage, QString("%1 contains 'delta' with wrong type").arg(pn));
+					return WsControlMessage();
+				}
+
+				out.delta = vdelta.toBool();
+			}
 		}
 	}
 	else if(out.type == Session)
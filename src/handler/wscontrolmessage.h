@@ -54,6 +54,7 @@ public:
 	Type type;
 	QString channel;
 	QStringList filters;
+	bool delta;
 	QString sessionId;
 	QString metaName;
 	QString metaValue;
@@ -64,6 +65,7 @@ public:
 
 	WsControlMessage() :
 		type((Type)-1),
+		delta(false),
 		messageType((MessageType)-1),
 		timeout(-1)
 	{
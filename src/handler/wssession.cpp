@@ -23,15 +23,20 @@
 
 #include "wssession.h"
 
-#include <QDateTime>
 #include "log.h"
 #include "timer.h"
+#include "loopclock.h"
 #include "defercall.h"
 #include "filter.h"
 #include "publishitem.h"
 #include "publishformat.h"
+#include "publishlatency.h"
+#include "statsmanager.h"
+#include "objectstats.h"
+#include "wscontrol.h"
 
 #define WSCONTROL_REQUEST_TIMEOUT 8000
+#define TIMER_SLACK 500
 
 WsSession::WsSession() :
 	nextReqId(0),
@@ -39,11 +44,13 @@ WsSession::WsSession() :
 	logLevel(LOG_LEVEL_DEBUG),
 	targetTrusted(false),
 	ttl(0),
+	stats(0),
 	inProcessPublishQueue(false),
 	closed(false)
 {
 	expireTimer = std::make_unique<Timer>();
 	expireTimer->setSingleShot(true);
+	expireTimer->setSlack(TIMER_SLACK);
 	expireTimer->timeout.connect(boost::bind(&WsSession::expireTimer_timeout, this));
 
 	delayedTimer = std::make_unique<Timer>();
@@ -53,9 +60,14 @@ WsSession::WsSession() :
 	requestTimer = std::make_unique<Timer>();
 	requestTimer->setSingleShot(true);
 	requestTimer->timeout.connect(boost::bind(&WsSession::requestTimer_timeout, this));
+
+	ObjectStats::add(ObjectStats::WsSessions, 1, sizeof(WsSession) + 3 * sizeof(Timer));
 }
 
-WsSession::~WsSession() = default;
+WsSession::~WsSession()
+{
+	ObjectStats::remove(ObjectStats::WsSessions, 1, sizeof(WsSession) + 3 * sizeof(Timer));
+}
 
 void WsSession::refreshExpiration()
 {
@@ -89,19 +101,105 @@ void WsSession::ack(int reqId)
 	}
 }
 
-void WsSession::publish(const PublishItem &item)
+void WsSession::publish(const std::shared_ptr<const PublishItem> &item)
 {
-	const PublishFormat &f = item.format;
+	const PublishFormat &f = item->format;
 
 	if(f.type != PublishFormat::WebSocketMessage)
 		return;
 
-	publishQueue += item;
+	if(f.coalesce == PublishFormat::NoCoalesce || !coalesceQueued(item))
+		publishQueue += item;
 
-	if(!inProcessPublishQueue)
+	if(inProcessPublishQueue)
+		return;
+
+	// the queue only backs up while the first item is in the filters
+	if(filters)
+		applySlowConsumerPolicy();
+	else
 		processPublishQueue();
 }
 
+void WsSession::applySlowConsumerPolicy()
+{
+	int queuedBytes = 0;
+	int dropped = slowConsumerPolicy.apply(&publishQueue, 1, [](const std::shared_ptr<const PublishItem> &i) -> const PublishItem & { return *i; }, &queuedBytes);
+
+	if(dropped > 0)
+	{
+		log_debug("wssession: slow consumer, dropped %d queued messages", dropped);
+
+		if(stats)
+			stats->incCounter(statsRouteId, Stats::SlowConsumerDrops, dropped);
+	}
+	else if(dropped < 0)
+	{
+		log_info("wssession: slow consumer, disconnecting: route=%s queued=%d bytes=%d", qPrintable(statsRoute), publishQueue.count(), queuedBytes);
+
+		if(stats)
+			stats->incCounter(statsRouteId, Stats::SlowConsumerDisconnects);
+
+		filtersFinishedConnection.disconnect();
+		filters.reset();
+		publishQueue.clear();
+
+		// try again later
+		sendClose(1013);
+	}
+}
+
+bool WsSession::coalesceQueued(const std::shared_ptr<const PublishItem> &item)
+{
+	const PublishFormat &f = item->format;
+
+	// the first item may be running through the filters
+	int start = filters ? 1 : 0;
+
+	for(int n = publishQueue.count() - 1; n >= start; --n)
+	{
+		const PublishItem &queued = *publishQueue[n];
+
+		if(queued.channel != item->channel)
+			continue;
+
+		// only the most recent message of the channel can be combined with
+		const PublishFormat &qf = queued.format;
+		if(qf.coalesce != f.coalesce || qf.action != PublishFormat::Send || qf.messageType != f.messageType)
+			return false;
+
+		std::shared_ptr<const PublishItem> out;
+
+		if(f.coalesce == PublishFormat::CoalesceLatest)
+		{
+			out = item;
+		}
+		else // CoalescePatch
+		{
+			// the combined message must pass the filters the same way
+			if(queued.meta != item->meta || qf.haveContentFilters != f.haveContentFilters || qf.contentFilters != f.contentFilters)
+				return false;
+
+			QByteArray body;
+			if(!WsControl::concatPatches(qf.body, f.body, &body))
+				return false;
+
+			auto merged = std::make_shared<PublishItem>(*item);
+			merged->format.body = body;
+			merged->receiveTime = queued.receiveTime;
+			out = merged;
+		}
+
+		// keep the combined message behind anything published before it
+		publishQueue.removeAt(n);
+		publishQueue += out;
+
+		return true;
+	}
+
+	return false;
+}
+
 void WsSession::processPublishQueue()
 {
 	assert(!inProcessPublishQueue);
@@ -109,18 +207,22 @@ void WsSession::processPublishQueue()
 
 	while(!closed && !publishQueue.isEmpty() && !filters)
 	{
-		const PublishItem &item = publishQueue.first();
+		const PublishItem &item = *publishQueue.first();
 		const PublishFormat &f = item.format;
 
+		if(item.isExpired())
+		{
+			publishQueue.removeFirst();
+			countExpired();
+			continue;
+		}
+
+		std::shared_ptr<const Filter::MessageFilterPlan> plan = Filter::MessageFilterPlan::get(channelFilters.value(item.channel));
+
 		if(f.haveContentFilters)
 		{
 			// ensure content filters match
-			QStringList contentFilters;
-			foreach(const QString &f, channelFilters[item.channel])
-			{
-				if(Filter::targets(f) & Filter::MessageContent)
-					contentFilters += f;
-			}
+			const QStringList &contentFilters = plan->contentFilters();
 			if(contentFilters != f.contentFilters)
 			{
 				publishQueue.removeFirst();
@@ -136,12 +238,23 @@ void WsSession::processPublishQueue()
 			}
 		}
 
-		filters = std::make_unique<Filter::MessageFilterStack>(channelFilters[item.channel]);
-		filtersFinishedConnection = filters->finished.connect(boost::bind(&WsSession::filtersFinished, this, boost::placeholders::_1));
-
 		Filter::Context fc;
 		fc.subscriptionMeta = meta;
 		fc.publishMeta = item.meta;
+
+		Filter::SendAction sendAction = plan->hasChecks() ? plan->checkDelivery(fc, item.userFiltersApplied) : Filter::Send;
+
+		if(sendAction == Filter::Drop || !plan->hasStages())
+		{
+			// nothing asynchronous to run
+			std::shared_ptr<const PublishItem> i = publishQueue.takeFirst();
+			afterFilters(*i, sendAction, i->format.body);
+			continue;
+		}
+
+		filters = std::make_unique<Filter::MessageFilterStack>(*plan);
+		filtersFinishedConnection = filters->finished.connect(boost::bind(&WsSession::filtersFinished, this, boost::placeholders::_1));
+
 		fc.zhttpOut = zhttpOut;
 		fc.currentUri = requestData.uri;
 		fc.route = route;
@@ -157,9 +270,15 @@ void WsSession::processPublishQueue()
 	inProcessPublishQueue = false;
 }
 
+void WsSession::countExpired()
+{
+	if(stats)
+		stats->incCounter(statsRouteId, Stats::MessagesExpired);
+}
+
 void WsSession::filtersFinished(const Filter::MessageFilter::Result &result)
 {
-	PublishItem item = publishQueue.takeFirst();
+	std::shared_ptr<const PublishItem> item = publishQueue.takeFirst();
 
 	filtersFinishedConnection.disconnect();
 	filters.reset();
@@ -173,9 +292,14 @@ void WsSession::filtersFinished(const Filter::MessageFilter::Result &result)
 			return;
 		}
 	}
+	else if(result.sendAction != Filter::Drop && item->isExpired())
+	{
+		// filters may take a while
+		countExpired();
+	}
 	else
 	{
-		afterFilters(item, result.sendAction, result.content);
+		afterFilters(*item, result.sendAction, result.content);
 	}
 
 	// if filters finished asynchronously then we need to resume processing
@@ -211,6 +335,12 @@ void WsSession::afterFilters(const PublishItem &item, Filter::SendAction sendAct
 		}
 
 		i.message = content;
+
+		if(f.coalesce != PublishFormat::NoCoalesce)
+		{
+			i.coalesce = (f.coalesce == PublishFormat::CoalesceLatest ? "latest" : "patch");
+			i.channel = item.channel.toUtf8();
+		}
 	}
 	else if(f.action == PublishFormat::Close)
 	{
@@ -226,23 +356,29 @@ void WsSession::afterFilters(const PublishItem &item, Filter::SendAction sendAct
 	}
 
 	send(i);
+
+	if(f.action == PublishFormat::Send)
+		PublishLatency::record(PublishLatency::Written, f.type, item.receiveTime);
 }
 
-void WsSession::sendCloseError(const QString &message)
+void WsSession::sendClose(int code, const QByteArray &reason)
 {
 	closed = true;
 
 	WsControlPacket::Item i;
 	i.cid = cid.toUtf8();
 	i.type = WsControlPacket::Item::Close;
-	i.code = 1011;
-
-	if(debug)
-		i.reason = message.toUtf8();
+	i.code = code;
+	i.reason = reason;
 
 	send(i);
 }
 
+void WsSession::sendCloseError(const QString &message)
+{
+	sendClose(1011, debug ? message.toUtf8() : QByteArray());
+}
+
 void WsSession::setupRequestTimer()
 {
 	if(!pendingRequests.isEmpty())
@@ -259,7 +395,7 @@ void WsSession::setupRequestTimer()
 				lowestTime = time;
 		}
 
-		int until = int(lowestTime - QDateTime::currentMSecsSinceEpoch());
+		int until = int(lowestTime - LoopClock::msecsSinceEpoch());
 
 		requestTimer->start(qMax(until, 0));
 	}
@@ -283,7 +419,7 @@ void WsSession::delayedTimer_timeout()
 	QByteArray message = delayedMessage;
 	delayedMessage.clear();
 
-	pendingRequests[reqId] = QDateTime::currentMSecsSinceEpoch() + WSCONTROL_REQUEST_TIMEOUT;
+	pendingRequests[reqId] = LoopClock::msecsSinceEpoch() + WSCONTROL_REQUEST_TIMEOUT;
 	setupRequestTimer();
 
 	WsControlPacket::Item i;
@@ -27,11 +27,13 @@
 #include <QHash>
 #include <QSet>
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 #include "packet/httprequestdata.h"
 #include "packet/wscontrolpacket.h"
 #include "ratelimiter.h"
 #include "filter.h"
 #include "clientsession.h"
+#include "slowconsumer.h"
 
 // each session can have a bunch of timers:
 // 3 misc timers
@@ -39,10 +41,10 @@
 #define TIMERS_PER_WSSESSION (3 + TIMERS_PER_MESSAGEFILTERSTACK)
 
 using Signal = boost::signals2::signal<void()>;
-using Connection = boost::signals2::scoped_connection;
 
 class Timer;
 class ZhttpManager;
+class StatsManager;
 class PublishItem;
 
 class WsSession : public ClientSession
@@ -57,12 +59,14 @@ public:
 	HttpRequestData requestData;
 	QString route;
 	QString statsRoute;
+	QByteArray statsRouteId; // statsRoute as utf-8
 	bool targetTrusted;
 	QString sid;
 	QHash<QString, QString> meta;
 	QHash<QString, QStringList> channelFilters; // k=channel, v=list(filters)
 	QSet<QString> channels;
 	QSet<QString> implicitChannels;
+	QSet<QString> deltaChannels; // subscribed with delta
 	int ttl;
 	QByteArray keepAliveType;
 	QByteArray keepAliveMessage;
@@ -72,9 +76,11 @@ public:
 	std::unique_ptr<Timer> expireTimer;
 	std::unique_ptr<Timer> delayedTimer;
 	std::unique_ptr<Timer> requestTimer;
-	QList<PublishItem> publishQueue;
+	QList<std::shared_ptr<const PublishItem>> publishQueue;
 	ZhttpManager *zhttpOut;
+	StatsManager *stats;
 	std::shared_ptr<RateLimiter> filterLimiter;
+	SlowConsumerPolicy slowConsumerPolicy; // applies while filters are running
 	std::unique_ptr<Filter::MessageFilter> filters;
 	Connection filtersFinishedConnection;
 	bool inProcessPublishQueue;
@@ -87,7 +93,8 @@ public:
 	void flushDelayed();
 	void sendDelayed(const QByteArray &type, const QByteArray &message, int timeout);
 	void ack(int reqId);
-	void publish(const PublishItem &item);
+	void publish(const std::shared_ptr<const PublishItem> &item);
+	void sendClose(int code, const QByteArray &reason = QByteArray());
 	void sendCloseError(const QString &message);
 
 	boost::signals2::signal<void(const WsControlPacket::Item&)> send;
@@ -95,7 +102,10 @@ public:
 	Signal error;
 
 private:
+	bool coalesceQueued(const std::shared_ptr<const PublishItem> &item);
 	void processPublishQueue();
+	void applySlowConsumerPolicy();
+	void countExpired();
 	void filtersFinished(const Filter::MessageFilter::Result &result);
 	void afterFilters(const PublishItem &item, Filter::SendAction sendAction, const QByteArray &content);
 	void setupRequestTimer();
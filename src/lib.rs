@@ -132,14 +132,43 @@ pub mod ffi {
     #[cfg(test)]
     import_cpptest! {
         pub fn httpheaders_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn httpheaderindex_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn ringqueue_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn fastsignal_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn arena_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn uuidutil_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn ridtable_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn bufferlist_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn flowwindow_test(out_ex: *mut TestException) -> libc::c_int;
         pub fn jwt_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn gzip_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn topk_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn objectstats_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn packetcapture_test(out_ex: *mut TestException) -> libc::c_int;
         pub fn timer_test(out_ex: *mut TestException) -> libc::c_int;
         pub fn defercall_test(out_ex: *mut TestException) -> libc::c_int;
         pub fn tcpstream_test(out_ex: *mut TestException) -> libc::c_int;
         pub fn unixstream_test(out_ex: *mut TestException) -> libc::c_int;
         pub fn eventloop_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn tnetstring_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn latencyhistogram_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn statsmanager_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn trace_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn tracecontext_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn log_test(out_ex: *mut TestException) -> libc::c_int;
         pub fn websocketoverhttp_test(out_ex: *mut TestException) -> libc::c_int;
         pub fn routesfile_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn pathtrie_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn targetbalancer_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn responsecache_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn inspectcache_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn admissioncontroller_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn concurrencylimit_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn zroutes_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn sharedrequests_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn workerload_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn keepalivescheduler_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn sockjsmanager_test(out_ex: *mut TestException) -> libc::c_int;
         pub fn proxyengine_test(out_ex: *mut TestException) -> libc::c_int;
         pub fn filter_test(out_ex: *mut TestException) -> libc::c_int;
         pub fn jsonpatch_test(out_ex: *mut TestException) -> libc::c_int;
@@ -148,6 +177,16 @@ pub mod ffi {
         pub fn publishformat_test(out_ex: *mut TestException) -> libc::c_int;
         pub fn publishitem_test(out_ex: *mut TestException) -> libc::c_int;
         pub fn handlerengine_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn channelindex_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn channeltrie_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn ratelimiter_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn sequencer_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn publishconflater_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn publishlastids_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn sessioncache_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn publishhistory_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn statesnapshot_test(out_ex: *mut TestException) -> libc::c_int;
+        pub fn slowconsumer_test(out_ex: *mut TestException) -> libc::c_int;
         pub fn template_test(out_ex: *mut TestException) -> libc::c_int;
     }
 }
@@ -24,15 +24,24 @@
 #include "m2adapterapp.h"
 
 #include <assert.h>
+#include <list>
+#include <thread>
+#include <pthread.h>
 #include <QCoreApplication>
+#include <QEventLoop>
 #include <QCommandLineParser>
 #include <QPair>
 #include <QHash>
-#include <QDateTime>
 #include <QElapsedTimer>
-#include <QTimer>
 #include <QDir>
 #include <QSettings>
+#include <QMutex>
+#include <QWaitCondition>
+#include "eventloop.h"
+#include "timer.h"
+#include "loopclock.h"
+#include "timerwheel.h"
+#include "defercall.h"
 #include "qzmqsocket.h"
 #include "qzmqvalve.h"
 #include "qtcompat.h"
@@ -46,9 +55,11 @@
 #include "log.h"
 #include "layertracker.h"
 #include "logutil.h"
+#include "cputopology.h"
 #include "config.h"
 
 #define DEFAULT_HWM 101000
+#define REGISTRATIONS_INITIAL 100
 #define STATUS_INTERVAL 250
 #define REFRESH_INTERVAL 1000
 #define M2_CONNECTION_EXPIRE 120000
@@ -57,11 +68,9 @@
 #define ZHTTP_CANCEL_RATE 100
 
 #define M2_CONNECTION_SHOULD_PROCESS (M2_CONNECTION_EXPIRE * 3 / 4)
-#define M2_CONNECTION_MUST_PROCESS (M2_CONNECTION_EXPIRE * 4 / 5)
 #define M2_REFRESH_BUCKETS (M2_CONNECTION_SHOULD_PROCESS / REFRESH_INTERVAL)
 
 #define ZHTTP_SHOULD_PROCESS (ZHTTP_EXPIRE * 3 / 4)
-#define ZHTTP_MUST_PROCESS (ZHTTP_EXPIRE * 4 / 5)
 #define ZHTTP_REFRESH_BUCKETS (ZHTTP_SHOULD_PROCESS / REFRESH_INTERVAL)
 
 #define ZHTTP_CANCEL_PER_REFRESH (ZHTTP_CANCEL_RATE * 1000 / REFRESH_INTERVAL)
@@ -75,6 +84,8 @@
 // this doesn't have to match the peer, but we'll set a reasonable number
 #define ZHTTP_IDS_MAX 128
 
+#define EXPIRE_WHEEL_CAPACITY_INITIAL 1000
+
 //#define CONTROL_PORT_DEBUG
 
 static void trimlist(QStringList *list)
@@ -234,10 +245,8 @@ static CommandLineParseResult parseCommandLine(QCommandLineParser *parser, ArgsD
 	return CommandLineOk;
 }
 
-class M2AdapterApp::Private : public QObject
+class M2AdapterApp::Private
 {
-	Q_OBJECT
-
 public:
 	enum Mode
 	{
@@ -316,8 +325,8 @@ public:
 		bool outCreditsEnabled;
 		int outCredits;
 		quint64 subIdBase;
-		qint64 lastRefresh;
 		int refreshBucket;
+		QByteArray outPrefix; // see m2_outPrefix()
 
 		M2Connection() :
 			confirmedBytesWritten(0),
@@ -360,6 +369,7 @@ public:
 	public:
 		Mode mode;
 		qint64 lastActive;
+		int expireTimerId;
 		QByteArray errorCondition;
 		QByteArray acceptToken; // for websocket
 		bool downClosed; // for websocket
@@ -394,6 +404,7 @@ public:
 
 		Session() :
 			lastActive(-1),
+			expireTimerId(-1),
 			downClosed(false),
 			upClosed(false),
 			responseHeadersOnly(false),
@@ -416,8 +427,9 @@ public:
 		}
 	};
 
-	M2AdapterApp *q;
-	ArgsData args;
+	QString configFile;
+	int shard;
+	int shardCount;
 	QByteArray zhttpInstanceId;
 	QByteArray zwsInstanceId;
 	std::unique_ptr<QZmq::Socket> m2_in_sock;
@@ -436,13 +448,12 @@ public:
 	QHash<Rid, Session*> sessionsByM2Rid;
 	QHash<Rid, Session*> sessionsByZhttpRid;
 	QHash<Rid, Session*> sessionsByZwsRid;
-	QMap<QPair<qint64, M2Connection*>, M2Connection*> m2ConnectionsByLastRefresh;
 	QSet<M2Connection*> m2ConnectionRefreshBuckets[M2_REFRESH_BUCKETS];
 	int currentM2RefreshBucket;
-	QMap<QPair<qint64, Session*>, Session*> sessionsByLastRefresh;
 	QSet<Session*> sessionRefreshBuckets[ZHTTP_REFRESH_BUCKETS];
 	int currentSessionRefreshBucket;
-	QMap<QPair<qint64, Session*>, Session*> sessionsByLastActive;
+	TimerWheel expireWheel;
+	qint64 expireStartTime;
 	int zhttpCancelMeter;
 	QSet<Session*> sessionsToCancel;
 	int m2_client_buffer;
@@ -452,30 +463,42 @@ public:
 	bool ignorePolicies;
 	QList<ControlPort> controlPorts;
 	QElapsedTimer time;
-	QTimer *statusTimer;
-	QTimer *refreshTimer;
+	std::unique_ptr<Timer> statusTimer;
+	std::unique_ptr<Timer> refreshTimer;
 	Connection quitConnection;
 	Connection hupConnection;
+	Connection statusTimerConnection;
+	Connection refreshTimerConnection;
 	map<QZmq::Socket*, Connection> rrConnection;
 	Connection m2InValveConnection;
 	Connection zhttpInValveConnection;
 	Connection zwsInValveConnection;
 
-	Private(M2AdapterApp *_q) :
-		QObject(_q),
-		q(_q),
+	SignalInt quit;
+
+	Private(const QString &_configFile, int _shard = 0, int _shardCount = 1) :
+		configFile(_configFile),
+		shard(_shard),
+		shardCount(_shardCount),
 		currentM2RefreshBucket(0),
 		currentSessionRefreshBucket(0),
+		expireWheel(EXPIRE_WHEEL_CAPACITY_INITIAL, 0),
 		zhttpCancelMeter(0)
 	{
-		quitConnection = ProcessQuit::instance()->quit.connect(boost::bind(&Private::doQuit, this));
-		hupConnection = ProcessQuit::instance()->hup.connect(boost::bind(&M2AdapterApp::Private::reload, this));
+		expireStartTime = LoopClock::msecsSinceEpoch();
 
-		statusTimer = new QTimer(this);
-		connect(statusTimer, &QTimer::timeout, this, &Private::status_timeout);
+		// when sharded, signals are handled by the main thread
+		if(shardCount == 1)
+		{
+			quitConnection = ProcessQuit::instance()->quit.connect(boost::bind(&Private::doQuit, this));
+			hupConnection = ProcessQuit::instance()->hup.connect(boost::bind(&M2AdapterApp::Private::reload, this));
+		}
 
-		refreshTimer = new QTimer(this);
-		connect(refreshTimer, &QTimer::timeout, this, &Private::refresh_timeout);
+		statusTimer = std::make_unique<Timer>();
+		statusTimerConnection = statusTimer->timeout.connect(boost::bind(&Private::status_timeout, this));
+
+		refreshTimer = std::make_unique<Timer>();
+		refreshTimerConnection = refreshTimer->timeout.connect(boost::bind(&Private::refresh_timeout, this));
 
 		time.start();
 	}
@@ -494,38 +517,10 @@ public:
 		}
 	}
 
-	void start()
+	bool start()
 	{
-		QCoreApplication::setApplicationName("m2adapter");
-		QCoreApplication::setApplicationVersion(Config::get().version);
-
-		QCommandLineParser parser;
-		parser.setApplicationDescription("Mongrel2 <-> ZHTTP adapter.");
-
-		QString errorMessage;
-		switch(parseCommandLine(&parser, &args, &errorMessage))
-		{
-			case CommandLineOk:
-				break;
-			case CommandLineError:
-				fprintf(stderr, "%s\n\n%s", qPrintable(errorMessage), qPrintable(parser.helpText()));
-				q->quit(1);
-				return;
-			case CommandLineVersionRequested:
-				printf("%s %s\n", qPrintable(QCoreApplication::applicationName()),
-					qPrintable(QCoreApplication::applicationVersion()));
-				q->quit(0);
-				return;
-			case CommandLineHelpRequested:
-				parser.showHelp();
-				Q_UNREACHABLE();
-		}
-
 		if(!init())
-		{
-			q->quit(1);
-			return;
-		}
+			return false;
 
 		m2_in_valve->open();
 
@@ -540,40 +535,12 @@ public:
 		refreshTimer->start();
 
 		log_info("started");
+
+		return true;
 	}
 
 	bool init()
 	{
-		if(args.logLevel != -1)
-			log_setOutputLevel(args.logLevel);
-		else
-			log_setOutputLevel(LOG_LEVEL_INFO);
-
-		if(!args.logFile.isEmpty())
-		{
-			if(!log_setFile(args.logFile))
-			{
-				log_error("failed to open log file: %s", qPrintable(args.logFile));
-				return false;
-			}
-		}
-
-		log_info("starting...");
-
-		QString configFile = args.configFile;
-		if(configFile.isEmpty())
-			configFile = QDir(Config::get().configDir).filePath("m2adapter.conf");
-
-		// QSettings doesn't inform us if the config file doesn't exist, so do that ourselves
-		{
-			QFile file(configFile);
-			if(!file.open(QIODevice::ReadOnly))
-			{
-				log_error("failed to open %s, and --config not passed", qPrintable(configFile));
-				return false;
-			}
-		}
-
 		QSettings settings(configFile, QSettings::IniFormat);
 
 		QStringList m2_in_specs = settings.value("m2_in_specs").toStringList();
@@ -644,7 +611,41 @@ public:
 			return false;
 		}
 
+		if(shardCount > 1)
+		{
+			// each shard serves its own subset of idents, so a shard must
+			// only receive from the send_specs of those idents
+			if(m2_in_specs.count() != m2_send_idents.count())
+			{
+				log_error("workers > 1 requires m2_in_specs to have the same count as m2_send_idents");
+				return false;
+			}
+
+			// shards can't share bound specs
+			if((!zhttp_in_specs.isEmpty() && !zhttp_connect) || (!zws_in_specs.isEmpty() && !zws_connect))
+			{
+				log_error("workers > 1 requires zhttp_connect and zws_connect");
+				return false;
+			}
+
+			QList<QByteArray> idents;
+			QStringList inSpecs;
+			QStringList controlSpecs;
+			for(int n = shard; n < m2_send_idents.count(); n += shardCount)
+			{
+				idents += m2_send_idents[n];
+				inSpecs += m2_in_specs[n];
+				controlSpecs += m2_control_specs[n];
+			}
+
+			m2_send_idents = idents;
+			m2_in_specs = inSpecs;
+			m2_control_specs = controlSpecs;
+		}
+
 		QByteArray pidStr = QByteArray::number(QCoreApplication::applicationPid());
+		if(shardCount > 1)
+			pidStr += '_' + QByteArray::number(shard);
 		zhttpInstanceId = "m2zhttp_" + pidStr;
 		zwsInstanceId = "m2zws_" + pidStr;
 
@@ -832,7 +833,6 @@ public:
 	void removeConnection(M2Connection *conn)
 	{
 		m2ConnectionRefreshBuckets[conn->refreshBucket].remove(conn);
-		m2ConnectionsByLastRefresh.remove(QPair<qint64, M2Connection*>(conn->lastRefresh, conn));
 		m2ConnectionsByRid.remove(Rid(m2_send_idents[conn->identIndex], conn->id));
 	}
 
@@ -882,24 +882,39 @@ public:
 		return best;
 	}
 
+	// activity only bumps lastActive. the expire timer is checked against
+	// it when it fires, and rescheduled if the session was active since
+	void touchSession(Session *s, qint64 now)
+	{
+		s->lastActive = now;
+
+		if(s->expireTimerId < 0)
+			scheduleExpire(s);
+	}
+
+	void scheduleExpire(Session *s)
+	{
+		qint64 expireTime = qMax(s->lastActive + ZHTTP_EXPIRE, expireStartTime);
+
+		s->expireTimerId = expireWheel.add((quint64)(expireTime - expireStartTime), (size_t)s);
+	}
+
 	void removeSession(Session *s)
 	{
 		unlinkConnection(s);
 
 		sessionsToCancel -= s;
 
+		// not in a bucket during handoff, but removing is harmless
 		if(s->lastRefresh >= 0)
+			sessionRefreshBuckets[s->refreshBucket].remove(s);
+
+		if(s->expireTimerId >= 0)
 		{
-			QPair<qint64, Session*> k(s->lastRefresh, s);
-			if(sessionsByLastRefresh.contains(k))
-			{
-				sessionRefreshBuckets[s->refreshBucket].remove(s);
-				sessionsByLastRefresh.remove(k);
-			}
+			expireWheel.remove(s->expireTimerId);
+			s->expireTimerId = -1;
 		}
 
-		sessionsByLastActive.remove(QPair<qint64, Session*>(s->lastActive, s));
-
 		if(s->mode == Http)
 			sessionsByZhttpRid.remove(Rid(zhttpInstanceId, s->id));
 		else // WebSocket
@@ -932,8 +947,11 @@ public:
 
 	void m2_out_write(const M2ResponsePacket &packet)
 	{
-		QByteArray buf = packet.toByteArray();
+		m2_out_write(packet.toByteArray());
+	}
 
+	void m2_out_write(const QByteArray &buf)
+	{
 		if(log_outputLevel() >= LOG_LEVEL_DEBUG)
 			LogUtil::logByteArray(LOG_LEVEL_DEBUG, buf, "m2: OUT");
 
@@ -1007,20 +1025,53 @@ public:
 		delete conn;
 	}
 
-	// contentSize = packet.data.size() - framing overhead
-	void m2_writeData(M2Connection *conn, const M2ResponsePacket &packet, int contentSize)
+	// the start of every data message to the connection, in the same
+	//   format as M2ResponsePacket
+	const QByteArray &m2_outPrefix(M2Connection *conn)
+	{
+		if(conn->outPrefix.isEmpty())
+			conn->outPrefix = m2_send_idents[conn->identIndex] + ' ' + TnetString::fromByteArray(conn->id) + ' ';
+
+		return conn->outPrefix;
+	}
+
+	// writes up to size bytes of the item's data, surrounded by the chunk
+	//   framing if chunked. the message is assembled in one buffer, so the
+	//   payload is copied only once on its way to the socket. returns the
+	//   size of the data part of the message
+	int m2_writeItemData(M2Connection *conn, M2PendingOutItem *item, int size, bool chunked, int contentSize)
 	{
+		const QByteArray &prefix = m2_outPrefix(conn);
+
+		size = (size >= 0 ? qMin(size, item->data.size()) : item->data.size());
+
+		QByteArray chunkHeader;
+		if(chunked)
+			chunkHeader = makeChunkHeader(size);
+
+		QByteArray buf;
+		buf.reserve(prefix.size() + chunkHeader.size() + size + 2);
+		buf += prefix;
+		buf += chunkHeader;
+		item->data.takeAppend(&buf, size);
+		if(chunked)
+			buf += makeChunkFooter();
+
+		int dataSize = buf.size() - prefix.size();
+
 		if(conn->outCreditsEnabled)
-			conn->outCredits -= packet.data.size();
+			conn->outCredits -= dataSize;
 
 		conn->bodyTracker.addPlain(contentSize);
-		conn->bodyTracker.specifyEncoded(packet.data.size(), contentSize);
+		conn->bodyTracker.specifyEncoded(dataSize, contentSize);
 
 		++(conn->packetsPending);
 		conn->packetTracker.addPlain(1);
-		conn->packetTracker.specifyEncoded(packet.data.size(), 1);
+		conn->packetTracker.specifyEncoded(dataSize, 1);
+
+		m2_out_write(buf);
 
-		m2_out_write(packet);
+		return dataSize;
 	}
 
 	void m2_queueHeaders(M2Connection *conn, const QByteArray &headerData)
@@ -1101,17 +1152,12 @@ public:
 			M2PendingOutItem *item = &conn->pendingOutItems.first();
 			if(item->type == M2PendingOutItem::Headers)
 			{
-				M2ResponsePacket packet;
-				packet.sender = m2_send_idents[conn->identIndex];
-				packet.id = conn->id;
-				packet.data = item->data.take();
+				int dataSize = m2_writeItemData(conn, item, -1, false, 0);
 
 				conn->pendingOutItems.removeFirst();
 
-				m2_writeData(conn, packet, 0);
-
 				if(!conn->flowControl)
-					handleConnectionBytesWritten(conn, packet.data.size(), true);
+					handleConnectionBytesWritten(conn, dataSize, true);
 			}
 			else if(item->type == M2PendingOutItem::Response)
 			{
@@ -1135,41 +1181,24 @@ public:
 					break;
 				}
 
-				QByteArray data = item->data.take(maxSize);
-				int contentSize = data.size();
+				int contentSize = qMin(maxSize, item->data.size());
 
-				M2ResponsePacket packet;
-				packet.sender = m2_send_idents[conn->identIndex];
-				packet.id = conn->id;
-
-				if(item->chunked)
-					packet.data = makeChunkHeader(data.size()) + data + makeChunkFooter();
-				else
-					packet.data = data;
+				int dataSize = m2_writeItemData(conn, item, contentSize, item->chunked, contentSize);
 
 				if(item->data.isEmpty())
 					conn->pendingOutItems.removeFirst();
 
-				m2_writeData(conn, packet, contentSize);
-
 				if(!conn->flowControl)
-					handleConnectionBytesWritten(conn, packet.data.size(), true);
+					handleConnectionBytesWritten(conn, dataSize, true);
 			}
 			else if(item->type == M2PendingOutItem::Frame)
 			{
-				M2ResponsePacket packet;
-				packet.sender = m2_send_idents[conn->identIndex];
-				packet.id = conn->id;
-				packet.data = item->data.take();
-
-				int contentSize = item->contentSize;
+				int dataSize = m2_writeItemData(conn, item, -1, false, item->contentSize);
 
 				conn->pendingOutItems.removeFirst();
 
-				m2_writeData(conn, packet, contentSize);
-
 				if(!conn->flowControl)
-					handleConnectionBytesWritten(conn, packet.data.size(), true);
+					handleConnectionBytesWritten(conn, dataSize, true);
 			}
 			else if(item->type == M2PendingOutItem::Close)
 			{
@@ -1368,11 +1397,7 @@ public:
 		{
 			Session *s = conn->session;
 
-			// update lastActive
-			qint64 now = QDateTime::currentMSecsSinceEpoch();
-			sessionsByLastActive.remove(QPair<qint64, Session*>(s->lastActive, s));
-			s->lastActive = now;
-			sessionsByLastActive.insert(QPair<qint64, Session*>(s->lastActive, s), s);
+			touchSession(s, LoopClock::msecsSinceEpoch());
 
 			handleSessionBodyWritten(s, bodyWritten, giveCredits);
 		}
@@ -1578,23 +1603,19 @@ public:
 		if(seq != -1)
 			++(s->inSeq);
 
-		qint64 now = QDateTime::currentMSecsSinceEpoch();
+		qint64 now = LoopClock::msecsSinceEpoch();
 
 		if(s->lastRefresh < 0 && !s->zhttpAddress.isEmpty())
 		{
 			// once we have the peer's address, set up refresh
 
 			s->lastRefresh = now;
-			sessionsByLastRefresh.insert(QPair<qint64, Session*>(s->lastRefresh, s), s);
 
 			s->refreshBucket = smallestSessionRefreshBucket();
 			sessionRefreshBuckets[s->refreshBucket] += s;
 		}
 
-		// update lastActive
-		sessionsByLastActive.remove(QPair<qint64, Session*>(s->lastActive, s));
-		s->lastActive = now;
-		sessionsByLastActive.insert(QPair<qint64, Session*>(s->lastActive, s), s);
+		touchSession(s, now);
 
 		if(s->pendingCancel)
 			return;
@@ -1637,7 +1658,6 @@ public:
 			// refresh would have already been set up once if we are here
 			assert(s->lastRefresh >= 0);
 
-			sessionsByLastRefresh.insert(QPair<qint64, Session*>(s->lastRefresh, s), s);
 			s->refreshBucket = smallestSessionRefreshBucket();
 			sessionRefreshBuckets[s->refreshBucket] += s;
 
@@ -1947,7 +1967,6 @@ public:
 			s->inHandoff = true;
 
 			sessionRefreshBuckets[s->refreshBucket].remove(s);
-			sessionsByLastRefresh.remove(QPair<qint64, Session*>(s->lastRefresh, s));
 
 			// whoever picks up after handoff can turn this on
 			s->multi = false;
@@ -1999,53 +2018,15 @@ public:
 		}
 	}
 
-	void refreshM2Connections(qint64 now)
+	void refreshM2Connections()
 	{
 		QHash<int, QList<QByteArray> > connIdListBySender;
 
-		// process the current bucket
+		// process the current bucket. every connection is in exactly one
+		//   bucket, so each is refreshed once per cycle
 		const QSet<M2Connection*> &bucket = m2ConnectionRefreshBuckets[currentM2RefreshBucket];
 		foreach(M2Connection *conn, bucket)
 		{
-			// move to the end
-			QPair<qint64, M2Connection*> k(conn->lastRefresh, conn);
-			m2ConnectionsByLastRefresh.remove(k);
-			conn->lastRefresh = now;
-			m2ConnectionsByLastRefresh.insert(QPair<qint64, M2Connection*>(conn->lastRefresh, conn), conn);
-
-			if(!connIdListBySender.contains(conn->identIndex))
-				connIdListBySender.insert(conn->identIndex, QList<QByteArray>());
-
-			QList<QByteArray> &connIdList = connIdListBySender[conn->identIndex];
-			connIdList += conn->id;
-
-			// if we're at max, send out now
-			if(connIdList.count() >= M2_HANDLER_TARGETS_MAX)
-			{
-				QVariantHash args;
-				args["keep-alive"] = true;
-				m2_writeCtlMany(m2_send_idents[conn->identIndex], connIdList, args);
-
-				connIdList.clear();
-				connIdListBySender.remove(conn->identIndex);
-			}
-		}
-
-		// process any others
-		qint64 threshold = now - M2_CONNECTION_MUST_PROCESS;
-		while(!m2ConnectionsByLastRefresh.isEmpty())
-		{
-			QMap<QPair<qint64, M2Connection*>, M2Connection*>::iterator it = m2ConnectionsByLastRefresh.begin();
-			M2Connection *conn = it.value();
-
-			if(conn->lastRefresh > threshold)
-				break;
-
-			// move to the end
-			m2ConnectionsByLastRefresh.erase(it);
-			conn->lastRefresh = now;
-			m2ConnectionsByLastRefresh.insert(QPair<qint64, M2Connection*>(conn->lastRefresh, conn), conn);
-
 			if(!connIdListBySender.contains(conn->identIndex))
 				connIdListBySender.insert(conn->identIndex, QList<QByteArray>());
 
@@ -2089,67 +2070,14 @@ public:
 	{
 		QHash<QByteArray, QList<Session*> > sessionListBySender[2]; // index corresponds to mode
 
-		// process the current bucket
+		// process the current bucket. sessions are only out of the buckets
+		//   during handoff, when they aren't refreshed
 		const QSet<Session*> &bucket = sessionRefreshBuckets[currentSessionRefreshBucket];
 		foreach(Session *s, bucket)
 		{
 			assert(!s->inHandoff && !s->zhttpAddress.isEmpty());
 
-			// move to the end
-			QPair<qint64, Session*> k(s->lastRefresh, s);
-			sessionsByLastRefresh.remove(k);
-			s->lastRefresh = now;
-			sessionsByLastRefresh.insert(QPair<qint64, Session*>(s->lastRefresh, s), s);
-
-			if(s->multi)
-			{
-				if(!sessionListBySender[s->mode].contains(s->zhttpAddress))
-					sessionListBySender[s->mode].insert(s->zhttpAddress, QList<Session*>());
-
-				QList<Session*> &sessionList = sessionListBySender[s->mode][s->zhttpAddress];
-				sessionList += s;
-
-				// if we're at max, send out now
-				if(sessionList.count() >= ZHTTP_IDS_MAX)
-				{
-					ZhttpRequestPacket zreq;
-					zreq.from = (s->mode == Http ? zhttpInstanceId : zwsInstanceId);
-					foreach(Session *i, sessionList)
-						zreq.ids += ZhttpRequestPacket::Id(i->id, (i->outSeq)++);
-					zreq.type = ZhttpRequestPacket::KeepAlive;
-					zhttp_out_write(s->mode, zreq, s->zhttpAddress);
-
-					sessionList.clear();
-					sessionListBySender[s->mode].remove(s->zhttpAddress);
-				}
-			}
-			else
-			{
-				// session doesn't support sending with multiple ids
-				ZhttpRequestPacket zreq;
-				zreq.from = (s->mode == Http ? zhttpInstanceId : zwsInstanceId);
-				zreq.ids += ZhttpRequestPacket::Id(s->id, (s->outSeq)++);
-				zreq.type = ZhttpRequestPacket::KeepAlive;
-				zhttp_out_write(s->mode, zreq, s->zhttpAddress);
-			}
-		}
-
-		// process any others
-		qint64 threshold = now - ZHTTP_MUST_PROCESS;
-		while(!sessionsByLastRefresh.isEmpty())
-		{
-			QMap<QPair<qint64, Session*>, Session*>::iterator it = sessionsByLastRefresh.begin();
-			Session *s = it.value();
-
-			if(s->lastRefresh > threshold)
-				break;
-
-			assert(!s->inHandoff && !s->zhttpAddress.isEmpty());
-
-			// move to the end
-			sessionsByLastRefresh.erase(it);
 			s->lastRefresh = now;
-			sessionsByLastRefresh.insert(QPair<qint64, Session*>(s->lastRefresh, s), s);
 
 			if(s->multi)
 			{
@@ -2215,15 +2143,26 @@ public:
 
 	void expireSessions(qint64 now)
 	{
-		qint64 threshold = now - ZHTTP_EXPIRE;
-		while(!sessionsByLastActive.isEmpty())
-		{
-			QMap<QPair<qint64, Session*>, Session*>::iterator it = sessionsByLastActive.begin();
-			Session *s = it.value();
+		// time must go forward
+		if(now > expireStartTime)
+			expireWheel.update((quint64)(now - expireStartTime));
 
-			if(s->lastActive > threshold)
+		while(true)
+		{
+			TimerWheel::Expired expired = expireWheel.takeExpired();
+			if(expired.key < 0)
 				break;
 
+			Session *s = (Session *)expired.userData;
+			s->expireTimerId = -1;
+
+			if(now - s->lastActive < ZHTTP_EXPIRE)
+			{
+				// active since scheduled
+				scheduleExpire(s);
+				continue;
+			}
+
 			log_warning("timing out request %s", s->id.data());
 			destroySessionAndErrorConnection(s);
 		}
@@ -2354,7 +2293,7 @@ public:
 			return;
 		}
 
-		qint64 now = QDateTime::currentMSecsSinceEpoch();
+		qint64 now = LoopClock::msecsSinceEpoch();
 
 		Rid m2Rid(mreq.sender, mreq.id);
 
@@ -2435,9 +2374,6 @@ public:
 
 			m2ConnectionsByRid.insert(m2Rid, conn);
 
-			conn->lastRefresh = now;
-			m2ConnectionsByLastRefresh.insert(QPair<qint64, M2Connection*>(conn->lastRefresh, conn), conn);
-
 			conn->refreshBucket = smallestM2RefreshBucket();
 			m2ConnectionRefreshBuckets[conn->refreshBucket] += conn;
 		}
@@ -2572,10 +2508,7 @@ public:
 
 			sessionsByM2Rid.insert(m2Rid, s);
 
-			qint64 now = QDateTime::currentMSecsSinceEpoch();
-
-			s->lastActive = now;
-			sessionsByLastActive.insert(QPair<qint64, Session*>(s->lastActive, s), s);
+			touchSession(s, now);
 
 			if(mreq.type == M2RequestPacket::HttpRequest)
 				sessionsByZhttpRid.insert(Rid(zhttpInstanceId, s->id), s);
@@ -2822,7 +2755,6 @@ public:
 		handleZhttpIn(WebSocket, message);
 	}
 
-private slots:
 	void status_timeout()
 	{
 		int now = time.elapsed();
@@ -2849,9 +2781,9 @@ private slots:
 
 	void refresh_timeout()
 	{
-		qint64 now = QDateTime::currentMSecsSinceEpoch();
+		qint64 now = LoopClock::msecsSinceEpoch();
 
-		refreshM2Connections(now);
+		refreshM2Connections();
 		refreshSessions(now);
 		expireSessions(now);
 		cancelSessions();
@@ -2871,24 +2803,351 @@ private slots:
 		ProcessQuit::cleanup();
 
 		log_info("stopped");
-		q->quit(0);
+		quit(0);
 	}
 };
 
-M2AdapterApp::M2AdapterApp(QObject *parent) :
-	QObject(parent)
+class M2AdapterApp::WorkerThread
 {
-	d = new Private(this);
-}
+public:
+	std::thread thread;
+	QMutex m;
+	QWaitCondition w;
+	QString configFile;
+	int shard;
+	int shardCount;
+	bool newEventLoop;
+	std::unique_ptr<DeferCall> deferCall;
+	bool active;
+
+	WorkerThread(const QString &_configFile, int _shard, int _shardCount, bool _newEventLoop) :
+		configFile(_configFile),
+		shard(_shard),
+		shardCount(_shardCount),
+		newEventLoop(_newEventLoop),
+		active(false)
+	{
+	}
 
-M2AdapterApp::~M2AdapterApp()
-{
-	delete d;
-}
+	~WorkerThread()
+	{
+		stop();
+		thread.join();
+	}
+
+	bool start()
+	{
+		QString name = "m2a-worker-" + QString::number(shard);
+
+		QMutexLocker locker(&m);
+
+		thread = std::thread([=] {
+#ifdef Q_OS_MAC
+			pthread_setname_np(name.toUtf8().data());
+#else
+			pthread_setname_np(pthread_self(), name.toUtf8().data());
+#endif
+
+			run();
+		});
+
+		w.wait(&m);
+		return active;
+	}
+
+	void stop()
+	{
+		QMutexLocker locker(&m);
+
+		if(active)
+		{
+			active = false;
+
+			// NOTE: handler is called from worker thread
+			deferCall->defer([=] { stopped(); });
+		}
+	}
+
+private:
+	std::unique_ptr<EventLoop> loop;
+	std::unique_ptr<QEventLoop> qloop;
+	std::unique_ptr<Private> d;
+
+	void exitLoop(int code)
+	{
+		if(newEventLoop)
+			loop->exit(code);
+		else
+			qloop->exit(code);
+	}
+
+	void stopped()
+	{
+		d.reset();
 
-void M2AdapterApp::start()
+		log_debug("worker %d: stopped", shard);
+
+		exitLoop(0);
+	}
+
+	void run()
+	{
+		// will unlock once started
+		m.lock();
+
+		if(newEventLoop)
+		{
+			log_debug("worker %d: using new event loop", shard);
+
+			loop = std::make_unique<EventLoop>(REGISTRATIONS_INITIAL, 0);
+		}
+		else
+		{
+			// for qt event loop, timer subsystem must be explicitly initialized
+			Timer::init(REGISTRATIONS_INITIAL, 0);
+
+			qloop = std::make_unique<QEventLoop>();
+		}
+
+		deferCall = std::make_unique<DeferCall>();
+		deferCall->defer([=] {
+			d = std::make_unique<Private>(configFile, shard, shardCount);
+
+			if(d->start())
+			{
+				log_debug("worker %d: started", shard);
+
+				active = true;
+			}
+			else
+			{
+				d.reset();
+
+				exitLoop(1);
+			}
+
+			// unblock start()
+			w.wakeOne();
+			m.unlock();
+		});
+
+		if(newEventLoop)
+			loop->exec();
+		else
+			qloop->exec();
+
+		if(!newEventLoop)
+		{
+			// ensure deferred deletes are processed
+			QCoreApplication::instance()->sendPostedEvents();
+		}
+
+		// no more calls can be queued once inactive
+		deferCall.reset();
+
+		// deinit here, after all event loop activity has completed
+
+		DeferCall::cleanup();
+
+		loop.reset();
+		qloop.reset();
+
+		if(!newEventLoop)
+			Timer::deinit();
+	}
+};
+
+M2AdapterApp::M2AdapterApp() = default;
+
+M2AdapterApp::~M2AdapterApp() = default;
+
+int M2AdapterApp::run()
 {
-	d->start();
-}
+	QCoreApplication::setApplicationName("m2adapter");
+	QCoreApplication::setApplicationVersion(Config::get().version);
 
-#include "m2adapterapp.moc"
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Mongrel2 <-> ZHTTP adapter.");
+
+	ArgsData args;
+	QString errorMessage;
+	switch(parseCommandLine(&parser, &args, &errorMessage))
+	{
+		case CommandLineOk:
+			break;
+		case CommandLineError:
+			fprintf(stderr, "%s\n\n%s", qPrintable(errorMessage), qPrintable(parser.helpText()));
+			return 1;
+		case CommandLineVersionRequested:
+			printf("%s %s\n", qPrintable(QCoreApplication::applicationName()),
+				qPrintable(QCoreApplication::applicationVersion()));
+			return 0;
+		case CommandLineHelpRequested:
+			parser.showHelp();
+			Q_UNREACHABLE();
+	}
+
+	if(args.logLevel != -1)
+		log_setOutputLevel(args.logLevel);
+	else
+		log_setOutputLevel(LOG_LEVEL_INFO);
+
+	if(!args.logFile.isEmpty())
+	{
+		if(!log_setFile(args.logFile))
+		{
+			log_error("failed to open log file: %s", qPrintable(args.logFile));
+			return 1;
+		}
+	}
+
+	log_info("starting...");
+
+	QString configFile = args.configFile;
+	if(configFile.isEmpty())
+		configFile = QDir(Config::get().configDir).filePath("m2adapter.conf");
+
+	// QSettings doesn't inform us if the config file doesn't exist, so do that ourselves
+	{
+		QFile file(configFile);
+		if(!file.open(QIODevice::ReadOnly))
+		{
+			log_error("failed to open %s, and --config not passed", qPrintable(configFile));
+			return 1;
+		}
+	}
+
+	bool newEventLoop;
+	int workerCount;
+	{
+		QSettings settings(configFile, QSettings::IniFormat);
+		newEventLoop = settings.value("new_event_loop", false).toBool();
+		workerCount = CpuTopology::parseWorkers(settings.value("workers").toString());
+
+		// idents are divided among workers, so more would sit idle
+		QStringList idents = settings.value("m2_send_idents").toStringList();
+		trimlist(&idents);
+		workerCount = qMax(qMin(workerCount, idents.count()), 1);
+	}
+
+	// the adapter needs a handful of sockets and timers, so registrations
+	// are grown as needed rather than sized up front
+	std::unique_ptr<EventLoop> loop;
+
+	if(newEventLoop)
+	{
+		log_debug("using new event loop");
+
+		loop = std::make_unique<EventLoop>(REGISTRATIONS_INITIAL, 0);
+	}
+	else
+	{
+		// for qt event loop, timer subsystem must be explicitly initialized
+		Timer::init(REGISTRATIONS_INITIAL, 0);
+	}
+
+	std::unique_ptr<Private> d;
+	std::list<WorkerThread*> threads;
+
+	DeferCall deferCall;
+	deferCall.defer([&] {
+		if(workerCount > 1)
+		{
+			ProcessQuit::instance()->quit.connect([&] {
+				log_info("stopping...");
+
+				// remove the handler, so if we get another signal then we crash out
+				ProcessQuit::cleanup();
+
+				for(WorkerThread *t : threads)
+					t->stop();
+
+				for(WorkerThread *t : threads)
+					delete t;
+
+				threads.clear();
+
+				log_info("stopped");
+
+				if(newEventLoop)
+					loop->exit(0);
+				else
+					QCoreApplication::exit(0);
+			});
+
+			ProcessQuit::instance()->hup.connect([&] {
+				log_info("reloading");
+				log_rotate();
+			});
+
+			for(int n = 0; n < workerCount; ++n)
+			{
+				WorkerThread *t = new WorkerThread(configFile, n, workerCount, newEventLoop);
+				if(!t->start())
+				{
+					delete t;
+
+					for(WorkerThread *t : threads)
+						delete t;
+
+					threads.clear();
+
+					if(newEventLoop)
+						loop->exit(1);
+					else
+						QCoreApplication::exit(1);
+
+					return;
+				}
+
+				threads.push_back(t);
+			}
+
+			return;
+		}
+
+		d = std::make_unique<Private>(configFile);
+
+		d->quit.connect([&](int code) {
+			deferCall.defer([&, code] {
+				d.reset();
+
+				if(newEventLoop)
+					loop->exit(code);
+				else
+					QCoreApplication::exit(code);
+			});
+		});
+
+		if(!d->start())
+		{
+			d.reset();
+
+			if(newEventLoop)
+				loop->exit(1);
+			else
+				QCoreApplication::exit(1);
+		}
+	});
+
+	int ret;
+	if(newEventLoop)
+		ret = loop->exec();
+	else
+		ret = QCoreApplication::exec();
+
+	if(!newEventLoop)
+	{
+		// ensure deferred deletes are processed
+		QCoreApplication::instance()->sendPostedEvents();
+	}
+
+	// deinit here, after all event loop activity has completed
+
+	DeferCall::cleanup();
+
+	if(!newEventLoop)
+		Timer::deinit();
+
+	return ret;
+}
@@ -23,29 +23,23 @@
 #ifndef M2ADAPTERAPP_H
 #define M2ADAPTERAPP_H
 
-#include <QObject>
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 
 using std::map;
 using SignalInt = boost::signals2::signal<void(int)>;
-using Connection = boost::signals2::scoped_connection;
 
-class M2AdapterApp : public QObject
+class M2AdapterApp
 {
-	Q_OBJECT
-
 public:
-	M2AdapterApp(QObject *parent = 0);
+	M2AdapterApp();
 	~M2AdapterApp();
 
-	void start();
-
-	SignalInt quit;
+	int run();
 
 private:
 	class Private;
-	friend class Private;
-	Private *d;
+	class WorkerThread;
 };
 
 #endif
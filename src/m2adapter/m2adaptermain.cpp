@@ -21,37 +21,16 @@
  */
 
 #include <QCoreApplication>
-#include <QTimer>
 #include "m2adapterapp.h"
 
-class M2AdapterAppMain
-{
-public:
-	M2AdapterApp *app;
-
-	void start()
-	{
-		app = new M2AdapterApp;
-		app->quit.connect(boost::bind(&M2AdapterAppMain::app_quit, this, boost::placeholders::_1));
-		app->start();
-	}
-
-	void app_quit(int returnCode)
-	{
-		delete app;
-		QCoreApplication::exit(returnCode);
-	}
-};
-
 extern "C" {
 
 int m2adapter_main(int argc, char **argv)
 {
 	QCoreApplication qapp(argc, argv);
 
-	M2AdapterAppMain appMain;
-	QTimer::singleShot(0, [&appMain]() {appMain.start();});
-	return qapp.exec();
+	M2AdapterApp app;
+	return app.run();
 }
 
 }
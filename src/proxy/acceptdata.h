@@ -90,8 +90,13 @@ public:
 	bool trusted; // whether a trusted target was used
 	bool useSession;
 	bool responseSent;
+	bool compressPublished;
 	QVariantList connMaxPackets;
 
+	// omit the headers and body of requestData where they are the same as
+	// those of origRequestData. the handler falls back to the latter
+	bool compact;
+
 	AcceptData() :
 		haveInspectData(false),
 		haveResponse(false),
@@ -99,7 +104,9 @@ public:
 		logLevel(-1),
 		trusted(false),
 		useSession(false),
-		responseSent(false)
+		responseSent(false),
+		compressPublished(false),
+		compact(false)
 	{
 	}
 };
@@ -24,8 +24,43 @@
 #include "acceptrequest.h"
 
 #include "qtcompat.h"
+#include "log.h"
+#include "defercall.h"
 #include "acceptdata.h"
 
+// max requests carried by a single accept-batch request. the handler
+// rejects larger batches
+#define BATCH_ITEMS_MAX 1000
+
+// if base is set, headers and body that are the same as base's are left
+// out, for the receiver to take from base instead
+static QVariant requestDataToVariant(const HttpRequestData &requestData, const HttpRequestData *base = 0)
+{
+	QVariantHash vrequestData;
+
+	vrequestData["method"] = requestData.method.toLatin1();
+	vrequestData["uri"] = requestData.uri.toEncoded();
+
+	if(!base || requestData.headers != base->headers)
+	{
+		QVariantList vheaders;
+		foreach(const HttpHeader &h, requestData.headers)
+		{
+			QVariantList vheader;
+			vheader += h.first;
+			vheader += h.second;
+			vheaders += QVariant(vheader);
+		}
+
+		vrequestData["headers"] = vheaders;
+	}
+
+	if(!base || requestData.body != base->body)
+		vrequestData["body"] = requestData.body;
+
+	return vrequestData;
+}
+
 static QVariant acceptDataToVariant(const AcceptData &adata)
 {
 	QVariantHash obj;
@@ -90,51 +125,8 @@ static QVariant acceptDataToVariant(const AcceptData &adata)
 		obj["requests"] = vrequests;
 	}
 
-	{
-		const HttpRequestData &requestData = adata.requestData;
-		QVariantHash vrequestData;
-
-		vrequestData["method"] = requestData.method.toLatin1();
-		vrequestData["uri"] = requestData.uri.toEncoded();
-
-		QVariantList vheaders;
-		foreach(const HttpHeader &h, requestData.headers)
-		{
-			QVariantList vheader;
-			vheader += h.first;
-			vheader += h.second;
-			vheaders += QVariant(vheader);
-		}
-
-		vrequestData["headers"] = vheaders;
-
-		vrequestData["body"] = requestData.body;
-
-		obj["request-data"] = vrequestData;
-	}
-
-	{
-		const HttpRequestData &requestData = adata.origRequestData;
-		QVariantHash vrequestData;
-
-		vrequestData["method"] = requestData.method.toLatin1();
-		vrequestData["uri"] = requestData.uri.toEncoded();
-
-		QVariantList vheaders;
-		foreach(const HttpHeader &h, requestData.headers)
-		{
-			QVariantList vheader;
-			vheader += h.first;
-			vheader += h.second;
-			vheaders += QVariant(vheader);
-		}
-
-		vrequestData["headers"] = vheaders;
-
-		vrequestData["body"] = requestData.body;
-
-		obj["orig-request-data"] = vrequestData;
-	}
+	obj["request-data"] = requestDataToVariant(adata.requestData, adata.compact ? &adata.origRequestData : 0);
+	obj["orig-request-data"] = requestDataToVariant(adata.origRequestData);
 
 	if(adata.haveInspectData)
 	{
@@ -212,6 +204,9 @@ static QVariant acceptDataToVariant(const AcceptData &adata)
 	if(adata.trusted)
 		obj["trusted"] = true;
 
+	if(adata.compressPublished)
+		obj["publish-compress"] = true;
+
 	if(adata.useSession)
 		obj["use-session"] = true;
 
@@ -326,21 +321,208 @@ class AcceptRequest::Private
 {
 public:
 	AcceptRequest *q;
+	ZrpcManager *manager;
 	ResponseData result;
+	QVariantHash args;
+	Batch *batch;
+
+	Private(AcceptRequest *_q, ZrpcManager *_manager) :
+		q(_q),
+		manager(_manager),
+		batch(0)
+	{
+	}
+};
+
+// collects the requests started for a manager, and then sends them as one
+// accept-batch request and hands each its own response
+class AcceptRequest::Batch
+{
+public:
+	Batch(ZrpcManager *_manager) :
+		manager(_manager),
+		delivering(false)
+	{
+		queued.insert(manager, this);
+
+		deferCall.defer([=] { send(); });
+	}
+
+	~Batch()
+	{
+		if(queued.value(manager) == this)
+			queued.remove(manager);
+	}
+
+	static void add(AcceptRequest *r)
+	{
+		Batch *b = queued.value(r->d->manager);
+		if(!b)
+			b = new Batch(r->d->manager);
+
+		b->requests += r;
+		r->d->batch = b;
+
+		// later requests go in a new batch
+		if(b->requests.count() >= BATCH_ITEMS_MAX)
+			queued.remove(b->manager);
+	}
+
+	void remove(AcceptRequest *r)
+	{
+		requests.removeAll(r);
+
+		// nothing left to send or deliver. this also stops an in-flight
+		// batch from outliving the manager
+		if(requests.isEmpty() && !delivering)
+			delete this;
+	}
+
+private:
+	static thread_local QHash<ZrpcManager*, Batch*> queued;
+
+	ZrpcManager *manager;
+	QList<AcceptRequest*> requests;
+	std::unique_ptr<ZrpcRequest> req;
+	Connection finishedConnection;
+	bool delivering;
+	DeferCall deferCall;
 
-	Private(AcceptRequest *_q) :
-		q(_q)
+	void send()
 	{
+		if(queued.value(manager) == this)
+			queued.remove(manager);
+
+		if(requests.count() == 1)
+		{
+			startSingles();
+			return;
+		}
+
+		QVariantList items;
+		foreach(AcceptRequest *r, requests)
+			items += r->d->args;
+
+		QVariantHash args;
+		args["items"] = items;
+
+		req = std::make_unique<ZrpcRequest>(manager);
+		finishedConnection = req->finished.connect(boost::bind(&Batch::req_finished, this));
+		req->start("accept-batch", args);
+	}
+
+	// sends the requests one by one as accept requests
+	void startSingles()
+	{
+		QList<AcceptRequest*> rs;
+		rs.swap(requests);
+
+		foreach(AcceptRequest *r, rs)
+		{
+			r->d->batch = 0;
+			r->ZrpcRequest::start("accept", r->d->args);
+		}
+
+		DeferCall::deleteLater(this);
+	}
+
+	void req_finished()
+	{
+		finishedConnection.disconnect();
+
+		if(!req->success())
+		{
+			if(req->errorConditionString() == "method-not-found")
+			{
+				log_debug("acceptrequest: handler does not support accept-batch, sending individually");
+
+				startSingles();
+				return;
+			}
+
+			finishAll(false, req->result(), req->errorCondition(), req->errorConditionString());
+			return;
+		}
+
+		QVariant vresult = req->result();
+
+		QVariantList results;
+		if(typeId(vresult) == QMetaType::QVariantHash)
+		{
+			QVariantHash obj = vresult.toHash();
+			if(typeId(obj.value("results")) == QMetaType::QVariantList)
+				results = obj["results"].toList();
+		}
+
+		if(results.count() != requests.count())
+		{
+			finishAll(false, QVariant(), ZrpcRequest::ErrorFormat);
+			return;
+		}
+
+		// a request's finished handler may delete others in the batch,
+		// which removes them from the list
+		QHash<AcceptRequest*, QVariantHash> byRequest;
+		for(int n = 0; n < requests.count(); ++n)
+			byRequest.insert(requests[n], results[n].toHash());
+
+		delivering = true;
+
+		while(!requests.isEmpty())
+		{
+			AcceptRequest *r = requests.takeFirst();
+			r->d->batch = 0;
+
+			QVariantHash i = byRequest.value(r);
+
+			if(typeId(i.value("success")) != QMetaType::Bool)
+			{
+				r->complete(false, QVariant(), ZrpcRequest::ErrorFormat);
+				continue;
+			}
+
+			if(i["success"].toBool())
+			{
+				r->complete(true, i.value("value"));
+			}
+			else
+			{
+				QByteArray condition = i.value("condition").toByteArray();
+				r->complete(false, i.value("value"), (condition == "bad-format" ? ZrpcRequest::ErrorFormat : ZrpcRequest::ErrorGeneric), condition);
+			}
+		}
+
+		DeferCall::deleteLater(this);
+	}
+
+	void finishAll(bool success, const QVariant &result, ZrpcRequest::ErrorCondition condition, const QByteArray &conditionString = QByteArray())
+	{
+		delivering = true;
+
+		while(!requests.isEmpty())
+		{
+			AcceptRequest *r = requests.takeFirst();
+			r->d->batch = 0;
+			r->complete(success, result, condition, conditionString);
+		}
+
+		DeferCall::deleteLater(this);
 	}
 };
 
+thread_local QHash<ZrpcManager*, AcceptRequest::Batch*> AcceptRequest::Batch::queued;
+
 AcceptRequest::AcceptRequest(ZrpcManager *manager) :
 	ZrpcRequest(manager)
 {
-	d = std::make_unique<Private>(this);
+	d = std::make_unique<Private>(this, manager);
 }
 
-AcceptRequest::~AcceptRequest() = default;
+AcceptRequest::~AcceptRequest()
+{
+	if(d->batch)
+		d->batch->remove(this);
+}
 
 AcceptRequest::ResponseData AcceptRequest::result() const
 {
@@ -349,7 +531,9 @@ AcceptRequest::ResponseData AcceptRequest::result() const
 
 void AcceptRequest::start(const AcceptData &adata)
 {
-	ZrpcRequest::start("accept", acceptDataToVariant(adata).toHash());
+	d->args = acceptDataToVariant(adata).toHash();
+
+	Batch::add(this);
 }
 
 void AcceptRequest::onSuccess()
@@ -362,4 +546,3 @@ void AcceptRequest::onSuccess()
 		return;
 	}
 }
-
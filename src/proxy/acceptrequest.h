@@ -50,6 +50,8 @@ public:
 
 	ResponseData result() const;
 
+	// requests started during the same pass of the event loop are sent to
+	// the handler together, as a single accept-batch request
 	void start(const AcceptData &adata);
 
 protected:
@@ -58,6 +60,8 @@ protected:
 private:
 	class Private;
 	std::unique_ptr<Private> d;
+
+	class Batch;
 };
 
 #endif
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "admissioncontroller.h"
+
+#include <assert.h>
+
+AdmissionController::AdmissionController() :
+	acceptsOutstanding_(0),
+	acceptLatency_(0),
+	haveLatency_(false)
+{
+}
+
+AdmissionController::Decision AdmissionController::check(const DomainMap::Entry &route) const
+{
+	const DomainMap::ShedConfig &c = route.shedConfig;
+
+	if(c.maxConcurrency > 0 && sessions(route.id) >= c.maxConcurrency)
+		return ShedConcurrency;
+
+	if(c.maxAccepts > 0 && acceptsOutstanding_ >= c.maxAccepts)
+		return ShedAccepts;
+
+	// the latency is only measured when accepts complete, so it is only
+	// trusted while some are outstanding. otherwise a slow period would
+	// shed requests forever, with nothing to bring the latency back down
+	if(c.maxAcceptLatency > 0 && acceptsOutstanding_ > 0 && acceptLatency() >= c.maxAcceptLatency)
+		return ShedAcceptLatency;
+
+	return Admit;
+}
+
+void AdmissionController::sessionStarted(const QByteArray &routeId)
+{
+	++sessions_[routeId];
+}
+
+void AdmissionController::sessionFinished(const QByteArray &routeId)
+{
+	QHash<QByteArray, int>::iterator it = sessions_.find(routeId);
+	assert(it != sessions_.end());
+
+	if(--it.value() == 0)
+		sessions_.erase(it);
+}
+
+int AdmissionController::sessions(const QByteArray &routeId) const
+{
+	return sessions_.value(routeId);
+}
+
+void AdmissionController::acceptStarted()
+{
+	++acceptsOutstanding_;
+}
+
+void AdmissionController::acceptFinished(int latencyMs)
+{
+	assert(acceptsOutstanding_ > 0);
+	--acceptsOutstanding_;
+
+	if(latencyMs < 0)
+		return;
+
+	// ewma with a gain of 1/8, as for tcp rtt
+	if(haveLatency_)
+	{
+		acceptLatency_ += latencyMs - (acceptLatency_ >> 3);
+	}
+	else
+	{
+		acceptLatency_ = (qint64)latencyMs << 3;
+		haveLatency_ = true;
+	}
+}
+
+int AdmissionController::acceptLatency() const
+{
+	return (int)(acceptLatency_ >> 3);
+}
+
+const char *AdmissionController::decisionName(Decision d)
+{
+	switch(d)
+	{
+		case ShedConcurrency: return "route concurrency";
+		case ShedAccepts: return "handler accepts outstanding";
+		case ShedAcceptLatency: return "handler accept latency";
+		default: return "admit";
+	}
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef ADMISSIONCONTROLLER_H
+#define ADMISSIONCONTROLLER_H
+
+#include <QByteArray>
+#include <QHash>
+#include "domainmap.h"
+
+// decides whether new proxy sessions should be started or shed, based on
+// how backed up the handler and the route's origin are. the handler is
+// considered saturated when too many accepts are outstanding or they are
+// taking too long, and the origin when too many sessions are open on the
+// route. limits come from the route and apply per engine
+class AdmissionController
+{
+public:
+	enum Decision
+	{
+		Admit,
+		ShedConcurrency,
+		ShedAccepts,
+		ShedAcceptLatency
+	};
+
+	AdmissionController();
+
+	Decision check(const DomainMap::Entry &route) const;
+
+	void sessionStarted(const QByteArray &routeId);
+	void sessionFinished(const QByteArray &routeId);
+	int sessions(const QByteArray &routeId) const;
+
+	// latency is -1 if the accept was abandoned before a reply
+	void acceptStarted();
+	void acceptFinished(int latencyMs);
+	int acceptsOutstanding() const { return acceptsOutstanding_; }
+
+	// smoothed accept latency, in milliseconds
+	int acceptLatency() const;
+
+	static const char *decisionName(Decision d);
+
+private:
+	QHash<QByteArray, int> sessions_;
+	int acceptsOutstanding_;
+	qint64 acceptLatency_; // scaled by 8
+	bool haveLatency_;
+};
+
+#endif
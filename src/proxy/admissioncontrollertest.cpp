@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "test.h"
+#include "admissioncontroller.h"
+
+static DomainMap::Entry makeRoute(const QByteArray &id)
+{
+	DomainMap::Entry e;
+	e.id = id;
+	return e;
+}
+
+static void concurrency()
+{
+	AdmissionController ac;
+
+	DomainMap::Entry a = makeRoute("a");
+	a.shedConfig.maxConcurrency = 2;
+
+	DomainMap::Entry b = makeRoute("b");
+	b.shedConfig.maxConcurrency = 2;
+
+	TEST_ASSERT(ac.check(a) == AdmissionController::Admit);
+
+	ac.sessionStarted("a");
+	ac.sessionStarted("a");
+	TEST_ASSERT_EQ(ac.sessions("a"), 2);
+	TEST_ASSERT(ac.check(a) == AdmissionController::ShedConcurrency);
+
+	// other routes are unaffected
+	TEST_ASSERT(ac.check(b) == AdmissionController::Admit);
+
+	ac.sessionFinished("a");
+	TEST_ASSERT(ac.check(a) == AdmissionController::Admit);
+
+	ac.sessionFinished("a");
+	TEST_ASSERT_EQ(ac.sessions("a"), 0);
+}
+
+static void accepts()
+{
+	AdmissionController ac;
+
+	DomainMap::Entry a = makeRoute("a");
+	a.shedConfig.maxAccepts = 2;
+
+	// no limit on this route
+	DomainMap::Entry b = makeRoute("b");
+
+	ac.acceptStarted();
+	TEST_ASSERT(ac.check(a) == AdmissionController::Admit);
+
+	ac.acceptStarted();
+	TEST_ASSERT_EQ(ac.acceptsOutstanding(), 2);
+	TEST_ASSERT(ac.check(a) == AdmissionController::ShedAccepts);
+	TEST_ASSERT(ac.check(b) == AdmissionController::Admit);
+
+	// abandoned accepts still free up a slot
+	ac.acceptFinished(-1);
+	TEST_ASSERT(ac.check(a) == AdmissionController::Admit);
+
+	ac.acceptFinished(-1);
+	TEST_ASSERT_EQ(ac.acceptsOutstanding(), 0);
+
+	// and don't affect latency
+	TEST_ASSERT_EQ(ac.acceptLatency(), 0);
+}
+
+static void acceptLatency()
+{
+	AdmissionController ac;
+
+	DomainMap::Entry a = makeRoute("a");
+	a.shedConfig.maxAcceptLatency = 100;
+
+	// first sample is taken as is
+	ac.acceptStarted();
+	ac.acceptFinished(400);
+	TEST_ASSERT_EQ(ac.acceptLatency(), 400);
+
+	// nothing outstanding, so the latency isn't trusted
+	TEST_ASSERT(ac.check(a) == AdmissionController::Admit);
+
+	ac.acceptStarted();
+	TEST_ASSERT(ac.check(a) == AdmissionController::ShedAcceptLatency);
+
+	// fast replies bring it back down gradually
+	ac.acceptFinished(0);
+	TEST_ASSERT_EQ(ac.acceptLatency(), 350);
+
+	for(int n = 0; n < 20; ++n)
+	{
+		ac.acceptStarted();
+		ac.acceptFinished(0);
+	}
+
+	ac.acceptStarted();
+	TEST_ASSERT(ac.acceptLatency() < 100);
+	TEST_ASSERT(ac.check(a) == AdmissionController::Admit);
+	ac.acceptFinished(0);
+}
+
+extern "C" int admissioncontroller_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(concurrency());
+	TEST_CATCH(accepts());
+	TEST_CATCH(acceptLatency());
+
+	return 0;
+}
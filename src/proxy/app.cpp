@@ -33,15 +33,25 @@
 #include <QFileInfo>
 #include <QMutex>
 #include <QWaitCondition>
+#include "rust/bindings.h"
 #include "eventloop.h"
+#include "loopstats.h"
 #include "processquit.h"
+#include "filewatcher.h"
+#include "qzmqcontext.h"
+#include "qzmqsocket.h"
 #include "timer.h"
 #include "defercall.h"
 #include "log.h"
 #include "simplehttpserver.h"
 #include "settings.h"
+#include "cputopology.h"
 #include "xffrule.h"
 #include "domainmap.h"
+#include "targetbalancer.h"
+#include "flowwindow.h"
+#include "memorybudget.h"
+#include "statsreportaggregator.h"
 #include "engine.h"
 #include "config.h"
 
@@ -93,6 +103,14 @@ static QStringList suffixSpecs(const QStringList &l, int i)
 	return l;
 }
 
+// settings that Engine::reload() can apply to a running engine
+static void readReloadableSettings(const Settings &settings, Engine::Configuration *config)
+{
+	config->statsConnectionTtl = settings.value("global/stats_connection_ttl", 120).toInt();
+	config->statsConnectionsMaxTtl = settings.value("proxy/stats_connections_max_ttl", 60).toInt();
+	config->statsReportInterval = settings.value("proxy/stats_report_interval", 10).toInt();
+}
+
 enum CommandLineParseResult
 {
 	CommandLineOk,
@@ -228,6 +246,12 @@ public:
 			engine_->routesChanged();
 	}
 
+	void reload(const Engine::Configuration &config)
+	{
+		if(engine_)
+			engine_->reload(config);
+	}
+
 private:
 	Engine::Configuration config_;
 	std::unique_ptr<Engine> engine_;
@@ -242,12 +266,14 @@ public:
 	Engine::Configuration config;
 	DomainMap *domainMap;
 	bool newEventLoop;
+	QString cpus;
 	std::unique_ptr<EngineWorker> worker;
 
-	EngineThread(const Engine::Configuration &_config, DomainMap *_domainMap, bool _newEventLoop) :
+	EngineThread(const Engine::Configuration &_config, DomainMap *_domainMap, bool _newEventLoop, const QString &_cpus) :
 		config(_config),
 		domainMap(_domainMap),
-		newEventLoop(_newEventLoop)
+		newEventLoop(_newEventLoop),
+		cpus(_cpus)
 	{
 	}
 
@@ -264,6 +290,11 @@ public:
 		QMutexLocker locker(&m);
 
 		thread = std::thread([=] {
+			// pin before anything is allocated, so the thread's memory is
+			// local to its cpus
+			if(!cpus.isEmpty() && ffi::cpu_affinity_set_current_thread(cpus.toUtf8().data()) != 0)
+				log_warning("worker %d: failed to set cpu affinity to %s", config.id, qPrintable(cpus));
+
 #ifdef Q_OS_MAC
 			pthread_setname_np(name.toUtf8().data());
 #else
@@ -303,6 +334,19 @@ public:
 		}
 	}
 
+	void reload(const Engine::Configuration &config)
+	{
+		QMutexLocker locker(&m);
+
+		if(worker)
+		{
+			worker->deferCall.defer([=] {
+				// NOTE: called from worker thread
+				worker->reload(config);
+			});
+		}
+	}
+
 	void run()
 	{
 		// will unlock during exec
@@ -456,7 +500,11 @@ public:
 
 		QStringList services = settings.value("runner/services").toStringList();
 
-		int workerCount = settings.value("proxy/workers", 1).toInt();
+		QString workersStr = settings.value("proxy/workers").toString().trimmed();
+		int workerCount = CpuTopology::parseWorkers(workersStr);
+		QStringList workerCpus = settings.value("proxy/worker_cpus").toStringList();
+		trimlist(&workerCpus);
+		QString zmqIoCpus = settings.value("proxy/zmq_io_cpus").toStringList().join(",");
 		QStringList connmgr_in_specs = settings.value("proxy/connmgr_in_specs").toStringList();
 		trimlist(&connmgr_in_specs);
 		QStringList connmgr_in_stream_specs = settings.value("proxy/connmgr_in_stream_specs").toStringList();
@@ -530,6 +578,10 @@ public:
 		trimlist(&origHeadersNeedMarkStr);
 		bool acceptPushpinRoute = settings.value("proxy/accept_pushpin_route").toBool();
 		QByteArray cdnLoop = settings.value("proxy/cdn_loop").toString().toUtf8();
+		int traceSampleRate = settings.value("proxy/trace_sample_rate", 0).toInt();
+		bool acceptCompact = settings.value("proxy/accept_compact").toBool();
+		bool crossWorkerSharing = settings.value("proxy/cross_worker_sharing").toBool();
+		bool loadAwareIntake = settings.value("proxy/load_aware_intake").toBool();
 		bool logFrom = settings.value("proxy/log_from").toBool();
 		bool logUserAgent = settings.value("proxy/log_user_agent").toBool();
 		QByteArray sigIss = settings.value("proxy/sig_iss", "pushpin").toString().toUtf8();
@@ -540,12 +592,23 @@ public:
 		QString organizationName = settings.value("proxy/organization_name").toString();
 		int clientMaxconn = settings.value("runner/client_maxconn", 50000).toInt();
 		bool statsConnectionSend = settings.value("global/stats_connection_send", true).toBool();
-		int statsConnectionTtl = settings.value("global/stats_connection_ttl", 120).toInt();
-		int statsConnectionsMaxTtl = settings.value("proxy/stats_connections_max_ttl", 60).toInt();
-		int statsReportInterval = settings.value("proxy/stats_report_interval", 10).toInt();
+		QString statsFormat = settings.value("proxy/stats_format").toString();
 		QString prometheusPort = settings.value("proxy/prometheus_port").toString();
 		QString prometheusPrefix = settings.value("proxy/prometheus_prefix").toString();
 		bool newEventLoop = settings.value("proxy/new_event_loop", false).toBool();
+		int targetEjectFailures = settings.value("proxy/target_eject_failures", 0).toInt();
+		int targetEjectCooldown = settings.value("proxy/target_eject_cooldown", 10).toInt();
+		int streamMemoryBudget = settings.value("proxy/stream_memory_budget", 0).toInt();
+		bool zhttpTargetLazy = settings.value("proxy/zhttp_target_lazy", false).toBool();
+		int zhttpTargetIdleTimeout = settings.value("proxy/zhttp_target_idle_timeout", 0).toInt();
+		QStringList zhttpTargetSharedPrefixes = settings.value("proxy/zhttp_target_shared_prefixes").toStringList();
+		QString captureFile = settings.value("proxy/capture_file").toString();
+		bool logAsync = settings.value("global/log_async", false).toBool();
+		bool loopStats = settings.value("global/loop_stats", false).toBool();
+		int loopStatsSlowCallback = settings.value("global/loop_stats_slow_callback", 0).toInt();
+		bool ioUring = settings.value("global/io_uring", false).toBool();
+		bool zmqCompression = settings.value("global/zmq_compression", false).toBool();
+		int memoryBudget = settings.value("global/memory_budget", 0).toInt();
 
 		QList<QByteArray> origHeadersNeedMark;
 		foreach(const QString &s, origHeadersNeedMarkStr)
@@ -568,6 +631,17 @@ public:
 			return 1;
 		}
 
+		if(workerCount < 1)
+		{
+			log_error("invalid workers: %s", qPrintable(workersStr));
+			return 1;
+		}
+
+		// automatically sized workers are kept on one NUMA node each, unless
+		// cpus are given explicitly
+		if(workersStr == "auto" && workerCpus.isEmpty())
+			workerCpus = CpuTopology::autoWorkerCpus();
+
 		if(updatesCheck == "true")
 			updatesCheck = "check";
 
@@ -626,6 +700,10 @@ public:
 		config.origHeadersNeedMark = origHeadersNeedMark;
 		config.acceptPushpinRoute = acceptPushpinRoute;
 		config.cdnLoop = cdnLoop;
+		config.traceSampleRate = qBound(0, traceSampleRate, 100);
+		config.acceptCompact = acceptCompact;
+		config.crossWorkerSharing = (crossWorkerSharing && workerCount > 1);
+		config.loadAwareIntake = (loadAwareIntake && workerCount > 1);
 		config.logFrom = logFrom;
 		config.logUserAgent = logUserAgent;
 		config.sigIss = sigIss;
@@ -636,17 +714,44 @@ public:
 		config.organizationName = organizationName;
 		config.quietCheck = args.quietCheck;
 		config.statsConnectionSend = statsConnectionSend;
-		config.statsConnectionTtl = statsConnectionTtl;
-		config.statsConnectionsMaxTtl = statsConnectionsMaxTtl;
-		config.statsReportInterval = statsReportInterval;
+		readReloadableSettings(settings, &config);
+		config.statsFormat = statsFormat;
 		config.prometheusPort = prometheusPort;
 		config.prometheusPrefix = prometheusPrefix;
+		config.zhttpTargetLazy = zhttpTargetLazy;
+		config.zhttpTargetIdleTimeout = zhttpTargetIdleTimeout * 1000;
+		config.zhttpTargetSharedPrefixes = zhttpTargetSharedPrefixes;
+		config.captureFile = captureFile;
 
-		return runLoop(config, args.routeLines, routesFile, workerCount, newEventLoop);
+		if(logAsync)
+			log_setAsync(true);
+
+		// must be set before any event loops are created
+		LoopStats::setEnabled(loopStats && newEventLoop);
+		LoopStats::setSlowCallbackThreshold((qint64)loopStatsSlowCallback * 1000);
+		EventLoop::setIoUringEnabled(ioUring && newEventLoop);
+
+		// must be set before any sockets are set up
+		QZmq::Socket::setTcpCompressionEnabled(zmqCompression);
+
+		MemoryBudget::setBudget((qint64)memoryBudget * 1024 * 1024);
+
+		// shared by all engine threads, so set before any routes are loaded
+		TargetHealth::setEjectPolicy(targetEjectFailures, targetEjectCooldown * 1000);
+		FlowWindow::setMemoryBudget((qint64)streamMemoryBudget * 1024 * 1024);
+
+		// must be set before any zmq sockets are created
+		if(!QZmq::Context::setIoThreadCpus(zmqIoCpus))
+		{
+			log_error("invalid zmq_io_cpus: %s", qPrintable(zmqIoCpus));
+			return 1;
+		}
+
+		return runLoop(config, configFile, args.routeLines, routesFile, workerCount, workerCpus, newEventLoop);
 	}
 
 private:
-	static int runLoop(const Engine::Configuration &config, const QStringList &routeLines, const QString &routesFile, int workerCount, bool newEventLoop)
+	static int runLoop(const Engine::Configuration &config, const QString &configFile, const QStringList &routeLines, const QString &routesFile, int workerCount, const QStringList &workerCpus, bool newEventLoop)
 	{
 		// plenty for the main thread
 		int timersMax = 100;
@@ -657,8 +762,8 @@ private:
 		{
 			log_debug("using new event loop");
 
-			// for processquit
-			int socketNotifiersMax = 1;
+			// for processquit and the config file watcher
+			int socketNotifiersMax = 2;
 
 			int registrationsMax = timersMax + socketNotifiersMax;
 			loop = std::make_unique<EventLoop>(registrationsMax);
@@ -669,8 +774,18 @@ private:
 			Timer::init(timersMax);
 		}
 
+		std::unique_ptr<StatsReportAggregator> statsReportAggregator;
 		std::unique_ptr<DomainMap> domainMap;
 		std::list<EngineThread*> threads;
+		std::unique_ptr<FileWatcher> configWatcher;
+
+		auto reloadSettings = [&] {
+			Engine::Configuration newConfig = config;
+			readReloadableSettings(Settings(configFile), &newConfig);
+
+			for(EngineThread *t : threads)
+				t->reload(newConfig);
+		};
 
 		DeferCall deferCall;
 		deferCall.defer([&] {
@@ -702,6 +817,8 @@ private:
 
 				threads.clear();
 
+				configWatcher.reset();
+
 				log_debug("stopped");
 
 				if(newEventLoop)
@@ -714,8 +831,14 @@ private:
 				log_info("reloading");
 				log_rotate();
 				domainMap->reload();
+				reloadSettings();
 			});
 
+			// workers hand their reports to the first worker, which sends one
+			// report per route for the whole process
+			if(workerCount > 1)
+				statsReportAggregator = std::make_unique<StatsReportAggregator>();
+
 			for(int n = 0; n < workerCount; ++n)
 			{
 				Engine::Configuration wconfig = config;
@@ -736,9 +859,16 @@ private:
 					wconfig.intServerInSpecs = suffixSpecs(wconfig.intServerInSpecs, n);
 					wconfig.intServerInStreamSpecs = suffixSpecs(wconfig.intServerInStreamSpecs, n);
 					wconfig.intServerOutSpecs = suffixSpecs(wconfig.intServerOutSpecs, n);
+					wconfig.statsReportAggregator = statsReportAggregator.get();
+
+					if(!wconfig.captureFile.isEmpty())
+						wconfig.captureFile += '-' + QString::number(n);
 				}
 
-				EngineThread *t = new EngineThread(wconfig, domainMap.get(), newEventLoop);
+				// workers take the cpu sets in turn
+				QString cpus = !workerCpus.isEmpty() ? workerCpus[n % workerCpus.count()] : QString();
+
+				EngineThread *t = new EngineThread(wconfig, domainMap.get(), newEventLoop, cpus);
 				if(!t->start())
 				{
 					delete t;
@@ -759,6 +889,20 @@ private:
 				threads.push_back(t);
 			}
 
+			configWatcher = std::make_unique<FileWatcher>();
+			if(configWatcher->start(configFile))
+			{
+				configWatcher->fileChanged.connect([&] {
+					log_info("config file changed, reloading");
+					reloadSettings();
+				});
+			}
+			else
+			{
+				log_warning("unable to watch config file: %s", qPrintable(configFile));
+				configWatcher.reset();
+			}
+
 			log_info("started");
 		});
 
@@ -791,5 +935,10 @@ App::~App() = default;
 
 int App::run()
 {
-	return Private::run();
+	int ret = Private::run();
+
+	// flush any queued log records
+	log_setAsync(false);
+
+	return ret;
 }
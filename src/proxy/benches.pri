@@ -0,0 +1,3 @@
+SOURCES += \
+	$$PWD/domainmapbench.cpp \
+	$$PWD/proxyenginebench.cpp
@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "cachedhttprequest.h"
+
+#include <assert.h>
+#include "defercall.h"
+#include "bufferlist.h"
+
+#define DISCARD_WRITE_SIZE 100000
+
+class CachedHttpRequest::Private
+{
+public:
+	CachedHttpRequest *q;
+	std::shared_ptr<const ResponseCache::Item> item;
+	bool started;
+	bool responded;
+	bool outputFinished;
+	QString method;
+	QUrl uri;
+	HttpHeaders headers;
+	BufferList responseBody;
+	DeferCall deferCall;
+
+	Private(CachedHttpRequest *_q, const std::shared_ptr<const ResponseCache::Item> &_item) :
+		q(_q),
+		item(_item),
+		started(false),
+		responded(false),
+		outputFinished(false)
+	{
+	}
+
+	void respond()
+	{
+		// HEAD responses have no body, even if the cached one for GET did
+		if(method != "HEAD")
+			responseBody += item->body;
+
+		responded = true;
+		q->readyRead();
+	}
+};
+
+CachedHttpRequest::CachedHttpRequest(const std::shared_ptr<const ResponseCache::Item> &item)
+{
+	d = new Private(this, item);
+}
+
+CachedHttpRequest::~CachedHttpRequest()
+{
+	delete d;
+}
+
+QHostAddress CachedHttpRequest::peerAddress() const
+{
+	// this class is client only
+	return QHostAddress();
+}
+
+void CachedHttpRequest::setConnectHost(const QString &host)
+{
+	Q_UNUSED(host);
+}
+
+void CachedHttpRequest::setConnectPort(int port)
+{
+	Q_UNUSED(port);
+}
+
+void CachedHttpRequest::setIgnorePolicies(bool on)
+{
+	Q_UNUSED(on);
+}
+
+void CachedHttpRequest::setTrustConnectHost(bool on)
+{
+	Q_UNUSED(on);
+}
+
+void CachedHttpRequest::setIgnoreTlsErrors(bool on)
+{
+	Q_UNUSED(on);
+}
+
+void CachedHttpRequest::setTimeout(int msecs)
+{
+	Q_UNUSED(msecs);
+}
+
+void CachedHttpRequest::start(const QString &method, const QUrl &uri, const HttpHeaders &headers)
+{
+	assert(!d->started);
+
+	d->started = true;
+	d->method = method;
+	d->uri = uri;
+	d->headers = headers;
+
+	// the response doesn't depend on the request body, so don't wait for it
+	d->deferCall.defer([=] { d->respond(); });
+}
+
+void CachedHttpRequest::beginResponse(int code, const QByteArray &reason, const HttpHeaders &headers)
+{
+	Q_UNUSED(code);
+	Q_UNUSED(reason);
+	Q_UNUSED(headers);
+
+	// this class is client only
+	assert(0);
+}
+
+void CachedHttpRequest::writeBody(const QByteArray &body)
+{
+	Q_UNUSED(body);
+}
+
+void CachedHttpRequest::endBody()
+{
+	d->outputFinished = true;
+}
+
+int CachedHttpRequest::bytesAvailable() const
+{
+	return d->responseBody.size();
+}
+
+int CachedHttpRequest::writeBytesAvailable() const
+{
+	// writes are discarded, so there is always room
+	return DISCARD_WRITE_SIZE;
+}
+
+bool CachedHttpRequest::isFinished() const
+{
+	return d->responded;
+}
+
+bool CachedHttpRequest::isInputFinished() const
+{
+	return d->responded;
+}
+
+bool CachedHttpRequest::isOutputFinished() const
+{
+	return d->outputFinished;
+}
+
+bool CachedHttpRequest::isErrored() const
+{
+	// this class can't fail
+	return false;
+}
+
+HttpRequest::ErrorCondition CachedHttpRequest::errorCondition() const
+{
+	return ErrorGeneric;
+}
+
+QString CachedHttpRequest::requestMethod() const
+{
+	return d->method;
+}
+
+QUrl CachedHttpRequest::requestUri() const
+{
+	return d->uri;
+}
+
+HttpHeaders CachedHttpRequest::requestHeaders() const
+{
+	return d->headers;
+}
+
+int CachedHttpRequest::responseCode() const
+{
+	return d->item->code;
+}
+
+QByteArray CachedHttpRequest::responseReason() const
+{
+	return d->item->reason;
+}
+
+HttpHeaders CachedHttpRequest::responseHeaders() const
+{
+	return d->item->headers;
+}
+
+QByteArray CachedHttpRequest::readBody(int size)
+{
+	return d->responseBody.take(size);
+}
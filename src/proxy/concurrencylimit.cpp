@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "concurrencylimit.h"
+
+#include <assert.h>
+#include <QHash>
+#include "latencyhistogram.h"
+#include "statsmanager.h"
+
+static QMutex g_limitsMutex;
+static QHash< QString, std::weak_ptr<ConcurrencyLimit> > g_limitsByKey;
+static int g_limitsPruneAt = 64;
+
+static std::atomic<qint64> g_queued(0);
+static std::atomic<quint64> g_rejected(0);
+static std::atomic<quint64> g_abandoned(0);
+static LatencyHistogram g_waitTime;
+
+ConcurrencyLimit::Ticket::Ticket(const std::function<void ()> &granted) :
+	grantedHandler_(granted),
+	queued_(false),
+	granted_(false),
+	queuedAt_(0),
+	prev_(0),
+	next_(0)
+{
+}
+
+ConcurrencyLimit::Ticket::~Ticket()
+{
+	if(!limit_)
+		return;
+
+	QMutexLocker locker(&limit_->mutex_);
+
+	if(queued_)
+	{
+		if(prev_)
+			prev_->next_ = next_;
+		else
+			limit_->first_ = next_;
+
+		if(next_)
+			next_->prev_ = prev_;
+		else
+			limit_->last_ = prev_;
+
+		--limit_->queued_;
+		--g_queued;
+		++g_abandoned;
+	}
+	else if(granted_)
+	{
+		limit_->release();
+	}
+}
+
+ConcurrencyLimit::Result ConcurrencyLimit::Ticket::acquire(const std::shared_ptr<ConcurrencyLimit> &limit)
+{
+	assert(!limit_);
+
+	QMutexLocker locker(&limit->mutex_);
+
+	// don't jump the queue
+	if(!limit->first_ && (limit->maxInFlight_ <= 0 || limit->inFlight_ < limit->maxInFlight_))
+	{
+		++limit->inFlight_;
+
+		limit_ = limit;
+		granted_ = true;
+
+		return Granted;
+	}
+
+	if(limit->queued_ >= limit->maxQueued_)
+	{
+		++g_rejected;
+
+		return Rejected;
+	}
+
+	limit_ = limit;
+	queued_ = true;
+	queuedAt_ = LatencyHistogram::now();
+
+	prev_ = limit->last_;
+	next_ = 0;
+
+	if(limit->last_)
+		limit->last_->next_ = this;
+	else
+		limit->first_ = this;
+
+	limit->last_ = this;
+
+	++limit->queued_;
+	++g_queued;
+
+	return Queued;
+}
+
+void ConcurrencyLimit::Ticket::granted()
+{
+	// may delete the ticket
+	grantedHandler_();
+}
+
+ConcurrencyLimit::ConcurrencyLimit() :
+	maxInFlight_(0),
+	maxQueued_(0),
+	inFlight_(0),
+	queued_(0),
+	first_(0),
+	last_(0)
+{
+}
+
+std::shared_ptr<ConcurrencyLimit> ConcurrencyLimit::get(const QString &key)
+{
+	QMutexLocker locker(&g_limitsMutex);
+
+	std::shared_ptr<ConcurrencyLimit> l = g_limitsByKey.value(key).lock();
+	if(l)
+		return l;
+
+	// see TargetHealth::get
+	if(g_limitsByKey.count() >= g_limitsPruneAt)
+	{
+		QMutableHashIterator< QString, std::weak_ptr<ConcurrencyLimit> > it(g_limitsByKey);
+		while(it.hasNext())
+		{
+			it.next();
+			if(it.value().expired())
+				it.remove();
+		}
+
+		g_limitsPruneAt = qMax(64, g_limitsByKey.count() * 2);
+	}
+
+	l = std::shared_ptr<ConcurrencyLimit>(new ConcurrencyLimit);
+	g_limitsByKey.insert(key, l);
+
+	return l;
+}
+
+void ConcurrencyLimit::setLimits(int maxInFlight, int maxQueued)
+{
+	QMutexLocker locker(&mutex_);
+
+	maxInFlight_ = maxInFlight;
+	maxQueued_ = maxQueued;
+
+	grantQueued();
+}
+
+int ConcurrencyLimit::inFlight() const
+{
+	QMutexLocker locker(&mutex_);
+
+	return inFlight_;
+}
+
+int ConcurrencyLimit::queued() const
+{
+	QMutexLocker locker(&mutex_);
+
+	return queued_;
+}
+
+void ConcurrencyLimit::addToPrometheus(StatsManager *stats, const QString &labels)
+{
+	stats->addPrometheusGauge("proxy_limit_queued", "Requests waiting for a route or target concurrency slot", labels, &g_queued);
+	stats->addPrometheusCounter("proxy_limit_rejected_total", "Requests rejected because a concurrency queue was full", labels, &g_rejected);
+	stats->addPrometheusCounter("proxy_limit_abandoned_total", "Requests that left a concurrency queue before getting a slot", labels, &g_abandoned);
+	stats->addPrometheusHistogram("proxy_limit_wait_seconds", "Time spent waiting for a concurrency slot", labels, &g_waitTime);
+}
+
+void ConcurrencyLimit::grantQueued()
+{
+	while(first_ && (maxInFlight_ <= 0 || inFlight_ < maxInFlight_))
+	{
+		Ticket *t = first_;
+
+		first_ = t->next_;
+		if(first_)
+			first_->prev_ = 0;
+		else
+			last_ = 0;
+
+		t->prev_ = 0;
+		t->next_ = 0;
+		t->queued_ = false;
+		t->granted_ = true;
+
+		++inFlight_;
+		--queued_;
+		--g_queued;
+
+		g_waitTime.record(LatencyHistogram::now() - t->queuedAt_);
+
+		// the ticket can't be destroyed while the lock is held, and any
+		// call still pending when it is gets dropped
+		t->deferCall_.defer([=] { t->granted(); });
+	}
+}
+
+void ConcurrencyLimit::release()
+{
+	assert(inFlight_ > 0);
+	--inFlight_;
+
+	grantQueued();
+}
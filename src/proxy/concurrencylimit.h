@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef CONCURRENCYLIMIT_H
+#define CONCURRENCYLIMIT_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <QString>
+#include <QMutex>
+#include "defercall.h"
+
+class StatsManager;
+
+// bounds the number of requests in flight to a route or target, with a
+// fifo queue for requests waiting on a slot. there is one instance per
+// key, shared by all threads
+class ConcurrencyLimit
+{
+public:
+	enum Result
+	{
+		Granted,
+		Queued,
+		Rejected // queue full
+	};
+
+	// a request's claim on a slot. it is either waiting in the queue or
+	// holding a slot, and gives up either one when destroyed
+	class Ticket
+	{
+	public:
+		// granted is called from the ticket's thread when a queued ticket
+		// gets a slot
+		Ticket(const std::function<void ()> &granted);
+		~Ticket();
+
+		Result acquire(const std::shared_ptr<ConcurrencyLimit> &limit);
+
+	private:
+		friend class ConcurrencyLimit;
+
+		std::shared_ptr<ConcurrencyLimit> limit_;
+		std::function<void ()> grantedHandler_;
+		bool queued_;
+		bool granted_;
+		qint64 queuedAt_;
+		Ticket *prev_;
+		Ticket *next_;
+		DeferCall deferCall_;
+
+		void granted();
+	};
+
+	// returns the instance for key, creating it if necessary
+	static std::shared_ptr<ConcurrencyLimit> get(const QString &key);
+
+	// takes effect for new requests. raising the limit lets queued
+	// requests through
+	void setLimits(int maxInFlight, int maxQueued);
+
+	int inFlight() const;
+	int queued() const;
+
+	// totals across all instances
+	static void addToPrometheus(StatsManager *stats, const QString &labels);
+
+private:
+	mutable QMutex mutex_;
+	int maxInFlight_;
+	int maxQueued_;
+	int inFlight_;
+	int queued_;
+	Ticket *first_;
+	Ticket *last_;
+
+	ConcurrencyLimit();
+
+	// call with lock held
+	void grantQueued();
+	void release();
+};
+
+#endif
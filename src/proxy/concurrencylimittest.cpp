@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "test.h"
+#include "eventloop.h"
+#include "defercall.h"
+#include "concurrencylimit.h"
+
+static void limit()
+{
+	EventLoop loop(10);
+
+	{
+		std::shared_ptr<ConcurrencyLimit> l = ConcurrencyLimit::get("test/limit");
+		l->setLimits(2, 1);
+
+		// same instance by key
+		TEST_ASSERT(ConcurrencyLimit::get("test/limit") == l);
+
+		int grants = 0;
+
+		auto a = std::make_unique<ConcurrencyLimit::Ticket>([&] { ++grants; });
+		auto b = std::make_unique<ConcurrencyLimit::Ticket>([&] { ++grants; });
+		auto c = std::make_unique<ConcurrencyLimit::Ticket>([&] { ++grants; });
+		auto d = std::make_unique<ConcurrencyLimit::Ticket>([&] { ++grants; });
+
+		TEST_ASSERT(a->acquire(l) == ConcurrencyLimit::Granted);
+		TEST_ASSERT(b->acquire(l) == ConcurrencyLimit::Granted);
+		TEST_ASSERT(c->acquire(l) == ConcurrencyLimit::Queued);
+		TEST_ASSERT(d->acquire(l) == ConcurrencyLimit::Rejected);
+		TEST_ASSERT_EQ(l->inFlight(), 2);
+		TEST_ASSERT_EQ(l->queued(), 1);
+
+		// a rejected ticket holds nothing
+		d.reset();
+		TEST_ASSERT_EQ(l->inFlight(), 2);
+
+		// the slot passes to the queued ticket, which is told later
+		a.reset();
+		TEST_ASSERT_EQ(l->inFlight(), 2);
+		TEST_ASSERT_EQ(l->queued(), 0);
+		TEST_ASSERT_EQ(grants, 0);
+
+		loop.step();
+		TEST_ASSERT_EQ(grants, 1);
+
+		b.reset();
+		c.reset();
+		TEST_ASSERT_EQ(l->inFlight(), 0);
+	}
+
+	DeferCall::cleanup();
+}
+
+static void cancel()
+{
+	EventLoop loop(10);
+
+	{
+		std::shared_ptr<ConcurrencyLimit> l = ConcurrencyLimit::get("test/cancel");
+		l->setLimits(1, 2);
+
+		int grants = 0;
+
+		auto a = std::make_unique<ConcurrencyLimit::Ticket>([&] { ++grants; });
+		auto b = std::make_unique<ConcurrencyLimit::Ticket>([&] { ++grants; });
+		auto c = std::make_unique<ConcurrencyLimit::Ticket>([&] { ++grants; });
+
+		TEST_ASSERT(a->acquire(l) == ConcurrencyLimit::Granted);
+		TEST_ASSERT(b->acquire(l) == ConcurrencyLimit::Queued);
+		TEST_ASSERT(c->acquire(l) == ConcurrencyLimit::Queued);
+
+		// leaving the queue lets the next one move up
+		b.reset();
+		TEST_ASSERT_EQ(l->queued(), 1);
+
+		a.reset();
+		TEST_ASSERT_EQ(l->queued(), 0);
+
+		// a granted ticket destroyed before being told still gives up
+		// its slot, and isn't told
+		c.reset();
+		TEST_ASSERT_EQ(l->inFlight(), 0);
+
+		loop.step();
+		TEST_ASSERT_EQ(grants, 0);
+
+		auto x = std::make_unique<ConcurrencyLimit::Ticket>([&] { ++grants; });
+		auto y = std::make_unique<ConcurrencyLimit::Ticket>([&] { ++grants; });
+
+		TEST_ASSERT(x->acquire(l) == ConcurrencyLimit::Granted);
+		TEST_ASSERT(y->acquire(l) == ConcurrencyLimit::Queued);
+
+		// raising the limit lets queued tickets through
+		l->setLimits(2, 2);
+		TEST_ASSERT_EQ(l->inFlight(), 2);
+
+		loop.step();
+		TEST_ASSERT_EQ(grants, 1);
+	}
+
+	DeferCall::cleanup();
+}
+
+extern "C" int concurrencylimit_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(limit());
+	TEST_CATCH(cancel());
+
+	return 0;
+}
@@ -24,15 +24,24 @@
 #include "domainmap.h"
 
 #include <assert.h>
+#include <atomic>
+#include <memory>
+#include <optional>
 #include <thread>
+#include <vector>
+#include <algorithm>
 #include <pthread.h>
 #include <QStringList>
 #include <QHash>
+#include <QSet>
+#include <QVarLengthArray>
 #include <QMutex>
 #include <QWaitCondition>
 #include <QFile>
 #include <QDir>
 #include <QTextStream>
+#include <QThread>
+#include <QCryptographicHash>
 #include <QCoreApplication>
 #include "log.h"
 #include "timer.h"
@@ -40,10 +49,19 @@
 #include "eventloop.h"
 #include "filewatcher.h"
 #include "routesfile.h"
+#include "pathtrie.h"
+#include "targetbalancer.h"
+#include "concurrencylimit.h"
 
 #define WORKER_THREAD_TIMERS 10
 #define WORKER_THREAD_SOCKETNOTIFIERS 1
 
+// routes files with fewer lines than this per thread are parsed serially
+#define PARSE_THREAD_LINES_MIN 2000
+
+// shared by all maps, so a generation is never reused
+static std::atomic<quint64> g_nextGeneration(1);
+
 class DomainMap::Worker
 {
 public:
@@ -80,8 +98,15 @@ public:
 		QByteArray sockJsAsPath;
 		HttpHeaders headers;
 		bool grip;
+		bool cacheResponses;
+		bool compressPublished;
 		QList<Target> targets;
+		std::shared_ptr<TargetBalancer> balancer;
+		ShedConfig shedConfig;
+		std::shared_ptr<ConcurrencyLimit> limit;
+		int queueTimeout;
 		int logLevel;
+		std::shared_ptr<const Entry> entry; // set when added to a table
 
 		Rule() :
 			proto(-1),
@@ -93,6 +118,9 @@ public:
 			autoCrossOrigin(false),
 			session(false),
 			grip(true),
+			cacheResponses(false),
+			compressPublished(false),
+			queueTimeout(DEFAULT_QUEUE_TIMEOUT),
 			logLevel(LOG_LEVEL_DEBUG)
 		{
 		}
@@ -194,22 +222,152 @@ public:
 			e.separateStats = explicitId;
 			e.grip = grip;
 			e.targets = targets;
+			e.cacheResponses = cacheResponses;
+			e.compressPublished = compressPublished;
+			e.balancer = balancer;
+			e.shedConfig = shedConfig;
+			e.limit = limit;
+			e.queueTimeout = queueTimeout;
 			e.logLevel = logLevel;
 			return e;
 		}
 	};
 
-	QMutex m;
+	// a domain's rules compiled for lookup. each trie holds the indexes of
+	// the rules that can apply to one combination of request protocol and
+	// ssl, keyed on path_beg
+	class DomainRoutes
+	{
+	public:
+		QList<Rule> rules;
+		PathTrie<int> tries[4];
+
+		static int trieIndex(Protocol reqProto, bool reqSsl)
+		{
+			return (reqProto == WebSocket ? 2 : 0) + (reqSsl ? 1 : 0);
+		}
+	};
+
+	// immutable once published. lookups read the current table without
+	// locking, and a replaced table is freed once no thread refers to it
+	class Table
+	{
+	public:
+		QList<Rule> allRules;
+		QHash< QString, QList<Rule> > rulesByDomain;
+		QHash<QString, Rule> rulesById;
+		QHash< QString, std::shared_ptr<const DomainRoutes> > routesByDomain;
+	};
+
+	// each thread keeps a reference to the table it last used, and only
+	// takes the lock to refresh it when the generation changes
+	class ReaderCache
+	{
+	public:
+		const Worker *worker;
+		quint64 generation;
+		std::shared_ptr<const Table> table;
+
+		ReaderCache() :
+			worker(0),
+			generation(0)
+		{
+		}
+	};
+
+	// signing keys parsed by earlier loads. file keys are cached by path and
+	// content, so only new or changed key files are parsed again. safe to
+	// use from the parsing threads
+	class KeyCache
+	{
+	public:
+		Jwt::EncodingKey get(const QString &configString, const QDir &baseDir)
+		{
+			QByteArray cacheKey;
+			QByteArray fileData;
+			bool isFile = configString.startsWith("file:");
+
+			if(isFile)
+			{
+				QString keyFile = configString.mid(5);
+				if(QFileInfo(keyFile).isRelative())
+					keyFile = QFileInfo(baseDir, keyFile).filePath();
+
+				QFile f(keyFile);
+				if(!f.open(QFile::ReadOnly))
+					return Jwt::EncodingKey();
+
+				fileData = f.readAll();
+
+				cacheKey = "file:" + keyFile.toUtf8() + ':' + QCryptographicHash::hash(fileData, QCryptographicHash::Sha1).toHex();
+			}
+			else
+			{
+				cacheKey = configString.toUtf8();
+			}
+
+			{
+				QMutexLocker locker(&m_);
+
+				auto it = keys_.constFind(cacheKey);
+				if(it != keys_.constEnd())
+				{
+					used_.insert(cacheKey);
+					return it.value();
+				}
+			}
+
+			Jwt::EncodingKey key;
+			if(isFile)
+				key = Jwt::EncodingKey::fromFileData(fileData);
+			else
+				key = Jwt::EncodingKey::fromConfigString(configString, baseDir);
+
+			QMutexLocker locker(&m_);
+
+			keys_.insert(cacheKey, key);
+			used_.insert(cacheKey);
+
+			return key;
+		}
+
+		// drops the keys not used since the previous call
+		void prune()
+		{
+			QMutexLocker locker(&m_);
+
+			auto it = keys_.begin();
+			while(it != keys_.end())
+			{
+				if(!used_.contains(it.key()))
+					it = keys_.erase(it);
+				else
+					++it;
+			}
+
+			used_.clear();
+		}
+
+	private:
+		QMutex m_;
+		QHash<QByteArray, Jwt::EncodingKey> keys_;
+		QSet<QByteArray> used_;
+	};
+
+	// guards table and serializes writers
+	mutable QMutex m;
+	std::shared_ptr<const Table> table;
+	std::atomic<quint64> generation;
 	QString fileName;
-	QList<Rule> allRules;
-	QHash< QString, QList<Rule> > rulesByDomain;
-	QHash<QString, Rule> rulesById;
 	Timer t;
 	Connection tConnection;
 	FileWatcher watcher;
+	KeyCache keyCache;
 	DeferCall deferCall;
 
-	Worker()
+	Worker() :
+		table(std::make_shared<Table>()),
+		generation(g_nextGeneration++)
 	{
 		tConnection = t.timeout.connect(boost::bind(&Worker::doReload, this));
 		t.setSingleShot(true);
@@ -224,24 +382,34 @@ public:
 			return;
 		}
 
-		QDir fileDir = QFileInfo(fileName).absoluteDir();
+		QString fileDirPath = QFileInfo(fileName).absoluteDir().absolutePath();
+
+		QStringList lines;
+		QTextStream ts(&file);
+		while(!ts.atEnd())
+			lines += ts.readLine();
+
+		std::vector<std::optional<Rule>> parsed = parseLines(lines, fileName, fileDirPath, &keyCache);
+
+		keyCache.prune();
 
 		QList<Rule> all;
 		QHash< QString, QList<Rule> > domainMap;
 		QHash<QString, Rule> idMap;
 
-		QTextStream ts(&file);
-		for(int lineNum = 1; !ts.atEnd(); ++lineNum)
+		// rules are added in file order, so duplicates resolve the same way
+		// regardless of how the parsing was split up
+		for(int n = 0; n < (int)parsed.size(); ++n)
 		{
-			QString line = ts.readLine();
-
-			Rule r;
-			if(!parseRouteLine(line, fileName, lineNum, fileDir, &r))
+			if(!parsed[n])
 			{
 				// parseRouteLine will have logged a message if needed
 				continue;
 			}
 
+			int lineNum = n + 1;
+			Rule &r = *parsed[n];
+
 			if(r.id.isEmpty())
 				r.id = r.idFromCondition();
 
@@ -285,31 +453,101 @@ public:
 			}
 		}
 
-		// atomically replace the map
-		m.lock();
-		allRules = all;
-		rulesByDomain = domainMap;
-		rulesById = idMap;
-		m.unlock();
+		auto newTable = std::make_shared<Table>();
+		newTable->allRules = all;
+		newTable->rulesByDomain = domainMap;
+		newTable->rulesById = idMap;
+
+		foreach(const QString &domain, domainMap.keys())
+			compileDomain(newTable.get(), domain);
+
+		publish(newTable);
 
-		log_info("routes loaded with %d entries", allRules.count());
+		log_info("routes loaded with %d entries", all.count());
 
 		deferCall.defer([=] { doChanged(); });
 	}
 
-	// mutex must be locked when calling this method
 	bool addRouteLine(const QString &line)
 	{
 		Rule r;
-		if(!parseRouteLine(line, "<route>", 1, QDir::current(), &r))
+		if(!parseRouteLine(line, "<route>", 1, QDir::current(), &keyCache, &r))
 			return false;
 
-		if(addRule(r, &allRules, &rulesByDomain, &rulesById) != AddRuleOk)
+		QMutexLocker locker(&m);
+
+		// copy on write. the containers are implicitly shared, so only
+		// the parts that change are duplicated
+		auto newTable = std::make_shared<Table>(*table);
+
+		if(addRule(r, &newTable->allRules, &newTable->rulesByDomain, &newTable->rulesById) != AddRuleOk)
 			return false;
 
+		if(!r.domain.isNull())
+			compileDomain(newTable.get(), r.domain);
+
+		table = newTable;
+		generation.store(g_nextGeneration++, std::memory_order_release);
+
 		return true;
 	}
 
+	static void compileDomain(Table *t, const QString &domain)
+	{
+		auto routes = std::make_shared<DomainRoutes>();
+		routes->rules = t->rulesByDomain.value(domain);
+
+		for(int n = 0; n < routes->rules.count(); ++n)
+		{
+			const Rule &r = routes->rules[n];
+
+			for(int proto = 0; proto < 2; ++proto)
+			{
+				Protocol reqProto = (proto == 1 ? WebSocket : Http);
+				if(r.proto != -1 && !r.matchProto(reqProto))
+					continue;
+
+				for(int ssl = 0; ssl < 2; ++ssl)
+				{
+					if(r.ssl != -1 && !r.matchSsl(ssl == 1))
+						continue;
+
+					routes->tries[DomainRoutes::trieIndex(reqProto, ssl == 1)].insert(r.pathBeg, n);
+				}
+			}
+		}
+
+		t->routesByDomain.insert(domain, routes);
+	}
+
+	void publish(const std::shared_ptr<const Table> &newTable)
+	{
+		QMutexLocker locker(&m);
+
+		table = newTable;
+		generation.store(g_nextGeneration++, std::memory_order_release);
+	}
+
+	// the returned table remains valid until the calling thread next calls
+	// this method
+	const Table *snapshot() const
+	{
+		static thread_local ReaderCache cache;
+
+		quint64 current = generation.load(std::memory_order_acquire);
+
+		if(cache.worker != this || cache.generation != current)
+		{
+			QMutexLocker locker(&m);
+
+			cache.worker = this;
+			cache.generation = generation.load(std::memory_order_relaxed);
+			cache.table = table;
+		}
+
+		return cache.table.get();
+	}
+
 	Signal started;
 	Signal changed;
 
@@ -346,7 +584,91 @@ public:
 	}
 
 private:
-	static bool parseRouteLine(const QString &line, const QString &fileName, int lineNum, const QDir &fileDir, Rule *rule)
+	// large files are split into contiguous ranges that are parsed on
+	// separate threads. lines that don't produce a rule are left empty
+	static std::vector<std::optional<Rule>> parseLines(const QStringList &lines, const QString &fileName, const QString &fileDirPath, KeyCache *keys)
+	{
+		std::vector<std::optional<Rule>> out(lines.count());
+
+		auto parseRange = [&](int start, int end) {
+			// QDir isn't safe to share between threads, so each range gets
+			// its own
+			QDir fileDir(fileDirPath);
+
+			for(int n = start; n < end; ++n)
+			{
+				Rule r;
+				if(parseRouteLine(lines[n], fileName, n + 1, fileDir, keys, &r))
+					out[n] = std::move(r);
+			}
+		};
+
+		int threadCount = qBound(1, (int)lines.count() / PARSE_THREAD_LINES_MIN, QThread::idealThreadCount());
+
+		if(threadCount == 1)
+		{
+			parseRange(0, lines.count());
+			return out;
+		}
+
+		int perThread = (lines.count() + threadCount - 1) / threadCount;
+
+		// the calling thread parses the first range
+		std::vector<std::thread> threads;
+		for(int n = 1; n < threadCount; ++n)
+		{
+			int start = n * perThread;
+			int end = qMin(start + perThread, (int)lines.count());
+
+			threads.emplace_back([=, &parseRange] { parseRange(start, end); });
+		}
+
+		parseRange(0, qMin(perThread, (int)lines.count()));
+
+		for(std::thread &t : threads)
+			t.join();
+
+		log_debug("parsed %d route lines using %d threads", (int)lines.count(), threadCount);
+
+		return out;
+	}
+
+	// the queue defaults to the size of the limit
+	static bool parseLimits(const QMultiHash<QString, QString> &props, int *maxInFlight, int *maxQueued, const QString &fileName, int lineNum)
+	{
+		if(props.contains("max_in_flight"))
+		{
+			bool ok_;
+			int x = props.value("max_in_flight").toInt(&ok_);
+			if(!ok_ || x < 1)
+			{
+				log_warning("%s:%d: invalid max_in_flight", qPrintable(fileName), lineNum);
+				return false;
+			}
+
+			*maxInFlight = x;
+		}
+
+		if(props.contains("max_queued"))
+		{
+			bool ok_;
+			int x = props.value("max_queued").toInt(&ok_);
+			if(!ok_ || x < 0)
+			{
+				log_warning("%s:%d: invalid max_queued", qPrintable(fileName), lineNum);
+				return false;
+			}
+
+			*maxQueued = x;
+		}
+
+		if(*maxQueued < 0)
+			*maxQueued = *maxInFlight;
+
+		return true;
+	}
+
+	static bool parseRouteLine(const QString &line, const QString &fileName, int lineNum, const QDir &fileDir, KeyCache *keys, Rule *rule)
 	{
 		bool ok;
 		QString errmsg;
@@ -436,7 +758,7 @@ private:
 
 		if(props.contains("sig_key"))
 		{
-			r.sigKey = Jwt::EncodingKey::fromConfigString(props.value("sig_key"), fileDir);
+			r.sigKey = keys->get(props.value("sig_key"), fileDir);
 		}
 
 		if(props.contains("prefix"))
@@ -541,11 +863,74 @@ private:
 		if(props.contains("no_grip"))
 			r.grip = false;
 
+		if(props.contains("cache"))
+			r.cacheResponses = true;
+
+		if(props.contains("publish_compress"))
+			r.compressPublished = true;
+
 		if(props.contains("log_level"))
 		{
 			r.logLevel = props.value("log_level").toInt();
 		}
 
+		TargetBalancer::Strategy balance = TargetBalancer::Ordered;
+		if(props.contains("balance"))
+		{
+			val = props.value("balance");
+			if(val == "ordered")
+				balance = TargetBalancer::Ordered;
+			else if(val == "round_robin")
+				balance = TargetBalancer::RoundRobin;
+			else if(val == "least_requests")
+				balance = TargetBalancer::LeastRequests;
+			else if(val == "p2c")
+				balance = TargetBalancer::PowerOfTwo;
+			else
+			{
+				log_warning("%s:%d: balance must be set to 'ordered', 'round_robin', 'least_requests', or 'p2c'", qPrintable(fileName), lineNum);
+				return false;
+			}
+		}
+
+		r.balancer = std::make_shared<TargetBalancer>(balance);
+
+		const char *shedProps[] = { "shed_concurrency", "shed_accepts", "shed_accept_latency", "shed_retry_after" };
+		int *shedValues[] = { &r.shedConfig.maxConcurrency, &r.shedConfig.maxAccepts, &r.shedConfig.maxAcceptLatency, &r.shedConfig.retryAfter };
+		for(int n = 0; n < 4; ++n)
+		{
+			if(!props.contains(shedProps[n]))
+				continue;
+
+			bool ok_;
+			int x = props.value(shedProps[n]).toInt(&ok_);
+			if(!ok_ || x < 0)
+			{
+				log_warning("%s:%d: invalid %s", qPrintable(fileName), lineNum, shedProps[n]);
+				return false;
+			}
+
+			*shedValues[n] = x;
+		}
+
+		int maxInFlight = 0;
+		int maxQueued = -1;
+		if(!parseLimits(props, &maxInFlight, &maxQueued, fileName, lineNum))
+			return false;
+
+		if(props.contains("queue_timeout"))
+		{
+			bool ok_;
+			int x = props.value("queue_timeout").toInt(&ok_);
+			if(!ok_ || x < 1)
+			{
+				log_warning("%s:%d: invalid queue_timeout", qPrintable(fileName), lineNum);
+				return false;
+			}
+
+			r.queueTimeout = x;
+		}
+
 		ok = true;
 		for(int n = 1; n < sections.count(); ++n)
 		{
@@ -650,6 +1035,34 @@ private:
 			if(props.contains("one_event"))
 				target.oneEvent = true;
 
+			if(props.contains("over_http_pipeline"))
+			{
+				bool ok_;
+				int x = props.value("over_http_pipeline").toInt(&ok_);
+				if(!ok_ || x < 1)
+				{
+					log_warning("%s:%d: invalid over_http_pipeline", qPrintable(fileName), lineNum);
+					ok = false;
+					break;
+				}
+
+				target.overHttpPipeline = x;
+			}
+
+			if(props.contains("over_http_keep_alive_max"))
+			{
+				bool ok_;
+				int x = props.value("over_http_keep_alive_max").toInt(&ok_);
+				if(!ok_ || x < 0)
+				{
+					log_warning("%s:%d: invalid over_http_keep_alive_max", qPrintable(fileName), lineNum);
+					ok = false;
+					break;
+				}
+
+				target.overHttpKeepAliveMax = x;
+			}
+
 			if(props.contains("ipc_file_mode"))
 			{
 				bool ok_;
@@ -658,17 +1071,53 @@ private:
 					target.zhttpRoute.ipcFileMode = x;
 			}
 
+			int targetMaxInFlight = 0;
+			int targetMaxQueued = -1;
+			if(!parseLimits(props, &targetMaxInFlight, &targetMaxQueued, fileName, lineNum))
+			{
+				ok = false;
+				break;
+			}
+
+			// health is tracked per destination, regardless of route
+			QString targetKey;
+			if(target.type == Target::Default)
+				targetKey = QString("%1:%2%3").arg(target.connectHost, QString::number(target.connectPort), target.ssl ? ";ssl" : "");
+			else if(target.type == Target::Custom)
+				targetKey = (target.zhttpRoute.req ? "zhttpreq/" : "zhttp/") + target.zhttpRoute.baseSpec;
+
+			if(!targetKey.isEmpty())
+			{
+				target.health = TargetHealth::get(targetKey);
+
+				// like health, the limit is shared by all routes using the
+				// target, and the last route loaded sets it
+				if(targetMaxInFlight > 0)
+				{
+					target.limit = ConcurrencyLimit::get("target/" + targetKey);
+					target.limit->setLimits(targetMaxInFlight, targetMaxQueued);
+				}
+			}
+
 			r.targets += target;
 		}
 
 		if(!ok)
 			return false;
 
+		if(maxInFlight > 0)
+		{
+			QByteArray id = !r.id.isEmpty() ? r.id : r.idFromCondition();
+
+			r.limit = ConcurrencyLimit::get("route/" + QString::fromUtf8(id));
+			r.limit->setLimits(maxInFlight, maxQueued);
+		}
+
 		*rule = r;
 		return true;
 	}
 
-	static AddRuleResult addRule(const Rule &r, QList<Rule> *all, QHash< QString,QList<Rule> > *domainMap, QHash<QString, Rule> *idMap)
+	static AddRuleResult addRule(Rule r, QList<Rule> *all, QHash< QString,QList<Rule> > *domainMap, QHash<QString, Rule> *idMap)
 	{
 		if(r.domain.isNull() && r.id.isEmpty())
 			return AddRuleNoDomainOrId;
@@ -712,6 +1161,9 @@ private:
 			}
 		}
 
+		// built once and shared by all lookups that resolve to the rule
+		r.entry = std::make_shared<const Entry>(r.toEntry());
+
 		*all += r;
 
 		if(addByDomain)
@@ -925,71 +1377,95 @@ void DomainMap::reload()
 
 bool DomainMap::isIdShared(const QString &id) const
 {
-	QMutexLocker locker(&d->thread->worker->m);
+	const Worker::Table *table = d->thread->worker->snapshot();
 
-	if(!d->thread->worker->rulesById.contains(id))
+	QHash<QString, Worker::Rule>::const_iterator it = table->rulesById.constFind(id);
+	if(it == table->rulesById.constEnd())
 		return false;
 
-	const Worker::Rule *r = &d->thread->worker->rulesById[id];
-
-	return r->id.isEmpty();
+	return it->id.isEmpty();
 }
 
-DomainMap::Entry DomainMap::entry(Protocol proto, bool ssl, const QString &domain, const QByteArray &path) const
+std::shared_ptr<const DomainMap::Entry> DomainMap::sharedEntry(Protocol proto, bool ssl, const QString &domain, const QByteArray &path) const
 {
-	QMutexLocker locker(&d->thread->worker->m);
+	const Worker::Table *table = d->thread->worker->snapshot();
 
-	const QList<Worker::Rule> *rules;
-	QString empty("");
-	if(d->thread->worker->rulesByDomain.contains(domain))
-		rules = &d->thread->worker->rulesByDomain[domain];
-	else if(d->thread->worker->rulesByDomain.contains(empty))
-		rules = &d->thread->worker->rulesByDomain[empty];
-	else
-		return Entry();
+	QHash< QString, std::shared_ptr<const Worker::DomainRoutes> >::const_iterator it = table->routesByDomain.constFind(domain);
+	if(it == table->routesByDomain.constEnd())
+	{
+		it = table->routesByDomain.constFind(QString(""));
+		if(it == table->routesByDomain.constEnd())
+			return std::shared_ptr<const Entry>();
+	}
+
+	const Worker::DomainRoutes *routes = it.value().get();
+
+	// every rule in the trie already matches the protocol and ssl, and the
+	// walk yields those whose path_beg is a prefix of the path. resolve
+	// them in their original order, so that precedence is the same as
+	// checking each rule of the domain in turn
+	QVarLengthArray<int, 16> candidates;
+	routes->tries[Worker::DomainRoutes::trieIndex(proto, ssl)].forEachPrefix(path, [&](int n) {
+		candidates.append(n);
+	});
+
+	std::sort(candidates.begin(), candidates.end());
 
 	const Worker::Rule *best = 0;
-	foreach(const Worker::Rule &r, *rules)
+	for(int n : candidates)
 	{
-		if((!best && r.isMatch(proto, ssl, path)) || (best && r.isMoreSpecificMatch(*best, proto, ssl, path)))
-		{
+		const Worker::Rule &r = routes->rules[n];
+
+		if(!best || r.isMoreSpecificMatch(*best, proto, ssl, path))
 			best = &r;
-		}
 	}
 
 	if(!best)
-		return Entry();
+		return std::shared_ptr<const Entry>();
 
 	assert(!best->targets.isEmpty());
 
-	return best->toEntry();
+	return best->entry;
 }
 
-DomainMap::Entry DomainMap::entry(const QString &id) const
+std::shared_ptr<const DomainMap::Entry> DomainMap::sharedEntry(const QString &id) const
 {
-	QMutexLocker locker(&d->thread->worker->m);
+	const Worker::Table *table = d->thread->worker->snapshot();
 
-	if(!d->thread->worker->rulesById.contains(id))
-		return Entry();
+	QHash<QString, Worker::Rule>::const_iterator it = table->rulesById.constFind(id);
+	if(it == table->rulesById.constEnd())
+		return std::shared_ptr<const Entry>();
 
-	const Worker::Rule *r = &d->thread->worker->rulesById[id];
+	const Worker::Rule *r = &it.value();
 
 	// this can happen if there were duplicate route IDs
 	if(r->id.isEmpty())
-		return Entry();
+		return std::shared_ptr<const Entry>();
+
+	return r->entry;
+}
 
-	return r->toEntry();
+DomainMap::Entry DomainMap::entry(Protocol proto, bool ssl, const QString &domain, const QByteArray &path) const
+{
+	std::shared_ptr<const Entry> e = sharedEntry(proto, ssl, domain, path);
+	return e ? *e : Entry();
+}
+
+DomainMap::Entry DomainMap::entry(const QString &id) const
+{
+	std::shared_ptr<const Entry> e = sharedEntry(id);
+	return e ? *e : Entry();
 }
 
 QList<DomainMap::ZhttpRoute> DomainMap::zhttpRoutes() const
 {
-	QMutexLocker locker(&d->thread->worker->m);
+	const Worker::Table *table = d->thread->worker->snapshot();
 
 	QList<ZhttpRoute> out;
 
-	foreach(const Worker::Rule &r, d->thread->worker->allRules)
+	for(const Worker::Rule &r : table->allRules)
 	{
-		foreach(const Target &t, r.targets)
+		for(const Target &t : r.targets)
 		{
 			if(!t.zhttpRoute.isNull() && !out.contains(t.zhttpRoute))
 				out += t.zhttpRoute;
@@ -1001,6 +1477,5 @@ QList<DomainMap::ZhttpRoute> DomainMap::zhttpRoutes() const
 
 bool DomainMap::addRouteLine(const QString &line)
 {
-	QMutexLocker locker(&d->thread->worker->m);
 	return d->thread->worker->addRouteLine(line);
 }
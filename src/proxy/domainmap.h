@@ -24,6 +24,7 @@
 #ifndef DOMAINMAP_H
 #define DOMAINMAP_H
 
+#include <memory>
 #include <QPair>
 #include <QString>
 #include <QStringList>
@@ -31,9 +32,15 @@
 #include "httpheaders.h"
 #include "jwt.h"
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
+
+class TargetHealth;
+class TargetBalancer;
+class ConcurrencyLimit;
 
 using Signal = boost::signals2::signal<void()>;
-using Connection = boost::signals2::scoped_connection;
+
+#define DEFAULT_QUEUE_TIMEOUT 10000
 
 // this class offers fast access to the routes file. the table is maintained
 //   by a background thread so that file access doesn't cause blocking.
@@ -62,6 +69,30 @@ public:
 		}
 	};
 
+	// thresholds for shedding new requests on a route. zero disables a
+	// threshold
+	class ShedConfig
+	{
+	public:
+		int maxConcurrency; // sessions open to the origin
+		int maxAccepts; // accepts outstanding to the handler
+		int maxAcceptLatency; // smoothed handler accept latency, in ms
+		int retryAfter; // seconds, sent to shed clients
+
+		ShedConfig() :
+			maxConcurrency(0),
+			maxAccepts(0),
+			maxAcceptLatency(0),
+			retryAfter(1)
+		{
+		}
+
+		bool isEnabled() const
+		{
+			return (maxConcurrency > 0 || maxAccepts > 0 || maxAcceptLatency > 0);
+		}
+	};
+
 	enum Protocol
 	{
 		Http,
@@ -115,6 +146,10 @@ public:
 		QStringList subscriptions; // implicit subscriptions
 		bool overHttp; // use websocket-over-http protocol
 		bool oneEvent; // send one event at a time with overHttp
+		int overHttpPipeline; // max requests in flight with overHttp
+		int overHttpKeepAliveMax; // max keep-alives in flight per origin, or 0
+		std::shared_ptr<TargetHealth> health; // null for test targets
+		std::shared_ptr<ConcurrencyLimit> limit; // null if unlimited
 
 		Target() :
 			type(Default),
@@ -124,7 +159,9 @@ public:
 			trustConnectHost(false),
 			insecure(false),
 			overHttp(false),
-			oneEvent(false)
+			oneEvent(false),
+			overHttpPipeline(1),
+			overHttpKeepAliveMax(0)
 		{
 		}
 	};
@@ -150,7 +187,13 @@ public:
 		HttpHeaders headers;
 		bool separateStats;
 		bool grip;
+		bool cacheResponses;
+		bool compressPublished; // gzip published content for clients that accept it
 		QList<Target> targets;
+		std::shared_ptr<TargetBalancer> balancer;
+		ShedConfig shedConfig;
+		std::shared_ptr<ConcurrencyLimit> limit; // null if unlimited
+		int queueTimeout; // ms to wait for a route or target slot
 		int logLevel;
 
 		bool isNull() const
@@ -174,6 +217,9 @@ public:
 			session(false),
 			separateStats(false),
 			grip(true),
+			cacheResponses(false),
+			compressPublished(false),
+			queueTimeout(DEFAULT_QUEUE_TIMEOUT),
 			logLevel(LOG_LEVEL_DEBUG)
 		{
 		}
@@ -191,6 +237,12 @@ public:
 	Entry entry(Protocol proto, bool ssl, const QString &domain, const QByteArray &path) const;
 	Entry entry(const QString &id) const;
 
+	// same as entry(), but returns the table's own immutable copy rather
+	//   than building a new one, or null if there is no match. the entry
+	//   remains valid after the routes change
+	std::shared_ptr<const Entry> sharedEntry(Protocol proto, bool ssl, const QString &domain, const QByteArray &path) const;
+	std::shared_ptr<const Entry> sharedEntry(const QString &id) const;
+
 	QList<ZhttpRoute> zhttpRoutes() const;
 
 	bool addRouteLine(const QString &line);
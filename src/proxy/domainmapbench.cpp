@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include <vector>
+#include "bench.h"
+#include "eventloop.h"
+#include "defercall.h"
+#include "domainmap.h"
+
+extern "C" void domainmap_bench(const char *filter)
+{
+	Bench bench(filter);
+
+	if(!bench.selected("domainmap/"))
+		return;
+
+	EventLoop loop(100);
+
+	{
+		DomainMap map(true);
+
+		// a mix of domain and path rules, as a large deployment might have
+		for(int n = 0; n < 1000; ++n)
+		{
+			map.addRouteLine(QString("host%1.example.com,id=d%1 origin%1:80").arg(n));
+			map.addRouteLine(QString("*,path_beg=/api/v%1/,id=p%1 origin%1:80").arg(n));
+		}
+
+		std::vector<QString> hosts;
+		std::vector<QByteArray> paths;
+		for(int n = 0; n < 1000; ++n)
+		{
+			hosts.push_back(QString("host%1.example.com").arg(n));
+			paths.push_back(QString("/api/v%1/items").arg(n).toUtf8());
+		}
+
+		int next = 0;
+
+		bench.run("domainmap/entry-domain", 100000, 1, [&] {
+			DomainMap::Entry e = map.entry(DomainMap::Http, false, hosts[next], "/");
+			Q_UNUSED(e);
+			next = (next + 1) % (int)hosts.size();
+		});
+
+		bench.run("domainmap/entry-path", 100000, 1, [&] {
+			DomainMap::Entry e = map.entry(DomainMap::Http, false, "other.example.com", paths[next]);
+			Q_UNUSED(e);
+			next = (next + 1) % (int)paths.size();
+		});
+
+		bench.run("domainmap/entry-id", 100000, 1, [&] {
+			DomainMap::Entry e = map.entry(QString("p%1").arg(next));
+			Q_UNUSED(e);
+			next = (next + 1) % (int)paths.size();
+		});
+	}
+
+	{
+		DomainMap map(true);
+
+		// many overlapping prefixes under one domain, with protocol and ssl
+		// variants, so most requests have several candidate rules
+		for(int n = 0; n < 1000; ++n)
+		{
+			map.addRouteLine(QString("api.example.com,path_beg=/t%1/,id=a%1 origin:80").arg(n));
+			map.addRouteLine(QString("api.example.com,path_beg=/t%1/items/,id=b%1 origin:80").arg(n));
+			map.addRouteLine(QString("api.example.com,path_beg=/t%1/items/,ssl=yes,id=c%1 origin:80").arg(n));
+			map.addRouteLine(QString("api.example.com,path_beg=/t%1/,proto=ws,id=d%1 origin:80").arg(n));
+		}
+
+		std::vector<QByteArray> paths;
+		for(int n = 0; n < 1000; ++n)
+			paths.push_back(QString("/t%1/items/%1/detail").arg(n).toUtf8());
+
+		int next = 0;
+
+		bench.run("domainmap/entry-path-nested", 100000, 1, [&] {
+			DomainMap::Entry e = map.entry(DomainMap::Http, (next & 1) != 0, "api.example.com", paths[next]);
+			Q_UNUSED(e);
+			next = (next + 1) % (int)paths.size();
+		});
+	}
+
+	DeferCall::cleanup();
+}
@@ -24,6 +24,8 @@
 #include "engine.h"
 
 #include <assert.h>
+#include <algorithm>
+#include <QCryptographicHash>
 #include "qzmqsocket.h"
 #include "qzmqvalve.h"
 #include "qzmqreqmessage.h"
@@ -36,6 +38,7 @@
 #include "timer.h"
 #include "defercall.h"
 #include "log.h"
+#include "trace.h"
 #include "inspectdata.h"
 #include "zhttpmanager.h"
 #include "zhttprequest.h"
@@ -51,14 +54,24 @@
 #include "proxysession.h"
 #include "wsproxysession.h"
 #include "statsmanager.h"
+#include "flowwindow.h"
+#include "memorybudget.h"
+#include "keepalivescheduler.h"
+#include "loopstats.h"
 #include "connectionmanager.h"
 #include "zutil.h"
 #include "sockjsmanager.h"
 #include "sockjssession.h"
 #include "updater.h"
 #include "logutil.h"
+#include "admissioncontroller.h"
+#include "concurrencylimit.h"
+#include "sharedrequests.h"
+#include "workerload.h"
+#include "loopclock.h"
 
 #define DEFAULT_HWM 1000
+#define LOAD_INTERVAL 100
 
 class Engine::Private
 {
@@ -69,10 +82,13 @@ public:
 		bool shared;
 		QByteArray key;
 		ProxySession *ps;
+		bool admissionCounted;
+		QByteArray routeId;
 
 		ProxyItem() :
 			shared(false),
-			ps(0)
+			ps(0),
+			admissionCounted(false)
 		{
 		}
 	};
@@ -88,6 +104,22 @@ public:
 		}
 	};
 
+	// a request waiting for another thread's response to share
+	class SharedWait
+	{
+	public:
+		RequestSession *rs;
+		bool haveInspectData;
+		InspectData idata;
+		QByteArray retryKey;
+
+		SharedWait() :
+			rs(0),
+			haveInspectData(false)
+		{
+		}
+	};
+
 	struct RequestSessionConnections {
 		Connection inspectedConnection;
 		Connection inspectErrorConnection;
@@ -105,6 +137,8 @@ public:
 	bool destroying;
 	DomainMap *domainMap;
 	Configuration config;
+	std::atomic<quint64> retryRequests;
+	std::atomic<quint64> retryRequestsCoalesced;
 	std::unique_ptr<ZhttpManager> zhttpIn;
 	std::unique_ptr<ZhttpManager> intZhttpIn;
 	std::unique_ptr<ZRoutes> zroutes;
@@ -120,8 +154,17 @@ public:
 	QHash<QByteArray, ProxyItem*> proxyItemsByKey;
 	QHash<ProxySession*, ProxyItem*> proxyItemsBySession;
 	QHash<WsProxySession*, WsProxyItem*> wsProxyItemsBySession;
+	std::unique_ptr<SharedRequests::Waiter> sharedWaiter;
+	QHash<QByteArray, QList<SharedWait>> sharedWaitsByKey;
+	QHash<RequestSession*, QByteArray> sharedWaitKeysBySession;
 	std::unique_ptr<SockJsManager> sockJsManager;
+	int loadId;
+	std::unique_ptr<Timer> loadTimer;
+	qint64 loadCheckTime;
+	int loadLag;
+	bool intakePaused;
 	ConnectionManager connectionManager;
+	AdmissionController admission;
 	std::unique_ptr<Updater> updater;
 	LogUtil::Config logConfig;
 	Connection cmdReqReadyConnection;
@@ -133,11 +176,19 @@ public:
 	map<ProxySession*, ProxySessionConnections> proxySessionConnectionMap;
 	Connection connMaxConnection;
 	Connection rrConnection;
+	Connection sharedWaiterConnection;
+	Connection loadTimerConnection;
 
 	Private(Engine *_q, DomainMap *_domainMap) :
 		q(_q),
 		destroying(false),
-		domainMap(_domainMap)
+		domainMap(_domainMap),
+		retryRequests(0),
+		retryRequestsCoalesced(0),
+		loadId(-1),
+		loadCheckTime(0),
+		loadLag(0),
+		intakePaused(false)
 	{
 	}
 
@@ -171,6 +222,18 @@ public:
 
 		wsProxyItemsBySession.clear();
 
+		// waiting sessions are deleted with the others below
+		sharedWaitsByKey.clear();
+		sharedWaitKeysBySession.clear();
+		sharedWaiterConnection.disconnect();
+		sharedWaiter.reset();
+
+		loadTimerConnection.disconnect();
+		loadTimer.reset();
+
+		if(loadId != -1)
+			WorkerLoad::remove(loadId);
+
 		foreach(RequestSession *rs, requestSessions){
 			reqSessionConnectionMap.erase(rs);
 			delete rs;
@@ -194,6 +257,13 @@ public:
 		logConfig.userAgent = config.logUserAgent;
 
 		WebSocketOverHttp::setMaxManagedDisconnects(config.sessionsMax);
+		KeepAliveScheduler::setCapacity(config.sessionsMax);
+
+		if(config.crossWorkerSharing)
+		{
+			sharedWaiter = std::make_unique<SharedRequests::Waiter>();
+			sharedWaiterConnection = sharedWaiter->ready.connect(boost::bind(&Private::sharedWaiter_ready, this));
+		}
 
 		zhttpIn = std::make_unique<ZhttpManager>();
 		requestReadyConnection = zhttpIn->requestReady.connect(boost::bind(&Private::zhttpIn_requestReady, this));
@@ -204,6 +274,28 @@ public:
 		zhttpIn->setServerInStreamSpecs(config.serverInStreamSpecs);
 		zhttpIn->setServerOutSpecs(config.serverOutSpecs);
 
+		if(!config.captureFile.isEmpty())
+		{
+			QString errorMessage;
+			if(!zhttpIn->setCaptureFile(config.captureFile, &errorMessage))
+			{
+				log_error("capture: %s", qPrintable(errorMessage));
+				return false;
+			}
+
+			log_info("capturing zhttp requests to %s", qPrintable(config.captureFile));
+		}
+
+		if(config.loadAwareIntake)
+		{
+			loadId = WorkerLoad::add();
+			loadCheckTime = LoopClock::preciseMSecsSinceEpoch();
+
+			loadTimer = std::make_unique<Timer>();
+			loadTimerConnection = loadTimer->timeout.connect(boost::bind(&Private::loadTimer_timeout, this));
+			loadTimer->start(LOAD_INTERVAL);
+		}
+
 		if(!config.intServerInSpecs.isEmpty() && !config.intServerInStreamSpecs.isEmpty() && !config.intServerOutSpecs.isEmpty())
 		{
 			intZhttpIn = std::make_unique<ZhttpManager>();
@@ -222,6 +314,9 @@ public:
 		zroutes->setDefaultOutSpecs(config.clientOutSpecs);
 		zroutes->setDefaultOutStreamSpecs(config.clientOutStreamSpecs);
 		zroutes->setDefaultInSpecs(config.clientInSpecs);
+		zroutes->setLazy(config.zhttpTargetLazy);
+		zroutes->setIdleTimeout(config.zhttpTargetIdleTimeout);
+		zroutes->setSharedPrefixes(config.zhttpTargetSharedPrefixes);
 
 		sockJsManager = std::make_unique<SockJsManager>(config.sockJsUrl);
 		sessionReadyConnection = sockJsManager->sessionReady.connect(boost::bind(&Private::sockjs_sessionReady, this));
@@ -239,6 +334,9 @@ public:
 
 			inspect->setTimeout(config.inspectTimeout);
 
+			// lookups for a burst of new requests share a round trip
+			inspect->setBatchWindow(0);
+
 			inspectChecker = std::make_unique<ZrpcChecker>();
 		}
 
@@ -256,6 +354,7 @@ public:
 
 			// there's no acceptTimeout config option so we'll reuse inspectTimeout
 			accept->setTimeout(config.inspectTimeout);
+			accept->setBatchWindow(0);
 		}
 
 		if(!config.retryInSpec.isEmpty())
@@ -281,7 +380,7 @@ public:
 
 		if(!config.wsControlInitSpecs.isEmpty() && !config.wsControlStreamSpecs.isEmpty())
 		{
-			wsControl = std::make_unique<WsControlManager>();
+			wsControl = std::make_unique<WsControlManager>(config.sessionsMax);
 
 			wsControl->setIdentity(config.clientId);
 			wsControl->setIpcFileMode(config.ipcFileMode);
@@ -313,6 +412,20 @@ public:
 			stats->setConnectionsMaxTtl(config.statsConnectionsMaxTtl);
 			stats->setReportInterval(config.statsReportInterval);
 
+			if(config.statsReportAggregator)
+				stats->setReportAggregator(config.statsReportAggregator, config.id == 0);
+
+			// the handler accepts tnetstring or binary
+			if(config.statsFormat == "binary")
+			{
+				stats->setOutputFormat(StatsManager::BinaryFormat);
+			}
+			else if(!config.statsFormat.isEmpty() && config.statsFormat != "tnetstring")
+			{
+				log_error("invalid stats_format: %s", qPrintable(config.statsFormat));
+				return false;
+			}
+
 			if(!config.statsSpec.isEmpty())
 			{
 				if(!stats->setSpec(config.statsSpec))
@@ -326,6 +439,22 @@ public:
 			{
 				stats->setPrometheusPrefix(config.prometheusPrefix);
 
+				if(LoopStats::enabled())
+					LoopStats::addToPrometheus(stats.get());
+
+				ProxySession::addToPrometheus(stats.get());
+
+				// engine init runs in the engine's thread, so this is the
+				// counter for streams owned by this engine
+				stats->addPrometheusGauge("proxy_buffered_bytes", "Response bytes received from origins but not yet read", QString("engine=\"%1\"").arg(config.id), FlowWindow::threadBufferedBytes());
+
+				// process-wide, so each engine exports the same values
+				MemoryBudget::addToPrometheus(stats.get(), QString("engine=\"%1\"").arg(config.id));
+				ConcurrencyLimit::addToPrometheus(stats.get(), QString("engine=\"%1\"").arg(config.id));
+
+				stats->addPrometheusCounter("proxy_retry_requests_total", "Requests retried on behalf of the handler", QString("engine=\"%1\"").arg(config.id), &retryRequests);
+				stats->addPrometheusCounter("proxy_retry_requests_coalesced_total", "Retried requests that shared an origin request with another", QString("engine=\"%1\"").arg(config.id), &retryRequestsCoalesced);
+
 				if(!stats->setPrometheusPort(config.prometheusPort))
 				{
 					log_error("unable to bind to prometheus port: %s", qPrintable(config.prometheusPort));
@@ -359,6 +488,33 @@ public:
 		return true;
 	}
 
+	void reload(const Configuration &newConfig)
+	{
+		if(newConfig.statsConnectionTtl != config.statsConnectionTtl)
+		{
+			config.statsConnectionTtl = newConfig.statsConnectionTtl;
+			if(stats)
+				stats->setConnectionTtl(config.statsConnectionTtl);
+			log_info("stats_connection_ttl changed to %d", config.statsConnectionTtl);
+		}
+
+		if(newConfig.statsConnectionsMaxTtl != config.statsConnectionsMaxTtl)
+		{
+			config.statsConnectionsMaxTtl = newConfig.statsConnectionsMaxTtl;
+			if(stats)
+				stats->setConnectionsMaxTtl(config.statsConnectionsMaxTtl);
+			log_info("stats_connections_max_ttl changed to %d", config.statsConnectionsMaxTtl);
+		}
+
+		if(newConfig.statsReportInterval != config.statsReportInterval)
+		{
+			config.statsReportInterval = newConfig.statsReportInterval;
+			if(stats)
+				stats->setReportInterval(config.statsReportInterval);
+			log_info("stats_report_interval changed to %d", config.statsReportInterval);
+		}
+	}
+
 	void routesChanged()
 	{
 		auto zhttpRoutes = domainMap->zhttpRoutes();
@@ -373,25 +529,140 @@ public:
 		zroutes->setup(zhttpRoutes);
 	}
 
-	void doProxy(RequestSession *rs, const InspectData *idata = 0)
+	// retries of identical requests can share a single origin request. the
+	// key covers everything that is sent to the origin or passed on to the
+	// handler afterwards, and only safe methods are shared
+	static QByteArray retrySharingKey(const RetryRequestPacket &p, bool https)
+	{
+		const HttpRequestData &rd = p.requestData;
+
+		if(rd.method != "GET" && rd.method != "HEAD")
+			return QByteArray();
+
+		QCryptographicHash hash(QCryptographicHash::Sha1);
+		hash.addData(rd.method.toLatin1());
+		hash.addData("\n");
+		hash.addData(rd.uri.toEncoded());
+		hash.addData(https ? "\ns\n" : "\n\n");
+		foreach(const HttpHeader &h, rd.headers)
+		{
+			hash.addData(h.first);
+			hash.addData(":");
+			hash.addData(h.second);
+			hash.addData("\n");
+		}
+		hash.addData("\n");
+		hash.addData(rd.body);
+		hash.addData("\n");
+		hash.addData(p.route);
+
+		if(p.haveInspectInfo)
+		{
+			const RetryRequestPacket::InspectInfo &ii = p.inspectInfo;
+
+			hash.addData(ii.doProxy ? "\np\n" : "\n\n");
+			hash.addData(ii.sid);
+
+			QList<QByteArray> channels = ii.lastIds.keys();
+			std::sort(channels.begin(), channels.end());
+			foreach(const QByteArray &channel, channels)
+			{
+				hash.addData("\n");
+				hash.addData(channel);
+				hash.addData(":");
+				hash.addData(ii.lastIds.value(channel));
+			}
+
+			if(ii.userData.isValid())
+			{
+				hash.addData("\n");
+				hash.addData(TnetString::fromVariant(ii.userData));
+			}
+		}
+
+		return "retry:" + hash.result().toHex();
+	}
+
+	// shared is set if the request waited on another thread, in which case
+	// it gets that thread's response, or makes its own request without
+	// waiting again if the response wasn't shared
+	void doProxy(RequestSession *rs, const InspectData *idata = 0, const QByteArray &retryKey = QByteArray(), const SharedRequests::Result *shared = 0)
 	{
-		DomainMap::Entry route = rs->route();
+		std::shared_ptr<const DomainMap::Entry> route = rs->route();
 
 		// we'll always have a route
-		assert(!route.isNull());
+		assert(route && !route->isNull());
 
-		bool sharable = (idata && !idata->sharingKey.isEmpty() && rs->haveCompleteRequestBody());
+		QByteArray sharingKey;
+		if(idata && !idata->sharingKey.isEmpty())
+			sharingKey = idata->sharingKey;
+		else
+			sharingKey = retryKey;
+
+		bool sharable = (!sharingKey.isEmpty() && rs->haveCompleteRequestBody());
 
 		ProxySession *ps = 0;
 		if(sharable)
 		{
-			log_debug("need to proxy with sharing key: %s", idata->sharingKey.data());
+			log_debug("need to proxy with sharing key: %s", sharingKey.data());
 
-			ProxyItem *i = proxyItemsByKey.value(idata->sharingKey);
+			ProxyItem *i = proxyItemsByKey.value(sharingKey);
 			if(i)
 				ps = i->ps;
 		}
 
+		bool sharedClaimed = false;
+		if(!ps && sharable && sharedWaiter && !shared)
+		{
+			SharedRequests::ClaimResult r = SharedRequests::Waiting;
+
+			// only one wait per key is registered for this thread
+			if(!sharedWaitsByKey.contains(sharingKey))
+				r = SharedRequests::claim(sharingKey, sharedWaiter.get());
+
+			if(r == SharedRequests::Waiting)
+			{
+				log_debug("waiting for shared response for id=%s", rs->rid().second.data());
+
+				SharedWait w;
+				w.rs = rs;
+				w.haveInspectData = (idata != 0);
+				if(idata)
+					w.idata = *idata;
+				w.retryKey = retryKey;
+
+				sharedWaitsByKey[sharingKey] += w;
+				sharedWaitKeysBySession.insert(rs, sharingKey);
+
+				if(!retryKey.isEmpty())
+					++retryRequestsCoalesced;
+
+				return;
+			}
+
+			sharedClaimed = (r == SharedRequests::Claimed);
+		}
+
+		if(!ps && route->shedConfig.isEnabled())
+		{
+			AdmissionController::Decision d = admission.check(*route);
+			if(d != AdmissionController::Admit)
+			{
+				log_debug("shedding request id=%s route=%s: %s", rs->rid().second.data(), route->id.data(), AdmissionController::decisionName(d));
+
+				QByteArray body = "Service temporarily overloaded.\n";
+
+				HttpHeaders headers;
+				headers += HttpHeader("Content-Type", "text/plain");
+				headers += HttpHeader("Content-Length", QByteArray::number(body.size()));
+				headers += HttpHeader("Retry-After", QByteArray::number(route->shedConfig.retryAfter));
+
+				// rs_finished will clean up
+				rs->respond(503, "Service Unavailable", headers, body);
+				return;
+			}
+		}
+
 		if(!ps)
 		{
 			log_debug("creating proxysession for id=%s", rs->rid().second.data());
@@ -412,25 +683,47 @@ public:
 			ps->setOrigHeadersNeedMark(config.origHeadersNeedMark);
 			ps->setAcceptPushpinRoute(config.acceptPushpinRoute);
 			ps->setCdnLoop(config.cdnLoop);
+			ps->setTraceSampleRate(config.traceSampleRate);
+			ps->setAcceptCompact(config.acceptCompact);
 			ps->setProxyInitialResponseEnabled(true);
+			ps->setAdmissionController(&admission);
 
 			if(idata)
 				ps->setInspectData(*idata);
 
+			if(sharedClaimed)
+				ps->setSharedKey(sharingKey);
+
+			if(shared && shared->item)
+				ps->setSharedResponse(shared->item);
+
 			ProxyItem *i = new ProxyItem;
 			i->ps = ps;
 			proxyItemsBySession.insert(i->ps, i);
 
+			// only routes that limit concurrency need their sessions counted
+			if(route->shedConfig.maxConcurrency > 0)
+			{
+				i->admissionCounted = true;
+				i->routeId = route->id;
+				admission.sessionStarted(i->routeId);
+			}
+
 			if(sharable)
 			{
 				i->shared = true;
-				i->key = idata->sharingKey;
+				i->key = sharingKey;
 				proxyItemsByKey.insert(i->key, i);
 			}
 		}
 		else
+		{
 			log_debug("reusing proxysession");
 
+			if(!retryKey.isEmpty())
+				++retryRequestsCoalesced;
+		}
+
 		// proxysession will take it from here
 		// TODO: use callbacks for performance
 		reqSessionConnectionMap.erase(rs);
@@ -575,7 +868,7 @@ public:
 
 			route.targets += target;
 
-			rs->setRoute(route);
+			rs->setRoute(std::make_shared<const DomainMap::Entry>(route));
 		}
 		else
 		{
@@ -684,11 +977,11 @@ public:
 
 		LogUtil::RequestData rd;
 
-		DomainMap::Entry route = rs->route();
+		std::shared_ptr<const DomainMap::Entry> route = rs->route();
 
 		// only log route id if explicitly set
-		if(route.separateStats)
-			rd.routeId = route.id;
+		if(route && route->separateStats)
+			rd.routeId = route->id;
 
 		if(accepted)
 		{
@@ -753,6 +1046,8 @@ private:
 		if(!rs->isSockJs())
 			logFinished(rs);
 
+		removeSharedWait(rs);
+
 		requestSessions.remove(rs);
 		reqSessionConnectionMap.erase(rs);
 		delete rs;
@@ -771,6 +1066,70 @@ private:
 		tryTakeNext();
 	}
 
+	void removeSharedWait(RequestSession *rs)
+	{
+		QHash<RequestSession*, QByteArray>::iterator it = sharedWaitKeysBySession.find(rs);
+		if(it == sharedWaitKeysBySession.end())
+			return;
+
+		QHash<QByteArray, QList<SharedWait>>::iterator wit = sharedWaitsByKey.find(it.value());
+		assert(wit != sharedWaitsByKey.end());
+
+		QList<SharedWait> &waits = wit.value();
+		for(int n = 0; n < waits.count(); ++n)
+		{
+			if(waits[n].rs == rs)
+			{
+				waits.removeAt(n);
+				break;
+			}
+		}
+
+		// the thread stays registered for the key, and the outcome is
+		// ignored when it arrives
+		sharedWaitKeysBySession.erase(it);
+	}
+
+	void loadTimer_timeout()
+	{
+		// the timer firing late means the loop is busy
+		qint64 now = LoopClock::preciseMSecsSinceEpoch();
+		int sample = (int)qBound((qint64)0, now - loadCheckTime - LOAD_INTERVAL, (qint64)60000);
+		loadCheckTime = now;
+
+		// smooth out single slow iterations
+		loadLag = (loadLag * 3 + sample) / 4;
+
+		int curSessions = requestSessions.count() + wsProxyItemsBySession.count();
+
+		bool paused = WorkerLoad::update(loadId, curSessions, loadLag);
+		if(paused != intakePaused)
+		{
+			intakePaused = paused;
+
+			log_debug("%s new sessions: sessions=%d lag=%d", paused ? "pausing" : "resuming", curSessions, loadLag);
+
+			// new sessions go to the other workers while paused. any that
+			// were already received are still taken
+			zhttpIn->setServerInPaused(paused);
+		}
+	}
+
+	void sharedWaiter_ready()
+	{
+		foreach(const SharedRequests::Result &r, sharedWaiter->take())
+		{
+			QList<SharedWait> waits = sharedWaitsByKey.take(r.key);
+
+			foreach(const SharedWait &w, waits)
+			{
+				sharedWaitKeysBySession.remove(w.rs);
+
+				doProxy(w.rs, w.haveInspectData ? &w.idata : 0, w.retryKey, &r);
+			}
+		}
+	}
+
 	void ps_addNotAllowed(ProxySession *ps)
 	{
 		ProxyItem *i = proxyItemsBySession.value(ps);
@@ -793,6 +1152,8 @@ private:
 		
 		if(i->shared)
 			proxyItemsByKey.remove(i->key);
+		if(i->admissionCounted)
+			admission.sessionFinished(i->routeId);
 		proxyItemsBySession.remove(i->ps);
 		delete i;
 		delete ps;
@@ -857,13 +1218,32 @@ private:
 		if(log_outputLevel() >= LOG_LEVEL_DEBUG)
 			log_debug("retry: IN %s", qPrintable(TnetString::variantToString(data, -1)));
 
-		RetryRequestPacket p;
-		if(!p.fromVariant(data))
+		// the handler may combine several packets into a list
+		QVariantList items;
+		if(typeId(data) == QMetaType::QVariantList)
+			items = data.toList();
+		else
+			items += data;
+
+		QList<RetryRequestPacket> packets;
+		foreach(const QVariant &item, items)
 		{
-			log_warning("retry: received message with invalid format (parse failed), skipping");
-			return;
+			RetryRequestPacket p;
+			if(!p.fromVariant(item))
+			{
+				log_warning("retry: received message with invalid format (parse failed), skipping");
+				return;
+			}
+
+			packets += p;
 		}
 
+		foreach(const RetryRequestPacket &p, packets)
+			processRetryPacket(p);
+	}
+
+	void processRetryPacket(const RetryRequestPacket &p)
+	{
 		log_debug("IN (retry) %s %s", qPrintable(p.requestData.method), p.requestData.uri.toEncoded().data());
 
 		InspectData idata;
@@ -876,6 +1256,8 @@ private:
 			idata.userData = p.inspectInfo.userData;
 		}
 
+		QByteArray retryKeys[2];
+
 		foreach(const RetryRequestPacket::Request &req, p.requests)
 		{
 			ZhttpRequest::ServerState ss;
@@ -910,7 +1292,15 @@ private:
 			//   stats processors tracking route+connection mappings.
 			rs->startRetry(zhttpRequest, req.debug, req.autoCrossOrigin, req.jsonpCallback, req.jsonpExtendedResponse, req.unreportedTime, p.retrySeq);
 
-			doProxy(rs, p.haveInspectInfo ? &idata : 0);
+			++retryRequests;
+
+			// requests of a packet share their data, so the key only needs
+			// computing once per scheme
+			QByteArray &retryKey = retryKeys[req.https ? 1 : 0];
+			if(retryKey.isNull())
+				retryKey = retrySharingKey(p, req.https);
+
+			doProxy(rs, p.haveInspectInfo ? &idata : 0, retryKey);
 		}
 	}
 
@@ -976,6 +1366,42 @@ private:
 
 			req->respond(out);
 		}
+		else if(req->method() == "refresh" && req->args().contains("cids"))
+		{
+			QVariantHash args = req->args();
+			if(typeId(args["cids"]) != QMetaType::QVariantList)
+			{
+				req->respondError("bad-format");
+				delete req;
+				return;
+			}
+
+			QVariantList vcids = args["cids"].toList();
+
+			foreach(const QVariant &vcid, vcids)
+			{
+				if(typeId(vcid) != QMetaType::QByteArray)
+				{
+					req->respondError("bad-format");
+					delete req;
+					return;
+				}
+			}
+
+			// unknown connections are skipped rather than failing the batch
+			foreach(const QVariant &vcid, vcids)
+			{
+				WsProxySession *ps = connectionManager.getProxyForConnection(vcid.toByteArray());
+				if(!ps)
+					continue;
+
+				WebSocketOverHttp *woh = dynamic_cast<WebSocketOverHttp*>(ps->outSocket());
+				if(woh)
+					woh->refresh();
+			}
+
+			req->respond();
+		}
 		else if(req->method() == "refresh")
 		{
 			QVariantHash args = req->args();
@@ -1048,6 +1474,49 @@ private:
 
 			req->respond();
 		}
+		else if(req->method() == "trace")
+		{
+			QVariantHash args = req->args();
+
+			if(args.contains("enable"))
+			{
+				if(typeId(args["enable"]) != QMetaType::Bool)
+				{
+					req->respondError("bad-format");
+					delete req;
+					return;
+				}
+
+				Trace::setEnabled(args["enable"].toBool());
+			}
+
+			QVariantHash out;
+			out["enabled"] = Trace::enabled();
+			req->respond(out);
+		}
+		else if(req->method() == "trace-dump")
+		{
+			QVariantHash args = req->args();
+
+			QByteArray format = args.value("format", QByteArray("chrome")).toByteArray();
+
+			Trace::Format f;
+			if(format == "chrome")
+				f = Trace::ChromeFormat;
+			else if(format == "perf")
+				f = Trace::PerfFormat;
+			else
+			{
+				req->respondError("bad-format");
+				delete req;
+				return;
+			}
+
+			QVariantHash out;
+			out["format"] = format;
+			out["data"] = Trace::dump(f);
+			req->respond(out);
+		}
 		else
 		{
 			req->respondError("method-not-found");
@@ -1081,3 +1550,8 @@ void Engine::routesChanged()
 {
 	d->routesChanged();
 }
+
+void Engine::reload(const Configuration &config)
+{
+	d->reload(config);
+}
@@ -27,6 +27,7 @@
 #include <QStringList>
 #include <QHostAddress>
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 #include <map>
 #include "jwt.h"
 #include "xffrule.h"
@@ -49,9 +50,9 @@
 #define ZROUTES_MAX 100
 
 using std::map;
-using Connection = boost::signals2::scoped_connection;
 
 class StatsManager;
+class StatsReportAggregator;
 class DomainMap;
 
 class Engine
@@ -93,6 +94,10 @@ public:
 		QList<QByteArray> origHeadersNeedMark;
 		bool acceptPushpinRoute;
 		QByteArray cdnLoop;
+		int traceSampleRate;
+		bool acceptCompact;
+		bool crossWorkerSharing;
+		bool loadAwareIntake;
 		bool logFrom;
 		bool logUserAgent;
 		QByteArray sigIss;
@@ -106,8 +111,14 @@ public:
 		int statsConnectionTtl;
 		int statsConnectionsMaxTtl;
 		int statsReportInterval;
+		QString statsFormat;
 		QString prometheusPort;
 		QString prometheusPrefix;
+		bool zhttpTargetLazy;
+		int zhttpTargetIdleTimeout; // msecs
+		QStringList zhttpTargetSharedPrefixes;
+		QString captureFile;
+		StatsReportAggregator *statsReportAggregator; // shared by workers
 
 		Configuration() :
 			id(0),
@@ -121,6 +132,10 @@ public:
 			setXForwardedProto(false),
 			setXForwardedProtocol(false),
 			acceptPushpinRoute(false),
+			traceSampleRate(0),
+			acceptCompact(false),
+			crossWorkerSharing(false),
+			loadAwareIntake(false),
 			logFrom(false),
 			logUserAgent(false),
 			updatesCheck("check"),
@@ -128,7 +143,10 @@ public:
 			statsConnectionSend(false),
 			statsConnectionTtl(-1),
 			statsConnectionsMaxTtl(-1),
-			statsReportInterval(-1)
+			statsReportInterval(-1),
+			zhttpTargetLazy(false),
+			zhttpTargetIdleTimeout(0),
+			statsReportAggregator(0)
 		{
 		}
 	};
@@ -141,6 +159,10 @@ public:
 	bool start(const Configuration &config);
 	void routesChanged();
 
+	// applies the settings that can be changed without a restart. other
+	// fields of config are ignored
+	void reload(const Configuration &config);
+
 private:
 	class Private;
 	Private *d;
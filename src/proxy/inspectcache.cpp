@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "inspectcache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <QHash>
+#include <QMutex>
+#include "packet/httprequestdata.h"
+#include "inspectdata.h"
+
+#define MAX_ITEMS 10000
+
+namespace InspectCache {
+
+class Item
+{
+public:
+	InspectData data;
+	qint64 expires; // monotonic msecs
+};
+
+static QMutex g_mutex;
+static QHash<QByteArray, Item> g_items;
+
+static qint64 nowMs()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// called with lock held
+static void removeExpired(qint64 now)
+{
+	QMutableHashIterator<QByteArray, Item> it(g_items);
+	while(it.hasNext())
+	{
+		it.next();
+
+		if(now >= it.value().expires)
+			it.remove();
+	}
+}
+
+QByteArray key(const HttpRequestData &hdata, bool autoShare)
+{
+	QList<QByteArray> gripLastHeaders = hdata.headers.getAll("Grip-Last");
+	std::sort(gripLastHeaders.begin(), gripLastHeaders.end());
+
+	QByteArray out = (autoShare ? "a|" : "-|") + hdata.method.toLatin1() + '|' + hdata.uri.toEncoded();
+
+	foreach(const QByteArray &h, gripLastHeaders)
+		out += '|' + h;
+
+	return out;
+}
+
+bool get(const QByteArray &key, InspectData *data)
+{
+	qint64 now = nowMs();
+
+	QMutexLocker locker(&g_mutex);
+
+	QHash<QByteArray, Item>::const_iterator it = g_items.constFind(key);
+	if(it == g_items.constEnd() || now >= it.value().expires)
+		return false;
+
+	*data = it.value().data;
+	return true;
+}
+
+bool put(const QByteArray &key, const InspectData &data)
+{
+	if(data.maxAge <= 0)
+		return false;
+
+	qint64 now = nowMs();
+
+	Item i;
+	i.data = data;
+	i.expires = now + (qint64)data.maxAge * 1000;
+
+	QMutexLocker locker(&g_mutex);
+
+	if(g_items.count() >= MAX_ITEMS && !g_items.contains(key))
+	{
+		removeExpired(now);
+
+		if(g_items.count() >= MAX_ITEMS)
+			return false;
+	}
+
+	g_items.insert(key, i);
+
+	return true;
+}
+
+void clear()
+{
+	QMutexLocker locker(&g_mutex);
+
+	g_items.clear();
+}
+
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef INSPECTCACHE_H
+#define INSPECTCACHE_H
+
+#include <QByteArray>
+
+class HttpRequestData;
+class InspectData;
+
+// shared cache of inspect results. the handler only marks results as
+// cacheable when they don't involve session detection, in which case
+// they depend on nothing but the fields that make up the key. it is
+// process-wide, so all engine threads share it
+namespace InspectCache {
+
+// covers the method, the URI, any Grip-Last headers and whether
+// auto-sharing is enabled
+QByteArray key(const HttpRequestData &hdata, bool autoShare);
+
+// returns false if there is no fresh result
+bool get(const QByteArray &key, InspectData *data);
+
+// stores the result if it has a max age. returns true if stored
+bool put(const QByteArray &key, const InspectData &data);
+
+void clear();
+
+}
+
+#endif
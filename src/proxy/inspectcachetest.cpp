@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "test.h"
+#include "packet/httprequestdata.h"
+#include "inspectdata.h"
+#include "inspectcache.h"
+
+static HttpRequestData requestData(const QByteArray &uri)
+{
+	HttpRequestData hdata;
+	hdata.method = "GET";
+	hdata.uri = QUrl(uri, QUrl::StrictMode);
+	return hdata;
+}
+
+static void storeAndLookup()
+{
+	InspectCache::clear();
+
+	QByteArray key = InspectCache::key(requestData("http://example.com/path?a=1"), false);
+
+	InspectData out;
+	TEST_ASSERT(!InspectCache::get(key, &out));
+
+	InspectData idata;
+	idata.doProxy = true;
+	idata.sharingKey = "GET|http://example.com/path?a=1";
+	idata.maxAge = 60;
+	TEST_ASSERT(InspectCache::put(key, idata));
+
+	TEST_ASSERT(InspectCache::get(key, &out));
+	TEST_ASSERT(out.doProxy);
+	TEST_ASSERT_EQ(out.sharingKey, QByteArray("GET|http://example.com/path?a=1"));
+
+	InspectCache::clear();
+	TEST_ASSERT(!InspectCache::get(key, &out));
+}
+
+static void notCacheable()
+{
+	InspectCache::clear();
+
+	QByteArray key = InspectCache::key(requestData("http://example.com/path"), false);
+
+	InspectData idata;
+	idata.doProxy = true;
+	TEST_ASSERT(!InspectCache::put(key, idata));
+
+	idata.maxAge = 0;
+	TEST_ASSERT(!InspectCache::put(key, idata));
+
+	InspectData out;
+	TEST_ASSERT(!InspectCache::get(key, &out));
+}
+
+static void keyFields()
+{
+	HttpRequestData a = requestData("http://example.com/path");
+	HttpRequestData b = a;
+
+	TEST_ASSERT_EQ(InspectCache::key(a, false), InspectCache::key(b, false));
+	TEST_ASSERT(InspectCache::key(a, false) != InspectCache::key(a, true));
+
+	b.method = "POST";
+	TEST_ASSERT(InspectCache::key(a, false) != InspectCache::key(b, false));
+
+	b = requestData("http://example.com/path?a=1");
+	TEST_ASSERT(InspectCache::key(a, false) != InspectCache::key(b, false));
+
+	// order of Grip-Last headers doesn't matter
+	a.headers += HttpHeader("Grip-Last", "apple; last-id=1");
+	a.headers += HttpHeader("Grip-Last", "banana; last-id=2");
+	b = requestData("http://example.com/path");
+	b.headers += HttpHeader("Grip-Last", "banana; last-id=2");
+	b.headers += HttpHeader("Grip-Last", "apple; last-id=1");
+	TEST_ASSERT_EQ(InspectCache::key(a, false), InspectCache::key(b, false));
+
+	// other headers don't matter
+	b.headers += HttpHeader("User-Agent", "test");
+	TEST_ASSERT_EQ(InspectCache::key(a, false), InspectCache::key(b, false));
+}
+
+extern "C" int inspectcache_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(storeAndLookup());
+	TEST_CATCH(notCacheable());
+	TEST_CATCH(keyFields());
+
+	InspectCache::clear();
+
+	return 0;
+}
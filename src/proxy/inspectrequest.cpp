@@ -99,6 +99,18 @@ static InspectData resultToData(const QVariant &in, bool *ok)
 
 	out.userData = obj["user-data"];
 
+	out.maxAge = -1;
+	if(obj.contains("max-age"))
+	{
+		if(!canConvert(obj["max-age"], QMetaType::Int))
+		{
+			*ok = false;
+			return InspectData();
+		}
+
+		out.maxAge = obj["max-age"].toInt();
+	}
+
 	*ok = true;
 	return out;
 }
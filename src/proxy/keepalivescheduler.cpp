@@ -0,0 +1,368 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "keepalivescheduler.h"
+
+#include <assert.h>
+#include <QDateTime>
+#include <QRandomGenerator>
+#include "timer.h"
+
+#define TICK_DURATION_MS 100
+#define UPDATE_TICKS_MAX 100
+#define EXPIRES_PER_CYCLE_MAX 100
+#define STARTS_PER_CYCLE_MAX 100
+#define DEFAULT_CAPACITY 10000
+
+class KeepAliveScheduler::Origin
+{
+public:
+	int outstanding;
+	QList<Item*> waiting;
+
+	Origin() :
+		outstanding(0)
+	{
+	}
+};
+
+KeepAliveScheduler::Item::Item() :
+	limit(0),
+	scheduler_(0),
+	timerId_(-1),
+	waiting_(false),
+	outstanding_(false)
+{
+}
+
+KeepAliveScheduler::Item::~Item()
+{
+	if(scheduler_)
+		scheduler_->detach(this);
+}
+
+void KeepAliveScheduler::Item::cancel()
+{
+	if(scheduler_)
+		scheduler_->cancel(this);
+}
+
+void KeepAliveScheduler::Item::finished()
+{
+	if(scheduler_)
+		scheduler_->finished(this);
+}
+
+KeepAliveScheduler::KeepAliveScheduler(int capacity) :
+	wheel_(TimerWheel(capacity)),
+	currentTicks_(0)
+{
+	startTime_ = QDateTime::currentMSecsSinceEpoch();
+
+	timer_ = std::make_unique<Timer>();
+	timer_->setSingleShot(true);
+
+	// safe to not track, since timer_ can't outlive this
+	timer_->timeout.connect([=] {
+		timer_timeout();
+	});
+}
+
+KeepAliveScheduler::~KeepAliveScheduler()
+{
+	foreach(Item *item, items_)
+	{
+		item->scheduler_ = 0;
+		item->timerId_ = -1;
+		item->waiting_ = false;
+		item->outstanding_ = false;
+		item->fallbackTimer_.reset();
+	}
+
+	qDeleteAll(origins_);
+}
+
+void KeepAliveScheduler::schedule(Item *item, int msec)
+{
+	cancel(item);
+
+	item->scheduler_ = this;
+	items_ += item;
+
+	// jitter, never later than requested
+	if(msec >= 10)
+		msec -= (int)(QRandomGenerator::global()->generate() % (quint32)(msec / 10 + 1));
+
+	qint64 currentTime = QDateTime::currentMSecsSinceEpoch();
+
+	// expireTime must be >= startTime_
+	qint64 expireTime = qMax(currentTime + msec, startTime_);
+
+	quint64 expiresTicks = (quint64)((expireTime - startTime_ + TICK_DURATION_MS - 1) / TICK_DURATION_MS);
+
+	int id = wheel_.add(expiresTicks, (size_t)item);
+	if(id < 0)
+	{
+		// wheel is full. fall back to a dedicated timer
+		if(!item->fallbackTimer_)
+		{
+			item->fallbackTimer_ = std::make_unique<Timer>();
+			item->fallbackTimer_->setSingleShot(true);
+
+			// safe to not track, since the timer can't outlive the item
+			item->fallbackTimer_->timeout.connect([=] {
+				expire(item);
+			});
+		}
+
+		item->fallbackTimer_->start(msec);
+		return;
+	}
+
+	item->timerId_ = id;
+
+	updateTimeout();
+}
+
+void KeepAliveScheduler::cancel(Item *item)
+{
+	if(item->timerId_ >= 0)
+	{
+		wheel_.remove(item->timerId_);
+		item->timerId_ = -1;
+
+		updateTimeout();
+	}
+
+	if(item->fallbackTimer_)
+		item->fallbackTimer_->stop();
+
+	if(item->waiting_)
+	{
+		item->waiting_ = false;
+
+		Origin *o = origins_.value(item->origin);
+		assert(o);
+
+		o->waiting.removeOne(item);
+		releaseOrigin(item->origin, o);
+	}
+}
+
+void KeepAliveScheduler::finished(Item *item)
+{
+	if(!item->outstanding_)
+		return;
+
+	item->outstanding_ = false;
+
+	Origin *o = origins_.value(item->origin);
+	assert(o);
+
+	--o->outstanding;
+
+	if(!o->waiting.isEmpty())
+	{
+		if(!ready_.contains(item->origin))
+			ready_ += item->origin;
+
+		updateTimeout();
+	}
+
+	releaseOrigin(item->origin, o);
+}
+
+int KeepAliveScheduler::outstanding(const QString &origin) const
+{
+	Origin *o = origins_.value(origin);
+
+	return o ? o->outstanding : 0;
+}
+
+void KeepAliveScheduler::timer_timeout()
+{
+	qint64 currentTime = QDateTime::currentMSecsSinceEpoch();
+
+	// time must go forward
+	if(currentTime > startTime_)
+	{
+		currentTicks_ = (quint64)((currentTime - startTime_) / TICK_DURATION_MS);
+
+		wheel_.update(currentTicks_);
+	}
+
+	// first let waiting items use freed slots
+	for(int i = 0; i < STARTS_PER_CYCLE_MAX && !ready_.isEmpty(); ++i)
+	{
+		QString name = ready_.first();
+
+		Origin *o = origins_.value(name);
+		if(!o || o->waiting.isEmpty())
+		{
+			ready_.removeFirst();
+			continue;
+		}
+
+		Item *item = o->waiting.first();
+		if(item->limit > 0 && o->outstanding >= item->limit)
+		{
+			ready_.removeFirst();
+			continue;
+		}
+
+		o->waiting.removeFirst();
+		item->waiting_ = false;
+
+		if(o->waiting.isEmpty())
+			ready_.removeFirst();
+
+		// may call back into the scheduler
+		start(item, o);
+	}
+
+	for(int i = 0; i < EXPIRES_PER_CYCLE_MAX; ++i)
+	{
+		TimerWheel::Expired expired = wheel_.takeExpired();
+
+		if(expired.key < 0)
+			break;
+
+		Item *item = (Item *)expired.userData;
+		item->timerId_ = -1;
+
+		expire(item);
+	}
+
+	updateTimeout();
+}
+
+void KeepAliveScheduler::updateTimeout()
+{
+	if(!ready_.isEmpty())
+	{
+		timer_->start(0);
+		return;
+	}
+
+	qint64 timeoutTicks = wheel_.timeout();
+
+	if(timeoutTicks >= 0)
+	{
+		qint64 currentTime = qMax(QDateTime::currentMSecsSinceEpoch(), startTime_);
+
+		quint64 currentTicks = (quint64)((currentTime - startTime_) / TICK_DURATION_MS);
+
+		// time must go forward
+		currentTicks = qMax(currentTicks, currentTicks_);
+
+		qint64 ticksSinceWheelUpdate = (qint64)(currentTicks - currentTicks_);
+
+		// reduce the timeout by the time already elapsed
+		timeoutTicks = qMax(timeoutTicks - ticksSinceWheelUpdate, (qint64)0);
+
+		// cap the timeout so the wheel is regularly updated
+		qint64 maxTimeoutTicks = qMax(UPDATE_TICKS_MAX - ticksSinceWheelUpdate, (qint64)0);
+		timeoutTicks = qMin(timeoutTicks, maxTimeoutTicks);
+
+		timer_->start((int)(timeoutTicks * TICK_DURATION_MS));
+	}
+	else
+	{
+		timer_->stop();
+	}
+}
+
+void KeepAliveScheduler::expire(Item *item)
+{
+	Origin *o = origin(item->origin);
+
+	if(item->limit > 0 && o->outstanding >= item->limit)
+	{
+		item->waiting_ = true;
+		o->waiting += item;
+		return;
+	}
+
+	start(item, o);
+}
+
+void KeepAliveScheduler::start(Item *item, Origin *o)
+{
+	++o->outstanding;
+	item->outstanding_ = true;
+
+	// item may be destroyed
+	item->fire();
+}
+
+KeepAliveScheduler::Origin *KeepAliveScheduler::origin(const QString &name)
+{
+	Origin *o = origins_.value(name);
+	if(!o)
+	{
+		o = new Origin;
+		origins_.insert(name, o);
+	}
+
+	return o;
+}
+
+void KeepAliveScheduler::releaseOrigin(const QString &name, Origin *o)
+{
+	if(o->outstanding == 0 && o->waiting.isEmpty())
+	{
+		origins_.remove(name);
+		ready_.removeAll(name);
+		delete o;
+	}
+}
+
+void KeepAliveScheduler::detach(Item *item)
+{
+	cancel(item);
+	finished(item);
+
+	items_.remove(item);
+	item->scheduler_ = 0;
+}
+
+static thread_local KeepAliveScheduler *g_instance = 0;
+static thread_local int g_capacity = DEFAULT_CAPACITY;
+
+KeepAliveScheduler *KeepAliveScheduler::instance()
+{
+	if(!g_instance)
+		g_instance = new KeepAliveScheduler(g_capacity);
+
+	return g_instance;
+}
+
+void KeepAliveScheduler::setCapacity(int capacity)
+{
+	g_capacity = capacity;
+}
+
+void KeepAliveScheduler::cleanup()
+{
+	delete g_instance;
+	g_instance = 0;
+}
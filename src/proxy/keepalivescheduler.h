@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef KEEPALIVESCHEDULER_H
+#define KEEPALIVESCHEDULER_H
+
+#include <functional>
+#include <memory>
+#include <QString>
+#include <QHash>
+#include <QSet>
+#include "timerwheel.h"
+
+class Timer;
+
+// schedules periodic keep-alives for many sessions using one timer wheel
+// and a single timer, rather than a timer per session. due times are
+// moved earlier by a random amount of up to a tenth of the interval, so
+// sessions started together don't stay in step. sessions sharing an
+// origin may be limited in how many keep-alives they have outstanding at
+// once, in which case the rest wait until one finishes
+class KeepAliveScheduler
+{
+public:
+	class Item
+	{
+	public:
+		QString origin;
+		int limit; // max outstanding for the origin, or 0 for no limit
+		std::function<void()> fire;
+
+		Item();
+		~Item();
+
+		void cancel();
+
+		// to call once the keep-alive started by fire is complete
+		void finished();
+
+	private:
+		friend class KeepAliveScheduler;
+
+		KeepAliveScheduler *scheduler_;
+		int timerId_;
+		bool waiting_;
+		bool outstanding_;
+		std::unique_ptr<Timer> fallbackTimer_;
+	};
+
+	KeepAliveScheduler(int capacity);
+	~KeepAliveScheduler();
+
+	// disable copying
+	KeepAliveScheduler(const KeepAliveScheduler &) = delete;
+	KeepAliveScheduler & operator=(const KeepAliveScheduler &) = delete;
+
+	// replaces any pending schedule for the item
+	void schedule(Item *item, int msec);
+
+	int outstanding(const QString &origin) const;
+
+	// thread local, created on first use
+	static KeepAliveScheduler *instance();
+	static void setCapacity(int capacity);
+	static void cleanup();
+
+private:
+	class Origin;
+	friend class Item;
+
+	TimerWheel wheel_;
+	qint64 startTime_;
+	quint64 currentTicks_;
+	std::unique_ptr<Timer> timer_;
+	QHash<QString, Origin*> origins_;
+	QList<QString> ready_; // origins with waiting items and a free slot
+	QSet<Item*> items_;
+
+	void cancel(Item *item);
+	void finished(Item *item);
+	void timer_timeout();
+	void updateTimeout();
+	void expire(Item *item);
+	void start(Item *item, Origin *o);
+	Origin *origin(const QString &name);
+	void releaseOrigin(const QString &name, Origin *o);
+	void detach(Item *item);
+};
+
+#endif
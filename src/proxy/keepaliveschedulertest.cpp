@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include <qtestsupport_core.h>
+#include "test.h"
+#include "timer.h"
+#include "defercall.h"
+#include "keepalivescheduler.h"
+
+static void limit()
+{
+	TestQCoreApplication qapp;
+	Timer::init(100);
+
+	{
+		KeepAliveScheduler s(100);
+
+		int aFired = 0;
+		KeepAliveScheduler::Item a;
+		a.origin = "http://example.com/ws";
+		a.limit = 1;
+		a.fire = [&] { ++aFired; };
+
+		int bFired = 0;
+		KeepAliveScheduler::Item b;
+		b.origin = a.origin;
+		b.limit = 1;
+		b.fire = [&] { ++bFired; };
+
+		int cFired = 0;
+		KeepAliveScheduler::Item c;
+		c.origin = "http://other.example.com/ws";
+		c.limit = 1;
+		c.fire = [&] { ++cFired; };
+
+		s.schedule(&a, 0);
+		s.schedule(&b, 0);
+		s.schedule(&c, 0);
+
+		for(int n = 0; n < 100 && (aFired + bFired < 1 || cFired < 1); ++n)
+			QTest::qWait(10);
+
+		// one of the first origin waits, the other origin is independent
+		TEST_ASSERT_EQ(aFired + bFired, 1);
+		TEST_ASSERT_EQ(cFired, 1);
+		TEST_ASSERT_EQ(s.outstanding(a.origin), 1);
+
+		QTest::qWait(200);
+		TEST_ASSERT_EQ(aFired + bFired, 1);
+
+		if(aFired)
+			a.finished();
+		else
+			b.finished();
+
+		for(int n = 0; n < 100 && aFired + bFired < 2; ++n)
+			QTest::qWait(10);
+
+		TEST_ASSERT_EQ(aFired, 1);
+		TEST_ASSERT_EQ(bFired, 1);
+		TEST_ASSERT_EQ(s.outstanding(a.origin), 1);
+
+		a.finished();
+		b.finished();
+		c.finished();
+		TEST_ASSERT_EQ(s.outstanding(a.origin), 0);
+	}
+
+	DeferCall::cleanup();
+	Timer::deinit();
+}
+
+static void cancel()
+{
+	TestQCoreApplication qapp;
+	Timer::init(100);
+
+	{
+		KeepAliveScheduler s(100);
+
+		int fired = 0;
+		KeepAliveScheduler::Item a;
+		a.origin = "http://example.com/ws";
+		a.fire = [&] { ++fired; };
+
+		s.schedule(&a, 100);
+		a.cancel();
+
+		QTest::qWait(300);
+		TEST_ASSERT_EQ(fired, 0);
+
+		// an item going away while waiting releases its place
+		{
+			KeepAliveScheduler::Item b;
+			b.origin = a.origin;
+			b.fire = [&] {};
+			s.schedule(&b, 100);
+		}
+
+		QTest::qWait(300);
+		TEST_ASSERT_EQ(s.outstanding(a.origin), 0);
+	}
+
+	DeferCall::cleanup();
+	Timer::deinit();
+}
+
+extern "C" int keepalivescheduler_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(limit());
+	TEST_CATCH(cancel());
+
+	return 0;
+}
@@ -34,6 +34,61 @@ mod tests {
         unsafe { ffi::proxyengine_test(out_ex) == 0 }
     }
 
+    fn pathtrie_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::pathtrie_test(out_ex) == 0 }
+    }
+
+    fn targetbalancer_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::targetbalancer_test(out_ex) == 0 }
+    }
+
+    fn responsecache_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::responsecache_test(out_ex) == 0 }
+    }
+
+    fn keepalivescheduler_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::keepalivescheduler_test(out_ex) == 0 }
+    }
+
+    fn sockjsmanager_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::sockjsmanager_test(out_ex) == 0 }
+    }
+
+    fn inspectcache_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::inspectcache_test(out_ex) == 0 }
+    }
+
+    fn admissioncontroller_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::admissioncontroller_test(out_ex) == 0 }
+    }
+
+    fn concurrencylimit_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::concurrencylimit_test(out_ex) == 0 }
+    }
+
+    fn zroutes_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::zroutes_test(out_ex) == 0 }
+    }
+
+    fn sharedrequests_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::sharedrequests_test(out_ex) == 0 }
+    }
+
+    fn workerload_test(out_ex: &mut TestException) -> bool {
+        // SAFETY: safe to call
+        unsafe { ffi::workerload_test(out_ex) == 0 }
+    }
+
     #[test]
     fn websocketoverhttp() {
         run_serial(websocketoverhttp_test);
@@ -48,4 +103,59 @@ mod tests {
     fn proxyengine() {
         run_serial(proxyengine_test);
     }
+
+    #[test]
+    fn pathtrie() {
+        run_serial(pathtrie_test);
+    }
+
+    #[test]
+    fn targetbalancer() {
+        run_serial(targetbalancer_test);
+    }
+
+    #[test]
+    fn responsecache() {
+        run_serial(responsecache_test);
+    }
+
+    #[test]
+    fn keepalivescheduler() {
+        run_serial(keepalivescheduler_test);
+    }
+
+    #[test]
+    fn sockjsmanager() {
+        run_serial(sockjsmanager_test);
+    }
+
+    #[test]
+    fn inspectcache() {
+        run_serial(inspectcache_test);
+    }
+
+    #[test]
+    fn admissioncontroller() {
+        run_serial(admissioncontroller_test);
+    }
+
+    #[test]
+    fn concurrencylimit() {
+        run_serial(concurrencylimit_test);
+    }
+
+    #[test]
+    fn zroutes() {
+        run_serial(zroutes_test);
+    }
+
+    #[test]
+    fn sharedrequests() {
+        run_serial(sharedrequests_test);
+    }
+
+    #[test]
+    fn workerload() {
+        run_serial(workerload_test);
+    }
 }
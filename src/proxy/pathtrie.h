@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef PATHTRIE_H
+#define PATHTRIE_H
+
+#include <string.h>
+#include <vector>
+#include <QByteArray>
+
+// radix tree keyed on byte strings, for finding all keys that are a prefix
+// of a given path. lookup cost depends on the length of the path rather
+// than the number of keys. values stored under the same key are kept in
+// insertion order
+template <typename T> class PathTrie
+{
+public:
+	PathTrie() :
+		nodes_(1)
+	{
+	}
+
+	bool isEmpty() const
+	{
+		return nodes_.size() == 1 && nodes_[0].values.empty();
+	}
+
+	void insert(const QByteArray &key, const T &value)
+	{
+		int n = 0;
+		int pos = 0;
+
+		while(pos < key.size())
+		{
+			int c = findChild(n, key[pos]);
+			if(c == -1)
+			{
+				c = addNode(key.mid(pos));
+				nodes_[n].children.push_back(c);
+				n = c;
+				break;
+			}
+
+			int common = commonPrefix(nodes_[c].label, key, pos);
+
+			if(common < nodes_[c].label.size())
+			{
+				// split the edge, so there is a node where the key ends
+				// or diverges
+				int m = addNode(nodes_[c].label.left(common));
+				nodes_[c].label = nodes_[c].label.mid(common);
+				nodes_[m].children.push_back(c);
+				replaceChild(n, c, m);
+				c = m;
+			}
+
+			n = c;
+			pos += common;
+		}
+
+		nodes_[n].values.push_back(value);
+	}
+
+	// calls f for each value whose key is a prefix of path, from the
+	// shortest key to the longest
+	template <typename F> void forEachPrefix(const QByteArray &path, F f) const
+	{
+		int n = 0;
+		int pos = 0;
+
+		while(true)
+		{
+			for(const T &v : nodes_[n].values)
+				f(v);
+
+			if(pos >= path.size())
+				break;
+
+			int c = findChild(n, path[pos]);
+			if(c == -1)
+				break;
+
+			const QByteArray &label = nodes_[c].label;
+			if(path.size() - pos < label.size() || memcmp(path.constData() + pos, label.constData(), label.size()) != 0)
+				break;
+
+			n = c;
+			pos += label.size();
+		}
+	}
+
+private:
+	class Node
+	{
+	public:
+		QByteArray label; // edge from the parent
+		std::vector<int> children;
+		std::vector<T> values;
+	};
+
+	std::vector<Node> nodes_; // first is the root
+
+	int addNode(const QByteArray &label)
+	{
+		Node node;
+		node.label = label;
+		nodes_.push_back(node);
+		return (int)nodes_.size() - 1;
+	}
+
+	// children never share a first byte
+	int findChild(int n, char first) const
+	{
+		for(int c : nodes_[n].children)
+		{
+			if(nodes_[c].label[0] == first)
+				return c;
+		}
+
+		return -1;
+	}
+
+	void replaceChild(int n, int from, int to)
+	{
+		for(int &c : nodes_[n].children)
+		{
+			if(c == from)
+			{
+				c = to;
+				return;
+			}
+		}
+	}
+
+	static int commonPrefix(const QByteArray &label, const QByteArray &key, int pos)
+	{
+		int max = qMin(label.size(), key.size() - pos);
+
+		int n = 0;
+		while(n < max && label[n] == key[pos + n])
+			++n;
+
+		return n;
+	}
+};
+
+#endif
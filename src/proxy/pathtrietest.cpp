@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include <vector>
+#include "test.h"
+#include "pathtrie.h"
+
+static std::vector<int> prefixes(const PathTrie<int> &trie, const QByteArray &path)
+{
+	std::vector<int> out;
+	trie.forEachPrefix(path, [&](int v) {
+		out.push_back(v);
+	});
+
+	return out;
+}
+
+static void lookup()
+{
+	PathTrie<int> trie;
+	TEST_ASSERT(trie.isEmpty());
+	TEST_ASSERT(prefixes(trie, "/foo").empty());
+
+	trie.insert("/api/", 1);
+	trie.insert("/api/v1/", 2);
+	trie.insert("", 3);
+	trie.insert("/apx", 4);
+
+	TEST_ASSERT(!trie.isEmpty());
+
+	std::vector<int> out = prefixes(trie, "/api/v1/items");
+	TEST_ASSERT_EQ((int)out.size(), 3);
+	TEST_ASSERT_EQ(out[0], 3);
+	TEST_ASSERT_EQ(out[1], 1);
+	TEST_ASSERT_EQ(out[2], 2);
+
+	out = prefixes(trie, "/api/v2/items");
+	TEST_ASSERT_EQ((int)out.size(), 2);
+	TEST_ASSERT_EQ(out[1], 1);
+
+	out = prefixes(trie, "/apx");
+	TEST_ASSERT_EQ((int)out.size(), 2);
+	TEST_ASSERT_EQ(out[1], 4);
+
+	// a key longer than the path does not match
+	out = prefixes(trie, "/ap");
+	TEST_ASSERT_EQ((int)out.size(), 1);
+	TEST_ASSERT_EQ(out[0], 3);
+}
+
+static void splitEdges()
+{
+	PathTrie<int> trie;
+
+	// inserting shorter keys after longer ones splits existing edges
+	trie.insert("/abcdef", 1);
+	trie.insert("/abc", 2);
+	trie.insert("/abx", 3);
+	trie.insert("/abc", 4);
+
+	std::vector<int> out = prefixes(trie, "/abcdefg");
+	TEST_ASSERT_EQ((int)out.size(), 3);
+	TEST_ASSERT_EQ(out[0], 2);
+	TEST_ASSERT_EQ(out[1], 4);
+	TEST_ASSERT_EQ(out[2], 1);
+
+	out = prefixes(trie, "/abxyz");
+	TEST_ASSERT_EQ((int)out.size(), 1);
+	TEST_ASSERT_EQ(out[0], 3);
+
+	TEST_ASSERT(prefixes(trie, "/ab").empty());
+	TEST_ASSERT(prefixes(trie, "/abd").empty());
+}
+
+extern "C" int pathtrie_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(lookup());
+	TEST_CATCH(splitEdges());
+
+	return 0;
+}
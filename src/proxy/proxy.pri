@@ -1,18 +1,28 @@
 HEADERS += \
 	$$PWD/testhttprequest.h \
+	$$PWD/cachedhttprequest.h \
+	$$PWD/responsecache.h \
+	$$PWD/sharedrequests.h \
+	$$PWD/workerload.h \
 	$$PWD/testwebsocket.h \
+	$$PWD/keepalivescheduler.h \
 	$$PWD/websocketoverhttp.h \
 	$$PWD/zrpcchecker.h \
 	$$PWD/sockjsmanager.h \
 	$$PWD/sockjssession.h \
 	$$PWD/inspectrequest.h \
+	$$PWD/inspectcache.h \
 	$$PWD/acceptrequest.h \
 	$$PWD/connectionmanager.h \
 	$$PWD/wscontrolmanager.h \
 	$$PWD/wscontrolsession.h \
 	$$PWD/acceptdata.h \
 	$$PWD/routesfile.h \
+	$$PWD/pathtrie.h \
 	$$PWD/domainmap.h \
+	$$PWD/targetbalancer.h \
+	$$PWD/admissioncontroller.h \
+	$$PWD/concurrencylimit.h \
 	$$PWD/zroutes.h \
 	$$PWD/xffrule.h \
 	$$PWD/requestsession.h \
@@ -26,18 +36,27 @@ HEADERS += \
 
 SOURCES += \
 	$$PWD/testhttprequest.cpp \
+	$$PWD/cachedhttprequest.cpp \
+	$$PWD/responsecache.cpp \
+	$$PWD/sharedrequests.cpp \
+	$$PWD/workerload.cpp \
 	$$PWD/testwebsocket.cpp \
+	$$PWD/keepalivescheduler.cpp \
 	$$PWD/websocketoverhttp.cpp \
 	$$PWD/zrpcchecker.cpp \
 	$$PWD/sockjsmanager.cpp \
 	$$PWD/sockjssession.cpp \
 	$$PWD/inspectrequest.cpp \
+	$$PWD/inspectcache.cpp \
 	$$PWD/acceptrequest.cpp \
 	$$PWD/connectionmanager.cpp \
 	$$PWD/wscontrolmanager.cpp \
 	$$PWD/wscontrolsession.cpp \
 	$$PWD/routesfile.cpp \
 	$$PWD/domainmap.cpp \
+	$$PWD/targetbalancer.cpp \
+	$$PWD/admissioncontroller.cpp \
+	$$PWD/concurrencylimit.cpp \
 	$$PWD/zroutes.cpp \
 	$$PWD/requestsession.cpp \
 	$$PWD/proxyutil.cpp \
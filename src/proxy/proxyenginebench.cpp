@@ -0,0 +1,575 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+#include <boost/signals2.hpp>
+#include <QDir>
+#include <QSet>
+#include <QHash>
+#include <QUrlQuery>
+#include "bench.h"
+#include "qzmqsocket.h"
+#include "qzmqvalve.h"
+#include "qzmqreqmessage.h"
+#include "log.h"
+#include "tnetstring.h"
+#include "zhttprequestpacket.h"
+#include "zhttpresponsepacket.h"
+#include "eventloop.h"
+#include "timer.h"
+#include "defercall.h"
+#include "domainmap.h"
+#include "engine.h"
+
+// count allocations made through operator new, to report allocations per
+// request. this replaces the global operators for the whole bench binary.
+// qt containers allocate with malloc, so their buffers are not included
+static std::atomic<unsigned long long> g_allocs(0);
+
+void *operator new(size_t size)
+{
+	g_allocs.fetch_add(1, std::memory_order_relaxed);
+
+	void *p = malloc(size > 0 ? size : 1);
+	if(!p)
+		throw std::bad_alloc();
+
+	return p;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+	free(p);
+}
+
+namespace {
+
+// plays the connection manager, the origin server and the handler around
+// an engine, with the same socket layout as the engine tests. unlike the
+// tests, it keeps state per request id so that requests can overlap
+class Harness
+{
+public:
+	std::unique_ptr<QZmq::Socket> zhttpClientOutSock;
+	std::unique_ptr<QZmq::Socket> zhttpClientOutStreamSock;
+	std::unique_ptr<QZmq::Socket> zhttpClientInSock;
+	std::unique_ptr<QZmq::Valve> zhttpClientInValve;
+	std::unique_ptr<QZmq::Socket> zhttpServerInSock;
+	std::unique_ptr<QZmq::Valve> zhttpServerInValve;
+	std::unique_ptr<QZmq::Socket> zhttpServerInStreamSock;
+	std::unique_ptr<QZmq::Valve> zhttpServerInStreamValve;
+	std::unique_ptr<QZmq::Socket> zhttpServerOutSock;
+
+	std::unique_ptr<QZmq::Socket> handlerInspectSock;
+	std::unique_ptr<QZmq::Valve> handlerInspectValve;
+	std::unique_ptr<QZmq::Socket> handlerAcceptSock;
+	std::unique_ptr<QZmq::Valve> handlerAcceptValve;
+	std::unique_ptr<QZmq::Socket> handlerRetryOutSock;
+
+	QDir workDir;
+	int nextId;
+	int finished; // client requests completed, or held requests accepted
+	QSet<QByteArray> clientWs;
+	QHash<QByteArray, ZhttpRequestPacket> serverReqs;
+	QHash<QByteArray, int> serverOutSeqs;
+	Connection zhttpClientInValveConnection;
+	Connection zhttpServerInValveConnection;
+	Connection zhttpServerInStreamValveConnection;
+	Connection handlerAcceptValveConnection;
+	Connection handlerInspectValveConnection;
+
+	Harness(const QDir &_workDir) :
+		workDir(_workDir),
+		nextId(0),
+		finished(0)
+	{
+		// http sockets
+
+		zhttpClientOutSock = std::make_unique<QZmq::Socket>(QZmq::Socket::Push);
+
+		zhttpClientOutStreamSock = std::make_unique<QZmq::Socket>(QZmq::Socket::Router);
+
+		zhttpClientInSock = std::make_unique<QZmq::Socket>(QZmq::Socket::Sub);
+		zhttpClientInValve = std::make_unique<QZmq::Valve>(zhttpClientInSock.get());
+		zhttpClientInValveConnection = zhttpClientInValve->readyRead.connect(boost::bind(&Harness::zhttpClientIn_readyRead, this, boost::placeholders::_1));
+
+		zhttpServerInSock = std::make_unique<QZmq::Socket>(QZmq::Socket::Pull);
+		zhttpServerInValve = std::make_unique<QZmq::Valve>(zhttpServerInSock.get());
+		zhttpServerInValveConnection = zhttpServerInValve->readyRead.connect(boost::bind(&Harness::zhttpServerIn_readyRead, this, boost::placeholders::_1));
+
+		zhttpServerInStreamSock = std::make_unique<QZmq::Socket>(QZmq::Socket::Router);
+		zhttpServerInStreamSock->setIdentity("test-server");
+		zhttpServerInStreamValve = std::make_unique<QZmq::Valve>(zhttpServerInStreamSock.get());
+		zhttpServerInStreamValveConnection = zhttpServerInStreamValve->readyRead.connect(boost::bind(&Harness::zhttpServerInStream_readyRead, this, boost::placeholders::_1));
+
+		zhttpServerOutSock = std::make_unique<QZmq::Socket>(QZmq::Socket::Pub);
+
+		// handler sockets
+
+		handlerInspectSock = std::make_unique<QZmq::Socket>(QZmq::Socket::Router);
+		handlerInspectValve = std::make_unique<QZmq::Valve>(handlerInspectSock.get());
+		handlerInspectValveConnection = handlerInspectValve->readyRead.connect(boost::bind(&Harness::handlerInspect_readyRead, this, boost::placeholders::_1));
+
+		handlerAcceptSock = std::make_unique<QZmq::Socket>(QZmq::Socket::Router);
+		handlerAcceptValve = std::make_unique<QZmq::Valve>(handlerAcceptSock.get());
+		handlerAcceptValveConnection = handlerAcceptValve->readyRead.connect(boost::bind(&Harness::handlerAccept_readyRead, this, boost::placeholders::_1));
+
+		handlerRetryOutSock = std::make_unique<QZmq::Socket>(QZmq::Socket::Router);
+	}
+
+	QString spec(const QString &name) const
+	{
+		return "ipc://" + workDir.filePath(name);
+	}
+
+	void startHttp()
+	{
+		zhttpClientOutSock->bind(spec("client-out"));
+		zhttpClientOutStreamSock->bind(spec("client-out-stream"));
+		zhttpClientInSock->bind(spec("client-in"));
+		zhttpServerInSock->bind(spec("server-in"));
+		zhttpServerInStreamSock->bind(spec("server-in-stream"));
+		zhttpServerOutSock->bind(spec("server-out"));
+
+		zhttpClientInSock->subscribe("test-client ");
+
+		zhttpClientInValve->open();
+		zhttpServerInValve->open();
+		zhttpServerInStreamValve->open();
+	}
+
+	void startHandler()
+	{
+		handlerInspectSock->connectToAddress(spec("inspect"));
+		handlerAcceptSock->connectToAddress(spec("accept"));
+		handlerRetryOutSock->connectToAddress(spec("retry-out"));
+
+		handlerInspectValve->open();
+		handlerAcceptValve->open();
+	}
+
+	void request(const QString &uri)
+	{
+		QByteArray id = "bench-" + QByteArray::number(nextId++);
+
+		ZhttpRequestPacket zreq;
+		zreq.from = "test-client";
+		zreq.ids += ZhttpRequestPacket::Id(id, 0);
+		zreq.type = ZhttpRequestPacket::Data;
+		zreq.uri = uri;
+		zreq.headers += HttpHeader("Host", "example");
+		zreq.stream = true;
+		zreq.credits = 200000;
+
+		if(zreq.uri.scheme() == "ws")
+			clientWs += id;
+		else
+			zreq.method = "GET";
+
+		zhttpClientOutSock->write(QList<QByteArray>() << ('T' + TnetString::fromVariant(zreq.toVariant())));
+	}
+
+private:
+	void writeClientStream(const QByteArray &id, ZhttpRequestPacket::Type type)
+	{
+		ZhttpRequestPacket zreq;
+		zreq.from = "test-client";
+		zreq.ids += ZhttpRequestPacket::Id(id, 1);
+		zreq.type = type;
+
+		QList<QByteArray> msg;
+		msg.append("proxy");
+		msg.append(QByteArray());
+		msg.append('T' + TnetString::fromVariant(zreq.toVariant()));
+		zhttpClientOutStreamSock->write(msg);
+	}
+
+	void writeServer(const QByteArray &to, const QByteArray &id, ZhttpResponsePacket &zresp)
+	{
+		zresp.from = "test-server";
+		zresp.ids += ZhttpResponsePacket::Id(id, serverOutSeqs[id]++);
+
+		zhttpServerOutSock->write(QList<QByteArray>() << (to + " T" + TnetString::fromVariant(zresp.toVariant())));
+	}
+
+	void zhttpClientIn_readyRead(const QList<QByteArray> &message)
+	{
+		int at = message[0].indexOf(' ');
+		ZhttpResponsePacket zresp;
+		if(!zresp.fromVariant(TnetString::toVariant(message[0].mid(at + 2))) || zresp.ids.isEmpty())
+			return;
+
+		QByteArray id = zresp.ids.first().id;
+
+		if(zresp.type == ZhttpResponsePacket::Data)
+		{
+			if(clientWs.contains(id))
+			{
+				// close once the message from the origin arrives
+				if(!zresp.body.isEmpty())
+					writeClientStream(id, ZhttpRequestPacket::Close);
+			}
+			else if(!zresp.more)
+			{
+				++finished;
+			}
+		}
+		else if(zresp.type == ZhttpResponsePacket::HandoffStart)
+		{
+			writeClientStream(id, ZhttpRequestPacket::HandoffProceed);
+		}
+		else if(zresp.type == ZhttpResponsePacket::Close)
+		{
+			clientWs.remove(id);
+			++finished;
+		}
+	}
+
+	void zhttpServerIn_readyRead(const QList<QByteArray> &message)
+	{
+		ZhttpRequestPacket zreq;
+		if(!zreq.fromVariant(TnetString::toVariant(message[0].mid(1))) || zreq.ids.isEmpty())
+			return;
+
+		serverReqs[zreq.ids.first().id] = zreq;
+
+		handleServerIn(zreq, true);
+	}
+
+	void zhttpServerInStream_readyRead(const QList<QByteArray> &message)
+	{
+		ZhttpRequestPacket zreq;
+		if(!zreq.fromVariant(TnetString::toVariant(message[2].mid(1))) || zreq.ids.isEmpty())
+			return;
+
+		handleServerIn(zreq, false);
+	}
+
+	// first is set for the packet that starts a request, which is stored
+	// with its body in serverReqs
+	void handleServerIn(const ZhttpRequestPacket &zreq, bool first)
+	{
+		QByteArray id = zreq.ids.first().id;
+
+		if(!serverReqs.contains(id))
+			return;
+
+		ZhttpRequestPacket &req = serverReqs[id];
+		bool isWs = (req.uri.scheme() == "ws");
+
+		if(zreq.type == ZhttpRequestPacket::Cancel)
+		{
+			finishServer(id);
+			return;
+		}
+
+		if(zreq.type == ZhttpRequestPacket::Close)
+		{
+			ZhttpResponsePacket zresp;
+			zresp.type = ZhttpResponsePacket::Close;
+			writeServer(req.from, id, zresp);
+
+			finishServer(id);
+			return;
+		}
+
+		if(zreq.type != ZhttpRequestPacket::Data)
+			return;
+
+		if(isWs)
+		{
+			// messages from the client are ignored
+			if(!first)
+				return;
+
+			// accept websocket
+			ZhttpResponsePacket zresp;
+			zresp.type = ZhttpResponsePacket::Data;
+			zresp.code = 101;
+			zresp.reason = "Switching Protocols";
+			zresp.credits = 200000;
+			writeServer(req.from, id, zresp);
+
+			// send message
+			zresp = ZhttpResponsePacket();
+			zresp.type = ZhttpResponsePacket::Data;
+			zresp.body = "hello world";
+			writeServer(req.from, id, zresp);
+
+			return;
+		}
+
+		if(!first)
+			req.body += zreq.body;
+
+		if(zreq.more)
+		{
+			// ack
+			if(!serverOutSeqs.contains(id))
+			{
+				ZhttpResponsePacket zresp;
+				zresp.type = ZhttpResponsePacket::Credit;
+				zresp.credits = 200000;
+				writeServer(req.from, id, zresp);
+			}
+
+			return;
+		}
+
+		ZhttpResponsePacket zresp;
+		zresp.type = ZhttpResponsePacket::Data;
+		zresp.code = 200;
+		zresp.reason = "OK";
+
+		if(req.headers.get("Content-Type") == "application/websocket-events")
+		{
+			// websocket-over-http. open with a message, and confirm a close
+			zresp.headers += HttpHeader("Content-Type", "application/websocket-events");
+
+			if(req.body.startsWith("OPEN\r\n"))
+				zresp.body = "OPEN\r\nTEXT b\r\nhello world\r\n";
+			else if(req.body.contains("CLOSE"))
+				zresp.body = "CLOSE\r\n";
+		}
+		else if(QUrlQuery(req.uri.query()).queryItemValue("hold") == "response")
+		{
+			zresp.headers += HttpHeader("Grip-Hold", "response");
+			zresp.headers += HttpHeader("Grip-Channel", "test-channel");
+		}
+		else
+		{
+			zresp.headers += HttpHeader("Content-Type", "text/plain");
+			zresp.body = "hello world";
+		}
+
+		zresp.headers += HttpHeader("Content-Length", QByteArray::number(zresp.body.size()));
+		writeServer(req.from, id, zresp);
+
+		finishServer(id);
+	}
+
+	void finishServer(const QByteArray &id)
+	{
+		serverReqs.remove(id);
+		serverOutSeqs.remove(id);
+	}
+
+	void handlerInspect_readyRead(const QList<QByteArray> &_message)
+	{
+		QZmq::ReqMessage message(_message);
+		QVariantHash vreq = TnetString::toVariant(message.content()[0]).toHash();
+
+		QVariantHash respValue;
+		respValue["no-proxy"] = false;
+
+		// requests to the same shared path can be served by one origin request
+		QByteArray path = vreq["args"].toHash()["uri"].toByteArray();
+		if(path.contains("/shared"))
+			respValue["sharing-key"] = QByteArray("shared");
+
+		QVariantHash vresp;
+		vresp["id"] = vreq["id"];
+		vresp["success"] = true;
+		vresp["value"] = respValue;
+		handlerInspectSock->write(message.createReply(QList<QByteArray>() << TnetString::fromVariant(vresp)).toRawMessage());
+	}
+
+	void handlerAccept_readyRead(const QList<QByteArray> &_message)
+	{
+		QZmq::ReqMessage message(_message);
+		QVariantHash vreq = TnetString::toVariant(message.content()[0]).toHash();
+
+		if(vreq["method"].toString() != "accept")
+			return;
+
+		QVariantHash respValue;
+		respValue["accepted"] = true;
+
+		QVariantHash vresp;
+		vresp["id"] = vreq["id"];
+		vresp["success"] = true;
+		vresp["value"] = respValue;
+		handlerAcceptSock->write(message.createReply(QList<QByteArray>() << TnetString::fromVariant(vresp)).toRawMessage());
+
+		++finished;
+	}
+};
+
+}
+
+static void waitFor(EventLoop *loop, int msecs)
+{
+	bool done = false;
+
+	Timer t;
+	t.setSingleShot(true);
+	Connection c = t.timeout.connect([&] { done = true; });
+	t.start(msecs);
+
+	while(!done)
+		loop->step();
+}
+
+// each call starts requests and runs the loop until count of them finish,
+// then reports operator new calls per request over some more calls
+template <typename F>
+static void runRequests(const Bench &bench, const char *name, int calls, EventLoop *loop, Harness *h, int count, F start)
+{
+	if(!bench.selected(name))
+		return;
+
+	auto fn = [&] {
+		int target = h->finished + count;
+
+		start();
+
+		while(h->finished < target)
+			loop->step();
+	};
+
+	bench.run(name, calls, count, fn);
+
+	int extra = std::max(calls / 10, 1);
+
+	unsigned long long before = g_allocs.load(std::memory_order_relaxed);
+
+	for(int n = 0; n < extra; ++n)
+		fn();
+
+	unsigned long long allocs = g_allocs.load(std::memory_order_relaxed) - before;
+
+	printf("%-40s %14.1f allocs/op\n", name, (double)allocs / ((double)extra * count));
+	fflush(stdout);
+}
+
+static void scenarios(const Bench &bench, EventLoop *loop, const QDir &workDir)
+{
+	Harness h(workDir);
+	h.startHttp();
+
+	DomainMap domainMap(true);
+	domainMap.addRouteLine("* origin:80");
+	domainMap.addRouteLine("*,path_beg=/woh,over_http origin:80");
+
+	Engine engine(&domainMap);
+
+	Engine::Configuration config;
+	config.clientId = "proxy";
+	config.serverInSpecs = QStringList() << h.spec("client-out");
+	config.serverInStreamSpecs = QStringList() << h.spec("client-out-stream");
+	config.serverOutSpecs = QStringList() << h.spec("client-in");
+	config.clientOutSpecs = QStringList() << h.spec("server-in");
+	config.clientOutStreamSpecs = QStringList() << h.spec("server-in-stream");
+	config.clientInSpecs = QStringList() << h.spec("server-out");
+	config.inspectSpec = h.spec("inspect");
+	config.acceptSpec = h.spec("accept");
+	config.retryInSpec = h.spec("retry-out");
+	config.statsSpec = h.spec("stats");
+	config.sessionsMax = 1000;
+	config.inspectTimeout = 500;
+	config.inspectPrefetch = 100;
+	config.sigIss = "pushpin";
+	config.sigKey = Jwt::EncodingKey::fromSecret("changeme");
+	config.statsConnectionTtl = 120;
+	config.statsReportInterval = 1000;
+
+	if(!engine.start(config))
+	{
+		printf("proxyengine: failed to start engine\n");
+		return;
+	}
+
+	h.startHandler();
+
+	// let the sockets connect
+	waitFor(loop, 500);
+
+	runRequests(bench, "proxyengine/passthrough", 2000, loop, &h, 1, [&] {
+		h.request("http://example/path");
+	});
+
+	runRequests(bench, "proxyengine/accept-hold", 2000, loop, &h, 1, [&] {
+		h.request("http://example/path?hold=response");
+	});
+
+	// one origin request serves all of them
+	runRequests(bench, "proxyengine/shared-10", 500, loop, &h, 10, [&] {
+		for(int n = 0; n < 10; ++n)
+			h.request("http://example/shared");
+	});
+
+	runRequests(bench, "proxyengine/websocket", 2000, loop, &h, 1, [&] {
+		h.request("ws://example/path");
+	});
+
+	runRequests(bench, "proxyengine/websocket-over-http", 2000, loop, &h, 1, [&] {
+		h.request("ws://example/woh");
+	});
+}
+
+extern "C" void proxyengine_bench(const char *filter)
+{
+	Bench bench(filter);
+
+	if(!bench.selected("proxyengine/"))
+		return;
+
+	log_setOutputLevel(LOG_LEVEL_WARNING);
+
+	QDir workDir(QDir::temp().filePath(QString("pushpin-proxyengine-bench-%1").arg(getpid())));
+	workDir.mkpath(".");
+
+	{
+		// registrations are allocated as needed
+		EventLoop loop(1000, 0);
+
+		scenarios(bench, &loop, workDir);
+
+		DeferCall::cleanup();
+	}
+
+	workDir.removeRecursively();
+}
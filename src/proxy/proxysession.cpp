@@ -24,28 +24,42 @@
 #include "proxysession.h"
 
 #include <assert.h>
+#include <atomic>
 #include <QSet>
 #include <QUrl>
 #include <QHostAddress>
+#include <QRandomGenerator>
 #include "packet/statspacket.h"
 #include "packet/httprequestdata.h"
 #include "packet/httpresponsedata.h"
 #include "qtcompat.h"
 #include "bufferlist.h"
 #include "log.h"
+#include "trace.h"
+#include "tracecontext.h"
 #include "jwt.h"
 #include "inspectdata.h"
 #include "acceptdata.h"
 #include "zhttpmanager.h"
 #include "zhttprequest.h"
 #include "zroutes.h"
+#include "targetbalancer.h"
 #include "statusreasons.h"
 #include "xffrule.h"
 #include "requestsession.h"
+#include "arena.h"
 #include "proxyutil.h"
 #include "statsmanager.h"
 #include "acceptrequest.h"
 #include "testhttprequest.h"
+#include "cachedhttprequest.h"
+#include "responsecache.h"
+#include "sharedrequests.h"
+#include "admissioncontroller.h"
+#include "concurrencylimit.h"
+#include "timer.h"
+#include "loopclock.h"
+#include "latencyhistogram.h"
 
 using std::map;
 
@@ -57,6 +71,11 @@ using std::map;
 #define MAX_INITIAL_BUFFER 100000
 #define MAX_STREAM_BUFFER 100000
 
+// how responses were handled, across all sessions
+static std::atomic<quint64> g_responsesAccepted(0);
+static std::atomic<quint64> g_responsesBuffered(0);
+static std::atomic<quint64> g_responsesStreamed(0);
+
 class ProxySession::Private
 {
 public:
@@ -124,8 +143,14 @@ public:
 	RequestSession *inRequest;
 	ZrpcManager *acceptManager;
 	bool isHttps;
-	DomainMap::Entry route;
+	std::shared_ptr<const DomainMap::Entry> route;
 	QList<DomainMap::Target> targets;
+	std::unique_ptr<TargetHealth::Outstanding> outstanding;
+	std::unique_ptr<ConcurrencyLimit::Ticket> routeTicket;
+	std::unique_ptr<ConcurrencyLimit::Ticket> targetTicket;
+	bool targetsBusy;
+	std::unique_ptr<Timer> queueTimer;
+	Connection queueTimerConnection;
 	DomainMap::Target target;
 	std::unique_ptr<HttpRequest> zhttpRequest;
 	bool addAllowed;
@@ -142,15 +167,22 @@ public:
 	BufferList requestBody;
 	BufferList responseBody;
 	QHash<RequestSession*, SessionItem*> sessionItemsBySession;
-	QByteArray initialRequestBody;
+	BufferList initialRequestBody;
 	bool requestBodySent;
 	int total;
 	bool buffering;
+	bool streamResponse;
 	QByteArray defaultSigIss;
 	Jwt::EncodingKey defaultSigKey;
 	bool trustedClient;
 	bool intReq;
 	bool passthrough;
+	bool useCache;
+	bool fromCache;
+	QByteArray cacheKey;
+	HttpHeaders cacheRequestHeaders;
+	QByteArray sharedKey;
+	std::shared_ptr<const ResponseCache::Item> sharedResponse;
 	bool acceptXForwardedProtocol;
 	bool useXForwardedProto;
 	bool useXForwardedProtocol;
@@ -159,9 +191,25 @@ public:
 	QList<QByteArray> origHeadersNeedMark;
 	bool acceptPushpinRoute;
 	QByteArray cdnLoop;
+	int traceSampleRate;
+	TraceContext trace;
+	quint64 traceStart;
+	bool acceptCompact;
 	bool proxyInitialResponse;
 	bool acceptAfterResponding;
 	std::unique_ptr<AcceptRequest> acceptRequest;
+	qint64 acceptStartTime;
+
+	// monotonic times and durations in microseconds, for the access log
+	//   and the per-route histograms. -1 if not reached
+	qint64 originStartTime;
+	qint64 originTime;
+	qint64 acceptSentTime;
+	qint64 acceptTime;
+	qint64 writeWaitStartTime;
+	qint64 writeWaitTime;
+
+	AdmissionController *admission;
 	LogUtil::Config logConfig;
 	StatsManager *statsManager;
 	Connection inReqReadyReadConnection;
@@ -178,6 +226,7 @@ public:
 		inRequest(0),
 		acceptManager(_acceptManager),
 		isHttps(false),
+		targetsBusy(false),
 		addAllowed(true),
 		haveInspectData(false),
 		shared(false),
@@ -186,12 +235,26 @@ public:
 		trustedClient(false),
 		intReq(false),
 		passthrough(false),
+		streamResponse(false),
+		useCache(false),
+		fromCache(false),
 		acceptXForwardedProtocol(false),
 		useXForwardedProto(false),
 		useXForwardedProtocol(false),
 		acceptPushpinRoute(false),
+		traceSampleRate(0),
+		traceStart(0),
+		acceptCompact(false),
 		proxyInitialResponse(false),
 		acceptAfterResponding(false),
+		acceptStartTime(0),
+		originStartTime(-1),
+		originTime(-1),
+		acceptSentTime(-1),
+		acceptTime(-1),
+		writeWaitStartTime(-1),
+		writeWaitTime(0),
+		admission(0),
 		logConfig(_logConfig),
 		statsManager(_statsManager)
 	{
@@ -201,9 +264,38 @@ public:
 
 	~Private()
 	{
+		if(acceptRequest && admission)
+			admission->acceptFinished(-1);
+
+		if(trace.isValid())
+			TRACE_SPAN(ProxyRequest, trace, traceStart);
+
+		// other threads waiting on the key make their own requests
+		finishShared(false);
+
 		cleanup();
 	}
 
+	void finishShared(bool haveResponse)
+	{
+		if(sharedKey.isEmpty())
+			return;
+
+		std::shared_ptr<ResponseCache::Item> item;
+		if(haveResponse)
+		{
+			item = std::make_shared<ResponseCache::Item>();
+			item->code = responseData.code;
+			item->reason = responseData.reason;
+			item->headers = responseData.headers;
+			item->body = responseBody.toByteArray();
+			item->expires = 0;
+		}
+
+		SharedRequests::finish(sharedKey, item);
+		sharedKey.clear();
+	}
+
 	void cleanup()
 	{
 		foreach(SessionItem *si, sessionItems)
@@ -227,7 +319,7 @@ public:
 	void add(RequestSession *rs)
 	{
 		assert(addAllowed);
-		assert(!route.isNull());
+		assert(route && !route->isNull());
 
 		SessionItem *si = new SessionItem;
 		si->rs = rs;
@@ -275,31 +367,35 @@ public:
 
 			origRequestData = requestData;
 
-			if(!route.asHost.isEmpty())
-				ProxyUtil::applyHost(&requestData.uri, route.asHost);
+			if(!route->asHost.isEmpty())
+				ProxyUtil::applyHost(&requestData.uri, route->asHost);
 
 			QByteArray path = requestData.uri.path(QUrl::FullyEncoded).toUtf8();
 
-			if(route.pathRemove > 0)
-				path = path.mid(route.pathRemove);
+			if(route->pathRemove > 0)
+				path = path.mid(route->pathRemove);
 
-			if(!route.pathPrepend.isEmpty())
-				path = route.pathPrepend + path;
+			if(!route->pathPrepend.isEmpty())
+				path = route->pathPrepend + path;
 
 			requestData.uri.setPath(QString::fromUtf8(path), QUrl::StrictMode);
 
 			QByteArray sigIss = defaultSigIss;
 			Jwt::EncodingKey sigKey = defaultSigKey;
 
-			if(!route.sigIss.isEmpty())
-				sigIss = route.sigIss;
+			if(!route->sigIss.isEmpty())
+				sigIss = route->sigIss;
 
-			if(!route.sigKey.isNull())
-				sigKey = route.sigKey;
+			if(!route->sigKey.isNull())
+				sigKey = route->sigKey;
 
-			targets = route.targets;
+			// direct routes set up by the engine have no balancer
+			if(route->balancer)
+				targets = route->balancer->order(route->targets);
+			else
+				targets = route->targets;
 
-			foreach(const HttpHeader &h, route.headers)
+			foreach(const HttpHeader &h, route->headers)
 			{
 				requestData.headers.removeAll(h.first);
 				if(!h.second.isEmpty())
@@ -323,15 +419,26 @@ public:
 			trustedClient = rs->trusted();
 			QHostAddress clientAddress = rs->request()->peerAddress();
 
-			ProxyUtil::manipulateRequestHeaders("proxysession", q, &requestData, trustedClient, route, sigIss, sigKey, acceptXForwardedProtocol, useXForwardedProto, useXForwardedProtocol, xffTrustedRule, xffRule, origHeadersNeedMark, acceptPushpinRoute, cdnLoop, clientAddress, idata, route.grip, intReq);
+			ProxyUtil::manipulateRequestHeaders("proxysession", q, &requestData, trustedClient, *route, sigIss, sigKey, acceptXForwardedProtocol, useXForwardedProto, useXForwardedProtocol, xffTrustedRule, xffRule, origHeadersNeedMark, acceptPushpinRoute, cdnLoop, clientAddress, idata, route->grip, intReq);
+
+			// the header is passed through untouched unless tracing is
+			// enabled, so there is no cost otherwise
+			if(Trace::enabled())
+				startTrace();
 
 			state = Requesting;
 			buffering = true;
 
-			if(trustedClient || !route.grip || intReq)
+			if(trustedClient || !route->grip || intReq)
 				passthrough = true;
 
-			initialRequestBody = requestBody.toByteArray();
+			// copying the list shares the buffers, so retries can resend
+			// the body without it being flattened
+			initialRequestBody = requestBody;
+
+			// passthrough responses aren't processed as GRIP, so they are
+			// not shared
+			useCache = (route->cacheResponses && !passthrough && ResponseCache::isCacheableRequest(requestData.method.toUtf8(), initialRequestBody.size()));
 
 			if(requestBody.size() > MAX_ACCEPT_REQUEST_BODY)
 			{
@@ -339,7 +446,7 @@ public:
 				buffering = false;
 			}
 
-			tryNextTarget();
+			startRequest();
 		}
 		else if(state == Requesting)
 		{
@@ -356,11 +463,19 @@ public:
 			if(!responseBody.isEmpty())
 			{
 				si->bytesToWrite += responseBody.size();
-				rs->writeResponseBody(responseBody.toByteArray());
+				writeBufferedResponseBody(rs);
 			}
 		}
 	}
 
+	// forwards the buffered chunks by reference rather than flattening
+	// them, since responseBody may still grow or be handed to accept
+	void writeBufferedResponseBody(RequestSession *rs)
+	{
+		for(const QByteArray &buf : responseBody.chunks())
+			rs->writeResponseBody(buf);
+	}
+
 	bool pendingWrites()
 	{
 		foreach(SessionItem *si, sessionItems)
@@ -372,14 +487,72 @@ public:
 		return false;
 	}
 
+	void startRequest()
+	{
+		if(route->limit)
+		{
+			routeTicket = std::make_unique<ConcurrencyLimit::Ticket>([=] { routeTicket_granted(); });
+
+			ConcurrencyLimit::Result r = routeTicket->acquire(route->limit);
+			if(r == ConcurrencyLimit::Rejected)
+			{
+				log_debug("proxysession: %p route queue full", q);
+
+				rejectAll(503, "Service Unavailable", "Origin is busy.", "Error: Too many requests queued for route.");
+				return;
+			}
+			else if(r == ConcurrencyLimit::Queued)
+			{
+				log_debug("proxysession: %p waiting for route slot", q);
+
+				startQueueTimer();
+				return;
+			}
+		}
+
+		tryNextTarget();
+	}
+
+	void startQueueTimer()
+	{
+		if(!queueTimer)
+		{
+			queueTimer = std::make_unique<Timer>();
+			queueTimerConnection = queueTimer->timeout.connect(boost::bind(&Private::queueTimer_timeout, this));
+			queueTimer->setSingleShot(true);
+		}
+
+		// the timeout covers all waiting done by the request
+		if(!queueTimer->isActive())
+			queueTimer->start(route->queueTimeout);
+	}
+
+	void releaseSlots()
+	{
+		routeTicket.reset();
+		targetTicket.reset();
+
+		if(queueTimer)
+			queueTimer->stop();
+	}
+
 	void tryNextTarget()
 	{
+		// give up the slot of the previous target, if any
+		targetTicket.reset();
+
 		if(targets.isEmpty())
 		{
+			if(targetsBusy)
+			{
+				rejectAll(503, "Service Unavailable", "Origin is busy.", "Error: Too many requests queued for all targets.");
+				return;
+			}
+
 			QString msg = "Error while proxying to origin.";
 
 			QStringList targetStrs;
-			foreach(const DomainMap::Target &t, route.targets)
+			foreach(const DomainMap::Target &t, route->targets)
 				targetStrs += ProxyUtil::targetToString(t);
 			QString dmsg = QString("Unable to connect to any targets. Tried: %1").arg(targetStrs.join(", "));
 
@@ -389,6 +562,41 @@ public:
 
 		target = targets.takeFirst();
 
+		if(target.limit)
+		{
+			targetTicket = std::make_unique<ConcurrencyLimit::Ticket>([=] { targetTicket_granted(); });
+
+			ConcurrencyLimit::Result r = targetTicket->acquire(target.limit);
+			if(r == ConcurrencyLimit::Rejected)
+			{
+				log_debug("proxysession: %p target queue full, trying next", q);
+
+				targetsBusy = true;
+				tryNextTarget();
+				return;
+			}
+			else if(r == ConcurrencyLimit::Queued)
+			{
+				log_debug("proxysession: %p waiting for target slot", q);
+
+				// drop the request to the previous target, if any
+				zhttpReqConnections = ZhttpReqConnections();
+				zhttpRequest.reset();
+				outstanding.reset();
+
+				startQueueTimer();
+				return;
+			}
+		}
+
+		startTarget();
+	}
+
+	void startTarget()
+	{
+		if(queueTimer)
+			queueTimer->stop();
+
 		if(target.overHttp)
 		{
 			// don't forward WOH requests from client unless trusted
@@ -414,19 +622,53 @@ public:
 		if(!target.host.isEmpty())
 			ProxyUtil::applyHost(&uri, target.host);
 
+		std::shared_ptr<const ResponseCache::Item> cached;
+		if(useCache)
+		{
+			cacheKey = route->id + ' ' + requestData.method.toUtf8() + ' ' + uri.toEncoded();
+			cacheRequestHeaders = requestData.headers;
+			cached = ResponseCache::get(cacheKey, cacheRequestHeaders);
+		}
+
+		// only used once. a retry after an error goes to the origin
+		if(sharedResponse)
+		{
+			cached = sharedResponse;
+			sharedResponse.reset();
+		}
+
+		fromCache = (bool)cached;
+
+		// the origin won't be contacted
+		if(fromCache)
+		{
+			routeTicket.reset();
+			targetTicket.reset();
+		}
+
+		outstanding.reset();
+		if(target.health && !fromCache)
+			outstanding = std::make_unique<TargetHealth::Outstanding>(target.health);
+
 		if(zhttpManager)
 		{
 			zroutes->removeRef(zhttpManager);
 			zhttpManager = 0;
 		}
 
-		if(target.type == DomainMap::Target::Test)
+		if(fromCache)
+		{
+			log_debug("proxysession: %p using cached response", q);
+
+			zhttpRequest = std::make_unique<CachedHttpRequest>(cached);
+		}
+		else if(target.type == DomainMap::Target::Test)
 		{
 			// for test route, auto-adjust path
-			if(!route.pathBeg.isEmpty())
+			if(!route->pathBeg.isEmpty())
 			{
-				int pathRemove = route.pathBeg.length();
-				if(route.pathBeg.endsWith('/'))
+				int pathRemove = route->pathBeg.length();
+				if(route->pathBeg.endsWith('/'))
 					--pathRemove;
 
 				if(pathRemove > 0)
@@ -478,6 +720,9 @@ public:
 
 		incCounter(Stats::ServerHeaderBytesSent, ZhttpManager::estimateRequestHeaderBytes(requestData.method, uri, requestData.headers));
 
+		originStartTime = LatencyHistogram::now();
+		originTime = -1;
+
 		zhttpRequest->start(requestData.method, uri, requestData.headers);
 
 		requestBodySent = false;
@@ -486,7 +731,8 @@ public:
 		{
 			incCounter(Stats::ServerContentBytesSent, initialRequestBody.size());
 
-			zhttpRequest->writeBody(initialRequestBody);
+			for(const QByteArray &buf : initialRequestBody.chunks())
+				zhttpRequest->writeBody(buf);
 		}
 
 		if(!inRequest || (inRequest->request()->isInputFinished() && inRequest->request()->bytesAvailable() == 0))
@@ -507,8 +753,8 @@ public:
 	void tryRequestRead()
 	{
 		// if the state changed before input finished, then
-		//   stop reading input
-		if(state != Requesting)
+		//   stop reading input. also wait while queued for a slot
+		if(state != Requesting || !zhttpRequest)
 			return;
 
 		int maxBytes = buffering ? MAX_STREAM_BUFFER : zhttpRequest->writeBytesAvailable();
@@ -621,6 +867,8 @@ public:
 		zhttpReqConnections = ZhttpReqConnections();
 		// kill the active target request, if any
 		zhttpRequest.reset();
+		outstanding.reset();
+		releaseSlots();
 
 		assert(state != Responding);
 		assert(state != Responded);
@@ -735,7 +983,18 @@ public:
 		// if we're not buffering, then don't read (instead, sync to slowest
 		//   receiver before reading again)
 		if(!buffering && pendingWrites())
+		{
+			if(writeWaitStartTime < 0)
+				writeWaitStartTime = LatencyHistogram::now();
+
 			return;
+		}
+
+		if(writeWaitStartTime >= 0)
+		{
+			writeWaitTime += LatencyHistogram::now() - writeWaitStartTime;
+			writeWaitStartTime = -1;
+		}
 
 		std::weak_ptr<Private> self = q->d;
 
@@ -859,7 +1118,7 @@ public:
 		}
 		else if(state == Responding)
 		{
-			if(buffering && responseBody.size() + zhttpRequest->bytesAvailable() > MAX_INITIAL_BUFFER)
+			if(buffering && (streamResponse || responseBody.size() + zhttpRequest->bytesAvailable() > MAX_INITIAL_BUFFER))
 			{
 				responseBody.clear();
 				buffering = false;
@@ -929,8 +1188,18 @@ public:
 				return;
 			}
 
+			if(useCache && !fromCache && buffering)
+			{
+				if(ResponseCache::put(cacheKey, cacheRequestHeaders, responseData.code, responseData.reason, responseData.headers, responseBody.toByteArray()))
+					log_debug("proxysession: %p stored response in cache", q);
+			}
+
+			finishShared(buffering);
+
 			zhttpReqConnections = ZhttpReqConnections();			
 			zhttpRequest.reset();
+			outstanding.reset();
+			releaseSlots();
 
 			// once the entire response has been received, cut off any new adds
 			if(addAllowed)
@@ -995,7 +1264,7 @@ public:
 			if(!responseBody.isEmpty())
 			{
 				si->bytesToWrite += responseBody.size();
-				si->rs->writeResponseBody(responseBody.toByteArray());
+				writeBufferedResponseBody(si->rs);
 			}
 		}
 	}
@@ -1009,8 +1278,8 @@ public:
 		LogUtil::RequestData rd;
 
 		// only log route id if explicitly set
-		if(route.separateStats)
-			rd.routeId = route.id;
+		if(route->separateStats)
+			rd.routeId = route->id;
 
 		if(accepted)
 		{
@@ -1038,13 +1307,46 @@ public:
 
 		rd.fromAddress = rs->peerAddress();
 
+		qint64 now = LatencyHistogram::now();
+
+		rd.inspectTime = rs->inspectTime();
+		rd.originTime = originTime;
+		rd.acceptTime = acceptTime;
+		rd.totalTime = now - rs->startTime();
+
+		// includes any wait still in progress
+		if(originStartTime >= 0)
+			rd.writeWaitTime = writeWaitTime + (writeWaitStartTime >= 0 ? now - writeWaitStartTime : 0);
+
+		// the breakdown is verbose, so it follows the route's log level
+		rd.timings = (log_outputLevel() >= route->logLevel);
+
 		LogUtil::logRequest(LOG_LEVEL_INFO, rd, logConfig);
+
+		if(statsManager)
+		{
+			QByteArray routeId = route->statsRoute();
+
+			if(rd.inspectTime >= 0)
+				statsManager->addRequestTiming(routeId, StatsManager::InspectPhase, rd.inspectTime);
+
+			if(rd.originTime >= 0)
+				statsManager->addRequestTiming(routeId, StatsManager::OriginPhase, rd.originTime);
+
+			if(rd.acceptTime >= 0)
+				statsManager->addRequestTiming(routeId, StatsManager::AcceptPhase, rd.acceptTime);
+
+			if(rd.writeWaitTime >= 0)
+				statsManager->addRequestTiming(routeId, StatsManager::WriteWaitPhase, rd.writeWaitTime);
+
+			statsManager->addRequestTiming(routeId, StatsManager::TotalPhase, rd.totalTime);
+		}
 	}
 
 	void incCounter(Stats::Counter c, int count = 1)
 	{
 		if(statsManager)
-			statsManager->incCounter(route.statsRoute(), c, count);
+			statsManager->incCounter(route->statsRoute(), c, count);
 	}
 
 public:
@@ -1066,6 +1368,12 @@ public:
 
 		if(state == Requesting)
 		{
+			if(originTime < 0)
+				originTime = LatencyHistogram::now() - originStartTime;
+
+			if(target.health && !fromCache)
+				target.health->recordSuccess();
+
 			responseData.code = zhttpRequest->responseCode();
 			responseData.reason = zhttpRequest->responseReason();
 			responseData.headers = zhttpRequest->responseHeaders();
@@ -1122,9 +1430,26 @@ public:
 				}
 
 				state = Accepting;
+
+				++g_responsesAccepted;
 			}
 			else
 			{
+				// the headers alone rule out GRIP, so unless the body is
+				// wanted for the cache or for other threads, stream it
+				// rather than buffering up to MAX_INITIAL_BUFFER for sharing
+				if(!useCache && sharedKey.isEmpty())
+				{
+					log_debug("proxysession: %p not GRIP, streaming response", q);
+					streamResponse = true;
+
+					++g_responsesStreamed;
+				}
+				else
+				{
+					++g_responsesBuffered;
+				}
+
 				startResponse();
 			}
 		}
@@ -1162,6 +1487,8 @@ public:
 				case ZhttpRequest::ErrorTls:
 					// it should not be possible to get one of these errors while accepting
 					assert(state == Requesting);
+					if(target.health)
+						target.health->recordFailure();
 					tryAgain = true;
 					break;
 				case ZhttpRequest::ErrorTimeout:
@@ -1266,11 +1593,11 @@ public:
 			QByteArray sigIss = defaultSigIss;
 			Jwt::EncodingKey sigKey = defaultSigKey;
 
-			if(!route.sigIss.isEmpty())
-				sigIss = route.sigIss;
+			if(!route->sigIss.isEmpty())
+				sigIss = route->sigIss;
 
-			if(!route.sigKey.isNull())
-				sigKey = route.sigKey;
+			if(!route->sigKey.isNull())
+				sigKey = route->sigKey;
 
 			acceptResponseData.body = responseBody.take();
 
@@ -1309,6 +1636,7 @@ public:
 			adata.requestData.body = requestBody.take();
 			adata.origRequestData = origRequestData;
 			adata.origRequestData.body = adata.requestData.body;
+			adata.compact = acceptCompact;
 
 			adata.haveResponse = true;
 			adata.response = acceptResponseData;
@@ -1319,31 +1647,58 @@ public:
 				adata.inspectData = idata;
 			}
 
-			adata.route = route.id;
-			adata.separateStats = route.separateStats;
-			adata.channelPrefix = route.prefix;
-			adata.logLevel = route.logLevel;
+			adata.route = route->id;
+			adata.separateStats = route->separateStats;
+			adata.channelPrefix = route->prefix;
+			adata.logLevel = route->logLevel;
 			foreach(const QString &s, target.subscriptions)
 				adata.channels += s.toUtf8();
 			adata.trusted = target.trusted;
-			adata.useSession = route.session;
+			adata.useSession = route->session;
 			adata.responseSent = acceptAfterResponding;
+			adata.compressPublished = route->compressPublished;
 
 			if(!statsManager->connectionSendEnabled())
 			{
 				// flush max. the count will include the connections we just unregistered
-				adata.connMaxPackets += statsManager->getConnMaxPacket(route.statsRoute()).toVariant();
+				adata.connMaxPackets += statsManager->getConnMaxPacket(route->statsRoute()).toVariant();
 
 				// flush max again to get the count without the connections
-				adata.connMaxPackets += statsManager->getConnMaxPacket(route.statsRoute()).toVariant();
+				adata.connMaxPackets += statsManager->getConnMaxPacket(route->statsRoute()).toVariant();
 			}
 
 			acceptRequest = std::make_unique<AcceptRequest>(acceptManager);
 			finishedConnection = acceptRequest->finished.connect(boost::bind(&Private::acceptRequest_finished, this));
+			acceptSentTime = LatencyHistogram::now();
 			acceptRequest->start(adata);
+
+			if(admission)
+			{
+				acceptStartTime = LoopClock::msecsSinceEpoch();
+				admission->acceptStarted();
+			}
 		}
 	}
 
+	// continues the client's trace, or starts one for a sample of requests
+	//   without one. the origin and the handler see our span as parent
+	void startTrace()
+	{
+		TraceContext parent = TraceContext::fromHeader(requestData.headers.get("traceparent"));
+		if(parent.isValid())
+			trace = parent.createChild();
+		else if(traceSampleRate > 0 && QRandomGenerator::global()->bounded(100) < traceSampleRate)
+			trace = TraceContext::createRoot(true);
+
+		if(!trace.isValid())
+			return;
+
+		requestData.headers.removeAll("traceparent");
+		requestData.headers += HttpHeader("traceparent", trace.toHeader());
+
+		traceStart = Trace::timestamp();
+	}
+
 	void rs_errorResponding(RequestSession *rs)
 	{
 		log_debug("proxysession: %p response error id=%s", q, rs->rid().second.data());
@@ -1378,8 +1733,41 @@ public:
 			incCounter(Stats::ClientContentBytesSent, count);
 	}
 
+	void routeTicket_granted()
+	{
+		log_debug("proxysession: %p got route slot", q);
+
+		tryNextTarget();
+
+		// catch up on input received while waiting
+		if(inRequest)
+			tryRequestRead();
+	}
+
+	void targetTicket_granted()
+	{
+		log_debug("proxysession: %p got target slot", q);
+
+		startTarget();
+
+		if(inRequest)
+			tryRequestRead();
+	}
+
+	void queueTimer_timeout()
+	{
+		log_debug("proxysession: %p timed out waiting for slot", q);
+
+		rejectAll(503, "Service Unavailable", "Origin is busy.", "Error: Timed out waiting for a free origin slot.");
+	}
+
 	void acceptRequest_finished()
 	{
+		acceptTime = LatencyHistogram::now() - acceptSentTime;
+
+		if(admission)
+			admission->acceptFinished((int)qMax(LoopClock::msecsSinceEpoch() - acceptStartTime, (qint64)0));
+
 		if(acceptRequest->success())
 		{
 			AcceptRequest::ResponseData rdata = acceptRequest->result();
@@ -1478,14 +1866,26 @@ public:
 	}
 };
 
+void ProxySession::addToPrometheus(StatsManager *stats)
+{
+	QString help = "Number of origin responses by how they were handled";
+
+	stats->addPrometheusCounter("proxy_responses_total", help, "path=\"accepted\"", &g_responsesAccepted);
+	stats->addPrometheusCounter("proxy_responses_total", help, "path=\"buffered\"", &g_responsesBuffered);
+	stats->addPrometheusCounter("proxy_responses_total", help, "path=\"streamed\"", &g_responsesStreamed);
+}
+
 ProxySession::ProxySession(ZRoutes *zroutes, ZrpcManager *acceptManager, const LogUtil::Config &logConfig, StatsManager *statsManager)
 {
-	d = std::make_shared<Private>(this, zroutes, acceptManager, logConfig, statsManager);
+	// see RequestSession
+	Arena *arena = Arena::create();
+	d = std::allocate_shared<Private>(ArenaAllocator<Private>(arena), this, zroutes, acceptManager, logConfig, statsManager);
+	arena->unref();
 }
 
 ProxySession::~ProxySession() = default;
 
-void ProxySession::setRoute(const DomainMap::Entry &route)
+void ProxySession::setRoute(const std::shared_ptr<const DomainMap::Entry> &route)
 {
 	d->route = route;
 }
@@ -1528,17 +1928,42 @@ void ProxySession::setCdnLoop(const QByteArray &value)
 	d->cdnLoop = value;
 }
 
+void ProxySession::setTraceSampleRate(int percent)
+{
+	d->traceSampleRate = percent;
+}
+
+void ProxySession::setAcceptCompact(bool enabled)
+{
+	d->acceptCompact = enabled;
+}
+
 void ProxySession::setProxyInitialResponseEnabled(bool enabled)
 {
 	d->proxyInitialResponse = enabled;
 }
 
+void ProxySession::setAdmissionController(AdmissionController *admission)
+{
+	d->admission = admission;
+}
+
 void ProxySession::setInspectData(const InspectData &idata)
 {
 	d->haveInspectData = true;
 	d->idata = idata;
 }
 
+void ProxySession::setSharedKey(const QByteArray &key)
+{
+	d->sharedKey = key;
+}
+
+void ProxySession::setSharedResponse(const std::shared_ptr<const ResponseCache::Item> &item)
+{
+	d->sharedResponse = item;
+}
+
 void ProxySession::add(RequestSession *rs)
 {
 	d->add(rs);
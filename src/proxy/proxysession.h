@@ -25,6 +25,7 @@
 #define PROXYSESSION_H
 
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 #include "logutil.h"
 #include "domainmap.h"
 
@@ -39,9 +40,13 @@ class ZRoutes;
 class StatsManager;
 class XffRule;
 class RequestSession;
+class AdmissionController;
+
+namespace ResponseCache {
+class Item;
+}
 
 using Signal = boost::signals2::signal<void()>;
-using Connection = boost::signals2::scoped_connection;
 
 class ProxySession
 {
@@ -49,7 +54,7 @@ public:
 	ProxySession(ZRoutes *zroutes, ZrpcManager *acceptManager, const LogUtil::Config &logConfig, StatsManager *stats = 0);
 	~ProxySession();
 
-	void setRoute(const DomainMap::Entry &route);
+	void setRoute(const std::shared_ptr<const DomainMap::Entry> &route);
 	void setDefaultSigKey(const QByteArray &iss, const Jwt::EncodingKey &key);
 	void setAcceptXForwardedProtocol(bool enabled);
 	void setUseXForwardedProtocol(bool protoEnabled, bool protocolEnabled);
@@ -57,16 +62,37 @@ public:
 	void setOrigHeadersNeedMark(const QList<QByteArray> &names);
 	void setAcceptPushpinRoute(bool enabled);
 	void setCdnLoop(const QByteArray &value);
+
+	// percent of requests without a traceparent that start a new trace
+	void setTraceSampleRate(int percent);
+
+	void setAcceptCompact(bool enabled);
 	void setProxyInitialResponseEnabled(bool enabled);
 
+	// reports handler accept latency to the controller
+	void setAdmissionController(AdmissionController *admission);
+
 	void setInspectData(const InspectData &idata);
 
+	// the key was claimed in SharedRequests. the session finishes it with
+	// the complete response, or with nothing if the response couldn't be
+	// buffered
+	void setSharedKey(const QByteArray &key);
+
+	// replays a response received through SharedRequests instead of
+	// contacting the origin
+	void setSharedResponse(const std::shared_ptr<const ResponseCache::Item> &item);
+
 	// takes ownership
 	void add(RequestSession *rs);
 
-	Signal addNotAllowed; // no more sharing, for whatever reason
-	Signal finished;
-	boost::signals2::signal<void(RequestSession*, bool)> requestSessionDestroyed;
+	// exports counts of how responses were handled: accepted as GRIP,
+	// buffered, or streamed directly based on headers
+	static void addToPrometheus(StatsManager *stats);
+
+	FastSignal<> addNotAllowed; // no more sharing, for whatever reason
+	FastSignal<> finished;
+	FastSignal<RequestSession*, bool> requestSessionDestroyed;
 
 private:
 	class Private;
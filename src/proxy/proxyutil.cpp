@@ -24,6 +24,8 @@
 #include "proxyutil.h"
 
 #include <QDateTime>
+#include <QHash>
+#include <QPair>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include "qtcompat.h"
@@ -31,16 +33,85 @@
 #include "jwt.h"
 #include "inspectdata.h"
 
+// signed tokens are valid for an hour, and are re-signed once half of
+// that has passed, so a cached token is never close to expiring
+#define TOKEN_LIFETIME 3600
+#define TOKEN_REFRESH (TOKEN_LIFETIME / 2)
+
+// bounds for the per-thread caches. these are only reached if keys keep
+// changing, in which case the caches are simply started over
+#define SIGNED_TOKENS_MAX 100
+#define VALID_TOKENS_MAX 1000
+
+// keys are identified by their underlying handle. the cached entries hold
+// a reference to the key, so a handle can't be reused while it is cached
+class SignedToken
+{
+public:
+	Jwt::EncodingKey key;
+	QByteArray token;
+	qint64 signedAt;
+};
+
+class ValidToken
+{
+public:
+	Jwt::DecodingKey key;
+	qint64 exp;
+};
+
+// issuer or token, paired with the key handle
+typedef QPair<QByteArray, quintptr> TokenCacheKey;
+
+static thread_local QHash<TokenCacheKey, SignedToken> g_signedTokens;
+static thread_local QHash<TokenCacheKey, ValidToken> g_validTokens;
+
 static QByteArray make_token(const QByteArray &iss, const Jwt::EncodingKey &key)
 {
+	qint64 now = QDateTime::currentDateTimeUtc().toSecsSinceEpoch();
+
+	TokenCacheKey cacheKey(iss, (quintptr)key.raw());
+
+	QHash<TokenCacheKey, SignedToken>::const_iterator it = g_signedTokens.constFind(cacheKey);
+	if(it != g_signedTokens.constEnd() && now - it->signedAt < TOKEN_REFRESH)
+		return it->token;
+
 	QVariantMap claim;
 	claim["iss"] = QString::fromUtf8(iss);
-	claim["exp"] = QDateTime::currentDateTimeUtc().toSecsSinceEpoch() + 3600;
-	return Jwt::encode(claim, key);
+	claim["exp"] = now + TOKEN_LIFETIME;
+	QByteArray token = Jwt::encode(claim, key);
+	if(token.isEmpty())
+		return token;
+
+	if(g_signedTokens.count() >= SIGNED_TOKENS_MAX && !g_signedTokens.contains(cacheKey))
+		g_signedTokens.clear();
+
+	SignedToken &st = g_signedTokens[cacheKey];
+	st.key = key;
+	st.token = token;
+	st.signedAt = now;
+
+	return token;
 }
 
 static bool validate_token(const QByteArray &token, const Jwt::DecodingKey &key)
 {
+	qint64 now = QDateTime::currentDateTimeUtc().toSecsSinceEpoch();
+
+	// upstream proxies typically send the same token for a while, so only
+	// the first occurrence needs its signature checked
+	TokenCacheKey cacheKey(token, (quintptr)key.raw());
+
+	QHash<TokenCacheKey, ValidToken>::iterator it = g_validTokens.find(cacheKey);
+	if(it != g_validTokens.end())
+	{
+		if(now < it->exp)
+			return true;
+
+		g_validTokens.erase(it);
+		return false;
+	}
+
 	QVariant claimObj = Jwt::decode(token, key);
 	if(!claimObj.isValid() || typeId(claimObj) != QMetaType::QVariantMap)
 		return false;
@@ -48,9 +119,17 @@ static bool validate_token(const QByteArray &token, const Jwt::DecodingKey &key)
 	QVariantMap claim = claimObj.toMap();
 
 	int exp = claim.value("exp").toInt();
-	if(exp <= 0 || (int)QDateTime::currentDateTimeUtc().toSecsSinceEpoch() >= exp)
+	if(exp <= 0 || (int)now >= exp)
 		return false;
 
+	// only successes are cached, so invalid tokens can't fill the cache
+	if(g_validTokens.count() >= VALID_TOKENS_MAX)
+		g_validTokens.clear();
+
+	ValidToken &vt = g_validTokens[cacheKey];
+	vt.key = key;
+	vt.exp = exp;
+
 	return true;
 }
 
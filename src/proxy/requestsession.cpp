@@ -36,6 +36,8 @@
 #include "bufferlist.h"
 #include "log.h"
 #include "defercall.h"
+#include "latencyhistogram.h"
+#include "arena.h"
 #include "layertracker.h"
 #include "sockjsmanager.h"
 #include "inspectdata.h"
@@ -44,6 +46,7 @@
 #include "zrpcmanager.h"
 #include "zrpcchecker.h"
 #include "inspectrequest.h"
+#include "inspectcache.h"
 #include "acceptrequest.h"
 #include "statsmanager.h"
 #include "cors.h"
@@ -168,11 +171,12 @@ public:
 	bool trusted;
 	QHostAddress peerAddress;
 	QHostAddress logicalPeerAddress;
-	DomainMap::Entry route;
+	std::shared_ptr<const DomainMap::Entry> route;
 	QString routeId;
 	bool debug;
 	bool autoCrossOrigin;
 	std::unique_ptr<InspectRequest> inspectRequest;
+	QByteArray inspectCacheKey;
 	InspectData idata;
 	std::unique_ptr<AcceptRequest> acceptRequest;
 	BufferList in;
@@ -195,6 +199,9 @@ public:
 	XffRule xffRule;
 	XffRule xffTrustedRule;
 	bool isSockJs;
+	qint64 startTime;
+	qint64 inspectStartTime;
+	qint64 inspectTime;
 	ZhttpReqConnections zhttpReqConnections;
 	Connection inspectFinishedConnection;
 	Connection acceptFinishedConnection;
@@ -225,7 +232,10 @@ public:
 		accepted(false),
 		passthrough(false),
 		autoShare(false),
-		isSockJs(false)
+		isSockJs(false),
+		startTime(LatencyHistogram::now()),
+		inspectStartTime(-1),
+		inspectTime(-1)
 	{
 		jsonpExtractableHeaders += "Cache-Control";
 	}
@@ -288,21 +298,21 @@ public:
 		bool isHttps = (requestData.uri.scheme() == "https");
 		QString host = requestData.uri.host();
 
-		if(route.isNull() && domainMap)
+		if(!route && domainMap)
 		{
 			QByteArray encPath = requestData.uri.path(QUrl::FullyEncoded).toUtf8();
 
 			// look up the route
 			if(!routeId.isEmpty() && !domainMap->isIdShared(routeId))
-				route = domainMap->entry(routeId);
+				route = domainMap->sharedEntry(routeId);
 			else
-				route = domainMap->entry(DomainMap::Http, isHttps, host, encPath);
+				route = domainMap->sharedEntry(DomainMap::Http, isHttps, host, encPath);
 
 			// before we do anything else, see if this is a sockjs request
-			if(!route.isNull() && !route.sockJsPath.isEmpty() && encPath.startsWith(route.sockJsPath))
+			if(route && !route->sockJsPath.isEmpty() && encPath.startsWith(route->sockJsPath))
 			{
 				isSockJs = true;
-				sockJsManager->giveRequest(zhttpRequest, route.sockJsPath.length(), route.sockJsAsPath, route);
+				sockJsManager->giveRequest(zhttpRequest, route->sockJsPath.length(), route->sockJsAsPath, *route);
 				zhttpRequest = 0;
 				deferCall.defer([=] { doFinished(); });
 				return;
@@ -312,20 +322,20 @@ public:
 		zhttpReqConnections.pausedConnection = zhttpRequest->paused.connect(boost::bind(&Private::zhttpRequest_paused, this));
 		zhttpReqConnections.errorConnection = zhttpRequest->error.connect(boost::bind(&Private::zhttpRequest_error, this));
 
-		if(!route.isNull())
+		if(route)
 		{
-			if(route.debug)
+			if(route->debug)
 				debug = true;
 
-			if(route.autoCrossOrigin)
+			if(route->autoCrossOrigin)
 				autoCrossOrigin = true;
 		}
 
 		if(autoCrossOrigin)
 		{
 			DomainMap::JsonpConfig config;
-			if(!route.isNull())
-				config = route.jsonpConfig;
+			if(route)
+				config = route->jsonpConfig;
 
 			bool ok = false;
 			QString str;
@@ -363,9 +373,9 @@ public:
 			return;
 		}
 
-		log_debug("requestsession: %p %s has %d routes", q, qPrintable(host), route.targets.count());
+		log_debug("requestsession: %p %s has %d routes", q, qPrintable(host), route ? route->targets.count() : 0);
 
-		if(route.isNull())
+		if(!route)
 		{
 			state = WaitingForResponse;
 			respondError(502, "Bad Gateway", QString("No route for host: %1").arg(host));
@@ -376,8 +386,8 @@ public:
 		{
 			connectionRegistered = true;
 
-			stats->addConnection(ridToString(rid), route.statsRoute(), StatsManager::Http, logicalPeerAddress, isHttps, false);
-			stats->addActivity(route.statsRoute());
+			stats->addConnection(ridToString(rid), route->statsRoute(), StatsManager::Http, logicalPeerAddress, isHttps, false);
+			stats->addActivity(route->statsRoute());
 			stats->addRequestsReceived(1);
 		}
 
@@ -406,13 +416,13 @@ public:
 
 		// look up the route
 		if(!routeId.isEmpty() && !domainMap->isIdShared(routeId))
-			route = domainMap->entry(routeId);
+			route = domainMap->sharedEntry(routeId);
 		else
-			route = domainMap->entry(DomainMap::Http, isHttps, host, encPath);
+			route = domainMap->sharedEntry(DomainMap::Http, isHttps, host, encPath);
 
-		log_debug("requestsession: %p %s has %d routes", q, qPrintable(host), route.targets.count());
+		log_debug("requestsession: %p %s has %d routes", q, qPrintable(host), route ? route->targets.count() : 0);
 
-		if(route.isNull())
+		if(!route)
 		{
 			state = WaitingForResponse;
 			respondError(502, "Bad Gateway", QString("No route for host: %1").arg(host));
@@ -422,14 +432,14 @@ public:
 		if(stats)
 		{
 			if(retrySeq >= 0)
-				stats->setRetrySeq(route.statsRoute(), retrySeq);
+				stats->setRetrySeq(route->statsRoute(), retrySeq);
 
 			connectionRegistered = true;
 
 			int reportOffset = stats->connectionSendEnabled() ? -1 : qMax(unreportedTime, 0);
 
-			stats->addConnection(ridToString(rid), route.statsRoute(), StatsManager::Http, logicalPeerAddress, isHttps, false, reportOffset);
-			stats->addActivity(route.statsRoute());
+			stats->addConnection(ridToString(rid), route->statsRoute(), StatsManager::Http, logicalPeerAddress, isHttps, false, reportOffset);
+			stats->addActivity(route->statsRoute());
 
 			// note: we don't call addRequestsReceived here, because we're acting for an existing request
 		}
@@ -454,21 +464,37 @@ public:
 
 				assert(!inspectRequest);
 
+				// results involving sessions depend on the body and on
+				//   state held by the handler, and are never cached
+				if(inspectManager && !route->session)
+				{
+					inspectCacheKey = InspectCache::key(requestData, autoShare);
+
+					// a cached result skips the handler and the checker
+					if(InspectCache::get(inspectCacheKey, &idata))
+					{
+						log_debug("inspect cache hit");
+						deferCall.defer([=] { inspectDone(); });
+						return;
+					}
+				}
+
 				if(inspectManager)
 				{
 					inspectRequest = std::make_unique<InspectRequest>(inspectManager);
+					inspectStartTime = LatencyHistogram::now();
 
 					if(inspectChecker->isInterfaceAvailable())
 					{
 						inspectFinishedConnection = inspectRequest->finished.connect(boost::bind(&Private::inspectRequest_finished, this));
 						inspectChecker->watch(inspectRequest.get());
-						inspectRequest->start(requestData, truncated, route.session, autoShare);
+						inspectRequest->start(requestData, truncated, route->session, autoShare);
 					}
 					else
 					{
 						inspectChecker->watch(inspectRequest.get());
 						inspectChecker->give(inspectRequest.get());
-						inspectRequest->start(requestData, truncated, route.session, autoShare);
+						inspectRequest->start(requestData, truncated, route->session, autoShare);
 						inspectRequest.release();
 					}
 				}
@@ -857,8 +883,8 @@ public:
 			adata.haveInspectData = true;
 			adata.inspectData = idata;
 
-			adata.route = route.id;
-			adata.channelPrefix = route.prefix;
+			adata.route = route->id;
+			adata.channelPrefix = route->prefix;
 
 			acceptRequest = std::make_unique<AcceptRequest>(acceptManager);
 			acceptFinishedConnection = acceptRequest->finished.connect(boost::bind(&Private::acceptRequest_finished, this));
@@ -879,6 +905,8 @@ public:
 
 	void inspectRequest_finished()
 	{
+		inspectTime = LatencyHistogram::now() - inspectStartTime;
+
 		if(!inspectRequest->success())
 		{
 			inspectFinishedConnection.disconnect();
@@ -893,6 +921,14 @@ public:
 		inspectFinishedConnection.disconnect();
 		inspectChecker->give(inspectRequest.release());
 
+		if(!inspectCacheKey.isEmpty())
+			InspectCache::put(inspectCacheKey, idata);
+
+		inspectDone();
+	}
+
+	void inspectDone()
+	{
 		if(!idata.doProxy)
 		{
 			state = ReceivingForAccept;
@@ -1182,7 +1218,11 @@ public:
 
 RequestSession::RequestSession(int workerId, DomainMap *domainMap, SockJsManager *sockJsManager, ZrpcManager *inspectManager, ZrpcChecker *inspectChecker, ZrpcManager *acceptManager, StatsManager *stats)
 {
-	d = std::make_shared<Private>(this, workerId, domainMap, sockJsManager, inspectManager, inspectChecker, acceptManager, stats);
+	// session state comes from a per-request arena, which is released once
+	// the last reference to the state is gone
+	Arena *arena = Arena::create();
+	d = std::allocate_shared<Private>(ArenaAllocator<Private>(arena), this, workerId, domainMap, sockJsManager, inspectManager, inspectChecker, acceptManager, stats);
+	arena->unref();
 }
 
 RequestSession::~RequestSession() = default;
@@ -1262,11 +1302,21 @@ bool RequestSession::haveCompleteRequestBody() const
 	return (d->zhttpRequest->isInputFinished() && d->zhttpRequest->bytesAvailable() == 0);
 }
 
-DomainMap::Entry RequestSession::route() const
+std::shared_ptr<const DomainMap::Entry> RequestSession::route() const
 {
 	return d->route;
 }
 
+qint64 RequestSession::startTime() const
+{
+	return d->startTime;
+}
+
+qint64 RequestSession::inspectTime() const
+{
+	return d->inspectTime;
+}
+
 ZhttpRequest *RequestSession::request()
 {
 	return d->zhttpRequest;
@@ -1287,7 +1337,7 @@ void RequestSession::setPrefetchSize(int size)
 	d->prefetchSize = size;
 }
 
-void RequestSession::setRoute(const DomainMap::Entry &route)
+void RequestSession::setRoute(const std::shared_ptr<const DomainMap::Entry> &route)
 {
 	d->route = route;
 }
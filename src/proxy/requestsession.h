@@ -25,12 +25,12 @@
 #define REQUESTSESSION_H
 
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 #include "zhttprequest.h"
 #include "domainmap.h"
 
 using Signal = boost::signals2::signal<void()>;
 using SignalInt = boost::signals2::signal<void(int)>;
-using Connection = boost::signals2::scoped_connection;
 
 class QHostAddress;
 
@@ -69,14 +69,20 @@ public:
 	QByteArray jsonpCallback() const; // non-empty if JSON-P is used
 	bool jsonpExtendedResponse() const;
 	bool haveCompleteRequestBody() const;
-	DomainMap::Entry route() const;
+	std::shared_ptr<const DomainMap::Entry> route() const; // null if not resolved
+
+	// monotonic time the session started, from LatencyHistogram::now()
+	qint64 startTime() const;
+
+	// inspect round trip in microseconds, or -1 if there was none
+	qint64 inspectTime() const;
 
 	ZhttpRequest *request();
 
 	void setDebugEnabled(bool enabled);
 	void setAutoCrossOrigin(bool enabled);
 	void setPrefetchSize(int size);
-	void setRoute(const DomainMap::Entry &route);
+	void setRoute(const std::shared_ptr<const DomainMap::Entry> &route);
 	void setRouteId(const QString &routeId);
 	void setAutoShare(bool enabled);
 	void setAccepted(bool enabled);
@@ -100,19 +106,19 @@ public:
 
 	int unregisterConnection(); // return unreported time
 
-	Signal inspectError;
-	boost::signals2::signal<void(const InspectData&)> inspected;
-	Signal finishedByAccept;
-	SignalInt bytesWritten;
-	Signal paused;
-	SignalInt headerBytesSent;
-	SignalInt bodyBytesSent;
+	FastSignal<> inspectError;
+	FastSignal<const InspectData&> inspected;
+	FastSignal<> finishedByAccept;
+	FastSignal<int> bytesWritten;
+	FastSignal<> paused;
+	FastSignal<int> headerBytesSent;
+	FastSignal<int> bodyBytesSent;
 	// this signal means some error was encountered while responding and
 	//   that you should not attempt to call further response-related
 	//   methods. the object remains in an active state though, and so you
 	//   should still wait for finished()
-	Signal errorResponding;
-	Signal finished;
+	FastSignal<> errorResponding;
+	FastSignal<> finished;
 
 private:
 	class Private;
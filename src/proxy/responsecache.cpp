@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "responsecache.h"
+
+#include <chrono>
+#include <QHash>
+#include <QMutex>
+
+// bound on stored responses. bodies are limited by the proxy's initial
+// response buffer, so this bounds memory as well
+#define MAX_ITEMS 10000
+
+namespace ResponseCache {
+
+typedef QList< std::shared_ptr<const Item> > Variants;
+
+static QMutex g_mutex;
+static QHash<QByteArray, Variants> g_items;
+static int g_count = 0;
+
+static qint64 nowMs()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool isCacheableStatus(int code)
+{
+	switch(code)
+	{
+		case 200:
+		case 203:
+		case 204:
+		case 300:
+		case 301:
+		case 404:
+		case 405:
+		case 410:
+		case 414:
+		case 501:
+			return true;
+		default:
+			return false;
+	}
+}
+
+static QList<QByteArray> headerValues(const HttpHeaders &headers, const QList<QByteArray> &names)
+{
+	QList<QByteArray> out;
+	for(const QByteArray &name : names)
+		out += headers.getAll(name, false).join(", ");
+
+	return out;
+}
+
+// called with lock held
+static void removeExpired(qint64 now)
+{
+	QMutableHashIterator<QByteArray, Variants> it(g_items);
+	while(it.hasNext())
+	{
+		it.next();
+
+		Variants &v = it.value();
+		for(int n = 0; n < v.count(); ++n)
+		{
+			if(now >= v[n]->expires)
+			{
+				v.removeAt(n);
+				--n; // adjust position
+				--g_count;
+			}
+		}
+
+		if(v.isEmpty())
+			it.remove();
+	}
+}
+
+bool isCacheableRequest(const QByteArray &method, int bodySize)
+{
+	return ((method == "GET" || method == "HEAD") && bodySize == 0);
+}
+
+std::shared_ptr<const Item> get(const QByteArray &key, const HttpHeaders &requestHeaders)
+{
+	qint64 now = nowMs();
+
+	QMutexLocker locker(&g_mutex);
+
+	QHash<QByteArray, Variants>::const_iterator it = g_items.constFind(key);
+	if(it == g_items.constEnd())
+		return std::shared_ptr<const Item>();
+
+	for(const std::shared_ptr<const Item> &i : it.value())
+	{
+		if(now < i->expires && headerValues(requestHeaders, i->varyNames) == i->varyValues)
+			return i;
+	}
+
+	return std::shared_ptr<const Item>();
+}
+
+bool put(const QByteArray &key, const HttpHeaders &requestHeaders, int code, const QByteArray &reason, const HttpHeaders &headers, const QByteArray &body)
+{
+	if(!isCacheableStatus(code))
+		return false;
+
+	// responses setting cookies are specific to a client
+	if(headers.contains("Set-Cookie"))
+		return false;
+
+	int maxAge = -1;
+	int sharedMaxAge = -1;
+	bool isPublic = false;
+
+	for(const QByteArray &i : headers.getAll("Cache-Control"))
+	{
+		QByteArray d = i.trimmed().toLower();
+
+		if(d == "no-store" || d == "no-cache" || d == "private" || d.startsWith("no-cache=") || d.startsWith("private="))
+			return false;
+		else if(d == "public")
+			isPublic = true;
+		else if(d.startsWith("max-age="))
+			maxAge = d.mid(8).toInt();
+		else if(d.startsWith("s-maxage="))
+			sharedMaxAge = d.mid(9).toInt();
+	}
+
+	int ttl = (sharedMaxAge >= 0 ? sharedMaxAge : maxAge);
+	if(ttl <= 0)
+		return false;
+
+	// authorized requests may only be shared if the origin says so
+	if(requestHeaders.contains("Authorization") && !isPublic && sharedMaxAge < 0)
+		return false;
+
+	QList<QByteArray> varyNames;
+	for(const QByteArray &i : headers.getAll("Vary"))
+	{
+		QByteArray name = i.trimmed().toLower();
+		if(name == "*")
+			return false;
+
+		if(!name.isEmpty())
+			varyNames += name;
+	}
+
+	qint64 now = nowMs();
+
+	auto item = std::make_shared<Item>();
+	item->code = code;
+	item->reason = reason;
+	item->headers = headers;
+	item->body = body;
+	item->varyNames = varyNames;
+	item->varyValues = headerValues(requestHeaders, varyNames);
+	item->expires = now + (qint64)ttl * 1000;
+
+	QMutexLocker locker(&g_mutex);
+
+	Variants &v = g_items[key];
+
+	// replace the variant for the same request header values, if any
+	for(int n = 0; n < v.count(); ++n)
+	{
+		if(v[n]->varyNames == item->varyNames && v[n]->varyValues == item->varyValues)
+		{
+			v[n] = item;
+			return true;
+		}
+	}
+
+	if(g_count >= MAX_ITEMS)
+	{
+		removeExpired(now);
+
+		if(g_count >= MAX_ITEMS)
+		{
+			if(g_items.value(key).isEmpty())
+				g_items.remove(key);
+
+			return false;
+		}
+	}
+
+	// the reference may have been invalidated by removeExpired
+	g_items[key] += item;
+	++g_count;
+
+	return true;
+}
+
+void clear()
+{
+	QMutexLocker locker(&g_mutex);
+
+	g_items.clear();
+	g_count = 0;
+}
+
+}
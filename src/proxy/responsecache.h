@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef RESPONSECACHE_H
+#define RESPONSECACHE_H
+
+#include <memory>
+#include <QByteArray>
+#include <QList>
+#include "httpheaders.h"
+
+// shared cache of complete origin responses, including any GRIP
+// instructions. storage follows the Cache-Control and Vary rules for a
+// shared cache. it is process-wide, so all engine threads share it
+namespace ResponseCache {
+
+class Item
+{
+public:
+	int code;
+	QByteArray reason;
+	HttpHeaders headers;
+	QByteArray body;
+	QList<QByteArray> varyNames; // lowercase
+	QList<QByteArray> varyValues;
+	qint64 expires; // monotonic msecs
+};
+
+// requests with a body or with methods other than GET and HEAD are never
+// cached
+bool isCacheableRequest(const QByteArray &method, int bodySize);
+
+// returns null if there is no fresh response matching the request headers
+std::shared_ptr<const Item> get(const QByteArray &key, const HttpHeaders &requestHeaders);
+
+// stores the response if its headers allow. returns true if stored
+bool put(const QByteArray &key, const HttpHeaders &requestHeaders, int code, const QByteArray &reason, const HttpHeaders &headers, const QByteArray &body);
+
+void clear();
+
+}
+
+#endif
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "test.h"
+#include "responsecache.h"
+
+static HttpHeaders cacheHeaders(const QByteArray &cacheControl)
+{
+	HttpHeaders h;
+	h += HttpHeader("Content-Type", "text/plain");
+	h += HttpHeader("Grip-Hold", "response");
+	h += HttpHeader("Grip-Channel", "test");
+	h += HttpHeader("Cache-Control", cacheControl);
+	return h;
+}
+
+static void storeAndLookup()
+{
+	ResponseCache::clear();
+
+	HttpHeaders req;
+	TEST_ASSERT(!ResponseCache::get("a", req));
+
+	TEST_ASSERT(ResponseCache::put("a", req, 200, "OK", cacheHeaders("max-age=60"), "nothing for now\n"));
+
+	std::shared_ptr<const ResponseCache::Item> i = ResponseCache::get("a", req);
+	TEST_ASSERT(i);
+	TEST_ASSERT_EQ(i->code, 200);
+	TEST_ASSERT_EQ(i->headers.get("Grip-Hold"), QByteArray("response"));
+	TEST_ASSERT_EQ(i->body, QByteArray("nothing for now\n"));
+
+	TEST_ASSERT(!ResponseCache::get("b", req));
+
+	ResponseCache::clear();
+	TEST_ASSERT(!ResponseCache::get("a", req));
+}
+
+static void notCacheable()
+{
+	ResponseCache::clear();
+
+	HttpHeaders req;
+
+	TEST_ASSERT(!ResponseCache::put("a", req, 200, "OK", cacheHeaders("no-store, max-age=60"), ""));
+	TEST_ASSERT(!ResponseCache::put("a", req, 200, "OK", cacheHeaders("private, max-age=60"), ""));
+	TEST_ASSERT(!ResponseCache::put("a", req, 200, "OK", cacheHeaders("max-age=0"), ""));
+	TEST_ASSERT(!ResponseCache::put("a", req, 500, "Internal Server Error", cacheHeaders("max-age=60"), ""));
+
+	HttpHeaders noDirectives;
+	TEST_ASSERT(!ResponseCache::put("a", req, 200, "OK", noDirectives, ""));
+
+	HttpHeaders varyAll = cacheHeaders("max-age=60");
+	varyAll += HttpHeader("Vary", "*");
+	TEST_ASSERT(!ResponseCache::put("a", req, 200, "OK", varyAll, ""));
+
+	HttpHeaders cookie = cacheHeaders("max-age=60");
+	cookie += HttpHeader("Set-Cookie", "a=b");
+	TEST_ASSERT(!ResponseCache::put("a", req, 200, "OK", cookie, ""));
+
+	// authorized requests need explicit permission to be shared
+	HttpHeaders authReq;
+	authReq += HttpHeader("Authorization", "Bearer x");
+	TEST_ASSERT(!ResponseCache::put("a", authReq, 200, "OK", cacheHeaders("max-age=60"), ""));
+	TEST_ASSERT(ResponseCache::put("a", authReq, 200, "OK", cacheHeaders("public, max-age=60"), ""));
+
+	TEST_ASSERT(ResponseCache::isCacheableRequest("GET", 0));
+	TEST_ASSERT(ResponseCache::isCacheableRequest("HEAD", 0));
+	TEST_ASSERT(!ResponseCache::isCacheableRequest("GET", 10));
+	TEST_ASSERT(!ResponseCache::isCacheableRequest("POST", 0));
+
+	ResponseCache::clear();
+}
+
+static void vary()
+{
+	ResponseCache::clear();
+
+	HttpHeaders gzipReq;
+	gzipReq += HttpHeader("Accept-Encoding", "gzip");
+
+	HttpHeaders plainReq;
+
+	HttpHeaders resp = cacheHeaders("s-maxage=60");
+	resp += HttpHeader("Vary", "Accept-Encoding");
+
+	TEST_ASSERT(ResponseCache::put("a", gzipReq, 200, "OK", resp, "gzip"));
+	TEST_ASSERT(!ResponseCache::get("a", plainReq));
+
+	TEST_ASSERT(ResponseCache::put("a", plainReq, 200, "OK", resp, "plain"));
+
+	std::shared_ptr<const ResponseCache::Item> i = ResponseCache::get("a", gzipReq);
+	TEST_ASSERT(i);
+	TEST_ASSERT_EQ(i->body, QByteArray("gzip"));
+
+	i = ResponseCache::get("a", plainReq);
+	TEST_ASSERT(i);
+	TEST_ASSERT_EQ(i->body, QByteArray("plain"));
+
+	// same variant is replaced
+	TEST_ASSERT(ResponseCache::put("a", plainReq, 200, "OK", resp, "plain2"));
+	TEST_ASSERT_EQ(ResponseCache::get("a", plainReq)->body, QByteArray("plain2"));
+
+	ResponseCache::clear();
+}
+
+extern "C" int responsecache_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(storeAndLookup());
+	TEST_CATCH(notCacheable());
+	TEST_CATCH(vary());
+
+	return 0;
+}
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+
+#include "sharedrequests.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <QHash>
+#include <QMutex>
+#include "socketnotifier.h"
+
+namespace SharedRequests {
+
+class Waiter::Private
+{
+public:
+	Waiter *q;
+	int pipe_[2];
+	std::unique_ptr<SocketNotifier> notifier;
+	Connection activatedConnection;
+	QMutex mutex;
+	QList<Result> results; // protected by mutex
+
+	Private(Waiter *_q) :
+		q(_q)
+	{
+		pipe_[0] = -1;
+		pipe_[1] = -1;
+
+		if(pipe(pipe_) == -1)
+		{
+			// can't be woken, so claim() won't register this waiter
+			return;
+		}
+
+		fcntl(pipe_[0], F_SETFL, O_NONBLOCK);
+		fcntl(pipe_[1], F_SETFL, O_NONBLOCK);
+
+		notifier = std::make_unique<SocketNotifier>(pipe_[0], SocketNotifier::Read);
+		activatedConnection = notifier->activated.connect(boost::bind(&Private::activated, this));
+		notifier->clearReadiness(SocketNotifier::Read);
+	}
+
+	~Private()
+	{
+		activatedConnection.disconnect();
+		notifier.reset();
+
+		if(pipe_[0] != -1)
+		{
+			close(pipe_[0]);
+			close(pipe_[1]);
+		}
+	}
+
+	bool isValid() const
+	{
+		return (bool)notifier;
+	}
+
+	// called from any thread
+	void deliver(const Result &r)
+	{
+		QMutexLocker locker(&mutex);
+
+		bool wasEmpty = results.isEmpty();
+
+		results += r;
+
+		// one byte per batch. if the write fails the pipe already has
+		// bytes in it, so the reader will be woken anyway
+		if(wasEmpty)
+		{
+			unsigned char c = 0;
+			if(::write(pipe_[1], &c, 1) == -1)
+				return;
+		}
+	}
+
+	void activated()
+	{
+		notifier->clearReadiness(SocketNotifier::Read);
+
+		unsigned char buf[64];
+		while(::read(pipe_[0], buf, sizeof(buf)) > 0)
+		{
+		}
+
+		q->ready();
+	}
+};
+
+class Entry
+{
+public:
+	QList<Waiter*> waiters;
+};
+
+static QMutex g_mutex;
+static QHash<QByteArray, Entry> g_entries;
+
+ClaimResult claim(const QByteArray &key, Waiter *waiter)
+{
+	// a thread that can't be woken can't wait on others either, so it
+	// doesn't take part
+	if(!waiter->d->isValid())
+		return Unshared;
+
+	QMutexLocker locker(&g_mutex);
+
+	QHash<QByteArray, Entry>::iterator it = g_entries.find(key);
+	if(it == g_entries.end())
+	{
+		g_entries.insert(key, Entry());
+		return Claimed;
+	}
+
+	if(!it->waiters.contains(waiter))
+		it->waiters += waiter;
+
+	return Waiting;
+}
+
+void finish(const QByteArray &key, const std::shared_ptr<const ResponseCache::Item> &item)
+{
+	QMutexLocker locker(&g_mutex);
+
+	QHash<QByteArray, Entry>::iterator it = g_entries.find(key);
+	if(it == g_entries.end())
+		return;
+
+	Result r;
+	r.key = key;
+	r.item = item;
+
+	// waiters remove themselves under the same lock before being
+	// destroyed, so they are all still valid here
+	for(Waiter *w : it->waiters)
+		w->d->deliver(r);
+
+	g_entries.erase(it);
+}
+
+Waiter::Waiter()
+{
+	d = std::make_unique<Private>(this);
+}
+
+Waiter::~Waiter()
+{
+	QMutexLocker locker(&g_mutex);
+
+	for(Entry &e : g_entries)
+		e.waiters.removeAll(this);
+}
+
+QList<Result> Waiter::take()
+{
+	QMutexLocker locker(&d->mutex);
+
+	QList<Result> out = d->results;
+	d->results.clear();
+
+	return out;
+}
+
+}
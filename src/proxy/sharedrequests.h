@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+
+#ifndef SHAREDREQUESTS_H
+#define SHAREDREQUESTS_H
+
+#include <memory>
+#include <QByteArray>
+#include <QList>
+#include "fastsignal.h"
+#include "responsecache.h"
+
+// process-wide table of in-flight origin requests, so that identical
+// requests on different engine threads can share one origin request. the
+// first thread to claim a key makes the request, and the others wait for
+// its complete response and replay it like a cache hit. responses are
+// passed around as ResponseCache items, so the body buffers are shared
+// rather than copied per thread
+namespace SharedRequests {
+
+class Result
+{
+public:
+	QByteArray key;
+	std::shared_ptr<const ResponseCache::Item> item; // null if not shared
+};
+
+class Waiter;
+
+enum ClaimResult
+{
+	Claimed, // the caller makes the request and must call finish()
+	Waiting, // the waiter will be given the outcome
+	Unshared // the caller makes its own request, without calling finish()
+};
+
+// claims the key for the caller if no thread has claimed it yet
+ClaimResult claim(const QByteArray &key, Waiter *waiter);
+
+// releases a claimed key and gives the response to the waiting threads.
+// item is null if the response can't be shared, in which case the waiters
+// should make their own requests
+void finish(const QByteArray &key, const std::shared_ptr<const ResponseCache::Item> &item);
+
+// receives the outcomes of keys claimed by other threads. a waiter belongs
+// to the thread that created it and must only be used from that thread
+class Waiter
+{
+public:
+	Waiter();
+	~Waiter();
+
+	// returns the outcomes delivered since the last call
+	QList<Result> take();
+
+	// emitted when there are outcomes to take
+	FastSignal<> ready;
+
+private:
+	class Private;
+	friend class Private;
+	friend ClaimResult claim(const QByteArray &key, Waiter *waiter);
+	friend void finish(const QByteArray &key, const std::shared_ptr<const ResponseCache::Item> &item);
+	std::unique_ptr<Private> d;
+};
+
+}
+
+#endif
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+
+#include <thread>
+#include "test.h"
+#include "eventloop.h"
+#include "sharedrequests.h"
+
+static void shareResponse()
+{
+	EventLoop loop(10);
+
+	{
+		SharedRequests::Waiter a;
+		SharedRequests::Waiter b;
+
+		int readyCount = 0;
+		Connection readyConnection = b.ready.connect([&] {
+			++readyCount;
+			loop.exit(0);
+		});
+
+		TEST_ASSERT(SharedRequests::claim("a", &a) == SharedRequests::Claimed);
+		TEST_ASSERT(SharedRequests::claim("a", &b) == SharedRequests::Waiting);
+
+		// waiting twice doesn't deliver twice
+		TEST_ASSERT(SharedRequests::claim("a", &b) == SharedRequests::Waiting);
+
+		auto item = std::make_shared<ResponseCache::Item>();
+		item->code = 200;
+		item->reason = "OK";
+		item->body = "hello\n";
+
+		std::shared_ptr<const ResponseCache::Item> citem = item;
+
+		// finishing from another thread wakes the waiter's thread
+		std::thread t([&] { SharedRequests::finish("a", citem); });
+		t.join();
+
+		TEST_ASSERT_EQ(loop.exec(), 0);
+		TEST_ASSERT_EQ(readyCount, 1);
+
+		QList<SharedRequests::Result> results = b.take();
+		TEST_ASSERT_EQ(results.count(), 1);
+		TEST_ASSERT_EQ(results[0].key, QByteArray("a"));
+		TEST_ASSERT(results[0].item == citem);
+
+		TEST_ASSERT(b.take().isEmpty());
+		TEST_ASSERT(a.take().isEmpty());
+
+		// the key is free again
+		TEST_ASSERT(SharedRequests::claim("a", &b) == SharedRequests::Claimed);
+		SharedRequests::finish("a", std::shared_ptr<const ResponseCache::Item>());
+	}
+}
+
+static void notShared()
+{
+	EventLoop loop(10);
+
+	{
+		SharedRequests::Waiter a;
+
+		TEST_ASSERT(SharedRequests::claim("b", &a) == SharedRequests::Claimed);
+
+		{
+			SharedRequests::Waiter b;
+			TEST_ASSERT(SharedRequests::claim("b", &b) == SharedRequests::Waiting);
+
+			SharedRequests::finish("b", std::shared_ptr<const ResponseCache::Item>());
+
+			// null means the waiter makes its own request
+			QList<SharedRequests::Result> results = b.take();
+			TEST_ASSERT_EQ(results.count(), 1);
+			TEST_ASSERT(!results[0].item);
+		}
+
+		TEST_ASSERT(SharedRequests::claim("b", &a) == SharedRequests::Claimed);
+
+		// a waiter destroyed while waiting is forgotten
+		{
+			SharedRequests::Waiter c;
+			TEST_ASSERT(SharedRequests::claim("b", &c) == SharedRequests::Waiting);
+		}
+
+		SharedRequests::finish("b", std::shared_ptr<const ResponseCache::Item>());
+	}
+}
+
+extern "C" int sharedrequests_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(shareResponse());
+	TEST_CATCH(notShared());
+
+	return 0;
+}
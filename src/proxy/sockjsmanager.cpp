@@ -24,6 +24,7 @@
 #include "sockjsmanager.h"
 
 #include <assert.h>
+#include <vector>
 #include <QtGlobal>
 #include <QUrlQuery>
 #include <QJsonDocument>
@@ -35,6 +36,9 @@
 #include "log.h"
 #include "bufferlist.h"
 #include "timer.h"
+#include "loopclock.h"
+#include "slabpool.h"
+#include "ringqueue.h"
 #include "zhttprequest.h"
 #include "zwebsocket.h"
 #include "sockjssession.h"
@@ -43,6 +47,15 @@ using std::map;
 
 #define MAX_REQUEST_BODY 100000
 
+// how long a closed session keeps answering with its close value
+#define LINGER_TIME 5000
+#define TIMER_SLACK 500
+
+// encoded messages kept for reuse by other sessions
+#define ENCODE_CACHE_SIZE 8
+#define ENCODE_CACHE_MESSAGE_MIN 128
+#define ENCODE_CACHE_MESSAGE_MAX 65536
+
 const char *iframeHtmlTemplate =
 "<!DOCTYPE html>\n"
 "<html>\n"
@@ -72,9 +85,146 @@ static QByteArray serializeJsonString(const QString &s)
 	return tmp.mid(1, tmp.length() - 2);
 }
 
+static void appendJsonStringUncached(QByteArray *out, const QByteArray &s)
+{
+	// only plain ascii is written directly
+	for(char c : s)
+	{
+		if((unsigned char)c >= 0x80)
+		{
+			*out += serializeJsonString(QString::fromUtf8(s));
+			return;
+		}
+	}
+
+	static const char *hex = "0123456789abcdef";
+
+	*out += '"';
+
+	for(char c : s)
+	{
+		switch(c)
+		{
+			case '"': *out += "\\\""; break;
+			case '\\': *out += "\\\\"; break;
+			case '\b': *out += "\\b"; break;
+			case '\f': *out += "\\f"; break;
+			case '\n': *out += "\\n"; break;
+			case '\r': *out += "\\r"; break;
+			case '\t': *out += "\\t"; break;
+			default:
+				if((unsigned char)c < 0x20)
+				{
+					*out += "\\u00";
+					*out += hex[(c >> 4) & 0x0f];
+					*out += hex[c & 0x0f];
+				}
+				else
+					*out += c;
+				break;
+		}
+	}
+
+	*out += '"';
+}
+
+// a publish to many sockjs sessions delivers the same message to each of
+// them, so the escaped form of recent messages is kept and reused. each
+// thread has its own cache
+class EncodeCache
+{
+public:
+	class Entry
+	{
+	public:
+		size_t hash;
+		QByteArray message;
+		QByteArray encoded;
+
+		Entry() :
+			hash(0)
+		{
+		}
+	};
+
+	Entry entries[ENCODE_CACHE_SIZE];
+	int next;
+
+	EncodeCache() :
+		next(0)
+	{
+	}
+
+	const QByteArray *find(const QByteArray &message, size_t hash) const
+	{
+		for(int n = 0; n < ENCODE_CACHE_SIZE; ++n)
+		{
+			const Entry &e = entries[n];
+			if(e.hash == hash && e.message == message)
+				return &e.encoded;
+		}
+
+		return 0;
+	}
+
+	void insert(const QByteArray &message, size_t hash, const QByteArray &encoded)
+	{
+		Entry &e = entries[next];
+		e.hash = hash;
+		e.message = message;
+		e.encoded = encoded;
+
+		next = (next + 1) % ENCODE_CACHE_SIZE;
+	}
+};
+
+static thread_local EncodeCache g_encodeCache;
+
+static void appendJsonString(QByteArray *out, const QByteArray &s)
+{
+	if(s.size() < ENCODE_CACHE_MESSAGE_MIN || s.size() > ENCODE_CACHE_MESSAGE_MAX)
+	{
+		appendJsonStringUncached(out, s);
+		return;
+	}
+
+	size_t hash = qHash(s);
+
+	const QByteArray *encoded = g_encodeCache.find(s, hash);
+	if(encoded)
+	{
+		*out += *encoded;
+		return;
+	}
+
+	QByteArray buf;
+	buf.reserve(s.size() + 2);
+	appendJsonStringUncached(&buf, s);
+
+	g_encodeCache.insert(s, hash, buf);
+
+	*out += buf;
+}
+
 class SockJsManager::Private
 {
 public:
+	// sessions are allocated from a slab and referred to by generational
+	// handles, so callbacks for a removed session are caught without keeping
+	// a lookup table per key
+	class SessionHandle
+	{
+	public:
+		int index;
+		quint32 generation;
+
+		SessionHandle() :
+			index(-1),
+			generation(0)
+		{
+		}
+	};
+
 	class Session
 	{
 	public:
@@ -85,6 +235,7 @@ public:
 		};
 
 		Private *owner;
+		SessionHandle handle;
 		Type type;
 		ZhttpRequest *req;
 		ZWebSocket *sock;
@@ -97,12 +248,10 @@ public:
 		QByteArray lastPart;
 		bool pending;
 		SockJsSession *ext;
-		std::unique_ptr<Timer> timer;
 		QVariant closeValue;
-		Connection timerConnection;
 
-		Session(Private *_owner) :
-			owner(_owner),
+		Session() :
+			owner(0),
 			req(0),
 			sock(0),
 			pending(false),
@@ -122,6 +271,25 @@ public:
 		}
 	};
 
+	class SessionSlot
+	{
+	public:
+		Session *s;
+		quint32 generation;
+	};
+
+	class Linger
+	{
+	public:
+		qint64 expireTime;
+		SessionHandle handle;
+
+		Linger() :
+			expireTime(0)
+		{
+		}
+	};
+
 	struct WSConnections {
 		Connection closedConnection;
 		Connection errorConnection;
@@ -134,13 +302,15 @@ public:
 	};
 
 	SockJsManager *q;
-	QSet<Session*> sessions;
-	QHash<ZhttpRequest*, Session*> sessionsByRequest;
-	QHash<ZWebSocket*, Session*> sessionsBySocket;
+	SlabPool<Session, 256> sessionPool;
+	std::vector<SessionSlot> sessionSlots;
+	std::vector<int> freeSessionSlots;
 	QHash<QByteArray, Session*> sessionsById;
 	QHash<SockJsSession*, Session*> sessionsByExt;
-	QHash<Timer*, Session*> sessionsByTimer;
 	QList<Session*> pendingSessions;
+	RingQueue<Linger> lingering; // all have the same duration, so in expiry order
+	std::unique_ptr<Timer> lingerTimer;
+	Connection lingerTimerConnection;
 	QByteArray iframeHtml;
 	QByteArray iframeHtmlEtag;
 	QSet<ZhttpRequest*> discardedRequests;
@@ -152,6 +322,11 @@ public:
 	{
 		iframeHtml = QString(iframeHtmlTemplate).arg(sockJsUrl).toUtf8();
 		iframeHtmlEtag = '\"' + QCryptographicHash::hash(iframeHtml, QCryptographicHash::Md5).toHex() + '\"';
+
+		lingerTimer = std::make_unique<Timer>();
+		lingerTimerConnection = lingerTimer->timeout.connect(boost::bind(&Private::lingerTimer_timeout, this));
+		lingerTimer->setSingleShot(true);
+		lingerTimer->setSlack(TIMER_SLACK);
 	}
 
 	~Private()
@@ -161,7 +336,54 @@ public:
 		while(!pendingSessions.isEmpty())
 			removeSession(pendingSessions.takeFirst());
 
-		assert(sessions.isEmpty());
+		while(!lingering.isEmpty())
+		{
+			Session *s = session(lingering.takeFirst().handle);
+			if(s)
+				removeSession(s);
+		}
+
+		assert(sessionPool.count() == 0);
+	}
+
+	Session *createSession()
+	{
+		int index;
+		if(!freeSessionSlots.empty())
+		{
+			index = freeSessionSlots.back();
+			freeSessionSlots.pop_back();
+		}
+		else
+		{
+			index = (int)sessionSlots.size();
+			sessionSlots.push_back(SessionSlot());
+			sessionSlots.back().generation = 0;
+		}
+
+		Session *s = sessionPool.create();
+		s->owner = this;
+
+		SessionSlot &slot = sessionSlots[index];
+		slot.s = s;
+
+		s->handle.index = index;
+		s->handle.generation = slot.generation;
+
+		return s;
+	}
+
+	// returns null if the session has been removed
+	Session *session(const SessionHandle &h) const
+	{
+		if(h.index < 0 || h.index >= (int)sessionSlots.size())
+			return 0;
+
+		const SessionSlot &slot = sessionSlots[h.index];
+		if(slot.generation != h.generation)
+			return 0;
+
+		return slot.s;
 	}
 
 	void removeSession(Session *s)
@@ -171,18 +393,18 @@ public:
 
 		// note: this method assumes the session has already been removed
 		//   from pendingSessions if needed
-		if(s->req)
-			sessionsByRequest.remove(s->req);
-		if(s->sock)
-			sessionsBySocket.remove(s->sock);
-		if(!s->sid.isEmpty())
+		if(!s->sid.isEmpty() && sessionsById.value(s->sid) == s)
 			sessionsById.remove(s->sid);
-		if(s->ext)
-			sessionsByExt.remove(s->ext);
-		if(s->timer)
-			sessionsByTimer.remove(s->timer.get());
-		sessions.remove(s);
-		delete s;
+
+		int index = s->handle.index;
+		SessionSlot &slot = sessionSlots[index];
+		assert(slot.s == s);
+
+		slot.s = 0;
+		++slot.generation;
+		freeSessionSlots.push_back(index);
+
+		sessionPool.release(s);
 	}
 
 	void unlink(SockJsSession *ext)
@@ -196,11 +418,13 @@ public:
 		if(s->closeValue.isValid())
 		{
 			// if there's a close value, hang around for a little bit
-			s->timer = std::make_unique<Timer>();
-			s->timerConnection = s->timer->timeout.connect(boost::bind(&Private::timer_timeout, this, s->timer.get()));
-			s->timer->setSingleShot(true);
-			sessionsByTimer.insert(s->timer.get(), s);
-			s->timer->start(5000);
+			Linger l;
+			l.expireTime = LoopClock::msecsSinceEpoch() + LINGER_TIME;
+			l.handle = s->handle;
+			lingering += l;
+
+			if(!lingerTimer->isActive())
+				lingerTimer->start(LINGER_TIME);
 		}
 		else
 			removeSession(s);
@@ -216,7 +440,7 @@ public:
 
 	void startHandleRequest(ZhttpRequest *req, int basePathStart, const QByteArray &asPath, const DomainMap::Entry &route)
 	{
-		Session *s = new Session(this);
+		Session *s = createSession();
 		s->req = req;
 
 		QUrl uri = req->requestUri();
@@ -251,20 +475,17 @@ public:
 		s->route = route;
 
 		reqConnectionMap[req] = {
-			req->readyRead.connect(boost::bind(&Private::req_readyRead, this, req)),
-			req->bytesWritten.connect(boost::bind(&Private::req_bytesWritten, this, boost::placeholders::_1, req)),
-			req->error.connect(boost::bind(&Private::req_error, this, req))
+			req->readyRead.connect(boost::bind(&Private::req_readyRead, this, s->handle)),
+			req->bytesWritten.connect(boost::bind(&Private::req_bytesWritten, this, boost::placeholders::_1, s->handle)),
+			req->error.connect(boost::bind(&Private::req_error, this, s->handle))
 		};
 
-		sessions += s;
-		sessionsByRequest.insert(s->req, s);
-
 		processRequestInput(s);
 	}
 
 	void startHandleSocket(ZWebSocket *sock, int basePathStart, const QByteArray &asPath, const DomainMap::Entry &route)
 	{
-		Session *s = new Session(this);
+		Session *s = createSession();
 		s->sock = sock;
 
 		QByteArray encPath = sock->requestUri().path(QUrl::FullyEncoded).toUtf8();
@@ -277,13 +498,10 @@ public:
 		s->route = route;
 
 		wsConnectionMap[sock] = {
-			sock->closed.connect(boost::bind(&Private::sock_closed, this, sock)),
-			sock->error.connect(boost::bind(&Private::sock_error, this, sock))
+			sock->closed.connect(boost::bind(&Private::sock_closed, this, s->handle)),
+			sock->error.connect(boost::bind(&Private::sock_error, this, s->handle))
 		};
 
-		sessions += s;
-		sessionsBySocket.insert(s->sock, s);
-
 		handleSocket(s);
 	}
 
@@ -319,12 +537,6 @@ public:
 
 	void respondOk(ZhttpRequest *req, const QVariant &data, const QByteArray &prefix = QByteArray(), const QByteArray &jsonpCallback = QByteArray())
 	{
-		HttpHeaders headers;
-		if(!jsonpCallback.isEmpty())
-			headers += HttpHeader("Content-Type", "application/javascript");
-		else
-			headers += HttpHeader("Content-Type", "text/plain");
-
 		QByteArray body;
 		if(data.isValid())
 		{
@@ -339,6 +551,24 @@ public:
 		if(!prefix.isEmpty())
 			body.prepend(prefix);
 
+		respondOkBody(req, body, jsonpCallback);
+	}
+
+	void respondMessages(ZhttpRequest *req, const QList<QByteArray> &messages, const QByteArray &jsonpCallback)
+	{
+		respondOkBody(req, encodeMessages(messages), jsonpCallback);
+	}
+
+	void respondOkBody(ZhttpRequest *req, const QByteArray &data, const QByteArray &jsonpCallback)
+	{
+		HttpHeaders headers;
+		if(!jsonpCallback.isEmpty())
+			headers += HttpHeader("Content-Type", "application/javascript");
+		else
+			headers += HttpHeader("Content-Type", "text/plain");
+
+		QByteArray body = data;
+
 		if(!jsonpCallback.isEmpty())
 		{
 			QByteArray encBody = serializeJsonString(QString::fromUtf8(body));
@@ -372,15 +602,16 @@ public:
 
 	void respondError(ZhttpRequest *req, int code, const QByteArray &reason, const QString &message, bool discard = false)
 	{
-		// if discarded, manager takes ownership of req to handle sending
+		// if discarded, manager takes ownership of req to handle sending.
+		//   the entire input must have been read already
 		if(discard)
 		{
 			discardedRequests += req;
 
 			reqConnectionMap[req] = {
-				req->readyRead.connect(boost::bind(&Private::req_readyRead, this, req)),
-				req->bytesWritten.connect(boost::bind(&Private::req_bytesWritten, this, boost::placeholders::_1, req)),
-				req->error.connect(boost::bind(&Private::req_error, this, req))
+				Connection(),
+				req->bytesWritten.connect(boost::bind(&Private::discarded_bytesWritten, this, boost::placeholders::_1, req)),
+				req->error.connect(boost::bind(&Private::discarded_error, this, req))
 			};
 		}
 
@@ -567,7 +798,6 @@ public:
 			s->ext->setupServer(q, s->req, s->jsonpCallback, s->asUri, s->sid, s->lastPart, s->reqBody.toByteArray(), s->route);
 
 			reqConnectionMap.erase(s->req);
-			sessionsByRequest.remove(s->req);
 			s->req = 0;
 		}
 		else // s->sock
@@ -581,7 +811,6 @@ public:
 				s->ext->setupServer(q, s->sock, s->asUri, s->route);
 
 			wsConnectionMap.erase(s->sock);
-			sessionsBySocket.remove(s->sock);
 			s->sock = 0;
 		}
 
@@ -591,55 +820,31 @@ public:
 	}
 
 private:
-	void req_readyRead(ZhttpRequest *req)
+	void req_readyRead(SessionHandle h)
 	{
-		// for a request to have been discardable, we must have read the
-		//   entire input already and handed to the session
-		assert(!discardedRequests.contains(req));
-
-		Session *s = sessionsByRequest.value(req);
+		Session *s = session(h);
 		assert(s);
 
 		processRequestInput(s);
 	}
 
-	void req_bytesWritten(int count, ZhttpRequest *req)
+	void req_bytesWritten(int count, SessionHandle h)
 	{
 		Q_UNUSED(count);
 
-		if(discardedRequests.contains(req))
-		{
-			if(req->isFinished())
-			{
-				discardedRequests.remove(req);
-				reqConnectionMap.erase(req);
-				delete req;
-			}
-
-			return;
-		}
-
-		Session *s = sessionsByRequest.value(req);
+		Session *s = session(h);
 		assert(s);
 
-		if(req->isFinished())
+		if(s->req->isFinished())
 		{
 			assert(!s->pending);
 			removeSession(s);
 		}
 	}
 
-	void req_error(ZhttpRequest *req)
+	void req_error(SessionHandle h)
 	{
-		if(discardedRequests.contains(req))
-		{
-			discardedRequests.remove(req);
-			reqConnectionMap.erase(req);
-			delete req;
-			return;
-		}
-
-		Session *s = sessionsByRequest.value(req);
+		Session *s = session(h);
 		assert(s);
 
 		if(s->pending)
@@ -648,9 +853,28 @@ private:
 			removeSession(s);
 	}
 
-	void sock_closed(ZWebSocket *sock)
+	void discarded_bytesWritten(int count, ZhttpRequest *req)
+	{
+		Q_UNUSED(count);
+
+		if(req->isFinished())
+		{
+			discardedRequests.remove(req);
+			reqConnectionMap.erase(req);
+			delete req;
+		}
+	}
+
+	void discarded_error(ZhttpRequest *req)
+	{
+		discardedRequests.remove(req);
+		reqConnectionMap.erase(req);
+		delete req;
+	}
+
+	void sock_closed(SessionHandle h)
 	{
-		Session *s = sessionsBySocket.value(sock);
+		Session *s = session(h);
 		assert(s);
 
 		if(s->pending)
@@ -659,9 +883,9 @@ private:
 			removeSession(s);
 	}
 
-	void sock_error(ZWebSocket *sock)
+	void sock_error(SessionHandle h)
 	{
-		Session *s = sessionsBySocket.value(sock);
+		Session *s = session(h);
 		assert(s);
 
 		if(s->pending)
@@ -670,14 +894,22 @@ private:
 			removeSession(s);
 	}
 
-private:
-	void timer_timeout(Timer *timer)
+	void lingerTimer_timeout()
 	{
-		Session *s = sessionsByTimer.value(timer);
-		assert(s);
+		qint64 now = LoopClock::msecsSinceEpoch();
 
-		assert(!s->pending);
-		removeSession(s);
+		while(!lingering.isEmpty() && lingering.first().expireTime <= now)
+		{
+			Session *s = session(lingering.takeFirst().handle);
+			if(s)
+			{
+				assert(!s->pending);
+				removeSession(s);
+			}
+		}
+
+		if(!lingering.isEmpty())
+			lingerTimer->start((int)(lingering.first().expireTime - now));
 	}
 };
 
@@ -726,6 +958,11 @@ void SockJsManager::respondOk(ZhttpRequest *req, const QString &str, const QByte
 	d->respondOk(req, str, jsonpCallback);
 }
 
+void SockJsManager::respondMessages(ZhttpRequest *req, const QList<QByteArray> &messages, const QByteArray &jsonpCallback)
+{
+	d->respondMessages(req, messages, jsonpCallback);
+}
+
 void SockJsManager::respondError(ZhttpRequest *req, int code, const QByteArray &reason, const QString &message, bool discard)
 {
 	d->respondError(req, code, reason, message, discard);
@@ -735,3 +972,27 @@ void SockJsManager::respond(ZhttpRequest *req, int code, const QByteArray &reaso
 {
 	d->respond(req, code, reason, headers, body);
 }
+
+QByteArray SockJsManager::encodeMessages(const QList<QByteArray> &messages)
+{
+	int size = 3;
+	foreach(const QByteArray &m, messages)
+		size += m.size() + 3;
+
+	QByteArray out;
+	out.reserve(size);
+
+	out += "a[";
+
+	for(int n = 0; n < messages.count(); ++n)
+	{
+		if(n > 0)
+			out += ',';
+
+		appendJsonString(&out, messages[n]);
+	}
+
+	out += ']';
+
+	return out;
+}
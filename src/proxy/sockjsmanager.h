@@ -27,9 +27,9 @@
 #include "domainmap.h"
 #include <boost/signals2.hpp>
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 
 using Signal = boost::signals2::signal<void()>;
-using Connection = boost::signals2::scoped_connection;
 
 class HttpHeaders;
 class ZhttpRequest;
@@ -47,6 +47,10 @@ public:
 
 	SockJsSession *takeNext();
 
+	// returns a sockjs message array frame ("a" followed by a json array
+	// of strings)
+	static QByteArray encodeMessages(const QList<QByteArray> &messages);
+
 	Signal sessionReady;
 
 private:
@@ -59,6 +63,7 @@ private:
 	void setLinger(SockJsSession *sess, const QVariant &closeValue);
 	void respondOk(ZhttpRequest *req, const QVariant &data, const QByteArray &prefix = QByteArray(), const QByteArray &jsonpCallback = QByteArray());
 	void respondOk(ZhttpRequest *req, const QString &str, const QByteArray &jsonpCallback = QByteArray());
+	void respondMessages(ZhttpRequest *req, const QList<QByteArray> &messages, const QByteArray &jsonpCallback = QByteArray());
 	void respondError(ZhttpRequest *req, int code, const QByteArray &reason, const QString &message, bool discard = false);
 	void respond(ZhttpRequest *req, int code, const QByteArray &reason, const HttpHeaders &headers, const QByteArray &body);
 };
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include <QJsonDocument>
+#include <QJsonArray>
+#include "test.h"
+#include "sockjsmanager.h"
+
+static QByteArray referenceEncode(const QList<QByteArray> &messages)
+{
+	QVariantList list;
+	foreach(const QByteArray &m, messages)
+		list += QString::fromUtf8(m);
+
+	return "a" + QJsonDocument(QJsonArray::fromVariantList(list)).toJson(QJsonDocument::Compact);
+}
+
+static void encodeMessages()
+{
+	TEST_ASSERT_EQ(SockJsManager::encodeMessages(QList<QByteArray>()), QByteArray("a[]"));
+	TEST_ASSERT_EQ(SockJsManager::encodeMessages(QList<QByteArray>() << "hello"), QByteArray("a[\"hello\"]"));
+	TEST_ASSERT_EQ(SockJsManager::encodeMessages(QList<QByteArray>() << "a" << "b"), QByteArray("a[\"a\",\"b\"]"));
+
+	QByteArray escaped("q\"b\\n\nt\tc\x01");
+	TEST_ASSERT_EQ(SockJsManager::encodeMessages(QList<QByteArray>() << escaped), QByteArray("a[\"q\\\"b\\\\n\\nt\\tc\\u0001\"]"));
+}
+
+static void matchesJson()
+{
+	QList<QByteArray> messages;
+	messages += QByteArray("{\"type\": \"update\", \"path\": \"/a/b\"}");
+	messages += QByteArray("caf\xc3\xa9");
+	messages += QByteArray("bad \xff utf-8");
+	messages += QByteArray("\r\n\b\f\x1f");
+
+	// the result must parse back to the same strings
+	QByteArray out = SockJsManager::encodeMessages(messages);
+	TEST_ASSERT(out.startsWith('a'));
+
+	QJsonParseError e;
+	QJsonDocument doc = QJsonDocument::fromJson(out.mid(1), &e);
+	TEST_ASSERT_EQ((int)e.error, (int)QJsonParseError::NoError);
+	TEST_ASSERT_EQ(doc.array().count(), messages.count());
+	TEST_ASSERT_EQ(out, referenceEncode(messages));
+}
+
+static void reuseEncoded()
+{
+	QByteArray plain(1000, 'a');
+	QByteArray other = plain;
+	other[500] = '"';
+
+	// messages large enough to be cached must not be confused with others
+	// of the same size
+	QByteArray first = SockJsManager::encodeMessages(QList<QByteArray>() << plain);
+	QByteArray second = SockJsManager::encodeMessages(QList<QByteArray>() << other);
+	TEST_ASSERT_EQ(first.size(), plain.size() + 5);
+	TEST_ASSERT_EQ(second.size(), other.size() + 6);
+
+	TEST_ASSERT_EQ(SockJsManager::encodeMessages(QList<QByteArray>() << plain), first);
+	TEST_ASSERT_EQ(SockJsManager::encodeMessages(QList<QByteArray>() << QByteArray(plain.data(), plain.size())), first);
+	TEST_ASSERT_EQ(SockJsManager::encodeMessages(QList<QByteArray>() << plain << other), referenceEncode(QList<QByteArray>() << plain << other));
+}
+
+extern "C" int sockjsmanager_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(encodeMessages());
+	TEST_CATCH(matchesJson());
+	TEST_CATCH(reuseEncoded());
+
+	return 0;
+}
@@ -43,6 +43,7 @@ using std::map;
 #define BUFFER_SIZE 200000
 #define KEEPALIVE_TIMEOUT 25
 #define UNCONNECTED_TIMEOUT 5
+#define TIMER_SLACK 500
 
 class SockJsSession::Private
 {
@@ -161,6 +162,7 @@ public:
 	int peerCloseCode;
 	QString peerCloseReason;
 	bool updating;
+	bool writePending;
 	map<ZhttpRequest*, ReqConnections> reqConnectionMap;
 	WSConnections wsConnection;
 	Connection keepAliveTimerConnection;
@@ -183,10 +185,12 @@ public:
 		closeSent(false),
 		peerClosed(false),
 		peerCloseCode(-1),
-		updating(false)
+		updating(false),
+		writePending(false)
 	{
 		keepAliveTimer = std::make_unique<Timer>();
 		keepAliveTimerConnection = keepAliveTimer->timeout.connect(boost::bind(&Private::keepAliveTimer_timeout, this));
+		keepAliveTimer->setSlack(TIMER_SLACK);
 	}
 
 	~Private()
@@ -541,15 +545,19 @@ public:
 
 				outFrames += frame;
 
-				tryWrite();
+				// frames written in the same pass go out in one response
+				if(!writePending)
+				{
+					writePending = true;
+					deferCall.defer([=] {
+						writePending = false;
+						tryWrite();
+					});
+				}
 			}
 			else // WebSocketFramed
 			{
-				QVariantList messages;
-				messages += QString::fromUtf8(frame.data);
-
-				QByteArray arrayJson = QJsonDocument(QJsonArray::fromVariantList(messages)).toJson(QJsonDocument::Compact);
-				Frame f(Frame::Text, "a" + arrayJson, false);
+				Frame f(Frame::Text, SockJsManager::encodeMessages(QList<QByteArray>() << frame.data), false);
 
 				pendingWrites += WriteItem(WriteItem::User, frame.data.size());
 				sock->writeFrame(f);
@@ -611,7 +619,7 @@ public:
 		if(ri->responded)
 			return;
 
-		QVariantList messages;
+		QList<QByteArray> messages;
 
 		int frames = 0;
 		int bytes = 0;
@@ -643,7 +651,7 @@ public:
 			QByteArray data = bufs.toByteArray();
 
 			pendingWrites += WriteItem(WriteItem::User, data.size());
-			messages += QString::fromUtf8(data);
+			messages += data;
 		}
 
 		if(bytes > 0)
@@ -660,7 +668,7 @@ public:
 		if(!messages.isEmpty())
 		{
 			ri->responded = true;
-			respondOk(req, messages, "a", ri->jsonpCallback);
+			manager->respondMessages(req, messages, ri->jsonpCallback);
 			keepAliveTimer->stop();
 		}
 		else if(state == Closing)
@@ -30,8 +30,7 @@
 #include "websocket.h"
 #include "domainmap.h"
 #include <boost/signals2.hpp>
-
-using Connection = boost::signals2::scoped_connection;
+#include "fastsignal.h"
 
 class ZhttpRequest;
 class ZWebSocket;
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "targetbalancer.h"
+
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <QHash>
+#include <QMutex>
+
+static QMutex g_healthMutex;
+static QHash< QString, std::weak_ptr<TargetHealth> > g_healthByKey;
+static int g_healthPruneAt = 64;
+
+static std::atomic<int> g_ejectFailures(0);
+static std::atomic<int> g_ejectCooldown(0);
+
+static qint64 nowMs()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int healthOutstanding(const DomainMap::Target &t)
+{
+	return t.health ? t.health->outstanding() : 0;
+}
+
+TargetHealth::Outstanding::Outstanding(const std::shared_ptr<TargetHealth> &health) :
+	health_(health)
+{
+	++health_->outstanding_;
+}
+
+TargetHealth::Outstanding::~Outstanding()
+{
+	--health_->outstanding_;
+}
+
+TargetHealth::TargetHealth() :
+	outstanding_(0),
+	failures_(0),
+	ejectedUntil_(0)
+{
+}
+
+std::shared_ptr<TargetHealth> TargetHealth::get(const QString &key)
+{
+	QMutexLocker locker(&g_healthMutex);
+
+	std::shared_ptr<TargetHealth> h = g_healthByKey.value(key).lock();
+	if(h)
+		return h;
+
+	// drop entries for targets no longer in any route, checking again
+	// once the table has doubled
+	if(g_healthByKey.count() >= g_healthPruneAt)
+	{
+		QMutableHashIterator< QString, std::weak_ptr<TargetHealth> > it(g_healthByKey);
+		while(it.hasNext())
+		{
+			it.next();
+			if(it.value().expired())
+				it.remove();
+		}
+
+		g_healthPruneAt = qMax(64, g_healthByKey.count() * 2);
+	}
+
+	h = std::shared_ptr<TargetHealth>(new TargetHealth);
+	g_healthByKey.insert(key, h);
+
+	return h;
+}
+
+void TargetHealth::setEjectPolicy(int failures, int cooldownMs)
+{
+	g_ejectFailures = failures;
+	g_ejectCooldown = cooldownMs;
+}
+
+int TargetHealth::outstanding() const
+{
+	return outstanding_.load(std::memory_order_relaxed);
+}
+
+bool TargetHealth::isEjected() const
+{
+	qint64 until = ejectedUntil_.load(std::memory_order_relaxed);
+
+	return (until != 0 && nowMs() < until);
+}
+
+void TargetHealth::recordSuccess()
+{
+	failures_.store(0, std::memory_order_relaxed);
+	ejectedUntil_.store(0, std::memory_order_relaxed);
+}
+
+void TargetHealth::recordFailure()
+{
+	int max = g_ejectFailures.load(std::memory_order_relaxed);
+
+	// once ejected, a failure after the cooldown ejects again right away,
+	// since the count is only reset by a success
+	if(++failures_ >= max && max > 0)
+		ejectedUntil_.store(nowMs() + g_ejectCooldown.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+TargetBalancer::TargetBalancer(Strategy strategy) :
+	strategy_(strategy),
+	next_(0)
+{
+}
+
+QList<DomainMap::Target> TargetBalancer::order(const QList<DomainMap::Target> &targets)
+{
+	if(strategy_ == Ordered && g_ejectFailures.load(std::memory_order_relaxed) <= 0)
+		return targets;
+
+	QList<DomainMap::Target> healthy;
+	QList<DomainMap::Target> ejected;
+
+	for(const DomainMap::Target &t : targets)
+	{
+		if(t.health && t.health->isEjected())
+			ejected += t;
+		else
+			healthy += t;
+	}
+
+	int count = healthy.count();
+
+	if(count > 1)
+	{
+		switch(strategy_)
+		{
+			case Ordered:
+				break;
+			case RoundRobin:
+			{
+				int start = (int)(next_++ % (quint32)count);
+				std::rotate(healthy.begin(), healthy.begin() + start, healthy.end());
+				break;
+			}
+			case LeastRequests:
+			{
+				// rotate first, so that ties are spread across targets
+				int start = (int)(next_++ % (quint32)count);
+				std::rotate(healthy.begin(), healthy.begin() + start, healthy.end());
+
+				std::stable_sort(healthy.begin(), healthy.end(), [](const DomainMap::Target &a, const DomainMap::Target &b) {
+					return healthOutstanding(a) < healthOutstanding(b);
+				});
+				break;
+			}
+			case PowerOfTwo:
+			{
+				static thread_local std::minstd_rand rng(std::random_device{}());
+
+				int a = (int)(rng() % (quint32)count);
+				int b = (int)(rng() % (quint32)(count - 1));
+				if(b >= a)
+					++b;
+
+				int pick = (healthOutstanding(healthy[b]) < healthOutstanding(healthy[a]) ? b : a);
+
+				// the remaining targets stay in their configured order as
+				// fallbacks
+				healthy.move(pick, 0);
+				break;
+			}
+		}
+	}
+
+	return healthy + ejected;
+}
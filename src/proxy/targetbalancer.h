@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef TARGETBALANCER_H
+#define TARGETBALANCER_H
+
+#include <atomic>
+#include <memory>
+#include <QString>
+#include <QList>
+#include "domainmap.h"
+
+// passive health and load of a single target. there is one instance per
+// distinct target, shared by all routes and threads that use it
+class TargetHealth
+{
+public:
+	// counts a request as outstanding for as long as it exists
+	class Outstanding
+	{
+	public:
+		Outstanding(const std::shared_ptr<TargetHealth> &health);
+		~Outstanding();
+
+	private:
+		std::shared_ptr<TargetHealth> health_;
+	};
+
+	// returns the instance for the target identified by key, creating it
+	// if necessary
+	static std::shared_ptr<TargetHealth> get(const QString &key);
+
+	// a target is ejected after the given number of consecutive failures,
+	// and is tried again once the cooldown has passed. a failure count of
+	// zero disables ejection
+	static void setEjectPolicy(int failures, int cooldownMs);
+
+	int outstanding() const;
+	bool isEjected() const;
+
+	void recordSuccess();
+	void recordFailure();
+
+private:
+	std::atomic<int> outstanding_;
+	std::atomic<int> failures_;
+	std::atomic<qint64> ejectedUntil_;
+
+	TargetHealth();
+};
+
+// chooses the order in which a route's targets are tried. there is one
+// instance per route, and it may be used from any thread
+class TargetBalancer
+{
+public:
+	enum Strategy
+	{
+		Ordered,
+		RoundRobin,
+		LeastRequests,
+		PowerOfTwo
+	};
+
+	TargetBalancer(Strategy strategy);
+
+	Strategy strategy() const { return strategy_; }
+
+	// ejected targets are placed last, in their configured order, so that
+	// a request can still be attempted if every target is ejected
+	QList<DomainMap::Target> order(const QList<DomainMap::Target> &targets);
+
+private:
+	Strategy strategy_;
+	std::atomic<quint32> next_;
+};
+
+#endif
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "test.h"
+#include "targetbalancer.h"
+
+static DomainMap::Target makeTarget(const QString &host)
+{
+	DomainMap::Target t;
+	t.connectHost = host;
+	t.connectPort = 80;
+	t.health = TargetHealth::get(host + ":80");
+	return t;
+}
+
+static void roundRobin()
+{
+	QList<DomainMap::Target> targets;
+	targets += makeTarget("rr-a");
+	targets += makeTarget("rr-b");
+	targets += makeTarget("rr-c");
+
+	TargetBalancer b(TargetBalancer::RoundRobin);
+
+	QList<DomainMap::Target> out = b.order(targets);
+	TEST_ASSERT_EQ(out.count(), 3);
+	TEST_ASSERT_EQ(out[0].connectHost, QString("rr-a"));
+	TEST_ASSERT_EQ(out[1].connectHost, QString("rr-b"));
+
+	out = b.order(targets);
+	TEST_ASSERT_EQ(out[0].connectHost, QString("rr-b"));
+	TEST_ASSERT_EQ(out[2].connectHost, QString("rr-a"));
+
+	out = b.order(targets);
+	TEST_ASSERT_EQ(out[0].connectHost, QString("rr-c"));
+
+	// the same target is shared by key
+	TEST_ASSERT(TargetHealth::get("rr-a:80") == targets[0].health);
+}
+
+static void leastRequests()
+{
+	QList<DomainMap::Target> targets;
+	targets += makeTarget("lr-a");
+	targets += makeTarget("lr-b");
+
+	TargetBalancer b(TargetBalancer::LeastRequests);
+
+	{
+		TargetHealth::Outstanding r1(targets[0].health);
+		TargetHealth::Outstanding r2(targets[0].health);
+		TEST_ASSERT_EQ(targets[0].health->outstanding(), 2);
+
+		for(int n = 0; n < 4; ++n)
+			TEST_ASSERT_EQ(b.order(targets)[0].connectHost, QString("lr-b"));
+
+		// power of two choices with two targets always compares both
+		TargetBalancer p(TargetBalancer::PowerOfTwo);
+		for(int n = 0; n < 4; ++n)
+			TEST_ASSERT_EQ(p.order(targets)[0].connectHost, QString("lr-b"));
+	}
+
+	TEST_ASSERT_EQ(targets[0].health->outstanding(), 0);
+}
+
+static void ejection()
+{
+	QList<DomainMap::Target> targets;
+	targets += makeTarget("ej-a");
+	targets += makeTarget("ej-b");
+
+	TargetBalancer b(TargetBalancer::Ordered);
+
+	TargetHealth::setEjectPolicy(2, 60000);
+
+	targets[0].health->recordFailure();
+	TEST_ASSERT(!targets[0].health->isEjected());
+	TEST_ASSERT_EQ(b.order(targets)[0].connectHost, QString("ej-a"));
+
+	// ejected targets are still tried, but last
+	targets[0].health->recordFailure();
+	TEST_ASSERT(targets[0].health->isEjected());
+	QList<DomainMap::Target> out = b.order(targets);
+	TEST_ASSERT_EQ(out.count(), 2);
+	TEST_ASSERT_EQ(out[0].connectHost, QString("ej-b"));
+	TEST_ASSERT_EQ(out[1].connectHost, QString("ej-a"));
+
+	targets[0].health->recordSuccess();
+	TEST_ASSERT(!targets[0].health->isEjected());
+	TEST_ASSERT_EQ(b.order(targets)[0].connectHost, QString("ej-a"));
+
+	TargetHealth::setEjectPolicy(0, 0);
+}
+
+extern "C" int targetbalancer_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(roundRobin());
+	TEST_CATCH(leastRequests());
+	TEST_CATCH(ejection());
+
+	return 0;
+}
@@ -1,4 +1,15 @@
 SOURCES += \
 	$$PWD/websocketoverhttptest.cpp \
 	$$PWD/routesfiletest.cpp \
-	$$PWD/proxyenginetest.cpp
+	$$PWD/proxyenginetest.cpp \
+	$$PWD/pathtrietest.cpp \
+	$$PWD/targetbalancertest.cpp \
+	$$PWD/responsecachetest.cpp \
+	$$PWD/keepaliveschedulertest.cpp \
+	$$PWD/sockjsmanagertest.cpp \
+	$$PWD/inspectcachetest.cpp \
+	$$PWD/admissioncontrollertest.cpp \
+	$$PWD/concurrencylimittest.cpp \
+	$$PWD/zroutestest.cpp \
+	$$PWD/sharedrequeststest.cpp \
+	$$PWD/workerloadtest.cpp
@@ -24,6 +24,7 @@
 #include "websocketoverhttp.h"
 
 #include <assert.h>
+#include <list>
 #include <QRandomGenerator>
 #include "log.h"
 #include "bufferlist.h"
@@ -34,6 +35,7 @@
 #include "uuidutil.h"
 #include "timer.h"
 #include "defercall.h"
+#include "keepalivescheduler.h"
 
 #define BUFFER_SIZE 200000
 #define FRAME_SIZE_MAX 16384
@@ -115,66 +117,65 @@ private:
 thread_local WebSocketOverHttp::DisconnectManager *WebSocketOverHttp::g_disconnectManager = 0;
 thread_local int WebSocketOverHttp::g_maxManagedDisconnects = -1;
 
-static QList<WebSocketOverHttp::Event> decodeEvents(const QByteArray &in, bool *ok = 0)
+static const char *eventType(WebSocket::Frame::Type type)
 {
-	QList<WebSocketOverHttp::Event> out;
-	if(ok)
-		*ok = false;
-
-	int start = 0;
-	while(start < in.size())
+	switch(type)
 	{
-		int at = in.indexOf("\r\n", start);
-		if(at == -1)
-			return QList<WebSocketOverHttp::Event>();
-
-		QByteArray typeLine = in.mid(start, at - start);
-		start = at + 2;
-
-		WebSocketOverHttp::Event e;
-		at = typeLine.indexOf(' ');
-		if(at != -1)
-		{
-			e.type = typeLine.mid(0, at);
-
-			bool check;
-			int clen = typeLine.mid(at + 1).toInt(&check, 16);
-			if(!check)
-				return QList<WebSocketOverHttp::Event>();
-
-			e.content = in.mid(start, clen);
-			start += clen + 2;
-		}
-		else
-		{
-			e.type = typeLine;
-		}
-
-		out += e;
+		case WebSocket::Frame::Text: return "TEXT";
+		case WebSocket::Frame::Binary: return "BINARY";
+		case WebSocket::Frame::Ping: return "PING";
+		case WebSocket::Frame::Pong: return "PONG";
+		default: return 0;
 	}
-
-	if(ok)
-		*ok = true;
-	return out;
 }
 
-static QByteArray encodeEvents(const QList<WebSocketOverHttp::Event> &events)
+// calls handle(type, pos, count, contentSize) for each complete message in
+// frames, starting at start. handle returns whether it produced an event.
+// returns false if the frames are invalid
+template <typename F>
+static bool forEachMessage(const QList<WebSocket::Frame> &frames, int start, int eventsMax, int contentMax, int *framesRepresented, int *contentRepresented, F handle)
 {
-	QByteArray out;
+	int pos = start;
+	int events = 0;
+	int contentSize = 0;
 
-	foreach(const WebSocketOverHttp::Event &e, events)
+	while(pos < frames.count() && (eventsMax <= 0 || events < eventsMax) && (contentMax <= 0 || contentSize < contentMax))
 	{
-		if(!e.content.isNull())
+		// make sure the next message is fully readable
+		int takeCount = -1;
+		for(int n = pos; n < frames.count(); ++n)
 		{
-			out += e.type + ' ' + QByteArray::number(e.content.size(), 16) + "\r\n" + e.content + "\r\n";
+			if(!frames[n].more)
+			{
+				takeCount = n - pos + 1;
+				break;
+			}
 		}
-		else
+		if(takeCount < 1)
+			break;
+
+		int size = 0;
+		for(int n = 0; n < takeCount; ++n)
 		{
-			out += e.type + "\r\n";
+			const WebSocket::Frame &f = frames[pos + n];
+
+			if((n == 0 && f.type == WebSocket::Frame::Continuation) || (n > 0 && f.type != WebSocket::Frame::Continuation))
+				return false;
+
+			size += f.data.size();
 		}
+
+		if(handle(frames[pos].type, pos, takeCount, size))
+			++events;
+
+		pos += takeCount;
+		contentSize += size;
 	}
 
-	return out;
+	*framesRepresented = pos - start;
+	*contentRepresented = contentSize;
+
+	return true;
 }
 
 class WebSocketOverHttp::Private
@@ -186,6 +187,21 @@ public:
 		Connection errorConnection;
 	};
 
+	// a request sent while an earlier one is still in flight. it covers
+	// the frames following those of the earlier requests, and its
+	// response is not read until the earlier responses are processed
+	class PipelinedRequest
+	{
+	public:
+		std::unique_ptr<ZhttpRequest> req;
+		QByteArray body;
+		int pendingBytes;
+		int frames;
+		int contentSize;
+		Connection bytesWrittenConnection;
+		Connection errorConnection;
+	};
+
 	WebSocketOverHttp *q;
 	ZhttpManager *zhttpManager;
 	QString connectHost;
@@ -211,6 +227,10 @@ public:
 	bool reqClose;
 	int reqCloseContentSize;
 	BufferList inBuf;
+	int inBytes;
+	EventDecoder inDecoder;
+	QList<Event> inEvents;
+	bool inDecodeError;
 	QList<Frame> inFrames;
 	QList<Frame> outFrames;
 	int outContentSize;
@@ -225,12 +245,15 @@ public:
 	bool disconnecting;
 	bool disconnectSent;
 	bool updateQueued;
-	std::unique_ptr<Timer> keepAliveTimer;
-	std::unique_ptr<Timer> retryTimer;
+	KeepAliveScheduler::Item keepAlive;
+	std::unique_ptr<Timer> retryTimer; // created on first retry
 	int retries;
 	int maxEvents;
+	int maxRequests;
+	std::list<std::unique_ptr<PipelinedRequest>> pipeline;
+	int pipelineFrames;
+	int pipelineContentSize;
 	ReqConnections reqConnections;
-	Connection keepAliveTimerConnection;
 	Connection retryTimerConnection;
 	DeferCall deferCall;
 
@@ -251,6 +274,8 @@ public:
 		reqMaxed(false),
 		reqClose(false),
 		reqCloseContentSize(0),
+		inBytes(0),
+		inDecodeError(false),
 		outContentSize(0),
 		outFramesReplay(0),
 		outContentReplay(0),
@@ -262,24 +287,24 @@ public:
 		disconnectSent(false),
 		updateQueued(false),
 		retries(0),
-		maxEvents(0)
+		maxEvents(0),
+		maxRequests(1),
+		pipelineFrames(0),
+		pipelineContentSize(0)
 	{
 		if(!g_disconnectManager)
 			g_disconnectManager = new DisconnectManager;
 
-		keepAliveTimer = std::make_unique<Timer>();
-		keepAliveTimerConnection = keepAliveTimer->timeout.connect(boost::bind(&Private::keepAliveTimer_timeout, this));
-		keepAliveTimer->setSingleShot(true);
-
-		retryTimer = std::make_unique<Timer>();
-		retryTimerConnection = retryTimer->timeout.connect(boost::bind(&Private::retryTimer_timeout, this));
-		retryTimer->setSingleShot(true);
+		keepAlive.fire = boost::bind(&Private::keepAlive_fire, this);
 	}
 
 	void cleanup()
 	{
-		keepAliveTimer->stop();
-		retryTimer->stop();
+		keepAlive.cancel();
+		keepAlive.finished();
+
+		if(retryTimer)
+			retryTimer->stop();
 
 		updating = false;
 		disconnecting = false;
@@ -288,6 +313,10 @@ public:
 		reqConnections = ReqConnections();
 		req.reset();
 
+		pipeline.clear();
+		pipelineFrames = 0;
+		pipelineContentSize = 0;
+
 		state = Idle;
 	}
 
@@ -323,6 +352,8 @@ public:
 		else
 			requestData.uri.setScheme("http");
 
+		keepAlive.origin = requestData.uri.toString(QUrl::RemoveQuery | QUrl::RemoveFragment);
+
 		update();
 	}
 
@@ -470,15 +501,18 @@ private:
 
 	void update()
 	{
-		// only one request allowed at a time
+		// only one request allowed at a time, unless pipelining
 		if(updating)
+		{
+			tryPipeline();
 			return;
+		}
 
 		updateQueued = false;
 
 		updating = true;
 
-		keepAliveTimer->stop();
+		keepAlive.cancel();
 
 		// if we can't send yet but also have no room for writes, then fail
 		if(!canSendCompleteMessage() && writeBytesAvailable() == 0)
@@ -494,21 +528,21 @@ private:
 		reqClose = false;
 		reqCloseContentSize = 0;
 
-		QList<Event> events;
+		reqBody.clear();
 
 		if(state == Connecting)
 		{
-			events += Event("OPEN");
+			reqBody += "OPEN\r\n";
 		}
 		else if(disconnecting && !disconnectSent)
 		{
-			events += Event("DISCONNECT");
+			reqBody += "DISCONNECT\r\n";
 			disconnectSent = true;
 		}
 		else
 		{
 			bool ok = false;
-			events += framesToEvents(outFrames, BUFFER_SIZE, maxEvents, &ok, &reqFrames, &reqContentSize);
+			int events = encodeFrames(outFrames, 0, BUFFER_SIZE, maxEvents, &ok, &reqFrames, &reqContentSize, &reqBody);
 			if(!ok)
 			{
 				updating = false;
@@ -519,7 +553,7 @@ private:
 			// set this if we couldn't fit everything
 			reqMaxed = reqFrames < outFrames.count();
 
-			if(state == Closing && (maxEvents <= 0 || events.count() < maxEvents))
+			if(state == Closing && (maxEvents <= 0 || events < maxEvents))
 			{
 				if(reqFrames < outFrames.count())
 					log_debug("woh: skipping partial message at close");
@@ -532,19 +566,17 @@ private:
 					buf[0] = (closeCode >> 8) & 0xff;
 					buf[1] = closeCode & 0xff;
 					memcpy(buf.data() + 2, rawReason.data(), rawReason.size());
-					events += Event("CLOSE", buf);
+					reqBody += "CLOSE " + QByteArray::number(buf.size(), 16) + "\r\n" + buf + "\r\n";
 
 					reqCloseContentSize = buf.size();
 				}
 				else
-					events += Event("CLOSE");
+					reqBody += "CLOSE\r\n";
 
 				reqClose = true;
 			}
 		}
 
-		reqBody = encodeEvents(events);
-
 		doRequest();
 	}
 
@@ -561,45 +593,155 @@ private:
 			req->error.connect(boost::bind(&Private::req_error, this))
 		};
 
+		reqPendingBytes = reqBody.size();
+
+		resetInput();
+
+		startRequest(req.get(), reqBody, outContentReplay);
+	}
+
+	void startRequest(ZhttpRequest *r, const QByteArray &body, int contentReplayed)
+	{
 		if(!connectHost.isEmpty())
-			req->setConnectHost(connectHost);
+			r->setConnectHost(connectHost);
 		if(connectPort != -1)
-			req->setConnectPort(connectPort);
-		req->setIgnorePolicies(ignorePolicies);
-		req->setTrustConnectHost(trustConnectHost);
-		req->setIgnoreTlsErrors(ignoreTlsErrors);
-		req->setSendBodyAfterAcknowledgement(true);
+			r->setConnectPort(connectPort);
+		r->setIgnorePolicies(ignorePolicies);
+		r->setTrustConnectHost(trustConnectHost);
+		r->setIgnoreTlsErrors(ignoreTlsErrors);
+		r->setSendBodyAfterAcknowledgement(true);
 
 		HttpHeaders headers = requestData.headers;
 
 		headers += HttpHeader("Accept", "application/websocket-events");
 		headers += HttpHeader("Connection-Id", cid);
 		headers += HttpHeader("Content-Type", "application/websocket-events");
-		headers += HttpHeader("Content-Length", QByteArray::number(reqBody.size()));
+		headers += HttpHeader("Content-Length", QByteArray::number(body.size()));
 
-		if(outContentReplay > 0)
-			headers += HttpHeader("Content-Bytes-Replayed", QByteArray::number(outContentReplay));
+		if(contentReplayed > 0)
+			headers += HttpHeader("Content-Bytes-Replayed", QByteArray::number(contentReplayed));
 
 		foreach(const HttpHeader &h, meta)
 			headers += HttpHeader("Meta-" + h.first, h.second);
 
-		reqPendingBytes = reqBody.size();
+		r->start("POST", requestData.uri, headers);
+		r->writeBody(body);
+		r->endBody();
+	}
+
+	// send the next complete messages while earlier requests are still in
+	// flight. only plain message events are pipelined. anything affecting
+	// the session state (open, close, disconnect) waits for the pipeline
+	// to drain
+	void tryPipeline()
+	{
+		if(maxRequests <= 1 || !req || state != Connected || disconnecting || reqClose || (retryTimer && retryTimer->isActive()))
+			return;
+
+		if(1 + (int)pipeline.size() >= maxRequests || !canReceive())
+			return;
+
+		int coveredFrames = reqFrames + pipelineFrames;
+		if(coveredFrames >= outFrames.count())
+			return;
+
+		QByteArray body;
+		bool ok = false;
+		int frameCount = 0;
+		int contentSize = 0;
+		int events = encodeFrames(outFrames, coveredFrames, BUFFER_SIZE, maxEvents, &ok, &frameCount, &contentSize, &body);
+		if(!ok || events == 0)
+			return;
+
+		q->aboutToSendRequest();
+
+		std::unique_ptr<PipelinedRequest> p = std::make_unique<PipelinedRequest>();
+		p->req = std::unique_ptr<ZhttpRequest>(zhttpManager->createRequest());
+		p->body = body;
+		p->pendingBytes = p->body.size();
+		p->frames = frameCount;
+		p->contentSize = contentSize;
+
+		PipelinedRequest *pp = p.get();
+		p->bytesWrittenConnection = p->req->bytesWritten.connect([=](int count) {
+			pp->pendingBytes -= count;
+		});
+		p->errorConnection = p->req->error.connect(boost::bind(&Private::pipelined_error, this));
+
+		pipelineFrames += frameCount;
+		pipelineContentSize += contentSize;
+
+		startRequest(p->req.get(), p->body, 0);
 
-		req->start("POST", requestData.uri, headers);
-		req->writeBody(reqBody);
-		req->endBody();
+		pipeline.push_back(std::move(p));
+	}
+
+	// make the oldest pipelined request the current one
+	void promotePipelined()
+	{
+		std::unique_ptr<PipelinedRequest> p = std::move(pipeline.front());
+		pipeline.pop_front();
+
+		pipelineFrames -= p->frames;
+		pipelineContentSize -= p->contentSize;
+
+		reqFrames = p->frames;
+		reqContentSize = p->contentSize;
+		reqMaxed = false;
+		reqClose = false;
+		reqCloseContentSize = 0;
+		reqBody = p->body;
+		reqPendingBytes = p->pendingBytes;
+
+		p->bytesWrittenConnection.disconnect();
+		p->errorConnection.disconnect();
+
+		req = std::move(p->req);
+		resetInput();
+		reqConnections = {
+			req->readyRead.connect(boost::bind(&Private::req_readyRead, this)),
+			req->bytesWritten.connect(boost::bind(&Private::req_bytesWritten, this, boost::placeholders::_1)),
+			req->error.connect(boost::bind(&Private::req_error, this))
+		};
+
+		// the response may have arrived already
+		if(req->bytesAvailable() > 0 || req->isFinished())
+			deferCall.defer([=] { if(req) req_readyRead(); });
+
+		tryPipeline();
+	}
+
+	void resetInput()
+	{
+		inBuf.clear();
+		inBytes = 0;
+		inDecoder = EventDecoder();
+		inEvents.clear();
+		inDecodeError = false;
 	}
 
 	void req_readyRead()
 	{
-		if(inBuf.size() + req->bytesAvailable() > RESPONSE_BODY_MAX)
+		inBytes += req->bytesAvailable();
+		if(inBytes > RESPONSE_BODY_MAX)
 		{
 			cleanup();
 			q->error();
 			return;
 		}
 
-		inBuf += req->readBody();
+		// parse events as they arrive, rather than holding the entire body.
+		// anything else is kept as is, for reporting a rejection
+		if(req->responseCode() == 200 && req->responseHeaders().get("Content-Type") == "application/websocket-events")
+		{
+			QByteArray buf = req->readBody();
+			if(!inDecodeError && !inDecoder.feed(buf, &inEvents))
+				inDecodeError = true;
+		}
+		else
+		{
+			inBuf += req->readBody();
+		}
 
 		if(!req->isFinished())
 		{
@@ -614,10 +756,15 @@ private:
 		QByteArray responseReason = req->responseReason();
 		HttpHeaders responseHeaders = req->responseHeaders();
 		QByteArray responseBody = inBuf.take();
+		QList<Event> events = inEvents;
+		bool eventsOk = (!inDecodeError && !inDecoder.havePending());
+		resetInput();
 
 		reqConnections = ReqConnections();
 		req.reset();
 
+		keepAlive.finished();
+
 		if(state == Connecting)
 		{
 			// save the initial response
@@ -685,12 +832,37 @@ private:
 		int contentRemoved = removeContentFromFrames(&outFrames, nonCloseContentBytesAccepted);
 		int framesRemoved = outFramesCountOrig - outFrames.count();
 
+		// zero-sized frames following the accepted content may be removed
+		// too, and those could belong to pipelined requests
+		if(!pipeline.empty() && framesRemoved > reqFrames)
+		{
+			int extra = framesRemoved - reqFrames;
+
+			for(auto &p : pipeline)
+			{
+				int take = qMin(extra, p->frames);
+				p->frames -= take;
+				pipelineFrames -= take;
+				extra -= take;
+			}
+		}
+
 		// guaranteed to succeed, since reqContentSize represents the initial
 		// data in outFrames and we guard against too large of an input
 		assert(contentRemoved == nonCloseContentBytesAccepted);
 
 		outContentSize -= contentRemoved;
 
+		// later requests carry the data following this request's, so
+		// there's no way to replay what wasn't accepted
+		if(!pipeline.empty() && contentRemoved < reqContentSize)
+		{
+			log_debug("woh: partial acceptance with requests in flight");
+			cleanup();
+			q->error();
+			return;
+		}
+
 		// if we couldn't fit all pending data in the request, then require
 		// progress to be made
 		if(reqMaxed && framesRemoved == 0 && contentRemoved == 0)
@@ -750,9 +922,7 @@ private:
 			}
 		}
 
-		bool ok;
-		QList<Event> events = decodeEvents(responseBody, &ok);
-		if(!ok)
+		if(!eventsOk)
 		{
 			cleanup();
 			q->error();
@@ -930,12 +1100,18 @@ private:
 			return;
 		}
 
+		if(!pipeline.empty())
+		{
+			promotePipelined();
+			return;
+		}
+
 		updating = false;
 
 		if(needUpdate())
 			update();
 		else if(keepAliveInterval != -1)
-			keepAliveTimer->start(keepAliveInterval * 1000);
+			KeepAliveScheduler::instance()->schedule(&keepAlive, keepAliveInterval * 1000);
 	}
 
 	void req_bytesWritten(int count)
@@ -973,9 +1149,13 @@ private:
 		reqConnections = ReqConnections();
 		req.reset();
 
+		// resending would reorder the request behind later ones
+		if(!pipeline.empty())
+			retry = false;
+
 		if(retry && retries < RETRY_MAX && state != Connecting)
 		{
-			keepAliveTimer->stop();
+			keepAlive.cancel();
 
 			int delay = RETRY_TIMEOUT;
 			for(int n = 0; n < retries; ++n)
@@ -989,6 +1169,13 @@ private:
 			// this should still be flagged, for protection while retrying
 			assert(updating);
 
+			if(!retryTimer)
+			{
+				retryTimer = std::make_unique<Timer>();
+				retryTimerConnection = retryTimer->timeout.connect(boost::bind(&Private::retryTimer_timeout, this));
+				retryTimer->setSingleShot(true);
+			}
+
 			retryTimer->start(delay);
 			return;
 		}
@@ -1004,8 +1191,23 @@ private:
 		q->error();
 	}
 
-	void keepAliveTimer_timeout()
+	void pipelined_error()
+	{
+		log_debug("woh: pipelined request failed");
+
+		cleanup();
+		q->error();
+	}
+
+	void keepAlive_fire()
 	{
+		// a request is already outstanding, so it serves as the keep-alive
+		if(updating)
+		{
+			keepAlive.finished();
+			return;
+		}
+
 		update();
 	}
 
@@ -1062,6 +1264,16 @@ void WebSocketOverHttp::setMaxEventsPerRequest(int max)
 	d->maxEvents = max;
 }
 
+void WebSocketOverHttp::setMaxRequestsInFlight(int max)
+{
+	d->maxRequests = max;
+}
+
+void WebSocketOverHttp::setMaxKeepAlivesInFlight(int max)
+{
+	d->keepAlive.limit = max;
+}
+
 void WebSocketOverHttp::refresh()
 {
 	d->refresh();
@@ -1076,6 +1288,9 @@ void WebSocketOverHttp::clearDisconnectManager()
 {
 	delete g_disconnectManager;
 	g_disconnectManager = 0;
+
+	// no sessions remain
+	KeepAliveScheduler::cleanup();
 }
 
 void WebSocketOverHttp::sendDisconnect()
@@ -1231,69 +1446,106 @@ void WebSocketOverHttp::setHeaders(const HttpHeaders &headers)
 QList<WebSocketOverHttp::Event> WebSocketOverHttp::framesToEvents(const QList<Frame> &frames, int eventsMax, int contentMax, bool *ok, int *framesRepresented, int *contentRepresented)
 {
 	QList<WebSocketOverHttp::Event> out;
-	int pos = 0;
-	int contentSize = 0;
 
-	while(pos < frames.count() && (eventsMax <= 0 || out.count() < eventsMax) && (contentMax <= 0 || contentSize < contentMax))
-	{
-		// make sure the next message is fully readable
-		int takeCount = -1;
-		for(int n = pos; n < frames.count(); ++n)
-		{
-			if(!frames[n].more)
-			{
-				takeCount = n - pos + 1;
-				break;
-			}
-		}
-		if(takeCount < 1)
-			break;
+	*ok = forEachMessage(frames, 0, eventsMax, contentMax, framesRepresented, contentRepresented, [&](Frame::Type type, int pos, int count, int size) {
+		const char *typeName = eventType(type);
+		if(!typeName)
+			return false;
 
-		Frame::Type ftype = Frame::Text;
 		BufferList content;
+		for(int n = 0; n < count; ++n)
+			content += frames[pos + n].data;
 
-		for(int n = 0; n < takeCount; ++n)
-		{
-			Frame f = frames[pos + n];
+		// for compactness, we only include content if non-empty
+		out += Event(typeName, size > 0 ? content.toByteArray() : QByteArray());
 
-			if((n == 0 && f.type == Frame::Continuation) || (n > 0 && f.type != Frame::Continuation))
-			{
-				*ok = false;
-				return QList<WebSocketOverHttp::Event>();
-			}
+		return true;
+	});
 
-			if(n == 0)
-			{
-				assert(f.type != Frame::Continuation);
-				ftype = f.type;
-			}
+	if(!*ok)
+		return QList<WebSocketOverHttp::Event>();
 
-			content += f.data;
+	return out;
+}
+
+int WebSocketOverHttp::encodeFrames(const QList<Frame> &frames, int start, int eventsMax, int contentMax, bool *ok, int *framesRepresented, int *contentRepresented, QByteArray *out)
+{
+	int events = 0;
+	int origSize = out->size();
+
+	*ok = forEachMessage(frames, start, eventsMax, contentMax, framesRepresented, contentRepresented, [&](Frame::Type type, int pos, int count, int size) {
+		const char *typeName = eventType(type);
+		if(!typeName)
+			return false;
+
+		*out += typeName;
 
-			assert(n + 1 < takeCount || !f.more);
+		if(size > 0)
+		{
+			*out += ' ' + QByteArray::number(size, 16) + "\r\n";
+
+			for(int n = 0; n < count; ++n)
+				*out += frames[pos + n].data;
 		}
 
-		QByteArray data = content.toByteArray();
+		*out += "\r\n";
 
-		// for compactness, we only include content on ping/pong if non-empty
-		if(ftype == Frame::Text)
-			out += Event("TEXT", data);
-		else if(ftype == Frame::Binary)
-			out += Event("BINARY", data);
-		else if(ftype == Frame::Ping)
-			out += Event("PING", !data.isEmpty() ? data : QByteArray());
-		else if(ftype == Frame::Pong)
-			out += Event("PONG", !data.isEmpty() ? data : QByteArray());
+		++events;
 
-		pos += takeCount;
-		contentSize += content.size();
+		return true;
+	});
+
+	if(!*ok)
+	{
+		out->truncate(origSize);
+		return 0;
 	}
 
-	*ok = true;
-	*framesRepresented = pos;
-	*contentRepresented = contentSize;
+	return events;
+}
 
-	return out;
+bool WebSocketOverHttp::EventDecoder::feed(const QByteArray &in, QList<Event> *out)
+{
+	buf_ += in;
+
+	int start = 0;
+	while(start < buf_.size())
+	{
+		int at = buf_.indexOf("\r\n", start);
+		if(at == -1)
+			break;
+
+		Event e;
+
+		int sp = buf_.indexOf(' ', start);
+		if(sp != -1 && sp < at)
+		{
+			bool check;
+			int clen = buf_.mid(sp + 1, at - sp - 1).toInt(&check, 16);
+			if(!check || clen < 0)
+				return false;
+
+			// wait for the content and its line ending
+			if(buf_.size() < at + 2 + clen + 2)
+				break;
+
+			e.type = buf_.mid(start, sp - start);
+			e.content = buf_.mid(at + 2, clen);
+			start = at + 2 + clen + 2;
+		}
+		else
+		{
+			e.type = buf_.mid(start, at - start);
+			start = at + 2;
+		}
+
+		*out += e;
+	}
+
+	if(start > 0)
+		buf_.remove(0, start);
+
+	return true;
 }
 
 int WebSocketOverHttp::removeContentFromFrames(QList<WebSocket::Frame> *frames, int count)
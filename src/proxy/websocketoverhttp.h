@@ -26,11 +26,11 @@
 
 #include "websocket.h"
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 #include <map>
 
 using std::map;
 using Signal = boost::signals2::signal<void()>;
-using Connection = boost::signals2::scoped_connection;
 
 class ZhttpManager;
 
@@ -52,11 +52,36 @@ public:
 		}
 	};
 
+	// parses events incrementally, as a response body arrives
+	class EventDecoder
+	{
+	public:
+		// returns false if the input is invalid
+		bool feed(const QByteArray &buf, QList<Event> *out);
+
+		// true if a partial event is left over
+		bool havePending() const { return !buf_.isEmpty(); }
+
+	private:
+		QByteArray buf_;
+	};
+
 	WebSocketOverHttp(ZhttpManager *zhttpManager);
 	~WebSocketOverHttp();
 
 	void setConnectionId(const QByteArray &id);
 	void setMaxEventsPerRequest(int max);
+
+	// allow sending further events while earlier requests are in flight.
+	// responses are still processed in order, and the origin is expected
+	// to accept all of the content of each request
+	void setMaxRequestsInFlight(int max);
+
+	// keep-alives are scheduled per thread. this limits how many sessions
+	// with the same origin URI may have keep-alive requests outstanding
+	// at once. the rest are delayed
+	void setMaxKeepAlivesInFlight(int max);
+
 	void refresh();
 
 	// disconnection management is thread local
@@ -97,8 +122,8 @@ public:
 
 	void setHeaders(const HttpHeaders &headers);
 
-	Signal aboutToSendRequest;
-	Signal disconnected;
+	FastSignal<> aboutToSendRequest;
+	FastSignal<> disconnected;
 
 	// creates events from `frames`. the returned events are guaranteed to
 	// represent 0 or more full messages from `frames`, where the first
@@ -107,6 +132,11 @@ public:
 	// removing the frames afterwards.
 	static QList<Event> framesToEvents(const QList<Frame> &frames, int eventsMax, int contentMax, bool *ok, int *framesRepresented, int *contentRepresented);
 
+	// same as framesToEvents(), but starts at frame `start` and appends the
+	// encoded events to `out` directly, without copying message content
+	// into intermediate events. returns the number of events written
+	static int encodeFrames(const QList<Frame> &frames, int start, int eventsMax, int contentMax, bool *ok, int *framesRepresented, int *contentRepresented, QByteArray *out);
+
 	// remove `count` content bytes from the beginning of `frames`, removing
 	// frames (including 0-sized frames) when their content is entirely removed.
 	// when a frame is removed from a multipart message, the original type is
@@ -38,8 +38,12 @@ class WohServer
 public:
 	std::unique_ptr<ZhttpManager> zhttpIn;
 	std::unordered_map<ZhttpRequest*, std::unique_ptr<ZhttpRequest>> reqs;
+	ZhttpRequest *heldFirst;
+	ZhttpRequest *heldSecond;
 
-	WohServer(const QDir &workDir)
+	WohServer(const QDir &workDir) :
+		heldFirst(0),
+		heldSecond(0)
 	{
 		zhttpIn = std::make_unique<ZhttpManager>();
 		zhttpIn->setInstanceId("woh-test-server");
@@ -146,6 +150,22 @@ public:
 
 				respondOk(req, "TEXT 4\r\n[ok]\r\n");
 			}
+			else if(body == "TEXT 5\r\nfirst\r\n" || body == "TEXT 6\r\nsecond\r\n")
+			{
+				// wait for both, then respond out of order
+				if(body == "TEXT 5\r\nfirst\r\n")
+					heldFirst = req;
+				else
+					heldSecond = req;
+
+				if(heldFirst && heldSecond)
+				{
+					respondOk(heldSecond, "TEXT 2\r\nB2\r\n");
+					respondOk(heldFirst, "TEXT 2\r\nA1\r\n");
+					heldFirst = 0;
+					heldSecond = 0;
+				}
+			}
 			else if(body == "CLOSE\r\n")
 				respondOk(req, "CLOSE\r\n");
 			else
@@ -221,6 +241,78 @@ static void convertFrames()
 	TEST_ASSERT(frames.isEmpty());
 }
 
+static void encodeFrames()
+{
+	QList<WebSocket::Frame> frames;
+	frames += WebSocket::Frame(WebSocket::Frame::Text, "skip", false);
+	frames += WebSocket::Frame(WebSocket::Frame::Text, "hello", true);
+	frames += WebSocket::Frame(WebSocket::Frame::Continuation, " world", false);
+	frames += WebSocket::Frame(WebSocket::Frame::Ping, "", false);
+	frames += WebSocket::Frame(WebSocket::Frame::Binary, "partial", true);
+
+	bool ok = false;
+	int framesRepresented = 0;
+	int contentRepresented = 0;
+	QByteArray out = "OPEN\r\n";
+	int events = WebSocketOverHttp::encodeFrames(frames, 1, -1, -1, &ok, &framesRepresented, &contentRepresented, &out);
+	TEST_ASSERT(ok);
+	TEST_ASSERT_EQ(events, 2);
+	TEST_ASSERT_EQ(framesRepresented, 3);
+	TEST_ASSERT_EQ(contentRepresented, 11);
+	TEST_ASSERT_EQ(out, "OPEN\r\nTEXT b\r\nhello world\r\nPING\r\n");
+
+	// continuation can't start a message
+	frames.clear();
+	frames += WebSocket::Frame(WebSocket::Frame::Continuation, "bad", false);
+	out = "OPEN\r\n";
+	WebSocketOverHttp::encodeFrames(frames, 0, -1, -1, &ok, &framesRepresented, &contentRepresented, &out);
+	TEST_ASSERT(!ok);
+	TEST_ASSERT_EQ(out, "OPEN\r\n");
+}
+
+static void decodeEvents()
+{
+	QByteArray in = "OPEN\r\nTEXT b\r\nhello world\r\nPING\r\nCLOSE 2\r\n\x03\xe8\r\n";
+
+	// split at every position, to cover events spanning chunks
+	for(int n = 0; n <= in.size(); ++n)
+	{
+		WebSocketOverHttp::EventDecoder dec;
+		QList<WebSocketOverHttp::Event> events;
+
+		TEST_ASSERT(dec.feed(in.mid(0, n), &events));
+		TEST_ASSERT(dec.feed(in.mid(n), &events));
+		TEST_ASSERT(!dec.havePending());
+
+		TEST_ASSERT_EQ(events.count(), 4);
+		TEST_ASSERT_EQ(events[0].type, "OPEN");
+		TEST_ASSERT(events[0].content.isNull());
+		TEST_ASSERT_EQ(events[1].type, "TEXT");
+		TEST_ASSERT_EQ(events[1].content, "hello world");
+		TEST_ASSERT_EQ(events[2].type, "PING");
+		TEST_ASSERT_EQ(events[3].type, "CLOSE");
+		TEST_ASSERT_EQ(events[3].content, QByteArray("\x03\xe8"));
+	}
+
+	// incomplete event is left pending
+	{
+		WebSocketOverHttp::EventDecoder dec;
+		QList<WebSocketOverHttp::Event> events;
+
+		TEST_ASSERT(dec.feed("TEXT 5\r\nhel", &events));
+		TEST_ASSERT(events.isEmpty());
+		TEST_ASSERT(dec.havePending());
+	}
+
+	// bad length
+	{
+		WebSocketOverHttp::EventDecoder dec;
+		QList<WebSocketOverHttp::Event> events;
+
+		TEST_ASSERT(!dec.feed("TEXT zz\r\nhello\r\n", &events));
+	}
+}
+
 static void removePartial()
 {
 	QList<WebSocket::Frame> frames;
@@ -400,12 +492,77 @@ static void replay()
 	TEST_ASSERT(clientClosed);
 }
 
+static void pipeline()
+{
+	TestQCoreApplication qapp;
+	TestState state;
+
+	WebSocketOverHttp client(state.zhttpOut.get());
+	client.setMaxRequestsInFlight(2);
+
+	bool clientConnected = false;
+	client.connected.connect([&] {
+		clientConnected = true;
+	});
+
+	int clientFramesWritten = 0;
+	client.framesWritten.connect([&](int count, int contentBytes) {
+		Q_UNUSED(contentBytes);
+		clientFramesWritten += count;
+	});
+
+	bool clientClosed = false;
+	client.closed.connect([&] {
+		clientClosed = true;
+	});
+
+	bool clientError = false;
+	client.error.connect([&] {
+		clientError = true;
+	});
+
+	client.start(QUrl("ws://localhost/ws"), HttpHeaders());
+
+	while(!clientConnected && !clientError)
+		QTest::qWait(10);
+
+	TEST_ASSERT(!clientError);
+	TEST_ASSERT(clientConnected);
+
+	// the second request is sent before the first is answered
+	client.writeFrame(WebSocket::Frame(WebSocket::Frame::Text, "first", false));
+	client.writeFrame(WebSocket::Frame(WebSocket::Frame::Text, "second", false));
+
+	while(client.framesAvailable() < 2 && !clientError)
+		QTest::qWait(10);
+
+	TEST_ASSERT(!clientError);
+	TEST_ASSERT_EQ(clientFramesWritten, 2);
+
+	// responses are processed in request order
+	WebSocket::Frame f = client.readFrame();
+	TEST_ASSERT_EQ(f.data, "A1");
+	f = client.readFrame();
+	TEST_ASSERT_EQ(f.data, "B2");
+
+	client.close();
+
+	while(!clientClosed && !clientError)
+		QTest::qWait(10);
+
+	TEST_ASSERT(!clientError);
+	TEST_ASSERT(clientClosed);
+}
+
 extern "C" int websocketoverhttp_test(ffi::TestException *out_ex)
 {
 	TEST_CATCH(convertFrames());
+	TEST_CATCH(encodeFrames());
+	TEST_CATCH(decodeEvents());
 	TEST_CATCH(removePartial());
 	TEST_CATCH(io());
 	TEST_CATCH(replay());
+	TEST_CATCH(pipeline());
 
 	return 0;
 }
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "workerload.h"
+
+#include <QHash>
+#include <QMutex>
+
+// lag at which a thread is considered to be falling behind
+#define LAG_MAX 50
+
+// sessions a thread may have beyond the least loaded thread before pausing
+#define SESSIONS_SLACK 32
+
+namespace WorkerLoad {
+
+class Entry
+{
+public:
+	int sessions;
+	int lag;
+	bool paused;
+
+	Entry() :
+		sessions(0),
+		lag(0),
+		paused(false)
+	{
+	}
+};
+
+static QMutex g_mutex;
+static QHash<int, Entry> g_entries; // protected by g_mutex
+static int g_nextId = 0; // protected by g_mutex
+
+int add()
+{
+	QMutexLocker locker(&g_mutex);
+
+	int id = g_nextId++;
+	g_entries.insert(id, Entry());
+
+	return id;
+}
+
+void remove(int id)
+{
+	QMutexLocker locker(&g_mutex);
+
+	g_entries.remove(id);
+}
+
+bool update(int id, int sessions, int lag)
+{
+	QMutexLocker locker(&g_mutex);
+
+	if(!g_entries.contains(id))
+		return false;
+
+	Entry &e = g_entries[id];
+	e.sessions = sessions;
+	e.lag = lag;
+
+	// compare with the least loaded of the threads still taking sessions.
+	// if there are none, this thread must keep taking them
+	bool found = false;
+	int minSessions = 0;
+	int minLag = 0;
+
+	QHashIterator<int, Entry> it(g_entries);
+	while(it.hasNext())
+	{
+		it.next();
+
+		if(it.key() == id || it.value().paused)
+			continue;
+
+		const Entry &other = it.value();
+
+		if(!found || other.sessions < minSessions)
+			minSessions = other.sessions;
+
+		if(!found || other.lag < minLag)
+			minLag = other.lag;
+
+		found = true;
+	}
+
+	if(!found)
+	{
+		e.paused = false;
+		return false;
+	}
+
+	bool lagging = (lag >= LAG_MAX && lag >= minLag * 2);
+	bool crowded = (sessions > minSessions + (minSessions / 4) + SESSIONS_SLACK);
+
+	e.paused = (lagging || crowded);
+
+	return e.paused;
+}
+
+}
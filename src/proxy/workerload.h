@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#ifndef WORKERLOAD_H
+#define WORKERLOAD_H
+
+// process-wide table of engine thread loads, used to steer new sessions
+// away from busy threads. each thread reports its outstanding sessions and
+// event loop lag, and is told to pause taking new sessions while it is
+// noticeably busier than the others. at least one thread always keeps
+// taking sessions
+namespace WorkerLoad {
+
+// registers a thread and returns its id
+int add();
+
+void remove(int id);
+
+// records the load of a thread. lag is in msecs. returns true if the thread
+// should pause taking new sessions
+bool update(int id, int sessions, int lag);
+
+}
+
+#endif
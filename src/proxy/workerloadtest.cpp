@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include "test.h"
+#include "workerload.h"
+
+static void sessions()
+{
+	int a = WorkerLoad::add();
+	int b = WorkerLoad::add();
+
+	TEST_ASSERT(!WorkerLoad::update(a, 10, 0));
+	TEST_ASSERT(!WorkerLoad::update(b, 0, 0));
+
+	// small differences are tolerated
+	TEST_ASSERT(!WorkerLoad::update(a, 30, 0));
+
+	TEST_ASSERT(WorkerLoad::update(a, 100, 0));
+
+	// the only thread taking sessions can't pause, however busy
+	TEST_ASSERT(!WorkerLoad::update(b, 200, 0));
+
+	// resumes once no longer busier than the others
+	TEST_ASSERT(!WorkerLoad::update(a, 100, 0));
+
+	WorkerLoad::remove(a);
+	WorkerLoad::remove(b);
+}
+
+static void lag()
+{
+	int a = WorkerLoad::add();
+	int b = WorkerLoad::add();
+
+	TEST_ASSERT(!WorkerLoad::update(b, 0, 10));
+	TEST_ASSERT(WorkerLoad::update(a, 0, 200));
+
+	// everyone being slow is not a reason to pause
+	TEST_ASSERT(!WorkerLoad::update(b, 0, 150));
+	TEST_ASSERT(!WorkerLoad::update(a, 0, 200));
+
+	WorkerLoad::remove(b);
+
+	// alone
+	TEST_ASSERT(!WorkerLoad::update(a, 100, 500));
+
+	WorkerLoad::remove(a);
+
+	// unknown id
+	TEST_ASSERT(!WorkerLoad::update(a, 100, 500));
+}
+
+extern "C" int workerload_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(sessions());
+	TEST_CATCH(lag());
+
+	return 0;
+}
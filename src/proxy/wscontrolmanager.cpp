@@ -24,13 +24,17 @@
 #include "wscontrolmanager.h"
 
 #include <assert.h>
-#include <QDateTime>
+#include <QRandomGenerator>
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 #include "qzmqsocket.h"
 #include "qzmqvalve.h"
 #include "qzmqreqmessage.h"
 #include "log.h"
 #include "timer.h"
+#include "loopclock.h"
+#include "timerwheel.h"
+#include "defercall.h"
 #include "tnetstring.h"
 #include "zutil.h"
 #include "logutil.h"
@@ -38,16 +42,18 @@
 
 #define DEFAULT_HWM 101000
 
+#define DEFAULT_SESSIONS_MAX 10000
+
 #define REFRESH_INTERVAL 1000
 #define SESSION_EXPIRE 60000
 
-#define SESSION_SHOULD_PROCESS (SESSION_EXPIRE * 3 / 4)
-#define SESSION_MUST_PROCESS (SESSION_EXPIRE * 4 / 5)
-#define SESSION_REFRESH_BUCKETS (SESSION_SHOULD_PROCESS / REFRESH_INTERVAL)
+// idle sessions are refreshed with doubling ttls, up to this
+#define SESSION_EXPIRE_MAX 300000
 
 #define PACKET_ITEMS_MAX 128
 
-using Connection = boost::signals2::scoped_connection;
+// initial output buffer sizing per item, beyond the message
+#define ITEM_OVERHEAD_ESTIMATE 256
 
 class WsControlManager::Private
 {
@@ -56,8 +62,11 @@ public:
 	{
 	public:
 		WsControlSession *s;
-		qint64 lastRefresh;
-		int refreshBucket;
+		qint64 lastRefresh; // last time any item was sent for the session
+		qint64 scheduledFrom; // lastRefresh when the refresh was scheduled
+		int ttl; // msecs, as last sent to the handler
+		int idleRefreshes;
+		int timerId;
 	};
 
 	WsControlManager *q;
@@ -71,23 +80,33 @@ public:
 	QHash<QByteArray, WsControlSession*> sessionsByCid;
 	std::unique_ptr<Timer> refreshTimer;
 	QHash<WsControlSession*, KeepAliveRegistration*> keepAliveRegistrations;
-	QMap<QPair<qint64, KeepAliveRegistration*>, KeepAliveRegistration*> sessionsByLastRefresh;
-	QSet<KeepAliveRegistration*> sessionRefreshBuckets[SESSION_REFRESH_BUCKETS];
-	int currentSessionRefreshBucket;
+	TimerWheel refreshWheel;
+	qint64 refreshStartTime;
+	QSet<KeepAliveRegistration*> unscheduledRegistrations; // wheel was full
+	QHash<QByteArray, WsControlPacket> pendingStreamPackets; // by peer
+	bool streamFlushPending;
+	DeferCall deferCall;
 	Connection streamValveConnection;
 	Connection refreshTimerConnection;
 
-	Private(WsControlManager *_q) :
+	Private(WsControlManager *_q, int sessionsMax) :
 		q(_q),
 		ipcFileMode(-1),
-		currentSessionRefreshBucket(0)
+		refreshWheel(sessionsMax),
+		streamFlushPending(false)
 	{
+		refreshStartTime = LoopClock::msecsSinceEpoch();
+
 		refreshTimer = std::make_unique<Timer>();
 		refreshTimerConnection = refreshTimer->timeout.connect(boost::bind(&Private::refresh_timeout, this));
 	}
 
 	~Private()
 	{
+		// don't lose the last items, such as gones for closed sessions
+		if(streamFlushPending)
+			flushStream();
+
 		assert(sessionsByCid.isEmpty());
 		assert(keepAliveRegistrations.isEmpty());
 	}
@@ -143,32 +162,29 @@ public:
 		return true;
 	}
 
-	int smallestSessionRefreshBucket()
+	static QByteArray serialize(const WsControlPacket &packet)
 	{
-		int best = -1;
-		int bestSize = 0;
+		int size = 0;
+		foreach(const WsControlPacket::Item &item, packet.items)
+			size += item.message.size() + ITEM_OVERHEAD_ESTIMATE;
 
-		for(int n = 0; n < SESSION_REFRESH_BUCKETS; ++n)
-		{
-			if(best == -1 || sessionRefreshBuckets[n].count() < bestSize)
-			{
-				best = n;
-				bestSize = sessionRefreshBuckets[n].count();
-			}
-		}
+		QByteArray buf;
+		buf.reserve(size);
+
+		TnetString::Writer w(&buf);
+		packet.writeTo(w);
 
-		return best;
+		return buf;
 	}
 
 	void writeInit(const WsControlPacket &packet)
 	{
 		assert(streamSock);
 
-		QVariant vpacket = packet.toVariant();
-		QByteArray buf = TnetString::fromVariant(vpacket);
+		QByteArray buf = serialize(packet);
 
 		if(log_outputLevel() >= LOG_LEVEL_DEBUG)
-			LogUtil::logVariant(LOG_LEVEL_DEBUG, vpacket, "wscontrol: OUT");
+			LogUtil::logVariant(LOG_LEVEL_DEBUG, packet.toVariant(), "wscontrol: OUT");
 
 		initSock->write(QList<QByteArray>() << buf);
 	}
@@ -177,11 +193,10 @@ public:
 	{
 		assert(streamSock);
 
-		QVariant vpacket = packet.toVariant();
-		QByteArray buf = TnetString::fromVariant(vpacket);
+		QByteArray buf = serialize(packet);
 
 		if(log_outputLevel() >= LOG_LEVEL_DEBUG)
-			LogUtil::logVariant(LOG_LEVEL_DEBUG, vpacket, "wscontrol: OUT to=%s", instanceAddress.data());
+			LogUtil::logVariant(LOG_LEVEL_DEBUG, packet.toVariant(), "wscontrol: OUT to=%s", instanceAddress.data());
 
 		QList<QByteArray> msg;
 		msg += instanceAddress;
@@ -200,10 +215,46 @@ public:
 
 	void writeStream(const WsControlPacket::Item &item, const QByteArray &instanceAddress)
 	{
-		WsControlPacket out;
-		out.from = identity;
-		out.items += item;
-		writeStream(out, instanceAddress);
+		// the handler treats any item as a keep-alive for the session
+		KeepAliveRegistration *r = keepAliveRegistrations.value(sessionsByCid.value(item.cid));
+		if(r)
+			r->lastRefresh = LoopClock::msecsSinceEpoch();
+
+		// items written during the same pass, such as the keep-alive
+		// requests of many sessions, are sent to each peer together
+		WsControlPacket &packet = pendingStreamPackets[instanceAddress];
+		if(packet.items.isEmpty())
+			packet.from = identity;
+
+		packet.items += item;
+
+		if(packet.items.count() >= PACKET_ITEMS_MAX)
+		{
+			writeStream(packet, instanceAddress);
+			packet.items.clear();
+		}
+		else if(!streamFlushPending)
+		{
+			streamFlushPending = true;
+			deferCall.defer([=] { flushStream(); });
+		}
+	}
+
+	void flushStream()
+	{
+		streamFlushPending = false;
+
+		QHashIterator<QByteArray, WsControlPacket> it(pendingStreamPackets);
+		while(it.hasNext())
+		{
+			it.next();
+			const WsControlPacket &packet = it.value();
+
+			if(!packet.items.isEmpty())
+				writeStream(packet, it.key());
+		}
+
+		pendingStreamPackets.clear();
 	}
 
 	void registerKeepAlive(WsControlSession *s)
@@ -211,17 +262,17 @@ public:
 		if(keepAliveRegistrations.contains(s))
 			return;
 
-		qint64 now = QDateTime::currentMSecsSinceEpoch();
+		qint64 now = LoopClock::msecsSinceEpoch();
 
 		KeepAliveRegistration *r = new KeepAliveRegistration;
 		r->s = s;
 		keepAliveRegistrations.insert(s, r);
 
 		r->lastRefresh = now;
-		sessionsByLastRefresh.insert(QPair<qint64, KeepAliveRegistration*>(r->lastRefresh, r), r);
-
-		r->refreshBucket = smallestSessionRefreshBucket();
-		sessionRefreshBuckets[r->refreshBucket] += r;
+		r->ttl = SESSION_EXPIRE;
+		r->idleRefreshes = 0;
+		r->timerId = -1;
+		scheduleRefresh(r);
 
 		setupKeepAlive();
 	}
@@ -232,14 +283,35 @@ public:
 		if(!r)
 			return;
 
-		sessionRefreshBuckets[r->refreshBucket].remove(r);
-		sessionsByLastRefresh.remove(QPair<qint64, KeepAliveRegistration*>(r->lastRefresh, r));
+		if(r->timerId >= 0)
+			refreshWheel.remove(r->timerId);
+
+		unscheduledRegistrations.remove(r);
 		keepAliveRegistrations.remove(s);
 		delete r;
 
 		setupKeepAlive();
 	}
 
+	// refresh at 3/4 of the ttl, a little earlier at random so sessions
+	// registered together spread out
+	void scheduleRefresh(KeepAliveRegistration *r)
+	{
+		assert(r->timerId < 0);
+
+		int msec = r->ttl * 3 / 4;
+		msec -= (int)(QRandomGenerator::global()->generate() % (quint32)(msec / 10 + 1));
+
+		r->scheduledFrom = r->lastRefresh;
+
+		qint64 expireTime = qMax(r->lastRefresh + msec, refreshStartTime);
+		quint64 expiresTicks = (quint64)((expireTime - refreshStartTime) / REFRESH_INTERVAL);
+
+		r->timerId = refreshWheel.add(expiresTicks, (size_t)r);
+		if(r->timerId < 0)
+			unscheduledRegistrations += r;
+	}
+
 	void setupKeepAlive()
 	{
 		if(!keepAliveRegistrations.isEmpty())
@@ -262,18 +334,20 @@ private:
 			return;
 		}
 
-		QVariant data = TnetString::toVariant(req.content()[0]);
-		if(data.isNull())
+		QByteArray buf = req.content()[0];
+
+		TnetString::View data(buf);
+		if(!data.isValid())
 		{
 			log_warning("wscontrol: received message with invalid format (tnetstring parse failed), skipping");
 			return;
 		}
 
 		if(log_outputLevel() >= LOG_LEVEL_DEBUG)
-			LogUtil::logVariant(LOG_LEVEL_DEBUG, data, "wscontrol: IN");
+			LogUtil::logVariant(LOG_LEVEL_DEBUG, data.toVariant(), "wscontrol: IN");
 
 		WsControlPacket p;
-		if(!p.fromVariant(data))
+		if(!p.fromView(data))
 		{
 			log_warning("wscontrol: received message with invalid format (parse failed), skipping");
 			return;
@@ -313,88 +387,88 @@ private:
 		}
 	}
 
-	void refresh_timeout()
+	void refresh(KeepAliveRegistration *r, qint64 now, QHash<QByteArray, WsControlPacket> *packets)
 	{
-		qint64 now = QDateTime::currentMSecsSinceEpoch();
-
-		QHash<QByteArray, WsControlPacket> packets;
-
-		// process the current bucket
-		const QSet<KeepAliveRegistration*> &bucket = sessionRefreshBuckets[currentSessionRefreshBucket];
-		foreach(KeepAliveRegistration *r, bucket)
+		if(r->lastRefresh != r->scheduledFrom)
 		{
-			// move to the end
-			QPair<qint64, KeepAliveRegistration*> k(r->lastRefresh, r);
-			sessionsByLastRefresh.remove(k);
-			r->lastRefresh = now;
-			sessionsByLastRefresh.insert(QPair<qint64, KeepAliveRegistration*>(r->lastRefresh, r), r);
-
-			QByteArray peer = r->s->peer();
-			if(peer.isEmpty())
-				continue;
+			// other items were sent in the meantime
+			r->idleRefreshes = 0;
+			scheduleRefresh(r);
+			return;
+		}
 
-			if(!packets.contains(peer))
-			{
-				WsControlPacket packet;
-				packet.from = identity;
-				packets.insert(peer, packet);
-			}
+		// back off while the session has nothing else to say
+		r->ttl = (int)qMin((qint64)SESSION_EXPIRE << qMin(r->idleRefreshes, 8), (qint64)SESSION_EXPIRE_MAX);
+		++r->idleRefreshes;
 
-			WsControlPacket &packet = packets[peer];
+		r->lastRefresh = now;
+		scheduleRefresh(r);
 
-			WsControlPacket::Item i;
-			i.cid = r->s->cid();
-			i.type = WsControlPacket::Item::KeepAlive;
-			i.ttl = SESSION_EXPIRE / 1000;
-			packet.items += i;
+		QByteArray peer = r->s->peer();
+		if(peer.isEmpty())
+			return;
 
-			// if we're at max, send out now
-			if(packet.items.count() >= PACKET_ITEMS_MAX)
-			{
-				writeStream(packet, peer);
-				packet.items.clear();
-			}
+		if(!packets->contains(peer))
+		{
+			WsControlPacket packet;
+			packet.from = identity;
+			packets->insert(peer, packet);
 		}
 
-		// process any others
-		qint64 threshold = now - SESSION_MUST_PROCESS;
-		while(!sessionsByLastRefresh.isEmpty())
+		WsControlPacket &packet = (*packets)[peer];
+
+		WsControlPacket::Item i;
+		i.cid = r->s->cid();
+		i.type = WsControlPacket::Item::KeepAlive;
+		i.ttl = r->ttl / 1000;
+		packet.items += i;
+
+		// if we're at max, send out now
+		if(packet.items.count() >= PACKET_ITEMS_MAX)
 		{
-			QMap<QPair<qint64, KeepAliveRegistration*>, KeepAliveRegistration*>::iterator it = sessionsByLastRefresh.begin();
-			KeepAliveRegistration *r = it.value();
+			writeStream(packet, peer);
+			packet.items.clear();
+		}
+	}
 
-			if(r->lastRefresh > threshold)
-				break;
+	void refresh_timeout()
+	{
+		qint64 now = LoopClock::msecsSinceEpoch();
 
-			// move to the end
-			sessionsByLastRefresh.erase(it);
-			r->lastRefresh = now;
-			sessionsByLastRefresh.insert(QPair<qint64, KeepAliveRegistration*>(r->lastRefresh, r), r);
+		// time must go forward
+		if(now > refreshStartTime)
+			refreshWheel.update((quint64)((now - refreshStartTime) / REFRESH_INTERVAL));
 
-			QByteArray peer = r->s->peer();
-			if(peer.isEmpty())
-				continue;
+		QHash<QByteArray, WsControlPacket> packets;
 
-			if(!packets.contains(peer))
-			{
-				WsControlPacket packet;
-				packet.from = identity;
-				packets.insert(peer, packet);
-			}
+		while(true)
+		{
+			TimerWheel::Expired expired = refreshWheel.takeExpired();
+			if(expired.key < 0)
+				break;
 
-			WsControlPacket &packet = packets[peer];
+			KeepAliveRegistration *r = (KeepAliveRegistration *)expired.userData;
+			r->timerId = -1;
 
-			WsControlPacket::Item i;
-			i.cid = r->s->cid();
-			i.type = WsControlPacket::Item::KeepAlive;
-			i.ttl = SESSION_EXPIRE / 1000;
-			packet.items += i;
+			refresh(r, now, &packets);
+		}
 
-			// if we're at max, send out now
-			if(packet.items.count() >= PACKET_ITEMS_MAX)
+		// registrations that didn't fit in the wheel are checked directly
+		if(!unscheduledRegistrations.isEmpty())
+		{
+			QSet<KeepAliveRegistration*> regs = unscheduledRegistrations;
+			unscheduledRegistrations.clear();
+
+			foreach(KeepAliveRegistration *r, regs)
 			{
-				writeStream(packet, peer);
-				packet.items.clear();
+				if(r->lastRefresh == r->scheduledFrom && now - r->lastRefresh < r->ttl * 3 / 4)
+				{
+					// not due. try the wheel again
+					scheduleRefresh(r);
+					continue;
+				}
+
+				refresh(r, now, &packets);
 			}
 		}
 
@@ -409,16 +483,12 @@ private:
 			if(!packet.items.isEmpty())
 				writeStream(packet, peer);
 		}
-
-		++currentSessionRefreshBucket;
-		if(currentSessionRefreshBucket >= SESSION_REFRESH_BUCKETS)
-			currentSessionRefreshBucket = 0;
 	}
 };
 
-WsControlManager::WsControlManager() 
+WsControlManager::WsControlManager(int sessionsMax)
 {
-	d = std::make_shared<Private>(this);
+	d = std::make_shared<Private>(this, sessionsMax > 0 ? sessionsMax : DEFAULT_SESSIONS_MAX);
 }
 
 WsControlManager::~WsControlManager() = default;
@@ -32,7 +32,8 @@ class WsControlSession;
 class WsControlManager
 {
 public:
-	WsControlManager();
+	// sessionsMax sizes the keep-alive schedule, 0 for the default
+	WsControlManager(int sessionsMax = 0);
 	~WsControlManager();
 
 	void setIdentity(const QByteArray &id);
@@ -24,17 +24,16 @@
 #include "wscontrolsession.h"
 
 #include <assert.h>
-#include <QDateTime>
 #include <QUrl>
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 #include "timer.h"
+#include "loopclock.h"
 #include "wscontrolmanager.h"
 
 #define SESSION_TTL 60
 #define REQUEST_TIMEOUT 8000
 
-using Connection = boost::signals2::scoped_connection;
-
 class WsControlSession::Private
 {
 public:
@@ -126,7 +125,7 @@ public:
 					lowestTime = time;
 			}
 
-			int until = int(lowestTime - QDateTime::currentMSecsSinceEpoch());
+			int until = int(lowestTime - LoopClock::msecsSinceEpoch());
 
 			requestTimer->start(qMax(until, 0));
 		}
@@ -145,7 +144,7 @@ public:
 		i.requestId = QByteArray::number(reqId);
 		i.message = message;
 
-		pendingRequests[reqId] = QDateTime::currentMSecsSinceEpoch() + REQUEST_TIMEOUT;
+		pendingRequests[reqId] = LoopClock::msecsSinceEpoch() + REQUEST_TIMEOUT;
 		setupRequestTimer();
 
 		write(i);
@@ -167,7 +166,7 @@ public:
 		i.requestId = QByteArray::number(reqId);
 		i.channel = channel;
 
-		pendingRequests[reqId] = QDateTime::currentMSecsSinceEpoch() + REQUEST_TIMEOUT;
+		pendingRequests[reqId] = LoopClock::msecsSinceEpoch() + REQUEST_TIMEOUT;
 		setupRequestTimer();
 
 		write(i);
@@ -244,7 +243,7 @@ public:
 			else
 				pendingSendEventWrites += QByteArray(); // placeholder
 
-			q->sendEventReceived(type, item.message, item.queue);
+			q->sendEventReceived(type, item.message, item.queue, item.coalesce, item.channel);
 		}
 		else if(item.type == WsControlPacket::Item::KeepAliveSetup)
 		{
@@ -50,7 +50,8 @@ public:
 	// tell session that a received sendEvent has been written
 	void sendEventWritten();
 
-	boost::signals2::signal<void(WebSocket::Frame::Type, const QByteArray&, bool)> sendEventReceived;
+	// type, message, queue, coalesce mode, channel
+	boost::signals2::signal<void(WebSocket::Frame::Type, const QByteArray&, bool, const QByteArray&, const QByteArray&)> sendEventReceived;
 	boost::signals2::signal<void(WsControl::KeepAliveMode, int)> keepAliveSetupEventReceived;
 	Signal refreshEventReceived;
 	boost::signals2::signal<void(int, const QByteArray&)> closeEventReceived; // Use -1 for no code
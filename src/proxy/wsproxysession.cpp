@@ -24,21 +24,22 @@
 #include "wsproxysession.h"
 
 #include <assert.h>
-#include <QDateTime>
 #include <QUrl>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QHostAddress>
-#include <QRandomGenerator>
 #include "packet/httprequestdata.h"
 #include "log.h"
 #include "timer.h"
+#include "loopclock.h"
 #include "defercall.h"
 #include "jwt.h"
 #include "zhttpmanager.h"
 #include "zwebsocket.h"
 #include "websocketoverhttp.h"
+#include "keepalivescheduler.h"
 #include "zroutes.h"
+#include "targetbalancer.h"
 #include "wscontrol.h"
 #include "wscontrolmanager.h"
 #include "wscontrolsession.h"
@@ -48,9 +49,15 @@
 #include "inspectdata.h"
 #include "connectionmanager.h"
 #include "testwebsocket.h"
+#include "ringqueue.h"
 
 #define ACTIVITY_TIMEOUT 60000
-#define KEEPALIVE_RAND_MAX 1000
+
+// limit of messages held for a slow client, in bytes
+#define COALESCE_BYTES_MAX 1000000
+
+// limit of fragments joined when relaying, in bytes
+#define MESSAGE_READ_MAX 65536
 
 class HttpExtension
 {
@@ -232,6 +239,14 @@ public:
 
 	typedef QPair<WebSocket::Frame, bool> QueuedFrame;
 
+	class CoalescedMessage
+	{
+	public:
+		QByteArray channel;
+		WebSocket::Frame frame;
+		bool patch;
+	};
+
 	struct WSConnections {
 		Connection connectedConnection;
 		Connection readyReadConnection;
@@ -289,22 +304,26 @@ public:
 	Jwt::EncodingKey sigKey;
 	std::unique_ptr<WebSocket> inSock;
 	std::unique_ptr<WebSocket> outSock;
-	QList<bool> inPendingFrames; // true means we should ack a send event
+	RingQueue<bool> inPendingFrames; // true means we should ack a send event
 	int outReadInProgress; // frame type or -1
 	QByteArray pathBeg;
 	QByteArray channelPrefix;
 	QList<DomainMap::Target> targets;
 	DomainMap::Target target;
+	std::unique_ptr<TargetHealth::Outstanding> outstanding;
 	QHostAddress clientAddress;
 	bool acceptGripMessages;
 	QByteArray messagePrefix;
 	bool detached;
-	QDateTime activityTime;
+	qint64 activityTime; // -1 if not tracking
 	QByteArray publicCid;
-	std::unique_ptr<Timer> keepAliveTimer;
+	KeepAliveScheduler::Item keepAlive;
+	bool keepAliveEnabled;
 	WsControl::KeepAliveMode keepAliveMode;
 	int keepAliveTimeout;
-	QList<QueuedFrame> queuedInFrames; // frames to deliver after out read finishes
+	RingQueue<QueuedFrame> queuedInFrames; // frames to deliver after out read finishes
+	QList<CoalescedMessage> coalescedMessages; // held until the client catches up
+	int coalescedBytes;
 	LogUtil::Config logConfig;
 	Callback<std::tuple<WsProxySession *>> finishedByPassthroughCallback;
 	Connection keepAliveConnection;
@@ -332,10 +351,17 @@ public:
 		outReadInProgress(-1),
 		acceptGripMessages(false),
 		detached(false),
+		activityTime(-1),
+		keepAliveEnabled(false),
 		keepAliveMode(WsControl::NoKeepAlive),
 		keepAliveTimeout(0),
+		coalescedBytes(0),
 		logConfig(_logConfig)
 	{
+		// safe to not track, since the item doesn't outlive this
+		keepAlive.fire = [=] {
+			keepAlive_fire();
+		};
 	}
 
 	~Private()
@@ -345,12 +371,13 @@ public:
 
 	void cleanup()
 	{
-		cleanupKeepAliveTimer();
+		cleanupKeepAlive();
 
 		cleanupInSock();
 		
 		outWSConnection = WSConnections();
 		outSock.reset();
+		outstanding.reset();
 
 		wsProxyConnectionMap.erase(wsControl);
 		delete wsControl;
@@ -373,9 +400,10 @@ public:
 		}
 	}
 
-	void cleanupKeepAliveTimer()
+	void cleanupKeepAlive()
 	{
-		keepAliveTimer.reset();
+		keepAliveEnabled = false;
+		keepAlive.cancel();
 	}
 
 	void start(WebSocket *sock, const QByteArray &_publicCid, const DomainMap::Entry &entry)
@@ -387,7 +415,7 @@ public:
 		publicCid = _publicCid;
 
 		if(statsManager)
-			activityTime = QDateTime::currentDateTimeUtc();
+			activityTime = LoopClock::msecsSinceEpoch();
 
 		inSock = std::unique_ptr<WebSocket>(sock);
 		inWSConnection = InWSConnections{
@@ -444,7 +472,10 @@ public:
 
 		pathBeg = route.pathBeg;
 		channelPrefix = route.prefix;
-		targets = route.targets;
+		if(route.balancer)
+			targets = route.balancer->order(route.targets);
+		else
+			targets = route.targets;
 
 		foreach(const HttpHeader &h, route.headers)
 		{
@@ -483,6 +514,67 @@ public:
 			incCounter(Stats::ClientMessagesSent);
 	}
 
+	// holds a message the client can't take yet. a later message of the
+	// same channel replaces it, or for patches is appended to it, so a slow
+	// client catches up with one message per channel instead of a backlog
+	void holdCoalesced(WebSocket::Frame::Type type, const QByteArray &message, bool patch, const QByteArray &channel)
+	{
+		for(int n = coalescedMessages.count() - 1; n >= 0; --n)
+		{
+			CoalescedMessage &m = coalescedMessages[n];
+			if(m.channel != channel)
+				continue;
+
+			if(m.patch != patch || m.frame.type != type)
+				break;
+
+			QByteArray data;
+			if(!patch)
+				data = message;
+			else if(!WsControl::concatPatches(m.frame.data, message, &data))
+				break;
+
+			// over the limit, drop as an uncoalesced message would be
+			if(coalescedBytes - m.frame.data.size() + data.size() > COALESCE_BYTES_MAX)
+				return;
+
+			coalescedBytes += data.size() - m.frame.data.size();
+			m.frame.data = data;
+			return;
+		}
+
+		if(coalescedBytes + message.size() > COALESCE_BYTES_MAX)
+			return;
+
+		CoalescedMessage m;
+		m.channel = channel;
+		m.frame = WebSocket::Frame(type, message, false);
+		m.patch = patch;
+		coalescedMessages += m;
+
+		coalescedBytes += message.size();
+	}
+
+	void flushCoalesced()
+	{
+		if(coalescedMessages.isEmpty() || !inSock || inSock->state() != WebSocket::Connected)
+			return;
+
+		bool wrote = false;
+
+		while(!coalescedMessages.isEmpty() && inSock->writeBytesAvailable() > 0 && outReadInProgress == -1)
+		{
+			CoalescedMessage m = coalescedMessages.takeFirst();
+			coalescedBytes -= m.frame.data.size();
+
+			writeInFrame(m.frame);
+			wrote = true;
+		}
+
+		if(wrote)
+			adjustKeepAlive();
+	}
+
 	void tryNextTarget()
 	{
 		if(targets.isEmpty())
@@ -500,6 +592,10 @@ public:
 
 		target = targets.takeFirst();
 
+		outstanding.reset();
+		if(target.health)
+			outstanding = std::make_unique<TargetHealth::Outstanding>(target.health);
+
 		QUrl uri = requestData.uri;
 		if(target.ssl)
 			uri.setScheme("wss");
@@ -554,6 +650,9 @@ public:
 				if(target.oneEvent)
 					woh->setMaxEventsPerRequest(1);
 
+				woh->setMaxRequestsInFlight(target.overHttpPipeline);
+				woh->setMaxKeepAlivesInFlight(target.overHttpKeepAliveMax);
+
 				aboutToSendRequestConnection = woh->aboutToSendRequest.connect(boost::bind(&Private::out_aboutToSendRequest, this, woh.get()));
 				outSock = std::move(woh);
 			}
@@ -628,7 +727,13 @@ public:
 	{
 		while(inSock->framesAvailable() > 0 && ((outSock && outSock->writeBytesAvailable() > 0) || detached))
 		{
-			WebSocket::Frame f = inSock->readFrame();
+			// relay the fragments that are already here in one go, as far as
+			//   the server can take them
+			int maxSize = MESSAGE_READ_MAX;
+			if(!detached)
+				maxSize = qMin(outSock->writeBytesAvailable(), maxSize);
+
+			WebSocket::Frame f = inSock->readMessage(maxSize);
 
 			tryLogActivity();
 
@@ -639,7 +744,7 @@ public:
 			if(detached)
 				continue;
 
-			outSock->writeFrame(f);
+			outSock->writeMessage(f);
 
 			incCounter(Stats::ServerContentBytesSent, f.data.size());
 			if(!f.more)
@@ -651,7 +756,17 @@ public:
 	{
 		while(outSock->framesAvailable() > 0 && ((inSock && inSock->writeBytesAvailable() > 0) || detached))
 		{
-			WebSocket::Frame f = outSock->readFrame();
+			int maxSize = MESSAGE_READ_MAX;
+			if(inSock && !detached)
+				maxSize = qMin(inSock->writeBytesAvailable(), maxSize);
+
+			// grip messages must be a single frame, so in that mode the
+			//   first frame of a message is read on its own
+			WebSocket::Frame f;
+			if(outReadInProgress == -1 && wsControl && acceptGripMessages)
+				f = outSock->readFrame();
+			else
+				f = outSock->readMessage(maxSize);
 
 			tryLogActivity();
 
@@ -685,7 +800,9 @@ public:
 					{
 						if(f.data.startsWith(messagePrefix))
 						{
-							f.data = f.data.mid(messagePrefix.size());
+							// in place, as the frame usually holds the only
+							// reference to its data
+							f.data.remove(0, messagePrefix.size());
 							writeInFrame(f);
 
 							adjustKeepAlive();
@@ -724,9 +841,15 @@ public:
 
 			if(outReadInProgress == -1 && !queuedInFrames.isEmpty())
 			{
-				foreach(const QueuedFrame &i, queuedInFrames)
+				while(!queuedInFrames.isEmpty())
+				{
+					QueuedFrame i = queuedInFrames.takeFirst();
 					writeInFrame(i.first, i.second);
+				}
 			}
+
+			if(outReadInProgress == -1)
+				flushCoalesced();
 		}
 	}
 
@@ -741,14 +864,14 @@ public:
 
 	void tryLogActivity()
 	{
-		if(statsManager && !activityTime.isNull())
+		if(statsManager && activityTime >= 0)
 		{
-			QDateTime now = QDateTime::currentDateTimeUtc();
-			if(now >= activityTime.addMSecs(ACTIVITY_TIMEOUT))
+			qint64 now = LoopClock::msecsSinceEpoch();
+			if(now >= activityTime + ACTIVITY_TIMEOUT)
 			{
 				statsManager->addActivity(route.id);
 
-				activityTime = activityTime.addMSecs((activityTime.msecsTo(now) / ACTIVITY_TIMEOUT) * ACTIVITY_TIMEOUT);
+				activityTime += ((now - activityTime) / ACTIVITY_TIMEOUT) * ACTIVITY_TIMEOUT;
 			}
 		}
 	}
@@ -789,18 +912,16 @@ public:
 
 	void setupKeepAlive()
 	{
+		// the scheduler spreads out keep-alives of sessions started
+		// together
 		if(keepAliveTimeout >= 0)
-		{
-			int timeout = keepAliveTimeout * 1000;
-			timeout = qMax(timeout - (int)(QRandomGenerator::global()->generate() % KEEPALIVE_RAND_MAX), 0);
-			keepAliveTimer->start(timeout);
-		}
+			KeepAliveScheduler::instance()->schedule(&keepAlive, keepAliveTimeout * 1000);
 	}
 
 	void adjustKeepAlive()
 	{
 		// if idle mode, restart the timer. else leave alone
-		if(keepAliveTimer && keepAliveMode == WsControl::Idle)
+		if(keepAliveEnabled && keepAliveMode == WsControl::Idle)
 			setupKeepAlive();
 	}
 
@@ -830,6 +951,8 @@ public:
 
 	void in_writeBytesChanged()
 	{
+		flushCoalesced();
+
 		if(!detached && outSock)
 			tryReadOut();
 	}
@@ -848,6 +971,7 @@ public:
 				{
 					outWSConnection = WSConnections();
 					outSock.reset();
+					outstanding.reset();
 
 					inSock->close();
 				}
@@ -879,6 +1003,7 @@ public:
 		{
 			outWSConnection = WSConnections();
 			outSock.reset();
+			outstanding.reset();
 		}
 
 		tryFinish();
@@ -890,6 +1015,9 @@ public:
 
 		state = Connected;
 
+		if(target.health)
+			target.health->recordSuccess();
+
 		HttpHeaders headers = outSock->responseHeaders();
 
 		incCounter(Stats::ServerHeaderBytesReceived, ZhttpManager::estimateResponseHeaderBytes(101, outSock->responseReason(), headers));
@@ -923,7 +1051,7 @@ public:
 			{
 				wsControl = wsControlManager->createSession(publicCid);
 				wsProxyConnectionMap[wsControl] = {
-					wsControl->sendEventReceived.connect(boost::bind(&Private::wsControl_sendEventReceived, this, boost::placeholders::_1, boost::placeholders::_2, boost::placeholders::_3)),
+					wsControl->sendEventReceived.connect(boost::bind(&Private::wsControl_sendEventReceived, this, boost::placeholders::_1, boost::placeholders::_2, boost::placeholders::_3, boost::placeholders::_4, boost::placeholders::_5)),
 					wsControl->keepAliveSetupEventReceived.connect(boost::bind(&Private::wsControl_keepAliveSetupEventReceived, this, boost::placeholders::_1, boost::placeholders::_2)),
 					wsControl->refreshEventReceived.connect(boost::bind(&Private::wsControl_refreshEventReceived, this)),
 					wsControl->closeEventReceived.connect(boost::bind(&Private::wsControl_closeEventReceived, this, boost::placeholders::_1, boost::placeholders::_2)),
@@ -975,6 +1103,7 @@ public:
 		QString reason = outSock->peerCloseReason();
 		outWSConnection = WSConnections();
 		outSock.reset();
+		outstanding.reset();
 
 		if(!detached && inSock && inSock->state() != WebSocket::Closing)
 			inSock->close(code, reason);
@@ -991,6 +1120,7 @@ public:
 		{
 			outWSConnection = WSConnections();
 			outSock.reset();
+			outstanding.reset();
 
 			tryFinish();
 			return;
@@ -1005,9 +1135,14 @@ public:
 				case WebSocket::ErrorConnect:
 				case WebSocket::ErrorConnectTimeout:
 				case WebSocket::ErrorTls:
+					if(target.health)
+						target.health->recordFailure();
 					tryAgain = true;
 					break;
 				case WebSocket::ErrorRejected:
+					// the target responded, so it is reachable
+					if(target.health)
+						target.health->recordSuccess();
 					reject(true, outSock->responseCode(), outSock->responseReason(), outSock->responseHeaders(), outSock->responseBody());
 					break;
 				default:
@@ -1017,6 +1152,7 @@ public:
 
 			outWSConnection = WSConnections();
 			outSock.reset();
+			outstanding.reset();
 
 			if(tryAgain)
 				tryNextTarget();
@@ -1027,6 +1163,7 @@ public:
 
 			outWSConnection = WSConnections();
 			outSock.reset();
+			outstanding.reset();
 
 			tryFinish();
 		}
@@ -1040,7 +1177,7 @@ public:
 	}
 
 private:
-	void wsControl_sendEventReceived(WebSocket::Frame::Type type, const QByteArray &message, bool queue)
+	void wsControl_sendEventReceived(WebSocket::Frame::Type type, const QByteArray &message, bool queue, const QByteArray &coalesce, const QByteArray &channel)
 	{
 		// this method accepts a full message, which must be typed
 		if(type == WebSocket::Frame::Continuation)
@@ -1055,9 +1192,19 @@ private:
 			return;
 		}
 
-		// if queue == false, drop if we can't send right now
-		if(!queue && (inSock->writeBytesAvailable() == 0 || outReadInProgress != -1))
+		bool coalescable = !coalesce.isEmpty() && !channel.isEmpty();
+
+		// if queue == false, drop if we can't send right now. messages that
+		//   can be coalesced are held instead, and stay behind any already
+		//   held
+		if(!queue && (inSock->writeBytesAvailable() == 0 || outReadInProgress != -1 || (coalescable && !coalescedMessages.isEmpty())))
 		{
+			if(coalescable)
+			{
+				holdCoalesced(type, message, coalesce == "patch", channel);
+				flushCoalesced();
+			}
+
 			// if drop is allowed, drop is success :)
 			wsControl->sendEventWritten();
 			return;
@@ -1085,21 +1232,13 @@ private:
 		{
 			keepAliveTimeout = timeout;
 
-			if(!keepAliveTimer)
-			{
-				keepAliveTimer = std::make_unique<Timer>();
-
-				// safe to not track, since timer doesn't outlive this
-				keepAliveTimer->timeout.connect(boost::bind(&Private::keepAliveTimer_timeout, this));
-
-				keepAliveTimer->setSingleShot(true);
-			}
+			keepAliveEnabled = true;
 
 			setupKeepAlive();
 		}
 		else
 		{
-			cleanupKeepAliveTimer();
+			cleanupKeepAlive();
 		}
 	}
 
@@ -1137,6 +1276,7 @@ private:
 		{
 			outWSConnection = WSConnections();
 			outSock.reset();
+			outstanding.reset();
 		}
 
 		cleanupInSock();
@@ -1150,8 +1290,11 @@ private:
 		wsControl_cancelEventReceived();
 	}
 
-	void keepAliveTimer_timeout()
+	void keepAlive_fire()
 	{
+		// nothing to wait for. the handler replies with the message
+		keepAlive.finished();
+
 		wsControl->sendNeedKeepAlive();
 
 		if(keepAliveMode == WsControl::Interval)
@@ -28,9 +28,9 @@
 #include "logutil.h"
 #include "domainmap.h"
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 
 using std::map;
-using Connection = boost::signals2::scoped_connection;
 
 namespace Jwt {
 	class EncodingKey;
@@ -27,10 +27,10 @@
 #include <QHash>
 #include <QStringList>
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 #include "log.h"
 #include "timer.h"
-
-using Connection = boost::signals2::scoped_connection;
+#include "loopclock.h"
 
 static QStringList baseSpecToSpecs(const QString &baseSpec)
 {
@@ -68,16 +68,18 @@ public:
 	class Item
 	{
 	public:
-		QString spec;
+		QString key;
 		std::unique_ptr<ZhttpManager> manager;
 		int refs;
 		bool markedForRemoval;
+		qint64 idleSince; // only meaningful while refs is zero
 
-		Item(const QString &_spec, std::unique_ptr<ZhttpManager> _manager) :
-			spec(_spec),
+		Item(const QString &_key, std::unique_ptr<ZhttpManager> _manager) :
+			key(_key),
 			manager(std::move(_manager)),
 			refs(0),
-			markedForRemoval(false)
+			markedForRemoval(false),
+			idleSince(LoopClock::msecsSinceEpoch())
 		{
 		}
 	};
@@ -87,14 +89,21 @@ public:
 	QStringList defaultOutSpecs;
 	QStringList defaultOutStreamSpecs;
 	QStringList defaultInSpecs;
+	bool lazy;
+	int idleTimeout;
+	QStringList sharedPrefixes;
 	Item *defaultItem;
-	QHash<QString, Item*> itemsBySpec;
+	QHash<QString, QString> keysBySpec; // k=route base spec, v=item key
+	QHash<QString, QList<DomainMap::ZhttpRoute>> routesByKey;
+	QHash<QString, Item*> itemsByKey;
 	QHash<ZhttpManager*, Item*> itemsByManager;
 	std::unique_ptr<Timer> cleanupTimer;
 	Connection cleanupTimerConnection;
 
 	Private(ZRoutes *_q) :
 		q(_q),
+		lazy(false),
+		idleTimeout(0),
 		defaultItem(0)
 	{
 		cleanupTimer = std::make_unique<Timer>();
@@ -105,7 +114,7 @@ public:
 
 	~Private()
 	{
-		qDeleteAll(itemsBySpec);
+		qDeleteAll(itemsByKey);
 		delete defaultItem;
 	}
 
@@ -125,34 +134,152 @@ public:
 		return defaultItem;
 	}
 
-	Item *ensureItem(const DomainMap::ZhttpRoute &route)
+	QString sharedPrefix(const QString &baseSpec) const
 	{
-		Item *i = itemsBySpec.value(route.baseSpec);
+		foreach(const QString &prefix, sharedPrefixes)
+		{
+			if(baseSpec.startsWith(prefix))
+				return prefix;
+		}
+
+		return QString();
+	}
+
+	// routes are all of the same type
+	std::unique_ptr<ZhttpManager> createManager(const QList<DomainMap::ZhttpRoute> &routes)
+	{
+		std::unique_ptr<ZhttpManager> manager = std::make_unique<ZhttpManager>();
+		manager->setInstanceId(instanceId);
+		manager->setIpcFileMode(routes.first().ipcFileMode);
+		manager->setBind(true);
+
+		if(routes.first().req)
+		{
+			QStringList specs;
+			foreach(const DomainMap::ZhttpRoute &route, routes)
+				specs += route.baseSpec;
+
+			manager->setClientReqSpecs(specs);
+		}
+		else
+		{
+			QStringList outSpecs;
+			QStringList outStreamSpecs;
+			QStringList inSpecs;
+			foreach(const DomainMap::ZhttpRoute &route, routes)
+			{
+				QStringList specs = baseSpecToSpecs(route.baseSpec);
+				outSpecs += specs[0];
+				outStreamSpecs += specs[1];
+				inSpecs += specs[2];
+			}
+
+			manager->setClientOutSpecs(outSpecs);
+			manager->setClientOutStreamSpecs(outStreamSpecs);
+			manager->setClientInSpecs(inSpecs);
+		}
+
+		return manager;
+	}
+
+	Item *ensureItem(const QString &key, const DomainMap::ZhttpRoute &route = DomainMap::ZhttpRoute())
+	{
+		Item *i = itemsByKey.value(key);
 		if(!i)
 		{
-			std::unique_ptr<ZhttpManager> manager = std::make_unique<ZhttpManager>();
-			manager->setInstanceId(instanceId);
-			manager->setIpcFileMode(route.ipcFileMode);
-			manager->setBind(true);
+			// a route not known to setup() gets a manager of its own
+			QList<DomainMap::ZhttpRoute> routes = routesByKey.value(key);
+			if(routes.isEmpty())
+				routes += route;
 
-			if(route.req)
+			log_debug("zroutes: adding %s", qPrintable(key));
+
+			i = new Item(key, createManager(routes));
+			itemsByKey.insert(key, i);
+			itemsByManager.insert(i->manager.get(), i);
+		}
+
+		return i;
+	}
+
+	Item *ensureItem(const DomainMap::ZhttpRoute &route)
+	{
+		return ensureItem(keysBySpec.value(route.baseSpec, route.baseSpec), route);
+	}
+
+	void setup(const QList<DomainMap::ZhttpRoute> &routes)
+	{
+		// group routes by shared prefix, keeping the order they were given
+		QStringList groupNames;
+		QHash<QString, QList<DomainMap::ZhttpRoute>> groups;
+		foreach(const DomainMap::ZhttpRoute &route, routes)
+		{
+			QString prefix = sharedPrefix(route.baseSpec);
+
+			QString name;
+			if(!prefix.isEmpty())
+				name = (route.req ? "req " : "") + prefix;
+			else
+				name = route.baseSpec;
+
+			if(!groups.contains(name))
+				groupNames += name;
+
+			groups[name] += route;
+		}
+
+		keysBySpec.clear();
+		routesByKey.clear();
+
+		foreach(const QString &name, groupNames)
+		{
+			const QList<DomainMap::ZhttpRoute> &members = groups[name];
+
+			QString key;
+			if(members.count() == 1 && members.first().baseSpec == name)
 			{
-				manager->setClientReqSpecs(QStringList() << route.baseSpec);
+				key = name;
 			}
 			else
 			{
-				QStringList specs = baseSpecToSpecs(route.baseSpec);
-				manager->setClientOutSpecs(QStringList() << specs[0]);
-				manager->setClientOutStreamSpecs(QStringList() << specs[1]);
-				manager->setClientInSpecs(QStringList() << specs[2]);
+				// the key of a shared manager includes its specs, so that
+				// a change in membership gets a new manager and the old one
+				// is removed once unused
+				QStringList specs;
+				foreach(const DomainMap::ZhttpRoute &route, members)
+					specs += route.baseSpec;
+				specs.sort();
+
+				key = name + " (" + specs.join(' ') + ")";
 			}
 
-			i = new Item(route.baseSpec, std::move(manager));
-			itemsBySpec.insert(route.baseSpec, i);
-			itemsByManager.insert(i->manager.get(), i);
+			foreach(const DomainMap::ZhttpRoute &route, members)
+				keysBySpec.insert(route.baseSpec, key);
+
+			routesByKey.insert(key, members);
 		}
 
-		return i;
+		QList<Item*> toRemove;
+		QHashIterator<QString, Item*> it(itemsByKey);
+		while(it.hasNext())
+		{
+			it.next();
+			Item *i = it.value();
+
+			if(routesByKey.contains(i->key))
+				i->markedForRemoval = false;
+			else
+				toRemove += i;
+		}
+
+		foreach(Item *i, toRemove)
+			tryRemoveItem(i);
+
+		if(!lazy)
+		{
+			foreach(const QString &key, routesByKey.keys())
+				ensureItem(key);
+		}
 	}
 
 	void tryRemoveItem(Item *i)
@@ -165,24 +292,30 @@ public:
 
 	void removeItem(Item *i)
 	{
-		log_debug("zroutes: removing %s", qPrintable(i->spec));
+		log_debug("zroutes: removing %s", qPrintable(i->key));
 
 		assert(i->refs == 0 && i->manager->connectionCount() == 0);
-		itemsBySpec.remove(i->spec);
+		itemsByKey.remove(i->key);
 		itemsByManager.remove(i->manager.get());
 		delete i;
 	}
 
 	void removeUnused()
 	{
+		qint64 now = LoopClock::msecsSinceEpoch();
+
 		QList<Item*> toRemove;
-		QHashIterator<QString, Item*> it(itemsBySpec);
+		QHashIterator<QString, Item*> it(itemsByKey);
 		while(it.hasNext())
 		{
 			it.next();
 			Item *i = it.value();
 
-			if(i->markedForRemoval && i->refs == 0 && i->manager->connectionCount() == 0)
+			if(i->refs > 0 || i->manager->connectionCount() > 0)
+				continue;
+
+			// idle managers are created again on next use
+			if(i->markedForRemoval || (idleTimeout > 0 && now - i->idleSince >= idleTimeout))
 				toRemove += i;
 		}
 
@@ -221,50 +354,26 @@ void ZRoutes::setDefaultInSpecs(const QStringList &specs)
 	d->defaultInSpecs = specs;
 }
 
-void ZRoutes::setup(const QList<DomainMap::ZhttpRoute> &routes)
+void ZRoutes::setLazy(bool enabled)
 {
-	d->ensureDefaultItem();
-
-	QList<DomainMap::ZhttpRoute> toAdd;
-	foreach(const DomainMap::ZhttpRoute &route, routes)
-	{
-		if(!d->itemsBySpec.contains(route.baseSpec))
-			toAdd += route;
-	}
-
-	QStringList toRemove;
-	QHashIterator<QString, Private::Item*> it(d->itemsBySpec);
-	while(it.hasNext())
-	{
-		it.next();
-		const QString &spec = it.key();
+	d->lazy = enabled;
+}
 
-		bool found = false;
-		foreach(const DomainMap::ZhttpRoute &route, routes)
-		{
-			if(route.baseSpec == spec)
-			{
-				found = true;
-				break;
-			}
-		}
-		if(!found)
-			toRemove += spec;
-	}
+void ZRoutes::setIdleTimeout(int msecs)
+{
+	d->idleTimeout = msecs;
+}
 
-	foreach(const QString &spec, toRemove)
-	{
-		Private::Item *i = d->itemsBySpec.value(spec);
-		assert(i);
+void ZRoutes::setSharedPrefixes(const QStringList &prefixes)
+{
+	d->sharedPrefixes = prefixes;
+}
 
-		d->tryRemoveItem(i);
-	}
+void ZRoutes::setup(const QList<DomainMap::ZhttpRoute> &routes)
+{
+	d->ensureDefaultItem();
 
-	foreach(const DomainMap::ZhttpRoute &route, toAdd)
-	{
-		log_debug("zroutes: adding %s", qPrintable(route.baseSpec));
-		d->ensureItem(route);
-	}
+	d->setup(routes);
 }
 
 ZhttpManager *ZRoutes::defaultManager()
@@ -290,4 +399,12 @@ void ZRoutes::removeRef(ZhttpManager *zhttpManager)
 	assert(i);
 	assert(i->refs > 0);
 	--(i->refs);
+
+	if(i->refs == 0)
+		i->idleSince = LoopClock::msecsSinceEpoch();
+}
+
+int ZRoutes::managerCount() const
+{
+	return d->itemsByKey.count();
 }
@@ -38,6 +38,20 @@ public:
 	void setDefaultOutStreamSpecs(const QStringList &specs);
 	void setDefaultInSpecs(const QStringList &specs);
 
+	// if enabled, managers for routes are created on first use rather than
+	// by setup()
+	void setLazy(bool enabled);
+
+	// managers for routes that have gone unused for this long are removed,
+	// and created again if needed. 0 to keep them
+	void setIdleTimeout(int msecs);
+
+	// routes whose base specs begin with one of these prefixes share a
+	// single manager, which spreads requests across all of their specs.
+	// only suitable for routes that are interchangeable, such as several
+	// instances of one backend
+	void setSharedPrefixes(const QStringList &prefixes);
+
 	void setup(const QList<DomainMap::ZhttpRoute> &routes);
 
 	ZhttpManager *defaultManager();
@@ -46,6 +60,9 @@ public:
 	void addRef(ZhttpManager *zhttpManager);
 	void removeRef(ZhttpManager *zhttpManager);
 
+	// number of managers for routes, not including the default
+	int managerCount() const;
+
 private:
 	class Private;
 	Private *d;
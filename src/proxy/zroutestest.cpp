@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2025 Fastly, Inc.
+ *
+ * This file is part of Pushpin.
+ *
+ * $FANOUT_BEGIN_LICENSE:APACHE2$
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * $FANOUT_END_LICENSE$
+ */
+
+#include <QDir>
+#include "test.h"
+#include "log.h"
+#include "eventloop.h"
+#include "defercall.h"
+#include "zhttpmanager.h"
+#include "zroutes.h"
+
+static DomainMap::ZhttpRoute makeRoute(const QDir &workDir, const QString &name, bool req = false)
+{
+	DomainMap::ZhttpRoute r;
+	r.baseSpec = "ipc://" + workDir.filePath("zroutes-test-" + name);
+	r.req = req;
+
+	return r;
+}
+
+static QDir testWorkDir()
+{
+	QDir outDir(qgetenv("OUT_DIR"));
+	return QDir(QDir::current().relativeFilePath(outDir.filePath("test-work")));
+}
+
+static void eager()
+{
+	log_setOutputLevel(LOG_LEVEL_WARNING);
+
+	QDir workDir = testWorkDir();
+	DomainMap::ZhttpRoute a = makeRoute(workDir, "a");
+	DomainMap::ZhttpRoute b = makeRoute(workDir, "b");
+
+	EventLoop loop(100);
+
+	{
+		ZRoutes zroutes;
+		zroutes.setInstanceId("zroutes-test");
+
+		zroutes.setup({a, b});
+		TEST_ASSERT_EQ(zroutes.managerCount(), 2);
+
+		ZhttpManager *ma = zroutes.managerForRoute(a);
+		TEST_ASSERT(ma != zroutes.managerForRoute(b));
+		TEST_ASSERT_EQ(zroutes.managerCount(), 2);
+
+		// in use, so kept until released
+		zroutes.addRef(ma);
+		zroutes.setup({b});
+		TEST_ASSERT_EQ(zroutes.managerCount(), 2);
+		TEST_ASSERT_EQ(zroutes.managerForRoute(a), ma);
+		zroutes.removeRef(ma);
+
+		// unused, so removed right away
+		zroutes.setup({});
+		TEST_ASSERT_EQ(zroutes.managerCount(), 1);
+	}
+
+	DeferCall::cleanup();
+}
+
+static void lazy()
+{
+	QDir workDir = testWorkDir();
+	DomainMap::ZhttpRoute a = makeRoute(workDir, "a");
+	DomainMap::ZhttpRoute b = makeRoute(workDir, "b");
+
+	EventLoop loop(100);
+
+	{
+		ZRoutes zroutes;
+		zroutes.setInstanceId("zroutes-test");
+		zroutes.setLazy(true);
+
+		zroutes.setup({a, b});
+		TEST_ASSERT_EQ(zroutes.managerCount(), 0);
+
+		ZhttpManager *ma = zroutes.managerForRoute(a);
+		TEST_ASSERT(ma);
+		TEST_ASSERT_EQ(zroutes.managerCount(), 1);
+		TEST_ASSERT_EQ(zroutes.managerForRoute(a), ma);
+	}
+
+	DeferCall::cleanup();
+}
+
+static void shared()
+{
+	QDir workDir = testWorkDir();
+	DomainMap::ZhttpRoute a1 = makeRoute(workDir, "shared-1");
+	DomainMap::ZhttpRoute a2 = makeRoute(workDir, "shared-2");
+	DomainMap::ZhttpRoute a3 = makeRoute(workDir, "shared-3");
+	DomainMap::ZhttpRoute r1 = makeRoute(workDir, "shared-req", true);
+	DomainMap::ZhttpRoute b = makeRoute(workDir, "b");
+
+	EventLoop loop(100);
+
+	{
+		ZRoutes zroutes;
+		zroutes.setInstanceId("zroutes-test");
+		zroutes.setSharedPrefixes({"ipc://" + workDir.filePath("zroutes-test-shared")});
+
+		zroutes.setup({a1, a2, r1, b});
+
+		// req routes don't share with the others
+		TEST_ASSERT_EQ(zroutes.managerCount(), 3);
+
+		ZhttpManager *m = zroutes.managerForRoute(a1);
+		TEST_ASSERT_EQ(zroutes.managerForRoute(a2), m);
+		TEST_ASSERT(zroutes.managerForRoute(r1) != m);
+		TEST_ASSERT(zroutes.managerForRoute(b) != m);
+
+		// a new member gets a new manager, and the old one goes away
+		// once unused
+		zroutes.setup({a1, a2, a3, r1, b});
+		TEST_ASSERT_EQ(zroutes.managerCount(), 3);
+
+		ZhttpManager *m2 = zroutes.managerForRoute(a3);
+		TEST_ASSERT_EQ(zroutes.managerForRoute(a1), m2);
+	}
+
+	DeferCall::cleanup();
+}
+
+extern "C" int zroutes_test(ffi::TestException *out_ex)
+{
+	TEST_CATCH(eager());
+	TEST_CATCH(lazy());
+	TEST_CATCH(shared());
+
+	return 0;
+}
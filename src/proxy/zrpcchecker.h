@@ -25,8 +25,7 @@
 #define ZRPCCHECKER_H
 
 #include <boost/signals2.hpp>
-
-using Connection = boost::signals2::scoped_connection;
+#include "fastsignal.h"
 
 class ZrpcRequest;
 
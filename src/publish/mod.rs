@@ -30,6 +30,10 @@ use std::io::{BufRead, Read, Write};
 use std::net;
 use std::str;
 use std::sync::Arc;
+use std::time::{Duration, Instant};
+
+// how long to wait for a subscriber when publishing through a PUB socket
+const SUBSCRIPTION_WAIT: Duration = Duration::from_secs(5);
 
 enum TnValue {
     Null,
@@ -71,14 +75,52 @@ impl TnValue {
         }
     }
 
+    // number of writer ops needed to serialize the value
+    fn op_count(&self) -> usize {
+        match self {
+            Self::Array(a) => 2 + a.iter().map(|v| v.op_count()).sum::<usize>(),
+            Self::Map(m) => 2 + m.values().map(|v| 1 + v.op_count()).sum::<usize>(),
+            _ => 1,
+        }
+    }
+
+    // upper bound on the encoded size, allowing for the length prefix and
+    // type byte of each frame
+    fn size_max(&self) -> usize {
+        const FRAME_OVERHEAD: usize = 22;
+
+        let content = match self {
+            Self::String(s) => s.len(),
+            Self::Array(a) => a.iter().map(|v| v.size_max()).sum(),
+            Self::Map(m) => m
+                .iter()
+                .map(|(k, v)| k.len() + FRAME_OVERHEAD + v.size_max())
+                .sum(),
+            _ => 32,
+        };
+
+        content + FRAME_OVERHEAD
+    }
+
     pub fn serialize(&self) -> Result<Vec<u8>, io::Error> {
-        let mut out = Vec::new();
-        let mut cursor = io::Cursor::new(&mut out[..]);
+        if self.op_count() > tnetstring::OPS_MAX {
+            return Err(io::Error::from(io::ErrorKind::InvalidInput));
+        }
 
-        let mut w = tnetstring::Writer::new(&mut cursor);
-        self.write_to(&mut w)?;
+        let mut out = vec![0; self.size_max()];
 
-        w.flush()?;
+        let size = {
+            let mut cursor = io::Cursor::new(&mut out[..]);
+
+            let mut w = tnetstring::Writer::new(&mut cursor);
+            self.write_to(&mut w)?;
+
+            w.flush()?;
+
+            cursor.position() as usize
+        };
+
+        out.truncate(size);
 
         Ok(out)
     }
@@ -155,6 +197,13 @@ fn tnet_to_json(v: &TnValue) -> Result<serde_json::Value, io::Error> {
 
             for (k, v) in m {
                 if let TnValue::String(s) = v {
+                    // binary keys carry raw bytes in tnetstrings, but JSON
+                    // can only express them as base64
+                    if k.ends_with("-bin") {
+                        out.insert(k.clone(), serde_json::Value::String(base64::encode(s)));
+                        continue;
+                    }
+
                     if (k == "body" || k == "content") && str::from_utf8(s).is_err() {
                         let k = k.to_owned() + "-bin";
                         let v = base64::encode(s);
@@ -310,7 +359,7 @@ impl Write for Stream {
 fn publish_http(
     base_url: &str,
     basic_auth: Option<&str>,
-    item: &serde_json::Value,
+    items: Vec<serde_json::Value>,
 ) -> Result<(), Box<dyn Error>> {
     let parsed_url = match parse_url(base_url) {
         Ok(p) => p,
@@ -319,8 +368,6 @@ fn publish_http(
 
     let path = parsed_url.path + "/publish/";
 
-    let items = vec![item.clone()];
-
     let mut data = serde_json::Map::new();
     data.insert("items".into(), serde_json::Value::Array(items));
 
@@ -420,17 +467,144 @@ fn publish_http(
     Ok(())
 }
 
-fn publish_zmq(spec: &str, item: &TnValue) -> Result<(), Box<dyn Error>> {
-    let message = item.serialize()?;
+// groups items into as few messages as the writer allows. a group of one
+// is sent as a plain item, otherwise as an object with an items list
+fn batch_messages(items: Vec<TnValue>) -> Vec<TnValue> {
+    // outer map, "items" key, and the list start/end
+    const BATCH_OPS: usize = 5;
+
+    let mut groups: Vec<Vec<TnValue>> = Vec::new();
+    let mut ops = 0;
+
+    for item in items {
+        let item_ops = item.op_count();
+
+        if groups.is_empty() || ops + item_ops + BATCH_OPS > tnetstring::OPS_MAX {
+            groups.push(Vec::new());
+            ops = 0;
+        }
+
+        groups.last_mut().unwrap().push(item);
+        ops += item_ops;
+    }
+
+    groups
+        .into_iter()
+        .map(|mut group| {
+            if group.len() == 1 {
+                group.remove(0)
+            } else {
+                let mut batch = HashMap::new();
+                batch.insert("items".into(), TnValue::Array(group));
+
+                TnValue::Map(batch)
+            }
+        })
+        .collect()
+}
+
+fn publish_zmq(spec: &str, items: Vec<TnValue>) -> Result<(), Box<dyn Error>> {
+    let mut messages = Vec::new();
+
+    for m in batch_messages(items) {
+        messages.push(m.serialize()?);
+    }
 
     let context = zmq::Context::new();
     let sock = context.socket(zmq::PUSH)?;
     sock.connect(spec)?;
-    sock.send(message, 0)?;
+
+    for message in messages {
+        sock.send(message, 0)?;
+    }
+
+    Ok(())
+}
+
+// returns the fixed-width topic a channel is published under when the
+// handler uses hashed topics: the 32-bit FNV-1a hash of the channel, as 8
+// lowercase hex digits
+pub fn hashed_topic(channel: &[u8]) -> Vec<u8> {
+    let mut h: u32 = 0x811c9dc5;
+
+    for b in channel {
+        h ^= *b as u32;
+        h = h.wrapping_mul(0x01000193);
+    }
+
+    format!("{:08x}", h).into_bytes()
+}
+
+// a PUB socket drops messages until the subscriptions of its peers have
+// arrived, so this waits for one that covers the topic. peers resend their
+// subscriptions on connect
+fn wait_for_subscription(sock: &zmq::Socket, topic: &[u8]) -> Result<(), Box<dyn Error>> {
+    let end = Instant::now() + SUBSCRIPTION_WAIT;
+
+    loop {
+        let now = Instant::now();
+        if now >= end {
+            return Err("no subscriber for the channel".into());
+        }
+
+        if sock.poll(zmq::POLLIN, (end - now).as_millis() as i64)? == 0 {
+            continue;
+        }
+
+        let msg = sock.recv_bytes(0)?;
+
+        if !msg.is_empty() && msg[0] == 1 && topic.starts_with(&msg[1..]) {
+            return Ok(());
+        }
+    }
+}
+
+fn publish_pub(
+    spec: &str,
+    topic: &PubTopic,
+    channel: &str,
+    items: Vec<TnValue>,
+) -> Result<(), Box<dyn Error>> {
+    let mut messages = Vec::new();
+
+    for m in batch_messages(items) {
+        messages.push(m.serialize()?);
+    }
+
+    let channel = channel.as_bytes();
+
+    let topic_bytes = match topic {
+        PubTopic::Channel => channel.to_vec(),
+        PubTopic::Hashed => hashed_topic(channel),
+    };
+
+    let context = zmq::Context::new();
+
+    // XPUB, to be able to see the subscriptions
+    let sock = context.socket(zmq::XPUB)?;
+    sock.connect(spec)?;
+
+    wait_for_subscription(&sock, &topic_bytes)?;
+
+    for message in messages {
+        match topic {
+            PubTopic::Channel => sock.send_multipart([channel, &message[..]], 0)?,
+            PubTopic::Hashed => {
+                sock.send_multipart([&topic_bytes[..], channel, &message[..]], 0)?
+            }
+        }
+    }
 
     Ok(())
 }
 
+// the first frame of a message sent through a PUB socket, which
+// subscribers filter on. hashed topics are followed by the channel
+pub enum PubTopic {
+    Channel,
+    Hashed,
+}
+
 pub enum Content {
     Value(String),
     Patch(Vec<serde_json::Value>),
@@ -454,17 +628,23 @@ pub struct Config {
     pub id: String,
     pub prev_id: String,
     pub sender: String,
-    pub action: Action,
+    pub actions: Vec<Action>,
     pub headers: Vec<(String, String)>,
     pub meta: Vec<(String, String)>,
     pub no_seq: bool,
+    pub conflate: bool,
+    pub delta: bool,
     pub eol: bool,
+    pub binary: bool,
+
+    // if set, spec is a SUB socket to publish to through a PUB socket
+    pub pub_topic: Option<PubTopic>,
 }
 
-pub fn run(config: &Config) -> Result<(), Box<dyn Error>> {
+fn make_item(config: &Config, action: &Action) -> Result<TnValue, Box<dyn Error>> {
     let mut formats = HashMap::new();
 
-    match &config.action {
+    match action {
         Action::Send(msg) => {
             let mut http_response = HashMap::new();
 
@@ -503,8 +683,16 @@ pub fn run(config: &Config) -> Result<(), Box<dyn Error>> {
                     http_stream.insert("content".into(), TnValue::String(http_content));
                     formats.insert("http-stream".into(), TnValue::Map(http_stream));
 
+                    // content that isn't valid UTF-8 can't go in a text frame.
+                    // over ZeroMQ the bytes are sent as-is, without base64
+                    let ws_key = if config.binary || str::from_utf8(&ws_content).is_err() {
+                        "content-bin"
+                    } else {
+                        "content"
+                    };
+
                     let mut ws_message = HashMap::new();
-                    ws_message.insert("content".into(), TnValue::String(ws_content));
+                    ws_message.insert(ws_key.into(), TnValue::String(ws_content));
                     formats.insert("ws-message".into(), TnValue::Map(ws_message));
                 }
                 Content::Patch(arr) => {
@@ -600,19 +788,175 @@ pub fn run(config: &Config) -> Result<(), Box<dyn Error>> {
         item.insert("no-seq".into(), TnValue::Bool(true));
     }
 
-    let item = TnValue::Map(item);
+    if config.conflate {
+        item.insert("conflate".into(), TnValue::Bool(true));
+    }
+
+    if config.delta {
+        item.insert("delta".into(), TnValue::Bool(true));
+    }
+
+    Ok(TnValue::Map(item))
+}
+
+pub fn run(config: &Config) -> Result<(), Box<dyn Error>> {
+    if config.actions.is_empty() {
+        return Err("nothing to publish".into());
+    }
+
+    if config.actions.len() > 1 && (!config.id.is_empty() || !config.prev_id.is_empty()) {
+        return Err("id and prev-id can't be used with multiple items".into());
+    }
+
+    let mut items = Vec::new();
+
+    for action in config.actions.iter() {
+        items.push(make_item(config, action)?);
+    }
+
+    let count = items.len();
 
     if config.spec.starts_with("https:") || config.spec.starts_with("http:") {
-        let item = tnet_to_json(&item)?;
+        let mut json_items = Vec::new();
+
+        for item in items.iter() {
+            json_items.push(tnet_to_json(item)?);
+        }
 
         let basic_auth = config.basic_auth.as_deref();
 
-        publish_http(&config.spec, basic_auth, &item)?;
+        publish_http(&config.spec, basic_auth, json_items)?;
+    } else if let Some(topic) = &config.pub_topic {
+        publish_pub(&config.spec, topic, &config.channel, items)?;
     } else {
-        publish_zmq(&config.spec, &item)?;
+        publish_zmq(&config.spec, items)?;
     }
 
-    println!("Published");
+    if count > 1 {
+        println!("Published {} items", count);
+    } else {
+        println!("Published");
+    }
 
     Ok(())
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn test_serialize() {
+        let v = TnValue::Array(vec![
+            TnValue::String(b"hello".to_vec()),
+            TnValue::Int(42),
+            TnValue::Null,
+        ]);
+
+        assert_eq!(v.serialize().unwrap(), b"20:5:hello,2:42#0:~]");
+    }
+
+    fn test_config(binary: bool) -> Config {
+        Config {
+            spec: String::new(),
+            basic_auth: None,
+            channel: "test".into(),
+            id: String::new(),
+            prev_id: String::new(),
+            sender: String::new(),
+            actions: Vec::new(),
+            headers: Vec::new(),
+            meta: Vec::new(),
+            no_seq: false,
+            conflate: false,
+            delta: false,
+            eol: true,
+            binary,
+            pub_topic: None,
+        }
+    }
+
+    fn ws_message(item: &TnValue) -> &HashMap<String, TnValue> {
+        let formats = match item {
+            TnValue::Map(m) => match m.get("formats") {
+                Some(TnValue::Map(m)) => m,
+                _ => panic!("expected formats"),
+            },
+            _ => panic!("expected map"),
+        };
+
+        match formats.get("ws-message") {
+            Some(TnValue::Map(m)) => m,
+            _ => panic!("expected ws-message"),
+        }
+    }
+
+    #[test]
+    fn test_binary_content() {
+        let action = Action::Send(Message {
+            code: 200,
+            content: Content::Value("hello".into()),
+        });
+
+        let item = make_item(&test_config(false), &action).unwrap();
+        let ws = ws_message(&item);
+        assert!(matches!(ws.get("content"), Some(TnValue::String(s)) if s == b"hello"));
+        assert!(ws.get("content-bin").is_none());
+
+        // raw bytes in the tnetstring, no base64
+        let item = make_item(&test_config(true), &action).unwrap();
+        let ws = ws_message(&item);
+        assert!(matches!(ws.get("content-bin"), Some(TnValue::String(s)) if s == b"hello"));
+        assert!(ws.get("content").is_none());
+
+        // JSON needs base64
+        let v = tnet_to_json(&item).unwrap();
+        assert_eq!(
+            v["formats"]["ws-message"]["content-bin"],
+            serde_json::Value::String(base64::encode(b"hello"))
+        );
+    }
+
+    #[test]
+    fn test_batch_messages() {
+        let items: Vec<TnValue> = (0..3).map(|i| TnValue::Int(i)).collect();
+
+        let messages = batch_messages(items);
+        assert_eq!(messages.len(), 1);
+
+        let m = match &messages[0] {
+            TnValue::Map(m) => m,
+            _ => panic!("expected map"),
+        };
+
+        match m.get("items") {
+            Some(TnValue::Array(a)) => assert_eq!(a.len(), 3),
+            _ => panic!("expected items list"),
+        }
+
+        // too many ops for one message
+        let items: Vec<TnValue> = (0..tnetstring::OPS_MAX)
+            .map(|i| TnValue::Int(i as isize))
+            .collect();
+
+        let messages = batch_messages(items);
+        assert_eq!(messages.len(), 2);
+
+        for m in messages.iter() {
+            assert!(m.serialize().is_ok());
+        }
+
+        // a single item is sent as-is
+        let messages = batch_messages(vec![TnValue::Int(1)]);
+        assert_eq!(messages.len(), 1);
+        assert!(matches!(messages[0], TnValue::Int(1)));
+    }
+
+    #[test]
+    fn test_hashed_topic() {
+        // FNV-1a test vectors
+        assert_eq!(hashed_topic(b""), b"811c9dc5");
+        assert_eq!(hashed_topic(b"a"), b"e40c292c");
+        assert_eq!(hashed_topic(b"foobar"), b"bf9cf968");
+    }
+}
@@ -105,6 +105,9 @@ ConnmgrService::ConnmgrService(
 
 		args_ += "--zclient-stream=ipc://" + runDir + "/" + ipcPrefix + "connmgr";
 
+		// lets a replacement instance take over the listening sockets
+		args_ += "--handoff-socket=" + runDir + "/" + ipcPrefix + "connmgr-handoff";
+
 		if(usingSsl)
 			args_ += "--tls-identities-dir=" + certsDir;
 	}
@@ -116,6 +119,9 @@ ConnmgrService::ConnmgrService(
 		args_ += "--zserver-stream=ipc://" + runDir + "/" + ipcPrefix + "connmgr-client";
 
 		args_ += "--deny-out-internal";
+
+		// the proxy unpacks combined packets
+		args_ += "--zserver-batch";
 	}
 
 	setName(name);
@@ -30,6 +30,10 @@
 #include <QDir>
 #include <QUrl>
 #include <QUrlQuery>
+#include <QSet>
+#include <QHash>
+#include <QTimer>
+#include <QDateTime>
 #include "processquit.h"
 #include "log.h"
 #include "settings.h"
@@ -42,6 +46,12 @@
 #include "pushpinhandlerservice.h"
 #include "config.h"
 
+// a failed service is restarted after this delay, up to a number of times
+// within the window before the runner gives up and shuts down
+#define RESTART_DELAY 250
+#define RESTART_MAX 5
+#define RESTART_WINDOW 60000
+
 struct ServiceConnections{
 	Connection startedConnection;
 	Connection stoppedConnection;
@@ -265,6 +275,11 @@ public:
 	Connection quitConnection;
 	Connection hupConnection;
 	map<Service*, ServiceConnections> serviceConnectionMap;
+	QStringList restartNames;
+	QSet<Service*> restartable;
+	QHash<Service*, QList<qint64>> restartTimes;
+	QSet<Service*> restartPending;
+	std::unique_ptr<QTimer> restartTimer;
 
 	Private(RunnerApp *_q) :
 		q(_q),
@@ -273,6 +288,10 @@ public:
 	{
 		quitConnection = ProcessQuit::instance()->quit.connect(boost::bind(&Private::processQuit, this));
 		hupConnection = ProcessQuit::instance()->hup.connect(boost::bind(&Private::reload, this));
+
+		restartTimer = std::make_unique<QTimer>();
+		restartTimer->setSingleShot(true);
+		QObject::connect(restartTimer.get(), &QTimer::timeout, [this] { restartTimer_timeout(); });
 	}
 
 	void start()
@@ -403,6 +422,9 @@ public:
 		QStringList serviceNames = settings.value("runner/services").toStringList();
 		trimlist(&serviceNames);
 
+		restartNames = settings.value("runner/restart_services").toStringList();
+		trimlist(&restartNames);
+
 		QStringList httpPortStrs = settings.value("runner/http_port").toStringList();
 		trimlist(&httpPortStrs);
 
@@ -623,7 +645,7 @@ public:
 			if(!serviceNames.contains("zurl") && ConnmgrService::hasClientMode(connmgrBin))
 				useClient = true;
 
-			services += new ConnmgrService("connmgr", connmgrBin, runDir, !args.mergeOutput ? logDir : QString(), ipcPrefix, filePrefix, logLevels.value("connmgr", defaultLevel), certsDir, clientBufferSize, clientMaxConnections, allowCompression, ports, useClient);
+			addService("connmgr", new ConnmgrService("connmgr", connmgrBin, runDir, !args.mergeOutput ? logDir : QString(), ipcPrefix, filePrefix, logLevels.value("connmgr", defaultLevel), certsDir, clientBufferSize, clientMaxConnections, allowCompression, ports, useClient));
 		}
 
 		if(serviceNames.contains("mongrel2"))
@@ -644,7 +666,7 @@ public:
 			}
 
 			foreach(const ListenPort &p, ports)
-				services += new Mongrel2Service(m2Bin, QDir(runDir).filePath(QString("%1mongrel2.sqlite").arg(filePrefix)), "default_" + QString::number(p.port), runDir, !args.mergeOutput ? logDir : QString(), filePrefix, p.port, p.ssl, logLevels.value("mongrel2", defaultLevel));
+				addService("mongrel2", new Mongrel2Service(m2Bin, QDir(runDir).filePath(QString("%1mongrel2.sqlite").arg(filePrefix)), "default_" + QString::number(p.port), runDir, !args.mergeOutput ? logDir : QString(), filePrefix, p.port, p.ssl, logLevels.value("mongrel2", defaultLevel)));
 		}
 
 		if(serviceNames.contains("m2adapter"))
@@ -653,7 +675,7 @@ public:
 			foreach(const ListenPort &p, ports)
 				portsOnly += p.port;
 
-			services += new M2AdapterService(m2aBin, QDir(libDir).filePath("m2adapter.conf.template"), runDir, !args.mergeOutput ? logDir : QString(), ipcPrefix, filePrefix, logLevels.value("m2adapter", defaultLevel), portsOnly);
+			addService("m2adapter", new M2AdapterService(m2aBin, QDir(libDir).filePath("m2adapter.conf.template"), runDir, !args.mergeOutput ? logDir : QString(), ipcPrefix, filePrefix, logLevels.value("m2adapter", defaultLevel), portsOnly));
 		}
 
 		bool quietCheck = false;
@@ -664,17 +686,17 @@ public:
 			if(settings.contains("runner/zurl_bin"))
 				zurlBin = settings.value("runner/zurl_bin").toString();
 
-			services += new ZurlService(zurlBin, QDir(libDir).filePath("zurl.conf.template"), runDir, !args.mergeOutput ? logDir : QString(), ipcPrefix, filePrefix, logLevels.value("zurl", defaultLevel));
+			addService("zurl", new ZurlService(zurlBin, QDir(libDir).filePath("zurl.conf.template"), runDir, !args.mergeOutput ? logDir : QString(), ipcPrefix, filePrefix, logLevels.value("zurl", defaultLevel)));
 
 			// when zurl is managed by pushpin, log updates checks as debug level
 			quietCheck = true;
 		}
 
 		if(serviceNames.contains("proxy"))
-			services += new PushpinProxyService(proxyBin, configFile, runDir, !args.mergeOutput ? logDir : QString(), ipcPrefix, filePrefix, logLevels.value("proxy", defaultLevel), args.routeLines, quietCheck);
+			addService("proxy", new PushpinProxyService(proxyBin, configFile, runDir, !args.mergeOutput ? logDir : QString(), ipcPrefix, filePrefix, logLevels.value("proxy", defaultLevel), args.routeLines, quietCheck));
 
 		if(serviceNames.contains("handler"))
-			services += new PushpinHandlerService(handlerBin, configFile, runDir, !args.mergeOutput ? logDir : QString(), ipcPrefix, filePrefix, portOffset, logLevels.value("handler", defaultLevel));
+			addService("handler", new PushpinHandlerService(handlerBin, configFile, runDir, !args.mergeOutput ? logDir : QString(), ipcPrefix, filePrefix, portOffset, logLevels.value("handler", defaultLevel)));
 
 		foreach(Service *s, services)
 		{
@@ -693,6 +715,14 @@ public:
 	}
 
 private:
+	void addService(const QString &configName, Service *s)
+	{
+		services += s;
+
+		if(restartNames.contains(configName))
+			restartable += s;
+	}
+
 	QString tryInsertPrefix(const QString &line, const QString &prefix)
 	{
 		if(line.startsWith('['))
@@ -717,15 +747,69 @@ private:
 		return line;
 	}
 
+	void removeService(Service *s)
+	{
+		serviceConnectionMap.erase(s);
+		restartable.remove(s);
+		restartTimes.remove(s);
+		restartPending.remove(s);
+
+		services.removeAll(s);
+		delete s;
+	}
+
 	void stopAll()
 	{
 		foreach(Service *s, services)
 		{
+			// waiting to restart, so there's nothing to stop
+			if(restartPending.contains(s))
+			{
+				removeService(s);
+				continue;
+			}
+
 			if(!args.mergeOutput || s->alwaysLogStatus())
 				log_info("stopping %s", qPrintable(s->name()));
 
 			s->stop();
 		}
+
+		checkStopped();
+	}
+
+	// returns false if the service has failed too often to try again
+	bool scheduleRestart(Service *s)
+	{
+		qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+		QList<qint64> &times = restartTimes[s];
+		while(!times.isEmpty() && now - times.first() >= RESTART_WINDOW)
+			times.removeFirst();
+
+		if(times.count() >= RESTART_MAX)
+			return false;
+
+		times += now;
+		restartPending += s;
+
+		if(!restartTimer->isActive())
+			restartTimer->start(RESTART_DELAY);
+
+		return true;
+	}
+
+	void restartTimer_timeout()
+	{
+		QSet<Service*> toStart = restartPending;
+		restartPending.clear();
+
+		foreach(Service *s, toStart)
+		{
+			log_info("restarting %s", qPrintable(s->name()));
+
+			s->start();
+		}
 	}
 
 	void checkStopped()
@@ -760,10 +844,7 @@ private:
 
 	void service_stopped(Service *s)
 	{
-		serviceConnectionMap.erase(s);
-
-		services.removeAll(s);
-		delete s;
+		removeService(s);
 
 		checkStopped();
 	}
@@ -780,10 +861,15 @@ private:
 	{
 		log_error("%s: %s", qPrintable(s->name()), qPrintable(error));
 
-		serviceConnectionMap.erase(s);
+		if(!stopping && restartable.contains(s))
+		{
+			if(scheduleRestart(s))
+				return;
 
-		services.removeAll(s);
-		delete s;
+			log_error("%s: failed %d times within %d seconds, giving up", qPrintable(s->name()), RESTART_MAX + 1, RESTART_WINDOW / 1000);
+		}
+
+		removeService(s);
 
 		errored = true;
 
@@ -826,6 +912,7 @@ private:
 		}
 		else
 		{
+			restartPending.clear();
 			qDeleteAll(services);
 
 			ProcessQuit::cleanup();
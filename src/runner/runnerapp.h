@@ -24,11 +24,11 @@
 #define RUNNERAPP_H
 
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 #include <map>
 
 using std::map;
 using SignalInt = boost::signals2::signal<void(int)>;
-using Connection = boost::signals2::scoped_connection;
 
 class RunnerApp
 {
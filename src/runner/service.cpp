@@ -28,6 +28,7 @@
 #include <QTimer>
 #include <QFile>
 #include <QProcess>
+#include <QElapsedTimer>
 #include "log.h"
 
 #define STOP_TIMEOUT 4000
@@ -88,6 +89,8 @@ public:
 	bool terminateAfterStarted;
 	bool sentKill;
 	QTimer *timer;
+	QElapsedTimer startTime;
+	bool readyLogged;
 
 	Private(Service *_q) :
 		QObject(_q),
@@ -95,7 +98,8 @@ public:
 		state(NotStarted),
 		proc(0),
 		terminateAfterStarted(false),
-		sentKill(false)
+		sentKill(false),
+		readyLogged(false)
 	{
 		timer = new QTimer(this);
 		connect(timer, &QTimer::timeout, this, &Private::timer_timeout);
@@ -147,6 +151,13 @@ public:
 
 	void start()
 	{
+		// may be a restart
+		terminateAfterStarted = false;
+		sentKill = false;
+		readyLogged = false;
+
+		startTime.start();
+
 		proc = new ServiceProcess(this);
 
 		connect(proc, &QProcess::started, this, &Private::proc_started);
@@ -215,6 +226,8 @@ private slots:
 				log_error("failed to write pid file: %s", qPrintable(pidFile));
 		}
 
+		log_info("%s launched in %d ms", qPrintable(name), (int)startTime.elapsed());
+
 		state = Started;
 		q->started();
 
@@ -230,7 +243,17 @@ private slots:
 			if(!line.isEmpty() && line[line.length() - 1] == '\n')
 				line.truncate(line.length() - 1);
 
-			q->logLine(QString::fromLocal8Bit(line));
+			QString str = QString::fromLocal8Bit(line);
+
+			// services log this once initialized. only seen if the
+			//   service's output isn't going to its own file
+			if(!readyLogged && str.endsWith(" started"))
+			{
+				readyLogged = true;
+				log_info("%s ready in %d ms", qPrintable(name), (int)startTime.elapsed());
+			}
+
+			q->logLine(str);
 		}
 	}
 
@@ -26,10 +26,10 @@
 #include <QObject>
 #include <QStringList>
 #include <boost/signals2.hpp>
+#include "fastsignal.h"
 
 using Signal = boost::signals2::signal<void()>;
 using SignalStr = boost::signals2::signal<void(const QString&)>;
-using Connection = boost::signals2::scoped_connection;
 
 class Service : public QObject
 {
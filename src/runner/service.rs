@@ -253,6 +253,7 @@ impl ConnmgrService {
             settings.ipc_prefix
         ));
         args.push("--deny-out-internal".to_string());
+        args.push("--zserver-batch".to_string());
 
         if !settings.ports.is_empty() {
             //server mode
@@ -291,6 +292,13 @@ impl ConnmgrService {
                 settings.ipc_prefix
             ));
 
+            // lets a replacement instance take over the listening sockets
+            args.push(format!(
+                "--handoff-socket={}/{}connmgr-handoff",
+                settings.run_dir.display(),
+                settings.ipc_prefix
+            ));
+
             if using_ssl {
                 args.push(format!(
                     "--tls-identities-dir={}",
@@ -48,6 +48,11 @@ resp = tnetstring.loads(sock.recv())
 
 if resp[b"success"]:
     value = resp[b"value"]
+    if len(sys.argv) > 4 and isinstance(value, dict) and b"data" in value:
+        # write bulk output such as trace dumps to a file
+        with open(sys.argv[4], "wb") as f:
+            f.write(value[b"data"])
+        del value[b"data"]
     print("success: {}".format(repr(value)))
 else:
     condition = resp[b"condition"].decode("utf-8")
@@ -108,6 +108,10 @@ while True:
                 ret.append(i)
         elif method == "session-create-or-update":
             session_create_or_update(args["sid"], args["last-ids"])
+        elif method == "session-create-or-update-many":
+            sid_last_ids = args["sid-last-ids"]
+            for sid, last_ids in sid_last_ids.iteritems():
+                session_create_or_update(sid, last_ids)
         elif method == "session-update-many":
             sid_last_ids = args["sid-last-ids"]
             for sid, last_ids in sid_last_ids.iteritems():
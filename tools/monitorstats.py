@@ -1,5 +1,7 @@
 import sys
 import json
+import socket
+import struct
 import tnetstring
 import zmq
 
@@ -21,6 +23,76 @@ def ensure_str(i):
         return i
 
 
+class BinaryReader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def take(self, n):
+        if self.pos + n > len(self.data):
+            raise ValueError("truncated packet")
+        out = self.data[self.pos : self.pos + n]
+        self.pos += n
+        return out
+
+    def u8(self):
+        return self.take(1)[0]
+
+    def i32(self):
+        return struct.unpack(">i", self.take(4))[0]
+
+    def string(self):
+        n = struct.unpack(">H", self.take(2))[0]
+        if n == 0xFFFF:
+            return None
+        return self.take(n).decode("utf-8")
+
+
+# decodes the compact binary encoding of conn and message packets (version 1)
+def decode_binary(mtype, data):
+    r = BinaryReader(data)
+    version = r.u8()
+    if version != 1:
+        raise ValueError("unsupported binary version {}".format(version))
+    m = {}
+    frm = r.string()
+    if frm:
+        m["from"] = frm
+    route = r.string()
+    if route:
+        m["route"] = route
+    if mtype == "message":
+        m["channel"] = r.string()
+        item_id = r.string()
+        if item_id is not None:
+            m["item-id"] = item_id
+        m["transport"] = r.string()
+        m["count"] = r.i32()
+        blocks = r.i32()
+        if blocks >= 0:
+            m["blocks"] = blocks
+    elif mtype == "conn":
+        m["id"] = r.string()
+        flags = r.u8()
+        ttl = r.i32()
+        addr_len = r.u8()
+        addr = r.take(addr_len)
+        if flags & 0x01:
+            m["unavailable"] = True
+        else:
+            m["type"] = "ws" if flags & 0x02 else "http"
+            if addr_len == 4:
+                m["peer-address"] = socket.inet_ntop(socket.AF_INET, addr)
+            elif addr_len == 16:
+                m["peer-address"] = socket.inet_ntop(socket.AF_INET6, addr)
+            if flags & 0x04:
+                m["ssl"] = True
+            m["ttl"] = ttl
+    else:
+        raise ValueError("no binary layout for {}".format(mtype))
+    return m
+
+
 ctx = zmq.Context()
 sock = ctx.socket(zmq.SUB)
 sock.connect(sys.argv[1])
@@ -40,6 +112,8 @@ while True:
         m = ensure_str(tnetstring.loads(mdata[1:]))
     elif mdata[0] == ord(b"J"):
         m = json.loads(mdata[1:])
+    elif mdata[0] == ord(b"B"):
+        m = decode_binary(mtype, mdata[1:])
     else:
         m = mdata
     print("{} {}".format(mtype, m))
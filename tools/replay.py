@@ -0,0 +1,254 @@
+# this program replays traffic recorded with the capture_file option of
+# pushpin-proxy or pushpin-handler, keeping the recorded spacing between
+# packets (scaled by --speed). it reports the send rate and, for zhttp
+# requests, the time from a request's first packet to its first response.
+#
+# zhttp packets are sent as if from a connection manager with a new
+# instance id. request ids are suffixed per run so that replays don't clash
+# with each other or with live traffic.
+#
+# usage: replay.py --push SPEC [--router SPEC] [--sub SPEC] [--speed N] FILE
+#
+# e.g. for a proxy: --push ipc:///var/run/pushpin/pushpin-zhttp-in
+#   --router ipc:///var/run/pushpin/pushpin-zhttp-in-stream
+#   --sub ipc:///var/run/pushpin/pushpin-zhttp-out
+# for a handler: --push ipc:///var/run/pushpin/pushpin-publish
+
+import argparse
+import os
+import struct
+import time
+import tnetstring
+import zmq
+
+FILE_HEADER = b"PPCAP001"
+
+ZHTTP_CLIENT_IN = 1
+ZHTTP_SERVER_IN = 2
+ZHTTP_SERVER_IN_STREAM = 3
+PUBLISH_PULL = 4
+PUBLISH_SUB = 5
+
+
+# yields (usecs, source, parts)
+def read_records(f):
+    if f.read(len(FILE_HEADER)) != FILE_HEADER:
+        raise ValueError("not a capture file")
+
+    while True:
+        head = f.read(10)
+        if len(head) < 10:
+            break
+
+        usecs, source, count = struct.unpack(">QBB", head)
+
+        parts = []
+        for _ in range(count):
+            size_data = f.read(4)
+            if len(size_data) < 4:
+                return
+            size = struct.unpack(">I", size_data)[0]
+            data = f.read(size)
+            if len(data) < size:
+                return
+            parts.append(data)
+
+        yield usecs, source, parts
+
+
+def rewrite_ids(v, suffix):
+    if isinstance(v, bytes):
+        return v + suffix
+    return [dict(i, **{b"id": i[b"id"] + suffix}) for i in v]
+
+
+def packet_ids(p):
+    v = p.get(b"id")
+    if v is None:
+        return []
+    if isinstance(v, bytes):
+        return [v]
+    return [i[b"id"] for i in v]
+
+
+def percentile(values, p):
+    return values[min(int(len(values) * p), len(values) - 1)]
+
+
+parser = argparse.ArgumentParser(description="Capture replay harness.")
+parser.add_argument("file", help="capture file")
+parser.add_argument("--push", required=True, help="zhttp in or publish spec")
+parser.add_argument("--router", help="zhttp in stream spec")
+parser.add_argument("--sub", help="zhttp out spec, to measure latency")
+parser.add_argument("--pub", help="spec to bind for replaying sub publishes")
+parser.add_argument(
+    "--speed", type=float, default=1.0, help="time scale, or 0 for no delays"
+)
+parser.add_argument(
+    "--wait", type=float, default=2.0, help="seconds to wait for responses"
+)
+args = parser.parse_args()
+
+instance = "replay-{}".format(os.getpid()).encode("utf-8")
+suffix = "-{}".format(int(time.time())).encode("utf-8")
+
+ctx = zmq.Context()
+
+push_sock = ctx.socket(zmq.PUSH)
+push_sock.connect(args.push)
+
+router_sock = None
+if args.router:
+    router_sock = ctx.socket(zmq.DEALER)
+    router_sock.setsockopt(zmq.IDENTITY, instance)
+    router_sock.connect(args.router)
+
+sub_sock = None
+if args.sub:
+    sub_sock = ctx.socket(zmq.SUB)
+    sub_sock.setsockopt(zmq.SUBSCRIBE, instance + b" ")
+    sub_sock.connect(args.sub)
+
+pub_sock = None
+if args.pub:
+    pub_sock = ctx.socket(zmq.PUB)
+    pub_sock.bind(args.pub)
+
+poller = zmq.Poller()
+if router_sock:
+    poller.register(router_sock, zmq.POLLIN)
+if sub_sock:
+    poller.register(sub_sock, zmq.POLLIN)
+
+# let the subscriptions and connections settle
+time.sleep(0.5)
+
+started = {}  # k=id, v=time of first packet sent, until a response
+seen = set()
+latencies = []
+responses = 0
+
+
+def handle_response(data):
+    global responses
+
+    if not data.startswith(b"T"):
+        return
+
+    p = tnetstring.loads(data[1:])
+    responses += 1
+
+    now = time.monotonic()
+    for id in packet_ids(p):
+        t = started.pop(id, None)
+        if t is not None:
+            latencies.append(now - t)
+
+
+def receive(timeout):
+    for sock, _ in poller.poll(timeout * 1000):
+        while True:
+            try:
+                parts = sock.recv_multipart(zmq.NOBLOCK)
+            except zmq.Again:
+                break
+
+            if sock is sub_sock:
+                at = parts[0].find(b" ")
+                handle_response(parts[0][at + 1 :])
+            else:
+                handle_response(parts[-1])
+
+
+def send(source, parts):
+    if source == ZHTTP_SERVER_IN or source == ZHTTP_SERVER_IN_STREAM:
+        data = parts[-1]
+        if not data.startswith(b"T"):
+            return False
+
+        if source == ZHTTP_SERVER_IN_STREAM and not router_sock:
+            return False
+
+        p = tnetstring.loads(data[1:])
+        p[b"from"] = instance
+        if b"id" in p:
+            p[b"id"] = rewrite_ids(p[b"id"], suffix)
+
+        now = time.monotonic()
+        for id in packet_ids(p):
+            if id not in seen:
+                seen.add(id)
+                started[id] = now
+
+        data = b"T" + tnetstring.dumps(p)
+
+        if source == ZHTTP_SERVER_IN:
+            push_sock.send(data)
+        else:
+            router_sock.send_multipart([b"", data])
+    elif source == PUBLISH_PULL:
+        push_sock.send_multipart(parts)
+    elif source == PUBLISH_SUB:
+        if not pub_sock:
+            return False
+        pub_sock.send_multipart(parts)
+    else:
+        return False
+
+    return True
+
+
+sent = 0
+skipped = 0
+first_usecs = None
+start = time.monotonic()
+
+with open(args.file, "rb") as f:
+    for usecs, source, parts in read_records(f):
+        if first_usecs is None:
+            first_usecs = usecs
+
+        if args.speed > 0:
+            due = start + (usecs - first_usecs) / 1000000.0 / args.speed
+            while True:
+                now = time.monotonic()
+                if now >= due:
+                    break
+                receive(due - now)
+        else:
+            receive(0)
+
+        if send(source, parts):
+            sent += 1
+        else:
+            skipped += 1
+
+elapsed = time.monotonic() - start
+
+end = time.monotonic() + args.wait
+while started and time.monotonic() < end:
+    receive(end - time.monotonic())
+
+print(
+    "sent {} packets in {:.2f}s ({:.0f}/s), {} skipped".format(
+        sent, elapsed, sent / elapsed if elapsed > 0 else 0, skipped
+    )
+)
+
+if sub_sock or router_sock:
+    print(
+        "received {} responses, {} requests without a response".format(
+            responses, len(started)
+        )
+    )
+
+if latencies:
+    latencies.sort()
+    print(
+        "first response latency (ms): p50={:.2f} p90={:.2f} p99={:.2f} max={:.2f}".format(
+            percentile(latencies, 0.5) * 1000,
+            percentile(latencies, 0.9) * 1000,
+            percentile(latencies, 0.99) * 1000,
+            latencies[-1] * 1000,
+        )
+    )
@@ -0,0 +1,187 @@
+# this program opens many idle websocket connections and reports how much
+# memory a process (e.g. pushpin-connmgr) uses per connection. if a duration
+# is given, it then counts the messages received on all connections, for
+# measuring broadcast delivery rate while publishing to them.
+#
+# usage: wsload.py [--pid PID] [--duration SECS] URL COUNT
+
+import argparse
+import base64
+import os
+import resource
+import selectors
+import socket
+import struct
+import sys
+import time
+from urllib.parse import urlparse
+
+
+def rss_bytes(pid):
+    with open("/proc/{}/status".format(pid)) as f:
+        for line in f:
+            if line.startswith("VmRSS:"):
+                return int(line.split()[1]) * 1024
+    raise ValueError("no VmRSS for pid {}".format(pid))
+
+
+def connect(host, port, path):
+    sock = socket.create_connection((host, port))
+
+    key = base64.b64encode(os.urandom(16)).decode("utf-8")
+    req = (
+        "GET {} HTTP/1.1\r\n"
+        "Host: {}:{}\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Version: 13\r\n"
+        "Sec-WebSocket-Key: {}\r\n"
+        "\r\n"
+    ).format(path, host, port, key)
+    sock.sendall(req.encode("utf-8"))
+
+    buf = b""
+    while b"\r\n\r\n" not in buf:
+        chunk = sock.recv(4096)
+        if not chunk:
+            raise ValueError("connection closed during handshake")
+        buf += chunk
+
+    head, rest = buf.split(b"\r\n\r\n", 1)
+    status = head.split(b"\r\n", 1)[0]
+    if b" 101 " not in status:
+        raise ValueError("unexpected response: {}".format(status.decode("utf-8")))
+
+    sock.setblocking(False)
+
+    return sock, rest
+
+
+# returns (messages, remaining buffer)
+def parse_frames(buf):
+    count = 0
+
+    while len(buf) >= 2:
+        b0, b1 = buf[0], buf[1]
+        size = b1 & 0x7F
+        pos = 2
+
+        if size == 126:
+            if len(buf) < 4:
+                break
+            size = struct.unpack(">H", buf[2:4])[0]
+            pos = 4
+        elif size == 127:
+            if len(buf) < 10:
+                break
+            size = struct.unpack(">Q", buf[2:10])[0]
+            pos = 10
+
+        if b1 & 0x80:
+            pos += 4
+
+        if len(buf) < pos + size:
+            break
+
+        # count data frames that end a message
+        if b0 & 0x80 and (b0 & 0x0F) in (0x00, 0x01, 0x02):
+            count += 1
+
+        buf = buf[pos + size :]
+
+    return count, buf
+
+
+parser = argparse.ArgumentParser(description="Websocket load harness.")
+parser.add_argument("url", help="websocket URL, e.g. ws://localhost:7999/ws")
+parser.add_argument("count", type=int, help="number of connections")
+parser.add_argument("--pid", type=int, help="process to measure RSS of")
+parser.add_argument(
+    "--duration", type=float, default=0, help="seconds to count messages for"
+)
+args = parser.parse_args()
+
+url = urlparse(args.url)
+if url.scheme != "ws":
+    print("only ws:// URLs are supported")
+    sys.exit(1)
+
+host = url.hostname
+port = url.port or 80
+path = url.path or "/"
+if url.query:
+    path += "?" + url.query
+
+# each connection needs a descriptor
+soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+if soft < args.count + 16:
+    resource.setrlimit(resource.RLIMIT_NOFILE, (hard, hard))
+
+rss_before = rss_bytes(args.pid) if args.pid else None
+
+sel = selectors.DefaultSelector()
+bufs = {}
+
+start = time.monotonic()
+
+for n in range(args.count):
+    sock, rest = connect(host, port, path)
+    sel.register(sock, selectors.EVENT_READ)
+    bufs[sock] = rest
+
+    if (n + 1) % 1000 == 0:
+        print("connected {}".format(n + 1))
+
+elapsed = time.monotonic() - start
+print(
+    "connected {} in {:.2f}s ({:.0f}/s)".format(
+        args.count, elapsed, args.count / elapsed if elapsed > 0 else 0
+    )
+)
+
+if rss_before is not None:
+    # let the server settle before measuring
+    time.sleep(1)
+
+    rss_after = rss_bytes(args.pid)
+    print(
+        "rss: {} -> {} bytes, {} bytes per connection".format(
+            rss_before, rss_after, (rss_after - rss_before) // max(args.count, 1)
+        )
+    )
+
+if args.duration > 0:
+    received = 0
+    closed = 0
+
+    start = time.monotonic()
+    end = start + args.duration
+
+    while True:
+        now = time.monotonic()
+        if now >= end:
+            break
+
+        for key, _ in sel.select(end - now):
+            sock = key.fileobj
+
+            try:
+                data = sock.recv(65536)
+            except BlockingIOError:
+                continue
+
+            if not data:
+                sel.unregister(sock)
+                sock.close()
+                del bufs[sock]
+                closed += 1
+                continue
+
+            count, bufs[sock] = parse_frames(bufs[sock] + data)
+            received += count
+
+    print(
+        "received {} messages in {:.2f}s ({:.0f}/s), {} connections closed".format(
+            received, args.duration, received / args.duration, closed
+        )
+    )